@@ -107,6 +107,8 @@ int		manageDIT = 0;
 int		manageDSAit = 0;
 int		noop = 0;
 int		ppolicy = 0;
+static char	*traceparent = NULL;
+static int	tracecrit = 0;
 int		preread = 0;
 static char	*preread_attrs = NULL;
 int		postread = 0;
@@ -153,6 +155,9 @@ static int print_deref( LDAP *ld, LDAPControl *ctrl );
 #ifdef LDAP_CONTROL_X_WHATFAILED
 static int print_whatfailed( LDAP *ld, LDAPControl *ctrl );
 #endif
+#ifdef LDAP_CONTROL_X_EXPLAIN
+static int print_explain( LDAP *ld, LDAPControl *ctrl );
+#endif
 static int print_syncstate( LDAP *ld, LDAPControl *ctrl );
 static int print_syncdone( LDAP *ld, LDAPControl *ctrl );
 
@@ -178,6 +183,9 @@ static struct tool_ctrls_t {
 #endif
 #ifdef LDAP_CONTROL_X_WHATFAILED
 	{ LDAP_CONTROL_X_WHATFAILED,			TOOL_ALL,	print_whatfailed },
+#endif
+#ifdef LDAP_CONTROL_X_EXPLAIN
+	{ LDAP_CONTROL_X_EXPLAIN,			TOOL_SEARCH,	print_explain },
 #endif
 	{ LDAP_CONTROL_SYNC_STATE,			TOOL_SEARCH,	print_syncstate },
 	{ LDAP_CONTROL_SYNC_DONE,			TOOL_SEARCH,	print_syncdone },
@@ -335,6 +343,11 @@ tool_destroy( void )
 		sessionTrackingName = NULL;
 	}
 #endif /* LDAP_CONTROL_X_SESSION_TRACKING */
+
+	if ( traceparent ) {
+		ber_memfree( traceparent );
+		traceparent = NULL;
+	}
 }
 
 void
@@ -369,6 +382,7 @@ N_("             [!]relax\n")
 #ifdef LDAP_CONTROL_X_SESSION_TRACKING
 N_("             [!]sessiontracking[=<username>]\n")
 #endif /* LDAP_CONTROL_X_SESSION_TRACKING */
+N_("             [!]trace=<traceparent> (W3C trace context)\n")
 N_("             abandon, cancel, ignore (SIGINT sends abandon/cancel,\n"
    "             or ignores response; if critical, doesn't wait for SIGINT.\n"
    "             not really controls)\n")
@@ -606,6 +620,19 @@ tool_args( int argc, char **argv )
 
 				noop = 1 + crit;
 
+			} else if ( strcasecmp( control, "trace" ) == 0 ) {
+				if( traceparent ) {
+					fprintf( stderr, "trace control previously specified\n");
+					exit( EXIT_FAILURE );
+				}
+				if( cvalue == NULL ) {
+					fprintf( stderr, "trace: control value expected\n" );
+					usage();
+				}
+
+				traceparent = ber_strdup( cvalue );
+				tracecrit = crit;
+
 #ifdef LDAP_CONTROL_PASSWORDPOLICYREQUEST
 			} else if ( strcasecmp( control, "ppolicy" ) == 0 ) {
 				if( ppolicy ) {
@@ -1191,7 +1218,7 @@ tool_args( int argc, char **argv )
 #ifdef LDAP_CONTROL_X_SESSION_TRACKING
 			sessionTracking ||
 #endif /* LDAP_CONTROL_X_SESSION_TRACKING */
-			noop || ppolicy || preread || postread )
+			noop || ppolicy || preread || postread || traceparent )
 		{
 			fprintf( stderr, "%s: -e/-M incompatible with LDAPv2\n", prog );
 			exit( EXIT_FAILURE );
@@ -1740,6 +1767,7 @@ tool_server_controls( LDAP *ld, LDAPControl *extra_c, int count )
 		|| manageDIT
 		|| manageDSAit
 		|| noop
+		|| traceparent
 #ifdef LDAP_CONTROL_PASSWORDPOLICYREQUEST
 		|| ppolicy
 #endif
@@ -1838,6 +1866,14 @@ tool_server_controls( LDAP *ld, LDAPControl *extra_c, int count )
 		i++;
 	}
 
+	if ( traceparent ) {
+		c[i].ldctl_oid = LDAP_CONTROL_X_TRACE;
+		ber_str2bv( traceparent, 0, 0, &c[i].ldctl_value );
+		c[i].ldctl_iscritical = tracecrit;
+		ctrls[i] = &c[i];
+		i++;
+	}
+
 #ifdef LDAP_CONTROL_PASSWORDPOLICYREQUEST
 	if ( ppolicy ) {
 		c[i].ldctl_oid = LDAP_CONTROL_PASSWORDPOLICYREQUEST;
@@ -2339,6 +2375,40 @@ print_whatfailed( LDAP *ld, LDAPControl *ctrl )
 }
 #endif
 
+#ifdef LDAP_CONTROL_X_EXPLAIN
+static int
+print_explain( LDAP *ld, LDAPControl *ctrl )
+{
+	BerElement *ber;
+	ber_tag_t tag;
+	ber_len_t siz;
+	BerVarray bva = NULL;
+
+	ber = ber_init( &ctrl->ldctl_value );
+	if ( ber == NULL ) {
+		return LDAP_NO_MEMORY;
+	}
+
+	siz = sizeof(struct berval);
+	tag = ber_scanf( ber, "{M}", &bva, &siz, 0 );
+	if ( tag != LBER_ERROR ) {
+		int i;
+
+		tool_write_ldif( LDIF_PUT_COMMENT, " explain:", NULL, 0 );
+
+		for ( i = 0; bva[i].bv_val != NULL; i++ ) {
+			tool_write_ldif( LDIF_PUT_COMMENT, NULL, bva[i].bv_val, bva[i].bv_len );
+		}
+
+		ldap_memfree( bva );
+	}
+
+	ber_free( ber, 1 );
+
+	return 0;
+}
+#endif
+
 static int
 print_syncstate( LDAP *ld, LDAPControl *ctrl )
 {
@@ -44,6 +44,8 @@ usage( void )
 	fprintf( stderr, _("Issue LDAP extended operations\n\n"));
 	fprintf( stderr, _("usage: %s [options] <oid|oid:data|oid::b64data>\n"), prog);
 	fprintf( stderr, _("       %s [options] whoami\n"), prog);
+	fprintf( stderr, _("       %s [options] metrics\n"), prog);
+	fprintf( stderr, _("       %s [options] snapshot <suffix> > data.mdb\n"), prog);
 	fprintf( stderr, _("       %s [options] cancel <id>\n"), prog);
 	fprintf( stderr, _("       %s [options] refresh <DN> [<ttl>]\n"), prog);
 	tool_common_usage();
@@ -106,6 +108,35 @@ main( int argc, char *argv[] )
 			goto skip;
 		}
 
+	} else if ( strcasecmp( argv[ 0 ], "metrics" ) == 0 ) {
+		tool_server_controls( ld, NULL, 0 );
+
+		rc = ldap_extended_operation( ld, LDAP_EXOP_X_METRICS,
+			NULL, NULL, NULL, &id );
+		if ( rc != LDAP_SUCCESS ) {
+			tool_perror( "ldap_extended_operation", rc, NULL, NULL, NULL, NULL );
+			rc = EXIT_FAILURE;
+			goto skip;
+		}
+
+	} else if ( strcasecmp( argv[ 0 ], "snapshot" ) == 0 ) {
+		struct berval	suffix;
+
+		if ( argc != 2 ) {
+			usage();
+		}
+
+		tool_server_controls( ld, NULL, 0 );
+
+		ber_str2bv( argv[ 1 ], 0, 0, &suffix );
+		rc = ldap_extended_operation( ld, LDAP_EXOP_X_MDB_SNAPSHOT,
+			&suffix, NULL, NULL, &id );
+		if ( rc != LDAP_SUCCESS ) {
+			tool_perror( "ldap_extended_operation", rc, NULL, NULL, NULL, NULL );
+			rc = EXIT_FAILURE;
+			goto skip;
+		}
+
 	} else if ( strcasecmp( argv[ 0 ], "cancel" ) == 0 ) {
 		int		cancelid;
 
@@ -219,13 +250,37 @@ main( int argc, char *argv[] )
 		tv.tv_sec = 0;
 		tv.tv_usec = 100000;
 
-		rc = ldap_result( ld, LDAP_RES_ANY, LDAP_MSG_ALL, &tv, &res );
+		/* the snapshot arrives in intermediate responses,
+		 * write each out instead of collecting them all */
+		rc = ldap_result( ld, LDAP_RES_ANY, LDAP_MSG_ONE, &tv, &res );
 		if ( rc < 0 ) {
 			tool_perror( "ldap_result", rc, NULL, NULL, NULL, NULL );
 			rc = EXIT_FAILURE;
 			goto skip;
 		}
 
+		if ( rc == LDAP_RES_INTERMEDIATE ) {
+			struct berval	*retdata = NULL;
+
+			rc = ldap_parse_intermediate( ld, res, NULL, &retdata, NULL, 1 );
+			res = NULL;
+			if ( rc != LDAP_SUCCESS ) {
+				tool_perror( "ldap_parse_intermediate", rc, NULL, NULL, NULL, NULL );
+				rc = EXIT_FAILURE;
+				goto skip;
+			}
+			if ( retdata != NULL ) {
+				if ( fwrite( retdata->bv_val, 1, retdata->bv_len, stdout )
+					!= retdata->bv_len ) {
+					perror( "fwrite" );
+					ber_bvfree( retdata );
+					tool_exit( ld, EXIT_FAILURE );
+				}
+				ber_bvfree( retdata );
+			}
+			continue;
+		}
+
 		if ( rc != 0 ) {
 			break;
 		}
@@ -266,6 +321,57 @@ main( int argc, char *argv[] )
 		ber_memfree( retoid );
 		ber_bvfree( retdata );
 
+	} else if ( strcasecmp( argv[ 0 ], "metrics" ) == 0 ) {
+		char		*retoid = NULL;
+		struct berval	*retdata = NULL;
+
+		rc = ldap_parse_extended_result( ld, res, &retoid, &retdata, 0 );
+
+		if ( rc != LDAP_SUCCESS ) {
+			tool_perror( "ldap_parse_extended_result", rc, NULL, NULL, NULL, NULL );
+			rc = EXIT_FAILURE;
+			goto skip;
+		}
+
+		/* already in the text exposition format */
+		if ( retdata != NULL ) {
+			fwrite( retdata->bv_val, 1, retdata->bv_len, stdout );
+		}
+
+		ber_memfree( retoid );
+		ber_bvfree( retdata );
+
+	} else if ( strcasecmp( argv[ 0 ], "snapshot" ) == 0 ) {
+		char		*retoid = NULL;
+		struct berval	*retdata = NULL;
+
+		rc = ldap_parse_extended_result( ld, res, &retoid, &retdata, 0 );
+
+		if ( rc != LDAP_SUCCESS ) {
+			tool_perror( "ldap_parse_extended_result", rc, NULL, NULL, NULL, NULL );
+			rc = EXIT_FAILURE;
+			goto skip;
+		}
+
+		/* stdout has the data, report the contextCSN it matches */
+		if ( retdata != NULL ) {
+			BerElement	*ber = ber_init( retdata );
+			BerVarray	csns = NULL;
+			int		i;
+
+			if ( ber != NULL && ber_scanf( ber, "{W}", &csns ) != LBER_ERROR ) {
+				for ( i = 0; csns && csns[i].bv_val != NULL; i++ ) {
+					fprintf( stderr, "contextCSN: %s\n", csns[i].bv_val );
+				}
+				ber_bvarray_free( csns );
+			}
+			ber_free( ber, 1 );
+		}
+		fflush( stdout );
+
+		ber_memfree( retoid );
+		ber_bvfree( retdata );
+
 	} else if ( strcasecmp( argv[ 0 ], "cancel" ) == 0 ) {
 		/* no extended response; returns specific errors */
 		assert( 0 );
@@ -318,7 +424,11 @@ main( int argc, char *argv[] )
 		}
 	}
 
-	if( verbose || code != LDAP_SUCCESS ||
+	/* don't mix anything into the snapshot data */
+	if ( strcasecmp( argv[ 0 ], "snapshot" ) == 0 && code == LDAP_SUCCESS ) {
+		/* nothing to add */
+
+	} else if( verbose || code != LDAP_SUCCESS ||
 		( matcheddn && *matcheddn ) || ( text && *text ) || refs ) {
 		printf( _("Result: %s (%d)\n"), ldap_err2string( code ), code );
 
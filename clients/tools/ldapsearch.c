@@ -127,6 +127,9 @@ usage( void )
 	fprintf( stderr, _("  -E [!]<ext>[=<extparam>] search extensions (! indicates criticality)\n"));
 	fprintf( stderr, _("             [!]domainScope              (domain scope)\n"));
 	fprintf( stderr, _("             !dontUseCopy                (Don't Use Copy)\n"));
+#ifdef LDAP_CONTROL_X_EXPLAIN
+	fprintf( stderr, _("             [!]explain                  (how the server evaluated the search)\n"));
+#endif
 	fprintf( stderr, _("             [!]mv=<filter>              (RFC 3876 matched values filter)\n"));
 	fprintf( stderr, _("             [!]pr=<size>[/prompt|noprompt] (RFC 2696 paged results/prompt)\n"));
 	fprintf( stderr, _("             [!]sss=[-]<attr[:OID]>[/[-]<attr[:OID]>...]\n"));
@@ -142,6 +145,10 @@ usage( void )
 	fprintf( stderr, _("             [!]<oid>[=:<b64value>] (generic control; no response handling)\n"));
 	fprintf( stderr, _("  -f file    read operations from `file'\n"));
 	fprintf( stderr, _("  -F prefix  URL prefix for files (default: %s)\n"), def_urlpre);
+	fprintf( stderr, _("  -j num     run up to num searches at once, splitting a subtree\n"));
+	fprintf( stderr, _("             search at the children of its base, or running the\n"));
+	fprintf( stderr, _("             searches of -f file concurrently\n"));
+	fprintf( stderr, _("  -J         print entries as JSON objects, one per line\n"));
 	fprintf( stderr, _("  -l limit   time limit (in seconds, or \"none\" or \"max\") for search\n"));
 	fprintf( stderr, _("  -L         print responses in LDIFv1 format\n"));
 	fprintf( stderr, _("  -LL        print responses in LDIF format without comments\n"));
@@ -165,6 +172,11 @@ static void print_entry LDAP_P((
 	LDAPMessage	*entry,
 	int		attrsonly));
 
+static void print_entry_json LDAP_P((
+	LDAP	*ld,
+	LDAPMessage	*entry,
+	int		attrsonly));
+
 static void print_reference(
 	LDAP *ld,
 	LDAPMessage *reference );
@@ -198,6 +210,16 @@ static int dosearch LDAP_P((
 	struct timeval *timeout,
 	int	sizelimit ));
 
+static int dosearch_parallel LDAP_P((
+	LDAP	*ld,
+	char	*base,
+	int		scope,
+	char	*filtpatt,
+	FILE	*fp,
+	char	**attrs,
+	int		attrsonly,
+	int	sizelimit ));
+
 static char *tmpdir = NULL;
 static char *urlpre = NULL;
 static char	*base = NULL;
@@ -213,6 +235,10 @@ static int dontUseCopy = 0;
 
 static int domainScope = 0;
 
+#ifdef LDAP_CONTROL_X_EXPLAIN
+static int explain = 0;
+#endif
+
 static int sss = 0;
 static LDAPSortKey **sss_keys = NULL;
 
@@ -224,6 +250,11 @@ static int ldapsync = 0;
 static struct berval sync_cookie = { 0, NULL };
 static int sync_slimit = -1;
 
+static int parallel = 0;	/* searches outstanding at once */
+static int jsonout = 0;
+static int bufout = 0;		/* stdout is block buffered, don't flush */
+#define	EXPORT_BUFSIZE	(1024 * 1024)
+
 /* cookie and morePagedResults moved to common.c */
 static int pagedResults = 0;
 static int pagePrompt = 1;
@@ -318,7 +349,7 @@ parse_vlv(char *cvalue)
 	return 0;
 }
 
-const char options[] = "a:Ab:cE:F:l:Ls:S:tT:uz:"
+const char options[] = "a:Ab:cE:F:j:Jl:Ls:S:tT:uz:"
 	"Cd:D:e:f:h:H:IMnNO:o:p:P:QR:U:vVw:WxX:y:Y:Z";
 
 int
@@ -468,6 +499,22 @@ handle_private_option( int i )
 
 			domainScope = 1 + crit;
 
+#ifdef LDAP_CONTROL_X_EXPLAIN
+		} else if ( strcasecmp( control, "explain" ) == 0 ) {
+			if( explain ) {
+				fprintf( stderr,
+					_("explain control previously specified\n"));
+				exit( EXIT_FAILURE );
+			}
+			if( cvalue != NULL ) {
+				fprintf( stderr,
+			         _("explain: no control value expected\n") );
+				usage();
+			}
+
+			explain = 1 + crit;
+#endif
+
 		} else if ( strcasecmp( control, "sss" ) == 0 ) {
 			char *keyp;
 			if( sss ) {
@@ -712,6 +759,18 @@ handle_private_option( int i )
 			exit( EXIT_FAILURE );
 		}
 		break;
+	case 'j':	/* concurrent searches */
+		ival = strtol( optarg, &next, 10 );
+		if ( next == NULL || next[0] != '\0' || ival < 1 ) {
+			fprintf( stderr,
+				_("Unable to parse number of searches \"%s\"\n"), optarg );
+			exit( EXIT_FAILURE );
+		}
+		parallel = ival;
+		break;
+	case 'J':	/* print entries as JSON */
+		++jsonout;
+		break;
 	case 'L':	/* print entries in LDIF format */
 		++ldif;
 		break;
@@ -835,6 +894,23 @@ main( int argc, char **argv )
 		return EXIT_FAILURE;
 	}
 
+	if ( parallel > 1 && ( sortattr || pagedResults || vlv || sss || ldapsync )) {
+		fprintf( stderr,
+			_("-j cannot be used with sorting, paging or sync\n" ));
+		return EXIT_FAILURE;
+	}
+
+	if ( jsonout ) {
+		/* no comments, no version line */
+		ldif = 3;
+	}
+
+	/* Exports write lots of small pieces, don't flush each entry */
+	if (( parallel > 1 || jsonout ) && !ldapsync ) {
+		setvbuf( stdout, NULL, _IOFBF, EXPORT_BUFSIZE );
+		bufout = 1;
+	}
+
 	if (( argc - optind < 1 ) ||
 		( *argv[optind] != '(' /*')'*/ &&
 		( strchr( argv[optind], '=' ) == NULL ) ) )
@@ -925,6 +1001,9 @@ getNextPage:
 		|| derefcrit
 #endif
 		|| domainScope
+#ifdef LDAP_CONTROL_X_EXPLAIN
+		|| explain
+#endif
 		|| pagedResults
 		|| ldapsync
 		|| sss
@@ -959,6 +1038,20 @@ getNextPage:
 			i++;
 		}
 
+#ifdef LDAP_CONTROL_X_EXPLAIN
+		if ( explain ) {
+			if ( ctrl_add() ) {
+				tool_exit( ld, EXIT_FAILURE );
+			}
+
+			c[i].ldctl_oid = LDAP_CONTROL_X_EXPLAIN;
+			c[i].ldctl_value.bv_val = NULL;
+			c[i].ldctl_value.bv_len = 0;
+			c[i].ldctl_iscritical = explain > 1;
+			i++;
+		}
+#endif
+
 		if ( subentries ) {
 			if ( ctrl_add() ) {
 				tool_exit( ld, EXIT_FAILURE );
@@ -1231,7 +1324,17 @@ getNextPage:
 		}
 	}
 
-	if ( infile == NULL ) {
+	if ( parallel > 1 && ( infile != NULL ||
+		scope == LDAP_SCOPE_SUBTREE || scope == LDAP_SCOPE_SUBORDINATE ))
+	{
+		rc = dosearch_parallel( ld, base, scope, filtpattern, fp,
+			attrs, attrsonly, sizelimit );
+		if ( fp != NULL && fp != stdin ) {
+			fclose( fp );
+			fp = NULL;
+		}
+
+	} else if ( infile == NULL ) {
 		rc = dosearch( ld, base, scope, NULL, filtpattern,
 			attrs, attrsonly, NULL, NULL, NULL, sizelimit );
 
@@ -1241,7 +1344,8 @@ getNextPage:
 		while ( fgets( line, sizeof( line ), fp ) != NULL ) { 
 			line[ strlen( line ) - 1 ] = '\0';
 			if ( !first ) {
-				putchar( '\n' );
+				if ( !jsonout )
+					putchar( '\n' );
 			} else {
 				first = 0;
 			}
@@ -1473,14 +1577,17 @@ static int dosearch(
 			msg != NULL;
 			msg = ldap_next_message( ld, msg ) )
 		{
-			if ( nresponses++ ) putchar('\n');
+			if ( nresponses++ && !jsonout ) putchar('\n');
 			if ( nresponses_psearch >= 0 ) 
 				nresponses_psearch++;
 
 			switch( ldap_msgtype( msg ) ) {
 			case LDAP_RES_SEARCH_ENTRY:
 				nentries++;
-				print_entry( ld, msg, attrsonly );
+				if ( jsonout )
+					print_entry_json( ld, msg, attrsonly );
+				else
+					print_entry( ld, msg, attrsonly );
 				break;
 
 			case LDAP_RES_SEARCH_REFERENCE:
@@ -1554,7 +1661,8 @@ static int dosearch(
 		}
 
 		ldap_msgfree( res );
-		fflush( stdout );
+		if ( !bufout )
+			fflush( stdout );
 	}
 
 done:
@@ -1600,6 +1708,227 @@ done:
 	return( rc2 );
 }
 
+/* One search of a parallel run */
+typedef struct psearch {
+	char	*ps_base;
+	int		ps_scope;
+	char	*ps_filter;
+} psearch;
+
+static int
+psearch_add( psearch **jobs, int *njobs, char *base, int scope, char *filter )
+{
+	psearch *ps;
+
+	ps = realloc( *jobs, ( *njobs + 1 ) * sizeof( psearch ));
+	if ( ps == NULL ) {
+		perror( "realloc" );
+		return -1;
+	}
+	*jobs = ps;
+	ps += (*njobs)++;
+	ps->ps_base = base ? strdup( base ) : NULL;
+	ps->ps_scope = scope;
+	ps->ps_filter = strdup( filter );
+	return 0;
+}
+
+/* Split a subtree search at the children of its base */
+static int
+psearch_split( LDAP *ld, char *base, int scope, char *filter,
+	psearch **jobs, int *njobs )
+{
+	static char *noattrs[] = { LDAP_NO_ATTRS, NULL };
+	LDAPMessage *res = NULL, *msg;
+	struct timeval tv, *tvp = NULL;
+	int rc, err = LDAP_SUCCESS;
+	char *dn;
+
+	if ( timelimit > 0 ) {
+		tv.tv_sec = timelimit;
+		tv.tv_usec = 0;
+		tvp = &tv;
+	}
+	rc = ldap_search_ext_s( ld, base, LDAP_SCOPE_ONELEVEL, NULL, noattrs, 1,
+		NULL, NULL, tvp, LDAP_NO_LIMIT, &res );
+	if ( rc == LDAP_SUCCESS || rc == LDAP_SIZELIMIT_EXCEEDED ) {
+		msg = ldap_first_message( ld, res );
+		for ( ; msg; msg = ldap_next_message( ld, msg )) {
+			if ( ldap_msgtype( msg ) == LDAP_RES_SEARCH_RESULT )
+				ldap_parse_result( ld, msg, &err, NULL, NULL, NULL, NULL, 0 );
+		}
+	}
+	if ( rc != LDAP_SUCCESS || err != LDAP_SUCCESS ) {
+		/* A partial list would silently lose entries */
+		if ( rc == LDAP_SUCCESS )
+			rc = err;
+		if ( rc != LDAP_SIZELIMIT_EXCEEDED && rc != LDAP_ADMINLIMIT_EXCEEDED ) {
+			tool_perror( "ldap_search_ext_s", rc, NULL, NULL, NULL, NULL );
+			ldap_msgfree( res );
+			return rc;
+		}
+		fprintf( stderr, _("could not list the children of the base (%s), "
+			"running a single search\n"), ldap_err2string( rc ));
+		ldap_msgfree( res );
+		return psearch_add( jobs, njobs, base, scope, filter );
+	}
+
+	if ( scope == LDAP_SCOPE_SUBTREE &&
+		psearch_add( jobs, njobs, base, LDAP_SCOPE_BASE, filter ))
+		return -1;
+	for ( msg = ldap_first_entry( ld, res ); msg;
+		msg = ldap_next_entry( ld, msg ))
+	{
+		dn = ldap_get_dn( ld, msg );
+		if ( dn == NULL )
+			continue;
+		rc = psearch_add( jobs, njobs, dn, LDAP_SCOPE_SUBTREE, filter );
+		ldap_memfree( dn );
+		if ( rc )
+			break;
+	}
+	ldap_msgfree( res );
+	return rc;
+}
+
+/*
+ * Run the searches of a -f file, or a subtree search split at the
+ * children of its base, keeping up to "parallel" of them outstanding.
+ * Entries are printed in the order they arrive.
+ */
+static int dosearch_parallel(
+	LDAP	*ld,
+	char	*base,
+	int		scope,
+	char	*filtpatt,
+	FILE	*fp,
+	char	**attrs,
+	int		attrsonly,
+	int sizelimit )
+{
+	psearch *jobs = NULL;
+	int njobs = 0, next = 0, outstanding = 0, stop = 0;
+	int rc = LDAP_SUCCESS, rc2, msgid;
+	int nresponses = 0, nentries = 0, nreferences = 0;
+	struct timeval tv_timelimit, *tv_timelimitp = NULL;
+	LDAPMessage *res;
+	char line[BUFSIZ], *filter;
+	int i;
+
+	if ( fp != NULL ) {
+		size_t max_fsize;
+
+		while ( fgets( line, sizeof( line ), fp ) != NULL ) {
+			line[ strlen( line ) - 1 ] = '\0';
+			max_fsize = strlen( filtpatt ) + strlen( line ) + 1;
+			filter = malloc( max_fsize );
+			if ( filter == NULL ) {
+				perror( "malloc" );
+				return EXIT_FAILURE;
+			}
+			snprintf( filter, max_fsize, filtpatt, line );
+			i = psearch_add( &jobs, &njobs, base, scope, filter );
+			free( filter );
+			if ( i )
+				return EXIT_FAILURE;
+		}
+	} else {
+		rc = psearch_split( ld, base, scope, filtpatt, &jobs, &njobs );
+		if ( rc )
+			goto done;
+	}
+
+	if ( dont )
+		goto done;
+
+	if ( timelimit > 0 ) {
+		tv_timelimit.tv_sec = timelimit;
+		tv_timelimit.tv_usec = 0;
+		tv_timelimitp = &tv_timelimit;
+	}
+
+	while ( next < njobs || outstanding ) {
+		while ( !stop && next < njobs && outstanding < parallel ) {
+			psearch *ps = &jobs[next++];
+
+			if ( verbose ) {
+				fprintf( stderr, _("searching <%s> for %s\n"),
+					ps->ps_base ? ps->ps_base : "", ps->ps_filter );
+			}
+			rc2 = ldap_search_ext( ld, ps->ps_base, ps->ps_scope,
+				ps->ps_filter, attrs, attrsonly, NULL, NULL,
+				tv_timelimitp, sizelimit, &msgid );
+			if ( rc2 != LDAP_SUCCESS ) {
+				tool_perror( "ldap_search_ext", rc2, NULL, NULL, NULL, NULL );
+				rc = rc2;
+				if ( !contoper || rc2 == LDAP_SERVER_DOWN )
+					stop = 1;
+				continue;
+			}
+			outstanding++;
+		}
+		if ( !outstanding )
+			break;
+
+		rc2 = ldap_result( ld, LDAP_RES_ANY, LDAP_MSG_ONE, NULL, &res );
+		if ( rc2 <= 0 ) {
+			ldap_get_option( ld, LDAP_OPT_RESULT_CODE, (void *)&rc );
+			tool_perror( "ldap_result", rc, NULL, NULL, NULL, NULL );
+			break;
+		}
+		if ( tool_check_abandon( ld, ldap_msgid( res ))) {
+			ldap_msgfree( res );
+			rc = -1;
+			break;
+		}
+
+		switch ( ldap_msgtype( res )) {
+		case LDAP_RES_SEARCH_ENTRY:
+			if ( nresponses++ && !jsonout ) putchar( '\n' );
+			nentries++;
+			if ( jsonout )
+				print_entry_json( ld, res, attrsonly );
+			else
+				print_entry( ld, res, attrsonly );
+			break;
+
+		case LDAP_RES_SEARCH_REFERENCE:
+			if ( nresponses++ && !jsonout ) putchar( '\n' );
+			nreferences++;
+			print_reference( ld, res );
+			break;
+
+		case LDAP_RES_SEARCH_RESULT:
+			outstanding--;
+			ldap_parse_result( ld, res, &rc2, NULL, NULL, NULL, NULL, 0 );
+			if ( rc2 != LDAP_SUCCESS ) {
+				if ( nresponses++ && !jsonout ) putchar( '\n' );
+				print_result( ld, res, 1 );
+				if ( rc == LDAP_SUCCESS )
+					rc = rc2;
+				if ( !contoper )
+					stop = 1;
+			}
+			break;
+		}
+		ldap_msgfree( res );
+	}
+
+	if ( ldif < 2 ) {
+		printf( _("\n# numResponses: %d\n"), nresponses );
+		if ( nentries ) printf( _("# numEntries: %d\n"), nentries );
+		if ( nreferences ) printf( _("# numReferences: %d\n"), nreferences );
+	}
+
+done:
+	for ( i = 0; i < njobs; i++ ) {
+		free( jobs[i].ps_base );
+		free( jobs[i].ps_filter );
+	}
+	free( jobs );
+	return rc;
+}
+
 /* This is the proposed new way of doing things.
  * It is more efficient, but the API is non-standard.
  */
@@ -1712,6 +2041,123 @@ print_entry(
 	}
 }
 
+/* JSON strings must be valid UTF-8 */
+static int
+json_is_utf8( const unsigned char *p, ber_len_t len )
+{
+	ber_len_t i, n;
+
+	for ( i = 0; i < len; i += n ) {
+		if ( p[i] < 0x80 ) {
+			if ( !p[i] )
+				return 0;
+			n = 1;
+			continue;
+		}
+		if ( p[i] >= 0xc2 && p[i] <= 0xdf ) n = 2;
+		else if ( p[i] >= 0xe0 && p[i] <= 0xef ) n = 3;
+		else if ( p[i] >= 0xf0 && p[i] <= 0xf4 ) n = 4;
+		else return 0;
+		if ( i + n > len )
+			return 0;
+		switch ( n ) {
+		case 4: if (( p[i+3] & 0xc0 ) != 0x80 ) return 0;
+		case 3: if (( p[i+2] & 0xc0 ) != 0x80 ) return 0;
+		case 2: if (( p[i+1] & 0xc0 ) != 0x80 ) return 0;
+		}
+	}
+	return 1;
+}
+
+static void
+json_print_string( const char *s, ber_len_t len )
+{
+	ber_len_t i;
+
+	putchar( '"' );
+	for ( i = 0; i < len; i++ ) {
+		unsigned char ch = s[i];
+
+		if ( ch == '"' || ch == '\\' ) {
+			putchar( '\\' );
+			putchar( ch );
+		} else if ( ch < 0x20 ) {
+			printf( "\\u%04x", ch );
+		} else {
+			putchar( ch );
+		}
+	}
+	putchar( '"' );
+}
+
+/* Print a value as a string, or as {"base64":...} if it is not UTF-8 */
+static void
+json_print_value( struct berval *bv )
+{
+	char *b64;
+	size_t len;
+
+	if ( json_is_utf8( (unsigned char *)bv->bv_val, bv->bv_len )) {
+		json_print_string( bv->bv_val, bv->bv_len );
+		return;
+	}
+	len = LUTIL_BASE64_ENCODE_LEN( bv->bv_len ) + 1;
+	b64 = malloc( len );
+	if ( b64 == NULL ) {
+		perror( "malloc" );
+		exit( EXIT_FAILURE );
+	}
+	lutil_b64_ntop( (unsigned char *)bv->bv_val, bv->bv_len, b64, len );
+	printf( "{\"base64\":\"%s\"}", b64 );
+	free( b64 );
+}
+
+/* Print the entry as one line of JSON, straight from the BER buffer */
+static void
+print_entry_json(
+	LDAP	*ld,
+	LDAPMessage	*entry,
+	int		attrsonly)
+{
+	int			i, rc;
+	BerElement		*ber = NULL;
+	struct berval		bv, *bvals, **bvp = &bvals;
+
+	rc = ldap_get_dn_ber( ld, entry, &ber, &bv );
+	if ( rc != LDAP_SUCCESS ) {
+		tool_perror( "ldap_get_dn_ber", rc, NULL, NULL, NULL, NULL );
+		return;
+	}
+	printf( "{\"dn\":" );
+	json_print_string( bv.bv_val, bv.bv_len );
+
+	if ( attrsonly ) bvp = NULL;
+
+	for ( rc = ldap_get_attribute_ber( ld, entry, ber, &bv, bvp );
+		rc == LDAP_SUCCESS;
+		rc = ldap_get_attribute_ber( ld, entry, ber, &bv, bvp ) )
+	{
+		if ( bv.bv_val == NULL ) break;
+
+		putchar( ',' );
+		json_print_string( bv.bv_val, bv.bv_len );
+		printf( ":[" );
+		if ( bvp && bvals ) {
+			for ( i = 0; bvals[i].bv_val != NULL; i++ ) {
+				if ( i ) putchar( ',' );
+				json_print_value( &bvals[i] );
+			}
+			ber_memfree( bvals );
+		}
+		putchar( ']' );
+	}
+	printf( "}\n" );
+
+	if( ber != NULL ) {
+		ber_free( ber, 0 );
+	}
+}
+
 static void print_reference(
 	LDAP *ld,
 	LDAPMessage *reference )
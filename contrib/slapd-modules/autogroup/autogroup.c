@@ -48,6 +48,8 @@ typedef struct autogroup_filter_t {
 	Filter				*agf_filter;
 	int				agf_scope;
 	AttributeName			*agf_anlist;
+	AttributeDescription		**agf_attrs;	/* attributes the filter and anlist use */
+	int				agf_anyattr;	/* filter may depend on any attribute */
 	struct autogroup_filter_t	*agf_next;
 } autogroup_filter_t;
 
@@ -589,6 +591,97 @@ autogroup_add_members_from_filter( Operation *op, Entry *e, autogroup_entry_t *a
 ** e	- the entry representing the group, can be NULL if the ndn is specified, and modify == 1
 ** ndn	- the DN of the group, can be NULL if we give a non-NULL e
 */
+static void
+autogroup_attrs_add( autogroup_filter_t *agf, AttributeDescription *ad, int *nattrs )
+{
+	int	i;
+
+	if ( ad == NULL ) {
+		agf->agf_anyattr = 1;
+		return;
+	}
+	for ( i = 0; i < *nattrs; i++ ) {
+		if ( agf->agf_attrs[i] == ad )
+			return;
+	}
+	agf->agf_attrs = ch_realloc( agf->agf_attrs,
+		( *nattrs + 2 ) * sizeof( AttributeDescription * ));
+	agf->agf_attrs[(*nattrs)++] = ad;
+	agf->agf_attrs[*nattrs] = NULL;
+}
+
+static void
+autogroup_filter_attrs( autogroup_filter_t *agf, Filter *f, int *nattrs )
+{
+	for ( ; f; f = f->f_next ) {
+		switch ( f->f_choice & SLAPD_FILTER_MASK ) {
+		case LDAP_FILTER_AND:
+		case LDAP_FILTER_OR:
+		case LDAP_FILTER_NOT:
+			autogroup_filter_attrs( agf, f->f_list, nattrs );
+			break;
+		case LDAP_FILTER_EQUALITY:
+		case LDAP_FILTER_GE:
+		case LDAP_FILTER_LE:
+		case LDAP_FILTER_APPROX:
+			autogroup_attrs_add( agf, f->f_av_desc, nattrs );
+			break;
+		case LDAP_FILTER_SUBSTRINGS:
+			autogroup_attrs_add( agf, f->f_sub_desc, nattrs );
+			break;
+		case LDAP_FILTER_PRESENT:
+			autogroup_attrs_add( agf, f->f_desc, nattrs );
+			break;
+		case LDAP_FILTER_EXT:
+			/* a dnAttributes match looks at the DN, which a modify
+			 * cannot change, but without a type any value counts */
+			autogroup_attrs_add( agf, f->f_mr_desc, nattrs );
+			break;
+		case SLAPD_FILTER_COMPUTED:
+			break;
+		default:
+			agf->agf_anyattr = 1;
+			break;
+		}
+	}
+}
+
+/*
+** Record which attributes decide whether an entry is a member through
+** agf, and which value it contributes, so that modifications that
+** touch none of them can skip the group.
+*/
+static void
+autogroup_filter_index( autogroup_filter_t *agf )
+{
+	int	nattrs = 0;
+
+	autogroup_filter_attrs( agf, agf->agf_filter, &nattrs );
+	if ( agf->agf_filter == NULL )
+		agf->agf_anyattr = 1;
+	if ( agf->agf_anlist )
+		autogroup_attrs_add( agf, agf->agf_anlist[0].an_desc, &nattrs );
+}
+
+static int
+autogroup_mods_touch( autogroup_filter_t *agf, Modifications *ml )
+{
+	int	i;
+
+	if ( agf->agf_anyattr )
+		return 1;
+	if ( agf->agf_attrs == NULL )
+		return 0;
+	for ( ; ml; ml = ml->sml_next ) {
+		for ( i = 0; agf->agf_attrs[i]; i++ ) {
+			if ( is_ad_subtype( ml->sml_desc, agf->agf_attrs[i] ) ||
+				is_ad_subtype( agf->agf_attrs[i], ml->sml_desc ))
+				return 1;
+		}
+	}
+	return 0;
+}
+
 static int
 autogroup_add_group( Operation *op, autogroup_info_t *agi, autogroup_def_t *agd, Entry *e, BerValue *ndn, int scan, int modify)
 {
@@ -716,6 +809,7 @@ autogroup_add_group( Operation *op, autogroup_info_t *agi, autogroup_def_t *agd,
 				}
 			}
 
+			autogroup_filter_index( agf );
 			agf->agf_next = NULL;
 
 			if( (*agep)->age_filter == NULL ) {
@@ -936,6 +1030,7 @@ autogroup_delete_group( autogroup_info_t *agi, autogroup_entry_t *e )
 				ch_free( agf->agf_dn.bv_val );
 				ch_free( agf->agf_ndn.bv_val );
 				anlist_free( agf->agf_anlist, 1, NULL );
+				ch_free( agf->agf_attrs );
 				ch_free( agf );
 			}
 
@@ -1087,6 +1182,7 @@ autogroup_response( Operation *op, SlapReply *rs )
 					for ( agf = age->age_filter ; agf ; agf = agf->agf_next ) {
 						autogroup_add_members_from_filter( op, NULL, age, agf, 1 );
 					}
+					age->age_mustrefresh = 0;
 				}
 
 				ldap_pvt_thread_mutex_unlock( &age->age_mutex );
@@ -1408,6 +1504,19 @@ autogroup_response( Operation *op, SlapReply *rs )
 
 				ldap_pvt_thread_mutex_lock( &age->age_mutex );
 
+				/* Membership can only change if the entry is under one
+				 * of the group's bases and the modification touches an
+				 * attribute that filter, or the member value, uses. */
+				for ( agf = age->age_filter ; agf ; agf = agf->agf_next ) {
+					if ( dnIsSuffix( &op->o_req_ndn, &agf->agf_ndn ) &&
+						autogroup_mods_touch( agf, op->orm_modlist ) )
+						break;
+				}
+				if ( agf == NULL ) {
+					ldap_pvt_thread_mutex_unlock( &age->age_mutex );
+					continue;
+				}
+
 				if ( age->age_filter && age->age_filter->agf_anlist ) {
 					ea = attrs_find( attrs, age->age_filter->agf_anlist[0].an_desc );
 				}
@@ -1833,6 +1942,7 @@ ag_cfgen( ConfigArgs *c )
 					ch_free( agf->agf_dn.bv_val );
 					ch_free( agf->agf_ndn.bv_val );
 					anlist_free( agf->agf_anlist, 1, NULL );
+					ch_free( agf->agf_attrs );
 					ch_free( agf );
 				}
 
@@ -1877,6 +1987,7 @@ ag_cfgen( ConfigArgs *c )
 						ch_free( agf->agf_dn.bv_val );
 						ch_free( agf->agf_ndn.bv_val );
 						anlist_free( agf->agf_anlist, 1, NULL );
+						ch_free( agf->agf_attrs );
 						ch_free( agf );
 					}
 
@@ -2161,6 +2272,7 @@ autogroup_db_close(
 				ch_free( agf->agf_dn.bv_val );
 				ch_free( agf->agf_ndn.bv_val );	
 				anlist_free( agf->agf_anlist, 1, NULL );
+				ch_free( agf->agf_attrs );
 				ch_free( agf );
 			}
 
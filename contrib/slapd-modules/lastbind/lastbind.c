@@ -25,6 +25,11 @@
  * Optimization: to avoid performing a write on each bind,
  * a precision for this timestamp may be configured, causing it to
  * only be updated if it is older than a given number of seconds.
+ *
+ * Further, a flush interval may be configured: the timestamps due are
+ * then only recorded in memory, coalescing repeated binds of the same
+ * entry, and written out periodically by a runqueue task, many entries
+ * per backend transaction.
  */
 
 #ifdef SLAPD_OVER_LASTBIND
@@ -37,14 +42,32 @@
 #include <ac/string.h>
 #include <ac/ctype.h>
 #include "config.h"
+#include "ldap_rq.h"
 
 /* Per-instance configuration information */
 typedef struct lastbind_info {
 	/* precision to update timestamp in authTimestamp attribute */
 	int timestamp_precision;
 	int forward_updates;	/* use frontend for authTimestamp updates */
+	int flush_interval;	/* seconds between writes of pending updates */
+	int no_replicate;	/* keep authTimestamp updates local */
+
+	BackendDB *lb_be;
+	struct re_s *lb_task;
+	ldap_pvt_thread_mutex_t lb_mutex;
+	Avlnode *lb_pending;	/* lastbind_pending, by DN */
+	int lb_npending;
 } lastbind_info;
 
+/* A timestamp waiting to be written */
+typedef struct lastbind_pending {
+	struct berval lp_ndn;
+	time_t lp_time;
+} lastbind_pending;
+
+/* pending updates written per backend transaction */
+#define LASTBIND_TXN_SIZE	500
+
 /* Operational attributes */
 static AttributeDescription *ad_authTimestamp;
 
@@ -66,6 +89,12 @@ static struct schema_info {
 	{ NULL, NULL }
 };
 
+static ConfigDriver lastbind_cf_gen;
+
+enum {
+	LB_FLUSH = 1
+};
+
 /* configuration attribute and objectclass */
 static ConfigTable lastbindcfg[] = {
 	{ "lastbind-precision", "seconds", 2, 2, 0,
@@ -81,6 +110,19 @@ static ConfigTable lastbindcfg[] = {
 	  "( OLcfgAt:5.2 NAME 'olcLastBindForwardUpdates' "
 	  "DESC 'Allow authTimestamp updates to be forwarded via updateref' "
 	  "SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "lastbind-flush-interval", "seconds", 2, 2, 0,
+	  ARG_MAGIC|ARG_INT|LB_FLUSH, lastbind_cf_gen,
+	  "( OLcfgCtAt:5.3 "
+	  "NAME 'olcLastBindFlushInterval' "
+	  "DESC 'Seconds between batched writes of authTimestamp, 0 to write at bind' "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "lastbind-no-replicate", "on|off", 1, 2, 0,
+	  ARG_ON_OFF|ARG_OFFSET,
+	  (void *)offsetof(lastbind_info, no_replicate),
+	  "( OLcfgCtAt:5.4 "
+	  "NAME 'olcLastBindNoReplicate' "
+	  "DESC 'Do not replicate authTimestamp updates' "
+	  "SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -89,7 +131,8 @@ static ConfigOCs lastbindocs[] = {
 	  "NAME 'olcLastBindConfig' "
 	  "DESC 'Last Bind configuration' "
 	  "SUP olcOverlayConfig "
-	  "MAY ( olcLastBindPrecision $ olcLastBindForwardUpdates) )",
+	  "MAY ( olcLastBindPrecision $ olcLastBindForwardUpdates $ "
+	  "olcLastBindFlushInterval $ olcLastBindNoReplicate ) )",
 	  Cft_Overlay, lastbindcfg, NULL, NULL },
 	{ NULL, 0, NULL }
 };
@@ -108,18 +151,149 @@ parse_time( char *atm )
 	return ret;
 }
 
+static int
+lastbind_pending_cmp( const void *v1, const void *v2 )
+{
+	const lastbind_pending *lp1 = v1, *lp2 = v2;
+	int rc = lp1->lp_ndn.bv_len - lp2->lp_ndn.bv_len;
+
+	if ( rc == 0 )
+		rc = memcmp( lp1->lp_ndn.bv_val, lp2->lp_ndn.bv_val, lp1->lp_ndn.bv_len );
+	return rc;
+}
+
+/*
+ * Write the authTimestamp of the entry ndn, as an internal modify
+ * done on behalf of op
+ */
+static int
+lastbind_update( Operation *op, lastbind_info *lbi, struct berval *ndn, time_t t )
+{
+	Operation op2 = *op;
+	SlapReply r2 = { REP_RESULT };
+	slap_callback cb = { NULL, slap_null_cb, NULL, NULL };
+	LDAPControl c, *ca[2];
+	Modifications *mod;
+	char nowstr[ LDAP_LUTIL_GENTIME_BUFSIZE ];
+	struct berval timestamp;
+
+	timestamp.bv_val = nowstr;
+	timestamp.bv_len = sizeof(nowstr);
+	slap_timestamp( &t, &timestamp );
+
+	mod = ch_calloc( sizeof(Modifications), 1 );
+	mod->sml_op = LDAP_MOD_REPLACE;
+	mod->sml_flags = 0;
+	mod->sml_type = ad_authTimestamp->ad_cname;
+	mod->sml_desc = ad_authTimestamp;
+	mod->sml_numvals = 1;
+	mod->sml_values = ch_calloc( sizeof(struct berval), 2 );
+	mod->sml_nvalues = ch_calloc( sizeof(struct berval), 2 );
+
+	ber_dupbv( &mod->sml_values[0], &timestamp );
+	ber_dupbv( &mod->sml_nvalues[0], &timestamp );
+
+	/* This is a DSA-specific opattr, it never gets replicated. */
+	op2.o_tag = LDAP_REQ_MODIFY;
+	op2.o_callback = &cb;
+	op2.o_req_dn = *ndn;
+	op2.o_req_ndn = *ndn;
+	op2.orm_modlist = mod;
+	op2.orm_no_opattrs = 0;
+	op2.o_dn = op->o_bd->be_rootdn;
+	op2.o_ndn = op->o_bd->be_rootndn;
+
+	/*
+	 * Code for forwarding of updates adapted from ppolicy.c of slapo-ppolicy
+	 *
+	 * If this server is a shadow and forward_updates is true,
+	 * use the frontend to perform this modify. That will trigger
+	 * the update referral, which can then be forwarded by the
+	 * chain overlay. Obviously the updateref and chain overlay
+	 * must be configured appropriately for this to be useful.
+	 */
+	if ( SLAP_SHADOW( op->o_bd ) && lbi->forward_updates ) {
+		op2.o_bd = frontendDB;
+
+		/* Must use Relax control since these are no-user-mod */
+		op2.o_relax = SLAP_CONTROL_CRITICAL;
+		op2.o_ctrls = ca;
+		ca[0] = &c;
+		ca[1] = NULL;
+		BER_BVZERO( &c.ldctl_value );
+		c.ldctl_iscritical = 1;
+		c.ldctl_oid = LDAP_CONTROL_RELAX;
+	} else {
+		/* If not forwarding, don't update opattrs and don't replicate */
+		if ( SLAP_SINGLE_SHADOW( op->o_bd ) || lbi->no_replicate ) {
+			op2.orm_no_opattrs = 1;
+			op2.o_dont_replicate = 1;
+		}
+		/* TODO: not sure what this does in slapo-ppolicy */
+		/*
+		op2.o_bd->bd_info = (BackendInfo *)on->on_info;
+		*/
+	}
+
+	op->o_bd->be_modify( &op2, &r2 );
+	slap_mods_free( mod, 1 );
+
+	return r2.sr_err;
+}
+
+/*
+ * Remember that the entry ndn is due an update, or move the time of
+ * its pending update forward. Returns nonzero if there already was
+ * one, in which case the entry need not be looked at.
+ */
+static int
+lastbind_defer( lastbind_info *lbi, struct berval *ndn, time_t now, int create )
+{
+	lastbind_pending *lp, key;
+	int found = 0;
+
+	key.lp_ndn = *ndn;
+
+	ldap_pvt_thread_mutex_lock( &lbi->lb_mutex );
+	lp = avl_find( lbi->lb_pending, &key, lastbind_pending_cmp );
+	if ( lp ) {
+		lp->lp_time = now;
+		found = 1;
+	} else if ( create ) {
+		lp = ch_malloc( sizeof(lastbind_pending) + ndn->bv_len + 1 );
+		lp->lp_ndn.bv_val = (char *)(lp+1);
+		lp->lp_ndn.bv_len = ndn->bv_len;
+		AC_MEMCPY( lp->lp_ndn.bv_val, ndn->bv_val, ndn->bv_len + 1 );
+		lp->lp_time = now;
+		avl_insert( &lbi->lb_pending, lp, lastbind_pending_cmp, avl_dup_error );
+		lbi->lb_npending++;
+	}
+	ldap_pvt_thread_mutex_unlock( &lbi->lb_mutex );
+
+	return found;
+}
+
 static int
 lastbind_bind_response( Operation *op, SlapReply *rs )
 {
-	Modifications *mod = NULL;
 	BackendInfo *bi = op->o_bd->bd_info;
+	lastbind_info *lbi = (lastbind_info *) op->o_callback->sc_private;
 	Entry *e;
-	int rc;
+	int rc, update = 0;
+	time_t now, bindtime = (time_t)-1;
+	Attribute *a;
 
 	/* we're only interested if the bind was successful */
 	if ( rs->sr_err != LDAP_SUCCESS )
 		return SLAP_CB_CONTINUE;
 
+	/* get the current time */
+	now = slap_get_time();
+
+	/* an update already waiting only needs its time moved */
+	if ( lbi->flush_interval && lastbind_defer( lbi, &op->o_req_ndn, now, 0 ) )
+		return SLAP_CB_CONTINUE;
+
 	rc = be_entry_get_rw( op, &op->o_req_ndn, NULL, NULL, 0, &e );
 	op->o_bd->bd_info = bi;
 
@@ -127,108 +301,196 @@ lastbind_bind_response( Operation *op, SlapReply *rs )
 		return SLAP_CB_CONTINUE;
 	}
 
-	{
-		lastbind_info *lbi = (lastbind_info *) op->o_callback->sc_private;
-
-		time_t now, bindtime = (time_t)-1;
-		Attribute *a;
-		Modifications *m;
-		char nowstr[ LDAP_LUTIL_GENTIME_BUFSIZE ];
-		struct berval timestamp;
-
-		/* get the current time */
-		now = slap_get_time();
-
-		/* get authTimestamp attribute, if it exists */
-		if ((a = attr_find( e->e_attrs, ad_authTimestamp)) != NULL) {
-			bindtime = parse_time( a->a_nvals[0].bv_val );
-
-			if (bindtime != (time_t)-1) {
-				/* if the recorded bind time is within our precision, we're done
-				 * it doesn't need to be updated (save a write for nothing) */
-				if ((now - bindtime) < lbi->timestamp_precision) {
-					goto done;
-				}
-			}
-		}
+	/* get authTimestamp attribute, if it exists */
+	if ((a = attr_find( e->e_attrs, ad_authTimestamp)) != NULL) {
+		bindtime = parse_time( a->a_nvals[0].bv_val );
+	}
 
-		/* update the authTimestamp in the user's entry with the current time */
-		timestamp.bv_val = nowstr;
-		timestamp.bv_len = sizeof(nowstr);
-		slap_timestamp( &now, &timestamp );
-
-		m = ch_calloc( sizeof(Modifications), 1 );
-		m->sml_op = LDAP_MOD_REPLACE;
-		m->sml_flags = 0;
-		m->sml_type = ad_authTimestamp->ad_cname;
-		m->sml_desc = ad_authTimestamp;
-		m->sml_numvals = 1;
-		m->sml_values = ch_calloc( sizeof(struct berval), 2 );
-		m->sml_nvalues = ch_calloc( sizeof(struct berval), 2 );
-
-		ber_dupbv( &m->sml_values[0], &timestamp );
-		ber_dupbv( &m->sml_nvalues[0], &timestamp );
-		m->sml_next = mod;
-		mod = m;
+	/* if the recorded bind time is within our precision, we're done
+	 * it doesn't need to be updated (save a write for nothing) */
+	if ( bindtime == (time_t)-1 || (now - bindtime) >= lbi->timestamp_precision ) {
+		update = 1;
 	}
 
-done:
 	be_entry_release_r( op, e );
 
 	/* perform the update, if necessary */
-	if ( mod ) {
-		Operation op2 = *op;
-		SlapReply r2 = { REP_RESULT };
-		slap_callback cb = { NULL, slap_null_cb, NULL, NULL };
-		LDAPControl c, *ca[2];
-		lastbind_info *lbi = (lastbind_info *) op->o_callback->sc_private;
-
-		/* This is a DSA-specific opattr, it never gets replicated. */
-		op2.o_tag = LDAP_REQ_MODIFY;
-		op2.o_callback = &cb;
-		op2.orm_modlist = mod;
-		op2.orm_no_opattrs = 0;
-		op2.o_dn = op->o_bd->be_rootdn;
-		op2.o_ndn = op->o_bd->be_rootndn;
+	if ( update ) {
+		if ( lbi->flush_interval )
+			lastbind_defer( lbi, &op->o_req_ndn, now, 1 );
+		else
+			lastbind_update( op, lbi, &op->o_req_ndn, now );
+	}
 
-		/*
-		 * Code for forwarding of updates adapted from ppolicy.c of slapo-ppolicy
-		 *
-		 * If this server is a shadow and forward_updates is true,
-		 * use the frontend to perform this modify. That will trigger
-		 * the update referral, which can then be forwarded by the
-		 * chain overlay. Obviously the updateref and chain overlay
-		 * must be configured appropriately for this to be useful.
-		 */
-		if ( SLAP_SHADOW( op->o_bd ) && lbi->forward_updates ) {
-			op2.o_bd = frontendDB;
-
-			/* Must use Relax control since these are no-user-mod */
-			op2.o_relax = SLAP_CONTROL_CRITICAL;
-			op2.o_ctrls = ca;
-			ca[0] = &c;
-			ca[1] = NULL;
-			BER_BVZERO( &c.ldctl_value );
-			c.ldctl_iscritical = 1;
-			c.ldctl_oid = LDAP_CONTROL_RELAX;
-		} else {
-			/* If not forwarding, don't update opattrs and don't replicate */
-			if ( SLAP_SINGLE_SHADOW( op->o_bd )) {
-				op2.orm_no_opattrs = 1;
-				op2.o_dont_replicate = 1;
-			}
-			/* TODO: not sure what this does in slapo-ppolicy */
-			/*
-			op2.o_bd->bd_info = (BackendInfo *)on->on_info;
-			*/
+	op->o_bd->bd_info = bi;
+	return SLAP_CB_CONTINUE;
+}
+
+/*
+ * Write out all pending updates. Unless they are forwarded to a
+ * master, they are grouped into backend transactions. The caller
+ * says whether the pool may be paused in between; it must not be
+ * when it already holds the pause itself.
+ */
+static void
+lastbind_flush( slap_overinst *on, void *ctx, int pausecheck )
+{
+	lastbind_info *lbi = (lastbind_info *) on->on_bi.bi_private;
+	BackendInfo *bi = on->on_info->oi_orig;
+	BackendDB db;
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+	Avlnode *pending;
+	lastbind_pending *lp;
+	OpExtra *txn = NULL;
+	int n = 0, npending, total = 0, usetxn;
+
+	ldap_pvt_thread_mutex_lock( &lbi->lb_mutex );
+	pending = lbi->lb_pending;
+	npending = lbi->lb_npending;
+	lbi->lb_pending = NULL;
+	lbi->lb_npending = 0;
+	ldap_pvt_thread_mutex_unlock( &lbi->lb_mutex );
+
+	if ( pending == NULL )
+		return;
+
+	connection_fake_init( &conn, &opbuf, ctx );
+	op = &opbuf.ob_op;
+
+	/* go through the whole overlay stack, so the updates are
+	 * seen by e.g. syncprov like any other modify */
+	db = *lbi->lb_be;
+	db.bd_info = (BackendInfo *)on->on_info;
+	op->o_bd = &db;
+
+	usetxn = bi->bi_op_txn &&
+		!( SLAP_SHADOW( op->o_bd ) && lbi->forward_updates );
+
+	while ( pending ) {
+		lp = pending->avl_data;
+		avl_delete( &pending, lp, lastbind_pending_cmp );
+
+		if ( usetxn && txn == NULL &&
+			bi->bi_op_txn( op, SLAP_TXN_BEGIN, &txn ) != 0 )
+			txn = NULL;
+
+		slap_op_time( &op->o_time, &op->o_tincr );
+		if ( lastbind_update( op, lbi, &lp->lp_ndn, lp->lp_time ) == LDAP_SUCCESS )
+			total++;
+		ch_free( lp );
+
+		if ( txn && ( ++n >= LASTBIND_TXN_SIZE || pending == NULL )) {
+			LDAP_SLIST_REMOVE( &op->o_extra, txn, OpExtra, oe_next );
+			bi->bi_op_txn( op, SLAP_TXN_COMMIT, &txn );
+			txn = NULL;
+			n = 0;
+			if ( pausecheck )
+				ldap_pvt_thread_pool_pausecheck( &connection_pool );
 		}
+	}
+
+	Debug( LDAP_DEBUG_STATS, "lastbind_flush: %s: "
+		"wrote %d of %d authTimestamp updates\n",
+		lbi->lb_be->be_suffix[0].bv_val, total, npending );
+}
+
+static void *
+lastbind_flush_task( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+
+	lastbind_flush( rtask->arg, ctx, 1 );
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	return NULL;
+}
+
+static void
+lastbind_task_start( slap_overinst *on )
+{
+	lastbind_info *lbi = (lastbind_info *) on->on_bi.bi_private;
 
-		rc = op->o_bd->be_modify( &op2, &r2 );
-		slap_mods_free( mod, 1 );
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( lbi->lb_task ) {
+		lbi->lb_task->interval.tv_sec = lbi->flush_interval;
+	} else {
+		lbi->lb_task = ldap_pvt_runqueue_insert( &slapd_rq,
+			lbi->flush_interval, lastbind_flush_task, on,
+			"lastbind_flush", lbi->lb_be->be_suffix[0].bv_val );
 	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
 
-	op->o_bd->bd_info = bi;
-	return SLAP_CB_CONTINUE;
+static void
+lastbind_task_stop( slap_overinst *on )
+{
+	lastbind_info *lbi = (lastbind_info *) on->on_bi.bi_private;
+	struct re_s *re = lbi->lb_task;
+
+	if ( re ) {
+		lbi->lb_task = NULL;
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+		if ( ldap_pvt_runqueue_isrunning( &slapd_rq, re ))
+			ldap_pvt_runqueue_stoptask( &slapd_rq, re );
+		ldap_pvt_runqueue_remove( &slapd_rq, re );
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	}
+}
+
+static int
+lastbind_cf_gen( ConfigArgs *c )
+{
+	slap_overinst *on = (slap_overinst *)c->bi;
+	lastbind_info *lbi = (lastbind_info *) on->on_bi.bi_private;
+	int rc = 0;
+
+	if ( c->op == SLAP_CONFIG_EMIT ) {
+		switch( c->type ) {
+		case LB_FLUSH:
+			c->value_int = lbi->flush_interval;
+			break;
+		}
+		return rc;
+	} else if ( c->op == LDAP_MOD_DELETE ) {
+		switch( c->type ) {
+		case LB_FLUSH:
+			lbi->flush_interval = 0;
+			lastbind_task_stop( on );
+			/* write out whatever is still waiting */
+			if ( slapMode & SLAP_SERVER_MODE )
+				lastbind_flush( on, ldap_pvt_thread_pool_context(), 0 );
+			break;
+		}
+		return rc;
+	}
+
+	switch( c->type ) {
+	case LB_FLUSH:
+		if ( c->value_int < 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"<%s> invalid interval", c->argv[0] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		lbi->flush_interval = c->value_int;
+		if ( !( slapMode & SLAP_SERVER_MODE ) || !lbi->lb_task ) {
+			/* started when the database is opened */
+			break;
+		}
+		if ( lbi->flush_interval ) {
+			lastbind_task_start( on );
+		} else {
+			lastbind_task_stop( on );
+			lastbind_flush( on, ldap_pvt_thread_pool_context(), 0 );
+		}
+		break;
+	}
+	return rc;
 }
 
 static int
@@ -256,8 +518,28 @@ lastbind_db_init(
 {
 	slap_overinst *on = (slap_overinst *) be->bd_info;
 
+	lastbind_info *lbi;
+
 	/* initialize private structure to store configuration */
-	on->on_bi.bi_private = ch_calloc( 1, sizeof(lastbind_info) );
+	lbi = ch_calloc( 1, sizeof(lastbind_info) );
+	lbi->lb_be = be;
+	ldap_pvt_thread_mutex_init( &lbi->lb_mutex );
+	on->on_bi.bi_private = lbi;
+
+	return 0;
+}
+
+static int
+lastbind_db_open(
+	BackendDB *be,
+	ConfigReply *cr
+)
+{
+	slap_overinst *on = (slap_overinst *) be->bd_info;
+	lastbind_info *lbi = (lastbind_info *) on->on_bi.bi_private;
+
+	if ( lbi->flush_interval && ( slapMode & SLAP_SERVER_MODE ))
+		lastbind_task_start( on );
 
 	return 0;
 }
@@ -267,11 +549,29 @@ lastbind_db_close(
 	BackendDB *be,
 	ConfigReply *cr
 )
+{
+	slap_overinst *on = (slap_overinst *) be->bd_info;
+
+	/* don't lose the updates still waiting */
+	lastbind_task_stop( on );
+	if ( slapMode & SLAP_SERVER_MODE )
+		lastbind_flush( on, ldap_pvt_thread_pool_context(), 0 );
+
+	return 0;
+}
+
+static int
+lastbind_db_destroy(
+	BackendDB *be,
+	ConfigReply *cr
+)
 {
 	slap_overinst *on = (slap_overinst *) be->bd_info;
 	lastbind_info *lbi = (lastbind_info *) on->on_bi.bi_private;
 
 	/* free private structure to store configuration */
+	avl_free( lbi->lb_pending, ch_free );
+	ldap_pvt_thread_mutex_destroy( &lbi->lb_mutex );
 	free( lbi );
 
 	return 0;
@@ -297,7 +597,9 @@ int lastbind_initialize()
 
 	lastbind.on_bi.bi_type = "lastbind";
 	lastbind.on_bi.bi_db_init = lastbind_db_init;
+	lastbind.on_bi.bi_db_open = lastbind_db_open;
 	lastbind.on_bi.bi_db_close = lastbind_db_close;
+	lastbind.on_bi.bi_db_destroy = lastbind_db_destroy;
 	lastbind.on_bi.bi_op_bind = lastbind_bind;
 
 	/* register configuration directives */
@@ -103,6 +103,193 @@ int nssov_filter_byid(nssov_mapinfo *mi,int key,struct berval *id,struct berval
 	return 0;
 }
 
+/* a cached lookup: the entries returned by one internal search */
+typedef struct nssov_cache_entry {
+	struct berval ce_key;
+	time_t ce_expire;
+	int ce_refcnt;
+	int ce_nentries;
+	Entry *ce_entries[1];
+} nssov_cache_entry;
+
+/* entries collected while a lookup is being done */
+typedef struct nssov_cache_cbp {
+	int nentries;
+	Entry *entries[NSSOV_CACHE_MAXENTRIES];
+} nssov_cache_cbp;
+
+static int nssov_cache_cmp(const void *v1,const void *v2)
+{
+	const nssov_cache_entry *c1 = v1, *c2 = v2;
+	int rc = c1->ce_key.bv_len - c2->ce_key.bv_len;
+	if ( rc ) return rc;
+	return memcmp( c1->ce_key.bv_val, c2->ce_key.bv_val, c1->ce_key.bv_len );
+}
+
+/* drop a reference, must be called with ni_cache_mutex held */
+static void nssov_cache_unref(void *v)
+{
+	nssov_cache_entry *ce = v;
+	int i;
+
+	if ( --ce->ce_refcnt > 0 )
+		return;
+	for (i=0; i<ce->ce_nentries; i++)
+		entry_free( ce->ce_entries[i] );
+	ch_free( ce->ce_key.bv_val );
+	ch_free( ce );
+}
+
+/* throw away all cached lookups, must be called with ni_cache_mutex held */
+static void nssov_cache_flush(nssov_info *ni)
+{
+	if ( ni->ni_cache ) {
+		avl_free( ni->ni_cache, nssov_cache_unref );
+		ni->ni_cache = NULL;
+	}
+	ni->ni_cache_count = 0;
+}
+
+/* remember the entries of a lookup while it is being done */
+static int nssov_cache_cb(Operation *op,SlapReply *rs)
+{
+	if ( rs->sr_type == REP_SEARCH ) {
+		nssov_cache_cbp *ccp = op->o_callback->sc_private;
+		if ( ccp->nentries < NSSOV_CACHE_MAXENTRIES )
+			ccp->entries[ccp->nentries] = entry_dup( rs->sr_entry );
+		/* count past the limit so the lookup is known to be too big */
+		if ( ccp->nentries <= NSSOV_CACHE_MAXENTRIES )
+			ccp->nentries++;
+	}
+	return SLAP_CB_CONTINUE;
+}
+
+/* Internal lookups are cached by map, attributes and filter. The
+   same requests tend to arrive over and over from every client of the
+   socket, so even a short TTL saves most of the searches. Results are
+   shared among all callers, and any successful write to the database
+   empties the cache. */
+int nssov_search(Operation *op,nssov_info *ni,nssov_mapinfo *mi,SlapReply *rs)
+{
+	nssov_cache_entry *ce, tmp;
+	nssov_cache_cbp *ccp;
+	slap_callback cb = {0};
+	time_t now;
+	int i, rc;
+
+	if ( ni->ni_cache_ttl <= 0 ||
+		( op->ors_attrs != mi->mi_attrs && op->ors_attrs != slap_anlist_no_attrs ))
+		return op->o_bd->be_search( op, rs );
+
+	/* the key is the map, the attribute list and the filter */
+	tmp.ce_key.bv_len = op->ors_filterstr.bv_len + 2;
+	tmp.ce_key.bv_val = op->o_tmpalloc( tmp.ce_key.bv_len + 1, op->o_tmpmemctx );
+	tmp.ce_key.bv_val[0] = 'a' + ( mi - ni->ni_maps );
+	tmp.ce_key.bv_val[1] = op->ors_attrs == mi->mi_attrs ? 'A' : 'N';
+	AC_MEMCPY( tmp.ce_key.bv_val + 2, op->ors_filterstr.bv_val,
+		op->ors_filterstr.bv_len + 1 );
+
+	now = slap_get_time();
+	ldap_pvt_thread_mutex_lock( &ni->ni_cache_mutex );
+	ce = avl_find( ni->ni_cache, &tmp, nssov_cache_cmp );
+	if ( ce ) {
+		if ( ce->ce_expire > now ) {
+			ce->ce_refcnt++;
+		} else {
+			avl_delete( &ni->ni_cache, ce, nssov_cache_cmp );
+			ni->ni_cache_count--;
+			nssov_cache_unref( ce );
+			ce = NULL;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &ni->ni_cache_mutex );
+
+	if ( ce ) {
+		/* replay the cached entries to the caller's callback */
+		for (i=0; i<ce->ce_nentries; i++) {
+			rs->sr_type = REP_SEARCH;
+			rs->sr_entry = ce->ce_entries[i];
+			rs->sr_flags = 0;
+			(void)op->o_callback->sc_response( op, rs );
+		}
+		rs->sr_type = REP_RESULT;
+		rs->sr_entry = NULL;
+		rs->sr_err = LDAP_SUCCESS;
+		ldap_pvt_thread_mutex_lock( &ni->ni_cache_mutex );
+		nssov_cache_unref( ce );
+		ldap_pvt_thread_mutex_unlock( &ni->ni_cache_mutex );
+		op->o_tmpfree( tmp.ce_key.bv_val, op->o_tmpmemctx );
+		return LDAP_SUCCESS;
+	}
+
+	ccp = op->o_tmpalloc( sizeof(nssov_cache_cbp), op->o_tmpmemctx );
+	ccp->nentries = 0;
+	cb.sc_response = nssov_cache_cb;
+	cb.sc_private = ccp;
+	cb.sc_next = op->o_callback;
+	op->o_callback = &cb;
+	rc = op->o_bd->be_search( op, rs );
+	op->o_callback = cb.sc_next;
+
+	if ( rc == LDAP_SUCCESS && ccp->nentries <= NSSOV_CACHE_MAXENTRIES &&
+		( ccp->nentries || ni->ni_cache_negttl > 0 ))
+	{
+		ce = ch_malloc( sizeof(nssov_cache_entry) +
+			ccp->nentries * sizeof(Entry *) );
+		ber_dupbv( &ce->ce_key, &tmp.ce_key );
+		ce->ce_expire = now + ( ccp->nentries ?
+			ni->ni_cache_ttl : ni->ni_cache_negttl );
+		ce->ce_refcnt = 1;
+		ce->ce_nentries = ccp->nentries;
+		for (i=0; i<ccp->nentries; i++)
+			ce->ce_entries[i] = ccp->entries[i];
+		ccp->nentries = 0;
+
+		ldap_pvt_thread_mutex_lock( &ni->ni_cache_mutex );
+		/* start over rather than track ages when the cache is full */
+		if ( ni->ni_cache_count >= ni->ni_cache_max )
+			nssov_cache_flush( ni );
+		if ( avl_insert( &ni->ni_cache, ce, nssov_cache_cmp, avl_dup_error )) {
+			/* someone else got there first */
+			nssov_cache_unref( ce );
+		} else {
+			ni->ni_cache_count++;
+		}
+		ldap_pvt_thread_mutex_unlock( &ni->ni_cache_mutex );
+	}
+
+	if ( ccp->nentries > NSSOV_CACHE_MAXENTRIES )
+		ccp->nentries = NSSOV_CACHE_MAXENTRIES;
+	for (i=0; i<ccp->nentries; i++)
+		entry_free( ccp->entries[i] );
+	op->o_tmpfree( ccp, op->o_tmpmemctx );
+	op->o_tmpfree( tmp.ce_key.bv_val, op->o_tmpmemctx );
+	return rc;
+}
+
+/* empty the lookup cache whenever the database changes */
+static int nssov_response(Operation *op,SlapReply *rs)
+{
+	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
+	nssov_info *ni = on->on_bi.bi_private;
+
+	if ( rs->sr_type != REP_RESULT || rs->sr_err != LDAP_SUCCESS ||
+		ni->ni_cache_ttl <= 0 )
+		return SLAP_CB_CONTINUE;
+
+	switch ( op->o_tag ) {
+	case LDAP_REQ_ADD:
+	case LDAP_REQ_DELETE:
+	case LDAP_REQ_MODIFY:
+	case LDAP_REQ_MODRDN:
+		ldap_pvt_thread_mutex_lock( &ni->ni_cache_mutex );
+		nssov_cache_flush( ni );
+		ldap_pvt_thread_mutex_unlock( &ni->ni_cache_mutex );
+		break;
+	}
+	return SLAP_CB_CONTINUE;
+}
+
 void get_userpassword(struct berval *attr,struct berval *pw)
 {
 	int i;
@@ -560,6 +747,24 @@ static ConfigTable nsscfg[] = {
 			"DESC 'Password Manager Pwd' "
 			"EQUALITY octetStringMatch "
 			"SYNTAX OMsOctetString SINGLE-VALUE )", NULL, NULL },
+	{ "nssov-cache-ttl", "seconds", 2, 2, 0,
+		ARG_OFFSET|ARG_INT,
+		(void *)offsetof(struct nssov_info, ni_cache_ttl),
+		"(OLcfgCtAt:3.15 NAME 'olcNssCacheTTL' "
+			"DESC 'Seconds to cache lookup results' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "nssov-cache-negttl", "seconds", 2, 2, 0,
+		ARG_OFFSET|ARG_INT,
+		(void *)offsetof(struct nssov_info, ni_cache_negttl),
+		"(OLcfgCtAt:3.16 NAME 'olcNssCacheNegTTL' "
+			"DESC 'Seconds to cache lookups that found nothing' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "nssov-cache-max", "count", 2, 2, 0,
+		ARG_OFFSET|ARG_INT,
+		(void *)offsetof(struct nssov_info, ni_cache_max),
+		"(OLcfgCtAt:3.17 NAME 'olcNssCacheMax' "
+			"DESC 'Maximum number of cached lookups' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0,0,0, ARG_IGNORED }
 };
 
@@ -571,7 +776,8 @@ static ConfigOCs nssocs[] = {
 		"MAY ( olcNssSsd $ olcNssMap $ olcNssPam $ olcNssPamDefHost $ "
 			"olcNssPamGroupDN $ olcNssPamGroupAD $ "
 			"olcNssPamMinUid $ olcNssPamMaxUid $ olcNssPamSession $ "
-			"olcNssPamTemplateAD $ olcNssPamTemplate ) )",
+			"olcNssPamTemplateAD $ olcNssPamTemplate $ "
+			"olcNssCacheTTL $ olcNssCacheNegTTL $ olcNssCacheMax ) )",
 		Cft_Overlay, nsscfg },
 	{ NULL, 0, NULL }
 };
@@ -795,6 +1001,9 @@ nssov_db_init(
 	ni->ni_db = be->bd_self;
 	ni->ni_pam_opts = NI_PAM_UID2DN;
 
+	ni->ni_cache_max = NSSOV_CACHE_MAX;
+	ldap_pvt_thread_mutex_init( &ni->ni_cache_mutex );
+
 	return 0;
 }
 
@@ -803,6 +1012,13 @@ nssov_db_destroy(
 	BackendDB *be,
 	ConfigReply *cr )
 {
+	slap_overinst *on = (slap_overinst *)be->bd_info;
+	nssov_info *ni = on->on_bi.bi_private;
+
+	if ( ni ) {
+		nssov_cache_flush( ni );
+		ldap_pvt_thread_mutex_destroy( &ni->ni_cache_mutex );
+	}
 	return 0;
 }
 
@@ -975,6 +1191,7 @@ nssov_initialize( void )
 	nssov.on_bi.bi_db_destroy = nssov_db_destroy;
 	nssov.on_bi.bi_db_open = nssov_db_open;
 	nssov.on_bi.bi_db_close = nssov_db_close;
+	nssov.on_response = nssov_response;
 
 	nssov.on_bi.bi_cf_ocs = nssocs;
 
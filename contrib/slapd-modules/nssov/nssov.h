@@ -92,8 +92,22 @@ typedef struct nssov_info
 	struct berval ni_pam_password_prohibit_message;
 	struct berval ni_pam_pwdmgr_dn;
 	struct berval ni_pam_pwdmgr_pwd;
+
+	/* lookup cache */
+	ldap_pvt_thread_mutex_t ni_cache_mutex;
+	Avlnode *ni_cache;
+	int ni_cache_count;
+	int ni_cache_max;
+	int ni_cache_ttl;
+	int ni_cache_negttl;
 } nssov_info;
 
+/* default number of cached lookups */
+#define NSSOV_CACHE_MAX	4096
+
+/* lookups returning more entries than this are not cached */
+#define NSSOV_CACHE_MAXENTRIES	64
+
 #define NI_PAM_USERHOST		1	/* old style host checking */
 #define NI_PAM_USERSVC		2	/* old style service checking */
 #define NI_PAM_USERGRP		4	/* old style group checking */
@@ -201,6 +215,10 @@ int nssov_dn2uid(Operation *op,nssov_info *ni,struct berval *dn,struct berval *u
 int nssov_uid2dn(Operation *op,nssov_info *ni,struct berval *uid,struct berval *dn);
 int nssov_name2dn_cb(Operation *op, SlapReply *rs);
 
+/* Does the internal search set up in op, answering from the lookup
+   cache when possible. */
+int nssov_search(Operation *op,nssov_info *ni,nssov_mapinfo *mi,SlapReply *rs);
+
 /* Escapes characters in a string for use in a search filter. */
 int nssov_escape(struct berval *src,struct berval *dst);
 
@@ -338,7 +356,7 @@ int pam_pwmod(nssov_info *ni,TFILE *fp,Operation *op,uid_t calleruid);
 	op->ors_tlimit = SLAP_NO_LIMIT; \
 	op->ors_slimit = SLAP_NO_LIMIT; \
     /* do the internal search */ \
-	op->o_bd->be_search( op, &rs ); \
+	nssov_search( op, ni, cbp.mi, &rs ); \
 	filter_free_x( op, op->ors_filter, 1 ); \
 	WRITE_INT32(fp,NSLCD_RESULT_END); \
     return 0; \
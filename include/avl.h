@@ -59,6 +59,13 @@ struct tavlnode {
 	signed char		avl_bf;
 };
 
+typedef struct btnode Btree;
+
+typedef struct btcursor {
+	Btree	*bc_node;
+	int	bc_pos;
+} BtreeCursor;
+
 #ifdef AVL_INTERNAL
 
 /* balance factor values */
@@ -153,6 +160,30 @@ tavl_end LDAP_P((TAvlnode *, int direction));
 LDAP_AVL_F( TAvlnode* )
 tavl_next LDAP_P((TAvlnode *, int direction));
 
+LDAP_AVL_F( int )
+btree_free LDAP_P(( Btree *root, AVL_FREE dfree ));
+
+LDAP_AVL_F( int )
+btree_insert LDAP_P((Btree **, void*, AVL_CMP, AVL_DUP));
+
+LDAP_AVL_F( void* )
+btree_delete LDAP_P((Btree **, void*, AVL_CMP));
+
+LDAP_AVL_F( void* )
+btree_find LDAP_P((Btree *, const void*, AVL_CMP));
+
+LDAP_AVL_F( void* )
+btree_find3 LDAP_P((Btree *, const void*, AVL_CMP, BtreeCursor *, int *ret));
+
+LDAP_AVL_F( void* )
+btree_end LDAP_P((Btree *, BtreeCursor *, int direction));
+
+LDAP_AVL_F( void* )
+btree_next LDAP_P((BtreeCursor *, int direction));
+
+LDAP_AVL_F( int )
+btree_apply LDAP_P((Btree *, AVL_APPLY, void*, int, int));
+
 /* apply traversal types */
 #define AVL_PREORDER	1
 #define AVL_INORDER	2
@@ -113,6 +113,7 @@ LDAP_BEGIN_DECL
 /* get/set Memory Debug options */
 #define LBER_OPT_MEMORY_INUSE		0x8005	/* for memory debugging */
 #define LBER_OPT_LOG_PROC           0x8006  /* for external logging function */
+#define LBER_OPT_MEMORY_COUNT		0x8007	/* count heap allocations */
 
 typedef int* (*BER_ERRNO_FN) LDAP_P(( void ));
 
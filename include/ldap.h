@@ -324,6 +324,8 @@ typedef struct ldapcontrol {
 #define LDAP_CONTROL_VALSORT			"1.3.6.1.4.1.4203.666.5.14"
 #define	LDAP_CONTROL_X_DEREF			"1.3.6.1.4.1.4203.666.5.16"
 #define	LDAP_CONTROL_X_WHATFAILED		"1.3.6.1.4.1.4203.666.5.17"
+#define	LDAP_CONTROL_X_EXPLAIN			"1.3.6.1.4.1.4203.666.5.18"
+#define	LDAP_CONTROL_X_TRACE			"1.3.6.1.4.1.4203.666.5.19"
 
 /* LDAP Chaining Behavior Control *//* work in progress */
 /* <draft-sermersheim-ldap-chaining>;
@@ -402,6 +404,9 @@ typedef struct ldapcontrol {
 
 #define LDAP_TAG_EXOP_VERIFY_CREDENTIALS_COOKIE	 ((ber_tag_t) 0x80U)
 #define LDAP_TAG_EXOP_VERIFY_CREDENTIALS_SCREDS	 ((ber_tag_t) 0x81U)
+
+#define LDAP_EXOP_X_METRICS	"1.3.6.1.4.1.4203.666.6.6"	/* server metrics */
+#define LDAP_EXOP_X_MDB_SNAPSHOT	"1.3.6.1.4.1.4203.666.6.7"	/* back-mdb snapshot */
 #define LDAP_TAG_EXOP_VERIFY_CREDENTIALS_CONTROLS ((ber_tag_t) 0xa2U) /* context specific + constructed + 2 */
 
 #define LDAP_EXOP_WHO_AM_I		"1.3.6.1.4.1.4203.1.11.3"		/* RFC 4532 */
@@ -1552,6 +1557,34 @@ ldap_dup LDAP_P((
 LDAP_F( int )
 ldap_connect( LDAP *ld );
 
+/*
+ * in pool.c:
+ */
+typedef struct ldap_pool LDAPPool;
+
+LDAP_F( int )
+ldap_pool_create LDAP_P((
+	LDAPPool **poolp,
+	LDAP_CONST char *uris,
+	int size,
+	LDAP_CONST char *binddn,
+	struct berval *cred ));
+
+LDAP_F( int )
+ldap_pool_get LDAP_P((
+	LDAPPool *pool,
+	LDAP **ldp ));
+
+LDAP_F( int )
+ldap_pool_put LDAP_P((
+	LDAPPool *pool,
+	LDAP *ld,
+	int rc ));
+
+LDAP_F( int )
+ldap_pool_destroy LDAP_P((
+	LDAPPool *pool ));
+
 /*
  * in tls.c
  */
@@ -1803,6 +1836,16 @@ ldap_get_attribute_ber LDAP_P((
 	LDAP *ld, LDAPMessage *e, BerElement *ber, struct berval *attr,
 	struct berval **vals ));
 
+LDAP_F( int )
+ldap_get_attribute_type_ber LDAP_P((
+	LDAP *ld, LDAPMessage *e, BerElement *ber, struct berval *attr,
+	char **last ));
+
+LDAP_F( int )
+ldap_get_value_ber LDAP_P((
+	LDAP *ld, LDAPMessage *e, BerElement *ber, char *last,
+	struct berval *val ));
+
 /*
  * in getattr.c
  */
@@ -1863,6 +1906,17 @@ ldap_result LDAP_P((
 	struct timeval *timeout,
 	LDAPMessage **result ));
 
+typedef int (LDAP_RESULT_PROC) LDAP_P((
+	LDAP *ld,
+	LDAPMessage *msg,
+	void *arg ));
+
+LDAP_F( int )
+ldap_process_input LDAP_P((
+	LDAP *ld,
+	LDAP_RESULT_PROC *proc,
+	void *arg ));
+
 LDAP_F( int )
 ldap_msgtype LDAP_P((
 	LDAPMessage *lm ));
@@ -218,6 +218,15 @@ ldap_pvt_thread_pool_submit2 LDAP_P((
 	void *arg,
 	void **cookie ));
 
+/* Queue the task ahead of all non-priority tasks when prio is set */
+LDAP_F( int )
+ldap_pvt_thread_pool_submit_prio LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	ldap_pvt_thread_start_t *start,
+	void *arg,
+	void **cookie,
+	int prio ));
+
 LDAP_F( int )
 ldap_pvt_thread_pool_retract LDAP_P((
 	void *cookie ));
@@ -239,6 +248,11 @@ ldap_pvt_thread_pool_queues LDAP_P((
 	ldap_pvt_thread_pool_t *pool,
 	int numqs ));
 
+LDAP_F( int )
+ldap_pvt_thread_pool_affinity LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	int on ));
+
 #ifndef LDAP_PVT_THREAD_H_DONE
 typedef enum {
 	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN = -1,
@@ -253,7 +267,8 @@ typedef enum {
 	LDAP_PVT_THREAD_POOL_PARAM_ACTIVE_MAX,
 	LDAP_PVT_THREAD_POOL_PARAM_PENDING_MAX,
 	LDAP_PVT_THREAD_POOL_PARAM_BACKLOAD_MAX,
-	LDAP_PVT_THREAD_POOL_PARAM_STATE
+	LDAP_PVT_THREAD_POOL_PARAM_STATE,
+	LDAP_PVT_THREAD_POOL_PARAM_STEALS
 } ldap_pvt_thread_pool_param_t;
 #endif /* !LDAP_PVT_THREAD_H_DONE */
 
@@ -262,6 +277,29 @@ ldap_pvt_thread_pool_query LDAP_P((
 	ldap_pvt_thread_pool_t *pool,
 	ldap_pvt_thread_pool_param_t param, void *value ));
 
+/* Wait times are counted in buckets of 16us << 2*i */
+#define LDAP_PVT_THREAD_POOL_WAIT_BUCKETS	11
+
+typedef struct ldap_pvt_thread_pool_stats_s {
+	int lps_open;
+	int lps_active;
+	int lps_pending;
+	int lps_pending_max;	/* highest pending count seen at submit */
+	unsigned long lps_submitted;
+	unsigned long lps_prio;	/* priority submits */
+	unsigned long lps_steals;
+	unsigned long lps_starved;	/* submits finding no free thread */
+	unsigned long lps_wait[LDAP_PVT_THREAD_POOL_WAIT_BUCKETS];
+	unsigned long lps_pauses;	/* whole pool only */
+	unsigned long lps_pause_msec;
+} ldap_pvt_thread_pool_stats_t;
+
+LDAP_F( int )
+ldap_pvt_thread_pool_stats LDAP_P((
+	ldap_pvt_thread_pool_t *tpool,
+	int q,
+	ldap_pvt_thread_pool_stats_t *st ));
+
 LDAP_F( int )
 ldap_pvt_thread_pool_pausing LDAP_P((
 	ldap_pvt_thread_pool_t *pool ));
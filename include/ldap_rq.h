@@ -30,12 +30,26 @@ typedef struct re_s {
 	char *tname;
 	char *tspec;
 	void *pool_cookie;
+	int heap_pos;		/* 1-based slot in rq_heap, 0 if not scheduled */
+	int running;
+	struct timeval run_start;
+	unsigned long runs;		/* times started */
+	unsigned long run_usec;		/* total run time */
+	unsigned long max_usec;		/* longest run */
+	time_t late;		/* seconds past next_sched at last start */
+	time_t max_late;
 } re_t;
 
 typedef struct runqueue_s {
 	LDAP_STAILQ_HEAD(l, re_s) task_list;
 	LDAP_STAILQ_HEAD(rl, re_s) run_list;
 	ldap_pvt_thread_mutex_t	rq_mutex;
+	unsigned long rq_runs;	/* tasks started */
+	unsigned long rq_late;	/* tasks started after their scheduled second */
+	struct re_s **rq_heap;	/* scheduled tasks, earliest first */
+	int rq_nheap;
+	int rq_heapmax;
+	int rq_ntasks;
 } runqueue_t;
 
 LDAP_F( struct re_s* )
@@ -144,8 +144,20 @@ ber_realloc( BerElement *ber, ber_len_t len )
 #define LBER_EXBUFSIZ	4060 /* a few words less than 2^N for binary buddy */
 #if defined( LBER_EXBUFSIZ ) && LBER_EXBUFSIZ > 0
 # ifndef notdef
-	/* don't realloc by small amounts */
-	total += len < LBER_EXBUFSIZ ? LBER_EXBUFSIZ : len;
+	/* don't realloc by small amounts; grow big buffers by half their
+	 * size, so that encoding a large PDU does not copy it over and
+	 * over again */
+	{
+		ber_len_t grow = total / 2;
+
+		if ( grow < LBER_EXBUFSIZ ) {
+			grow = LBER_EXBUFSIZ;
+		}
+		if ( grow < len || total + grow > (ber_len_t)-1 / 2 ) {
+			grow = len;
+		}
+		total += grow;
+	}
 # else
 	{	/* not sure what value this adds.  reduce fragmentation? */
 		ber_len_t have = (total + (LBER_EXBUFSIZE - 1)) / LBER_EXBUFSIZ;
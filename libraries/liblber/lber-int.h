@@ -191,6 +191,7 @@ LBER_V (FILE *) ber_pvt_err_file;
 /* memory.c */
 	/* simple macros to realloc for now */
 LBER_V (BerMemoryFunctions *)	ber_int_memory_fns;
+LBER_V (unsigned long *)	ber_int_memory_count;
 LBER_F (char *)	ber_strndup( LDAP_CONST char *, ber_len_t );
 LBER_F (char *)	ber_strndup_x( LDAP_CONST char *, ber_len_t, void *ctx );
 
@@ -122,6 +122,12 @@ static unsigned char endpattern[4] = { 0xd1, 0xed, 0xde, 0xca };
 
 BerMemoryFunctions *ber_int_memory_fns = NULL;
 
+/* If set, incremented for every allocation that goes to the C library */
+unsigned long *ber_int_memory_count = NULL;
+#define BER_MEM_COUNT()	do { \
+		if ( ber_int_memory_count ) (*ber_int_memory_count)++; \
+	} while(0)
+
 void
 ber_memfree_x( void *p, void *ctx )
 {
@@ -200,6 +206,7 @@ ber_memalloc_x( ber_len_t s, void *ctx )
 	}
 
 	if( ber_int_memory_fns == NULL || ctx == NULL ) {
+		BER_MEM_COUNT();
 #ifdef LDAP_MEMORY_DEBUG
 		new = malloc(s + sizeof(struct ber_mem_hdr) + sizeof( ber_int_t));
 		if( new )
@@ -255,6 +262,7 @@ ber_memcalloc_x( ber_len_t n, ber_len_t s, void *ctx )
 	}
 
 	if( ber_int_memory_fns == NULL || ctx == NULL ) {
+		BER_MEM_COUNT();
 #ifdef LDAP_MEMORY_DEBUG
 		new = n < (-sizeof(struct ber_mem_hdr) - sizeof(ber_int_t)) / s
 			? calloc(1, n*s + sizeof(struct ber_mem_hdr) + sizeof(ber_int_t))
@@ -319,6 +327,7 @@ ber_memrealloc_x( void* p, ber_len_t s, void *ctx )
 	BER_MEM_VALID( p );
 
 	if( ber_int_memory_fns == NULL || ctx == NULL ) {
+		BER_MEM_COUNT();
 #ifdef LDAP_MEMORY_DEBUG
 		ber_int_t oldlen;
 		struct ber_mem_hdr *mh = (struct ber_mem_hdr *)
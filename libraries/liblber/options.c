@@ -124,6 +124,14 @@ ber_set_option(
 	BerElement *ber;
 	Sockbuf *sb;
 
+	if(item == NULL && option == LBER_OPT_MEMORY_COUNT) {
+		/* invalue is the counter, NULL stops counting.
+		 * Not thread safe, meant for single threaded benchmarks.
+		 */
+		ber_int_memory_count = (unsigned long *) invalue;
+		return LBER_OPT_SUCCESS;
+	}
+
 	if(invalue == NULL) {
 		/* no place to set from */
 		ber_errno = LBER_ERROR_PARAM;
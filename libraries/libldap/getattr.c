@@ -155,3 +155,76 @@ ldap_get_attribute_ber( LDAP *ld, LDAPMessage *entry, BerElement *ber,
 
 	return rc;
 }
+
+/* Like ldap_get_attribute_ber(), but without allocating the array of
+ * values: the attribute type is fetched and *last marks the end of
+ * its values, which are then fetched one at a time, in-place, with
+ * ldap_get_value_ber().  A NULL attr->bv_val means no more attributes.
+ */
+/* ARGSUSED */
+int
+ldap_get_attribute_type_ber( LDAP *ld, LDAPMessage *entry, BerElement *ber,
+	BerValue *attr, char **last )
+{
+	ber_len_t len;
+	int rc = LDAP_SUCCESS;
+
+	Debug( LDAP_DEBUG_TRACE, "ldap_get_attribute_type_ber\n", 0, 0, 0 );
+
+	assert( ld != NULL );
+	assert( LDAP_VALID( ld ) );
+	assert( entry != NULL );
+	assert( ber != NULL );
+	assert( attr != NULL );
+	assert( last != NULL );
+
+	attr->bv_val = NULL;
+	attr->bv_len = 0;
+
+	if ( ber_pvt_ber_remaining( ber ) ) {
+		/* skip sequence, snarf attribute type, enter the set */
+		if ( ber_scanf( ber, "{m", attr ) == LBER_ERROR ||
+			( ber_first_element( ber, &len, last ) == LBER_DEFAULT &&
+			*last == NULL ) )
+		{
+			attr->bv_val = NULL;
+			attr->bv_len = 0;
+			rc = ld->ld_errno = LDAP_DECODING_ERROR;
+		}
+	}
+
+	return rc;
+}
+
+/* Fetch the next value of the attribute last returned by
+ * ldap_get_attribute_type_ber(), in-place.  A NULL val->bv_val
+ * means no more values.
+ */
+/* ARGSUSED */
+int
+ldap_get_value_ber( LDAP *ld, LDAPMessage *entry, BerElement *ber,
+	char *last, BerValue *val )
+{
+	ber_len_t len;
+	int rc = LDAP_SUCCESS;
+
+	assert( ld != NULL );
+	assert( LDAP_VALID( ld ) );
+	assert( entry != NULL );
+	assert( ber != NULL );
+	assert( last != NULL );
+	assert( val != NULL );
+
+	val->bv_val = NULL;
+	val->bv_len = 0;
+
+	if ( ber_next_element( ber, &len, last ) != LBER_DEFAULT &&
+		ber_scanf( ber, "m", val ) == LBER_ERROR )
+	{
+		val->bv_val = NULL;
+		val->bv_len = 0;
+		rc = ld->ld_errno = LDAP_DECODING_ERROR;
+	}
+
+	return rc;
+}
@@ -216,6 +216,9 @@ struct ldapoptions {
 
 	int		ldo_refhoplimit;	/* limit on referral nesting */
 
+	/* seconds to reuse resolved host addresses, 0 to disable */
+	int		ldo_resolv_ttl;
+
 	/* LDAPv3 server and client controls */
 	LDAPControl	**ldo_sctrls;
 	LDAPControl **ldo_cctrls;
@@ -233,7 +236,7 @@ struct ldapoptions {
 
 	LDAP_BOOLEANS ldo_booleans;	/* boolean options */
 
-#define LDAP_LDO_NULLARG	,0,0,0,0 ,{0},{0} ,0,0,0,0, 0,0,0,0, 0,0, 0,0,0,0,0,0, 0, 0
+#define LDAP_LDO_NULLARG	,0,0,0,0 ,{0},{0} ,0,0,0,0, 0,0,0,0, 0, 0,0, 0,0,0,0,0,0, 0, 0
 
 #ifdef LDAP_CONNECTIONLESS
 #define	LDAP_IS_UDP(ld)		((ld)->ld_options.ldo_is_udp)
@@ -364,6 +367,7 @@ typedef struct ldapreq {
 	struct ldapreq	*lr_refnext;	/* next referral spawned */
 	struct ldapreq	*lr_prev;	/* previous request */
 	struct ldapreq	*lr_next;	/* next request */
+	struct ldapreq	*lr_hnext;	/* next request in msgid hash bucket */
 } LDAPRequest;
 
 /*
@@ -409,9 +413,12 @@ struct ldap_common {
 	/* do not mess with these */
 	/* protected by req_mutex */
 	LDAPRequest	*ldc_requests;	/* list of outstanding requests */
+#define LDAP_REQ_BUCKETS	64	/* requests hashed by msgid */
+	LDAPRequest	*ldc_req_hash[LDAP_REQ_BUCKETS];
 	/* protected by res_mutex */
 	LDAPMessage	*ldc_responses;	/* list of outstanding responses */
 #define	ld_requests		ldc->ldc_requests
+#define	ld_req_hash		ldc->ldc_req_hash
 #define	ld_responses		ldc->ldc_responses
 
 	/* protected by abandon_mutex */
@@ -744,6 +751,7 @@ LDAP_F (int) ldap_send_server_request( LDAP *ld, BerElement *ber,
 	LDAPConn *lc, LDAPreqinfo *bind, int noconn, int m_res );
 LDAP_F (LDAPConn *) ldap_new_connection( LDAP *ld, LDAPURLDesc **srvlist,
 	int use_ldsb, int connect, LDAPreqinfo *bind, int m_req, int m_res );
+LDAP_F (void) ldap_insert_request( LDAP *ld, LDAPRequest *lr );
 LDAP_F (LDAPRequest *) ldap_find_request_by_msgid( LDAP *ld, ber_int_t msgid );
 LDAP_F (void) ldap_return_request( LDAP *ld, LDAPRequest *lr, int freeit );
 LDAP_F (void) ldap_free_request( LDAP *ld, LDAPRequest *lr );
@@ -601,6 +601,31 @@ ldif_sput_wrap(
 		byte < stop - 2;
 	    byte += 3 )
 	{
+		/* emit the groups that fit on the current line in one go,
+		 * only the one that straddles the wrap goes digit by digit
+		 */
+		if ( len < wrap ) {
+			ber_len_t n = ( wrap - len ) / 4;
+			ber_len_t left = ( stop - byte ) / 3;
+			char *o = *out;
+
+			if ( n > left )
+				n = left;
+			len += n * 4;
+			for ( ; n > 0; n--, byte += 3 ) {
+				bits = (byte[0] & 0xff) << 16;
+				bits |= (byte[1] & 0xff) << 8;
+				bits |= (byte[2] & 0xff);
+				*o++ = nib2b64[ bits >> 18 ];
+				*o++ = nib2b64[ ( bits >> 12 ) & 0x3f ];
+				*o++ = nib2b64[ ( bits >> 6 ) & 0x3f ];
+				*o++ = nib2b64[ bits & 0x3f ];
+			}
+			*out = o;
+			if ( byte >= stop - 2 )
+				break;
+		}
+
 		bits = (byte[0] & 0xff) << 16;
 		bits |= (byte[1] & 0xff) << 8;
 		bits |= (byte[2] & 0xff);
@@ -762,11 +787,29 @@ ldif_read_record(
 	char        **bufp,     /* ptr to malloced output buffer           */
 	int         *buflenp )  /* ptr to length of *bufp                  */
 {
-	char        line[LDIF_MAXLINE], *nbufp;
+	char        *line, *nbufp;
 	ber_len_t   lcur = 0, len;
 	int         last_ch = '\n', found_entry = 0, stop, top_comment = 0;
 
 	for ( stop = 0;  !stop;  last_ch = line[len-1] ) {
+		/* Lines are read straight into the output buffer, at its
+		 * end; a line is kept by just moving lcur past it.
+		 */
+		if ( *buflenp - lcur <= LDIF_MAXLINE ) {
+			int newlen = *buflenp * 2;
+
+			if ( (ber_len_t)newlen < lcur + LDIF_MAXLINE + 1 ) {
+				newlen = lcur + LDIF_MAXLINE + 1;
+			}
+			nbufp = ber_memrealloc( *bufp, newlen );
+			if( nbufp == NULL ) {
+				return 0;
+			}
+			*bufp = nbufp;
+			*buflenp = newlen;
+		}
+		line = *bufp + lcur;
+
 		/* If we're at the end of this file, see if we should pop
 		 * back to a previous file. (return from an include)
 		 */
@@ -782,7 +825,7 @@ ldif_read_record(
 			}
 		}
 		if ( !stop ) {
-			if ( fgets( line, sizeof( line ), lfp->fp ) == NULL ) {
+			if ( fgets( line, LDIF_MAXLINE, lfp->fp ) == NULL ) {
 				stop = 1;
 				len = 0;
 			} else {
@@ -871,17 +914,11 @@ ldif_read_record(
 		}
 
 last:
-		if ( *buflenp - lcur <= len ) {
-			*buflenp += len + LDIF_MAXLINE;
-			nbufp = ber_memrealloc( *bufp, *buflenp );
-			if( nbufp == NULL ) {
-				return 0;
-			}
-			*bufp = nbufp;
-		}
-		strcpy( *bufp + lcur, line );
 		lcur += len;
 	}
 
+	/* drop whatever was read past the record */
+	(*bufp)[lcur] = '\0';
+
 	return( found_entry );
 }
@@ -536,6 +536,406 @@ ldap_int_connect_cbs(LDAP *ld, Sockbuf *sb, ber_socket_t *s, LDAPURLDesc *srv, s
 	return 0;
 }
 
+#if defined( HAVE_GETADDRINFO ) && defined( HAVE_INET_NTOP )
+
+/* one resolved address */
+typedef struct ldap_int_addr {
+	int		la_family;
+	ber_socklen_t	la_len;
+#ifdef LDAP_PF_INET6
+	struct sockaddr_storage	la_addr;
+#else
+	struct sockaddr_in	la_addr;
+#endif
+} ldap_int_addr;
+
+/* recently resolved names, shared by all handles in the process */
+typedef struct ldap_int_resolv_cache {
+	char		*rc_host;
+	char		rc_serv[7];
+	int		rc_family;
+	int		rc_socktype;
+	time_t		rc_expire;
+	int		rc_naddrs;
+	ldap_int_addr	*rc_addrs;
+} ldap_int_resolv_cache;
+
+#define LDAP_RESOLV_CACHE_SIZE	16
+
+/* protected by ldap_int_resolv_mutex */
+static ldap_int_resolv_cache ldap_int_resolv_cached[LDAP_RESOLV_CACHE_SIZE];
+
+/* msec to wait for a pending connection attempt before starting
+ * the next one, as recommended by RFC 8305 */
+#define LDAP_CONNECT_STAGGER	250
+
+static int
+ldap_int_resolv_cache_get( const char *host, const char *serv,
+	struct addrinfo *hints, ldap_int_addr **addrs, int *naddrs )
+{
+	ldap_int_resolv_cache *rc;
+	time_t now = time( NULL );
+	int i;
+
+	for ( i = 0; i < LDAP_RESOLV_CACHE_SIZE; i++ ) {
+		rc = &ldap_int_resolv_cached[i];
+		if ( rc->rc_host == NULL || rc->rc_expire <= now ||
+			rc->rc_family != hints->ai_family ||
+			rc->rc_socktype != hints->ai_socktype ||
+			strcmp( rc->rc_serv, serv ) ||
+			strcasecmp( rc->rc_host, host ))
+			continue;
+
+		*addrs = LDAP_MALLOC( rc->rc_naddrs * sizeof(ldap_int_addr) );
+		if ( *addrs == NULL )
+			return -1;
+		AC_MEMCPY( *addrs, rc->rc_addrs, rc->rc_naddrs * sizeof(ldap_int_addr) );
+		*naddrs = rc->rc_naddrs;
+		return 0;
+	}
+	return -1;
+}
+
+static void
+ldap_int_resolv_cache_put( const char *host, const char *serv,
+	struct addrinfo *hints, ldap_int_addr *addrs, int naddrs, int ttl )
+{
+	ldap_int_resolv_cache *rc, *victim = NULL;
+	ldap_int_addr *copy;
+	char *hcopy;
+	int i;
+
+	/* replace the entry for this name, else the one closest to expiry */
+	for ( i = 0; i < LDAP_RESOLV_CACHE_SIZE; i++ ) {
+		rc = &ldap_int_resolv_cached[i];
+		if ( rc->rc_host == NULL ) {
+			if ( victim == NULL || victim->rc_host != NULL )
+				victim = rc;
+			continue;
+		}
+		if ( rc->rc_family == hints->ai_family &&
+			rc->rc_socktype == hints->ai_socktype &&
+			!strcmp( rc->rc_serv, serv ) &&
+			!strcasecmp( rc->rc_host, host ))
+		{
+			victim = rc;
+			break;
+		}
+		if ( victim == NULL || ( victim->rc_host != NULL &&
+			rc->rc_expire < victim->rc_expire ))
+			victim = rc;
+	}
+
+	copy = LDAP_MALLOC( naddrs * sizeof(ldap_int_addr) );
+	hcopy = LDAP_STRDUP( host );
+	if ( copy == NULL || hcopy == NULL ) {
+		LDAP_FREE( copy );
+		LDAP_FREE( hcopy );
+		return;
+	}
+	AC_MEMCPY( copy, addrs, naddrs * sizeof(ldap_int_addr) );
+
+	LDAP_FREE( victim->rc_host );
+	LDAP_FREE( victim->rc_addrs );
+	victim->rc_host = hcopy;
+	strcpy( victim->rc_serv, serv );
+	victim->rc_family = hints->ai_family;
+	victim->rc_socktype = hints->ai_socktype;
+	victim->rc_expire = time( NULL ) + ttl;
+	victim->rc_naddrs = naddrs;
+	victim->rc_addrs = copy;
+}
+
+/*
+ * Resolve host and serv into an array of addresses, using the
+ * process-wide cache if enabled.  Addresses of different families
+ * are interleaved, so that a broken path to one family can't stall
+ * the connection attempts (RFC 8305).
+ * The caller must LDAP_FREE() *addrsp.
+ */
+static int
+ldap_int_resolve( LDAP *ld, const char *host, const char *serv,
+	struct addrinfo *hints, ldap_int_addr **addrsp, int *naddrsp )
+{
+	struct addrinfo *res, *sai;
+	ldap_int_addr *addrs, *sorted;
+	int ttl = ld->ld_options.ldo_resolv_ttl;
+	int err, i, j, k, naddrs = 0;
+
+	/* most getaddrinfo(3) use non-threadsafe resolver libraries */
+	LDAP_MUTEX_LOCK(&ldap_int_resolv_mutex);
+
+	if ( ttl > 0 && ldap_int_resolv_cache_get( host, serv, hints,
+		addrsp, naddrsp ) == 0 )
+	{
+		LDAP_MUTEX_UNLOCK(&ldap_int_resolv_mutex);
+		osip_debug(ld, "ldap_int_resolve: %s found in cache\n",
+			host, 0, 0);
+		return 0;
+	}
+
+	err = getaddrinfo( host, serv, hints, &res );
+
+	LDAP_MUTEX_UNLOCK(&ldap_int_resolv_mutex);
+
+	if ( err != 0 ) {
+		osip_debug(ld, "ldap_connect_to_host: getaddrinfo failed: %s\n",
+			AC_GAI_STRERROR(err), 0, 0);
+		return -1;
+	}
+
+	for ( sai = res; sai != NULL; sai = sai->ai_next ) {
+		if ( sai->ai_addr == NULL ) {
+			osip_debug(ld, "ldap_connect_to_host: getaddrinfo "
+				"ai_addr is NULL?\n", 0, 0, 0);
+			continue;
+		}
+		naddrs++;
+	}
+
+	addrs = LDAP_MALLOC( 2 * naddrs * sizeof(ldap_int_addr) + 1 );
+	if ( addrs == NULL ) {
+		freeaddrinfo( res );
+		return -1;
+	}
+	sorted = addrs + naddrs;
+
+	for ( i = 0, sai = res; sai != NULL; sai = sai->ai_next ) {
+		if ( sai->ai_addr == NULL || sai->ai_addrlen > sizeof(addrs[i].la_addr) )
+			continue;
+		addrs[i].la_family = sai->ai_family;
+		addrs[i].la_len = sai->ai_addrlen;
+		AC_MEMCPY( &addrs[i].la_addr, sai->ai_addr, sai->ai_addrlen );
+		i++;
+	}
+	naddrs = i;
+	freeaddrinfo( res );
+
+	/* interleave families, keeping the resolver's order otherwise */
+	for ( k = 0; k < naddrs; k++ ) {
+		int family = k ? sorted[k-1].la_family : AF_UNSPEC;
+
+		for ( j = 0; j < naddrs; j++ ) {
+			if ( addrs[j].la_family != AF_UNSPEC &&
+				addrs[j].la_family != family )
+				break;
+		}
+		if ( j == naddrs ) {
+			/* only the same family is left */
+			for ( j = 0; addrs[j].la_family == AF_UNSPEC; j++ )
+				;
+		}
+		sorted[k] = addrs[j];
+		addrs[j].la_family = AF_UNSPEC;
+	}
+	AC_MEMCPY( addrs, sorted, naddrs * sizeof(ldap_int_addr) );
+
+	if ( ttl > 0 && naddrs > 0 ) {
+		LDAP_MUTEX_LOCK(&ldap_int_resolv_mutex);
+		ldap_int_resolv_cache_put( host, serv, hints, addrs, naddrs, ttl );
+		LDAP_MUTEX_UNLOCK(&ldap_int_resolv_mutex);
+	}
+
+	*addrsp = addrs;
+	*naddrsp = naddrs;
+	return 0;
+}
+
+static void
+ldap_int_addr_debug( LDAP *ld, ldap_int_addr *la, const char *serv )
+{
+	switch ( la->la_family ) {
+#ifdef LDAP_PF_INET6
+	case AF_INET6: {
+		char addr[INET6_ADDRSTRLEN];
+		inet_ntop( AF_INET6,
+			&((struct sockaddr_in6 *)&la->la_addr)->sin6_addr,
+			addr, sizeof addr);
+		osip_debug(ld, "ldap_connect_to_host: Trying %s %s\n", 
+			addr, serv, 0);
+	} break;
+#endif
+	case AF_INET: {
+		char addr[INET_ADDRSTRLEN];
+		inet_ntop( AF_INET,
+			&((struct sockaddr_in *)&la->la_addr)->sin_addr,
+			addr, sizeof addr);
+		osip_debug(ld, "ldap_connect_to_host: Trying %s:%s\n", 
+			addr, serv, 0);
+	} break;
+	}
+}
+
+#ifdef HAVE_POLL
+static long
+ldap_int_msec_since( struct timeval *tv )
+{
+	struct timeval now;
+
+#ifdef HAVE_GETTIMEOFDAY
+	gettimeofday( &now, NULL );
+#else
+	now.tv_sec = time( NULL );
+	now.tv_usec = 0;
+#endif
+	return ( now.tv_sec - tv->tv_sec ) * 1000L +
+		( now.tv_usec - tv->tv_usec ) / 1000L;
+}
+
+/*
+ * Connect over TCP to one of several addresses, in the manner of
+ * RFC 8305: a new attempt is started every LDAP_CONNECT_STAGGER
+ * msec while the earlier ones are still pending, or as soon as one
+ * fails, and the first one to complete wins.  The network timeout
+ * applies to the whole process.  Returns the index of the address
+ * that was connected to, with its socket in *sp, or -1.
+ */
+static int
+ldap_int_connect_staggered( LDAP *ld, int proto, ldap_int_addr *addrs,
+	int naddrs, const char *serv, ber_socket_t *sp )
+{
+	struct pollfd	*fds;
+	int		*idx;
+	struct timeval	start, last;
+	long		tmout = -1, elapsed;
+	int		i, rc, next = 0, npending = 0, win = -1;
+
+	if ( ld->ld_options.ldo_tm_net.tv_sec >= 0 ) {
+		tmout = TV2MILLISEC( &ld->ld_options.ldo_tm_net );
+	}
+
+	fds = LDAP_MALLOC( naddrs * ( sizeof(struct pollfd) + sizeof(int) ));
+	if ( fds == NULL )
+		return -1;
+	idx = (int *)( fds + naddrs );
+
+#ifdef HAVE_GETTIMEOFDAY
+	gettimeofday( &start, NULL );
+#else
+	start.tv_sec = time( NULL );
+	start.tv_usec = 0;
+#endif
+	last = start;
+
+	while ( win < 0 ) {
+		int timeout = INFTIM;
+
+		elapsed = ldap_int_msec_since( &start );
+		if ( tmout >= 0 && elapsed >= tmout ) {
+			osip_debug(ld, "ldap_connect_to_host: timed out\n",0,0,0);
+			ldap_pvt_set_errno( ETIMEDOUT );
+			break;
+		}
+
+		if ( next < naddrs && ( npending == 0 ||
+			ldap_int_msec_since( &last ) >= LDAP_CONNECT_STAGGER ))
+		{
+			ber_socket_t s;
+			int err;
+
+			/* a failed attempt lets the next one start right away */
+			last.tv_sec = 0;
+
+			i = next++;
+			s = ldap_int_socket( ld, addrs[i].la_family, SOCK_STREAM );
+			if ( s == AC_SOCKET_INVALID )
+				continue;
+			if ( ldap_int_prepare_socket( ld, s, proto ) == -1 ||
+				ldap_pvt_ndelay_on( ld, s ) == -1 )
+			{
+				ldap_pvt_close_socket( ld, s );
+				continue;
+			}
+			ldap_int_addr_debug( ld, &addrs[i], serv );
+
+			do {
+				rc = connect( s, (struct sockaddr *)&addrs[i].la_addr,
+					addrs[i].la_len );
+				err = rc == AC_SOCKET_ERROR ? sock_errno() : 0;
+			} while ( err == EINTR &&
+				LDAP_BOOL_GET( &ld->ld_options, LDAP_BOOL_RESTART ));
+
+			if ( rc != AC_SOCKET_ERROR ) {
+				*sp = s;
+				win = i;
+				break;
+			}
+			if ( err != EINPROGRESS && err != EWOULDBLOCK ) {
+				osip_debug(ld, "connect errno: %d\n", err, 0, 0);
+				ldap_pvt_close_socket( ld, s );
+				continue;
+			}
+			fds[npending].fd = s;
+			fds[npending].events = POLL_WRITE;
+			idx[npending] = i;
+			npending++;
+#ifdef HAVE_GETTIMEOFDAY
+			gettimeofday( &last, NULL );
+#else
+			last.tv_sec = time( NULL );
+#endif
+		}
+
+		if ( npending == 0 ) {
+			if ( next < naddrs )
+				continue;
+			break;
+		}
+
+		if ( next < naddrs ) {
+			timeout = LDAP_CONNECT_STAGGER - ldap_int_msec_since( &last );
+			if ( timeout < 0 )
+				timeout = 0;
+		}
+		if ( tmout >= 0 && ( timeout == INFTIM || tmout - elapsed < timeout )) {
+			timeout = tmout - elapsed;
+		}
+
+		for ( i = 0; i < npending; i++ )
+			fds[i].revents = 0;
+		rc = poll( fds, npending, timeout );
+		if ( rc == AC_SOCKET_ERROR ) {
+			if ( errno == EINTR &&
+				LDAP_BOOL_GET( &ld->ld_options, LDAP_BOOL_RESTART ))
+				continue;
+			break;
+		}
+
+		for ( i = 0; i < npending; i++ ) {
+			if ( !fds[i].revents )
+				continue;
+			if ( ldap_pvt_is_socket_ready( ld, fds[i].fd ) == 0 ) {
+				*sp = fds[i].fd;
+				win = idx[i];
+				fds[i] = fds[--npending];
+				idx[i] = idx[npending];
+				break;
+			}
+			osip_debug(ld, "ldap_connect_to_host: attempt on fd %d failed\n",
+				fds[i].fd, 0, 0);
+			ldap_pvt_close_socket( ld, fds[i].fd );
+			fds[i] = fds[--npending];
+			idx[i] = idx[npending];
+			i--;
+			last.tv_sec = 0;
+		}
+	}
+
+	/* abandon the losers */
+	for ( i = 0; i < npending; i++ )
+		ldap_pvt_close_socket( ld, fds[i].fd );
+	LDAP_FREE( fds );
+
+	if ( win >= 0 && ldap_pvt_ndelay_off( ld, *sp ) == -1 ) {
+		ldap_pvt_close_socket( ld, *sp );
+		win = -1;
+	}
+	return win;
+}
+#endif /* HAVE_POLL */
+
+#endif /* HAVE_GETADDRINFO && HAVE_INET_NTOP */
+
 int
 ldap_connect_to_host(LDAP *ld, Sockbuf *sb,
 	int proto, LDAPURLDesc *srv,
@@ -548,8 +948,9 @@ ldap_connect_to_host(LDAP *ld, Sockbuf *sb,
 
 #if defined( HAVE_GETADDRINFO ) && defined( HAVE_INET_NTOP )
 	char serv[7];
-	int err;
-	struct addrinfo hints, *res, *sai;
+	int err, i, naddrs;
+	struct addrinfo hints;
+	ldap_int_addr *addrs;
 #else
 	int i;
 	int use_hp = 0;
@@ -602,29 +1003,29 @@ ldap_connect_to_host(LDAP *ld, Sockbuf *sb,
 	hints.ai_socktype = socktype;
 	snprintf(serv, sizeof serv, "%d", port );
 
-	/* most getaddrinfo(3) use non-threadsafe resolver libraries */
-	LDAP_MUTEX_LOCK(&ldap_int_resolv_mutex);
-
-	err = getaddrinfo( host, serv, &hints, &res );
-
-	LDAP_MUTEX_UNLOCK(&ldap_int_resolv_mutex);
-
-	if ( err != 0 ) {
-		osip_debug(ld, "ldap_connect_to_host: getaddrinfo failed: %s\n",
-			AC_GAI_STRERROR(err), 0, 0);
+	if ( ldap_int_resolve( ld, host, serv, &hints, &addrs, &naddrs ) != 0 ) {
 		return -1;
 	}
 	rc = -1;
 
-	for( sai=res; sai != NULL; sai=sai->ai_next) {
-		if( sai->ai_addr == NULL ) {
-			osip_debug(ld, "ldap_connect_to_host: getaddrinfo "
-				"ai_addr is NULL?\n", 0, 0, 0);
-			continue;
+#ifdef HAVE_POLL
+	/* race the addresses unless the caller wants to poll for itself */
+	if ( !async && proto == LDAP_PROTO_TCP && naddrs > 1 ) {
+		i = ldap_int_connect_staggered( ld, proto, addrs, naddrs, serv, &s );
+		if ( i >= 0 ) {
+			rc = ldap_int_connect_cbs( ld, sb, &s, srv,
+				(struct sockaddr *)&addrs[i].la_addr );
+			if ( rc )
+				ldap_pvt_close_socket(ld, s);
 		}
+		LDAP_FREE( addrs );
+		return rc;
+	}
+#endif
 
+	for( i = 0; i < naddrs; i++ ) {
 		/* we assume AF_x and PF_x are equal for all x */
-		s = ldap_int_socket( ld, sai->ai_family, socktype );
+		s = ldap_int_socket( ld, addrs[i].la_family, socktype );
 		if ( s == AC_SOCKET_INVALID ) {
 			continue;
 		}
@@ -634,31 +1035,13 @@ ldap_connect_to_host(LDAP *ld, Sockbuf *sb,
 			break;
 		}
 
-		switch (sai->ai_family) {
-#ifdef LDAP_PF_INET6
-			case AF_INET6: {
-				char addr[INET6_ADDRSTRLEN];
-				inet_ntop( AF_INET6,
-					&((struct sockaddr_in6 *)sai->ai_addr)->sin6_addr,
-					addr, sizeof addr);
-				osip_debug(ld, "ldap_connect_to_host: Trying %s %s\n", 
-					addr, serv, 0);
-			} break;
-#endif
-			case AF_INET: {
-				char addr[INET_ADDRSTRLEN];
-				inet_ntop( AF_INET,
-					&((struct sockaddr_in *)sai->ai_addr)->sin_addr,
-					addr, sizeof addr);
-				osip_debug(ld, "ldap_connect_to_host: Trying %s:%s\n", 
-					addr, serv, 0);
-			} break;
-		}
+		ldap_int_addr_debug( ld, &addrs[i], serv );
 
 		rc = ldap_pvt_connect( ld, s,
-			sai->ai_addr, sai->ai_addrlen, async );
+			(struct sockaddr *)&addrs[i].la_addr, addrs[i].la_len, async );
 		if ( rc == 0 || rc == -2 ) {
-			err = ldap_int_connect_cbs( ld, sb, &s, srv, sai->ai_addr );
+			err = ldap_int_connect_cbs( ld, sb, &s, srv,
+				(struct sockaddr *)&addrs[i].la_addr );
 			if ( err )
 				rc = err;
 			else
@@ -666,7 +1049,7 @@ ldap_connect_to_host(LDAP *ld, Sockbuf *sb,
 		}
 		ldap_pvt_close_socket(ld, s);
 	}
-	freeaddrinfo(res);
+	LDAP_FREE( addrs );
 
 #else
 	if (! inet_aton( host, &in ) ) {
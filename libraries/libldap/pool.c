@@ -0,0 +1,283 @@
+/* pool.c - a fixed set of bound sessions shared by many callers */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/stdlib.h>
+
+#include <ac/socket.h>
+#include <ac/string.h>
+#include <ac/time.h>
+
+#include "ldap-int.h"
+
+/*
+ * Each slot of the pool owns one session. Slot i lists the servers
+ * starting with the (i mod n)th one, so the sessions spread over all
+ * of them and each still fails over to the rest. Sessions are opened
+ * and bound when first handed out, and again after the caller
+ * reports that the connection was lost.
+ */
+typedef struct ldap_pool_conn {
+	LDAP	*pc_ld;
+	char	*pc_uris;
+	int	pc_busy;
+} ldap_pool_conn;
+
+struct ldap_pool {
+	ldap_pool_conn	*lp_conns;
+	int	lp_size;
+	int	lp_next;	/* slot to try first, for round robin */
+	int	lp_nbusy;
+	char	*lp_binddn;
+	struct berval	lp_cred;
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_t	lp_mutex;
+	ldap_pvt_thread_cond_t	lp_cond;
+#endif
+};
+
+static void
+ldap_pool_free( LDAPPool *pool )
+{
+	int i;
+
+	if ( pool->lp_conns ) {
+		for ( i = 0; i < pool->lp_size; i++ ) {
+			if ( pool->lp_conns[i].pc_ld )
+				ldap_unbind_ext( pool->lp_conns[i].pc_ld, NULL, NULL );
+			LDAP_FREE( pool->lp_conns[i].pc_uris );
+		}
+		LDAP_FREE( pool->lp_conns );
+	}
+	LDAP_FREE( pool->lp_binddn );
+	if ( pool->lp_cred.bv_val ) {
+		memset( pool->lp_cred.bv_val, 0, pool->lp_cred.bv_len );
+		LDAP_FREE( pool->lp_cred.bv_val );
+	}
+	LDAP_FREE( pool );
+}
+
+int
+ldap_pool_create(
+	LDAPPool **poolp,
+	LDAP_CONST char *uris,
+	int size,
+	LDAP_CONST char *binddn,
+	struct berval *cred )
+{
+	LDAPPool *pool;
+	char **urls;
+	int i, j, n, len;
+
+	if ( poolp == NULL || uris == NULL || size <= 0 )
+		return LDAP_PARAM_ERROR;
+	*poolp = NULL;
+
+	urls = ldap_str2charray( uris, ", " );
+	if ( urls == NULL || urls[0] == NULL ) {
+		ldap_charray_free( urls );
+		return LDAP_PARAM_ERROR;
+	}
+	for ( n = 0, len = 0; urls[n]; n++ ) {
+		if ( !ldap_is_ldap_url( urls[n] ) &&
+			!ldap_is_ldaps_url( urls[n] ) &&
+			!ldap_is_ldapi_url( urls[n] ) )
+		{
+			ldap_charray_free( urls );
+			return LDAP_PARAM_ERROR;
+		}
+		len += strlen( urls[n] ) + 1;
+	}
+
+	pool = LDAP_CALLOC( 1, sizeof( LDAPPool ) );
+	if ( pool == NULL )
+		goto nomem;
+	pool->lp_conns = LDAP_CALLOC( size, sizeof( ldap_pool_conn ) );
+	if ( pool->lp_conns == NULL )
+		goto nomem;
+	pool->lp_size = size;
+
+	for ( i = 0; i < size; i++ ) {
+		char *ptr = LDAP_MALLOC( len );
+
+		if ( ptr == NULL )
+			goto nomem;
+		pool->lp_conns[i].pc_uris = ptr;
+		for ( j = 0; j < n; j++ ) {
+			if ( j )
+				*ptr++ = ' ';
+			strcpy( ptr, urls[ ( i + j ) % n ] );
+			ptr += strlen( ptr );
+		}
+	}
+
+	if ( binddn ) {
+		pool->lp_binddn = LDAP_STRDUP( binddn );
+		if ( pool->lp_binddn == NULL )
+			goto nomem;
+	}
+	if ( cred && cred->bv_val ) {
+		if ( ber_dupbv_x( &pool->lp_cred, cred, NULL ) == NULL )
+			goto nomem;
+	}
+
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_init( &pool->lp_mutex );
+	ldap_pvt_thread_cond_init( &pool->lp_cond );
+#endif
+
+	ldap_charray_free( urls );
+	*poolp = pool;
+	return LDAP_SUCCESS;
+
+nomem:
+	ldap_charray_free( urls );
+	if ( pool )
+		ldap_pool_free( pool );
+	return LDAP_NO_MEMORY;
+}
+
+static int
+ldap_pool_connect( LDAPPool *pool, ldap_pool_conn *pc )
+{
+	LDAP *ld;
+	int rc, version = LDAP_VERSION3;
+
+	rc = ldap_initialize( &ld, pc->pc_uris );
+	if ( rc != LDAP_SUCCESS )
+		return rc;
+
+	ldap_set_option( ld, LDAP_OPT_PROTOCOL_VERSION, &version );
+	rc = ldap_sasl_bind_s( ld, pool->lp_binddn, LDAP_SASL_SIMPLE,
+		&pool->lp_cred, NULL, NULL, NULL );
+	if ( rc != LDAP_SUCCESS ) {
+		ldap_unbind_ext( ld, NULL, NULL );
+		return rc;
+	}
+
+	pc->pc_ld = ld;
+	return LDAP_SUCCESS;
+}
+
+/*
+ * Hand out the next idle session, opening and binding it if needed.
+ * With libldap_r this waits for a session to be returned when all
+ * of them are in use; otherwise it fails with LDAP_BUSY.
+ */
+int
+ldap_pool_get( LDAPPool *pool, LDAP **ldp )
+{
+	ldap_pool_conn *pc = NULL;
+	int i, rc = LDAP_SUCCESS;
+
+	if ( pool == NULL || ldp == NULL )
+		return LDAP_PARAM_ERROR;
+	*ldp = NULL;
+
+	LDAP_MUTEX_LOCK( &pool->lp_mutex );
+	while ( pool->lp_nbusy == pool->lp_size ) {
+#ifdef LDAP_R_COMPILE
+		ldap_pvt_thread_cond_wait( &pool->lp_cond, &pool->lp_mutex );
+#else
+		return LDAP_BUSY;
+#endif
+	}
+	for ( i = 0; i < pool->lp_size; i++ ) {
+		pc = &pool->lp_conns[ ( pool->lp_next + i ) % pool->lp_size ];
+		if ( !pc->pc_busy )
+			break;
+	}
+	assert( i < pool->lp_size );
+	pool->lp_next = ( pool->lp_next + i + 1 ) % pool->lp_size;
+	pc->pc_busy = 1;
+	pool->lp_nbusy++;
+	LDAP_MUTEX_UNLOCK( &pool->lp_mutex );
+
+	/* the slot is ours now, connect without holding up the others */
+	if ( pc->pc_ld == NULL )
+		rc = ldap_pool_connect( pool, pc );
+
+	if ( rc != LDAP_SUCCESS ) {
+		LDAP_MUTEX_LOCK( &pool->lp_mutex );
+		pc->pc_busy = 0;
+		pool->lp_nbusy--;
+#ifdef LDAP_R_COMPILE
+		ldap_pvt_thread_cond_signal( &pool->lp_cond );
+#endif
+		LDAP_MUTEX_UNLOCK( &pool->lp_mutex );
+		return rc;
+	}
+
+	*ldp = pc->pc_ld;
+	return LDAP_SUCCESS;
+}
+
+/*
+ * Give back a session obtained from ldap_pool_get(). rc is the
+ * result of the last call made on it; a lost connection is dropped
+ * here and reopened by the next ldap_pool_get() of its slot.
+ */
+int
+ldap_pool_put( LDAPPool *pool, LDAP *ld, int rc )
+{
+	ldap_pool_conn *pc = NULL;
+	int i;
+
+	if ( pool == NULL || ld == NULL )
+		return LDAP_PARAM_ERROR;
+
+	for ( i = 0; i < pool->lp_size; i++ ) {
+		if ( pool->lp_conns[i].pc_ld == ld ) {
+			pc = &pool->lp_conns[i];
+			break;
+		}
+	}
+	if ( pc == NULL || !pc->pc_busy )
+		return LDAP_PARAM_ERROR;
+
+	if ( rc == LDAP_SERVER_DOWN || rc == LDAP_CONNECT_ERROR ) {
+		pc->pc_ld = NULL;
+		ldap_unbind_ext( ld, NULL, NULL );
+	}
+
+	LDAP_MUTEX_LOCK( &pool->lp_mutex );
+	pc->pc_busy = 0;
+	pool->lp_nbusy--;
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_cond_signal( &pool->lp_cond );
+#endif
+	LDAP_MUTEX_UNLOCK( &pool->lp_mutex );
+	return LDAP_SUCCESS;
+}
+
+/* All sessions must have been returned to the pool */
+int
+ldap_pool_destroy( LDAPPool *pool )
+{
+	if ( pool == NULL )
+		return LDAP_PARAM_ERROR;
+	if ( pool->lp_nbusy )
+		return LDAP_BUSY;
+
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_cond_destroy( &pool->lp_cond );
+	ldap_pvt_thread_mutex_destroy( &pool->lp_mutex );
+#endif
+	ldap_pool_free( pool );
+	return LDAP_SUCCESS;
+}
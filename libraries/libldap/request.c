@@ -399,12 +399,7 @@ ldap_send_server_request(
 		}
 	}
 
-	lr->lr_prev = NULL;
-	lr->lr_next = ld->ld_requests;
-	if ( lr->lr_next != NULL ) {
-		lr->lr_next->lr_prev = lr;
-	}
-	ld->ld_requests = lr;
+	ldap_insert_request( ld, lr );
 
 	ld->ld_errno = LDAP_SUCCESS;
 	if ( ldap_int_flush_request( ld, lr ) == -1 ) {
@@ -949,6 +944,43 @@ ldap_dump_requests_and_responses( LDAP *ld )
 }
 #endif /* LDAP_DEBUG */
 
+#define LDAP_REQ_HASH( msgid )	( (unsigned)(msgid) % LDAP_REQ_BUCKETS )
+
+/* protected by req_mutex */
+void
+ldap_insert_request( LDAP *ld, LDAPRequest *lr )
+{
+	LDAPRequest	**lrp;
+
+	lr->lr_prev = NULL;
+	lr->lr_next = ld->ld_requests;
+	if ( lr->lr_next != NULL ) {
+		lr->lr_next->lr_prev = lr;
+	}
+	ld->ld_requests = lr;
+
+	lrp = &ld->ld_req_hash[ LDAP_REQ_HASH( lr->lr_msgid ) ];
+	lr->lr_hnext = *lrp;
+	*lrp = lr;
+}
+
+/* protected by req_mutex */
+static void
+ldap_unhash_request( LDAP *ld, LDAPRequest *lr )
+{
+	LDAPRequest	**lrp;
+
+	for ( lrp = &ld->ld_req_hash[ LDAP_REQ_HASH( lr->lr_msgid ) ];
+		*lrp != NULL; lrp = &(*lrp)->lr_hnext )
+	{
+		if ( *lrp == lr ) {
+			*lrp = lr->lr_hnext;
+			lr->lr_hnext = NULL;
+			break;
+		}
+	}
+}
+
 /* protected by req_mutex */
 static void
 ldap_free_request_int( LDAP *ld, LDAPRequest *lr )
@@ -977,6 +1009,8 @@ ldap_free_request_int( LDAP *ld, LDAPRequest *lr )
 		lr->lr_next->lr_prev = lr->lr_prev;
 	}
 
+	ldap_unhash_request( ld, lr );
+
 	if ( lr->lr_refcnt > 0 ) {
 		lr->lr_refcnt = -lr->lr_refcnt;
 
@@ -1656,7 +1690,9 @@ ldap_find_request_by_msgid( LDAP *ld, ber_int_t msgid )
 {
 	LDAPRequest	*lr;
 
-	for ( lr = ld->ld_requests; lr != NULL; lr = lr->lr_next ) {
+	for ( lr = ld->ld_req_hash[ LDAP_REQ_HASH( msgid ) ]; lr != NULL;
+		lr = lr->lr_hnext )
+	{
 		if ( lr->lr_status == LDAP_REQST_COMPLETED ) {
 			continue;	/* Skip completed requests */
 		}
@@ -1675,7 +1711,10 @@ ldap_return_request( LDAP *ld, LDAPRequest *lrx, int freeit )
 {
 	LDAPRequest	*lr;
 
-	for ( lr = ld->ld_requests; lr != NULL; lr = lr->lr_next ) {
+	/* still in the list of outstanding requests? */
+	for ( lr = ld->ld_req_hash[ LDAP_REQ_HASH( lrx->lr_msgid ) ];
+		lr != NULL; lr = lr->lr_hnext )
+	{
 		if ( lr == lrx ) {
 			if ( lr->lr_refcnt > 0 ) {
 				lr->lr_refcnt--;
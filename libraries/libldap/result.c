@@ -123,6 +123,51 @@ ldap_result(
 	return rc;
 }
 
+/*
+ * ldap_process_input - read whatever responses are available without
+ * blocking, and hand each of them to proc, which takes ownership of
+ * the message.  Meant to be called from an event loop when the
+ * descriptor obtained with LDAP_OPT_DESC becomes readable.  Stops
+ * early if proc returns non-zero.  Returns the number of messages
+ * handed to proc, or -1 on error.
+ */
+int
+ldap_process_input(
+	LDAP *ld,
+	LDAP_RESULT_PROC *proc,
+	void *arg )
+{
+	struct timeval	tv;
+	LDAPMessage	*res;
+	int		rc, n = 0;
+
+	assert( ld != NULL );
+	assert( proc != NULL );
+
+	Debug( LDAP_DEBUG_TRACE, "ldap_process_input ld %p\n", (void *)ld, 0, 0 );
+
+	for ( ;; ) {
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+		res = NULL;
+		rc = ldap_result( ld, LDAP_RES_ANY, LDAP_MSG_ONE, &tv, &res );
+		if ( rc <= 0 ) {
+			break;
+		}
+
+		n++;
+		if ( proc( ld, res, arg ) != 0 ) {
+			return n;
+		}
+	}
+
+	if ( rc < 0 && ld->ld_errno != LDAP_TIMEOUT ) {
+		return -1;
+	}
+
+	return n;
+}
+
 /* protected by res_mutex */
 static LDAPMessage *
 chkResponseList(
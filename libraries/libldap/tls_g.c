@@ -53,6 +53,7 @@ typedef struct tlsg_ctx {
 	int refcount;
 	int reqcert;
 	gnutls_priority_t prios;
+	gnutls_datum_t ticket_key;
 #ifdef LDAP_R_COMPILE
 	ldap_pvt_thread_mutex_t ref_mutex;
 #endif
@@ -182,6 +183,10 @@ tlsg_ctx_free ( tls_ctx *ctx )
 	gnutls_certificate_free_credentials( c->cred );
 	if ( c->dh_params )
 		gnutls_dh_params_deinit( c->dh_params );
+	if ( c->ticket_key.data ) {
+		gnutls_memset( c->ticket_key.data, 0, c->ticket_key.size );
+		gnutls_free( c->ticket_key.data );
+	}
 	ber_memfree ( c );
 }
 
@@ -350,6 +355,21 @@ tlsg_ctx_init( struct ldapoptions *lo, struct ldaptls *lt, int is_server )
 		gnutls_certificate_set_dh_params( ctx->cred, ctx->dh_params );
 	}
 
+	/* Let clients resume with a session ticket instead of a full
+	 * handshake. The key lives as long as the context; a new one
+	 * is generated whenever the TLS settings are reloaded.
+	 */
+	if ( is_server && !ctx->ticket_key.data ) {
+		rc = gnutls_session_ticket_key_generate( &ctx->ticket_key );
+		if ( rc < 0 ) {
+			Debug( LDAP_DEBUG_ANY,
+				"TLS: could not generate session ticket key: %s.\n",
+				gnutls_strerror( rc ), 0, 0 );
+			ctx->ticket_key.data = NULL;
+		}
+		rc = 0;
+	}
+
 	ctx->reqcert = lo->ldo_tls_require_cert;
 
 	return 0;
@@ -380,6 +400,9 @@ tlsg_session_new ( tls_ctx * ctx, int is_server )
 				flag = GNUTLS_CERT_REQUIRE;
 			gnutls_certificate_server_set_request( session->session, flag );
 		}
+		if ( c->ticket_key.data )
+			gnutls_session_ticket_enable_server( session->session,
+				&c->ticket_key );
 	}
 	return (tls_session *)session;
 } 
@@ -409,7 +432,7 @@ tlsg_session_accept( tls_session *session )
 }
 
 static int
-tlsg_session_connect( LDAP *ld, tls_session *session )
+tlsg_session_connect( LDAP *ld, tls_session *session, const char *name_in )
 {
 	return tlsg_session_accept( session);
 }
@@ -2628,7 +2628,7 @@ tlsm_session_accept( tls_session *session )
 }
 
 static int
-tlsm_session_connect( LDAP *ld, tls_session *session )
+tlsm_session_connect( LDAP *ld, tls_session *session, const char *name_in )
 {
 	return tlsm_session_accept_or_connect( session, 0 );
 }
@@ -119,6 +119,108 @@ static void tlso_thr_init( void ) {}
 #endif
 #endif /* OpenSSL 1.1 */
 
+#if OPENSSL_VERSION_NUMBER >= 0x10101000
+#define HAVE_TLSO_SESSION_CACHE
+/*
+ * Client side session cache: each client context remembers the last
+ * session established with a server, so that reconnecting to the same
+ * host can resume it instead of going through a full handshake.
+ */
+typedef struct tlso_sesscache {
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_t	sc_mutex;
+#endif
+	char		*sc_host;
+	SSL_SESSION	*sc_session;
+} tlso_sesscache;
+
+static int tlso_ctx_cache_idx = -1;
+static int tlso_session_host_idx = -1;
+
+static void
+tlso_sesscache_free( void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+	int idx, long argl, void *argp )
+{
+	tlso_sesscache *sc = ptr;
+
+	if ( sc == NULL )
+		return;
+	if ( sc->sc_session )
+		SSL_SESSION_free( sc->sc_session );
+	LDAP_FREE( sc->sc_host );
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_destroy( &sc->sc_mutex );
+#endif
+	LDAP_FREE( sc );
+}
+
+static void
+tlso_host_free( void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+	int idx, long argl, void *argp )
+{
+	LDAP_FREE( ptr );
+}
+
+/* Called by OpenSSL whenever the server hands us a new session */
+static int
+tlso_new_session_cb( SSL *ssl, SSL_SESSION *sess )
+{
+	tlso_sesscache *sc;
+	char *host;
+
+	sc = SSL_CTX_get_ex_data( SSL_get_SSL_CTX( ssl ), tlso_ctx_cache_idx );
+	host = SSL_get_ex_data( ssl, tlso_session_host_idx );
+	if ( sc == NULL || host == NULL )
+		return 0;
+
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_lock( &sc->sc_mutex );
+#endif
+	if ( sc->sc_session )
+		SSL_SESSION_free( sc->sc_session );
+	if ( sc->sc_host == NULL || strcasecmp( sc->sc_host, host )) {
+		LDAP_FREE( sc->sc_host );
+		sc->sc_host = LDAP_STRDUP( host );
+	}
+	/* keep the reference we were given */
+	sc->sc_session = sc->sc_host ? sess : NULL;
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
+#endif
+	return sc->sc_session != NULL;
+}
+
+/* Offer the cached session, if it was established with the same host */
+static void
+tlso_session_resume( tlso_session *s, const char *host )
+{
+	tlso_sesscache *sc;
+	char *h;
+
+	h = LDAP_STRDUP( host );
+	if ( h == NULL || !SSL_set_ex_data( s, tlso_session_host_idx, h )) {
+		LDAP_FREE( h );
+		return;
+	}
+
+	sc = SSL_CTX_get_ex_data( SSL_get_SSL_CTX( s ), tlso_ctx_cache_idx );
+	if ( sc == NULL )
+		return;
+
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_lock( &sc->sc_mutex );
+#endif
+	if ( sc->sc_session && !strcasecmp( sc->sc_host, host ) &&
+		SSL_SESSION_is_resumable( sc->sc_session ))
+	{
+		SSL_set_session( s, sc->sc_session );
+	}
+#ifdef LDAP_R_COMPILE
+	ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
+#endif
+}
+#endif /* OpenSSL 1.1.1 */
+
 #if OPENSSL_VERSION_NUMBER < 0x10100000
 /*
  * OpenSSL 1.1 API and later makes the BIO method concrete types internal.
@@ -221,6 +323,13 @@ tlso_init( void )
 
 	tlso_bio_method = tlso_bio_setup();
 
+#ifdef HAVE_TLSO_SESSION_CACHE
+	tlso_ctx_cache_idx = SSL_CTX_get_ex_new_index( 0, NULL, NULL, NULL,
+		tlso_sesscache_free );
+	tlso_session_host_idx = SSL_get_ex_new_index( 0, NULL, NULL, NULL,
+		tlso_host_free );
+#endif
+
 	return 0;
 }
 
@@ -286,6 +395,27 @@ tlso_ctx_init( struct ldapoptions *lo, struct ldaptls *lt, int is_server )
 		SSL_CTX_set_session_id_context( ctx,
 			(const unsigned char *) "OpenLDAP", sizeof("OpenLDAP")-1 );
 	}
+#ifdef HAVE_TLSO_SESSION_CACHE
+	else if ( tlso_ctx_cache_idx >= 0 &&
+		SSL_CTX_get_ex_data( ctx, tlso_ctx_cache_idx ) == NULL )
+	{
+		tlso_sesscache *sc = LDAP_CALLOC( 1, sizeof( tlso_sesscache ));
+
+		if ( sc ) {
+#ifdef LDAP_R_COMPILE
+			ldap_pvt_thread_mutex_init( &sc->sc_mutex );
+#endif
+			if ( SSL_CTX_set_ex_data( ctx, tlso_ctx_cache_idx, sc )) {
+				SSL_CTX_set_session_cache_mode( ctx,
+					SSL_SESS_CACHE_CLIENT |
+					SSL_SESS_CACHE_NO_INTERNAL_STORE );
+				SSL_CTX_sess_set_new_cb( ctx, tlso_new_session_cb );
+			} else {
+				tlso_sesscache_free( NULL, sc, NULL, 0, 0, NULL );
+			}
+		}
+	}
+#endif
 
 #ifdef SSL_OP_NO_TLSv1
 #ifdef SSL_OP_NO_TLSv1_1
@@ -518,10 +648,16 @@ tlso_session_new( tls_ctx *ctx, int is_server )
 }
 
 static int
-tlso_session_connect( LDAP *ld, tls_session *sess )
+tlso_session_connect( LDAP *ld, tls_session *sess, const char *name_in )
 {
 	tlso_session *s = (tlso_session *)sess;
 
+#ifdef HAVE_TLSO_SESSION_CACHE
+	/* only on the first call for this handshake */
+	if ( name_in && SSL_get_ex_data( s, tlso_session_host_idx ) == NULL )
+		tlso_session_resume( s, name_in );
+#endif
+
 	/* Caller expects 0 = success, OpenSSL returns 1 = success */
 	return SSL_connect( s ) - 1;
 }
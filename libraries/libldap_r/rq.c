@@ -33,6 +33,89 @@
 #include "ldap_queue.h"
 #include "ldap_rq.h"
 
+/*
+ * Scheduled tasks are kept in a binary min-heap ordered by next_sched,
+ * so finding the next task is O(1) and rescheduling is O(log n) no
+ * matter how many tasks are registered.  Deferred tasks (next_sched
+ * of 0) are not in the heap.  task_list still holds every task, in no
+ * particular order, for lookups and for cn=Monitor.
+ */
+
+#define RQ_BEFORE(a,b)	( (a)->next_sched.tv_sec < (b)->next_sched.tv_sec || \
+	( (a)->next_sched.tv_sec == (b)->next_sched.tv_sec && \
+	(a)->next_sched.tv_usec < (b)->next_sched.tv_usec ))
+
+static void
+rq_heap_set( struct runqueue_s *rq, int i, struct re_s *e )
+{
+	rq->rq_heap[i] = e;
+	e->heap_pos = i + 1;
+}
+
+static void
+rq_heap_up( struct runqueue_s *rq, int i )
+{
+	struct re_s *e = rq->rq_heap[i];
+	int parent;
+
+	while ( i > 0 ) {
+		parent = ( i - 1 ) / 2;
+		if ( !RQ_BEFORE( e, rq->rq_heap[parent] ))
+			break;
+		rq_heap_set( rq, i, rq->rq_heap[parent] );
+		i = parent;
+	}
+	rq_heap_set( rq, i, e );
+}
+
+static void
+rq_heap_down( struct runqueue_s *rq, int i )
+{
+	struct re_s *e = rq->rq_heap[i];
+	int kid;
+
+	for (;;) {
+		kid = 2 * i + 1;
+		if ( kid >= rq->rq_nheap )
+			break;
+		if ( kid + 1 < rq->rq_nheap &&
+			RQ_BEFORE( rq->rq_heap[kid+1], rq->rq_heap[kid] ))
+			kid++;
+		if ( !RQ_BEFORE( rq->rq_heap[kid], e ))
+			break;
+		rq_heap_set( rq, i, rq->rq_heap[kid] );
+		i = kid;
+	}
+	rq_heap_set( rq, i, e );
+}
+
+/* the heap always has room for every task, see runqueue_insert */
+static void
+rq_heap_push( struct runqueue_s *rq, struct re_s *e )
+{
+	assert( rq->rq_nheap < rq->rq_heapmax );
+	rq->rq_heap[rq->rq_nheap++] = e;
+	rq_heap_up( rq, rq->rq_nheap - 1 );
+}
+
+static void
+rq_heap_delete( struct runqueue_s *rq, struct re_s *e )
+{
+	int i = e->heap_pos - 1;
+	struct re_s *last;
+
+	assert( i >= 0 && i < rq->rq_nheap && rq->rq_heap[i] == e );
+	e->heap_pos = 0;
+	last = rq->rq_heap[--rq->rq_nheap];
+	if ( last != e ) {
+		rq_heap_set( rq, i, last );
+		if ( i > 0 && RQ_BEFORE( last, rq->rq_heap[( i - 1 ) / 2] ))
+			rq_heap_up( rq, i );
+		else
+			rq_heap_down( rq, i );
+	}
+}
+
 struct re_s *
 ldap_pvt_runqueue_insert(
 	struct runqueue_s* rq,
@@ -45,6 +128,17 @@ ldap_pvt_runqueue_insert(
 {
 	struct re_s* entry;
 
+	if ( rq->rq_ntasks == rq->rq_heapmax ) {
+		int max = rq->rq_heapmax ? rq->rq_heapmax * 2 : 16;
+		struct re_s **heap;
+
+		heap = LDAP_REALLOC( rq->rq_heap, max * sizeof( struct re_s * ));
+		if ( heap == NULL )
+			return NULL;
+		rq->rq_heap = heap;
+		rq->rq_heapmax = max;
+	}
+
 	entry = (struct re_s *) LDAP_CALLOC( 1, sizeof( struct re_s ));
 	if ( entry ) {
 		entry->interval.tv_sec = interval;
@@ -56,6 +150,8 @@ ldap_pvt_runqueue_insert(
 		entry->tname = tname;
 		entry->tspec = tspec;
 		LDAP_STAILQ_INSERT_HEAD( &rq->task_list, entry, tnext );
+		rq->rq_ntasks++;
+		rq_heap_push( rq, entry );
 	}
 	return entry;
 }
@@ -92,6 +188,9 @@ ldap_pvt_runqueue_remove(
 	assert( e == entry );
 
 	LDAP_STAILQ_REMOVE( &rq->task_list, entry, re_s, tnext );
+	if ( entry->heap_pos )
+		rq_heap_delete( rq, entry );
+	rq->rq_ntasks--;
 
 	LDAP_FREE( entry );
 }
@@ -104,10 +203,10 @@ ldap_pvt_runqueue_next_sched(
 {
 	struct re_s* entry;
 
-	entry = LDAP_STAILQ_FIRST( &rq->task_list );
-	if ( entry == NULL || entry->next_sched.tv_sec == 0 ) {
+	if ( rq->rq_nheap == 0 ) {
 		return NULL;
 	} else {
+		entry = rq->rq_heap[0];
 		*next_run = entry->next_sched;
 		return entry;
 	}
@@ -120,6 +219,19 @@ ldap_pvt_runqueue_runtask(
 )
 {
 	LDAP_STAILQ_INSERT_TAIL( &rq->run_list, entry, rnext );
+	entry->running = 1;
+	entry->runs++;
+	rq->rq_runs++;
+
+	gettimeofday( &entry->run_start, NULL );
+	entry->late = 0;
+	if ( entry->next_sched.tv_sec &&
+		entry->run_start.tv_sec > entry->next_sched.tv_sec ) {
+		entry->late = entry->run_start.tv_sec - entry->next_sched.tv_sec;
+		if ( entry->late > entry->max_late )
+			entry->max_late = entry->late;
+		rq->rq_late++;
+	}
 }
 
 void
@@ -128,7 +240,20 @@ ldap_pvt_runqueue_stoptask(
 	struct re_s* entry
 )
 {
+	struct timeval now;
+	long usec;
+
 	LDAP_STAILQ_REMOVE( &rq->run_list, entry, re_s, rnext );
+	entry->running = 0;
+
+	gettimeofday( &now, NULL );
+	usec = ( now.tv_sec - entry->run_start.tv_sec ) * 1000000L +
+		now.tv_usec - entry->run_start.tv_usec;
+	if ( usec >= 0 ) {
+		entry->run_usec += usec;
+		if ( (unsigned long)usec > entry->max_usec )
+			entry->max_usec = usec;
+	}
 }
 
 int
@@ -137,14 +262,7 @@ ldap_pvt_runqueue_isrunning(
 	struct re_s* entry
 )
 {
-	struct re_s* e;
-
-	LDAP_STAILQ_FOREACH( e, &rq->run_list, rnext ) {
-		if ( e == entry ) {
-			return 1;
-		}
-	}
-	return 0;
+	return entry->running;
 }
 
 void 
@@ -154,50 +272,15 @@ ldap_pvt_runqueue_resched(
 	int defer
 )
 {
-	struct re_s* prev;
-	struct re_s* e;
-
-	LDAP_STAILQ_FOREACH( e, &rq->task_list, tnext ) {
-		if ( e == entry )
-			break;
-	}
-
-	assert ( e == entry );
-
-	LDAP_STAILQ_REMOVE( &rq->task_list, entry, re_s, tnext );
+	if ( entry->heap_pos )
+		rq_heap_delete( rq, entry );
 
 	if ( !defer ) {
 		entry->next_sched.tv_sec = time( NULL ) + entry->interval.tv_sec;
+		rq_heap_push( rq, entry );
 	} else {
 		entry->next_sched.tv_sec = 0;
 	}
-
-	if ( LDAP_STAILQ_EMPTY( &rq->task_list )) {
-		LDAP_STAILQ_INSERT_HEAD( &rq->task_list, entry, tnext );
-	} else if ( entry->next_sched.tv_sec == 0 ) {
-		LDAP_STAILQ_INSERT_TAIL( &rq->task_list, entry, tnext );
-	} else {
-		prev = NULL;
-		LDAP_STAILQ_FOREACH( e, &rq->task_list, tnext ) {
-			if ( e->next_sched.tv_sec == 0 ) {
-				if ( prev == NULL ) {
-					LDAP_STAILQ_INSERT_HEAD( &rq->task_list, entry, tnext );
-				} else {
-					LDAP_STAILQ_INSERT_AFTER( &rq->task_list, prev, entry, tnext );
-				}
-				return;
-			} else if ( e->next_sched.tv_sec > entry->next_sched.tv_sec ) {
-				if ( prev == NULL ) {
-					LDAP_STAILQ_INSERT_HEAD( &rq->task_list, entry, tnext );
-				} else {
-					LDAP_STAILQ_INSERT_AFTER( &rq->task_list, prev, entry, tnext );
-				}
-				return;
-			}
-			prev = e;
-		}
-		LDAP_STAILQ_INSERT_TAIL( &rq->task_list, entry, tnext );
-	}
 }
 
 int
@@ -193,6 +193,13 @@ ldap_pvt_thread_pool_query( ldap_pvt_thread_pool_t *tpool,
 	return(-1);
 }
 
+int
+ldap_pvt_thread_pool_stats( ldap_pvt_thread_pool_t *tpool, int q,
+	ldap_pvt_thread_pool_stats_t *st )
+{
+	return(-1);
+}
+
 int
 ldap_pvt_thread_pool_backload (
 	ldap_pvt_thread_pool_t *pool )
@@ -30,6 +30,11 @@
 #define LDAP_THREAD_POOL_IMPLEMENTATION
 #include "ldap_thr_debug.h"  /* May rename symbols defined below */
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #ifndef LDAP_THREAD_HAVE_TPOOL
 
 #ifndef CACHELINE
@@ -91,6 +96,7 @@ typedef struct ldap_int_thread_task_s {
 	ldap_pvt_thread_start_t *ltt_start_routine;
 	void *ltt_arg;
 	struct ldap_int_thread_poolq_s *ltt_queue;
+	struct timeval ltt_queued;	/* when it was submitted */
 } ldap_int_thread_task_t;
 
 typedef LDAP_STAILQ_HEAD(tcq, ldap_int_thread_task_s) ldap_int_tpool_plist_t;
@@ -117,6 +123,8 @@ struct ldap_int_thread_poolq_s {
 
 	/* pending tasks, and unused task objects */
 	ldap_int_tpool_plist_t ltp_pending_list;
+	/* last priority task in ltp_pending_list, they are all at its head */
+	struct ldap_int_thread_task_s *ltp_prio_last;
 	LDAP_SLIST_HEAD(tcl, ldap_int_thread_task_s) ltp_free_list;
 
 	/* Max number of threads in this queue */
@@ -129,6 +137,14 @@ struct ldap_int_thread_poolq_s {
 	int ltp_active_count;		/* Active, not paused/idle tasks */
 	int ltp_open_count;			/* Number of threads */
 	int ltp_starting;			/* Currently starting threads */
+	unsigned long ltp_steals;	/* Tasks taken from other queues */
+
+	/* statistics, see ldap_pvt_thread_pool_stats() */
+	int ltp_pending_max;		/* Highest ltp_pending_count at submit */
+	unsigned long ltp_submitted;
+	unsigned long ltp_prio;
+	unsigned long ltp_starved;	/* Submits finding no thread to run them */
+	unsigned long ltp_wait[LDAP_PVT_THREAD_POOL_WAIT_BUCKETS];
 };
 
 struct ldap_int_thread_pool_s {
@@ -171,8 +187,17 @@ struct ldap_int_thread_pool_s {
 	/* Configured max number of threads in pool, 0 for default (LDAP_MAXTHR) */
 	int ltp_conf_max_count;
 
+	/* Bind the threads of each queue to one NUMA node */
+	int ltp_affinity;
+
 	/* Max pending + paused + idle tasks, negated when ltp_finishing */
 	int ltp_max_pending;
+
+	/* Completed pauses and their total duration, from the pause
+	 * request until the resume */
+	unsigned long ltp_pauses;
+	unsigned long ltp_pause_msec;
+	struct timeval ltp_pause_start;
 };
 
 static ldap_int_tpool_plist_t empty_pending_list =
@@ -186,6 +211,9 @@ static LDAP_STAILQ_HEAD(tpq, ldap_int_thread_pool_s)
 static ldap_pvt_thread_mutex_t ldap_pvt_thread_pool_mutex;
 
 static void *ldap_int_thread_pool_wrapper( void *pool );
+static void ldap_int_thread_pool_poke(
+	struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq );
 
 static ldap_pvt_thread_key_t	ldap_tpool_key;
 
@@ -353,12 +381,23 @@ ldap_pvt_thread_pool_submit2 (
 	ldap_pvt_thread_pool_t *tpool,
 	ldap_pvt_thread_start_t *start_routine, void *arg,
 	void **cookie )
+{
+	return ldap_pvt_thread_pool_submit_prio( tpool, start_routine, arg,
+		cookie, 0 );
+}
+
+/* Submit a task, priority tasks run before all others in their queue */
+int
+ldap_pvt_thread_pool_submit_prio (
+	ldap_pvt_thread_pool_t *tpool,
+	ldap_pvt_thread_start_t *start_routine, void *arg,
+	void **cookie, int prio )
 {
 	struct ldap_int_thread_pool_s *pool;
 	struct ldap_int_thread_poolq_s *pq;
 	ldap_int_thread_task_t *task;
 	ldap_pvt_thread_t thr;
-	int i, j;
+	int i, j, poke = 0;
 
 	if (tpool == NULL)
 		return(-1);
@@ -413,11 +452,25 @@ ldap_pvt_thread_pool_submit2 (
 	task->ltt_start_routine = start_routine;
 	task->ltt_arg = arg;
 	task->ltt_queue = pq;
+	gettimeofday(&task->ltt_queued, NULL);
 	if ( cookie )
 		*cookie = task;
 
+	pq->ltp_submitted++;
 	pq->ltp_pending_count++;
-	LDAP_STAILQ_INSERT_TAIL(&pq->ltp_pending_list, task, ltt_next.q);
+	if (pq->ltp_pending_count > pq->ltp_pending_max)
+		pq->ltp_pending_max = pq->ltp_pending_count;
+	if (!prio) {
+		LDAP_STAILQ_INSERT_TAIL(&pq->ltp_pending_list, task, ltt_next.q);
+	} else {
+		if (pq->ltp_prio_last)
+			LDAP_STAILQ_INSERT_AFTER(&pq->ltp_pending_list,
+				pq->ltp_prio_last, task, ltt_next.q);
+		else
+			LDAP_STAILQ_INSERT_HEAD(&pq->ltp_pending_list, task, ltt_next.q);
+		pq->ltp_prio_last = task;
+		pq->ltp_prio++;
+	}
 
 	if (pool->ltp_pause)
 		goto done;
@@ -441,19 +494,23 @@ ldap_pvt_thread_pool_submit2 (
 			if (pq->ltp_open_count == 0) {
 				/* no open threads at all?!?
 				 */
-				ldap_int_thread_task_t *ptr;
+				ldap_int_thread_task_t *ptr, *prev = NULL;
 
 				/* let pool_close know there are no more threads */
 				ldap_pvt_thread_cond_signal(&pq->ltp_cond);
 
-				LDAP_STAILQ_FOREACH(ptr, &pq->ltp_pending_list, ltt_next.q)
+				LDAP_STAILQ_FOREACH(ptr, &pq->ltp_pending_list, ltt_next.q) {
 					if (ptr == task) break;
+					prev = ptr;
+				}
 				if (ptr == task) {
 					/* no open threads, task not handled, so
 					 * back out of ltp_pending_count, free the task,
 					 * report the error.
 					 */
 					pq->ltp_pending_count--;
+					if (pq->ltp_prio_last == task)
+						pq->ltp_prio_last = prev;
 					LDAP_STAILQ_REMOVE(&pq->ltp_pending_list, task,
 						ldap_int_thread_task_s, ltt_next.q);
 					LDAP_SLIST_INSERT_HEAD(&pq->ltp_free_list, task,
@@ -465,11 +522,20 @@ ldap_pvt_thread_pool_submit2 (
 			 * task will be handled eventually.
 			 */
 		}
+	} else if (pq->ltp_open_count - pq->ltp_starting <= pq->ltp_active_count) {
+		/* every thread of this queue is busy, let an idle
+		 * thread of another queue take the task instead
+		 */
+		poke = pool->ltp_numqs > 1;
+		if (pq->ltp_open_count >= pq->ltp_max_count)
+			pq->ltp_starved++;
 	}
 	ldap_pvt_thread_cond_signal(&pq->ltp_cond);
 
  done:
 	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	if (poke)
+		ldap_int_thread_pool_poke(pool, pq);
 	return(0);
 
  failed:
@@ -625,6 +691,98 @@ ldap_pvt_thread_pool_queues(
 	return 0;
 }
 
+/* Bind threads started from now on to the NUMA node of their queue.
+ * Queue i is served by the i-th online node, modulo the node count,
+ * so the number of queues should be a multiple of the node count.
+ * Only implemented on Linux; elsewhere this is a no-op.
+ */
+int
+ldap_pvt_thread_pool_affinity(
+	ldap_pvt_thread_pool_t *tpool,
+	int on )
+{
+	struct ldap_int_thread_pool_s *pool;
+
+	if (tpool == NULL)
+		return(-1);
+
+	pool = *tpool;
+
+	if (pool == NULL)
+		return(-1);
+
+	pool->ltp_affinity = on;
+	return(0);
+}
+
+#if defined(__linux__) && defined(SYS_sched_setaffinity)
+#define	TPOOL_MASKBITS	(8 * sizeof(unsigned long))
+#define	TPOOL_MASKLEN	(1024 / TPOOL_MASKBITS)
+
+/* Read a sysfs list such as "0-3,8-11" into a bitmask,
+ * return the number of bits set.
+ */
+static int
+ldap_int_thread_pool_readlist( const char *path, unsigned long *mask )
+{
+	char buf[1024], *p = buf;
+	unsigned long lo, hi;
+	FILE *fp;
+	int n = 0;
+
+	memset( mask, 0, TPOOL_MASKLEN * sizeof(unsigned long) );
+	fp = fopen( path, "r" );
+	if ( fp == NULL )
+		return 0;
+	if ( fgets( buf, sizeof(buf), fp ) == NULL )
+		buf[0] = '\0';
+	fclose( fp );
+
+	while ( *p >= '0' && *p <= '9' ) {
+		lo = hi = strtoul( p, &p, 10 );
+		if ( *p == '-' )
+			hi = strtoul( p+1, &p, 10 );
+		for ( ; lo <= hi && lo < TPOOL_MASKLEN * TPOOL_MASKBITS; lo++ ) {
+			mask[lo / TPOOL_MASKBITS] |= 1UL << ( lo % TPOOL_MASKBITS );
+			n++;
+		}
+		if ( *p == ',' )
+			p++;
+	}
+	return n;
+}
+
+/* Restrict the calling thread to the CPUs of its queue's node */
+static void
+ldap_int_thread_pool_bind( struct ldap_int_thread_poolq_s *pq )
+{
+	struct ldap_int_thread_pool_s *pool = pq->ltp_pool;
+	unsigned long nodes[TPOOL_MASKLEN], cpus[TPOOL_MASKLEN];
+	char path[64];
+	int q, node, nnodes;
+
+	for ( q = 0; q < pool->ltp_numqs && pool->ltp_wqs[q] != pq; q++ )
+		;
+	nnodes = ldap_int_thread_pool_readlist(
+		"/sys/devices/system/node/online", nodes );
+	if ( nnodes < 2 )
+		return;
+
+	q %= nnodes;
+	for ( node = 0; node < TPOOL_MASKLEN * TPOOL_MASKBITS; node++ ) {
+		if (( nodes[node / TPOOL_MASKBITS] & ( 1UL << ( node % TPOOL_MASKBITS ))) &&
+			q-- == 0 )
+			break;
+	}
+	snprintf( path, sizeof(path),
+		"/sys/devices/system/node/node%d/cpulist", node );
+	if ( ldap_int_thread_pool_readlist( path, cpus ))
+		syscall( SYS_sched_setaffinity, 0, sizeof(cpus), cpus );
+}
+#else
+#define	ldap_int_thread_pool_bind( pq )
+#endif
+
 /* Set max #threads.  value <= 0 means max supported #threads (LDAP_MAXTHR) */
 int
 ldap_pvt_thread_pool_maxthreads(
@@ -709,6 +867,7 @@ ldap_pvt_thread_pool_query(
 	case LDAP_PVT_THREAD_POOL_PARAM_ACTIVE:
 	case LDAP_PVT_THREAD_POOL_PARAM_PENDING:
 	case LDAP_PVT_THREAD_POOL_PARAM_BACKLOAD:
+	case LDAP_PVT_THREAD_POOL_PARAM_STEALS:
 		{
 			int i;
 			count = 0;
@@ -731,6 +890,9 @@ ldap_pvt_thread_pool_query(
 					case LDAP_PVT_THREAD_POOL_PARAM_BACKLOAD:
 						count += pq->ltp_pending_count + pq->ltp_active_count;
 						break;
+					case LDAP_PVT_THREAD_POOL_PARAM_STEALS:
+						count += pq->ltp_steals;
+						break;
 				}
 				ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 			}
@@ -775,6 +937,59 @@ ldap_pvt_thread_pool_query(
 	return ( count == -1 ? -1 : 0 );
 }
 
+/*
+ * Statistics of work queue q, or of the whole pool if q < 0.
+ * Returns -1 if there is no such queue.
+ */
+int
+ldap_pvt_thread_pool_stats(
+	ldap_pvt_thread_pool_t *tpool,
+	int q,
+	ldap_pvt_thread_pool_stats_t *st )
+{
+	struct ldap_int_thread_pool_s *pool;
+	struct ldap_int_thread_poolq_s *pq;
+	int i, j, first, last;
+
+	if ( tpool == NULL || st == NULL )
+		return -1;
+
+	pool = *tpool;
+
+	if ( pool == NULL || q >= pool->ltp_numqs )
+		return -1;
+
+	memset( st, 0, sizeof(*st) );
+	if ( q < 0 ) {
+		first = 0;
+		last = pool->ltp_numqs;
+		ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
+		st->lps_pauses = pool->ltp_pauses;
+		st->lps_pause_msec = pool->ltp_pause_msec;
+		ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
+	} else {
+		first = q;
+		last = q + 1;
+	}
+
+	for ( i = first; i < last; i++ ) {
+		pq = pool->ltp_wqs[i];
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		st->lps_open += pq->ltp_open_count;
+		st->lps_active += pq->ltp_active_count;
+		st->lps_pending += pq->ltp_pending_count;
+		st->lps_pending_max += pq->ltp_pending_max;
+		st->lps_submitted += pq->ltp_submitted;
+		st->lps_prio += pq->ltp_prio;
+		st->lps_steals += pq->ltp_steals;
+		st->lps_starved += pq->ltp_starved;
+		for ( j = 0; j < LDAP_PVT_THREAD_POOL_WAIT_BUCKETS; j++ )
+			st->lps_wait[j] += pq->ltp_wait[j];
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	}
+	return 0;
+}
+
 /*
  * true if pool is pausing; does not lock any mutex to check.
  * 0 if not pause, 1 if pause, -1 if error or no pool.
@@ -871,6 +1086,7 @@ ldap_pvt_thread_pool_close ( ldap_pvt_thread_pool_t *tpool, int run_pending )
 				LDAP_FREE(task);
 			}
 			pq->ltp_pending_count = 0;
+			pq->ltp_prio_last = NULL;
 		}
 
 		while (pq->ltp_open_count) {
@@ -935,6 +1151,94 @@ ldap_pvt_thread_pool_free ( ldap_pvt_thread_pool_t *tpool )
 	return(0);
 }
 
+/* Account for the time task spent in pq's pending list.
+ * Called with pq locked. Bucket i counts waits below 16us << 2i.
+ */
+static void
+ldap_int_thread_pool_waited(
+	struct ldap_int_thread_poolq_s *pq,
+	ldap_int_thread_task_t *task )
+{
+	struct timeval now;
+	unsigned long usec;
+	int i;
+
+	gettimeofday(&now, NULL);
+	if (now.tv_sec < task->ltt_queued.tv_sec)
+		usec = 0;
+	else
+		usec = (now.tv_sec - task->ltt_queued.tv_sec) * 1000000UL +
+			now.tv_usec - task->ltt_queued.tv_usec;
+	usec >>= 4;
+	for (i = 0; usec && i < LDAP_PVT_THREAD_POOL_WAIT_BUCKETS-1; i++)
+		usec >>= 2;
+	pq->ltp_wait[i]++;
+}
+
+/* Take a pending task from another queue for an idle thread of pq.
+ * Called with pq locked. Other queues are only try-locked, so this
+ * never waits on them and cannot deadlock against another thief.
+ * Nothing is taken while a pause is hiding the pending lists, or
+ * a pause could miss this thread becoming active again.
+ */
+static ldap_int_thread_task_t *
+ldap_int_thread_pool_steal( struct ldap_int_thread_poolq_s *pq )
+{
+	struct ldap_int_thread_pool_s *pool = pq->ltp_pool;
+	struct ldap_int_thread_poolq_s *vq;
+	ldap_int_thread_task_t *task = NULL;
+	int i;
+
+	if (pool->ltp_numqs < 2 || pq->ltp_work_list != &pq->ltp_pending_list)
+		return NULL;
+
+	for (i=0; i<pool->ltp_numqs && task == NULL; i++) {
+		vq = pool->ltp_wqs[i];
+		/* unlocked peek, recheck once locked */
+		if (vq == pq || vq->ltp_pending_count < 1)
+			continue;
+		if (ldap_pvt_thread_mutex_trylock(&vq->ltp_mutex))
+			continue;
+		task = LDAP_STAILQ_FIRST(vq->ltp_work_list);
+		if (task) {
+			LDAP_STAILQ_REMOVE_HEAD(vq->ltp_work_list, ltt_next.q);
+			vq->ltp_pending_count--;
+			if (vq->ltp_prio_last == task)
+				vq->ltp_prio_last = NULL;
+			ldap_int_thread_pool_waited(vq, task);
+		}
+		ldap_pvt_thread_mutex_unlock(&vq->ltp_mutex);
+	}
+	if (task)
+		pq->ltp_steals++;
+	return task;
+}
+
+/* Wake an idle thread in some queue other than pq, if there is one,
+ * so it can steal the task just queued on pq. Called with no queue
+ * locked; signalling under the target's mutex means the wakeup cannot
+ * slip in between its steal attempt and its wait.
+ */
+static void
+ldap_int_thread_pool_poke(
+	struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq )
+{
+	struct ldap_int_thread_poolq_s *vq;
+	int i;
+
+	for (i=0; i<pool->ltp_numqs; i++) {
+		vq = pool->ltp_wqs[i];
+		if (vq == pq ||
+			vq->ltp_open_count - vq->ltp_starting <= vq->ltp_active_count)
+			continue;
+		ldap_pvt_thread_mutex_lock(&vq->ltp_mutex);
+		ldap_pvt_thread_cond_signal(&vq->ltp_cond);
+		ldap_pvt_thread_mutex_unlock(&vq->ltp_mutex);
+		break;
+	}
+}
+
 /* Thread loop.  Accept and handle submitted tasks. */
 static void *
 ldap_int_thread_pool_wrapper ( 
@@ -946,7 +1250,7 @@ ldap_int_thread_pool_wrapper (
 	ldap_int_tpool_plist_t *work_list;
 	ldap_int_thread_userctx_t ctx, *kctx;
 	unsigned i, keyslot, hash;
-	int pool_lock = 0, freeme = 0;
+	int pool_lock = 0, freeme = 0, stolen;
 
 	assert(pool != NULL);
 
@@ -960,6 +1264,9 @@ ldap_int_thread_pool_wrapper (
 
 	ldap_pvt_thread_key_setdata( ldap_tpool_key, &ctx );
 
+	if (pool->ltp_affinity)
+		ldap_int_thread_pool_bind( pq );
+
 	if (pool->ltp_pause) {
 		ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
 		/* thread_keys[] is read-only when paused */
@@ -986,6 +1293,9 @@ ldap_int_thread_pool_wrapper (
 	for (;;) {
 		work_list = pq->ltp_work_list; /* help the compiler a bit */
 		task = LDAP_STAILQ_FIRST(work_list);
+		stolen = 0;
+		if (task == NULL && (task = ldap_int_thread_pool_steal(pq)) != NULL)
+			stolen = 1;
 		if (task == NULL) {	/* paused or no pending tasks */
 			if (--(pq->ltp_active_count) < 1) {
 				if (pool->ltp_pause) {
@@ -1031,6 +1341,9 @@ ldap_int_thread_pool_wrapper (
 
 				work_list = pq->ltp_work_list;
 				task = LDAP_STAILQ_FIRST(work_list);
+				if (task == NULL && !pool_lock &&
+					(task = ldap_int_thread_pool_steal(pq)) != NULL)
+					stolen = 1;
 			} while (task == NULL);
 
 			if (pool_lock) {
@@ -1041,8 +1354,13 @@ ldap_int_thread_pool_wrapper (
 			pq->ltp_active_count++;
 		}
 
-		LDAP_STAILQ_REMOVE_HEAD(work_list, ltt_next.q);
-		pq->ltp_pending_count--;
+		if (!stolen) {
+			LDAP_STAILQ_REMOVE_HEAD(work_list, ltt_next.q);
+			pq->ltp_pending_count--;
+			if (pq->ltp_prio_last == task)
+				pq->ltp_prio_last = NULL;
+			ldap_int_thread_pool_waited(pq, task);
+		}
 		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 
 		task->ltt_start_routine(&ctx, task->ltt_arg);
@@ -1168,6 +1486,7 @@ handle_pause( ldap_pvt_thread_pool_t *tpool, int pause_type )
 		assert(!pool->ltp_pause);
 		pool->ltp_pause = WANT_PAUSE;
 		pool->ltp_active_queues = 0;
+		gettimeofday(&pool->ltp_pause_start, NULL);
 
 		for (i=0; i<pool->ltp_numqs; i++)
 			if (pool->ltp_wqs[i] == pq) break;
@@ -1266,6 +1585,15 @@ ldap_pvt_thread_pool_resume (
 	ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
 	assert(pool->ltp_pause == PAUSED);
 	pool->ltp_pause = 0;
+	{
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		if (now.tv_sec >= pool->ltp_pause_start.tv_sec)
+			pool->ltp_pause_msec +=
+				(now.tv_sec - pool->ltp_pause_start.tv_sec) * 1000 +
+				(now.tv_usec - pool->ltp_pause_start.tv_usec) / 1000;
+		pool->ltp_pauses++;
+	}
 	for (i=0; i<pool->ltp_numqs; i++) {
 		pq = pool->ltp_wqs[i];
 		pq->ltp_work_list = &pq->ltp_pending_list;
@@ -303,6 +303,8 @@ typedef void (MDB_rel_func)(MDB_val *item, void *oldptr, void *newptr, void *rel
 #define MDB_NORDAHEAD	0x800000
 	/** don't initialize malloc'd memory before writing to datafile */
 #define MDB_NOMEMINIT	0x1000000
+	/** advise the OS to back the map with huge pages */
+#define MDB_HUGEPAGE	0x2000000
 /** @} */
 
 /**	@defgroup	mdb_dbi_open	Database Flags
@@ -356,6 +358,11 @@ typedef void (MDB_rel_func)(MDB_val *item, void *oldptr, void *newptr, void *rel
  * pages sequentially.
  */
 #define MDB_CP_COMPACT	0x01
+/** With #MDB_CP_COMPACT: use \b n more threads to read the pages
+ * ahead of the copy, for storage that serves many reads at once.
+ * At most 255.
+ */
+#define MDB_CP_THREADS(n)	(((unsigned int)(n) & 0xff) << 8)
 /*	@} */
 
 /** @brief Cursor Get operations.
@@ -463,6 +470,24 @@ typedef struct MDB_stat {
 	size_t		ms_entries;			/**< Number of data items */
 } MDB_stat;
 
+/** @brief Activity counters for a database, see #mdb_env_set_counters() */
+typedef struct MDB_counters {
+	size_t		mc_page_gets;		/**< Pages visited */
+	size_t		mc_page_samples;	/**< Mapped pages checked for residency */
+	size_t		mc_page_faults;		/**< Checked pages that were not in RAM */
+	size_t		mc_splits;			/**< Page splits */
+	size_t		mc_merges;			/**< Page merges */
+	size_t		mc_overflow_allocs;	/**< Overflow page runs allocated */
+	size_t		mc_freelist_searches;	/**< Page allocations that searched
+											the freelist (FREE_DBI only) */
+	size_t		mc_freelist_reads;	/**< FreeDB records read by those
+											searches (FREE_DBI only) */
+	size_t		mc_commits;			/**< Write txns committed with changes
+											(FREE_DBI only) */
+	size_t		mc_dirty_pages;		/**< Dirty pages those commits wrote
+											(FREE_DBI only) */
+} MDB_counters;
+
 /** @brief Information about the environment */
 typedef struct MDB_envinfo {
 	void	*me_mapaddr;			/**< Address of map, if fixed */
@@ -614,6 +639,18 @@ int  mdb_env_create(MDB_env **env);
 	 *		caller is expected to overwrite all of the memory that was
 	 *		reserved in that case.
 	 *		This flag may be changed at any time using #mdb_env_set_flags().
+	 *	<li>#MDB_HUGEPAGE
+	 *		Ask the OS to back the memory map with transparent huge pages.
+	 *		When the DB is much larger than the CPU's TLB reach, random reads
+	 *		spend a noticeable share of their time on TLB misses, and huge
+	 *		pages cut that down. For a read-only map this needs an OS that
+	 *		can collapse file-backed pages, e.g. Linux built with
+	 *		CONFIG_READ_ONLY_THP_FOR_FS; the collapse happens in the background
+	 *		after the pages have been read in. With #MDB_WRITEMAP on a DAX
+	 *		filesystem the pages are mapped large directly, provided the data
+	 *		file has been preallocated (e.g. with fallocate) to the full map
+	 *		size so that its blocks are contiguous. The flag is only advice
+	 *		and is ignored where the OS has no such facility, including Windows.
 	 * </ul>
 	 * @param[in] mode The UNIX permissions to set on created files and semaphores.
 	 * This parameter is ignored on Windows.
@@ -681,6 +718,9 @@ int  mdb_env_copyfd(MDB_env *env, mdb_filehandle_t fd);
 	 *		pages and sequentially renumber all pages in output. This option
 	 *		consumes more CPU and runs more slowly than the default.
 	 *		Currently it fails if the environment has suffered a page leak.
+	 *	<li>#MDB_CP_THREADS(n) - With #MDB_CP_COMPACT, have \b n threads
+	 *		read the subtrees just ahead of the copy into the page cache, so
+	 *		several reads are in progress at a time. The output is the same.
 	 * </ul>
 	 * @return A non-zero error value on failure and 0 on success.
 	 */
@@ -705,6 +745,51 @@ int  mdb_env_copy2(MDB_env *env, const char *path, unsigned int flags);
 	 */
 int  mdb_env_copyfd2(MDB_env *env, mdb_filehandle_t fd, unsigned int flags);
 
+	/** @brief Copy the pages of an LMDB environment changed since an
+	 *	earlier copy.
+	 *
+	 * Writes an incremental copy, a delta, that #mdb_delta_apply() applies
+	 * to the earlier copy to bring it up to the current state. Every page
+	 * is read and compared against the fingerprints of the earlier copy
+	 * recorded in \b manifest, but only the pages that differ are written,
+	 * so writing a delta costs in proportion to the change volume. The
+	 * manifest is replaced with the fingerprints of this copy when the
+	 * delta has been written successfully. Without a manifest all pages
+	 * are written, and applying the delta to an empty file makes a full
+	 * copy. Deltas must be applied in the order they were taken.
+	 * @note This call can trigger significant file size growth if run in
+	 * parallel with write transactions, because it employs a read-only
+	 * transaction. See long-lived transactions under @ref caveats_sec.
+	 * @param[in] env An environment handle returned by #mdb_env_create(). It
+	 * must have already been opened successfully.
+	 * @param[in] fd The filedescriptor to write the delta to. It must
+	 * have already been opened for Write access.
+	 * @param[in] manifest The path of the manifest file.
+	 * @return A non-zero error value on failure and 0 on success. Some
+	 * possible errors are:
+	 * <ul>
+	 *	<li>#MDB_INVALID - the manifest is damaged or belongs to an
+	 *		environment with another page size.
+	 * </ul>
+	 */
+int  mdb_env_copy_delta(MDB_env *env, mdb_filehandle_t fd, const char *manifest);
+
+	/** @brief Apply a delta written by #mdb_env_copy_delta() to a copy.
+	 *
+	 * The copy is a plain data file, not an open environment.
+	 * @param[in] delta The filedescriptor to read the delta from.
+	 * @param[in] fd The filedescriptor of the copy's data file. It must
+	 * have been opened for Read and Write access.
+	 * @return A non-zero error value on failure and 0 on success. Some
+	 * possible errors are:
+	 * <ul>
+	 *	<li>#MDB_INVALID - the delta or the copy is damaged.
+	 *	<li>EINVAL - the copy is not at the state the delta was taken
+	 *		against, or the delta is a full copy and the file is not empty.
+	 * </ul>
+	 */
+int  mdb_delta_apply(mdb_filehandle_t delta, mdb_filehandle_t fd);
+
 	/** @brief Return statistics about the LMDB environment.
 	 *
 	 * @param[in] env An environment handle returned by #mdb_env_create()
@@ -863,6 +948,45 @@ int  mdb_env_set_mapsize(MDB_env *env, size_t size);
 	 */
 int  mdb_env_set_maxreaders(MDB_env *env, unsigned int readers);
 
+	/** @brief Let write transactions of this process share commits (experimental).
+	 *
+	 * Normally each write transaction holds the environment's writer lock
+	 * from #mdb_txn_begin() to its own commit, so concurrent writers wait
+	 * for each other's page writes and meta page update. With batching,
+	 * the first writer to arrive begins a top-level transaction and leads
+	 * a batch. It and the writers that arrive while the batch is open get
+	 * a nested transaction of that one. The nested transactions still run
+	 * one after the other, but pages touched by several of them are written
+	 * once, and the batch needs a single meta page update and sync.
+	 *
+	 * To the caller, a batch member looks like a plain write transaction.
+	 * It sees the changes of the members before it. #mdb_txn_abort() only
+	 * discards its own changes. #mdb_txn_commit() returns once the whole
+	 * batch has been committed, and reports the result of that commit. If
+	 * the batch fails to commit, all its members fail. After committing
+	 * its own transaction, the leader waits for the members that already
+	 * joined to finish. If the previous batch had more than one member,
+	 * it also waits up to \b usec microseconds for more to join.
+	 *
+	 * Members must not begin another write transaction, nor wait for
+	 * another thread that might begin one, while their transaction is open.
+	 * Batching only applies to threads of this process. It is not used with
+	 * #MDB_WRITEMAP or #MDB_RDONLY, which do not allow nested transactions,
+	 * and it is not implemented on Windows.
+	 * This function may be called at any time; transactions already
+	 * begun finish the way they started.
+	 * @param[in] env An environment handle returned by #mdb_env_create()
+	 * @param[in] max The maximum number of write transactions in a batch.
+	 * 0 or 1 turn batching off, which is the default.
+	 * @param[in] usec How long a leader may wait for more writers to join
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  mdb_env_set_writebatch(MDB_env *env, unsigned int max, unsigned int usec);
+
 	/** @brief Get the maximum number of threads/reader slots for the environment.
 	 *
 	 * @param[in] env An environment handle returned by #mdb_env_create()
@@ -1141,6 +1265,43 @@ int  mdb_dbi_open(MDB_txn *txn, const char *name, unsigned int flags, MDB_dbi *d
 	 */
 int  mdb_stat(MDB_txn *txn, MDB_dbi dbi, MDB_stat *stat);
 
+	/** @brief Turn on activity counters for the databases of an environment.
+	 *
+	 * While on, every database handle counts its page visits, splits,
+	 * merges and overflow allocations, and the freelist (handle 0)
+	 * counts its searches. The counters are plain increments, so they
+	 * are cheap but may miss a few events when several threads hit the
+	 * same database at once. Mapped pages are also sampled with
+	 * mincore(), to estimate how much of each database is not in RAM.
+	 * Turning counters on again resets them.
+	 * @param[in] env An environment handle returned by #mdb_env_create(),
+	 * opened with #mdb_env_open()
+	 * @param[in] sample 0 turns the counters off. Otherwise, one page
+	 * visit in \b sample is checked for residency; 1 checks every page.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 *	<li>ENOMEM - out of memory.
+	 * </ul>
+	 */
+int  mdb_env_set_counters(MDB_env *env, unsigned int sample);
+
+	/** @brief Retrieve the activity counters of a database.
+	 *
+	 * @param[in] env An environment handle returned by #mdb_env_create()
+	 * @param[in] dbi A database handle returned by #mdb_dbi_open()
+	 * @param[out] ctr The address of an #MDB_counters structure
+	 * 	where the counters will be copied. They are all zero if
+	 * 	counters were never turned on.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  mdb_env_counters(MDB_env *env, MDB_dbi dbi, MDB_counters *ctr);
+
 	/** @brief Retrieve the DB flags for a database handle.
 	 *
 	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
@@ -1445,6 +1606,29 @@ MDB_dbi mdb_cursor_dbi(MDB_cursor *cursor);
 int  mdb_cursor_get(MDB_cursor *cursor, MDB_val *key, MDB_val *data,
 			    MDB_cursor_op op);
 
+	/** @brief Retrieve the data items for several keys.
+	 *
+	 * This is the same as calling #mdb_cursor_get() with #MDB_SET for
+	 * each key in turn. When the keys are in ascending order, each search
+	 * starts from the cursor's current position and only climbs as far up
+	 * the tree as needed, instead of starting again from the root.
+	 * For #MDB_DUPSORT databases the first data item of each key is
+	 * returned. On return the cursor is positioned near the last key.
+	 * See #mdb_get() for restrictions on using the output values.
+	 * @param[in] cursor A cursor handle returned by #mdb_cursor_open()
+	 * @param[in] keys An array of \b count keys, preferably sorted
+	 * @param[out] data An array of \b count items. The data of a key
+	 * that was not found is returned with a NULL mv_data.
+	 * @param[in] count The number of keys
+	 * @return A non-zero error value on failure and 0 on success, even if
+	 * some or all of the keys were not found. Some possible errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  mdb_cursor_get_multi(MDB_cursor *cursor, MDB_val *keys, MDB_val *data,
+			    size_t count);
+
 	/** @brief Store by cursor.
 	 *
 	 * This function stores key/data pairs into the database.
@@ -1526,6 +1710,21 @@ int  mdb_cursor_put(MDB_cursor *cursor, MDB_val *key, MDB_val *data,
 	 */
 int  mdb_cursor_del(MDB_cursor *cursor, unsigned int flags);
 
+	/** @brief Hint that a cursor will mostly be moved forward.
+	 *
+	 * Each time the cursor arrives on another leaf page, the overflow
+	 * pages of the records ahead on it and the next leaf pages are
+	 * announced to the OS with madvise(MADV_WILLNEED), so they are read
+	 * in the background instead of faulting in one at a time. This is
+	 * mostly useful with #MDB_NORDAHEAD, for scans of key ranges. The
+	 * hint is kept when the cursor is renewed.
+	 * @param[in] cursor A cursor handle returned by #mdb_cursor_open()
+	 * @param[in] pages The number of leaf pages to keep announced ahead
+	 * of the cursor. 0 turns the hint off.
+	 * @return A non-zero error value on failure and 0 on success.
+	 */
+int  mdb_cursor_readahead(MDB_cursor *cursor, unsigned int pages);
+
 	/** @brief Return count of duplicates for current key.
 	 *
 	 * This call is only valid on databases that support sorted duplicate
@@ -1540,6 +1739,31 @@ int  mdb_cursor_del(MDB_cursor *cursor, unsigned int flags);
 	 */
 int  mdb_cursor_count(MDB_cursor *cursor, size_t *countp);
 
+	/** @brief Estimate the number of data items in a range of keys.
+	 *
+	 * Counts the data items, including duplicates, whose keys are
+	 * between \b lo and \b hi inclusive. When the whole range lies on
+	 * one leaf page the count is exact; this includes a range of a single
+	 * key, whose duplicates are counted from the header of their sub-DB
+	 * without reading it, unlike #mdb_cursor_count() which needs the
+	 * cursor positioned on the first duplicate. Otherwise the count is
+	 * estimated from where the two keys fall in the tree, as if the items
+	 * were spread evenly over its pages. Either way only the two paths
+	 * from the root to the ends of the range are read.
+	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #mdb_dbi_open()
+	 * @param[in] lo The lowest key of the range, or NULL for the first key
+	 * @param[in] hi The highest key of the range, or NULL for the last key
+	 * @param[out] countp Address where the count will be stored
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  mdb_estimate_range(MDB_txn *txn, MDB_dbi dbi, MDB_val *lo, MDB_val *hi,
+	size_t *countp);
+
 	/** @brief Compare two data items according to a particular database.
 	 *
 	 * This returns a comparison as if the two data items were keys in the
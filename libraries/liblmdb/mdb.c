@@ -69,6 +69,7 @@
 #include <sys/param.h>
 #include <sys/uio.h>
 #include <sys/mman.h>
+#include <sys/time.h>
 #ifdef HAVE_SYS_FILE_H
 #include <sys/file.h>
 #endif
@@ -147,6 +148,19 @@ typedef SSIZE_T	ssize_t;
 # error "Ambiguous shared-lock implementation"
 #endif
 
+/* Compile with -DMDB_USE_IO_URING to have commits write their dirty
+ * pages through an io_uring: all of them in one batch, followed by the
+ * fdatasync in the same batch. Falls back to pwritev() at runtime if
+ * the kernel refuses to set up a ring.
+ */
+#ifdef MDB_USE_IO_URING
+# ifndef __linux
+#  error "MDB_USE_IO_URING needs Linux"
+# endif
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
 #ifdef USE_VALGRIND
 #include <valgrind/memcheck.h>
 #define VGMEMP_CREATE(h,r,z)    VALGRIND_CREATE_MEMPOOL(h,r,z)
@@ -667,6 +681,30 @@ typedef uint16_t	 indx_t;
 	 */
 #ifndef CACHELINE
 #define CACHELINE	64
+#endif
+
+	/**	Claim and release reader slots with compare-and-swap on
+	 *	#MDB_reader.%mr_pid instead of under the reader mutex.
+	 *	The mutex is then only taken to grow the table and to
+	 *	clear stale slots.
+	 *	Processes must agree on this, so it is part of #MDB_LOCK_FORMAT:
+	 *	an environment is then unusable by builds without it. Off by
+	 *	default, needs GCC >= 4.4, clang or Windows.
+	 */
+#ifndef MDB_RDR_CAS
+#define MDB_RDR_CAS	0
+#endif
+
+#if MDB_RDR_CAS
+# ifdef _WIN32
+#  define MDB_CAS(ptr, old, new) \
+	(InterlockedCompareExchange((LONG volatile *)(ptr), \
+		(LONG)(new), (LONG)(old)) == (LONG)(old))
+#  define MDB_MEMBAR()	MemoryBarrier()
+# else
+#  define MDB_CAS(ptr, old, new)	__sync_bool_compare_and_swap(ptr, old, new)
+#  define MDB_MEMBAR()	__sync_synchronize()
+# endif
 #endif
 
 	/**	The information we store in a single slot of the reader table.
@@ -743,6 +781,10 @@ typedef struct MDB_txbody {
 		 *	when readers release their slots.
 		 */
 	volatile unsigned	mtb_numreaders;
+		/** Where to start looking for a free reader slot: just past
+		 *	the last one claimed or at the last one freed. Only a hint.
+		 */
+	volatile unsigned	mtb_rdrhint;
 } MDB_txbody;
 
 	/** The actual reader table definition. */
@@ -755,6 +797,7 @@ typedef struct MDB_txninfo {
 #define mti_rmname	mt1.mtb.mtb_rmname
 #define mti_txnid	mt1.mtb.mtb_txnid
 #define mti_numreaders	mt1.mtb.mtb_numreaders
+#define mti_rdrhint	mt1.mtb.mtb_rdrhint
 		char pad[(sizeof(MDB_txbody)+CACHELINE-1) & ~(CACHELINE-1)];
 	} mt1;
 	union {
@@ -775,7 +818,8 @@ typedef struct MDB_txninfo {
 	((uint32_t) \
 	 ((MDB_LOCK_VERSION) \
 	  /* Flags which describe functionality */ \
-	  + (((MDB_PIDLOCK) != 0) << 16)))
+	  + (((MDB_PIDLOCK) != 0) << 16) \
+	  + (((MDB_RDR_CAS) != 0) << 17)))
 /** @} */
 
 /** Common header for all page types. The page type depends on #mp_flags.
@@ -1151,6 +1195,10 @@ struct MDB_txn {
 #define MDB_TXN_BLOCKED		(MDB_TXN_FINISHED|MDB_TXN_ERROR|MDB_TXN_HAS_CHILD)
 /** @} */
 	unsigned int	mt_flags;		/**< @ref mdb_txn */
+	/** Nested txn of a write batch, see #mdb_env_set_writebatch() */
+	unsigned int	mt_batch;
+#define MDB_BATCH_MEMBER	1	/**< joined the batch */
+#define MDB_BATCH_LEADER	2	/**< started the batch, commits it */
 	/** #dirty_list room: Array size - \#dirty pages visible to this txn.
 	 *	Includes ancestor txns' dirty pages not hidden by other txns'
 	 *	dirty/spilled pages. Thus commit(nested txn) has room to merge
@@ -1208,6 +1256,11 @@ struct MDB_cursor {
 	unsigned int	mc_flags;	/**< @ref mdb_cursor */
 	MDB_page	*mc_pg[CURSOR_STACK];	/**< stack of pushed pages */
 	indx_t		mc_ki[CURSOR_STACK];	/**< stack of page indices */
+	/** Leaf pages to announce ahead, see #mdb_cursor_readahead() */
+	unsigned int	mc_ra;
+	indx_t		mc_ra_next;		/**< first branch index not announced yet */
+	MDB_page	*mc_ra_leaf;	/**< leaf already handled */
+	MDB_page	*mc_ra_branch;	/**< branch mc_ra_next belongs to */
 };
 
 	/** Context for sorted-dup records.
@@ -1247,6 +1300,11 @@ typedef struct MDB_xcursor {
 typedef struct MDB_pgstate {
 	pgno_t		*mf_pghead;	/**< Reclaimed freeDB pages, or NULL before use */
 	txnid_t		mf_pglast;	/**< ID of last used record, or 0 if !mf_pghead */
+	/** No run of contiguous pages in mf_pghead is longer than this,
+	 *	or 0 if not known. Lets #mdb_page_alloc() skip searching the
+	 *	list for ranges it does not have.
+	 */
+	pgno_t		mf_pgrun;
 } MDB_pgstate;
 
 	/** The database environment. */
@@ -1289,6 +1347,7 @@ struct MDB_env {
 	MDB_pgstate	me_pgstate;		/**< state of old pages from freeDB */
 #	define		me_pglast	me_pgstate.mf_pglast
 #	define		me_pghead	me_pgstate.mf_pghead
+#	define		me_pgrun	me_pgstate.mf_pgrun
 	MDB_page	*me_dpages;		/**< list of malloc'd blocks for re-use */
 	/** IDL of pages that became unused in a write txn */
 	MDB_IDL		me_free_pgs;
@@ -1302,6 +1361,30 @@ struct MDB_env {
 	unsigned int	me_maxkey;	/**< max size of a key */
 #endif
 	int		me_live_reader;		/**< have liveness lock in reader table */
+#ifdef MDB_USE_IO_URING
+	struct MDB_uring *me_uring;	/**< for #mdb_page_flush(), set up on first use */
+#endif
+	MDB_counters	*me_ctrs;	/**< per-DBI counters, #mdb_env_set_counters() */
+	unsigned int	me_ctr_sample;	/**< residency sample interval, 0 = off */
+	unsigned int	me_ctr_tick;	/**< page gets since the last sample */
+#ifndef _WIN32
+	/* write batching, #mdb_env_set_writebatch() */
+	pthread_mutex_t	me_bmutex;	/**< protects the me_b* fields */
+	pthread_cond_t	me_bcond;	/**< broadcast on any batch progress */
+	MDB_txn		*me_btxn;	/**< top-level txn of the current batch */
+	int		me_bstate;	/**< #MDB_BATCH_IDLE etc. */
+#define MDB_BATCH_IDLE		0	/**< no batch */
+#define MDB_BATCH_STARTING	1	/**< leader is beginning #me_btxn */
+#define MDB_BATCH_OPEN		2	/**< writers may join */
+#define MDB_BATCH_CLOSED	3	/**< leader is committing #me_btxn */
+	unsigned int	me_bmax;	/**< max writers per batch */
+	unsigned int	me_bwait;	/**< usecs the leader waits for joiners */
+	unsigned int	me_bjoined;	/**< writers in the current batch */
+	unsigned int	me_bactive;	/**< of those, not yet finished */
+	unsigned int	me_blast;	/**< writers in the previous batch */
+	int		me_brc;		/**< commit result of the previous batch */
+	size_t		me_bgen;	/**< number of batches committed */
+#endif
 #ifdef _WIN32
 	int		me_pidquery;		/**< Used in OpenProcess */
 #endif
@@ -1332,6 +1415,15 @@ typedef struct MDB_ntxn {
 	/** max bytes to write in one call */
 #define MAX_WRITE		(0x40000000U >> (sizeof(ssize_t) == 4))
 
+	/** Count an event on the database of cursor \b mc,
+	 *	if #mdb_env_set_counters() turned counting on.
+	 */
+#define MDB_COUNT(mc, field) do { \
+	MDB_env *ce_ = (mc)->mc_txn->mt_env; \
+	if (ce_->me_ctr_sample) \
+		ce_->me_ctrs[(mc)->mc_dbi].field++; \
+	} while (0)
+
 	/** Check \b txn and \b dbi arguments to a function */
 #define TXN_DBI_EXIST(txn, dbi, validity) \
 	((txn) && (dbi)<(txn)->mt_numdbs && ((txn)->mt_dbflags[dbi] & (validity)))
@@ -1958,7 +2050,7 @@ mdb_pages_xkeep(MDB_cursor *mc, unsigned pflags, int all)
 	return rc;
 }
 
-static int mdb_page_flush(MDB_txn *txn, int keep);
+static int mdb_page_flush(MDB_txn *txn, int keep, int sync);
 
 /**	Spill pages from the dirty list back to disk.
  * This is intended to prevent running into #MDB_TXN_FULL situations,
@@ -2079,7 +2171,7 @@ mdb_page_spill(MDB_cursor *m0, MDB_val *key, MDB_val *data)
 	mdb_midl_sort(txn->mt_spill_pgs);
 
 	/* Flush the spilled part of dirty list */
-	if ((rc = mdb_page_flush(txn, i)) != MDB_SUCCESS)
+	if ((rc = mdb_page_flush(txn, i, 0)) != MDB_SUCCESS)
 		goto done;
 
 	/* Reset any dirty pages we kept that page_flush didn't see */
@@ -2128,6 +2220,115 @@ mdb_page_dirty(MDB_txn *txn, MDB_page *mp)
 	txn->mt_dirty_room--;
 }
 
+/** Find the tail-most run of \b num contiguous pages in a page list.
+ * @param[in] mop the list, in descending order.
+ * @param[in] num the number of pages wanted.
+ * @param[out] longest set to the longest run if none is long enough.
+ * @return the position of the lowest page of the run, or 0.
+ */
+static unsigned
+mdb_pgrun_scan(pgno_t *mop, unsigned num, pgno_t *longest)
+{
+	unsigned i = mop[0], start = i, max = 0;
+
+	for (; i; i--) {
+		if (i < start && mop[i] != mop[i+1] + 1) {
+			if (max < start - i)
+				max = start - i;
+			start = i;
+		}
+		if (start - i + 1 == num)
+			return start;
+	}
+	if (max < start - i)
+		max = start - i;
+	*longest = max;
+	return 0;
+}
+
+/** Look for a run of \b num contiguous pages through the pages just
+ * merged into a page list. Other runs in the list are known to be
+ * shorter, so this is all that needs checking after a merge.
+ * @param[in] mop the list, in descending order.
+ * @param[in] merged the pages merged into it, in descending order.
+ * @param[in] num the number of pages wanted.
+ * @param[in,out] longest raised to the longest run through the
+ * merged pages.
+ * @return the position of the lowest page of the tail-most run
+ * found, or 0.
+ */
+static unsigned
+mdb_pgrun_merged(pgno_t *mop, pgno_t *merged, unsigned num, pgno_t *longest)
+{
+	unsigned i, lo, hi, step, len = mop[0], pos = 1, found = 0;
+	pgno_t covered = P_INVALID;
+
+	for (i = 1; i <= merged[0]; i++) {
+		if (merged[i] >= covered)
+			continue;
+		/* Gallop from the previous page's position, they are in order */
+		for (step = 1; pos + step <= len && mop[pos + step] > merged[i]; step <<= 1) ;
+		lo = pos + (step >> 1);
+		hi = pos + step <= len ? pos + step : len;
+		while (lo < hi) {
+			unsigned mid = lo + ((hi - lo) >> 1);
+			if (mop[mid] > merged[i])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		while (hi < len && mop[hi+1] == mop[hi] - 1)
+			hi++;
+		while (lo > 1 && mop[lo-1] == mop[lo] + 1)
+			lo--;
+		covered = mop[hi];
+		pos = hi;
+		if (*longest < hi - lo + 1)
+			*longest = hi - lo + 1;
+		if (hi - lo + 1 >= num)
+			found = hi;
+	}
+	return found;
+}
+
+/** Merge freeDB pages into me_pghead, and look for a run of \b num
+ * pages through them if the list has been scanned already.
+ * @param[in] env the environment.
+ * @param[in] idl the pages, in descending order.
+ * @param[in] num the number of pages wanted.
+ * @param[in] scanned the list was searched for \b num pages before.
+ * @param[out] found the position of the lowest page of a run, or 0.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_pghead_merge(MDB_env *env, pgno_t *idl, unsigned num, int scanned,
+	unsigned *found)
+{
+	int rc;
+
+	if (!env->me_pghead) {
+		if (!(env->me_pghead = mdb_midl_alloc(idl[0])))
+			return ENOMEM;
+	} else if ((rc = mdb_midl_need(&env->me_pghead, idl[0])) != 0) {
+		return rc;
+	}
+	/* Merge in descending sorted order */
+	mdb_midl_xmerge(env->me_pghead, idl);
+	*found = 0;
+	if (scanned) {
+		*found = mdb_pgrun_merged(env->me_pghead, idl, num, &env->me_pgrun);
+	} else if (env->me_pgrun) {
+		/* Learn the runs it made before they are looked for */
+		mdb_pgrun_merged(env->me_pghead, idl, (unsigned)-1, &env->me_pgrun);
+	}
+	return MDB_SUCCESS;
+}
+
+/** Read freeDB records ahead of merging them once me_pghead has this
+ *	many pages, since each merge moves the pages below the new ones.
+ */
+#define MDB_PGHEAD_BATCH	4096
+
 /** Allocate page numbers and memory for writing.  Maintain me_pglast,
  * me_pghead and mt_next_pgno.  Set #MDB_TXN_ERROR on failure.
  *
@@ -2160,13 +2361,13 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 	int rc, retry = num * 60;
 	MDB_txn *txn = mc->mc_txn;
 	MDB_env *env = txn->mt_env;
-	pgno_t pgno, *mop = env->me_pghead;
+	pgno_t pgno, *mop = env->me_pghead, *pend = NULL;
 	unsigned i, j, mop_len = mop ? mop[0] : 0, n2 = num-1;
 	MDB_page *np;
 	txnid_t oldest = 0, last;
 	MDB_cursor_op op;
 	MDB_cursor m2;
-	int found_old = 0;
+	int found_old = 0, scanned = 0;
 
 	/* If there are any loose pages, just use them */
 	if (num == 1 && txn->mt_loose_pgs) {
@@ -2196,17 +2397,23 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 		 * pages at the tail, just truncating the list.
 		 */
 		if (mop_len > n2) {
-			i = mop_len;
-			do {
-				pgno = mop[i];
-				if (mop[i-n2] == pgno+n2)
-					goto search_done;
-			} while (--i > n2);
+			if (!scanned) {
+				/* Later merges only need their own pages checked */
+				if (!env->me_pgrun || env->me_pgrun > n2) {
+					if ((i = mdb_pgrun_scan(mop, num, &env->me_pgrun)) != 0) {
+						pgno = mop[i];
+						goto search_done;
+					}
+				}
+				scanned = 1;
+			}
 			if (--retry < 0)
 				break;
 		}
 
 		if (op == MDB_FIRST) {	/* 1st iteration */
+			if (env->me_ctr_sample)
+				env->me_ctrs[FREE_DBI].mc_freelist_searches++;
 			/* Prepare to fetch more and coalesce */
 			last = env->me_pglast;
 			oldest = env->me_pgoldest;
@@ -2253,19 +2460,10 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 		leaf = NODEPTR(np, m2.mc_ki[m2.mc_top]);
 		if ((rc = mdb_node_read(&m2, leaf, &data)) != MDB_SUCCESS)
 			goto fail;
+		MDB_COUNT(&m2, mc_freelist_reads);
 
 		idl = (MDB_ID *) data.mv_data;
 		i = idl[0];
-		if (!mop) {
-			if (!(env->me_pghead = mop = mdb_midl_alloc(i))) {
-				rc = ENOMEM;
-				goto fail;
-			}
-		} else {
-			if ((rc = mdb_midl_need(&env->me_pghead, i)) != 0)
-				goto fail;
-			mop = env->me_pghead;
-		}
 		env->me_pglast = last;
 #if (MDB_DEBUG) > 1
 		DPRINTF(("IDL read txn %"Z"u root %"Z"u num %u",
@@ -2273,9 +2471,40 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 		for (j = i; j; j--)
 			DPRINTF(("IDL %"Z"u", idl[j]));
 #endif
-		/* Merge in descending sorted order */
-		mdb_midl_xmerge(mop, idl);
+		if (mop_len >= MDB_PGHEAD_BATCH) {
+			if (!pend && !(pend = mdb_midl_alloc(mop_len / 4))) {
+				rc = ENOMEM;
+				goto fail;
+			}
+			if ((rc = mdb_midl_append_list(&pend, idl)) != 0)
+				goto fail;
+			if (pend[0] < mop_len / 8)
+				continue;
+			mdb_midl_sort(pend);
+			idl = pend;
+		}
+		if ((rc = mdb_pghead_merge(env, idl, num, scanned, &i)) != 0)
+			goto fail;
+		mop = env->me_pghead;
 		mop_len = mop[0];
+		if (pend)
+			pend[0] = 0;
+		if (i) {
+			pgno = mop[i];
+			goto search_done;
+		}
+	}
+
+	if (pend && pend[0]) {
+		mdb_midl_sort(pend);
+		if ((rc = mdb_pghead_merge(env, pend, num, scanned, &i)) != 0)
+			goto fail;
+		mop = env->me_pghead;
+		mop_len = mop[0];
+		if (i) {
+			pgno = mop[i];
+			goto search_done;
+		}
 	}
 
 	/* Use new pages from the map when nothing suitable in the freeDB */
@@ -2307,10 +2536,12 @@ search_done:
 	np->mp_pgno = pgno;
 	mdb_page_dirty(txn, np);
 	*mp = np;
+	mdb_midl_free(pend);
 
 	return MDB_SUCCESS;
 
 fail:
+	mdb_midl_free(pend);
 	txn->mt_flags |= MDB_TXN_ERROR;
 	return rc;
 }
@@ -2666,6 +2897,107 @@ mdb_reader_pid(MDB_env *env, enum Pidlock_op op, MDB_PID_T pid)
 #endif
 }
 
+/** Claim a free slot in the reader table for this thread.
+ * @param[in] env the environment handle
+ * @param[out] rp address where the slot is returned
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_reader_claim(MDB_env *env, MDB_reader **rp)
+{
+	MDB_txninfo *ti = env->me_txns;
+	MDB_PID_T pid = env->me_pid;
+	MDB_THR_T tid = pthread_self();
+	mdb_mutexref_t rmutex = env->me_rmutex;
+	MDB_reader *r;
+	unsigned int i, nr;
+	int rc;
+
+#if MDB_RDR_CAS
+	unsigned int n;
+
+	/* Any slot whose mr_pid we swap from 0 to ours is ours. Start
+	 * at the hint so that threads coming up together mostly don't
+	 * contend for the same slots.
+	 */
+	nr = ti->mti_numreaders;
+	i = ti->mti_rdrhint;
+	for (n = 0; n < nr; n++, i++) {
+		if (i >= nr)
+			i = 0;
+		r = &ti->mti_readers[i];
+		if (!r->mr_pid && MDB_CAS(&r->mr_pid, 0, pid))
+			goto claimed;
+	}
+
+	/* The table is full as far as it goes, grow it */
+	if (LOCK_MUTEX(rc, env, rmutex))
+		return rc;
+	for (nr = ti->mti_numreaders, i = 0; i < nr; i++) {
+		r = &ti->mti_readers[i];
+		if (!r->mr_pid && MDB_CAS(&r->mr_pid, 0, pid)) {
+			UNLOCK_MUTEX(rmutex);
+			goto claimed;
+		}
+	}
+	if (i == env->me_maxreaders) {
+		UNLOCK_MUTEX(rmutex);
+		return MDB_READERS_FULL;
+	}
+	/* Nobody looks at the new slot until mti_numreaders covers
+	 * it, so it can be filled in before it is published.
+	 */
+	r = &ti->mti_readers[i];
+	r->mr_txnid = (txnid_t)-1;
+	r->mr_tid = tid;
+	r->mr_pid = pid;
+	MDB_MEMBAR();
+	ti->mti_numreaders = i + 1;
+	UNLOCK_MUTEX(rmutex);
+
+claimed:
+	/* A slot freed by mdb_reader_check() may still hold the txnid
+	 * of the dead reader. That only holds back the writer for
+	 * the moment until we reset it here.
+	 */
+	r->mr_txnid = (txnid_t)-1;
+	r->mr_tid = tid;
+	ti->mti_rdrhint = i + 1;
+	/* Other threads of this env may be claiming slots too */
+	while ((n = env->me_close_readers) < i + 1 &&
+		!MDB_CAS(&env->me_close_readers, n, i + 1))
+		;
+#else
+	if (LOCK_MUTEX(rc, env, rmutex))
+		return rc;
+	nr = ti->mti_numreaders;
+	for (i=0; i<nr; i++)
+		if (ti->mti_readers[i].mr_pid == 0)
+			break;
+	if (i == env->me_maxreaders) {
+		UNLOCK_MUTEX(rmutex);
+		return MDB_READERS_FULL;
+	}
+	r = &ti->mti_readers[i];
+	/* Claim the reader slot, carefully since other code
+	 * uses the reader table un-mutexed: First reset the
+	 * slot, next publish it in mti_numreaders.  After
+	 * that, it is safe for mdb_env_close() to touch it.
+	 * When it will be closed, we can finally claim it.
+	 */
+	r->mr_pid = 0;
+	r->mr_txnid = (txnid_t)-1;
+	r->mr_tid = tid;
+	if (i == nr)
+		ti->mti_numreaders = ++nr;
+	env->me_close_readers = nr;
+	r->mr_pid = pid;
+	UNLOCK_MUTEX(rmutex);
+#endif
+	*rp = r;
+	return MDB_SUCCESS;
+}
+
 /** Common code for #mdb_txn_begin() and #mdb_txn_renew().
  * @param[in] txn the transaction handle to initialize
  * @return 0 on success, non-zero on failure.
@@ -2676,7 +3008,7 @@ mdb_txn_renew0(MDB_txn *txn)
 	MDB_env *env = txn->mt_env;
 	MDB_txninfo *ti = env->me_txns;
 	MDB_meta *meta;
-	unsigned int i, nr, flags = txn->mt_flags;
+	unsigned int i, flags = txn->mt_flags;
 	uint16_t x;
 	int rc, new_notls = 0;
 
@@ -2692,42 +3024,15 @@ mdb_txn_renew0(MDB_txn *txn)
 				if (r->mr_pid != env->me_pid || r->mr_txnid != (txnid_t)-1)
 					return MDB_BAD_RSLOT;
 			} else {
-				MDB_PID_T pid = env->me_pid;
-				MDB_THR_T tid = pthread_self();
-				mdb_mutexref_t rmutex = env->me_rmutex;
-
 				if (!env->me_live_reader) {
-					rc = mdb_reader_pid(env, Pidset, pid);
+					rc = mdb_reader_pid(env, Pidset, env->me_pid);
 					if (rc)
 						return rc;
 					env->me_live_reader = 1;
 				}
 
-				if (LOCK_MUTEX(rc, env, rmutex))
+				if ((rc = mdb_reader_claim(env, &r)) != 0)
 					return rc;
-				nr = ti->mti_numreaders;
-				for (i=0; i<nr; i++)
-					if (ti->mti_readers[i].mr_pid == 0)
-						break;
-				if (i == env->me_maxreaders) {
-					UNLOCK_MUTEX(rmutex);
-					return MDB_READERS_FULL;
-				}
-				r = &ti->mti_readers[i];
-				/* Claim the reader slot, carefully since other code
-				 * uses the reader table un-mutexed: First reset the
-				 * slot, next publish it in mti_numreaders.  After
-				 * that, it is safe for mdb_env_close() to touch it.
-				 * When it will be closed, we can finally claim it.
-				 */
-				r->mr_pid = 0;
-				r->mr_txnid = (txnid_t)-1;
-				r->mr_tid = tid;
-				if (i == nr)
-					ti->mti_numreaders = ++nr;
-				env->me_close_readers = nr;
-				r->mr_pid = pid;
-				UNLOCK_MUTEX(rmutex);
 
 				new_notls = (env->me_flags & MDB_NOTLS);
 				if (!new_notls && (rc=pthread_setspecific(env->me_txkey, r))) {
@@ -2819,8 +3124,8 @@ mdb_txn_renew(MDB_txn *txn)
 	return rc;
 }
 
-int
-mdb_txn_begin(MDB_env *env, MDB_txn *parent, unsigned int flags, MDB_txn **ret)
+static int
+mdb_txn_begin0(MDB_env *env, MDB_txn *parent, unsigned int flags, MDB_txn **ret)
 {
 	MDB_txn *txn;
 	MDB_ntxn *ntxn;
@@ -2920,6 +3225,23 @@ renew:
 	return rc;
 }
 
+#ifndef _WIN32
+static int mdb_txn_batch_begin(MDB_env *env, MDB_txn **ret);
+static int mdb_txn_batch_commit(MDB_txn *txn);
+static void mdb_txn_batch_abort(MDB_txn *txn);
+#endif
+
+int
+mdb_txn_begin(MDB_env *env, MDB_txn *parent, unsigned int flags, MDB_txn **ret)
+{
+#ifndef _WIN32
+	if (env->me_bmax > 1 && !parent && !(flags & MDB_RDONLY) &&
+		!(env->me_flags & (MDB_RDONLY|MDB_WRITEMAP)))
+		return mdb_txn_batch_begin(env, ret);
+#endif
+	return mdb_txn_begin0(env, parent, flags, ret);
+}
+
 MDB_env *
 mdb_txn_env(MDB_txn *txn)
 {
@@ -3015,6 +3337,7 @@ mdb_txn_end(MDB_txn *txn, unsigned mode)
 			/* me_pgstate: */
 			env->me_pghead = NULL;
 			env->me_pglast = 0;
+			env->me_pgrun = 0;
 
 			env->me_txn = NULL;
 			mode = 0;	/* txn == env->me_txn0, do not free() it */
@@ -3051,16 +3374,28 @@ mdb_txn_reset(MDB_txn *txn)
 	mdb_txn_end(txn, MDB_END_RESET);
 }
 
+static void
+mdb_txn_abort0(MDB_txn *txn)
+{
+	if (txn->mt_child)
+		mdb_txn_abort0(txn->mt_child);
+
+	mdb_txn_end(txn, MDB_END_ABORT|MDB_END_SLOT|MDB_END_FREE);
+}
+
 void
 mdb_txn_abort(MDB_txn *txn)
 {
 	if (txn == NULL)
 		return;
 
-	if (txn->mt_child)
-		mdb_txn_abort(txn->mt_child);
-
-	mdb_txn_end(txn, MDB_END_ABORT|MDB_END_SLOT|MDB_END_FREE);
+#ifndef _WIN32
+	if (txn->mt_batch) {
+		mdb_txn_batch_abort(txn);
+		return;
+	}
+#endif
+	mdb_txn_abort0(txn);
 }
 
 /** Save the freelist as of this transaction to the freeDB.
@@ -3220,6 +3555,7 @@ mdb_freelist_save(MDB_txn *txn)
 		loose[0] = count;
 		mdb_midl_sort(loose);
 		mdb_midl_xmerge(mop, loose);
+		env->me_pgrun = 0;
 		txn->mt_loose_pgs = NULL;
 		txn->mt_loose_count = 0;
 		mop_len = mop[0];
@@ -3255,13 +3591,250 @@ mdb_freelist_save(MDB_txn *txn)
 	return rc;
 }
 
+#ifdef MDB_USE_IO_URING
+	/** Number of submission queue entries in the io_uring. Each one
+	 *	carries one pwritev() worth of pages.
+	 */
+#ifndef MDB_URING_ENTRIES
+#define MDB_URING_ENTRIES	64
+#endif
+
+	/** An io_uring for writing dirty pages, driven by raw syscalls.
+	 *	If the kernel doesn't provide it, ur_fd is -1 and
+	 *	#mdb_page_flush() uses pwritev() as usual.
+	 */
+typedef struct MDB_uring {
+	int		ur_fd;			/**< the ring, or -1 if unusable */
+	unsigned	ur_entries;		/**< number of SQEs */
+	unsigned	ur_queued;		/**< SQEs not yet submitted */
+	unsigned	ur_inflight;	/**< SQEs submitted, not yet completed */
+	int		ur_err;			/**< first error from a completion */
+	unsigned	*ur_sqhead, *ur_sqtail, *ur_sqarray, ur_sqmask;
+	unsigned	*ur_cqhead, *ur_cqtail, ur_cqmask;
+	struct io_uring_sqe	*ur_sqes;
+	struct io_uring_cqe	*ur_cqes;
+	void	*ur_sqmap, *ur_cqmap;
+	size_t	ur_sqmaplen, ur_cqmaplen, ur_sqeslen;
+	struct iovec	*ur_iov;	/**< iovecs of the writes in flight */
+	unsigned	ur_iovsize, ur_iovused;
+} MDB_uring;
+
+/** Set up the io_uring of an environment.
+ * Failure isn't an error, it only leaves the ring unusable.
+ */
+static void
+mdb_uring_open(MDB_uring *ur)
+{
+	struct io_uring_params p;
+	char *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	ur->ur_fd = syscall(__NR_io_uring_setup, MDB_URING_ENTRIES, &p);
+	if (ur->ur_fd < 0)
+		return;
+	ur->ur_entries = p.sq_entries;
+	ur->ur_sqmaplen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ur->ur_cqmaplen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ur->ur_cqmaplen > ur->ur_sqmaplen)
+			ur->ur_sqmaplen = ur->ur_cqmaplen;
+		ur->ur_cqmaplen = 0;
+	}
+	sq = mmap(NULL, ur->ur_sqmaplen, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, ur->ur_fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		goto fail;
+	ur->ur_sqmap = sq;
+	if (ur->ur_cqmaplen) {
+		cq = mmap(NULL, ur->ur_cqmaplen, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_POPULATE, ur->ur_fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED)
+			goto fail;
+		ur->ur_cqmap = cq;
+	} else {
+		cq = sq;
+	}
+	ur->ur_sqeslen = p.sq_entries * sizeof(struct io_uring_sqe);
+	ur->ur_sqes = mmap(NULL, ur->ur_sqeslen, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, ur->ur_fd, IORING_OFF_SQES);
+	if (ur->ur_sqes == MAP_FAILED) {
+		ur->ur_sqes = NULL;
+		goto fail;
+	}
+	ur->ur_sqhead = (unsigned *)(sq + p.sq_off.head);
+	ur->ur_sqtail = (unsigned *)(sq + p.sq_off.tail);
+	ur->ur_sqarray = (unsigned *)(sq + p.sq_off.array);
+	ur->ur_sqmask = *(unsigned *)(sq + p.sq_off.ring_mask);
+	ur->ur_cqhead = (unsigned *)(cq + p.cq_off.head);
+	ur->ur_cqtail = (unsigned *)(cq + p.cq_off.tail);
+	ur->ur_cqmask = *(unsigned *)(cq + p.cq_off.ring_mask);
+	ur->ur_cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return;
+
+fail:
+	if (ur->ur_cqmap)
+		munmap(ur->ur_cqmap, ur->ur_cqmaplen);
+	if (ur->ur_sqmap)
+		munmap(ur->ur_sqmap, ur->ur_sqmaplen);
+	ur->ur_sqmap = ur->ur_cqmap = NULL;
+	close(ur->ur_fd);
+	ur->ur_fd = -1;
+}
+
+static void
+mdb_uring_close(MDB_env *env)
+{
+	MDB_uring *ur = env->me_uring;
+
+	if (!ur)
+		return;
+	if (ur->ur_fd >= 0) {
+		munmap(ur->ur_sqes, ur->ur_sqeslen);
+		if (ur->ur_cqmap)
+			munmap(ur->ur_cqmap, ur->ur_cqmaplen);
+		munmap(ur->ur_sqmap, ur->ur_sqmaplen);
+		close(ur->ur_fd);
+	}
+	free(ur->ur_iov);
+	free(ur);
+	env->me_uring = NULL;
+}
+
+/** Submit everything queued and wait until all of it has completed.
+ * @return 0, or the first error of any of the operations.
+ */
+static int
+mdb_uring_wait(MDB_uring *ur)
+{
+	struct io_uring_cqe *cqe;
+	unsigned head, tail;
+	int rc;
+
+	while (ur->ur_queued || ur->ur_inflight) {
+		rc = syscall(__NR_io_uring_enter, ur->ur_fd, ur->ur_queued,
+			ur->ur_queued + ur->ur_inflight, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (rc < 0) {
+			rc = ErrCode();
+			/* EBUSY/EAGAIN: the kernel is short on completion
+			 * space or memory. Our writes are still pending, so
+			 * keep waiting rather than give up on them.
+			 */
+			if (rc == EINTR || rc == EBUSY || rc == EAGAIN)
+				continue;
+			return rc;
+		}
+		ur->ur_queued -= rc;
+		ur->ur_inflight += rc;
+		head = *ur->ur_cqhead;
+		tail = __atomic_load_n(ur->ur_cqtail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			cqe = &ur->ur_cqes[head & ur->ur_cqmask];
+			/* user_data is the expected result */
+			if (cqe->res != (int)cqe->user_data && !ur->ur_err) {
+				if (cqe->res < 0) {
+					ur->ur_err = -cqe->res;
+					DPRINTF(("io_uring write error: %s", strerror(ur->ur_err)));
+				} else {
+					ur->ur_err = EIO;
+					DPUTS("short write, filesystem full?");
+				}
+			}
+			ur->ur_inflight--;
+		}
+		__atomic_store_n(ur->ur_cqhead, head, __ATOMIC_RELEASE);
+	}
+	ur->ur_iovused = 0;
+	rc = ur->ur_err;
+	ur->ur_err = 0;
+	return rc;
+}
+
+/** Queue one operation. Waits for the ring to drain if it is full.
+ * @param[in] ur the ring
+ * @param[in] op IORING_OP_WRITEV or IORING_OP_FSYNC
+ * @param[in] fd the file
+ * @param[in] iov the iovecs for a write. They are copied.
+ * @param[in] n number of iovecs, or fsync flags
+ * @param[in] pos file offset of a write
+ * @param[in] size number of bytes written
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_uring_push(MDB_uring *ur, int op, HANDLE fd, struct iovec *iov,
+	unsigned n, size_t pos, size_t size)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail, idx;
+	int rc;
+
+	if (ur->ur_queued + ur->ur_inflight == ur->ur_entries &&
+		(rc = mdb_uring_wait(ur)))
+		return rc;
+	tail = *ur->ur_sqtail;
+	idx = tail & ur->ur_sqmask;
+	sqe = &ur->ur_sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = op;
+	sqe->fd = fd;
+	sqe->user_data = size;
+	if (op == IORING_OP_FSYNC) {
+		/* Only after all the writes before it */
+		sqe->flags = IOSQE_IO_DRAIN;
+		sqe->fsync_flags = n;
+	} else {
+		memcpy(ur->ur_iov + ur->ur_iovused, iov, n * sizeof(struct iovec));
+		sqe->addr = (uintptr_t)(ur->ur_iov + ur->ur_iovused);
+		sqe->len = n;
+		sqe->off = pos;
+		ur->ur_iovused += n;
+	}
+	ur->ur_sqarray[idx] = idx;
+	__atomic_store_n(ur->ur_sqtail, tail + 1, __ATOMIC_RELEASE);
+	ur->ur_queued++;
+	return MDB_SUCCESS;
+}
+
+/** Get the ring ready for a flush of up to \\b npages pages.
+ * @param[in] env the environment handle
+ * @param[in] npages number of pages to be written
+ * @param[out] urp the ring, or NULL if it is not usable
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_uring_prep(MDB_env *env, unsigned npages, MDB_uring **urp)
+{
+	MDB_uring *ur = env->me_uring;
+
+	*urp = NULL;
+	if (!ur) {
+		if ((ur = calloc(1, sizeof(MDB_uring))) == NULL)
+			return ENOMEM;
+		mdb_uring_open(ur);
+		env->me_uring = ur;
+	}
+	if (ur->ur_fd < 0)
+		return MDB_SUCCESS;
+	if (npages > ur->ur_iovsize) {
+		struct iovec *iov = realloc(ur->ur_iov, npages * sizeof(struct iovec));
+		if (!iov)
+			return ENOMEM;
+		ur->ur_iov = iov;
+		ur->ur_iovsize = npages;
+	}
+	ur->ur_iovused = 0;
+	*urp = ur;
+	return MDB_SUCCESS;
+}
+#endif /* MDB_USE_IO_URING */
+
 /** Flush (some) dirty pages to the map, after clearing their dirty flag.
  * @param[in] txn the transaction that's being committed
  * @param[in] keep number of initial pages in dirty_list to keep dirty.
+ * @param[in] sync make the written pages durable, as #mdb_env_sync() does.
  * @return 0 on success, non-zero on failure.
  */
 static int
-mdb_page_flush(MDB_txn *txn, int keep)
+mdb_page_flush(MDB_txn *txn, int keep, int sync)
 {
 	MDB_env		*env = txn->mt_env;
 	MDB_ID2L	dl = txn->mt_u.dirty_list;
@@ -3278,6 +3851,9 @@ mdb_page_flush(MDB_txn *txn, int keep)
 	size_t		next_pos = 1; /* impossible pos, so pos != next_pos */
 	int			n = 0;
 #endif
+#ifdef MDB_USE_IO_URING
+	MDB_uring	*ur;
+#endif
 
 	j = i = keep;
 
@@ -3296,6 +3872,11 @@ mdb_page_flush(MDB_txn *txn, int keep)
 		goto done;
 	}
 
+#ifdef MDB_USE_IO_URING
+	if ((rc = mdb_uring_prep(env, pagecount - keep, &ur)) != 0)
+		return rc;
+#endif
+
 	/* Write the pages */
 	for (;;) {
 		if (++i <= pagecount) {
@@ -3336,6 +3917,15 @@ mdb_page_flush(MDB_txn *txn, int keep)
 		/* Write up to MDB_COMMIT_PAGES dirty pages at a time. */
 		if (pos!=next_pos || n==MDB_COMMIT_PAGES || wsize+size>MAX_WRITE) {
 			if (n) {
+#ifdef MDB_USE_IO_URING
+				if (ur) {
+					/* Queue them, wait for all of them below */
+					if ((rc = mdb_uring_push(ur, IORING_OP_WRITEV, env->me_fd,
+						iov, n, wpos, wsize)) != 0)
+						return rc;
+					goto written;
+				}
+#endif
 retry_write:
 				/* Write previous page(s) */
 #ifdef MDB_USE_PWRITEV
@@ -3367,6 +3957,9 @@ retry_seek:
 					}
 					return rc;
 				}
+#ifdef MDB_USE_IO_URING
+written:
+#endif
 				n = 0;
 			}
 			if (i > pagecount)
@@ -3383,6 +3976,21 @@ retry_seek:
 #endif	/* _WIN32 */
 	}
 
+#ifdef MDB_USE_IO_URING
+	if (ur) {
+		/* Let the sync go in the same batch, ordered after the writes */
+		if (sync && !(env->me_flags & MDB_NOSYNC)) {
+			if ((rc = mdb_uring_push(ur, IORING_OP_FSYNC, env->me_fd, NULL,
+				(env->me_flags & MDB_FSYNCONLY) ? 0 : IORING_FSYNC_DATASYNC,
+				0, 0)) != 0)
+				return rc;
+			sync = 0;
+		}
+		if ((rc = mdb_uring_wait(ur)) != 0)
+			return rc;
+	}
+#endif
+
 	/* MIPS has cache coherency issues, this is a no-op everywhere else
 	 * Note: for any size >= on-chip cache size, entire on-chip cache is
 	 * flushed.
@@ -3404,24 +4012,21 @@ done:
 	i--;
 	txn->mt_dirty_room += i - j;
 	dl[0].mid = j;
-	return MDB_SUCCESS;
+	return sync ? mdb_env_sync(env, 0) : MDB_SUCCESS;
 }
 
-int
-mdb_txn_commit(MDB_txn *txn)
+static int
+mdb_txn_commit0(MDB_txn *txn)
 {
 	int		rc;
 	unsigned int i, end_mode;
 	MDB_env	*env;
 
-	if (txn == NULL)
-		return EINVAL;
-
 	/* mdb_txn_end() mode for a commit which writes nothing */
 	end_mode = MDB_END_EMPTY_COMMIT|MDB_END_UPDATE|MDB_END_SLOT|MDB_END_FREE;
 
 	if (txn->mt_child) {
-		rc = mdb_txn_commit(txn->mt_child);
+		rc = mdb_txn_commit0(txn->mt_child);
 		if (rc)
 			goto fail;
 	}
@@ -3615,14 +4220,19 @@ mdb_txn_commit(MDB_txn *txn)
 
 	mdb_midl_free(env->me_pghead);
 	env->me_pghead = NULL;
+	env->me_pgrun = 0;
 	mdb_midl_shrink(&txn->mt_free_pgs);
 
 #if (MDB_DEBUG) > 2
 	mdb_audit(txn);
 #endif
 
-	if ((rc = mdb_page_flush(txn, 0)) ||
-		(rc = mdb_env_sync(env, 0)) ||
+	if (env->me_ctr_sample) {
+		env->me_ctrs[FREE_DBI].mc_commits++;
+		env->me_ctrs[FREE_DBI].mc_dirty_pages += txn->mt_u.dirty_list[0].mid;
+	}
+
+	if ((rc = mdb_page_flush(txn, 0, 1)) ||
 		(rc = mdb_env_write_meta(txn)))
 		goto fail;
 	end_mode = MDB_END_COMMITTED|MDB_END_UPDATE;
@@ -3632,30 +4242,201 @@ done:
 	return MDB_SUCCESS;
 
 fail:
-	mdb_txn_abort(txn);
+	mdb_txn_abort0(txn);
 	return rc;
 }
 
-/** Read the environment parameters of a DB environment before
- * mapping it into memory.
- * @param[in] env the environment handle
- * @param[out] meta address of where to store the meta information
+int
+mdb_txn_commit(MDB_txn *txn)
+{
+	if (txn == NULL)
+		return EINVAL;
+
+#ifndef _WIN32
+	if (txn->mt_batch)
+		return mdb_txn_batch_commit(txn);
+#endif
+	return mdb_txn_commit0(txn);
+}
+
+#ifndef _WIN32
+/** Commit the top-level txn of a write batch.
+ *	Called by the batch leader with #MDB_env.%me_bmutex locked,
+ *	after its own nested txn is done. Writers that joined are let
+ *	finish first. If the previous batch had company, the leader
+ *	also waits up to #MDB_env.%me_bwait usecs for more to join.
+ *	A lone writer thus never waits.
+ * @param[in] env the environment
  * @return 0 on success, non-zero on failure.
  */
-static int ESECT
-mdb_env_read_header(MDB_env *env, MDB_meta *meta)
+static int
+mdb_txn_batch_end(MDB_env *env)
 {
-	MDB_metabuf	pbuf;
-	MDB_page	*p;
-	MDB_meta	*m;
-	int			i, rc, off;
-	enum { Size = sizeof(pbuf) };
+	MDB_txn *txn = env->me_btxn;
+	struct timeval tv;
+	struct timespec ts;
+	int rc, wait = env->me_blast > 1 && env->me_bwait;
 
-	/* We don't know the page size yet, so use a minimum value.
-	 * Read both meta pages so we can use the latest one.
-	 */
+	if (wait) {
+		gettimeofday(&tv, NULL);
+		tv.tv_usec += env->me_bwait;
+		ts.tv_sec = tv.tv_sec + tv.tv_usec / 1000000;
+		ts.tv_nsec = (tv.tv_usec % 1000000) * 1000;
+	}
+	for (;;) {
+		if (env->me_bactive) {
+			pthread_cond_wait(&env->me_bcond, &env->me_bmutex);
+			continue;
+		}
+		if (!wait || env->me_bjoined >= env->me_bmax)
+			break;
+		if (pthread_cond_timedwait(&env->me_bcond, &env->me_bmutex, &ts) == ETIMEDOUT)
+			wait = 0;
+	}
+
+	env->me_bstate = MDB_BATCH_CLOSED;
+	pthread_mutex_unlock(&env->me_bmutex);
+	rc = mdb_txn_commit0(txn);
+	pthread_mutex_lock(&env->me_bmutex);
+	env->me_brc = rc;
+	env->me_blast = env->me_bjoined;
+	env->me_btxn = NULL;
+	env->me_bgen++;
+	env->me_bstate = MDB_BATCH_IDLE;
+	pthread_cond_broadcast(&env->me_bcond);
+	return rc;
+}
 
-	for (i=off=0; i<NUM_METAS; i++, off += meta->mm_psize) {
+/** Begin a write txn as a member of a write batch.
+ *	The first writer to arrive begins a top-level txn and leads
+ *	the batch. It and every writer joining after it get a nested
+ *	txn of the top-level one. Only one nested txn can be active at
+ *	a time, so the members still run one after the other, but they
+ *	share a single commit of the top-level txn.
+ * @param[in] env the environment
+ * @param[out] ret the nested txn
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_txn_batch_begin(MDB_env *env, MDB_txn **ret)
+{
+	MDB_txn *txn;
+	int rc, lead = 0;
+
+	pthread_mutex_lock(&env->me_bmutex);
+	for (;;) {
+		if (env->me_bstate == MDB_BATCH_IDLE) {
+			env->me_bstate = MDB_BATCH_STARTING;
+			pthread_mutex_unlock(&env->me_bmutex);
+			rc = mdb_txn_begin0(env, NULL, 0, &txn);
+			pthread_mutex_lock(&env->me_bmutex);
+			if (rc) {
+				env->me_bstate = MDB_BATCH_IDLE;
+				pthread_cond_broadcast(&env->me_bcond);
+				goto done;
+			}
+			env->me_btxn = txn;
+			env->me_bjoined = 0;
+			env->me_bstate = MDB_BATCH_OPEN;
+			lead = 1;
+			break;
+		}
+		if (env->me_bstate == MDB_BATCH_OPEN && env->me_bjoined < env->me_bmax)
+			break;
+		pthread_cond_wait(&env->me_bcond, &env->me_bmutex);
+	}
+	env->me_bjoined++;
+	env->me_bactive++;
+	while (env->me_btxn->mt_child)
+		pthread_cond_wait(&env->me_bcond, &env->me_bmutex);
+
+	rc = mdb_txn_begin0(env, env->me_btxn, 0, &txn);
+	if (rc) {
+		env->me_bactive--;
+		pthread_cond_broadcast(&env->me_bcond);
+		if (lead)
+			mdb_txn_batch_end(env);
+		goto done;
+	}
+	txn->mt_batch = lead ? MDB_BATCH_LEADER : MDB_BATCH_MEMBER;
+	*ret = txn;
+done:
+	pthread_mutex_unlock(&env->me_bmutex);
+	return rc;
+}
+
+/** Commit a member of a write batch.
+ *	The member's changes are merged into the batch. Only once the
+ *	whole batch has committed are they durable, so that is what
+ *	we wait for and report.
+ * @param[in] txn the member's nested txn
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_txn_batch_commit(MDB_txn *txn)
+{
+	MDB_env *env = txn->mt_env;
+	int rc, rc2, lead = txn->mt_batch == MDB_BATCH_LEADER;
+	size_t gen;
+
+	pthread_mutex_lock(&env->me_bmutex);
+	gen = env->me_bgen;
+	rc = mdb_txn_commit0(txn);
+	env->me_bactive--;
+	pthread_cond_broadcast(&env->me_bcond);
+	if (lead) {
+		rc2 = mdb_txn_batch_end(env);
+		if (!rc)
+			rc = rc2;
+	} else if (!rc) {
+		while (env->me_bgen == gen)
+			pthread_cond_wait(&env->me_bcond, &env->me_bmutex);
+		rc = env->me_brc;
+	}
+	pthread_mutex_unlock(&env->me_bmutex);
+	return rc;
+}
+
+/** Abort a member of a write batch. The rest of the batch is
+ *	unaffected; if the member was the leader, it still commits it.
+ * @param[in] txn the member's nested txn
+ */
+static void
+mdb_txn_batch_abort(MDB_txn *txn)
+{
+	MDB_env *env = txn->mt_env;
+	int lead = txn->mt_batch == MDB_BATCH_LEADER;
+
+	pthread_mutex_lock(&env->me_bmutex);
+	mdb_txn_abort0(txn);
+	env->me_bactive--;
+	pthread_cond_broadcast(&env->me_bcond);
+	if (lead)
+		mdb_txn_batch_end(env);
+	pthread_mutex_unlock(&env->me_bmutex);
+}
+#endif /* !_WIN32 */
+
+/** Read the environment parameters of a DB environment before
+ * mapping it into memory.
+ * @param[in] env the environment handle
+ * @param[out] meta address of where to store the meta information
+ * @return 0 on success, non-zero on failure.
+ */
+static int ESECT
+mdb_env_read_header(MDB_env *env, MDB_meta *meta)
+{
+	MDB_metabuf	pbuf;
+	MDB_page	*p;
+	MDB_meta	*m;
+	int			i, rc, off;
+	enum { Size = sizeof(pbuf) };
+
+	/* We don't know the page size yet, so use a minimum value.
+	 * Read both meta pages so we can use the latest one.
+	 */
+
+	for (i=off=0; i<NUM_METAS; i++, off += meta->mm_psize) {
 #ifdef _WIN32
 		DWORD len;
 		OVERLAPPED ov;
@@ -3930,6 +4711,17 @@ mdb_env_create(MDB_env **env)
 #endif
 	e->me_pid = getpid();
 	GET_PAGESIZE(e->me_os_psize);
+#ifndef _WIN32
+	if (pthread_mutex_init(&e->me_bmutex, NULL)) {
+		free(e);
+		return ENOMEM;
+	}
+	if (pthread_cond_init(&e->me_bcond, NULL)) {
+		pthread_mutex_destroy(&e->me_bmutex);
+		free(e);
+		return ENOMEM;
+	}
+#endif
 	VGMEMP_CREATE(e,0,0);
 	*env = e;
 	return MDB_SUCCESS;
@@ -4002,6 +4794,14 @@ mdb_env_map(MDB_env *env, void *addr)
 #endif /* POSIX_MADV_RANDOM */
 #endif /* MADV_RANDOM */
 	}
+#ifdef MADV_HUGEPAGE
+	if (flags & MDB_HUGEPAGE) {
+		/* Fewer TLB misses on a large map. Only advice, the OS may
+		 * refuse it, e.g. if file-backed huge pages are unsupported.
+		 */
+		madvise(env->me_map, env->me_mapsize, MADV_HUGEPAGE);
+	}
+#endif /* MADV_HUGEPAGE */
 #endif /* _WIN32 */
 
 	/* Can happen because the address argument to mmap() is just a
@@ -4071,6 +4871,20 @@ mdb_env_set_maxreaders(MDB_env *env, unsigned int readers)
 	return MDB_SUCCESS;
 }
 
+int ESECT
+mdb_env_set_writebatch(MDB_env *env, unsigned int max, unsigned int usec)
+{
+	if (!env)
+		return EINVAL;
+#ifndef _WIN32
+	pthread_mutex_lock(&env->me_bmutex);
+	env->me_bmax = max;
+	env->me_bwait = usec;
+	pthread_mutex_unlock(&env->me_bmutex);
+#endif
+	return MDB_SUCCESS;
+}
+
 int ESECT
 mdb_env_get_maxreaders(MDB_env *env, unsigned int *readers)
 {
@@ -4912,7 +5726,7 @@ fail:
 	 */
 #define	CHANGEABLE	(MDB_NOSYNC|MDB_NOMETASYNC|MDB_MAPASYNC|MDB_NOMEMINIT)
 #define	CHANGELESS	(MDB_FIXEDMAP|MDB_NOSUBDIR|MDB_RDONLY| \
-	MDB_WRITEMAP|MDB_NOTLS|MDB_NOLOCK|MDB_NORDAHEAD)
+	MDB_WRITEMAP|MDB_NOTLS|MDB_NOLOCK|MDB_NORDAHEAD|MDB_HUGEPAGE)
 
 #if VALID_FLAGS & PERSISTENT_FLAGS & (CHANGEABLE|CHANGELESS)
 # error "Persistent DB flags & env flags overlap, but both go in mm_flags"
@@ -5040,7 +5854,13 @@ mdb_env_close0(MDB_env *env, int excl)
 	free(env->me_path);
 	free(env->me_dirty_list);
 	free(env->me_txn0);
+	free(env->me_ctrs);
+	env->me_ctrs = NULL;
+	env->me_ctr_sample = 0;
 	mdb_midl_free(env->me_free_pgs);
+#ifdef MDB_USE_IO_URING
+	mdb_uring_close(env);
+#endif
 
 	if (env->me_flags & MDB_ENV_TXKEY) {
 		pthread_key_delete(env->me_txkey);
@@ -5131,6 +5951,10 @@ mdb_env_close(MDB_env *env)
 	}
 
 	mdb_env_close0(env, 0);
+#ifndef _WIN32
+	pthread_cond_destroy(&env->me_bcond);
+	pthread_mutex_destroy(&env->me_bmutex);
+#endif
 	free(env);
 }
 
@@ -5428,6 +6252,19 @@ mdb_page_get(MDB_cursor *mc, pgno_t pgno, MDB_page **ret, int *lvl)
 	if (pgno < txn->mt_next_pgno) {
 		level = 0;
 		p = (MDB_page *)(env->me_map + env->me_psize * pgno);
+#ifndef _WIN32
+		if (env->me_ctr_sample && ++env->me_ctr_tick >= env->me_ctr_sample) {
+			MDB_counters *ct = &env->me_ctrs[mc->mc_dbi];
+			unsigned char vec = 1;
+			env->me_ctr_tick = 0;
+			if (!mincore((char *)p - ((size_t)p & (env->me_os_psize-1)),
+				env->me_os_psize, (void *)&vec)) {
+				ct->mc_page_samples++;
+				if (!(vec & 1))
+					ct->mc_page_faults++;
+			}
+		}
+#endif
 	} else {
 		DPRINTF(("page %"Z"u not found", pgno));
 		txn->mt_flags |= MDB_TXN_ERROR;
@@ -5435,6 +6272,7 @@ mdb_page_get(MDB_cursor *mc, pgno_t pgno, MDB_page **ret, int *lvl)
 	}
 
 done:
+	MDB_COUNT(mc, mc_page_gets);
 	*ret = p;
 	if (lvl)
 		*lvl = level;
@@ -5700,6 +6538,7 @@ release:
 		while (j>i)
 			mop[j--] = pg++;
 		mop[0] += ovpages;
+		env->me_pgrun = 0;
 	} else {
 		rc = mdb_midl_append_range(&txn->mt_free_pgs, pg, ovpages);
 		if (rc)
@@ -6087,6 +6926,28 @@ mdb_cursor_set(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 				mc->mc_ki[mc->mc_top] = nkeys;
 				return MDB_NOTFOUND;
 			}
+			/* The key is past this leaf. Instead of starting over
+			 * from the root, climb to the nearest parent whose
+			 * range must contain the key and search down from there.
+			 * This makes a run of ascending lookups cheap.
+			 */
+			for (i = mc->mc_top - 1; i > 0; i--) {
+				MDB_page *bp = mc->mc_pg[i];
+				unsigned int bkeys = NUMKEYS(bp);
+				if (mc->mc_ki[i] < bkeys - 1) {
+					leaf = NODEPTR(bp, bkeys-1);
+					MDB_GET_KEY2(leaf, nodekey);
+					if (mc->mc_dbx->md_cmp(key, &nodekey) < 0) {
+						mc->mc_top = i;
+						mc->mc_snum = i + 1;
+						rc = mdb_page_search_root(mc, key, 0);
+						if (rc != MDB_SUCCESS)
+							return rc;
+						mp = mc->mc_pg[mc->mc_top];
+						goto set2;
+					}
+				}
+			}
 		}
 		if (!mc->mc_top) {
 			/* There are no other pages */
@@ -6278,6 +7139,93 @@ mdb_cursor_last(MDB_cursor *mc, MDB_val *key, MDB_val *data)
 	return MDB_SUCCESS;
 }
 
+/** Tell the OS that some pages of the map will be read soon. */
+static void
+mdb_page_willneed(MDB_env *env, pgno_t pg, pgno_t n)
+{
+#if defined(MADV_WILLNEED) || defined(POSIX_MADV_WILLNEED)
+	pgno_t max = env->me_mapsize / env->me_psize;
+
+	if (pg >= max)
+		return;
+	if (n > max - pg)
+		n = max - pg;
+#ifdef MADV_WILLNEED
+	madvise(env->me_map + pg * env->me_psize, n * env->me_psize, MADV_WILLNEED);
+#else
+	posix_madvise(env->me_map + pg * env->me_psize, n * env->me_psize,
+		POSIX_MADV_WILLNEED);
+#endif
+#endif
+}
+
+/** Announce the pages a cursor moving forward from a new leaf will
+ *	read: the overflow pages of the records still ahead on the leaf and
+ *	the next sibling leaves, #mc_ra of them being kept in the pipeline.
+ */
+static void
+mdb_cursor_ra(MDB_cursor *mc)
+{
+	MDB_env *env = mc->mc_txn->mt_env;
+	MDB_page *mp = mc->mc_pg[mc->mc_top], *bp;
+	MDB_node *node;
+	pgno_t pg, start = P_INVALID, n = 0;
+	unsigned int i, nkeys;
+
+	mc->mc_ra_leaf = mp;
+	if (!IS_LEAF(mp))
+		return;
+
+	if (!IS_LEAF2(mp)) {
+		nkeys = NUMKEYS(mp);
+		for (i = mc->mc_ki[mc->mc_top]; i < nkeys; i++) {
+			node = NODEPTR(mp, i);
+			if (F_ISSET(node->mn_flags, F_BIGDATA)) {
+				memcpy(&pg, NODEDATA(node), sizeof(pg));
+				mdb_page_willneed(env, pg, OVPAGES(NODEDSZ(node), env->me_psize));
+			}
+		}
+	}
+
+	if (!mc->mc_top)
+		return;
+	bp = mc->mc_pg[mc->mc_top-1];
+	i = mc->mc_ki[mc->mc_top-1] + 1;
+	if (bp == mc->mc_ra_branch && i + mc->mc_ra / 2 < mc->mc_ra_next)
+		return;
+	if (bp == mc->mc_ra_branch && i < mc->mc_ra_next)
+		i = mc->mc_ra_next;
+	nkeys = NUMKEYS(bp);
+	if (nkeys > mc->mc_ki[mc->mc_top-1] + 1 + mc->mc_ra)
+		nkeys = mc->mc_ki[mc->mc_top-1] + 1 + mc->mc_ra;
+	/* Leaves written in order are often adjacent, advise runs of them */
+	for (; i < nkeys; i++) {
+		pg = NODEPGNO(NODEPTR(bp, i));
+		if (pg != start + n) {
+			if (n)
+				mdb_page_willneed(env, start, n);
+			start = pg;
+			n = 0;
+		}
+		n++;
+	}
+	if (n)
+		mdb_page_willneed(env, start, n);
+	mc->mc_ra_branch = bp;
+	mc->mc_ra_next = i;
+}
+
+int
+mdb_cursor_readahead(MDB_cursor *mc, unsigned int pages)
+{
+	if (mc == NULL)
+		return EINVAL;
+	mc->mc_ra = pages;
+	mc->mc_ra_leaf = NULL;
+	mc->mc_ra_branch = NULL;
+	return MDB_SUCCESS;
+}
+
 int
 mdb_cursor_get(MDB_cursor *mc, MDB_val *key, MDB_val *data,
     MDB_cursor_op op)
@@ -6462,9 +7410,37 @@ fetchm:
 	if (mc->mc_flags & C_DEL)
 		mc->mc_flags ^= C_DEL;
 
+	if (mc->mc_ra && rc == MDB_SUCCESS && (mc->mc_flags & C_INITIALIZED) &&
+		mc->mc_pg[mc->mc_top] != mc->mc_ra_leaf)
+		mdb_cursor_ra(mc);
+
 	return rc;
 }
 
+int
+mdb_cursor_get_multi(MDB_cursor *mc, MDB_val *keys, MDB_val *data,
+    size_t count)
+{
+	MDB_val key;
+	size_t i;
+	int rc;
+
+	if (mc == NULL || (count && (keys == NULL || data == NULL)))
+		return EINVAL;
+
+	for (i = 0; i < count; i++) {
+		key = keys[i];
+		rc = mdb_cursor_get(mc, &key, &data[i], MDB_SET);
+		if (rc == MDB_NOTFOUND) {
+			data[i].mv_size = 0;
+			data[i].mv_data = NULL;
+		} else if (rc != MDB_SUCCESS) {
+			return rc;
+		}
+	}
+	return MDB_SUCCESS;
+}
+
 /** Touch all the pages in the cursor stack. Set mc_top.
  *	Makes sure all the pages are writable, before attempting a write operation.
  * @param[in] mc The cursor to operate on.
@@ -7159,6 +8135,7 @@ mdb_page_new(MDB_cursor *mc, uint32_t flags, int num, MDB_page **mp)
 	else if (IS_OVERFLOW(np)) {
 		mc->mc_db->md_overflow_pages += num;
 		np->mp_pages = num;
+		MDB_COUNT(mc, mc_overflow_allocs);
 	}
 	*mp = np;
 
@@ -7581,6 +8558,9 @@ mdb_cursor_init(MDB_cursor *mc, MDB_txn *txn, MDB_dbi dbi, MDB_xcursor *mx)
 	mc->mc_pg[0] = 0;
 	mc->mc_ki[0] = 0;
 	mc->mc_flags = 0;
+	mc->mc_ra = 0;
+	mc->mc_ra_leaf = NULL;
+	mc->mc_ra_branch = NULL;
 	if (txn->mt_dbs[dbi].md_flags & MDB_DUPSORT) {
 		mdb_tassert(txn, mx != NULL);
 		mc->mc_xcursor = mx;
@@ -7639,7 +8619,11 @@ mdb_cursor_renew(MDB_txn *txn, MDB_cursor *mc)
 	if (txn->mt_flags & MDB_TXN_BLOCKED)
 		return MDB_BAD_TXN;
 
-	mdb_cursor_init(mc, txn, mc->mc_dbi, mc->mc_xcursor);
+	{
+		unsigned int ra = mc->mc_ra;
+		mdb_cursor_init(mc, txn, mc->mc_dbi, mc->mc_xcursor);
+		mc->mc_ra = ra;
+	}
 	return MDB_SUCCESS;
 }
 
@@ -7682,6 +8666,122 @@ mdb_cursor_count(MDB_cursor *mc, size_t *countp)
 	return MDB_SUCCESS;
 }
 
+/** Find where a key falls in a DB, for #mdb_estimate_range().
+ *	Leaves the cursor stack on the first key >= \b key, or past the
+ *	last key if there is none. With \b after set, an exact match is
+ *	stepped over. A NULL key stands for the start of the DB, or with
+ *	\b after set for its end.
+ * @param[in] mc A cursor on the DB
+ * @param[in] key The key to find, or NULL
+ * @param[in] after Whether to land after the key
+ * @param[out] pos The position of the leaf page the cursor is on,
+ *	as a fraction of the DB from 0 to 1, taking each page to hold an
+ *	equal share of the items below it.
+ * @param[out] width The share of the DB on that leaf page.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_range_pos(MDB_cursor *mc, MDB_val *key, int after, double *pos,
+	double *width)
+{
+	MDB_page *mp;
+	double frac = 0, scale = 1;
+	unsigned int i, n;
+	int rc, exact = 0;
+
+	rc = mdb_page_search(mc, key, key ? 0 : after ? MDB_PS_LAST : MDB_PS_FIRST);
+	if (rc)
+		return rc;
+	mp = mc->mc_pg[mc->mc_top];
+	if (key) {
+		mdb_node_search(mc, key, &exact);
+		if (exact && after)
+			mc->mc_ki[mc->mc_top]++;
+	} else {
+		mc->mc_ki[mc->mc_top] = after ? NUMKEYS(mp) : 0;
+	}
+	for (i = 0; i < mc->mc_top; i++) {
+		n = NUMKEYS(mc->mc_pg[i]);
+		frac += scale * mc->mc_ki[i] / n;
+		scale /= n;
+	}
+	*pos = frac;
+	*width = scale;
+	return MDB_SUCCESS;
+}
+
+int
+mdb_estimate_range(MDB_txn *txn, MDB_dbi dbi, MDB_val *lo, MDB_val *hi,
+	size_t *countp)
+{
+	MDB_cursor mc[2];
+	MDB_xcursor mx[2];
+	MDB_page *mp;
+	MDB_node *leaf;
+	double p0, p1, w0, w1;
+	size_t n = 0;
+	indx_t i, end;
+	int rc, k;
+
+	if (!countp || !TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
+		return EINVAL;
+
+	if (txn->mt_flags & MDB_TXN_BLOCKED)
+		return MDB_BAD_TXN;
+
+	/* Reads the DB's root if it is stale */
+	mdb_cursor_init(&mc[0], txn, dbi, &mx[0]);
+	if (!lo && !hi) {
+		*countp = txn->mt_dbs[dbi].md_entries;
+		return MDB_SUCCESS;
+	}
+	*countp = 0;
+	if (lo && hi && mdb_cmp(txn, dbi, lo, hi) > 0)
+		return MDB_SUCCESS;
+
+	rc = mdb_range_pos(&mc[0], lo, 0, &p0, &w0);
+	if (!rc) {
+		mdb_cursor_init(&mc[1], txn, dbi, &mx[1]);
+		rc = mdb_range_pos(&mc[1], hi, 1, &p1, &w1);
+	}
+	if (rc)
+		return rc == MDB_NOTFOUND ? MDB_SUCCESS : rc;
+
+	/* The leaf pages at the ends are counted exactly, adding up the
+	 * items of each key. A dup sub-DB keeps its count in its header.
+	 * Only the pages in between are estimated.
+	 */
+	for (k = 0; k < 2; k++) {
+		mp = mc[k].mc_pg[mc[k].mc_top];
+		if (k == 0) {
+			i = mc[0].mc_ki[mc[0].mc_top];
+			end = mp == mc[1].mc_pg[mc[1].mc_top] ?
+				mc[1].mc_ki[mc[1].mc_top] : NUMKEYS(mp);
+		} else {
+			if (mp == mc[0].mc_pg[mc[0].mc_top])
+				break;
+			i = 0;
+			end = mc[1].mc_ki[mc[1].mc_top];
+		}
+		for (; i < end; i++) {
+			leaf = NODEPTR(mp, i);
+			if (!F_ISSET(leaf->mn_flags, F_DUPDATA)) {
+				n++;
+			} else if (F_ISSET(leaf->mn_flags, F_SUBDATA)) {
+				MDB_db db;
+				memcpy(&db, NODEDATA(leaf), sizeof(db));
+				n += db.md_entries;
+			} else {
+				n += NUMKEYS((MDB_page *)NODEDATA(leaf));
+			}
+		}
+	}
+	if (p1 > p0 + w0)
+		n += (p1 - p0 - w0) * txn->mt_dbs[dbi].md_entries + 0.5;
+	*countp = n;
+	return MDB_SUCCESS;
+}
+
 void
 mdb_cursor_close(MDB_cursor *mc)
 {
@@ -8052,6 +9152,7 @@ mdb_page_merge(MDB_cursor *csrc, MDB_cursor *cdst)
 
 	mdb_cassert(csrc, csrc->mc_snum > 1);	/* can't merge root page */
 	mdb_cassert(csrc, cdst->mc_snum > 1);
+	MDB_COUNT(csrc, mc_merges);
 
 	/* Mark dst as dirty. */
 	if ((rc = mdb_page_touch(cdst)))
@@ -8543,6 +9644,25 @@ mdb_del0(MDB_txn *txn, MDB_dbi dbi,
 	return rc;
 }
 
+/** Shorten the separator for a leaf split.
+ * Branch keys only have to sort after every key on the left page and not
+ * after the first key on the right one, so with the default lexical order
+ * the shortest prefix of \b sep that differs from \b left will do. This
+ * keeps long keys out of the branch pages, giving them more fanout.
+ * @param[in] left The last key remaining on the left page.
+ * @param[in,out] sep The first key of the right page.
+ */
+static void
+mdb_sep_shorten(const MDB_val *left, MDB_val *sep)
+{
+	const unsigned char *l = left->mv_data, *r = sep->mv_data;
+	size_t i, n = left->mv_size < sep->mv_size ? left->mv_size : sep->mv_size;
+
+	for (i = 0; i < n && l[i] == r[i]; i++) ;
+	if (i < sep->mv_size)
+		sep->mv_size = i + 1;
+}
+
 /** Split a page and insert a new node.
  * Set #MDB_TXN_ERROR on failure.
  * @param[in,out] mc Cursor pointing to the page and desired insertion index.
@@ -8579,6 +9699,7 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 	DPRINTF(("-----> splitting %s page %"Z"u and adding [%s] at index %i/%i",
 	    IS_LEAF(mp) ? "leaf" : "branch", mp->mp_pgno,
 	    DKEY(newkey), mc->mc_ki[mc->mc_top], nkeys));
+	MDB_COUNT(mc, mc_splits);
 
 	/* Create a right sibling. */
 	if ((rc = mdb_page_new(mc, mp->mp_flags, 1, &rp)))
@@ -8760,6 +9881,25 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 		}
 	}
 
+	if (IS_LEAF(mp) && !IS_LEAF2(mp) && split_indx > 0 &&
+		mc->mc_dbx->md_cmp == mdb_cmp_memn) {
+		MDB_val lkey;
+		if (nflags & MDB_APPEND) {
+			node = NODEPTR(mp, NUMKEYS(mp)-1);
+		} else if (split_indx-1 == newindx) {
+			node = NULL;
+		} else {
+			node = (MDB_node *)((char *)mp + copy->mp_ptrs[split_indx-1] + PAGEBASE);
+		}
+		if (node) {
+			lkey.mv_size = node->mn_ksize;
+			lkey.mv_data = NODEKEY(node);
+		} else {
+			lkey = *newkey;
+		}
+		mdb_sep_shorten(&lkey, &sepkey);
+	}
+
 	DPRINTF(("separator is %d [%s]", split_indx, DKEY(&sepkey)));
 
 	/* Copy separator key to the parent.
@@ -8998,6 +10138,11 @@ mdb_put(MDB_txn *txn, MDB_dbi dbi,
 #endif
 #define MDB_EOF		0x10	/**< #mdb_env_copyfd1() is done reading */
 
+	/** Subtrees each prefetch thread may read ahead of the copy walk */
+#define MDB_CP_AHEAD	4
+
+struct mdb_cprefetch;
+
 	/** State needed for a double-buffering compacting copy. */
 typedef struct mdb_copy {
 	MDB_env *mc_env;
@@ -9016,8 +10161,28 @@ typedef struct mdb_copy {
 	 *	to fail the copy.  Not mutex-protected, LMDB expects atomic int.
 	 */
 	volatile int mc_error;
+	/** Prefetch threads, reading ahead of #mdb_env_cwalk() */
+	struct mdb_cprefetch *mc_pthr;
+	int mc_nthr;
+	volatile int mc_stop;	/**< tells prefetch threads to quit */
+	/** Subtrees for the prefetch threads, in the order the walk enters
+	 *	them: the lowest branch pages of the main DB and named DBs, or
+	 *	their root if it is a leaf.
+	 */
+	pgno_t *mc_units;
+	unsigned mc_nunits;
+	unsigned mc_ualloc;
+	volatile unsigned mc_unit;	/**< count of units the walk entered */
 } mdb_copy;
 
+	/** A prefetch thread for compacting copy */
+typedef struct mdb_cprefetch {
+	mdb_copy *cp_copy;
+	pthread_t cp_thr;
+	pthread_cond_t cp_cond;	/**< Signaled when #mc_unit advances */
+	unsigned cp_id;
+} mdb_cprefetch;
+
 	/** Dedicated writer thread for compacting copy. */
 static THREAD_RET ESECT CALL_CONV
 mdb_env_copythr(void *arg)
@@ -9116,6 +10281,149 @@ mdb_env_cthr_toggle(mdb_copy *my, int adjust)
 	return my->mc_error;
 }
 
+	/** Note the copy walk entered another prefetch unit. */
+static void ESECT
+mdb_env_cunit(mdb_copy *my)
+{
+	int i;
+
+	if (!my->mc_nthr)
+		return;
+	pthread_mutex_lock(&my->mc_mutex);
+	my->mc_unit++;
+	for (i = 0; i < my->mc_nthr; i++)
+		pthread_cond_signal(&my->mc_pthr[i].cp_cond);
+	pthread_mutex_unlock(&my->mc_mutex);
+}
+
+	/** Collect the prefetch units of a tree, see #mdb_copy.%mc_units.
+	 * @param[in] my control structure.
+	 * @param[in] pg page to look at.
+	 * @param[in] level level of pg in its tree.
+	 * @param[in] ulevel level of the units in the tree.
+	 * @param[in] main the tree is the main DB, whose leaves hold named DBs.
+	 */
+static int ESECT
+mdb_env_cunits(mdb_copy *my, pgno_t pg, unsigned level, unsigned ulevel,
+	int main)
+{
+	MDB_env *env = my->mc_env;
+	MDB_page *mp;
+	MDB_node *ni;
+	MDB_db db;
+	unsigned i, n;
+	int rc;
+
+	if (pg >= my->mc_txn->mt_next_pgno)
+		return MDB_CORRUPTED;
+	mp = (MDB_page *)(env->me_map + env->me_psize * pg);
+	if (level == ulevel) {
+		if (my->mc_nunits == my->mc_ualloc) {
+			pgno_t *units = realloc(my->mc_units,
+				(my->mc_ualloc + 1024) * 2 * sizeof(pgno_t));
+			if (!units)
+				return ENOMEM;
+			my->mc_units = units;
+			my->mc_ualloc = (my->mc_ualloc + 1024) * 2;
+		}
+		my->mc_units[my->mc_nunits++] = pg;
+		if (!main)
+			return MDB_SUCCESS;
+	}
+	n = NUMKEYS(mp);
+	if (IS_BRANCH(mp)) {
+		for (i = 0; i < n; i++) {
+			rc = mdb_env_cunits(my, NODEPGNO(NODEPTR(mp, i)), level + 1,
+				ulevel, main);
+			if (rc)
+				return rc;
+		}
+	} else if (!IS_LEAF2(mp)) {
+		for (i = 0; i < n; i++) {
+			ni = NODEPTR(mp, i);
+			if ((ni->mn_flags & (F_SUBDATA|F_DUPDATA)) != F_SUBDATA)
+				continue;
+			memcpy(&db, NODEDATA(ni), sizeof(db));
+			if (db.md_root == P_INVALID)
+				continue;
+			rc = mdb_env_cunits(my, db.md_root, 0,
+				db.md_depth > 1 ? db.md_depth - 2 : 0, 0);
+			if (rc)
+				return rc;
+		}
+	}
+	return MDB_SUCCESS;
+}
+
+	/** Read a prefetch unit's pages and those of its overflow records
+	 * and sorted-duplicate sub-DBs, so they are in the page cache when
+	 * the walk gets there. Stops if the walk catches up.
+	 * @param[in] my control structure.
+	 * @param[in] pg page to read.
+	 * @param[in] unit the number of the unit being read.
+	 * @param[in] flags includes #F_DUPDATA if it is a sorted-duplicate sub-DB.
+	 */
+static void ESECT
+mdb_env_ctouch(mdb_copy *my, pgno_t pg, unsigned unit, int flags)
+{
+	MDB_env *env = my->mc_env;
+	MDB_page *mp;
+	MDB_node *ni;
+	MDB_db db;
+	volatile char *ptr;
+	unsigned i, n;
+
+	if (my->mc_stop || my->mc_unit > unit ||
+		pg >= my->mc_txn->mt_next_pgno)
+		return;
+	mp = (MDB_page *)(env->me_map + env->me_psize * pg);
+	n = NUMKEYS(mp);
+	if (IS_BRANCH(mp)) {
+		for (i = 0; i < n; i++)
+			mdb_env_ctouch(my, NODEPGNO(NODEPTR(mp, i)), unit, flags);
+	} else if (!IS_LEAF2(mp) && !(flags & F_DUPDATA)) {
+		for (i = 0; i < n; i++) {
+			ni = NODEPTR(mp, i);
+			if (ni->mn_flags & F_BIGDATA) {
+				memcpy(&pg, NODEDATA(ni), sizeof(pg));
+				if (pg >= my->mc_txn->mt_next_pgno)
+					continue;
+				ptr = env->me_map + env->me_psize * pg;
+				for (pg = ((MDB_page *)ptr)->mp_pages; --pg > 0; )
+					(void)ptr[env->me_psize * pg];
+			} else if ((ni->mn_flags & (F_SUBDATA|F_DUPDATA)) ==
+				(F_SUBDATA|F_DUPDATA)) {
+				memcpy(&db, NODEDATA(ni), sizeof(db));
+				if (db.md_root != P_INVALID)
+					mdb_env_ctouch(my, db.md_root, unit, F_DUPDATA);
+			}
+		}
+	}
+}
+
+	/** Prefetch thread for compacting copy. Reads every #mc_nthr'th
+	 * unit, staying at most #MDB_CP_AHEAD units of its own ahead of
+	 * the walk.
+	 */
+static THREAD_RET ESECT CALL_CONV
+mdb_env_cprefetch(void *arg)
+{
+	mdb_cprefetch *cp = arg;
+	mdb_copy *my = cp->cp_copy;
+	unsigned unit, ahead = MDB_CP_AHEAD * my->mc_nthr;
+
+	for (unit = cp->cp_id; unit < my->mc_nunits; unit += my->mc_nthr) {
+		pthread_mutex_lock(&my->mc_mutex);
+		while (!my->mc_stop && unit >= my->mc_unit + ahead)
+			pthread_cond_wait(&cp->cp_cond, &my->mc_mutex);
+		pthread_mutex_unlock(&my->mc_mutex);
+		if (my->mc_stop)
+			break;
+		mdb_env_ctouch(my, my->mc_units[unit], unit, 0);
+	}
+	return (THREAD_RET)0;
+}
+
 	/** Depth-first tree traversal for compacting copy.
 	 * @param[in] my control structure.
 	 * @param[in,out] pg database root.
@@ -9129,7 +10437,7 @@ mdb_env_cwalk(mdb_copy *my, pgno_t *pg, int flags)
 	MDB_page *mo, *mp, *leaf;
 	char *buf, *ptr;
 	int rc, toggle;
-	unsigned int i;
+	unsigned int i, ulevel;
 
 	/* Empty DB, nothing to do */
 	if (*pg == P_INVALID)
@@ -9144,6 +10452,10 @@ mdb_env_cwalk(mdb_copy *my, pgno_t *pg, int flags)
 	rc = mdb_page_search_root(&mc, NULL, MDB_PS_FIRST);
 	if (rc)
 		return rc;
+	/* The path to the first leaf went through the first unit */
+	ulevel = mc.mc_snum > 1 ? mc.mc_snum - 2 : 0;
+	if (!(flags & F_DUPDATA))
+		mdb_env_cunit(my);
 
 	/* Make cursor pages writable */
 	buf = ptr = malloc(my->mc_env->me_psize * mc.mc_snum);
@@ -9239,6 +10551,8 @@ again:
 				mc.mc_top++;
 				mc.mc_snum++;
 				mc.mc_ki[mc.mc_top] = 0;
+				if (mc.mc_top == ulevel && !(flags & F_DUPDATA))
+					mdb_env_cunit(my);
 				if (IS_BRANCH(mp)) {
 					/* Whenever we advance to a sibling branch page,
 					 * we must proceed all the way down to its first leaf.
@@ -9276,9 +10590,75 @@ done:
 	return rc;
 }
 
+	/** Stop the prefetch threads and free their resources.
+	 * @param[in] my control structure.
+	 * @param[in] started how many of the threads are running.
+	 */
+static void ESECT
+mdb_env_cprefetch_end(mdb_copy *my, int started)
+{
+	int i;
+
+	pthread_mutex_lock(&my->mc_mutex);
+	my->mc_stop = 1;
+	for (i = 0; i < started; i++)
+		pthread_cond_signal(&my->mc_pthr[i].cp_cond);
+	pthread_mutex_unlock(&my->mc_mutex);
+	for (i = 0; i < started; i++)
+		THREAD_FINISH(my->mc_pthr[i].cp_thr);
+	for (i = 0; i < my->mc_nthr; i++) {
+#ifdef _WIN32
+		CloseHandle(my->mc_pthr[i].cp_cond);
+#else
+		pthread_cond_destroy(&my->mc_pthr[i].cp_cond);
+#endif
+	}
+	free(my->mc_pthr);
+	my->mc_pthr = NULL;
+	my->mc_nthr = 0;
+}
+
+	/** Start the prefetch threads for a compacting copy.
+	 * Without them the copy just runs slower, so errors are not fatal.
+	 */
+static void ESECT
+mdb_env_cprefetch_start(mdb_copy *my, int nthr)
+{
+	MDB_db *db = &my->mc_txn->mt_dbs[MAIN_DBI];
+	int i;
+
+	if (mdb_env_cunits(my, db->md_root, 0,
+		db->md_depth > 1 ? db->md_depth - 2 : 0, 1) ||
+		my->mc_nunits < 2)
+		return;
+	if (!(my->mc_pthr = calloc(nthr, sizeof(mdb_cprefetch))))
+		return;
+	for (i = 0; i < nthr; i++) {
+		mdb_cprefetch *cp = &my->mc_pthr[i];
+		cp->cp_copy = my;
+		cp->cp_id = i;
+#ifdef _WIN32
+		if (!(cp->cp_cond = CreateEvent(NULL, FALSE, FALSE, NULL)))
+			break;
+#else
+		if (pthread_cond_init(&cp->cp_cond, NULL))
+			break;
+#endif
+	}
+	/* They share out the units by number, so all of these or none */
+	my->mc_nthr = i;
+	for (i = 0; i < my->mc_nthr; i++) {
+		if (THREAD_CREATE(my->mc_pthr[i].cp_thr, mdb_env_cprefetch,
+			&my->mc_pthr[i]))
+			break;
+	}
+	if (i < my->mc_nthr || !i)
+		mdb_env_cprefetch_end(my, i);
+}
+
 	/** Copy environment with compaction. */
 static int ESECT
-mdb_env_copyfd1(MDB_env *env, HANDLE fd)
+mdb_env_copyfd1(MDB_env *env, HANDLE fd, int nthr)
 {
 	MDB_meta *mm;
 	MDB_page *mp;
@@ -9381,10 +10761,15 @@ mdb_env_copyfd1(MDB_env *env, HANDLE fd)
 
 	my.mc_wlen[0] = env->me_psize * NUM_METAS;
 	my.mc_txn = txn;
+	if (nthr && root != P_INVALID)
+		mdb_env_cprefetch_start(&my, nthr);
 	rc = mdb_env_cwalk(&my, &root, 0);
 	if (rc == MDB_SUCCESS && root != new_root) {
 		rc = MDB_INCOMPATIBLE;	/* page leak or corrupt DB */
 	}
+	if (my.mc_pthr)
+		mdb_env_cprefetch_end(&my, my.mc_nthr);
+	free(my.mc_units);
 
 finish:
 	if (rc)
@@ -9511,7 +10896,7 @@ int ESECT
 mdb_env_copyfd2(MDB_env *env, HANDLE fd, unsigned int flags)
 {
 	if (flags & MDB_CP_COMPACT)
-		return mdb_env_copyfd1(env, fd);
+		return mdb_env_copyfd1(env, fd, (flags >> 8) & 0xff);
 	else
 		return mdb_env_copyfd0(env, fd);
 }
@@ -9548,6 +10933,349 @@ mdb_env_copy(MDB_env *env, const char *path)
 	return mdb_env_copy2(env, path, 0);
 }
 
+/** @defgroup delta	Incremental copies
+ *	@ingroup internal
+ *
+ *	Pages carry no stamp of the txn that wrote them, so a delta is taken
+ *	by fingerprinting every page of the snapshot and comparing against the
+ *	fingerprints of the previous copy, kept in a manifest file. Only the
+ *	pages that differ are written. A delta is a #MDB_delta header followed
+ *	by records of a 64-bit page number and the page contents, ending with
+ *	page number #MDB_DELTA_END. The meta pages come last, so a copy being
+ *	patched never points at pages that have not been written yet.
+ *	@{
+ */
+#define MDB_DELTA_MAGIC	0x4D444244U	/**< "MDBD" */
+#define MDB_MANIF_MAGIC	0x4D44424DU	/**< "MDBM" */
+#define MDB_DELTA_END	((uint64_t)-1)
+
+	/** Header of a delta or a manifest file */
+typedef struct MDB_delta {
+	uint32_t	md_magic;
+	uint32_t	md_psize;
+	uint64_t	md_base;	/**< txnid of the copy the delta applies to */
+	uint64_t	md_txnid;	/**< txnid of the snapshot taken */
+	uint64_t	md_npages;	/**< pages in the snapshot */
+} MDB_delta;
+
+	/** Fingerprint of a page. psize is a multiple of 8. */
+static uint64_t
+mdb_delta_hash(const char *p, unsigned int psize)
+{
+	uint64_t h = 0x9E3779B97F4A7C15ULL, w;
+	unsigned int i;
+
+	for (i = 0; i < psize; i += sizeof(w)) {
+		memcpy(&w, p + i, sizeof(w));
+		h ^= w * 0x87C37B91114253D5ULL;
+		h = ((h << 31) | (h >> 33)) * 0x4CF5AD432745937FULL;
+	}
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static int ESECT
+mdb_delta_write(HANDLE fd, const char *ptr, size_t size)
+{
+	int rc;
+#ifdef _WIN32
+	DWORD len, w2;
+#define DO_WRITE(rc, fd, ptr, w2, len)	rc = WriteFile(fd, ptr, w2, &len, NULL)
+#else
+	ssize_t len;
+	size_t w2;
+#define DO_WRITE(rc, fd, ptr, w2, len)	len = write(fd, ptr, w2); rc = (len >= 0)
+#endif
+
+	while (size > 0) {
+		w2 = size > MAX_WRITE ? MAX_WRITE : size;
+		DO_WRITE(rc, fd, ptr, w2, len);
+		if (!rc)
+			return ErrCode();
+		if (len <= 0)
+			return EIO;
+		ptr += len;
+		size -= len;
+	}
+	return MDB_SUCCESS;
+#undef DO_WRITE
+}
+
+	/** Read exactly size bytes, a short read means a truncated delta */
+static int ESECT
+mdb_delta_read(HANDLE fd, char *ptr, size_t size)
+{
+#ifdef _WIN32
+	DWORD len;
+#else
+	ssize_t len;
+#endif
+
+	while (size > 0) {
+#ifdef _WIN32
+		if (!ReadFile(fd, ptr, size > MAX_WRITE ? MAX_WRITE : size, &len, NULL))
+			return ErrCode();
+#else
+		len = read(fd, ptr, size > MAX_WRITE ? MAX_WRITE : size);
+		if (len < 0) {
+			if (ErrCode() == EINTR)
+				continue;
+			return ErrCode();
+		}
+#endif
+		if (len == 0)
+			return MDB_INVALID;
+		ptr += len;
+		size -= len;
+	}
+	return MDB_SUCCESS;
+}
+
+static int ESECT
+mdb_delta_pio(HANDLE fd, char *ptr, size_t size, uint64_t off, int wr)
+{
+#ifdef _WIN32
+	DWORD len;
+	OVERLAPPED ov;
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = off & 0xffffffff;
+	ov.OffsetHigh = off >> 16 >> 16;
+	if (!(wr ? WriteFile(fd, ptr, size, &len, &ov) :
+		ReadFile(fd, ptr, size, &len, &ov)))
+		return ErrCode();
+#else
+	ssize_t len;
+	do {
+		len = wr ? pwrite(fd, ptr, size, off) : pread(fd, ptr, size, off);
+	} while (len < 0 && ErrCode() == EINTR);
+	if (len < 0)
+		return ErrCode();
+#endif
+	return (size_t)len == size ? MDB_SUCCESS : wr ? EIO : MDB_INVALID;
+}
+
+int ESECT
+mdb_env_copy_delta(MDB_env *env, HANDLE fd, const char *manifest)
+{
+	MDB_txn *txn = NULL;
+	mdb_mutexref_t wmutex = NULL;
+	MDB_delta hd, mh;
+	FILE *mold = NULL, *mnew = NULL;
+	char *metas = NULL, *wbuf = NULL, *tmpname = NULL, *ptr;
+	unsigned int psize = env->me_psize, rlen = sizeof(uint64_t) + psize;
+	size_t wlen = 0, fsize = 0, i;
+	uint64_t pg, h, oh, mpages = 0;
+	int rc;
+
+	i = strlen(manifest);
+	if ((tmpname = malloc(i + sizeof(".new"))) == NULL)
+		return ENOMEM;
+	memcpy(tmpname, manifest, i);
+	memcpy(tmpname + i, ".new", sizeof(".new"));
+
+	memset(&hd, 0, sizeof(hd));
+	if ((mold = fopen(manifest, "rb")) != NULL) {
+		if (fread(&mh, sizeof(mh), 1, mold) != 1 ||
+			mh.md_magic != MDB_MANIF_MAGIC || mh.md_psize != psize) {
+			rc = MDB_INVALID;
+			goto leave;
+		}
+		hd.md_base = mh.md_txnid;
+		mpages = mh.md_npages;
+	} else if (errno != ENOENT) {
+		rc = errno;
+		goto leave;
+	}
+
+	metas = malloc(psize * NUM_METAS + MDB_WBUF + rlen);
+	if (!metas) {
+		rc = ENOMEM;
+		goto leave;
+	}
+	wbuf = metas + psize * NUM_METAS;
+
+	/* Same snapshotting as #mdb_env_copyfd0() */
+	rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+	if (rc)
+		goto leave;
+	if (env->me_txns) {
+		mdb_txn_end(txn, MDB_END_RESET_TMP);
+		wmutex = env->me_wmutex;
+		if (LOCK_MUTEX(rc, env, wmutex))
+			goto leave;
+		rc = mdb_txn_renew0(txn);
+		if (rc) {
+			UNLOCK_MUTEX(wmutex);
+			goto leave;
+		}
+	}
+	memcpy(metas, env->me_map, psize * NUM_METAS);
+	if (wmutex)
+		UNLOCK_MUTEX(wmutex);
+
+	if ((rc = mdb_fsize(env->me_fd, &fsize)))
+		goto leave;
+	hd.md_magic = MDB_DELTA_MAGIC;
+	hd.md_psize = psize;
+	hd.md_txnid = txn->mt_txnid;
+	hd.md_npages = txn->mt_next_pgno;
+	if (hd.md_npages > fsize / psize)
+		hd.md_npages = fsize / psize;
+
+	if ((mnew = fopen(tmpname, "wb")) == NULL) {
+		rc = errno;
+		goto leave;
+	}
+	mh = hd;
+	mh.md_magic = MDB_MANIF_MAGIC;
+	if (fwrite(&mh, sizeof(mh), 1, mnew) != 1) {
+		rc = errno;
+		goto leave;
+	}
+	memcpy(wbuf, &hd, sizeof(hd));
+	wlen = sizeof(hd);
+
+	for (pg = 0; pg < hd.md_npages; pg++) {
+		if (pg < NUM_METAS)
+			ptr = metas + pg * psize;
+		else
+			ptr = env->me_map + pg * psize;
+		/* Free pages may be written meanwhile, hash what gets copied */
+		memcpy(wbuf + wlen + sizeof(pg), ptr, psize);
+		h = mdb_delta_hash(wbuf + wlen + sizeof(pg), psize);
+		if (fwrite(&h, sizeof(h), 1, mnew) != 1) {
+			rc = errno;
+			goto leave;
+		}
+		if (pg < mpages) {
+			if (fread(&oh, sizeof(oh), 1, mold) != 1) {
+				rc = MDB_INVALID;
+				goto leave;
+			}
+			if (oh == h || pg < NUM_METAS)
+				continue;
+		} else if (pg < NUM_METAS) {
+			continue;
+		}
+		memcpy(wbuf + wlen, &pg, sizeof(pg));
+		wlen += rlen;
+		if (wlen + rlen > MDB_WBUF) {
+			if ((rc = mdb_delta_write(fd, wbuf, wlen)))
+				goto leave;
+			wlen = 0;
+		}
+	}
+
+	/* Meta pages last, then the end marker */
+	for (pg = 0; pg < NUM_METAS; pg++) {
+		memcpy(wbuf + wlen, &pg, sizeof(pg));
+		memcpy(wbuf + wlen + sizeof(pg), metas + pg * psize, psize);
+		wlen += rlen;
+		if (wlen + rlen > MDB_WBUF) {
+			if ((rc = mdb_delta_write(fd, wbuf, wlen)))
+				goto leave;
+			wlen = 0;
+		}
+	}
+	pg = MDB_DELTA_END;
+	memcpy(wbuf + wlen, &pg, sizeof(pg));
+	wlen += sizeof(pg);
+	if ((rc = mdb_delta_write(fd, wbuf, wlen)))
+		goto leave;
+
+	rc = fclose(mnew) ? errno : MDB_SUCCESS;
+	mnew = NULL;
+	if (rc == MDB_SUCCESS && rename(tmpname, manifest))
+		rc = errno;
+
+leave:
+	if (mnew)
+		fclose(mnew);
+	if (rc)
+		remove(tmpname);
+	if (mold)
+		fclose(mold);
+	mdb_txn_abort(txn);
+	free(metas);
+	free(tmpname);
+	return rc;
+}
+
+int ESECT
+mdb_delta_apply(HANDLE delta, HANDLE fd)
+{
+	MDB_delta hd;
+	MDB_meta *m;
+	MDB_page *p;
+	char *buf = NULL;
+	uint64_t pg, txnid = 0;
+	size_t fsize = 0;
+	int i, rc, synced = 0;
+
+	if ((rc = mdb_delta_read(delta, (char *)&hd, sizeof(hd))))
+		return rc;
+	if (hd.md_magic != MDB_DELTA_MAGIC || hd.md_psize < PAGEHDRSZ + sizeof(MDB_meta) ||
+		hd.md_psize % sizeof(uint64_t))
+		return MDB_INVALID;
+	if ((buf = malloc(hd.md_psize)) == NULL)
+		return ENOMEM;
+
+	/* The copy must be at the snapshot the delta was taken against */
+	if ((rc = mdb_fsize(fd, &fsize)))
+		goto leave;
+	if (hd.md_base) {
+		for (i = 0; i < NUM_METAS; i++) {
+			if ((rc = mdb_delta_pio(fd, buf, hd.md_psize,
+				(uint64_t)i * hd.md_psize, 0)))
+				goto leave;
+			p = (MDB_page *)buf;
+			m = METADATA(p);
+			if (!F_ISSET(p->mp_flags, P_META) || m->mm_magic != MDB_MAGIC) {
+				rc = MDB_INVALID;
+				goto leave;
+			}
+			if (m->mm_txnid > txnid)
+				txnid = m->mm_txnid;
+		}
+	}
+	if (txnid != hd.md_base || (!hd.md_base && fsize)) {
+		rc = EINVAL;
+		goto leave;
+	}
+
+	for (;;) {
+		if ((rc = mdb_delta_read(delta, (char *)&pg, sizeof(pg))))
+			goto leave;
+		if (pg == MDB_DELTA_END)
+			break;
+		if (pg >= hd.md_npages) {
+			rc = MDB_INVALID;
+			goto leave;
+		}
+		if ((rc = mdb_delta_read(delta, buf, hd.md_psize)))
+			goto leave;
+		/* Data pages must be on disk before the metas refer to them */
+		if (pg < NUM_METAS && !synced) {
+			if (MDB_FDATASYNC(fd)) {
+				rc = ErrCode();
+				goto leave;
+			}
+			synced = 1;
+		}
+		if ((rc = mdb_delta_pio(fd, buf, hd.md_psize, pg * hd.md_psize, 1)))
+			goto leave;
+	}
+	if (MDB_FDATASYNC(fd))
+		rc = ErrCode();
+
+leave:
+	free(buf);
+	return rc;
+}
+/** @} */
+
 int ESECT
 mdb_env_set_flags(MDB_env *env, unsigned int flag, int onoff)
 {
@@ -9648,6 +11376,44 @@ mdb_env_stat(MDB_env *env, MDB_stat *arg)
 	return mdb_stat0(env, &meta->mm_dbs[MAIN_DBI], arg);
 }
 
+int ESECT
+mdb_env_set_counters(MDB_env *env, unsigned int sample)
+{
+	if (env == NULL || !env->me_dbxs)
+		return EINVAL;
+
+	if (!sample) {
+		env->me_ctr_sample = 0;
+		return MDB_SUCCESS;
+	}
+	/* Readers may be counting into the old array; it is kept
+	 * until the env is closed and only zeroed here.
+	 */
+	if (!env->me_ctrs) {
+		env->me_ctrs = calloc(env->me_maxdbs, sizeof(MDB_counters));
+		if (!env->me_ctrs)
+			return ENOMEM;
+	} else {
+		memset(env->me_ctrs, 0, env->me_maxdbs * sizeof(MDB_counters));
+	}
+	env->me_ctr_tick = 0;
+	env->me_ctr_sample = sample;
+	return MDB_SUCCESS;
+}
+
+int ESECT
+mdb_env_counters(MDB_env *env, MDB_dbi dbi, MDB_counters *arg)
+{
+	if (env == NULL || arg == NULL || dbi >= env->me_maxdbs)
+		return EINVAL;
+
+	if (env->me_ctrs)
+		*arg = env->me_ctrs[dbi];
+	else
+		memset(arg, 0, sizeof(*arg));
+	return MDB_SUCCESS;
+}
+
 int ESECT
 mdb_env_info(MDB_env *env, MDB_envinfo *arg)
 {
@@ -10132,20 +11898,33 @@ mdb_reader_check(MDB_env *env, int *dead)
 	return env->me_txns ? mdb_reader_check0(env, 0, dead) : MDB_SUCCESS;
 }
 
-/** As #mdb_reader_check(). \b rlocked is set if caller locked #me_rmutex. */
+/** As #mdb_reader_check(). \b rlocked is set if caller locked #me_rmutex.
+ * With #MDB_RDR_CAS stale slots are freed with CAS, still under the
+ * mutex so that concurrent checkers cannot free a slot twice.
+ */
 static int ESECT
 mdb_reader_check0(MDB_env *env, int rlocked, int *dead)
 {
-	mdb_mutexref_t rmutex = rlocked ? NULL : env->me_rmutex;
 	unsigned int i, j, rdrs;
 	MDB_reader *mr;
 	MDB_PID_T *pids, pid;
 	int rc = MDB_SUCCESS, count = 0;
+	mdb_mutexref_t rmutex = rlocked ? NULL : env->me_rmutex;
+#if MDB_RDR_CAS
+	unsigned int *slots;
+#endif
 
 	rdrs = env->me_txns->mti_numreaders;
 	pids = malloc((rdrs+1) * sizeof(MDB_PID_T));
 	if (!pids)
 		return ENOMEM;
+#if MDB_RDR_CAS
+	slots = malloc((rdrs+1) * sizeof(unsigned int));
+	if (!slots) {
+		free(pids);
+		return ENOMEM;
+	}
+#endif
 	pids[0] = 0;
 	mr = env->me_txns->mti_readers;
 	for (i=0; i<rdrs; i++) {
@@ -10154,6 +11933,38 @@ mdb_reader_check0(MDB_env *env, int rlocked, int *dead)
 			if (mdb_pid_insert(pids, pid) == 0) {
 				if (!mdb_reader_pid(env, Pidcheck, pid)) {
 					/* Stale reader found */
+#if MDB_RDR_CAS
+					/* Slots are claimed without the mutex. Note the
+					 * stale ones first, then make sure pid was not
+					 * reused meanwhile: a new owner takes its pid lock
+					 * before it claims any slot. The mutex keeps other
+					 * checkers from freeing a noted slot, which a new
+					 * owner of pid could then claim before our CAS.
+					 */
+					unsigned int n = 0;
+					if (rmutex) {
+						if ((rc = LOCK_MUTEX0(rmutex)) != 0) {
+							if ((rc = mdb_mutex_failed(env, rmutex, rc)))
+								break;
+						}
+					}
+					for (j = i; j<rdrs; j++)
+						if (mr[j].mr_pid == pid)
+							slots[n++] = j;
+					if (mdb_reader_pid(env, Pidcheck, pid))
+						n = 0;
+					while (n--) {
+						j = slots[n];
+						if (MDB_CAS(&mr[j].mr_pid, pid, 0)) {
+							DPRINTF(("clear stale reader pid %u txn %"Z"d",
+								(unsigned) pid, mr[j].mr_txnid));
+							env->me_txns->mti_rdrhint = j;
+							count++;
+						}
+					}
+					if (rmutex)
+						UNLOCK_MUTEX(rmutex);
+#else
 					j = i;
 					if (rmutex) {
 						if ((rc = LOCK_MUTEX0(rmutex)) != 0) {
@@ -10175,10 +11986,14 @@ mdb_reader_check0(MDB_env *env, int rlocked, int *dead)
 							}
 					if (rmutex)
 						UNLOCK_MUTEX(rmutex);
+#endif
 				}
 			}
 		}
 	}
+#if MDB_RDR_CAS
+	free(slots);
+#endif
 	free(pids);
 	if (dead)
 		*dead = count;
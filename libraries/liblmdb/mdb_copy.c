@@ -14,11 +14,32 @@
 #ifdef _WIN32
 #include <windows.h>
 #define	MDB_STDOUT	GetStdHandle(STD_OUTPUT_HANDLE)
+#define	MDB_STDIN	GetStdHandle(STD_INPUT_HANDLE)
+#define	MDB_OPEN_IN(path)	CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, \
+	NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL)
+#define	MDB_OPEN_OUT(path)	CreateFileA(path, GENERIC_WRITE, 0, \
+	NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL)
+#define	MDB_OPEN_RW(path)	CreateFileA(path, GENERIC_READ|GENERIC_WRITE, 0, \
+	NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)
+#define	MDB_BADFD(fd)	((fd) == INVALID_HANDLE_VALUE)
+#define	MDB_CLOSE(fd)	(!CloseHandle(fd))
+#define	MDB_ERRNO	GetLastError()
 #else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #define	MDB_STDOUT	1
+#define	MDB_STDIN	0
+#define	MDB_OPEN_IN(path)	open(path, O_RDONLY)
+#define	MDB_OPEN_OUT(path)	open(path, O_WRONLY|O_CREAT|O_EXCL, 0666)
+#define	MDB_OPEN_RW(path)	open(path, O_RDWR|O_CREAT, 0600)
+#define	MDB_BADFD(fd)	((fd) < 0)
+#define	MDB_CLOSE(fd)	close(fd)
+#define	MDB_ERRNO	errno
 #endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include "lmdb.h"
 
@@ -27,19 +48,79 @@ sighandle(int sig)
 {
 }
 
+/* Apply the deltas named in argv, or the one on stdin, to the copy
+ * in dstpath.
+ */
+static int
+apply(const char *progname, const char *dstpath, int nosubdir,
+	int argc, char *argv[])
+{
+	mdb_filehandle_t fd, in;
+	char *path = NULL;
+	const char *act;
+	int i, rc = 0;
+
+	if (!nosubdir) {
+		path = malloc(strlen(dstpath) + sizeof("/data.mdb"));
+		if (!path) {
+			fprintf(stderr, "%s: out of memory\n", progname);
+			return EXIT_FAILURE;
+		}
+		sprintf(path, "%s/data.mdb", dstpath);
+		dstpath = path;
+	}
+	fd = MDB_OPEN_RW(dstpath);
+	if (MDB_BADFD(fd)) {
+		rc = MDB_ERRNO;
+		fprintf(stderr, "%s: opening %s failed, error %d (%s)\n",
+			progname, dstpath, rc, mdb_strerror(rc));
+		free(path);
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < argc || (!argc && !i); i++) {
+		act = argc ? argv[i] : "stdin";
+		in = argc ? MDB_OPEN_IN(argv[i]) : MDB_STDIN;
+		if (MDB_BADFD(in)) {
+			rc = MDB_ERRNO;
+		} else {
+			rc = mdb_delta_apply(in, fd);
+			if (argc)
+				MDB_CLOSE(in);
+		}
+		if (rc) {
+			fprintf(stderr, "%s: applying %s failed, error %d (%s)\n",
+				progname, act, rc, mdb_strerror(rc));
+			break;
+		}
+	}
+	MDB_CLOSE(fd);
+	free(path);
+	return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 int main(int argc,char * argv[])
 {
 	int rc;
 	MDB_env *env;
-	const char *progname = argv[0], *act;
+	const char *progname = argv[0], *act, *manifest = NULL;
 	unsigned flags = MDB_RDONLY;
 	unsigned cpflags = 0;
+	int doapply = 0, nthr = 0;
+	mdb_filehandle_t fd;
 
 	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
 		if (argv[1][1] == 'n' && argv[1][2] == '\0')
 			flags |= MDB_NOSUBDIR;
 		else if (argv[1][1] == 'c' && argv[1][2] == '\0')
 			cpflags |= MDB_CP_COMPACT;
+		else if (argv[1][1] == 'j' && argv[1][2] == '\0' && argc > 2) {
+			nthr = atoi(argv[2]);
+			argc--, argv++;
+		} else if (argv[1][1] == 'i' && argv[1][2] == '\0' && argc > 2) {
+			manifest = argv[2];
+			argc--, argv++;
+		} else if (argv[1][1] == 'a' && argv[1][2] == '\0')
+			doapply = 1;
 		else if (argv[1][1] == 'V' && argv[1][2] == '\0') {
 			printf("%s\n", MDB_VERSION_STRING);
 			exit(0);
@@ -47,8 +128,18 @@ int main(int argc,char * argv[])
 			argc = 0;
 	}
 
-	if (argc<2 || argc>3) {
-		fprintf(stderr, "usage: %s [-V] [-c] [-n] srcpath [dstpath]\n", progname);
+	if (doapply && argc >= 2 && !manifest && !cpflags)
+		return apply(progname, argv[1], flags & MDB_NOSUBDIR, argc-2, argv+2);
+
+	if (nthr > 0 && nthr < 256)
+		cpflags |= MDB_CP_THREADS(nthr);
+	else if (nthr)
+		argc = 0;
+
+	if (argc<2 || argc>3 || doapply || (manifest && cpflags) ||
+		(nthr && !(cpflags & MDB_CP_COMPACT))) {
+		fprintf(stderr, "usage: %s [-V] [-c [-j threads]] [-n] [-i manifest] srcpath [dstpath]\n"
+			"       %s -a [-n] dstpath [delta ...]\n", progname, progname);
 		exit(EXIT_FAILURE);
 	}
 
@@ -68,7 +159,16 @@ int main(int argc,char * argv[])
 	}
 	if (rc == MDB_SUCCESS) {
 		act = "copying";
-		if (argc == 2)
+		if (manifest) {
+			fd = argc == 2 ? MDB_STDOUT : MDB_OPEN_OUT(argv[2]);
+			if (MDB_BADFD(fd)) {
+				rc = MDB_ERRNO;
+			} else {
+				rc = mdb_env_copy_delta(env, fd, manifest);
+				if (argc > 2 && MDB_CLOSE(fd) && !rc)
+					rc = MDB_ERRNO;
+			}
+		} else if (argc == 2)
 			rc = mdb_env_copyfd2(env, MDB_STDOUT, cpflags);
 		else
 			rc = mdb_env_copy2(env, argv[2], cpflags);
@@ -35,9 +35,36 @@ static void prstat(MDB_stat *ms)
 	printf("  Entries: %"Z"u\n", ms->ms_entries);
 }
 
+/* Read every record of dbi with counters on, to see how much of it
+ * is in RAM.
+ */
+static int prheat(MDB_env *env, MDB_txn *txn, MDB_dbi dbi)
+{
+	MDB_cursor *cursor;
+	MDB_counters ct;
+	MDB_val key, data;
+	int rc;
+
+	rc = mdb_env_set_counters(env, 1);
+	if (rc)
+		return rc;
+	rc = mdb_cursor_open(txn, dbi, &cursor);
+	if (rc)
+		return rc;
+	while ((rc = mdb_cursor_get(cursor, &key, &data, MDB_NEXT)) == 0) ;
+	mdb_cursor_close(cursor);
+	mdb_env_set_counters(env, 0);
+	if (rc != MDB_NOTFOUND)
+		return rc;
+	mdb_env_counters(env, dbi, &ct);
+	printf("  Page visits: %"Z"u\n", ct.mc_page_gets);
+	printf("  Not in RAM: %"Z"u of %"Z"u\n", ct.mc_page_faults, ct.mc_page_samples);
+	return MDB_SUCCESS;
+}
+
 static void usage(char *prog)
 {
-	fprintf(stderr, "usage: %s [-V] [-n] [-e] [-r[r]] [-f[f[f]]] [-a|-s subdb] dbpath\n", prog);
+	fprintf(stderr, "usage: %s [-V] [-n] [-e] [-r[r]] [-f[f[f]]] [-t] [-a|-s subdb] dbpath\n", prog);
 	exit(EXIT_FAILURE);
 }
 
@@ -53,6 +80,7 @@ int main(int argc, char *argv[])
 	char *envname;
 	char *subname = NULL;
 	int alldbs = 0, envinfo = 0, envflags = 0, freinfo = 0, rdrinfo = 0;
+	int heat = 0;
 
 	if (argc < 2) {
 		usage(prog);
@@ -63,11 +91,12 @@ int main(int argc, char *argv[])
 	 * -e: print env info
 	 * -f: print freelist info
 	 * -r: print reader info
+	 * -t: read the DBs to find how much of them is in RAM
 	 * -n: use NOSUBDIR flag on env_open
 	 * -V: print version and exit
 	 * (default) print stat of only the main DB
 	 */
-	while ((i = getopt(argc, argv, "Vaefnrs:")) != EOF) {
+	while ((i = getopt(argc, argv, "Vaefnrs:t")) != EOF) {
 		switch(i) {
 		case 'V':
 			printf("%s\n", MDB_VERSION_STRING);
@@ -95,6 +124,11 @@ int main(int argc, char *argv[])
 				usage(prog);
 			subname = optarg;
 			break;
+		case 't':
+			heat++;
+			/* Don't let readahead hide what wasn't in RAM */
+			envflags |= MDB_NORDAHEAD;
+			break;
 		default:
 			usage(prog);
 		}
@@ -216,6 +250,10 @@ int main(int argc, char *argv[])
 	}
 	printf("Status of %s\n", subname ? subname : "Main DB");
 	prstat(&mst);
+	if (heat && (rc = prheat(env, txn, dbi))) {
+		fprintf(stderr, "mdb_cursor_get failed, error %d %s\n", rc, mdb_strerror(rc));
+		goto txn_abort;
+	}
 
 	if (alldbs) {
 		MDB_cursor *cursor;
@@ -245,6 +283,10 @@ int main(int argc, char *argv[])
 				goto txn_abort;
 			}
 			prstat(&mst);
+			if (heat && (rc = prheat(env, txn, db2))) {
+				fprintf(stderr, "mdb_cursor_get failed, error %d %s\n", rc, mdb_strerror(rc));
+				goto txn_abort;
+			}
 			mdb_close(env, db2);
 		}
 		mdb_cursor_close(cursor);
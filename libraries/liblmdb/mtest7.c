@@ -0,0 +1,123 @@
+/* mtest7.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2018 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for batched write txns: concurrent writers commit and abort
+ * in their own DBIs, and each DBI must end up with exactly the
+ * committed records.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "lmdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == MDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, mdb_strerror(rc)), abort()))
+
+#define NTHREADS	8
+#define NTXNS	200
+
+MDB_env *env;
+MDB_dbi dbis[NTHREADS];
+
+/* every fifth txn of a thread is aborted */
+#define ABORTED(i)	((i) % 5 == 4)
+
+static void *
+writer(void *arg)
+{
+	int t = (int)(long)arg;
+	int i, rc;
+	MDB_txn *txn;
+	MDB_val key, data;
+	char kbuf[16], dbuf[32];
+
+	for (i=0; i<NTXNS; i++) {
+		sprintf(kbuf, "%08x", i);
+		sprintf(dbuf, "thread %d txn %d", t, i);
+		key.mv_size = strlen(kbuf);
+		key.mv_data = kbuf;
+		data.mv_size = strlen(dbuf);
+		data.mv_data = dbuf;
+		E(mdb_txn_begin(env, NULL, 0, &txn));
+		E(mdb_put(txn, dbis[t], &key, &data, MDB_NOOVERWRITE));
+		if (ABORTED(i))
+			mdb_txn_abort(txn);
+		else
+			E(mdb_txn_commit(txn));
+	}
+	return NULL;
+}
+
+int main(int argc,char * argv[])
+{
+	int i, t, rc;
+	pthread_t tids[NTHREADS];
+	MDB_txn *txn;
+	MDB_stat mst;
+	MDB_val key, data;
+	char kbuf[16], dbuf[32], name[8];
+
+	E(mdb_env_create(&env));
+	E(mdb_env_set_maxreaders(env, NTHREADS * 2));
+	E(mdb_env_set_mapsize(env, 10485760));
+	E(mdb_env_set_maxdbs(env, NTHREADS));
+	E(mdb_env_open(env, "./testdb", MDB_NOSYNC, 0664));
+
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	for (t=0; t<NTHREADS; t++) {
+		sprintf(name, "db%d", t);
+		E(mdb_dbi_open(txn, name, MDB_CREATE, &dbis[t]));
+	}
+	E(mdb_txn_commit(txn));
+
+	E(mdb_env_set_writebatch(env, NTHREADS, 1000));
+
+	printf("Running %d writers of %d txns each, aborting every fifth\n",
+		NTHREADS, NTXNS);
+	for (t=0; t<NTHREADS; t++)
+		CHECK(!pthread_create(&tids[t], NULL, writer, (void *)(long)t),
+			"pthread_create");
+	for (t=0; t<NTHREADS; t++)
+		pthread_join(tids[t], NULL);
+
+	E(mdb_env_set_writebatch(env, 0, 0));
+
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+	for (t=0; t<NTHREADS; t++) {
+		E(mdb_stat(txn, dbis[t], &mst));
+		CHECK(mst.ms_entries == NTXNS - NTXNS / 5, "committed count");
+		for (i=0; i<NTXNS; i++) {
+			sprintf(kbuf, "%08x", i);
+			key.mv_size = strlen(kbuf);
+			key.mv_data = kbuf;
+			rc = mdb_get(txn, dbis[t], &key, &data);
+			if (ABORTED(i)) {
+				CHECK(rc == MDB_NOTFOUND, "aborted record");
+				continue;
+			}
+			CHECK(rc == MDB_SUCCESS, "committed record");
+			sprintf(dbuf, "thread %d txn %d", t, i);
+			CHECK(data.mv_size == strlen(dbuf) &&
+				!memcmp(data.mv_data, dbuf, data.mv_size), "record data");
+		}
+	}
+	mdb_txn_abort(txn);
+	printf("All %d DBIs hold exactly their committed records\n", NTHREADS);
+
+	mdb_env_close(env);
+
+	return 0;
+}
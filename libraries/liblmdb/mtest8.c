@@ -0,0 +1,173 @@
+/* mtest8.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2018 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for mdb_estimate_range() against exact counts */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lmdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == MDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, mdb_strerror(rc)), abort()))
+
+#define NKEYS	20000
+#define MAXDUPS	20
+#define NBIG	50
+#define BIGDUPS	3000
+#define NRANGES	200
+
+int dups[NKEYS], bigdups[NBIG];
+
+/* keys are even numbers, so odd ones fall between them */
+static void
+setkey(MDB_val *key, unsigned int *kval, int i)
+{
+	*kval = i * 2;
+	key->mv_size = sizeof(*kval);
+	key->mv_data = kval;
+}
+
+static size_t
+exact(int lo, int hi)
+{
+	size_t n = 0;
+	int i;
+
+	for (i=lo; i<=hi; i++)
+		n += dups[i];
+	return n;
+}
+
+static size_t
+fill(MDB_txn *txn, MDB_dbi dbi, int *counts, int nkeys)
+{
+	MDB_val key, data;
+	unsigned int kval, dval;
+	size_t total = 0;
+	int i, rc;
+
+	data.mv_size = sizeof(dval);
+	data.mv_data = &dval;
+	for (i=0; i<nkeys; i++) {
+		setkey(&key, &kval, i);
+		for (dval=0; dval<(unsigned int)counts[i]; dval++)
+			E(mdb_put(txn, dbi, &key, &data, 0));
+		total += counts[i];
+	}
+	return total;
+}
+
+int main(int argc,char * argv[])
+{
+	int i, k, lo, hi, rc;
+	MDB_env *env;
+	MDB_dbi dbi, bigdbi;
+	MDB_val key, key2;
+	MDB_txn *txn;
+	size_t n, n2, total, want;
+	unsigned int kval, kval2;
+
+	srand(time(NULL));
+
+	E(mdb_env_create(&env));
+	E(mdb_env_set_mapsize(env, 104857600));
+	E(mdb_env_set_maxdbs(env, 4));
+	E(mdb_env_open(env, "./testdb", MDB_NOSYNC, 0664));
+
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	E(mdb_dbi_open(txn, "id8", MDB_CREATE|MDB_DUPSORT|MDB_INTEGERKEY|
+		MDB_DUPFIXED|MDB_INTEGERDUP, &dbi));
+	E(mdb_dbi_open(txn, "big8", MDB_CREATE|MDB_DUPSORT|MDB_INTEGERKEY|
+		MDB_DUPFIXED|MDB_INTEGERDUP, &bigdbi));
+	printf("Adding %d keys with 1 to %d duplicates each\n", NKEYS, MAXDUPS);
+	for (i=0; i<NKEYS; i++)
+		dups[i] = 1 + rand() % MAXDUPS;
+	total = fill(txn, dbi, dups, NKEYS);
+	/* enough duplicates to need sub-DBs */
+	printf("Adding %d keys with up to %d duplicates each\n", NBIG, BIGDUPS);
+	for (i=0; i<NBIG; i++)
+		bigdups[i] = 1 + rand() % BIGDUPS;
+	fill(txn, bigdbi, bigdups, NBIG);
+	E(mdb_txn_commit(txn));
+
+	/* a fresh txn, whose named DBs are stale until first used */
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+	E(mdb_estimate_range(txn, dbi, NULL, NULL, &n));
+	CHECK(n == total, "whole DB");
+
+	printf("Single keys are counted exactly\n");
+	for (i=0; i<NBIG; i++) {
+		setkey(&key, &kval, i);
+		E(mdb_estimate_range(txn, bigdbi, &key, &key, &n));
+		CHECK(n == (size_t)bigdups[i], "single key with a sub-DB");
+	}
+	for (k=0; k<NRANGES; k++) {
+		i = rand() % NKEYS;
+		setkey(&key, &kval, i);
+		E(mdb_estimate_range(txn, dbi, &key, &key, &n));
+		CHECK(n == (size_t)dups[i], "single key");
+	}
+
+	/* absent keys, and bounds that cross */
+	kval = 1;
+	key.mv_size = sizeof(kval);
+	key.mv_data = &kval;
+	E(mdb_estimate_range(txn, dbi, &key, &key, &n));
+	CHECK(n == 0, "absent key");
+	kval = NKEYS * 2;
+	E(mdb_estimate_range(txn, dbi, &key, NULL, &n));
+	CHECK(n == 0, "past the last key");
+	setkey(&key, &kval, 10);
+	setkey(&key2, &kval2, 5);
+	E(mdb_estimate_range(txn, dbi, &key, &key2, &n));
+	CHECK(n == 0, "lo above hi");
+
+	/* Pages are assumed to share their parent's items evenly, which a
+	 * lopsided tree gets wrong by up to the ratio of its subtrees' sizes,
+	 * so only check the estimates are in the right ballpark.
+	 */
+	printf("Random ranges are estimated within a factor of 3\n");
+	for (k=0; k<NRANGES; k++) {
+		lo = rand() % NKEYS;
+		hi = lo + rand() % (NKEYS - lo);
+		setkey(&key, &kval, lo);
+		setkey(&key2, &kval2, hi);
+		E(mdb_estimate_range(txn, dbi, &key, &key2, &n));
+		want = exact(lo, hi);
+		CHECK(n <= want * 3 + MAXDUPS && n * 3 + MAXDUPS >= want,
+			"range estimate");
+
+		/* the two halves of the DB around lo */
+		E(mdb_estimate_range(txn, dbi, &key, NULL, &n));
+		if (lo) {
+			setkey(&key2, &kval2, lo - 1);
+			E(mdb_estimate_range(txn, dbi, NULL, &key2, &n2));
+		} else {
+			n2 = 0;
+		}
+		want = exact(lo, NKEYS - 1);
+		CHECK(n <= want * 3 + MAXDUPS && n * 3 + MAXDUPS >= want,
+			"open-ended estimate");
+		want = total - want;
+		CHECK(n2 <= want * 3 + MAXDUPS && n2 * 3 + MAXDUPS >= want,
+			"open-ended estimate");
+	}
+
+	mdb_txn_abort(txn);
+	mdb_env_close(env);
+
+	return 0;
+}
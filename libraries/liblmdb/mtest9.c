@@ -0,0 +1,111 @@
+/* mtest9.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2018 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for reclaiming the reader slots of killed processes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "lmdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == MDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, mdb_strerror(rc)), abort()))
+
+#define MAXREADERS	16
+
+static MDB_env *
+envopen(void)
+{
+	MDB_env *env;
+	int rc;
+
+	E(mdb_env_create(&env));
+	E(mdb_env_set_maxreaders(env, MAXREADERS));
+	E(mdb_env_set_mapsize(env, 10485760));
+	E(mdb_env_open(env, "./testdb", MDB_NOTLS|MDB_NOSYNC, 0664));
+	return env;
+}
+
+int main(int argc,char * argv[])
+{
+	int i, rc, dead, nreaders, rounds;
+	int fds[2];
+	unsigned int maxreaders;
+	pid_t *pids;
+	MDB_env *env;
+	MDB_txn *txn, **txns;
+	char c;
+
+	/* the lock file rounds the table up to whole pages */
+	env = envopen();
+	E(mdb_env_get_maxreaders(env, &maxreaders));
+	mdb_env_close(env);
+	nreaders = maxreaders;
+	pids = calloc(nreaders, sizeof(pid_t));
+	txns = calloc(nreaders + 1, sizeof(MDB_txn *));
+
+	for (rounds=0; rounds<2; rounds++) {
+		printf("Filling all %d reader slots from other processes\n",
+			nreaders);
+		CHECK(!pipe(fds), "pipe");
+		for (i=0; i<nreaders; i++) {
+			pids[i] = fork();
+			CHECK(pids[i] >= 0, "fork");
+			if (!pids[i]) {
+				env = envopen();
+				E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+				c = 0;
+				CHECK(write(fds[1], &c, 1) == 1, "write");
+				for (;;)
+					pause();
+			}
+		}
+		for (i=0; i<nreaders; i++)
+			CHECK(read(fds[0], &c, 1) == 1, "read");
+		close(fds[0]);
+		close(fds[1]);
+
+		env = envopen();
+		rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+		CHECK(rc == MDB_READERS_FULL, "reader table should be full");
+
+		E(mdb_reader_check(env, &dead));
+		CHECK(dead == 0, "no reader is dead yet");
+
+		for (i=0; i<nreaders; i++) {
+			kill(pids[i], SIGKILL);
+			waitpid(pids[i], NULL, 0);
+		}
+		E(mdb_reader_check(env, &dead));
+		CHECK(dead == nreaders, "all killed readers reclaimed");
+		E(mdb_reader_check(env, &dead));
+		CHECK(dead == 0, "nothing left to reclaim");
+
+		printf("Reusing the %d reclaimed slots\n", nreaders);
+		for (i=0; i<nreaders; i++)
+			E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txns[i]));
+		rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txns[i]);
+		CHECK(rc == MDB_READERS_FULL, "reader table should be full again");
+		for (i=0; i<nreaders; i++)
+			mdb_txn_abort(txns[i]);
+		mdb_env_close(env);
+	}
+	free(txns);
+	free(pids);
+
+	return 0;
+}
@@ -102,6 +102,31 @@ void ucstr2upper(
 	}
 }
 
+/* the ctype TOLOWER() goes through the locale; for ASCII it need not */
+#define ASCII_TOLOWER(c)	( ((c) >= 'A' && (c) <= 'Z') ? (c) - 'A' + 'a' : (c) )
+
+/*
+ * Length of the leading run of ASCII in s, tested a word at a time.
+ * Most directory data is plain ASCII, so this usually covers all of it.
+ */
+static int
+ascii_prefix( const char *s, int len )
+{
+	static const unsigned long high = ((unsigned long) -1) / 0xff * 0x80;
+	unsigned long w;
+	int i = 0;
+
+	for ( ; i + (int) sizeof(w) <= len; i += sizeof(w) ) {
+		memcpy( &w, s + i, sizeof(w) );
+		if ( w & high )
+			break;
+	}
+	while ( i < len && LDAP_UTF8_ISASCII( s + i ) )
+		i++;
+
+	return i;
+}
+
 struct berval * UTF8bvnormalize(
 	struct berval *bv,
 	struct berval *newbv,
@@ -142,7 +167,8 @@ struct berval * UTF8bvnormalize(
 	 */
 
 	/* finish off everything up to character before first non-ascii */
-	if ( LDAP_UTF8_ISASCII( s ) ) {
+	i = ascii_prefix( s, len );
+	if ( i ) {
 		if ( casefold ) {
 			outsize = len + 7;
 			out = (char *) ber_memalloc_x( outsize, ctx );
@@ -152,23 +178,19 @@ fail:
 					ber_memfree_x( newbv, ctx );
 				return NULL;
 			}
-			outpos = 0;
 
-			for ( i = 1; (i < len) && LDAP_UTF8_ISASCII(s + i); i++ ) {
-				out[outpos++] = TOLOWER( s[i-1] );
+			for ( outpos = 0; outpos < i - 1; outpos++ ) {
+				out[outpos] = ASCII_TOLOWER( s[outpos] );
 			}
 			if ( i == len ) {
-				out[outpos++] = TOLOWER( s[len-1] );
+				out[outpos] = ASCII_TOLOWER( s[outpos] );
+				outpos++;
 				out[outpos] = '\0';
 				newbv->bv_val = out;
 				newbv->bv_len = outpos;
 				return newbv;
 			}
 		} else {
-			for ( i = 1; (i < len) && LDAP_UTF8_ISASCII(s + i); i++ ) {
-				/* empty */
-			}
-
 			if ( i == len ) {
 				return ber_str2bv_x( s, len, 1, newbv, ctx );
 			}
@@ -199,7 +221,7 @@ fail:
 
 	/* convert character before first non-ascii to ucs-4 */
 	if ( i > 0 ) {
-		*p = casefold ? TOLOWER( s[i-1] ) : s[i-1];
+		*p = casefold ? ASCII_TOLOWER( s[i-1] ) : s[i-1];
 		p++;
 	}
 
@@ -288,15 +310,15 @@ fail:
 		/* s[i] is ascii */
 		/* finish off everything up to char before next non-ascii */
 		for ( i++; (i < len) && LDAP_UTF8_ISASCII(s + i); i++ ) {
-			out[outpos++] = casefold ? TOLOWER( s[i-1] ) : s[i-1];
+			out[outpos++] = casefold ? ASCII_TOLOWER( s[i-1] ) : s[i-1];
 		}
 		if ( i == len ) {
-			out[outpos++] = casefold ? TOLOWER( s[len-1] ) : s[len-1];
+			out[outpos++] = casefold ? ASCII_TOLOWER( s[len-1] ) : s[len-1];
 			break;
 		}
 
 		/* convert character before next non-ascii to ucs-4 */
-		*ucs = casefold ? TOLOWER( s[i-1] ) : s[i-1];
+		*ucs = casefold ? ASCII_TOLOWER( s[i-1] ) : s[i-1];
 		p = ucs + 1;
 	}
 
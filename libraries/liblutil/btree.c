@@ -0,0 +1,491 @@
+/* btree.c - routines to implement an in-memory B+tree */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2005-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <ac/stdlib.h>
+#include <ac/string.h>
+
+#ifdef CSRIMALLOC
+#define ber_memalloc malloc
+#define ber_memrealloc realloc
+#define ber_memfree free
+#else
+#include "lber.h"
+#endif
+
+#include "avl.h"
+
+/*
+ * A B+tree with the same calling conventions as the avl/tavl routines.
+ * Every node holds up to BT_ORDER entries, so a lookup touches a few
+ * contiguous arrays instead of chasing one pointer per comparison, and
+ * in-order traversal walks the linked leaves.
+ *
+ * Data pointers live only in the leaves.  An internal node keeps one
+ * child per slot; bt_data[i] (i > 0) is the smallest datum beneath
+ * bt_kids[i], and bt_data[0] is unused.  Separators are the data
+ * pointers themselves, so whenever a datum is deleted every separator
+ * referring to it is recomputed.
+ */
+
+#define BT_ORDER	32
+#define BT_MIN		(BT_ORDER/4)
+
+struct btnode {
+	int		bt_n;		/* data (leaf) or children (internal) */
+	int		bt_leaf;
+	struct btnode	*bt_link[2];	/* leaf siblings, TAVL_DIR_LEFT/RIGHT */
+	void		*bt_data[BT_ORDER];
+	struct btnode	*bt_kids[BT_ORDER];	/* internal nodes only */
+};
+
+#define BT_LEAFSIZE	(offsetof(struct btnode, bt_kids))
+
+static Btree *
+bt_alloc( int leaf )
+{
+	Btree *n;
+
+	n = ber_memalloc( leaf ? BT_LEAFSIZE : sizeof(Btree) );
+	if ( n ) {
+		n->bt_n = 0;
+		n->bt_leaf = leaf;
+		n->bt_link[0] = n->bt_link[1] = NULL;
+	}
+	return n;
+}
+
+/* smallest datum in a subtree */
+static void *
+bt_min( Btree *n )
+{
+	while ( !n->bt_leaf )
+		n = n->bt_kids[0];
+	return n->bt_data[0];
+}
+
+/* index of the first datum >= key in a leaf */
+static int
+bt_leafpos( Btree *n, const void *key, AVL_CMP fcmp, int *match )
+{
+	int lo = 0, hi = n->bt_n, mid, c;
+
+	*match = 0;
+	while ( lo < hi ) {
+		mid = (lo + hi) >> 1;
+		c = (*fcmp)( key, n->bt_data[mid] );
+		if ( c > 0 ) {
+			lo = mid + 1;
+		} else {
+			if ( c == 0 )
+				*match = 1;
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* index of the child of an internal node that would contain key */
+static int
+bt_kidpos( Btree *n, const void *key, AVL_CMP fcmp )
+{
+	int lo = 1, hi = n->bt_n, mid;
+
+	/* find the last separator <= key */
+	while ( lo < hi ) {
+		mid = (lo + hi) >> 1;
+		if ( (*fcmp)( key, n->bt_data[mid] ) >= 0 )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo - 1;
+}
+
+/* insert a datum or a child at pos, shifting the rest up */
+static void
+bt_shift_in( Btree *n, int pos, void *data, Btree *kid )
+{
+	int cnt = n->bt_n - pos;
+
+	if ( cnt > 0 ) {
+		memmove( &n->bt_data[pos+1], &n->bt_data[pos], cnt * sizeof(void *) );
+		if ( !n->bt_leaf )
+			memmove( &n->bt_kids[pos+1], &n->bt_kids[pos], cnt * sizeof(Btree *) );
+	}
+	n->bt_data[pos] = data;
+	if ( !n->bt_leaf )
+		n->bt_kids[pos] = kid;
+	n->bt_n++;
+}
+
+static void
+bt_shift_out( Btree *n, int pos )
+{
+	int cnt = n->bt_n - pos - 1;
+
+	if ( cnt > 0 ) {
+		memmove( &n->bt_data[pos], &n->bt_data[pos+1], cnt * sizeof(void *) );
+		if ( !n->bt_leaf )
+			memmove( &n->bt_kids[pos], &n->bt_kids[pos+1], cnt * sizeof(Btree *) );
+	}
+	n->bt_n--;
+}
+
+/*
+ * Split a full node in half.  Returns the new right sibling, whose
+ * smallest datum is the separator the parent needs.
+ */
+static Btree *
+bt_split( Btree *n )
+{
+	Btree *r;
+	int half = BT_ORDER / 2;
+
+	r = bt_alloc( n->bt_leaf );
+	if ( r == NULL )
+		return NULL;
+	r->bt_n = n->bt_n - half;
+	memcpy( r->bt_data, &n->bt_data[half], r->bt_n * sizeof(void *) );
+	if ( n->bt_leaf ) {
+		r->bt_link[1] = n->bt_link[1];
+		if ( r->bt_link[1] )
+			r->bt_link[1]->bt_link[0] = r;
+		r->bt_link[0] = n;
+		n->bt_link[1] = r;
+	} else {
+		memcpy( r->bt_kids, &n->bt_kids[half], r->bt_n * sizeof(Btree *) );
+	}
+	n->bt_n = half;
+	return r;
+}
+
+static int
+bt_insert( Btree *n, void *data, AVL_CMP fcmp, AVL_DUP fdup, Btree **split )
+{
+	Btree *kid = NULL, *r;
+	int pos, match, rc;
+
+	*split = NULL;
+	if ( n->bt_leaf ) {
+		pos = bt_leafpos( n, data, fcmp, &match );
+		if ( match )
+			return (*fdup)( n->bt_data[pos], data );
+	} else {
+		pos = bt_kidpos( n, data, fcmp );
+		rc = bt_insert( n->bt_kids[pos], data, fcmp, fdup, &kid );
+		if ( rc || kid == NULL )
+			return rc;
+		data = bt_min( kid );
+		pos++;
+	}
+
+	if ( n->bt_n == BT_ORDER ) {
+		r = bt_split( n );
+		if ( r == NULL )
+			return -1;
+		if ( pos > n->bt_n ) {
+			pos -= n->bt_n;
+			n = r;
+		}
+		*split = r;
+	}
+	bt_shift_in( n, pos, data, kid );
+	return 0;
+}
+
+/*
+ * btree_insert -- insert data into the tree at *root.  fcmp and fdup
+ * behave exactly as for avl_insert(): on a duplicate the value returned
+ * by fdup is passed back and the tree is left unchanged.  Returns -1 if
+ * memory could not be allocated.
+ *
+ * NOTE: this routine may malloc memory
+ */
+int
+btree_insert( Btree **root, void *data, AVL_CMP fcmp, AVL_DUP fdup )
+{
+	Btree *split, *nr;
+	int rc;
+
+	if ( *root == NULL ) {
+		if (( *root = bt_alloc( 1 )) == NULL )
+			return -1;
+	}
+
+	rc = bt_insert( *root, data, fcmp, fdup, &split );
+	if ( rc == 0 && split ) {
+		/* grow a new root */
+		if (( nr = bt_alloc( 0 )) == NULL )
+			return -1;
+		nr->bt_n = 2;
+		nr->bt_kids[0] = *root;
+		nr->bt_kids[1] = split;
+		nr->bt_data[1] = bt_min( split );
+		*root = nr;
+	}
+	return rc;
+}
+
+/*
+ * Refill child i of n, which has dropped below BT_MIN entries, by
+ * borrowing from or merging with a neighbour.
+ */
+static void
+bt_rebalance( Btree *n, int i )
+{
+	Btree *l, *r;
+	int li;
+
+	li = ( i + 1 < n->bt_n ) ? i : i - 1;
+	l = n->bt_kids[li];
+	r = n->bt_kids[li+1];
+
+	if ( l->bt_n + r->bt_n <= BT_ORDER ) {
+		/* merge r into l */
+		memcpy( &l->bt_data[l->bt_n], r->bt_data, r->bt_n * sizeof(void *) );
+		if ( l->bt_leaf ) {
+			l->bt_link[1] = r->bt_link[1];
+			if ( l->bt_link[1] )
+				l->bt_link[1]->bt_link[0] = l;
+		} else {
+			memcpy( &l->bt_kids[l->bt_n], r->bt_kids, r->bt_n * sizeof(Btree *) );
+			l->bt_data[l->bt_n] = n->bt_data[li+1];
+		}
+		l->bt_n += r->bt_n;
+		ber_memfree( r );
+		bt_shift_out( n, li+1 );
+		return;
+	}
+
+	if ( l->bt_n < r->bt_n ) {
+		/* move the first entry of r to the end of l */
+		if ( l->bt_leaf ) {
+			l->bt_data[l->bt_n] = r->bt_data[0];
+		} else {
+			l->bt_kids[l->bt_n] = r->bt_kids[0];
+			l->bt_data[l->bt_n] = n->bt_data[li+1];
+		}
+		l->bt_n++;
+		bt_shift_out( r, 0 );
+	} else {
+		/* move the last entry of l to the front of r */
+		l->bt_n--;
+		if ( r->bt_leaf ) {
+			bt_shift_in( r, 0, l->bt_data[l->bt_n], NULL );
+		} else {
+			bt_shift_in( r, 0, NULL, l->bt_kids[l->bt_n] );
+			r->bt_data[1] = n->bt_data[li+1];
+		}
+	}
+	n->bt_data[li+1] = bt_min( r );
+}
+
+static void *
+bt_delete( Btree *n, const void *data, AVL_CMP fcmp )
+{
+	void *del;
+	int pos, match;
+
+	if ( n->bt_leaf ) {
+		pos = bt_leafpos( n, data, fcmp, &match );
+		if ( !match )
+			return NULL;
+		del = n->bt_data[pos];
+		bt_shift_out( n, pos );
+		return del;
+	}
+
+	pos = bt_kidpos( n, data, fcmp );
+	del = bt_delete( n->bt_kids[pos], data, fcmp );
+	if ( del == NULL )
+		return NULL;
+	if ( pos > 0 && n->bt_data[pos] == del )
+		n->bt_data[pos] = bt_min( n->bt_kids[pos] );
+	if ( n->bt_kids[pos]->bt_n < BT_MIN )
+		bt_rebalance( n, pos );
+	return del;
+}
+
+/*
+ * btree_delete -- delete the datum matching data from the tree at *root.
+ * Returns the deleted datum, or NULL if nothing matched.
+ */
+void *
+btree_delete( Btree **root, void *data, AVL_CMP fcmp )
+{
+	Btree *n = *root;
+	void *del;
+
+	if ( n == NULL )
+		return NULL;
+
+	del = bt_delete( n, data, fcmp );
+	if ( del ) {
+		if ( n->bt_leaf && n->bt_n == 0 ) {
+			*root = NULL;
+			ber_memfree( n );
+		} else if ( !n->bt_leaf && n->bt_n == 1 ) {
+			*root = n->bt_kids[0];
+			ber_memfree( n );
+		}
+	}
+	return del;
+}
+
+/*
+ * btree_find -- search the tree for data, using fcmp as for avl_find().
+ */
+void *
+btree_find( Btree *root, const void *data, AVL_CMP fcmp )
+{
+	int pos, match;
+
+	if ( root == NULL )
+		return NULL;
+	while ( !root->bt_leaf )
+		root = root->bt_kids[bt_kidpos( root, data, fcmp )];
+	pos = bt_leafpos( root, data, fcmp, &match );
+	return match ? root->bt_data[pos] : NULL;
+}
+
+/*
+ * btree_find3 -- position cursor on the first datum >= data, or on the
+ * last datum if every datum is smaller.  *ret is set to the result of
+ * comparing data to the returned datum.  Returns NULL for an empty tree.
+ */
+void *
+btree_find3( Btree *root, const void *data, AVL_CMP fcmp, BtreeCursor *bc,
+	int *ret )
+{
+	int pos, match;
+
+	bc->bc_node = NULL;
+	if ( root == NULL )
+		return NULL;
+	while ( !root->bt_leaf )
+		root = root->bt_kids[bt_kidpos( root, data, fcmp )];
+	pos = bt_leafpos( root, data, fcmp, &match );
+	if ( pos == root->bt_n ) {
+		if ( root->bt_link[1] ) {
+			root = root->bt_link[1];
+			pos = 0;
+		} else {
+			pos--;
+		}
+	}
+	bc->bc_node = root;
+	bc->bc_pos = pos;
+	*ret = match ? 0 : (*fcmp)( data, root->bt_data[pos] );
+	return root->bt_data[pos];
+}
+
+/*
+ * btree_end -- position cursor on the first (TAVL_DIR_LEFT) or last
+ * (TAVL_DIR_RIGHT) datum and return it.
+ */
+void *
+btree_end( Btree *root, BtreeCursor *bc, int dir )
+{
+	bc->bc_node = NULL;
+	if ( root == NULL )
+		return NULL;
+	while ( !root->bt_leaf )
+		root = root->bt_kids[dir ? root->bt_n - 1 : 0];
+	bc->bc_node = root;
+	bc->bc_pos = dir ? root->bt_n - 1 : 0;
+	return root->bt_data[bc->bc_pos];
+}
+
+/*
+ * btree_next -- step cursor one datum in the given direction and return
+ * it, or NULL at the end.  A cursor is only valid until the tree is
+ * next modified.
+ */
+void *
+btree_next( BtreeCursor *bc, int dir )
+{
+	Btree *n = bc->bc_node;
+
+	if ( n == NULL )
+		return NULL;
+	if ( dir ) {
+		if ( ++bc->bc_pos >= n->bt_n ) {
+			n = n->bt_link[1];
+			bc->bc_pos = 0;
+		}
+	} else {
+		if ( --bc->bc_pos < 0 ) {
+			n = n->bt_link[0];
+			if ( n )
+				bc->bc_pos = n->bt_n - 1;
+		}
+	}
+	bc->bc_node = n;
+	return n ? n->bt_data[bc->bc_pos] : NULL;
+}
+
+/*
+ * btree_apply -- call fn for each datum in order until it returns
+ * stopflag.  Only in-order traversal is meaningful for a B+tree, so
+ * type is accepted for compatibility with avl_apply() and ignored.
+ * Returns stopflag if fn stopped the walk, AVL_NOMORE otherwise.
+ */
+int
+btree_apply( Btree *root, AVL_APPLY fn, void *arg, int stopflag, int type )
+{
+	int i;
+
+	if ( root == NULL )
+		return AVL_NOMORE;
+	while ( !root->bt_leaf )
+		root = root->bt_kids[0];
+	for ( ; root; root = root->bt_link[1] ) {
+		for ( i = 0; i < root->bt_n; i++ ) {
+			if ( (*fn)( root->bt_data[i], arg ) == stopflag )
+				return stopflag;
+		}
+	}
+	return AVL_NOMORE;
+}
+
+/*
+ * btree_free -- free the tree, calling dfree (if non-NULL) on each
+ * datum.  Returns the number of data freed.
+ */
+int
+btree_free( Btree *root, AVL_FREE dfree )
+{
+	int i, nleft = 0;
+
+	if ( root == NULL )
+		return 0;
+	if ( root->bt_leaf ) {
+		if ( dfree ) {
+			for ( i = 0; i < root->bt_n; i++ )
+				(*dfree)( root->bt_data[i] );
+		}
+		nleft = root->bt_n;
+	} else {
+		for ( i = 0; i < root->bt_n; i++ )
+			nleft += btree_free( root->bt_kids[i], dfree );
+	}
+	ber_memfree( root );
+	return nleft;
+}
@@ -0,0 +1,193 @@
+/* testbtree.c - Test the B+tree code against the AVL code */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2005-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * Usage: testbtree [ops [seed]]
+ *
+ * Does ops random inserts and deletes on a Btree and an Avlnode tree
+ * holding the same data, and checks after each batch that finds,
+ * cursor walks in both directions and btree_apply() agree with the
+ * AVL tree.  Exits non-zero on the first mismatch.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include <ac/stdlib.h>
+#include <ac/string.h>
+#include <ac/time.h>
+
+#define AVL_INTERNAL
+#include "avl.h"
+
+#define NVALS	4096	/* range of values, so inserts and deletes collide */
+#define BATCH	256
+
+static int vals[ NVALS ];
+static int sorted[ NVALS ];
+static int nsorted;
+
+static int
+int_cmp( const void *a, const void *b )
+{
+	int x = *(const int *)a, y = *(const int *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int
+collect( void *data, void *arg )
+{
+	sorted[ nsorted++ ] = *(int *)data;
+	return 0;
+}
+
+static int
+check_apply( void *data, void *arg )
+{
+	int *i = arg;
+
+	if ( *i >= nsorted || sorted[ *i ] != *(int *)data )
+		return -1;
+	(*i)++;
+	return 0;
+}
+
+static void
+fail( const char *what, int val )
+{
+	fprintf( stderr, "testbtree: %s mismatch at %d\n", what, val );
+	exit( EXIT_FAILURE );
+}
+
+/* compare every aspect of bt against the in-order contents of avl */
+static void
+check( Btree *bt, Avlnode *avl )
+{
+	BtreeCursor bc;
+	int i, k, ret, *p;
+
+	nsorted = 0;
+	avl_apply( avl, collect, NULL, -1, AVL_INORDER );
+
+	for ( i = 0, p = btree_end( bt, &bc, TAVL_DIR_LEFT ); p;
+		p = btree_next( &bc, TAVL_DIR_RIGHT ), i++ )
+	{
+		if ( i >= nsorted || *p != sorted[ i ] )
+			fail( "forward walk", i );
+	}
+	if ( i != nsorted )
+		fail( "forward walk length", i );
+
+	for ( i = nsorted - 1, p = btree_end( bt, &bc, TAVL_DIR_RIGHT ); p;
+		p = btree_next( &bc, TAVL_DIR_LEFT ), i-- )
+	{
+		if ( i < 0 || *p != sorted[ i ] )
+			fail( "backward walk", i );
+	}
+	if ( i != -1 )
+		fail( "backward walk length", i );
+
+	i = 0;
+	if ( btree_apply( bt, check_apply, &i, -1, AVL_INORDER ) != AVL_NOMORE
+		|| i != nsorted )
+		fail( "apply", i );
+
+	/* find and find3 for every value, present or not */
+	for ( k = 0, i = 0; k < NVALS; k++ ) {
+		while ( i < nsorted && sorted[ i ] < k )
+			i++;
+		p = btree_find( bt, &vals[ k ], int_cmp );
+		if ( ( p != NULL ) != ( avl_find( avl, &vals[ k ], int_cmp ) != NULL )
+			|| ( p && *p != k ))
+			fail( "find", k );
+
+		p = btree_find3( bt, &vals[ k ], int_cmp, &bc, &ret );
+		if ( nsorted == 0 ) {
+			if ( p )
+				fail( "find3 on empty tree", k );
+			continue;
+		}
+		/* first datum >= k, else the last one */
+		if ( *p != sorted[ i < nsorted ? i : nsorted - 1 ] ||
+			( ret == 0 ) != ( *p == k ) || ( ret < 0 ) != ( k < *p ))
+			fail( "find3", k );
+		if ( i < nsorted ) {
+			p = btree_next( &bc, TAVL_DIR_RIGHT );
+			if ( i + 1 < nsorted ? !p || *p != sorted[ i + 1 ] : p != NULL )
+				fail( "next after find3", k );
+		}
+	}
+}
+
+int
+main( int argc, char **argv )
+{
+	Btree	*bt = NULL;
+	Avlnode	*avl = NULL;
+	int	i, k, ops = 200000;
+	unsigned int seed = time( NULL );
+	int	brc, arc;
+
+	if ( argc > 1 )
+		ops = atoi( argv[1] );
+	if ( argc > 2 )
+		seed = strtoul( argv[2], NULL, 0 );
+	printf( "testbtree: %d ops, seed %u\n", ops, seed );
+	srand( seed );
+
+	for ( i = 0; i < NVALS; i++ )
+		vals[ i ] = i;
+
+	for ( i = 0; i < ops; i++ ) {
+		k = rand() % NVALS;
+		/* bias toward inserts for the first half, deletes after */
+		if ( rand() % 3 == 0 ? i < ops / 2 : i >= ops / 2 ) {
+			brc = btree_delete( &bt, &vals[ k ], int_cmp ) != NULL;
+			arc = avl_delete( &avl, &vals[ k ], int_cmp ) != NULL;
+			if ( brc != arc )
+				fail( "delete", k );
+		} else {
+			brc = btree_insert( &bt, &vals[ k ], int_cmp, avl_dup_error );
+			arc = avl_insert( &avl, &vals[ k ], int_cmp, avl_dup_error );
+			if ( brc != arc )
+				fail( "insert", k );
+		}
+		if ( i % BATCH == BATCH - 1 )
+			check( bt, avl );
+	}
+	check( bt, avl );
+
+	/* empty both trees, checking as they shrink */
+	for ( k = 0; k < NVALS; k++ ) {
+		brc = btree_delete( &bt, &vals[ k ], int_cmp ) != NULL;
+		arc = avl_delete( &avl, &vals[ k ], int_cmp ) != NULL;
+		if ( brc != arc )
+			fail( "delete", k );
+		if ( k % BATCH == BATCH - 1 )
+			check( bt, avl );
+	}
+	check( bt, avl );
+	if ( bt != NULL || avl != NULL )
+		fail( "empty tree", 0 );
+
+	if ( btree_free( bt, NULL ) != 0 || avl_free( avl, NULL ) != 0 )
+		fail( "free", 0 );
+
+	printf( "testbtree: OK\n" );
+	return( 0 );
+}
@@ -224,6 +224,15 @@ struct rewrite_rule {
 	 */
 
 	struct rewrite_subst           *lr_subst;
+
+	/*
+	 * Literal suffix of patterns like "((.+),)?dc=example,[ ]?dc=com$"
+	 * (as generated by suffix massaging), so that the common match
+	 * can be found without running the regex; lr_suffix_last is the
+	 * length of its tail after the last optional space
+	 */
+	struct berval			lr_suffix;
+	ber_len_t			lr_suffix_last;
 	
 #define REWRITE_REGEX_ICASE		REG_ICASE
 #define REWRITE_REGEX_EXTENDED		REG_EXTENDED	
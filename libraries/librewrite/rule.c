@@ -112,6 +112,113 @@ destroy_actions(
 	}
 }
 
+#define REWRITE_SUFFIX_PREFIX	"((.+),)?"
+#define REWRITE_SUFFIX_SPACE	"[ ]?"
+
+/*
+ * Recognizes patterns made of REWRITE_SUFFIX_PREFIX, a literal suffix
+ * with an optional space after each comma, and a trailing '$'.
+ * Helper for rewrite_rule_compile
+ */
+static void
+suffix_compile(
+		struct rewrite_rule *rule,
+		const char *pattern
+)
+{
+	const char *p;
+	char *s;
+	ber_len_t last = 0;
+
+	if ( !( rule->lr_flags & REWRITE_REGEX_EXTENDED )
+			|| strncmp( pattern, REWRITE_SUFFIX_PREFIX,
+				STRLENOF( REWRITE_SUFFIX_PREFIX ) ) != 0 ) {
+		return;
+	}
+
+	p = pattern + STRLENOF( REWRITE_SUFFIX_PREFIX );
+	s = rule->lr_suffix.bv_val = malloc( strlen( p ) + 1 );
+	if ( s == NULL ) {
+		return;
+	}
+
+	for ( ; p[ 0 ] != '$' || p[ 1 ] != '\0'; ) {
+		if ( s > rule->lr_suffix.bv_val && s[ -1 ] == ','
+				&& strncmp( p, REWRITE_SUFFIX_SPACE,
+					STRLENOF( REWRITE_SUFFIX_SPACE ) ) == 0 ) {
+			p += STRLENOF( REWRITE_SUFFIX_SPACE );
+			last = 0;
+			continue;
+		}
+		if ( p[ 0 ] == '\0' || strchr( ".[]()*+?{}|^$\\", p[ 0 ] ) ) {
+			free( rule->lr_suffix.bv_val );
+			rule->lr_suffix.bv_val = NULL;
+			return;
+		}
+		*s++ = *p++;
+		last++;
+	}
+	*s = '\0';
+
+	rule->lr_suffix.bv_len = s - rule->lr_suffix.bv_val;
+	rule->lr_suffix_last = last;
+	if ( last == 0 ) {
+		free( rule->lr_suffix.bv_val );
+		rule->lr_suffix.bv_val = NULL;
+		rule->lr_suffix.bv_len = 0;
+	}
+}
+
+/*
+ * Matches string against a rule compiled by suffix_compile; returns 0
+ * and fills match as regexec would, REG_NOMATCH if the regex cannot
+ * match, or -1 if the regex must be run to tell.
+ */
+static int
+suffix_exec(
+		struct rewrite_rule *rule,
+		const char *string,
+		size_t nmatch,
+		regmatch_t *match
+)
+{
+	int (*cmp)( const char *, const char *, size_t );
+	ber_len_t len = strlen( string ),
+		slen = rule->lr_suffix.bv_len,
+		last = rule->lr_suffix_last;
+	size_t i;
+
+	cmp = ( rule->lr_flags & REWRITE_REGEX_ICASE ) ? strncasecmp : strncmp;
+
+	/* any match ends with the tail after the last optional space */
+	if ( len < last || cmp( string + len - last,
+			rule->lr_suffix.bv_val + slen - last, last ) != 0 ) {
+		return REG_NOMATCH;
+	}
+
+	/* spaces after commas, or a suffix not starting an RDN */
+	if ( len < slen
+			|| cmp( string + len - slen, rule->lr_suffix.bv_val, slen ) != 0
+			|| ( len > slen && ( len < slen + 2
+				|| string[ len - slen - 1 ] != ',' ) ) ) {
+		return -1;
+	}
+
+	for ( i = 0; i < nmatch; i++ ) {
+		match[ i ].rm_so = match[ i ].rm_eo = -1;
+	}
+	match[ 0 ].rm_so = 0;
+	match[ 0 ].rm_eo = len;
+	if ( len > slen ) {
+		match[ 1 ].rm_so = 0;
+		match[ 1 ].rm_eo = len - slen;
+		match[ 2 ].rm_so = 0;
+		match[ 2 ].rm_eo = len - slen - 1;
+	}
+
+	return 0;
+}
+
 /*
  */
 int
@@ -365,6 +472,7 @@ rewrite_rule_compile(
 	rule->lr_mode = mode;
 	rule->lr_max_passes = max_passes;
 	rule->lr_action = first_action;
+	suffix_compile( rule, pattern );
 	
 	/*
 	 * Append rule at the end of the rewrite context
@@ -430,7 +538,13 @@ recurse:;
 	
 	op->lo_num_passes++;
 
-	rc = regexec( &rule->lr_regex, string, nmatch, match, 0 );
+	rc = -1;
+	if ( rule->lr_suffix.bv_val != NULL ) {
+		rc = suffix_exec( rule, string, nmatch, match );
+	}
+	if ( rc == -1 ) {
+		rc = regexec( &rule->lr_regex, string, nmatch, match, 0 );
+	}
 	if ( rc != 0 ) {
 		if ( *result == NULL && string != arg ) {
 			free( string );
@@ -498,6 +612,11 @@ rewrite_rule_destroy(
 		rewrite_subst_destroy( &rule->lr_subst );
 	}
 
+	if ( rule->lr_suffix.bv_val ) {
+		free( rule->lr_suffix.bv_val );
+		rule->lr_suffix.bv_val = NULL;
+	}
+
 	regfree( &rule->lr_regex );
 
 	destroy_actions( rule->lr_action );
@@ -374,6 +374,8 @@ access_allowed_mask(
 	slap_mask_t			mask;
 	slap_access_t			access_level;
 	const char			*attr;
+	struct timeval			tv;
+	int				prof;
 
 	assert( e != NULL );
 	assert( desc != NULL );
@@ -444,6 +446,13 @@ access_allowed_mask(
 	}
 	assert( op->o_bd != NULL );
 
+	/* checks made while evaluating this one count as part of it */
+	if ( op->o_trace.ot_acl_depth++ == 0 )
+		SLAP_OPTRACE_BEGIN( op, tv );
+	else
+		tv.tv_sec = 0;
+	SLAP_PROFILE_ENTER( op, SLAP_PROF_ACL, prof );
+
 	/* this is enforced in backend_add() */
 	if ( op->o_bd->bd_info->bi_access_allowed ) {
 		/* delegate to backend */
@@ -456,6 +465,9 @@ access_allowed_mask(
 		ret = frontendDB->bd_info->bi_access_allowed( op, e,
 				desc, val, access, state, &mask );
 	}
+	SLAP_PROFILE_LEAVE( op, prof );
+	op->o_trace.ot_acl_depth--;
+	SLAP_OPTRACE_END( op, ot_acl, tv );
 
 	if ( !ret ) {
 		if ( ACL_IS_INVALID( mask ) ) {
@@ -489,6 +501,152 @@ done:
 }
 
 
+/*
+ * Per-thread cache of "to" DN clauses known not to match an entry DN.
+ * Reading an entry checks the same ACL list against the same DN once
+ * per attribute and value; with long ACL sets the dn.regex clauses
+ * make up most of that work.  The result only depends on the ACL list
+ * and the normalized DN, so it stays valid until either changes;
+ * slap_acl_gen is bumped whenever an ACL is added or freed.
+ *
+ * While acl_entry_scope() has pinned an entry whose content can't
+ * change, e.g. one being sent as a search result, the results of
+ * the "to filter=" clauses against it are cached too, so an entry
+ * level filter is tested once per entry rather than once per
+ * attribute and value.
+ */
+typedef struct acl_dncache {
+	unsigned long	adc_gen;
+	AccessControl	*adc_head;
+	struct berval	adc_ndn;
+	ber_len_t	adc_ndnsize;
+	int		adc_nbits;
+	unsigned char	*adc_miss;
+	Entry		*adc_scope;
+	int		adc_nfilt;
+	unsigned char	*adc_filt;	/* ACL_FILT_* per ACL position */
+} acl_dncache;
+
+#define ACL_FILT_UNKNOWN	0
+#define ACL_FILT_TRUE		1
+#define ACL_FILT_FALSE		2
+
+static void
+acl_dncache_free( void *key, void *data )
+{
+	acl_dncache *adc = data;
+
+	ch_free( adc->adc_ndn.bv_val );
+	ch_free( adc->adc_miss );
+	ch_free( adc->adc_filt );
+	ch_free( adc );
+}
+
+static acl_dncache *
+acl_dncache_thread( Operation *op )
+{
+	acl_dncache *adc = NULL;
+	void *data = NULL;
+
+	if ( op->o_threadctx == NULL )
+		return NULL;
+
+	if ( ldap_pvt_thread_pool_getkey( op->o_threadctx,
+			(void *)acl_dncache_thread, &data, NULL ) || !data ) {
+		adc = ch_calloc( 1, sizeof( acl_dncache ));
+		if ( ldap_pvt_thread_pool_setkey( op->o_threadctx,
+				(void *)acl_dncache_thread, adc, acl_dncache_free,
+				NULL, NULL )) {
+			ch_free( adc );
+			return NULL;
+		}
+		adc->adc_gen = slap_acl_gen - 1;
+	} else {
+		adc = data;
+	}
+	return adc;
+}
+
+static acl_dncache *
+acl_dncache_get( Operation *op, Entry *e, AccessControl *head )
+{
+	acl_dncache *adc = acl_dncache_thread( op );
+
+	if ( adc == NULL )
+		return NULL;
+
+	if ( adc->adc_gen == slap_acl_gen && adc->adc_head == head &&
+		dn_match( &adc->adc_ndn, &e->e_nname ))
+		return adc;
+
+	if ( adc->adc_ndnsize <= e->e_nname.bv_len ) {
+		adc->adc_ndnsize = e->e_nname.bv_len + 1;
+		adc->adc_ndn.bv_val = ch_realloc( adc->adc_ndn.bv_val,
+			adc->adc_ndnsize );
+	}
+	AC_MEMCPY( adc->adc_ndn.bv_val, e->e_nname.bv_val, e->e_nname.bv_len + 1 );
+	adc->adc_ndn.bv_len = e->e_nname.bv_len;
+	adc->adc_gen = slap_acl_gen;
+	adc->adc_head = head;
+	if ( adc->adc_miss )
+		memset( adc->adc_miss, 0, adc->adc_nbits / 8 );
+	if ( adc->adc_filt )
+		memset( adc->adc_filt, ACL_FILT_UNKNOWN, adc->adc_nfilt );
+
+	return adc;
+}
+
+/*
+ * Pin e as the entry whose ACL filter results may be cached by this
+ * thread, or drop the pin with e == NULL. The caller guarantees that
+ * e is neither modified nor freed until the pin is dropped.
+ */
+void
+acl_entry_scope( Operation *op, Entry *e )
+{
+	acl_dncache *adc = acl_dncache_thread( op );
+
+	if ( adc == NULL )
+		return;
+
+	adc->adc_scope = e;
+	if ( adc->adc_filt )
+		memset( adc->adc_filt, ACL_FILT_UNKNOWN, adc->adc_nfilt );
+}
+
+static void
+acl_dncache_set_filt( acl_dncache *adc, int n, int match )
+{
+	if ( n >= adc->adc_nfilt ) {
+		int nfilt = adc->adc_nfilt ? adc->adc_nfilt : 64;
+
+		while ( nfilt <= n ) nfilt <<= 1;
+		adc->adc_filt = ch_realloc( adc->adc_filt, nfilt );
+		memset( adc->adc_filt + adc->adc_nfilt, ACL_FILT_UNKNOWN,
+			nfilt - adc->adc_nfilt );
+		adc->adc_nfilt = nfilt;
+	}
+	adc->adc_filt[n] = match ? ACL_FILT_TRUE : ACL_FILT_FALSE;
+}
+
+#define ACL_DNCACHE_MISS(adc, n) \
+	((n) < (adc)->adc_nbits && ((adc)->adc_miss[(n) >> 3] & (1 << ((n) & 7))))
+
+static void
+acl_dncache_set_miss( acl_dncache *adc, int n )
+{
+	if ( n >= adc->adc_nbits ) {
+		int nbits = adc->adc_nbits ? adc->adc_nbits : 64;
+
+		while ( nbits <= n ) nbits <<= 1;
+		adc->adc_miss = ch_realloc( adc->adc_miss, nbits / 8 );
+		memset( adc->adc_miss + adc->adc_nbits / 8, 0,
+			( nbits - adc->adc_nbits ) / 8 );
+		adc->adc_nbits = nbits;
+	}
+	adc->adc_miss[n >> 3] |= 1 << ( n & 7 );
+}
+
 /*
  * slap_acl_get - return the acl applicable to entry e, attribute
  * attr.  the acl returned is suitable for use in subsequent calls to
@@ -510,6 +668,7 @@ slap_acl_get(
 	const char *attr;
 	ber_len_t dnlen;
 	AccessControl *prev;
+	acl_dncache *adc;
 
 	assert( e != NULL );
 	assert( count != NULL );
@@ -537,6 +696,8 @@ slap_acl_get(
 	}
 
 	dnlen = e->e_nname.bv_len;
+	adc = acl_dncache_get( op, e, ( op->o_bd && op->o_bd->be_acl ) ?
+		op->o_bd->be_acl : frontendDB->be_acl );
 
  retry:
 	for ( ; a != NULL; prev = a, a = a->acl_next ) {
@@ -546,6 +707,9 @@ slap_acl_get(
 			state->as_fe_done++;
 
 		if ( a->acl_dn_pat.bv_len || ( a->acl_dn_style != ACL_STYLE_REGEX )) {
+			if ( adc && ACL_DNCACHE_MISS( adc, *count ))
+				continue;
+
 			if ( a->acl_dn_style == ACL_STYLE_REGEX ) {
 				Debug( LDAP_DEBUG_ACL, "=> dnpat: [%d] %s nsub: %d\n", 
 					*count, a->acl_dn_pat.bv_val, (int) a->acl_dn_re.re_nsub );
@@ -553,7 +717,10 @@ slap_acl_get(
 					       e->e_ndn, 
 				 	       matches->dn_count, 
 					       matches->dn_data, 0 ) )
+				{
+					if ( adc ) acl_dncache_set_miss( adc, *count );
 					continue;
+				}
 
 			} else {
 				ber_len_t patlen;
@@ -694,7 +861,19 @@ slap_acl_get(
 		}
 
 		if ( a->acl_filter != NULL ) {
-			ber_int_t rc = test_filter( NULL, e, a->acl_filter );
+			ber_int_t rc;
+
+			if ( adc && adc->adc_scope == e && *count < adc->adc_nfilt &&
+				adc->adc_filt[*count] != ACL_FILT_UNKNOWN )
+			{
+				rc = adc->adc_filt[*count] == ACL_FILT_TRUE ?
+					LDAP_COMPARE_TRUE : LDAP_COMPARE_FALSE;
+			} else {
+				rc = test_filter( NULL, e, a->acl_filter );
+				if ( adc && adc->adc_scope == e )
+					acl_dncache_set_filt( adc, *count,
+						rc == LDAP_COMPARE_TRUE );
+			}
 			if ( rc != LDAP_COMPARE_TRUE ) {
 				continue;
 			}
@@ -2160,8 +2339,8 @@ acl_set_cb_gather( Operation *op, SlapReply *rs )
 	return 0;
 }
 
-BerVarray
-acl_set_gather( SetCookie *cookie, struct berval *name, AttributeDescription *desc )
+static BerVarray
+acl_set_gather_url( SetCookie *cookie, struct berval *name, AttributeDescription *desc )
 {
 	AclSetCookie		*cp = (AclSetCookie *)cookie;
 	int			rc = 0;
@@ -2173,14 +2352,6 @@ acl_set_gather( SetCookie *cookie, struct berval *name, AttributeDescription *de
 	slap_callback		cb = { NULL, acl_set_cb_gather, NULL, NULL };
 	acl_set_gather_t	p = { 0 };
 
-	/* this routine needs to return the bervals instead of
-	 * plain strings, since syntax is not known.  It should
-	 * also return the syntax or some "comparison cookie".
-	 */
-	if ( strncasecmp( name->bv_val, "ldap:///", STRLENOF( "ldap:///" ) ) != 0 ) {
-		return acl_set_gather2( cookie, name, desc );
-	}
-
 	rc = ldap_url_parse( name->bv_val, &ludp );
 	if ( rc != LDAP_URL_SUCCESS ) {
 		Debug( LDAP_DEBUG_TRACE,
@@ -2326,6 +2497,109 @@ url_done:;
 	return p.bvals;
 }
 
+/*
+ * Gathering runs as the rootdn, or without access checks, so what is
+ * gathered doesn't depend on who asked: the results are remembered in
+ * op->o_sets for the rest of the operation and, with conn_set_cache,
+ * in the connection until the next local write (backend_group_gen()).
+ * Names matching the target entry are not remembered, as the entry
+ * may be one being added or modified.
+ */
+BerVarray
+acl_set_gather( SetCookie *cookie, struct berval *name, AttributeDescription *desc )
+{
+	AclSetCookie	*cp = (AclSetCookie *)cookie;
+	Operation	*op = cp->asc_op;
+	Connection	*conn = NULL;
+	SetAssertion	*sa;
+	BerVarray	bvals = NULL;
+	unsigned long	gen = backend_group_gen();
+	int		url;
+
+	/* this routine needs to return the bervals instead of
+	 * plain strings, since syntax is not known.  It should
+	 * also return the syntax or some "comparison cookie".
+	 */
+	url = strncasecmp( name->bv_val, "ldap:///", STRLENOF( "ldap:///" ) ) == 0;
+
+	if ( op->o_tag == LDAP_REQ_BIND || op->o_do_not_cache ||
+		( !url && ( desc == slap_schema.si_ad_entryDN ||
+			( cp->asc_e && bvmatch( name, &cp->asc_e->e_nname )))))
+	{
+		goto gather;
+	}
+
+	for ( sa = op->o_sets; sa; sa = sa->sa_next ) {
+		if ( sa->sa_desc == desc && sa->sa_len == name->bv_len &&
+			memcmp( sa->sa_name, name->bv_val, name->bv_len ) == 0 )
+		{
+			ber_bvarray_dup_x( &bvals, sa->sa_vals, op->o_tmpmemctx );
+			return bvals;
+		}
+	}
+
+	if ( slap_conn_set_cache > 0 && op->o_conn &&
+		op->o_conn->c_conn_idx >= 0 && op->o_tag != LDAP_REQ_ADD )
+	{
+		conn = op->o_conn;
+		ldap_pvt_thread_mutex_lock( &conn->c_groups_mutex );
+		for ( sa = conn->c_sets; sa; sa = sa->sa_next ) {
+			if ( sa->sa_desc == desc && sa->sa_gen == gen &&
+				sa->sa_len == name->bv_len &&
+				memcmp( sa->sa_name, name->bv_val, name->bv_len ) == 0 )
+			{
+				ber_bvarray_dup_x( &bvals, sa->sa_vals, op->o_tmpmemctx );
+				break;
+			}
+		}
+		ldap_pvt_thread_mutex_unlock( &conn->c_groups_mutex );
+		if ( sa ) goto remember;
+	}
+
+	bvals = url ? acl_set_gather_url( cookie, name, desc ) :
+		acl_set_gather2( cookie, name, desc );
+
+	if ( conn ) {
+		ldap_pvt_thread_mutex_lock( &conn->c_groups_mutex );
+		if ( conn->c_nsets >= slap_conn_set_cache ||
+			( conn->c_sets && conn->c_sets->sa_gen != gen ))
+		{
+			connection_sets_free( conn );
+		}
+		sa = ch_malloc( sizeof( SetAssertion ) + name->bv_len );
+		sa->sa_desc = desc;
+		sa->sa_gen = gen;
+		sa->sa_len = name->bv_len;
+		AC_MEMCPY( sa->sa_name, name->bv_val, name->bv_len );
+		sa->sa_name[ name->bv_len ] = '\0';
+		sa->sa_vals = NULL;
+		ber_bvarray_dup_x( &sa->sa_vals, bvals, NULL );
+		sa->sa_next = conn->c_sets;
+		conn->c_sets = sa;
+		conn->c_nsets++;
+		ldap_pvt_thread_mutex_unlock( &conn->c_groups_mutex );
+	}
+
+remember:;
+	sa = op->o_tmpalloc( sizeof( SetAssertion ) + name->bv_len,
+		op->o_tmpmemctx );
+	sa->sa_desc = desc;
+	sa->sa_gen = gen;
+	sa->sa_len = name->bv_len;
+	AC_MEMCPY( sa->sa_name, name->bv_val, name->bv_len );
+	sa->sa_name[ name->bv_len ] = '\0';
+	sa->sa_vals = NULL;
+	ber_bvarray_dup_x( &sa->sa_vals, bvals, op->o_tmpmemctx );
+	sa->sa_next = op->o_sets;
+	op->o_sets = sa;
+
+	return bvals;
+
+gather:;
+	return url ? acl_set_gather_url( cookie, name, desc ) :
+		acl_set_gather2( cookie, name, desc );
+}
+
 BerVarray
 acl_set_gather2( SetCookie *cookie, struct berval *name, AttributeDescription *desc )
 {
@@ -76,6 +76,95 @@ static int msad_range_hack = 0;
 
 static int ad_count;
 
+/*
+ * Cache of attribute descriptions by the string they were requested
+ * as, so repeated names skip the type lookup and option parsing.
+ * A slot is filled once and only emptied by ad_cache_flush(), which
+ * runs while the server is paused or not yet serving, so lookups
+ * take no lock.  Names that don't fit in their probe window simply
+ * take the slow path.
+ */
+#define AD_CACHE_SIZE	1024	/* must be a power of 2 */
+#define AD_CACHE_PROBES	4
+
+typedef struct ad_cache_entry {
+	AttributeDescription	*ace_ad;
+	ber_len_t		ace_len;
+	char			ace_name[1];
+} ad_cache_entry;
+
+static ad_cache_entry *ad_cache[AD_CACHE_SIZE];
+
+static unsigned
+ad_cache_hash( struct berval *bv )
+{
+	unsigned h = 5381;
+	ber_len_t i;
+
+	for ( i = 0; i < bv->bv_len; i++ )
+		h = ( h << 5 ) + h + TOLOWER( (unsigned char) bv->bv_val[i] );
+	return h;
+}
+
+static AttributeDescription *
+ad_cache_find( struct berval *bv, unsigned h )
+{
+	ad_cache_entry *ace;
+	int i;
+
+	for ( i = 0; i < AD_CACHE_PROBES; i++ ) {
+		ace = ad_cache[( h + i ) & ( AD_CACHE_SIZE - 1 )];
+		if ( ace == NULL )
+			break;
+		if ( ace->ace_len == bv->bv_len &&
+			strncasecmp( ace->ace_name, bv->bv_val, bv->bv_len ) == 0 )
+			return ace->ace_ad;
+	}
+	return NULL;
+}
+
+static void
+ad_cache_add( struct berval *bv, unsigned h, AttributeDescription *ad )
+{
+	ad_cache_entry *ace;
+	int i;
+
+	ldap_pvt_thread_mutex_lock( &ad_index_mutex );
+	for ( i = 0; i < AD_CACHE_PROBES; i++ ) {
+		ad_cache_entry **slot = &ad_cache[( h + i ) & ( AD_CACHE_SIZE - 1 )];
+
+		if ( *slot == NULL ) {
+			ace = ch_malloc( sizeof( ad_cache_entry ) + bv->bv_len );
+			ace->ace_ad = ad;
+			ace->ace_len = bv->bv_len;
+			AC_MEMCPY( ace->ace_name, bv->bv_val, bv->bv_len );
+			ace->ace_name[bv->bv_len] = '\0';
+			*slot = ace;
+			break;
+		}
+		if ( (*slot)->ace_len == bv->bv_len &&
+			strncasecmp( (*slot)->ace_name, bv->bv_val, bv->bv_len ) == 0 )
+			break;
+	}
+	ldap_pvt_thread_mutex_unlock( &ad_index_mutex );
+}
+
+/* Called when types or options go away; the caller must ensure no
+ * other thread is in slap_bv2ad().
+ */
+void
+ad_cache_flush( void )
+{
+	int i;
+
+	for ( i = 0; i < AD_CACHE_SIZE; i++ ) {
+		if ( ad_cache[i] ) {
+			ch_free( ad_cache[i] );
+			ad_cache[i] = NULL;
+		}
+	}
+}
+
 static Attr_option *ad_find_option_definition( const char *opt, int optlen );
 
 int ad_keystring(
@@ -167,6 +256,7 @@ int slap_bv2ad(
 	char *opt, *next;
 	int ntags;
 	int tagslen;
+	unsigned hash;
 
 	/* hardcoded limits for speed */
 #define MAX_TAGGING_OPTIONS 128
@@ -182,6 +272,11 @@ int slap_bv2ad(
 		return rtn;
 	}
 
+	hash = ad_cache_hash( bv );
+	d2 = ad_cache_find( bv, hash );
+	if ( d2 != NULL )
+		goto found;
+
 	/* make sure description is IA5 */
 	if( ad_keystring( bv ) ) {
 		*text = "AttributeDescription contains inappropriate characters";
@@ -451,6 +546,9 @@ done:;
 		ldap_pvt_thread_mutex_unlock( &desc.ad_type->sat_ad_mutex );
 	}
 
+	ad_cache_add( bv, hash, d2 );
+
+found:
 	if( *ad == NULL ) {
 		*ad = d2;
 	} else {
@@ -1197,6 +1295,8 @@ ad_define_option( const char *name, const char *fname, int lineno )
 	int i;
 	unsigned int optlen;
 
+	ad_cache_flush();
+
 	if ( options == &lang_option ) {
 		options = NULL;
 		option_count = 0;
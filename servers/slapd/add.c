@@ -340,6 +340,8 @@ fe_op_add( Operation *op, SlapReply *rs )
 			rc = op->o_bd->be_add( op, rs );
 			if ( rc == LDAP_SUCCESS ) {
 				OpExtra *oex;
+
+				slap_sasl_cache_update( op );
 				/* NOTE: be_entry_release_w() is
 				 * called by do_add(), so that global
 				 * overlays on the way back can
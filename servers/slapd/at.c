@@ -79,6 +79,7 @@ static LDAP_STAILQ_HEAD(ATList, AttributeType) attr_list
 
 /* Last hardcoded attribute registered */
 AttributeType *at_sys_tail;
+static unsigned at_nindex;	/* last sat_index handed out */
 
 int at_oc_cache;
 
@@ -258,6 +259,7 @@ at_delete( AttributeType *at )
 	LDAP_STAILQ_REMOVE(&attr_list, at, AttributeType, sat_next);
 
 	at_delete_names( at );
+	ad_cache_flush();
 }
 
 static void
@@ -318,6 +320,8 @@ at_destroy( void )
 {
 	AttributeType *a;
 
+	ad_cache_flush();
+
 	while( !LDAP_STAILQ_EMPTY(&attr_list) ) {
 		a = LDAP_STAILQ_FIRST(&attr_list);
 		LDAP_STAILQ_REMOVE_HEAD(&attr_list, sat_next);
@@ -470,6 +474,7 @@ at_insert(
 				/* Keep old oid, free new oid;
 				 * Keep old ads, free new ads;
 				 * Keep old ad_mutex, free new ad_mutex;
+				 * Keep old index, classes' atmaps use it;
 				 * Keep new everything else, free old
 				 */
 				tmp = *old_sat;
@@ -480,6 +485,7 @@ at_insert(
 				tmp.sat_ad = sat->sat_ad;
 				old_sat->sat_ad_mutex = tmp.sat_ad_mutex;
 				tmp.sat_ad_mutex = sat->sat_ad_mutex;
+				old_sat->sat_index = tmp.sat_index;
 				*sat = tmp;
 
 				/* Check for basic ad pointing at old cname */
@@ -496,6 +502,10 @@ at_insert(
 				air = air_old;
 				sat = old_sat;
 				*rat = sat;
+
+				/* the definition has changed in place even if
+				 * adding its names fails below */
+				slap_dn_cache_flush();
 			} else {
 				ldap_memfree( air );
 
@@ -572,6 +582,12 @@ at_insert(
 		}
 	}
 
+	/* DNs using this type may have been cached in their raw form */
+	slap_dn_cache_flush();
+
+	if ( !sat->sat_index )
+		sat->sat_index = ++at_nindex;
+
 	if ( sat->sat_flags & SLAP_AT_HARDCODE ) {
 		prev = at_sys_tail;
 		at_sys_tail = sat;
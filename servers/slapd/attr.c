@@ -647,6 +647,21 @@ attrs_find(
     Attribute	*a,
 	AttributeDescription *desc )
 {
+	/* Most descriptions have no subtypes, tags or flags; then only
+	 * attributes of the same type can match and is_ad_subtype() need
+	 * not be called for every attribute of a wide entry.
+	 */
+	if ( desc->ad_type->sat_subtypes == NULL &&
+		desc->ad_tags.bv_len == 0 && desc->ad_flags == 0 )
+	{
+		for ( ; a != NULL; a = a->a_next ) {
+			if ( a->a_desc->ad_type == desc->ad_type ) {
+				return( a );
+			}
+		}
+		return( NULL );
+	}
+
 	for ( ; a != NULL; a = a->a_next ) {
 		if ( is_ad_subtype( a->a_desc, desc ) ) {
 			return( a );
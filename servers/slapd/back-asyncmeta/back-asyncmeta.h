@@ -189,6 +189,14 @@ struct a_metatarget_t;
 #define	META_BINDING			((ber_tag_t)0x2)
 #define	META_RETRYING			((ber_tag_t)0x4)
 
+struct bm_context_t;
+
+/* msgid index entry, one per target, see msc_msgtree */
+typedef struct bm_msgid_t {
+	ber_int_t		bm_msgid;
+	struct bm_context_t	*bm_bc;	/* NULL if not indexed */
+} bm_msgid_t;
+
 typedef struct bm_context_t {
 	LDAP_SLIST_ENTRY(bm_context_t) bc_next;
 	time_t			timeout;
@@ -204,6 +212,7 @@ typedef struct bm_context_t {
 	Operation		*op;
 	LDAPControl	        **ctrls;
 	int                     *msgids;
+	bm_msgid_t              *bc_msgnodes;
 	SlapReply               *candidates;
 } bm_context_t;
 
@@ -234,6 +243,9 @@ typedef struct a_metasingleconn_t {
 #define	lc_lcflags		msc_mscflags
 	int msc_pending_ops;
 	int msc_timeout_ops;
+	/* pending requests by msgid on this target,
+	 * protected by mc_om_mutex */
+	Avlnode			*msc_msgtree;
 		/* Connection for the select */
 	Connection *conn;
 } a_metasingleconn_t;
@@ -724,6 +736,8 @@ void asyncmeta_clear_bm_context(bm_context_t *bc);
 
 int asyncmeta_add_message_queue(a_metaconn_t *mc, bm_context_t *bc);
 void asyncmeta_drop_bc(a_metaconn_t *mc, bm_context_t *bc);
+void asyncmeta_index_bc(a_metaconn_t *mc, bm_context_t *bc, int candidate);
+void asyncmeta_unindex_bc(a_metaconn_t *mc, bm_context_t *bc);
 
 bm_context_t *
 asyncmeta_find_message(ber_int_t msgid, a_metaconn_t *mc, int candidate);
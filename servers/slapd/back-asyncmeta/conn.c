@@ -1318,6 +1318,7 @@ int asyncmeta_start_one_listener(a_metaconn_t *mc,
 		return LDAP_SUCCESS;
 	}
 	bc->msgids[candidate] = candidates[candidate].sr_msgid;
+	asyncmeta_index_bc(mc, bc, candidate);
 	msc->msc_pending_ops++;
 	if ( msc->conn == NULL) {
 		ldap_get_option( msc->msc_ld, LDAP_OPT_DESC, &s );
@@ -350,6 +350,7 @@ asyncmeta_back_clear_miconns( a_metainfo_t *mi )
 		/* todo clear the message queue */
 		for (j = 0; j < mi->mi_ntargets; j ++) {
 			asyncmeta_clear_one_msc(NULL, mc, j);
+			avl_free(mc->mc_conns[j].msc_msgtree, NULL);
 		}
 		free(mc->mc_conns);
 		ldap_pvt_thread_mutex_destroy( &mc->mc_om_mutex );
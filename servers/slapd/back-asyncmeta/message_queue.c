@@ -291,6 +291,7 @@ int asyncmeta_new_bm_context(Operation *op, SlapReply *rs, bm_context_t **new_bc
 	(*new_bc)->op = asyncmeta_copy_op(op);
 	(*new_bc)->candidates = op->o_tmpcalloc(ntargets, sizeof(SlapReply),op->o_tmpmemctx);
 	(*new_bc)->msgids = op->o_tmpcalloc(ntargets, sizeof(int),op->o_tmpmemctx);
+	(*new_bc)->bc_msgnodes = op->o_tmpcalloc(ntargets, sizeof(bm_msgid_t),op->o_tmpmemctx);
 	for (i = 0; i < ntargets; i++) {
 		(*new_bc)->msgids[i] = META_MSGID_UNDEFINED;
 	}
@@ -505,11 +506,73 @@ int asyncmeta_add_message_queue(a_metaconn_t *mc, bm_context_t *bc)
 	return LDAP_SUCCESS;
 }
 
+static int
+asyncmeta_msgid_cmp( const void *c1, const void *c2 )
+{
+	const bm_msgid_t *m1 = c1, *m2 = c2;
+
+	return m1->bm_msgid < m2->bm_msgid ? -1 : m1->bm_msgid > m2->bm_msgid;
+}
+
+static void
+asyncmeta_unindex_one(a_metaconn_t *mc, bm_context_t *bc, int candidate)
+{
+	bm_msgid_t *bm = &bc->bc_msgnodes[candidate];
+	Avlnode **root = &mc->mc_conns[candidate].msc_msgtree;
+
+	if (bm->bm_bc == NULL) {
+		return;
+	}
+	/* the msgid may have been taken over by a newer request */
+	if (avl_find(*root, bm, asyncmeta_msgid_cmp) == bm) {
+		avl_delete(root, bm, asyncmeta_msgid_cmp);
+	}
+	bm->bm_bc = NULL;
+}
+
+/* Index bc under its current msgid on the given target, so that
+ * asyncmeta_find_message() doesn't have to walk the whole queue.
+ * Must be called with mc_om_mutex held.
+ */
+void
+asyncmeta_index_bc(a_metaconn_t *mc, bm_context_t *bc, int candidate)
+{
+	bm_msgid_t *bm = &bc->bc_msgnodes[candidate];
+	Avlnode **root = &mc->mc_conns[candidate].msc_msgtree;
+
+	asyncmeta_unindex_one(mc, bc, candidate);
+	if (bc->msgids[candidate] < 0) {
+		return;
+	}
+
+	bm->bm_msgid = bc->msgids[candidate];
+	bm->bm_bc = bc;
+	if (avl_insert(root, bm, asyncmeta_msgid_cmp, avl_dup_error)) {
+		/* a stale request left over from a previous connection
+		 * to the target; the new one wins */
+		bm_msgid_t *old = avl_delete(root, bm, asyncmeta_msgid_cmp);
+		old->bm_bc = NULL;
+		avl_insert(root, bm, asyncmeta_msgid_cmp, avl_dup_error);
+	}
+}
+
+void
+asyncmeta_unindex_bc(a_metaconn_t *mc, bm_context_t *bc)
+{
+	int i;
+
+	for (i = 0; i < mc->mc_info->mi_ntargets; i++) {
+		asyncmeta_unindex_one(mc, bc, i);
+	}
+}
+
 void
 asyncmeta_drop_bc(a_metaconn_t *mc, bm_context_t *bc)
 {
 	bm_context_t *om;
 	int i;
+
+	asyncmeta_unindex_bc(mc, bc);
 	LDAP_SLIST_FOREACH( om, &mc->mc_om_list, bc_next ) {
 		if (om == bc) {
 			for (i = 0; i < mc->mc_info->mi_ntargets; i++)
@@ -529,6 +592,15 @@ bm_context_t *
 asyncmeta_find_message(ber_int_t msgid, a_metaconn_t *mc, int candidate)
 {
 	bm_context_t *om;
+	bm_msgid_t bm, *found;
+
+	bm.bm_msgid = msgid;
+	found = avl_find(mc->mc_conns[candidate].msc_msgtree, &bm, asyncmeta_msgid_cmp);
+	if (found && found->bm_bc->candidates[candidate].sr_msgid == msgid) {
+		return found->bm_bc;
+	}
+
+	/* not indexed yet, e.g. a bind or a retried request */
 	LDAP_SLIST_FOREACH( om, &mc->mc_om_list, bc_next ) {
 		if (om->candidates[candidate].sr_msgid == msgid) {
 			break;
@@ -549,6 +621,7 @@ asyncmeta_find_message_by_opmsguid (ber_int_t msgid, a_metaconn_t *mc, int remov
 		}
 	}
 	if (remove && om) {
+		asyncmeta_unindex_bc(mc, om);
 		LDAP_SLIST_REMOVE(&mc->mc_om_list, om, bm_context_t, bc_next);
 		mc->pending_ops--;
 	}
@@ -1699,6 +1699,7 @@ void* asyncmeta_timeout_loop(void *ctx, void *arg)
 				SlapReply *rs = &bc->rs;
 				int		timeout_err;
 				const char *timeout_text;
+				asyncmeta_unindex_bc(mc, bc);
 				LDAP_SLIST_REMOVE(&mc->mc_om_list, bc, bm_context_t, bc_next);
 				mc->pending_ops--;
 
@@ -261,6 +261,9 @@ typedef struct ldapinfo_t {
 	/* hack because when TLS is used we need to lock and let 
 	 * the li_urllist_f function to know it's locked */
 	int			li_uri_mutex_do_not_lock;
+	/* li_uri_next: where the next connection starts in li_bvuri
+	 * when "uri-balance" is set; protected by li_uri_mutex */
+	unsigned		li_uri_next;
 
 	LDAP_REBIND_PROC	*li_rebind_f;
 	LDAP_URLLIST_PROC	*li_urllist_f;
@@ -336,6 +339,7 @@ typedef struct ldapinfo_t {
 #define LDAP_BACK_F_OMIT_UNKNOWN_SCHEMA (0x00200000U)
 
 #define LDAP_BACK_F_ONERR_STOP		(0x00200000U)
+#define LDAP_BACK_F_URI_BALANCE		(0x00400000U)
 
 #define	LDAP_BACK_ISSET_F(ff,f)		( ( (ff) & (f) ) == (f) )
 #define	LDAP_BACK_ISMASK_F(ff,m,f)	( ( (ff) & (m) ) == (f) )
@@ -379,6 +383,7 @@ typedef struct ldapinfo_t {
 #define	LDAP_BACK_NOUNDEFFILTER(li)	LDAP_BACK_ISSET( (li), LDAP_BACK_F_NOUNDEFFILTER)
 #define	LDAP_BACK_OMIT_UNKNOWN_SCHEMA(li)		LDAP_BACK_ISSET( (li), LDAP_BACK_F_OMIT_UNKNOWN_SCHEMA)
 #define	LDAP_BACK_ONERR_STOP(li)	LDAP_BACK_ISSET( (li), LDAP_BACK_F_ONERR_STOP)
+#define	LDAP_BACK_URI_BALANCE(li)	LDAP_BACK_ISSET( (li), LDAP_BACK_F_URI_BALANCE)
 
 	int			li_version;
 
@@ -659,11 +659,46 @@ ldap_back_start_tls(
 }
 #endif /* HAVE_TLS */
 
+/*
+ * ldap_back_balance_uri
+ *
+ * returns the URI list rotated so that it starts with the server
+ * after the one the previous new connection started with; the
+ * remaining URIs are still tried in order if that fails.
+ * Must be called with li_uri_mutex held.
+ */
+static char *
+ldap_back_balance_uri( ldapinfo_t *li )
+{
+	int		i, n;
+	ber_len_t	len = 0;
+	char		*uri, *ptr;
+
+	for ( n = 0; !BER_BVISNULL( &li->li_bvuri[ n ] ); n++ ) {
+		len += li->li_bvuri[ n ].bv_len + STRLENOF( " " );
+	}
+
+	uri = ptr = ch_malloc( len );
+	for ( i = 0; i < n; i++ ) {
+		struct berval	*bv = &li->li_bvuri[ ( li->li_uri_next + i ) % n ];
+
+		if ( i ) {
+			*ptr++ = ' ';
+		}
+		ptr = lutil_strncopy( ptr, bv->bv_val, bv->bv_len );
+	}
+	*ptr = '\0';
+	li->li_uri_next = ( li->li_uri_next + 1 ) % n;
+
+	return uri;
+}
+
 static int
 ldap_back_prepare_conn( ldapconn_t *lc, Operation *op, SlapReply *rs, ldap_back_send_t sendok )
 {
 	ldapinfo_t	*li = (ldapinfo_t *)op->o_bd->be_private;
 	int		version;
+	int		balanced = 0;
 	LDAP		*ld = NULL;
 #ifdef HAVE_TLS
 	int		is_tls = op->o_conn->c_is_tls;
@@ -673,13 +708,26 @@ ldap_back_prepare_conn( ldapconn_t *lc, Operation *op, SlapReply *rs, ldap_back_
 #endif /* HAVE_TLS */
 
 	ldap_pvt_thread_mutex_lock( &li->li_uri_mutex );
-	rs->sr_err = ldap_initialize( &ld, li->li_uri );
+	if ( LDAP_BACK_URI_BALANCE( li ) && li->li_bvuri != NULL
+		&& !BER_BVISNULL( &li->li_bvuri[ 0 ] )
+		&& !BER_BVISNULL( &li->li_bvuri[ 1 ] ) )
+	{
+		char	*uri = ldap_back_balance_uri( li );
+
+		balanced = 1;
+		rs->sr_err = ldap_initialize( &ld, uri );
+		ch_free( uri );
+
+	} else {
+		rs->sr_err = ldap_initialize( &ld, li->li_uri );
+	}
 	ldap_pvt_thread_mutex_unlock( &li->li_uri_mutex );
 	if ( rs->sr_err != LDAP_SUCCESS ) {
 		goto error_return;
 	}
 
-	if ( li->li_urllist_f ) {
+	/* when balancing, don't let a successful connect reorder li_uri */
+	if ( li->li_urllist_f && !balanced ) {
 		ldap_set_urllist_proc( ld, li->li_urllist_f, li->li_urllist_p );
 	}
 
@@ -908,13 +956,22 @@ ldap_back_getconn(
 retry_lock:
 		ldap_pvt_thread_mutex_lock( &li->li_conninfo.lai_mutex );
 		if ( LDAP_BACK_PCONN_ISPRIV( &lc_curr ) ) {
-			/* lookup a conn that's not binding */
+			ldapconn_t	*lc_min = NULL;
+
+			/* lookup a conn that's not binding; remember the least
+			 * busy one in case the pool is full and a conn must be
+			 * shared */
 			LDAP_TAILQ_FOREACH( lc,
 				&li->li_conn_priv[ LDAP_BACK_CONN2PRIV( &lc_curr ) ].lic_priv,
 				lc_q )
 			{
-				if ( !LDAP_BACK_CONN_BINDING( lc ) && lc->lc_refcnt == 0 ) {
-					break;
+				if ( !LDAP_BACK_CONN_BINDING( lc ) ) {
+					if ( lc->lc_refcnt == 0 ) {
+						break;
+					}
+					if ( lc_min == NULL || lc->lc_refcnt < lc_min->lc_refcnt ) {
+						lc_min = lc;
+					}
 				}
 			}
 
@@ -932,7 +989,12 @@ retry_lock:
 			} else if ( !LDAP_BACK_USE_TEMPORARIES( li )
 				&& li->li_conn_priv[ LDAP_BACK_CONN2PRIV( &lc_curr ) ].lic_num == li->li_conn_priv_max )
 			{
-				lc = LDAP_TAILQ_FIRST( &li->li_conn_priv[ LDAP_BACK_CONN2PRIV( &lc_curr ) ].lic_priv );
+				/* spread the outstanding operations over the pool
+				 * rather than piling them all onto its first conn */
+				lc = lc_min;
+				if ( lc == NULL ) {
+					lc = LDAP_TAILQ_FIRST( &li->li_conn_priv[ LDAP_BACK_CONN2PRIV( &lc_curr ) ].lic_priv );
+				}
 			}
 			
 		} else {
@@ -393,6 +393,90 @@ retry:;
 	return SLAP_CB_CONTINUE;
 }
 
+/*
+ * Selects the slapd-ldap instance to chain to the given URI,
+ * by looking it up in the tree or by instantiating a new one.
+ * New instances are added to the tree when chain-cache-uri is set,
+ * so that their connections are kept and reused by later operations;
+ * otherwise *temporary is set, and the caller must dispose of it
+ * once done.  The instance is set in op->o_bd->be_private.
+ */
+static int
+ldap_chain_target_get(
+	Operation	*op,
+	ldap_chain_t	*lc,
+	char		*uri,
+	int		*temporary )
+{
+	ldapinfo_t	li = { 0 }, *lip;
+	struct berval	bvuri[ 2 ] = { { 0 } };
+	int		rc;
+
+	*temporary = 0;
+
+	ber_str2bv( uri, 0, 0, &bvuri[ 0 ] );
+	li.li_bvuri = bvuri;
+
+	/* Searches for a ldapinfo in the avl tree */
+	ldap_pvt_thread_mutex_lock( &lc->lc_lai.lai_mutex );
+	lip = (ldapinfo_t *)avl_find( lc->lc_lai.lai_tree, 
+		(caddr_t)&li, ldap_chain_uri_cmp );
+	ldap_pvt_thread_mutex_unlock( &lc->lc_lai.lai_mutex );
+
+	if ( lip != NULL ) {
+		op->o_bd->be_private = (void *)lip;
+
+		Debug( LDAP_DEBUG_TRACE, "%s ldap_chain_target_get: URI=\"%s\" found in cache\n",
+			op->o_log_prefix, uri, 0 );
+
+		return 0;
+	}
+
+	/* if none is found, create one... */
+	rc = ldap_chain_db_init_one( op->o_bd );
+	if ( rc != 0 ) {
+		Debug( LDAP_DEBUG_TRACE, "%s ldap_chain_target_get: unable to init back-ldap for URI=\"%s\"\n",
+			op->o_log_prefix, uri, 0 );
+		return rc;
+	}
+
+	/* ...with its own copy of the URI, since it may
+	 * outlive this operation; it is freed by db_destroy */
+	lip = (ldapinfo_t *)op->o_bd->be_private;
+	lip->li_uri = ch_strdup( uri );
+	lip->li_bvuri = ch_calloc( 2, sizeof( struct berval ) );
+	ber_str2bv( lip->li_uri, 0, 1, &lip->li_bvuri[ 0 ] );
+
+	rc = ldap_chain_db_open_one( op->o_bd );
+	if ( rc != 0 ) {
+		Debug( LDAP_DEBUG_TRACE, "%s ldap_chain_target_get: unable to open back-ldap for URI=\"%s\"\n",
+			op->o_log_prefix, uri, 0 );
+		(void)ldap_chain_db_destroy_one( op->o_bd, NULL );
+		return rc;
+	}
+
+	if ( LDAP_CHAIN_CACHE_URI( lc ) ) {
+		ldap_pvt_thread_mutex_lock( &lc->lc_lai.lai_mutex );
+		if ( avl_insert( &lc->lc_lai.lai_tree,
+			(caddr_t)lip, ldap_chain_uri_cmp, ldap_chain_uri_dup ) )
+		{
+			/* someone just inserted another;
+			 * don't bother, use this and then
+			 * just free it */
+			*temporary = 1;
+		}
+		ldap_pvt_thread_mutex_unlock( &lc->lc_lai.lai_mutex );
+
+	} else {
+		*temporary = 1;
+	}
+
+	Debug( LDAP_DEBUG_TRACE, "%s ldap_chain_target_get: URI=\"%s\" %s\n",
+		op->o_log_prefix, uri, *temporary ? "temporary" : "caching" );
+
+	return 0;
+}
+
 static int
 ldap_chain_op(
 	Operation	*op,
@@ -406,8 +490,7 @@ ldap_chain_op(
 	ldap_chain_t	*lc = (ldap_chain_t *)on->on_bi.bi_private;
 	struct berval	odn = op->o_req_dn,
 			ondn = op->o_req_ndn;
-	ldapinfo_t	li = { 0 }, *lip = NULL;
-	struct berval	bvuri[ 2 ] = { { 0 } };
+	ldapinfo_t	li = { 0 };
 
 	/* NOTE: returned if ref is empty... */
 	int		rc = LDAP_OTHER,
@@ -419,7 +502,6 @@ ldap_chain_op(
 	(void)chaining_control_add( lc, op, &ctrls );
 #endif /* LDAP_CONTROL_X_CHAINING_BEHAVIOR */
 
-	li.li_bvuri = bvuri;
 	first_rc = -1;
 	for ( ; !BER_BVISNULL( ref ); ref++ ) {
 		SlapReply	rs2 = { 0 };
@@ -554,58 +636,9 @@ Document: RFC 4511
 			}
 		}
 
-		ber_str2bv( li.li_uri, 0, 0, &li.li_bvuri[ 0 ] );
-
-		/* Searches for a ldapinfo in the avl tree */
-		ldap_pvt_thread_mutex_lock( &lc->lc_lai.lai_mutex );
-		lip = (ldapinfo_t *)avl_find( lc->lc_lai.lai_tree, 
-			(caddr_t)&li, ldap_chain_uri_cmp );
-		ldap_pvt_thread_mutex_unlock( &lc->lc_lai.lai_mutex );
-
-		if ( lip != NULL ) {
-			op->o_bd->be_private = (void *)lip;
-
-			Debug( LDAP_DEBUG_TRACE, "%s ldap_chain_op: ref=\"%s\": URI=\"%s\" found in cache\n",
-				op->o_log_prefix, ref->bv_val, li.li_uri );
-
-		} else {
-			rc = ldap_chain_db_init_one( op->o_bd );
-			if ( rc != 0 ) {
-				Debug( LDAP_DEBUG_TRACE, "%s ldap_chain_op: ref=\"%s\" unable to init back-ldap for URI=\"%s\"\n",
-					op->o_log_prefix, ref->bv_val, li.li_uri );
-				goto cleanup;
-			}
-			lip = (ldapinfo_t *)op->o_bd->be_private;
-			lip->li_uri = li.li_uri;
-			lip->li_bvuri = bvuri;
-			rc = ldap_chain_db_open_one( op->o_bd );
-			if ( rc != 0 ) {
-				Debug( LDAP_DEBUG_TRACE, "%s ldap_chain_op: ref=\"%s\" unable to open back-ldap for URI=\"%s\"\n",
-					op->o_log_prefix, ref->bv_val, li.li_uri );
-				lip->li_uri = NULL;
-				lip->li_bvuri = NULL;
-				(void)ldap_chain_db_destroy_one( op->o_bd, NULL);
-				goto cleanup;
-			}
-
-			if ( LDAP_CHAIN_CACHE_URI( lc ) ) {
-				ldap_pvt_thread_mutex_lock( &lc->lc_lai.lai_mutex );
-				if ( avl_insert( &lc->lc_lai.lai_tree,
-					(caddr_t)lip, ldap_chain_uri_cmp, ldap_chain_uri_dup ) )
-				{
-					/* someone just inserted another;
-					 * don't bother, use this and then
-					 * just free it */
-					temporary = 1;
-				}
-				ldap_pvt_thread_mutex_unlock( &lc->lc_lai.lai_mutex );
-
-			} else {
-				temporary = 1;
-			}
-
-			Debug( LDAP_DEBUG_TRACE, "%s ldap_chain_op: ref=\"%s\" %s\n",
-				op->o_log_prefix, ref->bv_val, temporary ? "temporary" : "caching" );
+		rc = ldap_chain_target_get( op, lc, li.li_uri, &temporary );
+		if ( rc != 0 ) {
+			goto cleanup;
 		}
 
 		lb->lb_op_type = op_type;
@@ -623,8 +656,6 @@ cleanup:;
 		li.li_uri = NULL;
 
 		if ( temporary ) {
-			lip->li_uri = NULL;
-			lip->li_bvuri = NULL;
 			(void)ldap_chain_db_close_one( op->o_bd );
 			(void)ldap_chain_db_destroy_one( op->o_bd, NULL );
 		}
@@ -682,8 +713,7 @@ ldap_chain_search(
 	slap_overinst	*on = (slap_overinst *) op->o_bd->bd_info;
 	ldap_chain_cb_t	*lb = (ldap_chain_cb_t *)op->o_callback->sc_private;
 	ldap_chain_t	*lc = (ldap_chain_t *)on->on_bi.bi_private;
-	ldapinfo_t	li = { 0 }, *lip = NULL;
-	struct berval	bvuri[ 2 ] = { { 0 } };
+	ldapinfo_t	li = { 0 };
 
 	struct berval	odn = op->o_req_dn,
 			ondn = op->o_req_ndn;
@@ -708,7 +738,6 @@ ldap_chain_search(
 	 * because in back-ldap there's no caching
 	 * based on the URI value, which is supposed
 	 * to be set once for all (correct?) */
-	li.li_bvuri = bvuri;
 	for ( ; !BER_BVISNULL( &ref[0] ); ref++ ) {
 		SlapReply	rs2 = { REP_RESULT };
 		LDAPURLDesc	*srv;
@@ -826,59 +855,9 @@ ldap_chain_search(
 			op->ors_filterstr = tmp_oq_search.rs_filterstr;
 		}
 
-		ber_str2bv( li.li_uri, 0, 0, &li.li_bvuri[ 0 ] );
-
-		/* Searches for a ldapinfo in the avl tree */
-		ldap_pvt_thread_mutex_lock( &lc->lc_lai.lai_mutex );
-		lip = (ldapinfo_t *)avl_find( lc->lc_lai.lai_tree, 
-			(caddr_t)&li, ldap_chain_uri_cmp );
-		ldap_pvt_thread_mutex_unlock( &lc->lc_lai.lai_mutex );
-
-		if ( lip != NULL ) {
-			op->o_bd->be_private = (void *)lip;
-
-			Debug( LDAP_DEBUG_TRACE, "%s ldap_chain_search: ref=\"%s\": URI=\"%s\" found in cache\n",
-				op->o_log_prefix, ref->bv_val, li.li_uri );
-
-		} else {
-			/* if none is found, create a temporary... */
-			rc = ldap_chain_db_init_one( op->o_bd );
-			if ( rc != 0 ) {
-				Debug( LDAP_DEBUG_TRACE, "%s ldap_chain_search: ref=\"%s\" unable to init back-ldap for URI=\"%s\"\n",
-					op->o_log_prefix, ref->bv_val, li.li_uri );
-				goto cleanup;
-			}
-			lip = (ldapinfo_t *)op->o_bd->be_private;
-			lip->li_uri = li.li_uri;
-			lip->li_bvuri = bvuri;
-			rc = ldap_chain_db_open_one( op->o_bd );
-			if ( rc != 0 ) {
-				Debug( LDAP_DEBUG_TRACE, "%s ldap_chain_search: ref=\"%s\" unable to open back-ldap for URI=\"%s\"\n",
-					op->o_log_prefix, ref->bv_val, li.li_uri );
-				lip->li_uri = NULL;
-				lip->li_bvuri = NULL;
-				(void)ldap_chain_db_destroy_one( op->o_bd, NULL );
-				goto cleanup;
-			}
-
-			if ( LDAP_CHAIN_CACHE_URI( lc ) ) {
-				ldap_pvt_thread_mutex_lock( &lc->lc_lai.lai_mutex );
-				if ( avl_insert( &lc->lc_lai.lai_tree,
-					(caddr_t)lip, ldap_chain_uri_cmp, ldap_chain_uri_dup ) )
-				{
-					/* someone just inserted another;
-					 * don't bother, use this and then
-					 * just free it */
-					temporary = 1;
-				}
-				ldap_pvt_thread_mutex_unlock( &lc->lc_lai.lai_mutex );
-
-			} else {
-				temporary = 1;
-			}
-
-			Debug( LDAP_DEBUG_TRACE, "%s ldap_chain_search: ref=\"%s\" %s\n",
-				op->o_log_prefix, ref->bv_val, temporary ? "temporary" : "caching" );
+		rc = ldap_chain_target_get( op, lc, li.li_uri, &temporary );
+		if ( rc != 0 ) {
+			goto cleanup;
 		}
 
 		lb->lb_op_type = op_search;
@@ -896,8 +875,6 @@ cleanup:;
 		li.li_uri = NULL;
 
 		if ( temporary ) {
-			lip->li_uri = NULL;
-			lip->li_bvuri = NULL;
 			(void)ldap_chain_db_close_one( op->o_bd );
 			(void)ldap_chain_db_destroy_one( op->o_bd, NULL );
 		}
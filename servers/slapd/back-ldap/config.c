@@ -72,6 +72,7 @@ enum {
 	LDAP_BACK_CFG_NOREFS,
 	LDAP_BACK_CFG_NOUNDEFFILTER,
 	LDAP_BACK_CFG_ONERR,
+	LDAP_BACK_CFG_URI_BALANCE,
 
 	LDAP_BACK_CFG_REWRITE,
 	LDAP_BACK_CFG_KEEPALIVE,
@@ -337,6 +338,14 @@ static ConfigTable ldapcfg[] = {
 			"SYNTAX OMsDirectoryString "
 			"SINGLE-VALUE )",
 		NULL, NULL },
+	{ "uri-balance", "true|FALSE", 2, 2, 0,
+		ARG_MAGIC|ARG_ON_OFF|LDAP_BACK_CFG_URI_BALANCE,
+		ldap_back_cf_gen, "( OLcfgDbAt:3.30 "
+			"NAME 'olcDbURIBalance' "
+			"DESC 'spread new connections over the URI list' "
+			"SYNTAX OMsBoolean "
+			"SINGLE-VALUE )",
+		NULL, NULL },
 	{ "idassert-passThru", "authzRule", 2, 2, 0,
 		ARG_MAGIC|LDAP_BACK_CFG_IDASSERT_PASSTHRU,
 		ldap_back_cf_gen, "( OLcfgDbAt:3.27 "
@@ -413,6 +422,7 @@ static ConfigOCs ldapocs[] = {
 			"$ olcDbNoUndefFilter "
 			"$ olcDbOnErr "
 			"$ olcDbKeepalive "
+			"$ olcDbURIBalance "
 		") )",
 		 	Cft_Database, ldapcfg},
 	{ NULL, 0, NULL }
@@ -1364,6 +1374,10 @@ ldap_back_cf_gen( ConfigArgs *c )
 			c->value_int = LDAP_BACK_SINGLECONN( li );
 			break;
 
+		case LDAP_BACK_CFG_URI_BALANCE:
+			c->value_int = LDAP_BACK_URI_BALANCE( li );
+			break;
+
 		case LDAP_BACK_CFG_USETEMP:
 			c->value_int = LDAP_BACK_USE_TEMPORARIES( li );
 			break;
@@ -1568,6 +1582,10 @@ ldap_back_cf_gen( ConfigArgs *c )
 			li->li_flags &= ~LDAP_BACK_F_SINGLECONN;
 			break;
 
+		case LDAP_BACK_CFG_URI_BALANCE:
+			li->li_flags &= ~LDAP_BACK_F_URI_BALANCE;
+			break;
+
 		case LDAP_BACK_CFG_USETEMP:
 			li->li_flags &= ~LDAP_BACK_F_USE_TEMPORARIES;
 			break;
@@ -2162,6 +2180,15 @@ done_url:;
 		}
 		break;
 
+	case LDAP_BACK_CFG_URI_BALANCE:
+		if ( c->value_int ) {
+			li->li_flags |= LDAP_BACK_F_URI_BALANCE;
+
+		} else {
+			li->li_flags &= ~LDAP_BACK_F_URI_BALANCE;
+		}
+		break;
+
 	case LDAP_BACK_CFG_USETEMP:
 		if ( c->value_int ) {
 			li->li_flags |= LDAP_BACK_F_USE_TEMPORARIES;
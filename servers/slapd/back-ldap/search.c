@@ -767,9 +767,28 @@ ldap_build_entry(
 			continue;
 		}
 		
-		if ( ber_scanf( &ber, "[W]", &attr->a_vals ) == LBER_ERROR
-				|| attr->a_vals == NULL )
-		{
+		validate = attr->a_desc->ad_type->sat_syntax->ssyn_validate;
+		pretty = attr->a_desc->ad_type->sat_syntax->ssyn_pretty;
+
+		if ( pretty ) {
+			ber_len_t	siz = sizeof( struct berval );
+
+			/*
+			 * values are going to be replaced by their
+			 * pretty form anyway: parse them in place
+			 * rather than copying them first
+			 */
+			if ( ber_scanf( &ber, "[M]", &attr->a_vals, &siz,
+					(ber_len_t)0 ) == LBER_ERROR )
+			{
+				attr->a_vals = NULL;
+			}
+
+		} else if ( ber_scanf( &ber, "[W]", &attr->a_vals ) == LBER_ERROR ) {
+			attr->a_vals = NULL;
+		}
+
+		if ( attr->a_vals == NULL ) {
 			/*
 			 * Note: attr->a_vals can be null when using
 			 * values result filter
@@ -777,9 +796,6 @@ ldap_build_entry(
 			attr->a_vals = (struct berval *)&slap_dummy_bv;
 		}
 
-		validate = attr->a_desc->ad_type->sat_syntax->ssyn_validate;
-		pretty = attr->a_desc->ad_type->sat_syntax->ssyn_pretty;
-
 		if ( !validate && !pretty ) {
 			attr->a_nvals = NULL;
 			attr_free( attr );
@@ -818,7 +834,10 @@ ldap_build_entry(
 					rc = LDAP_SUCCESS;
 
 				} else {
-					ber_memfree( attr->a_vals[i].bv_val );
+					/* values parsed in place are not owned */
+					if ( !pretty ) {
+						ber_memfree( attr->a_vals[i].bv_val );
+					}
 					if ( --last == i ) {
 						BER_BVZERO( &attr->a_vals[i] );
 						break;
@@ -830,7 +849,6 @@ ldap_build_entry(
 			}
 
 			if ( rc == LDAP_SUCCESS && pretty ) {
-				ber_memfree( attr->a_vals[i].bv_val );
 				attr->a_vals[i] = pval;
 			}
 		}
@@ -56,9 +56,27 @@ struct ldif_info {
 	 */
 	ldap_pvt_thread_mutex_t	li_modop_mutex; /* serialize update requests */
 	ldap_pvt_thread_rdwr_t	li_rdwr;	/* no other I/O when writing */
+	/*
+	 * Parsed entries by filename.  A cached entry is used as long as
+	 * its file has the same size, inode and times as when it was read,
+	 * so files edited behind slapd's back are still picked up.
+	 */
+	Avlnode		*li_cache;
+	ldap_pvt_thread_mutex_t	li_cache_mutex;
 };
 
+/* An entry as read from its file, with the RDN as its DN */
+typedef struct ldif_cached {
+	char	*lc_path;
+	Entry	*lc_e;
+	off_t	lc_size;
+	ino_t	lc_ino;
+	time_t	lc_mtime;
+	time_t	lc_ctime;
+} ldif_cached;
+
 static int write_data( int fd, const char *spew, int len, int *save_errno );
+static void ldif_cache_drop( struct ldif_info *li, const char *path );
 
 #ifdef _WIN32
 #define mkdir(a,b)	mkdir(a)
@@ -597,6 +615,7 @@ ldif_write_entry(
 			if ( move_file( tmpfname, path->bv_val ) == 0 ) {
 				Debug( LDAP_DEBUG_TRACE, "ldif_write_entry: "
 					"wrote entry \"%s\"\n", e->e_name.bv_val, 0, 0 );
+				ldif_cache_drop( op->o_bd->be_private, path->bv_val );
 				rc = LDAP_SUCCESS;
 			} else {
 				save_errno = errno;
@@ -626,6 +645,87 @@ ldif_write_entry(
  * pdn and pndn are the parent's DN and normalized DN, or both NULL.
  * Return an LDAP result code.
  */
+static int
+ldif_cache_cmp( const void *v1, const void *v2 )
+{
+	const ldif_cached *c1 = v1, *c2 = v2;
+	return strcmp( c1->lc_path, c2->lc_path );
+}
+
+static void
+ldif_cache_free( void *v )
+{
+	ldif_cached *lc = v;
+
+	entry_free( lc->lc_e );
+	SLAP_FREE( lc );
+}
+
+/* Forget the cached entry of a file that was rewritten or removed */
+static void
+ldif_cache_drop( struct ldif_info *li, const char *path )
+{
+	ldif_cached key, *lc;
+
+	key.lc_path = (char *)path;
+	ldap_pvt_thread_mutex_lock( &li->li_cache_mutex );
+	lc = avl_delete( &li->li_cache, &key, ldif_cache_cmp );
+	ldap_pvt_thread_mutex_unlock( &li->li_cache_mutex );
+	if ( lc )
+		ldif_cache_free( lc );
+}
+
+/* Get a copy of the cached entry of path, if its file did not change */
+static Entry *
+ldif_cache_get( struct ldif_info *li, const char *path, struct stat *st )
+{
+	ldif_cached key, *lc;
+	Entry *e = NULL;
+
+	key.lc_path = (char *)path;
+	ldap_pvt_thread_mutex_lock( &li->li_cache_mutex );
+	lc = avl_find( li->li_cache, &key, ldif_cache_cmp );
+	if ( lc ) {
+		if ( lc->lc_size == st->st_size && lc->lc_ino == st->st_ino &&
+			lc->lc_mtime == st->st_mtime && lc->lc_ctime == st->st_ctime )
+		{
+			e = entry_dup( lc->lc_e );
+		} else {
+			avl_delete( &li->li_cache, lc, ldif_cache_cmp );
+			ldif_cache_free( lc );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &li->li_cache_mutex );
+	return e;
+}
+
+static void
+ldif_cache_put( struct ldif_info *li, const char *path, struct stat *st,
+	Entry *e )
+{
+	ldif_cached *lc;
+	size_t len = strlen( path ) + 1;
+
+	lc = SLAP_MALLOC( sizeof( ldif_cached ) + len );
+	if ( lc == NULL )
+		return;
+	lc->lc_path = (char *)( lc + 1 );
+	memcpy( lc->lc_path, path, len );
+	lc->lc_size = st->st_size;
+	lc->lc_ino = st->st_ino;
+	lc->lc_mtime = st->st_mtime;
+	lc->lc_ctime = st->st_ctime;
+	lc->lc_e = entry_dup( e );
+	ldap_pvt_thread_mutex_lock( &li->li_cache_mutex );
+	if ( avl_insert( &li->li_cache, lc, ldif_cache_cmp, avl_dup_error )) {
+		/* another reader got here first */
+		ldap_pvt_thread_mutex_unlock( &li->li_cache_mutex );
+		ldif_cache_free( lc );
+		return;
+	}
+	ldap_pvt_thread_mutex_unlock( &li->li_cache_mutex );
+}
+
 static int
 ldif_read_entry(
 	Operation *op,
@@ -635,10 +735,12 @@ ldif_read_entry(
 	Entry **entryp,
 	const char **text )
 {
-	int rc;
+	struct ldif_info *li = (struct ldif_info *) op->o_bd->be_private;
+	int rc, cached = 0;
 	Entry *entry;
 	char *entry_as_string;
 	struct berval rdn;
+	struct stat st;
 
 	/* TODO: Does slapd prevent Abandon of Bind as per rfc4511?
 	 * If so we need not check for LDAP_REQ_BIND here.
@@ -646,6 +748,19 @@ ldif_read_entry(
 	if ( op->o_abandon && op->o_tag != LDAP_REQ_BIND )
 		return SLAPD_ABANDON;
 
+	/* The tools read each entry once, don't keep them around */
+	if ( entryp && !( slapMode & SLAP_TOOL_MODE )) {
+		if ( stat( path, &st ) < 0 ) {
+			ldif_cache_drop( li, path );
+		} else if (( entry = ldif_cache_get( li, path, &st )) != NULL ) {
+			*entryp = entry;
+			rc = LDAP_SUCCESS;
+			goto fixup;
+		} else {
+			cached = 1;
+		}
+	}
+
 	rc = ldif_read_file( path, entryp ? &entry_as_string : NULL );
 
 	switch ( rc ) {
@@ -660,6 +775,9 @@ ldif_read_entry(
 				*text = "internal error (cannot parse some entry file)";
 			break;
 		}
+		if ( cached )
+			ldif_cache_put( li, path, &st, entry );
+fixup:
 		if ( pdn == NULL || BER_BVISEMPTY( pdn ) )
 			break;
 		/* Append parent DN to DN from LDIF file */
@@ -1514,6 +1632,7 @@ ldif_back_delete( Operation *op, SlapReply *rs )
 
 	if ( rc == LDAP_SUCCESS ) {
 		dir2ldif_name( path );
+		ldif_cache_drop( li, path.bv_val );
 		if ( unlink( path.bv_val ) < 0 ) {
 			rc = LDAP_NO_SUCH_OBJECT;
 			if ( errno != ENOENT ) {
@@ -1584,6 +1703,7 @@ ldif_move_entry(
 			for (;;) {
 				dir2ldif_name( newpath );
 				dir2ldif_name( *oldpath );
+				ldif_cache_drop( li, trash );
 				if ( unlink( trash ) == 0 )
 					break;
 				if ( rc == LDAP_SUCCESS ) {
@@ -1951,6 +2071,7 @@ ldif_back_db_init( BackendDB *be, ConfigReply *cr )
 	be->be_cf_ocs = ldifocs;
 	ldap_pvt_thread_mutex_init( &li->li_modop_mutex );
 	ldap_pvt_thread_rdwr_init( &li->li_rdwr );
+	ldap_pvt_thread_mutex_init( &li->li_cache_mutex );
 	SLAP_DBFLAGS( be ) |= SLAP_DBFLAG_ONE_SUFFIX;
 	return 0;
 }
@@ -1961,6 +2082,8 @@ ldif_back_db_destroy( Backend *be, ConfigReply *cr )
 	struct ldif_info *li = be->be_private;
 
 	ch_free( li->li_base_path.bv_val );
+	avl_free( li->li_cache, ldif_cache_free );
+	ldap_pvt_thread_mutex_destroy( &li->li_cache_mutex );
 	ldap_pvt_thread_rdwr_destroy( &li->li_rdwr );
 	ldap_pvt_thread_mutex_destroy( &li->li_modop_mutex );
 	free( be->be_private );
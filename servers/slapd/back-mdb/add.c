@@ -36,6 +36,8 @@ mdb_add(Operation *op, SlapReply *rs )
 	MDB_cursor	*mcd;
 	ID eid, pid = 0;
 	mdb_op_info opinfo = {{{ 0 }}}, *moi = &opinfo;
+	IndexKeys *ixkeys = NULL;
+	Attribute *ap;
 	int subentry;
 	int numads = mdb->mi_numads;
 
@@ -65,6 +67,15 @@ mdb_add(Operation *op, SlapReply *rs )
 		goto return_results;
 	}
 
+	/* generate the index keys now, outside the write txn */
+	for ( ap = op->ora_e->e_attrs; ap && ap->a_next; ap = ap->a_next ) ;
+	rs->sr_err = mdb_index_keys( op, op->ora_e, op->ora_e->e_attrs, &ixkeys );
+	if ( rs->sr_err != LDAP_SUCCESS ) {
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "index generation failed";
+		goto return_results;
+	}
+
 	/* begin transaction */
 	rs->sr_err = mdb_opinfo_get( op, mdb, 0, &moi );
 	rs->sr_text = NULL;
@@ -88,6 +99,15 @@ mdb_add(Operation *op, SlapReply *rs )
 		goto return_results;
 	}
 
+	/* opattrs are only ever appended; pick up the keys of any new ones */
+	rs->sr_err = mdb_index_keys( op, op->ora_e,
+		ap ? ap->a_next : op->ora_e->e_attrs, &ixkeys );
+	if ( rs->sr_err != LDAP_SUCCESS ) {
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "index generation failed";
+		goto return_results;
+	}
+
 	if ( get_assert( op ) &&
 		( test_filter( op, op->ora_e, get_assertion( op )) != LDAP_COMPARE_TRUE ))
 	{
@@ -320,7 +340,7 @@ mdb_add(Operation *op, SlapReply *rs )
 	}
 
 	/* attribute indexes */
-	rs->sr_err = mdb_index_entry_add( op, txn, op->ora_e );
+	rs->sr_err = mdb_index_keys_put( op, txn, ixkeys, eid );
 	if ( rs->sr_err != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_TRACE,
 			LDAP_XSTRING(mdb_add) ": index_entry_add failed\n",
@@ -330,6 +350,13 @@ mdb_add(Operation *op, SlapReply *rs )
 		goto return_results;
 	}
 
+	rs->sr_err = mdb_presmap_entry( op, txn, SLAP_INDEX_ADD_OP, op->ora_e );
+	if ( rs->sr_err != LDAP_SUCCESS ) {
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "presence map update failed";
+		goto return_results;
+	}
+
 	/* id2entry index */
 	rs->sr_err = mdb_id2entry_add( op, txn, mc, op->ora_e );
 	if ( rs->sr_err != 0 ) {
@@ -376,7 +403,7 @@ mdb_add(Operation *op, SlapReply *rs )
 			goto return_results;
 		}
 
-		rs->sr_err = mdb_txn_commit( txn );
+		rs->sr_err = mdb_commit( mdb, txn );
 		txn = NULL;
 		if ( rs->sr_err != 0 ) {
 			mdb->mi_numads = numads;
@@ -387,6 +414,14 @@ mdb_add(Operation *op, SlapReply *rs )
 			rs->sr_err = LDAP_OTHER;
 			goto return_results;
 		}
+
+		rs->sr_err = mdb_txn_durable( op, mdb );
+		if ( rs->sr_err != 0 ) {
+			rs->sr_text = "txn sync failed";
+			rs->sr_err = LDAP_OTHER;
+			goto return_results;
+		}
+		mdb_maxsize_check( op );
 	}
 
 	Debug(LDAP_DEBUG_TRACE,
@@ -424,6 +459,8 @@ return_results:
 
 	slap_graduate_commit_csn( op );
 
+	mdb_index_keys_free( op, ixkeys );
+
 	if( postread_ctrl != NULL && (*postread_ctrl) != NULL ) {
 		slap_sl_free( (*postread_ctrl)->ldctl_value.bv_val, op->o_tmpmemctx );
 		slap_sl_free( *postread_ctrl, op->o_tmpmemctx );
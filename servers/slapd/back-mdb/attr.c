@@ -23,6 +23,7 @@
 
 #include "slap.h"
 #include "back-mdb.h"
+#include "idl.h"
 #include "config.h"
 #include "lutil.h"
 
@@ -116,7 +117,8 @@ mdb_attr_dbs_open(
 	}
 
 	flags = MDB_DUPSORT|MDB_DUPFIXED|MDB_INTEGERDUP;
-	if ( !(slapMode & SLAP_TOOL_READONLY) )
+	if ( !(slapMode & SLAP_TOOL_READONLY) &&
+		!(mdb->mi_dbenv_flags & MDB_RDONLY) )
 		flags |= MDB_CREATE;
 
 	for ( i=0; i<mdb->mi_nattrs; i++ ) {
@@ -384,6 +386,7 @@ fail:
 #endif
 		a->ai_cursor = NULL;
 		a->ai_root = NULL;
+		a->ai_keybuf = NULL;
 		a->ai_desc = ad;
 		a->ai_dbi = 0;
 		a->ai_multi_hi = UINT_MAX;
@@ -812,3 +815,243 @@ int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad )
 
 	return rc;
 }
+
+/* The presence map keeps, for every AttributeDescription in ad2id, the
+ * IDs of the entries holding it, so presence filters on attributes
+ * without a presence index need not match every entry. Slot 0 is never
+ * an AD; its one ID 0 marks the map as covering every entry.
+ */
+static int mdb_presmap_mark = 0;
+
+static int
+mdb_presmap_keys( Operation *op, MDB_txn *txn, int opid, Attribute *a,
+	Attribute *other, ID id )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	struct berval *keys;
+	Attribute *ap;
+	int i, n, *adx, rc;
+
+	for ( n = 0, ap = a; ap; ap = ap->a_next )
+		n++;
+	if ( !n )
+		return 0;
+
+	keys = op->o_tmpalloc( ( n + 1 ) * sizeof(struct berval) + n * sizeof(int),
+		op->o_tmpmemctx );
+	adx = (int *)( keys + n + 1 );
+	for ( i = 0, ap = a; ap; ap = ap->a_next ) {
+		/* only attributes the other list lacks */
+		if ( other && attr_find( other, ap->a_desc ))
+			continue;
+		if ( !mdb->mi_adxs[ap->a_desc->ad_index] ) {
+			if ( opid == SLAP_INDEX_DELETE_OP )
+				continue;
+			rc = mdb_ad_get( mdb, txn, ap->a_desc );
+			if ( rc )
+				goto done;
+		}
+		adx[i] = mdb->mi_adxs[ap->a_desc->ad_index];
+		keys[i].bv_val = (char *)&adx[i];
+		keys[i].bv_len = sizeof(int);
+		i++;
+	}
+	BER_BVZERO( &keys[i] );
+	rc = 0;
+	if ( !i )
+		goto done;
+
+	rc = mdb_cursor_open( txn, mdb->mi_ad2pres, &mc );
+	if ( rc )
+		goto done;
+	if ( opid == SLAP_INDEX_DELETE_OP )
+		rc = mdb_idl_delete_keys( op->o_bd, mc, keys, id );
+	else
+		rc = mdb_idl_insert_keys( op->o_bd, mc, keys, id );
+	mdb_cursor_close( mc );
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+
+done:
+	op->o_tmpfree( keys, op->o_tmpmemctx );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_presmap_keys: failed %s(%d)\n",
+			mdb_strerror(rc), rc, 0 );
+	}
+	return rc;
+}
+
+/* Add or delete every attribute of an entry */
+int
+mdb_presmap_entry( Operation *op, MDB_txn *txn, int opid, Entry *e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+
+	if ( !mdb->mi_presmap || e->e_id == 0 )
+		return 0;
+	return mdb_presmap_keys( op, txn, opid, e->e_attrs, NULL, e->e_id );
+}
+
+/* Account for attributes a modification added or removed */
+int
+mdb_presmap_mods( Operation *op, MDB_txn *txn, ID id,
+	Attribute *oldattrs, Attribute *newattrs )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	int rc;
+
+	if ( !mdb->mi_presmap || id == 0 )
+		return 0;
+	rc = mdb_presmap_keys( op, txn, SLAP_INDEX_DELETE_OP,
+		oldattrs, newattrs, id );
+	if ( rc == 0 )
+		rc = mdb_presmap_keys( op, txn, SLAP_INDEX_ADD_OP,
+			newattrs, oldattrs, id );
+	return rc;
+}
+
+/* Entries holding desc or any of its subtypes. Returns
+ * LDAP_INAPPROPRIATE_MATCHING if the map can't answer.
+ */
+int
+mdb_presmap_read( Operation *op, MDB_txn *txn, AttributeDescription *desc,
+	ID *ids )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	struct berval key;
+	ID *tmp = NULL;
+	int i, rc = 0, found = 0;
+
+	if ( !mdb->mi_presmap_ok )
+		return LDAP_INAPPROPRIATE_MATCHING;
+
+	MDB_IDL_ZERO( ids );
+	key.bv_len = sizeof(int);
+	for ( i = 1; i <= mdb->mi_numads; i++ ) {
+		if ( !is_ad_subtype( mdb->mi_ads[i], desc ))
+			continue;
+		key.bv_val = (char *)&i;
+		if ( !found ) {
+			rc = mdb_key_read( op->o_bd, txn, mdb->mi_ad2pres, &key,
+				ids, NULL, 0, NULL );
+			if ( rc == 0 )
+				found = 1;
+		} else {
+			if ( !tmp )
+				tmp = op->o_tmpalloc( MDB_IDL_UM_SIZEOF, op->o_tmpmemctx );
+			rc = mdb_key_read( op->o_bd, txn, mdb->mi_ad2pres, &key,
+				tmp, NULL, 0, NULL );
+			if ( rc == 0 )
+				mdb_idl_union( ids, tmp );
+		}
+		if ( rc == MDB_NOTFOUND ) {
+			rc = 0;
+		} else if ( rc ) {
+			break;
+		}
+	}
+	if ( tmp )
+		op->o_tmpfree( tmp, op->o_tmpmemctx );
+	if ( !found )
+		MDB_IDL_ZERO( ids );
+	return rc;
+}
+
+/* Mark the map as covering every entry */
+int
+mdb_presmap_done( struct mdb_info *mdb, MDB_txn *txn )
+{
+	MDB_val key, data;
+	ID id = 0;
+	int rc;
+
+	key.mv_size = sizeof(int);
+	key.mv_data = &mdb_presmap_mark;
+	data.mv_size = sizeof(ID);
+	data.mv_data = &id;
+	rc = mdb_put( txn, mdb->mi_ad2pres, &key, &data, MDB_NODUPDATA );
+	if ( rc == MDB_KEYEXIST )
+		rc = 0;
+	if ( rc == 0 )
+		mdb->mi_presmap_ok = 1;
+	return rc;
+}
+
+/* Open the presence map if configured, or drop a leftover one that
+ * stopped being maintained.
+ */
+int
+mdb_presmap_open( BackendDB *be, MDB_txn *txn, ConfigReply *cr )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_val key, data;
+	MDB_stat st;
+	int rc, rdonly = mdb->mi_dbenv_flags & MDB_RDONLY;
+
+	mdb->mi_presmap_ok = 0;
+	if ( !mdb->mi_presmap ) {
+		MDB_dbi dbi;
+		if ( rdonly )
+			return 0;
+		rc = mdb_dbi_open( txn, "ad2pres", 0, &dbi );
+		if ( rc == 0 )
+			rc = mdb_drop( txn, dbi, 1 );
+		return rc == MDB_NOTFOUND ? 0 : rc;
+	}
+
+	rc = mdb_dbi_open( txn, "ad2pres", ( rdonly ? 0 : MDB_CREATE )|
+		MDB_DUPSORT|MDB_DUPFIXED|MDB_INTEGERDUP, &mdb->mi_ad2pres );
+	if ( rc == MDB_NOTFOUND && rdonly ) {
+		/* the writer hasn't built one; searches just do without */
+		mdb->mi_ad2pres = 0;
+		return 0;
+	}
+	if ( rc ) {
+		snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+			"mdb_dbi_open(ad2pres) failed: %s (%d).",
+			be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_presmap_open) ": %s\n",
+			cr->msg, 0, 0 );
+		return rc;
+	}
+
+	key.mv_size = sizeof(int);
+	key.mv_data = &mdb_presmap_mark;
+	rc = mdb_get( txn, mdb->mi_ad2pres, &key, &data );
+	if ( rc == 0 ) {
+		mdb->mi_presmap_ok = 1;
+	} else if ( rc == MDB_NOTFOUND ) {
+		/* an empty database is trivially covered */
+		mdb_stat( txn, mdb->mi_id2entry, &st );
+		rc = ( st.ms_entries || rdonly ) ? 0 : mdb_presmap_done( mdb, txn );
+		if ( !mdb->mi_presmap_ok ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_presmap_open) ": database \"%s\": "
+				"presence map incomplete, run slapindex to build it\n",
+				be->be_suffix[0].bv_val, 0, 0 );
+		}
+	}
+	return rc;
+}
+
+/* Forget that the map is complete, after a change it couldn't follow */
+int
+mdb_presmap_stale( struct mdb_info *mdb, MDB_txn *txn )
+{
+	MDB_val key;
+	int rc;
+
+	if ( !mdb->mi_presmap || !mdb->mi_presmap_ok )
+		return 0;
+	key.mv_size = sizeof(int);
+	key.mv_data = &mdb_presmap_mark;
+	rc = mdb_del( txn, mdb->mi_ad2pres, &key, NULL );
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	if ( rc == 0 )
+		mdb->mi_presmap_ok = 0;
+	return rc;
+}
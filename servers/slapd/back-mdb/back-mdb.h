@@ -33,7 +33,8 @@ LDAP_BEGIN_DECL
 #define MDB_DN2ID		1
 #define MDB_ID2ENTRY	2
 #define MDB_ID2VAL		3
-#define MDB_NDB			4
+#define MDB_ID2BIG		4
+#define MDB_NDB			5
 
 /* The default search IDL stack cache depth */
 #define DEFAULT_SEARCH_STACK_DEPTH	16
@@ -51,6 +52,9 @@ LDAP_BEGIN_DECL
 /* Most users will never see this */
 #define DEFAULT_RTXN_SIZE	10000
 
+/* Entries reindexed per write txn by online indexing */
+#define DEFAULT_INDEX_BATCH	100
+
 #ifdef LDAP_DEVEL
 #define MDB_MONITOR_IDX
 #endif
@@ -63,6 +67,51 @@ typedef struct mdb_monitor_t {
 /* From ldap_rq.h */
 struct re_s;
 
+/* Candidates of a paged search, kept between pages */
+typedef struct mdb_pcursor {
+	LDAP_TAILQ_ENTRY(mdb_pcursor) pc_next;
+	unsigned long	pc_connid;
+	int		pc_scope;
+	int		pc_deref;
+	struct berval	pc_ndn;
+	struct berval	pc_filter;
+	ID		pc_ncand;
+	ID		pc_ids[1];	/* candidate IDL, allocated to size */
+} mdb_pcursor;
+
+/* Candidates of a filter, valid while no write has committed */
+typedef struct mdb_ccentry {
+	LDAP_TAILQ_ENTRY(mdb_ccentry) cc_next;
+	size_t		cc_txnid;	/* snapshot the list was computed in */
+	unsigned	cc_hash;
+	int		cc_flags;	/* controls that change the filter used */
+	struct berval	cc_filter;
+	ID		cc_ids[1];	/* candidate IDL, allocated to size */
+} mdb_ccentry;
+
+/* longer candidate lists are not worth keeping */
+#define MDB_CCACHE_IDS	4096
+
+/* How a search was evaluated, returned with the explain control */
+typedef struct mdb_explain {
+	struct berval	*me_lines;	/* one per step, on o_tmpmemctx */
+	int		me_nlines;
+	int		me_dropped;	/* steps beyond MDB_EXPLAIN_MAX */
+	int		me_depth;	/* nesting of the filter being evaluated */
+	unsigned long	me_scopes;	/* candidates checked by mdb_idscopes */
+	unsigned long	me_outscope;	/* of those, not in the search scope */
+	unsigned long	me_tested;	/* entries tested against the filter */
+	unsigned long	me_matched;
+} mdb_explain;
+
+#define MDB_EXPLAIN_MAX	256
+
+/* leaf pages of id2entry announced ahead of sequential scans when
+ * the OS readahead is disabled, and the least candidates to bother
+ */
+#define MDB_SCAN_READAHEAD	16
+#define MDB_SCAN_RA_MIN		256
+
 struct mdb_info {
 	MDB_env		*mi_dbenv;
 
@@ -74,6 +123,10 @@ struct mdb_info {
 	size_t		mi_mapsize;
 	ID			mi_nextid;
 	size_t		mi_maxentrysize;
+	size_t		mi_compress;	/* compress id2entry records this big, 0 never */
+	size_t		mi_bigattr;	/* keep attrs this big in id2big, 0 never */
+	int			mi_share_nvals;	/* don't store nvals equal to their vals */
+	unsigned	mi_counters;	/* liblmdb counter sample interval, 0 off */
 
 	slap_mask_t	mi_defaultmask;
 	int			mi_nattrs;
@@ -83,6 +136,28 @@ struct mdb_info {
 	int			mi_readers;
 
 	uint32_t	mi_rtxn_size;
+	unsigned	mi_rtxn_maxage;	/* secs a search may keep one snapshot */
+	int			mi_idl_bitmap;	/* store oversized index slots as bitmaps */
+	unsigned	mi_substr_bits;	/* substring key buckets, 0 for full keys */
+	int			mi_presmap;	/* keep the ad2pres presence map */
+	int			mi_presmap_ok;	/* ad2pres covers every entry */
+	int			mi_presmap_build;	/* slapindex is rebuilding ad2pres */
+	MDB_dbi		mi_ad2pres;
+	unsigned	mi_search_threads;	/* workers prefiltering large searches */
+
+	/* retained paged results cursors, most recently used first */
+	unsigned	mi_pcursor_max;
+	unsigned	mi_pcursor_num;
+	ldap_pvt_thread_mutex_t	mi_pcursor_mutex;
+	LDAP_TAILQ_HEAD(mdb_pcq, mdb_pcursor) mi_pcursors;
+
+	/* candidate lists of recent filters, most recently used first */
+	unsigned	mi_ccache_max;
+	unsigned	mi_ccache_num;
+	unsigned long	mi_ccache_hits;
+	unsigned long	mi_ccache_misses;
+	ldap_pvt_thread_mutex_t	mi_ccache_mutex;
+	LDAP_TAILQ_HEAD(mdb_ccq, mdb_ccentry) mi_ccache;
 	int			mi_txn_cp;
 	uint32_t	mi_txn_cp_min;
 	uint32_t	mi_txn_cp_kbyte;
@@ -90,6 +165,53 @@ struct mdb_info {
 	struct re_s		*mi_txn_cp_task;
 	struct re_s		*mi_index_task;
 
+	/* growing the map before it fills up */
+	size_t		mi_grow_step;	/* bytes to add, 0 if disabled */
+	size_t		mi_grow_max;	/* never grow past this, 0 for no limit */
+	struct re_s		*mi_grow_task;
+
+	/* group commit of write txns */
+	unsigned	mi_gc_window;	/* msec to gather a batch, 0 if disabled */
+	unsigned	mi_gc_max;	/* sync at once when this many ops wait */
+	int			mi_gc_waiters;
+	int			mi_gc_batch;	/* writers seen around the last sync */
+	int			mi_gc_syncing;	/* a leader is gathering or syncing */
+	int			mi_gc_rc;	/* result of the last sync */
+	size_t		mi_gc_synced;	/* last txnid known to be on disk */
+	ldap_pvt_thread_mutex_t	mi_gc_mutex;
+	ldap_pvt_thread_cond_t	mi_gc_cond;
+
+	/* write txns sharing one LMDB commit */
+	unsigned	mi_wb_max;	/* writers per batch, 0 if disabled */
+	unsigned	mi_wb_wait;	/* usec a batch waits for writers to join */
+
+	/* online indexing */
+	unsigned	mi_index_batch;	/* entries per write txn */
+	unsigned	mi_index_delay;	/* msec to sleep between batches */
+	int			mi_index_paused;
+	int			mi_index_state;
+#define	MDB_REINDEX_IDLE	0
+#define	MDB_REINDEX_RUNNING	1
+#define	MDB_REINDEX_PAUSED	2
+	ID			mi_index_next;	/* where the task starts or resumes */
+	ID			mi_index_done;
+	ID			mi_index_total;
+	ID			mi_index_run_done;	/* mi_index_done when this run started */
+	time_t		mi_index_run_start;
+
+	/* per-thread decoded entry cache */
+	unsigned	mi_ecache_max;
+	unsigned	mi_ecache_gen;
+	ldap_pvt_thread_mutex_t	mi_ecache_mutex;
+	unsigned long	mi_ecache_hits;
+	unsigned long	mi_ecache_misses;
+
+	/* latency of write txn commits, bucket i counts those
+	 * under 2^i usec */
+#define	MDB_COMMIT_BUCKETS	32
+	ldap_pvt_thread_mutex_t	mi_commit_mutex;
+	unsigned long	mi_commit_hist[MDB_COMMIT_BUCKETS];
+
 	mdb_monitor_t	mi_monitor;
 
 #ifdef MDB_MONITOR_IDX
@@ -122,6 +244,7 @@ struct mdb_info {
 #define mi_dn2id	mi_dbis[MDB_DN2ID]
 #define mi_ad2id	mi_dbis[MDB_AD2ID]
 #define mi_id2val	mi_dbis[MDB_ID2VAL]
+#define mi_id2big	mi_dbis[MDB_ID2BIG]
 
 typedef struct mdb_op_info {
 	OpExtra		moi_oe;
@@ -145,12 +268,20 @@ typedef struct mdb_attrinfo {
 #endif
 	TAvlnode *ai_root;		/* for tools */
 	MDB_cursor *ai_cursor;	/* for tools */
+	void *ai_keybuf;	/* for tools, buffered slapadd keys */
 	int ai_idx;	/* position in AI array */
 	MDB_dbi ai_dbi;
 	unsigned ai_multi_hi;
 	unsigned ai_multi_lo;
 } AttrInfo;
 
+/* index keys generated outside of the write txn */
+typedef struct mdb_ixkeys {
+	struct mdb_ixkeys *ik_next;
+	AttrInfo *ik_ai;
+	BerVarray ik_keys;
+} IndexKeys;
+
 /* tool threaded indexer state */
 typedef struct mdb_attrixinfo {
 	OpExtra ai_oe;
@@ -181,6 +312,12 @@ typedef struct AttrList {
 #define	ALIGNER	(sizeof(size_t)-1)
 #endif
 
+/* Folded substring keys are at most 3 bytes, shorter than the hashed
+ * equality keys kept in the same index DB.
+ */
+#define MDB_SUBSTR_BITS_MIN	8
+#define MDB_SUBSTR_BITS_MAX	24
+
 typedef struct IndexRbody {
 	AttrInfo *ai;
 	AttrList *attrs;
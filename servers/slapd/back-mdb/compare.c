@@ -30,6 +30,9 @@ mdb_compare( Operation *op, SlapReply *rs )
 
 	MDB_txn		*rtxn;
 	mdb_op_info	opinfo = {{{0}}}, *moi = &opinfo;
+	AttributeDescription *ad = op->orc_ava->aa_desc;
+	AttributeName	skip[2], *sk = NULL;
+	unsigned	skipmask = 0;
 
 	rs->sr_err = mdb_opinfo_get(op, mdb, 1, &moi);
 	switch(rs->sr_err) {
@@ -42,8 +45,25 @@ mdb_compare( Operation *op, SlapReply *rs )
 
 	rtxn = moi->moi_txn;
 
+	/* An equality assertion on values kept in id2val can be checked
+	 * there, without reading them all. Not when ACLs or an assertion
+	 * may look at them.
+	 */
+	if ( !get_assert( op ) && ad->ad_type->sat_equality &&
+		!( ad->ad_type->sat_flags & SLAP_AT_ORDERED ) &&
+		ad != slap_schema.si_ad_objectClass &&
+		( be_isroot( op ) || !( mdb_acl_peeks( op->o_bd->be_acl ) ||
+			mdb_acl_peeks( frontendDB->be_acl ))))
+	{
+		memset( skip, 0, sizeof( skip ));
+		skip[0].an_name = ad->ad_cname;
+		skip[0].an_desc = ad;
+		sk = skip;
+	}
+
 	/* get entry */
-	rs->sr_err = mdb_dn2entry( op, rtxn, NULL, &op->o_req_ndn, &e, NULL, 1 );
+	rs->sr_err = mdb_dn2entry_skip( op, rtxn, NULL, &op->o_req_ndn, &e, NULL, 1,
+		sk, &skipmask );
 	switch( rs->sr_err ) {
 	case MDB_NOTFOUND:
 	case 0:
@@ -114,7 +134,28 @@ mdb_compare( Operation *op, SlapReply *rs )
 		goto done;
 	}
 
+	if ( skipmask && access_allowed( op, e, ad, &op->orc_ava->aa_value,
+		ACL_COMPARE, NULL ))
+	{
+		rs->sr_err = mdb_mval_find( op, rtxn, e->e_id, ad,
+			&op->orc_ava->aa_value );
+		switch ( rs->sr_err ) {
+		case 0:
+			rs->sr_err = LDAP_COMPARE_TRUE;
+			goto return_results;
+		case MDB_NOTFOUND:
+			break;
+		default:
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "internal error";
+			goto return_results;
+		}
+	}
+
 	rs->sr_err = slap_compare_entry( op, e, op->orc_ava );
+	/* the attribute was there, just not read */
+	if ( skipmask && rs->sr_err == LDAP_NO_SUCH_ATTRIBUTE )
+		rs->sr_err = LDAP_COMPARE_FALSE;
 
 return_results:
 	send_ldap_result( op, rs );
@@ -41,32 +41,90 @@ enum {
 	MDB_MODE,
 	MDB_SSTACK,
 	MDB_MULTIVAL,
+	MDB_INDEXPAUSED,
+	MDB_GROUPCOMMIT,
+	MDB_AUTOGROW,
+	MDB_SUBSTRBITS,
+	MDB_PRESMAP,
+	MDB_WRITEBATCH,
 };
 
 static ConfigTable mdbcfg[] = {
+	{ "autogrow", "step> <[max]", 2, 3, 0, ARG_MAGIC|MDB_AUTOGROW,
+		mdb_cf_gen, "( OLcfgDbAt:12.15 NAME 'olcDbAutoGrow' "
+			"DESC 'Grow the map by step bytes before it fills, up to max' "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "directory", "dir", 2, 2, 0, ARG_STRING|ARG_MAGIC|MDB_DIRECTORY,
 		mdb_cf_gen, "( OLcfgDbAt:0.1 NAME 'olcDbDirectory' "
 			"DESC 'Directory for database content' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "bigattrsize", "size", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_bigattr),
+		"( OLcfgDbAt:12.22 NAME 'olcDbBigAttrSize' "
+		"DESC 'Store attributes of at least this many bytes apart from their entry, 0 to disable' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "candcache", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_ccache_max),
+		"( OLcfgDbAt:12.18 NAME 'olcDbCandCache' "
+		"DESC 'Number of filter candidate lists to cache' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "checkpoint", "kbyte> <min", 3, 3, 0, ARG_MAGIC|MDB_CHKPT,
 		mdb_cf_gen, "( OLcfgDbAt:1.2 NAME 'olcDbCheckpoint' "
 			"DESC 'Database checkpoint interval in kbytes and minutes' "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )",NULL, NULL },
+	{ "compress", "size", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_compress),
+		"( OLcfgDbAt:12.20 NAME 'olcDbCompress' "
+		"DESC 'Compress entries of at least this many bytes, 0 to disable' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "counters", "sample", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_counters),
+		"( OLcfgDbAt:12.21 NAME 'olcDbCounters' "
+		"DESC 'Count page activity, checking one page visit in sample for residency' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "dbnosync", NULL, 1, 2, 0, ARG_ON_OFF|ARG_MAGIC|MDB_DBNOSYNC,
 		mdb_cf_gen, "( OLcfgDbAt:1.4 NAME 'olcDbNoSync' "
 			"DESC 'Disable synchronous database writes' "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "entrycache", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_ecache_max),
+		"( OLcfgDbAt:12.7 NAME 'olcDbEntryCache' "
+		"DESC 'Number of decoded entries to cache per thread' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "envflags", "flags", 2, 0, 0, ARG_MAGIC|MDB_ENVFLAGS,
 		mdb_cf_gen, "( OLcfgDbAt:12.3 NAME 'olcDbEnvFlags' "
 			"DESC 'Database environment flags' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "groupcommit", "msec> <[ops]", 2, 3, 0, ARG_MAGIC|MDB_GROUPCOMMIT,
+		mdb_cf_gen, "( OLcfgDbAt:12.14 NAME 'olcDbGroupCommit' "
+			"DESC 'Sync write txns in batches gathered over msec, or of ops writers' "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "idlbitmap", NULL, 1, 2, 0, ARG_ON_OFF|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_idl_bitmap),
+		"( OLcfgDbAt:12.8 NAME 'olcDbIDLBitmap' "
+		"DESC 'Store oversized index slots as bitmaps instead of ranges' "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "index", "attr> <[pres,eq,approx,sub]", 2, 3, 0, ARG_MAGIC|MDB_INDEX,
 		mdb_cf_gen, "( OLcfgDbAt:0.2 NAME 'olcDbIndex' "
 		"DESC 'Attribute index parameters' "
 		"EQUALITY caseIgnoreMatch "
 		"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "indexbatch", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_index_batch),
+		"( OLcfgDbAt:12.11 NAME 'olcDbIndexBatch' "
+		"DESC 'Number of entries to reindex in one write transaction' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "indexdelay", "msec", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_index_delay),
+		"( OLcfgDbAt:12.12 NAME 'olcDbIndexDelay' "
+		"DESC 'Milliseconds to wait between online reindexing batches' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "indexpaused", NULL, 1, 2, 0, ARG_ON_OFF|ARG_MAGIC|MDB_INDEXPAUSED,
+		mdb_cf_gen, "( OLcfgDbAt:12.13 NAME 'olcDbIndexPaused' "
+		"DESC 'Suspend online reindexing' "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "maxentrysize", "size", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_maxentrysize),
 		"( OLcfgDbAt:12.4 NAME 'olcDbMaxEntrySize' "
@@ -89,15 +147,47 @@ static ConfigTable mdbcfg[] = {
 		"( OLcfgDbAt:12.6 NAME 'olcDbMultival' "
 		"DESC 'Hi/Lo thresholds for splitting multivalued attr out of main blob' "
 		"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "pagedcursors", "num", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_pcursor_max),
+		"( OLcfgDbAt:12.10 NAME 'olcDbPagedCursors' "
+		"DESC 'Number of paged search candidate lists to keep between pages' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "presencemap", NULL, 1, 2, 0, ARG_ON_OFF|ARG_MAGIC|MDB_PRESMAP,
+		mdb_cf_gen, "( OLcfgDbAt:12.19 NAME 'olcDbPresenceMap' "
+		"DESC 'Track which entries hold each attribute, for presence filters' "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "rtxnsize", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_rtxn_size),
 		"( OLcfgDbAt:12.5 NAME 'olcDbRtxnSize' "
 		"DESC 'Number of entries to process in one read transaction' "
 		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "rtxnmaxage", "seconds", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_rtxn_maxage),
+		"( OLcfgDbAt:12.17 NAME 'olcDbRtxnMaxAge' "
+		"DESC 'Seconds a search may keep one read transaction' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "searchstack", "depth", 2, 2, 0, ARG_INT|ARG_MAGIC|MDB_SSTACK,
 		mdb_cf_gen, "( OLcfgDbAt:1.9 NAME 'olcDbSearchStack' "
 		"DESC 'Depth of search stack in IDLs' "
 		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "searchthreads", "num", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_search_threads),
+		"( OLcfgDbAt:12.9 NAME 'olcDbSearchThreads' "
+		"DESC 'Number of pool threads used to prefilter large searches' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "sharenvals", NULL, 1, 2, 0, ARG_ON_OFF|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_share_nvals),
+		"( OLcfgDbAt:12.24 NAME 'olcDbShareNvals' "
+		"DESC 'Store normalized values equal to their value only once' "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "substrbits", "bits", 2, 2, 0, ARG_UINT|ARG_MAGIC|MDB_SUBSTRBITS,
+		mdb_cf_gen, "( OLcfgDbAt:12.16 NAME 'olcDbSubstrBits' "
+		"DESC 'Fold substring index keys into 2^bits buckets, 0 to disable' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "writebatch", "ops> <[usec]", 2, 3, 0, ARG_MAGIC|MDB_WRITEBATCH,
+		mdb_cf_gen, "( OLcfgDbAt:12.23 NAME 'olcDbWriteBatch' "
+			"DESC 'Run up to ops concurrent write txns as one LMDB commit, waiting up to usec for them' "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED,
 		NULL, NULL, NULL, NULL }
 };
@@ -112,7 +202,12 @@ static ConfigOCs mdbocs[] = {
 		"MAY ( olcDbCheckpoint $ olcDbEnvFlags $ "
 		"olcDbNoSync $ olcDbIndex $ olcDbMaxReaders $ olcDbMaxSize $ "
 		"olcDbMode $ olcDbSearchStack $ olcDbMaxEntrySize $ olcDbRtxnSize $ "
-		"olcDbMultival ) )",
+		"olcDbMultival $ olcDbEntryCache $ olcDbIDLBitmap $ "
+		"olcDbSearchThreads $ olcDbPagedCursors $ olcDbIndexBatch $ "
+		"olcDbIndexDelay $ olcDbIndexPaused $ olcDbGroupCommit $ olcDbAutoGrow $ "
+		"olcDbSubstrBits $ olcDbRtxnMaxAge $ olcDbCandCache $ "
+		"olcDbPresenceMap $ olcDbCompress $ olcDbCounters $ olcDbBigAttrSize $ "
+		"olcDbWriteBatch $ olcDbShareNvals ) )",
 		 	Cft_Database, mdbcfg },
 	{ NULL, 0, NULL }
 };
@@ -123,9 +218,26 @@ static slap_verbmasks mdb_envflags[] = {
 	{ BER_BVC("writemap"),	MDB_WRITEMAP },
 	{ BER_BVC("mapasync"),	MDB_MAPASYNC },
 	{ BER_BVC("nordahead"),	MDB_NORDAHEAD },
+	{ BER_BVC("hugepage"),	MDB_HUGEPAGE },
+	{ BER_BVC("rdonly"),	MDB_RDONLY },
 	{ BER_BVNULL, 0 }
 };
 
+/* A read-only environment can't take writes; turn the database into
+ * a shadow so the frontend refers them to the updateref instead.
+ */
+static int
+mdb_cf_rdonly( ConfigArgs *c, int on )
+{
+	if ( on )
+		return config_slurp_shadow( c );
+
+	/* keep it a shadow if something else made it one */
+	if ( BER_BVISEMPTY( &c->be->be_update_ndn ) && !c->be->be_syncinfo )
+		SLAP_DBFLAGS( c->be ) &= ~SLAP_DBFLAG_SHADOW_MASK;
+	return 0;
+}
+
 /* perform periodic syncs */
 static void *
 mdb_checkpoint( void *ctx, void *arg )
@@ -133,14 +245,150 @@ mdb_checkpoint( void *ctx, void *arg )
 	struct re_s *rtask = arg;
 	struct mdb_info *mdb = rtask->arg;
 
-	mdb_env_sync( mdb->mi_dbenv, 1 );
+	if ( !( mdb->mi_dbenv_flags & MDB_RDONLY ))
+		mdb_env_sync( mdb->mi_dbenv, 1 );
 	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
 	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
 	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
 	return NULL;
 }
 
-/* reindex entries on the fly */
+/* Enlarge the map by one autogrow step. Writers schedule this when
+ * they see the headroom above the last used page drop below a step;
+ * the resize needs every other thread out of the environment, so it
+ * runs here with the server paused rather than in the writer.
+ */
+static void *
+mdb_maxsize_grow( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	struct mdb_info *mdb = rtask->arg;
+	MDB_envinfo ei;
+	MDB_stat st;
+	size_t size;
+	int rc;
+
+	slap_pause_server();
+	/* the database may have been closed while we waited */
+	if ( !( mdb->mi_flags & MDB_IS_OPEN ))
+		goto done;
+	mdb_env_info( mdb->mi_dbenv, &ei );
+	mdb_env_stat( mdb->mi_dbenv, &st );
+	size = ei.me_mapsize + mdb->mi_grow_step;
+	if ( mdb->mi_grow_max && size > mdb->mi_grow_max )
+		size = mdb->mi_grow_max;
+	if ( mdb->mi_grow_step && size > ei.me_mapsize &&
+		ei.me_mapsize - ( ei.me_last_pgno + 1 ) * st.ms_psize < mdb->mi_grow_step )
+	{
+		rc = mdb_env_set_mapsize( mdb->mi_dbenv, size );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_maxsize_grow)
+				": growing map to %lu failed: %s (%d)\n",
+				(unsigned long) size, mdb_strerror(rc), rc );
+		} else {
+			Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_maxsize_grow)
+				": map grown from %lu to %lu bytes\n",
+				(unsigned long) ei.me_mapsize, (unsigned long) size, 0 );
+			mdb->mi_mapsize = size;
+		}
+	}
+done:
+	slap_unpause_server();
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	/* unless mdb_db_close already took it off the queue */
+	if ( mdb->mi_grow_task == rtask ) {
+		ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+		ldap_pvt_runqueue_remove( &slapd_rq, rtask );
+		mdb->mi_grow_task = NULL;
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	return NULL;
+}
+
+/* Called by writers after a commit */
+void
+mdb_maxsize_check( Operation *op )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_envinfo ei;
+	MDB_stat st;
+
+	if ( !mdb->mi_grow_step || mdb->mi_grow_task ||
+		!( slapMode & SLAP_SERVER_MODE ))
+		return;
+
+	mdb_env_info( mdb->mi_dbenv, &ei );
+	if ( mdb->mi_grow_max && ei.me_mapsize >= mdb->mi_grow_max )
+		return;
+	mdb_env_stat( mdb->mi_dbenv, &st );
+	if ( ei.me_mapsize - ( ei.me_last_pgno + 1 ) * st.ms_psize >= mdb->mi_grow_step )
+		return;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( !mdb->mi_grow_task ) {
+		/* runs right away; the interval keeps it from coming back */
+		mdb->mi_grow_task = ldap_pvt_runqueue_insert( &slapd_rq, 36000,
+			mdb_maxsize_grow, mdb, LDAP_XSTRING(mdb_maxsize_grow),
+			op->o_bd->be_suffix[0].bv_val );
+		slap_wake_listener();
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
+/* Run the suspended index task again right away. The task's
+ * interval is only there to keep it from being rescheduled, so
+ * zero it while requeueing. rq_mutex must be held.
+ */
+static void
+mdb_index_task_wake( struct re_s *rtask )
+{
+	time_t interval = rtask->interval.tv_sec;
+
+	rtask->interval.tv_sec = 0;
+	ldap_pvt_runqueue_resched( &slapd_rq, rtask, 0 );
+	rtask->interval.tv_sec = interval;
+	slap_wake_listener();
+}
+
+/* Set or clear the pause flag of online indexing. A running task
+ * notices it between batches; a paused one is woken up here.
+ */
+static void
+mdb_index_pause( struct mdb_info *mdb, int paused )
+{
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	mdb->mi_index_paused = paused;
+	if ( !paused && mdb->mi_index_task &&
+		!ldap_pvt_runqueue_isrunning( &slapd_rq, mdb->mi_index_task ))
+	{
+		if ( mdb->mi_index_state == MDB_REINDEX_PAUSED )
+			mdb_index_task_wake( mdb->mi_index_task );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
+/* Count the index task's progress from the first entry again */
+static void
+mdb_index_progress_reset( struct mdb_info *mdb )
+{
+	MDB_txn *txn;
+	MDB_stat ms;
+
+	mdb->mi_index_done = 0;
+	mdb->mi_index_total = 0;
+	if ( mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn ) == 0 ) {
+		if ( mdb_stat( txn, mdb->mi_id2entry, &ms ) == 0 )
+			mdb->mi_index_total = ms.ms_entries;
+		mdb_txn_abort( txn );
+	}
+	mdb->mi_index_run_start = slap_get_time();
+	mdb->mi_index_run_done = 0;
+}
+
+/* reindex entries on the fly, in batches of mi_index_batch
+ * entries per write txn so writers in between aren't held up
+ */
 static void *
 mdb_online_index( void *ctx, void *arg )
 {
@@ -155,9 +403,10 @@ mdb_online_index( void *ctx, void *arg )
 	MDB_cursor *curs;
 	MDB_val key, data;
 	MDB_txn *txn;
-	ID id;
+	struct timeval tv;
+	ID id, n, batch;
 	Entry *e;
-	int rc, getnext = 1;
+	int rc, end = 0;
 	int i;
 
 	connection_fake_init( &conn, &opbuf, ctx );
@@ -165,13 +414,46 @@ mdb_online_index( void *ctx, void *arg )
 
 	op->o_bd = be;
 
-	id = 1;
+	id = mdb->mi_index_next;
+	if ( id == 1 )
+		mdb_index_progress_reset( mdb );
+	/* rate for the ETA is taken from this run only */
+	mdb->mi_index_run_start = slap_get_time();
+	mdb->mi_index_run_done = mdb->mi_index_done;
+	mdb->mi_index_state = MDB_REINDEX_RUNNING;
 	key.mv_size = sizeof(ID);
 
 	while ( 1 ) {
 		if ( slapd_shutdown )
 			break;
 
+		/* let cn=config changes through between batches */
+		ldap_pvt_thread_pool_pausecheck( &connection_pool );
+
+		if ( mdb->mi_index_next != id ) {
+			/* a new index was configured meanwhile, start over */
+			id = mdb->mi_index_next;
+			mdb->mi_index_run_start = slap_get_time();
+			mdb->mi_index_run_done = 0;
+		}
+
+		if ( mdb->mi_index_paused ) {
+			ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+			if ( mdb->mi_index_paused ) {
+				/* stay queued but unscheduled until resumed */
+				mdb->mi_index_next = id;
+				mdb->mi_index_state = MDB_REINDEX_PAUSED;
+				ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+				ldap_pvt_runqueue_resched( &slapd_rq, rtask, 1 );
+				ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+				Debug( LDAP_DEBUG_STATS, LDAP_XSTRING(mdb_online_index)
+					": database %s: paused at entry %lu\n",
+					be->be_suffix[0].bv_val, id, 0 );
+				return NULL;
+			}
+			ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+		}
+
 		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
 		if ( rc )
 			break;
@@ -180,32 +462,37 @@ mdb_online_index( void *ctx, void *arg )
 			mdb_txn_abort( txn );
 			break;
 		}
-		if ( getnext ) {
-			getnext = 0;
-			key.mv_data = &id;
-			rc = mdb_cursor_get( curs, &key, &data, MDB_SET_RANGE );
+
+		batch = mdb->mi_index_batch ? mdb->mi_index_batch : 1;
+		key.mv_data = &id;
+		for ( n = 0; n < batch; n++ ) {
+			rc = mdb_cursor_get( curs, &key, &data,
+				n ? MDB_NEXT : MDB_SET_RANGE );
 			if ( rc ) {
-				mdb_txn_abort( txn );
-				if ( rc == MDB_NOTFOUND )
+				if ( rc == MDB_NOTFOUND ) {
+					end = 1;
 					rc = 0;
+				}
 				break;
 			}
 			memcpy( &id, key.mv_data, sizeof( id ));
-		}
 
-		rc = mdb_id2entry( op, curs, id, &e );
-		mdb_cursor_close( curs );
-		if ( rc ) {
-			mdb_txn_abort( txn );
-			if ( rc == MDB_NOTFOUND ) {
-				id++;
-				getnext = 1;
-				continue;
+			rc = mdb_id2entry( op, curs, id, &e );
+			if ( rc ) {
+				/* stub from a missing parent, nothing to index */
+				if ( rc == MDB_NOTFOUND ) {
+					rc = 0;
+					continue;
+				}
+				break;
 			}
-			break;
+			rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
+			mdb_entry_return( op, e );
+			if ( rc )
+				break;
 		}
-		rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
-		mdb_entry_return( op, e );
+		mdb_cursor_close( curs );
+
 		if ( rc == 0 ) {
 			rc = mdb_txn_commit( txn );
 			txn = NULL;
@@ -220,8 +507,19 @@ mdb_online_index( void *ctx, void *arg )
 				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
 			break;
 		}
+		mdb->mi_index_done += n;
+		if ( end )
+			break;
 		id++;
-		getnext = 1;
+		mdb->mi_index_next = id;
+
+		if ( mdb->mi_index_delay ) {
+			tv.tv_sec = mdb->mi_index_delay / 1000;
+			tv.tv_usec = ( mdb->mi_index_delay % 1000 ) * 1000;
+			select( 0, NULL, NULL, NULL, &tv );
+		} else {
+			ldap_pvt_thread_yield();
+		}
 	}
 
 	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
@@ -237,6 +535,7 @@ mdb_online_index( void *ctx, void *arg )
 	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
 	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
 	mdb->mi_index_task = NULL;
+	mdb->mi_index_state = MDB_REINDEX_IDLE;
 	ldap_pvt_runqueue_remove( &slapd_rq, rtask );
 	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
 
@@ -317,6 +616,46 @@ mdb_cf_gen( ConfigArgs *c )
 			}
 			break;
 
+		case MDB_AUTOGROW:
+			if ( mdb->mi_grow_step ) {
+				char buf[64];
+				struct berval bv;
+				bv.bv_len = snprintf( buf, sizeof(buf), "%lu %lu",
+					(unsigned long) mdb->mi_grow_step,
+					(unsigned long) mdb->mi_grow_max );
+				bv.bv_val = buf;
+				value_add_one( &c->rvalue_vals, &bv );
+			} else {
+				rc = 1;
+			}
+			break;
+
+		case MDB_GROUPCOMMIT:
+			if ( mdb->mi_gc_window ) {
+				char buf[64];
+				struct berval bv;
+				bv.bv_len = snprintf( buf, sizeof(buf), "%u %u",
+					mdb->mi_gc_window, mdb->mi_gc_max );
+				bv.bv_val = buf;
+				value_add_one( &c->rvalue_vals, &bv );
+			} else {
+				rc = 1;
+			}
+			break;
+
+		case MDB_WRITEBATCH:
+			if ( mdb->mi_wb_max ) {
+				char buf[64];
+				struct berval bv;
+				bv.bv_len = snprintf( buf, sizeof(buf), "%u %u",
+					mdb->mi_wb_max, mdb->mi_wb_wait );
+				bv.bv_val = buf;
+				value_add_one( &c->rvalue_vals, &bv );
+			} else {
+				rc = 1;
+			}
+			break;
+
 		case MDB_DIRECTORY:
 			if ( mdb->mi_dbenv_home ) {
 				c->value_string = ch_strdup( mdb->mi_dbenv_home );
@@ -330,6 +669,10 @@ mdb_cf_gen( ConfigArgs *c )
 				c->value_int = 1;
 			break;
 
+		case MDB_INDEXPAUSED:
+			c->value_int = mdb->mi_index_paused;
+			break;
+
 		case MDB_ENVFLAGS:
 			if ( mdb->mi_dbenv_flags ) {
 				mask_to_verbs( mdb_envflags, mdb->mi_dbenv_flags, &c->rvalue_vals );
@@ -354,6 +697,14 @@ mdb_cf_gen( ConfigArgs *c )
 			c->value_ulong = mdb->mi_mapsize;
 			break;
 
+		case MDB_SUBSTRBITS:
+			c->value_uint = mdb->mi_substr_bits;
+			break;
+
+		case MDB_PRESMAP:
+			c->value_int = mdb->mi_presmap;
+			break;
+
 		case MDB_MULTIVAL:
 			mdb_attr_multi_unparse( mdb, &c->rvalue_vals );
 			if ( !c->rvalue_vals ) rc = 1;
@@ -377,6 +728,18 @@ mdb_cf_gen( ConfigArgs *c )
 		case MDB_MAXSIZE:
 			break;
 
+		case MDB_SUBSTRBITS:
+			mdb->mi_substr_bits = 0;
+			break;
+
+		case MDB_PRESMAP:
+			mdb->mi_presmap = 0;
+			if ( mdb->mi_flags & MDB_IS_OPEN ) {
+				mdb->mi_flags |= MDB_RE_OPEN;
+				c->cleanup = mdb_cf_cleanup;
+			}
+			break;
+
 		case MDB_CHKPT:
 			if ( mdb->mi_txn_cp_task ) {
 				struct re_s *re = mdb->mi_txn_cp_task;
@@ -397,10 +760,38 @@ mdb_cf_gen( ConfigArgs *c )
 			ldap_pvt_thread_pool_purgekey( mdb->mi_dbenv );
 			break;
 		case MDB_DBNOSYNC:
-			mdb_env_set_flags( mdb->mi_dbenv, MDB_NOSYNC, 0 );
+			mdb_env_set_flags( mdb->mi_dbenv, MDB_NOSYNC,
+				mdb->mi_gc_window != 0 );
 			mdb->mi_dbenv_flags &= ~MDB_NOSYNC;
 			break;
 
+		case MDB_AUTOGROW:
+			mdb->mi_grow_step = 0;
+			mdb->mi_grow_max = 0;
+			break;
+
+		case MDB_GROUPCOMMIT:
+			mdb->mi_gc_window = 0;
+			mdb->mi_gc_max = 0;
+			if ( mdb->mi_flags & MDB_IS_OPEN ) {
+				if ( !( mdb->mi_dbenv_flags & MDB_NOSYNC ))
+					mdb_env_set_flags( mdb->mi_dbenv, MDB_NOSYNC, 0 );
+				/* writers still waiting will sync for themselves */
+				mdb_env_sync( mdb->mi_dbenv, 1 );
+			}
+			break;
+
+		case MDB_WRITEBATCH:
+			mdb->mi_wb_max = 0;
+			mdb->mi_wb_wait = 0;
+			if ( mdb->mi_flags & MDB_IS_OPEN )
+				mdb_env_set_writebatch( mdb->mi_dbenv, 0, 0 );
+			break;
+
+		case MDB_INDEXPAUSED:
+			mdb_index_pause( mdb, 0 );
+			break;
+
 		case MDB_ENVFLAGS:
 			if ( c->valx == -1 ) {
 				int i;
@@ -414,6 +805,8 @@ mdb_cf_gen( ConfigArgs *c )
 							rc = 0;
 						}
 						mdb->mi_dbenv_flags ^= mdb_envflags[i].mask;
+						if ( mdb_envflags[i].mask == MDB_RDONLY )
+							mdb_cf_rdonly( c, 0 );
 					}
 				}
 			} else {
@@ -426,6 +819,8 @@ mdb_cf_gen( ConfigArgs *c )
 						rc = 0;
 					}
 					mdb->mi_dbenv_flags ^= mdb_envflags[i].mask;
+					if ( mdb_envflags[i].mask == MDB_RDONLY )
+						mdb_cf_rdonly( c, 0 );
 				} else {
 					/* unknown keyword */
 					snprintf( c->cr_msg, sizeof( c->cr_msg ), "%s: unknown keyword \"%s\"",
@@ -668,14 +1063,88 @@ mdb_cf_gen( ConfigArgs *c )
 			mdb->mi_dbenv_flags ^= MDB_NOSYNC;
 		if ( mdb->mi_flags & MDB_IS_OPEN ) {
 			mdb_env_set_flags( mdb->mi_dbenv, MDB_NOSYNC,
-				c->value_int );
+				c->value_int || mdb->mi_gc_window );
+		}
+		break;
+
+	case MDB_AUTOGROW: {
+		unsigned long l;
+		if ( lutil_atoulx( &l, c->argv[1], 0 ) != 0 || !l ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"invalid step \"%s\" in \"autogrow\"", c->argv[1] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		mdb->mi_grow_step = l;
+		l = 0;
+		if ( c->argc > 2 && lutil_atoulx( &l, c->argv[2], 0 ) != 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"invalid max \"%s\" in \"autogrow\"", c->argv[2] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		mdb->mi_grow_max = l;
+		} break;
+
+	case MDB_GROUPCOMMIT: {
+		unsigned u;
+		if ( lutil_atoux( &u, c->argv[1], 0 ) != 0 || !u ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"invalid msec \"%s\" in \"groupcommit\"", c->argv[1] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		mdb->mi_gc_window = u;
+		u = 0;
+		if ( c->argc > 2 && lutil_atoux( &u, c->argv[2], 0 ) != 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"invalid ops \"%s\" in \"groupcommit\"", c->argv[2] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		mdb->mi_gc_max = u;
+		if (( mdb->mi_flags & MDB_IS_OPEN ) && ( slapMode & SLAP_SERVER_MODE ))
+			mdb_env_set_flags( mdb->mi_dbenv, MDB_NOSYNC, 1 );
+		} break;
+
+	case MDB_WRITEBATCH: {
+		unsigned u;
+		if ( lutil_atoux( &u, c->argv[1], 0 ) != 0 || u < 2 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"invalid ops \"%s\" in \"writebatch\"", c->argv[1] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+			return 1;
 		}
+		mdb->mi_wb_max = u;
+		u = 0;
+		if ( c->argc > 2 && lutil_atoux( &u, c->argv[2], 0 ) != 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"invalid usec \"%s\" in \"writebatch\"", c->argv[2] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		mdb->mi_wb_wait = u;
+		if (( mdb->mi_flags & MDB_IS_OPEN ) && ( slapMode & SLAP_SERVER_MODE ))
+			mdb_env_set_writebatch( mdb->mi_dbenv, mdb->mi_wb_max, mdb->mi_wb_wait );
+		} break;
+
+	case MDB_INDEXPAUSED:
+		mdb_index_pause( mdb, c->value_int );
 		break;
 
 	case MDB_ENVFLAGS: {
 		int i, j;
 		for ( i=1; i<c->argc; i++ ) {
 			j = verb_to_mask( c->argv[i], mdb_envflags );
+			if ( mdb_envflags[j].mask == MDB_RDONLY &&
+				mdb_cf_rdonly( c, 1 ))
+			{
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s: \"rdonly\" conflicts with the database's shadow setup",
+					c->argv[0] );
+				Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+				return 1;
+			}
 			if ( mdb_envflags[j].mask ) {
 				if ( mdb->mi_flags & MDB_IS_OPEN )
 					rc = mdb_env_set_flags( mdb->mi_dbenv, mdb_envflags[j].mask, 1 );
@@ -717,10 +1186,24 @@ mdb_cf_gen( ConfigArgs *c )
 					return 1;
 				}
 				ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+				mdb->mi_index_next = 1;
 				mdb->mi_index_task = ldap_pvt_runqueue_insert( &slapd_rq, 36000,
 					mdb_online_index, c->be,
 					LDAP_XSTRING(mdb_online_index), c->be->be_suffix[0].bv_val );
 				ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+			} else {
+				/* The task may already be past entries that need the
+				 * new index. A running one is held in pausecheck while
+				 * we're here and notices the reset when it goes on; a
+				 * stopped one is requeued, and pauses again at the
+				 * first entry if indexpaused is still set.
+				 */
+				mdb_index_progress_reset( mdb );
+				ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+				mdb->mi_index_next = 1;
+				if ( !ldap_pvt_runqueue_isrunning( &slapd_rq, mdb->mi_index_task ))
+					mdb_index_task_wake( mdb->mi_index_task );
+				ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
 			}
 		}
 		break;
@@ -751,6 +1234,26 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case MDB_PRESMAP:
+		mdb->mi_presmap = c->value_int;
+		if ( mdb->mi_flags & MDB_IS_OPEN ) {
+			mdb->mi_flags |= MDB_RE_OPEN;
+			c->cleanup = mdb_cf_cleanup;
+		}
+		break;
+
+	case MDB_SUBSTRBITS:
+		if ( c->value_uint && ( c->value_uint < MDB_SUBSTR_BITS_MIN ||
+			c->value_uint > MDB_SUBSTR_BITS_MAX )) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"\"substrbits\" must be 0 or between %d and %d",
+				MDB_SUBSTR_BITS_MIN, MDB_SUBSTR_BITS_MAX );
+			Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		mdb->mi_substr_bits = c->value_uint;
+		break;
+
 	case MDB_MULTIVAL:
 		rc = mdb_attr_multi_config( mdb, c->fname, c->lineno,
 			c->argc - 1, &c->argv[1], &c->reply);
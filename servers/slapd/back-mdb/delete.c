@@ -22,6 +22,175 @@
 #include "lutil.h"
 #include "back-mdb.h"
 
+#ifdef SLAP_CONTROL_X_TREE_DELETE
+/* Entries removed per txn by a tree delete */
+#define MDB_TREEDEL_BATCH	1000
+
+/* Remove all the entries below base for the tree delete control,
+ * always a leaf first, so that the tree stays consistent between the
+ * txns. With batch set, the txn is committed every batch entries and
+ * a new one begun in *txnp, and *committed is set; those entries stay
+ * deleted if a later one fails. Returns an LDAP result code.
+ */
+static int
+mdb_tree_delete_kids(
+	Operation *op,
+	SlapReply *rs,
+	MDB_txn **txnp,
+	ID base,
+	int batch,
+	int *committed )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_txn *txn = *txnp;
+	MDB_cursor *mc = NULL, *mce = NULL;
+	MDB_val key, data;
+	Entry *e = NULL, *p;
+	ID id, pid, nsubs, pok = NOID;
+	unsigned long ndel = 0;
+	char *ptr;
+	int rc, n = 0;
+
+	for (;;) {
+		if ( op->o_abandon ) {
+			rc = SLAPD_ABANDON;
+			goto done;
+		}
+		if ( !mc ) {
+			rc = mdb_cursor_open( txn, mdb->mi_dn2id, &mc );
+			if ( rc == 0 )
+				rc = mdb_cursor_open( txn, mdb->mi_id2entry, &mce );
+			if ( rc )
+				break;
+		}
+
+		/* go down to the first leaf, its parent's cursor is then
+		 * set on it as mdb_dn2id_delete wants */
+		pid = base;
+		for (;;) {
+			key.mv_size = sizeof(ID);
+			key.mv_data = &pid;
+			rc = mdb_cursor_get( mc, &key, &data, MDB_SET );
+			if ( rc == 0 )
+				rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT_DUP );
+			if ( rc )
+				break;
+			ptr = (char *)data.mv_data + data.mv_size - 2*sizeof(ID);
+			memcpy( &id, ptr, sizeof(ID) );
+			memcpy( &nsubs, ptr + sizeof(ID), sizeof(ID) );
+			if ( nsubs < 2 )
+				break;
+			pid = id;
+		}
+		if ( rc == MDB_NOTFOUND && pid == base ) {
+			/* nothing left below */
+			rc = 0;
+			break;
+		}
+		if ( rc )
+			break;
+
+		if ( !be_isroot( op ) && pid != pok ) {
+			rc = mdb_id2entry( op, mce, pid, &p );
+			if ( rc )
+				break;
+			rc = access_allowed( op, p, slap_schema.si_ad_children,
+				NULL, ACL_WDEL, NULL );
+			mdb_entry_return( op, p );
+			if ( !rc ) {
+				rc = LDAP_INSUFFICIENT_ACCESS;
+				goto done;
+			}
+			pok = pid;
+		}
+		rc = mdb_id2entry( op, mce, id, &e );
+		if ( rc )
+			break;
+		if ( !access_allowed( op, e, slap_schema.si_ad_entry,
+			NULL, ACL_WDEL, NULL ))
+		{
+			rc = LDAP_INSUFFICIENT_ACCESS;
+			goto done;
+		}
+
+		rc = mdb_dn2id_delete( op, mc, id, 1 );
+		if ( rc )
+			break;
+		rc = mdb_index_entry_del( op, txn, e );
+		if ( rc == LDAP_SUCCESS )
+			rc = mdb_presmap_entry( op, txn, SLAP_INDEX_DELETE_OP, e );
+		if ( rc == LDAP_SUCCESS && !SLAP_SHADOW( op->o_bd )) {
+			struct berval vals[2];
+
+			vals[0] = op->o_csn;
+			BER_BVZERO( &vals[1] );
+			rc = mdb_index_values( op, txn, slap_schema.si_ad_entryCSN,
+				vals, 0, SLAP_INDEX_ADD_OP );
+		}
+		if ( rc != LDAP_SUCCESS ) {
+			rc = LDAP_OTHER;
+			goto done;
+		}
+		rc = mdb_id2entry_delete( op->o_bd, txn, e );
+		if ( rc )
+			break;
+		mdb_entry_return( op, e );
+		e = NULL;
+		ndel++;
+
+		if ( batch && ++n >= batch ) {
+			/* the commit closes the cursors */
+			mc = mce = NULL;
+			*txnp = NULL;
+			rc = mdb_commit( mdb, txn );
+			if ( rc )
+				break;
+			*committed = 1;
+			Debug( LDAP_DEBUG_STATS, "%s " LDAP_XSTRING(mdb_delete)
+				": tree delete of \"%s\": %lu entries removed\n",
+				op->o_log_prefix, op->o_req_dn.bv_val, ndel );
+			rc = mdb_txn_begin( mdb->mi_dbenv, NULL,
+				get_lazyCommit( op ) ? MDB_NOMETASYNC : 0, &txn );
+			if ( rc )
+				break;
+			*txnp = txn;
+			n = 0;
+		}
+	}
+
+	/* an MDB error */
+	if ( rc ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<=- " LDAP_XSTRING(mdb_delete) ": tree delete failed: "
+			"%s (%d)\n", mdb_strerror(rc), rc, 0 );
+		rc = LDAP_OTHER;
+	}
+
+done:
+	if ( e )
+		mdb_entry_return( op, e );
+	if ( mc ) {
+		mdb_cursor_close( mce );
+		mdb_cursor_close( mc );
+	}
+	switch ( rc ) {
+	case LDAP_SUCCESS:
+		Debug( LDAP_DEBUG_TRACE,
+			LDAP_XSTRING(mdb_delete) ": tree delete of \"%s\": "
+			"%lu entries removed below it\n",
+			op->o_req_dn.bv_val, ndel, 0 );
+		break;
+	case LDAP_INSUFFICIENT_ACCESS:
+		rs->sr_text = "no write access to subordinate entry";
+		break;
+	case LDAP_OTHER:
+		rs->sr_text = "subtree delete failed";
+		break;
+	}
+	return rc;
+}
+#endif /* SLAP_CONTROL_X_TREE_DELETE */
+
 int
 mdb_delete( Operation *op, SlapReply *rs )
 {
@@ -42,6 +211,9 @@ mdb_delete( Operation *op, SlapReply *rs )
 
 	int	parent_is_glue = 0;
 	int parent_is_leaf = 0;
+#ifdef SLAP_CONTROL_X_TREE_DELETE
+	int	tree_done = 0;
+#endif
 
 	Debug( LDAP_DEBUG_ARGS, "==> " LDAP_XSTRING(mdb_delete) ": %s\n",
 		op->o_req_dn.bv_val, 0, 0 );
@@ -80,6 +252,9 @@ mdb_delete( Operation *op, SlapReply *rs )
 		dnParent( &op->o_req_ndn, &pdn );
 	}
 
+#ifdef SLAP_CONTROL_X_TREE_DELETE
+again:
+#endif
 	rs->sr_err = mdb_cursor_open( txn, mdb->mi_dn2id, &mc );
 	if ( rs->sr_err ) {
 		rs->sr_err = LDAP_OTHER;
@@ -249,6 +424,42 @@ mdb_delete( Operation *op, SlapReply *rs )
 		goto return_results;
 	}
 
+#ifdef SLAP_CONTROL_X_TREE_DELETE
+	if ( get_treeDelete( op ) && !tree_done ) {
+		int committed = 0;
+
+		tree_done = 1;
+		rs->sr_err = mdb_dn2id_children( op, txn, e );
+		if ( rs->sr_err == 0 ) {
+			/* the subordinates would not be seen there */
+			if ( overlay_is_inst( op->o_bd->bd_self, "syncprov" ) ||
+				overlay_is_inst( op->o_bd->bd_self, "accesslog" ))
+			{
+				rs->sr_err = LDAP_UNWILLING_TO_PERFORM;
+				rs->sr_text = "subtree delete not possible with replication";
+				goto return_results;
+			}
+			rs->sr_err = mdb_tree_delete_kids( op, rs, &moi->moi_txn,
+				e->e_id, ( moi == &opinfo && !op->o_noop ) ?
+				MDB_TREEDEL_BATCH : 0, &committed );
+			txn = moi->moi_txn;
+			if ( rs->sr_err != LDAP_SUCCESS )
+				goto return_results;
+
+			/* the writes moved e and p, fetch them again */
+			if ( !committed )
+				mdb_cursor_close( mc );
+			mdb_entry_return( op, e );
+			e = NULL;
+			if ( p ) {
+				mdb_entry_return( op, p );
+				p = NULL;
+			}
+			goto again;
+		}
+	}
+#endif
+
 	/* pre-read */
 	if( op->o_preread ) {
 		if( preread_ctrl == NULL ) {
@@ -317,6 +528,13 @@ mdb_delete( Operation *op, SlapReply *rs )
 		goto return_results;
 	}
 
+	rs->sr_err = mdb_presmap_entry( op, txn, SLAP_INDEX_DELETE_OP, e );
+	if ( rs->sr_err != LDAP_SUCCESS ) {
+		rs->sr_text = "presence map delete failed";
+		rs->sr_err = LDAP_OTHER;
+		goto return_results;
+	}
+
 	/* fixup delete CSN */
 	if ( !SLAP_SHADOW( op->o_bd )) {
 		struct berval vals[2];
@@ -375,7 +593,11 @@ mdb_delete( Operation *op, SlapReply *rs )
 			txn = NULL;
 			goto return_results;
 		} else {
-			rs->sr_err = mdb_txn_commit( txn );
+			rs->sr_err = mdb_commit( mdb, txn );
+			if ( rs->sr_err == 0 )
+				rs->sr_err = mdb_txn_durable( op, mdb );
+			if ( rs->sr_err == 0 )
+				mdb_maxsize_check( op );
 		}
 		txn = NULL;
 	}
@@ -36,6 +36,24 @@ mdb_dn2entry(
 	Entry **e,
 	ID *nsubs,
 	int matched )
+{
+	return mdb_dn2entry_skip( op, tid, m2, dn, e, nsubs, matched, NULL, NULL );
+}
+
+/* As above, leaving out the id2val attributes listed in skip of the
+ * entry itself, see mdb_entry_decode_need.
+ */
+int
+mdb_dn2entry_skip(
+	Operation *op,
+	MDB_txn *tid,
+	MDB_cursor *m2,
+	struct berval *dn,
+	Entry **e,
+	ID *nsubs,
+	int matched,
+	AttributeName *skip,
+	unsigned *skipmask )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	int rc, rc2;
@@ -47,6 +65,8 @@ mdb_dn2entry(
 		dn->bv_val ? dn->bv_val : "", 0, 0 );
 
 	*e = NULL;
+	if ( skipmask )
+		*skipmask = 0;
 
 	rc = mdb_dn2id( op, tid, m2, dn, &id, nsubs, &mbv, &nmbv );
 	if ( rc ) {
@@ -61,7 +81,7 @@ mdb_dn2entry(
 	} else {
 		rc = mdb_cursor_open( tid, mdb->mi_id2entry, &mc );
 		if ( rc == MDB_SUCCESS ) {
-			rc = mdb_id2entry( op, mc, id, e );
+			rc = mdb_id2entry_skip( op, mc, id, e, skip, skipmask );
 			mdb_cursor_close(mc);
 		}
 	}
@@ -517,11 +517,17 @@ done:
 	return rc;
 }
 
+/* Return the number of immediate children of e. The entry's own node
+ * shares its key with one child node per child, and LMDB keeps the
+ * count of each key's sorted duplicates, so this costs a single
+ * lookup however many children there are.
+ */
 int
-mdb_dn2id_children(
+mdb_dn2id_nkids(
 	Operation *op,
 	MDB_txn *txn,
-	Entry *e )
+	Entry *e,
+	ID *nkids )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	MDB_dbi dbi = mdb->mi_dn2id;
@@ -541,14 +547,28 @@ mdb_dn2id_children(
 	if ( rc == 0 ) {
 		size_t dkids;
 		rc = mdb_cursor_count( cursor, &dkids );
-		if ( rc == 0 ) {
-			if ( dkids < 2 ) rc = MDB_NOTFOUND;
-		}
+		if ( rc == 0 )
+			*nkids = dkids - 1;
 	}
 	mdb_cursor_close( cursor );
 	return rc;
 }
 
+int
+mdb_dn2id_children(
+	Operation *op,
+	MDB_txn *txn,
+	Entry *e )
+{
+	ID nkids;
+	int rc;
+
+	rc = mdb_dn2id_nkids( op, txn, e, &nkids );
+	if ( rc == 0 && !nkids )
+		rc = MDB_NOTFOUND;
+	return rc;
+}
+
 int
 mdb_id2name(
 	Operation *op,
@@ -782,7 +802,30 @@ mdb_idscopes(
 			rc = 1;
 		}
 		if ( op->ors_scope == LDAP_SCOPE_ONELEVEL )
-			break;
+			return MDB_SUCCESS;
+
+		/* An ancestor already known to be out of scope */
+		if ( isc->outscopes ) {
+			x = mdb_id2l_search( isc->outscopes, id );
+			if ( x <= isc->outscopes[0].mid && isc->outscopes[x].mid == id )
+				break;
+		}
+	}
+
+	/* Not in scope. Remember the chain we walked so that candidates
+	 * sharing these parents stop as soon as they reach one of them.
+	 * Nothing on the chain was cached in scopes, so sctmp holds all
+	 * of it but the candidate itself.
+	 */
+	if ( isc->outscopes ) {
+		int i;
+		id2.mid = isc->id;
+		id2.mval.mv_data = NULL;
+		mdb_id2l_insert( isc->outscopes, &id2 );
+		for ( i = 1; i <= isc->sctmp[0].mid; i++ ) {
+			if ( mdb_id2l_insert( isc->outscopes, &isc->sctmp[i] ) == -2 )
+				break;
+		}
 	}
 	return MDB_SUCCESS;
 }
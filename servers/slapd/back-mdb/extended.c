@@ -19,16 +19,298 @@
 #include <stdio.h>
 #include <ac/string.h>
 
+#include <ac/unistd.h>
+
 #include "back-mdb.h"
 #include "lber_pvt.h"
 
+static const struct berval mdb_exop_snapshot_oid =
+	BER_BVC(LDAP_EXOP_X_MDB_SNAPSHOT);
+
+static BI_op_extended mdb_exop_snapshot;
+
 static struct exop {
 	struct berval *oid;
 	BI_op_extended	*extended;
 } exop_table[] = {
+	{ (struct berval *)&mdb_exop_snapshot_oid, mdb_exop_snapshot },
 	{ NULL, NULL }
 };
 
+/* size of the pieces the snapshot is sent in */
+#define MDB_SNAPSHOT_CHUNK	(256*1024)
+
+typedef struct mdb_snapshot {
+	MDB_env *ms_env;
+	int ms_fd;
+	int ms_rc;
+} mdb_snapshot;
+
+static void *
+mdb_snapshot_copy( void *arg )
+{
+	mdb_snapshot *ms = arg;
+
+	ms->ms_rc = mdb_env_copyfd2( ms->ms_env, ms->ms_fd, MDB_CP_COMPACT );
+	close( ms->ms_fd );
+	return NULL;
+}
+
+static int
+mdb_snapshot_csn_cb( Operation *op, SlapReply *rs )
+{
+	if ( rs->sr_type == REP_SEARCH ) {
+		BerVarray *csns = op->o_callback->sc_private;
+		Attribute *a;
+
+		a = attr_find( rs->sr_operational_attrs,
+			slap_schema.si_ad_contextCSN );
+		if ( !a )
+			a = attr_find( rs->sr_entry->e_attrs,
+				slap_schema.si_ad_contextCSN );
+		if ( a && !*csns )
+			ber_bvarray_dup_x( csns, a->a_vals, op->o_tmpmemctx );
+	}
+	return LDAP_SUCCESS;
+}
+
+/*
+ * Store the contextCSN the overlays currently report for the suffix,
+ * which may be ahead of the one last checkpointed. With the server
+ * paused no write is in flight, so it exactly matches the data.
+ */
+static BerVarray
+mdb_snapshot_ctxcsn( Operation *op )
+{
+	Operation op2 = *op;
+	SlapReply rs2 = {REP_RESULT};
+	slap_callback cb = {0};
+	AttributeName an[2];
+	BerVarray csns = NULL;
+
+	cb.sc_response = mdb_snapshot_csn_cb;
+	cb.sc_private = &csns;
+
+	op2.o_tag = LDAP_REQ_SEARCH;
+	op2.o_bd = op->o_bd->bd_self;
+	op2.o_callback = &cb;
+	op2.o_req_dn = op2.o_bd->be_suffix[0];
+	op2.o_req_ndn = op2.o_bd->be_nsuffix[0];
+	op2.ors_scope = LDAP_SCOPE_BASE;
+	op2.ors_deref = LDAP_DEREF_NEVER;
+	op2.ors_limit = NULL;
+	op2.ors_tlimit = SLAP_NO_LIMIT;
+	op2.ors_slimit = 1;
+	op2.ors_filterstr = *slap_filterstr_objectClass_pres;
+	op2.ors_filter = (Filter *) slap_filter_objectClass_pres;
+	an[0].an_name = slap_schema.si_ad_contextCSN->ad_cname;
+	an[0].an_desc = slap_schema.si_ad_contextCSN;
+	BER_BVZERO( &an[1].an_name );
+	op2.ors_attrs = an;
+	op2.ors_attrsonly = 0;
+	op2.o_managedsait = SLAP_CONTROL_NONCRITICAL;
+	op2.o_sync = SLAP_CONTROL_NONE;
+	op2.o_bd->be_search( &op2, &rs2 );
+
+	if ( csns ) {
+		Modifications mod;
+		SlapReply rsm = {REP_RESULT};
+
+		for ( mod.sml_numvals = 0; !BER_BVISNULL( &csns[mod.sml_numvals] );
+			mod.sml_numvals++ );
+		mod.sml_values = csns;
+		mod.sml_nvalues = NULL;
+		mod.sml_desc = slap_schema.si_ad_contextCSN;
+		mod.sml_op = LDAP_MOD_REPLACE;
+		mod.sml_flags = SLAP_MOD_INTERNAL;
+		mod.sml_next = NULL;
+
+		cb.sc_response = slap_null_cb;
+		cb.sc_private = NULL;
+		op2 = *op;
+		op2.o_tag = LDAP_REQ_MODIFY;
+		op2.o_callback = &cb;
+		op2.orm_modlist = &mod;
+		op2.orm_no_opattrs = 1;
+		op2.o_req_dn = op->o_bd->be_suffix[0];
+		op2.o_req_ndn = op->o_bd->be_nsuffix[0];
+		op2.o_managedsait = SLAP_CONTROL_NONCRITICAL;
+		op2.o_no_schema_check = 1;
+		op2.o_dont_replicate = 1;
+		op2.o_opid = -1;
+		BER_BVZERO( &op2.o_csn );
+		mdb_modify( &op2, &rsm );
+	}
+	return csns;
+}
+
+/*
+ * Stream a compacted copy of the environment as intermediate
+ * responses, for seeding a consumer. The copy is a consistent
+ * snapshot, and its suffix entry carries the matching contextCSN,
+ * which is also returned in the final response.
+ */
+static int
+mdb_exop_snapshot( Operation *op, SlapReply *rs )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_snapshot ms;
+	ldap_pvt_thread_t tid;
+	BerVarray csns = NULL;
+	struct berval chunk;
+	int fds[2], started = 0;
+	ssize_t len;
+
+	if ( !be_issuffix( op->o_bd, &op->o_req_ndn )) {
+		rs->sr_text = "not the suffix of a database";
+		return rs->sr_err = LDAP_UNWILLING_TO_PERFORM;
+	}
+	if ( !be_isroot( op )) {
+		rs->sr_text = "only the rootdn may take a snapshot";
+		return rs->sr_err = LDAP_INSUFFICIENT_ACCESS;
+	}
+
+	if ( pipe( fds ) < 0 ) {
+		rs->sr_text = "unable to create pipe";
+		return rs->sr_err = LDAP_OTHER;
+	}
+
+	chunk.bv_val = ch_malloc( MDB_SNAPSHOT_CHUNK );
+	ms.ms_env = mdb->mi_dbenv;
+	ms.ms_fd = fds[1];
+	ms.ms_rc = 0;
+
+	Statslog( LDAP_DEBUG_STATS, "%s SNAPSHOT dn=\"%s\"\n",
+		op->o_log_prefix, op->o_req_ndn.bv_val, 0, 0, 0 );
+
+	/* Nothing gets written between taking the contextCSN and the start
+	 * of the copy's read txn, which has begun once data arrives.
+	 */
+	if ( slap_pause_server() < 0 ) {
+		rs->sr_text = "unable to pause the server";
+		rs->sr_err = LDAP_OTHER;
+		close( fds[0] );
+		close( fds[1] );
+		goto done;
+	}
+	csns = mdb_snapshot_ctxcsn( op );
+	if ( ldap_pvt_thread_create( &tid, 0, mdb_snapshot_copy, &ms ) == 0 ) {
+		started = 1;
+		len = read( fds[0], chunk.bv_val, MDB_SNAPSHOT_CHUNK );
+	} else {
+		close( fds[1] );
+		len = -1;
+	}
+	slap_unpause_server();
+
+	rs->sr_rspoid = mdb_exop_snapshot_oid.bv_val;
+	rs->sr_rspdata = &chunk;
+	while ( len > 0 ) {
+		ssize_t n;
+
+		/* fill the chunk, the pipe gives us less at a time */
+		chunk.bv_len = len;
+		while ( chunk.bv_len < MDB_SNAPSHOT_CHUNK ) {
+			n = read( fds[0], chunk.bv_val + chunk.bv_len,
+				MDB_SNAPSHOT_CHUNK - chunk.bv_len );
+			if ( n <= 0 )
+				break;
+			chunk.bv_len += n;
+		}
+		if ( op->o_abandon )
+			break;
+		send_ldap_intermediate( op, rs );
+		if ( chunk.bv_len < MDB_SNAPSHOT_CHUNK )
+			break;
+		len = read( fds[0], chunk.bv_val, MDB_SNAPSHOT_CHUNK );
+	}
+	rs->sr_rspoid = NULL;
+	rs->sr_rspdata = NULL;
+
+	/* an abandoned copy fails its next write */
+	close( fds[0] );
+	if ( started )
+		ldap_pvt_thread_join( tid, NULL );
+
+	if ( op->o_abandon ) {
+		rs->sr_err = SLAPD_ABANDON;
+	} else if ( !started || ms.ms_rc ) {
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_exop_snapshot)
+			": copy failed: %s (%d)\n",
+			started ? mdb_strerror( ms.ms_rc ) : "no thread", ms.ms_rc, 0 );
+		rs->sr_text = "snapshot failed";
+		rs->sr_err = LDAP_OTHER;
+	} else {
+		BerElementBuffer berbuf;
+		BerElement *ber = (BerElement *)&berbuf;
+
+		ber_init2( ber, NULL, LBER_USE_DER );
+		ber_printf( ber, "{W}", csns );
+		rs->sr_rspdata = ch_calloc( 1, sizeof( struct berval ));
+		ber_flatten2( ber, rs->sr_rspdata, 1 );
+		ber_free_buf( ber );
+		rs->sr_rspoid = ch_strdup( mdb_exop_snapshot_oid.bv_val );
+		rs->sr_err = LDAP_SUCCESS;
+	}
+
+done:
+	ch_free( chunk.bv_val );
+	if ( csns )
+		ber_bvarray_free_x( csns, op->o_tmpmemctx );
+	return rs->sr_err;
+}
+
+/*
+ * Find the database named in the request and pass the request to it
+ */
+static int
+mdb_exop_snapshot_main( Operation *op, SlapReply *rs )
+{
+	BackendDB *bd = op->o_bd;
+	struct berval dn;
+
+	if ( op->ore_reqdata == NULL || BER_BVISEMPTY( op->ore_reqdata )) {
+		rs->sr_text = "no suffix given";
+		return rs->sr_err = LDAP_PROTOCOL_ERROR;
+	}
+
+	dn = *op->ore_reqdata;
+	rs->sr_err = dnPrettyNormal( NULL, &dn, &op->o_req_dn, &op->o_req_ndn,
+		op->o_tmpmemctx );
+	if ( rs->sr_err != LDAP_SUCCESS ) {
+		rs->sr_text = "invalid suffix";
+		return rs->sr_err = LDAP_INVALID_DN_SYNTAX;
+	}
+
+	op->o_bd = select_backend( &op->o_req_ndn, 0 );
+	if ( op->o_bd == NULL ) {
+		rs->sr_text = "no such database";
+		rs->sr_err = LDAP_NO_SUCH_OBJECT;
+	} else if ( op->o_bd->be_extended == NULL ) {
+		rs->sr_text = "not supported within naming context";
+		rs->sr_err = LDAP_UNWILLING_TO_PERFORM;
+	} else {
+		rs->sr_err = backend_check_restrictions( op, rs,
+			(struct berval *)&mdb_exop_snapshot_oid );
+		if ( rs->sr_err == LDAP_SUCCESS )
+			op->o_bd->be_extended( op, rs );
+	}
+
+	op->o_tmpfree( op->o_req_dn.bv_val, op->o_tmpmemctx );
+	op->o_tmpfree( op->o_req_ndn.bv_val, op->o_tmpmemctx );
+	BER_BVZERO( &op->o_req_dn );
+	BER_BVZERO( &op->o_req_ndn );
+	op->o_bd = bd;
+	return rs->sr_err;
+}
+
+int
+mdb_exop_init( void )
+{
+	return load_extop2( &mdb_exop_snapshot_oid, SLAP_EXOP_HIDE,
+		mdb_exop_snapshot_main, 0 );
+}
+
 int
 mdb_extended( Operation *op, SlapReply *rs )
 /*	struct berval		*reqoid,
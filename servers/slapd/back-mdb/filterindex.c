@@ -17,6 +17,7 @@
 #include "portable.h"
 
 #include <stdio.h>
+#include <ac/stdarg.h>
 #include <ac/string.h>
 
 #include "back-mdb.h"
@@ -25,6 +26,33 @@
 #include <component.h>
 #endif
 
+/* While the later components of an AND are evaluated, the candidates
+ * the AND has found so far are kept under this thread key. Bitmap
+ * index slots are then only probed for those IDs: anything else they
+ * hold would be dropped by the AND anyway.
+ */
+static ID *
+and_cands( Operation *op )
+{
+	void *cands = NULL;
+
+	if ( op->o_threadctx )
+		ldap_pvt_thread_pool_getkey( op->o_threadctx, (void *)and_cands,
+			&cands, NULL );
+	return cands;
+}
+
+static ID *
+and_cands_set( Operation *op, ID *cands )
+{
+	void *old = NULL;
+
+	if ( op->o_threadctx )
+		ldap_pvt_thread_pool_setkey( op->o_threadctx, (void *)and_cands,
+			cands, NULL, &old, NULL );
+	return old;
+}
+
 static int presence_candidates(
 	Operation *op,
 	MDB_txn *rtxn,
@@ -37,13 +65,20 @@ static int equality_candidates(
 	AttributeAssertion *ava,
 	ID *ids,
 	ID *tmp );
-static int inequality_candidates(
+static struct berval *range_key(
+	Operation *op,
+	AttributeDescription *desc,
+	slap_mask_t mask,
+	struct berval *prefix,
+	struct berval *value );
+static int range_candidates(
 	Operation *op,
 	MDB_txn *rtxn,
-	AttributeAssertion *ava,
+	AttributeDescription *desc,
+	struct berval *lo,
+	struct berval *hi,
 	ID *ids,
-	ID *tmp,
-	int gtorlt );
+	ID *tmp );
 static int approx_candidates(
 	Operation *op,
 	MDB_txn *rtxn,
@@ -97,6 +132,137 @@ ava_comp_candidates (
 		ID *stack);
 #endif
 
+static void
+explain_vadd( Operation *op, struct berval *bv, const char *fmt, va_list ap )
+{
+	char buf[ 1024 ];
+	int len;
+
+	len = vsnprintf( buf, sizeof( buf ), fmt, ap );
+	if ( len < 0 )
+		return;
+	if ( len >= sizeof( buf ))
+		len = sizeof( buf ) - 1;
+	bv->bv_val = op->o_tmprealloc( bv->bv_val, bv->bv_len + len + 1,
+		op->o_tmpmemctx );
+	AC_MEMCPY( bv->bv_val + bv->bv_len, buf, len + 1 );
+	bv->bv_len += len;
+}
+
+/* Add a step to the plan of an explained search, indented by the
+ * depth of the filter being evaluated. Returns the step's slot for
+ * mdb_explain_more, or -1 once the plan is full.
+ */
+int
+mdb_explain_step( Operation *op, const char *fmt, ... )
+{
+	mdb_explain *me = get_explain( op ) ? op->o_explain_plan : NULL;
+	struct berval *bv;
+	va_list ap;
+	int slot;
+
+	if ( me->me_nlines >= MDB_EXPLAIN_MAX ) {
+		me->me_dropped++;
+		return -1;
+	}
+	if (( me->me_nlines & 15 ) == 0 ) {
+		me->me_lines = op->o_tmprealloc( me->me_lines,
+			( me->me_nlines + 17 ) * sizeof( struct berval ),
+			op->o_tmpmemctx );
+	}
+	slot = me->me_nlines++;
+	bv = &me->me_lines[ slot ];
+	bv->bv_len = 2 * me->me_depth;
+	bv->bv_val = op->o_tmpalloc( bv->bv_len + 1, op->o_tmpmemctx );
+	memset( bv->bv_val, ' ', bv->bv_len );
+	bv->bv_val[ bv->bv_len ] = '\0';
+	BER_BVZERO( &me->me_lines[ me->me_nlines ] );
+
+	va_start( ap, fmt );
+	explain_vadd( op, bv, fmt, ap );
+	va_end( ap );
+	return slot;
+}
+
+/* Append to a step added by mdb_explain_step */
+void
+mdb_explain_more( Operation *op, int slot, const char *fmt, ... )
+{
+	mdb_explain *me = get_explain( op ) ? op->o_explain_plan : NULL;
+	va_list ap;
+
+	if ( slot < 0 )
+		return;
+	va_start( ap, fmt );
+	explain_vadd( op, &me->me_lines[ slot ], fmt, ap );
+	va_end( ap );
+}
+
+/* Append the size of a candidate list to a step */
+void
+mdb_explain_ids( Operation *op, int slot, ID *ids )
+{
+	if ( MDB_IDL_IS_RANGE( ids )) {
+		mdb_explain_more( op, slot, " ids=range(%lu-%lu)",
+			(unsigned long) MDB_IDL_RANGE_FIRST( ids ),
+			(unsigned long) MDB_IDL_RANGE_LAST( ids ));
+	} else {
+		mdb_explain_more( op, slot, " ids=%lu", (unsigned long) ids[0] );
+	}
+}
+
+/* The index an explained filter component looks up, "none" if
+ * that attribute has no such index
+ */
+static const char *
+explain_index( Operation *op, Filter *f )
+{
+	AttributeDescription *ad;
+	MDB_dbi dbi;
+	slap_mask_t mask;
+	struct berval prefix;
+	const char *name;
+	int ftype = f->f_choice;
+
+	switch ( ftype ) {
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		name = "pres";
+		break;
+	case LDAP_FILTER_EQUALITY:
+		ad = f->f_av_desc;
+		name = "eq";
+		break;
+	case LDAP_FILTER_APPROX:
+		ad = f->f_av_desc;
+		name = "approx";
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		name = "sub";
+		break;
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		ad = f->f_av_desc;
+		if ( ad->ad_type->sat_ordering &&
+			( ad->ad_type->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX ) ) {
+			ftype = LDAP_FILTER_EQUALITY;
+			name = "eq";
+		} else {
+			ftype = LDAP_FILTER_PRESENT;
+			name = "pres";
+		}
+		break;
+	case LDAP_FILTER_EXT:
+		return "ext";
+	default:
+		return NULL;
+	}
+	if ( mdb_index_param( op->o_bd, ad, ftype, &dbi, &mask, &prefix ))
+		return "none";
+	return name;
+}
+
 int
 mdb_filter_candidates(
 	Operation *op,
@@ -106,12 +272,41 @@ mdb_filter_candidates(
 	ID *tmp,
 	ID *stack )
 {
-	int rc = 0;
+	int rc = 0, slot = -1, all = 0;
+	mdb_explain *me = get_explain( op ) ? op->o_explain_plan : NULL;
 #ifdef LDAP_COMP_MATCH
 	AttributeAliasing *aa;
 #endif
 	Debug( LDAP_DEBUG_FILTER, "=> mdb_filter_candidates\n", 0, 0, 0 );
 
+	if ( me ) {
+		const char *ix;
+
+		switch ( f->f_choice ) {
+		case LDAP_FILTER_AND:
+			slot = mdb_explain_step( op, "&" );
+			break;
+		case LDAP_FILTER_OR:
+			slot = mdb_explain_step( op, "|" );
+			break;
+		case LDAP_FILTER_NOT:
+			slot = mdb_explain_step( op, "! not indexed" );
+			break;
+		default: {
+			struct berval fstr;
+
+			filter2bv_x( op, f, &fstr );
+			slot = mdb_explain_step( op, "%s", fstr.bv_val );
+			op->o_tmpfree( fstr.bv_val, op->o_tmpmemctx );
+			ix = explain_index( op, f );
+			if ( ix )
+				mdb_explain_more( op, slot, " index=%s", ix );
+			}
+		}
+		me->me_depth++;
+	}
+
+
 	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
 		MDB_IDL_ZERO( ids );
 		goto out;
@@ -169,7 +364,8 @@ mdb_filter_candidates(
 		Debug( LDAP_DEBUG_FILTER, "\tGE\n", 0, 0, 0 );
 		if( f->f_ava->aa_desc->ad_type->sat_ordering &&
 			( f->f_ava->aa_desc->ad_type->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX ) )
-			rc = inequality_candidates( op, rtxn, f->f_ava, ids, tmp, LDAP_FILTER_GE );
+			rc = range_candidates( op, rtxn, f->f_av_desc,
+				&f->f_av_value, NULL, ids, tmp );
 		else
 			rc = presence_candidates( op, rtxn, f->f_ava->aa_desc, ids );
 		break;
@@ -179,7 +375,8 @@ mdb_filter_candidates(
 		Debug( LDAP_DEBUG_FILTER, "\tLE\n", 0, 0, 0 );
 		if( f->f_ava->aa_desc->ad_type->sat_ordering &&
 			( f->f_ava->aa_desc->ad_type->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX ) )
-			rc = inequality_candidates( op, rtxn, f->f_ava, ids, tmp, LDAP_FILTER_LE );
+			rc = range_candidates( op, rtxn, f->f_av_desc,
+				NULL, &f->f_av_value, ids, tmp );
 		else
 			rc = presence_candidates( op, rtxn, f->f_ava->aa_desc, ids );
 		break;
@@ -215,6 +412,7 @@ mdb_filter_candidates(
 		struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 		ID last;
 
+		all = 1;
 		if ( mdb->mi_nextid ) {
 			last = mdb->mi_nextid;
 		} else {
@@ -238,6 +436,14 @@ mdb_filter_candidates(
 	}
 
 out:
+	if ( me ) {
+		me->me_depth--;
+		if ( all )
+			mdb_explain_more( op, slot, " ids=all" );
+		else
+			mdb_explain_ids( op, slot, ids );
+	}
+
 	Debug( LDAP_DEBUG_FILTER,
 		"<= mdb_filter_candidates: id=%ld first=%ld last=%ld\n",
 		(long) ids[0],
@@ -389,7 +595,7 @@ comp_equality_candidates (
 		return 0;
 	}
 	for ( i= 0; keys[i].bv_val != NULL; i++ ) {
-		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0 );
+		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0, NULL );
 
 		if( rc == MDB_NOTFOUND ) {
 			MDB_IDL_ZERO( ids );
@@ -558,6 +764,253 @@ base:
 	return 0;
 }
 
+/* An AND whose candidates have shrunk to this many IDs reads no more
+ * indexes: the search tests every candidate against the whole filter
+ * anyway.
+ */
+#define MDB_AND_STOP	16
+
+/* Components whose cost can't be estimated sort after those with up
+ * to this many IDs, and before unindexed ones.
+ */
+#define MDB_COST_UNKNOWN	MDB_IDL_DB_SIZE
+
+/* Estimate the number of IDs an index lookup for desc would return,
+ * from the item counts of its keys.
+ */
+static ID
+key_cost(
+	Operation *op,
+	MDB_txn *rtxn,
+	AttributeDescription *desc,
+	int ftype,
+	struct berval *value )
+{
+	MDB_dbi	dbi;
+	slap_mask_t mask;
+	struct berval prefix = {0, NULL};
+	struct berval *keys = NULL;
+	MatchingRule *mr;
+	ID cost, n;
+	int i, rc;
+
+	rc = mdb_index_param( op->o_bd, desc, ftype, &dbi, &mask, &prefix );
+	if ( rc == LDAP_INAPPROPRIATE_MATCHING )
+		return NOID;
+	if ( rc != LDAP_SUCCESS )
+		return MDB_COST_UNKNOWN;
+
+	if ( ftype == LDAP_FILTER_PRESENT ) {
+		if ( prefix.bv_val == NULL )
+			return MDB_COST_UNKNOWN;
+		rc = mdb_key_count( rtxn, dbi, &prefix, &n );
+		if ( rc == MDB_NOTFOUND )
+			return 0;
+		return rc ? MDB_COST_UNKNOWN : n;
+	}
+
+	mr = desc->ad_type->sat_equality;
+	if ( !mr || !mr->smr_filter )
+		return NOID;
+	rc = (mr->smr_filter)( LDAP_FILTER_EQUALITY, mask,
+		desc->ad_type->sat_syntax, mr, &prefix, value,
+		&keys, op->o_tmpmemctx );
+	if ( rc != LDAP_SUCCESS || keys == NULL )
+		return NOID;
+
+	/* the keys are ANDed, so the smallest one bounds the result */
+	cost = MDB_COST_UNKNOWN;
+	for ( i = 0; keys[i].bv_val != NULL; i++ ) {
+		rc = mdb_key_count( rtxn, dbi, &keys[i], &n );
+		if ( rc == MDB_NOTFOUND ) {
+			cost = 0;
+			break;
+		}
+		if ( rc == 0 && ( i == 0 || n < cost ))
+			cost = n;
+	}
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	return cost;
+}
+
+/* At most this many index keys are counted one by one to estimate the
+ * size of a range; the rest of a longer range is estimated by LMDB.
+ */
+#define MDB_RANGE_COST_KEYS	64
+
+/* Whether f is a >= or <= the ordered index of its attribute can
+ * answer, as a scan of the keys from or up to its value
+ */
+static int
+range_indexed( Operation *op, Filter *f )
+{
+	AttributeDescription *ad;
+	MDB_dbi dbi;
+	slap_mask_t mask;
+	struct berval prefix;
+
+	if ( f->f_choice != LDAP_FILTER_GE && f->f_choice != LDAP_FILTER_LE )
+		return 0;
+	ad = f->f_av_desc;
+	if ( !ad->ad_type->sat_ordering ||
+		!( ad->ad_type->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX ))
+		return 0;
+	return mdb_index_param( op->o_bd, ad, LDAP_FILTER_EQUALITY,
+		&dbi, &mask, &prefix ) == LDAP_SUCCESS;
+}
+
+/* Whether f can share one scan with an opposite bound on its attribute:
+ * only if an entry matching both has a value between them. An entry with
+ * x=2 and x=7 matches (x>=5)(x<=3) without one, and so does one with
+ * x;lang-a=2 and x;lang-b=7, or with values of a subtype of x, since all
+ * of these go to the same index keys. Every description stored in the
+ * database is known once it is open, so a type without tagged variants
+ * or subtypes cannot have such values in our snapshot.
+ */
+static int
+range_pairable( Operation *op, Filter *f )
+{
+	AttributeDescription *ad;
+
+	if ( !range_indexed( op, f ))
+		return 0;
+	ad = f->f_av_desc;
+	return ad->ad_type->sat_single_value && ad == ad->ad_type->sat_ad &&
+		ad->ad_next == NULL && ad->ad_type->sat_subtypes == NULL;
+}
+
+/* Estimate the number of IDs with a value of desc between lo and hi */
+static ID
+range_cost(
+	Operation *op,
+	MDB_txn *rtxn,
+	AttributeDescription *desc,
+	struct berval *lo,
+	struct berval *hi )
+{
+	MDB_dbi	dbi;
+	slap_mask_t mask;
+	struct berval prefix = {0, NULL};
+	struct berval *lokeys = NULL, *hikeys = NULL;
+	ID cost = MDB_COST_UNKNOWN;
+	int rc;
+
+	rc = mdb_index_param( op->o_bd, desc, LDAP_FILTER_EQUALITY,
+		&dbi, &mask, &prefix );
+	if ( rc != LDAP_SUCCESS )
+		return MDB_COST_UNKNOWN;
+
+	if ( lo && ( lokeys = range_key( op, desc, mask, &prefix, lo )) == NULL )
+		goto done;
+	if ( hi && ( hikeys = range_key( op, desc, mask, &prefix, hi )) == NULL )
+		goto done;
+
+	rc = mdb_key_range_count( rtxn, dbi,
+		lokeys ? &lokeys[0] : NULL, hikeys ? &hikeys[0] : NULL,
+		MDB_RANGE_COST_KEYS, &cost );
+	if ( rc )
+		cost = MDB_COST_UNKNOWN;
+
+done:
+	if ( lokeys )
+		ber_bvarray_free_x( lokeys, op->o_tmpmemctx );
+	if ( hikeys )
+		ber_bvarray_free_x( hikeys, op->o_tmpmemctx );
+	return cost;
+}
+
+/* The >= and the <= of a pair of range components, in that order */
+static void
+range_bounds( Filter *f, Filter *pair, struct berval **lo, struct berval **hi )
+{
+	*lo = *hi = NULL;
+	if ( f->f_choice == LDAP_FILTER_GE ) {
+		*lo = &f->f_av_value;
+		if ( pair )
+			*hi = &pair->f_av_value;
+	} else {
+		*hi = &f->f_av_value;
+		if ( pair )
+			*lo = &pair->f_av_value;
+	}
+}
+
+/* Evaluate f and the opposite inequality on the same attribute that
+ * was paired with it as one bounded scan of the index
+ */
+static int
+range_pair_candidates(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter *f,
+	Filter *pair,
+	ID *ids,
+	ID *tmp )
+{
+	mdb_explain *me = get_explain( op ) ? op->o_explain_plan : NULL;
+	struct berval *lo, *hi;
+	int rc, slot = -1;
+
+	if ( me ) {
+		struct berval fstr, pstr;
+
+		filter2bv_x( op, f, &fstr );
+		filter2bv_x( op, pair, &pstr );
+		slot = mdb_explain_step( op, "%s%s index=eq range",
+			fstr.bv_val, pstr.bv_val );
+		op->o_tmpfree( pstr.bv_val, op->o_tmpmemctx );
+		op->o_tmpfree( fstr.bv_val, op->o_tmpmemctx );
+	}
+
+	range_bounds( f, pair, &lo, &hi );
+	rc = range_candidates( op, rtxn, f->f_av_desc, lo, hi, ids, tmp );
+
+	if ( me )
+		mdb_explain_ids( op, slot, ids );
+	return rc;
+}
+
+static ID
+filter_cost(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter *f,
+	Filter *pair )
+{
+	struct berval *lo, *hi;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED )
+		return 0;
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		return f->f_result == LDAP_COMPARE_TRUE ? NOID : 0;
+	case LDAP_FILTER_PRESENT:
+		if ( f->f_desc == slap_schema.si_ad_objectClass )
+			return NOID;
+		return key_cost( op, rtxn, f->f_desc, LDAP_FILTER_PRESENT, NULL );
+	case LDAP_FILTER_EQUALITY:
+		if ( f->f_av_desc == slap_schema.si_ad_entryDN )
+			return 1;
+#ifdef LDAP_COMP_MATCH
+		if ( is_aliased_attribute && is_aliased_attribute( f->f_av_desc ))
+			return MDB_COST_UNKNOWN;
+#endif
+		return key_cost( op, rtxn, f->f_av_desc, LDAP_FILTER_EQUALITY,
+			&f->f_av_value );
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		if ( !range_indexed( op, f ))
+			break;
+		range_bounds( f, pair, &lo, &hi );
+		return range_cost( op, rtxn, f->f_av_desc, lo, hi );
+	case LDAP_FILTER_NOT:
+		/* no indexing to support NOT filters */
+		return NOID;
+	}
+	return MDB_COST_UNKNOWN;
+}
+
 static int
 list_candidates(
 	Operation *op,
@@ -568,19 +1021,87 @@ list_candidates(
 	ID *tmp,
 	ID *save )
 {
-	int rc = 0;
-	Filter	*f;
+	int rc = 0, i, j, n = 0, first;
+	Filter	*f, **fl, **pair = NULL, *p;
+	ID *cost = NULL, c, *outer = NULL;
 
 	Debug( LDAP_DEBUG_FILTER, "=> mdb_list_candidates 0x%x\n", ftype, 0, 0 );
-	for ( f = flist; f != NULL; f = f->f_next ) {
+
+	/* A precomputed scope in front is already in ids */
+	first = !( flist->f_choice == SLAPD_FILTER_COMPUTED &&
+		flist->f_result == LDAP_SUCCESS );
+
+	for ( f = flist; f != NULL; f = f->f_next )
+		n++;
+	fl = op->o_tmpalloc( n * sizeof(Filter *), op->o_tmpmemctx );
+	for ( i = 0, f = flist; f != NULL; f = f->f_next )
+		fl[i++] = f;
+
+	if ( ftype == LDAP_FILTER_AND ) {
+		outer = and_cands( op );
+
+		/* A >= and a <= on the same attribute become one scan of the
+		 * index keys between them, rather than two scans that each
+		 * run to the far end of the index, when range_pairable()
+		 * says that finds all the matching entries.
+		 */
+		for ( i = 0; i < n; i++ ) {
+			if ( !range_pairable( op, fl[i] ))
+				continue;
+			for ( j = i + 1; j < n; j++ ) {
+				if ( fl[j]->f_choice != fl[i]->f_choice &&
+					( fl[j]->f_choice == LDAP_FILTER_GE ||
+					  fl[j]->f_choice == LDAP_FILTER_LE ) &&
+					fl[j]->f_av_desc == fl[i]->f_av_desc )
+					break;
+			}
+			if ( j == n )
+				continue;
+			if ( !pair )
+				pair = op->o_tmpcalloc( n, sizeof(Filter *), op->o_tmpmemctx );
+			pair[i] = fl[j];
+			n--;
+			for ( ; j < n; j++ )
+				fl[j] = fl[j+1];
+		}
+
+		/* Evaluate the most selective components first */
+		if ( n > 1 ) {
+			cost = op->o_tmpalloc( n * sizeof(ID), op->o_tmpmemctx );
+			for ( i = 0; i < n; i++ ) {
+				f = fl[i];
+				p = pair ? pair[i] : NULL;
+				c = filter_cost( op, rtxn, f, p );
+				for ( j = i; j > 0 && cost[j-1] > c; j-- ) {
+					cost[j] = cost[j-1];
+					fl[j] = fl[j-1];
+					if ( pair )
+						pair[j] = pair[j-1];
+				}
+				cost[j] = c;
+				fl[j] = f;
+				if ( pair )
+					pair[j] = p;
+			}
+		}
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		f = fl[i];
 		/* ignore precomputed scopes */
 		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
 		     f->f_result == LDAP_SUCCESS ) {
 			continue;
 		}
+		if ( ftype == LDAP_FILTER_AND && !first &&
+			!MDB_IDL_IS_RANGE( ids ))
+			and_cands_set( op, ids );
 		MDB_IDL_ZERO( save );
-		rc = mdb_filter_candidates( op, rtxn, f, save, tmp,
-			save+MDB_IDL_UM_SIZE );
+		if ( pair && pair[i] )
+			rc = range_pair_candidates( op, rtxn, f, pair[i], save, tmp );
+		else
+			rc = mdb_filter_candidates( op, rtxn, f, save, tmp,
+				save+MDB_IDL_UM_SIZE );
 
 		if ( rc != 0 ) {
 			if ( ftype == LDAP_FILTER_AND ) {
@@ -592,21 +1113,41 @@ list_candidates(
 
 		
 		if ( ftype == LDAP_FILTER_AND ) {
-			if ( f == flist ) {
+			if ( first ) {
 				MDB_IDL_CPY( ids, save );
 			} else {
 				mdb_idl_intersection( ids, save );
 			}
+			first = 0;
 			if( MDB_IDL_IS_ZERO( ids ) )
 				break;
+			/* Few enough left to just test them */
+			if ( i < n-1 && !MDB_IDL_IS_RANGE( ids ) &&
+				ids[0] <= MDB_AND_STOP ) {
+				if ( get_explain( op ) && op->o_explain_plan )
+					mdb_explain_step( op, "stop, %d components left to "
+						"test_filter", n - 1 - i );
+				Debug( LDAP_DEBUG_FILTER,
+					"<= mdb_list_candidates: stopping at %ld candidates\n",
+					(long) ids[0], 0, 0 );
+				break;
+			}
 		} else {
-			if ( f == flist ) {
+			if ( first ) {
 				MDB_IDL_CPY( ids, save );
 			} else {
 				mdb_idl_union( ids, save );
 			}
+			first = 0;
 		}
 	}
+	if ( ftype == LDAP_FILTER_AND )
+		and_cands_set( op, outer );
+	if ( cost )
+		op->o_tmpfree( cost, op->o_tmpmemctx );
+	if ( pair )
+		op->o_tmpfree( pair, op->o_tmpmemctx );
+	op->o_tmpfree( fl, op->o_tmpmemctx );
 
 	if( rc == LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_FILTER,
@@ -649,11 +1190,16 @@ presence_candidates(
 		&dbi, &mask, &prefix );
 
 	if( rc == LDAP_INAPPROPRIATE_MATCHING ) {
-		/* not indexed */
-		Debug( LDAP_DEBUG_TRACE,
-			"<= mdb_presence_candidates: (%s) not indexed\n",
-			desc->ad_cname.bv_val, 0, 0 );
-		return 0;
+		/* not indexed, the presence map may still know */
+		rc = mdb_presmap_read( op, rtxn, desc, ids );
+		if ( rc == LDAP_INAPPROPRIATE_MATCHING ) {
+			Debug( LDAP_DEBUG_TRACE,
+				"<= mdb_presence_candidates: (%s) not indexed\n",
+				desc->ad_cname.bv_val, 0, 0 );
+			MDB_IDL_ALL( ids );
+			rc = 0;
+		}
+		return rc;
 	}
 
 	if( rc != LDAP_SUCCESS ) {
@@ -671,7 +1217,8 @@ presence_candidates(
 		return -1;
 	}
 
-	rc = mdb_key_read( op->o_bd, rtxn, dbi, &prefix, ids, NULL, 0 );
+	rc = mdb_key_read( op->o_bd, rtxn, dbi, &prefix, ids, NULL, 0,
+		and_cands( op ));
 
 	if( rc == MDB_NOTFOUND ) {
 		MDB_IDL_ZERO( ids );
@@ -782,7 +1329,8 @@ equality_candidates(
 	}
 
 	for ( i= 0; keys[i].bv_val != NULL; i++ ) {
-		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0 );
+		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0,
+			and_cands( op ));
 
 		if( rc == MDB_NOTFOUND ) {
 			MDB_IDL_ZERO( ids );
@@ -903,7 +1451,8 @@ approx_candidates(
 	}
 
 	for ( i= 0; keys[i].bv_val != NULL; i++ ) {
-		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0 );
+		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0,
+			and_cands( op ));
 
 		if( rc == MDB_NOTFOUND ) {
 			MDB_IDL_ZERO( ids );
@@ -1017,8 +1566,11 @@ substring_candidates(
 		return 0;
 	}
 
+	mdb_key_fold( op->o_bd->be_private, keys, op->o_tmpmemctx );
+
 	for ( i= 0; keys[i].bv_val != NULL; i++ ) {
-		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0 );
+		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0,
+			and_cands( op ));
 
 		if( rc == MDB_NOTFOUND ) {
 			MDB_IDL_ZERO( ids );
@@ -1059,98 +1611,112 @@ substring_candidates(
 	return( rc );
 }
 
+/* The ordered index key of value, NULL if there is none */
+static struct berval *
+range_key(
+	Operation *op,
+	AttributeDescription *desc,
+	slap_mask_t mask,
+	struct berval *prefix,
+	struct berval *value )
+{
+	MatchingRule *mr = desc->ad_type->sat_equality;
+	struct berval *keys = NULL;
+	int rc;
+
+	if( !mr || !mr->smr_filter ) {
+		return NULL;
+	}
+
+	rc = (mr->smr_filter)(
+		LDAP_FILTER_EQUALITY,
+		mask,
+		desc->ad_type->sat_syntax,
+		mr,
+		prefix,
+		value,
+		&keys, op->o_tmpmemctx );
+
+	if( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<= mdb_range_candidates: (%s, %s) "
+			"MR filter failed (%d)\n",
+			prefix->bv_val, desc->ad_cname.bv_val, rc );
+		return NULL;
+	}
+	return keys;
+}
+
+/* Candidates with a value of desc between lo and hi, inclusive,
+ * looked up in its ordered equality index. Either bound may be NULL;
+ * the scan then starts at the first key, or runs to the last.
+ */
 static int
-inequality_candidates(
+range_candidates(
 	Operation *op,
 	MDB_txn *rtxn,
-	AttributeAssertion *ava,
+	AttributeDescription *desc,
+	struct berval *lo,
+	struct berval *hi,
 	ID *ids,
-	ID *tmp,
-	int gtorlt )
+	ID *tmp )
 {
 	MDB_dbi	dbi;
 	int rc;
 	slap_mask_t mask;
 	struct berval prefix = {0, NULL};
-	struct berval *keys = NULL;
-	MatchingRule *mr;
+	struct berval *lokeys = NULL, *hikeys = NULL;
 	MDB_cursor *cursor = NULL;
 
-	Debug( LDAP_DEBUG_TRACE, "=> mdb_inequality_candidates (%s)\n",
-			ava->aa_desc->ad_cname.bv_val, 0, 0 );
+	Debug( LDAP_DEBUG_TRACE, "=> mdb_range_candidates (%s)\n",
+			desc->ad_cname.bv_val, 0, 0 );
 
 	MDB_IDL_ALL( ids );
 
-	rc = mdb_index_param( op->o_bd, ava->aa_desc, LDAP_FILTER_EQUALITY,
+	rc = mdb_index_param( op->o_bd, desc, LDAP_FILTER_EQUALITY,
 		&dbi, &mask, &prefix );
 
 	if ( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		Debug( LDAP_DEBUG_ANY,
-			"<= mdb_inequality_candidates: (%s) not indexed\n", 
-			ava->aa_desc->ad_cname.bv_val, 0, 0 );
+			"<= mdb_range_candidates: (%s) not indexed\n", 
+			desc->ad_cname.bv_val, 0, 0 );
 		return 0;
 	}
 
 	if( rc != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_ANY,
-			"<= mdb_inequality_candidates: (%s) "
+			"<= mdb_range_candidates: (%s) "
 			"index_param failed (%d)\n",
-			ava->aa_desc->ad_cname.bv_val, rc, 0 );
-		return 0;
-	}
-
-	mr = ava->aa_desc->ad_type->sat_equality;
-	if( !mr ) {
-		return 0;
-	}
-
-	if( !mr->smr_filter ) {
-		return 0;
-	}
-
-	rc = (mr->smr_filter)(
-		LDAP_FILTER_EQUALITY,
-		mask,
-		ava->aa_desc->ad_type->sat_syntax,
-		mr,
-		&prefix,
-		&ava->aa_value,
-		&keys, op->o_tmpmemctx );
-
-	if( rc != LDAP_SUCCESS ) {
-		Debug( LDAP_DEBUG_TRACE,
-			"<= mdb_inequality_candidates: (%s, %s) "
-			"MR filter failed (%d)\n",
-			prefix.bv_val, ava->aa_desc->ad_cname.bv_val, rc );
+			desc->ad_cname.bv_val, rc, 0 );
 		return 0;
 	}
 
-	if( keys == NULL ) {
-		Debug( LDAP_DEBUG_TRACE,
-			"<= mdb_inequality_candidates: (%s) no keys\n",
-			ava->aa_desc->ad_cname.bv_val, 0, 0 );
-		return 0;
-	}
+	if ( lo && ( lokeys = range_key( op, desc, mask, &prefix, lo )) == NULL )
+		goto nokeys;
+	if ( hi && ( hikeys = range_key( op, desc, mask, &prefix, hi )) == NULL )
+		goto nokeys;
 
 	MDB_IDL_ZERO( ids );
 	while(1) {
-		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[0], tmp, &cursor, gtorlt );
+		rc = mdb_key_range_read( op->o_bd, rtxn, dbi,
+			lokeys ? &lokeys[0] : NULL, hikeys ? &hikeys[0] : NULL,
+			tmp, &cursor, NULL );
 
 		if( rc == MDB_NOTFOUND ) {
 			rc = 0;
 			break;
 		} else if( rc != LDAP_SUCCESS ) {
 			Debug( LDAP_DEBUG_TRACE,
-			       "<= mdb_inequality_candidates: (%s) "
+			       "<= mdb_range_candidates: (%s) "
 			       "key read failed (%d)\n",
-			       ava->aa_desc->ad_cname.bv_val, rc, 0 );
+			       desc->ad_cname.bv_val, rc, 0 );
 			break;
 		}
 
 		if( MDB_IDL_IS_ZERO( tmp ) ) {
 			Debug( LDAP_DEBUG_TRACE,
-			       "<= mdb_inequality_candidates: (%s) NULL\n", 
-			       ava->aa_desc->ad_cname.bv_val, 0, 0 );
+			       "<= mdb_range_candidates: (%s) NULL\n", 
+			       desc->ad_cname.bv_val, 0, 0 );
 			break;
 		}
 
@@ -1162,12 +1728,23 @@ inequality_candidates(
 			break;
 		}
 	}
-	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	if ( lokeys )
+		ber_bvarray_free_x( lokeys, op->o_tmpmemctx );
+	if ( hikeys )
+		ber_bvarray_free_x( hikeys, op->o_tmpmemctx );
 
 	Debug( LDAP_DEBUG_TRACE,
-		"<= mdb_inequality_candidates: id=%ld, first=%ld, last=%ld\n",
+		"<= mdb_range_candidates: id=%ld, first=%ld, last=%ld\n",
 		(long) ids[0],
 		(long) MDB_IDL_FIRST(ids),
 		(long) MDB_IDL_LAST(ids) );
 	return( rc );
+
+nokeys:
+	Debug( LDAP_DEBUG_TRACE,
+		"<= mdb_range_candidates: (%s) no keys\n",
+		desc->ad_cname.bv_val, 0, 0 );
+	if ( lokeys )
+		ber_bvarray_free_x( lokeys, op->o_tmpmemctx );
+	return 0;
 }
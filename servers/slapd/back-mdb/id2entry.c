@@ -28,6 +28,7 @@ typedef struct Ecount {
 	int nattrs;
 	int nvals;
 	int offset;
+	int nbig;	/* attrs kept in id2big */
 	Attribute *multi;
 } Ecount;
 
@@ -35,7 +36,18 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 	Ecount *eh);
 static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data,
 	Ecount *ec);
-static Entry *mdb_entry_alloc( Operation *op, int nattrs, int nvals );
+static Entry *mdb_entry_alloc( Operation *op, int nattrs, int nvals,
+	int cached, ber_len_t extra );
+static ber_len_t mdb_entry_pack( unsigned char *src, ber_len_t slen,
+	unsigned char *dst, ber_len_t dmax );
+static ber_len_t mdb_entry_unpack( unsigned char *src, ber_len_t slen,
+	unsigned char *dst, ber_len_t dlen );
+static int mdb_entry_decode_int( Operation *op, MDB_txn *txn, MDB_val *data,
+	ID id, Entry **e, int cached, AttributeName *need, AttributeName *skip,
+	unsigned *skipmask, int *skipped );
+static int mdb_big_put( Operation *op, MDB_txn *txn, Entry *e, int adding );
+static int mdb_big_get( struct mdb_info *mdb, MDB_txn *txn, ID id,
+	Attribute *a, int have_nvals );
 
 #define ID2VKSZ	(sizeof(ID)+2)
 
@@ -260,6 +272,47 @@ static int mdb_mval_get(Operation *op, MDB_cursor *mc, ID id, Attribute *a, int
 	return rc;
 }
 
+/* Look for one normalized value of attribute ad of entry id in id2val,
+ * without reading the others.
+ */
+int mdb_mval_find(Operation *op, MDB_txn *txn, ID id, AttributeDescription *ad,
+	struct berval *val)
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	MDB_val key, data[3], found;
+	char ivk[ID2VKSZ];
+	unsigned short s;
+	int rc;
+
+	memcpy(ivk, &id, sizeof(id));
+	s = mdb->mi_adxs[ad->ad_index];
+	memcpy(ivk+sizeof(ID), &s, 2);
+	key.mv_data = &ivk;
+	key.mv_size = sizeof(ivk);
+	if ((ad->ad_type->sat_flags & SLAP_AT_ORDERED) || ad == slap_schema.si_ad_objectClass)
+		data[2].mv_data = NULL;
+	else
+		data[2].mv_data = ad;
+	data[0].mv_data = val->bv_val;
+	data[0].mv_size = val->bv_len+1;
+	data[1].mv_data = val->bv_val;
+	data[1].mv_size = val->bv_len;
+
+	rc = mdb_cursor_open(txn, mdb->mi_dbis[MDB_ID2VAL], &mc);
+	if (rc)
+		return rc;
+	rc = mdb_cursor_get(mc, &key, data, MDB_GET_BOTH_RANGE);
+	if (rc == 0) {
+		/* positioned at the first value not below it, is it a match? */
+		found = data[0];
+		if (mdb_id2v_dupsort(data, &found))
+			rc = MDB_NOTFOUND;
+	}
+	mdb_cursor_close(mc);
+	return rc;
+}
+
 #define ADD_FLAGS	(MDB_NOOVERWRITE|MDB_APPEND)
 
 static int mdb_id2entry_put(
@@ -271,7 +324,8 @@ static int mdb_id2entry_put(
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	Ecount ec;
-	MDB_val key, data;
+	MDB_val key, data, packed = { 0, NULL };
+	unsigned char *raw = NULL;
 	int rc, adding = flag;
 
 	/* We only store rdns, and they go in the dn2id database. */
@@ -291,14 +345,36 @@ static int mdb_id2entry_put(
 	if (mdb->mi_maxentrysize && ec.len > mdb->mi_maxentrysize)
 		return LDAP_ADMINLIMIT_EXCEEDED;
 
+	if ( mdb->mi_compress && ec.dlen >= mdb->mi_compress ) {
+		/* Encode aside, and keep it compressed if that saves an eighth */
+		raw = op->o_tmpalloc( 2 * ec.dlen, op->o_tmpmemctx );
+		data.mv_data = raw;
+		rc = mdb_entry_encode( op, e, &data, &ec );
+		if ( rc != LDAP_SUCCESS ) {
+			op->o_tmpfree( raw, op->o_tmpmemctx );
+			return rc;
+		}
+		packed.mv_data = raw + ec.dlen;
+		packed.mv_size = mdb_entry_pack( raw, ec.dlen, packed.mv_data,
+			ec.dlen - ec.dlen / 8 );
+	}
+
 again:
-	data.mv_size = ec.dlen;
+	data.mv_size = packed.mv_size ? packed.mv_size : ec.dlen;
 	if ( mc )
 		rc = mdb_cursor_put( mc, &key, &data, flag );
 	else
 		rc = mdb_put( txn, mdb->mi_id2entry, &key, &data, flag );
 	if (rc == MDB_SUCCESS) {
-		rc = mdb_entry_encode( op, e, &data, &ec );
+		if ( packed.mv_size )
+			memcpy( data.mv_data, packed.mv_data, packed.mv_size );
+		else if ( raw )
+			memcpy( data.mv_data, raw, ec.dlen );
+		else
+			rc = mdb_entry_encode( op, e, &data, &ec );
+		if ( raw )
+			op->o_tmpfree( raw, op->o_tmpmemctx );
+		raw = NULL;
 		if( rc != LDAP_SUCCESS )
 			return rc;
 		/* Handle adds of large multi-valued attrs here.
@@ -326,6 +402,17 @@ again:
 				return LDAP_OTHER;
 			}
 		}
+		/* Large attrs are only rewritten when they changed */
+		if (ec.nbig || !adding) {
+			rc = mdb_big_put( op, txn, e, adding );
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY,
+					"mdb_id2entry_put: mdb_big_put failed: %s(%d) \"%s\"\n",
+					mdb_strerror(rc), rc,
+					e->e_nname.bv_val );
+				return LDAP_OTHER;
+			}
+		}
 	}
 	if (rc) {
 		/* Was there a hole from slapadd? */
@@ -340,6 +427,8 @@ again:
 		if ( rc != MDB_KEYEXIST )
 			rc = LDAP_OTHER;
 	}
+	if ( raw )
+		op->o_tmpfree( raw, op->o_tmpmemctx );
 	return rc;
 }
 
@@ -389,11 +478,31 @@ int mdb_id2entry(
 	MDB_cursor *mc,
 	ID id,
 	Entry **e )
+{
+	return mdb_id2entry_skip( op, mc, id, e, NULL, NULL );
+}
+
+/* As above, leaving out the id2val attributes listed in skip,
+ * see mdb_entry_decode_need.
+ */
+int mdb_id2entry_skip(
+	Operation *op,
+	MDB_cursor *mc,
+	ID id,
+	Entry **e,
+	AttributeName *skip,
+	unsigned *skipmask )
 {
 	MDB_val key, data;
-	int rc = 0;
+	struct timeval tv;
+	int rc = 0, prof;
 
 	*e = NULL;
+	if ( skipmask )
+		*skipmask = 0;
+
+	if ( mdb_ecache_get( op, mdb_cursor_txn( mc ), id, e ) == MDB_SUCCESS )
+		return MDB_SUCCESS;
 
 	key.mv_data = &id;
 	key.mv_size = sizeof(ID);
@@ -404,7 +513,7 @@ int mdb_id2entry(
 		/* Looking for root entry on an empty-dn suffix? */
 		if ( !id && BER_BVISEMPTY( &op->o_bd->be_nsuffix[0] )) {
 			struct berval gluebv = BER_BVC("glue");
-			Entry *r = mdb_entry_alloc(op, 2, 4);
+			Entry *r = mdb_entry_alloc(op, 2, 4, 0, 0);
 			Attribute *a = r->e_attrs;
 			struct berval *bptr;
 
@@ -437,7 +546,12 @@ int mdb_id2entry(
 		rc = MDB_NOTFOUND;
 	if ( rc ) return rc;
 
-	rc = mdb_entry_decode( op, mdb_cursor_txn( mc ), &data, id, e );
+	SLAP_OPTRACE_BEGIN( op, tv );
+	SLAP_PROFILE_ENTER( op, SLAP_PROF_DECODE, prof );
+	rc = mdb_entry_decode_need( op, mdb_cursor_txn( mc ), &data, id, e,
+		NULL, skip, skipmask );
+	SLAP_PROFILE_LEAVE( op, prof );
+	SLAP_OPTRACE_END( op, ot_decode, tv );
 	if ( rc ) return rc;
 
 	(*e)->e_id = id;
@@ -456,6 +570,7 @@ int mdb_id2entry_delete(
 	MDB_dbi dbi = mdb->mi_id2entry;
 	MDB_val key;
 	MDB_cursor *mvc;
+	char ivk[ID2VKSZ];
 	int rc;
 
 	key.mv_data = &e->e_id;
@@ -470,33 +585,54 @@ int mdb_id2entry_delete(
 		return rc;
 
 	rc = mdb_cursor_get( mvc, &key, NULL, MDB_SET_RANGE );
-	if (rc) {
-		if (rc == MDB_NOTFOUND)
-			rc = MDB_SUCCESS;
-		return rc;
-	}
-	while (*(ID *)key.mv_data == e->e_id ) {
+	while (rc == 0 && *(ID *)key.mv_data == e->e_id ) {
 		rc = mdb_cursor_del( mvc, MDB_NODUPDATA );
 		if (rc)
 			return rc;
 		rc = mdb_cursor_get( mvc, &key, NULL, MDB_GET_CURRENT );
-		if (rc) {
-			if (rc == MDB_NOTFOUND)
-				rc = MDB_SUCCESS;
+	}
+	if (rc && rc != MDB_NOTFOUND)
+		return rc;
+
+	/* and its large attrs */
+	rc = mdb_cursor_open( tid, mdb->mi_id2big, &mvc );
+	if (rc)
+		return rc;
+	memcpy( ivk, &e->e_id, sizeof(ID) );
+	memset( ivk+sizeof(ID), 0, 2 );
+	key.mv_data = ivk;
+	key.mv_size = sizeof(ivk);
+	rc = mdb_cursor_get( mvc, &key, NULL, MDB_SET_RANGE );
+	while ( rc == 0 && !memcmp( key.mv_data, &e->e_id, sizeof(ID) )) {
+		rc = mdb_cursor_del( mvc, 0 );
+		if (rc)
 			break;
-		}
+		rc = mdb_cursor_get( mvc, &key, NULL, MDB_GET_CURRENT );
 	}
+	mdb_cursor_close( mvc );
+	if (rc == MDB_NOTFOUND)
+		rc = MDB_SUCCESS;
 	return rc;
 }
 
+/* extra bytes are left after the values, for a decompressed record */
 static Entry * mdb_entry_alloc(
 	Operation *op,
 	int nattrs,
-	int nvals )
+	int nvals,
+	int cached,
+	ber_len_t extra )
 {
-	Entry *e = op->o_tmpalloc( sizeof(Entry) +
+	ber_len_t size = sizeof(Entry) +
 		nattrs * sizeof(Attribute) +
-		nvals * sizeof(struct berval), op->o_tmpmemctx );
+		nvals * sizeof(struct berval) + extra;
+	Entry *e;
+
+	/* cached entries outlive the operation */
+	if ( cached )
+		e = ch_malloc( size );
+	else
+		e = op->o_tmpalloc( size, op->o_tmpmemctx );
 	BER_BVZERO(&e->e_bv);
 	e->e_private = e;
 	if (nattrs) {
@@ -509,6 +645,306 @@ static Entry * mdb_entry_alloc(
 	return e;
 }
 
+/* Per-thread cache of decoded entries.
+ *
+ * A decoded entry points directly into the memory map, so it is only
+ * usable while the snapshot it was decoded from is still live. Each
+ * slot is tagged with the txnid of that snapshot; a later reader that
+ * gets the same txnid is looking at the same pages, so the entry can
+ * be handed out again without decoding it. Any other txnid is a miss.
+ * The cache is only used by read-only txns, and each thread has its
+ * own, so lookups need no locking.
+ */
+typedef struct mdb_ecache_slot {
+	struct mdb_ecache_slot *es_next;	/* hash chain or free list */
+	struct mdb_ecache_slot *es_lru_prev, *es_lru_next;
+	struct mdb_ecache *es_cache;
+	Entry *es_entry;
+	size_t es_txnid;
+	ID es_id;
+	int es_inuse;
+} mdb_ecache_slot;
+
+typedef struct mdb_ecache {
+	unsigned ec_max;
+	unsigned ec_gen;
+	unsigned ec_mask;
+	unsigned ec_inuse;
+	unsigned long ec_hits;	/* not yet merged into mdb_info */
+	unsigned long ec_misses;
+	mdb_ecache_slot *ec_free;
+	mdb_ecache_slot *ec_lru_head;	/* most recently used */
+	mdb_ecache_slot *ec_lru_tail;
+	mdb_ecache_slot **ec_hash;
+	mdb_ecache_slot *ec_slots;
+} mdb_ecache;
+
+/* Merge the thread-local counters into the database totals this often */
+#define MDB_ECACHE_STATS	256
+
+static unsigned mdb_ecache_generation;
+
+/* Called from db_open: entries cached against a previous environment
+ * must never be mistaken for ones from this one.
+ */
+void
+mdb_ecache_init( struct mdb_info *mdb )
+{
+	mdb->mi_ecache_gen = ++mdb_ecache_generation;
+}
+
+static void
+mdb_ecache_free( void *key, void *data )
+{
+	mdb_ecache *ec = data;
+	unsigned i;
+
+	for ( i = 0; i < ec->ec_max; i++ )
+		ch_free( ec->ec_slots[i].es_entry );
+	ch_free( ec->ec_hash );
+	ch_free( ec->ec_slots );
+	ch_free( ec );
+}
+
+static mdb_ecache *
+mdb_ecache_new( struct mdb_info *mdb )
+{
+	mdb_ecache *ec;
+	unsigned i, nhash;
+
+	for ( nhash = 1; nhash < mdb->mi_ecache_max; nhash <<= 1 );
+
+	ec = ch_calloc( 1, sizeof( mdb_ecache ));
+	ec->ec_max = mdb->mi_ecache_max;
+	ec->ec_gen = mdb->mi_ecache_gen;
+	ec->ec_mask = nhash - 1;
+	ec->ec_hash = ch_calloc( nhash, sizeof( mdb_ecache_slot * ));
+	ec->ec_slots = ch_calloc( ec->ec_max, sizeof( mdb_ecache_slot ));
+	for ( i = 0; i < ec->ec_max; i++ ) {
+		ec->ec_slots[i].es_cache = ec;
+		ec->ec_slots[i].es_next = ec->ec_free;
+		ec->ec_free = &ec->ec_slots[i];
+	}
+	return ec;
+}
+
+/* Return this thread's cache, if txn is allowed to use it */
+static mdb_ecache *
+mdb_ecache_ctx( Operation *op, struct mdb_info *mdb, MDB_txn *txn )
+{
+	mdb_op_info *moi;
+	OpExtra *oex;
+	mdb_ecache *ec = NULL;
+	void *data;
+
+	if ( !mdb->mi_ecache_max || !( slapMode & SLAP_SERVER_MODE ) ||
+		!op->o_threadctx )
+		return NULL;
+
+	/* Only entries from our own read-only snapshot can be shared */
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == mdb ) break;
+	}
+	moi = (mdb_op_info *)oex;
+	if ( !moi || !( moi->moi_flag & MOI_READER ) || moi->moi_txn != txn )
+		return NULL;
+
+	if ( !ldap_pvt_thread_pool_getkey( op->o_threadctx, mdb, &data, NULL ))
+		ec = data;
+
+	if ( ec && ( ec->ec_max != mdb->mi_ecache_max ||
+		ec->ec_gen != mdb->mi_ecache_gen )) {
+		/* Resized or reopened; rebuild once nothing is borrowed */
+		if ( ec->ec_inuse )
+			return ec->ec_gen == mdb->mi_ecache_gen ? ec : NULL;
+		ldap_pvt_thread_pool_setkey( op->o_threadctx, mdb, NULL, 0,
+			NULL, NULL );
+		mdb_ecache_free( mdb, ec );
+		ec = NULL;
+	}
+
+	if ( !ec ) {
+		ec = mdb_ecache_new( mdb );
+		if ( ldap_pvt_thread_pool_setkey( op->o_threadctx, mdb, ec,
+			mdb_ecache_free, NULL, NULL )) {
+			mdb_ecache_free( mdb, ec );
+			return NULL;
+		}
+	}
+	return ec;
+}
+
+static void
+mdb_ecache_stats( struct mdb_info *mdb, mdb_ecache *ec )
+{
+	if ( ec->ec_hits + ec->ec_misses < MDB_ECACHE_STATS )
+		return;
+	ldap_pvt_thread_mutex_lock( &mdb->mi_ecache_mutex );
+	mdb->mi_ecache_hits += ec->ec_hits;
+	mdb->mi_ecache_misses += ec->ec_misses;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_ecache_mutex );
+	ec->ec_hits = 0;
+	ec->ec_misses = 0;
+}
+
+static void
+mdb_ecache_lru_unlink( mdb_ecache *ec, mdb_ecache_slot *es )
+{
+	if ( es->es_lru_prev )
+		es->es_lru_prev->es_lru_next = es->es_lru_next;
+	else
+		ec->ec_lru_head = es->es_lru_next;
+	if ( es->es_lru_next )
+		es->es_lru_next->es_lru_prev = es->es_lru_prev;
+	else
+		ec->ec_lru_tail = es->es_lru_prev;
+	es->es_lru_prev = es->es_lru_next = NULL;
+}
+
+static void
+mdb_ecache_lru_head( mdb_ecache *ec, mdb_ecache_slot *es )
+{
+	es->es_lru_prev = NULL;
+	es->es_lru_next = ec->ec_lru_head;
+	if ( ec->ec_lru_head )
+		ec->ec_lru_head->es_lru_prev = es;
+	else
+		ec->ec_lru_tail = es;
+	ec->ec_lru_head = es;
+}
+
+static mdb_ecache_slot *
+mdb_ecache_find( mdb_ecache *ec, ID id )
+{
+	mdb_ecache_slot *es;
+
+	for ( es = ec->ec_hash[id & ec->ec_mask]; es; es = es->es_next ) {
+		if ( es->es_id == id )
+			break;
+	}
+	return es;
+}
+
+static void
+mdb_ecache_unhash( mdb_ecache *ec, mdb_ecache_slot *es )
+{
+	mdb_ecache_slot **prev;
+
+	for ( prev = &ec->ec_hash[es->es_id & ec->ec_mask]; *prev;
+		prev = &(*prev)->es_next ) {
+		if ( *prev == es ) {
+			*prev = es->es_next;
+			break;
+		}
+	}
+	es->es_next = NULL;
+}
+
+/* Reserve a slot for a new decode of entry id. Returns NULL if
+ * every slot is currently borrowed, or this ID already is.
+ */
+static mdb_ecache_slot *
+mdb_ecache_alloc( mdb_ecache *ec, ID id, size_t txnid )
+{
+	mdb_ecache_slot *es;
+
+	es = mdb_ecache_find( ec, id );
+	if ( es ) {
+		/* an outdated copy of this entry */
+		if ( es->es_inuse )
+			return NULL;
+		mdb_ecache_lru_unlink( ec, es );
+	} else {
+		if ( ec->ec_free ) {
+			es = ec->ec_free;
+			ec->ec_free = es->es_next;
+		} else {
+			for ( es = ec->ec_lru_tail; es && es->es_inuse;
+				es = es->es_lru_prev );
+			if ( !es )
+				return NULL;
+			mdb_ecache_lru_unlink( ec, es );
+			mdb_ecache_unhash( ec, es );
+		}
+		es->es_id = id;
+		es->es_next = ec->ec_hash[id & ec->ec_mask];
+		ec->ec_hash[id & ec->ec_mask] = es;
+	}
+	ch_free( es->es_entry );
+	es->es_entry = NULL;
+	es->es_txnid = txnid;
+	es->es_inuse = 1;
+	ec->ec_inuse++;
+	mdb_ecache_lru_head( ec, es );
+	return es;
+}
+
+/* Give back a slot whose decode failed */
+static void
+mdb_ecache_discard( mdb_ecache *ec, mdb_ecache_slot *es )
+{
+	mdb_ecache_lru_unlink( ec, es );
+	mdb_ecache_unhash( ec, es );
+	es->es_inuse = 0;
+	ec->ec_inuse--;
+	es->es_next = ec->ec_free;
+	ec->ec_free = es;
+}
+
+/* Look up a previously decoded copy of entry id that is valid
+ * for txn. On success the entry is borrowed until mdb_entry_return().
+ */
+int
+mdb_ecache_get( Operation *op, MDB_txn *txn, ID id, Entry **e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_ecache *ec;
+	mdb_ecache_slot *es;
+	int rc = MDB_NOTFOUND;
+
+	ec = mdb_ecache_ctx( op, mdb, txn );
+	if ( !ec )
+		return rc;
+
+	es = mdb_ecache_find( ec, id );
+	if ( es && es->es_entry && !es->es_inuse &&
+		es->es_txnid == mdb_txn_id( txn )) {
+		es->es_inuse = 1;
+		ec->ec_inuse++;
+		mdb_ecache_lru_unlink( ec, es );
+		mdb_ecache_lru_head( ec, es );
+		*e = es->es_entry;
+		(*e)->e_id = id;
+		BER_BVZERO( &(*e)->e_name );
+		BER_BVZERO( &(*e)->e_nname );
+		ec->ec_hits++;
+		rc = MDB_SUCCESS;
+	} else {
+		ec->ec_misses++;
+	}
+	mdb_ecache_stats( mdb, ec );
+	return rc;
+}
+
+/* Return a borrowed entry to its slot */
+void
+mdb_ecache_release( Operation *op, Entry *e )
+{
+	mdb_ecache_slot *es = e->e_private;
+
+	if ( op->o_hdr && op->o_tmpmfuncs ) {
+		op->o_tmpfree( e->e_nname.bv_val, op->o_tmpmemctx );
+		op->o_tmpfree( e->e_name.bv_val, op->o_tmpmemctx );
+	} else {
+		ch_free( e->e_nname.bv_val );
+		ch_free( e->e_name.bv_val );
+	}
+	BER_BVZERO( &e->e_name );
+	BER_BVZERO( &e->e_nname );
+	es->es_inuse = 0;
+	es->es_cache->ec_inuse--;
+}
+
 int mdb_entry_return(
 	Operation *op,
 	Entry *e
@@ -517,6 +953,10 @@ int mdb_entry_return(
 	if ( !e )
 		return 0;
 	if ( e->e_private ) {
+		if ( e->e_private != e ) {
+			mdb_ecache_release( op, e );
+			return 0;
+		}
 		if ( op->o_hdr && op->o_tmpmfuncs ) {
 			op->o_tmpfree( e->e_nname.bv_val, op->o_tmpmemctx );
 			op->o_tmpfree( e->e_name.bv_val, op->o_tmpmemctx );
@@ -675,6 +1115,25 @@ mdb_reader_flush( MDB_env *env )
 
 extern MDB_txn *mdb_tool_txn;
 
+/* In a read-only environment the map may have been grown by the
+ * writing process. Adopt its size, with every other thread out of the
+ * environment, and let the caller retry its read txn.
+ */
+static int
+mdb_reader_resized( struct mdb_info *mdb, int rc )
+{
+	if ( rc != MDB_MAP_RESIZED || !( mdb->mi_dbenv_flags & MDB_RDONLY ) ||
+		!( slapMode & SLAP_SERVER_MODE ))
+		return rc;
+
+	slap_pause_server();
+	rc = mdb_env_set_mapsize( mdb->mi_dbenv, 0 );
+	slap_unpause_server();
+	Debug( LDAP_DEBUG_STATS, "mdb_opinfo_get: adopted grown map (%d)\n",
+		rc, 0, 0 );
+	return rc ? rc : MDB_MAP_RESIZED;
+}
+
 int
 mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **moip )
 {
@@ -764,7 +1223,9 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 			return rc;
 		}
 		if ( ldap_pvt_thread_pool_getkey( ctx, mdb->mi_dbenv, &data, NULL ) ) {
-			rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &moi->moi_txn );
+			do {
+				rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &moi->moi_txn );
+			} while ( rc && mdb_reader_resized( mdb, rc ) == MDB_MAP_RESIZED );
 			if (rc) {
 				Debug( LDAP_DEBUG_ANY, "mdb_opinfo_get: err %s(%d)\n",
 					mdb_strerror(rc), rc, 0 );
@@ -790,7 +1251,9 @@ ok:
 		moi->moi_ref = 0;
 	}
 	if ( renew ) {
-		rc = mdb_txn_renew( moi->moi_txn );
+		do {
+			rc = mdb_txn_renew( moi->moi_txn );
+		} while ( rc && mdb_reader_resized( mdb, rc ) == MDB_MAP_RESIZED );
 		assert(!rc);
 	}
 	moi->moi_ref++;
@@ -800,6 +1263,101 @@ ok:
 	return 0;
 }
 
+/* Commit a write txn of an operation, recording how long it took */
+int
+mdb_commit( struct mdb_info *mdb, MDB_txn *txn )
+{
+	struct timeval start, end;
+	unsigned long usec;
+	int rc, i;
+
+	gettimeofday( &start, NULL );
+	rc = mdb_txn_commit( txn );
+	gettimeofday( &end, NULL );
+
+	usec = ( end.tv_sec - start.tv_sec ) * 1000000 +
+		end.tv_usec - start.tv_usec;
+	if ( end.tv_sec < start.tv_sec )
+		usec = 0;
+	for ( i = 0; usec && i < MDB_COMMIT_BUCKETS - 1; i++ )
+		usec >>= 1;
+	ldap_pvt_thread_mutex_lock( &mdb->mi_commit_mutex );
+	mdb->mi_commit_hist[i]++;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_commit_mutex );
+
+	return rc;
+}
+
+/* Wait until the txn just committed by this thread is on disk.
+ *
+ * With groupcommit configured, write txns commit without syncing.
+ * The first writer to get here leads a batch: it waits up to
+ * mi_gc_window msec for other writers to join, or until mi_gc_max
+ * of them are waiting, then syncs once for all of them. Writers
+ * arriving during the sync form the next batch. A writer that ran
+ * alone last time syncs right away, so a lone client doesn't pay
+ * the window on every write. Ops carrying lazyCommit don't wait;
+ * their txns become durable with the next sync.
+ */
+int
+mdb_txn_durable( Operation *op, struct mdb_info *mdb )
+{
+	MDB_envinfo ei;
+	size_t txnid;
+	int rc = 0;
+
+	if ( !mdb->mi_gc_window || ( mdb->mi_dbenv_flags & MDB_NOSYNC ) ||
+		!( slapMode & SLAP_SERVER_MODE ) || get_lazyCommit( op ))
+		return 0;
+
+	mdb_env_info( mdb->mi_dbenv, &ei );
+	txnid = ei.me_last_txnid;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_gc_mutex );
+	mdb->mi_gc_waiters++;
+	while ( mdb->mi_gc_synced < txnid ) {
+		struct timeval tv;
+		unsigned ms;
+
+		if ( mdb->mi_gc_syncing ) {
+			ldap_pvt_thread_cond_wait( &mdb->mi_gc_cond, &mdb->mi_gc_mutex );
+			rc = mdb->mi_gc_rc;
+			continue;
+		}
+		mdb->mi_gc_syncing = 1;
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+
+		/* let the batch fill */
+		for ( ms = 0; mdb->mi_gc_batch > 1 && ms < mdb->mi_gc_window; ms++ ) {
+			if ( mdb->mi_gc_max && mdb->mi_gc_waiters >= mdb->mi_gc_max )
+				break;
+			tv.tv_sec = 0;
+			tv.tv_usec = 1000;
+			select( 0, NULL, NULL, NULL, &tv );
+		}
+
+		/* everything committed so far is covered by this sync */
+		mdb_env_info( mdb->mi_dbenv, &ei );
+		rc = mdb_env_sync( mdb->mi_dbenv, 1 );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				"mdb_txn_durable: mdb_env_sync failed: %s (%d)\n",
+				mdb_strerror(rc), rc, 0 );
+		}
+
+		ldap_pvt_thread_mutex_lock( &mdb->mi_gc_mutex );
+		mdb->mi_gc_synced = ei.me_last_txnid;
+		mdb->mi_gc_rc = rc;
+		mdb->mi_gc_batch = mdb->mi_gc_waiters;
+		mdb->mi_gc_syncing = 0;
+		ldap_pvt_thread_cond_broadcast( &mdb->mi_gc_cond );
+	}
+	mdb->mi_gc_waiters--;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+
+	return rc;
+}
+
 #ifdef LDAP_X_TXN
 int mdb_txn( Operation *op, int txnop, OpExtra **ptr )
 {
@@ -815,12 +1373,31 @@ int mdb_txn( Operation *op, int txnop, OpExtra **ptr )
 			moi->moi_flag |= MOI_KEEPER;
 		}
 		return rc;
-	case SLAP_TXN_COMMIT:
-		rc = mdb_txn_commit( moi->moi_txn );
-		if ( rc )
+	case SLAP_TXN_COMMIT: {
+		MDB_envinfo ei;
+		size_t txnid;
+
+		mdb_env_info( mdb->mi_dbenv, &ei );
+		txnid = ei.me_last_txnid;
+		rc = mdb_commit( mdb, moi->moi_txn );
+		if ( rc ) {
 			mdb->mi_numads = 0;
+		} else if ( !mdb->mi_gc_window ) {
+			/* An empty commit is used to flush earlier lazyCommit
+			 * txns, whose meta page wasn't synced.
+			 */
+			mdb_env_info( mdb->mi_dbenv, &ei );
+			if ( ei.me_last_txnid == txnid && !get_lazyCommit( op ) &&
+				!( mdb->mi_dbenv_flags & MDB_NOSYNC ))
+				rc = mdb_env_sync( mdb->mi_dbenv, 1 );
+		} else {
+			rc = mdb_txn_durable( op, mdb );
+		}
+		if ( rc == 0 )
+			mdb_maxsize_check( op );
 		op->o_tmpfree( moi, op->o_tmpmemctx );
 		return rc;
+		}
 	case SLAP_TXN_ABORT:
 		mdb->mi_numads = 0;
 		mdb_txn_abort( moi->moi_txn );
@@ -831,16 +1408,40 @@ int mdb_txn( Operation *op, int txnop, OpExtra **ptr )
 }
 #endif
 
+/* Stored as the length of a normalized value that is identical to
+ * the corresponding original value, which is then not stored again.
+ */
+#define MDB_NVAL_SAME	((unsigned int)-1)
+
+/* Whether the values of a add up to enough to be kept in id2big, in a
+ * record of their own. Those already kept in id2val stay there.
+ */
+static int mdb_attr_apart(struct mdb_info *mdb, Attribute *a)
+{
+	ber_len_t len = 0;
+	unsigned i;
+
+	if (!mdb->mi_bigattr || (a->a_flags & SLAP_ATTR_BIG_MULTI))
+		return 0;
+	for (i=0; i<a->a_numvals && len < mdb->mi_bigattr; i++) {
+		len += a->a_vals[i].bv_len;
+		if (a->a_nvals != a->a_vals)
+			len += a->a_nvals[i].bv_len;
+	}
+	return len >= mdb->mi_bigattr;
+}
+
 /* Count up the sizes of the components of an entry */
 static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 	Ecount *eh)
 {
 	ber_len_t len, dlen;
-	int i, nat = 0, nval = 0, nnval = 0, doff = 0;
+	int i, nat = 0, nval = 0, nnval = 0, doff = 0, apart;
 	Attribute *a;
 	unsigned hi;
 
 	eh->multi = NULL;
+	eh->nbig = 0;
 	len = 4*sizeof(int);	/* nattrs, nvals, ocflags, offset */
 	dlen = len;
 	for (a=e->e_attrs; a; a=a->a_next) {
@@ -862,7 +1463,10 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 		mdb_attr_multi_thresh( mdb, a->a_desc, &hi, NULL );
 		if (a->a_numvals > hi)
 			a->a_flags |= SLAP_ATTR_BIG_MULTI;
-		if (a->a_flags & SLAP_ATTR_BIG_MULTI)
+		apart = mdb_attr_apart( mdb, a );
+		if (apart)
+			eh->nbig++;
+		if ((a->a_flags & SLAP_ATTR_BIG_MULTI) || apart)
 			doff += a->a_numvals;
 		for (i=0; i<a->a_numvals; i++) {
 			int alen = a->a_vals[i].bv_len + 1 + sizeof(int);	/* len */
@@ -870,19 +1474,23 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 			if (a->a_flags & SLAP_ATTR_BIG_MULTI) {
 				if (!eh->multi)
 					eh->multi = a;
-			} else {
+			} else if (!apart) {
 				dlen += alen;
 			}
 		}
 		if (a->a_nvals != a->a_vals) {
 			nval += a->a_numvals + 1;
 			nnval++;
-			if (a->a_flags & SLAP_ATTR_BIG_MULTI)
+			if ((a->a_flags & SLAP_ATTR_BIG_MULTI) || apart)
 				doff += a->a_numvals;
 			for (i=0; i<a->a_numvals; i++) {
 				int alen = a->a_nvals[i].bv_len + 1 + sizeof(int);
+				if (mdb->mi_share_nvals &&
+					!(a->a_flags & SLAP_ATTR_BIG_MULTI) &&
+					bvmatch(&a->a_nvals[i], &a->a_vals[i]))
+					alen = sizeof(int);
 				len += alen;
-				if (!(a->a_flags & SLAP_ATTR_BIG_MULTI))
+				if (!(a->a_flags & SLAP_ATTR_BIG_MULTI) && !apart)
 					dlen += alen;
 			}
 		}
@@ -897,6 +1505,161 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 	return 0;
 }
 
+/* Set in the attribute count of a compressed record. The attribute and
+ * value counts are followed by the length of the encoded record, then
+ * the whole encoded record compressed by mdb_entry_pack.
+ */
+#define MDB_ENTRY_PACKED	(1U<<(sizeof(unsigned int)*CHAR_BIT-1))
+
+#define MDB_PACK_HBITS	12
+#define MDB_PACK_MINMATCH	4
+
+/* A plain LZ77: each sequence is a token byte with the literal count in
+ * the high nibble and the match length less MDB_PACK_MINMATCH in the
+ * low one, more length bytes when a nibble is 15, the literals, and a
+ * 2-byte match offset. The last sequence has literals only. Entries
+ * repeat attribute values, DN components and object classes a lot, so
+ * this wins most of what a stronger compressor would, at memcpy speed.
+ */
+
+static unsigned char *
+mdb_pack_len( unsigned char *op, ber_len_t len )
+{
+	for (; len >= 255; len -= 255 )
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+/* Compress an encoded entry into at most dmax bytes, with the
+ * MDB_ENTRY_PACKED header. Returns the size used, or 0 if it
+ * does not fit.
+ */
+static ber_len_t
+mdb_entry_pack( unsigned char *src, ber_len_t slen, unsigned char *dst,
+	ber_len_t dmax )
+{
+	unsigned int htab[1<<MDB_PACK_HBITS];
+	unsigned char *ip = src + 2*sizeof(int), *anchor = ip, *end = src + slen;
+	unsigned char *op = dst + 3*sizeof(int), *oend = dst + dmax;
+	unsigned int *lp = (unsigned int *)dst;
+	ber_len_t llen, mlen;
+	uint32_t seq, h;
+
+	if ( dmax < 3*sizeof(int) )
+		return 0;
+	lp[0] = ((unsigned int *)src)[0] | MDB_ENTRY_PACKED;
+	lp[1] = ((unsigned int *)src)[1];
+	lp[2] = slen;
+	memset( htab, 0, sizeof(htab) );
+	/* the header is stored as is, matches may not reach back that far */
+	while ( ip + MDB_PACK_MINMATCH < end ) {
+		unsigned char *ref;
+		memcpy( &seq, ip, sizeof(seq) );
+		h = ( seq * 2654435761U ) >> ( 32 - MDB_PACK_HBITS );
+		ref = htab[h] ? src + htab[h] : NULL;
+		htab[h] = ip - src;
+		if ( !ref || ip - ref > 0xffff || memcmp( ref, ip, MDB_PACK_MINMATCH )) {
+			ip++;
+			continue;
+		}
+		for ( mlen = MDB_PACK_MINMATCH; ip + mlen < end && ref[mlen] == ip[mlen];
+			mlen++ ) ;
+		llen = ip - anchor;
+		if ( op + 1 + llen + llen/255 + 3 + mlen/255 + 1 > oend )
+			return 0;
+		*op = ( llen < 15 ? llen : 15 ) << 4;
+		mlen -= MDB_PACK_MINMATCH;
+		*op++ |= mlen < 15 ? mlen : 15;
+		if ( llen >= 15 )
+			op = mdb_pack_len( op, llen - 15 );
+		memcpy( op, anchor, llen );
+		op += llen;
+		*op++ = ( ip - ref ) & 0xff;
+		*op++ = ( ip - ref ) >> 8;
+		if ( mlen >= 15 )
+			op = mdb_pack_len( op, mlen - 15 );
+		ip += mlen + MDB_PACK_MINMATCH;
+		anchor = ip;
+	}
+	llen = end - anchor;
+	if ( op + 1 + llen + llen/255 + 1 > oend )
+		return 0;
+	*op++ = ( llen < 15 ? llen : 15 ) << 4;
+	if ( llen >= 15 )
+		op = mdb_pack_len( op, llen - 15 );
+	memcpy( op, anchor, llen );
+	op += llen;
+	return op - dst;
+}
+
+/* Reverse mdb_entry_pack on the data after its header, into the dlen
+ * bytes the header announced. Returns the length produced, which is
+ * not dlen if the record is damaged.
+ */
+static ber_len_t
+mdb_entry_unpack( unsigned char *src, ber_len_t slen, unsigned char *dst,
+	ber_len_t dlen )
+{
+	unsigned char *ip = src, *iend = src + slen;
+	unsigned char *op, *oend = dst + dlen, *ref;
+	ber_len_t len, off;
+	unsigned int token, c;
+
+	if ( dlen < 2*sizeof(int) )
+		return 0;
+	/* the counts are in the header */
+	((unsigned int *)dst)[0] = ((unsigned int *)src)[-3] ^ MDB_ENTRY_PACKED;
+	((unsigned int *)dst)[1] = ((unsigned int *)src)[-2];
+	op = dst + 2*sizeof(int);
+	for (;;) {
+		if ( ip >= iend )
+			return 0;
+		token = *ip++;
+		len = token >> 4;
+		if ( len == 15 ) {
+			do {
+				if ( ip >= iend )
+					return 0;
+				len += c = *ip++;
+			} while ( c == 255 );
+		}
+		if ( len > (ber_len_t)( iend - ip ) || len > (ber_len_t)( oend - op ))
+			return 0;
+		memcpy( op, ip, len );
+		op += len;
+		ip += len;
+		if ( ip == iend )
+			break;
+		if ( iend - ip < 2 )
+			return 0;
+		off = ip[0] | ( ip[1] << 8 );
+		ip += 2;
+		if ( !off || off > (ber_len_t)( op - dst ))
+			return 0;
+		len = token & 15;
+		if ( len == 15 ) {
+			do {
+				if ( ip >= iend )
+					return 0;
+				len += c = *ip++;
+			} while ( c == 255 );
+		}
+		len += MDB_PACK_MINMATCH;
+		if ( len > (ber_len_t)( oend - op ))
+			return 0;
+		ref = op - off;
+		if ( off >= len ) {
+			memcpy( op, ref, len );
+			op += len;
+		} else {
+			for (; len; len-- )
+				*op++ = *ref++;
+		}
+	}
+	return op - dst;
+}
+
 /* Flag bits for an encoded attribute */
 #define MDB_AT_SORTED	(1<<(sizeof(unsigned int)*CHAR_BIT-1))
 	/* the values are in sorted order */
@@ -905,6 +1668,214 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 
 #define MDB_AT_NVALS	(1<<(sizeof(unsigned int)*CHAR_BIT-1))
 	/* this attribute has normalized values */
+#define MDB_AT_APART	(1<<(sizeof(unsigned int)*CHAR_BIT-2))
+	/* the values of this large attr are stored in id2big */
+
+/* An id2big record holds the values of one attribute, keyed like in
+ * id2val by the entry ID and the attr index. It is laid out like that
+ * attribute in mdb_entry_encode: numvals with MDB_AT_NVALS, the lengths
+ * of the values and then of the normalized values, and the values with
+ * a NUL after each. The record is not aligned, so the integers in it
+ * are copied in and out.
+ */
+static ber_len_t mdb_big_size(Attribute *a)
+{
+	ber_len_t len = sizeof(int);
+	unsigned i;
+
+	for (i=0; i<a->a_numvals; i++)
+		len += sizeof(int) + a->a_vals[i].bv_len + 1;
+	if (a->a_nvals != a->a_vals) {
+		for (i=0; i<a->a_numvals; i++) {
+			len += sizeof(int);
+			if (!bvmatch(&a->a_nvals[i], &a->a_vals[i]))
+				len += a->a_nvals[i].bv_len + 1;
+		}
+	}
+	return len;
+}
+
+static void mdb_big_encode(Attribute *a, unsigned char *lp)
+{
+	unsigned char *ptr;
+	unsigned int l;
+	unsigned i, nv = a->a_nvals != a->a_vals;
+
+	l = a->a_numvals;
+	if (nv)
+		l |= MDB_AT_NVALS;
+	memcpy(lp, &l, sizeof(l));
+	lp += sizeof(l);
+	ptr = lp + a->a_numvals * (nv + 1) * sizeof(int);
+	for (i=0; i<a->a_numvals; i++) {
+		l = a->a_vals[i].bv_len;
+		memcpy(lp, &l, sizeof(l));
+		lp += sizeof(l);
+		memcpy(ptr, a->a_vals[i].bv_val, l);
+		ptr += l;
+		*ptr++ = '\0';
+	}
+	if (!nv)
+		return;
+	for (i=0; i<a->a_numvals; i++) {
+		if (bvmatch(&a->a_nvals[i], &a->a_vals[i])) {
+			l = MDB_NVAL_SAME;
+			memcpy(lp, &l, sizeof(l));
+			lp += sizeof(l);
+			continue;
+		}
+		l = a->a_nvals[i].bv_len;
+		memcpy(lp, &l, sizeof(l));
+		lp += sizeof(l);
+		memcpy(ptr, a->a_nvals[i].bv_val, l);
+		ptr += l;
+		*ptr++ = '\0';
+	}
+}
+
+/* Point the values of a, with room for them at a_vals, into its id2big
+ * record, or just check that the record holds those values if check is
+ * set. Returns MDB_NOTFOUND if it does not.
+ */
+static int mdb_big_values(Attribute *a, MDB_val *data, int have_nvals,
+	int check)
+{
+	unsigned char *lp = data->mv_data, *ptr;
+	unsigned int l;
+	unsigned i;
+
+	if (data->mv_size < sizeof(int))
+		return MDB_CORRUPTED;
+	memcpy(&l, lp, sizeof(l));
+	lp += sizeof(l);
+	if (l != (a->a_numvals | (have_nvals ? MDB_AT_NVALS : 0)))
+		return check ? MDB_NOTFOUND : MDB_CORRUPTED;
+	if (check && data->mv_size != mdb_big_size(a))
+		return MDB_NOTFOUND;
+	ptr = lp + a->a_numvals * (have_nvals + 1) * sizeof(int);
+	if (!check && have_nvals)
+		a->a_nvals = a->a_vals + a->a_numvals + 1;
+	else if (!check)
+		a->a_nvals = a->a_vals;
+	for (i=0; i<a->a_numvals; i++) {
+		memcpy(&l, lp, sizeof(l));
+		lp += sizeof(l);
+		if (check) {
+			if (l != a->a_vals[i].bv_len ||
+				memcmp(ptr, a->a_vals[i].bv_val, l))
+				return MDB_NOTFOUND;
+		} else {
+			a->a_vals[i].bv_len = l;
+			a->a_vals[i].bv_val = (char *)ptr;
+		}
+		ptr += l + 1;
+	}
+	if (!check)
+		BER_BVZERO(&a->a_vals[i]);
+	if (!have_nvals)
+		return 0;
+	for (i=0; i<a->a_numvals; i++) {
+		memcpy(&l, lp, sizeof(l));
+		lp += sizeof(l);
+		if (check) {
+			if (l == MDB_NVAL_SAME ?
+				!bvmatch(&a->a_nvals[i], &a->a_vals[i]) :
+				l != a->a_nvals[i].bv_len ||
+				memcmp(ptr, a->a_nvals[i].bv_val, l))
+				return MDB_NOTFOUND;
+		} else if (l == MDB_NVAL_SAME) {
+			a->a_nvals[i] = a->a_vals[i];
+		} else {
+			a->a_nvals[i].bv_len = l;
+			a->a_nvals[i].bv_val = (char *)ptr;
+		}
+		if (l != MDB_NVAL_SAME)
+			ptr += l + 1;
+	}
+	if (!check)
+		BER_BVZERO(&a->a_nvals[i]);
+	return 0;
+}
+
+static int mdb_big_get(struct mdb_info *mdb, MDB_txn *txn, ID id,
+	Attribute *a, int have_nvals)
+{
+	MDB_val key, data;
+	char ivk[ID2VKSZ];
+	unsigned short s;
+	int rc;
+
+	memcpy(ivk, &id, sizeof(id));
+	s = mdb->mi_adxs[a->a_desc->ad_index];
+	memcpy(ivk+sizeof(ID), &s, 2);
+	key.mv_data = ivk;
+	key.mv_size = sizeof(ivk);
+	rc = mdb_get(txn, mdb->mi_id2big, &key, &data);
+	if (rc == 0)
+		rc = mdb_big_values(a, &data, have_nvals, 0);
+	return rc;
+}
+
+/* Write the id2big records of the large attrs of e. On updates, those
+ * still holding the same values are left alone, and those of attrs
+ * that are gone or small again are dropped.
+ */
+static int mdb_big_put(Operation *op, MDB_txn *txn, Entry *e, int adding)
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	MDB_stat st;
+	char ivk[ID2VKSZ];
+	Attribute *a;
+	unsigned short s;
+	int rc;
+
+	memcpy(ivk, &e->e_id, sizeof(ID));
+	key.mv_data = ivk;
+	key.mv_size = sizeof(ivk);
+
+	if (!adding && !mdb_stat(txn, mdb->mi_id2big, &st) && st.ms_entries) {
+		rc = mdb_cursor_open(txn, mdb->mi_id2big, &mc);
+		if (rc)
+			return rc;
+		s = 0;
+		memcpy(ivk+sizeof(ID), &s, 2);
+		rc = mdb_cursor_get(mc, &key, NULL, MDB_SET_RANGE);
+		while (rc == 0 && !memcmp(key.mv_data, &e->e_id, sizeof(ID))) {
+			memcpy(&s, (char *)key.mv_data + sizeof(ID), 2);
+			a = attr_find(e->e_attrs, mdb->mi_ads[s]);
+			if (!a || !mdb_attr_apart(mdb, a)) {
+				rc = mdb_cursor_del(mc, 0);
+				if (rc == 0)
+					rc = mdb_cursor_get(mc, &key, NULL, MDB_GET_CURRENT);
+			} else {
+				rc = mdb_cursor_get(mc, &key, NULL, MDB_NEXT);
+			}
+		}
+		mdb_cursor_close(mc);
+		if (rc && rc != MDB_NOTFOUND)
+			return rc;
+		key.mv_data = ivk;
+		key.mv_size = sizeof(ivk);
+	}
+
+	for (a=e->e_attrs; a; a=a->a_next) {
+		if (!mdb_attr_apart(mdb, a))
+			continue;
+		s = mdb->mi_adxs[a->a_desc->ad_index];
+		memcpy(ivk+sizeof(ID), &s, 2);
+		if (!adding && !mdb_get(txn, mdb->mi_id2big, &key, &data) &&
+			!mdb_big_values(a, &data, a->a_nvals != a->a_vals, 1))
+			continue;
+		data.mv_size = mdb_big_size(a);
+		rc = mdb_put(txn, mdb->mi_id2big, &key, &data, MDB_RESERVE);
+		if (rc)
+			return rc;
+		mdb_big_encode(a, data.mv_data);
+	}
+	return 0;
+}
 
 /* Flatten an Entry into a buffer. The buffer starts with the count of the
  * number of attributes in the entry, the total number of values in the
@@ -916,14 +1887,17 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
  * attr index is set, the values are stored separately.
  *
  * If the MDB_AT_NVALS bit of numvals is set, the attribute also has
- * normalized values present. (Note - a_numvals is an unsigned int, so this
+ * normalized values present. If its MDB_AT_APART bit is set, the values
+ * are in the attribute's own id2big record, see mdb_big_encode. (Note - a_numvals is an unsigned int, so this
  * means it's possible to receive an attribute that we can't encode due
  * to size overflow. In practice, this should not be an issue.)
  *
  * Then the length of each value is listed. If there are normalized values,
  * their lengths come next. This continues for each attribute. After all
  * of the lengths for the last attribute, the actual values are copied,
- * with a NUL terminator after each value.
+ * with a NUL terminator after each value. With sharenvals, a normalized
+ * value equal to its original has the length MDB_NVAL_SAME and no data
+ * of its own.
  * The buffer is padded to the sizeof(ID). The entire buffer size is
  * precomputed so that a single malloc can be performed.
  */
@@ -934,6 +1908,7 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
 	Attribute *a;
 	unsigned char *ptr;
 	unsigned int *lp, l;
+	int apart;
 
 	Debug( LDAP_DEBUG_TRACE, "=> mdb_entry_encode(0x%08lx): %s\n",
 		(long) e->e_id, e->e_dn, 0 );
@@ -961,8 +1936,11 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
 		l = a->a_numvals;
 		if (a->a_nvals != a->a_vals)
 			l |= MDB_AT_NVALS;
+		apart = mdb_attr_apart( mdb, a );
+		if (apart)
+			l |= MDB_AT_APART;
 		*lp++ = l;
-		if (a->a_flags & SLAP_ATTR_BIG_MULTI) {
+		if ((a->a_flags & SLAP_ATTR_BIG_MULTI) || apart) {
 			continue;
 		} else {
 			if (a->a_vals) {
@@ -977,6 +1955,11 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
 				}
 				if (a->a_nvals != a->a_vals) {
 					for (i=0; i<a->a_numvals; i++) {
+						if (mdb->mi_share_nvals &&
+							bvmatch(&a->a_nvals[i], &a->a_vals[i])) {
+							*lp++ = MDB_NVAL_SAME;
+							continue;
+						}
 						*lp++ = a->a_nvals[i].bv_len;
 						memcpy(ptr, a->a_nvals[i].bv_val,
 							a->a_nvals[i].bv_len);
@@ -1002,6 +1985,46 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
  */
 
 int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e)
+{
+	return mdb_entry_decode_need( op, txn, data, id, e, NULL, NULL, NULL );
+}
+
+/* As above, but if need is set, attributes whose values live in the
+ * id2val or id2big databases are only loaded when they match need. Those
+ * in id2val that are exactly one of the descriptions in skip are always
+ * left out, and bit i of skipmask is set when skip[i] was. Entries that
+ * came out incomplete this way are not cached.
+ */
+int mdb_entry_decode_need(Operation *op, MDB_txn *txn, MDB_val *data, ID id,
+	Entry **e, AttributeName *need, AttributeName *skip, unsigned *skipmask)
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_ecache *ec;
+	mdb_ecache_slot *es = NULL;
+	int rc, skipped = 0;
+
+	ec = mdb_ecache_ctx( op, mdb, txn );
+	if ( ec )
+		es = mdb_ecache_alloc( ec, id, mdb_txn_id( txn ));
+
+	if ( skipmask )
+		*skipmask = 0;
+	rc = mdb_entry_decode_int( op, txn, data, id, e, es != NULL,
+		need, skip, skipmask, &skipped );
+	if ( es ) {
+		if ( rc || skipped ) {
+			mdb_ecache_discard( ec, es );
+		} else {
+			es->es_entry = *e;
+			(*e)->e_private = es;
+		}
+	}
+	return rc;
+}
+
+static int mdb_entry_decode_int(Operation *op, MDB_txn *txn, MDB_val *data,
+	ID id, Entry **e, int cached, AttributeName *need, AttributeName *skip,
+	unsigned *skipmask, int *skipped)
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	int i, j, nattrs, nvals;
@@ -1020,7 +2043,26 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 
 	nattrs = *lp++;
 	nvals = *lp++;
-	x = mdb_entry_alloc(op, nattrs, nvals);
+	if ((unsigned)nattrs & MDB_ENTRY_PACKED) {
+		/* Decompress into the entry, its values will point there */
+		unsigned char *raw;
+		ber_len_t len = *lp++;
+		nattrs ^= MDB_ENTRY_PACKED;
+		x = mdb_entry_alloc(op, nattrs, nvals, cached, len);
+		raw = (unsigned char *)((struct berval *)
+			((Attribute *)(x+1) + nattrs) + nvals);
+		if (mdb_entry_unpack((unsigned char *)lp,
+			data->mv_size - 3*sizeof(int), raw, len) != len) {
+			Debug( LDAP_DEBUG_ANY,
+				"mdb_entry_decode: entry %lx does not decompress\n",
+				(long) id, 0, 0 );
+			rc = LDAP_OTHER;
+			goto leave;
+		}
+		lp = (unsigned int *)raw + 2;
+	} else {
+		x = mdb_entry_alloc(op, nattrs, nvals, cached, 0);
+	}
 	x->e_ocflags = *lp++;
 	if (!nvals) {
 		goto done;
@@ -1031,7 +2073,7 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 	ptr = (unsigned char *)(lp + i);
 
 	for (;nattrs>0; nattrs--) {
-		int have_nval = 0, multi = 0;
+		int have_nval = 0, multi = 0, apart = 0;
 		a->a_flags = SLAP_ATTR_DONT_FREE_DATA | SLAP_ATTR_DONT_FREE_VALS;
 		i = *lp++;
 		if (i & MDB_AT_SORTED) {
@@ -1061,18 +2103,49 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 			a->a_numvals ^= MDB_AT_NVALS;
 			have_nval = 1;
 		}
+		if (a->a_numvals & MDB_AT_APART) {
+			a->a_numvals ^= MDB_AT_APART;
+			apart = 1;
+		}
 		a->a_vals = bptr;
-		if (multi) {
-			if (!mvc) {
-				rc = mdb_cursor_open(txn, mdb->mi_dbis[MDB_ID2VAL], &mvc);
-				if (rc)
-					goto leave;
+		if (multi || apart) {
+			/* the skipped ones are looked up in id2val */
+			if ( skip && multi ) {
+				for ( j = 0; !BER_BVISNULL( &skip[j].an_name ); j++ )
+					if ( skip[j].an_desc == a->a_desc )
+						break;
+				if ( !BER_BVISNULL( &skip[j].an_name )) {
+					*skipmask |= 1U << j;
+					*skipped = 1;
+					continue;
+				}
+			}
+			if ( need && !ad_inlist( a->a_desc, need )) {
+				/* leave it out, its slot is reused by the next one */
+				*skipped = 1;
+				continue;
 			}
 			i = a->a_numvals;
-			mdb_mval_get(op, mvc, id, a, have_nval);
 			bptr += i + 1;
 			if (have_nval)
 				bptr += i + 1;
+			if (apart) {
+				rc = mdb_big_get(mdb, txn, id, a, have_nval);
+				if (rc) {
+					Debug( LDAP_DEBUG_ANY,
+						"mdb_entry_decode: attribute %s of entry %lx not in id2big: %s\n",
+						a->a_desc->ad_cname.bv_val, (long) id, mdb_strerror(rc) );
+					rc = LDAP_OTHER;
+					goto leave;
+				}
+			} else {
+				if (!mvc) {
+					rc = mdb_cursor_open(txn, mdb->mi_dbis[MDB_ID2VAL], &mvc);
+					if (rc)
+						goto leave;
+				}
+				mdb_mval_get(op, mvc, id, a, have_nval);
+			}
 		} else {
 			for (i=0; i<a->a_numvals; i++) {
 				bptr->bv_len = *lp++;
@@ -1087,6 +2160,11 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 			if (have_nval) {
 				a->a_nvals = bptr;
 				for (i=0; i<a->a_numvals; i++) {
+					if (*lp == MDB_NVAL_SAME) {
+						lp++;
+						*bptr++ = a->a_vals[i];
+						continue;
+					}
 					bptr->bv_len = *lp++;
 					bptr->bv_val = (char *)ptr;
 					ptr += bptr->bv_len+1;
@@ -1117,7 +2195,10 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 		a->a_next = a+1;
 		a = a->a_next;
 	}
-	a[-1].a_next = NULL;
+	if ( a == x->e_attrs )
+		x->e_attrs = NULL;
+	else
+		a[-1].a_next = NULL;
 done:
 	Debug(LDAP_DEBUG_TRACE, "<= mdb_entry_decode\n",
 		0, 0, 0 );
@@ -1127,5 +2208,7 @@ done:
 leave:
 	if (mvc)
 		mdb_cursor_close(mvc);
+	if (rc && cached)
+		ch_free(x);
 	return rc;
 }
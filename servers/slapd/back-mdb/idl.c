@@ -258,15 +258,216 @@ mdb_show_key(
 	}
 }
 
-int
-mdb_idl_fetch_key(
+#ifdef MDB_IDL_BITMAP
+static int
+idl_bm_lowbit( ID bits )
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzl( bits );
+#else
+	int b = 0;
+
+	while ( !( bits & 1 )) {
+		bits >>= 1;
+		b++;
+	}
+	return b;
+#endif
+}
+
+/* The cursor gets below are given a copy of the key: some of them
+ * point it into the database page, which a later write may change.
+ */
+
+/* Read a bitmap slot, the cursor being on its first word. If cands is
+ * a list, only the IDs in cands are looked up. Otherwise the slot is
+ * expanded, and replaced by its bounding range if it does not fit.
+ */
+static int
+idl_bitmap_fetch( MDB_cursor *cursor, MDB_val *key, ID *ids, ID *cands )
+{
+	MDB_val k2 = *key, data;
+	ID w, cur, *p, *end, bits, n = 0;
+	int rc;
+
+	if ( cands && !MDB_IDL_IS_RANGE( cands ) && cands[0] ) {
+		unsigned i;
+
+		rc = mdb_cursor_get( cursor, &k2, &data, MDB_GET_CURRENT );
+		if ( rc )
+			return rc;
+		memcpy( &cur, data.mv_data, sizeof(ID) );
+		for ( i = 1; i <= cands[0]; i++ ) {
+			w = MDB_IDL_BM_WORD( cands[i] );
+			if ( MDB_IDL_BM_CHUNK( cur ) < MDB_IDL_BM_CHUNK( w )) {
+				data.mv_data = &w;
+				data.mv_size = sizeof(ID);
+				rc = mdb_cursor_get( cursor, &k2, &data, MDB_GET_BOTH_RANGE );
+				if ( rc == MDB_NOTFOUND )
+					break;
+				if ( rc )
+					return rc;
+				memcpy( &cur, data.mv_data, sizeof(ID) );
+			}
+			if ( MDB_IDL_BM_CHUNK( cur ) == MDB_IDL_BM_CHUNK( w ) &&
+				( cur & MDB_IDL_BM_BIT( cands[i] )))
+				ids[++n] = cands[i];
+		}
+		ids[0] = n;
+		return 0;
+	}
+
+	rc = mdb_cursor_get( cursor, &k2, &data, MDB_GET_MULTIPLE );
+	while ( rc == 0 ) {
+		p = data.mv_data;
+		end = p + data.mv_size / sizeof(ID);
+		for ( ; p < end; p++ ) {
+			w = MDB_IDL_BM_BASE( *p );
+			for ( bits = MDB_IDL_BM_BITS( *p ); bits; bits &= bits - 1 ) {
+				if ( n == MDB_IDL_UM_MAX )
+					goto range;
+				ids[++n] = w + idl_bm_lowbit( bits );
+			}
+		}
+		rc = mdb_cursor_get( cursor, &k2, &data, MDB_NEXT_MULTIPLE );
+	}
+	if ( rc != MDB_NOTFOUND )
+		return rc;
+	ids[0] = n;
+	return 0;
+
+range:
+	rc = mdb_cursor_get( cursor, &k2, &data, MDB_LAST_DUP );
+	if ( rc )
+		return rc;
+	memcpy( &w, data.mv_data, sizeof(ID) );
+	bits = MDB_IDL_BM_BITS( w );
+	for ( cur = 31; !( bits & ((ID)1 << cur )); cur-- ) ;
+	MDB_IDL_RANGE( ids, ids[1], MDB_IDL_BM_BASE( w ) + cur );
+	return 0;
+}
+
+/* Set the bit for id in a bitmap slot */
+static int
+idl_bitmap_insert( MDB_cursor *cursor, MDB_val *key, ID id )
+{
+	MDB_val k2 = *key, data;
+	ID w = MDB_IDL_BM_WORD( id ), cur;
+	int rc, flag = 0;
+
+	if ( id > MDB_IDL_BM_MAXID )
+		return MDB_BAD_VALSIZE;
+
+	data.mv_size = sizeof(ID);
+	data.mv_data = &w;
+	rc = mdb_cursor_get( cursor, &k2, &data, MDB_GET_BOTH_RANGE );
+	if ( rc == 0 ) {
+		memcpy( &cur, data.mv_data, sizeof(ID) );
+		if ( MDB_IDL_BM_CHUNK( cur ) == MDB_IDL_BM_CHUNK( w )) {
+			if ( cur & MDB_IDL_BM_BIT( id ))
+				return 0;
+			/* same chunk, so it sorts into the same place */
+			w = cur;
+			flag = MDB_CURRENT;
+		}
+	} else if ( rc != MDB_NOTFOUND ) {
+		return rc;
+	}
+	w |= MDB_IDL_BM_BIT( id );
+	data.mv_size = sizeof(ID);
+	data.mv_data = &w;
+	return mdb_cursor_put( cursor, key, &data, flag );
+}
+
+/* Clear the bit for id in a bitmap slot, dropping the word if empty */
+static int
+idl_bitmap_delete( MDB_cursor *cursor, MDB_val *key, ID id )
+{
+	MDB_val k2 = *key, data;
+	ID w = MDB_IDL_BM_WORD( id ), cur;
+	int rc;
+
+	data.mv_size = sizeof(ID);
+	data.mv_data = &w;
+	rc = mdb_cursor_get( cursor, &k2, &data, MDB_GET_BOTH_RANGE );
+	if ( rc )
+		return rc;
+	memcpy( &cur, data.mv_data, sizeof(ID) );
+	if ( MDB_IDL_BM_CHUNK( cur ) != MDB_IDL_BM_CHUNK( w ) ||
+		!( cur & MDB_IDL_BM_BIT( id )))
+		return 0;
+	cur &= ~MDB_IDL_BM_BIT( id );
+	if ( !MDB_IDL_BM_BITS( cur ))
+		return mdb_cursor_del( cursor, 0 );
+	data.mv_size = sizeof(ID);
+	data.mv_data = &cur;
+	return mdb_cursor_put( cursor, key, &data, MDB_CURRENT );
+}
+
+/* Rewrite a full list slot of count IDs as a bitmap, the cursor being
+ * on its first item.
+ */
+static int
+idl_bitmap_convert( MDB_cursor *cursor, MDB_val *key, size_t count )
+{
+	MDB_val k2 = *key, data[2];
+	ID *buf, *p, n = 0, w = 0, i;
+	int rc;
+
+	buf = ch_malloc( count * sizeof(ID) );
+	rc = mdb_cursor_get( cursor, &k2, data, MDB_GET_MULTIPLE );
+	while ( rc == 0 ) {
+		i = data[0].mv_size / sizeof(ID);
+		if ( n + i > count )
+			i = count - n;
+		memcpy( buf + n, data[0].mv_data, i * sizeof(ID) );
+		n += i;
+		rc = mdb_cursor_get( cursor, &k2, data, MDB_NEXT_MULTIPLE );
+	}
+	if ( rc != MDB_NOTFOUND )
+		goto done;
+
+	/* Fold the sorted IDs into words, in place */
+	for ( i = 0, p = buf; i < n; i++ ) {
+		ID word = MDB_IDL_BM_WORD( buf[i] );
+		if ( w && MDB_IDL_BM_CHUNK( p[-1] ) == MDB_IDL_BM_CHUNK( word )) {
+			p[-1] |= MDB_IDL_BM_BIT( buf[i] );
+		} else {
+			*p++ = word | MDB_IDL_BM_BIT( buf[i] );
+			w++;
+		}
+	}
+
+	rc = mdb_cursor_get( cursor, &k2, data, MDB_SET );
+	if ( rc == 0 )
+		rc = mdb_cursor_del( cursor, MDB_NODUPDATA );
+	if ( rc == 0 ) {
+		data[0].mv_size = sizeof(ID);
+		data[0].mv_data = buf;
+		data[1].mv_size = w;
+		rc = mdb_cursor_put( cursor, key, data, MDB_APPENDDUP|MDB_MULTIPLE );
+	}
+done:
+	ch_free( buf );
+	return rc;
+}
+#endif /* MDB_IDL_BITMAP */
+
+/* Read the IDL of key, or with get_flag LDAP_FILTER_GE/LE and a saved
+ * cursor, of each successive key from key onwards / up to key. A GE
+ * scan stops after hikey if one is given.
+ */
+static int
+idl_fetch(
 	BackendDB	*be,
 	MDB_txn		*txn,
 	MDB_dbi		dbi,
 	MDB_val		*key,
+	MDB_val		*hikey,
 	ID			*ids,
 	MDB_cursor	**saved_cursor,
-	int			get_flag )
+	int			get_flag,
+	ID			*cands )
 {
 	MDB_val data, key2, *kptr;
 	MDB_cursor *cursor;
@@ -331,6 +532,17 @@ mdb_idl_fetch_key(
 		key->mv_data, key->mv_size ) > 0 ) {
 		rc = MDB_NOTFOUND;
 	}
+	/* Likewise past the upper end of a two-sided range */
+	if (rc == 0 && hikey && memcmp( kptr->mv_data,
+		hikey->mv_data, hikey->mv_size ) > 0 ) {
+		rc = MDB_NOTFOUND;
+	}
+#ifdef MDB_IDL_BITMAP
+	if (rc == 0 && MDB_IDL_BM_IS_WORD( *(ID *)data.mv_data )) {
+		rc = idl_bitmap_fetch( cursor, kptr, ids, cands );
+		data.mv_size = MDB_IDL_SIZEOF(ids);
+	} else
+#endif
 	if (rc == 0) {
 		i = ids+1;
 		rc = mdb_cursor_get( cursor, key, &data, MDB_GET_MULTIPLE );
@@ -389,6 +601,169 @@ mdb_idl_fetch_key(
 	return rc;
 }
 
+int
+mdb_idl_fetch_key(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*ids,
+	MDB_cursor	**saved_cursor,
+	int			get_flag,
+	ID			*cands )
+{
+	return idl_fetch( be, txn, dbi, key, NULL, ids, saved_cursor,
+		get_flag, cands );
+}
+
+/* Read the IDL of each successive key between lo and hi inclusive,
+ * through a saved cursor. Either bound may be NULL, leaving that side
+ * of the range open.
+ */
+int
+mdb_idl_fetch_range(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*lo,
+	MDB_val		*hi,
+	ID			*ids,
+	MDB_cursor	**saved_cursor,
+	ID			*cands )
+{
+	if ( lo )
+		return idl_fetch( be, txn, dbi, lo, hi, ids, saved_cursor,
+			LDAP_FILTER_GE, cands );
+	return idl_fetch( be, txn, dbi, hi, NULL, ids, saved_cursor,
+		LDAP_FILTER_LE, cands );
+}
+
+/* Count the IDs of the slot the cursor is on, from its data items */
+static int
+idl_count_cursor(
+	MDB_cursor	*cursor,
+	MDB_val		*key,
+	MDB_val		*data,
+	ID			*count )
+{
+	size_t n;
+	ID first, lo, hi;
+	int rc;
+
+	rc = mdb_cursor_count( cursor, &n );
+	if ( rc == 0 ) {
+		memcpy( &first, data->mv_data, sizeof(ID) );
+		if ( first == 0 ) {
+			/* a range, lo and hi follow */
+			rc = mdb_cursor_get( cursor, key, data, MDB_NEXT_DUP );
+			if ( rc == 0 ) {
+				memcpy( &lo, data->mv_data, sizeof(ID) );
+				rc = mdb_cursor_get( cursor, key, data, MDB_NEXT_DUP );
+			}
+			if ( rc == 0 ) {
+				memcpy( &hi, data->mv_data, sizeof(ID) );
+				*count = hi - lo + 1;
+			}
+#ifdef MDB_IDL_BITMAP
+		} else if ( MDB_IDL_BM_IS_WORD( first )) {
+			/* a bitmap, assume its words are full */
+			*count = (ID)n << MDB_IDL_BM_SHIFT;
+#endif
+		} else {
+			*count = n;
+		}
+	}
+	return rc;
+}
+
+/* Estimate how many IDs a slot holds from its number of data items */
+int
+mdb_idl_count_key(
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*count )
+{
+	MDB_cursor *cursor;
+	MDB_val data;
+	int rc;
+
+	rc = mdb_cursor_open( txn, dbi, &cursor );
+	if ( rc )
+		return rc;
+	rc = mdb_cursor_get( cursor, key, &data, MDB_SET );
+	if ( rc == 0 )
+		rc = idl_count_cursor( cursor, key, &data, count );
+	mdb_cursor_close( cursor );
+	return rc;
+}
+
+/* Estimate how many IDs the slots between lo and hi hold, as for
+ * mdb_idl_count_key. Either bound may be NULL. The first maxkeys slots
+ * are looked at one by one; the data items of the rest of the range are
+ * estimated by LMDB from where its ends fall in the tree, and turned into
+ * IDs at the rate seen in the slots that were counted, since range and
+ * bitmap slots hold nothing like one ID per item. The presence key is
+ * all zeroes and sorts before every other key, so it is never part of
+ * that rest.
+ */
+int
+mdb_idl_count_range(
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*lo,
+	MDB_val		*hi,
+	int			maxkeys,
+	ID			*count )
+{
+	MDB_cursor *cursor;
+	MDB_val key, data;
+	size_t len = lo ? lo->mv_size : hi->mv_size;
+	size_t rest, items = 0, nitems;
+	ID n, ids = 0;
+	int rc, nkeys = 0;
+
+	*count = 0;
+	rc = mdb_cursor_open( txn, dbi, &cursor );
+	if ( rc )
+		return rc;
+	if ( lo ) {
+		key = *lo;
+		rc = mdb_cursor_get( cursor, &key, &data, MDB_SET_RANGE );
+	} else {
+		rc = mdb_cursor_get( cursor, &key, &data, MDB_FIRST );
+	}
+	while ( rc == 0 ) {
+		/* skip the presence key */
+		if ( key.mv_size == len ) {
+			if ( hi && memcmp( key.mv_data, hi->mv_data, len ) > 0 )
+				break;
+			if ( nkeys++ >= maxkeys ) {
+				rc = mdb_estimate_range( txn, dbi, &key, hi, &rest );
+				if ( rc == 0 ) {
+					if ( items )
+						rest = (double)rest * ids / items;
+					*count += rest;
+				}
+				break;
+			}
+			rc = mdb_cursor_count( cursor, &nitems );
+			if ( rc == 0 )
+				rc = idl_count_cursor( cursor, &key, &data, &n );
+			if ( rc )
+				break;
+			items += nitems;
+			ids += n;
+			*count += n;
+		}
+		rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT_NODUP );
+	}
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	mdb_cursor_close( cursor );
+	return rc;
+}
+
 int
 mdb_idl_insert_keys(
 	BackendDB	*be,
@@ -439,7 +814,16 @@ mdb_idl_insert_keys(
 	if ( rc == 0 ) {
 		i = data.mv_data;
 		memcpy(&lo, data.mv_data, sizeof(ID));
-		if ( lo != 0 ) {
+		if ( MDB_IDL_BM_IS_WORD( lo )) {
+#ifdef MDB_IDL_BITMAP
+			/* a bitmap, set the ID's bit */
+			rc = idl_bitmap_insert( cursor, &key, id );
+			if ( rc != 0 ) {
+				err = "bitmap put";
+				goto fail;
+			}
+#endif
+		} else if ( lo != 0 ) {
 			/* not a range, count the number of items */
 			size_t count;
 			rc = mdb_cursor_count( cursor, &count );
@@ -447,6 +831,19 @@ mdb_idl_insert_keys(
 				err = "c_count";
 				goto fail;
 			}
+#ifdef MDB_IDL_BITMAP
+			if ( count >= MDB_IDL_DB_MAX && mdb->mi_idl_bitmap &&
+				id <= MDB_IDL_BM_MAXID && mdb->mi_nextid <= MDB_IDL_BM_MAXID ) {
+			/* No room, convert to a bitmap */
+				rc = idl_bitmap_convert( cursor, &key, count );
+				if ( rc == 0 )
+					rc = idl_bitmap_insert( cursor, &key, id );
+				if ( rc != 0 ) {
+					err = "bitmap convert";
+					goto fail;
+				}
+			} else
+#endif
 			if ( count >= MDB_IDL_DB_MAX ) {
 			/* No room, convert to a range */
 				lo = *i;
@@ -597,7 +994,16 @@ mdb_idl_delete_keys(
 	if ( rc == 0 ) {
 		memcpy( &tmp, data.mv_data, sizeof(ID) );
 		i = data.mv_data;
-		if ( tmp != 0 ) {
+		if ( MDB_IDL_BM_IS_WORD( tmp )) {
+#ifdef MDB_IDL_BITMAP
+			/* a bitmap, clear the ID's bit */
+			rc = idl_bitmap_delete( cursor, &key, id );
+			if ( rc != 0 ) {
+				err = "bitmap del";
+				goto fail;
+			}
+#endif
+		} else if ( tmp != 0 ) {
 			/* Not a range, just delete it */
 			data.mv_data = &id;
 			rc = mdb_cursor_get( cursor, &key, &data, MDB_GET_BOTH );
@@ -666,6 +1072,351 @@ fail:
 }
 
 
+/* Intersection kernels for two sorted lists, given as plain arrays
+ * without the count word. The result is written to out, which must
+ * have room for na IDs and may start at or below a: no output is
+ * written over an element of a that has not been read yet. Each
+ * returns the number of IDs written.
+ */
+typedef ID (idl_isect_func)( ID *a, ID na, const ID *b, ID nb, ID *out );
+
+/* Lists whose sizes differ by more than this factor are intersected
+ * by galloping through the larger one instead of merging.
+ */
+#define IDL_GALLOP_RATIO	32
+
+/* Branch-free merge of a against b starting at b[*jp] */
+static ID
+idl_isect_merge( const ID *a, ID na, const ID *b, ID nb, ID *jp, ID *out )
+{
+	ID i = 0, j = *jp, k = 0;
+
+	while ( i < na && j < nb ) {
+		ID x = a[i], y = b[j];
+		out[k] = x;
+		k += ( x == y );
+		i += ( x <= y );
+		j += ( x >= y );
+	}
+	*jp = j;
+	return k;
+}
+
+static ID
+idl_isect_scalar( ID *a, ID na, const ID *b, ID nb, ID *out )
+{
+	ID j = 0;
+
+	return idl_isect_merge( a, na, b, nb, &j, out );
+}
+
+/* Index of the first element of ids[0..n-1] that is >= id */
+static ID
+idl_gallop( const ID *ids, ID n, ID id )
+{
+	ID lo = 0, hi = 1;
+
+	while ( hi < n && ids[hi] < id ) {
+		lo = hi;
+		hi <<= 1;
+	}
+	if ( hi > n )
+		hi = n;
+	while ( lo < hi ) {
+		ID mid = lo + (( hi - lo ) >> 1 );
+		if ( ids[mid] < id )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Walk the smaller list, galloping through the larger one */
+static ID
+idl_isect_gallop( ID *a, ID na, const ID *b, ID nb, ID *out )
+{
+	ID i = 0, j = 0, k = 0;
+
+	if ( na <= nb ) {
+		for ( ; i < na && j < nb; i++ ) {
+			j += idl_gallop( b + j, nb - j, a[i] );
+			if ( j < nb && b[j] == a[i] )
+				out[k++] = a[i];
+		}
+	} else {
+		for ( ; j < nb && i < na; j++ ) {
+			i += idl_gallop( a + i, na - i, b[j] );
+			if ( i < na && a[i] == b[j] )
+				out[k++] = b[j];
+		}
+	}
+	return k;
+}
+
+/* Block intersection: a block of W IDs from a is compared against
+ * every rotation of a block of W IDs from b, and the block with the
+ * smaller maximum is retired. Each ID of a matches at most once and
+ * matches come out in order, so they are written straight to out:
+ * at most W of them come from the current block, which is already
+ * held in vector state and in blk[], and the next block of a is only
+ * loaded once the current one is retired. If b runs out first, the
+ * rest of the current block is finished from blk[].
+ *
+ * The including kernel must define IDL_LOAD_A(ptr) to load a block of
+ * a into its vector state and into blk[], and IDL_MATCH(ptr) to
+ * compare it against the block of b at ptr, yielding a lane bitmask.
+ */
+#define IDL_ISECT_BLOCKS( W ) \
+	ID i = 0, j = 0, k = 0, ia, ib; \
+	ID blk[W]; \
+	int mask, lane; \
+\
+	if ( na < W || nb < W ) \
+		return idl_isect_scalar( a, na, b, nb, out ); \
+\
+	IDL_LOAD_A( a ); \
+	for (;;) { \
+		mask = IDL_MATCH( b + j ); \
+		for ( lane = 0; lane < W; lane++ ) { \
+			out[k] = blk[lane]; \
+			k += ( mask >> lane ) & 1; \
+		} \
+		ia = blk[W-1]; \
+		ib = b[j+W-1]; \
+		j += ( ib <= ia ) * W; \
+		if ( ia <= ib ) { \
+			i += W; \
+			if ( i + W > na || j + W > nb ) \
+				break; \
+			IDL_LOAD_A( a + i ); \
+		} else if ( j + W > nb ) { \
+			k += idl_isect_merge( blk, W, b, nb, &j, out + k ); \
+			i += W; \
+			break; \
+		} \
+	} \
+	return k + idl_isect_merge( a + i, na - i, b, nb, &j, out + k )
+
+/* The vector kernels compare 64-bit lanes, so ID must be 64 bits */
+#if defined(__x86_64__) && SIZEOF_LONG == 8 && (( defined(__GNUC__) && \
+	( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ))) || \
+	defined(__clang__) )
+#define IDL_SIMD_X86	1
+#include <immintrin.h>
+
+__attribute__((target("sse4.2")))
+static inline int
+idl_match_sse42( __m128i va, const ID *b )
+{
+	__m128i vb, m;
+
+	vb = _mm_loadu_si128( (const __m128i *)b );
+	m = _mm_cmpeq_epi64( va, vb );
+	vb = _mm_shuffle_epi32( vb, _MM_SHUFFLE( 1, 0, 3, 2 ));
+	m = _mm_or_si128( m, _mm_cmpeq_epi64( va, vb ));
+	return _mm_movemask_pd( _mm_castsi128_pd( m ));
+}
+
+__attribute__((target("sse4.2")))
+static ID
+idl_isect_sse42( ID *a, ID na, const ID *b, ID nb, ID *out )
+{
+	__m128i va;
+
+#define IDL_LOAD_A( p ) \
+	va = _mm_loadu_si128( (const __m128i *)(p) ); \
+	_mm_storeu_si128( (__m128i *)blk, va )
+#define IDL_MATCH( p ) idl_match_sse42( va, (p) )
+
+	IDL_ISECT_BLOCKS( 2 );
+
+#undef IDL_LOAD_A
+#undef IDL_MATCH
+}
+
+__attribute__((target("avx2")))
+static inline int
+idl_match_avx2( __m256i va, const ID *b )
+{
+	__m256i vb, m;
+
+	vb = _mm256_loadu_si256( (const __m256i *)b );
+	m = _mm256_cmpeq_epi64( va, vb );
+	vb = _mm256_permute4x64_epi64( vb, _MM_SHUFFLE( 0, 3, 2, 1 ));
+	m = _mm256_or_si256( m, _mm256_cmpeq_epi64( va, vb ));
+	vb = _mm256_permute4x64_epi64( vb, _MM_SHUFFLE( 0, 3, 2, 1 ));
+	m = _mm256_or_si256( m, _mm256_cmpeq_epi64( va, vb ));
+	vb = _mm256_permute4x64_epi64( vb, _MM_SHUFFLE( 0, 3, 2, 1 ));
+	m = _mm256_or_si256( m, _mm256_cmpeq_epi64( va, vb ));
+	return _mm256_movemask_pd( _mm256_castsi256_pd( m ));
+}
+
+__attribute__((target("avx2")))
+static ID
+idl_isect_avx2( ID *a, ID na, const ID *b, ID nb, ID *out )
+{
+	__m256i va;
+
+#define IDL_LOAD_A( p ) \
+	va = _mm256_loadu_si256( (const __m256i *)(p) ); \
+	_mm256_storeu_si256( (__m256i *)blk, va )
+#define IDL_MATCH( p ) idl_match_avx2( va, (p) )
+
+	IDL_ISECT_BLOCKS( 4 );
+
+#undef IDL_LOAD_A
+#undef IDL_MATCH
+}
+#endif /* IDL_SIMD_X86 */
+
+#if defined(__aarch64__) && SIZEOF_LONG == 8 && defined(__ARM_NEON)
+#define IDL_SIMD_NEON	1
+#include <arm_neon.h>
+
+static inline int
+idl_match_neon( uint64x2_t va, const ID *b )
+{
+	uint64x2_t vb, m;
+
+	vb = vld1q_u64( (const uint64_t *)b );
+	m = vceqq_u64( va, vb );
+	m = vorrq_u64( m, vceqq_u64( va, vextq_u64( vb, vb, 1 )));
+	return ( vgetq_lane_u64( m, 0 ) & 1 ) | ( vgetq_lane_u64( m, 1 ) & 2 );
+}
+
+static ID
+idl_isect_neon( ID *a, ID na, const ID *b, ID nb, ID *out )
+{
+	uint64x2_t va;
+
+#define IDL_LOAD_A( p ) \
+	va = vld1q_u64( (const uint64_t *)(p) ); \
+	vst1q_u64( (uint64_t *)blk, va )
+#define IDL_MATCH( p ) idl_match_neon( va, (p) )
+
+	IDL_ISECT_BLOCKS( 2 );
+
+#undef IDL_LOAD_A
+#undef IDL_MATCH
+}
+#endif /* IDL_SIMD_NEON */
+
+static const struct {
+	const char *name;
+	idl_isect_func *func;
+} idl_kernels[] = {
+#ifdef IDL_SIMD_X86
+	{ "avx2", idl_isect_avx2 },
+	{ "sse4.2", idl_isect_sse42 },
+#endif
+#ifdef IDL_SIMD_NEON
+	{ "neon", idl_isect_neon },
+#endif
+	{ "scalar", idl_isect_scalar },
+	{ NULL, NULL }
+};
+
+static idl_isect_func *idl_isect = idl_isect_scalar;
+
+static int
+idl_kernel_usable( const char *name )
+{
+#ifdef IDL_SIMD_X86
+	__builtin_cpu_init();
+	if ( !strcmp( name, "avx2" ))
+		return __builtin_cpu_supports( "avx2" );
+	if ( !strcmp( name, "sse4.2" ))
+		return __builtin_cpu_supports( "sse4.2" );
+#endif
+	return 1;
+}
+
+/* Select the intersection kernel by name, or the best one the CPU
+ * supports if name is NULL. Returns the name of the kernel now in
+ * use, or NULL if the requested one is not available.
+ */
+const char *
+mdb_idl_kernel( const char *name )
+{
+	int i;
+
+	for ( i = 0; idl_kernels[i].name; i++ ) {
+		if ( name && strcmp( name, idl_kernels[i].name ))
+			continue;
+		if ( idl_kernel_usable( idl_kernels[i].name )) {
+			idl_isect = idl_kernels[i].func;
+			return idl_kernels[i].name;
+		}
+		if ( name )
+			break;
+	}
+	return NULL;
+}
+
+/* Number of IDs common to two sorted lists */
+static ID
+idl_common( const ID *a, ID na, const ID *b, ID nb )
+{
+	ID i = 0, j = 0, k = 0;
+
+	while ( i < na && j < nb ) {
+		ID x = a[i], y = b[j];
+		k += ( x == y );
+		i += ( x <= y );
+		j += ( x >= y );
+	}
+	return k;
+}
+
+/* Merge sorted list b[1..nb] into a[1..na] in place, from the top
+ * down, writing the highest result at a[top]. When b is much smaller,
+ * runs of a are located by binary search and moved as a block.
+ * Returns the number of IDs in the result, which starts at a[1].
+ */
+static ID
+idl_union_merge( ID *a, ID na, const ID *b, ID nb, ID top )
+{
+	ID i = na, j = nb, w = top;
+
+	if ( nb * IDL_GALLOP_RATIO < na ) {
+		while ( j ) {
+			ID id = b[j], lo = 1, hi = i + 1;
+
+			/* find the run a[lo..i] of IDs greater than id */
+			while ( lo < hi ) {
+				ID mid = lo + (( hi - lo ) >> 1 );
+				if ( a[mid] <= id )
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			if ( lo <= i ) {
+				w -= i - lo + 1;
+				AC_MEMCPY( a + w + 1, a + lo, ( i - lo + 1 ) * sizeof(ID));
+				i = lo - 1;
+			}
+			if ( i && a[i] == id )
+				i--;
+			a[w--] = id;
+			j--;
+		}
+	} else {
+		while ( j ) {
+			if ( i && a[i] > b[j] ) {
+				a[w--] = a[i--];
+			} else {
+				if ( i && a[i] == b[j] )
+					i--;
+				a[w--] = b[j--];
+			}
+		}
+	}
+	if ( w > i )
+		AC_MEMCPY( a + i + 1, a + w + 1, ( top - w ) * sizeof(ID));
+	return i + ( top - w );
+}
+
 /*
  * idl_intersection - return a = a intersection b
  */
@@ -674,9 +1425,8 @@ mdb_idl_intersection(
 	ID *a,
 	ID *b )
 {
-	ID ida, idb;
 	ID idmax, idmin;
-	ID cursora = 0, cursorb = 0, cursorc;
+	ID sa, ea, sb, eb, cursorc;
 	int swap = 0;
 
 	if ( MDB_IDL_IS_ZERO( a ) || MDB_IDL_IS_ZERO( b ) ) {
@@ -719,23 +1469,30 @@ mdb_idl_intersection(
 		goto done;
 	}
 
-	/* Fine, do the intersection one element at a time.
-	 * First advance to idmin in both IDLs.
-	 */
-	cursora = cursorb = idmin;
-	ida = mdb_idl_first( a, &cursora );
-	idb = mdb_idl_first( b, &cursorb );
-	cursorc = 0;
+	/* Only the part of each list between idmin and idmax matters */
+	sa = mdb_idl_search( a, idmin );
+	ea = mdb_idl_search( a, idmax );
+	if ( ea > a[0] || a[ea] > idmax )
+		ea--;
 
-	while( ida <= idmax || idb <= idmax ) {
-		if( ida == idb ) {
-			a[++cursorc] = ida;
-			ida = mdb_idl_next( a, &cursora );
-			idb = mdb_idl_next( b, &cursorb );
-		} else if ( ida < idb ) {
-			ida = mdb_idl_next( a, &cursora );
+	if ( MDB_IDL_IS_RANGE( b )) {
+		/* The result is the slice of the list inside the range */
+		cursorc = ea >= sa ? ea - sa + 1 : 0;
+		if ( cursorc && sa > 1 )
+			AC_MEMCPY( a + 1, a + sa, cursorc * sizeof(ID));
+	} else {
+		sb = mdb_idl_search( b, idmin );
+		eb = mdb_idl_search( b, idmax );
+		if ( eb > b[0] || b[eb] > idmax )
+			eb--;
+		if ( ea < sa || eb < sb ) {
+			cursorc = 0;
 		} else {
-			idb = mdb_idl_next( b, &cursorb );
+			ID na = ea - sa + 1, nb = eb - sb + 1;
+			if ( na > nb * IDL_GALLOP_RATIO || nb > na * IDL_GALLOP_RATIO )
+				cursorc = idl_isect_gallop( a + sa, na, b + sb, nb, a + 1 );
+			else
+				cursorc = idl_isect( a + sa, na, b + sb, nb, a + 1 );
 		}
 	}
 	a[0] = cursorc;
@@ -756,7 +1513,7 @@ mdb_idl_union(
 	ID	*b )
 {
 	ID ida, idb;
-	ID cursora = 0, cursorb = 0, cursorc;
+	ID top;
 
 	if ( MDB_IDL_IS_ZERO( b ) ) {
 		return 0;
@@ -776,44 +1533,16 @@ over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 		return 0;
 	}
 
-	ida = mdb_idl_first( a, &cursora );
-	idb = mdb_idl_first( b, &cursorb );
-
-	cursorc = b[0];
-
-	/* The distinct elements of a are cat'd to b */
-	while( ida != NOID || idb != NOID ) {
-		if ( ida < idb ) {
-			if( ++cursorc > MDB_IDL_UM_MAX ) {
-				goto over;
-			}
-			b[cursorc] = ida;
-			ida = mdb_idl_next( a, &cursora );
-
-		} else {
-			if ( ida == idb )
-				ida = mdb_idl_next( a, &cursora );
-			idb = mdb_idl_next( b, &cursorb );
-		}
-	}
-
-	/* b is copied back to a in sorted order */
-	a[0] = cursorc;
-	cursora = 1;
-	cursorb = 1;
-	cursorc = b[0]+1;
-	while (cursorb <= b[0] || cursorc <= a[0]) {
-		if (cursorc > a[0])
-			idb = NOID;
-		else
-			idb = b[cursorc];
-		if (cursorb <= b[0] && b[cursorb] < idb)
-			a[cursora++] = b[cursorb++];
-		else {
-			a[cursora++] = idb;
-			cursorc++;
-		}
+	/* Only count the duplicates if they could keep the result
+	 * from overflowing.
+	 */
+	top = a[0] + b[0];
+	if ( top > MDB_IDL_UM_MAX ) {
+		top -= idl_common( a + 1, a[0], b + 1, b[0] );
+		if ( top > MDB_IDL_UM_MAX )
+			goto over;
 	}
+	a[0] = idl_union_merge( a, a[0], b, b[0], top );
 
 	return 0;
 }
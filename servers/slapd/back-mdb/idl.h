@@ -69,6 +69,29 @@
 #define MDB_IDL_N( ids )		( MDB_IDL_IS_RANGE(ids) \
 	? ((ids)[2]-(ids)[1])+1 : (ids)[0] )
 
+/* On disk, a slot that outgrows MDB_IDL_DB_MAX may be kept as a chunked
+ * bitmap instead of being collapsed to a range. Each data item of such
+ * a slot is a bitmap word: MDB_IDL_BM_FLAG, the chunk number (id / 32)
+ * in bits 32-62, and one bit per ID of the chunk in the low 32 bits.
+ * Words sort by chunk, and no plain ID has the flag bit set.
+ */
+#if SIZEOF_LONG == 8
+#define MDB_IDL_BITMAP	1
+#define MDB_IDL_BM_FLAG		((ID)1 << 63)
+#define MDB_IDL_BM_SHIFT	5
+#define MDB_IDL_BM_MAXID	(((ID)1 << (31+MDB_IDL_BM_SHIFT)) - 1)
+#define MDB_IDL_BM_IS_WORD(w)	((w) & MDB_IDL_BM_FLAG)
+#define MDB_IDL_BM_WORD(id)	\
+	(MDB_IDL_BM_FLAG | ((id) >> MDB_IDL_BM_SHIFT) << 32)
+#define MDB_IDL_BM_BIT(id)	((ID)1 << ((id) & ((1<<MDB_IDL_BM_SHIFT)-1)))
+#define MDB_IDL_BM_CHUNK(w)	((w) >> 32)
+#define MDB_IDL_BM_BASE(w)	\
+	(((w) & ~MDB_IDL_BM_FLAG) >> 32 << MDB_IDL_BM_SHIFT)
+#define MDB_IDL_BM_BITS(w)	((w) & 0xffffffffUL)
+#else
+#define MDB_IDL_BM_IS_WORD(w)	0
+#endif
+
 	/** An ID2 is an ID/value pair.
 	 */
 typedef struct ID2 {
@@ -89,6 +112,7 @@ typedef struct IdScopes {
 	ID id;
 	ID2L scopes;
 	ID2L sctmp;
+	ID2L outscopes;	/* nodes known to be outside every scope, or NULL */
 	int numrdns;
 	int nscope;
 	int oscope;
@@ -0,0 +1,139 @@
+/* idlbench.c - IDL intersection/union micro-benchmark */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Checks every available intersection kernel against the scalar one
+ * and reports the time per operation for a few list shapes.
+ *
+ *	usage: idlbench [iterations]
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/stdlib.h>
+#include <ac/string.h>
+#include <ac/time.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+/* Normally provided by slapd */
+int slap_debug;
+int ldap_syslog;
+int ldap_syslog_level;
+
+static const char *kernels[] = { "avx2", "sse4.2", "neon", "scalar", NULL };
+
+static ID la[MDB_IDL_UM_SIZE], lb[MDB_IDL_UM_SIZE];
+static ID ta[MDB_IDL_UM_SIZE], tb[MDB_IDL_UM_SIZE], ref[MDB_IDL_UM_SIZE];
+
+/* Fill ids with n sorted IDs, about one in every gap */
+static void
+gen( ID *ids, ID n, ID gap )
+{
+	ID i, id = 0;
+
+	for ( i = 1; i <= n; i++ ) {
+		id += 1 + random() % gap;
+		ids[i] = id;
+	}
+	ids[0] = n;
+}
+
+static double
+now( void )
+{
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec * 1e9 + tv.tv_usec * 1e3;
+}
+
+static int
+run( const char *what, int (*op)( ID *, ID * ), int iter )
+{
+	double t;
+	int i, k;
+
+	mdb_idl_kernel( "scalar" );
+	MDB_IDL_CPY( ref, la );
+	MDB_IDL_CPY( tb, lb );
+	op( ref, tb );
+
+	for ( k = 0; kernels[k]; k++ ) {
+		if ( !mdb_idl_kernel( kernels[k] ))
+			continue;
+
+		MDB_IDL_CPY( ta, la );
+		MDB_IDL_CPY( tb, lb );
+		op( ta, tb );
+		if ( ta[0] != ref[0] || memcmp( ta, ref, MDB_IDL_SIZEOF( ref ))) {
+			fprintf( stderr, "%s: %s result differs from scalar\n",
+				what, kernels[k] );
+			return 1;
+		}
+
+		t = now();
+		for ( i = 0; i < iter; i++ ) {
+			MDB_IDL_CPY( ta, la );
+			op( ta, lb );
+		}
+		t = now() - t;
+		printf( "%-32s %-8s %10.0f ns/op (%lu IDs)\n",
+			what, kernels[k], t / iter, ref[0] );
+	}
+	return 0;
+}
+
+int
+main( int argc, char **argv )
+{
+	static const struct {
+		const char *name;
+		ID na, ga, nb, gb;
+	} shapes[] = {
+		{ "dense 64k x 64k", 65535, 2, 65535, 2 },
+		{ "sparse 64k x 64k", 65535, 16, 65535, 16 },
+		{ "skewed 64k x 1k", 65535, 2, 1024, 128 },
+		{ "small 256 x 256", 256, 4, 256, 4 },
+		{ NULL }
+	};
+	char name[64];
+	int i, iter = argc > 1 ? atoi( argv[1] ) : 200;
+
+	srandom( 42 );
+	for ( i = 0; shapes[i].name; i++ ) {
+		gen( la, shapes[i].na, shapes[i].ga );
+		gen( lb, shapes[i].nb, shapes[i].gb );
+
+		snprintf( name, sizeof(name), "intersection %s", shapes[i].name );
+		if ( run( name, mdb_idl_intersection, iter ))
+			return 1;
+		snprintf( name, sizeof(name), "union %s", shapes[i].name );
+		if ( run( name, mdb_idl_union, iter ))
+			return 1;
+	}
+
+	/* list against a range that clips it at both ends */
+	gen( la, 65535, 4 );
+	lb[0] = NOID;
+	lb[1] = la[1000];
+	lb[2] = la[60000] + 1;
+	if ( run( "intersection list x range", mdb_idl_intersection, iter ))
+		return 1;
+
+	return 0;
+}
@@ -161,6 +161,32 @@ done:
 	return LDAP_SUCCESS;
 }
 
+/* keys collected by mdb_index_keys() ahead of the write txn */
+typedef struct mdb_ixkeyctx {
+	Operation *ic_op;
+	AttrInfo *ic_ai;
+	IndexKeys **ic_tail;
+} IxKeyCtx;
+
+static int
+mdb_index_keys_add(
+	BackendDB *be,
+	MDB_cursor *mc,
+	struct berval *keys,
+	ID id )
+{
+	IxKeyCtx *ic = (IxKeyCtx *)mc;
+	IndexKeys *ik;
+
+	ik = ic->ic_op->o_tmpalloc( sizeof( IndexKeys ), ic->ic_op->o_tmpmemctx );
+	ik->ik_next = NULL;
+	ik->ik_ai = ic->ic_ai;
+	ik->ik_keys = keys;
+	*ic->ic_tail = ik;
+	ic->ic_tail = &ik->ik_next;
+	return 0;
+}
+
 static int indexer(
 	Operation *op,
 	MDB_txn *txn,
@@ -170,17 +196,28 @@ static int indexer(
 	BerVarray vals,
 	ID id,
 	int opid,
-	slap_mask_t mask )
+	slap_mask_t mask,
+	IndexKeys ***ikp )
 {
 	int rc;
 	struct berval *keys;
 	MDB_cursor *mc = ai->ai_cursor;
 	mdb_idl_keyfunc *keyfunc;
+	IxKeyCtx ic;
 	char *err;
 
 	assert( mask != 0 );
 
-	if ( !mc ) {
+	/* collected keys are kept, and inserted later by mdb_index_keys_put */
+	if ( ikp ) {
+		ic.ic_op = op;
+		ic.ic_ai = ai;
+		ic.ic_tail = *ikp;
+		keyfunc = mdb_index_keys_add;
+		mc = (MDB_cursor *)&ic;
+	} else
+	/* buffered keys need no cursor, nor a txn */
+	if ( !mc && !( opid == SLAP_INDEX_ADD_OP && ai->ai_keybuf )) {
 		err = "c_open";
 		rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
 		if ( rc ) goto done;
@@ -188,7 +225,9 @@ static int indexer(
 			ai->ai_cursor = mc;
 	}
 
-	if ( opid == SLAP_INDEX_ADD_OP ) {
+	if ( ikp ) {
+		/* keyfunc already set */
+	} else if ( opid == SLAP_INDEX_ADD_OP ) {
 #ifdef MDB_TOOL_IDL_CACHING
 		if (( slapMode & SLAP_TOOL_QUICK ) && slap_tool_thread_max > 2 ) {
 			AttrIxInfo *ax = (AttrIxInfo *)LDAP_SLIST_FIRST(&op->o_extra);
@@ -197,6 +236,10 @@ static int indexer(
 			mc = (MDB_cursor *)ax;
 		} else
 #endif
+		if ( ai->ai_keybuf ) {
+			keyfunc = mdb_tool_keys_add;
+			mc = (MDB_cursor *)ai;
+		} else
 			keyfunc = mdb_idl_insert_keys;
 	} else
 		keyfunc = mdb_idl_delete_keys;
@@ -219,7 +262,8 @@ static int indexer(
 
 		if( rc == LDAP_SUCCESS && keys != NULL ) {
 			rc = keyfunc( op->o_bd, mc, keys, id );
-			ber_bvarray_free_x( keys, op->o_tmpmemctx );
+			if ( !ikp )
+				ber_bvarray_free_x( keys, op->o_tmpmemctx );
 			if ( rc ) {
 				err = "equality";
 				goto done;
@@ -238,7 +282,8 @@ static int indexer(
 
 		if( rc == LDAP_SUCCESS && keys != NULL ) {
 			rc = keyfunc( op->o_bd, mc, keys, id );
-			ber_bvarray_free_x( keys, op->o_tmpmemctx );
+			if ( !ikp )
+				ber_bvarray_free_x( keys, op->o_tmpmemctx );
 			if ( rc ) {
 				err = "approx";
 				goto done;
@@ -257,8 +302,10 @@ static int indexer(
 			atname, vals, &keys, op->o_tmpmemctx );
 
 		if( rc == LDAP_SUCCESS && keys != NULL ) {
+			mdb_key_fold( op->o_bd->be_private, keys, op->o_tmpmemctx );
 			rc = keyfunc( op->o_bd, mc, keys, id );
-			ber_bvarray_free_x( keys, op->o_tmpmemctx );
+			if ( !ikp )
+				ber_bvarray_free_x( keys, op->o_tmpmemctx );
 			if( rc ) {
 				err = "substr";
 				goto done;
@@ -269,7 +316,9 @@ static int indexer(
 	}
 
 done:
-	if ( !(slapMode & SLAP_TOOL_QUICK))
+	if ( ikp )
+		*ikp = ic.ic_tail;
+	else if ( !(slapMode & SLAP_TOOL_QUICK))
 		mdb_cursor_close( mc );
 	switch( rc ) {
 	/* The callers all know how to deal with these results */
@@ -290,7 +339,8 @@ static int index_at_values(
 	struct berval *tags,
 	BerVarray vals,
 	ID id,
-	int opid )
+	int opid,
+	IndexKeys ***ikp )
 {
 	int rc;
 	slap_mask_t mask = 0;
@@ -304,7 +354,7 @@ static int index_at_values(
 		/* recurse */
 		rc = index_at_values( op, txn, NULL,
 			type->sat_sup, tags,
-			vals, id, opid );
+			vals, id, opid, ikp );
 
 		if( rc ) return rc;
 	}
@@ -320,7 +370,7 @@ static int index_at_values(
 				for( cr = ai->ai_cr ; cr ; cr = cr->cr_next ) {
 					rc = indexer( op, txn, ai, cr->cr_ad, &type->sat_cname,
 						cr->cr_nvals, id, ixop,
-						cr->cr_indexmask );
+						cr->cr_indexmask, ikp );
 				}
 			}
 #endif
@@ -337,7 +387,7 @@ static int index_at_values(
 				mask = ai->ai_newmask ? ai->ai_newmask : ai->ai_indexmask;
 			if( mask ) {
 				rc = indexer( op, txn, ai, ad, &type->sat_cname,
-					vals, id, ixop, mask );
+					vals, id, ixop, mask, ikp );
 
 				if( rc ) return rc;
 			}
@@ -358,7 +408,7 @@ static int index_at_values(
 					mask = ai->ai_newmask ? ai->ai_newmask : ai->ai_indexmask;
 				if ( mask ) {
 					rc = indexer( op, txn, ai, desc, &desc->ad_cname,
-						vals, id, ixop, mask );
+						vals, id, ixop, mask, ikp );
 
 					if( rc ) {
 						return rc;
@@ -387,11 +437,115 @@ int mdb_index_values(
 
 	rc = index_at_values( op, txn, desc,
 		desc->ad_type, &desc->ad_tags,
-		vals, id, opid );
+		vals, id, opid, NULL );
 
 	return rc;
 }
 
+/* Generate the add keys for the attributes of e starting at a, without
+ * touching the database. The keys are appended to *ikp, so that the
+ * write txn only has to insert them with mdb_index_keys_put().
+ */
+int
+mdb_index_keys(
+	Operation *op,
+	Entry *e,
+	Attribute *a,
+	IndexKeys **ikp )
+{
+	IndexKeys **tail = ikp;
+	int rc;
+
+	while ( *tail )
+		tail = &(*tail)->ik_next;
+
+	for ( ; a != NULL; a = a->a_next ) {
+		rc = index_at_values( op, NULL, a->a_desc,
+			a->a_desc->ad_type, &a->a_desc->ad_tags,
+			a->a_nvals, NOID, SLAP_INDEX_ADD_OP, &tail );
+		if ( rc != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_TRACE,
+				"<= mdb_index_keys( \"%s\" ) %s failure\n",
+				e->e_dn, a->a_desc->ad_cname.bv_val, 0 );
+			return rc;
+		}
+	}
+	return LDAP_SUCCESS;
+}
+
+static int
+mdb_key_cmp( const void *v1, const void *v2 )
+{
+	const struct berval *k1 = v1, *k2 = v2;
+	int rc;
+
+	rc = memcmp( k1->bv_val, k2->bv_val,
+		k1->bv_len < k2->bv_len ? k1->bv_len : k2->bv_len );
+	if ( !rc )
+		rc = ( k1->bv_len > k2->bv_len ) - ( k1->bv_len < k2->bv_len );
+	return rc;
+}
+
+/* Insert keys collected by mdb_index_keys() for entry id. The keys of
+ * each index are sorted first so the inserts walk the tree in order.
+ */
+int
+mdb_index_keys_put(
+	Operation *op,
+	MDB_txn *txn,
+	IndexKeys *ik,
+	ID id )
+{
+	MDB_cursor *mc = NULL;
+	AttrInfo *ai = NULL;
+	int i, rc = 0;
+
+	for ( ; ik; ik = ik->ik_next ) {
+		if ( ik->ik_ai != ai ) {
+			if ( mc )
+				mdb_cursor_close( mc );
+			ai = ik->ik_ai;
+			rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
+			if ( rc ) {
+				mc = NULL;
+				break;
+			}
+		}
+		if ( ik->ik_keys != presence_key ) {
+			for ( i = 0; !BER_BVISNULL( &ik->ik_keys[i] ); i++ ) ;
+			if ( i > 1 )
+				qsort( ik->ik_keys, i, sizeof( struct berval ), mdb_key_cmp );
+		}
+		rc = mdb_idl_insert_keys( op->o_bd, mc, ik->ik_keys, id );
+		if ( rc )
+			break;
+	}
+	if ( mc )
+		mdb_cursor_close( mc );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<= mdb_index_keys_put( %ld ) failure (%d)\n",
+			(long) id, rc, 0 );
+		rc = LDAP_OTHER;
+	}
+	return rc;
+}
+
+void
+mdb_index_keys_free(
+	Operation *op,
+	IndexKeys *ik )
+{
+	IndexKeys *next;
+
+	for ( ; ik; ik = next ) {
+		next = ik->ik_next;
+		if ( ik->ik_keys != presence_key )
+			ber_bvarray_free_x( ik->ik_keys, op->o_tmpmemctx );
+		op->o_tmpfree( ik, op->o_tmpmemctx );
+	}
+}
+
 /* Get the list of which indices apply to this attr */
 int
 mdb_index_recset(
@@ -463,7 +617,7 @@ int mdb_index_recrun(
 			rc = indexer( op, txn, ir->ir_ai, ir->ir_ai->ai_desc,
 				&ir->ir_ai->ai_desc->ad_type->sat_cname,
 				al->attr->a_nvals, id, SLAP_INDEX_ADD_OP,
-				ir->ir_ai->ai_indexmask );
+				ir->ir_ai->ai_indexmask, NULL );
 			free( al );
 			if ( rc ) break;
 		}
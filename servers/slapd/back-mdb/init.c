@@ -27,11 +27,12 @@
 #include <ldap_rq.h>
 #include "config.h"
 
-static const struct berval mdmi_databases[] = {
+const struct berval mdmi_databases[] = {
 	BER_BVC("ad2i"),
 	BER_BVC("dn2i"),
 	BER_BVC("id2e"),
 	BER_BVC("id2v"),
+	BER_BVC("id2b"),
 	BER_BVNULL
 };
 
@@ -64,9 +65,19 @@ mdb_db_init( BackendDB *be, ConfigReply *cr )
 
 	mdb->mi_mapsize = DEFAULT_MAPSIZE;
 	mdb->mi_rtxn_size = DEFAULT_RTXN_SIZE;
+	mdb->mi_index_batch = DEFAULT_INDEX_BATCH;
 	mdb->mi_multi_hi = UINT_MAX;
 	mdb->mi_multi_lo = UINT_MAX;
 
+	ldap_pvt_thread_mutex_init( &mdb->mi_ecache_mutex );
+	ldap_pvt_thread_mutex_init( &mdb->mi_commit_mutex );
+	ldap_pvt_thread_mutex_init( &mdb->mi_pcursor_mutex );
+	ldap_pvt_thread_mutex_init( &mdb->mi_ccache_mutex );
+	ldap_pvt_thread_mutex_init( &mdb->mi_gc_mutex );
+	ldap_pvt_thread_cond_init( &mdb->mi_gc_cond );
+	LDAP_TAILQ_INIT( &mdb->mi_pcursors );
+	LDAP_TAILQ_INIT( &mdb->mi_ccache );
+
 	be->be_private = mdb;
 	be->be_cf_ocs = be->bd_info->bi_cf_ocs;
 
@@ -85,7 +96,7 @@ mdb_db_close( BackendDB *be, ConfigReply *cr );
 static int
 mdb_db_open( BackendDB *be, ConfigReply *cr )
 {
-	int rc, i;
+	int rc, i, rdonly;
 	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
 	struct stat stat1;
 	uint32_t flags;
@@ -172,8 +183,17 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 	if ( slapMode & SLAP_TOOL_QUICK )
 		flags |= MDB_NOSYNC|MDB_WRITEMAP;
 
+	/* tool mode has a single writer */
+	if ( mdb->mi_wb_max && ( slapMode & SLAP_SERVER_MODE ))
+		mdb_env_set_writebatch( mdb->mi_dbenv, mdb->mi_wb_max, mdb->mi_wb_wait );
+
+	/* group commit syncs on behalf of the writers */
+	if ( mdb->mi_gc_window && ( slapMode & SLAP_SERVER_MODE ))
+		flags |= MDB_NOSYNC;
+
 	if ( slapMode & SLAP_TOOL_READONLY)
 		flags |= MDB_RDONLY;
+	rdonly = flags & MDB_RDONLY;
 
 	rc = mdb_env_open( mdb->mi_dbenv, dbhome,
 			flags, mdb->mi_dbenv_mode );
@@ -186,6 +206,9 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
+	if ( mdb->mi_counters )
+		mdb_env_set_counters( mdb->mi_dbenv, mdb->mi_counters );
+
 	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, flags & MDB_RDONLY, &txn );
 	if ( rc ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -199,14 +222,16 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 	for( i = 0; mdmi_databases[i].bv_val; i++ ) {
 		flags = MDB_INTEGERKEY;
 		if( i == MDB_ID2ENTRY ) {
-			if ( !(slapMode & (SLAP_TOOL_READMAIN|SLAP_TOOL_READONLY) ))
+			if ( !(slapMode & SLAP_TOOL_READMAIN) && !rdonly )
 				flags |= MDB_CREATE;
 		} else {
 			if ( i == MDB_DN2ID )
 				flags |= MDB_DUPSORT;
 			if ( i == MDB_ID2VAL )
 				flags ^= MDB_INTEGERKEY|MDB_DUPSORT;
-			if ( !(slapMode & SLAP_TOOL_READONLY) )
+			if ( i == MDB_ID2BIG )
+				flags ^= MDB_INTEGERKEY;
+			if ( !rdonly )
 				flags |= MDB_CREATE;
 		}
 
@@ -215,6 +240,12 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 			flags,
 			&mdb->mi_dbis[i] );
 
+		/* older read-only databases have no id2big, nor need it */
+		if ( rc == MDB_NOTFOUND && i == MDB_ID2BIG ) {
+			mdb->mi_dbis[i] = 0;
+			continue;
+		}
+
 		if ( rc != 0 ) {
 			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
 				"mdb_dbi_open(%s/%s) failed: %s (%d).", 
@@ -232,6 +263,8 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		else if ( i == MDB_ID2VAL ) {
 			mdb_set_compare( txn, mdb->mi_dbis[i], mdb_id2v_compare );
 			mdb_set_dupsort( txn, mdb->mi_dbis[i], mdb_id2v_dupsort );
+		} else if ( i == MDB_ID2BIG ) {
+			mdb_set_compare( txn, mdb->mi_dbis[i], mdb_id2v_compare );
 		} else if ( i == MDB_DN2ID ) {
 			MDB_cursor *mc;
 			MDB_val key, data;
@@ -282,6 +315,11 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 			mdb_txn_abort( txn );
 			goto fail;
 		}
+		rc = mdb_presmap_open( be, txn, cr );
+		if ( rc ) {
+			mdb_txn_abort( txn );
+			goto fail;
+		}
 	}
 
 	rc = mdb_txn_commit(txn);
@@ -293,12 +331,17 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
+	mdb_ecache_init( mdb );
+
 	/* monitor setup */
 	rc = mdb_monitor_db_open( be );
 	if ( rc != 0 ) {
 		goto fail;
 	}
 
+	/* with overlays, be is a copy on the stack */
+	slap_metrics_register( be->bd_self, mdb_monitor_metrics );
+
 	mdb->mi_flags |= MDB_IS_OPEN;
 
 	return 0;
@@ -316,9 +359,20 @@ mdb_db_close( BackendDB *be, ConfigReply *cr )
 
 	/* monitor handling */
 	(void)mdb_monitor_db_close( be );
+	slap_metrics_unregister( be->bd_self, mdb_monitor_metrics );
 
 	mdb->mi_flags &= ~MDB_IS_OPEN;
 
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( mdb->mi_grow_task ) {
+		struct re_s *re = mdb->mi_grow_task;
+		mdb->mi_grow_task = NULL;
+		if ( ldap_pvt_runqueue_isrunning( &slapd_rq, re ) )
+			ldap_pvt_runqueue_stoptask( &slapd_rq, re );
+		ldap_pvt_runqueue_remove( &slapd_rq, re );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
 	if( mdb->mi_dbenv ) {
 		mdb_reader_flush( mdb->mi_dbenv );
 	}
@@ -334,7 +388,8 @@ mdb_db_close( BackendDB *be, ConfigReply *cr )
 			/* force a sync, but not if we were ReadOnly,
 			 * and not in Quick mode.
 			 */
-			if (!(slapMode & (SLAP_TOOL_QUICK|SLAP_TOOL_READONLY))) {
+			if (!(slapMode & (SLAP_TOOL_QUICK|SLAP_TOOL_READONLY)) &&
+				!(mdb->mi_dbenv_flags & MDB_RDONLY)) {
 				rc = mdb_env_sync( mdb->mi_dbenv, 1 );
 				if( rc != 0 ) {
 					Debug( LDAP_DEBUG_ANY,
@@ -375,6 +430,15 @@ mdb_db_destroy( BackendDB *be, ConfigReply *cr )
 
 	mdb_attr_index_destroy( mdb );
 
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_ecache_mutex );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_commit_mutex );
+	mdb_pcursor_flush( mdb );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_pcursor_mutex );
+	mdb_ccache_flush( mdb );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_ccache_mutex );
+	ldap_pvt_thread_cond_destroy( &mdb->mi_gc_cond );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_gc_mutex );
+
 	ch_free( mdb );
 	be->be_private = NULL;
 
@@ -395,7 +459,11 @@ mdb_back_initialize(
 		LDAP_CONTROL_PRE_READ,
 		LDAP_CONTROL_POST_READ,
 		LDAP_CONTROL_SUBENTRIES,
+		LDAP_CONTROL_X_EXPLAIN,
 		LDAP_CONTROL_X_PERMISSIVE_MODIFY,
+#ifdef SLAP_CONTROL_X_TREE_DELETE
+		SLAP_CONTROL_X_TREE_DELETE,
+#endif
 #ifdef LDAP_X_TXN
 		LDAP_CONTROL_X_TXN_SPEC,
 #endif
@@ -444,6 +512,13 @@ mdb_back_initialize(
 			": %s\n", version, 0, 0 );
 	}
 
+	{	/* pick the IDL intersection kernel; Debug() may not evaluate it */
+		const char *kernel = mdb_idl_kernel( NULL );
+
+		Debug( LDAP_DEBUG_TRACE, LDAP_XSTRING(mdb_back_initialize)
+			": IDL intersection kernel %s\n", kernel, 0, 0 );
+	}
+
 	bi->bi_open = 0;
 	bi->bi_close = 0;
 	bi->bi_config = 0;
@@ -467,6 +542,7 @@ mdb_back_initialize(
 	bi->bi_op_txn = mdb_txn;
 
 	bi->bi_extended = mdb_extended;
+	mdb_exop_init();
 
 	bi->bi_chk_referrals = 0;
 	bi->bi_operational = mdb_operational;
@@ -490,9 +566,11 @@ mdb_back_initialize(
 	bi->bi_tool_dn2id_get = mdb_tool_dn2id_get;
 	bi->bi_tool_entry_modify = mdb_tool_entry_modify;
 	bi->bi_tool_entry_delete = mdb_tool_entry_delete;
+	bi->bi_tool_entry_scan = mdb_tool_entry_scan;
+	bi->bi_tool_index_rebuild = mdb_tool_index_rebuild;
 
 	bi->bi_connection_init = 0;
-	bi->bi_connection_destroy = 0;
+	bi->bi_connection_destroy = mdb_conn_destroy;
 
 	rc = mdb_back_init_cf( bi );
 
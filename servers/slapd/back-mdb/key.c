@@ -34,7 +34,8 @@ mdb_key_read(
 	struct berval *k,
 	ID *ids,
 	MDB_cursor **saved_cursor,
-	int get_flag
+	int get_flag,
+	ID *cands
 )
 {
 	int rc;
@@ -58,7 +59,7 @@ mdb_key_read(
 		key.mv_data = k->bv_val;
 	}
 
-	rc = mdb_idl_fetch_key( be, txn, dbi, &key, ids, saved_cursor, get_flag );
+	rc = mdb_idl_fetch_key( be, txn, dbi, &key, ids, saved_cursor, get_flag, cands );
 
 	if( rc != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_TRACE, "<= mdb_index_read: failed (%d)\n",
@@ -70,3 +71,166 @@ mdb_key_read(
 
 	return rc;
 }
+
+/* estimate the number of IDs under a key without reading them */
+int
+mdb_key_count(
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *k,
+	ID *count
+)
+{
+	MDB_val key;
+#ifndef MISALIGNED_OK
+	int kbuf[2];
+
+	if (k->bv_len & ALIGNER) {
+		key.mv_size = sizeof(kbuf);
+		key.mv_data = kbuf;
+		kbuf[1] = 0;
+		memcpy(kbuf, k->bv_val, k->bv_len);
+	} else
+#endif
+	{
+		key.mv_size = k->bv_len;
+		key.mv_data = k->bv_val;
+	}
+
+	return mdb_idl_count_key( txn, dbi, &key, count );
+}
+
+/* Set up key to point to k, padded as keys are stored if need be */
+static void
+key_mval( struct berval *k, MDB_val *key, int *kbuf )
+{
+#ifndef MISALIGNED_OK
+	if (k->bv_len & ALIGNER) {
+		key->mv_size = 2 * sizeof(int);
+		key->mv_data = kbuf;
+		kbuf[1] = 0;
+		memcpy(kbuf, k->bv_val, k->bv_len);
+	} else
+#endif
+	{
+		key->mv_size = k->bv_len;
+		key->mv_data = k->bv_val;
+	}
+}
+
+/* read the keys between lo and hi, one per call through saved_cursor;
+ * either bound may be NULL
+ */
+int
+mdb_key_range_read(
+	Backend	*be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *lo,
+	struct berval *hi,
+	ID *ids,
+	MDB_cursor **saved_cursor,
+	ID *cands
+)
+{
+	int rc;
+	MDB_val lokey, hikey;
+	int lobuf[2], hibuf[2];
+
+	Debug( LDAP_DEBUG_TRACE, "=> key_range_read\n", 0, 0, 0 );
+
+	if ( lo )
+		key_mval( lo, &lokey, lobuf );
+	if ( hi )
+		key_mval( hi, &hikey, hibuf );
+
+	rc = mdb_idl_fetch_range( be, txn, dbi, lo ? &lokey : NULL,
+		hi ? &hikey : NULL, ids, saved_cursor, cands );
+
+	if( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_TRACE, "<= mdb_key_range_read: failed (%d)\n",
+			rc, 0, 0 );
+	} else {
+		Debug( LDAP_DEBUG_TRACE, "<= mdb_key_range_read %ld candidates\n",
+			(long) MDB_IDL_N(ids), 0, 0 );
+	}
+
+	return rc;
+}
+
+/* estimate the number of IDs under the keys between lo and hi */
+int
+mdb_key_range_count(
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *lo,
+	struct berval *hi,
+	int maxkeys,
+	ID *count
+)
+{
+	MDB_val lokey, hikey;
+	int lobuf[2], hibuf[2];
+
+	if ( lo )
+		key_mval( lo, &lokey, lobuf );
+	if ( hi )
+		key_mval( hi, &hikey, hibuf );
+
+	return mdb_idl_count_range( txn, dbi, lo ? &lokey : NULL,
+		hi ? &hikey : NULL, maxkeys, count );
+}
+
+static int
+mdb_key_cmp( const void *a, const void *b )
+{
+	return memcmp( ((struct berval *)a)->bv_val,
+		((struct berval *)b)->bv_val, ((struct berval *)a)->bv_len );
+}
+
+/* Fold substring keys into 2^mi_substr_bits buckets. Values sharing
+ * n-grams then share index slots, so the index holds far fewer keys;
+ * the extra candidates this lets through are dropped when the filter
+ * is tested against each entry.
+ */
+void
+mdb_key_fold(
+	struct mdb_info *mdb,
+	BerVarray keys,
+	void *ctx
+)
+{
+	ber_len_t len, j;
+	uint32_t h;
+	int i, n;
+
+	if ( !mdb->mi_substr_bits )
+		return;
+
+	len = ( mdb->mi_substr_bits + 7 ) / 8;
+	for ( n = 0; keys[n].bv_val; n++ ) {
+		h = 0;
+		for ( j = 0; j < keys[n].bv_len; j++ )
+			h = h * 31 + (unsigned char)keys[n].bv_val[j];
+		h ^= h >> mdb->mi_substr_bits;
+		h &= ( 1U << mdb->mi_substr_bits ) - 1;
+		for ( j = 0; j < len; j++ ) {
+			keys[n].bv_val[j] = h & 0xff;
+			h >>= 8;
+		}
+		keys[n].bv_len = len;
+	}
+
+	/* the same bucket must not be added twice for one entry */
+	if ( n > 1 ) {
+		qsort( keys, n, sizeof(struct berval), mdb_key_cmp );
+		for ( i = 1, j = 0; i < n; i++ ) {
+			if ( !memcmp( keys[i].bv_val, keys[j].bv_val, len )) {
+				ber_memfree_x( keys[i].bv_val, ctx );
+			} else {
+				keys[++j] = keys[i];
+			}
+		}
+		BER_BVZERO( &keys[j+1] );
+	}
+}
@@ -548,6 +548,14 @@ do_del:
 		}
 	}
 
+	rc = mdb_presmap_mods( op, tid, e->e_id, save_attrs, e->e_attrs );
+	if ( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY, "%s: presence map update failure\n",
+			op->o_log_prefix, 0, 0 );
+		attrs_free( e->e_attrs );
+		e->e_attrs = save_attrs;
+	}
+
 	return rc;
 }
 
@@ -752,9 +760,13 @@ mdb_modify( Operation *op, SlapReply *rs )
 			txn = NULL;
 			goto return_results;
 		} else {
-			rs->sr_err = mdb_txn_commit( txn );
+			rs->sr_err = mdb_commit( mdb, txn );
 			if ( rs->sr_err )
 				mdb->mi_numads = numads;
+			else
+				rs->sr_err = mdb_txn_durable( op, mdb );
+			if ( rs->sr_err == 0 )
+				mdb_maxsize_check( op );
 			txn = NULL;
 		}
 	}
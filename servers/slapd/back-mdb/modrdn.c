@@ -551,10 +551,13 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 			goto return_results;
 
 		} else {
-			if(( rs->sr_err=mdb_txn_commit( txn )) != 0 ) {
+			if(( rs->sr_err=mdb_commit( mdb, txn )) != 0 ) {
 				rs->sr_text = "txn_commit failed";
+			} else if (( rs->sr_err=mdb_txn_durable( op, mdb )) != 0 ) {
+				rs->sr_text = "txn sync failed";
 			} else {
 				rs->sr_err = LDAP_SUCCESS;
+				mdb_maxsize_check( op );
 			}
 			txn = NULL;
 		}
@@ -31,7 +31,16 @@
 
 static ObjectClass		*oc_olmMDBDatabase;
 
-static AttributeDescription *ad_olmDbDirectory;
+static AttributeDescription *ad_olmDbDirectory,
+	*ad_olmDbEntryCacheHits, *ad_olmDbEntryCacheMisses,
+	*ad_olmDbIndexState, *ad_olmDbIndexDone, *ad_olmDbIndexTotal,
+	*ad_olmDbIndexETA, *ad_olmDbMapHeadroom, *ad_olmDbOldestReaderLag,
+	*ad_olmDbCandCacheHits, *ad_olmDbCandCacheMisses,
+	*ad_olmDbPageCounters,
+	*ad_olmMDBPagesMax, *ad_olmMDBPagesUsed, *ad_olmMDBPagesFree,
+	*ad_olmMDBFreeRunMax, *ad_olmMDBReadersMax, *ad_olmMDBReadersUsed,
+	*ad_olmMDBDirtyPagesPerCommit, *ad_olmMDBCommitTime,
+	*ad_olmMDBDbSize;
 
 #ifdef MDB_MONITOR_IDX
 static int
@@ -78,6 +87,166 @@ static struct {
 		"USAGE dSAOperation )",
 		&ad_olmDbDirectory },
 
+	{ "( olmDatabaseAttributes:3 "
+		"NAME ( 'olmDbEntryCacheHits' ) "
+		"DESC 'Number of entries found in the decoded entry cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbEntryCacheHits },
+
+	{ "( olmDatabaseAttributes:4 "
+		"NAME ( 'olmDbEntryCacheMisses' ) "
+		"DESC 'Number of entries not found in the decoded entry cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbEntryCacheMisses },
+
+	{ "( olmDatabaseAttributes:5 "
+		"NAME ( 'olmDbIndexState' ) "
+		"DESC 'State of online reindexing: idle, running or paused' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbIndexState },
+
+	{ "( olmDatabaseAttributes:6 "
+		"NAME ( 'olmDbIndexDone' ) "
+		"DESC 'Number of entries processed by online reindexing' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbIndexDone },
+
+	{ "( olmDatabaseAttributes:7 "
+		"NAME ( 'olmDbIndexTotal' ) "
+		"DESC 'Number of entries online reindexing will process' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbIndexTotal },
+
+	{ "( olmDatabaseAttributes:8 "
+		"NAME ( 'olmDbIndexETA' ) "
+		"DESC 'Estimated seconds until online reindexing completes' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbIndexETA },
+
+	{ "( olmDatabaseAttributes:9 "
+		"NAME ( 'olmDbMapHeadroom' ) "
+		"DESC 'Bytes of the map above the highest page in use' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbMapHeadroom },
+
+	{ "( olmDatabaseAttributes:10 "
+		"NAME ( 'olmDbOldestReaderLag' ) "
+		"DESC 'Write txns committed since the oldest live reader snapshot' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbOldestReaderLag },
+
+	{ "( olmDatabaseAttributes:11 "
+		"NAME ( 'olmDbCandCacheHits' ) "
+		"DESC 'Searches whose candidates came from the candidate cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbCandCacheHits },
+
+	{ "( olmDatabaseAttributes:12 "
+		"NAME ( 'olmDbCandCacheMisses' ) "
+		"DESC 'Searches that computed their candidates' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbCandCacheMisses },
+
+	{ "( olmDatabaseAttributes:13 "
+		"NAME ( 'olmDbPageCounters' ) "
+		"DESC 'Page activity of each internal database, if counters is set' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbPageCounters },
+
+	{ "( olmMDBAttributes:1 "
+		"NAME ( 'olmMDBPagesMax' ) "
+		"DESC 'Number of pages the map can hold' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBPagesMax },
+
+	{ "( olmMDBAttributes:2 "
+		"NAME ( 'olmMDBPagesUsed' ) "
+		"DESC 'Number of pages up to the highest page in use' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBPagesUsed },
+
+	{ "( olmMDBAttributes:3 "
+		"NAME ( 'olmMDBPagesFree' ) "
+		"DESC 'Number of pages in the freelist' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBPagesFree },
+
+	{ "( olmMDBAttributes:4 "
+		"NAME ( 'olmMDBFreeRunMax' ) "
+		"DESC 'Longest run of contiguous pages in the freelist' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBFreeRunMax },
+
+	{ "( olmMDBAttributes:5 "
+		"NAME ( 'olmMDBReadersMax' ) "
+		"DESC 'Number of reader slots in the environment' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBReadersMax },
+
+	{ "( olmMDBAttributes:6 "
+		"NAME ( 'olmMDBReadersUsed' ) "
+		"DESC 'Number of reader slots held by live threads' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBReadersUsed },
+
+	{ "( olmMDBAttributes:7 "
+		"NAME ( 'olmMDBDirtyPagesPerCommit' ) "
+		"DESC 'Average pages written by a write txn, if counters is set' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBDirtyPagesPerCommit },
+
+	{ "( olmMDBAttributes:8 "
+		"NAME ( 'olmMDBCommitTime' ) "
+		"DESC 'Percentiles of write txn commit time in microseconds' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBCommitTime },
+
+	{ "( olmMDBAttributes:9 "
+		"NAME ( 'olmMDBDbSize' ) "
+		"DESC 'Size of each internal and index database' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBDbSize },
+
 #ifdef MDB_MONITOR_IDX
 	{ "( olmDatabaseAttributes:2 "
 		"NAME ( 'olmDbNotIndexed' ) "
@@ -102,6 +271,26 @@ static struct {
 		"SUP top AUXILIARY "
 		"MAY ( "
 			"olmDbDirectory "
+			"$ olmDbEntryCacheHits "
+			"$ olmDbEntryCacheMisses "
+			"$ olmDbIndexState "
+			"$ olmDbIndexDone "
+			"$ olmDbIndexTotal "
+			"$ olmDbIndexETA "
+			"$ olmDbMapHeadroom "
+			"$ olmDbOldestReaderLag "
+			"$ olmDbCandCacheHits "
+			"$ olmDbCandCacheMisses "
+			"$ olmDbPageCounters "
+			"$ olmMDBPagesMax "
+			"$ olmMDBPagesUsed "
+			"$ olmMDBPagesFree "
+			"$ olmMDBFreeRunMax "
+			"$ olmMDBReadersMax "
+			"$ olmMDBReadersUsed "
+			"$ olmMDBDirtyPagesPerCommit "
+			"$ olmMDBCommitTime "
+			"$ olmMDBDbSize "
 #ifdef MDB_MONITOR_IDX
 			"$ olmDbNotIndexed "
 #endif /* MDB_MONITOR_IDX */
@@ -111,6 +300,269 @@ static struct {
 	{ NULL }
 };
 
+struct mdb_monitor_readers {
+	unsigned long	oldest;
+	unsigned	used;
+};
+
+/* mdb_reader_list() callback, keeps the lowest txnid of a live reader
+ * and counts the slots in use */
+static int
+mdb_monitor_reader( const char *msg, void *ctx )
+{
+	struct mdb_monitor_readers *mr = ctx;
+	unsigned long tid, txnid;
+	int pid, n;
+
+	n = sscanf( msg, "%d %lx %lu", &pid, &tid, &txnid );
+	if ( n >= 2 )
+		mr->used++;
+	if ( n == 3 && txnid < mr->oldest )
+		mr->oldest = txnid;
+	return 0;
+}
+
+/* Replace the values of ad in e, adding the attribute if needed */
+static void
+mdb_monitor_set( Entry *e, AttributeDescription *ad, BerVarray vals )
+{
+	Attribute	*a, **ap;
+	int		i;
+
+	a = attr_find( e->e_attrs, ad );
+	if ( a != NULL ) {
+		assert( a->a_nvals == a->a_vals );
+		ber_bvarray_free( a->a_vals );
+	} else {
+		for ( ap = &e->e_attrs; *ap != NULL; ap = &(*ap)->a_next )
+			;
+		*ap = attr_alloc( ad );
+		a = *ap;
+	}
+	a->a_vals = vals;
+	a->a_nvals = a->a_vals;
+	for ( i = 0; vals[i].bv_val; i++ )
+		;
+	a->a_numvals = i;
+}
+
+static void
+mdb_monitor_set_ulong( Entry *e, AttributeDescription *ad, unsigned long n )
+{
+	BerVarray	vals = NULL;
+	char		buf[ 32 ];
+	struct berval	bv;
+
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", n );
+	value_add_one( &vals, &bv );
+	mdb_monitor_set( e, ad, vals );
+}
+
+static int
+mdb_monitor_pgno_cmp( const void *a, const void *b )
+{
+	size_t pa = *(const size_t *)a, pb = *(const size_t *)b;
+
+	return pa < pb ? -1 : pa > pb;
+}
+
+/*
+ * Count the pages in the freelist and find the longest contiguous
+ * run of them. A run may span freelist records, so all the page
+ * numbers are gathered and sorted.
+ */
+static void
+mdb_monitor_freelist( MDB_txn *txn, unsigned long *nfree,
+	unsigned long *maxrun )
+{
+	MDB_cursor	*mc;
+	MDB_val		key, data;
+	size_t		*pgs = NULL, *iptr;
+	size_t		n = 0, max = 0, i, run;
+
+	*nfree = *maxrun = 0;
+	if ( mdb_cursor_open( txn, 0, &mc ))
+		return;
+	while ( mdb_cursor_get( mc, &key, &data, MDB_NEXT ) == 0 ) {
+		iptr = data.mv_data;
+		if ( n + iptr[0] > max ) {
+			max = ( n + iptr[0] ) * 2;
+			pgs = ch_realloc( pgs, max * sizeof( size_t ));
+		}
+		AC_MEMCPY( pgs + n, iptr + 1, iptr[0] * sizeof( size_t ));
+		n += iptr[0];
+	}
+	mdb_cursor_close( mc );
+
+	if ( n ) {
+		qsort( pgs, n, sizeof( size_t ), mdb_monitor_pgno_cmp );
+		for ( i = 1, run = 1, *maxrun = 1; i < n; i++ ) {
+			run = pgs[i] == pgs[i-1] + 1 ? run + 1 : 1;
+			if ( run > *maxrun )
+				*maxrun = run;
+		}
+	}
+	*nfree = n;
+	ch_free( pgs );
+}
+
+static void
+mdb_monitor_dbsize_val( BerVarray *vals, MDB_txn *txn,
+	const char *name, MDB_dbi dbi )
+{
+	MDB_stat	st;
+	char		buf[ BUFSIZ ];
+	struct berval	bv;
+
+	if ( mdb_stat( txn, dbi, &st ))
+		return;
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ),
+		"%s pages=%lu entries=%lu depth=%u", name,
+		(unsigned long)( st.ms_branch_pages + st.ms_leaf_pages +
+			st.ms_overflow_pages ),
+		(unsigned long)st.ms_entries, st.ms_depth );
+	if ( bv.bv_len < sizeof( buf ))
+		value_add_one( vals, &bv );
+}
+
+/* "p50=<usec> p90=<usec> p99=<usec> p999=<usec>", like the operation
+ * latencies of cn=Operations */
+static void
+mdb_monitor_commit_time( struct mdb_info *mdb, Entry *e )
+{
+	static const int	permille[] = { 500, 900, 990, 999 };
+	static const char	*names[] = { "p50", "p90", "p99", "p999" };
+	unsigned long		hist[ MDB_COMMIT_BUCKETS ], total = 0, seen, need;
+	BerVarray		vals = NULL;
+	struct berval		bv;
+	char			buf[ 128 ];
+	int			i, k, len = 0;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_commit_mutex );
+	AC_MEMCPY( hist, mdb->mi_commit_hist, sizeof( hist ));
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_commit_mutex );
+
+	for ( k = 0; k < MDB_COMMIT_BUCKETS; k++ )
+		total += hist[k];
+
+	for ( i = 0, k = 0, seen = 0; i < 4; i++ ) {
+		unsigned long usec = 0;
+
+		if ( total ) {
+			need = ( total * permille[i] + 999 ) / 1000;
+			for ( ; k < MDB_COMMIT_BUCKETS - 1; k++ ) {
+				if ( seen + hist[k] >= need )
+					break;
+				seen += hist[k];
+			}
+			usec = ( 1UL << k ) - 1;
+		}
+		len += snprintf( buf + len, sizeof( buf ) - len, "%s%s=%lu",
+			i ? " " : "", names[i], usec );
+	}
+
+	bv.bv_val = buf;
+	bv.bv_len = len;
+	value_add_one( &vals, &bv );
+	mdb_monitor_set( e, ad_olmMDBCommitTime, vals );
+}
+
+/* Sizes of the environment, its freelist and each of its databases */
+static void
+mdb_monitor_env( struct mdb_info *mdb, Entry *e, MDB_envinfo *ei,
+	MDB_stat *st, unsigned readers )
+{
+	MDB_txn		*txn;
+	MDB_counters	ct;
+	BerVarray	vals = NULL;
+	unsigned long	nfree, maxrun;
+	int		i;
+
+	mdb_monitor_set_ulong( e, ad_olmMDBPagesMax,
+		ei->me_mapsize / st->ms_psize );
+	mdb_monitor_set_ulong( e, ad_olmMDBPagesUsed, ei->me_last_pgno + 1 );
+	mdb_monitor_set_ulong( e, ad_olmMDBReadersMax, ei->me_maxreaders );
+	mdb_monitor_set_ulong( e, ad_olmMDBReadersUsed, readers );
+
+	if ( mdb_env_counters( mdb->mi_dbenv, 0, &ct ) == 0 )
+		mdb_monitor_set_ulong( e, ad_olmMDBDirtyPagesPerCommit,
+			ct.mc_commits ? ct.mc_dirty_pages / ct.mc_commits : 0 );
+
+	mdb_monitor_commit_time( mdb, e );
+
+	if ( mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn ))
+		return;
+
+	mdb_monitor_freelist( txn, &nfree, &maxrun );
+	mdb_monitor_set_ulong( e, ad_olmMDBPagesFree, nfree );
+	mdb_monitor_set_ulong( e, ad_olmMDBFreeRunMax, maxrun );
+
+	mdb_monitor_dbsize_val( &vals, txn, "freelist", 0 );
+	for ( i = 0; i < MDB_NDB; i++ )
+		mdb_monitor_dbsize_val( &vals, txn, mdmi_databases[i].bv_val,
+			mdb->mi_dbis[i] );
+	if ( mdb->mi_presmap )
+		mdb_monitor_dbsize_val( &vals, txn, "ad2pres", mdb->mi_ad2pres );
+	for ( i = 0; i < mdb->mi_nattrs; i++ )
+		mdb_monitor_dbsize_val( &vals, txn,
+			mdb->mi_attrs[i]->ai_desc->ad_cname.bv_val,
+			mdb->mi_attrs[i]->ai_dbi );
+	mdb_txn_abort( txn );
+
+	if ( vals )
+		mdb_monitor_set( e, ad_olmMDBDbSize, vals );
+}
+
+static void
+mdb_monitor_counter_val( BerVarray *vals, struct mdb_info *mdb,
+	const char *name, MDB_dbi dbi )
+{
+	MDB_counters	ct;
+	char		buf[ BUFSIZ ];
+	struct berval	bv;
+
+	if ( mdb_env_counters( mdb->mi_dbenv, dbi, &ct ))
+		return;
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ),
+		"%s visits=%lu notInRAM=%lu/%lu splits=%lu merges=%lu overflows=%lu",
+		name, (unsigned long)ct.mc_page_gets,
+		(unsigned long)ct.mc_page_faults, (unsigned long)ct.mc_page_samples,
+		(unsigned long)ct.mc_splits, (unsigned long)ct.mc_merges,
+		(unsigned long)ct.mc_overflow_allocs );
+	if ( dbi == 0 && bv.bv_len < sizeof( buf ))
+		bv.bv_len += snprintf( buf + bv.bv_len, sizeof( buf ) - bv.bv_len,
+			" searches=%lu reads=%lu",
+			(unsigned long)ct.mc_freelist_searches,
+			(unsigned long)ct.mc_freelist_reads );
+	if ( bv.bv_len >= sizeof( buf ))
+		bv.bv_len = sizeof( buf ) - 1;
+	value_add_one( vals, &bv );
+}
+
+/* one olmDbPageCounters value per internal database */
+static void
+mdb_monitor_counters( struct mdb_info *mdb, Entry *e )
+{
+	BerVarray	vals = NULL;
+	int		i;
+
+	mdb_monitor_counter_val( &vals, mdb, "freelist", 0 );
+	for ( i = 0; i < MDB_NDB; i++ )
+		mdb_monitor_counter_val( &vals, mdb, mdmi_databases[i].bv_val,
+			mdb->mi_dbis[i] );
+	if ( mdb->mi_presmap )
+		mdb_monitor_counter_val( &vals, mdb, "ad2pres", mdb->mi_ad2pres );
+	for ( i = 0; i < mdb->mi_nattrs; i++ )
+		mdb_monitor_counter_val( &vals, mdb,
+			mdb->mi_attrs[i]->ai_desc->ad_cname.bv_val,
+			mdb->mi_attrs[i]->ai_dbi );
+	if ( vals != NULL )
+		mdb_monitor_set( e, ad_olmDbPageCounters, vals );
+}
+
 static int
 mdb_monitor_update(
 	Operation	*op,
@@ -118,15 +570,156 @@ mdb_monitor_update(
 	Entry		*e,
 	void		*priv )
 {
-#ifdef MDB_MONITOR_IDX
 	struct mdb_info		*mdb = (struct mdb_info *) priv;
+	Attribute		*a;
+
+	char			buf[ BUFSIZ ];
+	struct berval		bv;
+	unsigned long		hits, misses;
+	static const char	*states[] = { "idle", "running", "paused" };
+	ID			done, total, eta = 0;
+	time_t			elapsed;
+	MDB_envinfo		ei;
+	MDB_stat		st;
+	struct mdb_monitor_readers	mr;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_ecache_mutex );
+	hits = mdb->mi_ecache_hits;
+	misses = mdb->mi_ecache_misses;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_ecache_mutex );
+
+	a = attr_find( e->e_attrs, ad_olmDbEntryCacheHits );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", hits );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmDbEntryCacheMisses );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", misses );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_ccache_mutex );
+	hits = mdb->mi_ccache_hits;
+	misses = mdb->mi_ccache_misses;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_ccache_mutex );
+
+	a = attr_find( e->e_attrs, ad_olmDbCandCacheHits );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", hits );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmDbCandCacheMisses );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", misses );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	/* these are only updated by the index task, a stale
+	 * read just gives a slightly older estimate */
+	done = mdb->mi_index_done;
+	total = mdb->mi_index_total;
+	if ( mdb->mi_index_state == MDB_REINDEX_RUNNING &&
+		done > mdb->mi_index_run_done && total > done )
+	{
+		elapsed = slap_get_time() - mdb->mi_index_run_start;
+		eta = ( total - done ) * elapsed / ( done - mdb->mi_index_run_done );
+	}
+
+	a = attr_find( e->e_attrs, ad_olmDbIndexState );
+	assert( a != NULL );
+	ber_str2bv( states[ mdb->mi_index_state ], 0, 0, &bv );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmDbIndexDone );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", done );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmDbIndexTotal );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", total );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmDbIndexETA );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", eta );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	mdb_env_info( mdb->mi_dbenv, &ei );
+	mdb_env_stat( mdb->mi_dbenv, &st );
+	a = attr_find( e->e_attrs, ad_olmDbMapHeadroom );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", (unsigned long)
+		( ei.me_mapsize - ( ei.me_last_pgno + 1 ) * st.ms_psize ));
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	/* readers pinning old snapshots keep their pages from being reused;
+	 * drop the slots of processes that died holding one first */
+	mdb_reader_check( mdb->mi_dbenv, NULL );
+	mr.oldest = ei.me_last_txnid;
+	mr.used = 0;
+	mdb_reader_list( mdb->mi_dbenv, mdb_monitor_reader, &mr );
+	a = attr_find( e->e_attrs, ad_olmDbOldestReaderLag );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu",
+		(unsigned long) ei.me_last_txnid - mr.oldest );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	mdb_monitor_env( mdb, e, &ei, &st, mr.used );
+
+	if ( mdb->mi_counters )
+		mdb_monitor_counters( mdb, e );
 
+#ifdef MDB_MONITOR_IDX
 	mdb_monitor_idx_entry_add( mdb, e );
 #endif /* MDB_MONITOR_IDX */
 
 	return SLAP_CB_CONTINUE;
 }
 
+/* samples for the metrics extended operation */
+void
+mdb_monitor_metrics( BackendDB *be, slap_metrics *ms )
+{
+	struct mdb_info		*mdb = (struct mdb_info *) be->be_private;
+	MDB_envinfo		ei;
+	MDB_stat		st;
+	MDB_txn			*txn;
+	unsigned long		hits, misses;
+
+	mdb_env_info( mdb->mi_dbenv, &ei );
+	mdb_env_stat( mdb->mi_dbenv, &st );
+	slap_metrics_add( ms, "slapd_mdb_map_size_bytes", "gauge", be, NULL,
+		"%lu", (unsigned long) ei.me_mapsize );
+	slap_metrics_add( ms, "slapd_mdb_used_bytes", "gauge", be, NULL,
+		"%lu", (unsigned long) ( ei.me_last_pgno + 1 ) * st.ms_psize );
+	slap_metrics_add( ms, "slapd_mdb_page_size_bytes", "gauge", be, NULL,
+		"%u", st.ms_psize );
+	slap_metrics_add( ms, "slapd_mdb_readers", "gauge", be, NULL,
+		"%u", ei.me_numreaders );
+	slap_metrics_add( ms, "slapd_mdb_readers_max", "gauge", be, NULL,
+		"%u", ei.me_maxreaders );
+	slap_metrics_add( ms, "slapd_mdb_last_txnid", "counter", be, NULL,
+		"%lu", (unsigned long) ei.me_last_txnid );
+
+	if ( mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn ) == 0 ) {
+		if ( mdb_stat( txn, mdb->mi_id2entry, &st ) == 0 )
+			slap_metrics_add( ms, "slapd_mdb_entries", "gauge", be, NULL,
+				"%lu", (unsigned long) st.ms_entries );
+		mdb_txn_abort( txn );
+	}
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_ecache_mutex );
+	hits = mdb->mi_ecache_hits;
+	misses = mdb->mi_ecache_misses;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_ecache_mutex );
+	slap_metrics_add( ms, "slapd_mdb_entry_cache_hits_total", "counter",
+		be, NULL, "%lu", hits );
+	slap_metrics_add( ms, "slapd_mdb_entry_cache_misses_total", "counter",
+		be, NULL, "%lu", misses );
+}
+
 #if 0	/* uncomment if required */
 static int
 mdb_monitor_modify(
@@ -315,7 +908,7 @@ mdb_monitor_db_open( BackendDB *be )
 	}
 
 	/* alloc as many as required (plus 1 for objectClass) */
-	a = attrs_alloc( 1 + 1 );
+	a = attrs_alloc( 1 + 11 );
 	if ( a == NULL ) {
 		rc = 1;
 		goto cleanup;
@@ -325,6 +918,54 @@ mdb_monitor_db_open( BackendDB *be )
 	attr_valadd( a, &oc_olmMDBDatabase->soc_cname, NULL, 1 );
 	next = a->a_next;
 
+	{
+		struct berval	bv = BER_BVC( "0" );
+
+		next->a_desc = ad_olmDbEntryCacheHits;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmDbEntryCacheMisses;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmDbIndexDone;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmDbIndexTotal;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmDbIndexETA;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmDbMapHeadroom;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmDbOldestReaderLag;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmDbCandCacheHits;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmDbCandCacheMisses;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+	}
+
+	{
+		struct berval	bv = BER_BVC( "idle" );
+
+		next->a_desc = ad_olmDbIndexState;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+	}
+
 	{
 		struct berval	bv, nbv;
 		ber_len_t	pathlen = 0, len = 0;
@@ -25,14 +25,13 @@
 #include "back-mdb.h"
 
 /*
- * sets *hasSubordinates to LDAP_COMPARE_TRUE/LDAP_COMPARE_FALSE
- * if the entry has children or not.
+ * sets *nkids to the number of children of the entry
  */
-int
-mdb_hasSubordinates(
+static int
+mdb_nkids(
 	Operation	*op,
 	Entry		*e,
-	int		*hasSubordinates )
+	ID		*nkids )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	MDB_txn		*rtxn;
@@ -52,21 +51,20 @@ mdb_hasSubordinates(
 
 	rtxn = moi->moi_txn;
 
-	rc = mdb_dn2id_children( op, rtxn, e );
+	rc = mdb_dn2id_nkids( op, rtxn, e, nkids );
 
 	switch( rc ) {
 	case 0:
-		*hasSubordinates = LDAP_COMPARE_TRUE;
 		break;
 
 	case MDB_NOTFOUND:
-		*hasSubordinates = LDAP_COMPARE_FALSE;
+		*nkids = 0;
 		rc = LDAP_SUCCESS;
 		break;
 
 	default:
 		Debug(LDAP_DEBUG_ARGS, 
-			"<=- " LDAP_XSTRING(mdb_hasSubordinates)
+			"<=- " LDAP_XSTRING(mdb_nkids)
 			": has_children failed: %s (%d)\n", 
 			mdb_strerror(rc), rc, 0 );
 		rc = LDAP_OTHER;
@@ -82,6 +80,42 @@ done:;
 	return rc;
 }
 
+/*
+ * sets *hasSubordinates to LDAP_COMPARE_TRUE/LDAP_COMPARE_FALSE
+ * if the entry has children or not.
+ */
+int
+mdb_hasSubordinates(
+	Operation	*op,
+	Entry		*e,
+	int		*hasSubordinates )
+{
+	ID		nkids;
+	int		rc;
+
+	rc = mdb_nkids( op, e, &nkids );
+	if ( rc == LDAP_SUCCESS )
+		*hasSubordinates = nkids ? LDAP_COMPARE_TRUE : LDAP_COMPARE_FALSE;
+	return rc;
+}
+
+/* whether ad is to be returned and isn't already */
+static int
+mdb_op_wanted(
+	SlapReply	*rs,
+	AttributeDescription *ad )
+{
+	Attribute	*a;
+
+	for ( a = rs->sr_operational_attrs; a; a = a->a_next ) {
+		if ( a->a_desc == ad )
+			return 0;
+	}
+	return attr_find( rs->sr_entry->e_attrs, ad ) == NULL &&
+		( SLAP_OPATTRS( rs->sr_attr_flags ) ||
+			ad_inlist( ad, rs->sr_attrs ) );
+}
+
 /*
  * sets the supported operational attributes (if required)
  */
@@ -91,31 +125,35 @@ mdb_operational(
 	SlapReply	*rs )
 {
 	Attribute	**ap;
+	int		has, num;
 
 	assert( rs->sr_entry != NULL );
 
-	for ( ap = &rs->sr_operational_attrs; *ap; ap = &(*ap)->a_next ) {
-		if ( (*ap)->a_desc == slap_schema.si_ad_hasSubordinates ) {
-			break;
-		}
-	}
+	has = mdb_op_wanted( rs, slap_schema.si_ad_hasSubordinates );
+	num = mdb_op_wanted( rs, slap_schema.si_ad_numSubordinates );
 
-	if ( *ap == NULL &&
-		attr_find( rs->sr_entry->e_attrs, slap_schema.si_ad_hasSubordinates ) == NULL &&
-		( SLAP_OPATTRS( rs->sr_attr_flags ) ||
-			ad_inlist( slap_schema.si_ad_hasSubordinates, rs->sr_attrs ) ) )
-	{
-		int	hasSubordinates, rc;
+	/* one lookup answers both */
+	if ( has || num ) {
+		ID	nkids;
+		int	rc;
 
-		rc = mdb_hasSubordinates( op, rs->sr_entry, &hasSubordinates );
-		if ( rc == LDAP_SUCCESS ) {
-			*ap = slap_operational_hasSubordinate( hasSubordinates == LDAP_COMPARE_TRUE );
-			assert( *ap != NULL );
+		for ( ap = &rs->sr_operational_attrs; *ap; ap = &(*ap)->a_next )
+			;
 
-			ap = &(*ap)->a_next;
+		rc = mdb_nkids( op, rs->sr_entry, &nkids );
+		if ( rc == LDAP_SUCCESS ) {
+			if ( has ) {
+				*ap = slap_operational_hasSubordinate( nkids != 0 );
+				assert( *ap != NULL );
+				ap = &(*ap)->a_next;
+			}
+			if ( num ) {
+				*ap = slap_operational_numSubordinates( nkids );
+				assert( *ap != NULL );
+				ap = &(*ap)->a_next;
+			}
 		}
 	}
 
 	return LDAP_SUCCESS;
 }
-
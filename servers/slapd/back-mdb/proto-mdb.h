@@ -58,6 +58,15 @@ void mdb_attr_info_free( AttrInfo *ai );
 int mdb_ad_read( struct mdb_info *mdb, MDB_txn *txn );
 int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad );
 
+int mdb_presmap_open( BackendDB *be, MDB_txn *txn, ConfigReply *cr );
+int mdb_presmap_done( struct mdb_info *mdb, MDB_txn *txn );
+int mdb_presmap_stale( struct mdb_info *mdb, MDB_txn *txn );
+int mdb_presmap_entry( Operation *op, MDB_txn *txn, int opid, Entry *e );
+int mdb_presmap_mods( Operation *op, MDB_txn *txn, ID id,
+	Attribute *oldattrs, Attribute *newattrs );
+int mdb_presmap_read( Operation *op, MDB_txn *txn, AttributeDescription *desc,
+	ID *ids );
+
 /*
  * config.c
  */
@@ -70,6 +79,9 @@ int mdb_back_init_cf( BackendInfo *bi );
 
 int mdb_dn2entry LDAP_P(( Operation *op, MDB_txn *tid, MDB_cursor *mc,
 	struct berval *dn, Entry **e, ID *nsubs, int matched ));
+int mdb_dn2entry_skip LDAP_P(( Operation *op, MDB_txn *tid, MDB_cursor *mc,
+	struct berval *dn, Entry **e, ID *nsubs, int matched,
+	AttributeName *skip, unsigned *skipmask ));
 
 /*
  * dn2id.c
@@ -105,6 +117,12 @@ int mdb_dn2id_children(
 	MDB_txn *tid,
 	Entry *e );
 
+int mdb_dn2id_nkids(
+	Operation *op,
+	MDB_txn *tid,
+	Entry *e,
+	ID *nkids );
+
 int mdb_dn2sups (
 	Operation *op,
 	MDB_txn *tid,
@@ -173,6 +191,10 @@ int mdb_filter_candidates(
 	ID *tmp,
 	ID *stack );
 
+int mdb_explain_step( Operation *op, const char *fmt, ... );
+void mdb_explain_more( Operation *op, int slot, const char *fmt, ... );
+void mdb_explain_ids( Operation *op, int slot, ID *ids );
+
 /*
  * id2entry.c
  */
@@ -203,6 +225,14 @@ int mdb_id2entry(
 	ID id,
 	Entry **e);
 
+int mdb_id2entry_skip(
+	Operation *op,
+	MDB_cursor *mc,
+	ID id,
+	Entry **e,
+	AttributeName *skip,
+	unsigned *skipmask);
+
 int mdb_id2edata(
 	Operation *op,
 	MDB_cursor *mc,
@@ -215,12 +245,23 @@ BI_entry_get_rw mdb_entry_get;
 BI_op_txn mdb_txn;
 
 int mdb_entry_decode( Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e );
+int mdb_entry_decode_need( Operation *op, MDB_txn *txn, MDB_val *data, ID id,
+	Entry **e, AttributeName *need, AttributeName *skip, unsigned *skipmask );
+
+void mdb_ecache_init( struct mdb_info *mdb );
+int mdb_ecache_get( Operation *op, MDB_txn *txn, ID id, Entry **e );
+void mdb_ecache_release( Operation *op, Entry *e );
 
 void mdb_reader_flush( MDB_env *env );
 int mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **moi );
+int mdb_commit( struct mdb_info *mdb, MDB_txn *txn );
+int mdb_txn_durable( Operation *op, struct mdb_info *mdb );
+void mdb_maxsize_check( Operation *op );
 
 int mdb_mval_put(Operation *op, MDB_cursor *mc, ID id, Attribute *a);
 int mdb_mval_del(Operation *op, MDB_cursor *mc, ID id, Attribute *a);
+int mdb_mval_find(Operation *op, MDB_txn *txn, ID id, AttributeDescription *ad,
+	struct berval *val);
 
 /*
  * idl.c
@@ -235,7 +276,32 @@ int mdb_idl_fetch_key(
 	MDB_val		*key,
 	ID			*ids,
 	MDB_cursor	**saved_cursor,
-	int                     get_flag );
+	int                     get_flag,
+	ID			*cands );
+
+int mdb_idl_fetch_range(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*lo,
+	MDB_val		*hi,
+	ID			*ids,
+	MDB_cursor	**saved_cursor,
+	ID			*cands );
+
+int mdb_idl_count_key(
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*count );
+
+int mdb_idl_count_range(
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*lo,
+	MDB_val		*hi,
+	int			maxkeys,
+	ID			*count );
 
 int mdb_idl_insert( ID *ids, ID id );
 
@@ -264,6 +330,7 @@ ID mdb_idl_next( ID *ids, ID *cursor );
 void mdb_idl_sort( ID *ids, ID *tmp );
 int mdb_idl_append( ID *a, ID *b );
 int mdb_idl_append_one( ID *ids, ID id );
+const char *mdb_idl_kernel( const char *name );
 
 
 /*
@@ -313,11 +380,36 @@ mdb_index_recrun LDAP_P((
 
 int mdb_index_entry LDAP_P(( Operation *op, MDB_txn *t, int r, Entry *e ));
 
+extern int
+mdb_index_keys LDAP_P((
+	Operation *op,
+	Entry *e,
+	Attribute *a,
+	IndexKeys **ikp ));
+
+extern int
+mdb_index_keys_put LDAP_P((
+	Operation *op,
+	MDB_txn *txn,
+	IndexKeys *ik,
+	ID id ));
+
+extern void
+mdb_index_keys_free LDAP_P((
+	Operation *op,
+	IndexKeys *ik ));
+
 #define mdb_index_entry_add(op,t,e) \
 	mdb_index_entry((op),(t),SLAP_INDEX_ADD_OP,(e))
 #define mdb_index_entry_del(op,t,e) \
 	mdb_index_entry((op),(t),SLAP_INDEX_DELETE_OP,(e))
 
+/*
+ * init.c
+ */
+
+extern const struct berval mdmi_databases[];
+
 /*
  * key.c
  */
@@ -330,7 +422,41 @@ mdb_key_read(
     struct berval *k,
 	ID *ids,
     MDB_cursor **saved_cursor,
-        int get_flags );
+        int get_flags,
+	ID *cands );
+
+extern int
+mdb_key_count(
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *k,
+	ID *count );
+
+extern int
+mdb_key_range_read(
+	Backend	*be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *lo,
+	struct berval *hi,
+	ID *ids,
+	MDB_cursor **saved_cursor,
+	ID *cands );
+
+extern int
+mdb_key_range_count(
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *lo,
+	struct berval *hi,
+	int maxkeys,
+	ID *count );
+
+extern void
+mdb_key_fold(
+	struct mdb_info *mdb,
+	BerVarray keys,
+	void *ctx );
 
 /*
  * nextid.c
@@ -359,6 +485,7 @@ int mdb_monitor_db_init( BackendDB *be );
 int mdb_monitor_db_open( BackendDB *be );
 int mdb_monitor_db_close( BackendDB *be );
 int mdb_monitor_db_destroy( BackendDB *be );
+void mdb_monitor_metrics( BackendDB *be, slap_metrics *ms );
 
 #ifdef MDB_MONITOR_IDX
 int
@@ -368,6 +495,14 @@ mdb_monitor_idx_add(
 	slap_mask_t		type );
 #endif /* MDB_MONITOR_IDX */
 
+/*
+ * search.c
+ */
+
+void mdb_pcursor_flush( struct mdb_info *mdb );
+void mdb_ccache_flush( struct mdb_info *mdb );
+int mdb_acl_peeks( AccessControl *a );
+
 /*
  * former external.h
  */
@@ -385,12 +520,16 @@ extern BI_op_modrdn			mdb_modrdn;
 extern BI_op_search			mdb_search;
 extern BI_op_extended			mdb_extended;
 
+int mdb_exop_init( void );
+
 extern BI_chk_referrals			mdb_referrals;
 
 extern BI_operational			mdb_operational;
 
 extern BI_has_subordinates 		mdb_hasSubordinates;
 
+extern BI_connection_destroy		mdb_conn_destroy;
+
 /* tools.c */
 extern BI_tool_entry_open		mdb_tool_entry_open;
 extern BI_tool_entry_close		mdb_tool_entry_close;
@@ -402,8 +541,11 @@ extern BI_tool_entry_reindex		mdb_tool_entry_reindex;
 extern BI_tool_dn2id_get		mdb_tool_dn2id_get;
 extern BI_tool_entry_modify		mdb_tool_entry_modify;
 extern BI_tool_entry_delete		mdb_tool_entry_delete;
+extern BI_tool_entry_scan		mdb_tool_entry_scan;
+extern BI_tool_index_rebuild		mdb_tool_index_rebuild;
 
 extern mdb_idl_keyfunc mdb_tool_idl_add;
+extern mdb_idl_keyfunc mdb_tool_keys_add;
 
 LDAP_END_DECL
 
@@ -44,6 +44,16 @@ static void send_paged_response(
 	ID  *lastid,
 	int tentries );
 
+static slap_response mdb_explain_response;
+
+static mdb_pcursor *mdb_pcursor_get( Operation *op, struct mdb_info *mdb );
+static void mdb_pcursor_put( Operation *op, struct mdb_info *mdb,
+	mdb_pcursor *pc, ID *ids, ID ncand );
+static int mdb_ccache_get( Operation *op, struct mdb_info *mdb,
+	MDB_txn *txn, ID *ids );
+static void mdb_ccache_put( Operation *op, struct mdb_info *mdb,
+	MDB_txn *txn, ID *ids );
+
 /* Dereference aliases for a single alias entry. Return the final
  * dereferenced entry on success, NULL on any failure.
  */
@@ -326,6 +336,7 @@ typedef struct ww_ctx {
 	MDB_val data;
 	int flag;
 	int nentries;
+	time_t since;	/* when the current snapshot was taken */
 } ww_ctx;
 
 /* ITS#7904 if we get blocked while writing results to client,
@@ -369,6 +380,7 @@ mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, IdSc
 	MDB_val key;
 	int rc = 0;
 	ww->flag = 0;
+	ww->since = slap_get_time();
 	mdb_txn_renew( ww->txn );
 	mdb_cursor_renew( ww->txn, mci );
 	mdb_cursor_renew( ww->txn, mcd );
@@ -407,14 +419,527 @@ mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, IdSc
 			mdb_cursor_get( mcd, &key, &isc->scopes[i].mval, MDB_SET );
 		}
 	}
+	/* the new snapshot may have moved entries into scope */
+	if ( isc->outscopes )
+		isc->outscopes[0].mid = 0;
 	return rc;
 }
 
+/* Parallel candidate prefilter.
+ *
+ * Large candidate-based searches may hand the decode and filter test
+ * of upcoming candidates to pool threads. The candidates ahead of the
+ * search are cut into a window of fixed-size chunks; workers claim
+ * chunks in order, decode each entry in their own read txn and mark
+ * the IDs that can't match. The search thread still walks every
+ * candidate in ID order and does all the scope, visibility and limit
+ * checks and the sending itself; it just skips IDs already rejected.
+ *
+ * LMDB read txns can't be shared between threads, so a worker only
+ * helps if its own txn sees the same snapshot as the search. The
+ * search thread takes any chunk nobody has claimed yet and only waits
+ * for chunks a worker is actually running, so a saturated pool just
+ * degrades to the serial loop.
+ */
+#define MDB_PSEARCH_CHUNK	128
+#define MDB_PSEARCH_WCHUNKS	8	/* window chunks per worker */
+
+typedef struct mdb_psearch {
+	ldap_pvt_thread_mutex_t ps_mutex;
+	ldap_pvt_thread_cond_t ps_cond;
+	Operation *ps_op;
+	struct mdb_info *ps_mdb;
+	size_t ps_txnid;	/* snapshot the window was cut from */
+	ID *ps_ids;
+	unsigned char *ps_skip;
+	unsigned char *ps_done;
+	int ps_size;		/* max IDs in a window */
+	int ps_nids;
+	int ps_nchunks;
+	int ps_next;		/* next unclaimed chunk */
+	int ps_busy;		/* chunks being evaluated by workers */
+	int ps_tasks;		/* worker tasks queued or running */
+	int ps_refs;
+	int ps_closed;
+	/* only used by the search thread */
+	int ps_pos;
+	int ps_chunk;		/* last chunk known to be settled */
+} mdb_psearch;
+
+static void
+mdb_psearch_unref( mdb_psearch *ps )
+{
+	int last;
+
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	last = !--ps->ps_refs;
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+	if ( last ) {
+		ldap_pvt_thread_cond_destroy( &ps->ps_cond );
+		ldap_pvt_thread_mutex_destroy( &ps->ps_mutex );
+		ch_free( ps->ps_ids );
+		ch_free( ps );
+	}
+}
+
+static void *
+mdb_psearch_task( void *ctx, void *arg )
+{
+	mdb_psearch *ps = arg;
+	struct mdb_info *mdb = ps->ps_mdb;
+	Operation op2;
+	Opheader ohdr;
+	mdb_op_info opinfo = {{{0}}}, *moi = &opinfo;
+	MDB_txn *txn = NULL;
+	MDB_cursor *mci = NULL, *mcd = NULL;
+	Entry *e;
+	int c, i, end, ok, init = 0;
+
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	while ( !ps->ps_closed && ps->ps_next < ps->ps_nchunks ) {
+		c = ps->ps_next++;
+		ps->ps_busy++;
+		if ( !init ) {
+			/* the search op stays valid as long as we're busy */
+			op2 = *ps->ps_op;
+			ohdr = *op2.o_hdr;
+			op2.o_hdr = &ohdr;
+			op2.o_threadctx = ctx;
+			op2.o_tmpmemctx = NULL;
+			op2.o_groups = NULL;
+			LDAP_SLIST_INIT( &op2.o_extra );
+			init = 1;
+			ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+			if ( mdb_opinfo_get( &op2, mdb, 1, &moi ) == 0 ) {
+				txn = moi->moi_txn;
+				if ( mdb_cursor_open( txn, mdb->mi_id2entry, &mci ))
+					mci = NULL;
+			}
+		} else {
+			ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+		}
+
+		/* ps_txnid can't change while we hold a chunk */
+		ok = mci && mdb_txn_id( txn ) == ps->ps_txnid;
+		if ( ok ) {
+			end = ( c + 1 ) * MDB_PSEARCH_CHUNK;
+			if ( end > ps->ps_nids )
+				end = ps->ps_nids;
+			for ( i = c * MDB_PSEARCH_CHUNK; i < end; i++ ) {
+				/* missing entries are left to the search thread */
+				if ( mdb_id2entry( &op2, mci, ps->ps_ids[i], &e ))
+					continue;
+				if ( mdb_id2name( &op2, txn, &mcd, e->e_id,
+					&e->e_name, &e->e_nname ) == 0 &&
+					test_filter( &op2, e, op2.ors_filter ) != LDAP_COMPARE_TRUE &&
+					( get_manageDSAit( &op2 ) || !is_entry_referral( e )))
+					ps->ps_skip[i] = 1;
+				mdb_entry_return( &op2, e );
+			}
+		}
+
+		ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+		ps->ps_done[c] = 1;
+		ps->ps_busy--;
+		ldap_pvt_thread_cond_broadcast( &ps->ps_cond );
+		if ( !ok )
+			break;
+	}
+	ps->ps_tasks--;
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+
+	if ( mcd )
+		mdb_cursor_close( mcd );
+	if ( mci )
+		mdb_cursor_close( mci );
+	if ( txn ) {
+		mdb_txn_reset( txn );
+		LDAP_SLIST_REMOVE( &op2.o_extra, &moi->moi_oe, OpExtra, oe_next );
+	}
+	if ( init )
+		slap_op_groups_free( &op2 );
+	mdb_psearch_unref( ps );
+	return NULL;
+}
+
+static mdb_psearch *
+mdb_psearch_new( Operation *op, struct mdb_info *mdb )
+{
+	mdb_psearch *ps;
+	int nchunks = mdb->mi_search_threads * MDB_PSEARCH_WCHUNKS;
+
+	ps = ch_calloc( 1, sizeof( mdb_psearch ));
+	ps->ps_size = nchunks * MDB_PSEARCH_CHUNK;
+	ps->ps_ids = ch_malloc( ps->ps_size * ( sizeof(ID) + 1 ) + nchunks );
+	ps->ps_skip = (unsigned char *)( ps->ps_ids + ps->ps_size );
+	ps->ps_done = ps->ps_skip + ps->ps_size;
+	ldap_pvt_thread_mutex_init( &ps->ps_mutex );
+	ldap_pvt_thread_cond_init( &ps->ps_cond );
+	ps->ps_op = op;
+	ps->ps_mdb = mdb;
+	ps->ps_refs = 1;
+	return ps;
+}
+
+/* Cut a new window starting at id and hand it to the workers */
+static void
+mdb_psearch_fill( mdb_psearch *ps, MDB_txn *txn, ID *ids, ID id, ID cursor )
+{
+	int n;
+
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	/* workers may still be finishing chunks we skipped past */
+	while ( ps->ps_busy )
+		ldap_pvt_thread_cond_wait( &ps->ps_cond, &ps->ps_mutex );
+
+	for ( n = 0; n < ps->ps_size && id != NOID; n++ ) {
+		ps->ps_ids[n] = id;
+		id = mdb_idl_next( ids, &cursor );
+	}
+	ps->ps_nids = n;
+	ps->ps_nchunks = ( n + MDB_PSEARCH_CHUNK - 1 ) / MDB_PSEARCH_CHUNK;
+	memset( ps->ps_skip, 0, n );
+	memset( ps->ps_done, 0, ps->ps_nchunks );
+	ps->ps_txnid = mdb_txn_id( txn );
+	ps->ps_next = 0;
+	ps->ps_pos = 0;
+	ps->ps_chunk = -1;
+
+	/* the search thread will be working on the first chunk */
+	for ( n = ps->ps_nchunks - 1; n > 0 &&
+		ps->ps_tasks < ps->ps_mdb->mi_search_threads; n-- ) {
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+			mdb_psearch_task, ps ))
+			break;
+		ps->ps_tasks++;
+		ps->ps_refs++;
+	}
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+}
+
+/* Returns 1 if a worker already found that id doesn't match */
+static int
+mdb_psearch_skip( mdb_psearch *ps, MDB_txn *txn, ID *ids, ID id, ID cursor )
+{
+	int c;
+
+	if ( !ps->ps_nids || id > ps->ps_ids[ps->ps_nids - 1] )
+		mdb_psearch_fill( ps, txn, ids, id, cursor );
+
+	while ( ps->ps_ids[ps->ps_pos] < id )
+		ps->ps_pos++;
+	if ( ps->ps_ids[ps->ps_pos] != id )
+		return 0;
+
+	c = ps->ps_pos / MDB_PSEARCH_CHUNK;
+	if ( c != ps->ps_chunk ) {
+		ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+		if ( c >= ps->ps_next ) {
+			/* nobody has claimed it yet, do it ourselves */
+			ps->ps_next = c + 1;
+		} else {
+			while ( !ps->ps_done[c] )
+				ldap_pvt_thread_cond_wait( &ps->ps_cond, &ps->ps_mutex );
+		}
+		ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+		ps->ps_chunk = c;
+	}
+
+	/* our txn may have been renewed since the window was cut */
+	return ps->ps_skip[ps->ps_pos] && ps->ps_txnid == mdb_txn_id( txn );
+}
+
+static void
+mdb_psearch_free( mdb_psearch *ps )
+{
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	ps->ps_closed = 1;
+	while ( ps->ps_busy )
+		ldap_pvt_thread_cond_wait( &ps->ps_cond, &ps->ps_mutex );
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+	mdb_psearch_unref( ps );
+}
+
+/* Put the attributes filter f looks at into need, if given, and
+ * return how many there are, or -1 if it may look at any attribute.
+ */
+static int
+mdb_filter_need( Filter *f, AttributeName *need )
+{
+	AttributeDescription *ad;
+	int n, i;
+
+	switch ( f->f_choice & SLAPD_FILTER_MASK ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+	case LDAP_FILTER_NOT:
+		n = 0;
+		for ( f = f->f_list; f; f = f->f_next ) {
+			i = mdb_filter_need( f, need ? need + n : NULL );
+			if ( i < 0 )
+				return i;
+			n += i;
+		}
+		return n;
+	case SLAPD_FILTER_COMPUTED:
+		return 0;
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		break;
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		ad = f->f_av_desc;
+		break;
+	case LDAP_FILTER_EXT:
+		if ( f->f_mr_dnattrs )
+			return -1;
+		ad = f->f_mr_desc;
+		break;
+	default:
+		return -1;
+	}
+	if ( !ad )
+		return -1;
+	if ( need ) {
+		memset( need, 0, sizeof( AttributeName ));
+		need->an_name = ad->ad_cname;
+		need->an_desc = ad;
+	}
+	return 1;
+}
+
+/* Whether an ACL in the list may look at attributes of the
+ * target entry other than the one it is checking.
+ */
+int
+mdb_acl_peeks( AccessControl *a )
+{
+	Access *b;
+
+	for ( ; a; a = a->acl_next ) {
+		if ( a->acl_filter )
+			return 1;
+		for ( b = a->acl_access; b; b = b->a_next ) {
+			if ( b->a_dn_at || b->a_realdn_at ||
+				!BER_BVISEMPTY( &b->a_set_pat ))
+				return 1;
+#ifdef SLAP_DYNACL
+			if ( b->a_dynacl )
+				return 1;
+#endif
+		}
+	}
+	return 0;
+}
+
+/* The attributes a search will look at in its entries, when that
+ * is known: the requested ones and those in the filter. Attributes
+ * outside this list that are kept in id2val then need not be read.
+ * Overlays and callbacks may look at anything, so not with those.
+ */
+static AttributeName *
+mdb_search_need( Operation *op )
+{
+	AttributeName *need;
+	int n, nf;
+
+	if ( !op->ors_attrs || op->o_callback ||
+		overlay_is_over( op->o_bd->bd_self ) || overlay_is_over( frontendDB ))
+		return NULL;
+	if ( !be_isroot( op ) && ( mdb_acl_peeks( op->o_bd->be_acl ) ||
+		mdb_acl_peeks( frontendDB->be_acl )))
+		return NULL;
+	nf = mdb_filter_need( op->ors_filter, NULL );
+	if ( nf < 0 )
+		return NULL;
+
+	for ( n = 0; !BER_BVISNULL( &op->ors_attrs[n].an_name ); n++ )
+		;
+	need = op->o_tmpalloc( ( n + nf + 1 ) * sizeof( AttributeName ),
+		op->o_tmpmemctx );
+	AC_MEMCPY( need, op->ors_attrs, n * sizeof( AttributeName ));
+	mdb_filter_need( op->ors_filter, need + n );
+	BER_BVZERO( &need[n + nf].an_name );
+	return need;
+}
+
+#define MDB_SKIP_MAX	32	/* one bit each in the decode skipmask */
+
+/* Whether equality assertions on ad can be looked up in id2val */
+static int
+mdb_skip_ok( Operation *op, AttributeDescription *ad )
+{
+	return !( ad->ad_type->sat_flags & SLAP_AT_ORDERED ) &&
+		ad != slap_schema.si_ad_objectClass &&
+		ad->ad_type->sat_equality &&
+		!ad_inlist( ad, op->ors_attrs );
+}
+
+/* Collect into skip the attributes that filter f only tests for
+ * equality, and flag in bad those it looks at in any other way.
+ */
+static void
+mdb_filter_skip( Operation *op, Filter *f, AttributeName *skip, int *nskip,
+	AttributeName *bad, int *nbad )
+{
+	AttributeDescription *ad;
+	AttributeName *an;
+	int *n;
+
+	switch ( f->f_choice & SLAPD_FILTER_MASK ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+	case LDAP_FILTER_NOT:
+		for ( f = f->f_list; f; f = f->f_next )
+			mdb_filter_skip( op, f, skip, nskip, bad, nbad );
+		return;
+	case LDAP_FILTER_EQUALITY:
+		ad = f->f_av_desc;
+		an = skip;
+		n = nskip;
+		if ( !mdb_skip_ok( op, ad ))
+			return;
+		break;
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		an = bad;
+		n = nbad;
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		an = bad;
+		n = nbad;
+		break;
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		ad = f->f_av_desc;
+		an = bad;
+		n = nbad;
+		break;
+	case LDAP_FILTER_EXT:
+		ad = f->f_mr_desc;
+		an = bad;
+		n = nbad;
+		break;
+	default:
+		return;
+	}
+	if ( !ad || *n >= MDB_SKIP_MAX )
+		return;
+	for ( ; !BER_BVISNULL( &an->an_name ); an++ )
+		if ( an->an_desc == ad )
+			return;
+	an->an_name = ad->ad_cname;
+	an->an_desc = ad;
+	BER_BVZERO( &an[1].an_name );
+	(*n)++;
+}
+
+/* The attributes whose equality assertions in the filter can be
+ * checked in id2val, so that their values need not be read at all.
+ * Only used together with a need list, which has the same safety
+ * conditions.
+ */
+static AttributeName *
+mdb_search_skip( Operation *op )
+{
+	AttributeName *skip, bad[MDB_SKIP_MAX + 1];
+	int i, j, nskip = 0, nbad = 0;
+
+	skip = op->o_tmpcalloc( MDB_SKIP_MAX + 1, sizeof( AttributeName ),
+		op->o_tmpmemctx );
+	BER_BVZERO( &bad[0].an_name );
+	mdb_filter_skip( op, op->ors_filter, skip, &nskip, bad, &nbad );
+	/* the bad list may have overflowed, then nothing is safe */
+	if ( nbad >= MDB_SKIP_MAX )
+		nskip = 0;
+	for ( i = 0, j = 0; i < nskip; i++ ) {
+		if ( ad_inlist( skip[i].an_desc, bad ))
+			continue;
+		skip[j++] = skip[i];
+	}
+	if ( !j ) {
+		op->o_tmpfree( skip, op->o_tmpmemctx );
+		return NULL;
+	}
+	BER_BVZERO( &skip[j].an_name );
+	return skip;
+}
+
+/* test_filter, but equality assertions on the attributes in skip that
+ * were left out of e, as told by mask, are looked up in id2val.
+ */
+static int
+mdb_filter_test( Operation *op, MDB_txn *txn, Entry *e, Filter *f,
+	AttributeName *skip, unsigned mask )
+{
+	int i, rc, r;
+
+	switch ( f->f_choice & SLAPD_FILTER_MASK ) {
+	case LDAP_FILTER_AND:
+		rc = LDAP_COMPARE_TRUE;
+		for ( f = f->f_list; f; f = f->f_next ) {
+			r = mdb_filter_test( op, txn, e, f, skip, mask );
+			if ( r == LDAP_COMPARE_FALSE )
+				return r;
+			if ( r != LDAP_COMPARE_TRUE )
+				rc = r;
+		}
+		return rc;
+	case LDAP_FILTER_OR:
+		rc = LDAP_COMPARE_FALSE;
+		for ( f = f->f_list; f; f = f->f_next ) {
+			r = mdb_filter_test( op, txn, e, f, skip, mask );
+			if ( r == LDAP_COMPARE_TRUE )
+				return r;
+			if ( r != LDAP_COMPARE_FALSE )
+				rc = r;
+		}
+		return rc;
+	case LDAP_FILTER_NOT:
+		r = mdb_filter_test( op, txn, e, f->f_not, skip, mask );
+		if ( r == LDAP_COMPARE_TRUE )
+			return LDAP_COMPARE_FALSE;
+		if ( r == LDAP_COMPARE_FALSE )
+			return LDAP_COMPARE_TRUE;
+		return r;
+	case LDAP_FILTER_EQUALITY:
+		for ( i = 0; !BER_BVISNULL( &skip[i].an_name ); i++ )
+			if ( skip[i].an_desc == f->f_av_desc )
+				break;
+		if ( BER_BVISNULL( &skip[i].an_name ) || !( mask & ( 1U << i )))
+			break;
+		rc = LDAP_COMPARE_FALSE;
+		if ( !access_allowed( op, e, f->f_av_desc, &f->f_av_value,
+			ACL_SEARCH, NULL )) {
+			rc = LDAP_INSUFFICIENT_ACCESS;
+		} else {
+			r = mdb_mval_find( op, txn, e->e_id, f->f_av_desc, &f->f_av_value );
+			if ( r == 0 )
+				return LDAP_COMPARE_TRUE;
+			if ( r != MDB_NOTFOUND )
+				return SLAPD_COMPARE_UNDEFINED;
+		}
+		/* subtypes of the attribute are still in the entry */
+		r = test_filter( op, e, f );
+		return r == LDAP_COMPARE_FALSE ? rc : r;
+	}
+	return test_filter( op, e, f );
+}
+
 int
 mdb_search( Operation *op, SlapReply *rs )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	ID		id, cursor, nsubs, ncand, cscope;
+	struct timeval	tv;
+	int		prof;
 	ID		lastid = NOID;
 	ID		candidates[MDB_IDL_UM_SIZE];
 	ID		iscopes[MDB_IDL_DB_SIZE];
@@ -430,7 +955,13 @@ mdb_search( Operation *op, SlapReply *rs )
 	IdScopes	isc;
 	MDB_cursor	*mci, *mcd;
 	ww_ctx wwctx;
-	slap_callback cb = { 0 };
+	slap_callback cb = { 0 }, ecb = { 0 };
+	mdb_explain	*me = NULL;
+	mdb_psearch	*ps = NULL;
+	mdb_pcursor	*pc = NULL;
+	int		pckeep, ccache;
+	AttributeName	*need = NULL, *skip = NULL;
+	unsigned	skipmask = 0;
 
 	mdb_op_info	opinfo = {{{0}}}, *moi = &opinfo;
 	MDB_txn			*ltid = NULL;
@@ -471,6 +1002,7 @@ mdb_search( Operation *op, SlapReply *rs )
 	isc.scopes = scopes;
 	isc.oscope = op->ors_scope;
 	isc.sctmp = stack;
+	isc.outscopes = NULL;
 
 	if ( op->ors_deref & LDAP_DEREF_FINDING ) {
 		MDB_IDL_ZERO(candidates);
@@ -637,8 +1169,41 @@ dn2entry_retry:
 
 	e = NULL;
 
+	if ( get_explain( op )) {
+		if ( be_isroot( op )) {
+			me = op->o_tmpcalloc( 1, sizeof( mdb_explain ), op->o_tmpmemctx );
+			op->o_explain_plan = me;
+			ecb.sc_response = mdb_explain_response;
+			ecb.sc_private = me;
+			ecb.sc_next = op->o_callback;
+			op->o_callback = &ecb;
+			mdb_explain_step( op, "base=\"%s\" scope=%s id=%lu",
+				base->e_nname.bv_val, ldap_pvt_scope2str( op->ors_scope ),
+				(unsigned long) base->e_id );
+		} else if ( op->o_explain == SLAP_CONTROL_CRITICAL ) {
+			rs->sr_err = LDAP_INSUFFICIENT_ACCESS;
+			rs->sr_text = "explain control requires the rootdn";
+			send_ldap_result( op, rs );
+			goto done;
+		}
+	}
+
+	if ( mdb->mi_pcursor_max && get_pagedresults( op ) > SLAP_CONTROL_IGNORED )
+		pc = mdb_pcursor_get( op, mdb );
+
 	/* select candidates */
-	if ( op->oq_search.rs_scope == LDAP_SCOPE_BASE ) {
+	if ( pc ) {
+		/* resume from the previous page's candidates */
+		MDB_IDL_CPY( candidates, pc->pc_ids );
+		ncand = pc->pc_ncand;
+		if ( me )
+			mdb_explain_ids( op, mdb_explain_step( op,
+				"candidates kept from the previous page" ), candidates );
+		scopes[0].mid = 1;
+		scopes[1].mid = base->e_id;
+		scopes[1].mval.mv_data = NULL;
+		rs->sr_err = LDAP_SUCCESS;
+	} else if ( op->oq_search.rs_scope == LDAP_SCOPE_BASE ) {
 		rs->sr_err = base_candidate( op->o_bd, base, candidates );
 		scopes[0].mid = 0;
 		ncand = 1;
@@ -663,8 +1228,22 @@ dn2entry_retry:
 		scopes[0].mid = 1;
 		scopes[1].mid = base->e_id;
 		scopes[1].mval.mv_data = NULL;
-		rs->sr_err = search_candidates( op, rs, base,
-			&isc, mci, candidates, stack );
+		/* explain the real evaluation, not a cached result */
+		ccache = mdb->mi_ccache_max && moi == &opinfo &&
+			( slapMode & SLAP_SERVER_MODE ) &&
+			!( op->ors_deref & LDAP_DEREF_SEARCHING ) && !me;
+		SLAP_OPTRACE_BEGIN( op, tv );
+		SLAP_PROFILE_ENTER( op, SLAP_PROF_CAND, prof );
+		if ( ccache && mdb_ccache_get( op, mdb, ltid, candidates )) {
+			rs->sr_err = LDAP_SUCCESS;
+		} else {
+			rs->sr_err = search_candidates( op, rs, base,
+				&isc, mci, candidates, stack );
+			if ( ccache && rs->sr_err == LDAP_SUCCESS )
+				mdb_ccache_put( op, mdb, ltid, candidates );
+		}
+		SLAP_PROFILE_LEAVE( op, prof );
+		SLAP_OPTRACE_END( op, ot_cand, tv );
 		ncand = MDB_IDL_N( candidates );
 		if ( !base->e_id || ncand == NOID ) {
 			/* grab entry count from id2entry stat
@@ -676,12 +1255,31 @@ dn2entry_retry:
 			if ( ncand == NOID )
 				ncand = ms.ms_entries;
 		}
+		op->o_trace.ot_idl += ncand;
+		if ( me ) {
+			int slot = mdb_explain_step( op, "candidates" );
+			mdb_explain_ids( op, slot, candidates );
+			if ( MDB_IDL_IS_RANGE( candidates ))
+				mdb_explain_more( op, slot, ", every entry in the range is read" );
+			if ( nsubs < ncand )
+				mdb_explain_step( op, "scope has %lu entries, fewer than the "
+					"candidates: walking dn2id instead", (unsigned long) nsubs );
+		}
 	}
 
+	/* scopes also caches parents as the loop runs, so note now
+	 * whether any alias scopes were added; those aren't kept
+	 */
+	pckeep = mdb->mi_pcursor_max && scopes[0].mid <= 1;
+
 	/* start cursor at beginning of candidates.
 	 */
 	cursor = 0;
 
+	if (( mdb->mi_dbenv_flags & MDB_NORDAHEAD ) &&
+		( MDB_IDL_IS_RANGE( candidates ) || ncand >= MDB_SCAN_RA_MIN ))
+		mdb_cursor_readahead( mci, MDB_SCAN_READAHEAD );
+
 	if ( candidates[0] == 0 ) {
 		Debug( LDAP_DEBUG_TRACE,
 			LDAP_XSTRING(mdb_search) ": no candidates\n",
@@ -707,8 +1305,14 @@ dn2entry_retry:
 		tentries = ncand;
 	}
 
+	/* before our own writewait callback goes in */
+	need = mdb_search_need( op );
+	if ( need )
+		skip = mdb_search_skip( op );
+
 	wwctx.flag = 0;
 	wwctx.nentries = 0;
+	wwctx.since = slap_get_time();
 	/* If we're running in our own read txn */
 	if (  moi == &opinfo ) {
 		cb.sc_writewait = mdb_writewait;
@@ -719,8 +1323,19 @@ dn2entry_retry:
 		op->o_callback = &cb;
 	}
 
+	/* only the candidate-based walk can be prefiltered */
+	if ( mdb->mi_search_threads && !( slapMode & SLAP_TOOL_MODE ) &&
+		ncand >= 2 * MDB_PSEARCH_CHUNK &&
+		( nsubs >= ncand || get_pagedresults( op ) > SLAP_CONTROL_IGNORED ))
+	{
+		ps = mdb_psearch_new( op, mdb );
+		if ( me && ps )
+			mdb_explain_step( op, "candidates prefiltered by %d threads",
+				mdb->mi_search_threads );
+	}
+
 	if ( get_pagedresults( op ) > SLAP_CONTROL_IGNORED ) {
-		PagedResultsState *ps = op->o_pagedresults_state;
+		PagedResultsState *prs = op->o_pagedresults_state;
 		/* deferred cookie parsing */
 		rs->sr_err = parse_paged_cookie( op, rs );
 		if ( rs->sr_err != LDAP_SUCCESS ) {
@@ -728,8 +1343,8 @@ dn2entry_retry:
 			goto done;
 		}
 
-		cursor = (ID) ps->ps_cookie;
-		if ( cursor && ps->ps_size == 0 ) {
+		cursor = (ID) prs->ps_cookie;
+		if ( cursor && prs->ps_size == 0 ) {
 			rs->sr_err = LDAP_SUCCESS;
 			rs->sr_text = "search abandoned by pagedResult size=0";
 			send_ldap_result( op, rs );
@@ -746,7 +1361,7 @@ dn2entry_retry:
 			rs->sr_err = LDAP_OTHER;
 			goto done;
 		}
-		if ( id == (ID)ps->ps_cookie )
+		if ( id == (ID)prs->ps_cookie )
 			id = mdb_idl_next( candidates, &cursor );
 		nsubs = ncand;	/* always bypass scope'd search */
 		goto loop_begin;
@@ -780,6 +1395,18 @@ dn2entry_retry:
 		cscope = 0;
 	} else {
 		id = mdb_idl_first( candidates, &cursor );
+
+		/* Cache the parents of out of scope candidates, unless
+		 * dereferencing may still add new scopes during the search.
+		 */
+		if (( op->ors_scope == LDAP_SCOPE_SUBTREE
+#ifdef LDAP_SCOPE_CHILDREN
+			|| op->ors_scope == LDAP_SCOPE_CHILDREN
+#endif
+			) && !( op->ors_deref & LDAP_DEREF_SEARCHING )) {
+			isc.outscopes = scope_chunk_get( op );
+			isc.outscopes[0].mid = 0;
+		}
 	}
 
 	while (id != NOID)
@@ -816,6 +1443,11 @@ loop_begin:
 			goto done;
 		}
 
+		/* don't sit on entries already found while looking for more */
+		slap_send_idle( op );
+
+		if ( ps && mdb_psearch_skip( ps, ltid, candidates, id, cursor ))
+			goto loop_continue;
 
 		if ( nsubs < ncand ) {
 			unsigned i;
@@ -860,6 +1492,8 @@ loop_begin:
 			if ( id == base->e_id ) break;
 			isc.id = id;
 			isc.nscope = 0;
+			if ( me )
+				me->me_scopes++;
 			rs->sr_err = mdb_idscopes( op, &isc );
 			if ( rs->sr_err == MDB_SUCCESS ) {
 				if ( isc.nscope )
@@ -874,6 +1508,8 @@ loop_begin:
 		/* Not in scope, ignore it */
 		if ( !scopeok )
 		{
+			if ( me )
+				me->me_outscope++;
 			Debug( LDAP_DEBUG_TRACE,
 				LDAP_XSTRING(mdb_search)
 				": %ld scope not okay\n",
@@ -882,9 +1518,11 @@ loop_begin:
 		}
 
 scopeok:
+		op->o_trace.ot_scanned++;
+		skipmask = 0;
 		if ( id == base->e_id ) {
 			e = base;
-		} else {
+		} else if ( mdb_ecache_get( op, ltid, id, &e ) != MDB_SUCCESS ) {
 
 			/* get the entry */
 			rs->sr_err = mdb_id2edata( op, mci, id, &edata );
@@ -922,7 +1560,12 @@ notfound:
 				goto done;
 			}
 
-			rs->sr_err = mdb_entry_decode( op, ltid, &edata, id, &e );
+			SLAP_OPTRACE_BEGIN( op, tv );
+			SLAP_PROFILE_ENTER( op, SLAP_PROF_DECODE, prof );
+			rs->sr_err = mdb_entry_decode_need( op, ltid, &edata, id, &e,
+				need, skip, &skipmask );
+			SLAP_PROFILE_LEAVE( op, prof );
+			SLAP_OPTRACE_END( op, ot_decode, tv );
 			if ( rs->sr_err ) {
 				rs->sr_err = LDAP_OTHER;
 				rs->sr_text = "internal error in mdb_entry_decode";
@@ -1059,7 +1702,18 @@ notfound:
 		}
 
 		/* if it matches the filter and scope, send it */
-		rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
+		SLAP_PROFILE_ENTER( op, SLAP_PROF_FILTER, prof );
+		if ( skipmask )
+			rs->sr_err = mdb_filter_test( op, ltid, e,
+				op->oq_search.rs_filter, skip, skipmask );
+		else
+			rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
+		SLAP_PROFILE_LEAVE( op, prof );
+		if ( me ) {
+			me->me_tested++;
+			if ( rs->sr_err == LDAP_COMPARE_TRUE )
+				me->me_matched++;
+		}
 
 		if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
 			/* check size limit */
@@ -1068,6 +1722,10 @@ notfound:
 					if (e != base)
 						mdb_entry_return( op, e );
 					e = NULL;
+					if ( pckeep ) {
+						mdb_pcursor_put( op, mdb, pc, candidates, ncand );
+						pc = NULL;
+					}
 					send_paged_response( op, rs, &lastid, tentries );
 					goto done;
 				}
@@ -1096,6 +1754,7 @@ notfound:
 				default:		/* entry not sent */
 					break;
 				case LDAP_BUSY:
+				case LDAP_ADMINLIMIT_EXCEEDED:
 					send_ldap_result( op, rs );
 					goto done;
 				case LDAP_UNAVAILABLE:
@@ -1120,14 +1779,19 @@ notfound:
 		}
 
 loop_continue:
-		if ( moi == &opinfo && !wwctx.flag && mdb->mi_rtxn_size ) {
+		if ( moi == &opinfo && !wwctx.flag &&
+			( mdb->mi_rtxn_size || mdb->mi_rtxn_maxage )) {
 			wwctx.nentries++;
-			if ( wwctx.nentries >= mdb->mi_rtxn_size ) {
+			if (( mdb->mi_rtxn_size && wwctx.nentries >= mdb->mi_rtxn_size ) ||
+				( mdb->mi_rtxn_maxage &&
+				slap_get_time() - wwctx.since >= mdb->mi_rtxn_maxage )) {
 				MDB_envinfo ei;
 				wwctx.nentries = 0;
 				mdb_env_info(mdb->mi_dbenv, &ei);
 				if ( ei.me_last_txnid > mdb_txn_id( ltid ))
 					mdb_rtxn_snap( op, &wwctx );
+				else
+					wwctx.since = slap_get_time();
 			}
 		}
 		if ( wwctx.flag ) {
@@ -1192,6 +1856,14 @@ nochange:
 	rs->sr_err = LDAP_SUCCESS;
 
 done:
+	if ( need )
+		op->o_tmpfree( need, op->o_tmpmemctx );
+	if ( skip )
+		op->o_tmpfree( skip, op->o_tmpmemctx );
+	if ( ps )
+		mdb_psearch_free( ps );
+	if ( pc )
+		ch_free( pc );
 	if ( cb.sc_private ) {
 		/* remove our writewait callback */
 		slap_callback **scp = &op->o_callback;
@@ -1203,6 +1875,22 @@ done:
 			}
 		}
 	}
+	if ( me ) {
+		slap_callback **scp;
+		int i;
+
+		for ( scp = &op->o_callback; *scp; scp = &(*scp)->sc_next ) {
+			if ( *scp == &ecb ) {
+				*scp = ecb.sc_next;
+				break;
+			}
+		}
+		for ( i = 0; i < me->me_nlines; i++ )
+			op->o_tmpfree( me->me_lines[i].bv_val, op->o_tmpmemctx );
+		op->o_tmpfree( me->me_lines, op->o_tmpmemctx );
+		op->o_tmpfree( me, op->o_tmpmemctx );
+		op->o_explain_plan = NULL;
+	}
 	mdb_cursor_close( mcd );
 	mdb_cursor_close( mci );
 	if ( moi == &opinfo ) {
@@ -1218,6 +1906,8 @@ done:
 	if (base)
 		mdb_entry_return( op, base );
 	scope_chunk_ret( op, scopes );
+	if ( isc.outscopes )
+		scope_chunk_ret( op, isc.outscopes );
 
 	return rs->sr_err;
 }
@@ -1499,3 +2189,282 @@ send_paged_response(
 done:
 	(void) ber_free_buf( ber );
 }
+
+/* Paged results cursors.
+ *
+ * Without them every page of a paged search recomputes the complete
+ * candidate list and then skips ahead to the ID in the cookie. With
+ * pagedcursors set, the candidate list is kept after a page is sent
+ * and the next page of the same search on the same connection starts
+ * from it directly. A connection has at most one paged search in
+ * progress, so it holds at most one cursor; the least recently used
+ * cursors are dropped once the limit is reached.
+ */
+static mdb_pcursor *
+mdb_pcursor_take( struct mdb_info *mdb, unsigned long connid )
+{
+	mdb_pcursor *pc;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_pcursor_mutex );
+	LDAP_TAILQ_FOREACH( pc, &mdb->mi_pcursors, pc_next ) {
+		if ( pc->pc_connid == connid ) {
+			LDAP_TAILQ_REMOVE( &mdb->mi_pcursors, pc, pc_next );
+			mdb->mi_pcursor_num--;
+			break;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_pcursor_mutex );
+	return pc;
+}
+
+/* Find the cursor left by the previous page of this search, if any */
+static mdb_pcursor *
+mdb_pcursor_get( Operation *op, struct mdb_info *mdb )
+{
+	PagedResultsState *ps = op->o_pagedresults_state;
+	mdb_pcursor *pc;
+
+	/* any other paged search on this connection is over now */
+	pc = mdb_pcursor_take( mdb, op->o_connid );
+	if ( pc && ( !ps->ps_cookieval.bv_len ||
+		pc->pc_scope != op->ors_scope ||
+		pc->pc_deref != op->ors_deref ||
+		!bvmatch( &pc->pc_ndn, &op->o_req_ndn ) ||
+		!bvmatch( &pc->pc_filter, &op->ors_filterstr )))
+	{
+		ch_free( pc );
+		pc = NULL;
+	}
+	return pc;
+}
+
+static void
+mdb_pcursor_put( Operation *op, struct mdb_info *mdb, mdb_pcursor *pc,
+	ID *ids, ID ncand )
+{
+	mdb_pcursor *old;
+
+	if ( !pc ) {
+		size_t len = MDB_IDL_SIZEOF( ids );
+
+		pc = ch_malloc( sizeof( mdb_pcursor ) + len +
+			op->o_req_ndn.bv_len + op->ors_filterstr.bv_len + 2 );
+		pc->pc_connid = op->o_connid;
+		pc->pc_scope = op->ors_scope;
+		pc->pc_deref = op->ors_deref;
+		pc->pc_ncand = ncand;
+		AC_MEMCPY( pc->pc_ids, ids, len );
+		pc->pc_ndn.bv_len = op->o_req_ndn.bv_len;
+		pc->pc_ndn.bv_val = (char *)pc->pc_ids + len;
+		AC_MEMCPY( pc->pc_ndn.bv_val, op->o_req_ndn.bv_val,
+			op->o_req_ndn.bv_len + 1 );
+		pc->pc_filter.bv_len = op->ors_filterstr.bv_len;
+		pc->pc_filter.bv_val = pc->pc_ndn.bv_val + pc->pc_ndn.bv_len + 1;
+		AC_MEMCPY( pc->pc_filter.bv_val, op->ors_filterstr.bv_val,
+			op->ors_filterstr.bv_len );
+		pc->pc_filter.bv_val[pc->pc_filter.bv_len] = '\0';
+	}
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_pcursor_mutex );
+	while ( mdb->mi_pcursor_num && mdb->mi_pcursor_num >= mdb->mi_pcursor_max ) {
+		old = LDAP_TAILQ_LAST( &mdb->mi_pcursors, mdb_pcq );
+		LDAP_TAILQ_REMOVE( &mdb->mi_pcursors, old, pc_next );
+		mdb->mi_pcursor_num--;
+		ch_free( old );
+	}
+	LDAP_TAILQ_INSERT_HEAD( &mdb->mi_pcursors, pc, pc_next );
+	mdb->mi_pcursor_num++;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_pcursor_mutex );
+}
+
+void
+mdb_pcursor_flush( struct mdb_info *mdb )
+{
+	mdb_pcursor *pc;
+
+	while (( pc = LDAP_TAILQ_FIRST( &mdb->mi_pcursors ))) {
+		LDAP_TAILQ_REMOVE( &mdb->mi_pcursors, pc, pc_next );
+		ch_free( pc );
+	}
+	mdb->mi_pcursor_num = 0;
+}
+
+/* Candidate list cache.
+ *
+ * Applications tend to repeat the same few filters, and without writes
+ * in between each repeat computes the same candidate list again. The
+ * list depends only on the filter and on the controls that make
+ * search_candidates() extend it, not on the base or scope, which are
+ * checked per entry. An entry is valid only for the snapshot it was
+ * computed in; entries of older snapshots are dropped as newer ones
+ * are stored.
+ */
+static int
+mdb_ccache_flags( Operation *op )
+{
+	return ( get_manageDSAit( op ) ? 1 : 0 ) |
+		( get_domainScope( op ) ? 2 : 0 ) |
+		( get_subentries_visibility( op ) ? 4 : 0 );
+}
+
+static unsigned
+mdb_ccache_hash( struct berval *bv )
+{
+	unsigned h = 0;
+	ber_len_t i;
+
+	for ( i = 0; i < bv->bv_len; i++ )
+		h = h * 31 + (unsigned char)bv->bv_val[i];
+	return h;
+}
+
+static int
+mdb_ccache_get( Operation *op, struct mdb_info *mdb, MDB_txn *txn, ID *ids )
+{
+	size_t txnid = mdb_txn_id( txn );
+	unsigned hash = mdb_ccache_hash( &op->ors_filterstr );
+	int flags = mdb_ccache_flags( op );
+	mdb_ccentry *cc;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_ccache_mutex );
+	LDAP_TAILQ_FOREACH( cc, &mdb->mi_ccache, cc_next ) {
+		if ( cc->cc_hash == hash && cc->cc_txnid == txnid &&
+			cc->cc_flags == flags &&
+			bvmatch( &cc->cc_filter, &op->ors_filterstr ))
+			break;
+	}
+	if ( cc ) {
+		MDB_IDL_CPY( ids, cc->cc_ids );
+		if ( cc != LDAP_TAILQ_FIRST( &mdb->mi_ccache )) {
+			LDAP_TAILQ_REMOVE( &mdb->mi_ccache, cc, cc_next );
+			LDAP_TAILQ_INSERT_HEAD( &mdb->mi_ccache, cc, cc_next );
+		}
+		mdb->mi_ccache_hits++;
+	} else {
+		mdb->mi_ccache_misses++;
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_ccache_mutex );
+	return cc != NULL;
+}
+
+static void
+mdb_ccache_put( Operation *op, struct mdb_info *mdb, MDB_txn *txn, ID *ids )
+{
+	size_t txnid = mdb_txn_id( txn ), len = MDB_IDL_SIZEOF( ids );
+	mdb_ccentry *cc, *next;
+
+	if ( !MDB_IDL_IS_RANGE( ids ) && ids[0] > MDB_CCACHE_IDS )
+		return;
+
+	cc = ch_malloc( sizeof( mdb_ccentry ) + len +
+		op->ors_filterstr.bv_len + 1 );
+	cc->cc_txnid = txnid;
+	cc->cc_hash = mdb_ccache_hash( &op->ors_filterstr );
+	cc->cc_flags = mdb_ccache_flags( op );
+	AC_MEMCPY( cc->cc_ids, ids, len );
+	cc->cc_filter.bv_len = op->ors_filterstr.bv_len;
+	cc->cc_filter.bv_val = (char *)cc->cc_ids + len;
+	AC_MEMCPY( cc->cc_filter.bv_val, op->ors_filterstr.bv_val,
+		op->ors_filterstr.bv_len + 1 );
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_ccache_mutex );
+	for ( next = LDAP_TAILQ_FIRST( &mdb->mi_ccache ); next; ) {
+		mdb_ccentry *old = next;
+		next = LDAP_TAILQ_NEXT( old, cc_next );
+		if ( old->cc_txnid < txnid ) {
+			LDAP_TAILQ_REMOVE( &mdb->mi_ccache, old, cc_next );
+			mdb->mi_ccache_num--;
+			ch_free( old );
+		} else if ( old->cc_txnid > txnid ) {
+			/* a newer snapshot is in use, ours is of no further use */
+			ch_free( cc );
+			cc = NULL;
+			break;
+		}
+	}
+	if ( cc ) {
+		while ( mdb->mi_ccache_num && mdb->mi_ccache_num >= mdb->mi_ccache_max ) {
+			next = LDAP_TAILQ_LAST( &mdb->mi_ccache, mdb_ccq );
+			LDAP_TAILQ_REMOVE( &mdb->mi_ccache, next, cc_next );
+			mdb->mi_ccache_num--;
+			ch_free( next );
+		}
+		LDAP_TAILQ_INSERT_HEAD( &mdb->mi_ccache, cc, cc_next );
+		mdb->mi_ccache_num++;
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_ccache_mutex );
+}
+
+void
+mdb_ccache_flush( struct mdb_info *mdb )
+{
+	mdb_ccentry *cc;
+
+	while (( cc = LDAP_TAILQ_FIRST( &mdb->mi_ccache ))) {
+		LDAP_TAILQ_REMOVE( &mdb->mi_ccache, cc, cc_next );
+		ch_free( cc );
+	}
+	mdb->mi_ccache_num = 0;
+}
+
+int
+mdb_conn_destroy( BackendDB *be, Connection *c )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+
+	if ( mdb->mi_pcursor_num )
+		ch_free( mdb_pcursor_take( mdb, c->c_connid ));
+	return 0;
+}
+
+/* Attach the plan of an explained search to its result, as a
+ * SEQUENCE OF OCTET STRING with one step per value.
+ */
+static int
+mdb_explain_response( Operation *op, SlapReply *rs )
+{
+	mdb_explain *me = op->o_callback->sc_private;
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *) &berbuf;
+	LDAPControl *ctrls[2];
+	struct berval bv;
+	char buf[ 256 ];
+	int i;
+
+	if ( rs->sr_type != REP_RESULT )
+		return SLAP_CB_CONTINUE;
+
+	ber_init2( ber, NULL, LBER_USE_DER );
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+	ber_printf( ber, "{" /*}*/ );
+	for ( i = 0; i < me->me_nlines; i++ )
+		ber_printf( ber, "O", &me->me_lines[i] );
+	if ( me->me_dropped ) {
+		bv.bv_val = buf;
+		bv.bv_len = snprintf( buf, sizeof( buf ),
+			"%d more steps not shown", me->me_dropped );
+		ber_printf( ber, "O", &bv );
+	}
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "scope checks=%lu "
+		"out of scope=%lu tested=%lu matched=%lu returned=%d",
+		me->me_scopes, me->me_outscope, me->me_tested, me->me_matched,
+		rs->sr_nentries );
+	ber_printf( ber, "O", &bv );
+	ber_printf( ber, /*{*/ "N}" );
+
+	if ( ber_flatten2( ber, &bv, 0 ) != -1 ) {
+		ctrls[0] = op->o_tmpalloc( sizeof( LDAPControl ) + bv.bv_len + 1,
+			op->o_tmpmemctx );
+		ctrls[0]->ldctl_oid = LDAP_CONTROL_X_EXPLAIN;
+		ctrls[0]->ldctl_iscritical = 0;
+		ctrls[0]->ldctl_value.bv_val = (char *)&ctrls[0][1];
+		ctrls[0]->ldctl_value.bv_len = bv.bv_len;
+		AC_MEMCPY( ctrls[0]->ldctl_value.bv_val, bv.bv_val, bv.bv_len + 1 );
+		ctrls[1] = NULL;
+		slap_add_ctrls( op, rs, ctrls );
+	}
+	ber_free_buf( ber );
+
+	return SLAP_CB_CONTINUE;
+}
@@ -87,6 +87,71 @@ static void * mdb_tool_index_task( void *ctx, void *ptr );
 
 static int	mdb_writes, mdb_writes_per_commit;
 
+/* In quick mode slapadd buffers the index keys of each attribute
+ * and writes them out sorted when the load is done. When the buffers
+ * outgrow the memory budget (-o sortmem, or MDB_TOOL_KEYS_MAX) they
+ * are sorted and spilled to temporary files in the database directory,
+ * and the runs are merged at the end, so memory use stays fixed and
+ * each index is written once, in key order. Into an index database
+ * that was empty to begin with the keys go with MDB_APPEND, which
+ * fills B-tree pages completely instead of splitting them in half
+ * over and over.
+ */
+typedef struct mdb_tool_keyrec {
+	ID kr_id;
+	unsigned short kr_len;
+	char kr_key[1];
+} mdb_tool_keyrec;
+
+#define	KEYREC_SIZE(len)	(( offsetof( mdb_tool_keyrec, kr_key ) + (len) + \
+	sizeof(ID) - 1 ) & ~(sizeof(ID) - 1 ))
+#define	KEYREC_KEY_MAX	0xffff	/* kr_len is an unsigned short */
+
+typedef struct mdb_tool_keybuf {
+	char *kb_buf;
+	size_t kb_len, kb_size;
+	size_t kb_commit;	/* kb_len as of the last txn commit */
+	int kb_append;	/* database was empty, keys may be appended */
+	/* for the parallel index rebuild */
+	ldap_pvt_thread_mutex_t kb_mutex;
+	FILE **kb_runs;	/* sorted runs spilled to disk */
+	int kb_nruns;
+} mdb_tool_keybuf;
+
+/* A sorted run of keys being merged, in memory or in a file */
+typedef struct mdb_tool_keyrun {
+	FILE *ru_fp;
+	mdb_tool_keyrec **ru_recs;
+	size_t ru_n, ru_pos;
+	mdb_tool_keyrec *ru_cur;	/* NULL at the end of the run */
+	mdb_tool_keyrec *ru_buf;	/* ru_cur when reading from ru_fp */
+} mdb_tool_keyrun;
+
+static mdb_tool_keybuf *mdb_tool_keys;
+/* 0 not decided yet, 1 buffering, 2 rebuilding from threads, -1 off */
+static int mdb_tool_keys_state;
+static size_t mdb_tool_keys_total;
+static size_t mdb_tool_keys_max;	/* memory budget of all buffers */
+static size_t mdb_tool_keys_spill;	/* buffer size to spill at, state 2 */
+
+/* Default buffer memory across all attributes before spilling */
+#ifndef MDB_TOOL_KEYS_MAX
+#define MDB_TOOL_KEYS_MAX	(256 * 1024 * 1024)
+#endif
+
+/* IDs written per txn while writing out the buffers */
+#ifndef MDB_TOOL_KEYS_PER_COMMIT
+#define MDB_TOOL_KEYS_PER_COMMIT	(256 * 1024)
+#endif
+
+static int mdb_tool_keys_start( BackendDB *be, MDB_txn *txn );
+static mdb_tool_keyrec **mdb_tool_keys_sort( mdb_tool_keybuf *kb, size_t *np );
+static int mdb_tool_keys_spill_run( BackendDB *be, AttrInfo *ai,
+	mdb_tool_keybuf *kb, char *buf, size_t len );
+static int mdb_tool_keys_spill_all( BackendDB *be );
+static int mdb_tool_keys_flush( BackendDB *be );
+static int mdb_tool_keys_done( BackendDB *be );
+
 /* Number of ops per commit in Quick mode.
  * Batching speeds writes overall, but too large a
  * batch will fail with MDB_TXN_FULL.
@@ -218,6 +283,37 @@ int mdb_tool_entry_close(
 		mdb_tool_txn = NULL;
 	}
 
+	/* a full reindex rebuilt the presence map, it can be trusted now */
+	{
+		struct mdb_info *mdb = be->be_private;
+		if ( mdb && mdb->mi_presmap_build == 2 && !txi ) {
+			MDB_txn *txn;
+			int rc;
+			mdb->mi_presmap_build = 0;
+			rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+			if ( rc == 0 ) {
+				rc = mdb_presmap_done( mdb, txn );
+				if ( rc == 0 )
+					rc = mdb_txn_commit( txn );
+				else
+					mdb_txn_abort( txn );
+			}
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_tool_entry_close) ": database %s: "
+					"presence map completion failed: %s (%d)\n",
+					be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+				return -1;
+			}
+		}
+	}
+
+	if ( mdb_tool_keys ) {
+		if ( mdb_tool_keys_done( be ))
+			return -1;
+	}
+	mdb_tool_keys_state = 0;
+
 	if( nholes ) {
 		unsigned i;
 		fprintf( stderr, "Error, entries missing!\n");
@@ -268,6 +364,8 @@ ID mdb_tool_entry_next(
 			mdb_txn_abort( mdb_tool_txn );
 			return NOID;
 		}
+		if ( mdb->mi_dbenv_flags & MDB_NORDAHEAD )
+			mdb_cursor_readahead( cursor, MDB_SCAN_READAHEAD );
 	}
 
 next:;
@@ -331,6 +429,10 @@ ID mdb_tool_dn2id_get(
 
 	mdb = (struct mdb_info *) be->be_private;
 
+	/* reads and changes after slapadd need the buffered keys in place */
+	if ( mdb_tool_keys && mdb_tool_keys_done( be ))
+		return NOID;
+
 	if ( !mdb_tool_txn ) {
 		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, (slapMode & SLAP_TOOL_READONLY) != 0 ?
 			MDB_RDONLY : 0, &mdb_tool_txn );
@@ -426,6 +528,9 @@ mdb_tool_entry_get( BackendDB *be, ID id )
 	Entry *e = NULL;
 	int rc;
 
+	if ( mdb_tool_keys && mdb_tool_keys_done( be ))
+		return NULL;
+
 	if ( !mdb_tool_txn ) {
 		struct mdb_info *mdb = (struct mdb_info *) be->be_private;
 		rc = mdb_txn_begin( mdb->mi_dbenv, NULL,
@@ -446,6 +551,113 @@ mdb_tool_entry_get( BackendDB *be, ID id )
 	return e;
 }
 
+/* The snapshot the export started from, see mdb_tool_entry_scan() */
+static size_t mdb_tool_scan_txnid;
+static int mdb_tool_scan_drift;
+
+/*
+ * LMDB transactions and cursors belong to one thread, so each call
+ * has its own read txn. If the database is written to while slapcat
+ * runs, the ranges may come from different snapshots; that is noted
+ * once instead of silently mixing them.
+ */
+int
+mdb_tool_entry_scan(
+	BackendDB *be,
+	ID first,
+	ID *last,
+	BI_tool_entry_scan_cb *cb,
+	void *arg )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	Operation op = {0};
+	Opheader ohdr = {0};
+	MDB_txn *txn = NULL;
+	MDB_cursor *mc, *idc = NULL;
+	MDB_val key, data;
+	struct berval dn, ndn;
+	Entry *e;
+	ID id;
+	int rc;
+
+	assert( slapMode & SLAP_TOOL_MODE );
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
+	if ( rc == 0 )
+		rc = mdb_cursor_open( txn, mdb->mi_id2entry, &mc );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_tool_entry_scan) ": database %s: "
+			"unable to read: %s (%d)\n",
+			be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+		if ( txn )
+			mdb_txn_abort( txn );
+		return -1;
+	}
+	if ( mdb->mi_dbenv_flags & MDB_NORDAHEAD )
+		mdb_cursor_readahead( mc, MDB_SCAN_READAHEAD );
+
+	if ( cb == NULL ) {
+		rc = mdb_cursor_get( mc, &key, &data, MDB_LAST );
+		*last = rc ? 0 : *(ID *)key.mv_data;
+		mdb_tool_scan_txnid = mdb_txn_id( txn );
+		mdb_tool_scan_drift = 0;
+		rc = 0;
+		goto done;
+	}
+	if ( mdb_txn_id( txn ) != mdb_tool_scan_txnid && !mdb_tool_scan_drift ) {
+		mdb_tool_scan_drift = 1;
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_tool_entry_scan) ": database %s: "
+			"changed during the export, it is not a single snapshot\n",
+			be->be_suffix[0].bv_val, 0, 0 );
+	}
+
+	op.o_hdr = &ohdr;
+	op.o_bd = be;
+	op.o_tmpmemctx = NULL;
+	op.o_tmpmfuncs = &ch_mfuncs;
+
+	key.mv_size = sizeof(ID);
+	key.mv_data = &first;
+	for ( rc = mdb_cursor_get( mc, &key, &data, MDB_SET_RANGE ); rc == 0;
+		rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT ))
+	{
+		id = *(ID *)key.mv_data;
+		if ( id > *last )
+			break;
+		if ( !data.mv_size )
+			continue;
+
+		e = NULL;
+		if ( mdb_id2name( &op, txn, &idc, id, &dn, &ndn ) == 0 ) {
+			if ( mdb_entry_decode( &op, txn, &data, id, &e ) == 0 ) {
+				e->e_id = id;
+				e->e_name = dn;
+				e->e_nname = ndn;
+			} else {
+				e = NULL;
+				ch_free( dn.bv_val );
+				ch_free( ndn.bv_val );
+			}
+		}
+		/* the values point into the map, done with e before the txn */
+		rc = cb( be, id, e, arg );
+		if ( e )
+			mdb_entry_return( &op, e );
+		if ( rc )
+			goto done;
+	}
+	rc = ( rc == MDB_NOTFOUND ) ? 0 : rc;
+
+done:
+	if ( idc )
+		mdb_cursor_close( idc );
+	mdb_cursor_close( mc );
+	mdb_txn_abort( txn );
+	return rc;
+}
+
 static int mdb_tool_next_id(
 	Operation *op,
 	MDB_txn *tid,
@@ -678,6 +890,8 @@ ID mdb_tool_entry_put(
 			ID dummy;
 			mdb_next_id( be, idcursor, &dummy );
 		}
+		if ( !mdb_tool_keys_state )
+			mdb_tool_keys_start( be, mdb_tool_txn );
 		rc = mdb_cursor_open( mdb_tool_txn, mdb->mi_dn2id, &mcp );
 		if( rc != 0 ) {
 			snprintf( text->bv_val, text->bv_len,
@@ -739,6 +953,17 @@ ID mdb_tool_entry_put(
 	if( mdb->mi_nattrs && mdb_tool_threads > 1 )
 		rc = mdb_tool_index_finish();
 
+	if ( rc == 0 ) {
+		rc = mdb_presmap_entry( &op, mdb_tool_txn, SLAP_INDEX_ADD_OP, e );
+		if ( rc != 0 ) {
+			snprintf( text->bv_val, text->bv_len,
+					"presence map add failed: err=%d", rc );
+			Debug( LDAP_DEBUG_ANY,
+				"=> " LDAP_XSTRING(mdb_tool_entry_put) ": %s\n",
+				text->bv_val, 0, 0 );
+		}
+	}
+
 done:
 	if( rc == 0 ) {
 		mdb_writes++;
@@ -761,6 +986,26 @@ done:
 					text->bv_val, 0, 0 );
 				e->e_id = NOID;
 			}
+			if ( mdb_tool_keys ) {
+				for ( i=0; i<mdb->mi_nattrs; i++ ) {
+					mdb_tool_keybuf *kb = &mdb_tool_keys[i];
+					if ( rc )
+						kb->kb_len = kb->kb_commit;
+					else
+						kb->kb_commit = kb->kb_len;
+				}
+				if ( !rc && mdb_tool_keys_total > mdb_tool_keys_max ) {
+					rc = mdb_tool_keys_spill_all( be );
+					if ( rc ) {
+						snprintf( text->bv_val, text->bv_len,
+							"index key spill failed (%d)", rc );
+						Debug( LDAP_DEBUG_ANY,
+							"=> " LDAP_XSTRING(mdb_tool_entry_put) ": %s\n",
+							text->bv_val, 0, 0 );
+						e->e_id = NOID;
+					}
+				}
+			}
 		}
 
 	} else {
@@ -770,6 +1015,11 @@ done:
 		idcursor = NULL;
 		for ( i=0; i<mdb->mi_nattrs; i++ )
 			mdb->mi_attrs[i]->ai_cursor = NULL;
+		if ( mdb_tool_keys ) {
+			/* drop the keys of the entries that were lost */
+			for ( i=0; i<mdb->mi_nattrs; i++ )
+				mdb_tool_keys[i].kb_len = mdb_tool_keys[i].kb_commit;
+		}
 		mdb_writes = 0;
 		snprintf( text->bv_val, text->bv_len,
 			"txn_aborted! %s (%d)",
@@ -786,6 +1036,52 @@ done:
 
 static int mdb_dn2id_upgrade( BackendDB *be );
 
+/* Move the indexes of adv to the front of mi_attrs and index
+ * only those for the rest of this run.
+ */
+static int
+mdb_tool_index_select( struct mdb_info *mi, AttributeDescription **adv )
+{
+	int i, j, n;
+
+	if ( mi->mi_attrs[0]->ai_desc != adv[0] ) {
+		/* count */
+		for ( n = 0; adv[n]; n++ ) ;
+
+		/* insertion sort */
+		for ( i = 0; i < n; i++ ) {
+			AttributeDescription *ad = adv[i];
+			for ( j = i-1; j>=0; j--) {
+				if ( SLAP_PTRCMP( adv[j], ad ) <= 0 ) break;
+				adv[j+1] = adv[j];
+			}
+			adv[j+1] = ad;
+		}
+	}
+
+	for ( i = 0; adv[i]; i++ ) {
+		if ( mi->mi_attrs[i]->ai_desc != adv[i] ) {
+			for ( j = i+1; j < mi->mi_nattrs; j++ ) {
+				if ( mi->mi_attrs[j]->ai_desc == adv[i] ) {
+					AttrInfo *ai = mi->mi_attrs[i];
+					mi->mi_attrs[i] = mi->mi_attrs[j];
+					mi->mi_attrs[j] = ai;
+					break;
+				}
+			}
+			if ( j == mi->mi_nattrs ) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_tool_index_select)
+					": no index configured for %s\n",
+					adv[i]->ad_cname.bv_val, 0, 0 );
+				return -1;
+			}
+		}
+	}
+	mi->mi_nattrs = i;
+	return 0;
+}
+
 int mdb_tool_entry_reindex(
 	BackendDB *be,
 	ID id,
@@ -810,53 +1106,21 @@ int mdb_tool_entry_reindex(
 		return mdb_dn2id_upgrade( be );
 	}
 
+	/* A full reindex also rebuilds an incomplete presence map */
+	if ( !adv && mi->mi_presmap && !mi->mi_presmap_ok &&
+		!mi->mi_presmap_build )
+		mi->mi_presmap_build = 1;
+
 	/* No indexes configured, nothing to do. Could return an
 	 * error here to shortcut things.
 	 */
-	if (!mi->mi_attrs) {
+	if (!mi->mi_attrs && !mi->mi_presmap_build) {
 		return 0;
 	}
 
 	/* Check for explicit list of attrs to index */
-	if ( adv ) {
-		int i, j, n;
-
-		if ( mi->mi_attrs[0]->ai_desc != adv[0] ) {
-			/* count */
-			for ( n = 0; adv[n]; n++ ) ;
-
-			/* insertion sort */
-			for ( i = 0; i < n; i++ ) {
-				AttributeDescription *ad = adv[i];
-				for ( j = i-1; j>=0; j--) {
-					if ( SLAP_PTRCMP( adv[j], ad ) <= 0 ) break;
-					adv[j+1] = adv[j];
-				}
-				adv[j+1] = ad;
-			}
-		}
-
-		for ( i = 0; adv[i]; i++ ) {
-			if ( mi->mi_attrs[i]->ai_desc != adv[i] ) {
-				for ( j = i+1; j < mi->mi_nattrs; j++ ) {
-					if ( mi->mi_attrs[j]->ai_desc == adv[i] ) {
-						AttrInfo *ai = mi->mi_attrs[i];
-						mi->mi_attrs[i] = mi->mi_attrs[j];
-						mi->mi_attrs[j] = ai;
-						break;
-					}
-				}
-				if ( j == mi->mi_nattrs ) {
-					Debug( LDAP_DEBUG_ANY,
-						LDAP_XSTRING(mdb_tool_entry_reindex)
-						": no index configured for %s\n",
-						adv[i]->ad_cname.bv_val, 0, 0 );
-					return -1;
-				}
-			}
-		}
-		mi->mi_nattrs = i;
-	}
+	if ( adv && mdb_tool_index_select( mi, adv ))
+		return -1;
 
 	e = mdb_tool_entry_get( be, id );
 
@@ -895,6 +1159,18 @@ int mdb_tool_entry_reindex(
 		slapMode ^= SLAP_TRUNCATE_MODE;
 	}
 
+	if ( mi->mi_presmap_build == 1 ) {
+		rc = mdb_drop( txi, mi->mi_ad2pres, 0 );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_tool_entry_reindex)
+				": mdb_drop(ad2pres) failed: %s (%d)\n",
+				mdb_strerror(rc), rc, 0 );
+			return -1;
+		}
+		mi->mi_presmap_build = 2;
+	}
+
 	/*
 	 * just (re)add them for now
 	 * Use truncate mode to empty/reset index databases
@@ -910,6 +1186,13 @@ int mdb_tool_entry_reindex(
 	op.o_tmpmfuncs = &ch_mfuncs;
 
 	rc = mdb_tool_index_add( &op, txi, e );
+	if ( rc == 0 && mi->mi_presmap_build ) {
+		/* the index threads must be done with the txn */
+		if ( mi->mi_nattrs && mdb_tool_threads > 1 )
+			rc = mdb_tool_index_finish();
+		if ( rc == 0 )
+			rc = mdb_presmap_entry( &op, txi, SLAP_INDEX_ADD_OP, e );
+	}
 
 done:
 	if( rc == 0 ) {
@@ -936,6 +1219,8 @@ done:
 			/* and then reopen it so that tool_entry_next still works. */
 			mdb_txn_begin( mi->mi_dbenv, NULL, MDB_RDONLY, &mdb_tool_txn );
 			mdb_cursor_open( mdb_tool_txn, mi->mi_id2entry, &cursor );
+			if ( mi->mi_dbenv_flags & MDB_NORDAHEAD )
+				mdb_cursor_readahead( cursor, MDB_SCAN_READAHEAD );
 			key.mv_data = &id;
 			key.mv_size = sizeof(ID);
 			mdb_cursor_get( cursor, &key, NULL, MDB_SET );
@@ -1008,6 +1293,17 @@ ID mdb_tool_entry_modify(
 	op.o_tmpmemctx = NULL;
 	op.o_tmpmfuncs = &ch_mfuncs;
 
+	/* the old entry isn't at hand to see which attributes changed */
+	rc = mdb_presmap_stale( mdb, mdb_tool_txn );
+	if( rc != 0 ) {
+		snprintf( text->bv_val, text->bv_len,
+				"presence map update failed: err=%d", rc );
+		Debug( LDAP_DEBUG_ANY,
+			"=> " LDAP_XSTRING(mdb_tool_entry_modify) ": %s\n",
+			text->bv_val, 0, 0 );
+		goto done;
+	}
+
 	/* id2entry index */
 	rc = mdb_id2entry_update( &op, mdb_tool_txn, NULL, e );
 	if( rc != 0 ) {
@@ -1080,6 +1376,16 @@ int mdb_tool_entry_delete(
 		mdb_cursor_close( cursor );
 		cursor = NULL;
 	}
+	/* buffered slapadd keys must be in place first */
+	if ( mdb_tool_keys && ( rc = mdb_tool_keys_done( be ))) {
+		snprintf( text->bv_val, text->bv_len,
+			"index key flush failed: %s (%d)",
+			mdb_strerror(rc), rc );
+		Debug( LDAP_DEBUG_ANY,
+			"=> " LDAP_XSTRING(mdb_tool_entry_delete) ": %s\n",
+			 text->bv_val, 0, 0 );
+		return LDAP_OTHER;
+	}
 	if( !mdb_tool_txn ) {
 		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &mdb_tool_txn );
 		if( rc != 0 ) {
@@ -1155,6 +1461,8 @@ int mdb_tool_entry_delete(
 
 	/* deindex values */
 	rc = mdb_index_entry_del( &op, mdb_tool_txn, e );
+	if( rc == 0 )
+		rc = mdb_presmap_entry( &op, mdb_tool_txn, SLAP_INDEX_DELETE_OP, e );
 	if( rc != 0 ) {
 		snprintf( text->bv_val, text->bv_len,
 				"entry_delete failed: err=%d", rc );
@@ -1207,6 +1515,615 @@ done:
 	return rc;
 }
 
+static int
+mdb_tool_keys_start( BackendDB *be, MDB_txn *txn )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_stat st;
+	int i;
+
+	mdb_tool_keys_state = -1;
+	if ( !( slapMode & SLAP_TOOL_QUICK ) || !mdb->mi_nattrs )
+		return 0;
+
+	mdb_tool_keys = ch_calloc( mdb->mi_nattrs, sizeof( mdb_tool_keybuf ));
+	mdb_tool_keys_total = 0;
+	mdb_tool_keys_max = slap_tool_sortmem ? slap_tool_sortmem : MDB_TOOL_KEYS_MAX;
+	for ( i=0; i<mdb->mi_nattrs; i++ ) {
+		AttrInfo *ai = mdb->mi_attrs[i];
+		if ( mdb_stat( txn, ai->ai_dbi, &st ) == 0 && !st.ms_entries )
+			mdb_tool_keys[i].kb_append = 1;
+		ldap_pvt_thread_mutex_init( &mdb_tool_keys[i].kb_mutex );
+		ai->ai_keybuf = &mdb_tool_keys[i];
+	}
+	mdb_tool_keys_state = 1;
+	return 0;
+}
+
+int mdb_tool_keys_add(
+	BackendDB *be,
+	MDB_cursor *mc,
+	struct berval *keys,
+	ID id )
+{
+	AttrInfo *ai = (AttrInfo *)mc;
+	mdb_tool_keybuf *kb = ai->ai_keybuf;
+	mdb_tool_keyrec *kr;
+	size_t len;
+	int k;
+
+	if ( mdb_tool_keys_state == 2 )
+		ldap_pvt_thread_mutex_lock( &kb->kb_mutex );
+	for ( k=0; keys[k].bv_val; k++ ) {
+		len = KEYREC_SIZE( keys[k].bv_len );
+		if ( kb->kb_len + len > kb->kb_size ) {
+			size_t size = kb->kb_size ? kb->kb_size * 2 : 65536;
+			while ( kb->kb_len + len > size )
+				size *= 2;
+			kb->kb_buf = ch_realloc( kb->kb_buf, size );
+			kb->kb_size = size;
+		}
+		kr = (mdb_tool_keyrec *)( kb->kb_buf + kb->kb_len );
+		kr->kr_id = id;
+		kr->kr_len = keys[k].bv_len;
+		memcpy( kr->kr_key, keys[k].bv_val, keys[k].bv_len );
+		kb->kb_len += len;
+		if ( mdb_tool_keys_state != 2 )
+			mdb_tool_keys_total += len;
+	}
+	if ( mdb_tool_keys_state == 2 ) {
+		char *buf = NULL;
+
+		/* take the full buffer, others can go on with a new one */
+		if ( kb->kb_len >= mdb_tool_keys_spill ) {
+			buf = kb->kb_buf;
+			len = kb->kb_len;
+			kb->kb_buf = NULL;
+			kb->kb_len = kb->kb_size = 0;
+		}
+		ldap_pvt_thread_mutex_unlock( &kb->kb_mutex );
+		if ( buf )
+			return mdb_tool_keys_spill_run( be, ai, kb, buf, len );
+	}
+	return 0;
+}
+
+/* An unlinked temporary file in the database directory */
+static FILE *
+mdb_tool_keys_tmpfile( struct mdb_info *mdb )
+{
+	char *path;
+	FILE *fp = NULL;
+	int fd;
+
+	path = ch_malloc( strlen( mdb->mi_dbenv_home ) + sizeof( "/keysXXXXXX" ));
+	sprintf( path, "%s/keysXXXXXX", mdb->mi_dbenv_home );
+	fd = mkstemp( path );
+	if ( fd >= 0 ) {
+		unlink( path );
+		fp = fdopen( fd, "w+" );
+		if ( fp == NULL )
+			close( fd );
+	}
+	ch_free( path );
+	return fp;
+}
+
+/* Sort a full key buffer and write it out as a run, buf is freed */
+static int
+mdb_tool_keys_spill_run( BackendDB *be, AttrInfo *ai, mdb_tool_keybuf *kb,
+	char *buf, size_t len )
+{
+	mdb_tool_keybuf tmp = {0};
+	mdb_tool_keyrec **recs;
+	FILE *fp;
+	size_t n, i;
+	int rc = 0;
+
+	tmp.kb_buf = buf;
+	tmp.kb_len = len;
+	recs = mdb_tool_keys_sort( &tmp, &n );
+	fp = mdb_tool_keys_tmpfile( be->be_private );
+	if ( fp == NULL ) {
+		rc = errno;
+	} else {
+		for ( i=0; i < n; i++ ) {
+			if ( fwrite( recs[i], KEYREC_SIZE( recs[i]->kr_len ), 1, fp ) != 1 )
+				break;
+		}
+		if ( i < n || fflush( fp ) || fseek( fp, 0L, SEEK_SET )) {
+			rc = errno;
+			fclose( fp );
+		}
+	}
+	ch_free( recs );
+	ch_free( buf );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_tool_keys_spill_run) ": %s: "
+			"could not write temporary file: %s (%d)\n",
+			ai->ai_desc->ad_cname.bv_val, STRERROR(rc), rc );
+		return LDAP_OTHER;
+	}
+
+	ldap_pvt_thread_mutex_lock( &kb->kb_mutex );
+	kb->kb_runs = ch_realloc( kb->kb_runs, ( kb->kb_nruns + 1 ) * sizeof( FILE * ));
+	kb->kb_runs[kb->kb_nruns++] = fp;
+	ldap_pvt_thread_mutex_unlock( &kb->kb_mutex );
+	return 0;
+}
+
+/* Spill all buffers, between slapadd txns */
+static int
+mdb_tool_keys_spill_all( BackendDB *be )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	mdb_tool_keybuf *kb;
+	int i, rc = 0;
+
+	for ( i=0; rc == 0 && i<mdb->mi_nattrs; i++ ) {
+		kb = &mdb_tool_keys[i];
+		if ( !kb->kb_len )
+			continue;
+		rc = mdb_tool_keys_spill_run( be, mdb->mi_attrs[i], kb,
+			kb->kb_buf, kb->kb_len );
+		kb->kb_buf = NULL;
+		kb->kb_len = kb->kb_size = kb->kb_commit = 0;
+	}
+	mdb_tool_keys_total = 0;
+	return rc;
+}
+
+/* Index databases use the default LMDB key order */
+static int
+mdb_tool_keyrec_cmp( const void *v1, const void *v2 )
+{
+	const mdb_tool_keyrec *k1 = *(const mdb_tool_keyrec **)v1;
+	const mdb_tool_keyrec *k2 = *(const mdb_tool_keyrec **)v2;
+	int rc;
+
+	rc = memcmp( k1->kr_key, k2->kr_key,
+		k1->kr_len < k2->kr_len ? k1->kr_len : k2->kr_len );
+	if ( !rc )
+		rc = k1->kr_len - k2->kr_len;
+	if ( !rc )
+		rc = k1->kr_id < k2->kr_id ? -1 : k1->kr_id > k2->kr_id;
+	return rc;
+}
+
+/* Sort the records of a key buffer */
+static mdb_tool_keyrec **
+mdb_tool_keys_sort( mdb_tool_keybuf *kb, size_t *np )
+{
+	mdb_tool_keyrec **recs, *kr;
+	size_t n, i, off;
+
+	for ( n=0, off=0; off < kb->kb_len; n++ ) {
+		kr = (mdb_tool_keyrec *)( kb->kb_buf + off );
+		off += KEYREC_SIZE( kr->kr_len );
+	}
+	recs = ch_malloc( ( n ? n : 1 ) * sizeof( mdb_tool_keyrec * ));
+	for ( i=0, off=0; i < n; i++ ) {
+		recs[i] = (mdb_tool_keyrec *)( kb->kb_buf + off );
+		off += KEYREC_SIZE( recs[i]->kr_len );
+	}
+	qsort( recs, n, sizeof( mdb_tool_keyrec * ), mdb_tool_keyrec_cmp );
+	*np = n;
+	return recs;
+}
+
+/* Move to the next record of a run */
+static int
+mdb_tool_keyrun_next( mdb_tool_keyrun *ru )
+{
+	size_t len;
+
+	if ( !ru->ru_fp ) {
+		ru->ru_cur = ru->ru_pos < ru->ru_n ? ru->ru_recs[ru->ru_pos++] : NULL;
+		return 0;
+	}
+
+	ru->ru_cur = NULL;
+	if ( fread( ru->ru_buf, offsetof( mdb_tool_keyrec, kr_key ), 1,
+		ru->ru_fp ) != 1 )
+		return ferror( ru->ru_fp ) ? -1 : 0;
+	len = KEYREC_SIZE( ru->ru_buf->kr_len ) - offsetof( mdb_tool_keyrec, kr_key );
+	if ( fread( ru->ru_buf->kr_key, len, 1, ru->ru_fp ) != 1 )
+		return -1;
+	ru->ru_cur = ru->ru_buf;
+	return 0;
+}
+
+/* The run with the smallest current record, NULL when all are done */
+static mdb_tool_keyrun *
+mdb_tool_keyrun_min( mdb_tool_keyrun *runs, int nruns )
+{
+	mdb_tool_keyrun *min = NULL;
+	int i;
+
+	for ( i=0; i < nruns; i++ ) {
+		if ( !runs[i].ru_cur )
+			continue;
+		if ( !min || mdb_tool_keyrec_cmp( &runs[i].ru_cur, &min->ru_cur ) < 0 )
+			min = &runs[i];
+	}
+	return min;
+}
+
+#define KEYREC_IS( kr, bv )	( (kr)->kr_len == (bv)->bv_len && \
+	!memcmp( (kr)->kr_key, (bv)->bv_val, (bv)->bv_len ))
+
+/* Write the merged runs of sorted keys into the index of ai.
+ * With append set the index must be empty.
+ */
+static int
+mdb_tool_keys_write( BackendDB *be, AttrInfo *ai,
+	mdb_tool_keyrun *runs, int nruns, int append )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	mdb_tool_keyrun *ru;
+	MDB_txn *txn = NULL;
+	MDB_cursor *mc;
+	MDB_val key, data[2];
+	struct berval keys[2];
+	ID *ids, lastid;
+	size_t puts = 0;
+	int i, nids, rc = 0;
+
+	for ( i=0; i < nruns; i++ ) {
+		rc = mdb_tool_keyrun_next( &runs[i] );
+		if ( rc )
+			goto leave;
+	}
+	ids = ch_malloc( MDB_IDL_DB_MAX * sizeof( ID ));
+	/* room for the longest key, int aligned and zero padded */
+	keys[0].bv_val = ch_calloc( 1, KEYREC_KEY_MAX + 2 * sizeof( int ));
+	BER_BVZERO( &keys[1] );
+
+	for ( ru = mdb_tool_keyrun_min( runs, nruns ); ru; ) {
+		if ( !txn ) {
+			rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+			if ( rc )
+				break;
+			rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
+			if ( rc )
+				break;
+		}
+		keys[0].bv_len = ru->ru_cur->kr_len;
+		memcpy( keys[0].bv_val, ru->ru_cur->kr_key, keys[0].bv_len );
+
+		/* the distinct IDs of this key, as many as fit in a slot */
+		nids = 0;
+		do {
+			lastid = ru->ru_cur->kr_id;
+			if ( !nids || ids[nids-1] != lastid )
+				ids[nids++] = lastid;
+			if (( rc = mdb_tool_keyrun_next( ru )))
+				break;
+			ru = mdb_tool_keyrun_min( runs, nruns );
+		} while ( ru && nids < MDB_IDL_DB_MAX && KEYREC_IS( ru->ru_cur, &keys[0] ));
+		if ( rc )
+			break;
+
+		if ( append ) {
+			key.mv_data = keys[0].bv_val;
+			key.mv_size = keys[0].bv_len;
+#ifndef MISALIGNED_OK
+			if ( key.mv_size & ALIGNER ) {
+				memset( keys[0].bv_val + key.mv_size, 0, 2 * sizeof( int ));
+				key.mv_size = 2 * sizeof( int );
+			}
+#endif
+			data[0].mv_size = sizeof(ID);
+			data[0].mv_data = ids;
+			rc = mdb_cursor_put( mc, &key, data, MDB_APPEND );
+			if ( rc == 0 && nids > 1 ) {
+				data[0].mv_data = ids + 1;
+				data[1].mv_size = nids - 1;
+				rc = mdb_cursor_put( mc, &key, data, MDB_APPENDDUP|MDB_MULTIPLE );
+			}
+			if ( rc )
+				break;
+		} else {
+			int k;
+			for ( k=0; k < nids; k++ ) {
+				rc = mdb_idl_insert_keys( be, mc, keys, ids[k] );
+				if ( rc )
+					break;
+			}
+			if ( rc )
+				break;
+		}
+		puts += nids;
+
+		/* the rest turns the slot into a range or bitmap */
+		for ( ; ru && KEYREC_IS( ru->ru_cur, &keys[0] );
+			ru = mdb_tool_keyrun_min( runs, nruns ))
+		{
+			if ( ru->ru_cur->kr_id != lastid ) {
+				lastid = ru->ru_cur->kr_id;
+				rc = mdb_idl_insert_keys( be, mc, keys, lastid );
+				if ( rc )
+					break;
+				puts++;
+			}
+			if (( rc = mdb_tool_keyrun_next( ru )))
+				break;
+		}
+		if ( rc )
+			break;
+
+		if ( puts >= MDB_TOOL_KEYS_PER_COMMIT ) {
+			rc = mdb_txn_commit( txn );
+			txn = NULL;
+			puts = 0;
+			if ( rc )
+				break;
+		}
+	}
+	if ( txn ) {
+		if ( rc )
+			mdb_txn_abort( txn );
+		else
+			rc = mdb_txn_commit( txn );
+	}
+	ch_free( keys[0].bv_val );
+	ch_free( ids );
+leave:
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_tool_keys_write) ": %s: "
+			"failed: %s (%d)\n",
+			ai->ai_desc->ad_cname.bv_val,
+			rc > 0 ? mdb_strerror(rc) : "error reading spilled keys", rc );
+	}
+	return rc;
+}
+
+/* Merge the spilled runs and the buffer of an index into it */
+static int
+mdb_tool_keys_merge( BackendDB *be, AttrInfo *ai, mdb_tool_keybuf *kb )
+{
+	mdb_tool_keyrun *runs;
+	int i, rc;
+
+	runs = ch_calloc( kb->kb_nruns + 1, sizeof( mdb_tool_keyrun ));
+	for ( i=0; i < kb->kb_nruns; i++ ) {
+		runs[i].ru_fp = kb->kb_runs[i];
+		runs[i].ru_buf = ch_malloc( KEYREC_SIZE( KEYREC_KEY_MAX ));
+	}
+	runs[i].ru_recs = mdb_tool_keys_sort( kb, &runs[i].ru_n );
+	rc = mdb_tool_keys_write( be, ai, runs, kb->kb_nruns + 1, kb->kb_append );
+	for ( i=0; i < kb->kb_nruns; i++ ) {
+		ch_free( runs[i].ru_buf );
+		fclose( kb->kb_runs[i] );
+	}
+	ch_free( runs[i].ru_recs );
+	ch_free( runs );
+	ch_free( kb->kb_runs );
+	kb->kb_runs = NULL;
+	kb->kb_nruns = 0;
+	return rc;
+}
+
+/* Write out the buffered keys. No tool txn may be open. */
+static int
+mdb_tool_keys_flush( BackendDB *be )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	int i, rc = 0;
+
+	for ( i=0; i<mdb->mi_nattrs; i++ ) {
+		mdb_tool_keybuf *kb = &mdb_tool_keys[i];
+		if ( !kb->kb_len && !kb->kb_nruns )
+			continue;
+		rc = mdb_tool_keys_merge( be, mdb->mi_attrs[i], kb );
+		if ( rc )
+			break;
+		/* from now on there are keys to merge with */
+		kb->kb_append = 0;
+		kb->kb_len = kb->kb_commit = 0;
+	}
+	mdb_tool_keys_total = 0;
+	return rc;
+}
+
+/* Write out the buffered keys and stop buffering for this run */
+static int
+mdb_tool_keys_done( BackendDB *be )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	int i, rc = 0;
+
+	if ( mdb_tool_txn ) {
+		rc = mdb_txn_commit( mdb_tool_txn );
+		mdb_tool_txn = NULL;
+		idcursor = NULL;
+		mdb_writes = 0;
+		for ( i=0; i<mdb->mi_nattrs; i++ ) {
+			mdb->mi_attrs[i]->ai_cursor = NULL;
+			if ( rc )
+				mdb_tool_keys[i].kb_len = mdb_tool_keys[i].kb_commit;
+		}
+	}
+	if ( !rc )
+		rc = mdb_tool_keys_flush( be );
+
+	for ( i=0; i<mdb->mi_nattrs; i++ ) {
+		mdb_tool_keybuf *kb = &mdb_tool_keys[i];
+		int j;
+
+		mdb->mi_attrs[i]->ai_keybuf = NULL;
+		for ( j=0; j < kb->kb_nruns; j++ )
+			fclose( kb->kb_runs[j] );
+		ch_free( kb->kb_runs );
+		ch_free( kb->kb_buf );
+		ldap_pvt_thread_mutex_destroy( &kb->kb_mutex );
+	}
+	ch_free( mdb_tool_keys );
+	mdb_tool_keys = NULL;
+	mdb_tool_keys_state = -1;
+	return rc;
+}
+
+/*
+ * slapindex -q with tool-threads > 1: rebuild the selected indexes
+ * from scratch. The index databases are emptied, the threads read
+ * id2entry in ranges of MDB_TOOL_REBUILD_IDS entries and buffer the
+ * keys, a buffer that grows past its share of the memory budget is
+ * sorted and spilled to a temporary file. At the end the runs of each
+ * index are merged and appended to it.
+ */
+#ifndef MDB_TOOL_REBUILD_IDS
+#define MDB_TOOL_REBUILD_IDS	1024
+#endif
+
+static struct mdb_tool_rebuild {
+	ldap_pvt_thread_mutex_t rb_mutex;
+	ldap_pvt_thread_cond_t rb_cond;
+	ID rb_next, rb_max;
+	int rb_running;
+	int rb_rc;
+} mdb_tool_rb;
+
+static int
+mdb_tool_rebuild_entry( BackendDB *be, ID id, Entry *e, void *arg )
+{
+	Operation *op = arg;
+
+	if ( mdb_tool_rb.rb_rc )
+		return -1;
+	if ( e == NULL ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_tool_index_rebuild)
+			": could not read id=%ld\n", (long) id, 0, 0 );
+		return -1;
+	}
+	return mdb_index_entry_add( op, NULL, e );
+}
+
+static void *
+mdb_tool_rebuild_task( void *ctx, void *ptr )
+{
+	BackendDB *be = ptr;
+	Operation op = {0};
+	Opheader ohdr = {0};
+	ID first, last;
+	int rc = 0;
+
+	op.o_hdr = &ohdr;
+	op.o_bd = be;
+	op.o_tmpmemctx = NULL;
+	op.o_tmpmfuncs = &ch_mfuncs;
+
+	for (;;) {
+		ldap_pvt_thread_mutex_lock( &mdb_tool_rb.rb_mutex );
+		if ( rc && !mdb_tool_rb.rb_rc )
+			mdb_tool_rb.rb_rc = rc;
+		if ( mdb_tool_rb.rb_rc || mdb_tool_rb.rb_next > mdb_tool_rb.rb_max ) {
+			if ( !--mdb_tool_rb.rb_running )
+				ldap_pvt_thread_cond_signal( &mdb_tool_rb.rb_cond );
+			ldap_pvt_thread_mutex_unlock( &mdb_tool_rb.rb_mutex );
+			break;
+		}
+		first = mdb_tool_rb.rb_next;
+		last = first + MDB_TOOL_REBUILD_IDS - 1;
+		if ( last > mdb_tool_rb.rb_max )
+			last = mdb_tool_rb.rb_max;
+		mdb_tool_rb.rb_next = last + 1;
+		ldap_pvt_thread_mutex_unlock( &mdb_tool_rb.rb_mutex );
+
+		rc = mdb_tool_entry_scan( be, first, &last,
+			mdb_tool_rebuild_entry, &op );
+	}
+	return NULL;
+}
+
+int
+mdb_tool_index_rebuild(
+	BackendDB *be,
+	AttributeDescription **adv )
+{
+	struct mdb_info *mi = (struct mdb_info *) be->be_private;
+	MDB_txn *txn;
+	int i, j, rc;
+
+	/* left to the entry by entry reindex */
+	if ( adv && adv[0] == slap_schema.si_ad_entryDN )
+		return SLAP_CB_CONTINUE;
+	if ( !adv && mi->mi_presmap && !mi->mi_presmap_ok )
+		return SLAP_CB_CONTINUE;
+
+	if ( !mi->mi_attrs )
+		return 0;
+	if ( adv && mdb_tool_index_select( mi, adv ))
+		return -1;
+
+	rc = mdb_txn_begin( mi->mi_dbenv, NULL, 0, &txn );
+	for ( i=0; rc == 0 && i < mi->mi_nattrs; i++ )
+		rc = mdb_drop( txn, mi->mi_attrs[i]->ai_dbi, 0 );
+	if ( rc == 0 )
+		rc = mdb_txn_commit( txn );
+	else if ( txn )
+		mdb_txn_abort( txn );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_tool_index_rebuild)
+			": could not empty the indexes: %s (%d)\n",
+			mdb_strerror(rc), rc, 0 );
+		return -1;
+	}
+
+	mdb_tool_keys = ch_calloc( mi->mi_nattrs, sizeof( mdb_tool_keybuf ));
+	for ( i=0; i < mi->mi_nattrs; i++ ) {
+		ldap_pvt_thread_mutex_init( &mdb_tool_keys[i].kb_mutex );
+		mi->mi_attrs[i]->ai_keybuf = &mdb_tool_keys[i];
+	}
+	mdb_tool_keys_max = slap_tool_sortmem ? slap_tool_sortmem : MDB_TOOL_KEYS_MAX;
+	mdb_tool_keys_spill = mdb_tool_keys_max / mi->mi_nattrs;
+	mdb_tool_keys_state = 2;
+
+	memset( &mdb_tool_rb, 0, sizeof( mdb_tool_rb ));
+	rc = mdb_tool_entry_scan( be, 0, &mdb_tool_rb.rb_max, NULL, NULL );
+	if ( rc == 0 && mdb_tool_rb.rb_max ) {
+		ldap_pvt_thread_mutex_init( &mdb_tool_rb.rb_mutex );
+		ldap_pvt_thread_cond_init( &mdb_tool_rb.rb_cond );
+		mdb_tool_rb.rb_next = 1;
+		mdb_tool_rb.rb_running = slap_tool_thread_max;
+		for ( i=0; i < slap_tool_thread_max; i++ )
+			ldap_pvt_thread_pool_submit( &connection_pool,
+				mdb_tool_rebuild_task, be );
+		ldap_pvt_thread_mutex_lock( &mdb_tool_rb.rb_mutex );
+		while ( mdb_tool_rb.rb_running )
+			ldap_pvt_thread_cond_wait( &mdb_tool_rb.rb_cond,
+				&mdb_tool_rb.rb_mutex );
+		ldap_pvt_thread_mutex_unlock( &mdb_tool_rb.rb_mutex );
+		ldap_pvt_thread_cond_destroy( &mdb_tool_rb.rb_cond );
+		ldap_pvt_thread_mutex_destroy( &mdb_tool_rb.rb_mutex );
+		rc = mdb_tool_rb.rb_rc;
+	}
+	mdb_tool_keys_state = -1;
+
+	/* merge the runs of each index into it */
+	for ( i=0; i < mi->mi_nattrs; i++ ) {
+		mdb_tool_keybuf *kb = &mdb_tool_keys[i];
+
+		kb->kb_append = 1;
+		if ( rc == 0 && ( kb->kb_len || kb->kb_nruns ))
+			rc = mdb_tool_keys_merge( be, mi->mi_attrs[i], kb );
+		for ( j=0; j < kb->kb_nruns; j++ )
+			fclose( kb->kb_runs[j] );
+		ch_free( kb->kb_runs );
+		ch_free( kb->kb_buf );
+		ldap_pvt_thread_mutex_destroy( &kb->kb_mutex );
+		mi->mi_attrs[i]->ai_keybuf = NULL;
+	}
+	ch_free( mdb_tool_keys );
+	mdb_tool_keys = NULL;
+
+	return rc ? -1 : 0;
+}
+
 static void *
 mdb_tool_index_task( void *ctx, void *ptr )
 {
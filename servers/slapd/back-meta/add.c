@@ -188,6 +188,14 @@ retry:;
 		}
 	}
 
+	/* the entry now exists; this also replaces a negative entry */
+	if ( rs->sr_err == LDAP_SUCCESS
+		&& mi->mi_cache.ttl != META_DNCACHE_DISABLED )
+	{
+		( void )meta_dncache_update_entry( &mi->mi_cache,
+				&op->o_req_ndn, candidate );
+	}
+
 cleanup:;
 	(void)mi->mi_ldap_extra->controls_free( op, rs, &ctrls );
 
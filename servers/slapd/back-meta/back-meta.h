@@ -672,6 +672,11 @@ meta_dncache_update_entry(
 	struct berval		*ndn,
 	int			target );
 
+extern int
+meta_dncache_is_negative(
+	metadncache_t		*cache,
+	struct berval		*ndn );
+
 extern int
 meta_dncache_delete_entry(
 	metadncache_t		*cache,
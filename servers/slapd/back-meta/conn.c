@@ -929,6 +929,14 @@ meta_back_get_candidate(
 		slap_callback	cb2 = { 0 };
 		int		rc;
 
+		/* a recent search of all the candidates
+		 * didn't find the entry; don't repeat it */
+		if ( meta_dncache_is_negative( &mi->mi_cache, ndn ) ) {
+			rs->sr_err = LDAP_NO_SUCH_OBJECT;
+			rs->sr_text = "No suitable candidate target found";
+			return META_TARGET_NONE;
+		}
+
 		/* try to get a unique match for the request ndn
 		 * among the multiple candidates available */
 		op2.o_tag = LDAP_REQ_SEARCH;
@@ -952,6 +960,15 @@ meta_back_get_candidate(
 		rc = op->o_bd->be_search( &op2, &rs2 );
 
 		switch ( rs2.sr_err ) {
+		case LDAP_NO_SUCH_OBJECT:
+			/* remember the miss, unless entries never expire
+			 * from the cache, or the miss would stick */
+			if ( mi->mi_cache.ttl > 0 ) {
+				( void )meta_dncache_update_entry( &mi->mi_cache,
+					ndn, META_TARGET_NONE );
+			}
+			/* fallthru */
+
 		case LDAP_SUCCESS:
 		default:
 			rs->sr_err = rs2.sr_err;
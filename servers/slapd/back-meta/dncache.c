@@ -31,6 +31,8 @@
 
 /*
  * The dncache, at present, maps an entry to the target that holds it.
+ * An entry with target META_TARGET_NONE records that a search on all
+ * the candidate targets found no such entry (see meta_dncache_is_negative).
  */
 
 typedef struct metadncacheentry_t {
@@ -190,10 +192,46 @@ error_return:;
 }
 
 /*
- * meta_dncache_update_entry
+ * meta_dncache_is_negative
  *
- * updates target and lastupdated of a struct metadncacheentry if exists,
- * otherwise it gets created; returns -1 in case of error
+ * returns 1 if a recent lookup found that no target holds the dn
+ */
+int
+meta_dncache_is_negative(
+	metadncache_t	*cache,
+	struct berval	*ndn )
+{
+	metadncacheentry_t	tmp_entry,
+				*entry;
+	int			rc = 0;
+
+	assert( cache != NULL );
+	assert( ndn != NULL );
+
+	/* negative entries are only recorded with a finite ttl */
+	if ( cache->ttl <= 0 ) {
+		return 0;
+	}
+
+	tmp_entry.dn = *ndn;
+	ldap_pvt_thread_mutex_lock( &cache->mutex );
+	entry = ( metadncacheentry_t * )avl_find( cache->tree,
+			( caddr_t )&tmp_entry, meta_dncache_cmp );
+
+	if ( entry != NULL && entry->target == META_TARGET_NONE
+		&& entry->lastupdated + cache->ttl > slap_get_time() )
+	{
+		rc = 1;
+	}
+	ldap_pvt_thread_mutex_unlock( &cache->mutex );
+
+	return rc;
+}
+
+/*
+ * meta_dncache_delete_entry
+ *
+ * removes the struct metadncacheentry of a dn, if any
  */
 int
 meta_dncache_delete_entry(
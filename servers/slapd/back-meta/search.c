@@ -781,6 +781,56 @@ doreturn:;
 	return retcode;
 }
 
+#ifdef HAVE_POLL
+/*
+ * meta_back_search_wait
+ *
+ * waits until any target with an outstanding search has something
+ * to read, or until tv expires, rather than sleeping blindly or
+ * blocking on one target while the others have results queued
+ */
+static void
+meta_back_search_wait(
+	Operation		*op,
+	metaconn_t		*mc,
+	SlapReply		*candidates,
+	struct timeval		*tv )
+{
+	metainfo_t	*mi = ( metainfo_t * )op->o_bd->be_private;
+	struct pollfd	*fds;
+	int		i, nfds = 0;
+
+	fds = op->o_tmpalloc( mi->mi_ntargets * sizeof( struct pollfd ),
+		op->o_tmpmemctx );
+
+	for ( i = 0; i < mi->mi_ntargets; i++ ) {
+		ber_socket_t	s;
+
+		if ( candidates[ i ].sr_msgid < 0
+			|| mc->mc_conns[ i ].msc_ld == NULL )
+		{
+			continue;
+		}
+
+		if ( ldap_get_option( mc->mc_conns[ i ].msc_ld, LDAP_OPT_DESC, &s ) != LDAP_OPT_SUCCESS
+			|| s == AC_SOCKET_INVALID )
+		{
+			continue;
+		}
+
+		fds[ nfds ].fd = s;
+		fds[ nfds ].events = POLLIN;
+		fds[ nfds ].revents = 0;
+		nfds++;
+	}
+
+	/* round up, so that sub-millisecond timeouts don't spin */
+	(void)poll( fds, nfds, tv->tv_sec * 1000 + ( tv->tv_usec + 999 ) / 1000 );
+
+	op->o_tmpfree( fds, op->o_tmpmemctx );
+}
+#endif /* HAVE_POLL */
+
 int
 meta_back_search( Operation *op, SlapReply *rs )
 {
@@ -1149,8 +1199,12 @@ getconn:;
 			 * to handle it, so at some time we'll
 			 * get a LDAP_TIMELIMIT_EXCEEDED from
 			 * one of them ...
+			 *
+			 * Don't block on a single target: waiting
+			 * for all of them at once is done below.
 			 */
-			tv = save_tv;
+			tv.tv_sec = 0;
+			tv.tv_usec = 0;
 			rc = ldap_result( msc->msc_ld, candidates[ i ].sr_msgid,
 					LDAP_MSG_RECEIVED, &tv, &res );
 			switch ( rc ) {
@@ -1804,7 +1858,11 @@ free_message:;
 
 			if ( alreadybound == 0 ) {
 				tv = save_tv;
+#ifdef HAVE_POLL
+				meta_back_search_wait( op, mc, candidates, &tv );
+#else /* ! HAVE_POLL */
 				(void)select( 0, NULL, NULL, NULL, &tv );
+#endif /* ! HAVE_POLL */
 
 			} else {
 				ldap_pvt_thread_yield();
@@ -76,13 +76,24 @@ typedef struct monitor_entry_t {
 
 struct entry_limbo_t;			/* in init.c */
 
+/*
+ * The entry cache is split by DN hash so that lookups of unrelated
+ * entries, e.g. a scrape walking cn=Connections while other operations
+ * update cn=Operations, don't serialize on one mutex.
+ */
+#define MONITOR_CACHE_SHARDS	16	/* must be a power of 2 */
+
+typedef struct monitor_cache_shard_t {
+	Avlnode			*mcs_tree;
+	ldap_pvt_thread_mutex_t	mcs_mutex;
+} monitor_cache_shard_t;
+
 typedef struct monitor_info_t {
 
 	/*
 	 * Internal data
 	 */
-	Avlnode			*mi_cache;
-	ldap_pvt_thread_mutex_t	mi_cache_mutex;
+	monitor_cache_shard_t	mi_cache[MONITOR_CACHE_SHARDS];
 
 	/*
 	 * Config parameters
@@ -131,6 +142,10 @@ typedef struct monitor_info_t {
 	AttributeDescription	*mi_ad_monitorUpdateRef;
 	AttributeDescription	*mi_ad_monitorRuntimeConfig;
 	AttributeDescription	*mi_ad_monitorSuperiorDN;
+	AttributeDescription	*mi_ad_monitorOpWaitTime;
+	AttributeDescription	*mi_ad_monitorOpExecTime;
+	AttributeDescription	*mi_ad_monitorSyncConsumer;
+	AttributeDescription	*mi_ad_monitorSyncSession;
 
 	/*
 	 * Generic description attribute
@@ -39,6 +39,24 @@ typedef struct monitor_cache_t {
 	Entry   		*mc_e;
 } monitor_cache_t;
 
+/*
+ * returns the shard of the cache that holds ndn
+ */
+static monitor_cache_shard_t *
+monitor_cache_shard(
+	monitor_info_t	*mi,
+	struct berval	*ndn )
+{
+	unsigned	h = 0;
+	ber_len_t	i;
+
+	for ( i = 0; i < ndn->bv_len; i++ ) {
+		h = h * 31 + (unsigned char)ndn->bv_val[ i ];
+	}
+
+	return &mi->mi_cache[ h & ( MONITOR_CACHE_SHARDS - 1 ) ];
+}
+
 /*
  * compares entries based on the dn
  */
@@ -82,6 +100,7 @@ monitor_cache_add(
 	Entry		*e )
 {
 	monitor_cache_t	*mc;
+	monitor_cache_shard_t *mcs;
 	monitor_entry_t	*mp;
 	int		rc;
 
@@ -93,10 +112,11 @@ monitor_cache_add(
 	mc = ( monitor_cache_t * )ch_malloc( sizeof( monitor_cache_t ) );
 	mc->mc_ndn = e->e_nname;
 	mc->mc_e = e;
-	ldap_pvt_thread_mutex_lock( &mi->mi_cache_mutex );
-	rc = avl_insert( &mi->mi_cache, ( caddr_t )mc,
+	mcs = monitor_cache_shard( mi, &e->e_nname );
+	ldap_pvt_thread_mutex_lock( &mcs->mcs_mutex );
+	rc = avl_insert( &mcs->mcs_tree, ( caddr_t )mc,
 			monitor_cache_cmp, monitor_cache_dup );
-	ldap_pvt_thread_mutex_unlock( &mi->mi_cache_mutex );
+	ldap_pvt_thread_mutex_unlock( &mcs->mcs_mutex );
 
 	return rc;
 }
@@ -146,6 +166,7 @@ monitor_cache_get(
 	Entry		**ep )
 {
 	monitor_cache_t tmp_mc, *mc;
+	monitor_cache_shard_t *mcs;
 
 	assert( mi != NULL );
 	assert( ndn != NULL );
@@ -154,22 +175,23 @@ monitor_cache_get(
 	*ep = NULL;
 
 	tmp_mc.mc_ndn = *ndn;
+	mcs = monitor_cache_shard( mi, ndn );
 retry:;
-	ldap_pvt_thread_mutex_lock( &mi->mi_cache_mutex );
-	mc = ( monitor_cache_t * )avl_find( mi->mi_cache,
+	ldap_pvt_thread_mutex_lock( &mcs->mcs_mutex );
+	mc = ( monitor_cache_t * )avl_find( mcs->mcs_tree,
 			( caddr_t )&tmp_mc, monitor_cache_cmp );
 
 	if ( mc != NULL ) {
 		/* entry is returned with mutex locked */
 		if ( monitor_cache_trylock( mc->mc_e ) ) {
-			ldap_pvt_thread_mutex_unlock( &mi->mi_cache_mutex );
+			ldap_pvt_thread_mutex_unlock( &mcs->mcs_mutex );
 			ldap_pvt_thread_yield();
 			goto retry;
 		}
 		*ep = mc->mc_e;
 	}
 
-	ldap_pvt_thread_mutex_unlock( &mi->mi_cache_mutex );
+	ldap_pvt_thread_mutex_unlock( &mcs->mcs_mutex );
 
 	return ( *ep == NULL ? -1 : 0 );
 }
@@ -185,6 +207,7 @@ monitor_cache_remove(
 	Entry		**ep )
 {
 	monitor_cache_t tmp_mc, *mc;
+	monitor_cache_shard_t *mcs, *pmcs;
 	struct berval	pndn;
 
 	assert( mi != NULL );
@@ -194,24 +217,37 @@ monitor_cache_remove(
 	*ep = NULL;
 
 	dnParent( ndn, &pndn );
+	mcs = monitor_cache_shard( mi, ndn );
+	pmcs = monitor_cache_shard( mi, &pndn );
 
 retry:;
-	ldap_pvt_thread_mutex_lock( &mi->mi_cache_mutex );
+	ldap_pvt_thread_mutex_lock( &mcs->mcs_mutex );
 
 	tmp_mc.mc_ndn = *ndn;
-	mc = ( monitor_cache_t * )avl_find( mi->mi_cache,
+	mc = ( monitor_cache_t * )avl_find( mcs->mcs_tree,
 			( caddr_t )&tmp_mc, monitor_cache_cmp );
 
 	if ( mc != NULL ) {
 		monitor_cache_t *pmc;
 
 		if ( monitor_cache_trylock( mc->mc_e ) ) {
-			ldap_pvt_thread_mutex_unlock( &mi->mi_cache_mutex );
+			ldap_pvt_thread_mutex_unlock( &mcs->mcs_mutex );
+			goto retry;
+		}
+
+		/* the parent may live in another shard; never wait for
+		 * a second shard while holding one */
+		if ( pmcs != mcs &&
+			ldap_pvt_thread_mutex_trylock( &pmcs->mcs_mutex ) )
+		{
+			monitor_cache_release( mi, mc->mc_e );
+			ldap_pvt_thread_mutex_unlock( &mcs->mcs_mutex );
+			ldap_pvt_thread_yield();
 			goto retry;
 		}
 
 		tmp_mc.mc_ndn = pndn;
-		pmc = ( monitor_cache_t * )avl_find( mi->mi_cache,
+		pmc = ( monitor_cache_t * )avl_find( pmcs->mcs_tree,
 			( caddr_t )&tmp_mc, monitor_cache_cmp );
 		if ( pmc != NULL ) {
 			monitor_entry_t	*mp = (monitor_entry_t *)mc->mc_e->e_private,
@@ -220,7 +256,9 @@ retry:;
 
 			if ( monitor_cache_trylock( pmc->mc_e ) ) {
 				monitor_cache_release( mi, mc->mc_e );
-				ldap_pvt_thread_mutex_unlock( &mi->mi_cache_mutex );
+				if ( pmcs != mcs )
+					ldap_pvt_thread_mutex_unlock( &pmcs->mcs_mutex );
+				ldap_pvt_thread_mutex_unlock( &mcs->mcs_mutex );
 				goto retry;
 			}
 
@@ -251,7 +289,7 @@ retry:;
 				monitor_cache_t *tmpmc;
 
 				tmp_mc.mc_ndn = *ndn;
-				tmpmc = avl_delete( &mi->mi_cache,
+				tmpmc = avl_delete( &mcs->mcs_tree,
 					( caddr_t )&tmp_mc, monitor_cache_cmp );
 				assert( tmpmc == mc );
 
@@ -273,9 +311,13 @@ retry:;
 		if ( mc ) {
 			monitor_cache_release( mi, mc->mc_e );
 		}
+
+		if ( pmcs != mcs ) {
+			ldap_pvt_thread_mutex_unlock( &pmcs->mcs_mutex );
+		}
 	}
 
-	ldap_pvt_thread_mutex_unlock( &mi->mi_cache_mutex );
+	ldap_pvt_thread_mutex_unlock( &mcs->mcs_mutex );
 
 	return ( *ep == NULL ? -1 : 0 );
 }
@@ -366,13 +408,15 @@ monitor_cache_release(
 
 	if ( mp->mp_flags & MONITOR_F_VOLATILE ) {
 		monitor_cache_t	*mc, tmp_mc;
+		monitor_cache_shard_t *mcs;
 
 		/* volatile entries do not return to cache */
-		ldap_pvt_thread_mutex_lock( &mi->mi_cache_mutex );
+		mcs = monitor_cache_shard( mi, &e->e_nname );
+		ldap_pvt_thread_mutex_lock( &mcs->mcs_mutex );
 		tmp_mc.mc_ndn = e->e_nname;
-		mc = avl_delete( &mi->mi_cache,
+		mc = avl_delete( &mcs->mcs_tree,
 				( caddr_t )&tmp_mc, monitor_cache_cmp );
-		ldap_pvt_thread_mutex_unlock( &mi->mi_cache_mutex );
+		ldap_pvt_thread_mutex_unlock( &mcs->mcs_mutex );
 		if ( mc != NULL ) {
 			ch_free( mc );
 		}
@@ -432,8 +476,13 @@ int
 monitor_cache_destroy(
 	monitor_info_t	*mi )
 {
-	if ( mi->mi_cache ) {
-		avl_free( mi->mi_cache, monitor_entry_destroy );
+	int	i;
+
+	for ( i = 0; i < MONITOR_CACHE_SHARDS; i++ ) {
+		if ( mi->mi_cache[ i ].mcs_tree ) {
+			avl_free( mi->mi_cache[ i ].mcs_tree, monitor_entry_destroy );
+			mi->mi_cache[ i ].mcs_tree = NULL;
+		}
 	}
 
 	return 0;
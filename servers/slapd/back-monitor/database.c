@@ -39,6 +39,12 @@ monitor_subsys_database_modify(
 	SlapReply	*rs,
 	Entry		*e );
 
+static int
+monitor_subsys_database_update(
+	Operation	*op,
+	SlapReply	*rs,
+	Entry		*e );
+
 static struct restricted_ops_t {
 	struct berval	op;
 	unsigned int	tag;
@@ -107,7 +113,7 @@ monitor_subsys_overlay_init_one(
 	monitor_subsys_t	*ms_overlay,
 	slap_overinst		*on,
 	Entry			*e_database,
-	Entry			**ep_overlay )
+	Entry			***ep_overlay )
 {
 	char			buf[ BACKMONITOR_BUFSIZE ];
 	int			j, o;
@@ -188,8 +194,8 @@ monitor_subsys_overlay_init_one(
 		return -1;
 	}
 
-	*ep_overlay = e_overlay;
-	ep_overlay = &mp_overlay->mp_next;
+	**ep_overlay = e_overlay;
+	*ep_overlay = &mp_overlay->mp_next;
 
 	return 0;
 }
@@ -365,7 +371,7 @@ monitor_subsys_database_init_one(
 
 		for ( ; on; on = on->on_next ) {
 			monitor_subsys_overlay_init_one( mi, be,
-				ms, ms_overlay, on, e, ep_overlay );
+				ms, ms_overlay, on, e, &ep_overlay );
 		}
 	}
 
@@ -554,6 +560,7 @@ monitor_subsys_database_init(
 
 	assert( be != NULL );
 
+	ms->mss_update = monitor_subsys_database_update;
 	ms->mss_modify = monitor_subsys_database_modify;
 
 	mi = ( monitor_info_t * )be->be_private;
@@ -670,6 +677,40 @@ value_mask( BerVarray v, slap_mask_t cur, slap_mask_t *delta )
 	return LDAP_SUCCESS;
 }
 
+/* The state of the syncrepl consumers of the database */
+static int
+monitor_subsys_database_update(
+	Operation	*op,
+	SlapReply	*rs,
+	Entry		*e )
+{
+	monitor_info_t	*mi = (monitor_info_t *)op->o_bd->be_private;
+	Backend		*be;
+	BerVarray	vals = NULL;
+	int		n;
+
+	if ( sscanf( e->e_nname.bv_val, "cn=database %d,", &n ) != 1 ) {
+		return SLAP_CB_CONTINUE;
+	}
+
+	LDAP_STAILQ_FOREACH( be, &backendDB, be_next ) {
+		if ( n == 0 ) {
+			break;
+		}
+		n--;
+	}
+
+	attr_delete( &e->e_attrs, mi->mi_ad_monitorSyncConsumer );
+	if ( be != NULL && be->be_syncinfo != NULL &&
+		syncrepl_monitor( be, &vals ) > 0 )
+	{
+		attr_merge_normalize( e, mi->mi_ad_monitorSyncConsumer, vals, NULL );
+		ber_bvarray_free( vals );
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
 static int
 monitor_subsys_database_modify(
 	Operation	*op,
@@ -1979,6 +1979,36 @@ monitor_back_initialize(
 			"NO-USER-MODIFICATION "
 			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
 			offsetof(monitor_info_t, mi_ad_monitorSuperiorDN) },
+		{ "( 1.3.6.1.4.1.4203.666.1.55.31 "
+			"NAME 'monitorOpWaitTime' "
+			"DESC 'percentiles of the time operations waited for a thread' "
+			"SUP monitoredInfo "
+			"SINGLE-VALUE "
+			"NO-USER-MODIFICATION "
+			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
+			offsetof(monitor_info_t, mi_ad_monitorOpWaitTime) },
+		{ "( 1.3.6.1.4.1.4203.666.1.55.32 "
+			"NAME 'monitorOpExecTime' "
+			"DESC 'percentiles of the time operations took to execute' "
+			"SUP monitoredInfo "
+			"SINGLE-VALUE "
+			"NO-USER-MODIFICATION "
+			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
+			offsetof(monitor_info_t, mi_ad_monitorOpExecTime) },
+		{ "( 1.3.6.1.4.1.4203.666.1.55.33 "
+			"NAME 'monitorSyncConsumer' "
+			"DESC 'state and throughput of a syncrepl consumer' "
+			"SUP monitoredInfo "
+			"NO-USER-MODIFICATION "
+			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
+			offsetof(monitor_info_t, mi_ad_monitorSyncConsumer) },
+		{ "( 1.3.6.1.4.1.4203.666.1.55.34 "
+			"NAME 'monitorSyncSession' "
+			"DESC 'queue and send rate of a syncprov persistent search' "
+			"SUP monitoredInfo "
+			"NO-USER-MODIFICATION "
+			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
+			offsetof(monitor_info_t, mi_ad_monitorSyncSession) },
 		{ NULL, 0, -1 }
 	};
 
@@ -2135,7 +2165,7 @@ monitor_back_db_init(
 	BackendDB	*be,
 	ConfigReply	*c)
 {
-	int			rc;
+	int			rc, i;
 	struct berval		dn = BER_BVC( SLAPD_MONITOR_DN ),
 				pdn,
 				ndn;
@@ -2179,7 +2209,9 @@ monitor_back_db_init(
 
 	/* NOTE: only one monitor database is allowed,
 	 * so we use static storage */
-	ldap_pvt_thread_mutex_init( &monitor_info.mi_cache_mutex );
+	for ( i = 0; i < MONITOR_CACHE_SHARDS; i++ ) {
+		ldap_pvt_thread_mutex_init( &monitor_info.mi_cache[i].mcs_mutex );
+	}
 
 	be->be_private = &monitor_info;
 
@@ -2544,6 +2576,7 @@ monitor_back_db_destroy(
 	ConfigReply	*cr)
 {
 	monitor_info_t	*mi = ( monitor_info_t * )be->be_private;
+	int		i;
 
 	if ( mi == NULL ) {
 		return -1;
@@ -2582,7 +2615,9 @@ monitor_back_db_destroy(
 		}
 	}
 	
-	ldap_pvt_thread_mutex_destroy( &monitor_info.mi_cache_mutex );
+	for ( i = 0; i < MONITOR_CACHE_SHARDS; i++ ) {
+		ldap_pvt_thread_mutex_destroy( &monitor_info.mi_cache[i].mcs_mutex );
+	}
 
 	be->be_private = NULL;
 
@@ -45,6 +45,14 @@ struct monitor_ops_t {
 	{ BER_BVNULL,			BER_BVNULL }
 };
 
+static struct monitor_ops_t monitor_slowops = {
+	BER_BVC( "cn=Slow Operations" ),	BER_BVNULL
+}, monitor_profile = {
+	BER_BVC( "cn=Profile" ),	BER_BVNULL
+};
+
+static struct berval bv_nolatency = BER_BVC( "p50=0 p90=0 p99=0 p999=0" );
+
 static int
 monitor_subsys_ops_destroy(
 	BackendDB		*be,
@@ -88,6 +96,8 @@ monitor_subsys_ops_init(
 
 	attr_merge_one( e_op, mi->mi_ad_monitorOpInitiated, &bv_zero, NULL );
 	attr_merge_one( e_op, mi->mi_ad_monitorOpCompleted, &bv_zero, NULL );
+	attr_merge_one( e_op, mi->mi_ad_monitorOpWaitTime, &bv_nolatency, NULL );
+	attr_merge_one( e_op, mi->mi_ad_monitorOpExecTime, &bv_nolatency, NULL );
 
 	mp = ( monitor_entry_t * )e_op->e_private;
 	mp->mp_children = NULL;
@@ -116,6 +126,8 @@ monitor_subsys_ops_init(
 		BER_BVSTR( &bv, "0" );
 		attr_merge_one( e, mi->mi_ad_monitorOpInitiated, &bv, NULL );
 		attr_merge_one( e, mi->mi_ad_monitorOpCompleted, &bv, NULL );
+		attr_merge_one( e, mi->mi_ad_monitorOpWaitTime, &bv_nolatency, NULL );
+		attr_merge_one( e, mi->mi_ad_monitorOpExecTime, &bv_nolatency, NULL );
 
 		/* steal normalized RDN */
 		dnRdn( &e->e_nname, &rdn );
@@ -143,6 +155,51 @@ monitor_subsys_ops_init(
 		ep = &mp->mp_next;
 	}
 
+	/*
+	 * Slow operations, see slowop_threshold, and the samples
+	 * taken every profile_interval
+	 */
+	for ( i = 0; i < 2; i++ ) {
+		struct monitor_ops_t	*mo = i ? &monitor_profile : &monitor_slowops;
+		struct berval	rdn;
+		Entry		*e;
+
+		e = monitor_entry_stub( &ms->mss_dn, &ms->mss_ndn, &mo->rdn,
+			mi->mi_oc_monitoredObject, NULL, NULL );
+		if ( e == NULL ) {
+			Debug( LDAP_DEBUG_ANY,
+				"monitor_subsys_ops_init: "
+				"unable to create entry \"%s,%s\"\n",
+				mo->rdn.bv_val,
+				ms->mss_ndn.bv_val, 0 );
+			return( -1 );
+		}
+
+		dnRdn( &e->e_nname, &rdn );
+		ber_dupbv( &mo->nrdn, &rdn );
+
+		mp = monitor_entrypriv_create();
+		if ( mp == NULL ) {
+			return -1;
+		}
+		e->e_private = ( void * )mp;
+		mp->mp_info = ms;
+		mp->mp_flags = ms->mss_flags \
+			| MONITOR_F_SUB | MONITOR_F_PERSISTENT;
+
+		if ( monitor_cache_add( mi, e ) ) {
+			Debug( LDAP_DEBUG_ANY,
+				"monitor_subsys_ops_init: "
+				"unable to add entry \"%s,%s\"\n",
+				mo->rdn.bv_val,
+				ms->mss_ndn.bv_val, 0 );
+			return( -1 );
+		}
+
+		*ep = e;
+		ep = &mp->mp_next;
+	}
+
 	monitor_cache_release( mi, e_op );
 
 	return( 0 );
@@ -160,10 +217,85 @@ monitor_subsys_ops_destroy(
 			ch_free( monitor_op[ i ].nrdn.bv_val );
 		}
 	}
+	if ( !BER_BVISNULL( &monitor_slowops.nrdn ) ) {
+		ch_free( monitor_slowops.nrdn.bv_val );
+		BER_BVZERO( &monitor_slowops.nrdn );
+	}
+	if ( !BER_BVISNULL( &monitor_profile.nrdn ) ) {
+		ch_free( monitor_profile.nrdn.bv_val );
+		BER_BVZERO( &monitor_profile.nrdn );
+	}
 
 	return 0;
 }
 
+/* Largest latency in microseconds that falls in a bucket */
+static unsigned long
+monitor_ops_lat_bound( int i )
+{
+	if ( i < 4 )
+		return i;
+	return ( (unsigned long)( 5 + ( i & 3 )) << ( i / 4 - 1 )) - 1;
+}
+
+/* Add up the latency histograms of op type opidx, of all types
+ * if opidx is SLAP_OP_LAST. slap_counters.sc_mutex must be locked.
+ */
+static void
+monitor_ops_lat_sum(
+	slap_counters_t		*sc,
+	int			opidx,
+	unsigned long		hist[SLAP_LAT_LAST][SLAP_LAT_BUCKETS] )
+{
+	int i, j, k;
+
+	for ( i = 0; i < SLAP_OP_LAST; i++ ) {
+		if ( opidx != SLAP_OP_LAST && i != opidx )
+			continue;
+		for ( j = 0; j < SLAP_LAT_LAST; j++ )
+			for ( k = 0; k < SLAP_LAT_BUCKETS; k++ )
+				hist[j][k] += SLAP_COUNTER_GET_UL( sc->sc_ops_latency_[i][j][k] );
+	}
+}
+
+/* Set a to "p50=<usec> p90=<usec> p99=<usec> p999=<usec>" */
+static void
+monitor_ops_lat_set( Attribute *a, unsigned long *hist )
+{
+	static const int permille[] = { 500, 900, 990, 999 };
+	static const char *names[] = { "p50", "p90", "p99", "p999" };
+	unsigned long total = 0, seen = 0, need;
+	struct berval bv;
+	char buf[ 128 ];
+	int i, k, len = 0;
+
+	for ( k = 0; k < SLAP_LAT_BUCKETS; k++ )
+		total += hist[k];
+
+	for ( i = 0, k = 0; i < 4; i++ ) {
+		unsigned long usec = 0;
+
+		if ( total ) {
+			need = ( total * permille[i] + 999 ) / 1000;
+			for ( ; k < SLAP_LAT_BUCKETS; k++ ) {
+				if ( seen + hist[k] >= need )
+					break;
+				seen += hist[k];
+			}
+			usec = monitor_ops_lat_bound( k );
+		}
+		len += snprintf( buf + len, sizeof( buf ) - len, "%s%s=%lu",
+			i ? " " : "", names[i], usec );
+	}
+
+	bv.bv_val = buf;
+	bv.bv_len = len;
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+	if ( a->a_nvals != a->a_vals ) {
+		ber_bvreplace( &a->a_nvals[ 0 ], &bv );
+	}
+}
+
 static int
 monitor_subsys_ops_update(
 	Operation		*op,
@@ -178,6 +310,7 @@ monitor_subsys_ops_update(
 	int 			i;
 	Attribute		*a;
 	slap_counters_t *sc;
+	unsigned long		hist[SLAP_LAT_LAST][SLAP_LAT_BUCKETS] = { { 0 } };
 	static struct berval	bv_ops = BER_BVC( "cn=operations" );
 
 	assert( mi != NULL );
@@ -185,23 +318,47 @@ monitor_subsys_ops_update(
 
 	dnRdn( &e->e_nname, &rdn );
 
+	if ( dn_match( &rdn, &monitor_slowops.nrdn ) ) {
+		BerVarray	vals = NULL;
+
+		attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+		if ( slap_slowop_list( &vals ) ) {
+			attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+			ber_bvarray_free( vals );
+		}
+		return SLAP_CB_CONTINUE;
+	}
+
+	if ( dn_match( &rdn, &monitor_profile.nrdn ) ) {
+		BerVarray	vals = NULL;
+
+		attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+		if ( slap_profile_list( &vals ) ) {
+			attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+			ber_bvarray_free( vals );
+		}
+		return SLAP_CB_CONTINUE;
+	}
+
 	if ( dn_match( &rdn, &bv_ops ) ) {
 		ldap_pvt_mp_init( nInitiated );
 		ldap_pvt_mp_init( nCompleted );
 
 		ldap_pvt_thread_mutex_lock( &slap_counters.sc_mutex );
 		for ( i = 0; i < SLAP_OP_LAST; i++ ) {
-			ldap_pvt_mp_add( nInitiated, slap_counters.sc_ops_initiated_[ i ] );
-			ldap_pvt_mp_add( nCompleted, slap_counters.sc_ops_completed_[ i ] );
+			ldap_pvt_mp_add( nInitiated, SLAP_COUNTER_GET( slap_counters.sc_ops_initiated_[ i ] ));
+			ldap_pvt_mp_add( nCompleted, SLAP_COUNTER_GET( slap_counters.sc_ops_completed_[ i ] ));
 		}
 		for ( sc = slap_counters.sc_next; sc; sc = sc->sc_next ) {
-			ldap_pvt_thread_mutex_lock( &sc->sc_mutex );
+			SLAP_COUNTERS_LOCK( sc );
 			for ( i = 0; i < SLAP_OP_LAST; i++ ) {
-				ldap_pvt_mp_add( nInitiated, sc->sc_ops_initiated_[ i ] );
-				ldap_pvt_mp_add( nCompleted, sc->sc_ops_completed_[ i ] );
+				ldap_pvt_mp_add( nInitiated, SLAP_COUNTER_GET( sc->sc_ops_initiated_[ i ] ));
+				ldap_pvt_mp_add( nCompleted, SLAP_COUNTER_GET( sc->sc_ops_completed_[ i ] ));
 			}
-			ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
+			monitor_ops_lat_sum( sc, SLAP_OP_LAST, hist );
+			SLAP_COUNTERS_UNLOCK( sc );
 		}
+		monitor_ops_lat_sum( &slap_counters, SLAP_OP_LAST, hist );
 		ldap_pvt_thread_mutex_unlock( &slap_counters.sc_mutex );
 		
 	} else {
@@ -209,14 +366,16 @@ monitor_subsys_ops_update(
 			if ( dn_match( &rdn, &monitor_op[ i ].nrdn ) )
 			{
 				ldap_pvt_thread_mutex_lock( &slap_counters.sc_mutex );
-				ldap_pvt_mp_init_set( nInitiated, slap_counters.sc_ops_initiated_[ i ] );
-				ldap_pvt_mp_init_set( nCompleted, slap_counters.sc_ops_completed_[ i ] );
+				ldap_pvt_mp_init_set( nInitiated, SLAP_COUNTER_GET( slap_counters.sc_ops_initiated_[ i ] ));
+				ldap_pvt_mp_init_set( nCompleted, SLAP_COUNTER_GET( slap_counters.sc_ops_completed_[ i ] ));
 				for ( sc = slap_counters.sc_next; sc; sc = sc->sc_next ) {
-					ldap_pvt_thread_mutex_lock( &sc->sc_mutex );
-					ldap_pvt_mp_add( nInitiated, sc->sc_ops_initiated_[ i ] );
-					ldap_pvt_mp_add( nCompleted, sc->sc_ops_completed_[ i ] );
-					ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
+					SLAP_COUNTERS_LOCK( sc );
+					ldap_pvt_mp_add( nInitiated, SLAP_COUNTER_GET( sc->sc_ops_initiated_[ i ] ));
+					ldap_pvt_mp_add( nCompleted, SLAP_COUNTER_GET( sc->sc_ops_completed_[ i ] ));
+					monitor_ops_lat_sum( sc, i, hist );
+					SLAP_COUNTERS_UNLOCK( sc );
 				}
+				monitor_ops_lat_sum( &slap_counters, i, hist );
 				ldap_pvt_thread_mutex_unlock( &slap_counters.sc_mutex );
 				break;
 			}
@@ -242,6 +401,14 @@ monitor_subsys_ops_update(
 	UI2BV( &a->a_vals[ 0 ], nCompleted );
 	ldap_pvt_mp_clear( nCompleted );
 
+	a = attr_find( e->e_attrs, mi->mi_ad_monitorOpWaitTime );
+	if ( a != NULL )
+		monitor_ops_lat_set( a, hist[SLAP_LAT_WAIT] );
+
+	a = attr_find( e->e_attrs, mi->mi_ad_monitorOpExecTime );
+	if ( a != NULL )
+		monitor_ops_lat_set( a, hist[SLAP_LAT_EXEC] );
+
 	/* FIXME: touch modifyTimestamp? */
 
 	return SLAP_CB_CONTINUE;
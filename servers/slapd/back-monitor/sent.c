@@ -187,38 +187,38 @@ monitor_subsys_sent_update(
 	ldap_pvt_thread_mutex_lock(&slap_counters.sc_mutex);
 	switch ( i ) {
 	case MONITOR_SENT_ENTRIES:
-		ldap_pvt_mp_init_set( n, slap_counters.sc_entries );
+		ldap_pvt_mp_init_set( n, SLAP_COUNTER_GET( slap_counters.sc_entries ));
 		for ( sc = slap_counters.sc_next; sc; sc = sc->sc_next ) {
-			ldap_pvt_thread_mutex_lock( &sc->sc_mutex );
-			ldap_pvt_mp_add( n, sc->sc_entries );
-			ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
+			SLAP_COUNTERS_LOCK( sc );
+			ldap_pvt_mp_add( n, SLAP_COUNTER_GET( sc->sc_entries ));
+			SLAP_COUNTERS_UNLOCK( sc );
 		}
 		break;
 
 	case MONITOR_SENT_REFERRALS:
-		ldap_pvt_mp_init_set( n, slap_counters.sc_refs );
+		ldap_pvt_mp_init_set( n, SLAP_COUNTER_GET( slap_counters.sc_refs ));
 		for ( sc = slap_counters.sc_next; sc; sc = sc->sc_next ) {
-			ldap_pvt_thread_mutex_lock( &sc->sc_mutex );
-			ldap_pvt_mp_add( n, sc->sc_refs );
-			ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
+			SLAP_COUNTERS_LOCK( sc );
+			ldap_pvt_mp_add( n, SLAP_COUNTER_GET( sc->sc_refs ));
+			SLAP_COUNTERS_UNLOCK( sc );
 		}
 		break;
 
 	case MONITOR_SENT_PDU:
-		ldap_pvt_mp_init_set( n, slap_counters.sc_pdu );
+		ldap_pvt_mp_init_set( n, SLAP_COUNTER_GET( slap_counters.sc_pdu ));
 		for ( sc = slap_counters.sc_next; sc; sc = sc->sc_next ) {
-			ldap_pvt_thread_mutex_lock( &sc->sc_mutex );
-			ldap_pvt_mp_add( n, sc->sc_pdu );
-			ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
+			SLAP_COUNTERS_LOCK( sc );
+			ldap_pvt_mp_add( n, SLAP_COUNTER_GET( sc->sc_pdu ));
+			SLAP_COUNTERS_UNLOCK( sc );
 		}
 		break;
 
 	case MONITOR_SENT_BYTES:
-		ldap_pvt_mp_init_set( n, slap_counters.sc_bytes );
+		ldap_pvt_mp_init_set( n, SLAP_COUNTER_GET( slap_counters.sc_bytes ));
 		for ( sc = slap_counters.sc_next; sc; sc = sc->sc_next ) {
-			ldap_pvt_thread_mutex_lock( &sc->sc_mutex );
-			ldap_pvt_mp_add( n, sc->sc_bytes );
-			ldap_pvt_thread_mutex_unlock( &sc->sc_mutex );
+			SLAP_COUNTERS_LOCK( sc );
+			ldap_pvt_mp_add( n, SLAP_COUNTER_GET( sc->sc_bytes ));
+			SLAP_COUNTERS_UNLOCK( sc );
 		}
 		break;
 
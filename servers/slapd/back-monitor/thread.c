@@ -34,6 +34,12 @@ typedef enum {
 	MT_UNKNOWN,
 	MT_RUNQUEUE,
 	MT_TASKLIST,
+	MT_SLAB,
+	MT_DNCACHE,
+	MT_READCACHE,
+	MT_QUEUES,
+	MT_PAUSES,
+	MT_TASKS,
 
 	MT_LAST
 } monitor_thread_t;
@@ -66,6 +72,9 @@ static struct {
 	{ BER_BVC( "cn=Backload" ),	
 		BER_BVC("Number of active plus pending threads"),
 		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_BACKLOAD,	MT_UNKNOWN },
+	{ BER_BVC( "cn=Steals" ),
+		BER_BVC("Number of tasks taken from another work queue"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_STEALS,	MT_UNKNOWN },
 #if 0	/* not meaningful right now */
 	{ BER_BVC( "cn=Active Max" ),
 		BER_BVNULL,
@@ -87,6 +96,24 @@ static struct {
 	{ BER_BVC( "cn=Tasklist" ),
 		BER_BVC("List of running plus standby threads - besides those handling operations"),
 		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_TASKLIST },
+	{ BER_BVC( "cn=Slab" ),
+		BER_BVC("Operations that outgrew their thread's slab memory"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_SLAB },
+	{ BER_BVC( "cn=DN Cache" ),
+		BER_BVC("Lookups in the shared pretty/normalized DN cache"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_DNCACHE },
+	{ BER_BVC( "cn=Read Cache" ),
+		BER_BVC("Base scope reads answered from the shared read cache"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_READCACHE },
+	{ BER_BVC( "cn=Queues" ),
+		BER_BVC("Statistics of each work queue of the thread pool"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_QUEUES },
+	{ BER_BVC( "cn=Pauses" ),
+		BER_BVC("Completed thread pool pauses and their total duration"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_PAUSES },
+	{ BER_BVC( "cn=Tasks" ),
+		BER_BVC("Tasks submitted to the thread pool, by type"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_TASKS },
 
 	{ BER_BVNULL }
 };
@@ -216,6 +243,49 @@ monitor_subsys_thread_init(
 }
 
 #ifndef NO_THREADS
+/*
+ * "{q}open=.. active=.. ... waitP50=<usec> ..." for work queue q;
+ * a wait percentile is the upper bound of the histogram bucket it
+ * falls in, or ">" the lower bound of the last one
+ */
+static void
+monitor_thread_queue_val( BerVarray *vals, int q,
+	ldap_pvt_thread_pool_stats_t *st )
+{
+	static const int	pct[] = { 500, 900, 990, 999 };
+	static const char	*names[] = { "P50", "P90", "P99", "P999" };
+	char			buf[ BACKMONITOR_BUFSIZE ];
+	struct berval		bv;
+	unsigned long		total = 0, sum, want, bound;
+	int			i, b, last = LDAP_PVT_THREAD_POOL_WAIT_BUCKETS - 1;
+
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ),
+		"{%d}open=%d active=%d pending=%d pendingMax=%d submitted=%lu "
+		"prio=%lu steals=%lu starved=%lu",
+		q, st->lps_open, st->lps_active, st->lps_pending,
+		st->lps_pending_max, st->lps_submitted, st->lps_prio,
+		st->lps_steals, st->lps_starved );
+
+	for ( b = 0; b <= last; b++ )
+		total += st->lps_wait[ b ];
+
+	for ( i = 0; i < 4 && bv.bv_len < sizeof( buf ); i++ ) {
+		want = total - total * ( 1000 - pct[ i ] ) / 1000;
+		for ( b = 0, sum = 0; b < last; b++ ) {
+			sum += st->lps_wait[ b ];
+			if ( sum >= want )
+				break;
+		}
+		bound = total ? 16UL << ( 2 * ( b < last ? b : last - 1 )) : 0;
+		bv.bv_len += snprintf( buf + bv.bv_len, sizeof( buf ) - bv.bv_len,
+			" wait%s=%s%lu", names[ i ],
+			total && b == last ? ">" : "", bound );
+	}
+	if ( bv.bv_len < sizeof( buf ) )
+		value_add_one( vals, &bv );
+}
+
 static int 
 monitor_subsys_thread_update( 
 	Operation		*op,
@@ -300,8 +370,12 @@ monitor_subsys_thread_update(
 			bv.bv_val = buf;
 			ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
 			LDAP_STAILQ_FOREACH( re, &slapd_rq.task_list, tnext ) {
-				bv.bv_len = snprintf( buf, sizeof( buf ), "{%d}%s(%s)",
-					i, re->tname, re->tspec );
+				bv.bv_len = snprintf( buf, sizeof( buf ),
+					"{%d}%s(%s) next=%ld runs=%lu usec=%lu maxUsec=%lu "
+					"late=%ld maxLate=%ld",
+					i, re->tname, re->tspec, (long)re->next_sched.tv_sec,
+					re->runs, re->run_usec, re->max_usec,
+					(long)re->late, (long)re->max_late );
 				if ( bv.bv_len < sizeof( buf ) ) {
 					value_add_one( &vals, &bv );
 				}
@@ -318,6 +392,118 @@ monitor_subsys_thread_update(
 			}
 			break;
 
+		case MT_SLAB: {
+			unsigned long st[5];
+			static const char *names[] = {
+				"overflows", "fallbacks", "fallbackBytes", "grows",
+				"inUse" };
+
+			slap_sl_mem_stats( &st[0], &st[1], &st[2], &st[3], &st[4] );
+			bv.bv_val = buf;
+			for ( i = 0; i < 5; i++ ) {
+				bv.bv_len = snprintf( buf, sizeof( buf ), "%s=%lu",
+					names[i], st[i] );
+				value_add_one( &vals, &bv );
+			}
+			attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+			attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+			ber_bvarray_free( vals );
+			} break;
+
+		case MT_DNCACHE: {
+			unsigned long st[2];
+			static const char *names[] = { "hits", "misses" };
+
+			slap_dn_cache_stats( &st[0], &st[1] );
+			bv.bv_val = buf;
+			for ( i = 0; i < 2; i++ ) {
+				bv.bv_len = snprintf( buf, sizeof( buf ), "%s=%lu",
+					names[i], st[i] );
+				value_add_one( &vals, &bv );
+			}
+			attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+			attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+			ber_bvarray_free( vals );
+			} break;
+
+		case MT_READCACHE: {
+			unsigned long st[2];
+			static const char *names[] = { "hits", "misses" };
+
+			slap_read_cache_stats( &st[0], &st[1] );
+			bv.bv_val = buf;
+			for ( i = 0; i < 2; i++ ) {
+				bv.bv_len = snprintf( buf, sizeof( buf ), "%s=%lu",
+					names[i], st[i] );
+				value_add_one( &vals, &bv );
+			}
+			attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+			attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+			ber_bvarray_free( vals );
+			} break;
+
+		case MT_QUEUES: {
+			ldap_pvt_thread_pool_stats_t st;
+
+			for ( i = 0; ldap_pvt_thread_pool_stats( &connection_pool,
+				i, &st ) == 0; i++ )
+			{
+				monitor_thread_queue_val( &vals, i, &st );
+			}
+			attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+			if ( vals ) {
+				attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+				ber_bvarray_free( vals );
+			}
+			} break;
+
+		case MT_PAUSES: {
+			ldap_pvt_thread_pool_stats_t st;
+
+			if ( ldap_pvt_thread_pool_stats( &connection_pool, -1, &st ) )
+				break;
+			bv.bv_val = buf;
+			bv.bv_len = snprintf( buf, sizeof( buf ), "count=%lu",
+				st.lps_pauses );
+			value_add_one( &vals, &bv );
+			bv.bv_len = snprintf( buf, sizeof( buf ), "msec=%lu",
+				st.lps_pause_msec );
+			value_add_one( &vals, &bv );
+			attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+			attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+			ber_bvarray_free( vals );
+			} break;
+
+		case MT_TASKS: {
+			ldap_pvt_thread_pool_stats_t st;
+			unsigned long runs, late;
+
+			if ( ldap_pvt_thread_pool_stats( &connection_pool, -1, &st ) )
+				break;
+			ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+			runs = slapd_rq.rq_runs;
+			late = slapd_rq.rq_late;
+			ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+			/* operations are counted in cn=Operations */
+			bv.bv_val = buf;
+			bv.bv_len = snprintf( buf, sizeof( buf ), "total=%lu",
+				st.lps_submitted );
+			value_add_one( &vals, &bv );
+			bv.bv_len = snprintf( buf, sizeof( buf ), "priority=%lu",
+				st.lps_prio );
+			value_add_one( &vals, &bv );
+			bv.bv_len = snprintf( buf, sizeof( buf ), "runqueue=%lu",
+				runs );
+			value_add_one( &vals, &bv );
+			bv.bv_len = snprintf( buf, sizeof( buf ), "runqueueLate=%lu",
+				late );
+			value_add_one( &vals, &bv );
+			attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+			attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+			ber_bvarray_free( vals );
+			} break;
+
 		default:
 			assert( 0 );
 		}
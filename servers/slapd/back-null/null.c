@@ -25,14 +25,33 @@
 
 #include "slap.h"
 #include "config.h"
+#include "lutil.h"
+
+typedef struct null_synthattr {
+	struct null_synthattr *ns_next;
+	AttributeDescription *ns_ad;
+	int ns_nvals;
+	int ns_size;
+} null_synthattr;
 
 typedef struct null_info {
 	int	ni_bind_allowed;
 	int ni_dosearch;
 	ID	ni_nextid;
 	Entry *ni_entry;
+
+	/* synthetic entries returned by subtree/onelevel searches */
+	int ni_nsynth;
+	null_synthattr *ni_synthattrs;
+	Entry *ni_synth;
 } null_info;
 
+static ConfigDriver null_cf_gen;
+
+enum {
+	NULL_SYNTHATTR = 1
+};
+
 static ConfigTable nullcfg[] = {
 	{ "bind", "true|FALSE", 1, 2, 0, ARG_ON_OFF|ARG_OFFSET,
 		(void *)offsetof(null_info, ni_bind_allowed),
@@ -44,6 +63,17 @@ static ConfigTable nullcfg[] = {
 		"( OLcfgDbAt:8.2 NAME 'olcDbDoSearch' "
 		"DESC 'Return an entry on searches' "
 		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "synthentries", "count", 2, 2, 0, ARG_INT|ARG_OFFSET,
+		(void *)offsetof(null_info, ni_nsynth),
+		"( OLcfgDbAt:8.3 NAME 'olcDbSynthEntries' "
+		"DESC 'Number of synthetic entries to return on searches' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "synthattr", "attr> <nvals> <size", 4, 4, 0, ARG_MAGIC|NULL_SYNTHATTR,
+		null_cf_gen,
+		"( OLcfgDbAt:8.4 NAME 'olcDbSynthAttr' "
+		"DESC 'Attribute of the synthetic entries' "
+		"EQUALITY caseIgnoreMatch "
+		"SYNTAX OMsDirectoryString X-ORDERED 'VALUES' )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED,
 		NULL, NULL, NULL, NULL }
 };
@@ -53,11 +83,152 @@ static ConfigOCs nullocs[] = {
 		"NAME 'olcNullConfig' "
 		"DESC 'Null backend configuration' "
 		"SUP olcDatabaseConfig "
-		"MAY ( olcDbBindAllowed $ olcDbDoSearch ) )",
+		"MAY ( olcDbBindAllowed $ olcDbDoSearch $ "
+		"olcDbSynthEntries $ olcDbSynthAttr ) )",
 		Cft_Database, nullcfg },
 	{ NULL, 0, NULL }
 };
 
+/* Build the template all synthetic entries share. Values are
+ * deterministic so that runs can be compared. */
+static void
+null_synth_build( null_info *ni )
+{
+	null_synthattr *ns;
+	struct berval bv;
+	Entry *e;
+	int i, j, k;
+
+	if ( ni->ni_synth ) {
+		entry_free( ni->ni_synth );
+		ni->ni_synth = NULL;
+	}
+
+	e = entry_alloc();
+	ber_str2bv( "extensibleObject", 0, 0, &bv );
+	attr_merge_one( e, slap_schema.si_ad_objectClass, &bv, NULL );
+
+	for ( ns = ni->ni_synthattrs, k = 0; ns; ns = ns->ns_next, k++ ) {
+		bv.bv_len = ns->ns_size;
+		bv.bv_val = ch_malloc( bv.bv_len + 1 );
+		for ( j = 0; j < ns->ns_nvals; j++ ) {
+			for ( i = 0; i < ns->ns_size; i++ ) {
+				bv.bv_val[i] = 'a' + ( k * 7 + j * 3 + i ) % 26;
+			}
+			bv.bv_val[i] = '\0';
+			attr_merge_normalize_one( e, ns->ns_ad, &bv, NULL );
+		}
+		ch_free( bv.bv_val );
+	}
+	ni->ni_synth = e;
+}
+
+static int
+null_synth_cleanup( ConfigArgs *c )
+{
+	null_info *ni = (null_info *) c->be->be_private;
+
+	/* rebuild if the database is already running */
+	if ( ni->ni_synth ) {
+		null_synth_build( ni );
+	}
+	return 0;
+}
+
+static int
+null_cf_gen( ConfigArgs *c )
+{
+	null_info *ni = (null_info *) c->be->be_private;
+	null_synthattr *ns, **nsp;
+	char buf[SLAP_TEXT_BUFLEN];
+	struct berval bv;
+	const char *text;
+	int i, rc = 0;
+
+	if ( c->op == SLAP_CONFIG_EMIT ) {
+		switch ( c->type ) {
+		case NULL_SYNTHATTR:
+			for ( ns = ni->ni_synthattrs, i = 0; ns; ns = ns->ns_next, i++ ) {
+				bv.bv_len = snprintf( buf, sizeof( buf ), SLAP_X_ORDERED_FMT "%s %d %d",
+					i, ns->ns_ad->ad_cname.bv_val, ns->ns_nvals, ns->ns_size );
+				bv.bv_val = buf;
+				value_add_one( &c->rvalue_vals, &bv );
+			}
+			if ( !ni->ni_synthattrs )
+				rc = 1;
+			break;
+		}
+		return rc;
+
+	} else if ( c->op == LDAP_MOD_DELETE ) {
+		switch ( c->type ) {
+		case NULL_SYNTHATTR:
+			for ( nsp = &ni->ni_synthattrs, i = 0; *nsp; i++ ) {
+				ns = *nsp;
+				if ( c->valx < 0 || c->valx == i ) {
+					*nsp = ns->ns_next;
+					ch_free( ns );
+				} else {
+					nsp = &ns->ns_next;
+				}
+			}
+			c->cleanup = null_synth_cleanup;
+			break;
+		}
+		return rc;
+	}
+
+	switch ( c->type ) {
+	case NULL_SYNTHATTR: {
+		AttributeDescription *ad = NULL;
+		int nvals, size;
+
+		if ( slap_str2ad( c->argv[1], &ad, &text ) != LDAP_SUCCESS ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"<%s> unknown attribute \"%s\": %s",
+				c->argv[0], c->argv[1], text );
+			Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		if ( lutil_atoi( &nvals, c->argv[2] ) != 0 || nvals < 1 ||
+			lutil_atoi( &size, c->argv[3] ) != 0 || size < 1 )
+		{
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"<%s> invalid value count or size",
+				c->argv[0] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		/* the generated values are plain letters */
+		bv.bv_val = "abc";
+		bv.bv_len = 3;
+		if ( is_at_operational( ad->ad_type ) ||
+			ad == slap_schema.si_ad_cn ||
+			ad == slap_schema.si_ad_objectClass ||
+			ad->ad_type->sat_syntax->ssyn_validate( ad->ad_type->sat_syntax, &bv ))
+		{
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"<%s> attribute \"%s\" cannot hold generated values",
+				c->argv[0], c->argv[1] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+
+		ns = ch_malloc( sizeof( null_synthattr ) );
+		ns->ns_ad = ad;
+		ns->ns_nvals = nvals;
+		ns->ns_size = size;
+		for ( nsp = &ni->ni_synthattrs, i = 0; *nsp; nsp = &(*nsp)->ns_next, i++ ) {
+			if ( c->valx == i )
+				break;
+		}
+		ns->ns_next = *nsp;
+		*nsp = ns;
+		c->cleanup = null_synth_cleanup;
+		} break;
+	}
+	return rc;
+}
 
 static int
 null_back_db_open( BackendDB *be, ConfigReply *cr )
@@ -68,6 +239,8 @@ null_back_db_open( BackendDB *be, ConfigReply *cr )
 	const char *text;
 	Entry *e;
 
+	null_synth_build( ni );
+
 	if ( ni->ni_dosearch ) {
 		e = entry_alloc();
 		e->e_name = be->be_suffix[0];
@@ -279,10 +452,75 @@ null_back_false( Operation *op, SlapReply *rs )
 	return null_back_respond( op, rs, LDAP_COMPARE_FALSE );
 }
 
+/* Send ni_nsynth children of the suffix built from the template, so
+ * the frontend's filter, ACL and encoding paths can be measured
+ * without any storage behind them. */
+static int
+null_back_synth( Operation *op, SlapReply *rs )
+{
+	struct null_info *ni = (struct null_info *) op->o_bd->be_private;
+	struct berval *suffix = &op->o_bd->be_suffix[0],
+		*nsuffix = &op->o_bd->be_nsuffix[0];
+	struct berval vals[2];
+	Attribute rdn = { 0 };
+	Entry e = { 0 };
+	char *dn, *ndn;
+	int i, len;
+
+	len = STRLENOF( "cn=synth4294967295," );
+	dn = op->o_tmpalloc( len + suffix->bv_len + 1, op->o_tmpmemctx );
+	ndn = op->o_tmpalloc( len + nsuffix->bv_len + 1, op->o_tmpmemctx );
+
+	BER_BVZERO( &vals[1] );
+	rdn.a_desc = slap_schema.si_ad_cn;
+	rdn.a_vals = vals;
+	rdn.a_nvals = vals;
+	rdn.a_numvals = 1;
+	rdn.a_next = ni->ni_synth->e_attrs;
+
+	rs->sr_err = LDAP_SUCCESS;
+	for ( i = 0; i < ni->ni_nsynth; i++ ) {
+		if ( op->o_abandon ) {
+			rs->sr_err = SLAPD_ABANDON;
+			break;
+		}
+
+		e.e_id = i + 1;
+		e.e_ocflags = 0;
+		e.e_attrs = &rdn;
+		e.e_name.bv_val = dn;
+		e.e_name.bv_len = sprintf( dn, "cn=synth%d,%s", i, suffix->bv_val );
+		e.e_nname.bv_val = ndn;
+		e.e_nname.bv_len = sprintf( ndn, "cn=synth%d,%s", i, nsuffix->bv_val );
+		vals[0].bv_val = ndn + STRLENOF( "cn=" );
+		vals[0].bv_len = strchr( vals[0].bv_val, ',' ) - vals[0].bv_val;
+
+		if ( test_filter( op, &e, op->ors_filter ) != LDAP_COMPARE_TRUE )
+			continue;
+
+		rs->sr_entry = &e;
+		rs->sr_flags = 0;
+		rs->sr_attrs = op->ors_attrs;
+		rs->sr_operational_attrs = NULL;
+		rs->sr_err = send_search_entry( op, rs );
+		rs->sr_entry = NULL;
+		rs->sr_attrs = NULL;
+		if ( rs->sr_err == LDAP_UNAVAILABLE ||
+			rs->sr_err == LDAP_SIZELIMIT_EXCEEDED )
+			break;
+		rs->sr_err = LDAP_SUCCESS;
+	}
+
+	op->o_tmpfree( ndn, op->o_tmpmemctx );
+	op->o_tmpfree( dn, op->o_tmpmemctx );
+	return rs->sr_err;
+}
+
 static int
 null_back_search( Operation *op, SlapReply *rs )
 {
 	struct null_info *ni = (struct null_info *) op->o_bd->be_private;
+	int rc = LDAP_SUCCESS;
 
 	if ( ni->ni_entry ) {
 		rs->sr_entry = ni->ni_entry;
@@ -292,7 +530,17 @@ null_back_search( Operation *op, SlapReply *rs )
 		rs->sr_operational_attrs = NULL;
 		send_search_entry( op, rs );
 	}
-	return null_back_respond( op, rs, LDAP_SUCCESS );
+
+	if ( ni->ni_nsynth > 0 && op->ors_scope != LDAP_SCOPE_BASE &&
+		dn_match( &op->o_req_ndn, &op->o_bd->be_nsuffix[0] ))
+	{
+		rc = null_back_synth( op, rs );
+		if ( rc == SLAPD_ABANDON )
+			return rc;
+		if ( rc == LDAP_UNAVAILABLE )
+			return rs->sr_err = LDAP_OTHER;
+	}
+	return null_back_respond( op, rs, rc );
 }
 
 /* for overlays */
@@ -388,6 +636,15 @@ null_back_db_destroy( Backend *be, ConfigReply *cr )
 		entry_free( ni->ni_entry );
 		ni->ni_entry = NULL;
 	}
+	if ( ni->ni_synth ) {
+		entry_free( ni->ni_synth );
+		ni->ni_synth = NULL;
+	}
+	while ( ni->ni_synthattrs ) {
+		null_synthattr *ns = ni->ni_synthattrs;
+		ni->ni_synthattrs = ns->ns_next;
+		ch_free( ns );
+	}
 	free( be->be_private );
 	return 0;
 }
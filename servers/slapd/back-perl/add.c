@@ -23,19 +23,22 @@ perl_back_add(
 	SlapReply	*rs )
 {
 	PerlBackend *perl_back = (PerlBackend *) op->o_bd->be_private;
+	PerlInterp *pi;
 	int len;
 	int count;
 
-	PERL_SET_CONTEXT( PERL_INTERPRETER );
-	ldap_pvt_thread_mutex_lock( &perl_interpreter_mutex );
-	ldap_pvt_thread_mutex_lock( &entry2str_mutex );
+	pi = perl_back_interp_get( perl_back );
 
 	{
+		dTHXa( pi->pi_perl );
 		dSP; ENTER; SAVETMPS;
 
 		PUSHMARK(sp);
-		XPUSHs( perl_back->pb_obj_ref );
+		XPUSHs( pi->pi_obj_ref );
+		/* newSVpv copies entry2str's shared buffer */
+		ldap_pvt_thread_mutex_lock( &entry2str_mutex );
 		XPUSHs(sv_2mortal(newSVpv( entry2str( op->ora_e, &len ), 0 )));
+		ldap_pvt_thread_mutex_unlock( &entry2str_mutex );
 
 		PUTBACK;
 
@@ -52,8 +55,7 @@ perl_back_add(
 		PUTBACK; FREETMPS; LEAVE;
 	}
 
-	ldap_pvt_thread_mutex_unlock( &entry2str_mutex );
-	ldap_pvt_thread_mutex_unlock( &perl_interpreter_mutex );	
+	perl_back_interp_release( perl_back, pi );
 
 	send_ldap_result( op, rs );
 
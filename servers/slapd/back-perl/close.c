@@ -40,6 +40,30 @@ perl_back_close(
 	return 0;
 }
 
+int
+perl_back_db_close(
+	BackendDB *be,
+	ConfigReply *cr
+)
+{
+	PerlBackend *pb = be->be_private;
+	int i;
+
+	if ( !pb->pb_interps )
+		return 0;
+
+	for ( i = 0; i < pb->pb_ninterps; i++ ) {
+		PERL_SET_CONTEXT( pb->pb_interps[i].pi_perl );
+		perl_destruct( pb->pb_interps[i].pi_perl );
+		perl_free( pb->pb_interps[i].pi_perl );
+	}
+	PERL_SET_CONTEXT( PERL_INTERPRETER );
+	ch_free( pb->pb_interps );
+	pb->pb_interps = NULL;
+
+	return 0;
+}
+
 int
 perl_back_db_destroy(
 	BackendDB *be,
@@ -51,6 +75,8 @@ perl_back_db_destroy(
 	ch_free( pb->pb_module_name );
 	ber_bvarray_free( pb->pb_module_path );
 	ber_bvarray_free( pb->pb_module_config );
+	ldap_pvt_thread_cond_destroy( &pb->pb_pool_cond );
+	ldap_pvt_thread_mutex_destroy( &pb->pb_pool_mutex );
 
 	free( be->be_private );
 	be->be_private = NULL;
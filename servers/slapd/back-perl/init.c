@@ -57,7 +57,7 @@ perl_back_initialize(
 	bi->bi_db_init = perl_back_db_init;
 	bi->bi_db_config = perl_back_db_config;
 	bi->bi_db_open = perl_back_db_open;
-	bi->bi_db_close = 0;
+	bi->bi_db_close = perl_back_db_close;
 	bi->bi_db_destroy = perl_back_db_destroy;
 
 	bi->bi_op_bind = perl_back_bind;
@@ -111,6 +111,9 @@ perl_back_db_init(
 	memset( be->be_private, '\0', sizeof(PerlBackend));
 
 	((PerlBackend *)be->be_private)->pb_filter_search_results = 0;
+	((PerlBackend *)be->be_private)->pb_ninterps = 1;
+	ldap_pvt_thread_mutex_init( &((PerlBackend *)be->be_private)->pb_pool_mutex );
+	ldap_pvt_thread_cond_init( &((PerlBackend *)be->be_private)->pb_pool_cond );
 
 	Debug( LDAP_DEBUG_TRACE, "perl backend db init\n", 0, 0, 0 );
 
@@ -153,11 +156,95 @@ perl_back_db_open(
 		PUTBACK; FREETMPS; LEAVE;
 	}
 
+	if ( return_code == 0 && perl_back->pb_ninterps > 1 ) {
+#ifdef USE_ITHREADS
+		int i;
+
+		/* Clone only now, so each copy has the module configured
+		 * and initialized exactly like the original. perl_clone
+		 * only copies what Perl code can reach, so park the object
+		 * in a package variable for the clones to pick it up.
+		 */
+		sv_setsv( get_sv( PERL_BACK_OBJ_VAR, GV_ADD ), perl_back->pb_obj_ref );
+		perl_back->pb_interps = ch_calloc( perl_back->pb_ninterps,
+			sizeof(PerlInterp) );
+		for ( i = 0; i < perl_back->pb_ninterps; i++ ) {
+			PerlInterp *pi = &perl_back->pb_interps[i];
+
+			pi->pi_perl = perl_clone( PERL_INTERPRETER, 0 );
+			{
+				dTHXa( pi->pi_perl );
+				SV *sv;
+
+				PERL_SET_CONTEXT( my_perl );
+				sv = get_sv( PERL_BACK_OBJ_VAR, 0 );
+				pi->pi_obj_ref = newSVsv( sv );
+				sv_setsv( sv, &PL_sv_undef );
+			}
+		}
+		PERL_SET_CONTEXT( PERL_INTERPRETER );
+		sv_setsv( get_sv( PERL_BACK_OBJ_VAR, 0 ), &PL_sv_undef );
+#else
+		Debug( LDAP_DEBUG_ANY, "perl backend db open: "
+			"perlInterpreters needs a Perl built with ithreads, using 1\n",
+			0, 0, 0 );
+#endif
+	}
+
 	ldap_pvt_thread_mutex_unlock( &perl_interpreter_mutex );
 
 	return return_code;
 }
 
+/* Get an idle interpreter for an operation on this database, waiting
+ * if all are busy, and make it the thread's current one.
+ */
+PerlInterp *
+perl_back_interp_get( PerlBackend *pb )
+{
+	PerlInterp *pi;
+	int i;
+
+	if ( !pb->pb_interps ) {
+		ldap_pvt_thread_mutex_lock( &perl_interpreter_mutex );
+		pi = &pb->pb_master;
+		pi->pi_perl = PERL_INTERPRETER;
+		pi->pi_obj_ref = pb->pb_obj_ref;
+
+	} else {
+		ldap_pvt_thread_mutex_lock( &pb->pb_pool_mutex );
+		for (;;) {
+			for ( i = 0; i < pb->pb_ninterps; i++ ) {
+				if ( !pb->pb_interps[i].pi_busy )
+					break;
+			}
+			if ( i < pb->pb_ninterps )
+				break;
+			ldap_pvt_thread_cond_wait( &pb->pb_pool_cond, &pb->pb_pool_mutex );
+		}
+		pi = &pb->pb_interps[i];
+		pi->pi_busy = 1;
+		ldap_pvt_thread_mutex_unlock( &pb->pb_pool_mutex );
+	}
+
+	PERL_SET_CONTEXT( pi->pi_perl );
+	return pi;
+}
+
+void
+perl_back_interp_release( PerlBackend *pb, PerlInterp *pi )
+{
+	if ( pi == &pb->pb_master ) {
+		ldap_pvt_thread_mutex_unlock( &perl_interpreter_mutex );
+		return;
+	}
+
+	ldap_pvt_thread_mutex_lock( &pb->pb_pool_mutex );
+	pi->pi_busy = 0;
+	ldap_pvt_thread_cond_signal( &pb->pb_pool_cond );
+	ldap_pvt_thread_mutex_unlock( &pb->pb_pool_mutex );
+}
+
 
 static void
 perl_back_xs_init(PERL_BACK_XS_INIT_PARAMS)
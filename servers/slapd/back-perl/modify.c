@@ -24,18 +24,19 @@ perl_back_modify(
 	SlapReply	*rs )
 {
 	PerlBackend *perl_back = (PerlBackend *)op->o_bd->be_private;
+	PerlInterp *pi;
 	Modifications *modlist = op->orm_modlist;
 	int count;
 	int i;
 
-	PERL_SET_CONTEXT( PERL_INTERPRETER );
-	ldap_pvt_thread_mutex_lock( &perl_interpreter_mutex );	
+	pi = perl_back_interp_get( perl_back );
 
 	{
+		dTHXa( pi->pi_perl );
 		dSP; ENTER; SAVETMPS;
 		
 		PUSHMARK(sp);
-		XPUSHs( perl_back->pb_obj_ref );
+		XPUSHs( pi->pi_obj_ref );
 		XPUSHs(sv_2mortal(newSVpv( op->o_req_dn.bv_val , 0)));
 
 		for (; modlist != NULL; modlist = modlist->sml_next ) {
@@ -87,7 +88,7 @@ perl_back_modify(
 		PUTBACK; FREETMPS; LEAVE;
 	}
 
-	ldap_pvt_thread_mutex_unlock( &perl_interpreter_mutex );
+	perl_back_interp_release( perl_back, pi );
 
 	send_ldap_result( op, rs );
 
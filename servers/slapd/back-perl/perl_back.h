@@ -39,6 +39,9 @@ LDAP_BEGIN_DECL
 
 #define EVAL_BUF_SIZE 500
 
+/* Hands a database's object to the interpreters cloned for it */
+#define PERL_BACK_OBJ_VAR	"OpenLDAP::BackPerl::obj"
+
 extern ldap_pvt_thread_mutex_t  perl_interpreter_mutex;
 
 #ifdef PERL_IS_5_6
@@ -67,12 +70,28 @@ extern ldap_pvt_thread_mutex_t  perl_interpreter_mutex;
 extern PerlInterpreter *PERL_INTERPRETER;
 
 
+/* An interpreter an operation runs in, with the database's object in it */
+typedef struct perl_interp {
+	PerlInterpreter	*pi_perl;
+	SV	*pi_obj_ref;
+	int	pi_busy;
+} PerlInterp;
+
 typedef struct perl_backend_instance {
 	char *pb_module_name;
 	BerVarray pb_module_path;
 	BerVarray pb_module_config;
 	SV	*pb_obj_ref;
 	int	pb_filter_search_results;
+
+	/* perlInterpreters > 1: clones of the configured interpreter,
+	 * private to this database, so operations need not share
+	 * perl_interpreter_mutex */
+	int	pb_ninterps;
+	PerlInterp	*pb_interps;
+	PerlInterp	pb_master;
+	ldap_pvt_thread_mutex_t	pb_pool_mutex;
+	ldap_pvt_thread_cond_t	pb_pool_cond;
 } PerlBackend;
 
 LDAP_END_DECL
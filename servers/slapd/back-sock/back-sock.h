@@ -32,6 +32,10 @@ struct sockinfo {
 	slap_mask_t	si_resps;	/* overlay: responses to forward */
 	regex_t	si_dnpat;		/* overlay: DN pattern to match */
 	struct berval 	si_dnpatstr;
+	int		si_poolmax;	/* idle persistent connections to keep */
+	int		si_npool;
+	FILE		**si_pool;
+	ldap_pvt_thread_mutex_t	si_pool_mutex;
 };
 
 #define	SOCK_EXT_BINDDN	1
@@ -42,6 +46,17 @@ struct sockinfo {
 extern FILE *opensock LDAP_P((
 	const char *sockpath));
 
+extern FILE *sock_open LDAP_P((
+	struct sockinfo *si));
+
+extern void sock_release LDAP_P((
+	struct sockinfo *si,
+	FILE *fp));
+
+extern void sock_pool_set LDAP_P((
+	struct sockinfo *si,
+	int max));
+
 extern void sock_print_suffixes LDAP_P((
 	FILE *fp,
 	BackendDB *bd));
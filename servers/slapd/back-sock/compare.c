@@ -56,7 +56,7 @@ sock_back_compare(
 		return -1;
 	}
 
-	if ( (fp = opensock( si->si_sockpath )) == NULL ) {
+	if ( (fp = sock_open( si )) == NULL ) {
 		send_ldap_error( op, rs, LDAP_OTHER,
 		    "could not open socket" );
 		return( -1 );
@@ -83,6 +83,6 @@ sock_back_compare(
 	/* read in the result and send it along */
 	sock_read_and_send_results( op, rs, fp );
 
-	fclose( fp );
+	sock_release( si, fp );
 	return( 0 );
 }
@@ -37,7 +37,8 @@ enum {
 	BS_EXT = 1,
 	BS_OPS,
 	BS_RESP,
-	BS_DNPAT
+	BS_DNPAT,
+	BS_POOL
 };
 
 /* The number of overlay-only config attrs */
@@ -71,6 +72,10 @@ static ConfigTable bscfg[] = {
 			"DESC 'binddn, peername, or ssf' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "sockpool", "count", 2, 2, 0, ARG_MAGIC|ARG_INT|BS_POOL,
+		bs_cf_gen, "( OLcfgDbAt:7.6 NAME 'olcDbSocketPool' "
+			"DESC 'Number of idle persistent connections to keep' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL }
 };
 
@@ -80,7 +85,7 @@ static ConfigOCs bsocs[] = {
 		"DESC 'Socket backend configuration' "
 		"SUP olcDatabaseConfig "
 		"MUST olcDbSocketPath "
-		"MAY olcDbSocketExtensions )",
+		"MAY ( olcDbSocketExtensions $ olcDbSocketPool ) )",
 			Cft_Database, bscfg+NUM_OV_ATTRS },
 	{ NULL, 0, NULL }
 };
@@ -91,7 +96,7 @@ static ConfigOCs osocs[] = {
 		"DESC 'Socket overlay configuration' "
 		"SUP olcOverlayConfig "
 		"MUST olcDbSocketPath "
-		"MAY ( olcDbSocketExtensions $ "
+		"MAY ( olcDbSocketExtensions $ olcDbSocketPool $ "
 			" olcOvSocketOps $ olcOvSocketResps $ "
 			" olcOvSocketDNpat ) )",
 			Cft_Overlay, bscfg },
@@ -162,6 +167,9 @@ bs_cf_gen( ConfigArgs *c )
 		case BS_DNPAT:
 			value_add_one( &c->rvalue_vals, &si->si_dnpatstr );
 			return 0;
+		case BS_POOL:
+			c->value_int = si->si_poolmax;
+			return 0;
 		}
 	} else if ( c->op == LDAP_MOD_DELETE ) {
 		switch( c->type ) {
@@ -203,6 +211,9 @@ bs_cf_gen( ConfigArgs *c )
 			ch_free( si->si_dnpatstr.bv_val );
 			BER_BVZERO( &si->si_dnpatstr );
 			return 0;
+		case BS_POOL:
+			sock_pool_set( si, 0 );
+			return 0;
 		}
 
 	} else {
@@ -220,6 +231,15 @@ bs_cf_gen( ConfigArgs *c )
 			} else {
 				return 1;
 			}
+		case BS_POOL:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> invalid count %d", c->argv[0], c->value_int );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg, 0 );
+				return 1;
+			}
+			sock_pool_set( si, c->value_int );
+			return 0;
 		}
 	}
 	return 1;
@@ -326,7 +346,7 @@ sock_over_response( Operation *op, SlapReply *rs )
 	} else
 		return SLAP_CB_CONTINUE;
 
-	if (( fp = opensock( si->si_sockpath )) == NULL )
+	if (( fp = sock_open( si )) == NULL )
 		return SLAP_CB_CONTINUE;
 
 	if ( rs->sr_type == REP_RESULT ) {
@@ -350,7 +370,7 @@ sock_over_response( Operation *op, SlapReply *rs )
 		ldap_pvt_thread_mutex_unlock( &entry2str_mutex );
 	}
 	fprintf( fp, "\n" );
-	fclose( fp );
+	sock_release( si, fp );
 
 	return SLAP_CB_CONTINUE;
 }
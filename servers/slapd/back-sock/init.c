@@ -72,6 +72,7 @@ sock_back_db_init(
 	struct sockinfo	*si;
 
 	si = (struct sockinfo *) ch_calloc( 1, sizeof(struct sockinfo) );
+	ldap_pvt_thread_mutex_init( &si->si_pool_mutex );
 
 	be->be_private = si;
 	be->be_cf_ocs = be->bd_info->bi_cf_ocs;
@@ -85,6 +86,10 @@ sock_back_db_destroy(
 	struct config_reply_s *cr
 )
 {
+	struct sockinfo	*si = (struct sockinfo *) be->be_private;
+
+	sock_pool_set( si, 0 );
+	ldap_pvt_thread_mutex_destroy( &si->si_pool_mutex );
 	free( be->be_private );
 	return 0;
 }
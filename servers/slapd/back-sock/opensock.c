@@ -34,6 +34,10 @@
  * FIXME: count the number of concurrent open sockets (since each thread
  * may open one). Perhaps block here if a soft limit is reached, and fail
  * if a hard limit reached
+ *
+ * With sockpool set, up to si_poolmax idle connections are kept open and
+ * reused, so the listener must leave the socket open after each reply
+ * and end every reply, including CONTINUE, with a blank line.
  */
 
 FILE *
@@ -69,3 +73,80 @@ opensock(
 
 	return( fp );
 }
+
+/* an idle pooled socket has nothing to read unless the peer closed it */
+static int
+sock_idle_ok( FILE *fp )
+{
+#ifdef MSG_DONTWAIT
+	char	c;
+	ssize_t	n;
+
+	n = recv( fileno( fp ), &c, 1, MSG_PEEK|MSG_DONTWAIT );
+	return n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK );
+#else
+	return 1;
+#endif
+}
+
+FILE *
+sock_open(
+    struct sockinfo	*si
+)
+{
+	FILE	*fp = NULL;
+
+	if ( si->si_poolmax ) {
+		ldap_pvt_thread_mutex_lock( &si->si_pool_mutex );
+		while ( si->si_npool ) {
+			fp = si->si_pool[--si->si_npool];
+			if ( sock_idle_ok( fp ))
+				break;
+			fclose( fp );
+			fp = NULL;
+		}
+		ldap_pvt_thread_mutex_unlock( &si->si_pool_mutex );
+		if ( fp )
+			return fp;
+	}
+
+	return opensock( si->si_sockpath );
+}
+
+/* return a socket to the pool if it is left at a request boundary */
+void
+sock_release(
+    struct sockinfo	*si,
+    FILE	*fp
+)
+{
+	if ( si->si_poolmax && fflush( fp ) == 0 && !feof( fp ) && !ferror( fp )) {
+		ldap_pvt_thread_mutex_lock( &si->si_pool_mutex );
+		if ( si->si_npool < si->si_poolmax ) {
+			si->si_pool[si->si_npool++] = fp;
+			fp = NULL;
+		}
+		ldap_pvt_thread_mutex_unlock( &si->si_pool_mutex );
+	}
+	if ( fp )
+		fclose( fp );
+}
+
+void
+sock_pool_set(
+    struct sockinfo	*si,
+    int		max
+)
+{
+	ldap_pvt_thread_mutex_lock( &si->si_pool_mutex );
+	while ( si->si_npool > max )
+		fclose( si->si_pool[--si->si_npool] );
+	if ( max ) {
+		si->si_pool = ch_realloc( si->si_pool, max * sizeof( FILE * ));
+	} else if ( si->si_pool ) {
+		ch_free( si->si_pool );
+		si->si_pool = NULL;
+	}
+	si->si_poolmax = max;
+	ldap_pvt_thread_mutex_unlock( &si->si_pool_mutex );
+}
@@ -82,6 +82,12 @@ sock_read_and_send_results(
 			/* Only valid when operating as an overlay! */
 			assert( si->si_ops != 0 );
 			rs->sr_err = SLAP_CB_CONTINUE;
+			/* leave a pooled socket at the next reply */
+			if ( si->si_poolmax ) {
+				while ( fgets( line, sizeof(line), fp ) != NULL &&
+					*line != '\n' )
+					;
+			}
 			goto skip;
 		}
 
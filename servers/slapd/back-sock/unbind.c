@@ -37,7 +37,7 @@ sock_back_unbind(
 	struct sockinfo	*si = (struct sockinfo *) op->o_bd->be_private;
 	FILE			*fp;
 
-	if ( (fp = opensock( si->si_sockpath )) == NULL ) {
+	if ( (fp = sock_open( si )) == NULL ) {
 		send_ldap_error( op, rs, LDAP_OTHER,
 		    "could not open socket" );
 		return( -1 );
@@ -51,7 +51,7 @@ sock_back_unbind(
 	fprintf( fp, "\n" );
 
 	/* no response to unbind */
-	fclose( fp );
+	sock_release( si, fp );
 
 	return 0;
 }
@@ -185,7 +185,7 @@ backsql_dn2id(
 	assert( bi->sql_id_query != NULL );
 	Debug( LDAP_DEBUG_TRACE, "   backsql_dn2id(\"%s\"): id_query \"%s\"\n",
 			ndn->bv_val, bi->sql_id_query, 0 );
- 	rc = backsql_Prepare( dbh, &sth, bi->sql_id_query, 0 );
+ 	rc = backsql_PrepareCached( op, dbh, &sth, bi->sql_id_query );
 	if ( rc != SQL_SUCCESS ) {
 		Debug( LDAP_DEBUG_TRACE, 
 			"   backsql_dn2id(\"%s\"): "
@@ -371,7 +371,7 @@ done:;
 		"<==backsql_dn2id(\"%s\"): err=%d\n",
 		ndn->bv_val, res, 0 );
 	if ( sth != SQL_NULL_HSTMT ) {
-		SQLFreeStmt( sth, SQL_DROP );
+		backsql_FreeStmtCached( op, sth, bi->sql_id_query );
 	}
 
 	if ( !BER_BVISNULL( &realndn ) && realndn.bv_val != ndn->bv_val ) {
@@ -661,7 +661,8 @@ backsql_get_attr_vals( void *v_at, void *v_bsi )
 	}
 #endif /* BACKSQL_COUNTQUERY */
 
-	rc = backsql_Prepare( bsi->bsi_dbh, &sth, at->bam_query, 0 );
+	rc = backsql_PrepareCached( bsi->bsi_op, bsi->bsi_dbh, &sth,
+			at->bam_query );
 	if ( rc != SQL_SUCCESS ) {
 		Debug( LDAP_DEBUG_TRACE, "backsql_get_attr_vals(): "
 			"error preparing query: %s\n", at->bam_query, 0, 0 );
@@ -679,6 +680,7 @@ backsql_get_attr_vals( void *v_at, void *v_bsi )
 	if ( rc != SQL_SUCCESS ) {
 		Debug( LDAP_DEBUG_TRACE, "backsql_get_attr_vals(): "
 			"error binding key value parameter\n", 0, 0, 0 );
+		backsql_FreeStmtCached( bsi->bsi_op, sth, at->bam_query );
 #ifdef BACKSQL_COUNTQUERY
 		if ( append ) {
 			attr_free( attr );
@@ -699,7 +701,7 @@ backsql_get_attr_vals( void *v_at, void *v_bsi )
 			"error executing attribute query \"%s\"\n",
 			at->bam_query, 0, 0 );
 		backsql_PrintErrors( bi->sql_db_env, bsi->bsi_dbh, sth, rc );
-		SQLFreeStmt( sth, SQL_DROP );
+		backsql_FreeStmtCached( bsi->bsi_op, sth, at->bam_query );
 #ifdef BACKSQL_COUNTQUERY
 		if ( append ) {
 			attr_free( attr );
@@ -890,7 +892,7 @@ backsql_get_attr_vals( void *v_at, void *v_bsi )
 	}
 #endif /* BACKSQL_COUNTQUERY */
 
-	SQLFreeStmt( sth, SQL_DROP );
+	backsql_FreeStmtCached( bsi->bsi_op, sth, at->bam_query );
 	Debug( LDAP_DEBUG_TRACE, "<==backsql_get_attr_vals()\n", 0, 0, 0 );
 
 	if ( at->bam_next ) {
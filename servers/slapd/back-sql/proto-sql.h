@@ -185,6 +185,9 @@ void backsql_entry_clean( Operation *op, Entry *e );
  */
 
 RETCODE backsql_Prepare( SQLHDBC dbh, SQLHSTMT *sth, const char* query, int timeout );
+RETCODE backsql_PrepareCached( Operation *op, SQLHDBC dbh, SQLHSTMT *sth,
+	const char *query );
+void backsql_FreeStmtCached( Operation *op, SQLHSTMT sth, const char *query );
 
 #define backsql_BindParamStr( sth, par_ind, io, str, maxlen ) 		\
 	SQLBindParameter( (sth), (SQLUSMALLINT)(par_ind), 		\
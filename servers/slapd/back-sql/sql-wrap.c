@@ -465,22 +465,91 @@ backsql_open_db_handle(
 
 static void	*backsql_db_conn_dummy;
 
+/*
+ * per-thread connection, along with the statements prepared on it
+ * for the queries that are run once per entry (see
+ * backsql_PrepareCached())
+ */
+typedef struct backsql_db_conn {
+	SQLHDBC		bdc_dbh;
+	int		bdc_cache;
+	Avlnode		*bdc_stmts;
+} backsql_db_conn;
+
+typedef struct backsql_cached_stmt {
+	const char	*bcs_query;
+	SQLHSTMT	bcs_sth;
+	int		bcs_busy;
+} backsql_cached_stmt;
+
+static int
+backsql_cached_stmt_cmp( const void *v1, const void *v2 )
+{
+	const backsql_cached_stmt	*s1 = v1, *s2 = v2;
+
+	if ( s1->bcs_query < s2->bcs_query ) {
+		return -1;
+	}
+	return s1->bcs_query > s2->bcs_query;
+}
+
+static void
+backsql_cached_stmt_free( void *v )
+{
+	backsql_cached_stmt	*bcs = v;
+
+	SQLFreeStmt( bcs->bcs_sth, SQL_DROP );
+	ch_free( bcs );
+}
+
+static void
+backsql_db_conn_close( backsql_db_conn *bdc )
+{
+	/* statements must go before the connection they belong to */
+	avl_free( bdc->bdc_stmts, backsql_cached_stmt_free );
+	(void)backsql_close_db_handle( bdc->bdc_dbh );
+	ch_free( bdc );
+}
+
 static void
 backsql_db_conn_keyfree(
 	void		*key,
 	void		*data )
 {
-	(void)backsql_close_db_handle( (SQLHDBC)data );
+	if ( data != NULL ) {
+		backsql_db_conn_close( (backsql_db_conn *)data );
+	}
+}
+
+static backsql_db_conn *
+backsql_db_conn_get( Operation *op )
+{
+	void		*data = NULL;
+
+	if ( op->o_threadctx ) {
+		ldap_pvt_thread_pool_getkey( op->o_threadctx,
+				&backsql_db_conn_dummy, &data, NULL );
+	}
+
+	return (backsql_db_conn *)data;
 }
 
 int
 backsql_free_db_conn( Operation *op, SQLHDBC dbh )
 {
+	backsql_db_conn	*bdc;
+
 	Debug( LDAP_DEBUG_TRACE, "==>backsql_free_db_conn()\n", 0, 0, 0 );
 
-	(void)backsql_close_db_handle( dbh );
+	bdc = backsql_db_conn_get( op );
+	if ( bdc != NULL && bdc->bdc_dbh == dbh ) {
+		backsql_db_conn_close( bdc );
+
+	} else {
+		(void)backsql_close_db_handle( dbh );
+	}
 	ldap_pvt_thread_pool_setkey( op->o_threadctx,
-		&backsql_db_conn_dummy, (void *)SQL_NULL_HDBC,
+		&backsql_db_conn_dummy, NULL,
 		backsql_db_conn_keyfree, NULL, NULL );
 
 	Debug( LDAP_DEBUG_TRACE, "<==backsql_free_db_conn()\n", 0, 0, 0 );
@@ -501,11 +570,11 @@ backsql_get_db_conn( Operation *op, SQLHDBC *dbhp )
 	*dbhp = SQL_NULL_HDBC;
 
 	if ( op->o_threadctx ) {
-		void		*data = NULL;
+		backsql_db_conn	*bdc = backsql_db_conn_get( op );
 
-		ldap_pvt_thread_pool_getkey( op->o_threadctx,
-				&backsql_db_conn_dummy, &data, NULL );
-		dbh = (SQLHDBC)data;
+		if ( bdc != NULL ) {
+			dbh = bdc->bdc_dbh;
+		}
 
 	} else {
 		dbh = bi->sql_dbh;
@@ -518,10 +587,24 @@ backsql_get_db_conn( Operation *op, SQLHDBC *dbhp )
 		}
 
 		if ( op->o_threadctx ) {
-			void		*data = (void *)dbh;
-
+			backsql_db_conn	*bdc;
+
+			SQLUSMALLINT	cb_commit = SQL_CB_DELETE,
+					cb_rollback = SQL_CB_DELETE;
+
+			bdc = ch_calloc( 1, sizeof( backsql_db_conn ) );
+			bdc->bdc_dbh = dbh;
+
+			/* prepared statements can only be kept if they
+			 * survive the end of a transaction */
+			SQLGetInfo( dbh, SQL_CURSOR_COMMIT_BEHAVIOR,
+				&cb_commit, sizeof( cb_commit ), NULL );
+			SQLGetInfo( dbh, SQL_CURSOR_ROLLBACK_BEHAVIOR,
+				&cb_rollback, sizeof( cb_rollback ), NULL );
+			bdc->bdc_cache = ( cb_commit != SQL_CB_DELETE &&
+				cb_rollback != SQL_CB_DELETE );
 			ldap_pvt_thread_pool_setkey( op->o_threadctx,
-					&backsql_db_conn_dummy, data,
+					&backsql_db_conn_dummy, (void *)bdc,
 					backsql_db_conn_keyfree, NULL, NULL );
 
 		} else {
@@ -536,3 +619,73 @@ backsql_get_db_conn( Operation *op, SQLHDBC *dbhp )
 	return LDAP_SUCCESS;
 }
 
+/*
+ * Like backsql_Prepare(), but keeps the statement prepared on the
+ * thread's connection for later reuse; query must be a string that
+ * lives as long as the database (e.g. from the schema map), since it
+ * is used as the cache key.  The statement must be given back with
+ * backsql_FreeStmtCached().
+ */
+RETCODE
+backsql_PrepareCached( Operation *op, SQLHDBC dbh, SQLHSTMT *sth,
+	const char *query )
+{
+	backsql_db_conn		*bdc = backsql_db_conn_get( op );
+	backsql_cached_stmt	bcs, *bcsp;
+	RETCODE			rc;
+
+	if ( bdc == NULL || bdc->bdc_dbh != dbh || !bdc->bdc_cache ) {
+		return backsql_Prepare( dbh, sth, query, 0 );
+	}
+
+	bcs.bcs_query = query;
+	bcsp = avl_find( bdc->bdc_stmts, &bcs, backsql_cached_stmt_cmp );
+	if ( bcsp != NULL ) {
+		if ( bcsp->bcs_busy ) {
+			/* nested use of the same query */
+			return backsql_Prepare( dbh, sth, query, 0 );
+		}
+		bcsp->bcs_busy = 1;
+		*sth = bcsp->bcs_sth;
+		return SQL_SUCCESS;
+	}
+
+	rc = backsql_Prepare( dbh, sth, query, 0 );
+	if ( rc != SQL_SUCCESS ) {
+		return rc;
+	}
+
+	bcsp = ch_malloc( sizeof( backsql_cached_stmt ) );
+	bcsp->bcs_query = query;
+	bcsp->bcs_sth = *sth;
+	bcsp->bcs_busy = 1;
+	if ( avl_insert( &bdc->bdc_stmts, bcsp, backsql_cached_stmt_cmp,
+			avl_dup_error ) ) {
+		ch_free( bcsp );
+	}
+
+	return SQL_SUCCESS;
+}
+
+void
+backsql_FreeStmtCached( Operation *op, SQLHSTMT sth, const char *query )
+{
+	backsql_db_conn		*bdc = backsql_db_conn_get( op );
+	backsql_cached_stmt	bcs, *bcsp = NULL;
+
+	if ( bdc != NULL ) {
+		bcs.bcs_query = query;
+		bcsp = avl_find( bdc->bdc_stmts, &bcs, backsql_cached_stmt_cmp );
+	}
+
+	if ( bcsp == NULL || bcsp->bcs_sth != sth ) {
+		SQLFreeStmt( sth, SQL_DROP );
+		return;
+	}
+
+	/* keep the statement prepared, but drop results and bindings */
+	SQLFreeStmt( sth, SQL_CLOSE );
+	SQLFreeStmt( sth, SQL_UNBIND );
+	SQLFreeStmt( sth, SQL_RESET_PARAMS );
+	bcsp->bcs_busy = 0;
+}
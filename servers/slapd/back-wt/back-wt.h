@@ -70,6 +70,7 @@ struct wt_info {
 
 typedef struct {
 	WT_SESSION *session;
+	WT_CURSOR *id2entry;	/* kept open for wt_id2entry() */
 } wt_ctx;
 
 /* for the cache of attribute information (which are indexed, etc.) */
@@ -57,6 +57,10 @@ wt_ctx_free( void *key, void *data )
 {
 	wt_ctx *wc = data;
 
+	if(wc->id2entry){
+		wc->id2entry->close(wc->id2entry);
+		wc->id2entry = NULL;
+	}
 	if(wc->session){
 		wc->session->close(wc->session, NULL);
 		wc->session = NULL;
@@ -133,6 +137,33 @@ wt_ctx_index_cursor(wt_ctx *wc, struct berval *name, int create)
 	return cursor;
 }
 
+/*
+ * The id2entry cursor is used for every entry a search returns, so it
+ * is opened once per thread context and only reset between lookups.
+ */
+WT_CURSOR *
+wt_ctx_id2entry_cursor(wt_ctx *wc)
+{
+	WT_SESSION *session = wc->session;
+	int rc;
+
+	if(wc->id2entry){
+		return wc->id2entry;
+	}
+
+	rc = session->open_cursor(session, WT_TABLE_ID2ENTRY"(entry)", NULL,
+							  NULL, &wc->id2entry);
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			   LDAP_XSTRING(wt_ctx_id2entry_cursor)
+			   ": open_cursor failed: %s (%d)\n",
+			   wiredtiger_strerror(rc), rc, 0 );
+		wc->id2entry = NULL;
+	}
+
+	return wc->id2entry;
+}
+
 /*
  * Local variables:
  * indent-tabs-mode: t
@@ -118,24 +118,19 @@ done:
 }
 
 int wt_id2entry( BackendDB *be,
-				 WT_SESSION *session,
+				 wt_ctx *wc,
 				 ID id,
 				 Entry **ep ){
 	int rc;
-	WT_CURSOR *cursor = NULL;
+	WT_CURSOR *cursor;
 	WT_ITEM item;
 	EntryHeader eh;
 	int eoff;
 	Entry *e = NULL;
 
-	rc = session->open_cursor(session, WT_TABLE_ID2ENTRY"(entry)", NULL,
-							  NULL, &cursor);
-	if ( rc ) {
-		Debug( LDAP_DEBUG_ANY,
-			   LDAP_XSTRING(wt_id2entry)
-			   ": open_cursor failed: %s (%d)\n",
-			   wiredtiger_strerror(rc), rc, 0 );
-		goto done;
+	cursor = wt_ctx_id2entry_cursor(wc);
+	if ( !cursor ) {
+		return WT_ERROR;
 	}
 
 	cursor->set_key(cursor, id);
@@ -165,9 +160,8 @@ int wt_id2entry( BackendDB *be,
 	*ep = e;
 
 done:
-	if(cursor){
-		cursor->close(cursor);
-	}
+	/* release the position, and the snapshot it pins */
+	cursor->reset(cursor);
 	return rc;
 }
 
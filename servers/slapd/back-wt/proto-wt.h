@@ -35,6 +35,7 @@ void wt_attr_flush( struct wt_info *wi );
 int wt_id2entry_add(Operation *op, WT_SESSION *session, Entry *e );
 int wt_id2entry_update(Operation *op, WT_SESSION *session, Entry *e );
 int wt_id2entry_delete(Operation *op, WT_SESSION *session, Entry *e );
+int wt_id2entry(BackendDB *be, wt_ctx *wc, ID id, Entry **ep);
 
 BI_entry_release_rw wt_entry_release;
 BI_entry_get_rw wt_entry_get;
@@ -147,6 +148,7 @@ wt_ctx *wt_ctx_init(struct wt_info *wi);
 void wt_ctx_free(void *key, void *data);
 wt_ctx *wt_ctx_get(Operation *op, struct wt_info *wi);
 WT_CURSOR *wt_ctx_index_cursor(wt_ctx *wc, struct berval *name, int create);
+WT_CURSOR *wt_ctx_id2entry_cursor(wt_ctx *wc);
 
 
 /*
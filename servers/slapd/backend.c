@@ -52,6 +52,10 @@ slap_bi_head backendInfo = LDAP_STAILQ_HEAD_INITIALIZER(backendInfo);
 int			nBackendDB = 0; 
 slap_be_head backendDB = LDAP_STAILQ_HEAD_INITIALIZER(backendDB);
 
+/* bumped on every local write, invalidates connection group caches */
+static unsigned long slap_group_gen;
+static ldap_pvt_thread_mutex_t slap_group_gen_mutex;
+
 static int
 backend_init_controls( BackendInfo *bi )
 {
@@ -90,6 +94,8 @@ int backend_init(void)
 		return -1;
 	}
 
+	ldap_pvt_thread_mutex_init( &slap_group_gen_mutex );
+
 	for( bi=slap_binfo; bi->bi_type != NULL; bi++,nBackendInfo++ ) {
 		assert( bi->bi_init != 0 );
 
@@ -434,7 +440,6 @@ backend_stopdown_one( BackendDB *bd )
 			struct slap_csn_entry *tmp_csne = csne;
 
 			LDAP_TAILQ_REMOVE( bd->be_pending_csn_list, csne, ce_csn_link );
-			ch_free( csne->ce_csn.bv_val );
 			csne = LDAP_TAILQ_NEXT( csne, ce_csn_link );
 			ch_free( tmp_csne );
 		}
@@ -508,6 +513,8 @@ int backend_destroy(void)
 	nBackendInfo = 0;
 	LDAP_STAILQ_INIT(&backendInfo);
 
+	ldap_pvt_thread_mutex_destroy( &slap_group_gen_mutex );
+
 	/* destroy frontend database */
 	bd = frontendDB;
 	if ( bd ) {
@@ -1455,6 +1462,8 @@ fe_acl_group(
 	GroupAssertion *g;
 	Backend *be = op->o_bd;
 	OpExtra		*oex;
+	Connection	*conn = NULL;
+	unsigned long	gen = slap_group_gen;
 
 	LDAP_SLIST_FOREACH(oex, &op->o_extra, oe_next) {
 		if ( oex->oe_key == (void *)backend_group )
@@ -1483,6 +1492,31 @@ fe_acl_group(
 		goto done;
 	}
 
+	/* connection-lifetime cache, see backend_group_changed() */
+	if ( slap_conn_group_cache > 0 && op->o_conn &&
+		op->o_conn->c_conn_idx >= 0 &&
+		op->o_tag != LDAP_REQ_BIND && !op->o_do_not_cache )
+	{
+		conn = op->o_conn;
+		ldap_pvt_thread_mutex_lock( &conn->c_groups_mutex );
+		if ( dn_match( &conn->c_groups_ndn, op_ndn ) ) {
+			for ( g = conn->c_groups; g; g = g->ga_next ) {
+				if ( g->ga_be != op->o_bd || g->ga_oc != group_oc ||
+					g->ga_at != group_at || g->ga_gen != gen ||
+					g->ga_len != gr_ndn->bv_len )
+				{
+					continue;
+				}
+				if ( strcmp( g->ga_ndn, gr_ndn->bv_val ) == 0 ) {
+					rc = g->ga_res;
+					break;
+				}
+			}
+		}
+		ldap_pvt_thread_mutex_unlock( &conn->c_groups_mutex );
+		if ( g ) goto done;
+	}
+
 	if ( target && dn_match( &target->e_nname, gr_ndn ) ) {
 		e = target;
 		rc = 0;
@@ -1656,11 +1690,56 @@ loopit:
 		op->o_groups = g;
 	}
 
+	if ( conn ) {
+		GroupAssertion *cg;
+
+		ldap_pvt_thread_mutex_lock( &conn->c_groups_mutex );
+		if ( !dn_match( &conn->c_groups_ndn, op_ndn ) ||
+			conn->c_ngroups >= slap_conn_group_cache )
+		{
+			connection_groups_free( conn );
+			ber_dupbv( &conn->c_groups_ndn, op_ndn );
+		}
+		cg = ch_malloc( sizeof( GroupAssertion ) + gr_ndn->bv_len );
+		cg->ga_be = op->o_bd;
+		cg->ga_oc = group_oc;
+		cg->ga_at = group_at;
+		cg->ga_res = rc;
+		cg->ga_gen = gen;
+		cg->ga_len = gr_ndn->bv_len;
+		strcpy( cg->ga_ndn, gr_ndn->bv_val );
+		cg->ga_next = conn->c_groups;
+		conn->c_groups = cg;
+		conn->c_ngroups++;
+		ldap_pvt_thread_mutex_unlock( &conn->c_groups_mutex );
+	}
+
 done:
 	op->o_bd = be;
 	return rc;
 }
 
+/*
+ * Called after every local write.  Group membership can change with
+ * any of them (static groups through the group entry, dynamic ones
+ * through the member entry), so the connection caches filled by
+ * fe_acl_group() are all invalidated at once.
+ */
+void
+backend_group_changed( void )
+{
+	ldap_pvt_thread_mutex_lock( &slap_group_gen_mutex );
+	slap_group_gen++;
+	ldap_pvt_thread_mutex_unlock( &slap_group_gen_mutex );
+}
+
+/* For other caches that must be dropped on the same occasions */
+unsigned long
+backend_group_gen( void )
+{
+	return slap_group_gen;
+}
+
 int 
 backend_group(
 	Operation *op,
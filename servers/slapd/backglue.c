@@ -377,6 +377,243 @@ glue_sub_search( Operation *op, SlapReply *rs, BackendDB *b0,
 	return op->o_bd->be_search( op, rs );
 }
 
+/* Concurrent search of the subordinates below the search base.
+ * The glued set still looks like a single database to the client:
+ * entries are sent one at a time, the sizelimit is counted across
+ * all of them, and the results are merged into the shared glue_state.
+ */
+#define GLUE_PAR_MAX	8	/* pool tasks per search */
+
+typedef struct glue_par {
+	ldap_pvt_thread_mutex_t gp_mutex;
+	ldap_pvt_thread_cond_t gp_cond;
+	Operation *gp_op;		/* the client's operation */
+	Operation gp_tmpl;		/* copied by the pool tasks */
+	slap_callback *gp_cb;	/* the glue_op_response collector */
+	BackendDB **gp_be;
+	int gp_nbe;
+	int gp_next;
+	int gp_busy;
+	int gp_stop;
+	int gp_nentries;
+	int gp_tlimit;
+	long gp_stoptime;
+} glue_par;
+
+typedef struct glue_sub {
+	glue_par *gu_par;
+	int gu_locked;
+	int gu_nentries;
+	int gu_sub;		/* searching a subordinate below the base */
+} glue_sub;
+
+typedef struct glue_task {
+	glue_par *gt_par;
+	void *gt_cookie;
+	int gt_started;
+} glue_task;
+
+static int
+glue_par_response( Operation *op, SlapReply *rs )
+{
+	glue_sub *gu = op->o_callback->sc_private;
+	glue_par *gp = gu->gu_par;
+	glue_state *gs = gp->gp_cb->sc_private;
+
+	ldap_pvt_thread_mutex_lock( &gp->gp_mutex );
+	switch ( rs->sr_type ) {
+	case REP_SEARCH:
+		if ( !gp->gp_stop && gp->gp_tmpl.ors_slimit != SLAP_NO_LIMIT &&
+			gp->gp_nentries >= gp->gp_tmpl.ors_slimit )
+		{
+			gs->err = LDAP_SIZELIMIT_EXCEEDED;
+			gp->gp_stop = 1;
+		}
+		/* FALLTHRU */
+	case REP_SEARCHREF:
+	case REP_INTERMEDIATE:
+		if ( gp->gp_stop || gp->gp_op->o_abandon ) {
+			gp->gp_stop = 1;
+			ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+			return LDAP_UNAVAILABLE;
+		}
+		/* Keep the mutex until glue_par_cleanup, after the
+		 * response has been written */
+		gu->gu_locked = 1;
+		gu->gu_nentries = rs->sr_nentries;
+		return SLAP_CB_CONTINUE;
+
+	default:
+		/* A missing subordinate suffix is not an error */
+		if ( !gp->gp_stop &&
+			!( gu->gu_sub && rs->sr_err == LDAP_NO_SUCH_OBJECT ) )
+		{
+			slap_callback *sc = op->o_callback;
+			void *memctx = op->o_tmpmemctx;
+
+			/* The pool tasks' slabs don't outlive their searches,
+			 * collect the controls on the heap */
+			op->o_callback = gp->gp_cb;
+			op->o_tmpmemctx = NULL;
+			glue_op_response( op, rs );
+			op->o_tmpmemctx = memctx;
+			op->o_callback = sc;
+
+			switch ( gs->err ) {
+			case LDAP_SIZELIMIT_EXCEEDED:
+			case LDAP_TIMELIMIT_EXCEEDED:
+			case LDAP_ADMINLIMIT_EXCEEDED:
+			case LDAP_NO_SUCH_OBJECT:
+#ifdef LDAP_CONTROL_X_CHAINING_BEHAVIOR
+			case LDAP_X_CANNOT_CHAIN:
+#endif /* LDAP_CONTROL_X_CHAINING_BEHAVIOR */
+				gp->gp_stop = 1;
+				break;
+			}
+		}
+		ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+		return 0;
+	}
+}
+
+static int
+glue_par_cleanup( Operation *op, SlapReply *rs )
+{
+	glue_sub *gu = op->o_callback->sc_private;
+	glue_par *gp = gu->gu_par;
+
+	if ( gu->gu_locked ) {
+		gp->gp_nentries += rs->sr_nentries - gu->gu_nentries;
+		gu->gu_locked = 0;
+		ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+	}
+	return SLAP_CB_CONTINUE;
+}
+
+/* Take subordinates off the queue until it is empty */
+static void
+glue_par_run( glue_par *gp, Operation *op )
+{
+	glue_sub gu = { NULL, 0, 0, 1 };
+	slap_callback sc = { NULL, glue_par_response, glue_par_cleanup, NULL };
+	BackendDB *be;
+
+	gu.gu_par = gp;
+	sc.sc_next = gp->gp_cb;
+	sc.sc_private = &gu;
+
+	for (;;) {
+		SlapReply rs = { REP_RESULT };
+
+		ldap_pvt_thread_mutex_lock( &gp->gp_mutex );
+		if ( gp->gp_stop || gp->gp_op->o_abandon ||
+			gp->gp_next >= gp->gp_nbe )
+		{
+			ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+			break;
+		}
+		be = gp->gp_be[gp->gp_next++];
+		if ( gp->gp_tlimit != SLAP_NO_LIMIT ) {
+			op->o_time = slap_get_time();
+			op->ors_tlimit = gp->gp_stoptime - op->o_time;
+			if ( op->ors_tlimit <= 0 ) {
+				glue_state *gs = gp->gp_cb->sc_private;
+
+				gs->err = LDAP_TIMELIMIT_EXCEEDED;
+				gp->gp_stop = 1;
+				ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+				break;
+			}
+		}
+		ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+
+		op->o_bd = be;
+		op->o_callback = &sc;
+		op->o_req_dn = be->be_suffix[0];
+		op->o_req_ndn = be->be_nsuffix[0];
+		(void)be->be_search( op, &rs );
+	}
+}
+
+static void *
+glue_par_task( void *ctx, void *arg )
+{
+	glue_task *gt = arg;
+	glue_par *gp = gt->gt_par;
+	OperationBuffer opbuf;
+	Operation *op = &opbuf.ob_op;
+
+	ldap_pvt_thread_mutex_lock( &gp->gp_mutex );
+	gt->gt_started = 1;
+	*op = gp->gp_tmpl;
+	op->o_hdr = &opbuf.ob_hdr;
+	*op->o_hdr = *gp->gp_tmpl.o_hdr;
+	ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+
+	op->o_threadctx = ctx;
+	op->o_tmpmemctx = slap_sl_mem_create( SLAP_SLAB_SIZE, SLAP_SLAB_STACK,
+		ctx, 1 );
+	op->o_tmpmfuncs = &slap_sl_mfuncs;
+	LDAP_SLIST_INIT( &op->o_extra );
+
+	glue_par_run( gp, op );
+
+	ldap_pvt_thread_mutex_lock( &gp->gp_mutex );
+	if ( --gp->gp_busy == 0 )
+		ldap_pvt_thread_cond_signal( &gp->gp_cond );
+	ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+	return NULL;
+}
+
+static void
+glue_par_search( Operation *op, glue_par *gp )
+{
+	glue_task gt[GLUE_PAR_MAX];
+	struct berval dn = op->o_req_dn, ndn = op->o_req_ndn;
+	slap_callback *sc = op->o_callback;
+	int i, ntask;
+
+	ntask = gp->gp_nbe - 1;
+	if ( ntask > GLUE_PAR_MAX )
+		ntask = GLUE_PAR_MAX;
+
+	gp->gp_tmpl = *op;
+	for ( i = 0; i < ntask; i++ ) {
+		gt[i].gt_par = gp;
+		gt[i].gt_cookie = NULL;
+		gt[i].gt_started = 0;
+		ldap_pvt_thread_mutex_lock( &gp->gp_mutex );
+		gp->gp_busy++;
+		ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+		if ( ldap_pvt_thread_pool_submit2( &connection_pool,
+			glue_par_task, &gt[i], &gt[i].gt_cookie ) )
+		{
+			ldap_pvt_thread_mutex_lock( &gp->gp_mutex );
+			gp->gp_busy--;
+			gt[i].gt_started = 1;
+			ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+		}
+	}
+
+	/* This thread takes its share, so the search completes even
+	 * if the pool has no idle threads */
+	glue_par_run( gp, op );
+
+	ldap_pvt_thread_mutex_lock( &gp->gp_mutex );
+	for ( i = 0; i < ntask; i++ ) {
+		if ( !gt[i].gt_started &&
+			ldap_pvt_thread_pool_retract( gt[i].gt_cookie ) > 0 )
+			gp->gp_busy--;
+	}
+	while ( gp->gp_busy )
+		ldap_pvt_thread_cond_wait( &gp->gp_cond, &gp->gp_mutex );
+	ldap_pvt_thread_mutex_unlock( &gp->gp_mutex );
+
+	op->o_callback = sc;
+	op->o_req_dn = dn;
+	op->o_req_ndn = ndn;
+}
+
 static const ID glueID = NOID;
 static const struct berval gluecookie = { sizeof( glueID ), (char *)&glueID };
 
@@ -394,6 +631,10 @@ glue_op_search ( Operation *op, SlapReply *rs )
 	slap_callback cb = { NULL, glue_op_response, glue_op_cleanup, NULL };
 	int scope0, tlimit0;
 	struct berval dn, ndn, *pdn;
+	glue_par gp;
+	glue_sub gu = { NULL, 0, 0, 0 };
+	slap_callback pcb = { NULL, glue_par_response, glue_par_cleanup, NULL };
+	int par = 0;
 
 	cb.sc_private = &gs;
 
@@ -458,6 +699,30 @@ glue_op_search ( Operation *op, SlapReply *rs )
 		ndn = op->o_req_ndn;
 		b1 = op->o_bd;
 
+		/* Paged results resume from a single remembered database,
+		 * those are always searched one after the other */
+		if ( scope0 == LDAP_SCOPE_SUBTREE && SLAP_GLUE_PARALLEL( b0 ) &&
+			get_pagedresults( op ) <= SLAP_CONTROL_IGNORED &&
+			op->o_sync <= SLAP_CONTROL_IGNORED &&
+			!get_no_subordinate_glue( op ) )
+		{
+			par = 1;
+			memset( &gp, 0, sizeof( gp ) );
+			ldap_pvt_thread_mutex_init( &gp.gp_mutex );
+			ldap_pvt_thread_cond_init( &gp.gp_cond );
+			gp.gp_op = op;
+			gp.gp_cb = &cb;
+			gp.gp_be = op->o_tmpalloc( gi->gi_nodes * sizeof(BackendDB *),
+				op->o_tmpmemctx );
+			gp.gp_tlimit = tlimit0;
+			gp.gp_stoptime = stoptime;
+			gp.gp_tmpl.ors_slimit = op->ors_slimit;
+			gu.gu_par = &gp;
+			pcb.sc_next = &cb;
+			pcb.sc_private = &gu;
+			op->o_callback = &pcb;
+		}
+
 		/*
 		 * Execute in reverse order, most specific first 
 		 */
@@ -529,6 +794,12 @@ glue_op_search ( Operation *op, SlapReply *rs )
 				dnIsSuffix(&op->o_bd->be_nsuffix[0], &ndn))
 			{
 				struct berval mdn, mndn;
+				if ( par ) {
+					/* searched by glue_par_search once the
+					 * database holding the base is done */
+					gp.gp_be[gp.gp_nbe++] = btmp;
+					continue;
+				}
 				mdn = op->o_req_dn = op->o_bd->be_suffix[0];
 				mndn = op->o_req_ndn = op->o_bd->be_nsuffix[0];
 				rs->sr_err = glue_sub_search( op, rs, b0, on );
@@ -692,10 +963,18 @@ glue_op_search ( Operation *op, SlapReply *rs )
 				break;
 			}
 		}
+		if ( par && gp.gp_nbe && !op->o_abandon )
+			glue_par_search( op, &gp );
 end_of_loop:;
 		op->ors_scope = scope0;
 		op->ors_tlimit = tlimit0;
 		op->o_time = starttime;
+		if ( par ) {
+			rs->sr_nentries = gp.gp_nentries;
+			op->o_tmpfree( gp.gp_be, op->o_tmpmemctx );
+			ldap_pvt_thread_cond_destroy( &gp.gp_cond );
+			ldap_pvt_thread_mutex_destroy( &gp.gp_mutex );
+		}
 
 		break;
 	}
@@ -1306,6 +1585,9 @@ glue_db_init(
 		oi->oi_bi.bi_tool_entry_modify = glue_tool_entry_modify;
 	if ( bi->bi_tool_sync )
 		oi->oi_bi.bi_tool_sync = glue_tool_sync;
+	/* IDs are per database, the glued tree can't be scanned by range */
+	oi->oi_bi.bi_tool_entry_scan = NULL;
+	oi->oi_bi.bi_tool_index_rebuild = NULL;
 
 	SLAP_DBFLAGS( be ) |= SLAP_DBFLAG_GLUE_INSTANCE;
 
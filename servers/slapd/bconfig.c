@@ -25,7 +25,9 @@
 #include <ac/ctype.h>
 #include <ac/errno.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <ac/unistd.h>
+#include <ac/dirent.h>
 
 #include "slap.h"
 
@@ -35,6 +37,7 @@
 
 #include <ldif.h>
 #include <lutil.h>
+#include <lutil_md5.h>
 
 #include "config.h"
 
@@ -86,11 +89,15 @@ static BerVarray authz_rewrites;
 #endif
 static AccessControl *defacl_parsed = NULL;
 
+/* Serializes olcAccess changes made without pausing the server */
+static ldap_pvt_thread_mutex_t config_acl_mutex;
+
 static struct berval cfdir;
 
 /* Private state */
 static AttributeDescription *cfAd_backend, *cfAd_database, *cfAd_overlay,
-	*cfAd_include, *cfAd_attr, *cfAd_oc, *cfAd_om, *cfAd_syntax;
+	*cfAd_include, *cfAd_attr, *cfAd_oc, *cfAd_om, *cfAd_syntax,
+	*cfAd_access;
 
 static ConfigFile *cfn;
 
@@ -128,6 +135,7 @@ static ConfigDriver config_tcp_buffer;
 static ConfigDriver config_rootdn;
 static ConfigDriver config_rootpw;
 static ConfigDriver config_restrict;
+static ConfigDriver config_opclass;
 static ConfigDriver config_allows;
 static ConfigDriver config_disallows;
 static ConfigDriver config_requires;
@@ -174,6 +182,9 @@ enum {
 	CFG_ATOPT,
 	CFG_ROOTDSE,
 	CFG_LOGFILE,
+	CFG_LOGASYNC,
+	CFG_PROFILE,
+	CFG_TRACEFILE,
 	CFG_PLUGIN,
 	CFG_MODLOAD,
 	CFG_MODPATH,
@@ -199,10 +210,14 @@ enum {
 	CFG_IX_HASH64,
 	CFG_DISABLED,
 	CFG_THREADQS,
+	CFG_THREADAFF,
 	CFG_TLS_ECNAME,
 	CFG_TLS_CACERT,
 	CFG_TLS_CERT,
 	CFG_TLS_KEY,
+	CFG_GLUE_PARALLEL,
+	CFG_PW_THREADS,
+	CFG_READ_CACHE,
 
 	CFG_LAST
 };
@@ -344,6 +359,14 @@ static ConfigTable config_back_cf_table[] = {
 		&config_generic, "( OLcfgGlAt:7 NAME 'olcAuthzPolicy' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "authz-cache-size", "entries", 2, 2, 0, ARG_INT,
+		&slap_authz_cache_size, "( OLcfgGlAt:113 NAME 'olcAuthzCacheSize' "
+			"DESC 'Number of positive authz decisions and SASL name mappings to cache' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "authz-cache-ttl", "seconds", 2, 2, 0, ARG_INT,
+		&slap_authz_cache_ttl, "( OLcfgGlAt:114 NAME 'olcAuthzCacheTTL' "
+			"DESC 'Lifetime of cached authz decisions' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "authz-regexp", "regexp> <DN", 3, 3, 0, ARG_MAGIC|CFG_AZREGEXP|ARG_NO_INSERT,
 		&config_generic, "( OLcfgGlAt:8 NAME 'olcAuthzRegexp' "
 			"EQUALITY caseIgnoreMatch "
@@ -363,6 +386,18 @@ static ConfigTable config_back_cf_table[] = {
 	{ "conn_max_pending_auth", "max", 2, 2, 0, ARG_INT,
 		&slap_conn_max_pending_auth, "( OLcfgGlAt:12 NAME 'olcConnMaxPendingAuth' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "conn_max_pdus", "max", 2, 2, 0, ARG_INT,
+		&slap_conn_max_pdus, "( OLcfgGlAt:102 NAME 'olcConnMaxPDUs' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "conn_output_buffer", "bytes", 2, 2, 0, ARG_INT,
+		&slap_conn_output_buffer, "( OLcfgGlAt:103 NAME 'olcConnOutputBuffer' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "conn_group_cache", "max", 2, 2, 0, ARG_INT,
+		&slap_conn_group_cache, "( OLcfgGlAt:106 NAME 'olcConnGroupCache' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "conn_set_cache", "max", 2, 2, 0, ARG_INT,
+		&slap_conn_set_cache, "( OLcfgGlAt:118 NAME 'olcConnSetCache' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "database", "type", 2, 2, 0, ARG_MAGIC|CFG_DATABASE,
 		&config_generic, "( OLcfgGlAt:13 NAME 'olcDatabase' "
 			"DESC 'The backend type for a database instance' "
@@ -377,6 +412,9 @@ static ConfigTable config_back_cf_table[] = {
 		&config_disallows, "( OLcfgGlAt:15 NAME 'olcDisallows' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "dn_cache_size", "entries", 2, 2, 0, ARG_INT,
+		&slap_dn_cache_size, "( OLcfgGlAt:107 NAME 'olcDnCacheSize' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "ditcontentrule",	NULL, 0, 0, 0, ARG_MAGIC|CFG_DIT|ARG_NO_DELETE|ARG_NO_INSERT,
 		&config_generic, "( OLcfgGlAt:16 NAME 'olcDitContentRules' "
 			"DESC 'OpenLDAP DIT content rules' "
@@ -396,6 +434,10 @@ static ConfigTable config_back_cf_table[] = {
 #endif
 		"( OLcfgGlAt:17 NAME 'olcGentleHUP' "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "glue_parallel", "on|off", 2, 2, 0, ARG_DB|ARG_ON_OFF|ARG_MAGIC|CFG_GLUE_PARALLEL,
+		&config_generic, "( OLcfgDbAt:0.22 NAME 'olcGlueParallel' "
+			"DESC 'Search glued subordinate databases concurrently' "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "hidden", "on|off", 2, 2, 0, ARG_DB|ARG_ON_OFF|ARG_MAGIC|CFG_HIDDEN,
 		&config_generic, "( OLcfgDbAt:0.17 NAME 'olcHidden' "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
@@ -449,6 +491,9 @@ static ConfigTable config_back_cf_table[] = {
 	{ "localSSF", "ssf", 2, 2, 0, ARG_INT,
 		&local_ssf, "( OLcfgGlAt:26 NAME 'olcLocalSSF' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "logasync", "bytes", 2, 2, 0, ARG_BER_LEN_T|ARG_MAGIC|CFG_LOGASYNC,
+		&config_generic, "( OLcfgGlAt:108 NAME 'olcLogAsync' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "logfile", "file", 2, 2, 0, ARG_STRING|ARG_MAGIC|CFG_LOGFILE,
 		&config_generic, "( OLcfgGlAt:27 NAME 'olcLogFile' "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
@@ -459,6 +504,9 @@ static ConfigTable config_back_cf_table[] = {
 	{ "maxDerefDepth", "depth", 2, 2, 0, ARG_DB|ARG_INT|ARG_MAGIC|CFG_DEPTH,
 		&config_generic, "( OLcfgDbAt:0.6 NAME 'olcMaxDerefDepth' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "mem_budget", "bytes", 2, 2, 0, ARG_BER_LEN_T,
+		&slap_mem_budget, "( OLcfgGlAt:119 NAME 'olcMemBudget' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "mirrormode", "on|off", 2, 2, 0, ARG_DB|ARG_ON_OFF|ARG_MAGIC|CFG_MIRRORMODE,
 		&config_generic, "( OLcfgDbAt:0.16 NAME 'olcMirrorMode' "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
@@ -495,9 +543,39 @@ static ConfigTable config_back_cf_table[] = {
 			"EQUALITY caseIgnoreMatch "
 			"SUBSTR caseIgnoreSubstringsMatch "
 			"SYNTAX OMsDirectoryString X-ORDERED 'VALUES' )", NULL, NULL },
+	{ "opclass", "class> <limits", 2, 4, 0,
+#ifdef NO_THREADS
+		ARG_IGNORED, NULL,
+#else
+		ARG_MAGIC, &config_opclass,
+#endif
+		"( OLcfgGlAt:101 NAME 'olcOpClass' "
+			"DESC 'Scheduling limits of an operation class' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "op_mem_budget", "bytes", 2, 2, 0, ARG_BER_LEN_T,
+		&slap_op_mem_budget, "( OLcfgGlAt:120 NAME 'olcOpMemBudget' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "overlay", "overlay", 2, 2, 0, ARG_MAGIC,
 		&config_overlay, "( OLcfgGlAt:34 NAME 'olcOverlay' "
 			"SUP olcDatabase SINGLE-VALUE X-ORDERED 'SIBLINGS' )", NULL, NULL },
+	{ "password-cache-size", "entries", 2, 2, 0, ARG_INT,
+		&slap_passwd_cache_size, "( OLcfgGlAt:116 NAME 'olcPasswordCacheSize' "
+			"DESC 'Number of successful password checks to remember' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "password-cache-ttl", "seconds", 2, 2, 0, ARG_INT,
+		&slap_passwd_cache_ttl, "( OLcfgGlAt:117 NAME 'olcPasswordCacheTTL' "
+			"DESC 'Lifetime of remembered password checks' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "password-check-threads", "count", 2, 2, 0,
+#ifdef NO_THREADS
+		ARG_IGNORED, NULL,
+#else
+		ARG_INT|ARG_MAGIC|CFG_PW_THREADS, &config_generic,
+#endif
+		"( OLcfgGlAt:115 NAME 'olcPasswordCheckThreads' "
+			"DESC 'Maximum number of concurrent password verifications' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "password-crypt-salt-format", "salt", 2, 2, 0, ARG_STRING|ARG_MAGIC|CFG_SALT,
 		&config_generic, "( OLcfgGlAt:35 NAME 'olcPasswordCryptSaltFormat' "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
@@ -525,9 +603,19 @@ static ConfigTable config_back_cf_table[] = {
 #endif
 		"( OLcfgGlAt:39 NAME 'olcPluginLogFile' "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "profile_interval", "msec", 2, 2, 0, ARG_INT|ARG_MAGIC|CFG_PROFILE,
+		&config_generic, "( OLcfgGlAt:111 NAME 'olcProfileInterval' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "readonly", "on|off", 2, 2, 0, ARG_MAY_DB|ARG_ON_OFF|ARG_MAGIC|CFG_RO,
 		&config_generic, "( OLcfgGlAt:40 NAME 'olcReadOnly' "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "read_cache", "on|off", 2, 2, 0, ARG_DB|ARG_ON_OFF|ARG_MAGIC|CFG_READ_CACHE,
+		&config_generic, "( OLcfgDbAt:0.23 NAME 'olcReadCache' "
+			"DESC 'Answer base scope reads from the read cache' "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "read_cache_size", "entries", 2, 2, 0, ARG_INT,
+		&slap_read_cache_size, "( OLcfgGlAt:121 NAME 'olcReadCacheSize' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "referral", "url", 2, 2, 0, ARG_MAGIC,
 		&config_referral, "( OLcfgGlAt:41 NAME 'olcReferral' "
 			"SUP labeledURI SINGLE-VALUE )", NULL, NULL },
@@ -645,6 +733,18 @@ static ConfigTable config_back_cf_table[] = {
 	{ "sizelimit", "limit",	2, 0, 0, ARG_MAY_DB|ARG_MAGIC,
 		&config_sizelimit, "( OLcfgGlAt:60 NAME 'olcSizeLimit' "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "slab_max_size", "bytes", 2, 2, 0, ARG_BER_LEN_T,
+		&slap_slab_max_size, "( OLcfgGlAt:105 NAME 'olcSlabMaxSize' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "slab_size", "bytes", 2, 2, 0, ARG_BER_LEN_T,
+		&slap_slab_size, "( OLcfgGlAt:104 NAME 'olcSlabSize' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "slowop_entries", "count", 2, 2, 0, ARG_INT,
+		&slap_slowop_entries, "( OLcfgGlAt:110 NAME 'olcSlowOpEntries' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "slowop_threshold", "msec", 2, 2, 0, ARG_INT,
+		&slap_slowop_threshold, "( OLcfgGlAt:109 NAME 'olcSlowOpThreshold' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "sockbuf_max_incoming", "max", 2, 2, 0, ARG_BER_LEN_T,
 		&sockbuf_max_incoming, "( OLcfgGlAt:61 NAME 'olcSockbufMaxIncoming' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
@@ -696,6 +796,14 @@ static ConfigTable config_back_cf_table[] = {
 #endif
 		"( OLcfgGlAt:95 NAME 'olcThreadQueues' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "threadaffinity", "on|off", 2, 2, 0,
+#ifdef NO_THREADS
+		ARG_IGNORED, NULL,
+#else
+		ARG_ON_OFF|ARG_MAGIC|CFG_THREADAFF, &config_generic,
+#endif
+		"( OLcfgGlAt:100 NAME 'olcThreadAffinity' "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "timelimit", "limit", 2, 0, 0, ARG_MAY_DB|ARG_MAGIC,
 		&config_timelimit, "( OLcfgGlAt:67 NAME 'olcTimeLimit' "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
@@ -825,6 +933,9 @@ static ConfigTable config_back_cf_table[] = {
 	{ "tool-threads", "count", 2, 2, 0, ARG_INT|ARG_MAGIC|CFG_TTHREADS,
 		&config_generic, "( OLcfgGlAt:80 NAME 'olcToolThreads' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "tracefile", "file", 2, 2, 0, ARG_STRING|ARG_MAGIC|CFG_TRACEFILE,
+		&config_generic, "( OLcfgGlAt:112 NAME 'olcTraceFile' "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "ucdata-path", "path", 2, 2, 0, ARG_IGNORED,
 		NULL, NULL, NULL, NULL },
 	{ "updatedn", "dn", 2, 2, 0, ARG_DB|ARG_DN|ARG_QUOTE|ARG_MAGIC,
@@ -878,29 +989,35 @@ static ConfigOCs cf_ocs[] = {
 		"SUP olcConfig STRUCTURAL "
 		"MAY ( cn $ olcConfigFile $ olcConfigDir $ olcAllows $ olcArgsFile $ "
 		 "olcAttributeOptions $ olcAuthIDRewrite $ "
-		 "olcAuthzPolicy $ olcAuthzRegexp $ olcConcurrency $ "
-		 "olcConnMaxPending $ olcConnMaxPendingAuth $ "
-		 "olcDisallows $ olcGentleHUP $ olcIdleTimeout $ "
+		 "olcAuthzPolicy $ olcAuthzRegexp $ olcAuthzCacheSize $ olcAuthzCacheTTL $ "
+		 "olcConcurrency $ "
+		 "olcConnMaxPending $ olcConnMaxPendingAuth $ olcConnMaxPDUs $ "
+		 "olcConnOutputBuffer $ olcConnGroupCache $ olcConnSetCache $ "
+		 "olcDisallows $ olcDnCacheSize $ olcGentleHUP $ olcIdleTimeout $ "
 		 "olcIndexSubstrIfMaxLen $ olcIndexSubstrIfMinLen $ "
 		 "olcIndexSubstrAnyLen $ olcIndexSubstrAnyStep $ olcIndexHash64 $ "
 		 "olcIndexIntLen $ "
-		 "olcListenerThreads $ olcLocalSSF $ olcLogFile $ olcLogLevel $ "
+		 "olcListenerThreads $ olcLocalSSF $ olcLogAsync $ olcLogFile $ olcLogLevel $ "
+		 "olcMemBudget $ olcOpClass $ olcOpMemBudget $ "
+		 "olcPasswordCacheSize $ olcPasswordCacheTTL $ olcPasswordCheckThreads $ "
 		 "olcPasswordCryptSaltFormat $ olcPasswordHash $ olcPidFile $ "
-		 "olcPluginLogFile $ olcReadOnly $ olcReferral $ "
+		 "olcPluginLogFile $ olcProfileInterval $ olcReadCacheSize $ olcReadOnly $ olcReferral $ "
 		 "olcReplogFile $ olcRequires $ olcRestrict $ olcReverseLookup $ "
 		 "olcRootDSE $ "
 		 "olcSaslAuxprops $ olcSaslAuxpropsDontUseCopy $ olcSaslAuxpropsDontUseCopyIgnore $ "
 		 "olcSaslHost $ olcSaslRealm $ olcSaslSecProps $ "
 		 "olcSecurity $ olcServerID $ olcSizeLimit $ "
+		 "olcSlabSize $ olcSlabMaxSize $ "
+		 "olcSlowOpEntries $ olcSlowOpThreshold $ "
 		 "olcSockbufMaxIncoming $ olcSockbufMaxIncomingAuth $ "
 		 "olcTCPBuffer $ "
-		 "olcThreads $ olcThreadQueues $ "
+		 "olcThreads $ olcThreadQueues $ olcThreadAffinity $ "
 		 "olcTimeLimit $ olcTLSCACertificateFile $ "
 		 "olcTLSCACertificatePath $ olcTLSCertificateFile $ "
 		 "olcTLSCertificateKeyFile $ olcTLSCipherSuite $ olcTLSCRLCheck $ "
 		 "olcTLSCACertificate $ olcTLSCertificate $ olcTLSCertificateKey $ "
 		 "olcTLSRandFile $ olcTLSVerifyClient $ olcTLSDHParamFile $ olcTLSECName $ "
-		 "olcTLSCRLFile $ olcTLSProtocolMin $ olcToolThreads $ olcWriteTimeout $ "
+		 "olcTLSCRLFile $ olcTLSProtocolMin $ olcToolThreads $ olcTraceFile $ olcWriteTimeout $ "
 		 "olcObjectIdentifier $ olcAttributeTypes $ olcObjectClasses $ "
 		 "olcDitContentRules $ olcLdapSyntaxes ) )", Cft_Global },
 	{ "( OLcfgGlOc:2 "
@@ -921,8 +1038,8 @@ static ConfigOCs cf_ocs[] = {
 		"SUP olcConfig STRUCTURAL "
 		"MUST olcDatabase "
 		"MAY ( olcDisabled $ olcHidden $ olcSuffix $ olcSubordinate $ olcAccess $ "
-		 "olcAddContentAcl $ olcLastMod $ olcLimits $ "
-		 "olcMaxDerefDepth $ olcPlugin $ olcReadOnly $ olcReplica $ "
+		 "olcGlueParallel $ olcAddContentAcl $ olcLastMod $ olcLimits $ "
+		 "olcMaxDerefDepth $ olcPlugin $ olcReadCache $ olcReadOnly $ olcReplica $ "
 		 "olcReplicaArgsFile $ olcReplicaPidFile $ olcReplicationInterval $ "
 		 "olcReplogFile $ olcRequires $ olcRestrict $ olcRootDN $ olcRootPW $ "
 		 "olcSchemaDN $ olcSecurity $ olcSizeLimit $ olcSyncUseSubentry $ olcSyncrepl $ "
@@ -1001,6 +1118,12 @@ config_generic(ConfigArgs *c) {
 		case CFG_THREADQS:
 			c->value_int = connection_pool_queues;
 			break;
+		case CFG_PW_THREADS:
+			c->value_int = slap_passwd_threads;
+			break;
+		case CFG_THREADAFF:
+			c->value_int = connection_pool_affinity;
+			break;
 		case CFG_TTHREADS:
 			c->value_int = slap_tool_thread_max;
 			break;
@@ -1252,6 +1375,24 @@ config_generic(ConfigArgs *c) {
 				rc = 1;
 			}
 			break;
+		case CFG_LOGASYNC:
+			if ( slap_log_async_size )
+				c->value_ber_t = slap_log_async_size;
+			else
+				rc = 1;
+			break;
+		case CFG_PROFILE:
+			if ( slap_profile_interval )
+				c->value_int = slap_profile_interval;
+			else
+				rc = 1;
+			break;
+		case CFG_TRACEFILE:
+			if ( slap_trace_file )
+				c->value_string = ch_strdup( slap_trace_file );
+			else
+				rc = 1;
+			break;
 		case CFG_LOGFILE:
 			if ( logfileName )
 				c->value_string = ch_strdup( logfileName );
@@ -1264,6 +1405,12 @@ config_generic(ConfigArgs *c) {
 		case CFG_SYNC_SUBENTRY:
 			c->value_int = (SLAP_SYNC_SUBENTRY(c->be) != 0);
 			break;
+		case CFG_GLUE_PARALLEL:
+			c->value_int = (SLAP_GLUE_PARALLEL(c->be) != 0);
+			break;
+		case CFG_READ_CACHE:
+			c->value_int = (SLAP_READ_CACHE(c->be) != 0);
+			break;
 		case CFG_MIRRORMODE:
 			if ( SLAP_SHADOW(c->be))
 				c->value_int = (SLAP_MULTIMASTER(c->be) != 0);
@@ -1369,7 +1516,9 @@ config_generic(ConfigArgs *c) {
 		case CFG_CONCUR:
 		case CFG_THREADS:
 		case CFG_THREADQS:
+		case CFG_THREADAFF:
 		case CFG_TTHREADS:
+		case CFG_PW_THREADS:
 		case CFG_LTHREADS:
 		case CFG_RO:
 		case CFG_AZPOLICY:
@@ -1381,6 +1530,11 @@ config_generic(ConfigArgs *c) {
 		case CFG_SSTR_IF_MIN:
 		case CFG_ACL_ADD:
 		case CFG_SYNC_SUBENTRY:
+		case CFG_GLUE_PARALLEL:
+			break;
+
+		case CFG_READ_CACHE:
+			SLAP_DBFLAGS(c->be) &= ~SLAP_DBFLAG_READ_CACHE;
 			break;
 
 		/* no-ops, requires slapd restart */
@@ -1431,6 +1585,23 @@ config_generic(ConfigArgs *c) {
 			passwd_salt = NULL;
 			break;
 
+		case CFG_LOGASYNC:
+			slap_log_async_size = 0;
+			slap_log_async = 0;
+			break;
+
+		case CFG_PROFILE:
+			slap_profile_interval = 0;
+			slap_profile_stop();
+			break;
+
+		case CFG_TRACEFILE:
+			/* the flush task stays, it has nothing to write */
+			ch_free( slap_trace_file );
+			slap_trace_file = NULL;
+			slap_trace_reopen();
+			break;
+
 		case CFG_LOGFILE:
 			ch_free( logfileName );
 			logfileName = NULL;
@@ -1766,6 +1937,24 @@ config_generic(ConfigArgs *c) {
 			connection_pool_queues = c->value_int;	/* save for reference */
 			break;
 
+		case CFG_PW_THREADS:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"password-check-threads=%d must not be negative",
+					c->value_int );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg, 0 );
+				return 1;
+			}
+			slap_passwd_threads_set( c->value_int );
+			break;
+
+		case CFG_THREADAFF:
+			if ( slapMode & SLAP_SERVER_MODE )
+				ldap_pvt_thread_pool_affinity(&connection_pool, c->value_int);
+			connection_pool_affinity = c->value_int;	/* save for reference */
+			break;
+
 		case CFG_TTHREADS:
 			if ( slapMode & SLAP_TOOL_MODE )
 				ldap_pvt_thread_pool_maxthreads(&connection_pool, c->value_int);
@@ -2194,6 +2383,60 @@ sortval_reject:
 					ldap_free_urldesc( lud );
 			}
 			break;
+		case CFG_LOGASYNC:
+#ifndef SLAP_LOG_ASYNC
+			if ( c->value_ber_t ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> not supported by this build", c->argv[0] );
+				Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+				return 1;
+			}
+#endif
+			slap_log_async_size = c->value_ber_t;
+			if ( !slap_log_async_size ) {
+				slap_log_async = 0;
+			} else if ( slapMode & SLAP_SERVER_RUNNING ) {
+				/* set online, the logger may already be running */
+				if ( slap_log_start() ) {
+					snprintf( c->cr_msg, sizeof( c->cr_msg ),
+						"<%s> unable to start logger thread", c->argv[0] );
+					Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+					return 1;
+				}
+			}
+			break;
+
+		case CFG_PROFILE:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> invalid interval", c->argv[0] );
+				Debug( LDAP_DEBUG_ANY, "%s: %s %d\n",
+					c->log, c->cr_msg, c->value_int );
+				return 1;
+			}
+			/* samples taken at another rate don't add up */
+			slap_profile_reset();
+			slap_profile_interval = c->value_int;
+			if ( !slap_profile_interval ) {
+				slap_profile_stop();
+			} else if ( slapMode & SLAP_SERVER_RUNNING ) {
+				if ( slap_profile_start() ) {
+					snprintf( c->cr_msg, sizeof( c->cr_msg ),
+						"<%s> unable to start sampler thread", c->argv[0] );
+					Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+					return 1;
+				}
+			}
+			break;
+
+		case CFG_TRACEFILE:
+			ch_free( slap_trace_file );
+			slap_trace_file = c->value_string;
+			slap_trace_reopen();
+			if ( slapMode & SLAP_SERVER_RUNNING )
+				slap_trace_start();
+			break;
+
 		case CFG_LOGFILE: {
 				if ( logfileName ) ch_free( logfileName );
 				logfileName = c->value_string;
@@ -2276,6 +2519,20 @@ sortval_reject:
 				SLAP_DBFLAGS(c->be) &= ~SLAP_DBFLAG_SYNC_SUBENTRY;
 			break;
 
+		case CFG_GLUE_PARALLEL:
+			if (c->value_int)
+				SLAP_DBFLAGS(c->be) |= SLAP_DBFLAG_GLUE_PARALLEL;
+			else
+				SLAP_DBFLAGS(c->be) &= ~SLAP_DBFLAG_GLUE_PARALLEL;
+			break;
+
+		case CFG_READ_CACHE:
+			if (c->value_int)
+				SLAP_DBFLAGS(c->be) |= SLAP_DBFLAG_READ_CACHE;
+			else
+				SLAP_DBFLAGS(c->be) &= ~SLAP_DBFLAG_READ_CACHE;
+			break;
+
 		case CFG_SSTR_IF_MAX:
 			if (c->value_uint < index_substr_if_minlen) {
 				snprintf( c->cr_msg, sizeof( c->cr_msg ), "<%s> invalid value", c->argv[0] );
@@ -3382,6 +3639,103 @@ config_restrict(ConfigArgs *c) {
 	return(0);
 }
 
+static slap_verbmasks opclass_names[] = {
+	{ BER_BVC("bind"),	SLAP_OPCLASS_BIND },
+	{ BER_BVC("write"),	SLAP_OPCLASS_WRITE },
+	{ BER_BVC("read"),	SLAP_OPCLASS_READ },
+	{ BER_BVC("expensive"),	SLAP_OPCLASS_EXPENSIVE },
+#ifdef HAVE_TLS
+	{ BER_BVC("tls"),	SLAP_OPCLASS_TLS },
+#endif
+	{ BER_BVNULL,	0 }
+};
+
+static int
+config_opclass(ConfigArgs *c) {
+	slap_opclass_t *oc;
+	int i, j, max = 0, max_pending = 0;
+
+	if (c->op == SLAP_CONFIG_EMIT) {
+		char buf[ 64 ];
+		struct berval bv;
+		int rc = 1;
+
+		for ( i = 0; !BER_BVISNULL( &opclass_names[i].word ); i++ ) {
+			oc = &slap_opclasses[ opclass_names[i].mask ];
+			if ( !oc->soc_conf )
+				continue;
+			bv.bv_val = buf;
+			bv.bv_len = snprintf( buf, sizeof( buf ), "%s",
+				opclass_names[i].word.bv_val );
+			if ( oc->soc_max )
+				bv.bv_len += snprintf( buf + bv.bv_len,
+					sizeof( buf ) - bv.bv_len, " threads=%d", oc->soc_max );
+			if ( oc->soc_max_pending )
+				bv.bv_len += snprintf( buf + bv.bv_len,
+					sizeof( buf ) - bv.bv_len, " pending=%d", oc->soc_max_pending );
+			value_add_one( &c->rvalue_vals, &bv );
+			rc = 0;
+		}
+		return rc;
+
+	} else if ( c->op == LDAP_MOD_DELETE ) {
+		for ( i = 0, j = 0; !BER_BVISNULL( &opclass_names[i].word ); i++ ) {
+			oc = &slap_opclasses[ opclass_names[i].mask ];
+			if ( !oc->soc_conf )
+				continue;
+			if ( c->valx < 0 || c->valx == j ) {
+				oc->soc_conf = 0;
+				oc->soc_max = 0;
+				oc->soc_max_pending = 0;
+			}
+			j++;
+		}
+		/* a tls limit alone doesn't reorder the pool */
+		for ( i = 0; i < SLAP_OPCLASS_TLS; i++ )
+			if ( slap_opclasses[i].soc_conf )
+				break;
+		slap_opclass_enabled = i < SLAP_OPCLASS_TLS;
+		connection_opclass_update();
+		return 0;
+	}
+
+	i = verb_to_mask( c->argv[1], opclass_names );
+	if ( BER_BVISNULL( &opclass_names[i].word )) {
+		snprintf( c->cr_msg, sizeof( c->cr_msg ), "<%s> unknown class", c->argv[0] );
+		Debug( LDAP_DEBUG_ANY, "%s: %s \"%s\"\n",
+			c->log, c->cr_msg, c->argv[1] );
+		return 1;
+	}
+	oc = &slap_opclasses[ opclass_names[i].mask ];
+
+	for ( j = 2; j < c->argc; j++ ) {
+		int *tgt = NULL;
+		char *val;
+
+		if ( !strncasecmp( c->argv[j], "threads=", STRLENOF("threads=") )) {
+			tgt = &max;
+			val = c->argv[j] + STRLENOF("threads=");
+		} else if ( !strncasecmp( c->argv[j], "pending=", STRLENOF("pending=") )) {
+			tgt = &max_pending;
+			val = c->argv[j] + STRLENOF("pending=");
+		}
+		if ( !tgt || lutil_atoi( tgt, val ) != 0 || *tgt < 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ), "<%s> invalid limit", c->argv[0] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s \"%s\"\n",
+				c->log, c->cr_msg, c->argv[j] );
+			return 1;
+		}
+	}
+
+	oc->soc_max = max;
+	oc->soc_max_pending = max_pending;
+	oc->soc_conf = 1;
+	if ( opclass_names[i].mask != SLAP_OPCLASS_TLS )
+		slap_opclass_enabled = 1;
+	connection_opclass_update();
+	return 0;
+}
+
 static int
 config_allows(ConfigArgs *c) {
 	slap_mask_t allows = 0;
@@ -4214,8 +4568,181 @@ typedef struct setup_cookie {
 	Entry *config;
 	int got_frontend;
 	int got_config;
+	struct berval snap;	/* entries read, for the snapshot */
+	ber_len_t snapsize;
 } setup_cookie;
 
+/*
+ * The entries read from the config directory are also saved, in the
+ * order they were read, in a single LDIF file next to them. The file
+ * starts with a fingerprint of the names, sizes, inodes, mtimes and
+ * ctimes of the .ldif files of the tree; when it still matches, slapd
+ * reads the snapshot instead of walking, opening and sorting hundreds
+ * of files. Any change to the directory, by slapd or by hand, changes
+ * the fingerprint and the tree is read in full again.
+ *
+ * The times only have a resolution of one second, so a file changed in
+ * the same second as the fingerprint was taken could change again
+ * unnoticed. No snapshot is written then, nor when the fingerprint
+ * differs after the tree was read from what it was before.
+ */
+#define	CONFIG_SNAP	"cn=config.snapshot"
+#define	CONFIG_SNAP_MAGIC	"# slapd config snapshot 1 "
+
+static void
+config_snap_walk( lutil_MD5_CTX *ctx, char *path, size_t len, size_t max,
+	time_t *newest )
+{
+	DIR *dir;
+	struct dirent *de;
+	struct stat st;
+	char buf[128];
+	size_t n;
+
+	dir = opendir( path );
+	if ( dir == NULL )
+		return;
+	while (( de = readdir( dir )) != NULL ) {
+		if ( de->d_name[0] == '.' )
+			continue;
+		n = strlen( de->d_name );
+		if ( len + 1 + n >= max )
+			continue;
+		path[len] = LDAP_DIRSEP[0];
+		strcpy( path + len + 1, de->d_name );
+		if ( stat( path, &st ) < 0 )
+			continue;
+		if ( S_ISDIR( st.st_mode )) {
+			config_snap_walk( ctx, path, len + 1 + n, max, newest );
+		} else if ( n > STRLENOF( ".ldif" ) &&
+			!strcmp( de->d_name + n - STRLENOF( ".ldif" ), ".ldif" ))
+		{
+			lutil_MD5Update( ctx, (unsigned char *)path + len, n + 1 );
+			n = snprintf( buf, sizeof( buf ), "%lu %lu %ld %ld\n",
+				(unsigned long)st.st_size, (unsigned long)st.st_ino,
+				(long)st.st_mtime, (long)st.st_ctime );
+			lutil_MD5Update( ctx, (unsigned char *)buf, n );
+			if ( *newest < st.st_mtime )
+				*newest = st.st_mtime;
+			if ( *newest < st.st_ctime )
+				*newest = st.st_ctime;
+		}
+	}
+	closedir( dir );
+	path[len] = '\0';
+}
+
+/* Fingerprint the config directory as a hex string, returns the
+ * time of the most recent change to a file in it
+ */
+static time_t
+config_snap_sum( const char *dir, char *hex )
+{
+	lutil_MD5_CTX ctx;
+	unsigned char digest[16];
+	char path[MAXPATHLEN];
+	size_t len;
+	time_t newest = 0;
+	int i;
+
+	len = lutil_strncopy( path, dir, sizeof( path ) - 1 ) - path;
+	path[len] = '\0';
+	lutil_MD5Init( &ctx );
+	config_snap_walk( &ctx, path, len, sizeof( path ), &newest );
+	lutil_MD5Final( digest, &ctx );
+	for ( i=0; i < 16; i++ )
+		sprintf( hex + 2*i, "%02x", digest[i] );
+	return newest;
+}
+
+/* Read the snapshot if it is still valid, returns the entries or NULL */
+static char *
+config_snap_read( const char *dir )
+{
+	char path[MAXPATHLEN], sum[33];
+	struct stat st;
+	char *buf = NULL;
+	ssize_t n;
+	int fd;
+
+	snprintf( path, sizeof( path ), "%s" LDAP_DIRSEP CONFIG_SNAP, dir );
+	fd = open( path, O_RDONLY );
+	if ( fd < 0 )
+		return NULL;
+	if ( fstat( fd, &st ) == 0 &&
+		st.st_size > STRLENOF( CONFIG_SNAP_MAGIC ) + 32 )
+	{
+		buf = ch_malloc( st.st_size + 1 );
+		n = read( fd, buf, st.st_size );
+		if ( n == st.st_size ) {
+			buf[n] = '\0';
+			config_snap_sum( dir, sum );
+			if ( !strncmp( buf, CONFIG_SNAP_MAGIC,
+					STRLENOF( CONFIG_SNAP_MAGIC )) &&
+				!strncmp( buf + STRLENOF( CONFIG_SNAP_MAGIC ), sum, 32 ) &&
+				buf[STRLENOF( CONFIG_SNAP_MAGIC ) + 32] == '\n' )
+			{
+				close( fd );
+				return buf;
+			}
+		}
+		ch_free( buf );
+		buf = NULL;
+	}
+	close( fd );
+	Debug( LDAP_DEBUG_CONFIG, "config_snap_read: "
+		"%s is out of date, reading %s\n", path, dir, 0 );
+	return NULL;
+}
+
+/* Replace the snapshot with the entries just read, if the directory
+ * still has the fingerprint taken before reading them
+ */
+static void
+config_snap_write( const char *dir, const char *before,
+	struct berval *entries )
+{
+	char path[MAXPATHLEN], tmp[MAXPATHLEN], sum[33];
+	FILE *fp;
+	int fd, rc = -1;
+
+	config_snap_sum( dir, sum );
+	if ( strcmp( sum, before )) {
+		Debug( LDAP_DEBUG_CONFIG, "config_snap_write: "
+			"%s changed while being read, no snapshot\n", dir, 0, 0 );
+		return;
+	}
+	if ( snprintf( path, sizeof( path ), "%s" LDAP_DIRSEP CONFIG_SNAP,
+			dir ) >= sizeof( path ) ||
+		snprintf( tmp, sizeof( tmp ), "%sXXXXXX", path ) >= sizeof( tmp ))
+	{
+		errno = ENAMETOOLONG;
+		goto fail;
+	}
+	fd = mkstemp( tmp );
+	if ( fd < 0 )
+		goto fail;
+	fp = fdopen( fd, "w" );
+	if ( fp == NULL ) {
+		close( fd );
+		unlink( tmp );
+		goto fail;
+	}
+	if ( fprintf( fp, CONFIG_SNAP_MAGIC "%s\n", sum ) > 0 &&
+		fwrite( entries->bv_val, 1, entries->bv_len, fp ) == entries->bv_len )
+		rc = 0;
+	if ( fclose( fp ) )
+		rc = -1;
+	if ( rc == 0 )
+		rc = rename( tmp, path );
+	if ( rc ) {
+		unlink( tmp );
+fail:
+		Debug( LDAP_DEBUG_ANY, "config_snap_write: "
+			"could not write %s: %s\n", path, STRERROR( errno ), 0 );
+	}
+}
+
 static int
 config_ldif_resp( Operation *op, SlapReply *rs )
 {
@@ -4286,6 +4813,16 @@ config_ldif_resp( Operation *op, SlapReply *rs )
 		}
 
 ok:
+		if ( sc->snap.bv_val ) {
+			entry2str_append( rs->sr_entry, &sc->snap, &sc->snapsize,
+				LDIF_LINE_WIDTH );
+			if ( sc->snap.bv_len + 2 > sc->snapsize ) {
+				sc->snapsize = sc->snap.bv_len + 2;
+				sc->snap.bv_val = ch_realloc( sc->snap.bv_val, sc->snapsize );
+			}
+			sc->snap.bv_val[sc->snap.bv_len++] = '\n';
+			sc->snap.bv_val[sc->snap.bv_len] = '\0';
+		}
 		rs->sr_err = config_add_internal( sc->cfb, rs->sr_entry, sc->ca, NULL, NULL, NULL );
 		if ( rs->sr_err != LDAP_SUCCESS ) {
 			Debug( LDAP_DEBUG_ANY, "config error processing %s: %s\n",
@@ -4312,6 +4849,8 @@ config_setup_ldif( BackendDB *be, const char *dir, int readit ) {
 	Filter filter = { LDAP_FILTER_PRESENT };
 	struct berval filterstr = BER_BVC("(objectclass=*)");
 	struct stat st;
+	char *snap, snapsum[33];
+	time_t newest;
 
 	/* Is the config directory available? */
 	if ( stat( dir, &st ) < 0 ) {
@@ -4395,6 +4934,8 @@ config_setup_ldif( BackendDB *be, const char *dir, int readit ) {
 		sc.got_config = 0;
 		sc.frontend = NULL;
 		sc.config = NULL;
+		BER_BVZERO( &sc.snap );
+		sc.snapsize = 0;
 
 		op->o_bd = &cfb->cb_db;
 		
@@ -4402,7 +4943,45 @@ config_setup_ldif( BackendDB *be, const char *dir, int readit ) {
 		prev_DN_strict = slap_DN_strict;
 		slap_DN_strict = 0;
 
-		rc = op->o_bd->be_search( op, &rs );
+		snap = config_snap_read( dir );
+		if ( snap ) {
+			char *next = strchr( snap, '\n' ) + 1, *ptr;
+
+			rc = LDAP_NO_SUCH_OBJECT;
+			rs.sr_type = REP_SEARCH;
+			for ( ptr = next; *ptr; ptr = next ) {
+				next = strstr( ptr, "\n\n" );
+				if ( next ) {
+					next[1] = '\0';
+					next += 2;
+				} else {
+					next = ptr + strlen( ptr );
+				}
+				rs.sr_entry = str2entry( ptr );
+				if ( rs.sr_entry == NULL ) {
+					rc = LDAP_OTHER;
+					break;
+				}
+				rc = config_ldif_resp( op, &rs );
+				entry_free( rs.sr_entry );
+				rs.sr_entry = NULL;
+				if ( rc != LDAP_SUCCESS )
+					break;
+			}
+			rs_reinit( &rs, REP_RESULT );
+			ch_free( snap );
+		} else {
+			if ( slapMode & SLAP_SERVER_MODE ) {
+				/* fingerprint the tree before reading it */
+				newest = config_snap_sum( dir, snapsum );
+				if ( newest < time( NULL )) {
+					sc.snapsize = 4096;
+					sc.snap.bv_val = ch_malloc( sc.snapsize );
+					sc.snap.bv_val[0] = '\0';
+				}
+			}
+			rc = op->o_bd->be_search( op, &rs );
+		}
 
 		/* Restore normal DN validation */
 		slap_DN_strict = prev_DN_strict;
@@ -4418,6 +4997,11 @@ config_setup_ldif( BackendDB *be, const char *dir, int readit ) {
 			op->ora_e = sc.config;
 			rc = op->o_bd->be_add( op, &rs );
 		}
+		/* Entries added just now are not in it, leave it for next time */
+		if ( rc == LDAP_SUCCESS && sc.snap.bv_val &&
+			!sc.frontend && !sc.config )
+			config_snap_write( dir, snapsum, &sc.snap );
+		ch_free( sc.snap.bv_val );
 		ldap_pvt_thread_pool_context_reset( thrctx );
 	}
 
@@ -5836,13 +6420,35 @@ config_modify_add( ConfigTable *ct, ConfigArgs *ca, AttributeDescription *ad,
 	return rc;
 }
 
+static void
+config_attrs_free( void *v )
+{
+	attrs_free( v );
+}
+
+static void
+config_acl_free( void *v )
+{
+	AccessControl *a, *n;
+
+	for ( a = v; a && a != defacl_parsed; a = n ) {
+		n = a->acl_next;
+		acl_free( a );
+	}
+}
+
+/* If shadow is set, the changes are applied to a copy of the entry and
+ * to shadow, a copy of the entry's database whose ACL list is rebuilt
+ * from scratch, so nothing that running operations look at is touched
+ * before the caller publishes the result.
+ */
 static int
 config_modify_internal( CfEntryInfo *ce, Operation *op, SlapReply *rs,
-	ConfigArgs *ca )
+	ConfigArgs *ca, BackendDB *shadow )
 {
 	int rc = LDAP_UNWILLING_TO_PERFORM;
 	Modifications *ml;
-	Entry *e = ce->ce_entry;
+	Entry *e = ce->ce_entry, shadow_e;
 	Attribute *save_attrs = e->e_attrs, *oc_at, *s, *a;
 	ConfigTable *ct;
 	ConfigOCs **colst;
@@ -5865,10 +6471,14 @@ config_modify_internal( CfEntryInfo *ce, Operation *op, SlapReply *rs,
 		s->a_flags &= ~(SLAP_ATTR_IXADD|SLAP_ATTR_IXDEL);
 	}
 
+	if ( shadow ) {
+		shadow_e = *e;
+		e = &shadow_e;
+	}
 	e->e_attrs = attrs_dup( e->e_attrs );
 
 	init_config_argv( ca );
-	ca->be = ce->ce_be;
+	ca->be = shadow ? shadow : ce->ce_be;
 	ca->bi = ce->ce_bi;
 	ca->ca_private = ce->ce_private;
 	ca->ca_entry = e;
@@ -5876,6 +6486,25 @@ config_modify_internal( CfEntryInfo *ce, Operation *op, SlapReply *rs,
 	ca->ca_op = op;
 	strcpy( ca->log, "back-config" );
 
+	if ( shadow ) {
+		shadow->be_acl = NULL;
+		a = attr_find( save_attrs, cfAd_access );
+		ct = config_find_table( colst, nocs, cfAd_access, ca );
+		for ( i = 0; a && ct && !BER_BVISNULL( &a->a_vals[i] ); i++ ) {
+			ca->line = a->a_vals[i].bv_val;
+			ca->linelen = a->a_vals[i].bv_len;
+			rc = config_modify_add( ct, ca, cfAd_access, i );
+			if ( rc ) {
+				snprintf( ca->cr_msg, sizeof( ca->cr_msg ),
+					"cannot rebuild %s", cfAd_access->ad_cname.bv_val );
+				goto out_noop;
+			}
+		}
+		if ( SLAP_CONFIG( shadow ) && !shadow->be_acl )
+			shadow->be_acl = defacl_parsed;
+		rc = LDAP_UNWILLING_TO_PERFORM;
+	}
+
 	for (ml = op->orm_modlist; ml; ml=ml->sml_next) {
 		ct = config_find_table( colst, nocs, ml->sml_desc, ca );
 		switch (ml->sml_op) {
@@ -6151,7 +6780,12 @@ out:
 	}
 out_noop:
 	if ( rc == LDAP_SUCCESS ) {
-		attrs_free( save_attrs );
+		if ( shadow ) {
+			ce->ce_entry->e_attrs = e->e_attrs;
+			slap_retire( config_attrs_free, save_attrs );
+		} else {
+			attrs_free( save_attrs );
+		}
 		rs->sr_text = NULL;
 	} else {
 		attrs_free( e->e_attrs );
@@ -6178,7 +6812,8 @@ config_back_modify( Operation *op, SlapReply *rs )
 	struct berval rdn;
 	char *ptr;
 	AttributeDescription *rad = NULL;
-	int do_pause = 1;
+	BackendDB shadow, *sbe = NULL;
+	int do_pause = 1, acl_only;
 
 	cfb = (CfBackInfo *)op->o_bd->be_private;
 
@@ -6205,7 +6840,10 @@ config_back_modify( Operation *op, SlapReply *rs )
 	}
 
 	/* Some basic validation... */
+	acl_only = ce->ce_type == Cft_Database && ce->ce_be != NULL;
 	for ( ml = op->orm_modlist; ml; ml = ml->sml_next ) {
+		if ( ml->sml_desc != cfAd_access )
+			acl_only = 0;
 		/* Don't allow Modify of RDN; must use ModRdn for that. */
 		if ( ml->sml_desc == rad ) {
 			rs->sr_err = LDAP_NOT_ALLOWED_ON_RDN;
@@ -6221,6 +6859,19 @@ config_back_modify( Operation *op, SlapReply *rs )
 
 	slap_mods_opattrs( op, &op->orm_modlist, 1 );
 
+	/* A change to a database's olcAccess only needs a new ACL list.
+	 * Build it on a shadow copy of the database and publish it with
+	 * a single pointer store; operations already walking the old list
+	 * keep using it until the next pause frees it.
+	 */
+	if ( do_pause && acl_only ) {
+		ldap_pvt_thread_mutex_lock( &config_acl_mutex );
+		shadow = *ce->ce_be;
+		shadow.be_acl = NULL;
+		sbe = &shadow;
+		do_pause = 0;
+	}
+
 	if ( do_pause ) {
 		if ( op->o_abandon ) {
 			rs->sr_err = SLAPD_ABANDON;
@@ -6236,7 +6887,18 @@ config_back_modify( Operation *op, SlapReply *rs )
 	 * 3) perform the individual config operations.
 	 * 4) store Modified entry in underlying LDIF backend.
 	 */
-	rs->sr_err = config_modify_internal( ce, op, rs, &ca );
+	rs->sr_err = config_modify_internal( ce, op, rs, &ca, sbe );
+	if ( sbe ) {
+		if ( rs->sr_err == LDAP_SUCCESS ) {
+			AccessControl *old = ce->ce_be->be_acl;
+
+			ce->ce_be->be_acl = shadow.be_acl;
+			if ( old && old != defacl_parsed )
+				slap_retire( config_acl_free, old );
+		} else {
+			config_acl_free( shadow.be_acl );
+		}
+	}
 	if ( rs->sr_err ) {
 		rs->sr_text = ca.cr_msg;
 	} else if ( cfb->cb_use_ldif ) {
@@ -6262,6 +6924,8 @@ config_back_modify( Operation *op, SlapReply *rs )
 
 	if ( do_pause )
 		slap_unpause_server();
+	if ( sbe )
+		ldap_pvt_thread_mutex_unlock( &config_acl_mutex );
 out:
 	send_ldap_result( op, rs );
 	slap_graduate_commit_csn( op );
@@ -7447,6 +8111,7 @@ static int
 config_back_destroy( BackendInfo *bi )
 {
 	ldif_must_b64_encode_release();
+	ldap_pvt_thread_mutex_destroy( &config_acl_mutex );
 	return 0;
 }
 
@@ -7733,6 +8398,7 @@ static struct {
 	char *name;
 	AttributeDescription **desc;
 } ads[] = {
+	{ "access", &cfAd_access },
 	{ "attribute", &cfAd_attr },
 	{ "backend", &cfAd_backend },
 	{ "database", &cfAd_database },
@@ -7786,6 +8452,8 @@ config_back_initialize( BackendInfo *bi )
 
 	bi->bi_controls = controls;
 
+	ldap_pvt_thread_mutex_init( &config_acl_mutex );
+
 	bi->bi_open = 0;
 	bi->bi_close = 0;
 	bi->bi_config = 0;
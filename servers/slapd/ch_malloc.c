@@ -58,6 +58,7 @@ ch_malloc(
 		exit( EXIT_FAILURE );
 	}
 
+	slap_sl_mem_charge( size );
 	return( new );
 }
 
@@ -90,6 +91,7 @@ ch_realloc(
 		exit( EXIT_FAILURE );
 	}
 
+	slap_sl_mem_charge( size );
 	return( new );
 }
 
@@ -108,6 +110,7 @@ ch_calloc(
 		exit( EXIT_FAILURE );
 	}
 
+	slap_sl_mem_charge( nelem * size );
 	return( new );
 }
 
@@ -81,6 +81,17 @@ ber_len_t sockbuf_max_incoming_auth= SLAP_SB_MAX_INCOMING_AUTH;
 
 int	slap_conn_max_pending = SLAP_CONN_MAX_PENDING_DEFAULT;
 int	slap_conn_max_pending_auth = SLAP_CONN_MAX_PENDING_AUTH;
+int	slap_conn_max_pdus = SLAP_CONN_MAX_PDUS_DEFAULT;
+int	slap_conn_output_buffer = SLAP_CONN_OUTPUT_BUFFER_DEFAULT;
+int	slap_conn_group_cache = SLAP_CONN_GROUP_CACHE_DEFAULT;
+int	slap_conn_set_cache = 0;
+int	slap_dn_cache_size = SLAP_DN_CACHE_SIZE_DEFAULT;
+int	slap_read_cache_size = 0;
+
+ber_len_t slap_slab_size = SLAP_SLAB_SIZE;
+ber_len_t slap_slab_max_size = SLAP_SLAB_MAX_SIZE;
+ber_len_t slap_mem_budget = 0;
+ber_len_t slap_op_mem_budget = 0;
 
 char   *slapd_pid_file  = NULL;
 char   *slapd_args_file = NULL;
@@ -47,15 +47,54 @@
 #include "slapi/slapi.h"
 #endif
 
-/* protected by connections_mutex */
-static ldap_pvt_thread_mutex_t connections_mutex;
+/*
+ * The connection table is split into SLAP_CONN_SHARDS contiguous ranges
+ * of descriptors.  Each shard's cs_mutex protects c_struct_state of its
+ * slots, so accepts and closes on unrelated descriptors and walks over
+ * the table no longer serialize on one lock.  Lookup by descriptor is a
+ * plain index into connections[] and takes no shard lock at all.
+ */
+#define SLAP_CONN_SHARDS	16
+
+/* Shards swept by each connections_timeout_idle() call */
+#define SLAP_CONN_IDLE_SHARDS	(SLAP_CONN_SHARDS/2)
+
+typedef struct conn_shard {
+	ldap_pvt_thread_mutex_t cs_mutex;
+	int cs_nused;			/* slots in SLAP_C_USED */
+	char cs_pad[64];		/* keep shards off each other's cache lines */
+} conn_shard;
+
+static conn_shard conn_shards[SLAP_CONN_SHARDS];
+static ber_socket_t conn_shard_span;
+static int conn_idle_shard;		/* listener thread only */
 static Connection *connections = NULL;
 
+#define CONN_SHARD(s)	(&conn_shards[(s) / conn_shard_span])
+
 static ldap_pvt_thread_mutex_t conn_nextid_mutex;
 static unsigned long conn_nextid = SLAPD_SYNC_SYNCCONN_OFFSET;
 
 static const char conn_lost_str[] = "connection lost";
 
+/* protected by opclass_mutex, limits are set by the opclass directive */
+slap_opclass_t slap_opclasses[SLAP_OPCLASS_LAST];
+int slap_opclass_enabled;
+static ldap_pvt_thread_mutex_t opclass_mutex;
+
+#ifdef HAVE_TLS
+/* A connection waiting for a tls opclass slot to do its handshake */
+typedef struct conn_tls_wait {
+	LDAP_STAILQ_ENTRY(conn_tls_wait) tw_next;
+	ber_socket_t	tw_sd;
+	unsigned long	tw_connid;
+} conn_tls_wait;
+
+/* protected by opclass_mutex */
+static LDAP_STAILQ_HEAD(ctw, conn_tls_wait) conn_tls_waiting =
+	LDAP_STAILQ_HEAD_INITIALIZER(conn_tls_waiting);
+#endif
+
 const char *
 connection_state2str( int state )
 {
@@ -86,6 +125,14 @@ static void connection_close( Connection *c );
 
 static int connection_op_activate( Operation *op );
 static void connection_op_queue( Operation *op );
+static int connection_op_class( Operation *op );
+static int connection_opclass_submit( Operation *op );
+static void connection_opclass_release( int opclass );
+#ifdef HAVE_TLS
+static int connection_tls_admit( Connection *c );
+static void connection_tls_release( Connection *c );
+static void connection_tls_run( void );
+#endif
 static int connection_resched( Connection *conn );
 static void connection_abandon( Connection *conn );
 static void connection_destroy( Connection *c );
@@ -108,8 +155,16 @@ int connections_init(void)
 	}
 
 	/* should check return of every call */
-	ldap_pvt_thread_mutex_init( &connections_mutex );
+	for ( i = 0; i < SLAP_CONN_SHARDS; i++ ) {
+		ldap_pvt_thread_mutex_init( &conn_shards[i].cs_mutex );
+		conn_shards[i].cs_nused = 0;
+	}
+	conn_shard_span = ( dtblsize + SLAP_CONN_SHARDS - 1 ) / SLAP_CONN_SHARDS;
+	conn_idle_shard = 0;
 	ldap_pvt_thread_mutex_init( &conn_nextid_mutex );
+	ldap_pvt_thread_mutex_init( &opclass_mutex );
+	for ( i = 0; i < SLAP_OPCLASS_LAST; i++ )
+		LDAP_STAILQ_INIT( &slap_opclasses[i].soc_ops );
 
 	connections = (Connection *) ch_calloc( dtblsize, sizeof(Connection) );
 
@@ -153,6 +208,7 @@ int connections_destroy(void)
 		if( connections[i].c_struct_state != SLAP_C_UNINITIALIZED ) {
 			ber_sockbuf_free( connections[i].c_sb );
 			ldap_pvt_thread_mutex_destroy( &connections[i].c_mutex );
+			ldap_pvt_thread_mutex_destroy( &connections[i].c_groups_mutex );
 			ldap_pvt_thread_mutex_destroy( &connections[i].c_write1_mutex );
 			ldap_pvt_thread_cond_destroy( &connections[i].c_write1_cv );
 #ifdef LDAP_SLAPI
@@ -167,7 +223,16 @@ int connections_destroy(void)
 	free( connections );
 	connections = NULL;
 
-	ldap_pvt_thread_mutex_destroy( &connections_mutex );
+	for ( i = 0; i < SLAP_CONN_SHARDS; i++ )
+		ldap_pvt_thread_mutex_destroy( &conn_shards[i].cs_mutex );
+#ifdef HAVE_TLS
+	while ( !LDAP_STAILQ_EMPTY( &conn_tls_waiting )) {
+		conn_tls_wait *tw = LDAP_STAILQ_FIRST( &conn_tls_waiting );
+		LDAP_STAILQ_REMOVE_HEAD( &conn_tls_waiting, tw_next );
+		ch_free( tw );
+	}
+#endif
+	ldap_pvt_thread_mutex_destroy( &opclass_mutex );
 	ldap_pvt_thread_mutex_destroy( &conn_nextid_mutex );
 	return 0;
 }
@@ -202,36 +267,49 @@ int connections_shutdown(void)
 }
 
 /*
- * Timeout idle connections.
+ * Timeout idle connections.  Each call sweeps the next
+ * SLAP_CONN_IDLE_SHARDS shards of the table, so the listener never
+ * stalls on a full walk and a whole pass takes two calls.
  */
 int connections_timeout_idle(time_t now)
 {
-	int i = 0, writers = 0;
-	ber_socket_t connindex;
+	int i = 0, n;
+	ber_socket_t connindex, end;
 	Connection* c;
 
-	for( c = connection_first( &connindex );
-		c != NULL;
-		c = connection_next( c, &connindex ) )
-	{
-		/* Don't timeout a slow-running request or a persistent
-		 * outbound connection.
-		 */
-		if(( c->c_n_ops_executing && !c->c_writewaiter)
-			|| c->c_conn_state == SLAP_C_CLIENT ) {
+	for ( n = 0; n < SLAP_CONN_IDLE_SHARDS; n++ ) {
+		connindex = conn_idle_shard * conn_shard_span;
+		end = connindex + conn_shard_span;
+		if ( end > dtblsize ) end = dtblsize;
+		conn_idle_shard = ( conn_idle_shard + 1 ) % SLAP_CONN_SHARDS;
+		if ( connindex >= end || !CONN_SHARD( connindex )->cs_nused )
 			continue;
-		}
 
-		if( global_idletimeout && 
-			difftime( c->c_activitytime+global_idletimeout, now) < 0 ) {
-			/* close it */
-			connection_closing( c, "idletimeout" );
-			connection_close( c );
-			i++;
-			continue;
+		for( c = connection_next( NULL, &connindex );
+			c != NULL;
+			c = connection_next( c, &connindex ) )
+		{
+			if ( c->c_conn_idx >= end ) break;
+
+			/* Don't timeout a slow-running request or a persistent
+			 * outbound connection.
+			 */
+			if(( c->c_n_ops_executing && !c->c_writewaiter)
+				|| c->c_conn_state == SLAP_C_CLIENT ) {
+				continue;
+			}
+
+			if( global_idletimeout && 
+				difftime( c->c_activitytime+global_idletimeout, now) < 0 ) {
+				/* close it */
+				connection_closing( c, "idletimeout" );
+				connection_close( c );
+				i++;
+				continue;
+			}
 		}
+		connection_done( c );
 	}
-	connection_done( c );
 
 	return i;
 }
@@ -398,9 +476,19 @@ Connection * connection_init(
 		}
 
 		c->c_currentber = NULL;
+		c->c_outber = NULL;
+
+		c->c_groups = NULL;
+		BER_BVZERO( &c->c_groups_ndn );
+		c->c_ngroups = 0;
+		c->c_sets = NULL;
+		c->c_nsets = 0;
+		c->c_limits_be = NULL;
+		BER_BVZERO( &c->c_limits_ndn );
 
 		/* should check status of thread calls */
 		ldap_pvt_thread_mutex_init( &c->c_mutex );
+		ldap_pvt_thread_mutex_init( &c->c_groups_mutex );
 		ldap_pvt_thread_mutex_init( &c->c_write1_mutex );
 		ldap_pvt_thread_cond_init( &c->c_write1_cv );
 
@@ -442,10 +530,11 @@ Connection * connection_init(
 
 	if ( flags & CONN_IS_CLIENT ) {
 		c->c_connid = 0;
-		ldap_pvt_thread_mutex_lock( &connections_mutex );
+		ldap_pvt_thread_mutex_lock( &CONN_SHARD( s )->cs_mutex );
 		c->c_conn_state = SLAP_C_CLIENT;
 		c->c_struct_state = SLAP_C_USED;
-		ldap_pvt_thread_mutex_unlock( &connections_mutex );
+		CONN_SHARD( s )->cs_nused++;
+		ldap_pvt_thread_mutex_unlock( &CONN_SHARD( s )->cs_mutex );
 		c->c_close_reason = "?";			/* should never be needed */
 		ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_SET_FD, &sfd );
 		ldap_pvt_thread_mutex_unlock( &c->c_mutex );
@@ -508,8 +597,18 @@ Connection * connection_init(
 		ber_sockbuf_add_io( c->c_sb, &ber_sockbuf_io_debug,
 			LBER_SBIOD_LEVEL_PROVIDER, (void*)"tcp_" );
 #endif
+#ifdef SLAP_X_IO_URING
+		ber_sockbuf_add_io( c->c_sb, &slapd_sockbuf_io_uring,
+			LBER_SBIOD_LEVEL_PROVIDER, (void *)&sfd );
+#else
+		int ra = SLAP_CONN_READAHEAD;
+
 		ber_sockbuf_add_io( c->c_sb, &ber_sockbuf_io_tcp,
 			LBER_SBIOD_LEVEL_PROVIDER, (void *)&sfd );
+		/* let one read() pick up several pipelined PDUs */
+		ber_sockbuf_add_io( c->c_sb, &ber_sockbuf_io_readahead,
+			LBER_SBIOD_LEVEL_PROVIDER, (void *)&ra );
+#endif
 	}
 
 #ifdef LDAP_DEBUG
@@ -529,10 +628,11 @@ Connection * connection_init(
 	id = c->c_connid = conn_nextid++;
 	ldap_pvt_thread_mutex_unlock( &conn_nextid_mutex );
 
-	ldap_pvt_thread_mutex_lock( &connections_mutex );
+	ldap_pvt_thread_mutex_lock( &CONN_SHARD( s )->cs_mutex );
 	c->c_conn_state = SLAP_C_INACTIVE;
 	c->c_struct_state = SLAP_C_USED;
-	ldap_pvt_thread_mutex_unlock( &connections_mutex );
+	CONN_SHARD( s )->cs_nused++;
+	ldap_pvt_thread_mutex_unlock( &CONN_SHARD( s )->cs_mutex );
 	c->c_close_reason = "?";			/* should never be needed */
 
 	c->c_ssf = c->c_transport_ssf = ssf;
@@ -542,6 +642,7 @@ Connection * connection_init(
 	if ( flags & CONN_IS_TLS ) {
 		c->c_is_tls = 1;
 		c->c_needs_tls_accept = 1;
+		c->c_tls_slot = 0;
 	} else {
 		c->c_is_tls = 0;
 		c->c_needs_tls_accept = 0;
@@ -623,12 +724,18 @@ connection_destroy( Connection *c )
 	connid = c->c_connid;
 	close_reason = c->c_close_reason;
 
-	ldap_pvt_thread_mutex_lock( &connections_mutex );
+	ldap_pvt_thread_mutex_lock( &CONN_SHARD( c->c_conn_idx )->cs_mutex );
 	c->c_struct_state = SLAP_C_PENDING;
-	ldap_pvt_thread_mutex_unlock( &connections_mutex );
+	CONN_SHARD( c->c_conn_idx )->cs_nused--;
+	ldap_pvt_thread_mutex_unlock( &CONN_SHARD( c->c_conn_idx )->cs_mutex );
 
 	backend_connection_destroy(c);
 
+#ifdef HAVE_TLS
+	/* closed between getting a slot and using it */
+	connection_tls_release( c );
+#endif
+
 	c->c_protocol = 0;
 	c->c_connid = -1;
 
@@ -658,6 +765,20 @@ connection_destroy( Connection *c )
 		ber_free( c->c_currentber, 1 );
 		c->c_currentber = NULL;
 	}
+	if ( c->c_outber != NULL ) {
+		ber_free( c->c_outber, 1 );
+		c->c_outber = NULL;
+	}
+
+	ldap_pvt_thread_mutex_lock( &c->c_groups_mutex );
+	connection_groups_free( c );
+	connection_sets_free( c );
+	c->c_limits_be = NULL;
+	if ( !BER_BVISNULL( &c->c_limits_ndn ) ) {
+		ch_free( c->c_limits_ndn.bv_val );
+		BER_BVZERO( &c->c_limits_ndn );
+	}
+	ldap_pvt_thread_mutex_unlock( &c->c_groups_mutex );
 
 
 #ifdef LDAP_SLAPI
@@ -867,20 +988,15 @@ Connection* connection_first( ber_socket_t *index )
 	assert( connections != NULL );
 	assert( index != NULL );
 
-	ldap_pvt_thread_mutex_lock( &connections_mutex );
-	for( *index = 0; *index < dtblsize; (*index)++) {
-		if( connections[*index].c_struct_state != SLAP_C_UNINITIALIZED ) {
-			break;
-		}
-	}
-	ldap_pvt_thread_mutex_unlock( &connections_mutex );
-
+	*index = 0;
 	return connection_next(NULL, index);
 }
 
 /* Next connection in loop, see connection_first() */
 Connection* connection_next( Connection *c, ber_socket_t *index )
 {
+	conn_shard *cs = NULL;
+
 	assert( connections != NULL );
 	assert( index != NULL );
 	assert( *index <= dtblsize );
@@ -889,9 +1005,21 @@ Connection* connection_next( Connection *c, ber_socket_t *index )
 
 	c = NULL;
 
-	ldap_pvt_thread_mutex_lock( &connections_mutex );
 	for(; *index < dtblsize; (*index)++) {
 		int c_struct;
+
+		if ( cs != CONN_SHARD( *index )) {
+			if ( cs ) ldap_pvt_thread_mutex_unlock( &cs->cs_mutex );
+			cs = CONN_SHARD( *index );
+			if ( !cs->cs_nused ) {
+				/* nothing in use here, skip the whole shard */
+				*index = ( *index / conn_shard_span + 1 ) * conn_shard_span - 1;
+				cs = NULL;
+				continue;
+			}
+			ldap_pvt_thread_mutex_lock( &cs->cs_mutex );
+		}
+
 		if( connections[*index].c_struct_state == SLAP_C_UNINITIALIZED ) {
 			/* FIXME: accessing c_conn_state without locking c_mutex */
 			assert( connections[*index].c_conn_state == SLAP_C_INVALID );
@@ -902,12 +1030,13 @@ Connection* connection_next( Connection *c, ber_socket_t *index )
 			c = &connections[(*index)++];
 			if ( ldap_pvt_thread_mutex_trylock( &c->c_mutex )) {
 				/* avoid deadlock */
-				ldap_pvt_thread_mutex_unlock( &connections_mutex );
+				ldap_pvt_thread_mutex_unlock( &cs->cs_mutex );
 				ldap_pvt_thread_mutex_lock( &c->c_mutex );
-				ldap_pvt_thread_mutex_lock( &connections_mutex );
+				ldap_pvt_thread_mutex_lock( &cs->cs_mutex );
 				if ( c->c_struct_state != SLAP_C_USED ) {
 					ldap_pvt_thread_mutex_unlock( &c->c_mutex );
 					c = NULL;
+					(*index)--;
 					continue;
 				}
 			}
@@ -923,7 +1052,7 @@ Connection* connection_next( Connection *c, ber_socket_t *index )
 		assert( connections[*index].c_conn_state == SLAP_C_INVALID );
 	}
 
-	ldap_pvt_thread_mutex_unlock( &connections_mutex );
+	if ( cs ) ldap_pvt_thread_mutex_unlock( &cs->cs_mutex );
 	return c;
 }
 
@@ -942,27 +1071,64 @@ void connection_done( Connection *c )
  */
 
 #ifdef SLAPD_MONITOR
+/* Histogram bucket of a latency, see SLAP_LAT_BUCKETS */
+static int
+connection_lat_bucket( long usec )
+{
+	int n;
+
+	if ( usec < 4 )
+		return usec < 0 ? 0 : usec;
+	for ( n = 2; usec >> ( n + 1 ); n++ )
+		;
+	if ( n > 25 )
+		return SLAP_LAT_BUCKETS - 1;
+	return ( n - 1 ) * 4 + (( usec >> ( n - 2 )) & 3 );
+}
+
+/* Record how long op waited for a thread and how long it ran.
+ * o_counters must be locked.
+ */
+static void
+connection_op_latency( Operation *op, slap_op_t opidx )
+{
+	struct timeval now;
+	long wait, total;
+	unsigned long *lat = op->o_counters->sc_ops_latency_[opidx][0];
+
+	gettimeofday( &now, NULL );
+	wait = op->o_qtime.tv_sec * 1000000L + op->o_qtime.tv_usec;
+	total = ( now.tv_sec - op->o_time ) * 1000000L
+		+ now.tv_usec - op->o_tusec;
+
+	SLAP_COUNTER_INCR_UL( lat[ SLAP_LAT_WAIT * SLAP_LAT_BUCKETS +
+		connection_lat_bucket( wait ) ] );
+	SLAP_COUNTER_INCR_UL( lat[ SLAP_LAT_EXEC * SLAP_LAT_BUCKETS +
+		connection_lat_bucket( total - wait ) ] );
+}
+
 /* FIXME: returns 0 in case of failure */
 #define INCR_OP_INITIATED(index) \
 	do { \
-		ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex ); \
-		ldap_pvt_mp_add_ulong(op->o_counters->sc_ops_initiated_[(index)], 1); \
-		ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex ); \
+		SLAP_COUNTERS_LOCK( op->o_counters ); \
+		SLAP_COUNTER_ADD( op->o_counters->sc_ops_initiated_[(index)], 1 ); \
+		SLAP_COUNTERS_UNLOCK( op->o_counters ); \
 	} while (0)
 #define INCR_OP_COMPLETED(index) \
 	do { \
-		ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex ); \
-		ldap_pvt_mp_add_ulong(op->o_counters->sc_ops_completed, 1); \
-		ldap_pvt_mp_add_ulong(op->o_counters->sc_ops_completed_[(index)], 1); \
-		ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex ); \
+		SLAP_COUNTERS_LOCK( op->o_counters ); \
+		SLAP_COUNTER_ADD( op->o_counters->sc_ops_completed, 1 ); \
+		SLAP_COUNTER_ADD( op->o_counters->sc_ops_completed_[(index)], 1 ); \
+		connection_op_latency( op, (index) ); \
+		SLAP_COUNTERS_UNLOCK( op->o_counters ); \
 	} while (0)
 #else /* !SLAPD_MONITOR */
 #define INCR_OP_INITIATED(index) do { } while (0)
 #define INCR_OP_COMPLETED(index) \
 	do { \
-		ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex ); \
-		ldap_pvt_mp_add_ulong(op->o_counters->sc_ops_completed, 1); \
-		ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex ); \
+		SLAP_COUNTERS_LOCK( op->o_counters ); \
+		SLAP_COUNTER_ADD( op->o_counters->sc_ops_completed, 1 ); \
+		SLAP_COUNTERS_UNLOCK( op->o_counters ); \
 	} while (0)
 #endif /* !SLAPD_MONITOR */
 
@@ -998,16 +1164,22 @@ conn_counter_destroy( void *key, void *data )
 
 			*prev = sc->sc_next;
 			/* Copy data to main counter */
-			ldap_pvt_mp_add( slap_counters.sc_bytes, sc->sc_bytes );
-			ldap_pvt_mp_add( slap_counters.sc_pdu, sc->sc_pdu );
-			ldap_pvt_mp_add( slap_counters.sc_entries, sc->sc_entries );
-			ldap_pvt_mp_add( slap_counters.sc_refs, sc->sc_refs );
-			ldap_pvt_mp_add( slap_counters.sc_ops_initiated, sc->sc_ops_initiated );
-			ldap_pvt_mp_add( slap_counters.sc_ops_completed, sc->sc_ops_completed );
+			SLAP_COUNTER_ADD_MP( slap_counters.sc_bytes, SLAP_COUNTER_GET( sc->sc_bytes ));
+			SLAP_COUNTER_ADD_MP( slap_counters.sc_pdu, SLAP_COUNTER_GET( sc->sc_pdu ));
+			SLAP_COUNTER_ADD_MP( slap_counters.sc_entries, SLAP_COUNTER_GET( sc->sc_entries ));
+			SLAP_COUNTER_ADD_MP( slap_counters.sc_refs, SLAP_COUNTER_GET( sc->sc_refs ));
+			SLAP_COUNTER_ADD_MP( slap_counters.sc_ops_initiated, SLAP_COUNTER_GET( sc->sc_ops_initiated ));
+			SLAP_COUNTER_ADD_MP( slap_counters.sc_ops_completed, SLAP_COUNTER_GET( sc->sc_ops_completed ));
 #ifdef SLAPD_MONITOR
 			for ( i = 0; i < SLAP_OP_LAST; i++ ) {
-				ldap_pvt_mp_add( slap_counters.sc_ops_initiated_[ i ], sc->sc_ops_initiated_[ i ] );
-				ldap_pvt_mp_add( slap_counters.sc_ops_initiated_[ i ], sc->sc_ops_completed_[ i ] );
+				SLAP_COUNTER_ADD_MP( slap_counters.sc_ops_initiated_[ i ], SLAP_COUNTER_GET( sc->sc_ops_initiated_[ i ] ));
+				SLAP_COUNTER_ADD_MP( slap_counters.sc_ops_completed_[ i ], SLAP_COUNTER_GET( sc->sc_ops_completed_[ i ] ));
+			}
+			{
+				unsigned long *from = sc->sc_ops_latency_[0][0],
+					*to = slap_counters.sc_ops_latency_[0][0];
+				for ( i = 0; i < SLAP_OP_LAST * SLAP_LAT_LAST * SLAP_LAT_BUCKETS; i++ )
+					to[i] += SLAP_COUNTER_GET_UL( from[i] );
 			}
 #endif /* SLAPD_MONITOR */
 			slap_counters_destroy( sc );
@@ -1073,10 +1245,12 @@ connection_operation( void *ctx, void *arg_v )
 	SlapReply rs = {REP_RESULT};
 	ber_tag_t tag = op->o_tag;
 	slap_op_t opidx = SLAP_OP_LAST;
+	int opclass = op->o_opclass;
 	Connection *conn = op->o_conn;
 	void *memctx = NULL;
 	void *memctx_null = NULL;
 	ber_len_t memsiz;
+	slap_profslot *prof = NULL;
 
 	gettimeofday( &op->o_qtime, NULL );
 	op->o_qtime.tv_usec -= op->o_tusec;
@@ -1086,10 +1260,10 @@ connection_operation( void *ctx, void *arg_v )
 	}
 	op->o_qtime.tv_sec -= op->o_time;
 	conn_counter_init( op, ctx );
-	ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex );
+	SLAP_COUNTERS_LOCK( op->o_counters );
 	/* FIXME: returns 0 in case of failure */
-	ldap_pvt_mp_add_ulong(op->o_counters->sc_ops_initiated, 1);
-	ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex );
+	SLAP_COUNTER_ADD( op->o_counters->sc_ops_initiated, 1 );
+	SLAP_COUNTERS_UNLOCK( op->o_counters );
 
 	op->o_threadctx = ctx;
 	op->o_tid = ldap_pvt_thread_pool_tid( ctx );
@@ -1149,7 +1323,7 @@ connection_operation( void *ctx, void *arg_v )
 	memsiz = ber_len( op->o_ber ) * 64;
 	if ( SLAP_SLAB_SIZE > memsiz ) memsiz = SLAP_SLAB_SIZE;
 #endif
-	memsiz = SLAP_SLAB_SIZE;
+	memsiz = slap_slab_size;
 
 	memctx = slap_sl_mem_create( memsiz, SLAP_SLAB_STACK, ctx, 1 );
 	op->o_tmpmemctx = memctx;
@@ -1163,12 +1337,26 @@ connection_operation( void *ctx, void *arg_v )
 	}
 	}
 
+	if ( opclass & SLAP_OPCLASS_BUSY ) {
+		send_ldap_error( op, &rs, LDAP_BUSY,
+			"too many operations of this class pending" );
+		rc = LDAP_BUSY;
+		goto operations_error;
+	}
+
 	opidx = slap_req2op( tag );
 	assert( opidx != SLAP_OP_LAST );
 	INCR_OP_INITIATED( opidx );
+	slap_profile_begin( op, opidx );
+	prof = op->o_prof;
 	rc = (*(opfun[opidx]))( op, &rs );
 
 operations_error:
+	/* op may already be gone if it went async, use the copies */
+	slap_profile_end( prof );
+	if ( opclass & SLAP_OPCLASS_HELD )
+		connection_opclass_release( opclass );
+
 	if ( rc == SLAPD_DISCONNECT ) {
 		tag = LBER_ERROR;
 
@@ -1190,6 +1378,12 @@ operations_error:
 		INCR_OP_COMPLETED( opidx );
 	}
 
+	/* don't leave results behind if the op ended without a response */
+	slap_send_flush( op );
+
+	/* what it allocated no longer counts against mem_budget */
+	slap_sl_mem_release( memctx );
+
 	ldap_pvt_thread_mutex_lock( &conn->c_mutex );
 
 	if ( opidx == SLAP_OP_BIND && conn->c_conn_state == SLAP_C_BINDING )
@@ -1276,6 +1470,37 @@ void connection_client_enable(
 	slapd_set_read( c->c_sd, 1 );
 }
 
+/* Drop the cached group checks; c_groups_mutex must be locked */
+void connection_groups_free( Connection *c )
+{
+	GroupAssertion *g, *n;
+
+	for ( g = c->c_groups; g; g = n ) {
+		n = g->ga_next;
+		ch_free( g );
+	}
+	c->c_groups = NULL;
+	c->c_ngroups = 0;
+	if ( !BER_BVISNULL( &c->c_groups_ndn ) ) {
+		ch_free( c->c_groups_ndn.bv_val );
+		BER_BVZERO( &c->c_groups_ndn );
+	}
+}
+
+/* Drop the cached ACL sets; c_groups_mutex must be locked */
+void connection_sets_free( Connection *c )
+{
+	SetAssertion *sa, *n;
+
+	for ( sa = c->c_sets; sa; sa = n ) {
+		n = sa->sa_next;
+		ber_bvarray_free( sa->sa_vals );
+		ch_free( sa );
+	}
+	c->c_sets = NULL;
+	c->c_nsets = 0;
+}
+
 void connection_client_stop(
 	Connection *c )
 {
@@ -1297,7 +1522,10 @@ void connection_client_stop(
 		ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_SET_MAX_INCOMING, &max );
 	}
 	c->c_conn_state = SLAP_C_INVALID;
+	ldap_pvt_thread_mutex_lock( &CONN_SHARD( s )->cs_mutex );
 	c->c_struct_state = SLAP_C_UNUSED;
+	CONN_SHARD( s )->cs_nused--;
+	ldap_pvt_thread_mutex_unlock( &CONN_SHARD( s )->cs_mutex );
 	slapd_remove( s, sb, 0, 1, 0 );
 
 	connection_return( c );
@@ -1344,8 +1572,10 @@ int connection_read_activate( ber_socket_t s )
 	if ( rc )
 		return rc;
 
-	rc = ldap_pvt_thread_pool_submit( &connection_pool,
-		connection_read_thread, (void *)(long)s );
+	/* with op classes, reading is what lets binds get ahead */
+	rc = ldap_pvt_thread_pool_submit_prio( &connection_pool,
+		connection_read_thread, (void *)(long)s, NULL,
+		slap_opclass_enabled );
 
 	if( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -1359,7 +1589,7 @@ int connection_read_activate( ber_socket_t s )
 static int
 connection_read( ber_socket_t s, conn_readinfo *cri )
 {
-	int rc = 0;
+	int rc = 0, npdus = 0;
 	Connection *c;
 
 	assert( connections != NULL );
@@ -1399,7 +1629,25 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 
 #ifdef HAVE_TLS
 	if ( c->c_is_tls && c->c_needs_tls_accept ) {
+		rc = connection_tls_admit( c );
+		if ( rc > 0 ) {
+			/* reading stays off until a slot frees up */
+			connection_return( c );
+			return 0;
+		} else if ( rc < 0 ) {
+			Debug( LDAP_DEBUG_CONNS,
+				"connection_read(%d): too many TLS handshakes "
+				"waiting, closing id=%lu\n",
+				s, c->c_connid, 0 );
+			c->c_needs_tls_accept = 0;
+			connection_closing( c, "too many TLS handshakes waiting" );
+			connection_close( c );
+			connection_return( c );
+			return 0;
+		}
+
 		rc = ldap_pvt_tls_accept( c->c_sb, slap_tls_ctx );
+		connection_tls_release( c );
 		if ( rc < 0 ) {
 			Debug( LDAP_DEBUG_TRACE,
 				"connection_read(%d): TLS accept failure "
@@ -1491,20 +1739,13 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 	}
 #endif
 
-#define CONNECTION_INPUT_LOOP 1
-/* #define	DATA_READY_LOOP 1 */
-
+	/* Dispatch every complete PDU we can get without blocking, but
+	 * give up the thread after conn_max_pdus so one pipelining client
+	 * can't starve the others.
+	 */
 	do {
-		/* How do we do this without getting into a busy loop ? */
 		rc = connection_input( c, cri );
-	}
-#ifdef DATA_READY_LOOP
-	while( !rc && ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_DATA_READY, NULL ));
-#elif defined CONNECTION_INPUT_LOOP
-	while(!rc);
-#else
-	while(0);
-#endif
+	} while ( !rc && ( !slap_conn_max_pdus || ++npdus < slap_conn_max_pdus ));
 
 	if( rc < 0 ) {
 		Debug( LDAP_DEBUG_CONNS,
@@ -1522,6 +1763,22 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 		slapd_set_write( s, 0 );
 	}
 
+	/* Input already buffered won't wake the listener, so if we
+	 * stopped at the cap, come back for it through the pool.
+	 */
+	if ( !rc && ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_DATA_READY, NULL ) ) {
+		rc = ldap_pvt_thread_pool_submit_prio( &connection_pool,
+			connection_read_thread, (void *)(long)s, NULL,
+			slap_opclass_enabled );
+		if ( rc == 0 ) {
+			connection_return( c );
+			return 0;
+		}
+		Debug( LDAP_DEBUG_ANY,
+			"connection_read(%d): resubmit failed (%d)\n",
+			s, rc, 0 );
+	}
+
 	slapd_set_read( s, 1 );
 	connection_return( c );
 
@@ -1664,6 +1921,8 @@ connection_input( Connection *conn , conn_readinfo *cri )
 
 	ctx = cri->ctx;
 	op = slap_op_alloc( ber, msgid, tag, conn->c_n_ops_received++, ctx );
+	op->o_opclass = slap_opclass_enabled
+		? connection_op_class( op ) : SLAP_OPCLASS_NONE;
 
 	Debug( LDAP_DEBUG_TRACE, "op tag 0x%lx, time %ld\n", tag,
 		(long) op->o_time, 0);
@@ -1762,15 +2021,14 @@ connection_input( Connection *conn , conn_readinfo *cri )
 		 * Subsequent ops will be submitted to the pool by
 		 * calling connection_op_activate()
 		 */
-		if ( cri->op == NULL ) {
+		if ( cri->op == NULL && op->o_opclass == SLAP_OPCLASS_NONE ) {
 			/* the first incoming request */
 			connection_op_queue( op );
 			cri->op = op;
 		} else {
-			if ( !cri->nullop ) {
+			if ( cri->op && !cri->nullop ) {
 				cri->nullop = 1;
-				rc = ldap_pvt_thread_pool_submit( &connection_pool,
-					connection_operation, (void *) cri->op );
+				rc = connection_opclass_submit( cri->op );
 			}
 			connection_op_activate( op );
 		}
@@ -1910,6 +2168,304 @@ static int connection_bind_cb( Operation *op, SlapReply *rs )
 	return SLAP_CB_CONTINUE;
 }
 
+/* Classify a request that has not been parsed yet. Searches are only
+ * told apart by their scope, limits can only be applied once the
+ * backend has the parsed request.
+ */
+static int
+connection_op_class( Operation *op )
+{
+	switch ( op->o_tag ) {
+	case LDAP_REQ_BIND:
+	case LDAP_REQ_EXTENDED:
+		return SLAP_OPCLASS_BIND;
+
+	case LDAP_REQ_ADD:
+	case LDAP_REQ_DELETE:
+	case LDAP_REQ_MODDN:
+	case LDAP_REQ_MODIFY:
+		return SLAP_OPCLASS_WRITE;
+
+	case LDAP_REQ_COMPARE:
+		return SLAP_OPCLASS_READ;
+
+	case LDAP_REQ_SEARCH: {
+		BerElement *ber = ber_dup( op->o_ber );
+		struct berval base;
+		ber_int_t scope = LDAP_SCOPE_SUBTREE;
+
+		if ( ber ) {
+			if ( ber_scanf( ber, "{mi" /*}*/, &base, &scope ) == LBER_ERROR )
+				scope = LDAP_SCOPE_SUBTREE;
+			ber_free( ber, 0 );
+		}
+		return scope == LDAP_SCOPE_BASE
+			? SLAP_OPCLASS_READ : SLAP_OPCLASS_EXPENSIVE;
+		}
+	}
+	return SLAP_OPCLASS_NONE;
+}
+
+/* Submit waiting ops of a class while it has free slots.
+ * opclass_mutex must be locked.
+ */
+static void
+connection_opclass_run( slap_opclass_t *oc, struct soc_o *rejected )
+{
+	Operation *op;
+	int cls;
+
+	while (( op = LDAP_STAILQ_FIRST( &oc->soc_ops )) != NULL ) {
+		if ( slap_opclass_enabled && oc->soc_max &&
+			oc->soc_executing >= oc->soc_max )
+			break;
+		LDAP_STAILQ_REMOVE_HEAD( &oc->soc_ops, o_cnext );
+		oc->soc_pending--;
+		oc->soc_executing++;
+		op->o_opclass |= SLAP_OPCLASS_HELD;
+		cls = op->o_opclass & SLAP_OPCLASS_MASK;
+		if ( ldap_pvt_thread_pool_submit_prio( &connection_pool,
+			connection_operation, (void *) op, NULL,
+			cls == SLAP_OPCLASS_BIND ) )
+		{
+			Debug( LDAP_DEBUG_ANY,
+				"connection_opclass_run: submit failed for conn=%lu op=%lu\n",
+				op->o_connid, op->o_opid, 0 );
+			oc->soc_executing--;
+			op->o_opclass &= ~SLAP_OPCLASS_HELD;
+			LDAP_STAILQ_INSERT_TAIL( rejected, op, o_cnext );
+		}
+	}
+}
+
+/* Answer the ops the pool would not take with LDAP_BUSY and drop
+ * them, as connection_operation does with ops that can't wait.
+ * Called without opclass_mutex, sending may block.
+ */
+static void
+connection_opclass_reject( struct soc_o *rejected )
+{
+	Operation *op;
+
+	while (( op = LDAP_STAILQ_FIRST( rejected )) != NULL ) {
+		Connection *conn = op->o_conn;
+		SlapReply rs = {REP_RESULT};
+
+		LDAP_STAILQ_REMOVE_HEAD( rejected, o_cnext );
+		op->o_threadctx = ldap_pvt_thread_pool_context();
+		op->o_tmpmemctx = NULL;
+		op->o_tmpmfuncs = &ch_mfuncs;
+		send_ldap_error( op, &rs, LDAP_BUSY, "server busy" );
+
+		ldap_pvt_thread_mutex_lock( &conn->c_mutex );
+		LDAP_STAILQ_REMOVE( &conn->c_ops, op, Operation, o_next );
+		LDAP_STAILQ_NEXT( op, o_next ) = NULL;
+		conn->c_n_ops_executing--;
+		conn->c_n_ops_completed++;
+		connection_resched( conn );
+		ldap_pvt_thread_mutex_unlock( &conn->c_mutex );
+		slap_op_free( op, NULL );
+	}
+}
+
+/* Hand op to the pool. If its class already runs as many ops as
+ * allowed, op waits for a slot instead, or gets LDAP_BUSY if too
+ * many are waiting already. Binds and ops that aren't classified
+ * go ahead of everything else in the pool.
+ */
+static int
+connection_opclass_submit( Operation *op )
+{
+	int cls = op->o_opclass & SLAP_OPCLASS_MASK;
+	int rc, prio = 0;
+
+	if ( cls != SLAP_OPCLASS_NONE ) {
+		slap_opclass_t *oc = &slap_opclasses[cls];
+
+		ldap_pvt_thread_mutex_lock( &opclass_mutex );
+		if ( !oc->soc_max || oc->soc_executing < oc->soc_max ) {
+			oc->soc_executing++;
+			op->o_opclass |= SLAP_OPCLASS_HELD;
+		} else if ( !oc->soc_max_pending ||
+			oc->soc_pending < oc->soc_max_pending )
+		{
+			oc->soc_pending++;
+			LDAP_STAILQ_INSERT_TAIL( &oc->soc_ops, op, o_cnext );
+			ldap_pvt_thread_mutex_unlock( &opclass_mutex );
+			return 0;
+		} else {
+			op->o_opclass |= SLAP_OPCLASS_BUSY;
+		}
+		ldap_pvt_thread_mutex_unlock( &opclass_mutex );
+		prio = cls == SLAP_OPCLASS_BIND;
+	} else {
+		prio = slap_opclass_enabled;
+	}
+
+	rc = ldap_pvt_thread_pool_submit_prio( &connection_pool,
+		connection_operation, (void *) op, NULL, prio );
+	if ( rc && ( op->o_opclass & SLAP_OPCLASS_HELD )) {
+		/* Just give the slot back: the caller may hold c_mutex, and
+		 * the pool won't take the waiting ops now either */
+		ldap_pvt_thread_mutex_lock( &opclass_mutex );
+		slap_opclasses[cls].soc_executing--;
+		ldap_pvt_thread_mutex_unlock( &opclass_mutex );
+		op->o_opclass &= ~SLAP_OPCLASS_HELD;
+	}
+	return rc;
+}
+
+/* An op of this class is done with its thread */
+static void
+connection_opclass_release( int opclass )
+{
+	slap_opclass_t *oc = &slap_opclasses[opclass & SLAP_OPCLASS_MASK];
+	struct soc_o rejected = LDAP_STAILQ_HEAD_INITIALIZER( rejected );
+
+	ldap_pvt_thread_mutex_lock( &opclass_mutex );
+	oc->soc_executing--;
+	connection_opclass_run( oc, &rejected );
+	ldap_pvt_thread_mutex_unlock( &opclass_mutex );
+	connection_opclass_reject( &rejected );
+}
+
+/* Limits were changed, let waiting ops use any new slots */
+void
+connection_opclass_update( void )
+{
+	struct soc_o rejected = LDAP_STAILQ_HEAD_INITIALIZER( rejected );
+	int i;
+
+	if ( connections == NULL )
+		return;
+
+	ldap_pvt_thread_mutex_lock( &opclass_mutex );
+	for ( i = 0; i < SLAP_OPCLASS_LAST; i++ )
+		connection_opclass_run( &slap_opclasses[i], &rejected );
+#ifdef HAVE_TLS
+	connection_tls_run();
+#endif
+	ldap_pvt_thread_mutex_unlock( &opclass_mutex );
+	connection_opclass_reject( &rejected );
+}
+
+#ifdef HAVE_TLS
+/* Handshakes are CPU bound; the tls opclass caps how many pool
+ * threads work on them at a time, so a burst of new TLS clients
+ * can't crowd out the operations of established sessions.
+ */
+
+/* Take a slot for one handshake step on c, or park c until one
+ * frees up. Returns 0 to go ahead, 1 if parked and -1 if too many
+ * connections are parked already. c_mutex must be locked.
+ */
+static int
+connection_tls_admit( Connection *c )
+{
+	slap_opclass_t *oc = &slap_opclasses[SLAP_OPCLASS_TLS];
+	conn_tls_wait *tw;
+	int rc = 0;
+
+	/* already granted by connection_tls_run */
+	if ( c->c_tls_slot )
+		return 0;
+
+	ldap_pvt_thread_mutex_lock( &opclass_mutex );
+	if ( !oc->soc_max ) {
+		/* not limited, don't count it */
+	} else if ( oc->soc_executing < oc->soc_max ) {
+		oc->soc_executing++;
+		c->c_tls_slot = 1;
+	} else if ( !oc->soc_max_pending ||
+		oc->soc_pending < oc->soc_max_pending )
+	{
+		tw = ch_malloc( sizeof( conn_tls_wait ));
+		tw->tw_sd = c->c_sd;
+		tw->tw_connid = c->c_connid;
+		LDAP_STAILQ_INSERT_TAIL( &conn_tls_waiting, tw, tw_next );
+		oc->soc_pending++;
+		rc = 1;
+	} else {
+		rc = -1;
+	}
+	ldap_pvt_thread_mutex_unlock( &opclass_mutex );
+	return rc;
+}
+
+/* Resume a parked handshake in the slot granted to it */
+static void *
+connection_tls_thread( void *ctx, void *arg )
+{
+	conn_tls_wait *tw = arg;
+	ber_socket_t s = tw->tw_sd;
+	Connection *c;
+	int ok = 0;
+
+	c = connection_get( s );
+	if ( c ) {
+		if ( c->c_connid == tw->tw_connid && c->c_needs_tls_accept ) {
+			c->c_tls_slot = 1;
+			ok = 1;
+		}
+		connection_return( c );
+	}
+
+	if ( !ok ) {
+		/* it went away while waiting */
+		ldap_pvt_thread_mutex_lock( &opclass_mutex );
+		slap_opclasses[SLAP_OPCLASS_TLS].soc_executing--;
+		connection_tls_run();
+		ldap_pvt_thread_mutex_unlock( &opclass_mutex );
+		ch_free( tw );
+		return NULL;
+	}
+
+	ch_free( tw );
+	return connection_read_thread( ctx, (void *)(long)s );
+}
+
+/* Hand free slots to parked connections, behind the operations
+ * already queued in the pool. opclass_mutex must be locked.
+ */
+static void
+connection_tls_run( void )
+{
+	slap_opclass_t *oc = &slap_opclasses[SLAP_OPCLASS_TLS];
+	conn_tls_wait *tw;
+
+	while (( tw = LDAP_STAILQ_FIRST( &conn_tls_waiting )) != NULL ) {
+		if ( oc->soc_max && oc->soc_executing >= oc->soc_max )
+			break;
+		LDAP_STAILQ_REMOVE_HEAD( &conn_tls_waiting, tw_next );
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+			connection_tls_thread, (void *) tw ))
+		{
+			Debug( LDAP_DEBUG_ANY,
+				"connection_tls_run: submit failed for conn=%lu\n",
+				tw->tw_connid, 0, 0 );
+			LDAP_STAILQ_INSERT_HEAD( &conn_tls_waiting, tw, tw_next );
+			break;
+		}
+		oc->soc_pending--;
+		oc->soc_executing++;
+	}
+}
+
+/* c is done with its handshake step. c_mutex must be locked. */
+static void
+connection_tls_release( Connection *c )
+{
+	if ( !c->c_tls_slot )
+		return;
+	c->c_tls_slot = 0;
+
+	ldap_pvt_thread_mutex_lock( &opclass_mutex );
+	slap_opclasses[SLAP_OPCLASS_TLS].soc_executing--;
+	connection_tls_run();
+	ldap_pvt_thread_mutex_unlock( &opclass_mutex );
+}
+#endif /* HAVE_TLS */
+
 static void connection_op_queue( Operation *op )
 {
 	ber_tag_t tag = op->o_tag;
@@ -1960,8 +2516,7 @@ static int connection_op_activate( Operation *op )
 
 	connection_op_queue( op );
 
-	rc = ldap_pvt_thread_pool_submit( &connection_pool,
-		connection_operation, (void *) op );
+	rc = connection_opclass_submit( op );
 
 	if ( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
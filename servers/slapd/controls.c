@@ -29,6 +29,7 @@
 static SLAP_CTRL_PARSE_FN parseAssert;
 static SLAP_CTRL_PARSE_FN parseDomainScope;
 static SLAP_CTRL_PARSE_FN parseDontUseCopy;
+static SLAP_CTRL_PARSE_FN parseExplain;
 static SLAP_CTRL_PARSE_FN parseManageDSAit;
 static SLAP_CTRL_PARSE_FN parseNoOp;
 static SLAP_CTRL_PARSE_FN parsePagedResults;
@@ -37,6 +38,7 @@ static SLAP_CTRL_PARSE_FN parsePreRead, parsePostRead;
 static SLAP_CTRL_PARSE_FN parseProxyAuthz;
 static SLAP_CTRL_PARSE_FN parseRelax;
 static SLAP_CTRL_PARSE_FN parseSearchOptions;
+static SLAP_CTRL_PARSE_FN parseTrace;
 #ifdef SLAP_CONTROL_X_SORTEDRESULTS
 static SLAP_CTRL_PARSE_FN parseSortedResults;
 #endif
@@ -80,11 +82,34 @@ struct slap_control {
 	SLAP_CTRL_PARSE_FN *sc_parse;
 
 	LDAP_SLIST_ENTRY(slap_control) sc_next;
+
+	/* Next control in the same controls_hash bucket */
+	struct slap_control *sc_hnext;
 };
 
 static LDAP_SLIST_HEAD(ControlsList, slap_control) controls_list
 	= LDAP_SLIST_HEAD_INITIALIZER(&controls_list);
 
+/*
+ * Registered controls hashed by OID, so that parsing the controls of
+ * a request doesn't compare against every OID in controls_list.
+ * Like the list, it only changes at startup or while the server is
+ * paused.
+ */
+#define CONTROLS_HASH_SIZE	64	/* must be a power of 2 */
+
+static struct slap_control *controls_hash[CONTROLS_HASH_SIZE];
+
+static struct slap_control **
+controls_hash_bucket( const char *oid )
+{
+	unsigned h = 0;
+
+	for ( ; *oid; oid++ )
+		h = h * 31 + (unsigned char) *oid;
+	return &controls_hash[h & ( CONTROLS_HASH_SIZE - 1 )];
+}
+
 /*
  * all known request control OIDs should be added to this list
  */
@@ -114,6 +139,13 @@ static char *manageDSAit_extops[] = {
 	NULL
 };
 
+static char *trace_extops[] = {
+	LDAP_EXOP_MODIFY_PASSWD,
+	LDAP_EXOP_WHO_AM_I,
+	LDAP_EXOP_REFRESH,
+	NULL
+};
+
 #ifdef SLAP_CONTROL_X_SESSION_TRACKING
 static char *session_tracking_extops[] = {
 	LDAP_EXOP_MODIFY_PASSWD,
@@ -171,6 +203,11 @@ static struct slap_control control_defs[] = {
 		SLAP_CTRL_MODIFY|SLAP_CTRL_HIDE,
 		NULL, NULL,
 		parsePermissiveModify, LDAP_SLIST_ENTRY_INITIALIZER(next) },
+	{ LDAP_CONTROL_X_EXPLAIN,
+ 		(int)offsetof(struct slap_control_ids, sc_explain),
+		SLAP_CTRL_SEARCH|SLAP_CTRL_HIDE,
+		NULL, NULL,
+		parseExplain, LDAP_SLIST_ENTRY_INITIALIZER(next) },
 #ifdef SLAP_CONTROL_X_TREE_DELETE
 	{ LDAP_CONTROL_X_TREE_DELETE,
  		(int)offsetof(struct slap_control_ids, sc_treeDelete),
@@ -229,6 +266,11 @@ static struct slap_control control_defs[] = {
 		NULL, NULL,
 		parseWhatFailed, LDAP_SLIST_ENTRY_INITIALIZER(next) },
 #endif
+	{ LDAP_CONTROL_X_TRACE,
+		(int)offsetof(struct slap_control_ids, sc_trace),
+		SLAP_CTRL_GLOBAL|SLAP_CTRL_ACCESS|SLAP_CTRL_BIND|SLAP_CTRL_HIDE,
+		trace_extops, NULL,
+		parseTrace, LDAP_SLIST_ENTRY_INITIALIZER(next) },
 #ifdef SLAP_CONTROL_X_LAZY_COMMIT
 	{ LDAP_CONTROL_X_LAZY_COMMIT,
 		(int)offsetof(struct slap_control_ids, sc_lazyCommit),
@@ -327,6 +369,12 @@ register_supported_control2(const char *controloid,
 
 		LDAP_SLIST_NEXT( sc, sc_next ) = NULL;
 		LDAP_SLIST_INSERT_HEAD( &controls_list, sc, sc_next );
+		{
+			struct slap_control **bucket = controls_hash_bucket( sc->sc_oid );
+
+			sc->sc_hnext = *bucket;
+			*bucket = sc;
+		}
 
 	} else {
 		if ( sc->sc_extendedopsbv ) {
@@ -368,6 +416,14 @@ unregister_supported_control( const char *controloid )
 	}
 
 	LDAP_SLIST_REMOVE(&controls_list, sc, slap_control, sc_next);
+	{
+		struct slap_control **scp;
+
+		for ( scp = controls_hash_bucket( sc->sc_oid ); *scp != sc;
+			scp = &(*scp)->sc_hnext )
+			;
+		*scp = sc->sc_hnext;
+	}
 	ch_free( sc->sc_oid );
 	if ( sc->sc_extendedopsbv != NULL ) {
 		ber_bvarray_free( sc->sc_extendedopsbv );
@@ -464,6 +520,7 @@ controls_destroy( void )
 	while ( !LDAP_SLIST_EMPTY(&controls_list) ) {
 		sc = LDAP_SLIST_FIRST(&controls_list);
 		LDAP_SLIST_REMOVE_HEAD(&controls_list, sc_next);
+		*controls_hash_bucket( sc->sc_oid ) = NULL;
 
 		ch_free( sc->sc_oid );
 		if ( sc->sc_extendedopsbv != NULL ) {
@@ -562,7 +619,7 @@ find_ctrl( const char *oid )
 {
 	struct slap_control *sc;
 
-	LDAP_SLIST_FOREACH( sc, &controls_list, sc_next ) {
+	for ( sc = *controls_hash_bucket( oid ); sc; sc = sc->sc_hnext ) {
 		if ( strcmp( oid, sc->sc_oid ) == 0 ) {
 			return sc;
 		}
@@ -1716,6 +1773,53 @@ static int parsePermissiveModify (
 	return LDAP_SUCCESS;
 }
 
+static int parseExplain (
+	Operation *op,
+	SlapReply *rs,
+	LDAPControl *ctrl )
+{
+	if ( op->o_explain != SLAP_CONTROL_NONE ) {
+		rs->sr_text = "explain control specified multiple times";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	if ( !BER_BVISNULL( &ctrl->ldctl_value )) {
+		rs->sr_text = "explain control value not absent";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	op->o_explain = ctrl->ldctl_iscritical
+		? SLAP_CONTROL_CRITICAL
+		: SLAP_CONTROL_NONCRITICAL;
+
+	return LDAP_SUCCESS;
+}
+
+static int parseTrace (
+	Operation *op,
+	SlapReply *rs,
+	LDAPControl *ctrl )
+{
+	if ( op->o_tracectrl != SLAP_CONTROL_NONE ) {
+		rs->sr_text = "trace control specified multiple times";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	/* rewrites the parent-id, so a proxy forwards our span */
+	if ( BER_BVISNULL( &ctrl->ldctl_value ) ||
+		slap_trace_parse( &op->o_tracectx, &ctrl->ldctl_value ))
+	{
+		rs->sr_text = "trace control value invalid";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	op->o_tracectrl = ctrl->ldctl_iscritical
+		? SLAP_CONTROL_CRITICAL
+		: SLAP_CONTROL_NONCRITICAL;
+
+	return LDAP_SUCCESS;
+}
+
 static int parseDomainScope (
 	Operation *op,
 	SlapReply *rs,
@@ -40,7 +40,7 @@ slap_get_commit_csn(
 {
 	struct slap_csn_entry *csne, *committed_csne = NULL;
 	BackendDB *be = op->o_bd->bd_self;
-	int sid = -1;
+	int sid = -1, mine = 0;
 
 	if ( maxcsn ) {
 		assert( maxcsn->bv_val != NULL );
@@ -56,19 +56,24 @@ slap_get_commit_csn(
 
 	ldap_pvt_thread_mutex_lock( &be->be_pcl_mutex );
 
+	/* One walk marks our own CSN committed and finds the last committed
+	 * CSN of our SID ahead of its first pending one. The list is in CSN
+	 * order, so once both are found the rest doesn't matter.
+	 */
 	LDAP_TAILQ_FOREACH( csne, be->be_pending_csn_list, ce_csn_link ) {
 		if ( csne->ce_op == op ) {
 			csne->ce_state = SLAP_CSN_COMMIT;
 			if ( foundit ) *foundit = 1;
-			break;
+			mine = 1;
 		}
-	}
-
-	LDAP_TAILQ_FOREACH( csne, be->be_pending_csn_list, ce_csn_link ) {
 		if ( sid != -1 && sid == csne->ce_sid ) {
-			if ( csne->ce_state == SLAP_CSN_COMMIT ) committed_csne = csne;
-			if ( csne->ce_state == SLAP_CSN_PENDING ) break;
+			if ( csne->ce_state == SLAP_CSN_PENDING )
+				sid = -1;
+			else
+				committed_csne = csne;
 		}
+		if ( mine && sid == -1 )
+			break;
 	}
 
 	if ( maxcsn ) {
@@ -119,19 +124,23 @@ slap_graduate_commit_csn( Operation *op )
 		if ( csne->ce_op == op ) {
 			LDAP_TAILQ_REMOVE( be->be_pending_csn_list,
 				csne, ce_csn_link );
-			Debug( LDAP_DEBUG_SYNC, "slap_graduate_commit_csn: removing %p %s\n",
-				csne, csne->ce_csn.bv_val, 0 );
-			if ( op->o_csn.bv_val == csne->ce_csn.bv_val ) {
-				BER_BVZERO( &op->o_csn );
-			}
-			ch_free( csne->ce_csn.bv_val );
-			ch_free( csne );
 			break;
 		}
 	}
 
 	ldap_pvt_thread_mutex_unlock( &be->be_pcl_mutex );
 
+	if ( csne ) {
+		Debug( LDAP_DEBUG_SYNC, "slap_graduate_commit_csn: removing %p %s\n",
+			csne, csne->ce_csn.bv_val, 0 );
+		if ( op->o_csn.bv_val == csne->ce_csn.bv_val ) {
+			BER_BVZERO( &op->o_csn );
+		}
+		ch_free( csne );
+	}
+
+	backend_group_changed();
+
 	return;
 }
 
@@ -175,6 +184,35 @@ slap_create_context_csn_entry(
 	return e;
 }
 
+/* The CSN is kept in the same allocation as its list entry */
+static struct slap_csn_entry *
+slap_csn_entry_alloc( Operation *op, ber_len_t len )
+{
+	struct slap_csn_entry *pending;
+
+	pending = ch_malloc( sizeof( struct slap_csn_entry ) + len + 1 );
+	pending->ce_csn.bv_val = (char *)(pending + 1);
+	pending->ce_csn.bv_len = len;
+	pending->ce_op = op;
+	pending->ce_state = SLAP_CSN_PENDING;
+	return pending;
+}
+
+static void
+slap_csn_entry_queue( Operation *op, struct slap_csn_entry *pending )
+{
+	BackendDB *be = op->o_bd->bd_self;
+
+	Debug( LDAP_DEBUG_SYNC, "slap_queue_csn: queueing %p %s\n",
+		pending, pending->ce_csn.bv_val, 0 );
+
+	pending->ce_sid = slap_parse_csn_sid( &pending->ce_csn );
+	ber_bvreplace_x( &op->o_csn, &pending->ce_csn, op->o_tmpmemctx );
+
+	LDAP_TAILQ_INSERT_TAIL( be->be_pending_csn_list,
+		pending, ce_csn_link );
+}
+
 void
 slap_queue_csn(
 	Operation *op,
@@ -183,20 +221,12 @@ slap_queue_csn(
 	struct slap_csn_entry *pending;
 	BackendDB *be = op->o_bd->bd_self;
 
-	pending = (struct slap_csn_entry *) ch_calloc( 1,
-			sizeof( struct slap_csn_entry ));
-
-	Debug( LDAP_DEBUG_SYNC, "slap_queue_csn: queueing %p %s\n", pending, csn->bv_val, 0 );
-
-	ber_dupbv( &pending->ce_csn, csn );
-	ber_bvreplace_x( &op->o_csn, &pending->ce_csn, op->o_tmpmemctx );
-	pending->ce_sid = slap_parse_csn_sid( csn );
-	pending->ce_op = op;
-	pending->ce_state = SLAP_CSN_PENDING;
+	pending = slap_csn_entry_alloc( op, csn->bv_len );
+	AC_MEMCPY( pending->ce_csn.bv_val, csn->bv_val, csn->bv_len );
+	pending->ce_csn.bv_val[csn->bv_len] = '\0';
 
 	ldap_pvt_thread_mutex_lock( &be->be_pcl_mutex );
-	LDAP_TAILQ_INSERT_TAIL( be->be_pending_csn_list,
-		pending, ce_csn_link );
+	slap_csn_entry_queue( op, pending );
 	ldap_pvt_thread_mutex_unlock( &be->be_pcl_mutex );
 }
 
@@ -206,11 +236,31 @@ slap_get_csn(
 	struct berval *csn,
 	int manage_ctxcsn )
 {
+	struct slap_csn_entry *pending;
+	BackendDB *be;
+
 	if ( csn == NULL ) return LDAP_OTHER;
 
-	csn->bv_len = ldap_pvt_csnstr( csn->bv_val, csn->bv_len, slap_serverID, 0 );
-	if ( manage_ctxcsn )
-		slap_queue_csn( op, csn );
+	if ( !manage_ctxcsn ) {
+		csn->bv_len = ldap_pvt_csnstr( csn->bv_val, csn->bv_len, slap_serverID, 0 );
+		return LDAP_SUCCESS;
+	}
+
+	/* Stamp and queue the CSN in one go, so the pending list stays
+	 * in CSN order for slap_get_commit_csn()
+	 */
+	be = op->o_bd->bd_self;
+	pending = slap_csn_entry_alloc( op, LDAP_PVT_CSNSTR_BUFSIZE );
+	ldap_pvt_thread_mutex_lock( &be->be_pcl_mutex );
+	pending->ce_csn.bv_len = ldap_pvt_csnstr( pending->ce_csn.bv_val,
+		LDAP_PVT_CSNSTR_BUFSIZE, slap_serverID, 0 );
+	slap_csn_entry_queue( op, pending );
+	ldap_pvt_thread_mutex_unlock( &be->be_pcl_mutex );
+
+	/* callers always pass a LDAP_PVT_CSNSTR_BUFSIZE buffer */
+	assert( csn->bv_len > pending->ce_csn.bv_len );
+	csn->bv_len = pending->ce_csn.bv_len;
+	AC_MEMCPY( csn->bv_val, pending->ce_csn.bv_val, csn->bv_len + 1 );
 
 	return LDAP_SUCCESS;
 }
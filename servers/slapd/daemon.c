@@ -45,7 +45,19 @@
 #include <poll.h>
 #endif
 
-#ifdef HAVE_KQUEUE
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#if defined(SLAP_X_IO_URING)
+# ifndef __linux__
+#  error "SLAP_X_IO_URING needs Linux"
+# endif
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <linux/io_uring.h>
+# include <poll.h>
+#elif defined(HAVE_KQUEUE)
 # include <sys/types.h>
 # include <sys/event.h>
 # include <sys/time.h>
@@ -87,6 +99,9 @@ struct runqueue_s slapd_rq;
 int slapd_daemon_threads = 1;
 int slapd_daemon_mask;
 
+/* open one SO_REUSEPORT socket per listener thread for TCP listeners */
+int slapd_reuseport = 0;
+
 #ifdef LDAP_TCP_BUFFER
 int slapd_tcp_rmem;
 int slapd_tcp_wmem;
@@ -144,7 +159,19 @@ typedef struct slap_daemon_st {
 	int			sd_nwriters;
 	int			sd_nfds;
 
-#if defined(HAVE_KQUEUE)
+#if defined(SLAP_X_IO_URING)
+	int			sd_urfd;
+	int			sd_blocked;	/* listener thread waits in the ring */
+	unsigned		*sd_sqhead, *sd_sqtail, *sd_sqarray, sd_sqmask;
+	unsigned		*sd_cqhead, *sd_cqtail, sd_cqmask;
+	unsigned		sd_sqentries;
+	struct io_uring_sqe	*sd_sqes;
+	struct io_uring_cqe	*sd_cqes;
+	void			*sd_sqmap, *sd_cqmap;
+	size_t			sd_sqmaplen, sd_cqmaplen, sd_sqeslen;
+	struct slap_uring_event	*sd_events;
+	int			sd_nevents;
+#elif defined(HAVE_KQUEUE)
 	uint8_t*        sd_fdmodes; /* indexed by fd */
 	Listener**      sd_l;       /* indexed by fd */
 	/* Double buffer the kqueue changes to avoid holding the sd_mutex \
@@ -193,7 +220,588 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
  *
  * private interface should not be used in the code.
  */
-#ifdef HAVE_KQUEUE
+#if defined(SLAP_X_IO_URING)
+/*****************************************************************
+ * Use io_uring(7), driven by raw syscalls - needs Linux >= 5.11 *
+ *****************************************************************/
+/*
+ * Interest in a descriptor is armed as a one-shot request on the ring
+ * of its listener thread: a poll for listeners, outbound sessions and
+ * the wake pipe, and a receive straight into a per-session buffer for
+ * the sessions that read through slapd_sockbuf_io_uring.  Requests
+ * queued while the listener thread is running are submitted by its
+ * next wait in the same io_uring_enter() call; requests queued while
+ * it sleeps are submitted at once.  Pool threads then consume the
+ * received data without a read() of their own.
+ */
+# define SLAP_EVENT_FNAME		"io_uring"
+# define SLAP_EVENTS_ARE_INDEXED	0
+
+# ifndef SLAP_URING_ENTRIES
+#  define SLAP_URING_ENTRIES		1024
+# endif
+# ifndef SLAP_URING_RECVSIZE
+#  define SLAP_URING_RECVSIZE		4096
+# endif
+# define SLAP_URING_RECVMAX		65536
+
+# define SLAP_URING_READ		0x01
+# define SLAP_URING_WRITE		0x02
+
+/* request kinds, in the low bits of the user_data */
+# define SLAP_URING_POLLIN		1
+# define SLAP_URING_POLLOUT		2
+# define SLAP_URING_RECV		3
+# define SLAP_URING_KICK		4	/* data is already queued */
+# define SLAP_URING_CANCEL		5
+# define SLAP_URING_DATA(gen, fd, kind) \
+	(((__u64)(gen) << 32) | ((__u64)(fd) << 3) | (kind))
+
+typedef struct slap_uring_sock {
+	Listener	*us_l;
+	unsigned	us_gen;		/* bumped each time the descriptor is removed */
+	char		us_active;
+	char		us_want;	/* SLAP_URING_READ/WRITE wanted */
+	char		us_armed;	/* ... and requested from the kernel */
+	char		us_recv;	/* reads through slapd_sockbuf_io_uring */
+	char		us_inflight;	/* a receive is in flight */
+	char		us_pending;	/* arm a receive once the stale one is done */
+	unsigned	us_rgen;	/* generation of the receive in flight */
+
+	/* received data, guarded by us_mutex */
+	ldap_pvt_thread_mutex_t	us_mutex;
+	char		*us_buf;
+	ber_len_t	us_size, us_off, us_len;
+	int		us_err;		/* errno of a failed receive, -1 at EOF */
+} slap_uring_sock;
+
+typedef struct slap_uring_event {
+	ber_socket_t	se_fd;
+	int		se_events;
+} slap_uring_event;
+
+static slap_uring_sock *slap_urs;
+Sockbuf_IO slapd_sockbuf_io_uring;
+
+static int
+slap_uring_enter( int t, unsigned submit, unsigned wait, unsigned flags,
+	void *arg, size_t argsz )
+{
+	return syscall( __NR_io_uring_enter, slap_daemon[t].sd_urfd,
+		submit, wait, flags, arg, argsz );
+}
+
+/* Get a cleared SQE; the caller holds sd_mutex */
+static struct io_uring_sqe *
+slap_uring_sqe( int t, int fd, int kind )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	struct io_uring_sqe *sqe;
+	unsigned tail = *sd->sd_sqtail;
+
+	if ( tail - __atomic_load_n( sd->sd_sqhead, __ATOMIC_ACQUIRE )
+		== sd->sd_sqentries )
+	{
+		slap_uring_enter( t, sd->sd_sqentries, 0, 0, NULL, 0 );
+	}
+	sqe = &sd->sd_sqes[tail & sd->sd_sqmask];
+	memset( sqe, 0, sizeof(*sqe) );
+	sqe->fd = fd;
+	sqe->user_data = SLAP_URING_DATA( slap_urs[fd].us_gen, fd, kind );
+	return sqe;
+}
+
+/* Queue the SQE from slap_uring_sqe(); the caller holds sd_mutex */
+static void
+slap_uring_push( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	unsigned tail = *sd->sd_sqtail;
+
+	sd->sd_sqarray[tail & sd->sd_sqmask] = tail & sd->sd_sqmask;
+	__atomic_store_n( sd->sd_sqtail, tail + 1, __ATOMIC_RELEASE );
+
+	/* otherwise the next wait submits it */
+	if ( sd->sd_blocked )
+		slap_uring_enter( t, 1, 0, 0, NULL, 0 );
+}
+
+static void
+slap_uring_poll( int t, int fd, int kind )
+{
+	struct io_uring_sqe *sqe = slap_uring_sqe( t, fd, kind );
+	unsigned mask = kind == SLAP_URING_POLLIN ? POLLIN : POLLOUT;
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+# if __BYTE_ORDER == __BIG_ENDIAN
+	mask = ( mask << 16 ) | ( mask >> 16 );
+# endif
+	sqe->poll32_events = mask;
+	slap_uring_push( t );
+}
+
+/* Arm a receive, or report data that is already there */
+static void
+slap_uring_recv( int t, int fd )
+{
+	slap_uring_sock *us = &slap_urs[fd];
+	struct io_uring_sqe *sqe;
+
+	ldap_pvt_thread_mutex_lock( &us->us_mutex );
+	if ( us->us_off < us->us_len || us->us_err ) {
+		ldap_pvt_thread_mutex_unlock( &us->us_mutex );
+		sqe = slap_uring_sqe( t, fd, SLAP_URING_KICK );
+		sqe->opcode = IORING_OP_NOP;
+		slap_uring_push( t );
+		return;
+	}
+	us->us_off = us->us_len = 0;
+	if ( us->us_buf == NULL ) {
+		us->us_size = SLAP_URING_RECVSIZE;
+		us->us_buf = ch_malloc( us->us_size );
+	}
+	ldap_pvt_thread_mutex_unlock( &us->us_mutex );
+
+	sqe = slap_uring_sqe( t, fd, SLAP_URING_RECV );
+	sqe->opcode = IORING_OP_RECV;
+	sqe->addr = (__u64)(uintptr_t)us->us_buf;
+	sqe->len = us->us_size;
+	us->us_inflight = 1;
+	us->us_rgen = us->us_gen;
+	slap_uring_push( t );
+}
+
+static void
+slap_uring_arm( int t, int fd, int mode )
+{
+	slap_uring_sock *us = &slap_urs[fd];
+
+	us->us_want |= mode;
+	if ( us->us_armed & mode )
+		return;
+	us->us_armed |= mode;
+
+	if ( mode == SLAP_URING_WRITE ) {
+		slap_uring_poll( t, fd, SLAP_URING_POLLOUT );
+	} else if ( !us->us_recv ) {
+		slap_uring_poll( t, fd, SLAP_URING_POLLIN );
+	} else if ( us->us_inflight ) {
+		/* a previous session's receive is being cancelled */
+		us->us_pending = 1;
+	} else {
+		slap_uring_recv( t, fd );
+	}
+}
+
+static void
+slap_uring_rearm( int t, int fd )
+{
+	int mode = slap_urs[fd].us_want & ~slap_urs[fd].us_armed;
+
+	if ( mode & SLAP_URING_READ )
+		slap_uring_arm( t, fd, SLAP_URING_READ );
+	if ( mode & SLAP_URING_WRITE )
+		slap_uring_arm( t, fd, SLAP_URING_WRITE );
+}
+
+static void
+slap_uring_add( int t, int fd, Listener *l )
+{
+	slap_uring_sock *us = &slap_urs[fd];
+
+	us->us_l = l;
+	us->us_active = 1;
+	us->us_want = us->us_armed = 0;
+	slap_daemon[t].sd_nfds++;
+	slap_uring_arm( t, fd, SLAP_URING_READ );
+}
+
+static void
+slap_uring_cancel( int t, int fd, int kind )
+{
+	struct io_uring_sqe *sqe = slap_uring_sqe( t, fd, SLAP_URING_CANCEL );
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = SLAP_URING_DATA( slap_urs[fd].us_gen, fd, kind );
+	slap_uring_push( t );
+}
+
+static void
+slap_uring_free( slap_uring_sock *us )
+{
+	ldap_pvt_thread_mutex_lock( &us->us_mutex );
+	if ( us->us_buf ) {
+		ch_free( us->us_buf );
+		us->us_buf = NULL;
+	}
+	us->us_off = us->us_len = 0;
+	ldap_pvt_thread_mutex_unlock( &us->us_mutex );
+}
+
+static void
+slap_uring_del( int t, int fd )
+{
+	slap_uring_sock *us = &slap_urs[fd];
+
+	if ( us->us_armed & SLAP_URING_READ ) {
+		slap_uring_cancel( t, fd, us->us_inflight && us->us_rgen == us->us_gen ?
+			SLAP_URING_RECV : SLAP_URING_POLLIN );
+	}
+	if ( us->us_armed & SLAP_URING_WRITE )
+		slap_uring_cancel( t, fd, SLAP_URING_POLLOUT );
+
+	us->us_gen++;
+	us->us_l = NULL;
+	us->us_active = 0;
+	us->us_want = us->us_armed = 0;
+	us->us_recv = 0;
+	us->us_pending = 0;
+	if ( !us->us_inflight )
+		slap_uring_free( us );
+	slap_daemon[t].sd_nfds--;
+}
+
+/* Collect completions as events; the caller holds sd_mutex */
+static int
+slap_uring_reap( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	unsigned head = *sd->sd_cqhead;
+	unsigned tail = __atomic_load_n( sd->sd_cqtail, __ATOMIC_ACQUIRE );
+	int n = 0;
+
+	for ( ; head != tail && n < sd->sd_nevents; head++ ) {
+		struct io_uring_cqe *cqe = &sd->sd_cqes[head & sd->sd_cqmask];
+		int fd = ( cqe->user_data >> 3 ) & 0x1fffffff;
+		unsigned gen = cqe->user_data >> 32;
+		int kind = cqe->user_data & 7, ev = 0;
+		slap_uring_sock *us = &slap_urs[fd];
+
+		if ( kind == SLAP_URING_CANCEL )
+			continue;
+
+		if ( kind == SLAP_URING_RECV && us->us_rgen == gen )
+			us->us_inflight = 0;
+
+		if ( gen != us->us_gen || !us->us_active ) {
+			/* left over from a removed descriptor */
+			if ( kind == SLAP_URING_RECV && us->us_rgen == gen ) {
+				if ( !us->us_active ) {
+					slap_uring_free( us );
+				} else if ( us->us_pending ) {
+					us->us_pending = 0;
+					slap_uring_recv( t, fd );
+				}
+			}
+			continue;
+		}
+
+		switch ( kind ) {
+		case SLAP_URING_RECV:
+			us->us_armed &= ~SLAP_URING_READ;
+			ldap_pvt_thread_mutex_lock( &us->us_mutex );
+			if ( cqe->res > 0 ) {
+				us->us_len = cqe->res;
+				ev = SLAP_URING_READ;
+				if ( (ber_len_t)cqe->res == us->us_size &&
+					us->us_size < SLAP_URING_RECVMAX &&
+					us->us_off == 0 )
+				{
+					/* the next receive may want more room */
+					us->us_size *= 2;
+					us->us_buf = ch_realloc( us->us_buf, us->us_size );
+				}
+			} else if ( cqe->res == 0 ) {
+				us->us_err = -1;
+				ev = SLAP_URING_READ;
+			} else if ( cqe->res != -EINTR && cqe->res != -EAGAIN ) {
+				us->us_err = -cqe->res;
+				ev = SLAP_URING_READ;
+			}
+			ldap_pvt_thread_mutex_unlock( &us->us_mutex );
+			break;
+
+		case SLAP_URING_POLLIN:
+		case SLAP_URING_KICK:
+			us->us_armed &= ~SLAP_URING_READ;
+			ev = SLAP_URING_READ;
+			break;
+
+		case SLAP_URING_POLLOUT:
+			us->us_armed &= ~SLAP_URING_WRITE;
+			ev = SLAP_URING_WRITE;
+			break;
+		}
+
+		/* drop what has been lost interest in meanwhile */
+		ev &= us->us_want;
+		if ( fd == wake_sds[t][0] ) {
+			slap_uring_rearm( t, fd );
+		} else if ( !ev ) {
+			slap_uring_rearm( t, fd );
+			continue;
+		}
+		sd->sd_events[n].se_fd = fd;
+		sd->sd_events[n].se_events = ev;
+		n++;
+	}
+	__atomic_store_n( sd->sd_cqhead, head, __ATOMIC_RELEASE );
+	return n;
+}
+
+static int
+slap_uring_wait( int t, struct timeval *tvp )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned submit;
+	int rc, err, n;
+
+	memset( &arg, 0, sizeof(arg) );
+	if ( tvp ) {
+		ts.tv_sec = tvp->tv_sec;
+		ts.tv_nsec = tvp->tv_usec * 1000;
+		arg.ts = (__u64)(uintptr_t)&ts;
+	}
+
+	ldap_pvt_thread_mutex_lock( &sd->sd_mutex );
+	sd->sd_blocked = 1;
+	submit = *sd->sd_sqtail - __atomic_load_n( sd->sd_sqhead, __ATOMIC_ACQUIRE );
+	ldap_pvt_thread_mutex_unlock( &sd->sd_mutex );
+
+	rc = slap_uring_enter( t, submit, 1,
+		IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg) );
+	err = errno;
+
+	ldap_pvt_thread_mutex_lock( &sd->sd_mutex );
+	sd->sd_blocked = 0;
+	n = slap_uring_reap( t );
+	ldap_pvt_thread_mutex_unlock( &sd->sd_mutex );
+
+	if ( n == 0 && rc < 0 && err != ETIME ) {
+		errno = err;
+		return -1;
+	}
+	return n;
+}
+
+/*
+ * Sockbuf provider for sessions whose reads complete on the ring.
+ * Writes and everything else go through ber_sockbuf_io_tcp.
+ */
+static int
+slap_uring_sb_setup( Sockbuf_IO_Desc *sbiod, void *arg )
+{
+	slap_uring_sock *us;
+	int rc;
+
+	rc = ber_sockbuf_io_tcp.sbi_setup( sbiod, arg );
+	us = &slap_urs[*(ber_socket_t *)arg];
+	sbiod->sbiod_pvt = us;
+	ldap_pvt_thread_mutex_lock( &us->us_mutex );
+	us->us_off = us->us_len = 0;
+	us->us_err = 0;
+	ldap_pvt_thread_mutex_unlock( &us->us_mutex );
+	us->us_recv = 1;
+	return rc;
+}
+
+static ber_slen_t
+slap_uring_sb_read( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	slap_uring_sock *us = sbiod->sbiod_pvt;
+	ber_slen_t rc;
+
+	ldap_pvt_thread_mutex_lock( &us->us_mutex );
+	if ( us->us_off < us->us_len ) {
+		if ( len > us->us_len - us->us_off )
+			len = us->us_len - us->us_off;
+		AC_MEMCPY( buf, us->us_buf + us->us_off, len );
+		us->us_off += len;
+		rc = len;
+	} else if ( us->us_err < 0 ) {
+		rc = 0;
+	} else {
+		errno = us->us_err ? us->us_err : EWOULDBLOCK;
+		rc = -1;
+	}
+	ldap_pvt_thread_mutex_unlock( &us->us_mutex );
+	return rc;
+}
+
+static int
+slap_uring_sb_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg )
+{
+	slap_uring_sock *us = sbiod->sbiod_pvt;
+	int rc = 0;
+
+	if ( opt == LBER_SB_OPT_DATA_READY ) {
+		ldap_pvt_thread_mutex_lock( &us->us_mutex );
+		rc = us->us_off < us->us_len;
+		ldap_pvt_thread_mutex_unlock( &us->us_mutex );
+	}
+	return rc;
+}
+
+static int
+slap_uring_init( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	struct io_uring_params p;
+	char *sq, *cq;
+	int i;
+
+	if ( slap_urs == NULL ) {
+		slap_urs = ch_calloc( dtblsize, sizeof(slap_uring_sock) );
+		for ( i = 0; i < dtblsize; i++ )
+			ldap_pvt_thread_mutex_init( &slap_urs[i].us_mutex );
+
+		slapd_sockbuf_io_uring = ber_sockbuf_io_tcp;
+		slapd_sockbuf_io_uring.sbi_setup = slap_uring_sb_setup;
+		slapd_sockbuf_io_uring.sbi_ctrl = slap_uring_sb_ctrl;
+		slapd_sockbuf_io_uring.sbi_read = slap_uring_sb_read;
+	}
+
+	memset( &p, 0, sizeof(p) );
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = 8 * SLAP_URING_ENTRIES;
+	sd->sd_urfd = syscall( __NR_io_uring_setup, SLAP_URING_ENTRIES, &p );
+	if ( sd->sd_urfd < 0 )
+		return -1;
+	if ( !( p.features & IORING_FEAT_EXT_ARG )) {
+		close( sd->sd_urfd );
+		errno = ENOSYS;
+		return -1;
+	}
+
+	sd->sd_sqentries = p.sq_entries;
+	sd->sd_sqmaplen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	sd->sd_cqmaplen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+		if ( sd->sd_cqmaplen > sd->sd_sqmaplen )
+			sd->sd_sqmaplen = sd->sd_cqmaplen;
+		sd->sd_cqmaplen = 0;
+	}
+	sq = mmap( NULL, sd->sd_sqmaplen, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, sd->sd_urfd, IORING_OFF_SQ_RING );
+	if ( sq == MAP_FAILED )
+		return -1;
+	sd->sd_sqmap = sq;
+	cq = sq;
+	if ( sd->sd_cqmaplen ) {
+		cq = mmap( NULL, sd->sd_cqmaplen, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_POPULATE, sd->sd_urfd, IORING_OFF_CQ_RING );
+		if ( cq == MAP_FAILED )
+			return -1;
+		sd->sd_cqmap = cq;
+	}
+	sd->sd_sqeslen = p.sq_entries * sizeof(struct io_uring_sqe);
+	sd->sd_sqes = mmap( NULL, sd->sd_sqeslen, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, sd->sd_urfd, IORING_OFF_SQES );
+	if ( sd->sd_sqes == MAP_FAILED ) {
+		sd->sd_sqes = NULL;
+		return -1;
+	}
+	sd->sd_sqhead = (unsigned *)(sq + p.sq_off.head);
+	sd->sd_sqtail = (unsigned *)(sq + p.sq_off.tail);
+	sd->sd_sqarray = (unsigned *)(sq + p.sq_off.array);
+	sd->sd_sqmask = *(unsigned *)(sq + p.sq_off.ring_mask);
+	sd->sd_cqhead = (unsigned *)(cq + p.cq_off.head);
+	sd->sd_cqtail = (unsigned *)(cq + p.cq_off.tail);
+	sd->sd_cqmask = *(unsigned *)(cq + p.cq_off.ring_mask);
+	sd->sd_cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	sd->sd_nevents = p.cq_entries;
+	sd->sd_events = ch_malloc( sd->sd_nevents * sizeof(slap_uring_event) );
+	sd->sd_nfds = 0;
+	return 0;
+}
+
+static void
+slap_uring_destroy( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+
+	if ( sd->sd_sqes )
+		munmap( sd->sd_sqes, sd->sd_sqeslen );
+	if ( sd->sd_cqmap )
+		munmap( sd->sd_cqmap, sd->sd_cqmaplen );
+	if ( sd->sd_sqmap )
+		munmap( sd->sd_sqmap, sd->sd_sqmaplen );
+	sd->sd_sqes = NULL;
+	sd->sd_sqmap = sd->sd_cqmap = NULL;
+	if ( sd->sd_urfd > 0 ) {
+		close( sd->sd_urfd );
+		sd->sd_urfd = -1;
+	}
+	if ( sd->sd_events ) {
+		ch_free( sd->sd_events );
+		sd->sd_events = NULL;
+	}
+	if ( t == 0 && slap_urs ) {
+		int i;
+
+		for ( i = 0; i < dtblsize; i++ ) {
+			ch_free( slap_urs[i].us_buf );
+			ldap_pvt_thread_mutex_destroy( &slap_urs[i].us_mutex );
+		}
+		ch_free( slap_urs );
+		slap_urs = NULL;
+	}
+}
+
+# define SLAP_SOCK_INIT(t)		do { \
+	if ( slap_uring_init( t ) < 0 ) { \
+		Debug( LDAP_DEBUG_ANY, \
+			"daemon: io_uring setup failed, errno=%d, shutting down\n", \
+			errno, 0, 0 ); \
+		slapd_shutdown = 2; \
+	} \
+} while (0)
+
+# define SLAP_SOCK_DESTROY(t)		slap_uring_destroy( t )
+
+# define SLAP_SOCK_IS_ACTIVE(t,s)	(slap_urs[(s)].us_active)
+# define SLAP_SOCK_NOT_ACTIVE(t,s)	(!slap_urs[(s)].us_active)
+# define SLAP_SOCK_IS_READ(t,s)		(slap_urs[(s)].us_want & SLAP_URING_READ)
+# define SLAP_SOCK_IS_WRITE(t,s)	(slap_urs[(s)].us_want & SLAP_URING_WRITE)
+
+# define SLAP_SOCK_SET_READ(t,s)	slap_uring_arm( (t), (s), SLAP_URING_READ )
+# define SLAP_SOCK_SET_WRITE(t,s)	slap_uring_arm( (t), (s), SLAP_URING_WRITE )
+/* requests already armed are left alone; their completion is ignored */
+# define SLAP_SOCK_CLR_READ(t,s)	(slap_urs[(s)].us_want &= ~SLAP_URING_READ)
+# define SLAP_SOCK_CLR_WRITE(t,s)	(slap_urs[(s)].us_want &= ~SLAP_URING_WRITE)
+
+# define SLAP_SOCK_ADD(t,s,l)		slap_uring_add( (t), (s), (l) )
+# define SLAP_SOCK_DEL(t,s)		slap_uring_del( (t), (s) )
+
+# define SLAP_EVENTS_ONESHOT		1
+# define SLAP_SOCK_IS_ONESHOT(t,s)	1
+# define SLAP_SOCK_REARM(t,s)		slap_uring_rearm( (t), (s) )
+
+# define SLAP_EVENT_MAX(t)		slap_daemon[t].sd_nevents
+# define SLAP_EVENT_DECL		slap_uring_event *revents
+# define SLAP_EVENT_INIT(t)		do { \
+	revents = slap_daemon[t].sd_events; \
+} while (0)
+
+# define SLAP_EVENT_IS_READ(i)		(revents[(i)].se_events & SLAP_URING_READ)
+# define SLAP_EVENT_IS_WRITE(i)		(revents[(i)].se_events & SLAP_URING_WRITE)
+# define SLAP_EVENT_CLR_READ(i)		(revents[(i)].se_events &= ~SLAP_URING_READ)
+# define SLAP_EVENT_CLR_WRITE(i)	(revents[(i)].se_events &= ~SLAP_URING_WRITE)
+# define SLAP_EVENT_FD(t,i)		(revents[(i)].se_fd)
+# define SLAP_EVENT_IS_LISTENER(t,i)	(slap_urs[revents[(i)].se_fd].us_l != NULL)
+# define SLAP_EVENT_LISTENER(t,i)	(slap_urs[revents[(i)].se_fd].us_l)
+
+# define SLAP_EVENT_WAIT(t, tvp, nsp)	do { \
+	*(nsp) = slap_uring_wait( (t), (tvp) ); \
+} while (0)
+
+/*-------------------------------------------------------------------------------*/
+
+#elif defined(HAVE_KQUEUE)
 # define SLAP_EVENT_FNAME		    "kqueue"
 # define SLAP_EVENTS_ARE_INDEXED	0
 # define SLAP_EVENT_MAX(t)             (2 * dtblsize)  /* each fd can have a read & a write event */
@@ -418,6 +1026,20 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 # define SLAP_SOCK_IS_READ(t,s)		SLAP_EPOLL_SOCK_IS_SET(t,(s), EPOLLIN)
 # define SLAP_SOCK_IS_WRITE(t,s)		SLAP_EPOLL_SOCK_IS_SET(t,(s), EPOLLOUT)
 
+/* Sessions are armed one-shot unless SLAP_EPOLL_LEVEL is defined: an
+ * event disables the descriptor in the kernel, so dropping interest
+ * needs no epoll_ctl(), and re-arming it from a pool thread takes
+ * effect at once without waking the listener thread.  The listener
+ * thread re-arms whatever interest is left after handling an event.
+ */
+#ifndef SLAP_EPOLL_LEVEL
+# define SLAP_EVENTS_ONESHOT		1
+# define SLAP_EPOLL_ONESHOT		EPOLLONESHOT
+#else
+# define SLAP_EPOLL_ONESHOT		0
+#endif
+# define SLAP_SOCK_IS_ONESHOT(t,s)	SLAP_EPOLL_SOCK_IS_SET(t,(s), EPOLLONESHOT)
+
 # define SLAP_EPOLL_SOCK_SET(t,s, mode)	do { \
 	if ( (SLAP_EPOLL_SOCK_EV(t,s) & (mode)) != (mode) ) {	\
 		SLAP_EPOLL_SOCK_EV(t,s) |= (mode); \
@@ -426,14 +1048,24 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 	} \
 } while (0)
 
+/* a one-shot descriptor may report a dropped interest once more;
+ * the event handlers check the interest before acting on it */
 # define SLAP_EPOLL_SOCK_CLR(t,s, mode)	do { \
 	if ( (SLAP_EPOLL_SOCK_EV(t,s) & (mode)) ) { \
 		SLAP_EPOLL_SOCK_EV(t,s) &= ~(mode);	\
-		epoll_ctl( slap_daemon[t].sd_epfd, EPOLL_CTL_MOD, s, \
-			&SLAP_EPOLL_SOCK_EP(t,s) ); \
+		if ( !SLAP_SOCK_IS_ONESHOT(t,s) ) \
+			epoll_ctl( slap_daemon[t].sd_epfd, EPOLL_CTL_MOD, s, \
+				&SLAP_EPOLL_SOCK_EP(t,s) ); \
 	} \
 } while (0)
 
+# define SLAP_SOCK_REARM(t,s)		do { \
+	if ( SLAP_SOCK_IS_ONESHOT(t,s) && \
+		SLAP_EPOLL_SOCK_IS_SET(t,(s), EPOLLIN|EPOLLOUT) ) \
+		epoll_ctl( slap_daemon[t].sd_epfd, EPOLL_CTL_MOD, (s), \
+			&SLAP_EPOLL_SOCK_EP(t,s) ); \
+} while (0)
+
 # define SLAP_SOCK_SET_READ(t,s)		SLAP_EPOLL_SOCK_SET(t,s, EPOLLIN)
 # define SLAP_SOCK_SET_WRITE(t,s)		SLAP_EPOLL_SOCK_SET(t,s, EPOLLOUT)
 
@@ -460,7 +1092,8 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 	int rc; \
 	SLAP_EPOLL_SOCK_IX(t,(s)) = slap_daemon[t].sd_nfds; \
 	SLAP_EPOLL_SOCK_EP(t,(s)).data.ptr = (l) ? (l) : (void *)(&SLAP_EPOLL_SOCK_IX(t,s)); \
-	SLAP_EPOLL_SOCK_EV(t,(s)) = EPOLLIN; \
+	SLAP_EPOLL_SOCK_EV(t,(s)) = EPOLLIN | \
+		( (l) || (s) == wake_sds[t][0] ? 0 : SLAP_EPOLL_ONESHOT ); \
 	rc = epoll_ctl(slap_daemon[t].sd_epfd, EPOLL_CTL_ADD, \
 		(s), &SLAP_EPOLL_SOCK_EP(t,(s))); \
 	if ( rc == 0 ) { \
@@ -905,6 +1538,11 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 # endif /* !HAVE_WINSOCK */
 #endif /* ! kqueue && ! epoll && ! /dev/poll */
 
+#ifndef SLAP_SOCK_IS_ONESHOT
+# define SLAP_SOCK_IS_ONESHOT(t,s)	0
+# define SLAP_SOCK_REARM(t,s)
+#endif
+
 #ifdef HAVE_SLP
 /*
  * SLP related functions
@@ -1205,7 +1843,9 @@ slapd_clr_read( ber_socket_t s, int wake )
 	int id = DAEMON_ID(s);
 	ldap_pvt_thread_mutex_lock( &slap_daemon[id].sd_mutex );
 
-	if ( SLAP_SOCK_IS_ACTIVE( id, s )) {
+	/* a one-shot descriptor may report a read we no longer want */
+	if ( SLAP_SOCK_IS_ACTIVE( id, s ) &&
+		( SLAP_SOCK_IS_READ( id, s ) || !SLAP_SOCK_IS_ONESHOT( id, s ))) {
 		SLAP_SOCK_CLR_READ( id, s );
 		rc = 0;
 	}
@@ -1224,6 +1864,9 @@ slapd_set_read( ber_socket_t s, int wake )
 
 	if( SLAP_SOCK_IS_ACTIVE( id, s ) && !SLAP_SOCK_IS_READ( id, s )) {
 		SLAP_SOCK_SET_READ( id, s );
+		/* re-arming took effect already */
+		if ( SLAP_SOCK_IS_ONESHOT( id, s ))
+			do_wake = 0;
 	} else {
 		do_wake = 0;
 	}
@@ -1489,6 +2132,104 @@ errexit:
 	return -1;
 }
 
+#if defined(SO_REUSEPORT) && defined(F_DUPFD) && SLAPD_MAX_DAEMON_THREADS > 1
+#define SLAP_REUSEPORT
+
+/* Move s to a descriptor congruent to want modulo SLAPD_MAX_DAEMON_THREADS,
+ * so that DAEMON_ID() hands it to a given listener thread whatever
+ * power of two slapd_daemon_threads ends up being.
+ */
+static ber_socket_t
+slap_shard_fd( ber_socket_t s, int want )
+{
+	int fd, from = want;
+
+	for (;;) {
+		fd = fcntl( s, F_DUPFD, from );
+		if ( fd < 0 )
+			return s;
+		if ( fd % SLAPD_MAX_DAEMON_THREADS == want )
+			break;
+		close( fd );
+		from = fd + ( want - fd % SLAPD_MAX_DAEMON_THREADS +
+			SLAPD_MAX_DAEMON_THREADS ) % SLAPD_MAX_DAEMON_THREADS;
+	}
+	close( s );
+	return fd;
+}
+
+/* Open SO_REUSEPORT clones of a bound TCP listener, one for each
+ * possible listener thread; the kernel spreads incoming connections
+ * across them.  Clones beyond slapd_daemon_threads are closed again
+ * by slapd_daemon() once the configuration is known.
+ */
+static void
+slap_shard_listener(
+	Listener *li,
+	int addrlen,
+	int *listeners,
+	int *cur )
+{
+	Listener *sh;
+	ber_socket_t s;
+	int i, rc, tmp, err, family = li->sl_sa.sa_addr.sa_family;
+
+	*listeners += SLAPD_MAX_DAEMON_THREADS - 1;
+	slap_listeners = ch_realloc( slap_listeners,
+		(*listeners + 1) * sizeof(Listener *) );
+
+	for ( i = 1; i < SLAPD_MAX_DAEMON_THREADS; i++ ) {
+		s = socket( family, SOCK_STREAM, 0 );
+		if ( s == AC_SOCKET_INVALID ) {
+			err = sock_errno();
+			Debug( LDAP_DEBUG_ANY,
+				"daemon: %s shard socket() failed errno=%d (%s)\n",
+				li->sl_url.bv_val, err, sock_errstr(err) );
+			break;
+		}
+		s = slap_shard_fd( s, ( li->sl_sd + i ) % SLAPD_MAX_DAEMON_THREADS );
+		if ( s >= dtblsize ) {
+			tcp_close( s );
+			break;
+		}
+
+		tmp = 1;
+		(void) setsockopt( s, SOL_SOCKET, SO_REUSEADDR,
+			(char *) &tmp, sizeof(tmp) );
+		(void) setsockopt( s, SOL_SOCKET, SO_REUSEPORT,
+			(char *) &tmp, sizeof(tmp) );
+#if defined(LDAP_PF_INET6) && defined(IPV6_V6ONLY)
+		if ( family == AF_INET6 ) {
+			(void) setsockopt( s, IPPROTO_IPV6, IPV6_V6ONLY,
+				(char *) &tmp, sizeof(tmp) );
+		}
+#endif /* LDAP_PF_INET6 && IPV6_V6ONLY */
+
+		rc = bind( s, &li->sl_sa.sa_addr, addrlen );
+		if ( rc ) {
+			err = sock_errno();
+			Debug( LDAP_DEBUG_ANY,
+				"daemon: %s shard bind failed errno=%d (%s)\n",
+				li->sl_url.bv_val, err, sock_errstr(err) );
+			tcp_close( s );
+			break;
+		}
+
+		sh = ch_malloc( sizeof( Listener ) );
+		*sh = *li;
+		sh->sl_sd = SLAP_SOCKNEW( s );
+		sh->sl_shard = i;
+		ber_dupbv( &sh->sl_url, &li->sl_url );
+		ber_dupbv( &sh->sl_name, &li->sl_name );
+		slap_listeners[*cur] = sh;
+		(*cur)++;
+	}
+
+	Debug( LDAP_DEBUG_TRACE, "daemon: %s opened with %d shards\n",
+		li->sl_url.bv_val, i, 0 );
+}
+#endif /* SO_REUSEPORT && F_DUPFD */
+
 static int
 slap_open_listener(
 	const char* url,
@@ -1524,6 +2265,7 @@ slap_open_listener(
 	l.sl_url.bv_val = NULL;
 	l.sl_mute = 0;
 	l.sl_busy = 0;
+	l.sl_shard = 0;
 
 #ifndef HAVE_TLS
 	if( ldap_pvt_url_scheme2tls( lud->lud_scheme ) ) {
@@ -1667,6 +2409,19 @@ slap_open_listener(
 					(long) l.sl_sd, err, sock_errstr(err) );
 			}
 #endif /* SO_REUSEADDR */
+#ifdef SLAP_REUSEPORT
+			if ( slapd_reuseport && socktype == SOCK_STREAM ) {
+				tmp = 1;
+				rc = setsockopt( s, SOL_SOCKET, SO_REUSEPORT,
+					(char *) &tmp, sizeof(tmp) );
+				if ( rc == AC_SOCKET_ERROR ) {
+					int err = sock_errno();
+					Debug( LDAP_DEBUG_ANY, "slapd(%ld): "
+						"setsockopt(SO_REUSEPORT) failed errno=%d (%s)\n",
+						(long) l.sl_sd, err, sock_errstr(err) );
+				}
+			}
+#endif /* SLAP_REUSEPORT */
 		}
 
 		switch( (*sal)->sa_family ) {
@@ -1794,6 +2549,16 @@ slap_open_listener(
 		*li = l;
 		slap_listeners[*cur] = li;
 		(*cur)++;
+#ifdef SLAP_REUSEPORT
+		if ( slapd_reuseport && socktype == SOCK_STREAM
+#ifdef LDAP_PF_LOCAL
+			&& (*sal)->sa_family != AF_LOCAL
+#endif /* LDAP_PF_LOCAL */
+			)
+		{
+			slap_shard_listener( li, addrlen, listeners, cur );
+		}
+#endif /* SLAP_REUSEPORT */
 		sal++;
 	}
 
@@ -1815,6 +2580,51 @@ static int sockdestroy(void);
 
 static int daemon_inited = 0;
 
+/*
+ * Objects unlinked while the server is running, e.g. an ACL list
+ * replaced by back-config without a pause.  Operations may still be
+ * walking them, so they are only freed once every thread has been
+ * quiesced by the next server pause, or at shutdown.
+ */
+typedef struct slap_retired {
+	struct slap_retired *sr_next;
+	void (*sr_free)( void *ptr );
+	void *sr_ptr;
+} slap_retired;
+
+static slap_retired *retired_list;
+static ldap_pvt_thread_mutex_t retired_mutex;
+
+void
+slap_retire( void (*free_fn)( void *ptr ), void *ptr )
+{
+	slap_retired *sr = ch_malloc( sizeof( slap_retired ));
+
+	sr->sr_free = free_fn;
+	sr->sr_ptr = ptr;
+	ldap_pvt_thread_mutex_lock( &retired_mutex );
+	sr->sr_next = retired_list;
+	retired_list = sr;
+	ldap_pvt_thread_mutex_unlock( &retired_mutex );
+}
+
+static void
+slap_retired_free( void )
+{
+	slap_retired *sr, *next;
+
+	ldap_pvt_thread_mutex_lock( &retired_mutex );
+	sr = retired_list;
+	retired_list = NULL;
+	ldap_pvt_thread_mutex_unlock( &retired_mutex );
+
+	for ( ; sr; sr = next ) {
+		next = sr->sr_next;
+		sr->sr_free( sr->sr_ptr );
+		ch_free( sr );
+	}
+}
+
 int
 slapd_daemon_init( const char *urls )
 {
@@ -1830,6 +2640,7 @@ slapd_daemon_init( const char *urls )
 	}
 
 	ldap_pvt_thread_mutex_init( &slap_daemon[0].sd_mutex );
+	ldap_pvt_thread_mutex_init( &retired_mutex );
 #ifdef HAVE_TCPD
 	ldap_pvt_thread_mutex_init( &sd_tcpd_mutex );
 #endif /* TCP Wrappers */
@@ -1934,6 +2745,7 @@ slapd_daemon_destroy( void )
 			SLAP_SOCK_DESTROY(i);
 		}
 		daemon_inited = 0;
+		ldap_pvt_thread_mutex_destroy( &retired_mutex );
 #ifdef HAVE_TCPD
 		ldap_pvt_thread_mutex_destroy( &sd_tcpd_mutex );
 #endif /* TCP Wrappers */
@@ -3014,14 +3826,25 @@ loop:
 					SLAP_EVENT_CLR_READ( i );
 					connection_read_activate( fd );
 				} else if ( !w ) {
-#ifdef HAVE_EPOLL
-					/* Don't keep reporting the hangup
+#if defined(HAVE_EPOLL) && !defined(SLAP_X_IO_URING)
+					/* Don't keep reporting the hangup; a one-shot
+					 * descriptor is simply left disarmed
 					 */
-					if ( SLAP_SOCK_IS_ACTIVE( tid, fd )) {
+					if ( SLAP_SOCK_IS_ACTIVE( tid, fd ) &&
+						!SLAP_SOCK_IS_ONESHOT( tid, fd )) {
 						SLAP_EPOLL_SOCK_SET( tid, fd, EPOLLET );
 					}
 #endif
+					continue;
+				}
+
+#ifdef SLAP_EVENTS_ONESHOT
+				ldap_pvt_thread_mutex_lock( &slap_daemon[tid].sd_mutex );
+				if ( SLAP_SOCK_IS_ACTIVE( tid, fd )) {
+					SLAP_SOCK_REARM( tid, fd );
 				}
+				ldap_pvt_thread_mutex_unlock( &slap_daemon[tid].sd_mutex );
+#endif /* SLAP_EVENTS_ONESHOT */
 			}
 		}
 #endif	/* SLAP_EVENTS_ARE_INDEXED */
@@ -3122,6 +3945,25 @@ slapd_daemon( void )
 	if ( slapd_daemon_threads > SLAPD_MAX_DAEMON_THREADS )
 		slapd_daemon_threads = SLAPD_MAX_DAEMON_THREADS;
 
+#ifdef SLAP_REUSEPORT
+	/* drop the listener shards no thread will serve */
+	if ( slapd_reuseport ) {
+		Listener **src, **dst;
+
+		for ( src = dst = slap_listeners; *src; src++ ) {
+			if ( (*src)->sl_shard < slapd_daemon_threads ) {
+				*dst++ = *src;
+				continue;
+			}
+			tcp_close( SLAP_FD2SOCK( (*src)->sl_sd ) );
+			ber_memfree( (*src)->sl_url.bv_val );
+			ber_memfree( (*src)->sl_name.bv_val );
+			ch_free( *src );
+		}
+		*dst = NULL;
+	}
+#endif /* SLAP_REUSEPORT */
+
 	listener_tid = ch_malloc(slapd_daemon_threads * sizeof(ldap_pvt_thread_t));
 
 	/* daemon_init only inits element 0 */
@@ -3156,6 +3998,9 @@ slapd_daemon( void )
 	for ( i=0; i<slapd_daemon_threads; i++ )
   		ldap_pvt_thread_join( listener_tid[i], (void *)NULL );
 
+	/* The worker threads are gone too */
+	slap_retired_free();
+
 	destroy_listeners();
 	ch_free( listener_tid );
 	listener_tid = NULL;
@@ -3275,6 +4120,10 @@ slap_pause_server( void )
 
 	rc = ldap_pvt_thread_pool_pause( &connection_pool );
 
+	/* Nothing can be referencing retired objects now */
+	if ( rc == 0 )
+		slap_retired_free();
+
 	LDAP_STAILQ_FOREACH(bi, &backendInfo, bi_next) {
 		if ( bi->bi_pause ) {
 			rc = bi->bi_pause( bi );
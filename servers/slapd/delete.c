@@ -176,6 +176,9 @@ fe_op_delete( Operation *op, SlapReply *rs )
 
 			op->o_bd = op_be;
 			op->o_bd->be_delete( op, rs );
+			if ( rs->sr_err == LDAP_SUCCESS ) {
+				slap_sasl_cache_update( op );
+			}
 
 			org_req_dn = op->o_req_dn;
 			org_req_ndn = op->o_req_ndn;
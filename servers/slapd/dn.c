@@ -55,6 +55,212 @@
 
 int slap_DN_strict = SLAP_AD_NOINSERT;
 
+/*
+ * Cache of pretty/normalized forms of recently seen DNs, keyed by the
+ * raw value.  The table is direct-mapped, so a colliding DN simply
+ * replaces the previous occupant; slots are protected by a fixed set
+ * of striped mutexes.  Only successful results are kept.
+ */
+#define DN_CACHE_LOCKS	64
+#define DN_CACHE_MAXLEN	512
+
+typedef struct dn_cache_slot {
+	struct berval	dcs_val;
+	struct berval	dcs_pretty;
+	struct berval	dcs_normal;
+} dn_cache_slot;
+
+typedef struct dn_cache_lock {
+	ldap_pvt_thread_mutex_t	dcl_mutex;
+	unsigned long	dcl_hits;
+	unsigned long	dcl_misses;
+	char	dcl_pad[64];
+} dn_cache_lock;
+
+static dn_cache_slot *dn_cache;
+static unsigned dn_cache_mask;
+static dn_cache_lock dn_cache_locks[DN_CACHE_LOCKS];
+
+int
+slap_dn_cache_init( void )
+{
+	unsigned n;
+	int i;
+
+	if ( slap_dn_cache_size <= 0 || dn_cache != NULL ) {
+		return 0;
+	}
+
+	for ( n = DN_CACHE_LOCKS; n < (unsigned)slap_dn_cache_size; n <<= 1 )
+		;
+
+	dn_cache = ch_calloc( n, sizeof( dn_cache_slot ) );
+	dn_cache_mask = n - 1;
+	for ( i = 0; i < DN_CACHE_LOCKS; i++ ) {
+		ldap_pvt_thread_mutex_init( &dn_cache_locks[i].dcl_mutex );
+		dn_cache_locks[i].dcl_hits = 0;
+		dn_cache_locks[i].dcl_misses = 0;
+	}
+
+	return 0;
+}
+
+static void
+dn_cache_slot_free( dn_cache_slot *dc )
+{
+	ber_memfree( dc->dcs_val.bv_val );
+	ber_memfree( dc->dcs_pretty.bv_val );
+	ber_memfree( dc->dcs_normal.bv_val );
+	BER_BVZERO( &dc->dcs_val );
+	BER_BVZERO( &dc->dcs_pretty );
+	BER_BVZERO( &dc->dcs_normal );
+}
+
+void
+slap_dn_cache_flush( void )
+{
+	unsigned i;
+
+	if ( dn_cache == NULL ) {
+		return;
+	}
+
+	for ( i = 0; i <= dn_cache_mask; i++ ) {
+		dn_cache_lock *dl = &dn_cache_locks[ i & ( DN_CACHE_LOCKS - 1 ) ];
+
+		ldap_pvt_thread_mutex_lock( &dl->dcl_mutex );
+		dn_cache_slot_free( &dn_cache[i] );
+		ldap_pvt_thread_mutex_unlock( &dl->dcl_mutex );
+	}
+}
+
+void
+slap_dn_cache_destroy( void )
+{
+	int i;
+
+	if ( dn_cache == NULL ) {
+		return;
+	}
+
+	slap_dn_cache_flush();
+	ch_free( dn_cache );
+	dn_cache = NULL;
+	for ( i = 0; i < DN_CACHE_LOCKS; i++ ) {
+		ldap_pvt_thread_mutex_destroy( &dn_cache_locks[i].dcl_mutex );
+	}
+}
+
+void
+slap_dn_cache_stats( unsigned long *hits, unsigned long *misses )
+{
+	int i;
+
+	*hits = *misses = 0;
+	if ( dn_cache == NULL ) {
+		return;
+	}
+
+	for ( i = 0; i < DN_CACHE_LOCKS; i++ ) {
+		ldap_pvt_thread_mutex_lock( &dn_cache_locks[i].dcl_mutex );
+		*hits += dn_cache_locks[i].dcl_hits;
+		*misses += dn_cache_locks[i].dcl_misses;
+		ldap_pvt_thread_mutex_unlock( &dn_cache_locks[i].dcl_mutex );
+	}
+}
+
+static unsigned
+dn_cache_hash( struct berval *val )
+{
+	unsigned h = 2166136261U;
+	ber_len_t i;
+
+	for ( i = 0; i < val->bv_len; i++ ) {
+		h ^= (unsigned char)val->bv_val[i];
+		h *= 16777619U;
+	}
+
+	return h & dn_cache_mask;
+}
+
+/*
+ * Copy the requested forms of val out of the cache; pretty or normal
+ * may be NULL when that form is not wanted.  Returns 1 on a hit.
+ */
+static int
+dn_cache_get(
+	struct berval *val,
+	struct berval *pretty,
+	struct berval *normal,
+	void *ctx )
+{
+	dn_cache_slot *dc;
+	dn_cache_lock *dl;
+	unsigned h;
+	int rc = 0;
+
+	if ( dn_cache == NULL || val->bv_len > DN_CACHE_MAXLEN ) {
+		return 0;
+	}
+
+	h = dn_cache_hash( val );
+	dc = &dn_cache[h];
+	dl = &dn_cache_locks[ h & ( DN_CACHE_LOCKS - 1 ) ];
+
+	ldap_pvt_thread_mutex_lock( &dl->dcl_mutex );
+	if ( bvmatch( &dc->dcs_val, val ) &&
+		( pretty == NULL || dc->dcs_pretty.bv_val != NULL ) &&
+		( normal == NULL || dc->dcs_normal.bv_val != NULL ) )
+	{
+		if ( pretty ) {
+			ber_dupbv_x( pretty, &dc->dcs_pretty, ctx );
+		}
+		if ( normal ) {
+			ber_dupbv_x( normal, &dc->dcs_normal, ctx );
+		}
+		dl->dcl_hits++;
+		rc = 1;
+
+	} else {
+		dl->dcl_misses++;
+	}
+	ldap_pvt_thread_mutex_unlock( &dl->dcl_mutex );
+
+	return rc;
+}
+
+static void
+dn_cache_put(
+	struct berval *val,
+	struct berval *pretty,
+	struct berval *normal )
+{
+	dn_cache_slot *dc;
+	dn_cache_lock *dl;
+	unsigned h;
+
+	if ( dn_cache == NULL || val->bv_len > DN_CACHE_MAXLEN ) {
+		return;
+	}
+
+	h = dn_cache_hash( val );
+	dc = &dn_cache[h];
+	dl = &dn_cache_locks[ h & ( DN_CACHE_LOCKS - 1 ) ];
+
+	ldap_pvt_thread_mutex_lock( &dl->dcl_mutex );
+	if ( !bvmatch( &dc->dcs_val, val ) ) {
+		dn_cache_slot_free( dc );
+		ber_dupbv( &dc->dcs_val, val );
+	}
+	if ( pretty && dc->dcs_pretty.bv_val == NULL ) {
+		ber_dupbv( &dc->dcs_pretty, pretty );
+	}
+	if ( normal && dc->dcs_normal.bv_val == NULL ) {
+		ber_dupbv( &dc->dcs_normal, normal );
+	}
+	ldap_pvt_thread_mutex_unlock( &dl->dcl_mutex );
+}
+
 static int
 LDAPRDN_validate( LDAPRDN rdn )
 {
@@ -426,7 +632,10 @@ dnNormalize(
 
 	Debug( LDAP_DEBUG_TRACE, ">>> dnNormalize: <%s>\n", val->bv_val ? val->bv_val : "", 0, 0 );
 
-	if ( val->bv_len != 0 ) {
+	if ( val->bv_len != 0 && dn_cache_get( val, NULL, out, ctx ) ) {
+		/* cached */
+
+	} else if ( val->bv_len != 0 ) {
 		LDAPDN		dn = NULL;
 		int		rc;
 
@@ -459,6 +668,8 @@ dnNormalize(
 		if ( rc != LDAP_SUCCESS ) {
 			return LDAP_INVALID_SYNTAX;
 		}
+
+		dn_cache_put( val, NULL, out );
 	} else {
 		ber_dupbv_x( out, val, ctx );
 	}
@@ -544,6 +755,9 @@ dnPretty(
 	} else if ( val->bv_len > SLAP_LDAPDN_MAXLEN ) {
 		return LDAP_INVALID_SYNTAX;
 
+	} else if ( dn_cache_get( val, out, NULL, ctx ) ) {
+		/* cached */
+
 	} else {
 		LDAPDN		dn = NULL;
 		int		rc;
@@ -576,6 +790,8 @@ dnPretty(
 		if ( rc != LDAP_SUCCESS ) {
 			return LDAP_INVALID_SYNTAX;
 		}
+
+		dn_cache_put( val, out, NULL );
 	}
 
 	Debug( LDAP_DEBUG_TRACE, "<<< dnPretty: <%s>\n", out->bv_val ? out->bv_val : "", 0, 0 );
@@ -716,6 +932,9 @@ dnPrettyNormal(
 		/* too big */
 		return LDAP_INVALID_SYNTAX;
 
+	} else if ( dn_cache_get( val, pretty, normal, ctx ) ) {
+		/* cached */
+
 	} else {
 		LDAPDN		dn = NULL;
 		int		rc;
@@ -767,6 +986,8 @@ dnPrettyNormal(
 			pretty->bv_len = 0;
 			return LDAP_INVALID_SYNTAX;
 		}
+
+		dn_cache_put( val, pretty, normal );
 	}
 
 	Debug( LDAP_DEBUG_TRACE, "<<< dnPrettyNormal: <%s>, <%s>\n",
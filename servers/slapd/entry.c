@@ -398,11 +398,39 @@ entry2str_wrap(
 	Entry		*e,
 	int			*len,
 	ber_len_t	wrap )
+{
+	struct berval	bv;
+	ber_len_t	size = emaxsize;
+
+	bv.bv_val = ebuf;
+	bv.bv_len = 0;
+	entry2str_append( e, &bv, &size, wrap );
+	ebuf = bv.bv_val;
+	emaxsize = size;
+	ecur = ebuf + bv.bv_len;
+	*len = bv.bv_len;
+
+	return( ebuf );
+}
+
+/*
+ * Reentrant version: append the LDIF form of e to the bv_len bytes in
+ * bv, a buffer of *size bytes that is grown with ch_realloc() as
+ * needed, and keep it NUL terminated.
+ */
+void
+entry2str_append(
+	Entry		*e,
+	struct berval	*bv,
+	ber_len_t	*size,
+	ber_len_t	wrap )
 {
 	Attribute	*a;
-	struct berval	*bv;
+	struct berval	*v;
 	int		i;
 	ber_len_t tmplen;
+	char		*ebuf = bv->bv_val, *ecur = ebuf + bv->bv_len;
+	ber_len_t	emaxsize = *size;
 
 	assert( e != NULL );
 
@@ -412,8 +440,6 @@ entry2str_wrap(
 	 *	[<attr>: <value>\n]*
 	 */
 
-	ecur = ebuf;
-
 	/* put the dn */
 	if ( e->e_dn != NULL ) {
 		/* put "dn: <dn>" */
@@ -426,21 +452,25 @@ entry2str_wrap(
 	for ( a = e->e_attrs; a != NULL; a = a->a_next ) {
 		/* put "<type>:[:] <value>" line for each value */
 		for ( i = 0; a->a_vals[i].bv_val != NULL; i++ ) {
-			bv = &a->a_vals[i];
+			v = &a->a_vals[i];
 			tmplen = a->a_desc->ad_cname.bv_len;
-			MAKE_SPACE( LDIF_SIZE_NEEDED( tmplen, bv->bv_len ));
+			MAKE_SPACE( LDIF_SIZE_NEEDED( tmplen, v->bv_len ));
 			ldif_sput_wrap( &ecur, LDIF_PUT_VALUE,
 				a->a_desc->ad_cname.bv_val,
-				bv->bv_val, bv->bv_len, wrap );
+				v->bv_val, v->bv_len, wrap );
 		}
 	}
 	MAKE_SPACE( 1 );
 	*ecur = '\0';
-	*len = ecur - ebuf;
 
-	return( ebuf );
+	bv->bv_val = ebuf;
+	bv->bv_len = ecur - ebuf;
+	*size = emaxsize;
 }
 
+#define ENTRY_IN_BV( e, p )	( (p) >= (e)->e_bv.bv_val && \
+	(p) < (e)->e_bv.bv_val + (e)->e_bv.bv_len )
+
 void
 entry_clean( Entry *e )
 {
@@ -452,15 +482,15 @@ entry_clean( Entry *e )
 
 	e->e_id = 0;
 
-	/* free DNs */
-	if ( !BER_BVISNULL( &e->e_name ) ) {
+	/* free DNs, unless entry_dup_bv() put them in e_bv */
+	if ( !BER_BVISNULL( &e->e_name ) && !ENTRY_IN_BV( e, e->e_name.bv_val )) {
 		free( e->e_name.bv_val );
-		BER_BVZERO( &e->e_name );
 	}
-	if ( !BER_BVISNULL( &e->e_nname ) ) {
+	BER_BVZERO( &e->e_name );
+	if ( !BER_BVISNULL( &e->e_nname ) && !ENTRY_IN_BV( e, e->e_nname.bv_val )) {
 		free( e->e_nname.bv_val );
-		BER_BVZERO( &e->e_nname );
 	}
+	BER_BVZERO( &e->e_nname );
 
 	if ( !BER_BVISNULL( &e->e_bv ) ) {
 		free( e->e_bv.bv_val );
@@ -954,7 +984,9 @@ entry_dup( Entry *e )
  * heap usage because a single large malloc is harder to satisfy than
  * lots of small ones, and the freed space isn't as easily reusable.
  *
- * Probably not worth using this function.
+ * Only worth it for copies that are never modified, such as the
+ * snapshot syncprov shares among the psearches a write goes to.
+ * The result is released with entry_free().
  */
 Entry *entry_dup_bv( Entry *e )
 {
@@ -986,7 +1018,7 @@ Entry *entry_dup_bv( Entry *e )
 	ret->e_nname.bv_len = e->e_nname.bv_len;
 	ret->e_nname.bv_val = ptr;
 	AC_MEMCPY( ptr, e->e_nname.bv_val, e->e_nname.bv_len );
-	ptr += e->e_name.bv_len;
+	ptr += e->e_nname.bv_len;
 	*ptr++ = '\0';
 
 	dst = ret->e_attrs;
@@ -1018,6 +1050,8 @@ Entry *entry_dup_bv( Entry *e )
 			}
 			BER_BVZERO(bvl);
 			bvl++;
+		} else {
+			dst->a_nvals = dst->a_vals;
 		}
 	}
 	return ret;
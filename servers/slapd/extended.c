@@ -41,11 +41,28 @@
 
 static struct extop_list {
 	struct extop_list *next;
+	struct extop_list *hnext;	/* same supp_ext_hash bucket */
 	struct berval oid;
 	slap_mask_t flags;
 	SLAP_EXTOP_MAIN_FN *ext_main;
 } *supp_ext_list = NULL;
 
+/* Extops hashed by OID for dispatch; maintained alongside the list */
+#define EXTOP_HASH_SIZE	32	/* must be a power of 2 */
+
+static struct extop_list *supp_ext_hash[EXTOP_HASH_SIZE];
+
+static struct extop_list **
+extop_hash_bucket( struct berval *oid )
+{
+	unsigned h = 0;
+	ber_len_t i;
+
+	for ( i = 0; i < oid->bv_len; i++ )
+		h = h * 31 + (unsigned char) oid->bv_val[i];
+	return &supp_ext_hash[h & ( EXTOP_HASH_SIZE - 1 )];
+}
+
 static SLAP_EXTOP_MAIN_FN whoami_extop;
 
 /* This list of built-in extops is for extops that are not part
@@ -65,12 +82,12 @@ static struct {
 	{ &slap_EXOP_CANCEL, 0, cancel_extop },
 	{ &slap_EXOP_WHOAMI, 0, whoami_extop },
 	{ &slap_EXOP_MODIFY_PASSWD, SLAP_EXOP_WRITES, passwd_extop },
+	{ &slap_EXOP_METRICS, SLAP_EXOP_HIDE, metrics_extop },
 	{ NULL, 0, NULL }
 };
 
 
-static struct extop_list *find_extop(
-	struct extop_list *list, struct berval *oid );
+static struct extop_list *find_extop( struct berval *oid );
 
 struct berval *
 get_supported_extop (int index)
@@ -202,7 +219,7 @@ fe_extended( Operation *op, SlapReply *rs )
 		reqdata = *op->ore_reqdata;
 	}
 
-	ext = find_extop(supp_ext_list, &op->ore_reqoid );
+	ext = find_extop( &op->ore_reqoid );
 	if ( ext == NULL ) {
 		Debug( LDAP_DEBUG_ANY, "%s do_extended: unsupported operation \"%s\"\n",
 			op->o_log_prefix, op->ore_reqoid.bv_val, 0 );
@@ -289,13 +306,9 @@ load_extop2(
 		ext_oid = &oidm;
 	}
 
-	for ( ext = supp_ext_list; ext; ext = ext->next ) {
-		if ( bvmatch( ext_oid, &ext->oid ) ) {
-			if ( flags == 1 ) {
-				break;
-			}
-			return -1;
-		}
+	ext = find_extop( (struct berval *)ext_oid );
+	if ( ext != NULL && flags != 1 ) {
+		return -1;
 	}
 
 	if ( flags == 0 || ext == NULL ) {
@@ -316,8 +329,12 @@ load_extop2(
 	ext->ext_main = ext_main;
 
 	if ( insertme ) {
+		struct extop_list **bucket = extop_hash_bucket( &ext->oid );
+
 		ext->next = supp_ext_list;
 		supp_ext_list = ext;
+		ext->hnext = *bucket;
+		*bucket = ext;
 	}
 
 	return(0);
@@ -369,6 +386,11 @@ unload_extop(
 	ext = *extp;
 	*extp = (*extp)->next;
 
+	for ( extp = extop_hash_bucket( &ext->oid ); *extp != ext;
+		extp = &(*extp)->hnext )
+		;
+	*extp = ext->hnext;
+
 	ch_free( ext );
 
 	return 0;
@@ -398,15 +420,16 @@ extops_kill (void)
 		supp_ext_list = ext->next;
 		ch_free(ext);
 	}
+	memset( supp_ext_hash, 0, sizeof( supp_ext_hash ));
 	return(0);
 }
 
 static struct extop_list *
-find_extop( struct extop_list *list, struct berval *oid )
+find_extop( struct berval *oid )
 {
 	struct extop_list *ext;
 
-	for (ext = list; ext; ext = ext->next) {
+	for (ext = *extop_hash_bucket( oid ); ext; ext = ext->hnext) {
 		if (bvmatch(&ext->oid, oid))
 			return(ext);
 	}
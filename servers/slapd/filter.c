@@ -90,7 +90,7 @@ get_filter(
 	ber_tag_t	tag;
 	ber_len_t	len;
 	int		err;
-	Filter		f;
+	Filter		*f;
 
 	Debug( LDAP_DEBUG_FILTER, "begin get_filter\n", 0, 0, 0 );
 	/*
@@ -135,45 +135,50 @@ get_filter(
 
 	err = LDAP_SUCCESS;
 
-	f.f_next = NULL;
-	f.f_choice = tag; 
+	/* Allocate the node before decoding its operands, so that in the
+	 * operation's stack slab a filter is laid out in preorder, each
+	 * node followed by its assertion and its subfilters.
+	 */
+	f = op->o_tmpalloc( sizeof( Filter ), op->o_tmpmemctx );
+	f->f_next = NULL;
+	f->f_choice = tag; 
 
-	switch ( f.f_choice ) {
+	switch ( f->f_choice ) {
 	case LDAP_FILTER_EQUALITY:
 		Debug( LDAP_DEBUG_FILTER, "EQUALITY\n", 0, 0, 0 );
-		err = get_ava( op, ber, &f, SLAP_MR_EQUALITY, text );
+		err = get_ava( op, ber, f, SLAP_MR_EQUALITY, text );
 		if ( err != LDAP_SUCCESS ) {
 			break;
 		}
 
-		assert( f.f_ava != NULL );
+		assert( f->f_ava != NULL );
 		break;
 
 	case LDAP_FILTER_SUBSTRINGS:
 		Debug( LDAP_DEBUG_FILTER, "SUBSTRINGS\n", 0, 0, 0 );
-		err = get_ssa( op, ber, &f, text );
+		err = get_ssa( op, ber, f, text );
 		if( err != LDAP_SUCCESS ) {
 			break;
 		}
-		assert( f.f_sub != NULL );
+		assert( f->f_sub != NULL );
 		break;
 
 	case LDAP_FILTER_GE:
 		Debug( LDAP_DEBUG_FILTER, "GE\n", 0, 0, 0 );
-		err = get_ava( op, ber, &f, SLAP_MR_ORDERING, text );
+		err = get_ava( op, ber, f, SLAP_MR_ORDERING, text );
 		if ( err != LDAP_SUCCESS ) {
 			break;
 		}
-		assert( f.f_ava != NULL );
+		assert( f->f_ava != NULL );
 		break;
 
 	case LDAP_FILTER_LE:
 		Debug( LDAP_DEBUG_FILTER, "LE\n", 0, 0, 0 );
-		err = get_ava( op, ber, &f, SLAP_MR_ORDERING, text );
+		err = get_ava( op, ber, f, SLAP_MR_ORDERING, text );
 		if ( err != LDAP_SUCCESS ) {
 			break;
 		}
-		assert( f.f_ava != NULL );
+		assert( f->f_ava != NULL );
 		break;
 
 	case LDAP_FILTER_PRESENT: {
@@ -186,12 +191,12 @@ get_filter(
 			break;
 		}
 
-		f.f_desc = NULL;
-		err = slap_bv2ad( &type, &f.f_desc, text );
+		f->f_desc = NULL;
+		err = slap_bv2ad( &type, &f->f_desc, text );
 
 		if( err != LDAP_SUCCESS ) {
-			f.f_choice |= SLAPD_FILTER_UNDEFINED;
-			err = slap_bv2undef_ad( &type, &f.f_desc, text,
+			f->f_choice |= SLAPD_FILTER_UNDEFINED;
+			err = slap_bv2undef_ad( &type, &f->f_desc, text,
 				SLAP_AD_PROXIED|SLAP_AD_NOINSERT );
 
 			if ( err != LDAP_SUCCESS ) {
@@ -202,45 +207,45 @@ get_filter(
 					op->o_connid, type.bv_val, err );
 
 				err = LDAP_SUCCESS;
-				f.f_desc = slap_bv2tmp_ad( &type, op->o_tmpmemctx );
+				f->f_desc = slap_bv2tmp_ad( &type, op->o_tmpmemctx );
 			}
 			*text = NULL;
 		}
 
-		assert( f.f_desc != NULL );
+		assert( f->f_desc != NULL );
 		} break;
 
 	case LDAP_FILTER_APPROX:
 		Debug( LDAP_DEBUG_FILTER, "APPROX\n", 0, 0, 0 );
-		err = get_ava( op, ber, &f, SLAP_MR_EQUALITY_APPROX, text );
+		err = get_ava( op, ber, f, SLAP_MR_EQUALITY_APPROX, text );
 		if ( err != LDAP_SUCCESS ) {
 			break;
 		}
-		assert( f.f_ava != NULL );
+		assert( f->f_ava != NULL );
 		break;
 
 	case LDAP_FILTER_AND:
 		Debug( LDAP_DEBUG_FILTER, "AND\n", 0, 0, 0 );
-		err = get_filter_list( op, ber, &f.f_and, text );
+		err = get_filter_list( op, ber, &f->f_and, text );
 		if ( err != LDAP_SUCCESS ) {
 			break;
 		}
-		if ( f.f_and == NULL ) {
-			f.f_choice = SLAPD_FILTER_COMPUTED;
-			f.f_result = LDAP_COMPARE_TRUE;
+		if ( f->f_and == NULL ) {
+			f->f_choice = SLAPD_FILTER_COMPUTED;
+			f->f_result = LDAP_COMPARE_TRUE;
 		}
 		/* no assert - list could be empty */
 		break;
 
 	case LDAP_FILTER_OR:
 		Debug( LDAP_DEBUG_FILTER, "OR\n", 0, 0, 0 );
-		err = get_filter_list( op, ber, &f.f_or, text );
+		err = get_filter_list( op, ber, &f->f_or, text );
 		if ( err != LDAP_SUCCESS ) {
 			break;
 		}
-		if ( f.f_or == NULL ) {
-			f.f_choice = SLAPD_FILTER_COMPUTED;
-			f.f_result = LDAP_COMPARE_FALSE;
+		if ( f->f_or == NULL ) {
+			f->f_choice = SLAPD_FILTER_COMPUTED;
+			f->f_result = LDAP_COMPARE_FALSE;
 		}
 		/* no assert - list could be empty */
 		break;
@@ -248,24 +253,24 @@ get_filter(
 	case LDAP_FILTER_NOT:
 		Debug( LDAP_DEBUG_FILTER, "NOT\n", 0, 0, 0 );
 		(void) ber_skip_tag( ber, &len );
-		err = get_filter( op, ber, &f.f_not, text );
+		err = get_filter( op, ber, &f->f_not, text );
 		if ( err != LDAP_SUCCESS ) {
 			break;
 		}
 
-		assert( f.f_not != NULL );
-		if ( f.f_not->f_choice == SLAPD_FILTER_COMPUTED ) {
-			int fresult = f.f_not->f_result;
-			f.f_choice = SLAPD_FILTER_COMPUTED;
-			op->o_tmpfree( f.f_not, op->o_tmpmemctx );
-			f.f_not = NULL;
+		assert( f->f_not != NULL );
+		if ( f->f_not->f_choice == SLAPD_FILTER_COMPUTED ) {
+			int fresult = f->f_not->f_result;
+			f->f_choice = SLAPD_FILTER_COMPUTED;
+			op->o_tmpfree( f->f_not, op->o_tmpmemctx );
+			f->f_not = NULL;
 
 			switch( fresult ) {
 			case LDAP_COMPARE_TRUE:
-				f.f_result = LDAP_COMPARE_FALSE;
+				f->f_result = LDAP_COMPARE_FALSE;
 				break;
 			case LDAP_COMPARE_FALSE:
-				f.f_result = LDAP_COMPARE_TRUE;
+				f->f_result = LDAP_COMPARE_TRUE;
 				break;
 			default: ;
 				/* (!Undefined) is Undefined */
@@ -276,34 +281,35 @@ get_filter(
 	case LDAP_FILTER_EXT:
 		Debug( LDAP_DEBUG_FILTER, "EXTENSIBLE\n", 0, 0, 0 );
 
-		err = get_mra( op, ber, &f, text );
+		err = get_mra( op, ber, f, text );
 		if ( err != LDAP_SUCCESS ) {
 			break;
 		}
 
-		assert( f.f_mra != NULL );
+		assert( f->f_mra != NULL );
 		break;
 
 	default:
 		(void) ber_scanf( ber, "x" ); /* skip the element */
 		Debug( LDAP_DEBUG_ANY, "get_filter: unknown filter type=%lu\n",
-			f.f_choice, 0, 0 );
-		f.f_choice = SLAPD_FILTER_COMPUTED;
-		f.f_result = SLAPD_COMPARE_UNDEFINED;
+			f->f_choice, 0, 0 );
+		f->f_choice = SLAPD_FILTER_COMPUTED;
+		f->f_result = SLAPD_COMPARE_UNDEFINED;
 		break;
 	}
 
 	if( err != LDAP_SUCCESS && err != SLAPD_DISCONNECT ) {
 		/* ignore error */
 		*text = NULL;
-		f.f_choice = SLAPD_FILTER_COMPUTED;
-		f.f_result = SLAPD_COMPARE_UNDEFINED;
+		f->f_choice = SLAPD_FILTER_COMPUTED;
+		f->f_result = SLAPD_COMPARE_UNDEFINED;
 		err = LDAP_SUCCESS;
 	}
 
 	if ( err == LDAP_SUCCESS ) {
-		*filt = op->o_tmpalloc( sizeof(f), op->o_tmpmemctx );
-		**filt = f;
+		*filt = f;
+	} else {
+		op->o_tmpfree( f, op->o_tmpmemctx );
 	}
 
 	Debug( LDAP_DEBUG_FILTER, "end get_filter %d\n", err, 0, 0 );
@@ -351,7 +357,7 @@ get_ssa(
 	int	rc;
 	struct berval desc, value, nvalue;
 	char		*last;
-	SubstringsAssertion ssa;
+	SubstringsAssertion *ssa;
 
 	*text = "error decoding filter";
 
@@ -362,16 +368,18 @@ get_ssa(
 
 	*text = NULL;
 
-	ssa.sa_desc = NULL;
-	ssa.sa_initial.bv_val = NULL;
-	ssa.sa_any = NULL;
-	ssa.sa_final.bv_val = NULL;
+	/* Like the filter node, allocate the assertion ahead of its values */
+	ssa = op->o_tmpalloc( sizeof( SubstringsAssertion ), op->o_tmpmemctx );
+	ssa->sa_desc = NULL;
+	ssa->sa_initial.bv_val = NULL;
+	ssa->sa_any = NULL;
+	ssa->sa_final.bv_val = NULL;
 
-	rc = slap_bv2ad( &desc, &ssa.sa_desc, text );
+	rc = slap_bv2ad( &desc, &ssa->sa_desc, text );
 
 	if( rc != LDAP_SUCCESS ) {
 		f->f_choice |= SLAPD_FILTER_UNDEFINED;
-		rc = slap_bv2undef_ad( &desc, &ssa.sa_desc, text,
+		rc = slap_bv2undef_ad( &desc, &ssa->sa_desc, text,
 			SLAP_AD_PROXIED|SLAP_AD_NOINSERT );
 
 		if( rc != LDAP_SUCCESS ) {
@@ -379,7 +387,7 @@ get_ssa(
 				"get_ssa: conn %lu unknown attribute type=%s (%ld)\n",
 				op->o_connid, desc.bv_val, (long) rc );
 	
-			ssa.sa_desc = slap_bv2tmp_ad( &desc, op->o_tmpmemctx );
+			ssa->sa_desc = slap_bv2tmp_ad( &desc, op->o_tmpmemctx );
 		}
 	}
 
@@ -389,7 +397,7 @@ get_ssa(
 	 * we can do with this filter. But we continue to parse it
 	 * for logging purposes.
 	 */
-	if ( ssa.sa_desc->ad_type->sat_substr == NULL ) {
+	if ( ssa->sa_desc->ad_type->sat_substr == NULL ) {
 		f->f_choice |= SLAPD_FILTER_UNDEFINED;
 		Debug( LDAP_DEBUG_FILTER,
 		"get_ssa: no substring matching rule for attributeType %s\n",
@@ -414,9 +422,9 @@ get_ssa(
 
 		switch ( tag ) {
 		case LDAP_SUBSTRING_INITIAL:
-			if ( ssa.sa_initial.bv_val != NULL
-				|| ssa.sa_any != NULL 
-				|| ssa.sa_final.bv_val != NULL )
+			if ( ssa->sa_initial.bv_val != NULL
+				|| ssa->sa_any != NULL 
+				|| ssa->sa_final.bv_val != NULL )
 			{
 				rc = LDAP_PROTOCOL_ERROR;
 				goto return_error;
@@ -425,7 +433,7 @@ get_ssa(
 			break;
 
 		case LDAP_SUBSTRING_ANY:
-			if ( ssa.sa_final.bv_val != NULL ) {
+			if ( ssa->sa_final.bv_val != NULL ) {
 				rc = LDAP_PROTOCOL_ERROR;
 				goto return_error;
 			}
@@ -433,7 +441,7 @@ get_ssa(
 			break;
 
 		case LDAP_SUBSTRING_FINAL:
-			if ( ssa.sa_final.bv_val != NULL ) {
+			if ( ssa->sa_final.bv_val != NULL ) {
 				rc = LDAP_PROTOCOL_ERROR;
 				goto return_error;
 			}
@@ -452,7 +460,7 @@ get_ssa(
 
 		/* validate/normalize using equality matching rule validator! */
 		rc = asserted_value_validate_normalize(
-			ssa.sa_desc, ssa.sa_desc->ad_type->sat_equality,
+			ssa->sa_desc, ssa->sa_desc->ad_type->sat_equality,
 			usage, &value, &nvalue, text, op->o_tmpmemctx );
 		if( rc != LDAP_SUCCESS ) {
 			f->f_choice |= SLAPD_FILTER_UNDEFINED;
@@ -465,17 +473,17 @@ get_ssa(
 		switch ( tag ) {
 		case LDAP_SUBSTRING_INITIAL:
 			Debug( LDAP_DEBUG_FILTER, "  INITIAL\n", 0, 0, 0 );
-			ssa.sa_initial = nvalue;
+			ssa->sa_initial = nvalue;
 			break;
 
 		case LDAP_SUBSTRING_ANY:
 			Debug( LDAP_DEBUG_FILTER, "  ANY\n", 0, 0, 0 );
-			ber_bvarray_add_x( &ssa.sa_any, &nvalue, op->o_tmpmemctx );
+			ber_bvarray_add_x( &ssa->sa_any, &nvalue, op->o_tmpmemctx );
 			break;
 
 		case LDAP_SUBSTRING_FINAL:
 			Debug( LDAP_DEBUG_FILTER, "  FINAL\n", 0, 0, 0 );
-			ssa.sa_final = nvalue;
+			ssa->sa_final = nvalue;
 			break;
 
 		default:
@@ -486,11 +494,12 @@ get_ssa(
 return_error:
 			Debug( LDAP_DEBUG_FILTER, "  error=%ld\n",
 				(long) rc, 0, 0 );
-			slap_sl_free( ssa.sa_initial.bv_val, op->o_tmpmemctx );
-			ber_bvarray_free_x( ssa.sa_any, op->o_tmpmemctx );
-			if ( ssa.sa_desc->ad_flags & SLAP_DESC_TEMPORARY )
-				op->o_tmpfree( ssa.sa_desc, op->o_tmpmemctx );
-			slap_sl_free( ssa.sa_final.bv_val, op->o_tmpmemctx );
+			slap_sl_free( ssa->sa_initial.bv_val, op->o_tmpmemctx );
+			ber_bvarray_free_x( ssa->sa_any, op->o_tmpmemctx );
+			if ( ssa->sa_desc->ad_flags & SLAP_DESC_TEMPORARY )
+				op->o_tmpfree( ssa->sa_desc, op->o_tmpmemctx );
+			slap_sl_free( ssa->sa_final.bv_val, op->o_tmpmemctx );
+			op->o_tmpfree( ssa, op->o_tmpmemctx );
 			return rc;
 		}
 
@@ -499,8 +508,9 @@ return_error:
 	}
 
 	if( rc == LDAP_SUCCESS ) {
-		f->f_sub = op->o_tmpalloc( sizeof( ssa ), op->o_tmpmemctx );
-		*f->f_sub = ssa;
+		f->f_sub = ssa;
+	} else {
+		op->o_tmpfree( ssa, op->o_tmpmemctx );
 	}
 
 	Debug( LDAP_DEBUG_FILTER, "end get_ssa\n", 0, 0, 0 );
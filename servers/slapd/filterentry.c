@@ -532,6 +532,7 @@ test_ava_filter(
 {
 	int rc;
 	Attribute	*a;
+	ObjectClass	*oc = NULL;
 #ifdef LDAP_COMP_MATCH
 	int i, num_attr_vals = 0;
 	AttributeAliasing *a_alias = NULL;
@@ -599,6 +600,17 @@ test_ava_filter(
 		return LDAP_COMPARE_FALSE;
 	}
 
+	/* (objectClass=x) is in nearly every filter; resolve the
+	 * asserted class once instead of once per stored value, as
+	 * objectSubClassMatch() would.  Unknown classes keep going
+	 * through the matching rule for its OID/undefined handling.
+	 */
+	if ( type == LDAP_FILTER_EQUALITY &&
+		ava->aa_desc == slap_schema.si_ad_objectClass )
+	{
+		oc = oc_bvfind( &ava->aa_value );
+	}
+
 	rc = LDAP_COMPARE_FALSE;
 
 #ifdef LDAP_COMP_MATCH
@@ -773,7 +785,18 @@ test_ava_filter(
 
 			} else 
 #endif
-			{
+			if ( oc && a->a_desc == ava->aa_desc ) {
+				ObjectClass *voc = oc_bvfind( bv );
+
+				if ( voc == NULL ) {
+					/* unrecognized stored value */
+					ret = LDAP_INVALID_SYNTAX;
+				} else {
+					ret = LDAP_SUCCESS;
+					match = !is_object_subclass( oc, voc );
+				}
+
+			} else {
 				ret = ordered_value_match( &match, a->a_desc, mr, use,
 					bv, &ava->aa_value, &text );
 			}
@@ -61,7 +61,9 @@ BerVarray default_referral = NULL;
 ldap_pvt_thread_pool_t	connection_pool;
 int		connection_pool_max = SLAP_MAX_WORKER_THREADS;
 int		connection_pool_queues = 1;
+int		connection_pool_affinity = 0;
 int		slap_tool_thread_max = 1;
+unsigned long	slap_tool_sortmem;	/* bytes, 0 for the backend's default */
 
 slap_counters_t			slap_counters, *slap_counters_list;
 
@@ -88,6 +90,7 @@ slap_init( int mode, const char *name )
 	slapMode = mode;
 
 	slap_op_init();
+	slap_metrics_init();
 
 #ifdef SLAPD_MODULES
 	if ( module_init() != 0 ) {
@@ -140,12 +143,16 @@ slap_init( int mode, const char *name )
 				connection_pool_max, 0, connection_pool_queues);
 
 		slap_counters_init( &slap_counters );
+		slap_log_init();
+		slap_profile_init();
+		slap_trace_init();
 
 		ldap_pvt_thread_mutex_init( &slapd_rq.rq_mutex );
 		LDAP_STAILQ_INIT( &slapd_rq.task_list );
 		LDAP_STAILQ_INIT( &slapd_rq.run_list );
 
 		slap_passwd_init();
+		slap_limits_init();
 
 		rc = slap_sasl_init();
 
@@ -217,9 +224,16 @@ int slap_startup( Backend *be )
 		"%s startup: initiated.\n",
 		slap_name, 0, 0 );
 
+	slap_dn_cache_init();
+	slap_read_cache_init();
+
 	rc = backend_startup( be );
-	if ( !rc && ( slapMode & SLAP_SERVER_MODE ))
+	if ( !rc && ( slapMode & SLAP_SERVER_MODE )) {
 		slapMode |= SLAP_SERVER_RUNNING;
+		slap_log_start();
+		slap_profile_start();
+		slap_trace_start();
+	}
 	return rc;
 }
 
@@ -232,6 +246,11 @@ int slap_shutdown( Backend *be )
 	/* Make sure the pool stops now even if we did not start up fully */
 	ldap_pvt_thread_pool_close( &connection_pool, 1 );
 
+	/* flush queued stats messages, nothing else can queue them now */
+	slap_log_stop();
+	slap_profile_stop();
+	slap_trace_stop();
+
 	/* let backends do whatever cleanup they need to do */
 	return backend_shutdown( be ); 
 }
@@ -250,6 +269,9 @@ int slap_destroy(void)
 
 	ldap_pvt_thread_pool_free( &connection_pool );
 
+	slap_dn_cache_destroy();
+	slap_read_cache_destroy();
+
 	/* clear out any thread-keys for the main thread */
 	ldap_pvt_thread_pool_context_reset( ldap_pvt_thread_pool_context());
 
@@ -257,6 +279,9 @@ int slap_destroy(void)
 
 	slap_sasl_destroy();
 
+	slap_passwd_destroy();
+	slap_limits_destroy();
+
 	/* rootdse destroy goes before entry_destroy()
 	 * because it may use entry_free() */
 	root_dse_destroy();
@@ -266,6 +291,9 @@ int slap_destroy(void)
 	case SLAP_SERVER_MODE:
 	case SLAP_TOOL_MODE:
 		slap_counters_destroy( &slap_counters );
+		slap_log_destroy();
+		slap_profile_destroy();
+		slap_trace_destroy();
 		break;
 
 	default:
@@ -277,6 +305,7 @@ int slap_destroy(void)
 
 	}
 
+	slap_metrics_destroy();
 	slap_op_destroy();
 
 	ldap_pvt_thread_destroy();
@@ -303,6 +332,7 @@ void slap_counters_init( slap_counters_t *sc )
 		ldap_pvt_mp_init( sc->sc_ops_initiated_[ i ] );
 		ldap_pvt_mp_init( sc->sc_ops_completed_[ i ] );
 	}
+	memset( sc->sc_ops_latency_, 0, sizeof( sc->sc_ops_latency_ ));
 #endif /* SLAPD_MONITOR */
 }
 
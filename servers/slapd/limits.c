@@ -62,144 +62,398 @@ limits2str( unsigned i )
 }
 #endif /* LDAP_DEBUG */
 
+/*
+ * The limits of an operation depend on the database, on its identity
+ * and, for "dn.this" and group rules, on its target and on group
+ * membership. Rather than matching every rule for every search:
+ *
+ * - rules on the identity's DN (exact, onelevel, subtree, children)
+ *   are indexed by pattern, and looked up by walking up the DN of the
+ *   identity; only the other rules are still tried in turn;
+ * - the result is remembered in the Connection for the identity and
+ *   database of the last search, unless a "dn.this" rule had to be
+ *   tried. It is dropped when the limits are reconfigured and, if a
+ *   group rule was tried, with the group caches (backend_group_gen()).
+ */
+static unsigned long limits_gen;
+
+typedef struct limits_dnpat {
+	struct berval ldp_pat;
+	int ldp_num;
+	int ldp_pos[1];		/* indexes in be_limits, ascending */
+} limits_dnpat;
+
+typedef struct limits_index {
+	struct slap_limits **li_limits;
+	Avlnode *li_dnpats;
+	int *li_scan;		/* rules not in li_dnpats, ends with -1 */
+} limits_index;
+
+static Avlnode *limits_indexes;
+static ldap_pvt_thread_rdwr_t limits_indexes_rwlock;
+
 static int
-limits_get( 
-	Operation		*op,
-	struct slap_limits_set 	**limit
-)
+limits_index_cmp( const void *v1, const void *v2 )
 {
-	static struct berval empty_dn = BER_BVC( "" );
-	struct slap_limits **lm;
-	struct berval		*ndns[2];
+	const limits_index *i1 = v1, *i2 = v2;
 
-	assert( op != NULL );
-	assert( limit != NULL );
+	return ( i1->li_limits < i2->li_limits ) ? -1 :
+		( i1->li_limits > i2->li_limits );
+}
 
-	ndns[0] = &op->o_ndn;
-	ndns[1] = &op->o_req_ndn;
+static int
+limits_dnpat_cmp( const void *v1, const void *v2 )
+{
+	const limits_dnpat *p1 = v1, *p2 = v2;
+	int rc = p1->ldp_pat.bv_len - p2->ldp_pat.bv_len;
 
-	Debug( LDAP_DEBUG_TRACE, "==> limits_get: %s self=\"%s\" this=\"%s\"\n",
-			op->o_log_prefix,
-			BER_BVISNULL( ndns[0] ) ? "[anonymous]" : ndns[0]->bv_val,
-			BER_BVISNULL( ndns[1] ) ? "" : ndns[1]->bv_val );
-	/*
-	 * default values
-	 */
-	*limit = &op->o_bd->be_def_limit;
+	if ( rc == 0 )
+		rc = memcmp( p1->ldp_pat.bv_val, p2->ldp_pat.bv_val,
+			p1->ldp_pat.bv_len );
+	return rc;
+}
 
-	if ( op->o_bd->be_limits == NULL ) {
-		return( 0 );
+static void
+limits_index_free( void *v )
+{
+	limits_index *li = v;
+
+	avl_free( li->li_dnpats, ch_free );
+	ch_free( li->li_scan );
+	ch_free( li );
+}
+
+/* Called whenever a set of limits is changed or freed */
+static void
+limits_changed( void )
+{
+	limits_gen++;
+	avl_free( limits_indexes, limits_index_free );
+	limits_indexes = NULL;
+}
+
+static int
+limits_is_dnpat( struct slap_limits *lm )
+{
+	if ( ( lm->lm_flags & SLAP_LIMITS_TYPE_MASK ) != SLAP_LIMITS_TYPE_SELF )
+		return 0;
+
+	switch ( lm->lm_flags & SLAP_LIMITS_MASK ) {
+	case SLAP_LIMITS_EXACT:
+	case SLAP_LIMITS_ONE:
+	case SLAP_LIMITS_SUBTREE:
+	case SLAP_LIMITS_CHILDREN:
+		return 1;
 	}
+	return 0;
+}
+
+static limits_index *
+limits_index_build( struct slap_limits **limits )
+{
+	limits_index *li;
+	limits_dnpat pat, *ldp, *old;
+	int i, n, nscan = 0;
+
+	for ( n = 0; limits[n]; n++ )
+		/* count */ ;
+
+	li = ch_calloc( 1, sizeof( limits_index ));
+	li->li_limits = limits;
+	li->li_scan = ch_malloc( ( n + 1 ) * sizeof( int ));
 
-	for ( lm = op->o_bd->be_limits; lm[0] != NULL; lm++ ) {
-		unsigned	style = lm[0]->lm_flags & SLAP_LIMITS_MASK;
-		unsigned	type = lm[0]->lm_flags & SLAP_LIMITS_TYPE_MASK;
-		unsigned	isthis = type == SLAP_LIMITS_TYPE_THIS;
-		struct berval *ndn = ndns[isthis];
-
-		if ( style == SLAP_LIMITS_ANY )
-			goto found_any;
-
-		if ( BER_BVISEMPTY( ndn ) ) {
-			if ( style == SLAP_LIMITS_ANONYMOUS )
-				goto found_nodn;
-			if ( !isthis )
-				continue;
-			ndn = &empty_dn;
+	for ( i = 0; i < n; i++ ) {
+		if ( !limits_is_dnpat( limits[i] )) {
+			li->li_scan[nscan++] = i;
+			continue;
 		}
 
-		switch ( style ) {
-		case SLAP_LIMITS_EXACT:
-			if ( type == SLAP_LIMITS_TYPE_GROUP ) {
-				int	rc = backend_group( op, NULL,
-						&lm[0]->lm_pat, ndn,
-						lm[0]->lm_group_oc,
-						lm[0]->lm_group_ad );
-				if ( rc == 0 ) {
-					goto found_group;
-				}
-			} else {
-				if ( dn_match( &lm[0]->lm_pat, ndn ) ) {
-					goto found_dn;
-				}
-			}
-			break;
+		pat.ldp_pat = limits[i]->lm_pat;
+		old = avl_find( li->li_dnpats, &pat, limits_dnpat_cmp );
+		ldp = ch_malloc( sizeof( limits_dnpat ) +
+			( old ? old->ldp_num : 0 ) * sizeof( int ));
+		ldp->ldp_pat = limits[i]->lm_pat;
+		ldp->ldp_num = 0;
+		if ( old ) {
+			AC_MEMCPY( ldp->ldp_pos, old->ldp_pos, old->ldp_num * sizeof( int ));
+			ldp->ldp_num = old->ldp_num;
+			avl_delete( &li->li_dnpats, old, limits_dnpat_cmp );
+			ch_free( old );
+		}
+		ldp->ldp_pos[ldp->ldp_num++] = i;
+		avl_insert( &li->li_dnpats, ldp, limits_dnpat_cmp, avl_dup_error );
+	}
+	li->li_scan[nscan] = -1;
 
-		case SLAP_LIMITS_ONE:
-		case SLAP_LIMITS_SUBTREE:
-		case SLAP_LIMITS_CHILDREN: {
-			ber_len_t d;
-			
-			/* ndn shorter than lm_pat */
-			if ( ndn->bv_len < lm[0]->lm_pat.bv_len ) {
+	return li;
+}
+
+/* Position of the first DN rule matching ndn, or -1 */
+static int
+limits_index_find( limits_index *li, struct berval *ndn )
+{
+	limits_dnpat pat, *ldp;
+	int depth, i, best = -1;
+
+	pat.ldp_pat = *ndn;
+	for ( depth = 0; ; depth++ ) {
+		ldp = avl_find( li->li_dnpats, &pat, limits_dnpat_cmp );
+		for ( i = 0; ldp && i < ldp->ldp_num; i++ ) {
+			int pos = ldp->ldp_pos[i];
+
+			if ( best >= 0 && pos >= best )
+				break;
+			switch ( li->li_limits[pos]->lm_flags & SLAP_LIMITS_MASK ) {
+			case SLAP_LIMITS_EXACT:
+				if ( depth != 0 ) continue;
+				break;
+			case SLAP_LIMITS_ONE:
+				if ( depth != 1 ) continue;
+				break;
+			case SLAP_LIMITS_CHILDREN:
+				if ( depth == 0 ) continue;
 				break;
 			}
-			d = ndn->bv_len - lm[0]->lm_pat.bv_len;
+			best = pos;
+			break;
+		}
+		if ( BER_BVISEMPTY( &pat.ldp_pat ))
+			break;
+		dnParent( &pat.ldp_pat, &pat.ldp_pat );
+	}
 
-			if ( d == 0 ) {
-				/* allow exact match for SUBTREE only */
-				if ( style != SLAP_LIMITS_SUBTREE ) {
-					break;
-				}
-			} else {
-				/* check for unescaped rdn separator */
-				if ( !DN_SEPARATOR( ndn->bv_val[d - 1] ) ) {
-					break;
-				}
+	return best;
+}
+
+static limits_index *
+limits_index_get( struct slap_limits **limits )
+{
+	limits_index li, *found;
+
+	li.li_limits = limits;
+	ldap_pvt_thread_rdwr_rlock( &limits_indexes_rwlock );
+	found = avl_find( limits_indexes, &li, limits_index_cmp );
+	ldap_pvt_thread_rdwr_runlock( &limits_indexes_rwlock );
+	if ( found )
+		return found;
+
+	ldap_pvt_thread_rdwr_wlock( &limits_indexes_rwlock );
+	found = avl_find( limits_indexes, &li, limits_index_cmp );
+	if ( !found ) {
+		found = limits_index_build( limits );
+		avl_insert( &limits_indexes, found, limits_index_cmp, avl_dup_error );
+	}
+	ldap_pvt_thread_rdwr_wunlock( &limits_indexes_rwlock );
+
+	return found;
+}
+
+/*
+ * Returns 1 if lm applies to op. *uses is or'ed with the types of the
+ * rules that had to be evaluated.
+ */
+static int
+limits_match(
+	Operation		*op,
+	struct slap_limits	*lm,
+	unsigned		*uses )
+{
+	static struct berval empty_dn = BER_BVC( "" );
+	unsigned	style = lm->lm_flags & SLAP_LIMITS_MASK;
+	unsigned	type = lm->lm_flags & SLAP_LIMITS_TYPE_MASK;
+	unsigned	isthis = type == SLAP_LIMITS_TYPE_THIS;
+	struct berval *ndn = isthis ? &op->o_req_ndn : &op->o_ndn;
+
+	*uses |= type;
+
+	if ( style == SLAP_LIMITS_ANY )
+		goto found_any;
+
+	if ( BER_BVISEMPTY( ndn ) ) {
+		if ( style == SLAP_LIMITS_ANONYMOUS )
+			goto found_nodn;
+		if ( !isthis )
+			return 0;
+		ndn = &empty_dn;
+	}
+
+	switch ( style ) {
+	case SLAP_LIMITS_EXACT:
+		if ( type == SLAP_LIMITS_TYPE_GROUP ) {
+			int	rc = backend_group( op, NULL,
+					&lm->lm_pat, ndn,
+					lm->lm_group_oc,
+					lm->lm_group_ad );
+			if ( rc == 0 ) {
+				goto found_group;
+			}
+		} else {
+			if ( dn_match( &lm->lm_pat, ndn ) ) {
+				goto found_dn;
 			}
+		}
+		break;
+
+	case SLAP_LIMITS_ONE:
+	case SLAP_LIMITS_SUBTREE:
+	case SLAP_LIMITS_CHILDREN: {
+		ber_len_t d;
+		
+		/* ndn shorter than lm_pat */
+		if ( ndn->bv_len < lm->lm_pat.bv_len ) {
+			break;
+		}
+		d = ndn->bv_len - lm->lm_pat.bv_len;
 
-			/* check that ndn ends with lm_pat */
-			if ( strcmp( lm[0]->lm_pat.bv_val, &ndn->bv_val[d] ) != 0 ) {
+		if ( d == 0 ) {
+			/* allow exact match for SUBTREE only */
+			if ( style != SLAP_LIMITS_SUBTREE ) {
+				break;
+			}
+		} else {
+			/* check for unescaped rdn separator */
+			if ( !DN_SEPARATOR( ndn->bv_val[d - 1] ) ) {
 				break;
 			}
+		}
 
-			/* in case of ONE, require exactly one rdn below lm_pat */
-			if ( style == SLAP_LIMITS_ONE ) {
-				if ( dn_rdnlen( NULL, ndn ) != d - 1 ) {
-					break;
-				}
+		/* check that ndn ends with lm_pat */
+		if ( strcmp( lm->lm_pat.bv_val, &ndn->bv_val[d] ) != 0 ) {
+			break;
+		}
+
+		/* in case of ONE, require exactly one rdn below lm_pat */
+		if ( style == SLAP_LIMITS_ONE ) {
+			if ( dn_rdnlen( NULL, ndn ) != d - 1 ) {
+				break;
 			}
+		}
+
+		goto found_dn;
+	}
 
+	case SLAP_LIMITS_REGEX:
+		if ( regexec( &lm->lm_regex, ndn->bv_val, 0, NULL, 0 ) == 0 ) {
 			goto found_dn;
 		}
+		break;
 
-		case SLAP_LIMITS_REGEX:
-			if ( regexec( &lm[0]->lm_regex, ndn->bv_val, 0, NULL, 0 ) == 0 ) {
-				goto found_dn;
-			}
-			break;
+	case SLAP_LIMITS_ANONYMOUS:
+		break;
 
-		case SLAP_LIMITS_ANONYMOUS:
-			break;
+	case SLAP_LIMITS_USERS:
+	found_nodn:
+		Debug( LDAP_DEBUG_TRACE, "<== limits_get: type=%s match=%s\n",
+			dn_source[isthis], limits2str( style ), 0 );
+	found_any:
+		return( 1 );
+
+	found_dn:
+		Debug( LDAP_DEBUG_TRACE,
+			"<== limits_get: type=%s match=%s dn=\"%s\"\n",
+			dn_source[isthis], limits2str( style ), lm->lm_pat.bv_val );
+		return( 1 );
+
+	found_group:
+		Debug( LDAP_DEBUG_TRACE, "<== limits_get: type=GROUP match=EXACT "
+			"dn=\"%s\" oc=\"%s\" ad=\"%s\"\n",
+			lm->lm_pat.bv_val,
+			lm->lm_group_oc->soc_cname.bv_val,
+			lm->lm_group_ad->ad_cname.bv_val );
+		return( 1 );
+
+	default:
+		assert( 0 );	/* unreachable */
+		return( 0 );
+	}
 
-		case SLAP_LIMITS_USERS:
-		found_nodn:
-			Debug( LDAP_DEBUG_TRACE, "<== limits_get: type=%s match=%s\n",
-				dn_source[isthis], limits2str( style ), 0 );
-		found_any:
-			*limit = &lm[0]->lm_limits;
+	return( 0 );
+}
+
+static int
+limits_get( 
+	Operation		*op,
+	struct slap_limits_set 	**limit
+)
+{
+	struct slap_limits **lm;
+	limits_index	*li;
+	Connection	*conn = NULL;
+	unsigned long	gen = limits_gen, ggen = backend_group_gen();
+	unsigned	uses = 0;
+	int		i, best = -1;
+
+	assert( op != NULL );
+	assert( limit != NULL );
+
+	Debug( LDAP_DEBUG_TRACE, "==> limits_get: %s self=\"%s\" this=\"%s\"\n",
+			op->o_log_prefix,
+			BER_BVISNULL( &op->o_ndn ) ? "[anonymous]" : op->o_ndn.bv_val,
+			BER_BVISNULL( &op->o_req_ndn ) ? "" : op->o_req_ndn.bv_val );
+	/*
+	 * default values
+	 */
+	*limit = &op->o_bd->be_def_limit;
+
+	lm = op->o_bd->be_limits;
+	if ( lm == NULL ) {
+		return( 0 );
+	}
+
+	if ( op->o_conn && op->o_conn->c_conn_idx >= 0 && !op->o_do_not_cache ) {
+		int hit;
+
+		conn = op->o_conn;
+		ldap_pvt_thread_mutex_lock( &conn->c_groups_mutex );
+		hit = conn->c_limits_be == op->o_bd && conn->c_limits_gen == gen &&
+			( !conn->c_limits_group || conn->c_limits_ggen == ggen ) &&
+			dn_match( &conn->c_limits_ndn, &op->o_ndn );
+		if ( hit ) {
+			*limit = conn->c_limits;
+		}
+		ldap_pvt_thread_mutex_unlock( &conn->c_groups_mutex );
+		if ( hit ) {
+			Debug( LDAP_DEBUG_TRACE, "<== limits_get: cached\n", 0, 0, 0 );
 			return( 0 );
+		}
+	}
+
+	li = limits_index_get( lm );
+	if ( !BER_BVISEMPTY( &op->o_ndn ) ) {
+		best = limits_index_find( li, &op->o_ndn );
+	}
 
-		found_dn:
+	for ( i = 0; li->li_scan[i] >= 0 &&
+		( best < 0 || li->li_scan[i] < best ); i++ )
+	{
+		if ( limits_match( op, lm[li->li_scan[i]], &uses ) ) {
+			best = li->li_scan[i];
+			break;
+		}
+	}
+
+	if ( best >= 0 ) {
+		if ( limits_is_dnpat( lm[best] ) ) {
 			Debug( LDAP_DEBUG_TRACE,
 				"<== limits_get: type=%s match=%s dn=\"%s\"\n",
-				dn_source[isthis], limits2str( style ), lm[0]->lm_pat.bv_val );
-			*limit = &lm[0]->lm_limits;
-			return( 0 );
-
-		found_group:
-			Debug( LDAP_DEBUG_TRACE, "<== limits_get: type=GROUP match=EXACT "
-				"dn=\"%s\" oc=\"%s\" ad=\"%s\"\n",
-				lm[0]->lm_pat.bv_val,
-				lm[0]->lm_group_oc->soc_cname.bv_val,
-				lm[0]->lm_group_ad->ad_cname.bv_val );
-			*limit = &lm[0]->lm_limits;
-			return( 0 );
+				dn_source[0], limits2str( lm[best]->lm_flags & SLAP_LIMITS_MASK ),
+				lm[best]->lm_pat.bv_val );
+		}
+		*limit = &lm[best]->lm_limits;
+	}
 
-		default:
-			assert( 0 );	/* unreachable */
-			return( -1 );
+	if ( conn && !( uses & SLAP_LIMITS_TYPE_THIS ) ) {
+		ldap_pvt_thread_mutex_lock( &conn->c_groups_mutex );
+		conn->c_limits_be = op->o_bd;
+		conn->c_limits = *limit;
+		conn->c_limits_gen = gen;
+		conn->c_limits_ggen = ggen;
+		conn->c_limits_group = ( uses & SLAP_LIMITS_TYPE_GROUP ) != 0;
+		if ( !dn_match( &conn->c_limits_ndn, &op->o_ndn ) ) {
+			ch_free( conn->c_limits_ndn.bv_val );
+			ber_dupbv( &conn->c_limits_ndn, &op->o_ndn );
 		}
+		ldap_pvt_thread_mutex_unlock( &conn->c_groups_mutex );
 	}
 
 	return( 0 );
@@ -301,6 +555,7 @@ limits_add(
 			sizeof( struct slap_limits * ) * ( i + 2 ) );
 	be->be_limits[i] = lm;
 	be->be_limits[i+1] = NULL;
+	limits_changed();
 	
 	return( 0 );
 }
@@ -1324,6 +1579,20 @@ limits_check( Operation *op, SlapReply *rs )
 	return 0;
 }
 
+void
+slap_limits_init( void )
+{
+	ldap_pvt_thread_rdwr_init( &limits_indexes_rwlock );
+}
+
+void
+slap_limits_destroy( void )
+{
+	avl_free( limits_indexes, limits_index_free );
+	limits_indexes = NULL;
+	ldap_pvt_thread_rdwr_destroy( &limits_indexes_rwlock );
+}
+
 void
 limits_free_one( 
 	struct slap_limits	*lm )
@@ -1335,6 +1604,7 @@ limits_free_one(
 		ch_free( lm->lm_pat.bv_val );
 
 	ch_free( lm );
+	limits_changed();
 }
 
 void
@@ -0,0 +1,403 @@
+/* logging.c - queue stats messages for a separate writer thread */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include <ac/stdarg.h>
+#include <ac/string.h>
+#include <ac/syslog.h>
+
+#include "slap.h"
+
+ber_len_t slap_log_async_size;
+int slap_log_async;
+
+#ifdef SLAP_LOG_ASYNC
+
+/*
+ * Each pool thread formats its stats messages into a ring of its
+ * own, and one logger thread writes them to the debug output and
+ * syslog. A ring has a single writer and a single reader, so the
+ * two indices are handed over with acquire/release atomics and the
+ * worker takes no lock. Threads outside the pool (the main thread
+ * and the listeners) share one ring under a mutex. A message that
+ * does not fit is dropped and counted; the logger reports the count.
+ */
+typedef struct slap_logring {
+	struct slap_logring	*lr_next;
+	char		*lr_buf;
+	unsigned long	lr_size;	/* a power of 2 */
+	unsigned long	lr_head;	/* advanced by the owning thread */
+	unsigned long	lr_tail;	/* advanced by the logger */
+	unsigned long	lr_dropped;
+	int		lr_dead;	/* the owning thread has exited */
+} slap_logring;
+
+/* a record is a header followed by the text, padded to the header size */
+typedef struct slap_logrec {
+	unsigned int	lh_len;
+	int		lh_level;
+} slap_logrec;
+
+#define SLAP_LOGREC_WRAP	((unsigned int)-1)	/* rest of the ring is unused */
+#define SLAP_LOGREC_SIZE(len) \
+	( sizeof(slap_logrec) + \
+	  ( ( (len) + sizeof(slap_logrec) - 1 ) & ~( sizeof(slap_logrec) - 1 ) ) )
+
+#define SLAP_LOG_MSGMAX		4096
+#define SLAP_LOG_MINSIZE	( 2 * SLAP_LOG_MSGMAX )
+
+static slap_logring *slap_log_rings;
+static slap_logring slap_log_mainring;
+static void *slap_log_mainctx;
+
+static ldap_pvt_thread_mutex_t slap_log_mutex;		/* rings list, wakeups */
+static ldap_pvt_thread_mutex_t slap_log_mainmutex;	/* slap_log_mainring */
+static ldap_pvt_thread_cond_t slap_log_cond;
+static ldap_pvt_thread_t slap_log_tid;
+static int slap_log_running;
+static int slap_log_idle;
+static int slap_log_shutdown;
+
+static unsigned long
+slap_log_ringsize( void )
+{
+	unsigned long size = SLAP_LOG_MINSIZE;
+
+	while ( size < slap_log_async_size )
+		size <<= 1;
+	return size;
+}
+
+static void
+slap_logring_put( slap_logring *lr, int level, const char *text, int len )
+{
+	slap_logrec *rec;
+	unsigned long head, tail, pos, need, room;
+
+	need = SLAP_LOGREC_SIZE( len );
+	head = lr->lr_head;
+	tail = __atomic_load_n( &lr->lr_tail, __ATOMIC_ACQUIRE );
+	pos = head & ( lr->lr_size - 1 );
+	room = lr->lr_size - pos;
+
+	if ( room < need ) {
+		/* records are contiguous, skip to the start of the ring */
+		if ( lr->lr_size - ( head - tail ) < room + need )
+			goto drop;
+		rec = (slap_logrec *)( lr->lr_buf + pos );
+		rec->lh_len = SLAP_LOGREC_WRAP;
+		head += room;
+		pos = 0;
+	} else if ( lr->lr_size - ( head - tail ) < need ) {
+		goto drop;
+	}
+
+	rec = (slap_logrec *)( lr->lr_buf + pos );
+	rec->lh_len = len;
+	rec->lh_level = level;
+	AC_MEMCPY( rec + 1, text, len );
+	__atomic_store_n( &lr->lr_head, head + need, __ATOMIC_RELEASE );
+	return;
+
+drop:
+	__atomic_fetch_add( &lr->lr_dropped, 1, __ATOMIC_RELAXED );
+}
+
+static void
+slap_logring_free( void *key, void *data )
+{
+	slap_logring *lr = data;
+
+	/* the logger frees it once it has been drained */
+	__atomic_store_n( &lr->lr_dead, 1, __ATOMIC_RELEASE );
+}
+
+static slap_logring *
+slap_logring_get( void *ctx )
+{
+	slap_logring *lr = NULL;
+
+	if ( ldap_pvt_thread_pool_getkey( ctx, (void *)slap_logring_get,
+		(void **)&lr, NULL ) == 0 && lr )
+		return lr;
+
+	lr = ch_calloc( 1, sizeof( slap_logring ) );
+	lr->lr_size = slap_log_ringsize();
+	lr->lr_buf = ch_malloc( lr->lr_size );
+	if ( ldap_pvt_thread_pool_setkey( ctx, (void *)slap_logring_get, lr,
+		slap_logring_free, NULL, NULL ) ) {
+		ch_free( lr->lr_buf );
+		ch_free( lr );
+		return NULL;
+	}
+
+	ldap_pvt_thread_mutex_lock( &slap_log_mutex );
+	lr->lr_next = slap_log_rings;
+	slap_log_rings = lr;
+	ldap_pvt_thread_mutex_unlock( &slap_log_mutex );
+	return lr;
+}
+
+/* Called in place of lutil_debug()/syslog() by Statslog when logasync is set */
+void
+slap_log_push( int level, const char *fmt, ... )
+{
+	char buf[SLAP_LOG_MSGMAX];
+	slap_logring *lr;
+	va_list vl;
+	void *ctx;
+	int len;
+
+	va_start( vl, fmt );
+	len = vsnprintf( buf, sizeof( buf ), fmt, vl );
+	va_end( vl );
+	if ( len <= 0 )
+		return;
+	if ( len >= sizeof( buf ) )
+		len = sizeof( buf ) - 1;
+
+	ctx = ldap_pvt_thread_pool_context();
+	if ( ctx == slap_log_mainctx ) {
+		ldap_pvt_thread_mutex_lock( &slap_log_mainmutex );
+		slap_logring_put( &slap_log_mainring, level, buf, len );
+		ldap_pvt_thread_mutex_unlock( &slap_log_mainmutex );
+	} else {
+		lr = slap_logring_get( ctx );
+		if ( lr == NULL ) {
+			StatslogNow( level, "%s", buf, 0, 0, 0, 0 );
+			return;
+		}
+		slap_logring_put( lr, level, buf, len );
+	}
+
+	/* pairs with the fence in slap_log_pending() */
+	__atomic_thread_fence( __ATOMIC_SEQ_CST );
+	if ( __atomic_load_n( &slap_log_idle, __ATOMIC_RELAXED ) ) {
+		ldap_pvt_thread_mutex_lock( &slap_log_mutex );
+		ldap_pvt_thread_cond_signal( &slap_log_cond );
+		ldap_pvt_thread_mutex_unlock( &slap_log_mutex );
+	}
+}
+
+static void
+slap_log_write( int level, const char *text, int len )
+{
+	if ( ldap_debug & level )
+		lutil_debug( ldap_debug, level, "%.*s", len, text );
+#ifdef LDAP_SYSLOG
+	if ( ldap_syslog & level )
+		syslog( LDAP_LEVEL_MASK( ldap_syslog_level ), "%.*s", len, text );
+#endif /* LDAP_SYSLOG */
+}
+
+static int
+slap_logring_drain( slap_logring *lr )
+{
+	slap_logrec *rec;
+	unsigned long head, tail, pos;
+	int n = 0;
+
+	tail = lr->lr_tail;
+	head = __atomic_load_n( &lr->lr_head, __ATOMIC_ACQUIRE );
+	while ( tail != head ) {
+		pos = tail & ( lr->lr_size - 1 );
+		rec = (slap_logrec *)( lr->lr_buf + pos );
+		if ( rec->lh_len == SLAP_LOGREC_WRAP ) {
+			tail += lr->lr_size - pos;
+		} else {
+			slap_log_write( rec->lh_level, (char *)( rec + 1 ), rec->lh_len );
+			tail += SLAP_LOGREC_SIZE( rec->lh_len );
+			n++;
+		}
+		__atomic_store_n( &lr->lr_tail, tail, __ATOMIC_RELEASE );
+	}
+	return n;
+}
+
+/* Write out whatever is queued, in the logger thread or once it has exited */
+static int
+slap_log_drain( void )
+{
+	slap_logring *lr, **prev;
+	unsigned long dropped;
+	int n, dead;
+
+	/* the mutex only serializes its writers */
+	n = slap_logring_drain( &slap_log_mainring );
+	dropped = __atomic_exchange_n( &slap_log_mainring.lr_dropped, 0,
+		__ATOMIC_RELAXED );
+
+	for ( prev = &slap_log_rings; ( lr = *prev ) != NULL; ) {
+		dead = __atomic_load_n( &lr->lr_dead, __ATOMIC_ACQUIRE );
+		n += slap_logring_drain( lr );
+		dropped += __atomic_exchange_n( &lr->lr_dropped, 0,
+			__ATOMIC_RELAXED );
+		if ( dead ) {
+			*prev = lr->lr_next;
+			ch_free( lr->lr_buf );
+			ch_free( lr );
+		} else {
+			prev = &lr->lr_next;
+		}
+	}
+
+	if ( dropped ) {
+		Log1( LDAP_DEBUG_STATS, ldap_syslog_level,
+			"slap_log: %lu stats messages dropped, logasync buffer full\n",
+			dropped );
+	}
+	return n;
+}
+
+/* Checked with slap_log_idle set, so a late writer will signal us */
+static int
+slap_log_pending( void )
+{
+	slap_logring *lr;
+
+	__atomic_thread_fence( __ATOMIC_SEQ_CST );
+	if ( __atomic_load_n( &slap_log_mainring.lr_head, __ATOMIC_RELAXED ) !=
+		slap_log_mainring.lr_tail )
+		return 1;
+	for ( lr = slap_log_rings; lr; lr = lr->lr_next ) {
+		if ( __atomic_load_n( &lr->lr_head, __ATOMIC_RELAXED ) !=
+			lr->lr_tail )
+			return 1;
+	}
+	return 0;
+}
+
+static void *
+slap_log_thread( void *arg )
+{
+	ldap_pvt_thread_mutex_lock( &slap_log_mutex );
+	while ( !slap_log_shutdown ) {
+		if ( slap_log_drain() )
+			continue;
+
+		__atomic_store_n( &slap_log_idle, 1, __ATOMIC_RELAXED );
+		if ( !slap_log_pending() )
+			ldap_pvt_thread_cond_wait( &slap_log_cond, &slap_log_mutex );
+		__atomic_store_n( &slap_log_idle, 0, __ATOMIC_RELAXED );
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_log_mutex );
+	return NULL;
+}
+
+void
+slap_log_init( void )
+{
+	slap_log_mainctx = ldap_pvt_thread_pool_context();
+	ldap_pvt_thread_mutex_init( &slap_log_mutex );
+	ldap_pvt_thread_mutex_init( &slap_log_mainmutex );
+	ldap_pvt_thread_cond_init( &slap_log_cond );
+}
+
+void
+slap_log_destroy( void )
+{
+	ldap_pvt_thread_cond_destroy( &slap_log_cond );
+	ldap_pvt_thread_mutex_destroy( &slap_log_mainmutex );
+	ldap_pvt_thread_mutex_destroy( &slap_log_mutex );
+}
+
+/* Start the logger if logasync is set; also called when it is set online */
+int
+slap_log_start( void )
+{
+	if ( !slap_log_async_size )
+		return 0;
+	if ( slap_log_running ) {
+		slap_log_async = 1;
+		return 0;
+	}
+
+	slap_log_mainring.lr_size = slap_log_ringsize();
+	slap_log_mainring.lr_buf = ch_malloc( slap_log_mainring.lr_size );
+	slap_log_mainring.lr_head = slap_log_mainring.lr_tail = 0;
+	slap_log_shutdown = 0;
+
+	if ( ldap_pvt_thread_create( &slap_log_tid, 0, slap_log_thread, NULL ) ) {
+		Debug( LDAP_DEBUG_ANY,
+			"slap_log_start: unable to start logger thread\n", 0, 0, 0 );
+		ch_free( slap_log_mainring.lr_buf );
+		slap_log_mainring.lr_buf = NULL;
+		return -1;
+	}
+	slap_log_running = 1;
+	slap_log_async = 1;
+	return 0;
+}
+
+/* Must only be called once the thread pool has been closed */
+void
+slap_log_stop( void )
+{
+	slap_logring *lr;
+
+	if ( !slap_log_running )
+		return;
+
+	slap_log_async = 0;
+	ldap_pvt_thread_mutex_lock( &slap_log_mutex );
+	slap_log_shutdown = 1;
+	ldap_pvt_thread_cond_signal( &slap_log_cond );
+	ldap_pvt_thread_mutex_unlock( &slap_log_mutex );
+	ldap_pvt_thread_join( slap_log_tid, NULL );
+
+	slap_log_drain();
+	while ( ( lr = slap_log_rings ) != NULL ) {
+		slap_log_rings = lr->lr_next;
+		ch_free( lr->lr_buf );
+		ch_free( lr );
+	}
+	ch_free( slap_log_mainring.lr_buf );
+	slap_log_mainring.lr_buf = NULL;
+	slap_log_running = 0;
+}
+
+#else /* !SLAP_LOG_ASYNC */
+
+void
+slap_log_init( void )
+{
+}
+
+void
+slap_log_destroy( void )
+{
+}
+
+int
+slap_log_start( void )
+{
+	return 0;
+}
+
+void
+slap_log_stop( void )
+{
+}
+
+void
+slap_log_push( int level, const char *fmt, ... )
+{
+}
+
+#endif /* !SLAP_LOG_ASYNC */
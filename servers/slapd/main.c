@@ -65,7 +65,7 @@ static struct sockaddr_in	bind_addr;
 
 typedef int (MainFunc) LDAP_P(( int argc, char *argv[] ));
 extern MainFunc slapadd, slapcat, slapdn, slapindex, slappasswd,
-	slaptest, slapauth, slapacl, slapschema, slapmodify;
+	slaptest, slapauth, slapacl, slapschema, slapmodify, slapbench;
 
 static struct {
 	char *name;
@@ -81,6 +81,7 @@ static struct {
 	{"slaptest", slaptest},
 	{"slapauth", slapauth},
 	{"slapacl", slapacl},
+	{"slapbench", slapbench},
 	/* NOTE: new tools must be added in chronological order,
 	 * not in alphabetical order, because for backwards
 	 * compatibility name[4] is used to identify the
@@ -139,6 +140,29 @@ slapd_opt_slp( const char *val, void *arg )
 #endif
 }
 
+static int
+slapd_opt_reuseport( const char *val, void *arg )
+{
+	if ( val == NULL || strcasecmp( val, "on" ) == 0 ) {
+		slapd_reuseport = 1;
+
+	} else if ( strcasecmp( val, "off" ) == 0 ) {
+		slapd_reuseport = 0;
+
+	} else {
+		fprintf(stderr, "unrecognized value \"%s\" for reuseport option\n", val );
+		return -1;
+	}
+
+#ifndef SO_REUSEPORT
+	if ( slapd_reuseport ) {
+		fputs( "slapd: SO_REUSEPORT is not available\n", stderr );
+		slapd_reuseport = 0;
+	}
+#endif
+	return 0;
+}
+
 /*
  * Option helper structure:
  * 
@@ -158,6 +182,7 @@ struct option_helper {
 	void		*oh_arg;
 	const char	*oh_usage;
 } option_helpers[] = {
+	{ BER_BVC("reuseport"),	slapd_opt_reuseport,	NULL, "reuseport[={on|off}] open one SO_REUSEPORT socket per listener thread" },
 	{ BER_BVC("slp"),	slapd_opt_slp,	NULL, "slp[={on|off|(attrs)}] enable/disable SLP using (attrs)" },
 	{ BER_BVNULL, 0, NULL, NULL }
 };
@@ -0,0 +1,434 @@
+/* metrics.c - server metrics in one extended operation */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * The metrics extended operation returns the server's counters as a
+ * single text in the Prometheus exposition format, so that a scraper
+ * gets them with one request instead of searching the many small
+ * entries under cn=Monitor. Backends add their own samples through
+ * slap_metrics_register().
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include <ac/stdarg.h>
+#include <ac/string.h>
+
+#include "slap.h"
+#include "lber_pvt.h"
+#include "lutil.h"
+
+const struct berval slap_EXOP_METRICS = BER_BVC(LDAP_EXOP_X_METRICS);
+
+typedef struct slap_metric {
+	const char	*sm_name;
+	const char	*sm_type;
+	struct berval	sm_sample;	/* name{labels} value */
+	int		sm_seq;		/* keeps samples of a name in order */
+} slap_metric;
+
+struct slap_metrics {
+	slap_metric	*ms_list;
+	int		ms_num;
+	int		ms_max;
+};
+
+typedef struct slap_metrics_hook {
+	struct slap_metrics_hook *mh_next;
+	BackendDB	*mh_be;
+	SLAP_METRICS_FN	*mh_fn;
+} slap_metrics_hook;
+
+static slap_metrics_hook *slap_metrics_hooks;
+static ldap_pvt_thread_rdwr_t slap_metrics_rwlock;
+
+static const char *const slap_metrics_ops[] = {
+	"bind", "unbind", "search", "compare", "modify",
+	"modrdn", "add", "delete", "abandon", "extended"
+};
+
+/*
+ * Add a sample of metric name, of the given Prometheus type. If be
+ * is set the sample is labeled with the database's suffix; labels
+ * holds any further labels, already formatted.
+ */
+void
+slap_metrics_add(
+	slap_metrics *ms,
+	const char *name,
+	const char *type,
+	BackendDB *be,
+	const char *labels,
+	const char *fmt, ... )
+{
+	slap_metric *sm;
+	char buf[ 1024 ], *ptr, *end;
+	va_list ap;
+	int len;
+
+	ptr = buf;
+	end = buf + sizeof( buf ) - 1;
+	ptr = lutil_strcopy( ptr, name );
+	if ( be || labels ) {
+		*ptr++ = '{';
+		if ( be && be->be_nsuffix ) {
+			struct berval *bv = &be->be_nsuffix[0];
+			ber_len_t i;
+
+			ptr = lutil_strcopy( ptr, "db=\"" );
+			for ( i = 0; i < bv->bv_len && ptr < end - 64; i++ ) {
+				if ( bv->bv_val[i] == '"' || bv->bv_val[i] == '\\' )
+					*ptr++ = '\\';
+				*ptr++ = bv->bv_val[i];
+			}
+			*ptr++ = '"';
+			if ( labels )
+				*ptr++ = ',';
+		}
+		if ( labels ) {
+			len = strlen( labels );
+			if ( len > end - ptr - 64 )
+				return;
+			ptr = lutil_strncopy( ptr, labels, len );
+		}
+		*ptr++ = '}';
+	}
+	*ptr++ = ' ';
+	va_start( ap, fmt );
+	len = vsnprintf( ptr, end - ptr, fmt, ap );
+	va_end( ap );
+	if ( len < 0 || len >= end - ptr )
+		return;
+	ptr += len;
+	*ptr++ = '\n';
+
+	if ( ms->ms_num == ms->ms_max ) {
+		ms->ms_max = ms->ms_max ? ms->ms_max * 2 : 64;
+		ms->ms_list = ch_realloc( ms->ms_list,
+			ms->ms_max * sizeof( slap_metric ));
+	}
+	sm = &ms->ms_list[ ms->ms_num ];
+	sm->sm_name = name;
+	sm->sm_type = type;
+	sm->sm_seq = ms->ms_num++;
+	sm->sm_sample.bv_len = ptr - buf;
+	sm->sm_sample.bv_val = ch_malloc( sm->sm_sample.bv_len + 1 );
+	AC_MEMCPY( sm->sm_sample.bv_val, buf, sm->sm_sample.bv_len );
+	sm->sm_sample.bv_val[ sm->sm_sample.bv_len ] = '\0';
+}
+
+/* As above, for a counter kept as ldap_pvt_mp_t */
+static void
+slap_metrics_add_mp(
+	slap_metrics *ms,
+	const char *name,
+	const char *labels,
+	ldap_pvt_mp_t mp )
+{
+	struct berval bv = BER_BVNULL;
+
+	UI2BV( &bv, mp );
+	if ( !BER_BVISNULL( &bv )) {
+		slap_metrics_add( ms, name, "counter", NULL, labels, "%s", bv.bv_val );
+		ch_free( bv.bv_val );
+	}
+}
+
+int
+slap_metrics_register( BackendDB *be, SLAP_METRICS_FN *fn )
+{
+	slap_metrics_hook *mh;
+
+	mh = ch_malloc( sizeof( slap_metrics_hook ));
+	mh->mh_be = be;
+	mh->mh_fn = fn;
+	ldap_pvt_thread_rdwr_wlock( &slap_metrics_rwlock );
+	mh->mh_next = slap_metrics_hooks;
+	slap_metrics_hooks = mh;
+	ldap_pvt_thread_rdwr_wunlock( &slap_metrics_rwlock );
+	return 0;
+}
+
+int
+slap_metrics_unregister( BackendDB *be, SLAP_METRICS_FN *fn )
+{
+	slap_metrics_hook **mhp, *mh;
+	int rc = -1;
+
+	ldap_pvt_thread_rdwr_wlock( &slap_metrics_rwlock );
+	for ( mhp = &slap_metrics_hooks; *mhp; mhp = &(*mhp)->mh_next ) {
+		mh = *mhp;
+		if ( mh->mh_be == be && mh->mh_fn == fn ) {
+			*mhp = mh->mh_next;
+			ch_free( mh );
+			rc = 0;
+			break;
+		}
+	}
+	ldap_pvt_thread_rdwr_wunlock( &slap_metrics_rwlock );
+	return rc;
+}
+
+static int
+slap_metric_cmp( const void *a, const void *b )
+{
+	const slap_metric *ma = a, *mb = b;
+	int rc = strcmp( ma->sm_name, mb->sm_name );
+
+	if ( rc == 0 )
+		rc = ma->sm_seq - mb->sm_seq;
+	return rc;
+}
+
+static void
+slap_metrics_server( slap_metrics *ms )
+{
+	ldap_pvt_mp_t bytes, pdu, entries, refs, initiated, completed;
+#ifdef SLAPD_MONITOR
+	ldap_pvt_mp_t op_initiated[SLAP_OP_LAST], op_completed[SLAP_OP_LAST];
+	char labels[ 32 ];
+#endif
+	slap_counters_t *sc;
+	Connection *c;
+	ber_socket_t connindex;
+	unsigned long nconns;
+	int i, n;
+	static const struct {
+		const char *name;
+		int param;
+	} pool_params[] = {
+		{ "slapd_threads_max", LDAP_PVT_THREAD_POOL_PARAM_MAX },
+		{ "slapd_threads_open", LDAP_PVT_THREAD_POOL_PARAM_OPEN },
+		{ "slapd_threads_active", LDAP_PVT_THREAD_POOL_PARAM_ACTIVE },
+		{ "slapd_threads_pending", LDAP_PVT_THREAD_POOL_PARAM_PENDING },
+		{ "slapd_threads_backload", LDAP_PVT_THREAD_POOL_PARAM_BACKLOAD },
+		{ NULL, 0 }
+	};
+
+	/* one pass under the global counter lock, so that the totals
+	 * belong together */
+	ldap_pvt_thread_mutex_lock( &slap_counters.sc_mutex );
+	ldap_pvt_mp_init_set( bytes, SLAP_COUNTER_GET( slap_counters.sc_bytes ));
+	ldap_pvt_mp_init_set( pdu, SLAP_COUNTER_GET( slap_counters.sc_pdu ));
+	ldap_pvt_mp_init_set( entries, SLAP_COUNTER_GET( slap_counters.sc_entries ));
+	ldap_pvt_mp_init_set( refs, SLAP_COUNTER_GET( slap_counters.sc_refs ));
+	ldap_pvt_mp_init_set( initiated, SLAP_COUNTER_GET( slap_counters.sc_ops_initiated ));
+	ldap_pvt_mp_init_set( completed, SLAP_COUNTER_GET( slap_counters.sc_ops_completed ));
+#ifdef SLAPD_MONITOR
+	for ( i = 0; i < SLAP_OP_LAST; i++ ) {
+		ldap_pvt_mp_init_set( op_initiated[i],
+			SLAP_COUNTER_GET( slap_counters.sc_ops_initiated_[i] ));
+		ldap_pvt_mp_init_set( op_completed[i],
+			SLAP_COUNTER_GET( slap_counters.sc_ops_completed_[i] ));
+	}
+#endif
+	for ( sc = slap_counters.sc_next; sc; sc = sc->sc_next ) {
+		SLAP_COUNTERS_LOCK( sc );
+		ldap_pvt_mp_add( bytes, SLAP_COUNTER_GET( sc->sc_bytes ));
+		ldap_pvt_mp_add( pdu, SLAP_COUNTER_GET( sc->sc_pdu ));
+		ldap_pvt_mp_add( entries, SLAP_COUNTER_GET( sc->sc_entries ));
+		ldap_pvt_mp_add( refs, SLAP_COUNTER_GET( sc->sc_refs ));
+		ldap_pvt_mp_add( initiated, SLAP_COUNTER_GET( sc->sc_ops_initiated ));
+		ldap_pvt_mp_add( completed, SLAP_COUNTER_GET( sc->sc_ops_completed ));
+#ifdef SLAPD_MONITOR
+		for ( i = 0; i < SLAP_OP_LAST; i++ ) {
+			ldap_pvt_mp_add( op_initiated[i],
+				SLAP_COUNTER_GET( sc->sc_ops_initiated_[i] ));
+			ldap_pvt_mp_add( op_completed[i],
+				SLAP_COUNTER_GET( sc->sc_ops_completed_[i] ));
+		}
+#endif
+		SLAP_COUNTERS_UNLOCK( sc );
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_counters.sc_mutex );
+
+	slap_metrics_add_mp( ms, "slapd_sent_bytes_total", NULL, bytes );
+	slap_metrics_add_mp( ms, "slapd_sent_pdus_total", NULL, pdu );
+	slap_metrics_add_mp( ms, "slapd_sent_entries_total", NULL, entries );
+	slap_metrics_add_mp( ms, "slapd_sent_referrals_total", NULL, refs );
+#ifndef SLAPD_MONITOR
+	/* otherwise they are the sums of the per operation samples below */
+	slap_metrics_add_mp( ms, "slapd_operations_initiated_total", NULL, initiated );
+	slap_metrics_add_mp( ms, "slapd_operations_completed_total", NULL, completed );
+#endif
+	ldap_pvt_mp_clear( bytes );
+	ldap_pvt_mp_clear( pdu );
+	ldap_pvt_mp_clear( entries );
+	ldap_pvt_mp_clear( refs );
+	ldap_pvt_mp_clear( initiated );
+	ldap_pvt_mp_clear( completed );
+#ifdef SLAPD_MONITOR
+	for ( i = 0; i < SLAP_OP_LAST; i++ ) {
+		snprintf( labels, sizeof( labels ), "op=\"%s\"", slap_metrics_ops[i] );
+		slap_metrics_add_mp( ms, "slapd_operations_initiated_total",
+			labels, op_initiated[i] );
+		slap_metrics_add_mp( ms, "slapd_operations_completed_total",
+			labels, op_completed[i] );
+		ldap_pvt_mp_clear( op_initiated[i] );
+		ldap_pvt_mp_clear( op_completed[i] );
+	}
+#endif
+
+	for ( nconns = 0, c = connection_first( &connindex );
+			c != NULL;
+			nconns++, c = connection_next( c, &connindex ) )
+	{
+		/* No Op */ ;
+	}
+	connection_done( c );
+	slap_metrics_add( ms, "slapd_connections", "gauge", NULL, NULL,
+		"%lu", nconns );
+	slap_metrics_add( ms, "slapd_connections_total", "counter", NULL, NULL,
+		"%lu", connections_nextid() );
+
+	for ( i = 0; pool_params[i].name; i++ ) {
+		if ( ldap_pvt_thread_pool_query( &connection_pool,
+			pool_params[i].param, (void *)&n ) == 0 )
+		{
+			slap_metrics_add( ms, pool_params[i].name, "gauge", NULL, NULL,
+				"%d", n );
+		}
+	}
+
+	slap_metrics_add( ms, "slapd_start_time_seconds", "gauge", NULL, NULL,
+		"%ld", (long) starttime );
+
+	slap_sasl_cache_metrics( ms );
+	slap_passwd_metrics( ms );
+}
+
+/*
+ * Collect the samples of the server and of every database, group
+ * them by metric name and write them out in the text exposition
+ * format.
+ */
+int
+slap_metrics_get( struct berval *out )
+{
+	slap_metrics ms = { 0 };
+	slap_metrics_hook *mh;
+	BackendDB *be;
+	ber_len_t len = 0;
+	char *ptr;
+	const char *last = NULL;
+	int i;
+
+	slap_metrics_server( &ms );
+
+	ldap_pvt_thread_rdwr_rlock( &slap_metrics_rwlock );
+	for ( mh = slap_metrics_hooks; mh; mh = mh->mh_next )
+		mh->mh_fn( mh->mh_be, &ms );
+	ldap_pvt_thread_rdwr_runlock( &slap_metrics_rwlock );
+
+	LDAP_STAILQ_FOREACH( be, &backendDB, be_next ) {
+		if ( be->be_syncinfo )
+			syncrepl_metrics( be, &ms );
+	}
+
+	qsort( ms.ms_list, ms.ms_num, sizeof( slap_metric ), slap_metric_cmp );
+
+	for ( i = 0; i < ms.ms_num; i++ ) {
+		if ( !last || strcmp( last, ms.ms_list[i].sm_name )) {
+			last = ms.ms_list[i].sm_name;
+			len += STRLENOF( "# TYPE  \n" ) + strlen( last ) +
+				strlen( ms.ms_list[i].sm_type );
+		}
+		len += ms.ms_list[i].sm_sample.bv_len;
+	}
+
+	out->bv_val = ptr = ch_malloc( len + 1 );
+	last = NULL;
+	for ( i = 0; i < ms.ms_num; i++ ) {
+		if ( !last || strcmp( last, ms.ms_list[i].sm_name )) {
+			last = ms.ms_list[i].sm_name;
+			ptr = lutil_strcopy( ptr, "# TYPE " );
+			ptr = lutil_strcopy( ptr, last );
+			*ptr++ = ' ';
+			ptr = lutil_strcopy( ptr, ms.ms_list[i].sm_type );
+			*ptr++ = '\n';
+		}
+		ptr = lutil_strncopy( ptr, ms.ms_list[i].sm_sample.bv_val,
+			ms.ms_list[i].sm_sample.bv_len );
+		ch_free( ms.ms_list[i].sm_sample.bv_val );
+	}
+	*ptr = '\0';
+	out->bv_len = ptr - out->bv_val;
+	ch_free( ms.ms_list );
+
+	return LDAP_SUCCESS;
+}
+
+/* Only the rootdn of some database may read the metrics */
+static int
+metrics_allowed( Operation *op )
+{
+	BackendDB *be;
+
+	if ( BER_BVISEMPTY( &op->o_ndn ))
+		return 0;
+	LDAP_STAILQ_FOREACH( be, &backendDB, be_next ) {
+		if ( be_isroot_dn( be, &op->o_ndn ))
+			return 1;
+	}
+	return 0;
+}
+
+int
+metrics_extop(
+	Operation *op,
+	SlapReply *rs )
+{
+	struct berval *bv;
+
+	if ( op->ore_reqdata != NULL ) {
+		rs->sr_text = "no request data expected";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	Statslog( LDAP_DEBUG_STATS, "%s METRICS\n",
+		op->o_log_prefix, 0, 0, 0, 0 );
+
+	if ( !metrics_allowed( op )) {
+		rs->sr_text = "metrics are only available to the rootdn";
+		return LDAP_INSUFFICIENT_ACCESS;
+	}
+
+	bv = ch_malloc( sizeof( struct berval ));
+	slap_metrics_get( bv );
+	rs->sr_rspoid = ch_strdup( slap_EXOP_METRICS.bv_val );
+	rs->sr_rspdata = bv;
+	return LDAP_SUCCESS;
+}
+
+void
+slap_metrics_init( void )
+{
+	ldap_pvt_thread_rdwr_init( &slap_metrics_rwlock );
+}
+
+void
+slap_metrics_destroy( void )
+{
+	slap_metrics_hook *mh;
+
+	while (( mh = slap_metrics_hooks ) != NULL ) {
+		slap_metrics_hooks = mh->mh_next;
+		ch_free( mh );
+	}
+	ldap_pvt_thread_rdwr_destroy( &slap_metrics_rwlock );
+}
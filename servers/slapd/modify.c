@@ -305,6 +305,9 @@ fe_op_modify( Operation *op, SlapReply *rs )
 				}
 			}
 			op->o_bd->be_modify( op, rs );
+			if ( rs->sr_err == LDAP_SUCCESS ) {
+				slap_sasl_cache_update( op );
+			}
 
 		} else { /* send a referral */
 			BerVarray defref = op->o_bd->be_update_refs
@@ -317,6 +317,9 @@ fe_op_modrdn( Operation *op, SlapReply *rs )
 		{
 			op->o_bd = op_be;
 			op->o_bd->be_modrdn( op, rs );
+			if ( rs->sr_err == LDAP_SUCCESS ) {
+				slap_sasl_cache_update( op );
+			}
 
 			if ( op->o_bd->be_delete ) {
 				struct berval	org_req_dn = BER_BVNULL;
@@ -30,6 +30,81 @@
 #include "slap.h"
 #include "lutil.h"
 
+/* Attributes with at least this many values get a temporary hash of
+ * their normalized values when a modification looks up several values
+ * in them, instead of a linear attr_valfind() scan per value.
+ */
+#define MODS_VHASH_MIN	64
+
+/* The hash can only stand in for the matching rule when equality means
+ * the normalized values are identical; sorted attributes are already
+ * binary searched and ordered ones carry an {x} prefix.
+ */
+static int
+mods_vhash_ok( Attribute *a, Modification *mod, MatchingRule *mr )
+{
+	if ( a->a_numvals < MODS_VHASH_MIN || mod->sm_numvals < 2 )
+		return 0;
+	if ( a->a_flags & SLAP_ATTR_SORTED_VALS )
+		return 0;
+	if ( a->a_desc->ad_type->sat_flags & SLAP_AT_ORDERED )
+		return 0;
+	if ( mod->sm_nvalues == NULL && mr->smr_normalize )
+		return 0;
+	return mr->smr_match == octetStringMatch || mr->smr_match == dnMatch;
+}
+
+static unsigned
+mods_vhash( struct berval *val )
+{
+	unsigned h = 2166136261U;
+	ber_len_t i;
+
+	for ( i = 0; i < val->bv_len; i++ ) {
+		h ^= (unsigned char)val->bv_val[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/* Open-addressed table of value index + 1, 0 marks an empty slot */
+static unsigned *
+mods_vhash_build( Attribute *a, unsigned *maskp )
+{
+	unsigned *tab, n, i, h;
+
+	for ( n = 1; n < 2 * a->a_numvals; n <<= 1 )
+		;
+	tab = ch_calloc( n, sizeof( unsigned ));
+	for ( i = 0; i < a->a_numvals; i++ ) {
+		for ( h = mods_vhash( &a->a_nvals[i] ) & (n-1); tab[h];
+			h = ( h + 1 ) & (n-1) )
+			;
+		tab[h] = i + 1;
+	}
+	*maskp = n - 1;
+	return tab;
+}
+
+static int
+mods_vhash_find(
+	Attribute *a,
+	unsigned *tab,
+	unsigned mask,
+	struct berval *val,
+	unsigned *slot )
+{
+	unsigned h;
+
+	for ( h = mods_vhash( val ) & mask; tab[h]; h = ( h + 1 ) & mask ) {
+		if ( bvmatch( &a->a_nvals[tab[h] - 1], val )) {
+			*slot = tab[h] - 1;
+			return LDAP_SUCCESS;
+		}
+	}
+	return LDAP_NO_SUCH_ATTRIBUTE;
+}
+
 int
 modify_add_values(
 	Entry		*e,
@@ -71,6 +146,7 @@ modify_add_values(
 		struct berval *cvals;
 		int		rc;
 		unsigned i, p, flags;
+		unsigned *vhash = NULL, vmask = 0;
 
 		mr = mod->sm_desc->ad_type->sat_equality;
 		if( mr == NULL || !mr->smr_match ) {
@@ -113,10 +189,17 @@ modify_add_values(
 		} else {
 			cvals = mod->sm_values;
 		}
+		if ( mods_vhash_ok( a, mod, mr ) ) {
+			vhash = mods_vhash_build( a, &vmask );
+		}
 		for ( p = i = 0; i < mod->sm_numvals; i++ ) {
 			unsigned	slot;
 
-			rc = attr_valfind( a, flags, &cvals[i], &slot, NULL );
+			if ( vhash ) {
+				rc = mods_vhash_find( a, vhash, vmask, &cvals[i], &slot );
+			} else {
+				rc = attr_valfind( a, flags, &cvals[i], &slot, NULL );
+			}
 			if ( rc == LDAP_SUCCESS ) {
 				if ( !permissive ) {
 					/* value already exists */
@@ -124,9 +207,11 @@ modify_add_values(
 					snprintf( textbuf, textlen,
 						"modify/%s: %s: value #%u already exists",
 						op, mod->sm_desc->ad_cname.bv_val, i );
+					ch_free( vhash );
 					return LDAP_TYPE_OR_VALUE_EXISTS;
 				}
 			} else if ( rc != LDAP_NO_SUCH_ATTRIBUTE ) {
+				ch_free( vhash );
 				return rc;
 			}
 
@@ -137,6 +222,7 @@ modify_add_values(
 				pmod.sm_values[p++] = mod->sm_values[i];
 			}
 		}
+		ch_free( vhash );
 
 		if ( permissive ) {
 			if ( p == 0 ) {
@@ -204,6 +290,7 @@ modify_delete_vindex(
 	int		*id2 = NULL;
 	int		rc = 0;
 	unsigned i, j, flags;
+	unsigned	*vhash = NULL, vmask = 0;
 	char		dummy = '\0';
 
 	/*
@@ -279,9 +366,16 @@ modify_delete_vindex(
 	}
 
 	/* Locate values to delete */
+	if ( mods_vhash_ok( a, mod, mr ) ) {
+		vhash = mods_vhash_build( a, &vmask );
+	}
 	for ( i = 0; !BER_BVISNULL( &mod->sm_values[i] ); i++ ) {
 		unsigned sort;
-		rc = attr_valfind( a, flags, &cvals[i], &sort, NULL );
+		if ( vhash ) {
+			rc = mods_vhash_find( a, vhash, vmask, &cvals[i], &sort );
+		} else {
+			rc = attr_valfind( a, flags, &cvals[i], &sort, NULL );
+		}
 		if ( rc == LDAP_SUCCESS ) {
 			idx[i] = sort;
 		} else if ( rc == LDAP_NO_SUCH_ATTRIBUTE ) {
@@ -357,6 +451,8 @@ modify_delete_vindex(
 		ordered_value_sort( a, 1 );
 	}
 return_result:
+	if ( vhash )
+		ch_free( vhash );
 	if ( id2 )
 		ch_free( id2 );
 	return rc;
@@ -319,6 +319,32 @@ oc_create_allowed(
 	return 0;
 }
 
+/* Build the bitmap of all types the class requires or allows, including
+ * those inherited from its superclasses, so oc_check_allowed() can test
+ * membership without scanning the lists.
+ */
+static void
+oc_create_atmap( ObjectClass *soc )
+{
+	AttributeType	**satp;
+	unsigned	max = 0;
+
+	for ( satp = soc->soc_required; satp && *satp; satp++ )
+		if ( (*satp)->sat_index > max ) max = (*satp)->sat_index;
+	for ( satp = soc->soc_allowed; satp && *satp; satp++ )
+		if ( (*satp)->sat_index > max ) max = (*satp)->sat_index;
+
+	soc->soc_atmaplen = max / 8 + 1;
+	soc->soc_atmap = ch_calloc( 1, soc->soc_atmaplen );
+
+	for ( satp = soc->soc_required; satp && *satp; satp++ )
+		soc->soc_atmap[ (*satp)->sat_index / 8 ] |=
+			1U << ( (*satp)->sat_index % 8 );
+	for ( satp = soc->soc_allowed; satp && *satp; satp++ )
+		soc->soc_atmap[ (*satp)->sat_index / 8 ] |=
+			1U << ( (*satp)->sat_index % 8 );
+}
+
 static int
 oc_add_sups(
 	ObjectClass		*soc,
@@ -447,6 +473,11 @@ oc_clean( ObjectClass *o )
 		ldap_memfree(o->soc_oidmacro);
 		o->soc_oidmacro = NULL;
 	}
+	if (o->soc_atmap) {
+		ch_free(o->soc_atmap);
+		o->soc_atmap = NULL;
+		o->soc_atmaplen = 0;
+	}
 }
 
 static void
@@ -789,6 +820,8 @@ oc_add(
 		goto done;
 	}
 
+	oc_create_atmap( soc );
+
 	if ( !user ) {
 		soc->soc_flags |= SLAP_OC_HARDCODE;
 	}
@@ -812,6 +845,10 @@ done:;
 			ch_free( soc->soc_oidmacro );
 		}
 
+		if ( soc->soc_atmap ) {
+			ch_free( soc->soc_atmap );
+		}
+
 		ch_free( soc );
 
 	} else if ( rsoc ) {
@@ -41,13 +41,30 @@ static ldap_pvt_thread_mutex_t	slap_op_mutex;
 static time_t last_time;
 static int last_incr;
 
+int slap_slowop_threshold;		/* msec, 0 disables tracing */
+int slap_slowop_entries = 32;
+
+/* the last slap_slowop_entries slow operations, oldest first from next */
+static ldap_pvt_thread_mutex_t	slap_slowop_mutex;
+static struct berval *slap_slowops;
+static int slap_slowop_size, slap_slowop_next, slap_slowop_count;
+
 void slap_op_init(void)
 {
 	ldap_pvt_thread_mutex_init( &slap_op_mutex );
+	ldap_pvt_thread_mutex_init( &slap_slowop_mutex );
 }
 
 void slap_op_destroy(void)
 {
+	int i;
+
+	for ( i = 0; i < slap_slowop_size; i++ )
+		ch_free( slap_slowops[i].bv_val );
+	ch_free( slap_slowops );
+	slap_slowops = NULL;
+	slap_slowop_size = slap_slowop_next = slap_slowop_count = 0;
+	ldap_pvt_thread_mutex_destroy( &slap_slowop_mutex );
 	ldap_pvt_thread_mutex_destroy( &slap_op_mutex );
 }
 
@@ -72,6 +89,18 @@ slap_op_groups_free( Operation *op )
 	op->o_groups = NULL;
 }
 
+void
+slap_op_sets_free( Operation *op )
+{
+	SetAssertion *sa, *n;
+	for ( sa = op->o_sets; sa; sa = n ) {
+		n = sa->sa_next;
+		ber_bvarray_free_x( sa->sa_vals, op->o_tmpmemctx );
+		slap_sl_free( sa, op->o_tmpmemctx );
+	}
+	op->o_sets = NULL;
+}
+
 void
 slap_op_free( Operation *op, void *ctx )
 {
@@ -108,6 +137,10 @@ slap_op_free( Operation *op, void *ctx )
 		slap_op_groups_free( op );
 	}
 
+	if ( op->o_sets ) {
+		slap_op_sets_free( op );
+	}
+
 #if defined( LDAP_SLAPI )
 	if ( slapi_plugins_used ) {
 		slapi_int_free_object_extensions( SLAPI_X_EXT_OPERATION, op );
@@ -246,3 +279,126 @@ slap_req2op( ber_tag_t tag )
 
 	return SLAP_OP_LAST;
 }
+
+/* Add the time elapsed since *start to *usec */
+void
+slap_optrace_add( unsigned long *usec, struct timeval *start )
+{
+	struct timeval now;
+	long delta;
+
+	gettimeofday( &now, NULL );
+	delta = ( now.tv_sec - start->tv_sec ) * 1000000L
+		+ now.tv_usec - start->tv_usec;
+	if ( delta > 0 )
+		*usec += delta;
+}
+
+static const char *const slap_optrace_names[] = {
+	"BIND", "UNBIND", "SRCH", "CMP", "MOD",
+	"MODRDN", "ADD", "DEL", "ABANDON", "EXT"
+};
+
+#define USEC_FMT	"%lu.%06lu"
+#define USEC_ARG(u)	(unsigned long)(u) / 1000000, (unsigned long)(u) % 1000000
+
+/*
+ * Called once the result of op has been sent. Records its span if it
+ * is traced. If op took longer than slowop_threshold, log where the
+ * time went and keep the line for cn=Monitor.
+ */
+void
+slap_optrace_done( Operation *op, SlapReply *rs )
+{
+	slap_optrace *ot = &op->o_trace;
+	struct timeval now;
+	struct berval *bv;
+	char buf[ 4 * SLAP_TEXT_BUFLEN ];
+	unsigned long etime, qtime;
+	slap_op_t opidx;
+	int len;
+
+	opidx = slap_req2op( op->o_tag );
+	if ( op->o_tracectx.tc_record ) {
+		now.tv_sec = op->o_time;
+		now.tv_usec = op->o_tusec;
+		slap_trace_span( op,
+			opidx < SLAP_OP_LAST ? slap_optrace_names[opidx] : "UNKNOWN",
+			&now, rs->sr_err, rs->sr_nentries );
+	}
+
+	if ( !slap_slowop_threshold )
+		return;
+
+	gettimeofday( &now, NULL );
+	etime = ( now.tv_sec - op->o_time ) * 1000000UL
+		+ now.tv_usec - op->o_tusec;
+	if ( etime < slap_slowop_threshold * 1000UL )
+		return;
+
+	qtime = op->o_qtime.tv_sec * 1000000UL + op->o_qtime.tv_usec;
+	len = snprintf( buf, sizeof( buf ), "%s %s err=%d etime=" USEC_FMT
+		" qtime=" USEC_FMT " acl=" USEC_FMT " cand=" USEC_FMT
+		" decode=" USEC_FMT " write=" USEC_FMT
+		" idl=%lu scanned=%lu nentries=%d dn=\"%s\"",
+		op->o_log_prefix,
+		opidx < SLAP_OP_LAST ? slap_optrace_names[opidx] : "UNKNOWN",
+		rs->sr_err, USEC_ARG( etime ), USEC_ARG( qtime ),
+		USEC_ARG( ot->ot_acl ), USEC_ARG( ot->ot_cand ),
+		USEC_ARG( ot->ot_decode ), USEC_ARG( ot->ot_write ),
+		ot->ot_idl, ot->ot_scanned, rs->sr_nentries,
+		op->o_req_dn.bv_val ? op->o_req_dn.bv_val : "" );
+	if ( len >= 0 && len < sizeof( buf ) && opidx == SLAP_OP_SEARCH &&
+		!BER_BVISNULL( &op->ors_filterstr ) )
+	{
+		len += snprintf( buf + len, sizeof( buf ) - len, " filter=\"%s\"",
+			op->ors_filterstr.bv_val );
+	}
+	if ( len < 0 )
+		return;
+	if ( len >= sizeof( buf ) )
+		len = sizeof( buf ) - 1;
+
+	Statslog( LDAP_DEBUG_STATS, "%s SLOW %s\n",
+		op->o_log_prefix, buf + strlen( op->o_log_prefix ) + 1, 0, 0, 0 );
+
+	ldap_pvt_thread_mutex_lock( &slap_slowop_mutex );
+	if ( slap_slowop_size != slap_slowop_entries ) {
+		/* resized online, start over */
+		int i;
+		for ( i = 0; i < slap_slowop_size; i++ )
+			ch_free( slap_slowops[i].bv_val );
+		slap_slowop_size = slap_slowop_entries > 0 ? slap_slowop_entries : 0;
+		slap_slowops = ch_realloc( slap_slowops,
+			( slap_slowop_size + 1 ) * sizeof( struct berval ));
+		memset( slap_slowops, 0, slap_slowop_size * sizeof( struct berval ));
+		slap_slowop_next = slap_slowop_count = 0;
+	}
+	if ( slap_slowop_size ) {
+		bv = &slap_slowops[ slap_slowop_next ];
+		ch_free( bv->bv_val );
+		bv->bv_len = len;
+		bv->bv_val = ch_malloc( len + 1 );
+		AC_MEMCPY( bv->bv_val, buf, len + 1 );
+		slap_slowop_next = ( slap_slowop_next + 1 ) % slap_slowop_size;
+		if ( slap_slowop_count < slap_slowop_size )
+			slap_slowop_count++;
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_slowop_mutex );
+}
+
+/* Copy the kept slow operations into *vals, oldest first */
+int
+slap_slowop_list( BerVarray *vals )
+{
+	int i, n;
+
+	ldap_pvt_thread_mutex_lock( &slap_slowop_mutex );
+	n = slap_slowop_count;
+	for ( i = 0; i < n; i++ ) {
+		value_add_one( vals, &slap_slowops[ ( slap_slowop_next - n + i +
+			slap_slowop_size ) % slap_slowop_size ] );
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_slowop_mutex );
+	return n;
+}
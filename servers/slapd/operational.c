@@ -88,3 +88,25 @@ slap_operational_hasSubordinate( int hs )
 	return a;
 }
 
+Attribute *
+slap_operational_numSubordinates( unsigned long n )
+{
+	Attribute	*a;
+	char		buf[ LDAP_PVT_INTTYPE_CHARS( unsigned long ) ];
+	struct berval	val;
+
+	val.bv_val = buf;
+	val.bv_len = snprintf( buf, sizeof( buf ), "%lu", n );
+
+	a = attr_alloc( slap_schema.si_ad_numSubordinates );
+	a->a_numvals = 1;
+	a->a_vals = ch_malloc( 2 * sizeof( struct berval ) );
+
+	ber_dupbv( &a->a_vals[0], &val );
+	a->a_vals[1].bv_val = NULL;
+
+	a->a_nvals = a->a_vals;
+
+	return a;
+}
+
@@ -69,6 +69,7 @@ typedef struct log_info {
 	slap_mask_t li_ops;
 	int li_age;
 	int li_cycle;
+	int li_purgebatch;
 	struct re_s *li_task;
 	Filter *li_oldf;
 	Entry *li_old;
@@ -80,6 +81,12 @@ typedef struct log_info {
 	ldap_pvt_thread_mutex_t li_log_mutex;
 } log_info;
 
+/* Per-operation state for a logged write */
+typedef struct log_mod_cb {
+	slap_callback lc_cb;
+	int lc_lazy;	/* we deferred the sync of the write */
+} log_mod_cb;
+
 static ConfigDriver log_cf_gen;
 
 enum {
@@ -89,7 +96,8 @@ enum {
 	LOG_SUCCESS,
 	LOG_OLD,
 	LOG_OLDATTR,
-	LOG_BASE
+	LOG_BASE,
+	LOG_PURGEBATCH
 };
 
 static ConfigTable log_cfats[] = {
@@ -126,6 +134,10 @@ static ConfigTable log_cfats[] = {
 			"DESC 'Operation types to log under a specific branch' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "logpurgebatch", "entries", 2, 2, 0, ARG_INT|ARG_MAGIC|LOG_PURGEBATCH,
+		log_cf_gen, "( OLcfgOvAt:4.8 NAME 'olcAccessLogPurgeBatch' "
+			"DESC 'Maximum number of log entries deleted per purge pass' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL }
 };
 
@@ -136,7 +148,8 @@ static ConfigOCs log_cfocs[] = {
 		"SUP olcOverlayConfig "
 		"MUST olcAccessLogDB "
 		"MAY ( olcAccessLogOps $ olcAccessLogPurge $ olcAccessLogSuccess $ "
-			"olcAccessLogOld $ olcAccessLogOldAttr $ olcAccessLogBase ) )",
+			"olcAccessLogOld $ olcAccessLogOldAttr $ olcAccessLogBase $ "
+			"olcAccessLogPurgeBatch ) )",
 			Cft_Overlay, log_cfats },
 	{ NULL }
 };
@@ -582,6 +595,9 @@ static slap_callback nullsc;
 
 #define PURGE_INCREMENT	100
 
+/* Default number of expired entries collected and deleted per pass */
+#define LOG_PURGE_BATCH	1000
+
 typedef struct purge_data {
 	int slots;
 	int used;
@@ -626,7 +642,11 @@ log_old_lookup( Operation *op, SlapReply *rs )
 	return 0;
 }
 
-/* Periodically search for old entries in the log database and delete them */
+/* Periodically search for old entries in the log database and delete them.
+ * Entries are collected and deleted at most li_purgebatch at a time so that
+ * a large backlog neither has to be held in memory at once nor keeps the
+ * log database busy without pausing in between.
+ */
 static void *
 accesslog_purge( void *ctx, void *arg )
 {
@@ -644,6 +664,7 @@ accesslog_purge( void *ctx, void *arg )
 	char timebuf[LDAP_LUTIL_GENTIME_BUFSIZE];
 	char csnbuf[LDAP_PVT_CSNSTR_BUFSIZE];
 	time_t old = slap_get_time();
+	int batch = li->li_purgebatch, more, deleted, total = 0;
 
 	connection_fake_init( &conn, &opbuf, ctx );
 	op = &opbuf.ob_op;
@@ -659,54 +680,66 @@ accesslog_purge( void *ctx, void *arg )
 	old -= li->li_age;
 	slap_timestamp( &old, &ava.aa_value );
 
-	op->o_tag = LDAP_REQ_SEARCH;
-	op->o_bd = li->li_db;
-	op->o_dn = li->li_db->be_rootdn;
-	op->o_ndn = li->li_db->be_rootndn;
-	op->o_req_dn = li->li_db->be_suffix[0];
-	op->o_req_ndn = li->li_db->be_nsuffix[0];
-	op->o_callback = &cb;
-	op->ors_scope = LDAP_SCOPE_ONELEVEL;
-	op->ors_deref = LDAP_DEREF_NEVER;
-	op->ors_tlimit = SLAP_NO_LIMIT;
-	op->ors_slimit = SLAP_NO_LIMIT;
-	op->ors_filter = &f;
-	filter2bv_x( op, &f, &op->ors_filterstr );
-	op->ors_attrs = slap_anlist_no_attrs;
-	op->ors_attrsonly = 1;
-	
 	pd.csn.bv_len = sizeof( csnbuf );
 	pd.csn.bv_val = csnbuf;
 	csnbuf[0] = '\0';
 	cb.sc_private = &pd;
 
-	op->o_bd->be_search( op, &rs );
-	op->o_tmpfree( op->ors_filterstr.bv_val, op->o_tmpmemctx );
+	do {
+		op->o_tag = LDAP_REQ_SEARCH;
+		op->o_bd = li->li_db;
+		op->o_dn = li->li_db->be_rootdn;
+		op->o_ndn = li->li_db->be_rootndn;
+		op->o_req_dn = li->li_db->be_suffix[0];
+		op->o_req_ndn = li->li_db->be_nsuffix[0];
+		op->o_callback = &cb;
+		op->ors_scope = LDAP_SCOPE_ONELEVEL;
+		op->ors_deref = LDAP_DEREF_NEVER;
+		op->ors_tlimit = SLAP_NO_LIMIT;
+		op->ors_slimit = batch ? batch : SLAP_NO_LIMIT;
+		op->ors_filter = &f;
+		filter2bv_x( op, &f, &op->ors_filterstr );
+		op->ors_attrs = slap_anlist_no_attrs;
+		op->ors_attrsonly = 1;
+
+		pd.used = 0;
+		rs_reinit( &rs, REP_RESULT );
+		op->o_bd->be_search( op, &rs );
+		op->o_tmpfree( op->ors_filterstr.bv_val, op->o_tmpmemctx );
+
+		/* The search stops early when the batch is full, or when
+		 * the pool wants to pause; either way there may be more
+		 * expired entries waiting behind this batch.
+		 */
+		more = rs.sr_err == LDAP_SIZELIMIT_EXCEEDED ||
+			rs.sr_err == LDAP_BUSY;
+		deleted = 0;
 
-	if ( pd.used ) {
-		int i;
+		if ( pd.used ) {
+			int i;
 
-		/* delete the expired entries */
-		op->o_tag = LDAP_REQ_DELETE;
-		op->o_callback = &nullsc;
-		op->o_csn = pd.csn;
-		op->o_dont_replicate = 1;
-
-		for (i=0; i<pd.used; i++) {
-			op->o_req_dn = pd.dn[i];
-			op->o_req_ndn = pd.ndn[i];
-			if ( !slapd_shutdown ) {
-				rs_reinit( &rs, REP_RESULT );
-				op->o_bd->be_delete( op, &rs );
+			/* delete the expired entries */
+			op->o_tag = LDAP_REQ_DELETE;
+			op->o_callback = &nullsc;
+			op->o_csn = pd.csn;
+			op->o_dont_replicate = 1;
+
+			for (i=0; i<pd.used; i++) {
+				op->o_req_dn = pd.dn[i];
+				op->o_req_ndn = pd.ndn[i];
+				if ( !slapd_shutdown ) {
+					rs_reinit( &rs, REP_RESULT );
+					op->o_bd->be_delete( op, &rs );
+					if ( rs.sr_err == LDAP_SUCCESS )
+						deleted++;
+				}
+				ch_free( pd.ndn[i].bv_val );
+				ch_free( pd.dn[i].bv_val );
+				ldap_pvt_thread_pool_pausecheck( &connection_pool );
 			}
-			ch_free( pd.ndn[i].bv_val );
-			ch_free( pd.dn[i].bv_val );
-			ldap_pvt_thread_pool_pausecheck( &connection_pool );
 		}
-		ch_free( pd.ndn );
-		ch_free( pd.dn );
 
-		{
+		if ( deleted ) {
 			Modifications mod;
 			struct berval bv[2];
 			rs_reinit( &rs, REP_RESULT );
@@ -732,7 +765,26 @@ accesslog_purge( void *ctx, void *arg )
 			if ( mod.sml_next ) {
 				slap_mods_free( mod.sml_next, 1 );
 			}
+			total += deleted;
 		}
+
+		/* Stop if nothing could be deleted, so that a persistent
+		 * failure doesn't turn into a busy loop.
+		 */
+		if ( !deleted || slapd_shutdown )
+			break;
+
+		ldap_pvt_thread_pool_pausecheck( &connection_pool );
+	} while ( more );
+
+	ch_free( pd.ndn );
+	ch_free( pd.dn );
+
+	if ( total ) {
+		Debug( LDAP_DEBUG_STATS, "accesslog_purge: %s: "
+			"deleted %d expired entries%s\n",
+			li->li_db->be_suffix[0].bv_val, total,
+			more ? ", more remain" : "" );
 	}
 
 	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
@@ -822,6 +874,12 @@ log_cf_gen(ConfigArgs *c)
 			else
 				rc = 1;
 			break;
+		case LOG_PURGEBATCH:
+			if ( li->li_purgebatch != LOG_PURGE_BATCH )
+				c->value_int = li->li_purgebatch;
+			else
+				rc = 1;
+			break;
 		}
 		break;
 	case LDAP_MOD_DELETE:
@@ -900,6 +958,9 @@ log_cf_gen(ConfigArgs *c)
 				ch_free( lb );
 			}
 			break;
+		case LOG_PURGEBATCH:
+			li->li_purgebatch = LOG_PURGE_BATCH;
+			break;
 		}
 		break;
 	default:
@@ -1024,6 +1085,17 @@ log_cf_gen(ConfigArgs *c)
 			}
 			}
 			break;
+		case LOG_PURGEBATCH:
+			if ( c->value_int < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ), "%s invalid size: %d",
+					c->argv[0], c->value_int );
+				Debug( LDAP_DEBUG_CONFIG|LDAP_DEBUG_NONE,
+					"%s: %s\n", c->log, c->cr_msg, 0 );
+				rc = ARG_BAD_CONF;
+			} else {
+				li->li_purgebatch = c->value_int;
+			}
+			break;
 		}
 		break;
 	}
@@ -1451,6 +1523,57 @@ accesslog_op2logop( Operation *op )
 	return LOG_EN_UNKNOWN;
 }
 
+static BackendInfo *
+accesslog_orig_bi( BackendDB *be )
+{
+	if ( overlay_is_over( be ))
+		return ((slap_overinfo *)be->bd_info->bi_private)->oi_orig;
+	return be->bd_info;
+}
+
+/*
+ * Make the writes committed so far in a database durable: an empty
+ * commit waits for everything committed before it.
+ */
+static int
+accesslog_flush( Operation *op, BackendDB *be, BackendInfo *bi )
+{
+	BackendDB *bd = op->o_bd;
+	OpExtra *txn = NULL;
+	int rc;
+
+	op->o_bd = be;
+	rc = bi->bi_op_txn( op, SLAP_TXN_BEGIN, &txn );
+	if ( rc == 0 ) {
+		LDAP_SLIST_REMOVE( &op->o_extra, txn, OpExtra, oe_next );
+		rc = bi->bi_op_txn( op, SLAP_TXN_COMMIT, &txn );
+	}
+	op->o_bd = bd;
+	return rc;
+}
+
+/*
+ * Can the write and its log record both be committed without syncing,
+ * and be made durable by accesslog_flush() afterwards?
+ */
+static int
+accesslog_can_defer( Operation *op, slap_overinst *on, log_info *li )
+{
+	OpExtra *oex;
+
+	if ( get_lazyCommit( op ) || !li->li_db ||
+		!on->on_info->oi_orig->bi_op_txn ||
+		!accesslog_orig_bi( li->li_db )->bi_op_txn )
+		return 0;
+
+	/* part of a txn someone else will commit */
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == op->o_bd->be_private )
+			return 0;
+	}
+	return 1;
+}
+
 static int accesslog_response(Operation *op, SlapReply *rs) {
 	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
 	log_info *li = on->on_bi.bi_private;
@@ -1467,6 +1590,7 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 	BerVarray vals;
 	Operation op2 = {0};
 	SlapReply rs2 = {REP_RESULT};
+	int lazy = 0;
 
 	if ( rs->sr_type != REP_RESULT && rs->sr_type != REP_EXTENDED )
 		return SLAP_CB_CONTINUE;
@@ -1504,6 +1628,7 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 		for ( cb = op->o_callback; cb; cb = cb->sc_next ) {
 			if ( cb->sc_private == (void *)on ) {
 				cb->sc_private = NULL;
+				lazy = ((log_mod_cb *)cb)->lc_lazy;
 				break;
 			}
 		}
@@ -1513,6 +1638,19 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 			op->o_tid, 0, 0 );
 #endif
 		ldap_pvt_thread_mutex_unlock( &li->li_op_rmutex );
+
+		if ( lazy ) {
+			op->o_lazyCommit = SLAP_CONTROL_NONE;
+			/* The write must be on disk before its log record
+			 * can be seen. Writers that committed meanwhile are
+			 * covered by the same sync.
+			 */
+			if ( rs->sr_err == LDAP_SUCCESS &&
+				accesslog_flush( op, op->o_bd, on->on_info->oi_orig ) != 0 ) {
+				rs->sr_err = LDAP_OTHER;
+				rs->sr_text = "txn sync failed";
+			}
+		}
 	}
 
 	/* ignore these internal reads */
@@ -1871,18 +2009,32 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 		}
 	}
 
+	/* synced below, outside the log mutex */
+	if ( lazy )
+		op2.o_lazyCommit = SLAP_CONTROL_NONCRITICAL;
+
 	op2.o_bd->be_add( &op2, &rs2 );
 	if ( rs2.sr_err != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_SYNC,
 			"accesslog_response: got result 0x%x adding log entry %s\n",
 			rs2.sr_err, op2.o_req_dn.bv_val, 0 );
+		lazy = 0;
 	}
 	if ( e == op2.ora_e ) entry_free( e );
 	e = NULL;
 
 done:
-	if ( lo->mask & LOG_OP_WRITES )
+	if ( lo->mask & LOG_OP_WRITES ) {
 		ldap_pvt_thread_mutex_unlock( &li->li_log_mutex );
+		/* concurrent writers share this sync */
+		if ( lazy && rs->sr_err == LDAP_SUCCESS &&
+			accesslog_flush( op, li->li_db,
+				accesslog_orig_bi( li->li_db )) != 0 ) {
+			Debug( LDAP_DEBUG_ANY,
+				"accesslog_response: failed to sync log database %s\n",
+				li->li_db->be_suffix[0].bv_val, 0, 0 );
+		}
+	}
 	if ( old ) entry_free( old );
 	return SLAP_CB_CONTINUE;
 }
@@ -1974,12 +2126,24 @@ accesslog_op_mod( Operation *op, SlapReply *rs )
 	}
 			
 	if ( doit ) {
-		slap_callback *cb = op->o_tmpcalloc( 1, sizeof( slap_callback ), op->o_tmpmemctx ), *cb2;
+		log_mod_cb *lc = op->o_tmpcalloc( 1, sizeof( log_mod_cb ), op->o_tmpmemctx );
+		slap_callback *cb = &lc->lc_cb, *cb2;
 		cb->sc_cleanup = accesslog_mod_cleanup;
 		cb->sc_private = on;
 		for ( cb2 = op->o_callback; cb2->sc_next; cb2 = cb2->sc_next );
 		cb2->sc_next = cb;
 
+		/* Commit the write without syncing; accesslog_response()
+		 * syncs it before adding the log record, and syncs the log
+		 * database after releasing li_log_mutex. Neither sync is
+		 * then serialized by the mutexes, and concurrent writers
+		 * can share them.
+		 */
+		if ( accesslog_can_defer( op, on, li )) {
+			lc->lc_lazy = 1;
+			op->o_lazyCommit = SLAP_CONTROL_NONCRITICAL;
+		}
+
 #ifdef RMUTEX_DEBUG
 		Debug( LDAP_DEBUG_SYNC,
 			"accesslog_op_mod: locking rmutex for tid %x\n",
@@ -2169,6 +2333,7 @@ accesslog_db_init(
 	log_info *li = ch_calloc(1, sizeof(log_info));
 
 	on->on_bi.bi_private = li;
+	li->li_purgebatch = LOG_PURGE_BATCH;
 	ldap_pvt_thread_mutex_recursive_init( &li->li_op_rmutex );
 	ldap_pvt_thread_mutex_init( &li->li_log_mutex );
 	return 0;
@@ -63,6 +63,10 @@ typedef struct dds_info_t {
 	int			di_num_dynamicObjects;
 	int			di_max_dynamicObjects;
 
+	/* earliest pending expiration (0 if unknown); the expire task
+	 * only searches the database once it is reached */
+	time_t			di_next_expire;
+
 	/* used to advertize the dynamicSubtrees in the root DSE,
 	 * and to select the database in the expiration task */
 	BerVarray		di_suffix;
@@ -80,17 +84,63 @@ typedef struct dds_expire_t {
 
 typedef struct dds_cb_t {
 	dds_expire_t	*dc_ndnlist;
+	time_t		dc_expire;	/* entries expiring up to this are gone */
+	time_t		dc_next;	/* earliest expiration after dc_expire */
 } dds_cb_t;
 
+/* get the expiration time of a dynamic object */
+static int
+dds_entry_expire( Entry *e, time_t *expirep )
+{
+	Attribute		*a;
+	struct lutil_tm		tm;
+	struct lutil_timet	tt;
+
+	a = attr_find( e->e_attrs, ad_entryExpireTimestamp );
+	if ( a == NULL || lutil_parsetime( a->a_nvals[ 0 ].bv_val, &tm ) ) {
+		return -1;
+	}
+
+	lutil_tm2time( &tm, &tt );
+	*expirep = tt.tt_sec;
+
+	return 0;
+}
+
+/* lower the earliest pending expiration, if known */
+static void
+dds_next_expire( dds_info_t *di, time_t expire )
+{
+	ldap_pvt_thread_mutex_lock( &di->di_mutex );
+	if ( di->di_next_expire && expire < di->di_next_expire ) {
+		di->di_next_expire = expire;
+	}
+	ldap_pvt_thread_mutex_unlock( &di->di_mutex );
+}
+
 static int
 dds_expire_cb( Operation *op, SlapReply *rs )
 {
 	dds_cb_t	*dc = (dds_cb_t *)op->o_callback->sc_private;
 	dds_expire_t	*de;
+	time_t		expire;
 	int		rc;
 
 	switch ( rs->sr_type ) {
 	case REP_SEARCH:
+		rc = 0;
+		if ( dds_entry_expire( rs->sr_entry, &expire ) ) {
+			break;
+		}
+
+		/* not expired yet; remember when it will */
+		if ( expire > dc->dc_expire ) {
+			if ( expire < dc->dc_next ) {
+				dc->dc_next = expire;
+			}
+			break;
+		}
+
 		/* alloc list and buffer for berval all in one */
 		de = op->o_tmpalloc( sizeof( dds_expire_t ) + rs->sr_entry->e_nname.bv_len + 1,
 			op->o_tmpmemctx );
@@ -102,7 +152,6 @@ dds_expire_cb( Operation *op, SlapReply *rs )
 		de->de_ndn.bv_val = (char *)&de[ 1 ];
 		AC_MEMCPY( de->de_ndn.bv_val, rs->sr_entry->e_nname.bv_val,
 			rs->sr_entry->e_nname.bv_len + 1 );
-		rc = 0;
 		break;
 
 	case REP_SEARCHREF:
@@ -128,15 +177,29 @@ dds_expire( void *ctx, dds_info_t *di )
 	dds_expire_t	*de = NULL, **dep;
 	SlapReply	rs = { REP_RESULT };
 
-	time_t		expire;
-	char		tsbuf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
-	struct berval	ts;
+	time_t		now, next = 0;
 
 	int		ndeletes, ntotdeletes;
 
 	int		rc;
 	char		*extra = "";
 
+	now = slap_get_time();
+
+	/* nothing can have expired before the earliest known expiration */
+	ldap_pvt_thread_mutex_lock( &di->di_mutex );
+	if ( di->di_next_expire && now - di->di_tolerance < di->di_next_expire ) {
+		ldap_pvt_thread_mutex_unlock( &di->di_mutex );
+		return LDAP_SUCCESS;
+	}
+	/* no object can expire later than this; the search, and any
+	 * dynamic object added meanwhile, will lower it */
+	di->di_next_expire = now + di->di_max_ttl;
+	ldap_pvt_thread_mutex_unlock( &di->di_mutex );
+
+	dc.dc_expire = now - di->di_tolerance;
+	dc.dc_next = now + di->di_max_ttl;
+
 	connection_fake_init2( &conn, &opbuf, ctx, 0 );
 	op = &opbuf.ob_op;
 
@@ -156,20 +219,14 @@ dds_expire( void *ctx, dds_info_t *di )
 	op->ors_slimit = SLAP_NO_LIMIT;
 	op->ors_attrs = slap_anlist_no_attrs;
 
-	expire = slap_get_time() - di->di_tolerance;
-	ts.bv_val = tsbuf;
-	ts.bv_len = sizeof( tsbuf );
-	slap_timestamp( &expire, &ts );
-
-	op->ors_filterstr.bv_len = STRLENOF( "(&(objectClass=" ")(" "<=" "))" )
-		+ slap_schema.si_oc_dynamicObject->soc_cname.bv_len
-		+ ad_entryExpireTimestamp->ad_cname.bv_len
-		+ ts.bv_len;
+	/* expired objects are picked by dds_expire_cb(), which also
+	 * finds out when the next one expires */
+	op->ors_filterstr.bv_len = STRLENOF( "(objectClass=" ")" )
+		+ slap_schema.si_oc_dynamicObject->soc_cname.bv_len;
 	op->ors_filterstr.bv_val = op->o_tmpalloc( op->ors_filterstr.bv_len + 1, op->o_tmpmemctx );
 	snprintf( op->ors_filterstr.bv_val, op->ors_filterstr.bv_len + 1,
-		"(&(objectClass=%s)(%s<=%s))",
-		slap_schema.si_oc_dynamicObject->soc_cname.bv_val,
-		ad_entryExpireTimestamp->ad_cname.bv_val, ts.bv_val );
+		"(objectClass=%s)",
+		slap_schema.si_oc_dynamicObject->soc_cname.bv_val );
 
 	op->ors_filter = str2filter_x( op, op->ors_filterstr.bv_val );
 	if ( op->ors_filter == NULL ) {
@@ -205,6 +262,8 @@ done_search:;
 		goto done;
 	}
 
+	next = dc.dc_next;
+
 	op->o_tag = LDAP_REQ_DELETE;
 	op->o_callback = &sc;
 	sc.sc_response = slap_null_cb;
@@ -234,6 +293,7 @@ done_search:;
 					de->de_ndn.bv_val );
 				dep = &de->de_next;
 				de = NULL;
+				next = 0;
 				break;
 	
 			default:
@@ -241,6 +301,7 @@ done_search:;
 					"DDS dn=\"%s\" err=%d; "
 					"deferring.\n",
 					de->de_ndn.bv_val, rs.sr_err );
+				next = 0;
 				break;
 			}
 
@@ -259,6 +320,13 @@ done_search:;
 		"DDS expired=%d\n", ntotdeletes );
 
 done:;
+	/* if anything was left behind, search again next time */
+	ldap_pvt_thread_mutex_lock( &di->di_mutex );
+	if ( next == 0 || next < di->di_next_expire ) {
+		di->di_next_expire = next;
+	}
+	ldap_pvt_thread_mutex_unlock( &di->di_mutex );
+
 	return rs.sr_err;
 }
 
@@ -432,6 +500,7 @@ dds_op_add( Operation *op, SlapReply *rs )
 		slap_timestamp( &expire, &bv );
 		assert( attr_find( op->ora_e->e_attrs, ad_entryExpireTimestamp ) == NULL );
 		attr_merge_one( op->ora_e, ad_entryExpireTimestamp, &bv, &bv );
+		dds_next_expire( di, expire );
 
 		/* if required, install counter callback */
 		if ( di->di_max_dynamicObjects > 0) {
@@ -810,6 +879,7 @@ done:;
 			value_add_one( &tmpmod->sml_values, &bv );
 			value_add_one( &tmpmod->sml_nvalues, &bv );
 			tmpmod->sml_numvals = 1;
+			dds_next_expire( di, expire );
 		}
 	}
 
@@ -1659,15 +1729,20 @@ dds_entry_info( void *arg, Entry *e )
 
 /* callback that counts the returned entries, since the search
  * does not get to the point in slap_send_search_entries where
- * the actual count occurs */
+ * the actual count occurs; it also finds the earliest expiration */
 static int
 dds_count_cb( Operation *op, SlapReply *rs )
 {
-	int	*nump = (int *)op->o_callback->sc_private;
+	dds_info_t	*di = (dds_info_t *)op->o_callback->sc_private;
+	time_t		expire;
 
 	switch ( rs->sr_type ) {
 	case REP_SEARCH:
-		(*nump)++;
+		di->di_num_dynamicObjects++;
+		if ( dds_entry_expire( rs->sr_entry, &expire ) == 0
+				&& expire < di->di_next_expire ) {
+			di->di_next_expire = expire;
+		}
 		break;
 
 	case REP_SEARCHREF:
@@ -1731,8 +1806,9 @@ dds_count( void *ctx, BackendDB *be )
 	
 	op->o_callback = &sc;
 	sc.sc_response = dds_count_cb;
-	sc.sc_private = &di->di_num_dynamicObjects;
+	sc.sc_private = di;
 	di->di_num_dynamicObjects = 0;
+	di->di_next_expire = slap_get_time() + di->di_max_ttl;
 
 	op->o_bd->bd_info = (BackendInfo *)on->on_info;
 	(void)op->o_bd->bd_info->bi_op_search( op, &rs );
@@ -1760,6 +1836,7 @@ done_search:;
 		Log2( LDAP_DEBUG_ANY, LDAP_LEVEL_ERR,
 			"DDS non-expired objects lookup failed err=%d%s\n",
 			rc, extra );
+		di->di_next_expire = 0;
 		break;
 	}
 
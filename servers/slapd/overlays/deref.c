@@ -137,10 +137,34 @@ typedef struct deref_cb_t {
 	DerefSpec *dc_ds;
 } deref_cb_t;
 
+typedef struct deref_info {
+	int di_maxvals;
+} deref_info;
+
 static int			deref_cid;
 static slap_overinst 		deref;
 static int ov_count;
 
+static ConfigTable derefcfg[] = {
+	{ "deref-maxvals", "count", 2, 2, 0,
+		ARG_INT|ARG_OFFSET,
+		(void *)offsetof(deref_info, di_maxvals),
+		"( OLcfgOvAt:23.1 NAME 'olcDerefMaxVals' "
+		"DESC 'Maximum number of values dereferenced per attribute' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
+};
+
+static ConfigOCs derefocs[] = {
+	{ "( OLcfgOvOc:23.1 "
+		"NAME 'olcDerefConfig' "
+		"DESC 'Dereference control configuration' "
+		"SUP olcOverlayConfig "
+		"MAY olcDerefMaxVals )",
+		Cft_Overlay, derefcfg },
+	{ NULL, 0, NULL }
+};
+
 static int
 deref_parseCtrl (
 	Operation *op,
@@ -278,6 +302,22 @@ deref_cleanup( Operation *op, SlapReply *rs )
 	return SLAP_CB_CONTINUE;
 }
 
+/* order target DNs so consecutive lookups touch neighbouring keys */
+static int
+deref_dn_cmp( const void *v1, const void *v2 )
+{
+	const struct berval *b1 = *(const struct berval **)v1,
+		*b2 = *(const struct berval **)v2;
+	int rc;
+
+	rc = memcmp( b1->bv_val, b2->bv_val,
+		b1->bv_len < b2->bv_len ? b1->bv_len : b2->bv_len );
+	if ( rc == 0 ) {
+		rc = b1->bv_len < b2->bv_len ? -1 : b1->bv_len > b2->bv_len;
+	}
+	return rc;
+}
+
 static int
 deref_response( Operation *op, SlapReply *rs )
 {
@@ -287,6 +327,7 @@ deref_response( Operation *op, SlapReply *rs )
 		BerElementBuffer berbuf;
 		BerElement *ber = (BerElement *) &berbuf;
 		deref_cb_t *dc = (deref_cb_t *)op->o_callback->sc_private;
+		deref_info *di = (deref_info *)dc->dc_on->on_bi.bi_private;
 		DerefSpec *ds;
 		DerefRes *dr, *drhead = NULL, **drp = &drhead;
 		struct berval bv = BER_BVNULL;
@@ -296,7 +337,8 @@ deref_response( Operation *op, SlapReply *rs )
 		AccessControlState acl_state = ACL_STATE_INIT;
 		static char dummy = '\0';
 		Entry *ebase;
-		int i;
+		struct berval **targets;
+		int i, n, ntargets;
 
 		rc = overlay_entry_get_ov( op, &rs->sr_entry->e_nname, NULL, NULL, 0, &ebase, dc->dc_on );
 		if ( rc != LDAP_SUCCESS || ebase == NULL ) {
@@ -327,14 +369,17 @@ deref_response( Operation *op, SlapReply *rs )
 				nAttrs++;
 				nDerefRes++;
 
+				/* first pick the values to dereference, in attribute
+				 * order so that the cap keeps the leading ones */
+				targets = op->o_tmpalloc( a->a_numvals * sizeof( struct berval * ),
+					op->o_tmpmemctx );
+				ntargets = 0;
 				for ( i = 0; !BER_BVISNULL( &a->a_nvals[ i ] ); i++ ) {
-					Entry *e = NULL;
-
 					dv[ i ].dv_attrVals = bva;
 					bva += ds->ds_nattrs;
 
-
-					if ( !access_allowed( op, rs->sr_entry, a->a_desc,
+					if ( ( di->di_maxvals > 0 && ntargets >= di->di_maxvals ) ||
+						!access_allowed( op, rs->sr_entry, a->a_desc,
 							&a->a_nvals[ i ], ACL_READ, &acl_state ) )
 					{
 						dv[ i ].dv_derefSpecVal.bv_val = &dummy;
@@ -345,8 +390,21 @@ deref_response( Operation *op, SlapReply *rs )
 					bv.bv_len += dv[ i ].dv_derefSpecVal.bv_len;
 					nVals++;
 					nDerefVals++;
+					targets[ ntargets++ ] = &a->a_nvals[ i ];
+				}
+
+				/* then fetch the targets in DN order; results still
+				 * go out in attribute order */
+				if ( ntargets > 1 ) {
+					qsort( targets, ntargets, sizeof( struct berval * ), deref_dn_cmp );
+				}
 
-					rc = overlay_entry_get_ov( op, &a->a_nvals[ i ], NULL, NULL, 0, &e, dc->dc_on );
+				for ( n = 0; n < ntargets; n++ ) {
+					Entry *e = NULL;
+
+					i = targets[ n ] - a->a_nvals;
+
+					rc = overlay_entry_get_ov( op, targets[ n ], NULL, NULL, 0, &e, dc->dc_on );
 					if ( rc == LDAP_SUCCESS && e != NULL ) {
 						int j;
 
@@ -395,6 +453,7 @@ deref_response( Operation *op, SlapReply *rs )
 						overlay_entry_release_ov( op, e, 0, dc->dc_on );
 					}
 				}
+				op->o_tmpfree( targets, op->o_tmpmemctx );
 
 				*drp = dr;
 				drp = &dr->dr_next;
@@ -521,6 +580,10 @@ deref_op_search( Operation *op, SlapReply *rs )
 static int
 deref_db_init( BackendDB *be, ConfigReply *cr)
 {
+	slap_overinst *on = (slap_overinst *)be->bd_info;
+
+	on->on_bi.bi_private = ch_calloc( 1, sizeof( deref_info ) );
+
 	if ( ov_count == 0 ) {
 		int rc;
 
@@ -547,30 +610,38 @@ deref_db_open( BackendDB *be, ConfigReply *cr)
 	return overlay_register_control( be, LDAP_CONTROL_X_DEREF );
 }
 
-#ifdef SLAP_CONFIG_DELETE
 static int
 deref_db_destroy( BackendDB *be, ConfigReply *cr)
 {
+	slap_overinst *on = (slap_overinst *)be->bd_info;
+
+#ifdef SLAP_CONFIG_DELETE
 	ov_count--;
 	overlay_unregister_control( be, LDAP_CONTROL_X_DEREF );
 	if ( ov_count == 0 ) {
 		unregister_supported_control( LDAP_CONTROL_X_DEREF );
 	}
+#endif /* SLAP_CONFIG_DELETE */
+	ch_free( on->on_bi.bi_private );
+	on->on_bi.bi_private = NULL;
 	return 0;
 }
-#endif /* SLAP_CONFIG_DELETE */
 
 int
 deref_initialize(void)
 {
+	int rc;
+
 	deref.on_bi.bi_type = "deref";
 	deref.on_bi.bi_db_init = deref_db_init;
 	deref.on_bi.bi_db_open = deref_db_open;
-#ifdef SLAP_CONFIG_DELETE
 	deref.on_bi.bi_db_destroy = deref_db_destroy;
-#endif /* SLAP_CONFIG_DELETE */
 	deref.on_bi.bi_op_search = deref_op_search;
 
+	deref.on_bi.bi_cf_ocs = derefocs;
+	rc = config_register_schema( derefcfg, derefocs );
+	if ( rc ) return rc;
+
 	return overlay_register( &deref );
 }
 
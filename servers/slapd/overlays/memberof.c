@@ -194,6 +194,7 @@ typedef struct memberof_cbinfo_t {
 	BerVarray member;
 	BerVarray memberof;
 	memberof_is_t what;
+	int nmods;	/* internal modifies not yet made durable */
 } memberof_cbinfo_t;
 
 static void
@@ -379,6 +380,11 @@ memberof_value_modify(
 	op2.orm_no_opattrs = 1;
 	op2.o_dont_replicate = 1;
 
+	/* Don't wait for each of these to reach the disk,
+	 * memberof_flush() does it once for all of them */
+	op2.o_lazyCommit = SLAP_CONTROL_NONCRITICAL;
+	mci->nmods++;
+
 	if ( !BER_BVISNULL( &mo->mo_ndn ) ) {
 		ml = &mod[ mcnt ];
 		ml->sml_numvals = 1;
@@ -499,6 +505,32 @@ memberof_value_modify(
 	 * move towards self-repairing capabilities. */
 }
 
+/*
+ * make the internal modifies done on behalf of op durable
+ */
+static void
+memberof_flush( Operation *op, memberof_cbinfo_t *mci )
+{
+	BackendInfo	*bi = mci->on->on_info->oi_orig;
+	OpExtra		*oex, *txn = NULL;
+
+	if ( !mci->nmods || get_lazyCommit( op ) || !bi->bi_op_txn )
+		return;
+	mci->nmods = 0;
+
+	/* they're part of a txn someone else will commit */
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == op->o_bd->be_private )
+			return;
+	}
+
+	/* an empty commit waits for everything committed before it */
+	if ( bi->bi_op_txn( op, SLAP_TXN_BEGIN, &txn ) == 0 ) {
+		LDAP_SLIST_REMOVE( &op->o_extra, txn, OpExtra, oe_next );
+		bi->bi_op_txn( op, SLAP_TXN_COMMIT, &txn );
+	}
+}
+
 static int
 memberof_cleanup( Operation *op, SlapReply *rs )
 {
@@ -745,6 +777,7 @@ memberof_op_add( Operation *op, SlapReply *rs )
 	sc->sc_writewait = 0;
 	mci = sc->sc_private;
 	mci->on = on;
+	mci->nmods = 0;
 	mci->member = NULL;
 	mci->memberof = NULL;
 	sc->sc_next = op->o_callback;
@@ -780,6 +813,7 @@ memberof_op_delete( Operation *op, SlapReply *rs )
 	sc->sc_writewait = 0;
 	mci = sc->sc_private;
 	mci->on = on;
+	mci->nmods = 0;
 	mci->member = NULL;
 	mci->memberof = NULL;
 	mci->what = MEMBEROF_IS_GROUP;
@@ -824,6 +858,19 @@ memberof_op_modify( Operation *op, SlapReply *rs )
 		}
 	}
 
+	/* Nothing to do unless the group membership is touched;
+	 * spare the group lookup for all the other modifications */
+	if ( mmlp == NULL ) {
+		Modifications *ml;
+
+		for ( ml = op->orm_modlist; ml; ml = ml->sml_next ) {
+			if ( is_ad_subtype( ml->sml_desc, mo->mo_ad_member ) )
+				break;
+		}
+		if ( ml == NULL )
+			return SLAP_CB_CONTINUE;
+	}
+
 	save_dn = op->o_dn;
 	save_ndn = op->o_ndn;
 	mcis.on = on;
@@ -1199,6 +1246,7 @@ done2:;
 	sc->sc_writewait = 0;
 	mci = sc->sc_private;
 	mci->on = on;
+	mci->nmods = 0;
 	mci->member = NULL;
 	mci->memberof = NULL;
 	mci->what = mcis.what;
@@ -1245,6 +1293,7 @@ memberof_op_modrdn( Operation *op, SlapReply *rs )
 	sc->sc_writewait = 0;
 	mci = sc->sc_private;
 	mci->on = on;
+	mci->nmods = 0;
 	mci->member = NULL;
 	mci->memberof = NULL;
 
@@ -1316,6 +1365,7 @@ memberof_res_add( Operation *op, SlapReply *rs )
 		}
 	}
 
+	memberof_flush( op, mci );
 	return SLAP_CB_CONTINUE;
 }
 
@@ -1358,6 +1408,7 @@ memberof_res_delete( Operation *op, SlapReply *rs )
 		}
 	}
 
+	memberof_flush( op, mci );
 	return SLAP_CB_CONTINUE;
 }
 
@@ -1504,6 +1555,7 @@ memberof_res_modify( Operation *op, SlapReply *rs )
 		}
 	}
 
+	memberof_flush( op, mci );
 	return SLAP_CB_CONTINUE;
 }
 
@@ -1598,6 +1650,8 @@ memberof_res_modrdn( Operation *op, SlapReply *rs )
 		}
 	}
 
+	memberof_flush( op, mci );
+
 done:;
 	if ( !BER_BVISNULL( &newDN ) ) {
 		op->o_tmpfree( newDN.bv_val, op->o_tmpmemctx );
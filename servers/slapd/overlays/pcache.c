@@ -65,7 +65,7 @@ typedef struct Query_s {
 struct query_template_s;
 
 typedef struct Qbase_s {
-	TAvlnode *scopes[4];		/* threaded AVL trees of cached queries */
+	Btree *scopes[4];		/* B+trees of cached queries */
 	struct berval base;
 	int queries;
 } Qbase;
@@ -118,6 +118,7 @@ typedef struct cached_query_s {
 
 struct attr_set {
 	struct query_template_s *templates;
+	Avlnode		*tindex;	/* templates indexed by querystr */
 	AttributeName*	attrs; 		/* specifies the set */
 	unsigned	flags;
 #define	PC_CONFIGURED	(0x1)
@@ -132,6 +133,7 @@ struct attr_set {
 typedef struct query_template_s {
 	struct query_template_s *qtnext;
 	struct query_template_s *qmnext;
+	struct query_template_s *qtdup;	/* next template with same querystr */
 
 	Avlnode*		qbase;
 	CachedQuery* 	query;	        /* most recent query cached for the template */
@@ -148,6 +150,9 @@ typedef struct query_template_s {
 	int			bindscope;
 	int 		attr_set_index; /* determines the projected attributes */
 	int 		no_of_queries;  /* Total number of queries in the template */
+	unsigned long	t_hits;		/* searches answered from the cache */
+	unsigned long	t_neghits;	/* ...of which from a negative result */
+	unsigned long	t_misses;	/* searches sent to the remote server */
 	time_t		ttl;		/* TTL for the queries of this template */
 	time_t		negttl;		/* TTL for negative results */
 	time_t		limitttl;	/* TTL for sizelimit exceeding results */
@@ -250,7 +255,8 @@ static int privDB_cid;
 static AttributeDescription	*ad_queryId, *ad_cachedQueryURL;
 
 #ifdef PCACHE_MONITOR
-static AttributeDescription	*ad_numQueries, *ad_numEntries;
+static AttributeDescription	*ad_numQueries, *ad_numEntries,
+				*ad_templateStats;
 static ObjectClass		*oc_olmPCache;
 #endif /* PCACHE_MONITOR */
 
@@ -302,6 +308,14 @@ static struct {
 		"NO-USER-MODIFICATION "
 		"USAGE directoryOperation )",
 		&ad_numEntries },
+	{ "( PCacheAttributes:5 "
+		"NAME 'pcacheTemplateStats' "
+		"DESC 'Hit and miss counters of a query template' "
+		"EQUALITY caseExactMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.15 "
+		"NO-USER-MODIFICATION "
+		"USAGE directoryOperation )",
+		&ad_templateStats },
 #endif /* PCACHE_MONITOR */
 
 	{ NULL }
@@ -320,6 +334,7 @@ static struct {
 			"pcacheQueryURL "
 			"$ pcacheNumQueries "
 			"$ pcacheNumEntries "
+			"$ pcacheTemplateStats "
 			" ) )",
 		&oc_olmPCache },
 #endif /* PCACHE_MONITOR */
@@ -588,6 +603,30 @@ bottom:
 	return attr_cnt;
 }
 
+/* Length-ordered, case-insensitive sort on template strings */
+static int pcache_temp_cmp( const void *v1, const void *v2 )
+{
+	const QueryTemplate *t1 = v1, *t2 = v2;
+
+	int rc = t1->querystr.bv_len - t2->querystr.bv_len;
+	if ( rc == 0 )
+		rc = strncasecmp( t1->querystr.bv_val, t2->querystr.bv_val,
+			t1->querystr.bv_len );
+	return rc;
+}
+
+/* Find the first template of an attrset matching a template string.
+ * Further templates with the same string are chained via qtdup.
+ */
+static QueryTemplate *
+pcache_find_template( struct attr_set *as, struct berval *tempstr )
+{
+	QueryTemplate qt;
+
+	qt.querystr = *tempstr;
+	return avl_find( as->tindex, &qt, pcache_temp_cmp );
+}
+
 /*
  * Turn an URL representing a formerly cached query into a cached query,
  * and try to cache it
@@ -788,8 +827,8 @@ url2query(
 		}
 
 		/* check for query containment */
-		qt = qm->attr_sets[attrset].templates;
-		for ( ; qt; qt = qt->qtnext ) {
+		qt = pcache_find_template( &qm->attr_sets[attrset], &tempstr );
+		for ( ; qt; qt = qt->qtdup ) {
 			/* find if template i can potentially answer tempstr */
 			if ( bvmatch( &qt->querystr, &tempstr ) ) {
 				break;
@@ -1272,14 +1311,14 @@ typedef struct fstack {
 } fstack;
 
 static CachedQuery *
-find_filter( Operation *op, TAvlnode *root, Filter *inputf, Filter *first )
+find_filter( Operation *op, Btree *root, Filter *inputf, Filter *first )
 {
 	Filter* fs;
 	Filter* fi;
 	MatchingRule* mrule = NULL;
 	int res=0, eqpass= 0;
 	int ret, rc, dir;
-	TAvlnode *ptr;
+	BtreeCursor bc;
 	CachedQuery cq, *qc;
 	fstack *stack = NULL, *fsp;
 
@@ -1290,16 +1329,15 @@ find_filter( Operation *op, TAvlnode *root, Filter *inputf, Filter *first )
 	 * walk the entire list.
 	 */
 	if ( first->f_choice == LDAP_FILTER_SUBSTRINGS ) {
-		ptr = tavl_end( root, 1 );
+		qc = btree_end( root, &bc, TAVL_DIR_RIGHT );
 		dir = TAVL_DIR_LEFT;
 	} else {
-		ptr = tavl_find3( root, &cq, pcache_query_cmp, &ret );
+		qc = btree_find3( root, &cq, pcache_query_cmp, &bc, &ret );
 		dir = (first->f_choice == LDAP_FILTER_GE) ? TAVL_DIR_LEFT :
 			TAVL_DIR_RIGHT;
 	}
 
-	while (ptr) {
-		qc = ptr->avl_data;
+	while (qc) {
 		fi = inputf;
 		fs = qc->filter;
 
@@ -1317,7 +1355,7 @@ find_filter( Operation *op, TAvlnode *root, Filter *inputf, Filter *first )
 			if ( eqpass == 0 ) {
 				if ( qc->first->f_choice != LDAP_FILTER_EQUALITY ) {
 nextpass:			eqpass = 1;
-					ptr = tavl_end( root, 1 );
+					qc = btree_end( root, &bc, TAVL_DIR_RIGHT );
 					dir = TAVL_DIR_LEFT;
 					continue;
 				}
@@ -1426,7 +1464,7 @@ nextpass:			eqpass = 1;
 
 		if ( res )
 			return qc;
-		ptr = tavl_next( ptr, dir );
+		qc = btree_next( &bc, dir );
 	}
 	return NULL;
 }
@@ -1509,6 +1547,9 @@ query_containment(Operation *op, query_manager *qm,
 							return NULL;
 						}
 						ldap_pvt_thread_mutex_lock(&qm->lru_mutex);
+						templa->t_hits++;
+						if ( BER_BVISNULL( &qc->q_uuid ))
+							templa->t_neghits++;
 						if (qm->lru_top != qc) {
 							remove_query(qm, qc);
 							add_query_on_top(qm, qc);
@@ -1628,7 +1669,7 @@ add_query(
 	new_cached_query->next = templ->query;
 	new_cached_query->prev = NULL;
 	new_cached_query->qbase = qbase;
-	rc = tavl_insert( &qbase->scopes[query->scope], new_cached_query,
+	rc = btree_insert( &qbase->scopes[query->scope], new_cached_query,
 		pcache_query_cmp, avl_dup_error );
 	if ( rc == 0 ) {
 		qbase->queries++;
@@ -1680,7 +1721,7 @@ remove_from_template (CachedQuery* qc, QueryTemplate* template)
 		qc->next->prev = qc->prev;
 		qc->prev->next = qc->next;
 	}
-	tavl_delete( &qc->qbase->scopes[qc->scope], qc, pcache_query_cmp );
+	btree_delete( &qc->qbase->scopes[qc->scope], qc, pcache_query_cmp );
 	qc->qbase->queries--;
 	if ( qc->qbase->queries == 0 ) {
 		avl_delete( &template->qbase, qc->qbase, pcache_dn_cmp );
@@ -2763,6 +2804,30 @@ pc_bind_resp( Operation *op, SlapReply *rs )
 }
 
 #ifdef PCACHE_CONTROL_PRIVDB
+/* drop the cached queries that returned an entry
+ * once a write to that entry went through */
+static int
+pcache_write_cb( Operation *op, SlapReply *rs )
+{
+	if ( rs->sr_type == REP_RESULT && rs->sr_err == LDAP_SUCCESS ) {
+		cache_manager	*cm = op->o_callback->sc_private;
+
+		(void)pcache_remove_entry_queries_from_cache( op, cm,
+			&op->o_req_ndn, NULL );
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+pcache_write_cleanup( Operation *op, SlapReply *rs )
+{
+	op->o_tmpfree( op->o_callback, op->o_tmpmemctx );
+	op->o_callback = NULL;
+
+	return SLAP_CB_CONTINUE;
+}
+
 static int
 pcache_op_privdb(
 	Operation		*op,
@@ -2775,6 +2840,19 @@ pcache_op_privdb(
 
 	/* skip if control is unset */
 	if ( op->o_ctrlflag[ privDB_cid ] != SLAP_CONTROL_CRITICAL ) {
+		if ( !cm->defer_db_open && ( op->o_tag == LDAP_REQ_MODIFY
+			|| op->o_tag == LDAP_REQ_DELETE
+			|| op->o_tag == LDAP_REQ_MODRDN ) )
+		{
+			slap_callback	*sc;
+
+			sc = op->o_tmpcalloc( 1, sizeof( slap_callback ), op->o_tmpmemctx );
+			sc->sc_response = pcache_write_cb;
+			sc->sc_cleanup = pcache_write_cleanup;
+			sc->sc_private = cm;
+			sc->sc_next = op->o_callback;
+			op->o_callback = sc;
+		}
 		return SLAP_CB_CONTINUE;
 	}
 
@@ -3033,11 +3111,10 @@ pcache_op_search(
 
 		/* check for query containment */
 		if (attr_set > -1) {
-			QueryTemplate *qt = qm->attr_sets[attr_set].templates;
-			for (; qt; qt = qt->qtnext ) {
+			QueryTemplate *qt = pcache_find_template(
+				&qm->attr_sets[attr_set], &tempstr );
+			for (; qt; qt = qt->qtdup ) {
 				/* find if template i can potentially answer tempstr */
-				if ( ber_bvstrcasecmp( &qt->querystr, &tempstr ) != 0 )
-					continue;
 				cacheable = 1;
 				qtemp = qt;
 				Debug( pcache_debug, "Entering QC, querystr = %s\n",
@@ -3106,6 +3183,12 @@ pcache_op_search(
 
 	Debug( pcache_debug, "QUERY NOT ANSWERABLE\n", 0, 0, 0 );
 
+	if ( qtemp ) {
+		ldap_pvt_thread_mutex_lock( &qm->lru_mutex );
+		qtemp->t_misses++;
+		ldap_pvt_thread_mutex_unlock( &qm->lru_mutex );
+	}
+
 	ldap_pvt_thread_mutex_lock(&cm->cache_mutex);
 	if (cm->num_cached_queries >= cm->max_queries) {
 		cacheable = 0;
@@ -4243,6 +4326,12 @@ pc_temp_fail:
 		qm->attr_sets[i].flags |= PC_REFERENCED;
 		temp->qtnext = qm->attr_sets[i].templates;
 		qm->attr_sets[i].templates = temp;
+		/* keep the search order of the qtnext list: the newest
+		 * template with a given string is tried first */
+		temp->qtdup = avl_delete( &qm->attr_sets[i].tindex, temp,
+			pcache_temp_cmp );
+		avl_insert( &qm->attr_sets[i].tindex, temp, pcache_temp_cmp,
+			avl_dup_error );
 		Debug( pcache_debug, "  attributes: \n", 0, 0, 0 );
 		if ( ( attrarray = qm->attr_sets[i].attrs ) != NULL ) {
 			for ( i=0; attrarray[i].an_name.bv_val; i++ )
@@ -4771,7 +4860,7 @@ pcache_free_qbase( void *v )
 	int i;
 
 	for (i=0; i<3; i++)
-		tavl_free( qb->scopes[i], NULL );
+		btree_free( qb->scopes[i], NULL );
 	ch_free( qb );
 }
 
@@ -4918,6 +5007,8 @@ pcache_db_destroy(
 	for ( i = 0; i < cm->numattrsets; i++ ) {
 		int j;
 
+		avl_free( qm->attr_sets[i].tindex, NULL );
+
 		/* Account of LDAP_NO_ATTRS */
 		if ( !qm->attr_sets[i].count ) continue;
 
@@ -5407,6 +5498,33 @@ pcache_monitor_update(
 		}
 	}
 
+	attr_delete( &e->e_attrs, ad_templateStats );
+	if ( ( SLAP_OPATTRS( rs->sr_attr_flags ) || ad_inlist( ad_templateStats, rs->sr_attrs ) )
+		&& qm->templates != NULL )
+	{
+		QueryTemplate *tm;
+		struct berval	bv;
+
+		vals = NULL;
+		ldap_pvt_thread_mutex_lock( &qm->lru_mutex );
+		for ( tm = qm->templates; tm != NULL; tm = tm->qmnext ) {
+			bv.bv_len = tm->querystr.bv_len + STRLENOF( " 0123456789" )
+				+ 3 * STRLENOF( " misses=18446744073709551615" );
+			bv.bv_val = op->o_tmpalloc( bv.bv_len + 1, op->o_tmpmemctx );
+			bv.bv_len = snprintf( bv.bv_val, bv.bv_len + 1,
+				"%s %d hits=%lu neghits=%lu misses=%lu",
+				tm->querystr.bv_val, tm->attr_set_index,
+				tm->t_hits, tm->t_neghits, tm->t_misses );
+			ber_bvarray_add_x( &vals, &bv, op->o_tmpmemctx );
+		}
+		ldap_pvt_thread_mutex_unlock( &qm->lru_mutex );
+
+		if ( vals != NULL ) {
+			attr_merge_normalize( e, ad_templateStats, vals, NULL );
+			ber_bvarray_free_x( vals, op->o_tmpmemctx );
+		}
+	}
+
 	{
 		Attribute	*a;
 		char		buf[ SLAP_TEXT_BUFLEN ];
@@ -5476,6 +5594,14 @@ pcache_monitor_free(
 		textbuf, sizeof( textbuf ) );
 	/* don't care too much about return code... */
 
+	/* remove attrs */
+	mod.sm_values = NULL;
+	mod.sm_desc = ad_templateStats;
+	mod.sm_numvals = 0;
+	rc = modify_delete_values( e, &mod, 1, &text,
+		textbuf, sizeof( textbuf ) );
+	/* don't care too much about return code... */
+
 	/* remove attrs */
 	mod.sm_values = NULL;
 	mod.sm_desc = ad_numQueries;
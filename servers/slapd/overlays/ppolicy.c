@@ -906,6 +906,11 @@ typedef struct ppbind {
 	Modifications *mod;
 	LDAPPasswordPolicyError pErr;
 	PassPolicy pp;
+	/* success-path state, sampled when the entry was first read */
+	time_t pwtime;
+	int nfailures;
+	int ngraceuse;
+	int pwdreset;
 } ppbind;
 
 static void
@@ -943,6 +948,26 @@ ppolicy_ctrls_cleanup( Operation *op, SlapReply *rs )
 	return SLAP_CB_CONTINUE;
 }
 
+/* Remember what a successful Bind needs to know about the entry, so
+ * the response callback doesn't have to fetch the entry again.
+ */
+static void
+ppolicy_bind_state( Entry *e, ppbind *ppb )
+{
+	Attribute *a;
+
+	ppb->pwtime = (time_t)-1;
+	if ((a = attr_find( e->e_attrs, ad_pwdChangedTime )) != NULL)
+		ppb->pwtime = parse_time( a->a_nvals[0].bv_val );
+	if ((a = attr_find( e->e_attrs, ad_pwdFailureTime )) != NULL)
+		ppb->nfailures = a->a_numvals;
+	if ((a = attr_find( e->e_attrs, ad_pwdGraceUseTime )) != NULL)
+		ppb->ngraceuse = a->a_numvals;
+	if ((a = attr_find( e->e_attrs, ad_pwdReset )) != NULL &&
+		bvmatch( &a->a_nvals[0], &slap_true_bv ))
+		ppb->pwdreset = 1;
+}
+
 static int
 ppolicy_bind_response( Operation *op, SlapReply *rs )
 {
@@ -959,19 +984,28 @@ ppolicy_bind_response( Operation *op, SlapReply *rs )
 	char nowstr_usec[ LDAP_LUTIL_GENTIME_BUFSIZE+8 ];
 	struct berval timestamp, timestamp_usec;
 	BackendInfo *bi = op->o_bd->bd_info;
-	Entry *e;
+	Entry *e = NULL;
 
 	/* If we already know it's locked, just get on with it */
 	if ( ppb->pErr != PP_noError ) {
 		goto locked;
 	}
 
-	op->o_bd->bd_info = (BackendInfo *)on->on_info;
-	rc = be_entry_get_rw( op, &op->o_req_ndn, NULL, NULL, 0, &e );
-	op->o_bd->bd_info = bi;
+	/* A successful Bind only needs the state ppolicy_bind already
+	 * collected, and other results leave the entry alone. Only a
+	 * failure needs the entry again, to count its current
+	 * pwdFailureTime values.
+	 */
+	if ( rs->sr_err == LDAP_INVALID_CREDENTIALS ) {
+		op->o_bd->bd_info = (BackendInfo *)on->on_info;
+		rc = be_entry_get_rw( op, &op->o_req_ndn, NULL, NULL, 0, &e );
+		op->o_bd->bd_info = bi;
 
-	if ( rc != LDAP_SUCCESS ) {
-		return SLAP_CB_CONTINUE;
+		if ( rc != LDAP_SUCCESS ) {
+			return SLAP_CB_CONTINUE;
+		}
+	} else if ( rs->sr_err != LDAP_SUCCESS ) {
+		goto locked;
 	}
 
 	ldap_pvt_gettime(&now_tm); /* stored for later consideration */
@@ -1099,11 +1133,10 @@ ppolicy_bind_response( Operation *op, SlapReply *rs )
 			mod = m;
 		}
 	} else if ( rs->sr_err == LDAP_SUCCESS ) {
-		if ((a = attr_find( e->e_attrs, ad_pwdChangedTime )) != NULL)
-			pwtime = parse_time( a->a_nvals[0].bv_val );
+		pwtime = ppb->pwtime;
 
 		/* delete all pwdFailureTimes */
-		if ( attr_find( e->e_attrs, ad_pwdFailureTime )) {
+		if ( ppb->nfailures ) {
 			m = ch_calloc( sizeof(Modifications), 1 );
 			m->sml_op = LDAP_MOD_DELETE;
 			m->sml_flags = 0;
@@ -1116,10 +1149,7 @@ ppolicy_bind_response( Operation *op, SlapReply *rs )
 		/*
 		 * check to see if the password must be changed
 		 */
-		if ( ppb->pp.pwdMustChange &&
-			(a = attr_find( e->e_attrs, ad_pwdReset )) &&
-			bvmatch( &a->a_nvals[0], &slap_true_bv ) )
-		{
+		if ( ppb->pp.pwdMustChange && ppb->pwdreset ) {
 			/*
 			 * need to inject client controls here to give
 			 * more information. For the moment, we ensure
@@ -1157,19 +1187,14 @@ ppolicy_bind_response( Operation *op, SlapReply *rs )
 grace:
 		if (!pwExpired) goto check_expiring_password;
 		
-		if ((a = attr_find( e->e_attrs, ad_pwdGraceUseTime )) == NULL)
-			ngut = ppb->pp.pwdGraceAuthNLimit;
-		else {
-			for(ngut=0; a->a_nvals[ngut].bv_val; ngut++);
-			ngut = ppb->pp.pwdGraceAuthNLimit - ngut;
-		}
+		ngut = ppb->pp.pwdGraceAuthNLimit - ppb->ngraceuse;
 
 		/*
 		 * ngut is the number of remaining grace logins
 		 */
 		Debug( LDAP_DEBUG_ANY,
 			"ppolicy_bind: Entry %s has an expired password: %d grace logins\n",
-			e->e_name.bv_val, ngut, 0);
+			op->o_req_dn.bv_val, ngut, 0);
 		
 		if (ngut < 1) {
 			ppb->pErr = PP_passwordExpired;
@@ -1229,8 +1254,10 @@ check_expiring_password:
 	}
 
 done:
-	op->o_bd->bd_info = (BackendInfo *)on->on_info;
-	be_entry_release_r( op, e );
+	if ( e ) {
+		op->o_bd->bd_info = (BackendInfo *)on->on_info;
+		be_entry_release_r( op, e );
+	}
 
 locked:
 	if ( mod ) {
@@ -1340,6 +1367,7 @@ ppolicy_bind( Operation *op, SlapReply *rs )
 		ppolicy_get( op, e, &ppb->pp );
 
 		rc = account_locked( op, e, &ppb->pp, &ppb->mod );
+		ppolicy_bind_state( e, ppb );
 
 		op->o_bd->bd_info = (BackendInfo *)on->on_info;
 		be_entry_release_r( op, e );
@@ -1481,6 +1509,7 @@ ppolicy_compare(
 		ppolicy_get( op, e, &ppb->pp );
 
 		rc = account_locked( op, e, &ppb->pp, &ppb->mod );
+		ppolicy_bind_state( e, ppb );
 
 		op->o_bd->bd_info = (BackendInfo *)on->on_info;
 		be_entry_release_r( op, e );
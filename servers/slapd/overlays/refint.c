@@ -98,6 +98,9 @@ typedef struct refint_pre_s {
 
 #define	RUNQ_INTERVAL	36000	/* a long time */
 
+/* Max number of queued deletes looked up with a single search */
+#define	REFINT_BATCH	64
+
 static MatchingRule	*mr_dnSubtreeMatch;
 
 enum {
@@ -571,11 +574,94 @@ refint_search_cb(
 	return(0);
 }
 
+/*
+** search callback for a batch of plain deletes chained off rq
+** collects the values referring to any of the deleted DNs
+** into one set of dependents hung off the first queue entry
+*/
+
+static int
+refint_batch_cb(
+	Operation *op,
+	SlapReply *rs
+)
+{
+	Attribute *a;
+	refint_q *rq = op->o_callback->sc_private, *rn;
+	refint_data *dd = rq->rdata;
+	refint_attrs *ia, *na;
+	dependent_data *ip;
+	unsigned i;
+
+	if (rs->sr_type != REP_SEARCH || !rs->sr_entry) return(0);
+
+	ip = op->o_tmpalloc(sizeof(dependent_data), op->o_tmpmemctx );
+	ip->attrs = NULL;
+	for(ia = dd->attrs; ia; ia = ia->next) {
+		if ( !(a = attr_find(rs->sr_entry->e_attrs, ia->attr) ) )
+			continue;
+
+		na = NULL;
+		for ( rn = rq; rn; rn = rn->next ) {
+			struct berval	dn;
+
+			if ( attr_valfind( a,
+				SLAP_MR_EQUALITY|SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH|
+				SLAP_MR_ATTRIBUTE_VALUE_NORMALIZED_MATCH, &rn->oldndn, &i, NULL ) )
+				continue;
+
+			/* the same DN may have been deleted more than once */
+			if ( na && na->old_nvals ) {
+				int j;
+				for ( j = 0; j < na->ra_numvals; j++ ) {
+					if ( bvmatch( &na->old_nvals[j], &a->a_nvals[i] ) )
+						break;
+				}
+				if ( j < na->ra_numvals )
+					continue;
+			}
+
+			if ( na == NULL ) {
+				na = op->o_tmpcalloc( 1, sizeof( refint_attrs ),
+					op->o_tmpmemctx );
+				na->next = ip->attrs;
+				ip->attrs = na;
+				na->attr = ia->attr;
+			}
+			ber_dupbv_x( &dn, &a->a_vals[i], op->o_tmpmemctx );
+			ber_bvarray_add_x( &na->old_vals, &dn, op->o_tmpmemctx );
+			ber_dupbv_x( &dn, &a->a_nvals[i], op->o_tmpmemctx );
+			ber_bvarray_add_x( &na->old_nvals, &dn, op->o_tmpmemctx );
+			na->ra_numvals++;
+		}
+
+		/* Deleting all values and a nothing DN is configured? */
+		if ( na && na->ra_numvals == a->a_numvals && !BER_BVISNULL(&dd->nothing) )
+			na->dont_empty = 1;
+	}
+
+	if ( !ip->attrs ) {
+		op->o_tmpfree( ip, op->o_tmpmemctx );
+		return(0);
+	}
+
+	Debug( LDAP_DEBUG_TRACE, "refint_batch_cb: %s\n",
+		rs->sr_entry->e_name.bv_val, 0, 0 );
+
+	ber_dupbv_x( &ip->dn, &rs->sr_entry->e_name, op->o_tmpmemctx );
+	ber_dupbv_x( &ip->ndn, &rs->sr_entry->e_nname, op->o_tmpmemctx );
+	ip->next = rq->attrs;
+	rq->attrs = ip;
+
+	return(0);
+}
+
 static int
 refint_repair(
 	Operation	*op,
 	refint_data	*id,
-	refint_q	*rq )
+	refint_q	*rq,
+	slap_response	*search_cb )
 {
 	dependent_data	*dp;
 	SlapReply		rs = {REP_RESULT};
@@ -584,7 +670,7 @@ refint_repair(
 	int		rc;
 	int	cache;
 
-	op->o_callback->sc_response = refint_search_cb;
+	op->o_callback->sc_response = search_cb;
 	op->o_req_dn = op->o_bd->be_suffix[ 0 ];
 	op->o_req_ndn = op->o_bd->be_nsuffix[ 0 ];
 	op->o_dn = op->o_bd->be_rootdn;
@@ -760,10 +846,10 @@ refint_qtask( void *ctx, void *arg )
 	OperationBuffer opbuf;
 	Operation *op;
 	slap_callback cb = { NULL, NULL, NULL, NULL };
-	Filter ftop, *fptr;
-	refint_q *rq;
+	Filter ftop, *fptr, *fbatch = NULL;
+	refint_q *rq, *rn;
 	refint_attrs *ip;
-	int pausing = 0, rc = 0;
+	int pausing = 0, rc = 0, nattrs = 0;
 
 	connection_fake_init( &conn, &opbuf, ctx );
 	op = &opbuf.ob_op;
@@ -793,11 +879,13 @@ refint_qtask( void *ctx, void *arg )
 		fptr->f_mr_dnattrs = 0;
 		fptr->f_next = ftop.f_or;
 		ftop.f_or = fptr;
+		nattrs++;
 	}
 
 	for (;;) {
 		dependent_data	*dp, *dp_next;
 		refint_attrs *ra, *ra_next;
+		slap_response *search_cb;
 
 		if ( ldap_pvt_thread_pool_pausing( &connection_pool ) > 0 ) {
 			pausing = 1;
@@ -808,7 +896,28 @@ refint_qtask( void *ctx, void *arg )
 		ldap_pvt_thread_mutex_lock( &id->qmutex );
 		rq = id->qhead;
 		if ( rq ) {
+			int nbatch = 1;
+
 			id->qhead = rq->next;
+			rq->next = NULL;
+
+			/* Plain deletes queued behind this one can be looked
+			 * up together: they only remove values, so repairing
+			 * one can't change what refers to another */
+			if ( BER_BVISNULL( &rq->newndn ) && !rq->do_sub ) {
+				refint_q **rtail = &rq->next;
+
+				while ( nbatch < REFINT_BATCH && ( rn = id->qhead ) &&
+					BER_BVISNULL( &rn->newndn ) && !rn->do_sub &&
+					rn->db == rq->db )
+				{
+					id->qhead = rn->next;
+					rn->next = NULL;
+					*rtail = rn;
+					rtail = &rn->next;
+					nbatch++;
+				}
+			}
 			if ( !id->qhead )
 				id->qtail = NULL;
 		}
@@ -816,21 +925,51 @@ refint_qtask( void *ctx, void *arg )
 		if ( !rq )
 			break;
 
-		for (fptr = ftop.f_or; fptr; fptr = fptr->f_next ) {
-			fptr->f_mr_value = rq->oldndn;
-			/* Use (attr:dnSubtreeMatch:=value) to catch subtree rename
-			 * and subtree delete where supported */
-			if (rq->do_sub)
-				fptr->f_choice = LDAP_FILTER_EXT;
-			else
-				fptr->f_choice = LDAP_FILTER_EQUALITY;
+		if ( rq->next ) {
+			/* (|(attr1=dn1)(attr2=dn1)...(attr1=dnN)(attr2=dnN)) */
+			Filter *fb;
+			AttributeAssertion *ava;
+			int n = 0;
+
+			for ( rn = rq; rn; rn = rn->next )
+				n += nattrs;
+			fbatch = op->o_tmpalloc( sizeof(Filter) + n * ( sizeof(Filter) +
+				sizeof(AttributeAssertion) ), op->o_tmpmemctx );
+			fbatch->f_choice = LDAP_FILTER_OR;
+			fbatch->f_next = NULL;
+			fbatch->f_or = NULL;
+			fb = fbatch + 1;
+			ava = (AttributeAssertion *)(fb + n);
+			for ( rn = rq; rn; rn = rn->next ) {
+				for ( ip = id->attrs; ip; ip = ip->next ) {
+					*ava = (AttributeAssertion)ATTRIBUTEASSERTION_INIT;
+					ava->aa_desc = ip->attr;
+					ava->aa_value = rn->oldndn;
+					fb->f_choice = LDAP_FILTER_EQUALITY;
+					fb->f_ava = ava++;
+					fb->f_next = fbatch->f_or;
+					fbatch->f_or = fb++;
+				}
+			}
+			op->ors_filter = fbatch;
+		} else {
+			for (fptr = ftop.f_or; fptr; fptr = fptr->f_next ) {
+				fptr->f_mr_value = rq->oldndn;
+				/* Use (attr:dnSubtreeMatch:=value) to catch subtree rename
+				 * and subtree delete where supported */
+				if (rq->do_sub)
+					fptr->f_choice = LDAP_FILTER_EXT;
+				else
+					fptr->f_choice = LDAP_FILTER_EQUALITY;
+			}
+			op->ors_filter = &ftop;
 		}
 
 		filter2bv_x( op, op->ors_filter, &op->ors_filterstr );
 
 		/* callback gets the searched dn instead */
+		search_cb = rq->next ? refint_batch_cb : refint_search_cb;
 		cb.sc_private	= rq;
-		cb.sc_response	= refint_search_cb;
 		op->o_callback	= &cb;
 		op->o_tag	= LDAP_REQ_SEARCH;
 		op->ors_scope	= LDAP_SCOPE_SUBTREE;
@@ -846,7 +985,7 @@ refint_qtask( void *ctx, void *arg )
 
 		if ( rq->db != NULL ) {
 			op->o_bd = rq->db;
-			rc = refint_repair( op, id, rq );
+			rc = refint_repair( op, id, rq, search_cb );
 
 		} else {
 			BackendDB	*be;
@@ -859,7 +998,7 @@ refint_qtask( void *ctx, void *arg )
 
 				if ( be->be_search && be->be_modify ) {
 					op->o_bd = be;
-					rc = refint_repair( op, id, rq );
+					rc = refint_repair( op, id, rq, search_cb );
 				}
 			}
 		}
@@ -878,26 +1017,35 @@ refint_qtask( void *ctx, void *arg )
 			op->o_tmpfree( dp->dn.bv_val, op->o_tmpmemctx );
 			op->o_tmpfree( dp, op->o_tmpmemctx );
 		}
+		rq->attrs = NULL;
 		op->o_tmpfree( op->ors_filterstr.bv_val, op->o_tmpmemctx );
+		if ( fbatch ) {
+			op->o_tmpfree( fbatch, op->o_tmpmemctx );
+			fbatch = NULL;
+		}
 		if ( rc == LDAP_BUSY ) {
 			pausing = 1;
-			/* re-queue this op */
+			/* re-queue this op, or the whole batch */
+			for ( rn = rq; rn->next; rn = rn->next ) ;
 			ldap_pvt_thread_mutex_lock( &id->qmutex );
-			rq->next = id->qhead;
+			rn->next = id->qhead;
 			id->qhead = rq;
 			if ( !id->qtail )
-				id->qtail = rq;
+				id->qtail = rn;
 			ldap_pvt_thread_mutex_unlock( &id->qmutex );
 			break;
 		}
 
-		if ( !BER_BVISNULL( &rq->newndn )) {
-			ch_free( rq->newndn.bv_val );
-			ch_free( rq->newdn.bv_val );
+		for ( ; rq; rq = rn ) {
+			rn = rq->next;
+			if ( !BER_BVISNULL( &rq->newndn )) {
+				ch_free( rq->newndn.bv_val );
+				ch_free( rq->newdn.bv_val );
+			}
+			ch_free( rq->oldndn.bv_val );
+			ch_free( rq->olddn.bv_val );
+			ch_free( rq );
 		}
-		ch_free( rq->oldndn.bv_val );
-		ch_free( rq->olddn.bv_val );
-		ch_free( rq );
 	}
 
 	/* free filter */
@@ -1030,6 +1178,9 @@ refint_preop(
 		refint_pre *rp = (refint_pre *)(sc+1);
 		rp->on = on;
 		rp->do_sub = 1;	/* assume there are children */
+		/* ask the underlying database, the overlay itself has no
+		 * hasSubordinates handler */
+		op->o_bd->bd_info = (BackendInfo *)on->on_info;
 		if ( op->o_bd->be_has_subordinates ) {
 			int has = 0;
 			rc = op->o_bd->be_has_subordinates( op, e, &has );
@@ -1037,6 +1188,7 @@ refint_preop(
 			if ( rc == LDAP_SUCCESS && has == LDAP_COMPARE_FALSE )
 				rp->do_sub = 0;
 		}
+		op->o_bd->bd_info = (BackendInfo *)on;
 		overlay_entry_release_ov( op, e, 0, on );
 		sc->sc_response = refint_response;
 		sc->sc_private = rp;
@@ -106,6 +106,7 @@ typedef struct sssvlv_info
 typedef struct sort_op
 {
 	TAvlnode *so_tree;
+	sort_node **so_list;	/* VLV: so_tree flattened in sort order */
 	sort_ctrl *so_ctrl;
 	sssvlv_info *so_info;
 	int so_paged;
@@ -161,12 +162,33 @@ static struct berval* select_value(
 	return ber1;
 }
 
+/* Compare two values of one sort key; missing values sort last */
+static int key_cmp( sort_key *sk, struct berval *bv1, struct berval *bv2 )
+{
+	MatchingRule *mr;
+	int cmp;
+
+	if ( BER_BVISNULL( bv1 )) {
+		if ( BER_BVISNULL( bv2 ))
+			cmp = 0;
+		else
+			cmp = sk->sk_direction;
+	} else if ( BER_BVISNULL( bv2 )) {
+		cmp = sk->sk_direction * -1;
+	} else {
+		mr = sk->sk_ordering;
+		mr->smr_match( &cmp, 0, mr->smr_syntax, mr, bv1, bv2 );
+		if ( cmp )
+			cmp *= sk->sk_direction;
+	}
+	return cmp;
+}
+
 static int node_cmp( const void* val1, const void* val2 )
 {
 	sort_node *sn1 = (sort_node *)val1;
 	sort_node *sn2 = (sort_node *)val2;
 	sort_ctrl *sc;
-	MatchingRule *mr;
 	int i, cmp = 0;
 	assert( sort_conns[sn1->sn_conn]
 		&& sort_conns[sn1->sn_conn][sn1->sn_session]
@@ -174,20 +196,7 @@ static int node_cmp( const void* val1, const void* val2 )
 	sc = sort_conns[sn1->sn_conn][sn1->sn_session]->so_ctrl;
 
 	for ( i=0; cmp == 0 && i<sc->sc_nkeys; i++ ) {
-		if ( BER_BVISNULL( &sn1->sn_vals[i] )) {
-			if ( BER_BVISNULL( &sn2->sn_vals[i] ))
-				cmp = 0;
-			else
-				cmp = sc->sc_keys[i].sk_direction;
-		} else if ( BER_BVISNULL( &sn2->sn_vals[i] )) {
-			cmp = sc->sc_keys[i].sk_direction * -1;
-		} else {
-			mr = sc->sc_keys[i].sk_ordering;
-			mr->smr_match( &cmp, 0, mr->smr_syntax, mr,
-				&sn1->sn_vals[i], &sn2->sn_vals[i] );
-			if ( cmp )
-				cmp *= sc->sc_keys[i].sk_direction;
-		}
+		cmp = key_cmp( &sc->sc_keys[i], &sn1->sn_vals[i], &sn2->sn_vals[i] );
 	}
 	return cmp;
 }
@@ -370,7 +379,8 @@ static int find_session_by_context(
 	for(sess_id = 0; sess_id < svi_max_percon; sess_id++) {
 		if( sort_conns[conn_id] && sort_conns[conn_id][sess_id] &&
 		    ( sort_conns[conn_id][sess_id]->so_vcontext == vc_context || 
-                      (PagedResultsCookie) sort_conns[conn_id][sess_id]->so_tree == ps_cookie ) )
+                      ( sort_conns[conn_id][sess_id]->so_paged > SLAP_CONTROL_IGNORED &&
+                      (PagedResultsCookie) sort_conns[conn_id][sess_id]->so_tree == ps_cookie ) ) )
 			return sess_id;
 	}
 	return -1;
@@ -423,6 +433,13 @@ static void free_sort_op( Connection *conn, sort_op *so )
 		    }
 		    so->so_tree = NULL;
 	    }
+	    if ( so->so_list ) {
+		    int i;
+		    for ( i = 0; i < so->so_nentries; i++ )
+			    ch_free( so->so_list[i] );
+		    ch_free( so->so_list );
+		    so->so_list = NULL;
+	    }
 
 	    ch_free( so );
 	}
@@ -442,37 +459,52 @@ static void free_sort_ops( Connection *conn, sort_op **sos, int svi_max_percon )
 	}
 }
 	
+/* Move the sorted nodes of so_tree into a flat array, so that VLV
+ * requests on the same context can position themselves directly
+ * instead of walking the tree.
+ */
+static void flatten_tree( sort_op *so )
+{
+	TAvlnode *cur_node, *next_node;
+	int i;
+
+	so->so_list = ch_malloc( so->so_nentries * sizeof(sort_node *) );
+	cur_node = tavl_end( so->so_tree, TAVL_DIR_LEFT );
+	for ( i = 0; cur_node; i++ ) {
+		next_node = tavl_next( cur_node, TAVL_DIR_RIGHT );
+		so->so_list[i] = cur_node->avl_data;
+		ber_memfree( cur_node );
+		cur_node = next_node;
+	}
+	so->so_tree = NULL;
+}
+
 static void send_list(
 	Operation		*op,
 	SlapReply		*rs,
 	sort_op			*so)
 {
-	TAvlnode *cur_node, *tmp_node;
 	vlv_ctrl *vc = op->o_controls[vlv_cid];
-	int i, j, dir, rc;
+	int i, j, cur, rc;
 	BackendDB *be;
 	Entry *e;
 	LDAPControl *ctrls[2];
 
 	rs->sr_attrs = op->ors_attrs;
 
-	/* FIXME: it may be better to just flatten the tree into
-	 * an array before doing all of this...
-	 */
+	if ( !so->so_list )
+		flatten_tree( so );
 
 	/* Are we just counting an offset? */
 	if ( BER_BVISNULL( &vc->vc_value )) {
 		if ( vc->vc_offset == vc->vc_count ) {
 			/* wants the last entry in the list */
-			cur_node = tavl_end(so->so_tree, TAVL_DIR_RIGHT);
 			so->so_vlv_target = so->so_nentries;
 		} else if ( vc->vc_offset == 1 ) {
 			/* wants the first entry in the list */
-			cur_node = tavl_end(so->so_tree, TAVL_DIR_LEFT);
 			so->so_vlv_target = 1;
 		} else {
 			int target;
-			/* Just iterate to the right spot */
 			if ( vc->vc_count && vc->vc_count != so->so_nentries ) {
 				if ( vc->vc_offset > vc->vc_count )
 					goto range_err;
@@ -490,24 +522,14 @@ range_err:
 				target = vc->vc_offset;
 			}
 			so->so_vlv_target = target;
-			/* Start at left and go right, or start at right and go left? */
-			if ( target < so->so_nentries / 2 ) {
-				cur_node = tavl_end(so->so_tree, TAVL_DIR_LEFT);
-				dir = TAVL_DIR_RIGHT;
-			} else {
-				cur_node = tavl_end(so->so_tree, TAVL_DIR_RIGHT);
-				dir = TAVL_DIR_LEFT;
-				target = so->so_nentries - target + 1;
-			}
-			for ( i=1; i<target; i++ )
-				cur_node = tavl_next( cur_node, dir );
 		}
+		cur = so->so_vlv_target > 0 ? so->so_vlv_target - 1 : 0;
 	} else {
 	/* we're looking for a specific value */
-		sort_ctrl *sc = so->so_ctrl;
-		MatchingRule *mr = sc->sc_keys[0].sk_ordering;
-		sort_node *sn;
+		sort_key *sk = &so->so_ctrl->sc_keys[0];
+		MatchingRule *mr = sk->sk_ordering;
 		struct berval bv;
+		int lo, hi, mid;
 
 		if ( mr->smr_normalize ) {
 			rc = mr->smr_normalize( SLAP_MR_VALUE_OF_SYNTAX,
@@ -524,58 +546,34 @@ range_err:
 			bv = vc->vc_value;
 		}
 
-		sn = op->o_tmpalloc( sizeof(sort_node) +
-			sc->sc_nkeys * sizeof(struct berval), op->o_tmpmemctx );
-		sn->sn_vals = (struct berval *)(sn+1);
-		sn->sn_conn = op->o_conn->c_conn_idx;
-		sn->sn_session = find_session_by_so( so->so_info->svi_max_percon, op->o_conn->c_conn_idx, so );
-		sn->sn_vals[0] = bv;
-		for (i=1; i<sc->sc_nkeys; i++) {
-			BER_BVZERO( &sn->sn_vals[i] );
-		}
-		cur_node = tavl_find3( so->so_tree, sn, node_cmp, &j );
-		/* didn't find >= match */
-		if ( j > 0 ) {
-			if ( cur_node )
-				cur_node = tavl_next( cur_node, TAVL_DIR_RIGHT );
+		/* find the first entry whose first key is >= the value */
+		lo = 0;
+		hi = so->so_nentries;
+		while ( lo < hi ) {
+			mid = lo + ( hi - lo ) / 2;
+			if ( key_cmp( sk, &so->so_list[mid]->sn_vals[0], &bv ) < 0 )
+				lo = mid + 1;
+			else
+				hi = mid;
 		}
-		op->o_tmpfree( sn, op->o_tmpmemctx );
+		cur = lo;
+		so->so_vlv_target = cur + 1;
 
-		if ( !cur_node ) {
-			so->so_vlv_target = so->so_nentries + 1;
-		} else {
-			sort_node *sn = so->so_tree->avl_data;
-			/* start from the left or the right side? */
-			mr->smr_match( &i, 0, mr->smr_syntax, mr, &bv, &sn->sn_vals[0] );
-			if ( i > 0 ) {
-				tmp_node = tavl_end(so->so_tree, TAVL_DIR_RIGHT);
-				dir = TAVL_DIR_LEFT;
-			} else {
-				tmp_node = tavl_end(so->so_tree, TAVL_DIR_LEFT);
-				dir = TAVL_DIR_RIGHT;
-			}
-			for (i=0; tmp_node != cur_node;
-				tmp_node = tavl_next( tmp_node, dir ), i++);
-			so->so_vlv_target = (dir == TAVL_DIR_RIGHT) ? i+1 : so->so_nentries - i;
-		}
 		if ( bv.bv_val != vc->vc_value.bv_val )
 			op->o_tmpfree( bv.bv_val, op->o_tmpmemctx );
 	}
-	if ( !cur_node ) {
+	if ( cur >= so->so_nentries ) {
 		i = 1;
-		cur_node = tavl_end(so->so_tree, TAVL_DIR_RIGHT);
+		cur = so->so_nentries - 1;
 	} else {
 		i = 0;
 	}
-	for ( ; i<vc->vc_before; i++ ) {
-		tmp_node = tavl_next( cur_node, TAVL_DIR_LEFT );
-		if ( !tmp_node ) break;
-		cur_node = tmp_node;
-	}
+	for ( ; i<vc->vc_before && cur > 0; i++ )
+		cur--;
 	j = i + vc->vc_after + 1;
 	be = op->o_bd;
-	for ( i=0; i<j; i++ ) {
-		sort_node *sn = cur_node->avl_data;
+	for ( i=0; i<j && cur < so->so_nentries; i++, cur++ ) {
+		sort_node *sn = so->so_list[cur];
 
 		if ( slapd_shutdown ) break;
 
@@ -590,8 +588,6 @@ range_err:
 			if ( rs->sr_err == LDAP_UNAVAILABLE )
 				break;
 		}
-		cur_node = tavl_next( cur_node, TAVL_DIR_RIGHT );
-		if ( !cur_node ) break;
 	}
 	so->so_vlv_rc = LDAP_SUCCESS;
 
@@ -707,7 +703,7 @@ static void send_result(
 		slap_add_ctrls( op, rs, ctrls );
 	send_ldap_result( op, rs );
 
-	if ( so->so_tree == NULL ) {
+	if ( so->so_tree == NULL && so->so_list == NULL ) {
 		/* Search finished, so clean up */
 		free_sort_op( op->o_conn, so );
 	} else {
@@ -27,11 +27,14 @@
 #include "slap.h"
 #include "config.h"
 #include "ldap_rq.h"
+#include "../back-monitor/back-monitor.h"
 
 #ifdef LDAP_DEVEL
 #define	CHECK_CSN	1
 #endif
 
+static slap_overinst 		syncprov;
+
 /* A modify request on a particular entry */
 typedef struct modinst {
 	struct modinst *mi_next;
@@ -89,6 +92,11 @@ typedef struct syncops {
 	int		s_inuse;	/* reference count */
 	struct syncres *s_res;
 	struct syncres *s_restail;
+	int		s_qlen;		/* responses in s_res */
+	unsigned long	s_nsent;	/* responses played back */
+	unsigned long	s_winSent;	/* ...in the current window */
+	unsigned long	s_rate;		/* responses/sec in the last window */
+	time_t		s_winStart;
 	void *s_pool_cookie;
 	ldap_pvt_thread_mutex_t	s_mutex;
 } syncops;
@@ -118,23 +126,26 @@ typedef struct syncmatches {
 
 /* Session log data */
 typedef struct slog_entry {
-	struct slog_entry *se_next;
 	struct berval se_uuid;
 	struct berval se_csn;
 	int	se_sid;
 	ber_tag_t	se_tag;
 } slog_entry;
 
+/* The log entries live in a tree ordered by CSN, so out of order CSNs
+ * from other providers are inserted, the oldest entry trimmed, and a
+ * consumer's starting point found without walking the whole log.
+ */
 typedef struct sessionlog {
 	BerVarray	sl_mincsn;
 	int		*sl_sids;
 	int		sl_numcsns;
 	int		sl_num;
 	int		sl_size;
-	int		sl_playing;
-	slog_entry *sl_head;
-	slog_entry *sl_tail;
-	ldap_pvt_thread_mutex_t sl_mutex;
+	int		*sl_logsids;	/* every SID ever logged */
+	int		sl_numlogsids;
+	TAvlnode	*sl_entries;
+	ldap_pvt_thread_rdwr_t sl_mutex;
 } sessionlog;
 
 /* The main state for this overlay */
@@ -153,19 +164,24 @@ typedef struct syncprov_info_t {
 	int		si_dirty;	/* True if the context is dirty, i.e changes
 						 * have been made without updating the csn. */
 	time_t	si_chklast;	/* time of last checkpoint */
+	struct re_s	*si_chktask;	/* writes deferred checkpoints */
+	int		si_chkpend;	/* a checkpoint is waiting for it */
+	BackendDB	*si_be;
 	Avlnode	*si_mods;	/* entries being modified */
 	sessionlog	*si_logs;
+	struct berval	si_logbase;	/* accesslog to refill si_logs from */
 	ldap_pvt_thread_rdwr_t	si_csn_rwlock;
 	ldap_pvt_thread_mutex_t	si_ops_mutex;
 	ldap_pvt_thread_mutex_t	si_mods_mutex;
 	ldap_pvt_thread_mutex_t	si_resp_mutex;
+	void		*si_monitor_cb;
+	struct berval	si_monitor_ndn;
 } syncprov_info_t;
 
 typedef struct opcookie {
 	slap_overinst *son;
 	syncmatches *smatches;
 	modtarget *smt;
-	Entry *se;
 	struct berval sdn;	/* DN of entry, for deletes */
 	struct berval sndn;
 	struct berval suuid;	/* UUID of entry */
@@ -920,6 +936,23 @@ syncprov_sendresp( Operation *op, resinfo *ri, syncops *so, int mode )
 static void
 syncprov_qstart( syncops *so );
 
+#define SYNCPROV_STATS_WINDOW	10	/* seconds */
+
+/* Count a response played back; only the playing task updates these */
+static void
+syncprov_sent( syncops *so )
+{
+	time_t now = slap_get_time();
+
+	so->s_nsent++;
+	if ( now - so->s_winStart >= SYNCPROV_STATS_WINDOW ) {
+		so->s_rate = so->s_winSent / ( now - so->s_winStart );
+		so->s_winStart = now;
+		so->s_winSent = 0;
+	}
+	so->s_winSent++;
+}
+
 /* Play back queued responses */
 static int
 syncprov_qplay( Operation *op, syncops *so )
@@ -936,6 +969,7 @@ syncprov_qplay( Operation *op, syncops *so )
 		so->s_res = sr->s_next;
 		if ( !so->s_res )
 			so->s_restail = NULL;
+		so->s_qlen--;
 		ldap_pvt_thread_mutex_unlock( &so->s_mutex );
 
 		if ( !so->s_op->o_abandon ) {
@@ -948,6 +982,7 @@ syncprov_qplay( Operation *op, syncops *so )
 			} else {
 				rc = syncprov_sendresp( op, sr->s_info, so, sr->s_mode );
 			}
+			syncprov_sent( so );
 		}
 
 		free_resinfo( sr );
@@ -1031,9 +1066,12 @@ syncprov_qstart( syncops *so )
 		syncprov_qtask, so, &so->s_pool_cookie );
 }
 
-/* Queue a persistent search response */
+/* Queue a persistent search response. All the psearches a write goes
+ * to share one resinfo; e is the written entry, if still at hand, and
+ * is copied into it once, when the first add or modify is queued.
+ */
 static int
-syncprov_qresp( opcookie *opc, syncops *so, int mode )
+syncprov_qresp( opcookie *opc, syncops *so, int mode, Entry *e )
 {
 	syncres *sr;
 	resinfo *ri;
@@ -1044,62 +1082,58 @@ syncprov_qresp( opcookie *opc, syncops *so, int mode )
 	sr->s_next = NULL;
 	sr->s_mode = mode;
 	if ( !opc->ssres.s_info ) {
+		struct berval dn = opc->sdn, ndn = opc->sndn, uuid = opc->suuid;
 
-		srsize = sizeof( resinfo );
-		if ( csn.bv_len )
-			srsize += csn.bv_len + 1;
-
-		if ( opc->se ) {
+		if ( e ) {
 			Attribute *a;
-			ri = ch_malloc( srsize );
-			ri->ri_dn = opc->se->e_name;
-			ri->ri_ndn = opc->se->e_nname;
-			a = attr_find( opc->se->e_attrs, slap_schema.si_ad_entryUUID );
+			dn = e->e_name;
+			ndn = e->e_nname;
+			a = attr_find( e->e_attrs, slap_schema.si_ad_entryUUID );
 			if ( a )
-				ri->ri_uuid = a->a_nvals[0];
+				uuid = a->a_nvals[0];
 			else
-				ri->ri_uuid.bv_len = 0;
-			if ( csn.bv_len ) {
-				ri->ri_csn.bv_val = (char *)(ri + 1);
-				ri->ri_csn.bv_len = csn.bv_len;
-				memcpy( ri->ri_csn.bv_val, csn.bv_val, csn.bv_len );
-				ri->ri_csn.bv_val[csn.bv_len] = '\0';
-			} else {
-				ri->ri_csn.bv_val = NULL;
-			}
+				BER_BVZERO( &uuid );
+		}
+		srsize = sizeof( resinfo ) + uuid.bv_len +
+			dn.bv_len + 1 + ndn.bv_len + 1;
+		if ( csn.bv_len )
+			srsize += csn.bv_len + 1;
+
+		ri = ch_malloc( srsize );
+		ri->ri_dn.bv_val = (char *)(ri + 1);
+		ri->ri_dn.bv_len = dn.bv_len;
+		ri->ri_ndn.bv_val = lutil_strncopy( ri->ri_dn.bv_val,
+			dn.bv_val, dn.bv_len ) + 1;
+		ri->ri_dn.bv_val[dn.bv_len] = '\0';
+		ri->ri_ndn.bv_len = ndn.bv_len;
+		ri->ri_uuid.bv_val = lutil_strncopy( ri->ri_ndn.bv_val,
+			ndn.bv_val, ndn.bv_len ) + 1;
+		ri->ri_ndn.bv_val[ndn.bv_len] = '\0';
+		ri->ri_uuid.bv_len = uuid.bv_len;
+		AC_MEMCPY( ri->ri_uuid.bv_val, uuid.bv_val, uuid.bv_len );
+		if ( csn.bv_len ) {
+			ri->ri_csn.bv_val = ri->ri_uuid.bv_val + ri->ri_uuid.bv_len;
+			memcpy( ri->ri_csn.bv_val, csn.bv_val, csn.bv_len );
+			ri->ri_csn.bv_val[csn.bv_len] = '\0';
 		} else {
-			srsize += opc->suuid.bv_len +
-				opc->sdn.bv_len + 1 + opc->sndn.bv_len + 1;
-			ri = ch_malloc( srsize );
-			ri->ri_dn.bv_val = (char *)(ri + 1);
-			ri->ri_dn.bv_len = opc->sdn.bv_len;
-			ri->ri_ndn.bv_val = lutil_strcopy( ri->ri_dn.bv_val,
-				opc->sdn.bv_val ) + 1;
-			ri->ri_ndn.bv_len = opc->sndn.bv_len;
-			ri->ri_uuid.bv_val = lutil_strcopy( ri->ri_ndn.bv_val,
-				opc->sndn.bv_val ) + 1;
-			ri->ri_uuid.bv_len = opc->suuid.bv_len;
-			AC_MEMCPY( ri->ri_uuid.bv_val, opc->suuid.bv_val, opc->suuid.bv_len );
-			if ( csn.bv_len ) {
-				ri->ri_csn.bv_val = ri->ri_uuid.bv_val + ri->ri_uuid.bv_len;
-				memcpy( ri->ri_csn.bv_val, csn.bv_val, csn.bv_len );
-				ri->ri_csn.bv_val[csn.bv_len] = '\0';
-			} else {
-				ri->ri_csn.bv_val = NULL;
-			}
+			ri->ri_csn.bv_val = NULL;
 		}
 		ri->ri_list = &opc->ssres;
-		ri->ri_e = opc->se;
+		ri->ri_e = NULL;
 		ri->ri_csn.bv_len = csn.bv_len;
 		ri->ri_isref = opc->sreference;
 		BER_BVZERO( &ri->ri_cookie );
 		ldap_pvt_thread_mutex_init( &ri->ri_mutex );
-		opc->se = NULL;
 		opc->ssres.s_info = ri;
 	}
 	ri = opc->ssres.s_info;
 	sr->s_info = ri;
 	ldap_pvt_thread_mutex_lock( &ri->ri_mutex );
+	if ( !ri->ri_e && ( mode == LDAP_SYNC_ADD || mode == LDAP_SYNC_MODIFY )) {
+		/* read-only from here on, so a single block will do */
+		assert( e != NULL );
+		ri->ri_e = entry_dup_bv( e );
+	}
 	sr->s_rilist = ri->ri_list;
 	ri->ri_list = sr;
 	if ( mode == LDAP_SYNC_NEW_COOKIE && BER_BVISNULL( &ri->ri_cookie )) {
@@ -1117,6 +1151,7 @@ syncprov_qresp( opcookie *opc, syncops *so, int mode )
 		so->s_restail->s_next = sr;
 	}
 	so->s_restail = sr;
+	so->s_qlen++;
 
 	/* If the base of the psearch was modified, check it next time round */
 	if ( so->s_flags & PS_WROTE_BASE ) {
@@ -1195,6 +1230,53 @@ syncprov_op_abandon( Operation *op, SlapReply *rs )
 }
 
 /* Find which persistent searches are affected by this operation */
+/* Tell whether an equality component that every match of filter f
+ * must satisfy is plainly absent from e. Unlike test_filter() this
+ * needs no access checks, so most persistent searches that cannot
+ * match a write are dismissed without evaluating their filter.
+ */
+static int
+syncprov_filter_excludes( Filter *f, Entry *e )
+{
+	Filter *fs = f;
+	AttributeAssertion *ava;
+	Attribute *a;
+
+	if ( f->f_choice == LDAP_FILTER_AND )
+		fs = f->f_and;
+	for ( ; fs; fs = fs->f_next ) {
+		if ( fs->f_choice != LDAP_FILTER_EQUALITY )
+			goto next;
+		ava = fs->f_ava;
+#ifdef LDAP_COMP_MATCH
+		if ( ava->aa_cf )
+			goto next;
+#endif
+		if ( ava->aa_desc == slap_schema.si_ad_objectClass ||
+			ava->aa_desc == slap_schema.si_ad_entryDN ||
+			ava->aa_desc == slap_schema.si_ad_hasSubordinates ||
+			!ava->aa_desc->ad_type->sat_equality )
+			goto next;
+
+		for ( a = attrs_find( e->e_attrs, ava->aa_desc ); a;
+			a = attrs_find( a->a_next, ava->aa_desc ))
+		{
+			if ( !a->a_desc->ad_type->sat_equality ||
+				attr_valfind( a, SLAP_MR_EQUALITY |
+					SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH |
+					SLAP_MR_ATTRIBUTE_VALUE_NORMALIZED_MATCH,
+					&ava->aa_value, NULL, NULL ) != LDAP_NO_SUCH_ATTRIBUTE )
+				break;
+		}
+		if ( !a )
+			return 1;
+next:
+		if ( f->f_choice != LDAP_FILTER_AND )
+			break;
+	}
+	return 0;
+}
+
 static void
 syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 {
@@ -1225,25 +1307,16 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 			db = *op->o_bd;
 			op->o_bd = &db;
 		}
+		/* Kept until all psearches are checked; syncprov_qresp() only
+		 * copies it if one of them is sent the entry.
+		 */
 		rc = overlay_entry_get_ov( op, fc.fdn, NULL, NULL, 0, &e, on );
-		/* If we're sending responses now, make a copy and unlock the DB */
-		if ( e && !saveit ) {
-			if ( !opc->se )
-				opc->se = entry_dup( e );
-			overlay_entry_release_ov( op, e, 0, on );
-			e = opc->se;
-		}
 		if ( rc ) {
 			op->o_bd = b0;
 			return;
 		}
 	} else {
 		e = op->ora_e;
-		if ( !saveit ) {
-			if ( !opc->se )
-				opc->se = entry_dup( e );
-			e = opc->se;
-		}
 	}
 
 	if ( saveit || op->o_tag == LDAP_REQ_ADD ) {
@@ -1343,7 +1416,10 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 				   phase otherwise (ITS#6555) */
 				op2.ors_filter = ss->s_op->ors_filter->f_and->f_next;
 			}
-			rc = test_filter( &op2, e, op2.ors_filter );
+			if ( syncprov_filter_excludes( op2.ors_filter, e ))
+				rc = LDAP_COMPARE_FALSE;
+			else
+				rc = test_filter( &op2, e, op2.ors_filter );
 			ldap_pvt_thread_mutex_unlock( &ss->s_mutex );
 		}
 
@@ -1363,13 +1439,13 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 			} else {
 				/* if found send UPDATE else send ADD */
 				syncprov_qresp( opc, ss,
-					found ? LDAP_SYNC_MODIFY : LDAP_SYNC_ADD );
+					found ? LDAP_SYNC_MODIFY : LDAP_SYNC_ADD, e );
 			}
 		} else if ( !saveit && found ) {
 			/* send DELETE */
-			syncprov_qresp( opc, ss, LDAP_SYNC_DELETE );
+			syncprov_qresp( opc, ss, LDAP_SYNC_DELETE, e );
 		} else if ( !saveit ) {
-			syncprov_qresp( opc, ss, LDAP_SYNC_NEW_COOKIE );
+			syncprov_qresp( opc, ss, LDAP_SYNC_NEW_COOKIE, e );
 		}
 		if ( !saveit && found ) {
 			/* Decrement s_inuse, was incremented when called
@@ -1388,16 +1464,11 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 		if ( !SLAP_ISOVERLAY( op->o_bd )) {
 			op->o_bd = &db;
 		}
-		if ( saveit )
-			overlay_entry_release_ov( op, e, 0, on );
+		overlay_entry_release_ov( op, e, 0, on );
 		op->o_bd = b0;
 	}
-	if ( !saveit ) {
-		if ( opc->ssres.s_info )
-			free_resinfo( &opc->ssres );
-		else if ( opc->se )
-			entry_free( opc->se );
-	}
+	if ( !saveit && opc->ssres.s_info )
+		free_resinfo( &opc->ssres );
 	if ( freefdn ) {
 		op->o_tmpfree( fc.fdn->bv_val, op->o_tmpmemctx );
 	}
@@ -1464,7 +1535,8 @@ syncprov_op_cleanup( Operation *op, SlapReply *rs )
 }
 
 static void
-syncprov_checkpoint( Operation *op, slap_overinst *on )
+syncprov_checkpoint_write( Operation *op, slap_overinst *on,
+	BerVarray csns, int numcsns )
 {
 	syncprov_info_t *si = (syncprov_info_t *)on->on_bi.bi_private;
 	Modifications mod;
@@ -1478,12 +1550,12 @@ syncprov_checkpoint( Operation *op, slap_overinst *on )
 	Syntax *syn = slap_schema.si_ad_contextCSN->ad_type->sat_syntax;
 
 	int i;
-	for ( i=0; i<si->si_numcsns; i++ ) {
-		assert( !syn->ssyn_validate( syn, si->si_ctxcsn+i ));
+	for ( i=0; i<numcsns; i++ ) {
+		assert( !syn->ssyn_validate( syn, csns+i ));
 	}
 #endif
-	mod.sml_numvals = si->si_numcsns;
-	mod.sml_values = si->si_ctxcsn;
+	mod.sml_numvals = numcsns;
+	mod.sml_values = csns;
 	mod.sml_nvalues = NULL;
 	mod.sml_desc = slap_schema.si_ad_contextCSN;
 	mod.sml_op = LDAP_MOD_REPLACE;
@@ -1529,12 +1601,171 @@ syncprov_checkpoint( Operation *op, slap_overinst *on )
 		slap_mods_free( mod.sml_next, 1 );
 	}
 #ifdef CHECK_CSN
-	for ( i=0; i<si->si_numcsns; i++ ) {
-		assert( !syn->ssyn_validate( syn, si->si_ctxcsn+i ));
+	for ( i=0; i<numcsns; i++ ) {
+		assert( !syn->ssyn_validate( syn, csns+i ));
 	}
 #endif
 }
 
+/* Caller holds si_csn_rwlock */
+static void
+syncprov_checkpoint( Operation *op, slap_overinst *on )
+{
+	syncprov_info_t *si = (syncprov_info_t *)on->on_bi.bi_private;
+
+	syncprov_checkpoint_write( op, on, si->si_ctxcsn, si->si_numcsns );
+}
+
+/* Write checkpoints in the background, so the write that crossed the
+ * threshold doesn't wait for the internal modify. Checkpoints asked for
+ * while one is waiting or being written are folded into the next.
+ * The modify runs on a copy of the contextCSN without si_csn_rwlock:
+ * it may have to wait for a syncrepl refresh txn, whose own writes
+ * need that lock to get through syncprov_op_response.
+ */
+static void *
+syncprov_checkpoint_task( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	slap_overinst *on = rtask->arg;
+	syncprov_info_t *si = on->on_bi.bi_private;
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+	BackendDB be;
+	BerVarray csns;
+	int numcsns;
+
+	connection_fake_init2( &conn, &opbuf, ctx, 0 );
+	op = &opbuf.ob_op;
+	be = *si->si_be;
+	op->o_bd = &be;
+	op->o_dn = be.be_rootdn;
+	op->o_ndn = be.be_rootndn;
+
+	for (;;) {
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+		if ( !si->si_chkpend ) {
+			ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+			ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+			break;
+		}
+		si->si_chkpend = 0;
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+		ldap_pvt_thread_rdwr_rlock( &si->si_csn_rwlock );
+		numcsns = si->si_numcsns;
+		ber_bvarray_dup_x( &csns, si->si_ctxcsn, op->o_tmpmemctx );
+		ldap_pvt_thread_rdwr_runlock( &si->si_csn_rwlock );
+
+		syncprov_checkpoint_write( op, on, csns, numcsns );
+		ber_bvarray_free_x( csns, op->o_tmpmemctx );
+	}
+	return NULL;
+}
+
+static void
+syncprov_checkpoint_defer( slap_overinst *on )
+{
+	syncprov_info_t *si = on->on_bi.bi_private;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	si->si_chkpend = 1;
+	if ( !si->si_chktask ) {
+		/* runs right away; the interval keeps it from coming back */
+		si->si_chktask = ldap_pvt_runqueue_insert( &slapd_rq, 36000,
+			syncprov_checkpoint_task, on, "syncprov_checkpoint",
+			si->si_be->be_suffix[0].bv_val );
+		slap_wake_listener();
+	} else if ( !ldap_pvt_runqueue_isrunning( &slapd_rq, si->si_chktask )) {
+		time_t interval = si->si_chktask->interval.tv_sec;
+
+		si->si_chktask->interval.tv_sec = 0;
+		ldap_pvt_runqueue_resched( &slapd_rq, si->si_chktask, 0 );
+		si->si_chktask->interval.tv_sec = interval;
+		slap_wake_listener();
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
+static int
+syncprov_sessionlog_cmp( const void *l, const void *r )
+{
+	const slog_entry *left = l, *right = r;
+	int ret = ber_bvcmp( &left->se_csn, &right->se_csn );
+	if ( !ret )
+		ret = ber_bvcmp( &left->se_uuid, &right->se_uuid );
+	return ret;
+}
+
+/* Insert a record into the session log, trimming it back to size */
+static void
+syncprov_slog_insert( sessionlog *sl, ber_tag_t tag, struct berval *uuid,
+	struct berval *csn )
+{
+	slog_entry *se;
+	int i;
+
+	/* Allocate a record. UUIDs are not NUL-terminated. */
+	se = ch_malloc( sizeof( slog_entry ) + uuid->bv_len + csn->bv_len + 1 );
+	se->se_tag = tag;
+
+	se->se_uuid.bv_val = (char *)(&se[1]);
+	AC_MEMCPY( se->se_uuid.bv_val, uuid->bv_val, uuid->bv_len );
+	se->se_uuid.bv_len = uuid->bv_len;
+
+	se->se_csn.bv_val = se->se_uuid.bv_val + uuid->bv_len;
+	AC_MEMCPY( se->se_csn.bv_val, csn->bv_val, csn->bv_len );
+	se->se_csn.bv_val[csn->bv_len] = '\0';
+	se->se_csn.bv_len = csn->bv_len;
+	se->se_sid = slap_parse_csn_sid( &se->se_csn );
+
+	ldap_pvt_thread_rdwr_wlock( &sl->sl_mutex );
+	if ( !sl->sl_entries ) {
+		if ( !sl->sl_mincsn ) {
+			sl->sl_numcsns = 1;
+			sl->sl_mincsn = ch_malloc( 2*sizeof( struct berval ));
+			sl->sl_sids = ch_malloc( sizeof( int ));
+			sl->sl_sids[0] = se->se_sid;
+			ber_dupbv( sl->sl_mincsn, &se->se_csn );
+			BER_BVZERO( &sl->sl_mincsn[1] );
+		}
+	}
+	if ( tavl_insert( &sl->sl_entries, se, syncprov_sessionlog_cmp,
+		avl_dup_error )) {
+		/* already logged */
+		ldap_pvt_thread_rdwr_wunlock( &sl->sl_mutex );
+		ch_free( se );
+		return;
+	}
+	for ( i=0; i<sl->sl_numlogsids; i++ )
+		if ( sl->sl_logsids[i] == se->se_sid )
+			break;
+	if ( i == sl->sl_numlogsids ) {
+		sl->sl_logsids = ch_realloc( sl->sl_logsids,
+			( i + 1 ) * sizeof( int ));
+		sl->sl_logsids[i] = se->se_sid;
+		sl->sl_numlogsids++;
+	}
+	sl->sl_num++;
+	while ( sl->sl_num > sl->sl_size ) {
+		se = tavl_end( sl->sl_entries, TAVL_DIR_LEFT )->avl_data;
+		tavl_delete( &sl->sl_entries, se, syncprov_sessionlog_cmp );
+		for ( i=0; i<sl->sl_numcsns; i++ )
+			if ( sl->sl_sids[i] >= se->se_sid )
+				break;
+		if  ( i == sl->sl_numcsns || sl->sl_sids[i] != se->se_sid ) {
+			slap_insert_csn_sids( (struct sync_cookie *)sl,
+				i, se->se_sid, &se->se_csn );
+		} else {
+			ber_bvreplace( &sl->sl_mincsn[i], &se->se_csn );
+		}
+		ch_free( se );
+		sl->sl_num--;
+	}
+	ldap_pvt_thread_rdwr_wunlock( &sl->sl_mutex );
+}
+
 static void
 syncprov_add_slog( Operation *op )
 {
@@ -1542,96 +1773,23 @@ syncprov_add_slog( Operation *op )
 	slap_overinst *on = opc->son;
 	syncprov_info_t		*si = on->on_bi.bi_private;
 	sessionlog *sl;
-	slog_entry *se;
 
 	sl = si->si_logs;
-	{
-		if ( BER_BVISEMPTY( &op->o_csn ) ) {
-			/* During the syncrepl refresh phase we can receive operations
-			 * without a csn.  We cannot reliably determine the consumers
-			 * state with respect to such operations, so we ignore them and
-			 * wipe out anything in the log if we see them.
-			 */
-			ldap_pvt_thread_mutex_lock( &sl->sl_mutex );
-			/* can only do this if no one else is reading the log at the moment */
-			if (!sl->sl_playing) {
-			while ( se = sl->sl_head ) {
-				sl->sl_head = se->se_next;
-				ch_free( se );
-			}
-			sl->sl_tail = NULL;
-			sl->sl_num = 0;
-			}
-			ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
-			return;
-		}
-
-		/* Allocate a record. UUIDs are not NUL-terminated. */
-		se = ch_malloc( sizeof( slog_entry ) + opc->suuid.bv_len +
-			op->o_csn.bv_len + 1 );
-		se->se_next = NULL;
-		se->se_tag = op->o_tag;
-
-		se->se_uuid.bv_val = (char *)(&se[1]);
-		AC_MEMCPY( se->se_uuid.bv_val, opc->suuid.bv_val, opc->suuid.bv_len );
-		se->se_uuid.bv_len = opc->suuid.bv_len;
-
-		se->se_csn.bv_val = se->se_uuid.bv_val + opc->suuid.bv_len;
-		AC_MEMCPY( se->se_csn.bv_val, op->o_csn.bv_val, op->o_csn.bv_len );
-		se->se_csn.bv_val[op->o_csn.bv_len] = '\0';
-		se->se_csn.bv_len = op->o_csn.bv_len;
-		se->se_sid = slap_parse_csn_sid( &se->se_csn );
-
-		ldap_pvt_thread_mutex_lock( &sl->sl_mutex );
-		if ( sl->sl_head ) {
-			/* Keep the list in csn order. */
-			if ( ber_bvcmp( &sl->sl_tail->se_csn, &se->se_csn ) <= 0 ) {
-				sl->sl_tail->se_next = se;
-				sl->sl_tail = se;
-			} else {
-				slog_entry **sep;
-
-				for ( sep = &sl->sl_head; *sep; sep = &(*sep)->se_next ) {
-					if ( ber_bvcmp( &se->se_csn, &(*sep)->se_csn ) < 0 ) {
-						se->se_next = *sep;
-						*sep = se;
-						break;
-					}
-				}
-			}
-		} else {
-			sl->sl_head = se;
-			sl->sl_tail = se;
-			if ( !sl->sl_mincsn ) {
-				sl->sl_numcsns = 1;
-				sl->sl_mincsn = ch_malloc( 2*sizeof( struct berval ));
-				sl->sl_sids = ch_malloc( sizeof( int ));
-				sl->sl_sids[0] = se->se_sid;
-				ber_dupbv( sl->sl_mincsn, &se->se_csn );
-				BER_BVZERO( &sl->sl_mincsn[1] );
-			}
-		}
-		sl->sl_num++;
-		if (!sl->sl_playing) {
-		while ( sl->sl_num > sl->sl_size ) {
-			int i;
-			se = sl->sl_head;
-			sl->sl_head = se->se_next;
-			for ( i=0; i<sl->sl_numcsns; i++ )
-				if ( sl->sl_sids[i] >= se->se_sid )
-					break;
-			if  ( i == sl->sl_numcsns || sl->sl_sids[i] != se->se_sid ) {
-				slap_insert_csn_sids( (struct sync_cookie *)sl,
-					i, se->se_sid, &se->se_csn );
-			} else {
-				ber_bvreplace( &sl->sl_mincsn[i], &se->se_csn );
-			}
-			ch_free( se );
-			sl->sl_num--;
-		}
-		}
-		ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
+	if ( BER_BVISEMPTY( &op->o_csn ) ) {
+		/* During the syncrepl refresh phase we can receive operations
+		 * without a csn.  We cannot reliably determine the consumers
+		 * state with respect to such operations, so we ignore them and
+		 * wipe out anything in the log if we see them.
+		 */
+		ldap_pvt_thread_rdwr_wlock( &sl->sl_mutex );
+		tavl_free( sl->sl_entries, ch_free );
+		sl->sl_entries = NULL;
+		sl->sl_num = 0;
+		ldap_pvt_thread_rdwr_wunlock( &sl->sl_mutex );
+		return;
 	}
+
+	syncprov_slog_insert( sl, op->o_tag, &opc->suuid, &op->o_csn );
 }
 
 /* Just set a flag if we found the matching entry */
@@ -1644,28 +1802,66 @@ playlog_cb( Operation *op, SlapReply *rs )
 	return rs->sr_err;
 }
 
-/* enter with sl->sl_mutex locked, release before returning */
+/* Order UUIDs of the playlog arrays; they are all UUID_LEN long,
+ * and clearing bv_len drops one without losing its value.
+ */
+static int
+syncprov_uuid_cmp( const void *l, const void *r )
+{
+	const struct berval *left = l, *right = r;
+	return memcmp( left->bv_val, right->bv_val, UUID_LEN );
+}
+
+/* enter with sl->sl_mutex read locked, release before returning */
 static void
 syncprov_playlog( Operation *op, SlapReply *rs, sessionlog *sl,
 	sync_control *srs, BerVarray ctxcsn, int numcsns, int *sids )
 {
 	slap_overinst		*on = (slap_overinst *)op->o_bd->bd_info;
 	slog_entry *se;
+	TAvlnode *entry;
 	int i, j, ndel, num, nmods, mmods;
 	char cbuf[LDAP_PVT_CSNSTR_BUFSIZE];
 	BerVarray uuids;
 	struct berval delcsn[2];
 
 	if ( !sl->sl_num ) {
-		ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
+		ldap_pvt_thread_rdwr_runlock( &sl->sl_mutex );
 		return;
 	}
 
+	/* Entries older than all the consumer's CSNs are of no interest,
+	 * unless their SID is unknown to the consumer; seek past them.
+	 */
+	entry = tavl_end( sl->sl_entries, TAVL_DIR_LEFT );
+	if ( srs->sr_state.numcsns ) {
+		slog_entry key;
+		int k, ret;
+
+		for ( i=0; i<sl->sl_numlogsids; i++ ) {
+			for ( k=0; k<srs->sr_state.numcsns; k++ )
+				if ( sl->sl_logsids[i] == srs->sr_state.sids[k] )
+					break;
+			if ( k == srs->sr_state.numcsns )
+				break;
+		}
+		if ( i == sl->sl_numlogsids ) {
+			key.se_csn = srs->sr_state.ctxcsn[0];
+			for ( k=1; k<srs->sr_state.numcsns; k++ )
+				if ( ber_bvcmp( &srs->sr_state.ctxcsn[k], &key.se_csn ) < 0 )
+					key.se_csn = srs->sr_state.ctxcsn[k];
+			/* sorts ahead of any entry with the same CSN */
+			BER_BVZERO( &key.se_uuid );
+			entry = tavl_find3( sl->sl_entries, &key,
+				syncprov_sessionlog_cmp, &ret );
+			if ( entry && ret > 0 )
+				entry = tavl_next( entry, TAVL_DIR_RIGHT );
+		}
+	}
+
 	num = sl->sl_num;
 	i = 0;
 	nmods = 0;
-	sl->sl_playing++;
-	ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
 
 	uuids = op->o_tmpalloc( (num+1) * sizeof( struct berval ) +
 		num * UUID_LEN, op->o_tmpmemctx );
@@ -1681,8 +1877,9 @@ syncprov_playlog( Operation *op, SlapReply *rs, sessionlog *sl,
 	 */
 	Debug( LDAP_DEBUG_SYNC, "srs csn %s\n",
 		srs->sr_state.ctxcsn[0].bv_val, 0, 0 );
-	for ( se=sl->sl_head; se; se=se->se_next ) {
+	for ( ; entry; entry = tavl_next( entry, TAVL_DIR_RIGHT )) {
 		int k;
+		se = entry->avl_data;
 		Debug( LDAP_DEBUG_SYNC, "log csn %s\n", se->se_csn.bv_val, 0, 0 );
 		ndel = 1;
 		for ( k=0; k<srs->sr_state.numcsns; k++ ) {
@@ -1722,9 +1919,7 @@ syncprov_playlog( Operation *op, SlapReply *rs, sessionlog *sl,
 		AC_MEMCPY(uuids[j].bv_val, se->se_uuid.bv_val, UUID_LEN);
 		uuids[j].bv_len = UUID_LEN;
 	}
-	ldap_pvt_thread_mutex_lock( &sl->sl_mutex );
-	sl->sl_playing--;
-	ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
+	ldap_pvt_thread_rdwr_runlock( &sl->sl_mutex );
 
 	ndel = i;
 
@@ -1736,22 +1931,20 @@ syncprov_playlog( Operation *op, SlapReply *rs, sessionlog *sl,
 	 */
 
 	mmods = nmods;
-	/* Strip any duplicates */
-	for ( i=0; i<nmods; i++ ) {
-		for ( j=0; j<ndel; j++ ) {
-			if ( bvmatch( &uuids[j], &uuids[num - 1 - i] )) {
-				uuids[num - 1 - i].bv_len = 0;
-				mmods --;
-				break;
-			}
-		}
-		if ( uuids[num - 1 - i].bv_len == 0 ) continue;
-		for ( j=0; j<i; j++ ) {
-			if ( bvmatch( &uuids[num - 1 - j], &uuids[num - 1 - i] )) {
-				uuids[num - 1 - i].bv_len = 0;
-				mmods --;
-				break;
-			}
+	/* Strip any duplicates: sort both sets, drop repeated mods and
+	 * mods of entries that are in the delete set.
+	 */
+	qsort( uuids, ndel, sizeof( struct berval ), syncprov_uuid_cmp );
+	qsort( &uuids[num - nmods], nmods, sizeof( struct berval ),
+		syncprov_uuid_cmp );
+	for ( i=num - nmods; i<num; i++ ) {
+		if (( i > num - nmods &&
+				!syncprov_uuid_cmp( &uuids[i-1], &uuids[i] )) ||
+			bsearch( &uuids[i], uuids, ndel, sizeof( struct berval ),
+				syncprov_uuid_cmp ))
+		{
+			uuids[i].bv_len = 0;
+			mmods --;
 		}
 	}
 
@@ -1864,7 +2057,7 @@ syncprov_new_ctxcsn( opcookie *opc, syncprov_info_t *si, int csn_changed, int nu
 			 * the originating server may be configured to store
 			 * their csn values in different entries.
 			 */
-			syncprov_qresp( opc, ss, LDAP_SYNC_NEW_COOKIE );
+			syncprov_qresp( opc, ss, LDAP_SYNC_NEW_COOKIE, NULL );
 		}
 		ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
 	}
@@ -1996,9 +2189,17 @@ syncprov_op_response( Operation *op, SlapReply *rs )
 
 added:
 		if ( do_check ) {
-			ldap_pvt_thread_rdwr_rlock( &si->si_csn_rwlock );
-			syncprov_checkpoint( op, on );
-			ldap_pvt_thread_rdwr_runlock( &si->si_csn_rwlock );
+			if ( LDAP_SLIST_EMPTY( &op->o_extra )) {
+				syncprov_checkpoint_defer( on );
+			} else {
+				/* The op may hold a backend txn (syncrepl refresh)
+				 * that a background modify would wait on; checkpoint
+				 * in it instead.
+				 */
+				ldap_pvt_thread_rdwr_rlock( &si->si_csn_rwlock );
+				syncprov_checkpoint( op, on );
+				ldap_pvt_thread_rdwr_runlock( &si->si_csn_rwlock );
+			}
 		}
 
 		/* only update consumer ctx if this is a newer csn */
@@ -2025,7 +2226,7 @@ added:
 				for ( sm = opc->smatches; sm; sm=sm->sm_next ) {
 					if ( sm->sm_op->s_op->o_abandon )
 						continue;
-					syncprov_qresp( opc, sm->sm_op, LDAP_SYNC_DELETE );
+					syncprov_qresp( opc, sm->sm_op, LDAP_SYNC_DELETE, NULL );
 				}
 				if ( opc->ssres.s_info )
 					free_resinfo( &opc->ssres );
@@ -2361,6 +2562,8 @@ syncprov_detach_op( Operation *op, syncops *so, slap_overinst *on )
 		g2->ga_next = op2->o_groups;
 		op2->o_groups = g2;
 	}
+	/* Gathered ACL sets live in the original op's memory */
+	op2->o_sets = NULL;
 	/* Don't allow any further group caching */
 	op2->o_do_not_cache = 1;
 
@@ -2743,7 +2946,7 @@ no_change:	if ( !(op->o_sync_mode & SLAP_SYNC_PERSIST) ) {
 		sl=si->si_logs;
 		if ( sl ) {
 			int do_play = 0;
-			ldap_pvt_thread_mutex_lock( &sl->sl_mutex );
+			ldap_pvt_thread_rdwr_rlock( &sl->sl_mutex );
 			/* Are there any log entries, and is the consumer state
 			 * present in the session log?
 			 */
@@ -2772,7 +2975,7 @@ no_change:	if ( !(op->o_sync_mode & SLAP_SYNC_PERSIST) ) {
 				/* mutex is unlocked in playlog */
 				syncprov_playlog( op, rs, sl, srs, ctxcsn, numcsns, sids );
 			} else {
-				ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
+				ldap_pvt_thread_rdwr_runlock( &sl->sl_mutex );
 			}
 		}
 		/* Is the CSN still present in the database? */
@@ -2942,6 +3145,7 @@ syncprov_operational(
 enum {
 	SP_CHKPT = 1,
 	SP_SESSL,
+	SP_SESSL_SRC,
 	SP_NOPRES,
 	SP_USEHINT
 };
@@ -2957,6 +3161,10 @@ static ConfigTable spcfg[] = {
 		sp_cf_gen, "( OLcfgOvAt:1.2 NAME 'olcSpSessionlog' "
 			"DESC 'Session log size in ops' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "syncprov-sessionlog-source", "dn", 2, 2, 0, ARG_DN|ARG_MAGIC|SP_SESSL_SRC,
+		sp_cf_gen, "( OLcfgOvAt:1.5 NAME 'olcSpSessionlogSource' "
+			"DESC 'Accesslog database to reload the session log from' "
+			"SUP distinguishedName SINGLE-VALUE )", NULL, NULL },
 	{ "syncprov-nopresent", NULL, 2, 2, 0, ARG_ON_OFF|ARG_MAGIC|SP_NOPRES,
 		sp_cf_gen, "( OLcfgOvAt:1.3 NAME 'olcSpNoPresent' "
 			"DESC 'Omit Present phase processing' "
@@ -2975,6 +3183,7 @@ static ConfigOCs spocs[] = {
 		"SUP olcOverlayConfig "
 		"MAY ( olcSpCheckpoint "
 			"$ olcSpSessionlog "
+			"$ olcSpSessionlogSource "
 			"$ olcSpNoPresent "
 			"$ olcSpReloadHint "
 		") )",
@@ -3016,6 +3225,14 @@ sp_cf_gen(ConfigArgs *c)
 				rc = 1;
 			}
 			break;
+		case SP_SESSL_SRC:
+			if ( !BER_BVISNULL( &si->si_logbase )) {
+				value_add_one( &c->rvalue_vals, &si->si_logbase );
+				value_add_one( &c->rvalue_nvals, &si->si_logbase );
+			} else {
+				rc = 1;
+			}
+			break;
 		case SP_NOPRES:
 			if ( si->si_nopres ) {
 				c->value_int = 1;
@@ -3041,6 +3258,10 @@ sp_cf_gen(ConfigArgs *c)
 		case SP_SESSL:
 			si->si_logs->sl_size = 0;
 			break;
+		case SP_SESSL_SRC:
+			ch_free( si->si_logbase.bv_val );
+			BER_BVZERO( &si->si_logbase );
+			break;
 		case SP_NOPRES:
 			si->si_nopres = 0;
 			break;
@@ -3100,13 +3321,20 @@ sp_cf_gen(ConfigArgs *c)
 			sl->sl_sids = NULL;
 			sl->sl_num = 0;
 			sl->sl_numcsns = 0;
-			sl->sl_head = sl->sl_tail = NULL;
-			ldap_pvt_thread_mutex_init( &sl->sl_mutex );
+			sl->sl_logsids = NULL;
+			sl->sl_numlogsids = 0;
+			sl->sl_entries = NULL;
+			ldap_pvt_thread_rdwr_init( &sl->sl_mutex );
 			si->si_logs = sl;
 		}
 		sl->sl_size = size;
 		}
 		break;
+	case SP_SESSL_SRC:
+		ch_free( si->si_logbase.bv_val );
+		si->si_logbase = c->value_ndn;
+		ch_free( c->value_dn.bv_val );
+		break;
 	case SP_NOPRES:
 		si->si_nopres = c->value_int;
 		break;
@@ -3130,6 +3358,304 @@ syncprov_db_otask(
 }
 
 
+typedef struct slog_load {
+	syncprov_info_t *sl_si;
+	BackendDB *sl_be;
+	AttributeDescription *sl_ad_type;
+	AttributeDescription *sl_ad_dn;
+	AttributeDescription *sl_ad_uuid;
+	int sl_count;
+} slog_load;
+
+static int
+syncprov_slog_load_cb( Operation *op, SlapReply *rs )
+{
+	slog_load *ld = op->o_callback->sc_private;
+	sessionlog *sl = ld->sl_si->si_logs;
+	Attribute *a;
+	struct berval *type, *uuid, *csn;
+	ber_tag_t tag;
+	int i, sid;
+
+	if ( rs->sr_type != REP_SEARCH )
+		return 0;
+
+	a = attr_find( rs->sr_entry->e_attrs, ld->sl_ad_type );
+	if ( !a )
+		return 0;
+	type = &a->a_vals[0];
+	if ( !strcasecmp( type->bv_val, "add" ))
+		tag = LDAP_REQ_ADD;
+	else if ( !strcasecmp( type->bv_val, "delete" ))
+		tag = LDAP_REQ_DELETE;
+	else if ( !strcasecmp( type->bv_val, "modify" ))
+		tag = LDAP_REQ_MODIFY;
+	else if ( !strcasecmp( type->bv_val, "modrdn" ))
+		tag = LDAP_REQ_MODRDN;
+	else if ( !strncasecmp( type->bv_val, "extended", STRLENOF("extended") ))
+		tag = LDAP_REQ_EXTENDED;
+	else
+		return 0;
+
+	a = attr_find( rs->sr_entry->e_attrs, ld->sl_ad_dn );
+	if ( !a || !dnIsSuffix( &a->a_nvals[0], ld->sl_be->be_nsuffix ))
+		return 0;
+
+	a = attr_find( rs->sr_entry->e_attrs, ld->sl_ad_uuid );
+	if ( !a || a->a_nvals[0].bv_len != UUID_LEN )
+		return 0;
+	uuid = &a->a_nvals[0];
+
+	a = attr_find( rs->sr_entry->e_attrs, slap_schema.si_ad_entryCSN );
+	if ( !a )
+		return 0;
+	csn = &a->a_vals[0];
+	sid = slap_parse_csn_sid( csn );
+	if ( sid < 0 )
+		return 0;
+
+	/* The log now reaches back to this change, so consumers as old
+	 * as its CSN can be served from it.
+	 */
+	if ( sl->sl_mincsn ) {
+		for ( i=0; i<sl->sl_numcsns; i++ )
+			if ( sl->sl_sids[i] >= sid )
+				break;
+		if ( i == sl->sl_numcsns || sl->sl_sids[i] != sid ) {
+			slap_insert_csn_sids( (struct sync_cookie *)sl, i, sid, csn );
+		} else if ( ber_bvcmp( csn, &sl->sl_mincsn[i] ) < 0 ) {
+			ber_bvreplace( &sl->sl_mincsn[i], csn );
+		}
+	}
+
+	syncprov_slog_insert( sl, tag, uuid, csn );
+	ld->sl_count++;
+	return 0;
+}
+
+/* Refill the session log from the accesslog database named by
+ * syncprov-sessionlog-source, so that consumers need not fall back
+ * to a present phase just because the provider was restarted.
+ */
+static void *
+syncprov_slog_load(
+	void *ptr
+)
+{
+	Operation *op = ptr;
+	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
+	syncprov_info_t *si = on->on_bi.bi_private;
+	BackendDB *be = op->o_bd, *db, *b2;
+	slap_callback cb = { 0 };
+	SlapReply rs = { REP_RESULT };
+	slog_load ld = { 0 };
+	const char *text;
+
+	/* Databases are opened in configuration order; the log must
+	 * come before us to be readable yet.
+	 */
+	db = select_backend( &si->si_logbase, 0 );
+	b2 = NULL;
+	if ( db && db->be_search ) {
+		LDAP_STAILQ_FOREACH( b2, &backendDB, be_next ) {
+			if ( b2 == db )
+				break;
+			if ( b2 == be->bd_self ) {
+				b2 = NULL;
+				break;
+			}
+		}
+	}
+	if ( !b2 ) {
+		Debug( LDAP_DEBUG_ANY, "syncprov_db_open: "
+			"sessionlog source \"%s\" is not an open database, "
+			"session log starts empty\n", si->si_logbase.bv_val, 0, 0 );
+		return NULL;
+	}
+	if ( slap_str2ad( "reqType", &ld.sl_ad_type, &text ) ||
+		slap_str2ad( "reqDN", &ld.sl_ad_dn, &text ) ||
+		slap_str2ad( "reqEntryUUID", &ld.sl_ad_uuid, &text )) {
+		Debug( LDAP_DEBUG_ANY, "syncprov_db_open: "
+			"accesslog schema unavailable, session log starts empty\n",
+			0, 0, 0 );
+		return NULL;
+	}
+	ld.sl_si = si;
+	ld.sl_be = be;
+
+	op->o_bd = db;
+	op->o_tag = LDAP_REQ_SEARCH;
+	op->o_dn = db->be_rootdn;
+	op->o_ndn = db->be_rootndn;
+	op->o_req_dn = si->si_logbase;
+	op->o_req_ndn = si->si_logbase;
+	op->ors_scope = LDAP_SCOPE_SUBTREE;
+	op->ors_deref = LDAP_DEREF_NEVER;
+	op->ors_slimit = SLAP_NO_LIMIT;
+	op->ors_tlimit = SLAP_NO_LIMIT;
+	op->ors_limit = NULL;
+	op->ors_attrs = slap_anlist_all_attributes;
+	op->ors_attrsonly = 0;
+	ber_str2bv_x( "(&(objectClass=auditWriteObject)(reqResult=0))", 0, 1,
+		&op->ors_filterstr, op->o_tmpmemctx );
+	op->ors_filter = str2filter_x( op, op->ors_filterstr.bv_val );
+	if ( op->ors_filter ) {
+		cb.sc_response = syncprov_slog_load_cb;
+		cb.sc_private = &ld;
+		op->o_callback = &cb;
+		db->be_search( op, &rs );
+		filter_free_x( op, op->ors_filter, 1 );
+	}
+	op->o_tmpfree( op->ors_filterstr.bv_val, op->o_tmpmemctx );
+	op->o_callback = NULL;
+	op->o_bd = be;
+	op->o_dn = be->be_rootdn;
+	op->o_ndn = be->be_rootndn;
+
+	Debug( LDAP_DEBUG_SYNC, "syncprov_db_open: "
+		"loaded %d of %d session log entries from \"%s\"\n",
+		si->si_logs->sl_num, ld.sl_count, si->si_logbase.bv_val );
+	return NULL;
+}
+
+static int
+syncprov_session_list( syncprov_info_t *si, BerVarray *vals )
+{
+	syncops *so;
+	struct berval bv;
+	char buf[ SLAP_TEXT_BUFLEN ];
+	time_t now = slap_get_time();
+	unsigned long rate;
+	int n = 0;
+
+	ldap_pvt_thread_mutex_lock( &si->si_ops_mutex );
+	for ( so = si->si_ops; so; so = so->s_next ) {
+		rate = so->s_rate;
+		if ( now - so->s_winStart >= SYNCPROV_STATS_WINDOW )
+			rate = so->s_winSent / ( now - so->s_winStart );
+		bv.bv_val = buf;
+		bv.bv_len = snprintf( buf, sizeof( buf ),
+			"rid=%03d conn=%lu state=%s queued=%d sent=%lu rate=%lu",
+			so->s_rid, so->s_op->o_connid,
+			( so->s_flags & PS_IS_REFRESHING ) ? "refresh" : "persist",
+			so->s_qlen, so->s_nsent, rate );
+		value_add_one( vals, &bv );
+		n++;
+	}
+	ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
+	return n;
+}
+
+static int
+syncprov_monitor_update(
+	Operation	*op,
+	SlapReply	*rs,
+	Entry		*e,
+	void		*priv )
+{
+	syncprov_info_t *si = priv;
+	monitor_info_t *mi = (monitor_info_t *)op->o_bd->be_private;
+	BerVarray vals = NULL;
+
+	attr_delete( &e->e_attrs, mi->mi_ad_monitorSyncSession );
+	if ( syncprov_session_list( si, &vals ) > 0 ) {
+		attr_merge_normalize( e, mi->mi_ad_monitorSyncSession, vals, NULL );
+		ber_bvarray_free( vals );
+	}
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+syncprov_monitor_free(
+	Entry		*e,
+	void		**priv )
+{
+	/* NOTE: if slap_shutdown != 0, priv might have already been freed */
+	*priv = NULL;
+	return SLAP_CB_CONTINUE;
+}
+
+/* Show the psearches on the overlay's entry under cn=Monitor */
+static void
+syncprov_monitor_db_open( BackendDB *be, slap_overinst *on )
+{
+	syncprov_info_t *si = on->on_bi.bi_private;
+	monitor_callback_t *cb;
+	monitor_extra_t *mbe;
+	BackendInfo *mi;
+
+	mi = backend_info( "monitor" );
+	if ( !mi || !mi->bi_extra )
+		return;
+	mbe = mi->bi_extra;
+	if ( !mbe->is_configured() )
+		return;
+
+	cb = ch_calloc( sizeof( monitor_callback_t ), 1 );
+	cb->mc_update = syncprov_monitor_update;
+	cb->mc_free = syncprov_monitor_free;
+	cb->mc_private = (void *)si;
+
+	BER_BVZERO( &si->si_monitor_ndn );
+	if ( mbe->register_overlay( be, on, &si->si_monitor_ndn ) ||
+		mbe->register_entry_callback( &si->si_monitor_ndn, cb,
+			NULL, -1, NULL ))
+	{
+		ch_free( cb );
+		return;
+	}
+	si->si_monitor_cb = cb;
+}
+
+static void
+syncprov_monitor_db_close( BackendDB *be, slap_overinst *on )
+{
+	syncprov_info_t *si = on->on_bi.bi_private;
+	monitor_extra_t *mbe;
+	BackendInfo *mi;
+
+	if ( si->si_monitor_cb == NULL )
+		return;
+
+	mi = backend_info( "monitor" );
+	if ( mi && mi->bi_extra ) {
+		mbe = mi->bi_extra;
+		mbe->unregister_entry_callback( &si->si_monitor_ndn,
+			(monitor_callback_t *)si->si_monitor_cb, NULL, 0, NULL );
+	}
+	si->si_monitor_cb = NULL;
+}
+
+/* Report the psearches of a database to the metrics extended operation */
+static void
+syncprov_metrics( BackendDB *be, slap_metrics *ms )
+{
+	slap_overinfo *oi = be->bd_info->bi_private;
+	slap_overinst *on;
+	syncprov_info_t *si;
+	syncops *so;
+	char labels[ sizeof( "rid=\"999\",conn=\"\"" ) + LDAP_PVT_INTTYPE_CHARS( unsigned long ) ];
+
+	for ( on = oi->oi_list; on; on = on->on_next ) {
+		if ( on->on_bi.bi_type == syncprov.on_bi.bi_type )
+			break;
+	}
+	if ( !on )
+		return;
+	si = on->on_bi.bi_private;
+
+	ldap_pvt_thread_mutex_lock( &si->si_ops_mutex );
+	for ( so = si->si_ops; so; so = so->s_next ) {
+		snprintf( labels, sizeof( labels ), "rid=\"%03d\",conn=\"%lu\"",
+			so->s_rid, so->s_op->o_connid );
+		slap_metrics_add( ms, "slapd_syncprov_queued", "gauge",
+			be, labels, "%d", so->s_qlen );
+		slap_metrics_add( ms, "slapd_syncprov_sent_total", "counter",
+			be, labels, "%lu", so->s_nsent );
+	}
+	ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
+}
+
 /* Read any existing contextCSN from the underlying db.
  * Then search for any entries newer than that. If no value exists,
  * just generate it. Cache whatever result.
@@ -3161,6 +3687,9 @@ syncprov_db_open(
 		return 0;
 	}
 
+	/* with overlays, be is a copy on the stack */
+	si->si_be = be->bd_self;
+
 	rc = overlay_register_control( be, LDAP_CONTROL_SYNC );
 	if ( rc ) {
 		return rc;
@@ -3238,8 +3767,18 @@ syncprov_db_open(
 			sl->sl_sids[i] = si->si_sids[i];
 	}
 
+	if ( si->si_logs && !BER_BVISNULL( &si->si_logbase )) {
+		ldap_pvt_thread_t tid;
+
+		ldap_pvt_thread_create( &tid, 0, syncprov_slog_load, op );
+		ldap_pvt_thread_join( tid, NULL );
+	}
+
 out:
 	op->o_bd->bd_info = (BackendInfo *)on;
+	syncprov_monitor_db_open( be, on );
+	/* be is a copy on the stack */
+	slap_metrics_register( be->bd_self, syncprov_metrics );
 	return 0;
 }
 
@@ -3253,6 +3792,7 @@ syncprov_db_close(
 {
 	slap_overinst   *on = (slap_overinst *) be->bd_info;
 	syncprov_info_t *si = (syncprov_info_t *)on->on_bi.bi_private;
+	int chkpend;
 #ifdef SLAP_CONFIG_DELETE
 	syncops *so, *sonext;
 #endif /* SLAP_CONFIG_DELETE */
@@ -3260,7 +3800,22 @@ syncprov_db_close(
 	if ( slapMode & SLAP_TOOL_MODE ) {
 		return 0;
 	}
-	if ( si->si_numops ) {
+	syncprov_monitor_db_close( be, on );
+	slap_metrics_unregister( be->bd_self, syncprov_metrics );
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( si->si_chktask ) {
+		struct re_s *re = si->si_chktask;
+
+		si->si_chktask = NULL;
+		if ( ldap_pvt_runqueue_isrunning( &slapd_rq, re ))
+			ldap_pvt_runqueue_stoptask( &slapd_rq, re );
+		ldap_pvt_runqueue_remove( &slapd_rq, re );
+	}
+	chkpend = si->si_chkpend;
+	si->si_chkpend = 0;
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	if ( si->si_numops || chkpend ) {
 		Connection conn = {0};
 		OperationBuffer opbuf;
 		Operation *op;
@@ -3343,21 +3898,20 @@ syncprov_db_destroy(
 	if ( si ) {
 		if ( si->si_logs ) {
 			sessionlog *sl = si->si_logs;
-			slog_entry *se = sl->sl_head;
 
-			while ( se ) {
-				slog_entry *se_next = se->se_next;
-				ch_free( se );
-				se = se_next;
-			}
+			tavl_free( sl->sl_entries, ch_free );
+			if ( sl->sl_logsids )
+				ch_free( sl->sl_logsids );
 			if ( sl->sl_mincsn )
 				ber_bvarray_free( sl->sl_mincsn );
 			if ( sl->sl_sids )
 				ch_free( sl->sl_sids );
 
-			ldap_pvt_thread_mutex_destroy(&si->si_logs->sl_mutex);
+			ldap_pvt_thread_rdwr_destroy(&si->si_logs->sl_mutex);
 			ch_free( si->si_logs );
 		}
+		if ( si->si_logbase.bv_val )
+			ch_free( si->si_logbase.bv_val );
 		if ( si->si_ctxcsn )
 			ber_bvarray_free( si->si_ctxcsn );
 		if ( si->si_sids )
@@ -43,8 +43,23 @@ typedef struct translucent_info {
 	int defer_db_open;
 	int bind_local;
 	int pwmod_local;
+	int cache_ttl;			/* seconds to keep remote entries */
+	int cache_max;			/* max number of cached remote entries */
+	int batch;				/* remote results per local lookup batch */
+	ldap_pvt_thread_mutex_t cache_mutex;
+	Avlnode *cache;			/* trans_centry, by DN */
+	int cache_num;
 } translucent_info;
 
+/* cached copy of a remote entry */
+typedef struct trans_centry {
+	struct berval ce_ndn;
+	Entry *ce_e;			/* NULL if it doesn't exist remotely */
+	time_t ce_expire;
+} trans_centry;
+
+#define	TRANS_CACHE_MAX	1024
+
 static ConfigLDAPadd translucent_ldadd;
 static ConfigCfAdd translucent_cfadd;
 
@@ -92,6 +107,24 @@ static ConfigTable translucentcfg[] = {
 	  "( OLcfgOvAt:14.6 NAME 'olcTranslucentPwModLocal' "
 	  "DESC 'Enable local RFC 3062 Password Modify extended operation' "
 	  "SYNTAX OMsBoolean SINGLE-VALUE)", NULL, NULL },
+	{ "translucent_cache_ttl", "seconds", 2, 2, 0,
+	  ARG_INT|ARG_OFFSET,
+	  (void *)offsetof(translucent_info, cache_ttl),
+	  "( OLcfgOvAt:14.7 NAME 'olcTranslucentCacheTTL' "
+	  "DESC 'Seconds to cache entries read from the remote database' "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "translucent_cache_max", "entries", 2, 2, 0,
+	  ARG_INT|ARG_OFFSET,
+	  (void *)offsetof(translucent_info, cache_max),
+	  "( OLcfgOvAt:14.8 NAME 'olcTranslucentCacheMax' "
+	  "DESC 'Maximum number of cached remote entries' "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "translucent_batch", "entries", 2, 2, 0,
+	  ARG_INT|ARG_OFFSET,
+	  (void *)offsetof(translucent_info, batch),
+	  "( OLcfgOvAt:14.9 NAME 'olcTranslucentBatch' "
+	  "DESC 'Number of remote search results merged per local lookup batch' "
+	  "SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -102,7 +135,9 @@ static ConfigOCs translucentocs[] = {
 	  "SUP olcOverlayConfig "
 	  "MAY ( olcTranslucentStrict $ olcTranslucentNoGlue $"
 	  " olcTranslucentLocal $ olcTranslucentRemote $"
-	  " olcTranslucentBindLocal $ olcTranslucentPwModLocal ) )",
+	  " olcTranslucentBindLocal $ olcTranslucentPwModLocal $"
+	  " olcTranslucentCacheTTL $ olcTranslucentCacheMax $"
+	  " olcTranslucentBatch ) )",
 	  Cft_Overlay, translucentcfg, NULL, translucent_cfadd },
 	{ "( OLcfgOvOc:14.2 "
 	  "NAME 'olcTranslucentDatabase' "
@@ -225,6 +260,104 @@ translucent_cf_gen( ConfigArgs *c )
 
 static slap_overinst translucent;
 
+static int
+trans_centry_cmp( const void *v1, const void *v2 )
+{
+	const trans_centry *c1 = v1, *c2 = v2;
+	int rc = c1->ce_ndn.bv_len - c2->ce_ndn.bv_len;
+
+	if ( rc == 0 )
+		rc = memcmp( c1->ce_ndn.bv_val, c2->ce_ndn.bv_val, c1->ce_ndn.bv_len );
+	return rc;
+}
+
+static void
+trans_centry_free( void *v )
+{
+	trans_centry *ce = v;
+
+	if ( ce->ce_e )
+		entry_free( ce->ce_e );
+	ch_free( ce );
+}
+
+/*
+** trans_remote_get()
+**	fetch an entry from the captive backend, using the
+**	remote entry cache if enabled; with refresh set the
+**	cached copy is bypassed and replaced.
+**	The caller owns the returned entry and must entry_free() it.
+**	op->o_bd must be the captive backend.
+*/
+
+static int
+trans_remote_get( Operation *op, translucent_info *ov, struct berval *ndn,
+	int refresh, Entry **ep )
+{
+	trans_centry *ce, tmp;
+	Entry *e = NULL;
+	int rc;
+
+	*ep = NULL;
+	if ( ov->cache_ttl > 0 && !refresh ) {
+		tmp.ce_ndn = *ndn;
+		ldap_pvt_thread_mutex_lock( &ov->cache_mutex );
+		ce = avl_find( ov->cache, &tmp, trans_centry_cmp );
+		if ( ce && ce->ce_expire > slap_get_time() ) {
+			if ( ce->ce_e )
+				*ep = entry_dup( ce->ce_e );
+			ldap_pvt_thread_mutex_unlock( &ov->cache_mutex );
+			return *ep ? LDAP_SUCCESS : LDAP_NO_SUCH_OBJECT;
+		}
+		ldap_pvt_thread_mutex_unlock( &ov->cache_mutex );
+	}
+
+	rc = ov->db.bd_info->bi_entry_get_rw( op, ndn, NULL, NULL, 0, &e );
+	if ( rc == LDAP_SUCCESS && e ) {
+		if ( ov->db.bd_info->bi_entry_release_rw ) {
+			*ep = entry_dup( e );
+			ov->db.bd_info->bi_entry_release_rw( op, e, 0 );
+		} else {
+			*ep = e;
+		}
+	} else if ( rc == LDAP_SUCCESS ) {
+		rc = LDAP_NO_SUCH_OBJECT;
+	}
+
+	/* don't remember transient failures */
+	if ( ov->cache_ttl > 0 && ( *ep || rc == LDAP_NO_SUCH_OBJECT )) {
+		trans_centry *old;
+
+		ce = ch_malloc( sizeof( trans_centry ) + ndn->bv_len + 1 );
+		ce->ce_ndn.bv_val = (char *)( ce + 1 );
+		ce->ce_ndn.bv_len = ndn->bv_len;
+		AC_MEMCPY( ce->ce_ndn.bv_val, ndn->bv_val, ndn->bv_len + 1 );
+		ce->ce_e = *ep ? entry_dup( *ep ) : NULL;
+		ce->ce_expire = slap_get_time() + ov->cache_ttl;
+
+		ldap_pvt_thread_mutex_lock( &ov->cache_mutex );
+		old = avl_delete( &ov->cache, ce, trans_centry_cmp );
+		if ( old ) {
+			trans_centry_free( old );
+		} else if ( ov->cache_num >= ov->cache_max ) {
+			/* full, start over rather than tracking age */
+			avl_free( ov->cache, trans_centry_free );
+			ov->cache = NULL;
+			ov->cache_num = 0;
+		}
+		if ( old || ov->cache_num < ov->cache_max ) {
+			avl_insert( &ov->cache, ce, trans_centry_cmp, avl_dup_error );
+			if ( !old )
+				ov->cache_num++;
+		} else {
+			trans_centry_free( ce );
+		}
+		ldap_pvt_thread_mutex_unlock( &ov->cache_mutex );
+	}
+
+	return rc;
+}
+
 /*
 ** glue_parent()
 **	call syncrepl_add_glue() with the parent suffix;
@@ -419,7 +552,7 @@ static int translucent_modify(Operation *op, SlapReply *rs) {
 	db = op->o_bd;
 	op->o_bd = &ov->db;
 	ov->db.be_acl = op->o_bd->be_acl;
-	rc = ov->db.bd_info->bi_entry_get_rw(op, &op->o_req_ndn, NULL, NULL, 0, &re);
+	rc = trans_remote_get(op, ov, &op->o_req_ndn, 1, &re);
 	op->o_bd = db;
 	if(rc != LDAP_SUCCESS || re == NULL ) {
 		send_ldap_error((op), rs, LDAP_NO_SUCH_OBJECT,
@@ -479,12 +612,7 @@ static int translucent_modify(Operation *op, SlapReply *rs) {
 		erc = SLAP_CB_CONTINUE;
 release:
 		if(re) {
-			if(ov->db.bd_info->bi_entry_release_rw) {
-				op->o_bd = &ov->db;
-				ov->db.bd_info->bi_entry_release_rw(op, re, 0);
-				op->o_bd = db;
-			} else
-				entry_free(re);
+			entry_free(re);
 		}
 		op->o_bd->bd_info = (BackendInfo *) on->on_info->oi_orig;
 		be_entry_release_r(op, e);
@@ -500,12 +628,7 @@ release:
 
 	/* don't leak remote entry copy */
 	if(re) {
-		if(ov->db.bd_info->bi_entry_release_rw) {
-			op->o_bd = &ov->db;
-			ov->db.bd_info->bi_entry_release_rw(op, re, 0);
-			op->o_bd = db;
-		} else
-			entry_free(re);
+		entry_free(re);
 	}
 /*
 ** foreach Modification:
@@ -649,7 +772,7 @@ static int translucent_pwmod(Operation *op, SlapReply *rs) {
 	db = op->o_bd;
 	op->o_bd = &ov->db;
 	ov->db.be_acl = op->o_bd->be_acl;
-	rc = ov->db.bd_info->bi_entry_get_rw(op, &op->o_req_ndn, NULL, NULL, 0, &re);
+	rc = trans_remote_get(op, ov, &op->o_req_ndn, 1, &re);
 	if(rc != LDAP_SUCCESS || re == NULL ) {
 		send_ldap_error((op), rs, LDAP_NO_SUCH_OBJECT,
 			"attempt to modify nonexistent local record");
@@ -668,13 +791,7 @@ static int translucent_pwmod(Operation *op, SlapReply *rs) {
 
 	if(e && rc == LDAP_SUCCESS) {
 		if(re) {
-			if(ov->db.bd_info->bi_entry_release_rw) {
-				op->o_bd = &ov->db;
-				ov->db.bd_info->bi_entry_release_rw(op, re, 0);
-				op->o_bd = db;
-			} else {
-				entry_free(re);
-			}
+			entry_free(re);
 		}
 		op->o_bd->bd_info = (BackendInfo *) on->on_info->oi_orig;
 		be_entry_release_r(op, e);
@@ -684,13 +801,7 @@ static int translucent_pwmod(Operation *op, SlapReply *rs) {
 
 	/* don't leak remote entry copy */
 	if(re) {
-		if(ov->db.bd_info->bi_entry_release_rw) {
-			op->o_bd = &ov->db;
-			ov->db.bd_info->bi_entry_release_rw(op, re, 0);
-			op->o_bd = db;
-		} else {
-			entry_free(re);
-		}
+		entry_free(re);
 	}
 /*
 ** glue_parent() for this Entry;
@@ -770,20 +881,146 @@ typedef struct trans_ctx {
 	int step;
 	int slimit;
 	AttributeName *attrs;
+	Entry **batch;		/* remote entries awaiting their local part */
+	Entry ***order;		/* batch slots sorted by DN */
+	char *testf;		/* merged entries that need test_filter() */
+	int nbatch;
 } trans_ctx;
 
+/*
+** trans_merge()
+**	override remote attributes with local ones,
+**	append the local-only attributes to the remote entry;
+**	returns nonzero if a remote attribute was replaced
+*/
+
+static int trans_merge(Entry *re, Entry *le) {
+	Attribute *a, *ax, *an, *as = NULL;
+	int test_f = 0;
+
+	for(ax = le->e_attrs; ax; ax = ax->a_next) {
+		for(a = re->e_attrs; a; a = a->a_next) {
+			if(a->a_desc == ax->a_desc) {
+				test_f = 1;
+				if(a->a_vals != a->a_nvals)
+					ber_bvarray_free(a->a_nvals);
+				ber_bvarray_free(a->a_vals);
+				ber_bvarray_dup_x( &a->a_vals, ax->a_vals, NULL );
+				if ( ax->a_vals == ax->a_nvals ) {
+					a->a_nvals = a->a_vals;
+				} else {
+					ber_bvarray_dup_x( &a->a_nvals, ax->a_nvals, NULL );
+				}
+				break;
+			}
+		}
+		if(a) continue;
+		an = attr_dup(ax);
+		an->a_next = as;
+		as = an;
+	}
+
+	/* literally append, so locals are always last */
+	if(as) {
+		if(re->e_attrs) {
+			for(ax = re->e_attrs; ax->a_next; ax = ax->a_next);
+			ax->a_next = as;
+		} else {
+			re->e_attrs = as;
+		}
+	}
+	return test_f;
+}
+
+static int
+trans_batch_cmp( const void *v1, const void *v2 )
+{
+	return entry_dn_cmp( **(Entry ***)v1, **(Entry ***)v2 );
+}
+
+/*
+** trans_batch_flush()
+**	look up the local entries for a batch of remote results
+**	in DN order, so the local database is walked sequentially;
+**	then queue the merged entries when both filters are in use,
+**	else send them in the order the remote server returned them.
+*/
+
+static int trans_batch_flush(Operation *op, SlapReply *rs, trans_ctx *tc) {
+	slap_callback *sc = op->o_callback;
+	BackendDB *db = op->o_bd;
+	SlapReply rs2 = { REP_SEARCH };
+	Entry *re, *le;
+	int i, rc = 0;
+
+	for ( i = 0; i < tc->nbatch; i++ )
+		tc->order[i] = &tc->batch[i];
+	qsort( tc->order, tc->nbatch, sizeof(Entry **), trans_batch_cmp );
+
+	op->o_bd = tc->db;
+	for ( i = 0; i < tc->nbatch; i++ ) {
+		re = *tc->order[i];
+		tc->testf[tc->order[i] - tc->batch] = 0;
+		le = NULL;
+		if ( overlay_entry_get_ov( op, &re->e_nname, NULL, NULL, 0, &le, tc->on )
+			== LDAP_SUCCESS && le ) {
+			tc->testf[tc->order[i] - tc->batch] = trans_merge( re, le );
+			overlay_entry_release_ov( op, le, 0, tc->on );
+		}
+	}
+	op->o_bd = db;
+
+	rs2.sr_attrs = rs->sr_attrs;
+	rs2.sr_nentries = rs->sr_nentries;
+	for ( i = 0; i < tc->nbatch; i++ ) {
+		re = tc->batch[i];
+		if ( rc ) {
+			entry_free( re );
+			continue;
+		}
+		if ( tc->step & USE_LIST ) {
+			tavl_insert( &tc->list, re, entry_dn_cmp, avl_dup_error );
+			continue;
+		}
+		if ( tc->testf[i] && test_filter( op, re, tc->orig ) != LDAP_COMPARE_TRUE ) {
+			entry_free( re );
+			continue;
+		}
+
+		/* skip ourselves, we've already seen this one */
+		op->o_callback = sc->sc_next;
+		rs2.sr_entry = re;
+		rs2.sr_flags = REP_ENTRY_MUSTBEFREED;
+		rs2.sr_attr_flags = slap_attr_flags( rs2.sr_attrs );
+		rc = send_search_entry( op, &rs2 );
+		op->o_callback = sc;
+		if ( rc == LDAP_SUCCESS && tc->slimit >= 0 && rs2.sr_nentries >= tc->slimit )
+			rc = LDAP_SIZELIMIT_EXCEEDED;
+	}
+	tc->nbatch = 0;
+	rs->sr_nentries = rs2.sr_nentries;
+
+	return rc;
+}
+
 static int translucent_search_cb(Operation *op, SlapReply *rs) {
 	trans_ctx *tc;
 	BackendDB *db;
 	slap_overinst *on;
 	translucent_info *ov;
 	Entry *le, *re;
-	Attribute *a, *ax, *an, *as = NULL;
 	int rc;
 	int test_f = 0;
 
 	tc = op->o_callback->sc_private;
 
+	/* Merge whatever is left of the remote results */
+	if ( rs->sr_type == REP_RESULT && tc->nbatch ) {
+		rc = trans_batch_flush( op, rs, tc );
+		if ( rc == LDAP_SIZELIMIT_EXCEEDED && rs->sr_err == LDAP_SUCCESS )
+			rs->sr_err = rc;
+	}
+
 	/* Don't let the op complete while we're gathering data */
 	if ( rs->sr_type == REP_RESULT && ( tc->step & USE_LIST ))
 		return 0;
@@ -833,13 +1070,18 @@ static int translucent_search_cb(Operation *op, SlapReply *rs) {
 			}
 		}
 		op->o_bd = &ov->db;
-		rc = be_entry_get_rw( op, &rs->sr_entry->e_nname, NULL, NULL, 0, &re );
+		rc = trans_remote_get( op, ov, &rs->sr_entry->e_nname, 0, &re );
 		if ( rc == LDAP_SUCCESS && re ) {
-			Entry *tmp = entry_dup( re );
-			be_entry_release_r( op, re );
-			re = tmp;
 			test_f = 1;
 		}
+	} else if ( tc->batch ) {
+	/* Else we have remote, queue it for a batched local lookup */
+		tc->batch[tc->nbatch++] = entry_dup( rs->sr_entry );
+		rs_flush_entry( op, rs, on );
+		rc = 0;
+		if ( tc->nbatch == ov->batch )
+			rc = trans_batch_flush( op, rs, tc );
+		return rc;
 	} else {
 	/* Else we have remote, get local */
 		op->o_bd = tc->db;
@@ -864,43 +1106,14 @@ static int translucent_search_cb(Operation *op, SlapReply *rs) {
 */
 
 	if ( re && le ) {
-		for(ax = le->e_attrs; ax; ax = ax->a_next) {
-			for(a = re->e_attrs; a; a = a->a_next) {
-				if(a->a_desc == ax->a_desc) {
-					test_f = 1;
-					if(a->a_vals != a->a_nvals)
-						ber_bvarray_free(a->a_nvals);
-					ber_bvarray_free(a->a_vals);
-					ber_bvarray_dup_x( &a->a_vals, ax->a_vals, NULL );
-					if ( ax->a_vals == ax->a_nvals ) {
-						a->a_nvals = a->a_vals;
-					} else {
-						ber_bvarray_dup_x( &a->a_nvals, ax->a_nvals, NULL );
-					}
-					break;
-				}
-			}
-			if(a) continue;
-			an = attr_dup(ax);
-			an->a_next = as;
-			as = an;
-		}
+		if ( trans_merge( re, le ))
+			test_f = 1;
 		/* Dispose of local entry */
 		if ( tc->step & LCL_SIDE ) {
 			rs_flush_entry(op, rs, on);
 		} else {
 			overlay_entry_release_ov(op, le, 0, on);
 		}
-
-		/* literally append, so locals are always last */
-		if(as) {
-			if(re->e_attrs) {
-				for(ax = re->e_attrs; ax->a_next; ax = ax->a_next);
-				ax->a_next = as;
-			} else {
-				re->e_attrs = as;
-			}
-		}
 		/* If both filters, save entry for later */
 		if ( tc->step == (USE_LIST|RMT_SIDE) ) {
 			tavl_insert( &tc->list, re, entry_dn_cmp, avl_dup_error );
@@ -1096,6 +1309,10 @@ static int translucent_search(Operation *op, SlapReply *rs) {
 	tc.step = 0;
 	tc.slimit = op->ors_slimit;
 	tc.attrs = NULL;
+	tc.batch = NULL;
+	tc.order = NULL;
+	tc.testf = NULL;
+	tc.nbatch = 0;
 	fbv = op->ors_filterstr;
 
 	op->o_callback = &cb;
@@ -1111,7 +1328,20 @@ static int translucent_search(Operation *op, SlapReply *rs) {
 			op->ors_filter = fr;
 			filter2bv_x( op, fr, &op->ors_filterstr );
 		}
+		if ( ov->batch > 1 ) {
+			tc.batch = op->o_tmpalloc( ov->batch * ( sizeof(Entry *) +
+				sizeof(Entry **) + 1 ), op->o_tmpmemctx );
+			tc.order = (Entry ***)( tc.batch + ov->batch );
+			tc.testf = (char *)( tc.order + ov->batch );
+		}
 		rc = ov->db.bd_info->bi_op_search(op, rs);
+		if ( tc.batch ) {
+			/* only left over if the search failed */
+			while ( tc.nbatch > 0 )
+				entry_free( tc.batch[--tc.nbatch] );
+			op->o_tmpfree( tc.batch, op->o_tmpmemctx );
+			tc.batch = NULL;
+		}
 		if ( op->ors_attrs == slap_anlist_all_attributes )
 			op->ors_attrs = tc.attrs;
 		op->o_bd = tc.db;
@@ -1276,6 +1506,8 @@ static int translucent_db_init(BackendDB *be, ConfigReply *cr) {
 	ov->db = *be;
 	ov->db.be_private = NULL;
 	ov->defer_db_open = 1;
+	ov->cache_max = TRANS_CACHE_MAX;
+	ldap_pvt_thread_mutex_init( &ov->cache_mutex );
 
 	if ( !backend_db_init( "ldap", &ov->db, -1, NULL )) {
 		Debug( LDAP_DEBUG_CONFIG, "translucent: unable to open captive back-ldap\n", 0, 0, 0);
@@ -1365,6 +1597,9 @@ translucent_db_destroy( BackendDB *be, ConfigReply *cr )
 		}
 
 		ldap_pvt_thread_mutex_destroy( &ov->db.be_pcl_mutex );
+		if ( ov->cache )
+			avl_free( ov->cache, trans_centry_free );
+		ldap_pvt_thread_mutex_destroy( &ov->cache_mutex );
 		ch_free(ov);
 		on->on_bi.bi_private = NULL;
 	}
@@ -826,7 +826,7 @@ unique_db_destroy(
 
 /*
 ** search callback
-**	if this is a REP_SEARCH, count++;
+**	if this is a REP_SEARCH, count++ and stop the search;
 **
 */
 
@@ -853,7 +853,8 @@ static int count_attr_cb(
 
 	uc->count++;
 
-	return(0);
+	/* one conflicting entry is enough, stop the search */
+	return(LDAP_SIZELIMIT_EXCEEDED);
 }
 
 /* count the length of one attribute ad
@@ -1000,7 +1001,8 @@ unique_search(
 	filter_free_x(nop, nop->ors_filter, 1);
 	op->o_tmpfree( key->bv_val, op->o_tmpmemctx );
 
-	if(rc != LDAP_SUCCESS && rc != LDAP_NO_SUCH_OBJECT) {
+	if(rc != LDAP_SUCCESS && rc != LDAP_NO_SUCH_OBJECT
+		&& rc != LDAP_SIZELIMIT_EXCEEDED) {
 		op->o_bd->bd_info = (BackendInfo *) on->on_info;
 		send_ldap_error(op, rs, rc, "unique_search failed");
 		return(rs->sr_err);
@@ -44,6 +44,8 @@
 
 #define	VALSORT_WEIGHTED	8
 
+#define	VALSORT_PRESORTED	0x10	/* kept sorted in storage */
+
 typedef struct valsort_info {
 	struct valsort_info *vi_next;
 	struct berval vi_dn;
@@ -53,10 +55,13 @@ typedef struct valsort_info {
 
 static int valsort_cid;
 
+/* serializes modifies of presorted attributes with their re-sort */
+static ldap_pvt_thread_mutex_t valsort_mutex;
+
 static ConfigDriver valsort_cf_func;
 
 static ConfigTable valsort_cfats[] = {
-	{ "valsort-attr", "attribute> <dn> <sort-type", 4, 5, 0, ARG_MAGIC,
+	{ "valsort-attr", "attribute> <dn> <sort-type> [presorted]", 4, 6, 0, ARG_MAGIC,
 		valsort_cf_func, "( OLcfgOvAt:5.1 NAME 'olcValSortAttr' "
 			"DESC 'Sorting rule for attribute under given DN' "
 			"EQUALITY caseIgnoreMatch "
@@ -90,7 +95,7 @@ valsort_cf_func(ConfigArgs *c) {
 	slap_overinst *on = (slap_overinst *)c->bi;
 	valsort_info vitmp, *vi;
 	const char *text = NULL;
-	int i, is_numeric;
+	int i, is_numeric, argc, presorted = 0;
 	struct berval bv = BER_BVNULL;
 
 	if ( c->op == SLAP_CONFIG_EMIT ) {
@@ -100,7 +105,7 @@ valsort_cf_func(ConfigArgs *c) {
 			int len;
 			
 			len = vi->vi_ad->ad_cname.bv_len + 1 + vi->vi_dn.bv_len + 2;
-			i = vi->vi_sort;
+			i = vi->vi_sort & ~VALSORT_PRESORTED;
 			if ( i & VALSORT_WEIGHTED ) {
 				enum_to_verb( sorts, VALSORT_WEIGHTED, &bv2 );
 				len += bv2.bv_len + 1;
@@ -124,7 +129,13 @@ valsort_cf_func(ConfigArgs *c) {
 			}
 			if ( i ) {
 				*ptr++ = ' ';
-				strcpy( ptr, bv.bv_val );
+				ptr = lutil_strcopy( ptr, bv.bv_val );
+			}
+			if ( vi->vi_sort & VALSORT_PRESORTED ) {
+				bvret.bv_val = ch_realloc( bvret.bv_val,
+					bvret.bv_len + STRLENOF( " presorted" ) + 1 );
+				strcpy( bvret.bv_val + bvret.bv_len, " presorted" );
+				bvret.bv_len += STRLENOF( " presorted" );
 			}
 			ber_bvarray_add( &c->rvalue_vals, &bvret );
 		}
@@ -149,6 +160,11 @@ valsort_cf_func(ConfigArgs *c) {
 		}
 		return 0;
 	}
+	argc = c->argc;
+	if ( argc > 4 && !strcasecmp( c->argv[argc - 1], "presorted" )) {
+		presorted = 1;
+		argc--;
+	}
 	vitmp.vi_ad = NULL;
 	i = slap_str2ad( c->argv[1], &vitmp.vi_ad, &text );
 	if ( i ) {
@@ -183,7 +199,7 @@ valsort_cf_func(ConfigArgs *c) {
 		return(1);
 	}
 	vitmp.vi_sort = sorts[i].mask;
-	if ( sorts[i].mask == VALSORT_WEIGHTED && c->argc == 5 ) {
+	if ( sorts[i].mask == VALSORT_WEIGHTED && argc == 5 ) {
 		i = verb_to_mask( c->argv[4], sorts );
 		if ( BER_BVISNULL( &sorts[i].word )) {
 			snprintf( c->cr_msg, sizeof( c->cr_msg ), "<%s> unrecognized sort type", c->argv[0] );
@@ -193,6 +209,18 @@ valsort_cf_func(ConfigArgs *c) {
 		}
 		vitmp.vi_sort |= sorts[i].mask;
 	}
+	if ( presorted ) {
+		/* weights are stripped on every read, so there is
+		 * nothing to gain from storing those in order */
+		if ( vitmp.vi_sort & VALSORT_WEIGHTED ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ), "<%s> presorted is not supported for weighted sorts",
+				c->argv[0] );
+			Debug( LDAP_DEBUG_ANY, "%s: %s (%s)!\n",
+				c->log, c->cr_msg, c->argv[1] );
+			return(1);
+		}
+		vitmp.vi_sort |= VALSORT_PRESORTED;
+	}
 	if (( vitmp.vi_sort & VALSORT_NUMERIC ) && !is_numeric ) {
 		snprintf( c->cr_msg, sizeof( c->cr_msg ), "<%s> numeric sort specified for non-numeric syntax",
 			c->argv[0] );
@@ -265,6 +293,29 @@ do_sort( Operation *op, Attribute *a, int beg, int num, slap_mask_t sort )
 	}
 }
 
+/* Check whether the values are already in the order do_sort() would
+ * put them in */
+static int
+is_sorted( Attribute *a, slap_mask_t sort )
+{
+	int i;
+
+	for ( i = 1; i < a->a_numvals; i++ ) {
+		int cmp;
+
+		if ( sort & VALSORT_NUMERIC ) {
+			long n1 = strtol( a->a_nvals[i-1].bv_val, NULL, 0 ),
+				n2 = strtol( a->a_nvals[i].bv_val, NULL, 0 );
+			cmp = n1 < n2 ? -1 : n1 > n2;
+		} else {
+			cmp = strcmp( a->a_nvals[i-1].bv_val, a->a_nvals[i].bv_val );
+		}
+		if ( (sort & VALSORT_DESCEND) ? (cmp < 0) : (cmp > 0) )
+			return 0;
+	}
+	return 1;
+}
+
 static int
 valsort_response( Operation *op, SlapReply *rs )
 {
@@ -297,6 +348,11 @@ valsort_response( Operation *op, SlapReply *rs )
 		a = attr_find( rs->sr_entry->e_attrs, vi->vi_ad );
 		if ( !a ) continue;
 
+		/* Nothing to do if the values were stored in order */
+		if ( !( vi->vi_sort & VALSORT_WEIGHTED ) &&
+			is_sorted( a, vi->vi_sort ))
+			continue;
+
 		if ( rs_entry2modifiable( op, rs, on )) {
 			a = attr_find( rs->sr_entry->e_attrs, vi->vi_ad );
 		}
@@ -398,6 +454,12 @@ valsort_add( Operation *op, SlapReply *rs )
 	for ( ;vi;vi=vi->vi_next ) {
 		if ( !dnIsSuffix( &op->o_req_ndn, &vi->vi_dn ))
 			continue;
+		if ( vi->vi_sort & VALSORT_PRESORTED ) {
+			a = attr_find( op->ora_e->e_attrs, vi->vi_ad );
+			if ( a )
+				do_sort( op, a, 0, a->a_numvals, vi->vi_sort );
+			continue;
+		}
 		if ( !(vi->vi_sort & VALSORT_WEIGHTED ))
 			continue;
 		a = attr_find( op->ora_e->e_attrs, vi->vi_ad );
@@ -425,6 +487,127 @@ valsort_add( Operation *op, SlapReply *rs )
 	return SLAP_CB_CONTINUE;
 }
 
+/* Rewrite the presorted attributes touched by a modify in sorted
+ * order, as an internal replace of the same values */
+static void
+valsort_presort( Operation *op, slap_overinst *on )
+{
+	valsort_info *vi;
+	Modifications *ml, *mods = NULL;
+	Entry *e = NULL;
+	Attribute *a;
+
+	if ( overlay_entry_get_ov( op, &op->o_req_ndn, NULL, NULL, 0, &e, on )
+		!= LDAP_SUCCESS || e == NULL )
+		return;
+
+	for ( vi = on->on_bi.bi_private; vi; vi = vi->vi_next ) {
+		Modifications *mod;
+
+		if ( !( vi->vi_sort & VALSORT_PRESORTED ) ||
+			!dnIsSuffix( &op->o_req_ndn, &vi->vi_dn ))
+			continue;
+		for ( ml = op->orm_modlist; ml; ml = ml->sml_next ) {
+			if ( ml->sml_desc == vi->vi_ad )
+				break;
+		}
+		if ( !ml )
+			continue;
+		a = attr_find( e->e_attrs, vi->vi_ad );
+		if ( !a || is_sorted( a, vi->vi_sort ))
+			continue;
+
+		mod = op->o_tmpcalloc( 1, sizeof( Modifications ), op->o_tmpmemctx );
+		mod->sml_op = LDAP_MOD_REPLACE;
+		mod->sml_flags = SLAP_MOD_INTERNAL;
+		mod->sml_desc = vi->vi_ad;
+		mod->sml_type = vi->vi_ad->ad_cname;
+		mod->sml_numvals = a->a_numvals;
+		mod->sml_values = a->a_vals;
+		mod->sml_nvalues = a->a_nvals != a->a_vals ? a->a_nvals : NULL;
+		mod->sml_next = mods;
+		mods = mod;
+	}
+
+	/* sort private copies, the entry belongs to the backend */
+	for ( ml = mods; ml; ml = ml->sml_next ) {
+		Attribute tmp;
+
+		for ( vi = on->on_bi.bi_private; vi->vi_ad != ml->sml_desc; vi = vi->vi_next )
+			;
+		ber_bvarray_dup_x( &ml->sml_values, ml->sml_values, op->o_tmpmemctx );
+		if ( ml->sml_nvalues )
+			ber_bvarray_dup_x( &ml->sml_nvalues, ml->sml_nvalues, op->o_tmpmemctx );
+		tmp.a_vals = ml->sml_values;
+		tmp.a_nvals = ml->sml_nvalues ? ml->sml_nvalues : ml->sml_values;
+		do_sort( op, &tmp, 0, ml->sml_numvals, vi->vi_sort );
+	}
+
+	/* must be released before op is copied, the backend may hang
+	 * state for the read off op->o_extra */
+	overlay_entry_release_ov( op, e, 0, on );
+
+	if ( mods ) {
+		Operation op2 = *op;
+		SlapReply rs2 = { REP_RESULT };
+		slap_callback cb = { NULL, slap_null_cb, NULL, NULL };
+		BackendInfo *bi = op->o_bd->bd_info;
+		OpExtra oex;
+
+		op2.o_tag = LDAP_REQ_MODIFY;
+		op2.o_callback = &cb;
+		op2.o_dn = op->o_bd->be_rootdn;
+		op2.o_ndn = op->o_bd->be_rootndn;
+		op2.orm_modlist = mods;
+		BER_BVZERO( &op2.o_csn );
+
+		/* Same values in another order, nothing to replicate */
+		op2.o_opid = 0;
+		op2.orm_no_opattrs = 1;
+		op2.o_dont_replicate = 1;
+
+		oex.oe_key = (void *)&valsort_mutex;
+		LDAP_SLIST_INSERT_HEAD( &op2.o_extra, &oex, oe_next );
+		op2.o_bd->bd_info = (BackendInfo *)on->on_info;
+		(void)op->o_bd->be_modify( &op2, &rs2 );
+		op2.o_bd->bd_info = bi;
+		LDAP_SLIST_REMOVE( &op2.o_extra, &oex, OpExtra, oe_next );
+		if ( rs2.sr_err != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY, "%s valsort_presort: "
+				"re-sorting values of \"%s\" failed (%d)\n",
+				op->o_log_prefix, op->o_req_dn.bv_val, rs2.sr_err );
+		}
+
+		for ( ; mods; mods = ml ) {
+			ml = mods->sml_next;
+			ber_bvarray_free_x( mods->sml_values, op->o_tmpmemctx );
+			if ( mods->sml_nvalues )
+				ber_bvarray_free_x( mods->sml_nvalues, op->o_tmpmemctx );
+			op->o_tmpfree( mods, op->o_tmpmemctx );
+		}
+	}
+}
+
+static int
+valsort_modify_response( Operation *op, SlapReply *rs )
+{
+	if ( rs->sr_type == REP_RESULT && rs->sr_err == LDAP_SUCCESS ) {
+		valsort_presort( op, (slap_overinst *)op->o_callback->sc_private );
+	}
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+valsort_modify_cleanup( Operation *op, SlapReply *rs )
+{
+	if ( rs->sr_type == REP_RESULT || rs->sr_err == SLAPD_ABANDON ) {
+		ldap_pvt_thread_mutex_unlock( &valsort_mutex );
+		op->o_tmpfree( op->o_callback, op->o_tmpmemctx );
+		op->o_callback = NULL;
+	}
+	return SLAP_CB_CONTINUE;
+}
+
 static int
 valsort_modify( Operation *op, SlapReply *rs )
 {
@@ -434,6 +617,7 @@ valsort_modify( Operation *op, SlapReply *rs )
 	Modifications *ml;
 	int i;
 	char *ptr, *end;
+	OpExtra *oex;
 
 	/* See if any weighted sorting applies to this entry */
 	for ( ;vi;vi=vi->vi_next ) {
@@ -469,6 +653,39 @@ valsort_modify( Operation *op, SlapReply *rs )
 			}
 		}
 	}
+
+	/* Our own re-sort */
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == (void *)&valsort_mutex )
+			return SLAP_CB_CONTINUE;
+	}
+
+	/* See if a presorted attribute is being changed */
+	for ( vi = on->on_bi.bi_private; vi; vi = vi->vi_next ) {
+		if ( !( vi->vi_sort & VALSORT_PRESORTED ) ||
+			!dnIsSuffix( &op->o_req_ndn, &vi->vi_dn ))
+			continue;
+		for ( ml = op->orm_modlist; ml; ml = ml->sml_next ) {
+			if ( ml->sml_desc == vi->vi_ad )
+				break;
+		}
+		if ( ml )
+			break;
+	}
+	if ( vi ) {
+		slap_callback *sc = op->o_tmpcalloc( 1, sizeof( slap_callback ),
+			op->o_tmpmemctx );
+
+		sc->sc_response = valsort_modify_response;
+		sc->sc_cleanup = valsort_modify_cleanup;
+		sc->sc_private = on;
+		sc->sc_next = op->o_callback;
+		op->o_callback = sc;
+
+		/* held until the values have been re-sorted, so that a
+		 * concurrent change can't be lost to our replace */
+		ldap_pvt_thread_mutex_lock( &valsort_mutex );
+	}
 	return SLAP_CB_CONTINUE;
 }
 
@@ -565,6 +782,8 @@ int valsort_initialize( void )
 
 	syn_numericString = syn_find( "1.3.6.1.4.1.1466.115.121.1.36" );
 
+	ldap_pvt_thread_mutex_init( &valsort_mutex );
+
 	rc = config_register_schema( valsort_cfats, valsort_cfocs );
 	if ( rc ) return rc;
 
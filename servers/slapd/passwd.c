@@ -496,6 +496,213 @@ struct berval * slap_passwd_return(
 	return bv;
 }
 
+/*
+ * Password checks can be expensive (crypt, PBKDF2, argon2...). When
+ * password-check-threads is set, at most that many threads verify a
+ * password at any time and the others queue for their turn, so that a
+ * storm of binds cannot have every worker thread hashing at once.
+ * (libldap_r only supports the one thread pool, so this is a gate in
+ * front of lutil_passwd() rather than a pool of its own.)
+ *
+ * Successful checks can also be remembered for password-cache-ttl
+ * seconds. The cache key is an HMAC, under a key chosen at startup,
+ * of the entry DN, the stored password value and the credentials:
+ * nothing usable is kept in memory, and once the password changes
+ * the old entries simply stop matching. Failures are never cached,
+ * so lockout policies see every attempt.
+ */
+int slap_passwd_threads = 0;
+int slap_passwd_cache_size = 0;
+int slap_passwd_cache_ttl = 60;
+
+static ldap_pvt_thread_mutex_t passwd_gate_mutex;
+static ldap_pvt_thread_cond_t passwd_gate_cond;
+static int passwd_gate_active, passwd_gate_waiting;
+static unsigned long passwd_gate_queued, passwd_gate_wait_usec;
+
+static int
+passwd_verify( struct berval *passwd, struct berval *cred, const char **text )
+{
+	struct timeval start, now;
+	int rc;
+
+	if ( slap_passwd_threads <= 0 )
+		return lutil_passwd( passwd, cred, NULL, text );
+
+	ldap_pvt_thread_mutex_lock( &passwd_gate_mutex );
+	if ( passwd_gate_active >= slap_passwd_threads ) {
+		gettimeofday( &start, NULL );
+		passwd_gate_waiting++;
+		passwd_gate_queued++;
+		while ( slap_passwd_threads > 0 &&
+			passwd_gate_active >= slap_passwd_threads )
+		{
+			ldap_pvt_thread_cond_wait( &passwd_gate_cond, &passwd_gate_mutex );
+		}
+		passwd_gate_waiting--;
+		gettimeofday( &now, NULL );
+		passwd_gate_wait_usec += ( now.tv_sec - start.tv_sec ) * 1000000 +
+			now.tv_usec - start.tv_usec;
+	}
+	passwd_gate_active++;
+	ldap_pvt_thread_mutex_unlock( &passwd_gate_mutex );
+
+	rc = lutil_passwd( passwd, cred, NULL, text );
+
+	ldap_pvt_thread_mutex_lock( &passwd_gate_mutex );
+	passwd_gate_active--;
+	if ( passwd_gate_waiting )
+		ldap_pvt_thread_cond_signal( &passwd_gate_cond );
+	ldap_pvt_thread_mutex_unlock( &passwd_gate_mutex );
+
+	return rc;
+}
+
+#ifdef LUTIL_SHA1_BYTES
+typedef struct passwd_cached {
+	unsigned char pc_key[ LUTIL_SHA1_BYTES ];
+	time_t pc_time;
+	LDAP_TAILQ_ENTRY(passwd_cached) pc_lru;
+} passwd_cached;
+
+static ldap_pvt_thread_mutex_t passwd_cache_mutex;
+static Avlnode *passwd_cache_tree;
+static LDAP_TAILQ_HEAD(pc_lru, passwd_cached) passwd_cache_lru;
+static int passwd_cache_num;
+static unsigned long passwd_cache_hits, passwd_cache_misses;
+static unsigned char passwd_cache_secret[ 64 ];
+static int passwd_cache_ok;
+
+static int
+passwd_cached_cmp( const void *v1, const void *v2 )
+{
+	const passwd_cached *p1 = v1, *p2 = v2;
+
+	return memcmp( p1->pc_key, p2->pc_key, LUTIL_SHA1_BYTES );
+}
+
+/*
+ * Only values hashed by a local scheme are cached.  Schemes such as
+ * {SASL}, {UNIX} or {KERBEROS} hand verification to an external
+ * authority whose secret can change without the stored value changing,
+ * so a cached result could keep an old password working.
+ */
+static struct berval passwd_cache_schemes[] = {
+	BER_BVC("{SSHA}"), BER_BVC("{SHA}"),
+	BER_BVC("{SMD5}"), BER_BVC("{MD5}"),
+	BER_BVC("{CRYPT}"),
+	BER_BVC("{SSHA256}"), BER_BVC("{SSHA384}"), BER_BVC("{SSHA512}"),
+	BER_BVC("{SHA256}"), BER_BVC("{SHA384}"), BER_BVC("{SHA512}"),
+	BER_BVC("{PBKDF2"), BER_BVC("{ARGON2}"),
+	BER_BVNULL
+};
+
+static int
+passwd_cache_scheme( struct berval *passwd )
+{
+	int i;
+
+	for ( i = 0; !BER_BVISNULL( &passwd_cache_schemes[i] ); i++ ) {
+		struct berval *sc = &passwd_cache_schemes[i];
+
+		if ( passwd->bv_len > sc->bv_len &&
+			strncasecmp( passwd->bv_val, sc->bv_val, sc->bv_len ) == 0 )
+			return 1;
+	}
+	return 0;
+}
+
+/* HMAC-SHA1( secret, ndn \0 stored \0 cred ) */
+static void
+passwd_cache_key( unsigned char *key, Entry *e, struct berval *passwd,
+	struct berval *cred )
+{
+	lutil_SHA1_CTX ctx;
+	unsigned char pad[ sizeof( passwd_cache_secret ) ];
+	unsigned char nul = '\0';
+	int i;
+
+	for ( i = 0; i < sizeof( pad ); i++ )
+		pad[i] = passwd_cache_secret[i] ^ 0x36;
+	lutil_SHA1Init( &ctx );
+	lutil_SHA1Update( &ctx, pad, sizeof( pad ));
+	if ( e )
+		lutil_SHA1Update( &ctx, (const unsigned char *)e->e_nname.bv_val,
+			e->e_nname.bv_len );
+	lutil_SHA1Update( &ctx, &nul, 1 );
+	lutil_SHA1Update( &ctx, (const unsigned char *)passwd->bv_val,
+		passwd->bv_len );
+	lutil_SHA1Update( &ctx, &nul, 1 );
+	lutil_SHA1Update( &ctx, (const unsigned char *)cred->bv_val,
+		cred->bv_len );
+	lutil_SHA1Final( key, &ctx );
+
+	for ( i = 0; i < sizeof( pad ); i++ )
+		pad[i] = passwd_cache_secret[i] ^ 0x5c;
+	lutil_SHA1Init( &ctx );
+	lutil_SHA1Update( &ctx, pad, sizeof( pad ));
+	lutil_SHA1Update( &ctx, key, LUTIL_SHA1_BYTES );
+	lutil_SHA1Final( key, &ctx );
+}
+
+static void
+passwd_cache_evict( passwd_cached *pc )
+{
+	LDAP_TAILQ_REMOVE( &passwd_cache_lru, pc, pc_lru );
+	avl_delete( &passwd_cache_tree, pc, passwd_cached_cmp );
+	passwd_cache_num--;
+	ch_free( pc );
+}
+
+static int
+passwd_cache_get( unsigned char *key )
+{
+	passwd_cached *pc;
+	int rc = 0;
+
+	ldap_pvt_thread_mutex_lock( &passwd_cache_mutex );
+	pc = avl_find( passwd_cache_tree, key, passwd_cached_cmp );
+	if ( pc && pc->pc_time + slap_passwd_cache_ttl <= slap_get_time() ) {
+		passwd_cache_evict( pc );
+		pc = NULL;
+	}
+	if ( pc ) {
+		LDAP_TAILQ_REMOVE( &passwd_cache_lru, pc, pc_lru );
+		LDAP_TAILQ_INSERT_HEAD( &passwd_cache_lru, pc, pc_lru );
+		passwd_cache_hits++;
+		rc = 1;
+	} else {
+		passwd_cache_misses++;
+	}
+	ldap_pvt_thread_mutex_unlock( &passwd_cache_mutex );
+	return rc;
+}
+
+static void
+passwd_cache_put( unsigned char *key )
+{
+	passwd_cached *pc;
+
+	pc = ch_malloc( sizeof( passwd_cached ));
+	AC_MEMCPY( pc->pc_key, key, LUTIL_SHA1_BYTES );
+	pc->pc_time = slap_get_time();
+
+	ldap_pvt_thread_mutex_lock( &passwd_cache_mutex );
+	if ( avl_insert( &passwd_cache_tree, pc, passwd_cached_cmp,
+		avl_dup_error ))
+	{
+		ldap_pvt_thread_mutex_unlock( &passwd_cache_mutex );
+		ch_free( pc );
+		return;
+	}
+	LDAP_TAILQ_INSERT_HEAD( &passwd_cache_lru, pc, pc_lru );
+	passwd_cache_num++;
+	while ( passwd_cache_num > slap_passwd_cache_size )
+		passwd_cache_evict( LDAP_TAILQ_LAST( &passwd_cache_lru, pc_lru ));
+	ldap_pvt_thread_mutex_unlock( &passwd_cache_mutex );
+}
+#endif /* LUTIL_SHA1_BYTES */
+
 /*
  * if "e" is provided, access to each value of the password is checked first
  */
@@ -511,6 +718,12 @@ slap_passwd_check(
 	struct berval		*bv;
 	AccessControlState	acl_state = ACL_STATE_INIT;
 	char		credNul = cred->bv_val[cred->bv_len];
+#ifdef LUTIL_SHA1_BYTES
+	unsigned char key[ LUTIL_SHA1_BYTES ];
+	int cache = passwd_cache_ok && slap_passwd_cache_size > 0 &&
+		( slapMode & SLAP_SERVER_MODE );
+	int cacheable = 0;
+#endif
 
 #ifdef SLAPD_SPASSWD
 	void		*old_authctx = NULL;
@@ -528,8 +741,22 @@ slap_passwd_check(
 		{
 			continue;
 		}
-		
-		if ( !lutil_passwd( bv, cred, NULL, text ) ) {
+
+#ifdef LUTIL_SHA1_BYTES
+		if ( cache && ( cacheable = passwd_cache_scheme( bv )) ) {
+			passwd_cache_key( key, e, bv, cred );
+			if ( passwd_cache_get( key )) {
+				result = 0;
+				break;
+			}
+		}
+#endif
+
+		if ( !passwd_verify( bv, cred, text ) ) {
+#ifdef LUTIL_SHA1_BYTES
+			if ( cacheable )
+				passwd_cache_put( key );
+#endif
 			result = 0;
 			break;
 		}
@@ -545,6 +772,59 @@ slap_passwd_check(
 	return result;
 }
 
+void
+slap_passwd_threads_set( int threads )
+{
+	ldap_pvt_thread_mutex_lock( &passwd_gate_mutex );
+	slap_passwd_threads = threads;
+	ldap_pvt_thread_cond_broadcast( &passwd_gate_cond );
+	ldap_pvt_thread_mutex_unlock( &passwd_gate_mutex );
+}
+
+void
+slap_passwd_metrics( slap_metrics *ms )
+{
+	unsigned long queued, wait;
+	int active, waiting, n;
+
+	if ( slap_passwd_threads > 0 ) {
+		ldap_pvt_thread_mutex_lock( &passwd_gate_mutex );
+		active = passwd_gate_active;
+		waiting = passwd_gate_waiting;
+		queued = passwd_gate_queued;
+		wait = passwd_gate_wait_usec;
+		ldap_pvt_thread_mutex_unlock( &passwd_gate_mutex );
+
+		slap_metrics_add( ms, "slapd_passwd_checks_active", "gauge",
+			NULL, NULL, "%d", active );
+		slap_metrics_add( ms, "slapd_passwd_checks_waiting", "gauge",
+			NULL, NULL, "%d", waiting );
+		slap_metrics_add( ms, "slapd_passwd_checks_queued_total", "counter",
+			NULL, NULL, "%lu", queued );
+		slap_metrics_add( ms, "slapd_passwd_queue_wait_seconds_total", "counter",
+			NULL, NULL, "%lu.%06lu", wait / 1000000, wait % 1000000 );
+	}
+
+#ifdef LUTIL_SHA1_BYTES
+	if ( slap_passwd_cache_size > 0 ) {
+		unsigned long hits, misses;
+
+		ldap_pvt_thread_mutex_lock( &passwd_cache_mutex );
+		hits = passwd_cache_hits;
+		misses = passwd_cache_misses;
+		n = passwd_cache_num;
+		ldap_pvt_thread_mutex_unlock( &passwd_cache_mutex );
+
+		slap_metrics_add( ms, "slapd_passwd_cache_hits_total", "counter",
+			NULL, NULL, "%lu", hits );
+		slap_metrics_add( ms, "slapd_passwd_cache_misses_total", "counter",
+			NULL, NULL, "%lu", misses );
+		slap_metrics_add( ms, "slapd_passwd_cache_entries", "gauge",
+			NULL, NULL, "%d", n );
+	}
+#endif
+}
+
 void
 slap_passwd_generate( struct berval *pass )
 {
@@ -650,6 +930,26 @@ void slap_passwd_init()
 #ifdef SLAPD_CRYPT
 	ldap_pvt_thread_mutex_init( &passwd_mutex );
 	lutil_cryptptr = slapd_crypt;
+#endif
+	ldap_pvt_thread_mutex_init( &passwd_gate_mutex );
+	ldap_pvt_thread_cond_init( &passwd_gate_cond );
+#ifdef LUTIL_SHA1_BYTES
+	ldap_pvt_thread_mutex_init( &passwd_cache_mutex );
+	LDAP_TAILQ_INIT( &passwd_cache_lru );
+	/* without a secret key the cache stays off */
+	passwd_cache_ok = lutil_entropy( passwd_cache_secret,
+		sizeof( passwd_cache_secret )) == 0;
+#endif
+}
+
+void slap_passwd_destroy()
+{
+	ldap_pvt_thread_cond_destroy( &passwd_gate_cond );
+	ldap_pvt_thread_mutex_destroy( &passwd_gate_mutex );
+#ifdef LUTIL_SHA1_BYTES
+	avl_free( passwd_cache_tree, ch_free );
+	passwd_cache_tree = NULL;
+	ldap_pvt_thread_mutex_destroy( &passwd_cache_mutex );
 #endif
 }
 
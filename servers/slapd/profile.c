@@ -0,0 +1,311 @@
+/* profile.c - sample where worker threads spend their time */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include <ac/string.h>
+#include <ac/socket.h>
+#include <ac/time.h>
+
+#include "slap.h"
+
+int slap_profile_interval;		/* msec, 0 disables sampling */
+
+/*
+ * Each pool thread that runs an operation while profile_interval is
+ * set gets a slot, and the operation marks the phase it is in there
+ * (see SLAP_PROFILE_PHASE). A sampler thread wakes up every interval,
+ * reads every slot without locking and counts what it finds per
+ * database, operation type and phase. A marker is two stores, so
+ * the cost to the workers does not depend on the interval.
+ */
+typedef struct slap_profdb {
+	struct slap_profdb	*pd_next;
+	BerVarray	pd_suffix;	/* shared by copies of the BackendDB */
+	struct berval	pd_name;
+	unsigned long	pd_samples[SLAP_OP_LAST][SLAP_PROF_LAST];
+} slap_profdb;
+
+static slap_profslot *slap_profile_slots;
+static slap_profdb *slap_profile_dbs;
+static unsigned long slap_profile_ticks;
+
+static ldap_pvt_thread_mutex_t slap_profile_mutex;	/* slots, samples */
+static ldap_pvt_thread_t slap_profile_tid;
+static int slap_profile_running;
+static int slap_profile_shutdown;
+
+static const struct berval slap_profile_ops[] = {
+	BER_BVC( "bind" ),
+	BER_BVC( "unbind" ),
+	BER_BVC( "search" ),
+	BER_BVC( "compare" ),
+	BER_BVC( "modify" ),
+	BER_BVC( "modrdn" ),
+	BER_BVC( "add" ),
+	BER_BVC( "delete" ),
+	BER_BVC( "abandon" ),
+	BER_BVC( "extended" )
+};
+
+static const char *const slap_profile_phases[] = {
+	NULL, "other", "acl", "cand", "decode", "filter", "send"
+};
+
+static void
+slap_profslot_free( void *key, void *data )
+{
+	slap_profslot *ps = data;
+
+	/* the sampler frees it */
+	ps->ps_dead = 1;
+}
+
+static slap_profslot *
+slap_profslot_get( void *ctx )
+{
+	slap_profslot *ps = NULL;
+
+	if ( ldap_pvt_thread_pool_getkey( ctx, (void *)slap_profslot_get,
+		(void **)&ps, NULL ) == 0 && ps )
+		return ps;
+
+	ps = ch_calloc( 1, sizeof( slap_profslot ) );
+	if ( ldap_pvt_thread_pool_setkey( ctx, (void *)slap_profslot_get, ps,
+		slap_profslot_free, NULL, NULL ) ) {
+		ch_free( ps );
+		return NULL;
+	}
+
+	ldap_pvt_thread_mutex_lock( &slap_profile_mutex );
+	ps->ps_next = slap_profile_slots;
+	slap_profile_slots = ps;
+	ldap_pvt_thread_mutex_unlock( &slap_profile_mutex );
+	return ps;
+}
+
+/* Called by connection_operation() before an operation is run */
+void
+slap_profile_begin( Operation *op, slap_op_t opidx )
+{
+	slap_profslot *ps;
+
+	if ( !slap_profile_interval || opidx >= SLAP_OP_LAST )
+		return;
+
+	ps = slap_profslot_get( op->o_threadctx );
+	if ( ps == NULL )
+		return;
+	ps->ps_op = opidx;
+	ps->ps_suffix = NULL;
+	ps->ps_phase = SLAP_PROF_OTHER;
+	op->o_prof = ps;
+}
+
+/* The operation is finished or has gone async, the thread is idle */
+void
+slap_profile_end( slap_profslot *ps )
+{
+	if ( ps ) {
+		ps->ps_phase = SLAP_PROF_NONE;
+		ps->ps_suffix = NULL;
+	}
+}
+
+static slap_profdb *
+slap_profile_db( BerVarray suffix )
+{
+	slap_profdb *pd, **prev;
+
+	for ( prev = &slap_profile_dbs; ( pd = *prev ) != NULL;
+		prev = &pd->pd_next )
+	{
+		if ( pd->pd_suffix == suffix )
+			return pd;
+	}
+
+	pd = ch_calloc( 1, sizeof( slap_profdb ) );
+	pd->pd_suffix = suffix;
+	if ( suffix && !BER_BVISEMPTY( &suffix[0] ) ) {
+		ber_dupbv( &pd->pd_name, &suffix[0] );
+	} else {
+		ber_str2bv( "frontend", STRLENOF( "frontend" ), 1, &pd->pd_name );
+	}
+	*prev = pd;
+	return pd;
+}
+
+static void
+slap_profile_sample( void )
+{
+	slap_profslot *ps, **prev;
+	slap_profdb *pd;
+	int phase, opidx;
+
+	ldap_pvt_thread_mutex_lock( &slap_profile_mutex );
+	slap_profile_ticks++;
+	for ( prev = &slap_profile_slots; ( ps = *prev ) != NULL; ) {
+		if ( ps->ps_dead ) {
+			*prev = ps->ps_next;
+			ch_free( ps );
+			continue;
+		}
+		prev = &ps->ps_next;
+
+		phase = ps->ps_phase;
+		if ( phase == SLAP_PROF_NONE )
+			continue;
+		opidx = ps->ps_op;
+		pd = slap_profile_db( ps->ps_suffix );
+		pd->pd_samples[opidx][phase]++;
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_profile_mutex );
+}
+
+static void *
+slap_profile_thread( void *arg )
+{
+	struct timeval tv;
+
+	while ( !slap_profile_shutdown ) {
+		tv.tv_sec = slap_profile_interval / 1000;
+		tv.tv_usec = ( slap_profile_interval % 1000 ) * 1000;
+		select( 0, NULL, NULL, NULL, &tv );
+
+		/* databases may be going away while the pool is paused */
+		if ( slap_profile_shutdown || !slap_profile_interval ||
+			ldap_pvt_thread_pool_pausing( &connection_pool ) )
+			continue;
+		slap_profile_sample();
+	}
+	return NULL;
+}
+
+/*
+ * Copy the samples into *vals: the number of ticks, then one value
+ * per database and operation type with the samples in each phase.
+ */
+int
+slap_profile_list( BerVarray *vals )
+{
+	slap_profdb *pd;
+	struct berval bv;
+	char buf[ SLAP_TEXT_BUFLEN ];
+	unsigned long total;
+	int i, j, len, n = 1;
+
+	ldap_pvt_thread_mutex_lock( &slap_profile_mutex );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "interval=%d ticks=%lu",
+		slap_profile_interval, slap_profile_ticks );
+	value_add_one( vals, &bv );
+
+	for ( pd = slap_profile_dbs; pd; pd = pd->pd_next ) {
+		for ( i = 0; i < SLAP_OP_LAST; i++ ) {
+			total = 0;
+			for ( j = SLAP_PROF_OTHER; j < SLAP_PROF_LAST; j++ )
+				total += pd->pd_samples[i][j];
+			if ( !total )
+				continue;
+
+			len = snprintf( buf, sizeof( buf ), "%s %s samples=%lu",
+				pd->pd_name.bv_val, slap_profile_ops[i].bv_val, total );
+			for ( j = SLAP_PROF_OTHER + 1; j < SLAP_PROF_LAST; j++ ) {
+				if ( len >= sizeof( buf ) )
+					break;
+				len += snprintf( buf + len, sizeof( buf ) - len, " %s=%lu",
+					slap_profile_phases[j], pd->pd_samples[i][j] );
+			}
+			if ( len < sizeof( buf ) )
+				len += snprintf( buf + len, sizeof( buf ) - len, " %s=%lu",
+					slap_profile_phases[SLAP_PROF_OTHER],
+					pd->pd_samples[i][SLAP_PROF_OTHER] );
+			if ( len >= sizeof( buf ) )
+				len = sizeof( buf ) - 1;
+			bv.bv_len = len;
+			value_add_one( vals, &bv );
+			n++;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_profile_mutex );
+	return n;
+}
+
+/* Forget the samples taken so far */
+void
+slap_profile_reset( void )
+{
+	slap_profdb *pd;
+
+	ldap_pvt_thread_mutex_lock( &slap_profile_mutex );
+	while ( ( pd = slap_profile_dbs ) != NULL ) {
+		slap_profile_dbs = pd->pd_next;
+		ch_free( pd->pd_name.bv_val );
+		ch_free( pd );
+	}
+	slap_profile_ticks = 0;
+	ldap_pvt_thread_mutex_unlock( &slap_profile_mutex );
+}
+
+void
+slap_profile_init( void )
+{
+	ldap_pvt_thread_mutex_init( &slap_profile_mutex );
+}
+
+void
+slap_profile_destroy( void )
+{
+	slap_profslot *ps;
+
+	slap_profile_reset();
+	while ( ( ps = slap_profile_slots ) != NULL ) {
+		slap_profile_slots = ps->ps_next;
+		ch_free( ps );
+	}
+	ldap_pvt_thread_mutex_destroy( &slap_profile_mutex );
+}
+
+/* Start the sampler if profile_interval is set; also called when it is set online */
+int
+slap_profile_start( void )
+{
+	if ( !slap_profile_interval || slap_profile_running )
+		return 0;
+
+	slap_profile_shutdown = 0;
+	if ( ldap_pvt_thread_create( &slap_profile_tid, 0,
+		slap_profile_thread, NULL ) ) {
+		Debug( LDAP_DEBUG_ANY,
+			"slap_profile_start: unable to start sampler thread\n", 0, 0, 0 );
+		return -1;
+	}
+	slap_profile_running = 1;
+	return 0;
+}
+
+void
+slap_profile_stop( void )
+{
+	if ( !slap_profile_running )
+		return;
+
+	slap_profile_shutdown = 1;
+	ldap_pvt_thread_join( slap_profile_tid, NULL );
+	slap_profile_running = 0;
+}
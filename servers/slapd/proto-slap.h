@@ -72,6 +72,8 @@ LDAP_SLAPD_F (int) slap_access_always_allowed LDAP_P((
 
 LDAP_SLAPD_F (int) acl_check_modlist LDAP_P((
 	Operation *op, Entry *e, Modifications *ml ));
+LDAP_SLAPD_F (void) acl_entry_scope LDAP_P((
+	Operation *op, Entry *e ));
 
 LDAP_SLAPD_F (void) acl_append( AccessControl **l, AccessControl *a, int pos );
 
@@ -99,6 +101,7 @@ LDAP_SLAPD_F (int) acl_string_expand LDAP_P((
  * aclparse.c
  */
 LDAP_SLAPD_V (LDAP_CONST char *) style_strings[];
+LDAP_SLAPD_V (unsigned long) slap_acl_gen;
 
 LDAP_SLAPD_F (int) parse_acl LDAP_P(( Backend *be,
 	const char *fname, int lineno,
@@ -129,6 +132,7 @@ LDAP_SLAPD_F (int) slap_bv2ad LDAP_P((
 	const char **text ));
 
 LDAP_SLAPD_F (void) ad_destroy LDAP_P(( AttributeDescription * ));
+LDAP_SLAPD_F (void) ad_cache_flush LDAP_P(( void ));
 LDAP_SLAPD_F (int) ad_keystring LDAP_P(( struct berval *bv ));
 
 #define ad_cmp(l,r)	(((l)->ad_cname.bv_len < (r)->ad_cname.bv_len) \
@@ -407,6 +411,8 @@ LDAP_SLAPD_F( int )	backend_check_referrals LDAP_P((
 	Operation *op,
 	SlapReply *rs ));
 
+LDAP_SLAPD_F (void) backend_group_changed LDAP_P(( void ));
+LDAP_SLAPD_F (unsigned long) backend_group_gen LDAP_P(( void ));
 LDAP_SLAPD_F (int) backend_group LDAP_P((
 	Operation *op,
 	Entry *target,
@@ -781,6 +787,8 @@ LDAP_SLAPD_F (Connection *) connection_client_setup LDAP_P((
 	void *arg ));
 LDAP_SLAPD_F (void) connection_client_enable LDAP_P(( Connection *c ));
 LDAP_SLAPD_F (void) connection_client_stop LDAP_P(( Connection *c ));
+LDAP_SLAPD_F (void) connection_groups_free LDAP_P(( Connection *c ));
+LDAP_SLAPD_F (void) connection_sets_free LDAP_P(( Connection *c ));
 
 #ifdef LDAP_PF_LOCAL_SENDMSG
 #define LDAP_PF_LOCAL_SENDMSG_ARG(arg)	, arg
@@ -810,6 +818,10 @@ LDAP_SLAPD_F (int) connection_write LDAP_P((ber_socket_t s));
 LDAP_SLAPD_F (void) connection_op_finish LDAP_P((
 	Operation *op ));
 
+LDAP_SLAPD_V (slap_opclass_t) slap_opclasses[SLAP_OPCLASS_LAST];
+LDAP_SLAPD_V (int) slap_opclass_enabled;
+LDAP_SLAPD_F (void) connection_opclass_update LDAP_P((void));
+
 LDAP_SLAPD_F (unsigned long) connections_nextid(void);
 
 LDAP_SLAPD_F (Connection *) connection_first LDAP_P(( ber_socket_t * ));
@@ -889,6 +901,8 @@ LDAP_SLAPD_F (void) slap_resume_listeners LDAP_P((void));
 
 LDAP_SLAPD_F (int) slap_pause_server LDAP_P((void));
 LDAP_SLAPD_F (int) slap_unpause_server LDAP_P((void));
+LDAP_SLAPD_F (void) slap_retire LDAP_P((
+	void (*free_fn)( void *ptr ), void *ptr ));
 
 LDAP_SLAPD_F (void) slapd_set_write LDAP_P((ber_socket_t s, int wake));
 LDAP_SLAPD_F (void) slapd_clr_write LDAP_P((ber_socket_t s, int wake));
@@ -905,6 +919,10 @@ LDAP_SLAPD_V (slap_ssf_t) local_ssf;
 LDAP_SLAPD_V (struct runqueue_s) slapd_rq;
 LDAP_SLAPD_V (int) slapd_daemon_threads;
 LDAP_SLAPD_V (int) slapd_daemon_mask;
+LDAP_SLAPD_V (int) slapd_reuseport;
+#ifdef SLAP_X_IO_URING
+LDAP_SLAPD_V (Sockbuf_IO) slapd_sockbuf_io_uring;
+#endif
 #ifdef LDAP_TCP_BUFFER
 LDAP_SLAPD_V (int) slapd_tcp_rmem;
 LDAP_SLAPD_V (int) slapd_tcp_wmem;
@@ -952,6 +970,12 @@ LDAP_SLAPD_F (int) dnPrettyNormal LDAP_P((
 	struct berval *normal,
 	void *ctx ));
 
+LDAP_SLAPD_F (int) slap_dn_cache_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_dn_cache_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_dn_cache_flush LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_dn_cache_stats LDAP_P((
+	unsigned long *hits, unsigned long *misses ));
+
 LDAP_SLAPD_F (int) dnMatch LDAP_P(( 
 	int *matchp, 
 	slap_mask_t flags, 
@@ -1029,6 +1053,8 @@ LDAP_SLAPD_F (Entry *) str2entry LDAP_P(( char	*s ));
 LDAP_SLAPD_F (Entry *) str2entry2 LDAP_P(( char	*s, int checkvals ));
 LDAP_SLAPD_F (char *) entry2str LDAP_P(( Entry *e, int *len ));
 LDAP_SLAPD_F (char *) entry2str_wrap LDAP_P(( Entry *e, int *len, ber_len_t wrap ));
+LDAP_SLAPD_F (void) entry2str_append LDAP_P(( Entry *e, struct berval *bv,
+	ber_len_t *size, ber_len_t wrap ));
 
 LDAP_SLAPD_F (ber_len_t) entry_flatsize LDAP_P(( Entry *e, int norm ));
 LDAP_SLAPD_F (void) entry_partsize LDAP_P(( Entry *e, ber_len_t *len,
@@ -1229,6 +1255,8 @@ LDAP_SLAPD_F (int) limits_unparse LDAP_P((
 LDAP_SLAPD_F (void) limits_free_one LDAP_P(( 
 	struct slap_limits	*lm ));
 LDAP_SLAPD_F (void) limits_destroy LDAP_P(( struct slap_limits **lm ));
+LDAP_SLAPD_F (void) slap_limits_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_limits_destroy LDAP_P(( void ));
 
 /*
  * lock.c
@@ -1237,6 +1265,20 @@ LDAP_SLAPD_F (FILE *) lock_fopen LDAP_P(( const char *fname,
 	const char *type, FILE **lfp ));
 LDAP_SLAPD_F (int) lock_fclose LDAP_P(( FILE *fp, FILE *lfp ));
 
+/*
+ * logging.c
+ */
+LDAP_SLAPD_V (ber_len_t) slap_log_async_size;
+LDAP_SLAPD_V (int) slap_log_async;
+LDAP_SLAPD_F (void) slap_log_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_log_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (int) slap_log_start LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_log_stop LDAP_P(( void ));
+/* not format-checked, Statslog passes all of its arguments whether
+ * fmt uses them or not */
+LDAP_SLAPD_F (void) slap_log_push LDAP_P((
+	int level, const char *fmt, ... ));
+
 /*
  * main.c
  */
@@ -1264,6 +1306,27 @@ LDAP_SLAPD_F (int) slap_modrdn2mods LDAP_P((
 	Operation	*op,
 	SlapReply	*rs ));
 
+/*
+ * metrics.c
+ */
+LDAP_SLAPD_V( const struct berval ) slap_EXOP_METRICS;
+
+typedef struct slap_metrics slap_metrics;
+typedef void (SLAP_METRICS_FN) LDAP_P(( BackendDB *be, slap_metrics *ms ));
+
+LDAP_SLAPD_F (void) slap_metrics_add LDAP_P(( slap_metrics *ms,
+	const char *name, const char *type, BackendDB *be,
+	const char *labels, const char *fmt, ... ))
+	LDAP_GCCATTR((format(printf, 6, 7)));
+LDAP_SLAPD_F (int) slap_metrics_register LDAP_P(( BackendDB *be,
+	SLAP_METRICS_FN *fn ));
+LDAP_SLAPD_F (int) slap_metrics_unregister LDAP_P(( BackendDB *be,
+	SLAP_METRICS_FN *fn ));
+LDAP_SLAPD_F (int) slap_metrics_get LDAP_P(( struct berval *out ));
+LDAP_SLAPD_F (void) slap_metrics_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_metrics_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (SLAP_EXTOP_MAIN_FN) metrics_extop;
+
 /*
  * modify.c
  */
@@ -1493,12 +1556,19 @@ LDAP_SLAPD_F (int) parse_oidm LDAP_P((
 LDAP_SLAPD_F (void) slap_op_init LDAP_P(( void ));
 LDAP_SLAPD_F (void) slap_op_destroy LDAP_P(( void ));
 LDAP_SLAPD_F (void) slap_op_groups_free LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_op_sets_free LDAP_P(( Operation *op ));
 LDAP_SLAPD_F (void) slap_op_free LDAP_P(( Operation *op, void *ctx ));
 LDAP_SLAPD_F (void) slap_op_time LDAP_P(( time_t *t, int *n ));
 LDAP_SLAPD_F (Operation *) slap_op_alloc LDAP_P((
 	BerElement *ber, ber_int_t msgid,
 	ber_tag_t tag, ber_int_t id, void *ctx ));
 
+LDAP_SLAPD_V (int) slap_slowop_threshold;
+LDAP_SLAPD_V (int) slap_slowop_entries;
+LDAP_SLAPD_F (void) slap_optrace_add LDAP_P(( unsigned long *usec,
+	struct timeval *start ));
+LDAP_SLAPD_F (void) slap_optrace_done LDAP_P(( Operation *op, SlapReply *rs ));
+LDAP_SLAPD_F (int) slap_slowop_list LDAP_P(( BerVarray *vals ));
 LDAP_SLAPD_F (slap_op_t) slap_req2op LDAP_P(( ber_tag_t tag ));
 
 /*
@@ -1507,6 +1577,7 @@ LDAP_SLAPD_F (slap_op_t) slap_req2op LDAP_P(( ber_tag_t tag ));
 LDAP_SLAPD_F (Attribute *) slap_operational_subschemaSubentry( Backend *be );
 LDAP_SLAPD_F (Attribute *) slap_operational_entryDN( Entry *e );
 LDAP_SLAPD_F (Attribute *) slap_operational_hasSubordinate( int has );
+LDAP_SLAPD_F (Attribute *) slap_operational_numSubordinates( unsigned long n );
 
 /*
  * overlays.c
@@ -1549,12 +1620,32 @@ LDAP_SLAPD_F (int) slap_passwd_parse(
 	const char		**text );
 
 LDAP_SLAPD_F (void) slap_passwd_init (void);
+LDAP_SLAPD_F (void) slap_passwd_destroy (void);
+LDAP_SLAPD_F (void) slap_passwd_threads_set LDAP_P(( int threads ));
+LDAP_SLAPD_F (void) slap_passwd_metrics LDAP_P(( slap_metrics *ms ));
+LDAP_SLAPD_V (int) slap_passwd_threads;
+LDAP_SLAPD_V (int) slap_passwd_cache_size;
+LDAP_SLAPD_V (int) slap_passwd_cache_ttl;
 
 /*
  * phonetic.c
  */
 LDAP_SLAPD_F (char *) phonetic LDAP_P(( char *s ));
 
+/*
+ * profile.c
+ */
+LDAP_SLAPD_V (int) slap_profile_interval;
+LDAP_SLAPD_F (void) slap_profile_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_profile_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (int) slap_profile_start LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_profile_stop LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_profile_reset LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_profile_begin LDAP_P(( Operation *op,
+	slap_op_t opidx ));
+LDAP_SLAPD_F (void) slap_profile_end LDAP_P(( slap_profslot *ps ));
+LDAP_SLAPD_F (int) slap_profile_list LDAP_P(( BerVarray *vals ));
+
 /*
  * referral.c
  */
@@ -1626,6 +1717,16 @@ LDAP_SLAPD_F (void) slap_send_ldap_intermediate LDAP_P(( Operation *op, SlapRepl
 LDAP_SLAPD_F (void) slap_send_search_result LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_send_search_reference LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_send_search_entry LDAP_P(( Operation *op, SlapReply *rs ));
+LDAP_SLAPD_F (int) slap_read_cache_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_read_cache_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_read_cache_flush LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_read_cache_stats LDAP_P((
+	unsigned long *hits, unsigned long *misses ));
+LDAP_SLAPD_F (int) slap_read_cache_get LDAP_P(( Operation *op,
+	SlapReply *rs, int opattrs ));
+LDAP_SLAPD_F (void) slap_read_cache_done LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_send_flush LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_send_idle LDAP_P(( Operation *op ));
 LDAP_SLAPD_F (int) slap_null_cb LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_freeself_cb LDAP_P(( Operation *op, SlapReply *rs ));
 
@@ -1718,6 +1819,13 @@ LDAP_SLAPD_F (int) slap_sasl_regexp_config LDAP_P((
 LDAP_SLAPD_F (void) slap_sasl_regexp_unparse LDAP_P(( BerVarray *bva ));
 LDAP_SLAPD_F (int) slap_sasl_setpolicy LDAP_P(( const char * ));
 LDAP_SLAPD_F (const char *) slap_sasl_getpolicy LDAP_P(( void ));
+LDAP_SLAPD_V (int) slap_authz_cache_size;
+LDAP_SLAPD_V (int) slap_authz_cache_ttl;
+LDAP_SLAPD_F (void) slap_sasl_cache_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_sasl_cache_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_sasl_cache_flush LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_sasl_cache_update LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_sasl_cache_metrics LDAP_P(( slap_metrics *ms ));
 #ifdef SLAP_AUTH_REWRITE
 LDAP_SLAPD_F (int) slap_sasl_rewrite_config LDAP_P(( 
 	const char *fname,
@@ -1876,6 +1984,13 @@ LDAP_SLAPD_F (void *) slap_sl_mem_create LDAP_P((
 LDAP_SLAPD_F (void) slap_sl_mem_setctx LDAP_P(( void *ctx, void *memctx ));
 LDAP_SLAPD_F (void) slap_sl_mem_destroy LDAP_P(( void *key, void *data ));
 LDAP_SLAPD_F (void *) slap_sl_context LDAP_P(( void *ptr ));
+LDAP_SLAPD_F (void) slap_sl_mem_stats LDAP_P(( unsigned long *overflows,
+	unsigned long *fallbacks, unsigned long *fbytes, unsigned long *grows,
+	unsigned long *inuse ));
+LDAP_SLAPD_F (void) slap_sl_mem_charge LDAP_P(( ber_len_t size ));
+LDAP_SLAPD_F (void) slap_sl_mem_release LDAP_P(( void *ctx ));
+LDAP_SLAPD_F (ber_len_t) slap_sl_mem_used LDAP_P(( void *ctx ));
+LDAP_SLAPD_F (ber_len_t) slap_sl_mem_inuse LDAP_P(( void ));
 
 /*
  * starttls.c
@@ -1898,6 +2013,10 @@ LDAP_SLAPD_F (void) syncrepl_diff_entry LDAP_P((
 	Operation *op, Attribute *old, Attribute *anew,
 	Modifications **mods, Modifications **ml, int is_ctx ));
 LDAP_SLAPD_F (void) syncinfo_free LDAP_P(( struct syncinfo_s *, int all ));
+LDAP_SLAPD_F (void) syncrepl_metrics LDAP_P(( BackendDB *be,
+	slap_metrics *ms ));
+LDAP_SLAPD_F (int) syncrepl_monitor LDAP_P(( BackendDB *be,
+	BerVarray *vals ));
 
 /* syntax.c */
 LDAP_SLAPD_F (int) syn_is_sup LDAP_P((
@@ -1928,6 +2047,25 @@ LDAP_SLAPD_F (void) syn_delete LDAP_P(( Syntax *at ));
 LDAP_SLAPD_F (void) syn_unparse LDAP_P((
 	BerVarray *bva, Syntax *start, Syntax *end, int system ));
 
+/*
+ * trace.c
+ */
+LDAP_SLAPD_V (char *) slap_trace_file;
+LDAP_SLAPD_F (void) slap_trace_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_trace_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_trace_start LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_trace_stop LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_trace_reopen LDAP_P(( void ));
+LDAP_SLAPD_F (int) slap_trace_parse LDAP_P(( slap_tracectx *tc,
+	struct berval *val ));
+LDAP_SLAPD_F (void) slap_trace_new LDAP_P(( slap_tracectx *tc ));
+LDAP_SLAPD_F (void) slap_trace_child LDAP_P(( Operation *op,
+	slap_tracectx *parent ));
+LDAP_SLAPD_F (void) slap_trace_format LDAP_P(( slap_tracectx *tc,
+	struct berval *bv ));
+LDAP_SLAPD_F (void) slap_trace_span LDAP_P(( Operation *op,
+	const char *name, struct timeval *start, int err, int nentries ));
+
 /*
  * user.c
  */
@@ -2055,6 +2193,16 @@ LDAP_SLAPD_V (ber_len_t) sockbuf_max_incoming;
 LDAP_SLAPD_V (ber_len_t) sockbuf_max_incoming_auth;
 LDAP_SLAPD_V (int)		slap_conn_max_pending;
 LDAP_SLAPD_V (int)		slap_conn_max_pending_auth;
+LDAP_SLAPD_V (int)		slap_conn_max_pdus;
+LDAP_SLAPD_V (int)		slap_conn_output_buffer;
+LDAP_SLAPD_V (int)		slap_conn_group_cache;
+LDAP_SLAPD_V (int)		slap_conn_set_cache;
+LDAP_SLAPD_V (int)		slap_dn_cache_size;
+LDAP_SLAPD_V (int)		slap_read_cache_size;
+LDAP_SLAPD_V (ber_len_t)	slap_slab_size;
+LDAP_SLAPD_V (ber_len_t)	slap_slab_max_size;
+LDAP_SLAPD_V (ber_len_t)	slap_mem_budget;
+LDAP_SLAPD_V (ber_len_t)	slap_op_mem_budget;
 
 LDAP_SLAPD_V (slap_mask_t)	global_allows;
 LDAP_SLAPD_V (slap_mask_t)	global_disallows;
@@ -2092,7 +2240,9 @@ LDAP_SLAPD_V (time_t)		starttime;
 LDAP_SLAPD_V (ldap_pvt_thread_pool_t)	connection_pool;
 LDAP_SLAPD_V (int)			connection_pool_max;
 LDAP_SLAPD_V (int)			connection_pool_queues;
+LDAP_SLAPD_V (int)			connection_pool_affinity;
 LDAP_SLAPD_V (int)			slap_tool_thread_max;
+LDAP_SLAPD_V (unsigned long)		slap_tool_sortmem;
 
 LDAP_SLAPD_V (ldap_pvt_thread_mutex_t)	entry2str_mutex;
 
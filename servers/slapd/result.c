@@ -36,6 +36,7 @@
 #include <ac/unistd.h>
 
 #include "slap.h"
+#include "lutil.h"
 
 #if SLAP_STATS_ETIME
 #define ETIME_SETUP \
@@ -59,6 +60,13 @@
 #define StatslogEtime	Statslog
 #endif	/* SLAP_STATS_ETIME */
 
+/* Entries whose flattened size exceeds this are encoded with fixed-width
+ * definite lengths instead of DER. This is the only place that gives up
+ * DER for speed; liblber itself always compacts lengths in DER mode. */
+#ifndef SLAP_SEARCH_DER_MAX
+#define SLAP_SEARCH_DER_MAX	65536
+#endif
+
 const struct berval slap_dummy_bv = BER_BVNULL;
 
 int slap_null_cb( Operation *op, SlapReply *rs )
@@ -331,20 +339,48 @@ slap_writewait_play(
 	}
 }
 
+/* Is a coalescing buffer due to be written out? */
+static int
+send_ldap_ber_due( Connection *conn )
+{
+	struct timeval now;
+	ber_len_t len;
+	long ms;
+
+	ber_get_option( conn->c_outber, LBER_OPT_BER_BYTES_TO_WRITE, &len );
+	if ( len >= (ber_len_t)slap_conn_output_buffer )
+		return 1;
+
+	gettimeofday( &now, NULL );
+	ms = ( now.tv_sec - conn->c_outtime.tv_sec ) * 1000 +
+		( now.tv_usec - conn->c_outtime.tv_usec ) / 1000;
+	return ms >= SLAP_CONN_OUTPUT_DELAY;
+}
+
+/* Write one PDU, or with more set, queue it on the connection's
+ * output buffer so a run of search entries goes out in a few large
+ * writes. Anything already buffered is written ahead of the PDU,
+ * so responses stay in order. With a NULL ber, just write out
+ * whatever is buffered.
+ */
 static long send_ldap_ber(
 	Operation *op,
-	BerElement *ber )
+	BerElement *ber,
+	int more )
 {
 	Connection *conn = op->o_conn;
-	ber_len_t bytes;
+	BerElement *out = ber;
+	ber_len_t bytes = 0;
 	long ret = 0;
 	char *close_reason;
+	struct timeval wait;
 
-	ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
+	if ( ber )
+		ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
 
 	/* write only one pdu at a time - wait til it's our turn */
 	ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
-	if (( op->o_abandon && !op->o_cancel ) || !connection_valid( conn ) ||
+	if (( ber && op->o_abandon && !op->o_cancel ) || !connection_valid( conn ) ||
 		conn->c_writers < 0 ) {
 		ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
 		return 0;
@@ -352,11 +388,13 @@ static long send_ldap_ber(
 
 	conn->c_writers++;
 
+	SLAP_OPTRACE_BEGIN( op, wait );
 	while ( conn->c_writers > 0 && conn->c_writing ) {
 		ldap_pvt_thread_pool_idle( &connection_pool );
 		ldap_pvt_thread_cond_wait( &conn->c_write1_cv, &conn->c_write1_mutex );
 		ldap_pvt_thread_pool_unidle( &connection_pool );
 	}
+	SLAP_OPTRACE_END( op, ot_write, wait );
 
 	/* connection was closed under us */
 	if ( conn->c_writers < 0 ) {
@@ -371,11 +409,32 @@ static long send_ldap_ber(
 	/* Our turn */
 	conn->c_writing = 1;
 
+	if ( ber && ( more || conn->c_outber )) {
+		struct berval bv;
+
+		if ( !conn->c_outber ) {
+			conn->c_outber = ber_alloc_t( LBER_USE_DER );
+			gettimeofday( &conn->c_outtime, NULL );
+		}
+		if ( ber_flatten2( ber, &bv, 0 ) ||
+			ber_write( conn->c_outber, bv.bv_val, bv.bv_len, 0 ) < 0 ) {
+			close_reason = "output buffer error";
+			goto fail;
+		}
+		ret = bytes;
+		if ( more && !send_ldap_ber_due( conn ))
+			goto done;
+	}
+	if ( conn->c_outber )
+		out = conn->c_outber;
+	if ( !out )
+		goto done;
+
 	/* write the pdu */
 	while( 1 ) {
 		int err;
 
-		if ( ber_flush2( conn->c_sb, ber, LBER_FLUSH_FREE_NEVER ) == 0 ) {
+		if ( ber_flush2( conn->c_sb, out, LBER_FLUSH_FREE_NEVER ) == 0 ) {
 			ret = bytes;
 			break;
 		}
@@ -408,7 +467,9 @@ fail:
 		ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
 		ldap_pvt_thread_pool_idle( &connection_pool );
 		slap_writewait_play( op );
+		SLAP_OPTRACE_BEGIN( op, wait );
 		err = slapd_wait_writer( conn->c_sd );
+		SLAP_OPTRACE_END( op, ot_write, wait );
 		conn->c_writewaiter = 0;
 		ldap_pvt_thread_pool_unidle( &connection_pool );
 		ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
@@ -429,6 +490,12 @@ fail:
 		}
 	}
 
+	if ( out == conn->c_outber ) {
+		ber_free( out, 1 );
+		conn->c_outber = NULL;
+	}
+
+done:
 	conn->c_writing = 0;
 	if ( conn->c_writers < 0 ) {
 		conn->c_writers++;
@@ -443,6 +510,502 @@ fail:
 	return ret;
 }
 
+/* Write out any search results still held in the output buffer */
+void
+slap_send_flush( Operation *op )
+{
+	if ( op->o_conn && op->o_conn->c_outber )
+		send_ldap_ber( op, NULL, 0 );
+}
+
+/* For backends between search candidates: the next entry may be a
+ * long way off, so write out the buffer if it is already due rather
+ * than leave it until then.
+ */
+void
+slap_send_idle( Operation *op )
+{
+	Connection *conn = op->o_conn;
+	int due;
+
+	if ( !conn || !conn->c_outber )
+		return;
+
+	ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
+	due = !conn->c_writing && conn->c_outber &&
+		send_ldap_ber_due( conn );
+	ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
+	if ( due )
+		send_ldap_ber( op, NULL, 0 );
+}
+
+/* Search results may be coalesced unless the client is
+ * waiting on them as they happen.
+ */
+#ifdef LDAP_CONNECTIONLESS
+#define SLAP_SEND_MORE(op) ( slap_conn_output_buffer > 0 && \
+	!(op)->o_sync && !(op)->o_conn->c_is_udp )
+#else
+#define SLAP_SEND_MORE(op) ( slap_conn_output_buffer > 0 && !(op)->o_sync )
+#endif
+
+/*
+ * Cache of encoded SearchResultEntry protocolOps for base scope reads
+ * (read_cache_size, per database read_cache).  Buckets are selected by
+ * the entry's DN and hold READ_CACHE_WAYS variants of it, keyed by the
+ * request and by what access control may depend on: the requester's
+ * identity and security strength factors.  Writes invalidate the
+ * target's bucket; modrdn and cn=config changes flush everything.
+ * Every invalidation bumps its lock stripe's generation, and a search
+ * that missed only stores its result if the generation it saw before
+ * reading the entry is unchanged, so it cannot resurrect stale data.
+ */
+#define READ_CACHE_LOCKS	64
+#define READ_CACHE_WAYS	4
+#define READ_CACHE_MAXKEY	2048
+#define READ_CACHE_MAXPDU	262144
+
+typedef struct read_cache_slot {
+	struct berval	rcs_key;	/* starts with the entry's ndn */
+	ber_len_t	rcs_dnlen;
+	struct berval	rcs_pdu;	/* protocolOp, without the messageID */
+} read_cache_slot;
+
+typedef struct read_cache_lock {
+	ldap_pvt_thread_mutex_t	rcl_mutex;
+	unsigned long	rcl_gen;
+	unsigned long	rcl_hits;
+	unsigned long	rcl_misses;
+	char	rcl_pad[64];
+} read_cache_lock;
+
+static read_cache_slot *read_cache;
+static unsigned char *read_cache_next;
+static unsigned read_cache_mask;	/* of buckets */
+static read_cache_lock read_cache_locks[READ_CACHE_LOCKS];
+
+/* A search that missed, waiting in o_extra for its entry */
+typedef struct read_cache_miss {
+	OpExtra	rcm_oe;
+	struct berval	rcm_key;
+	ber_len_t	rcm_dnlen;
+	unsigned	rcm_bucket;
+	unsigned long	rcm_gen;
+} read_cache_miss;
+
+#define read_cache_lock_of(b)	(&read_cache_locks[ (b) & ( READ_CACHE_LOCKS - 1 ) ])
+
+int
+slap_read_cache_init( void )
+{
+	unsigned n;
+	int i;
+
+	if ( slap_read_cache_size <= 0 || read_cache != NULL ) {
+		return 0;
+	}
+
+	for ( n = READ_CACHE_LOCKS; n * READ_CACHE_WAYS < (unsigned)slap_read_cache_size; n <<= 1 )
+		;
+
+	read_cache = ch_calloc( n * READ_CACHE_WAYS, sizeof( read_cache_slot ) );
+	read_cache_next = ch_calloc( n, 1 );
+	read_cache_mask = n - 1;
+	for ( i = 0; i < READ_CACHE_LOCKS; i++ ) {
+		ldap_pvt_thread_mutex_init( &read_cache_locks[i].rcl_mutex );
+		read_cache_locks[i].rcl_gen = 0;
+		read_cache_locks[i].rcl_hits = 0;
+		read_cache_locks[i].rcl_misses = 0;
+	}
+
+	return 0;
+}
+
+static void
+read_cache_slot_free( read_cache_slot *rc )
+{
+	ch_free( rc->rcs_key.bv_val );
+	ch_free( rc->rcs_pdu.bv_val );
+	BER_BVZERO( &rc->rcs_key );
+	BER_BVZERO( &rc->rcs_pdu );
+	rc->rcs_dnlen = 0;
+}
+
+void
+slap_read_cache_flush( void )
+{
+	unsigned b;
+	int i;
+
+	if ( read_cache == NULL ) {
+		return;
+	}
+
+	for ( b = 0; b <= read_cache_mask; b++ ) {
+		read_cache_lock *rl = read_cache_lock_of( b );
+
+		ldap_pvt_thread_mutex_lock( &rl->rcl_mutex );
+		for ( i = 0; i < READ_CACHE_WAYS; i++ ) {
+			read_cache_slot_free( &read_cache[ b * READ_CACHE_WAYS + i ] );
+		}
+		rl->rcl_gen++;
+		ldap_pvt_thread_mutex_unlock( &rl->rcl_mutex );
+	}
+}
+
+void
+slap_read_cache_destroy( void )
+{
+	int i;
+
+	if ( read_cache == NULL ) {
+		return;
+	}
+
+	slap_read_cache_flush();
+	ch_free( read_cache );
+	ch_free( read_cache_next );
+	read_cache = NULL;
+	for ( i = 0; i < READ_CACHE_LOCKS; i++ ) {
+		ldap_pvt_thread_mutex_destroy( &read_cache_locks[i].rcl_mutex );
+	}
+}
+
+void
+slap_read_cache_stats( unsigned long *hits, unsigned long *misses )
+{
+	int i;
+
+	*hits = *misses = 0;
+	if ( read_cache == NULL ) {
+		return;
+	}
+
+	for ( i = 0; i < READ_CACHE_LOCKS; i++ ) {
+		ldap_pvt_thread_mutex_lock( &read_cache_locks[i].rcl_mutex );
+		*hits += read_cache_locks[i].rcl_hits;
+		*misses += read_cache_locks[i].rcl_misses;
+		ldap_pvt_thread_mutex_unlock( &read_cache_locks[i].rcl_mutex );
+	}
+}
+
+static unsigned
+read_cache_bucket( struct berval *ndn )
+{
+	unsigned h = 2166136261U;
+	ber_len_t i;
+
+	for ( i = 0; i < ndn->bv_len; i++ ) {
+		h ^= (unsigned char)ndn->bv_val[i];
+		h *= 16777619U;
+	}
+
+	return h & read_cache_mask;
+}
+
+/* Forget every variant of the entry ndn */
+static void
+read_cache_invalidate( struct berval *ndn )
+{
+	read_cache_slot *rc;
+	read_cache_lock *rl;
+	unsigned b;
+	int i;
+
+	b = read_cache_bucket( ndn );
+	rc = &read_cache[ b * READ_CACHE_WAYS ];
+	rl = read_cache_lock_of( b );
+
+	ldap_pvt_thread_mutex_lock( &rl->rcl_mutex );
+	for ( i = 0; i < READ_CACHE_WAYS; i++ ) {
+		if ( rc[i].rcs_dnlen == ndn->bv_len &&
+			!memcmp( rc[i].rcs_key.bv_val, ndn->bv_val, ndn->bv_len ))
+		{
+			read_cache_slot_free( &rc[i] );
+		}
+	}
+	rl->rcl_gen++;
+	ldap_pvt_thread_mutex_unlock( &rl->rcl_mutex );
+}
+
+/* Called with the result of every write */
+static void
+read_cache_write( Operation *op )
+{
+	if ( read_cache == NULL ) {
+		return;
+	}
+
+	switch ( op->o_tag ) {
+	case LDAP_REQ_ADD:
+	case LDAP_REQ_DELETE:
+	case LDAP_REQ_MODIFY:
+		if ( op->o_bd && SLAP_CONFIG( op->o_bd )) {
+			/* access, schema or the root DSE may have changed */
+			slap_read_cache_flush();
+		} else if ( op->o_tag == LDAP_REQ_DELETE && get_treeDelete( op )) {
+			/* removes a whole subtree */
+			slap_read_cache_flush();
+		} else {
+			read_cache_invalidate( &op->o_req_ndn );
+		}
+		break;
+	case LDAP_REQ_MODRDN:
+		/* renames a whole subtree */
+		slap_read_cache_flush();
+		break;
+	}
+}
+
+/*
+ * Build the cache key of a base search: the target ndn, then the
+ * parameters that shape the response and what ACLs may look at.
+ * Returns 0 if this search must not be cached.  Operational
+ * attributes of database entries may be computed on the fly
+ * (hasSubordinates, contextCSN...), so unless opattrs is set only
+ * requests for user attributes qualify.
+ */
+static int
+read_cache_key( Operation *op, int opattrs, struct berval *key )
+{
+	AttributeName *an;
+	slap_ssf_t ssf[4];
+	ber_len_t len;
+	char *ptr;
+
+	if ( op->ors_scope != LDAP_SCOPE_BASE ||
+		op->o_protocol < LDAP_VERSION3 ||
+		op->ors_slimit == 0 ||
+		op->o_ctrls != NULL ||
+		op->o_res_ber != NULL ||
+		op->o_conn == NULL
+#ifdef LDAP_CONNECTIONLESS
+		|| op->o_conn->c_is_udp
+#endif
+		)
+	{
+		return 0;
+	}
+
+	len = op->o_req_ndn.bv_len + op->o_ndn.bv_len +
+		op->ors_filterstr.bv_len + 3 + 2 + sizeof( ssf );
+	for ( an = op->ors_attrs; an && !BER_BVISNULL( &an->an_name ); an++ ) {
+		if ( !opattrs && ( an->an_desc
+			? is_at_operational( an->an_desc->ad_type )
+			: bvmatch( &an->an_name, slap_bv_all_operational_attrs )))
+		{
+			return 0;
+		}
+		len += an->an_name.bv_len + 1;
+	}
+	if ( len > READ_CACHE_MAXKEY ) {
+		return 0;
+	}
+
+	ssf[0] = op->o_ssf;
+	ssf[1] = op->o_transport_ssf;
+	ssf[2] = op->o_tls_ssf;
+	ssf[3] = op->o_sasl_ssf;
+
+	key->bv_val = op->o_tmpalloc( len, op->o_tmpmemctx );
+	ptr = lutil_strbvcopy( key->bv_val, &op->o_req_ndn );
+	*ptr++ = '\0';
+	ptr = lutil_strbvcopy( ptr, &op->o_ndn );
+	*ptr++ = '\0';
+	ptr = lutil_strbvcopy( ptr, &op->ors_filterstr );
+	*ptr++ = '\0';
+	for ( an = op->ors_attrs; an && !BER_BVISNULL( &an->an_name ); an++ ) {
+		ptr = lutil_strbvcopy( ptr, &an->an_name );
+		*ptr++ = ',';
+	}
+	*ptr++ = (char)op->ors_deref;
+	*ptr++ = (char)op->ors_attrsonly;
+	AC_MEMCPY( ptr, ssf, sizeof( ssf ));
+	ptr += sizeof( ssf );
+	key->bv_len = ptr - key->bv_val;
+
+	return 1;
+}
+
+/*
+ * Answer a base search from the read cache.  Returns 1 when the entry
+ * and the final result were sent.  Otherwise, if the search may be
+ * cached, the entry it sends will be stored; the caller must call
+ * slap_read_cache_done() once the search is over.
+ */
+int
+slap_read_cache_get( Operation *op, SlapReply *rs, int opattrs )
+{
+	read_cache_slot *rc;
+	read_cache_lock *rl;
+	read_cache_miss *rcm;
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *) &berbuf;
+	struct berval key;
+	unsigned b;
+	long bytes;
+	int i, err;
+
+	if ( read_cache == NULL || !read_cache_key( op, opattrs, &key )) {
+		return 0;
+	}
+
+	b = read_cache_bucket( &op->o_req_ndn );
+	rc = &read_cache[ b * READ_CACHE_WAYS ];
+	rl = read_cache_lock_of( b );
+
+	ldap_pvt_thread_mutex_lock( &rl->rcl_mutex );
+	for ( i = 0; i < READ_CACHE_WAYS; i++ ) {
+		if ( bvmatch( &rc[i].rcs_key, &key ))
+			break;
+	}
+	if ( i == READ_CACHE_WAYS ) {
+		rl->rcl_misses++;
+		rcm = op->o_tmpalloc( sizeof( read_cache_miss ), op->o_tmpmemctx );
+		rcm->rcm_oe.oe_key = (void *)slap_read_cache_get;
+		rcm->rcm_key = key;
+		rcm->rcm_dnlen = op->o_req_ndn.bv_len;
+		rcm->rcm_bucket = b;
+		rcm->rcm_gen = rl->rcl_gen;
+		ldap_pvt_thread_mutex_unlock( &rl->rcl_mutex );
+		LDAP_SLIST_INSERT_HEAD( &op->o_extra, &rcm->rcm_oe, oe_next );
+		return 0;
+	}
+	rl->rcl_hits++;
+
+	/* Copy the PDU out under the lock, then send it unlocked */
+	ber_init2( ber, NULL, LBER_USE_DER );
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+	err = ber_printf( ber, "{i" /*}*/, op->o_msgid );
+	if ( err != -1 && ber_write( ber, rc[i].rcs_pdu.bv_val,
+		rc[i].rcs_pdu.bv_len, 0 ) < 0 )
+	{
+		err = -1;
+	}
+	ldap_pvt_thread_mutex_unlock( &rl->rcl_mutex );
+	op->o_tmpfree( key.bv_val, op->o_tmpmemctx );
+
+	if ( err != -1 ) {
+		err = ber_printf( ber, /*{*/ "N}" );
+	}
+	if ( err == -1 ) {
+		ber_free_buf( ber );
+		return 0;
+	}
+
+	Statslog( LDAP_DEBUG_STATS2, "%s ENTRY dn=\"%s\" (cached)\n",
+		op->o_log_prefix, op->o_req_ndn.bv_val, 0, 0, 0 );
+
+	bytes = send_ldap_ber( op, ber, SLAP_SEND_MORE( op ));
+	ber_free_buf( ber );
+	if ( bytes < 0 ) {
+		rs->sr_err = LDAP_UNAVAILABLE;
+		return 1;
+	}
+	rs->sr_nentries++;
+
+	SLAP_COUNTERS_LOCK( op->o_counters );
+	SLAP_COUNTER_ADD( op->o_counters->sc_bytes, (unsigned long)bytes );
+	SLAP_COUNTER_ADD( op->o_counters->sc_entries, 1 );
+	SLAP_COUNTER_ADD( op->o_counters->sc_pdu, 1 );
+	SLAP_COUNTERS_UNLOCK( op->o_counters );
+
+	rs->sr_err = LDAP_SUCCESS;
+	send_ldap_result( op, rs );
+	return 1;
+}
+
+/* Store the entry an uncached base search is sending, given its PDU */
+static void
+read_cache_put( Operation *op, SlapReply *rs, struct berval *pdu )
+{
+	OpExtra *oex;
+	read_cache_miss *rcm;
+	read_cache_slot *rc;
+	read_cache_lock *rl;
+	ber_tag_t tag;
+	ber_len_t len;
+	unsigned char *p, *end;
+	int i, n;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == (void *)slap_read_cache_get )
+			break;
+	}
+	if ( !oex )
+		return;
+	rcm = (read_cache_miss *)oex;
+
+	/* Only the entry itself, as it was asked for, without controls */
+	if ( rs->sr_ctrls || pdu->bv_len > READ_CACHE_MAXPDU ||
+		!dn_match( &rs->sr_entry->e_nname, &op->o_req_ndn ))
+		return;
+
+	/* Skip the LDAPMessage header and the messageID */
+	p = (unsigned char *)pdu->bv_val;
+	end = p + pdu->bv_len;
+	for ( n = 0; n < 2; n++ ) {
+		if ( end - p < 2 )
+			return;
+		tag = *p++;
+		len = *p++;
+		if ( len & 0x80U ) {
+			i = len & 0x7fU;
+			if ( i > (int)sizeof( ber_len_t ) || end - p < i )
+				return;
+			for ( len = 0; i > 0; i-- )
+				len = ( len << 8 ) | *p++;
+		}
+		if ( n == 0 ) {
+			if ( tag != LBER_SEQUENCE || len != (ber_len_t)( end - p ))
+				return;
+		} else {
+			if ( tag != LBER_INTEGER || len > (ber_len_t)( end - p ))
+				return;
+			p += len;
+		}
+	}
+
+	rc = &read_cache[ rcm->rcm_bucket * READ_CACHE_WAYS ];
+	rl = read_cache_lock_of( rcm->rcm_bucket );
+
+	ldap_pvt_thread_mutex_lock( &rl->rcl_mutex );
+	if ( rl->rcl_gen == rcm->rcm_gen ) {
+		for ( i = 0; i < READ_CACHE_WAYS; i++ ) {
+			if ( bvmatch( &rc[i].rcs_key, &rcm->rcm_key ))
+				break;
+		}
+		if ( i == READ_CACHE_WAYS ) {
+			i = read_cache_next[ rcm->rcm_bucket ]++ % READ_CACHE_WAYS;
+			read_cache_slot_free( &rc[i] );
+			ber_dupbv( &rc[i].rcs_key, &rcm->rcm_key );
+			rc[i].rcs_dnlen = rcm->rcm_dnlen;
+			rc[i].rcs_pdu.bv_len = end - p;
+			rc[i].rcs_pdu.bv_val = ch_malloc( end - p );
+			AC_MEMCPY( rc[i].rcs_pdu.bv_val, p, end - p );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &rl->rcl_mutex );
+}
+
+void
+slap_read_cache_done( Operation *op )
+{
+	OpExtra *oex;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == (void *)slap_read_cache_get )
+			break;
+	}
+	if ( oex ) {
+		read_cache_miss *rcm = (read_cache_miss *)oex;
+
+		LDAP_SLIST_REMOVE( &op->o_extra, oex, OpExtra, oe_next );
+		op->o_tmpfree( rcm->rcm_key.bv_val, op->o_tmpmemctx );
+		op->o_tmpfree( rcm, op->o_tmpmemctx );
+	}
+}
+
 static int
 send_ldap_control( BerElement *ber, LDAPControl *c )
 {
@@ -619,6 +1182,9 @@ send_ldap_response(
 	BerElement	*ber = (BerElement *) &berbuf;
 	int		rc = LDAP_SUCCESS;
 	long	bytes;
+	int		prof;
+
+	SLAP_PROFILE_ENTER( op, SLAP_PROF_SEND, prof );
 
 	/* op was actually aborted, bypass everything if client didn't Cancel */
 	if (( rs->sr_err == SLAPD_ABANDON ) && !op->o_cancel ) {
@@ -749,7 +1315,7 @@ send_ldap_response(
 	}
 
 	/* send BER */
-	bytes = send_ldap_ber( op, ber );
+	bytes = send_ldap_ber( op, ber, 0 );
 #ifdef LDAP_CONNECTIONLESS
 	if (!op->o_conn || op->o_conn->c_is_udp == 0)
 #endif
@@ -765,10 +1331,10 @@ send_ldap_response(
 		goto cleanup;
 	}
 
-	ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex );
-	ldap_pvt_mp_add_ulong( op->o_counters->sc_pdu, 1 );
-	ldap_pvt_mp_add_ulong( op->o_counters->sc_bytes, (unsigned long)bytes );
-	ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex );
+	SLAP_COUNTERS_LOCK( op->o_counters );
+	SLAP_COUNTER_ADD( op->o_counters->sc_pdu, 1 );
+	SLAP_COUNTER_ADD( op->o_counters->sc_bytes, (unsigned long)bytes );
+	SLAP_COUNTERS_UNLOCK( op->o_counters );
 
 cleanup:;
 	/* Tell caller that we did this for real, as opposed to being
@@ -805,6 +1371,7 @@ clean2:;
 		}
 	}
 
+	SLAP_PROFILE_LEAVE( op, prof );
 	return rc;
 }
 
@@ -858,6 +1425,9 @@ slap_send_ldap_result( Operation *op, SlapReply *rs )
 
 	rs->sr_type = REP_RESULT;
 
+	/* Before the client can hear the write is done, even if abandoned */
+	read_cache_write( op );
+
 	/* Propagate Abandons so that cleanup callbacks can be processed */
 	if ( rs->sr_err == SLAPD_ABANDON || op->o_abandon )
 		goto abandon;
@@ -919,6 +1489,7 @@ abandon:
 				op->o_log_prefix, rs->sr_tag, rs->sr_err,
 				rs->sr_text ? rs->sr_text : "", 0 );
 		}
+		slap_optrace_done( op, rs );
 	}
 
 	if( tmp != NULL ) ch_free(tmp);
@@ -971,6 +1542,7 @@ slap_send_ldap_extended( Operation *op, SlapReply *rs )
 			"%s RESULT oid=%s err=%d "ETIME_LOGFMT"text=%s\n",
 			op->o_log_prefix, rs->sr_rspoid ? rs->sr_rspoid : "",
 			rs->sr_err, rs->sr_text ? rs->sr_text : "", 0 );
+		slap_optrace_done( op, rs );
 	}
 }
 
@@ -1020,6 +1592,8 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	int		userattrs;
 	AccessControlState acl_state = ACL_STATE_INIT;
 	int			 attrsonly;
+	int			 prof;
+	int			 scoped = 0;
 	AttributeDescription *ad_entry = slap_schema.si_ad_entry;
 
 	/* a_flags: array of flags telling if the i-th element will be
@@ -1029,12 +1603,22 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	char **e_flags = NULL;
 
 	rs->sr_type = REP_SEARCH;
+	SLAP_PROFILE_ENTER( op, SLAP_PROF_SEND, prof );
 
 	if ( op->ors_slimit >= 0 && rs->sr_nentries >= op->ors_slimit ) {
 		rc = LDAP_SIZELIMIT_EXCEEDED;
 		goto error_return;
 	}
 
+	if ( slap_op_mem_budget &&
+		slap_sl_mem_used( op->o_tmpmemctx ) > slap_op_mem_budget &&
+		!be_isroot( op ))
+	{
+		rc = LDAP_ADMINLIMIT_EXCEEDED;
+		rs->sr_text = "operation memory budget exceeded";
+		goto error_return;
+	}
+
 	/* Every 64 entries, check for thread pool pause */
 	if ( ( ( rs->sr_nentries & 0x3f ) == 0x3f ) &&
 		ldap_pvt_thread_pool_pausing( &connection_pool ) > 0 )
@@ -1072,6 +1656,10 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 
 	attrsonly = op->ors_attrsonly;
 
+	/* The entry stays as is until we're done encoding it */
+	acl_entry_scope( op, rs->sr_entry );
+	scoped = 1;
+
 	if ( !access_allowed( op, rs->sr_entry, ad_entry, NULL, ACL_READ, NULL )) {
 		Debug( LDAP_DEBUG_ACL,
 			"send_search_entry: conn %lu access to entry (%s) not allowed\n", 
@@ -1090,7 +1678,14 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		bv.bv_len = entry_flatsize( rs->sr_entry, 0 );
 		bv.bv_val = op->o_tmpalloc( bv.bv_len, op->o_tmpmemctx );
 
-		ber_init2( ber, &bv, LBER_USE_DER );
+		/* Closing a sequence in DER mode slides its contents down over
+		 * the unused length octets, so every value of a large entry is
+		 * copied once per nesting level after being encoded. RFC 4511
+		 * only requires definite lengths; skip the compaction for big
+		 * entries and let the values be copied into the buffer once.
+		 */
+		ber_init2( ber, &bv, bv.bv_len > SLAP_SEARCH_DER_MAX
+			? 0 : LBER_USE_DER );
 		ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
 	}
 
@@ -1472,13 +2067,22 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		goto error_return;
 	}
 
+	if ( read_cache && op->o_res_ber == NULL &&
+		!LDAP_SLIST_EMPTY( &op->o_extra ))
+	{
+		struct berval pdu;
+
+		if ( ber_flatten2( ber, &pdu, 0 ) == 0 )
+			read_cache_put( op, rs, &pdu );
+	}
+
 	Statslog( LDAP_DEBUG_STATS2, "%s ENTRY dn=\"%s\"\n",
 	    op->o_log_prefix, rs->sr_entry->e_nname.bv_val, 0, 0, 0 );
 
 	rs_flush_entry( op, rs, NULL );
 
 	if ( op->o_res_ber == NULL ) {
-		bytes = send_ldap_ber( op, ber );
+		bytes = send_ldap_ber( op, ber, SLAP_SEND_MORE( op ));
 		ber_free_buf( ber );
 
 		if ( bytes < 0 ) {
@@ -1491,11 +2095,11 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		}
 		rs->sr_nentries++;
 
-		ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex );
-		ldap_pvt_mp_add_ulong( op->o_counters->sc_bytes, (unsigned long)bytes );
-		ldap_pvt_mp_add_ulong( op->o_counters->sc_entries, 1 );
-		ldap_pvt_mp_add_ulong( op->o_counters->sc_pdu, 1 );
-		ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex );
+		SLAP_COUNTERS_LOCK( op->o_counters );
+		SLAP_COUNTER_ADD( op->o_counters->sc_bytes, (unsigned long)bytes );
+		SLAP_COUNTER_ADD( op->o_counters->sc_entries, 1 );
+		SLAP_COUNTER_ADD( op->o_counters->sc_pdu, 1 );
+		SLAP_COUNTERS_UNLOCK( op->o_counters );
 	}
 
 	Debug( LDAP_DEBUG_TRACE,
@@ -1504,6 +2108,10 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	rc = LDAP_SUCCESS;
 
 error_return:;
+	if ( scoped ) {
+		acl_entry_scope( op, NULL );
+	}
+
 	if ( op->o_callback ) {
 		(void)slap_cleanup_play( op, rs );
 	}
@@ -1533,6 +2141,7 @@ error_return:;
 		}
 	}
 
+	SLAP_PROFILE_LEAVE( op, prof );
 	return( rc );
 }
 
@@ -1646,17 +2255,17 @@ slap_send_search_reference( Operation *op, SlapReply *rs )
 #ifdef LDAP_CONNECTIONLESS
 	if (!op->o_conn || op->o_conn->c_is_udp == 0) {
 #endif
-	bytes = send_ldap_ber( op, ber );
+	bytes = send_ldap_ber( op, ber, SLAP_SEND_MORE( op ));
 	ber_free_buf( ber );
 
 	if ( bytes < 0 ) {
 		rc = LDAP_UNAVAILABLE;
 	} else {
-		ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex );
-		ldap_pvt_mp_add_ulong( op->o_counters->sc_bytes, (unsigned long)bytes );
-		ldap_pvt_mp_add_ulong( op->o_counters->sc_refs, 1 );
-		ldap_pvt_mp_add_ulong( op->o_counters->sc_pdu, 1 );
-		ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex );
+		SLAP_COUNTERS_LOCK( op->o_counters );
+		SLAP_COUNTER_ADD( op->o_counters->sc_bytes, (unsigned long)bytes );
+		SLAP_COUNTER_ADD( op->o_counters->sc_refs, 1 );
+		SLAP_COUNTER_ADD( op->o_counters->sc_pdu, 1 );
+		SLAP_COUNTERS_UNLOCK( op->o_counters );
 	}
 #ifdef LDAP_CONNECTIONLESS
 	}
@@ -1251,6 +1251,8 @@ int slap_sasl_init( void )
 	rewrite_mapper_register( &slapd_mapper );
 #endif
 
+	slap_sasl_cache_init();
+
 #ifdef HAVE_CYRUS_SASL
 #ifdef HAVE_SASL_VERSION
 	/* stringify the version number, sasl.h doesn't do it for us */
@@ -1331,6 +1333,8 @@ int slap_sasl_destroy( void )
 	free( sasl_host );
 	sasl_host = NULL;
 
+	slap_sasl_cache_destroy();
+
 	return 0;
 }
 
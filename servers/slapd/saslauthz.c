@@ -98,6 +98,250 @@ static int
 slap_sasl_match( Operation *opx, struct berval *rule,
 	struct berval *assertDN, struct berval *authc );
 
+/*
+ * Cache of positive answers, so that clients using proxied
+ * authorization on every request don't repeat the rule evaluation
+ * and the internal searches each time. One cache holds
+ * slap_sasl_authorized() decisions keyed by (authcDN, authzDN),
+ * the other slap_sasl2dn() results keyed by the SASL name.
+ * Both are flushed when authz rules or the authz configuration
+ * change; entries also expire after slap_authz_cache_ttl seconds,
+ * which bounds the staleness of search based rules and of changes
+ * arriving by replication.
+ */
+int slap_authz_cache_size = 0;
+int slap_authz_cache_ttl = 60;
+
+typedef struct authz_cached {
+	struct berval ac_key;
+	struct berval ac_dn;
+	BackendDB *ac_be;
+	time_t ac_time;
+	LDAP_TAILQ_ENTRY(authz_cached) ac_lru;
+} authz_cached;
+
+typedef struct authz_cache {
+	ldap_pvt_thread_mutex_t ax_mutex;
+	Avlnode *ax_tree;
+	LDAP_TAILQ_HEAD(ax_lru, authz_cached) ax_lru;
+	int ax_num;
+	unsigned long ax_hits;
+	unsigned long ax_misses;
+	const char *ax_name;
+} authz_cache;
+
+static authz_cache authz_decisions, authz_names;
+
+static int
+authz_cached_cmp( const void *v1, const void *v2 )
+{
+	const authz_cached *a1 = v1, *a2 = v2;
+	int rc = a1->ac_key.bv_len - a2->ac_key.bv_len;
+
+	if ( rc == 0 )
+		rc = memcmp( a1->ac_key.bv_val, a2->ac_key.bv_val,
+			a1->ac_key.bv_len );
+	return rc;
+}
+
+static void
+authz_cached_free( void *v )
+{
+	authz_cached *ac = v;
+
+	ch_free( ac->ac_dn.bv_val );
+	ch_free( ac );
+}
+
+static void
+authz_cache_flush( authz_cache *ax )
+{
+	ldap_pvt_thread_mutex_lock( &ax->ax_mutex );
+	avl_free( ax->ax_tree, authz_cached_free );
+	ax->ax_tree = NULL;
+	LDAP_TAILQ_INIT( &ax->ax_lru );
+	ax->ax_num = 0;
+	ldap_pvt_thread_mutex_unlock( &ax->ax_mutex );
+}
+
+/* Build "part1\0part2" in buf, or in a temporary buffer if too long */
+static void
+authz_cache_key( Operation *op, struct berval *key, char *buf, ber_len_t size,
+	struct berval *part1, struct berval *part2 )
+{
+	key->bv_len = part1->bv_len + 1 + part2->bv_len;
+	key->bv_val = key->bv_len < size ? buf :
+		op->o_tmpalloc( key->bv_len + 1, op->o_tmpmemctx );
+	AC_MEMCPY( key->bv_val, part1->bv_val, part1->bv_len );
+	key->bv_val[part1->bv_len] = '\0';
+	AC_MEMCPY( key->bv_val + part1->bv_len + 1, part2->bv_val, part2->bv_len );
+}
+
+/* Returns 1 and a copy of the cached DN on a hit */
+static int
+authz_cache_get( Operation *op, authz_cache *ax, struct berval *key,
+	struct berval *dn, BackendDB **be )
+{
+	authz_cached ac, *found;
+	int rc = 0;
+
+	if ( slap_authz_cache_size <= 0 )
+		return 0;
+
+	ac.ac_key = *key;
+	ldap_pvt_thread_mutex_lock( &ax->ax_mutex );
+	found = avl_find( ax->ax_tree, &ac, authz_cached_cmp );
+	if ( found && found->ac_time + slap_authz_cache_ttl <= slap_get_time() ) {
+		avl_delete( &ax->ax_tree, found, authz_cached_cmp );
+		LDAP_TAILQ_REMOVE( &ax->ax_lru, found, ac_lru );
+		ax->ax_num--;
+		authz_cached_free( found );
+		found = NULL;
+	}
+	if ( found ) {
+		LDAP_TAILQ_REMOVE( &ax->ax_lru, found, ac_lru );
+		LDAP_TAILQ_INSERT_HEAD( &ax->ax_lru, found, ac_lru );
+		if ( dn )
+			ber_dupbv_x( dn, &found->ac_dn, op->o_tmpmemctx );
+		if ( be )
+			*be = found->ac_be;
+		ax->ax_hits++;
+		rc = 1;
+	} else {
+		ax->ax_misses++;
+	}
+	ldap_pvt_thread_mutex_unlock( &ax->ax_mutex );
+	return rc;
+}
+
+static void
+authz_cache_put( authz_cache *ax, struct berval *key, struct berval *dn,
+	BackendDB *be )
+{
+	authz_cached *ac, *old;
+
+	if ( slap_authz_cache_size <= 0 )
+		return;
+
+	ac = ch_malloc( sizeof( authz_cached ) + key->bv_len + 1 );
+	ac->ac_key.bv_val = (char *)(ac + 1);
+	ac->ac_key.bv_len = key->bv_len;
+	AC_MEMCPY( ac->ac_key.bv_val, key->bv_val, key->bv_len );
+	ac->ac_key.bv_val[key->bv_len] = '\0';
+	if ( dn )
+		ber_dupbv( &ac->ac_dn, dn );
+	else
+		BER_BVZERO( &ac->ac_dn );
+	ac->ac_be = be;
+	ac->ac_time = slap_get_time();
+
+	ldap_pvt_thread_mutex_lock( &ax->ax_mutex );
+	if ( avl_insert( &ax->ax_tree, ac, authz_cached_cmp, avl_dup_error )) {
+		/* someone else got here first */
+		ldap_pvt_thread_mutex_unlock( &ax->ax_mutex );
+		authz_cached_free( ac );
+		return;
+	}
+	LDAP_TAILQ_INSERT_HEAD( &ax->ax_lru, ac, ac_lru );
+	ax->ax_num++;
+	while ( ax->ax_num > slap_authz_cache_size ) {
+		old = LDAP_TAILQ_LAST( &ax->ax_lru, ax_lru );
+		LDAP_TAILQ_REMOVE( &ax->ax_lru, old, ac_lru );
+		avl_delete( &ax->ax_tree, old, authz_cached_cmp );
+		ax->ax_num--;
+		authz_cached_free( old );
+	}
+	ldap_pvt_thread_mutex_unlock( &ax->ax_mutex );
+}
+
+void
+slap_sasl_cache_flush( void )
+{
+	authz_cache_flush( &authz_decisions );
+	authz_cache_flush( &authz_names );
+}
+
+/* Called by the frontend after a successful update */
+void
+slap_sasl_cache_update( Operation *op )
+{
+	Modifications *ml;
+
+	if ( slap_authz_cache_size <= 0 )
+		return;
+
+	switch ( op->o_tag ) {
+	case LDAP_REQ_ADD:
+		if ( !attr_find( op->ora_e->e_attrs, slap_schema.si_ad_saslAuthzTo ) &&
+			!attr_find( op->ora_e->e_attrs, slap_schema.si_ad_saslAuthzFrom ))
+			return;
+		break;
+
+	case LDAP_REQ_MODIFY:
+		for ( ml = op->orm_modlist; ml; ml = ml->sml_next ) {
+			if ( ml->sml_desc == slap_schema.si_ad_saslAuthzTo ||
+				ml->sml_desc == slap_schema.si_ad_saslAuthzFrom )
+				break;
+		}
+		if ( !ml )
+			return;
+		break;
+
+	default:
+		/* a rule holder or a DN named by rules may have gone */
+		break;
+	}
+	slap_sasl_cache_flush();
+}
+
+void
+slap_sasl_cache_init( void )
+{
+	ldap_pvt_thread_mutex_init( &authz_decisions.ax_mutex );
+	LDAP_TAILQ_INIT( &authz_decisions.ax_lru );
+	authz_decisions.ax_name = "decision";
+	ldap_pvt_thread_mutex_init( &authz_names.ax_mutex );
+	LDAP_TAILQ_INIT( &authz_names.ax_lru );
+	authz_names.ax_name = "sasl2dn";
+}
+
+void
+slap_sasl_cache_destroy( void )
+{
+	slap_sasl_cache_flush();
+	ldap_pvt_thread_mutex_destroy( &authz_decisions.ax_mutex );
+	ldap_pvt_thread_mutex_destroy( &authz_names.ax_mutex );
+}
+
+static void
+authz_cache_metrics( slap_metrics *ms, authz_cache *ax )
+{
+	char labels[ 32 ];
+	unsigned long hits, misses;
+	int num;
+
+	ldap_pvt_thread_mutex_lock( &ax->ax_mutex );
+	hits = ax->ax_hits;
+	misses = ax->ax_misses;
+	num = ax->ax_num;
+	ldap_pvt_thread_mutex_unlock( &ax->ax_mutex );
+
+	snprintf( labels, sizeof( labels ), "cache=\"%s\"", ax->ax_name );
+	slap_metrics_add( ms, "slapd_authz_cache_hits_total", "counter",
+		NULL, labels, "%lu", hits );
+	slap_metrics_add( ms, "slapd_authz_cache_misses_total", "counter",
+		NULL, labels, "%lu", misses );
+	slap_metrics_add( ms, "slapd_authz_cache_entries", "gauge",
+		NULL, labels, "%d", num );
+}
+
+void
+slap_sasl_cache_metrics( slap_metrics *ms )
+{
+	authz_cache_metrics( ms, &authz_decisions );
+	authz_cache_metrics( ms, &authz_names );
+}
+
 int slap_sasl_setpolicy( const char *arg )
 {
 	int rc = LDAP_SUCCESS;
@@ -115,6 +359,8 @@ int slap_sasl_setpolicy( const char *arg )
 	} else {
 		rc = LDAP_OTHER;
 	}
+	if ( rc == LDAP_SUCCESS )
+		slap_sasl_cache_flush();
 	return rc;
 }
 
@@ -1299,6 +1545,7 @@ int slap_sasl_rewrite_config(
 	argv[0] += STRLENOF( "authid-" );
  	rc = rewrite_parse( sasl_rwinfo, fname, lineno, argc, argv );
 	argv[0] = savearg0;
+	slap_sasl_cache_flush();
 
 	return rc;
 }
@@ -1392,6 +1639,7 @@ int slap_sasl_regexp_config( const char *match, const char *replace )
 		reg->sr_replace = ch_strdup( replace );
 
 		nSaslRegexp++;
+		slap_sasl_cache_flush();
 	}
 
 	return rc;
@@ -1919,6 +2167,8 @@ slap_sasl2dn(
 	SlapReply rs = {REP_RESULT};
 	struct berval regout = BER_BVNULL;
 	struct berval base = BER_BVNULL;
+	struct berval key = BER_BVNULL;
+	char keybuf[ 256 ];
 
 	Debug( LDAP_DEBUG_TRACE, "==>slap_sasl2dn: "
 		"converting SASL name %s to a DN\n",
@@ -1927,6 +2177,26 @@ slap_sasl2dn(
 	BER_BVZERO( sasldn );
 	cb.sc_private = sasldn;
 
+#ifdef SLAP_AUTH_REWRITE
+	if ( slap_authz_cache_size > 0 && sasl_rwinfo != NULL )
+#else /* ! SLAP_AUTH_REWRITE */
+	if ( slap_authz_cache_size > 0 && nSaslRegexp > 0 )
+#endif /* ! SLAP_AUTH_REWRITE */
+	{
+		char fbuf[ 16 ];
+		struct berval fbv;
+
+		fbv.bv_val = fbuf;
+		fbv.bv_len = snprintf( fbuf, sizeof( fbuf ), "%x", flags );
+		authz_cache_key( opx, &key, keybuf, sizeof( keybuf ), &fbv, saslname );
+		if ( authz_cache_get( opx, &authz_names, &key, sasldn, &op.o_bd ) ) {
+			if ( key.bv_val != keybuf )
+				opx->o_tmpfree( key.bv_val, opx->o_tmpmemctx );
+			BER_BVZERO( &key );
+			goto FINISHED;
+		}
+	}
+
 	/* Convert the SASL name into a minimal URI */
 	if( !slap_authz_regexp( saslname, &regout, flags, opx->o_tmpmemctx ) ) {
 		goto FINISHED;
@@ -2011,6 +2281,14 @@ FINISHED:
 	if( opx == opx->o_conn->c_sasl_bindop && !BER_BVISEMPTY( sasldn ) ) {
 		opx->o_conn->c_authz_backend = op.o_bd;
 	}
+	if( !BER_BVISNULL( &key ) ) {
+		if ( !BER_BVISEMPTY( sasldn ) ) {
+			authz_cache_put( &authz_names, &key, sasldn, op.o_bd );
+		}
+		if ( key.bv_val != keybuf ) {
+			opx->o_tmpfree( key.bv_val, opx->o_tmpmemctx );
+		}
+	}
 	if( !BER_BVISNULL( &op.o_req_dn ) ) {
 		slap_sl_free( op.o_req_dn.bv_val, opx->o_tmpmemctx );
 	}
@@ -2039,6 +2317,8 @@ int slap_sasl_authorized( Operation *op,
 	struct berval *authcDN, struct berval *authzDN )
 {
 	int rc = LDAP_INAPPROPRIATE_AUTH;
+	struct berval key = BER_BVNULL;
+	char keybuf[ 256 ];
 
 	/* User binding as anonymous */
 	if ( !authzDN || !authzDN->bv_len || !authzDN->bv_val ) {
@@ -2070,6 +2350,19 @@ int slap_sasl_authorized( Operation *op,
 		goto DONE;
 	}
 
+	/* Only positive decisions are cached, a denial may come
+	 * from a transient failure of the internal searches */
+	if( slap_authz_cache_size > 0 && authz_policy != SASL_AUTHZ_NONE ) {
+		authz_cache_key( op, &key, keybuf, sizeof( keybuf ), authcDN, authzDN );
+		if ( authz_cache_get( op, &authz_decisions, &key, NULL, NULL ) ) {
+			if ( key.bv_val != keybuf )
+				op->o_tmpfree( key.bv_val, op->o_tmpmemctx );
+			BER_BVZERO( &key );
+			rc = LDAP_SUCCESS;
+			goto DONE;
+		}
+	}
+
 	/* Check source rules */
 	if( authz_policy & SASL_AUTHZ_TO ) {
 		rc = slap_sasl_check_authz( op, authcDN, authzDN,
@@ -2093,6 +2386,14 @@ int slap_sasl_authorized( Operation *op,
 	rc = LDAP_INAPPROPRIATE_AUTH;
 
 DONE:
+	if( !BER_BVISNULL( &key ) ) {
+		if ( rc == LDAP_SUCCESS ) {
+			authz_cache_put( &authz_decisions, &key, NULL, NULL );
+		}
+		if ( key.bv_val != keybuf ) {
+			op->o_tmpfree( key.bv_val, op->o_tmpmemctx );
+		}
+	}
 
 	Debug( LDAP_DEBUG_TRACE,
 		"<== slap_sasl_authorized: return %d\n", rc, 0, 0 );
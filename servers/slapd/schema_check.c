@@ -544,14 +544,14 @@ int oc_check_allowed(
 	ObjectClass **socs,
 	ObjectClass *sc )
 {
-	int		i, j;
+	int		i;
 
 	Debug( LDAP_DEBUG_TRACE,
 		"oc_check_allowed type \"%s\"\n",
 		at->sat_cname.bv_val, 0, 0 );
 
 	/* always allow objectClass attribute */
-	if ( strcasecmp( at->sat_cname.bv_val, "objectClass" ) == 0 ) {
+	if ( at == slap_schema.si_ad_objectClass->ad_type ) {
 		return LDAP_SUCCESS;
 	}
 
@@ -563,24 +563,8 @@ int oc_check_allowed(
 	}
 
 	/* check to see if its allowed by the structuralObjectClass */
-	if( sc ) {
-		/* does it require the type? */
-		for ( j = 0; sc->soc_required != NULL && 
-			sc->soc_required[j] != NULL; j++ )
-		{
-			if( at == sc->soc_required[j] ) {
-				return LDAP_SUCCESS;
-			}
-		}
-
-		/* does it allow the type? */
-		for ( j = 0; sc->soc_allowed != NULL && 
-			sc->soc_allowed[j] != NULL; j++ )
-		{
-			if( at == sc->soc_allowed[j] ) {
-				return LDAP_SUCCESS;
-			}
-		}
+	if( sc && oc_allows_at( sc, at ) ) {
+		return LDAP_SUCCESS;
 	}
 
 	/* check that the type appears as req or opt in at least one oc */
@@ -592,24 +576,10 @@ int oc_check_allowed(
 			return LDAP_SUCCESS;
 		}
 		if ( oc != NULL && oc->soc_kind != LDAP_SCHEMA_ABSTRACT &&
-			( sc == NULL || oc->soc_kind == LDAP_SCHEMA_AUXILIARY ))
+			( sc == NULL || oc->soc_kind == LDAP_SCHEMA_AUXILIARY ) &&
+			oc_allows_at( oc, at ) )
 		{
-			/* does it require the type? */
-			for ( j = 0; oc->soc_required != NULL && 
-				oc->soc_required[j] != NULL; j++ )
-			{
-				if( at == oc->soc_required[j] ) {
-					return LDAP_SUCCESS;
-				}
-			}
-			/* does it allow the type? */
-			for ( j = 0; oc->soc_allowed != NULL && 
-				oc->soc_allowed[j] != NULL; j++ )
-			{
-				if( at == oc->soc_allowed[j] ) {
-					return LDAP_SUCCESS;
-				}
-			}
+			return LDAP_SUCCESS;
 		}
 	}
 
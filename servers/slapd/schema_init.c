@@ -996,20 +996,28 @@ octetStringSubstringsIndexer(
 		max = index_substr_if_maxlen < values[i].bv_len
 			? index_substr_if_maxlen : values[i].bv_len;
 
-		for( j=index_substr_if_minlen; j<=max; j++ ) {
-
-			if( flags & SLAP_INDEX_SUBSTR_INITIAL ) {
-				hashIter( &HCini, HASHdigest,
-					(unsigned char *)values[i].bv_val, j );
+		if( flags & SLAP_INDEX_SUBSTR_INITIAL ) {
+			/* each initial key extends the previous one by an octet,
+			 * so carry the hash state along instead of rehashing
+			 * the whole prefix for every length */
+			HASH_CONTEXT HCpre = HCini;
+
+			HASH_Update( &HCpre, (unsigned char *)values[i].bv_val,
+				index_substr_if_minlen - 1 );
+			for( j=index_substr_if_minlen; j<=max; j++ ) {
+				HASH_Update( &HCpre,
+					(unsigned char *)&values[i].bv_val[j-1], 1 );
+				HASH_Final( HASHdigest, &HCpre );
 				ber_dupbv_x( &keys[nkeys++], &digest, ctx );
 			}
+		}
 
-			if( flags & SLAP_INDEX_SUBSTR_FINAL ) {
+		if( flags & SLAP_INDEX_SUBSTR_FINAL ) {
+			for( j=index_substr_if_minlen; j<=max; j++ ) {
 				hashIter( &HCfin, HASHdigest,
 					(unsigned char *)&values[i].bv_val[values[i].bv_len-j], j );
 				ber_dupbv_x( &keys[nkeys++], &digest, ctx );
 			}
-
 		}
 	}
 
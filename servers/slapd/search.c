@@ -291,6 +291,10 @@ fe_op_search( Operation *op, SlapReply *rs )
 				goto return_results;
 			}
 
+			if ( SLAP_READ_CACHE( frontendDB ) &&
+				slap_read_cache_get( op, rs, 1 ))
+				goto return_results;
+
 			rs->sr_err = root_dse_info( op->o_conn, &entry, &rs->sr_text );
 
 		} else if ( bvmatch( &op->o_req_ndn, &frontendDB->be_schemandn ) ) {
@@ -300,6 +304,10 @@ fe_op_search( Operation *op, SlapReply *rs )
 				goto return_results;
 			}
 
+			if ( SLAP_READ_CACHE( frontendDB ) &&
+				slap_read_cache_get( op, rs, 1 ))
+				goto return_results;
+
 			rs->sr_err = schema_info( &entry, &rs->sr_text );
 		}
 
@@ -381,6 +389,15 @@ fail1:
 		goto return_results;
 	}
 
+	/* don't start new scans while running tasks hold mem_budget */
+	if ( slap_mem_budget && op->ors_scope != LDAP_SCOPE_BASE &&
+		!be_isroot( op ) && slap_sl_mem_inuse() >= slap_mem_budget )
+	{
+		send_ldap_error( op, rs, LDAP_BUSY,
+			"server memory budget exhausted" );
+		goto return_results;
+	}
+
 	if ( SLAP_SHADOW(op->o_bd) && get_dontUseCopy(op) ) {
 		/* don't use shadow copy */
 		BerVarray defref = op->o_bd->be_update_refs
@@ -401,7 +418,10 @@ fail1:
 		}
 
 	} else if ( op->o_bd->be_search ) {
-		if ( limits_check( op, rs ) == 0 ) {
+		if ( limits_check( op, rs ) == 0 &&
+			!( SLAP_READ_CACHE( op->o_bd ) &&
+				slap_read_cache_get( op, rs, 0 )))
+		{
 			/* actually do the search and send the result(s) */
 			(op->o_bd->be_search)( op, rs );
 		}
@@ -413,6 +433,7 @@ fail1:
 	}
 
 return_results:;
+	slap_read_cache_done( op );
 	op->o_bd = bd;
 	return rs->sr_err;
 }
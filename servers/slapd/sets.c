@@ -75,6 +75,48 @@ slap_set_dispose( SetCookie *cp, BerVarray set, unsigned flags )
 	}
 }
 
+/* Sets larger than this are sorted for joins instead of having every
+ * member of one compared against every member of the other; sets
+ * gathered from large groups would otherwise make joins quadratic */
+#define SLAP_SET_SORT_MIN	16
+
+/* Order by length, then contents; equal exactly when bvmatch() */
+static int
+set_bvcmp( const void *v1, const void *v2 )
+{
+	const struct berval *b1 = *(const struct berval * const *)v1;
+	const struct berval *b2 = *(const struct berval * const *)v2;
+
+	if ( b1->bv_len != b2->bv_len ) {
+		return b1->bv_len < b2->bv_len ? -1 : 1;
+	}
+	return memcmp( b1->bv_val, b2->bv_val, b1->bv_len );
+}
+
+/* Return an array of pointers to the n members of set, sorted */
+static struct berval **
+set_sort( SetCookie *cp, BerVarray set, long n )
+{
+	struct berval	**sorted;
+	long		i;
+
+	sorted = cp->set_op->o_tmpalloc( ( n + 1 ) * sizeof( struct berval * ),
+			cp->set_op->o_tmpmemctx );
+	for ( i = 0; i < n; i++ ) {
+		sorted[ i ] = &set[ i ];
+	}
+	qsort( sorted, n, sizeof( struct berval * ), set_bvcmp );
+
+	return sorted;
+}
+
+static int
+set_sorted_find( struct berval **sorted, long n, struct berval *bv )
+{
+	return bsearch( &bv, sorted, n, sizeof( struct berval * ),
+			set_bvcmp ) != NULL;
+}
+
 /* Duplicate a set.  If SLAP_SET_REFARR, is not set, the original array
  * with the original values is returned, otherwise the array is duplicated;
  * if SLAP_SET_REFVAL is set, also the values are duplicated.
@@ -168,9 +210,71 @@ slap_set_join(
 
 		/* worst scenario: no duplicates */
 		rlast = slap_set_size( rset );
-		i = slap_set_size( lset ) + rlast + 1;
+		last = slap_set_size( lset );
+		i = last + rlast + 1;
 		set = cp->set_op->o_tmpcalloc( i, sizeof( struct berval ), cp->set_op->o_tmpmemctx );
-		if ( set != NULL ) {
+		if ( set != NULL && last + rlast > SLAP_SET_SORT_MIN ) {
+			struct berval	**lsorted, **rsorted;
+			char		*keep;
+			long		k;
+
+			/* left members first, in the same order; see below */
+			for ( i = 0; i < last; i++ ) {
+				if ( op_flags & SLAP_SET_LREFVAL ) {
+					ber_dupbv_x( &set[ i ], &lset[ i ], cp->set_op->o_tmpmemctx );
+
+				} else {
+					set[ i ] = lset[ i ];
+				}
+			}
+			op_flags |= SLAP_SET_LREFVAL;
+
+			/* of the right members, keep the first occurrence
+			 * of those not already in the left set */
+			lsorted = set_sort( cp, lset, last );
+			rsorted = set_sort( cp, rset, rlast );
+			keep = cp->set_op->o_tmpalloc( rlast + 1, cp->set_op->o_tmpmemctx );
+			memset( keep, 1, rlast );
+			for ( i = 0; i < rlast; i = j ) {
+				k = rsorted[ i ] - rset;
+				for ( j = i + 1; j < rlast &&
+					set_bvcmp( &rsorted[ i ], &rsorted[ j ] ) == 0; j++ )
+				{
+					if ( rsorted[ j ] - rset < k ) {
+						keep[ k ] = 0;
+						k = rsorted[ j ] - rset;
+
+					} else {
+						keep[ rsorted[ j ] - rset ] = 0;
+					}
+				}
+				if ( set_sorted_find( lsorted, last, rsorted[ i ] ) ) {
+					keep[ k ] = 0;
+				}
+			}
+
+			for ( i = 0; i < rlast; i++ ) {
+				if ( keep[ i ] ) {
+					if ( op_flags & SLAP_SET_RREFVAL ) {
+						ber_dupbv_x( &set[ last ], &rset[ i ], cp->set_op->o_tmpmemctx );
+
+					} else {
+						set[ last ] = rset[ i ];
+					}
+					last++;
+
+				} else if ( !( op_flags & SLAP_SET_RREFVAL ) ) {
+					cp->set_op->o_tmpfree( rset[ i ].bv_val, cp->set_op->o_tmpmemctx );
+				}
+			}
+			op_flags |= SLAP_SET_RREFVAL;
+			BER_BVZERO( &set[ last ] );
+
+			cp->set_op->o_tmpfree( keep, cp->set_op->o_tmpmemctx );
+			cp->set_op->o_tmpfree( rsorted, cp->set_op->o_tmpmemctx );
+			cp->set_op->o_tmpfree( lsorted, cp->set_op->o_tmpmemctx );
+
+		} else if ( set != NULL ) {
 			/* set_chase() depends on this routine to
 			 * keep the first elements of the result
 			 * set the same (and in the same order)
@@ -259,6 +363,22 @@ slap_set_join(
 				break;
 			}
 
+			if ( llen + rlen > SLAP_SET_SORT_MIN ) {
+				long		slen = ( llen < rlen ? rlen : llen );
+				struct berval	**ssorted = set_sort( cp, sset, slen );
+
+				for ( i = 0; !BER_BVISNULL( &set[ i ] ); i++ ) {
+					if ( !set_sorted_find( ssorted, slen, &set[ i ] ) ) {
+						cp->set_op->o_tmpfree( set[ i ].bv_val, cp->set_op->o_tmpmemctx );
+						set[ i ] = set[ --last ];
+						BER_BVZERO( &set[ last ] );
+						i--;
+					}
+				}
+				cp->set_op->o_tmpfree( ssorted, cp->set_op->o_tmpmemctx );
+				break;
+			}
+
 			for ( i = 0; !BER_BVISNULL( &set[ i ] ); i++ ) {
 				for ( j = 0; !BER_BVISNULL( &sset[ j ] ); j++ ) {
 					if ( bvmatch( &set[ i ], &sset[ j ] ) ) {
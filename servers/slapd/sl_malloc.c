@@ -53,7 +53,8 @@
  * It is not (yet) reliable as a garbage collector:
  *
  * It falls back to context NULL - plain ber_memalloc() - when the
- * context's slab is full.  A reset does not reclaim such memory.
+ * context's slab is full.  A reset does not reclaim such memory, but
+ * it grows the slab (up to slab_max_size) so the next task fits.
  * Conversely, free/realloc of data not from the given context assumes
  * context NULL.  The data must not belong to another memory context.
  *
@@ -92,6 +93,10 @@ struct slab_heap {
     void *sh_end;
 	int sh_stack;
 	int sh_maxorder;
+	int sh_fallback;	/* allocations that missed the slab since reset */
+	ber_len_t sh_fbytes;	/* and their total size */
+	ber_len_t sh_charged;	/* bytes charged to the task beyond the slab */
+	ber_len_t sh_published;	/* part of sh_charged counted in sl_inuse */
     unsigned char **sh_map;
     LDAP_LIST_HEAD(sh_freelist, slab_object) *sh_free;
 	LDAP_LIST_HEAD(sh_so, slab_object) sh_sopool;
@@ -105,7 +110,23 @@ enum {
 	pad = Align - 1
 };
 
+/* Fallback statistics, folded in from each heap when it is reset */
+static ldap_pvt_thread_mutex_t sl_stats_mutex;
+static unsigned long sl_overflows, sl_fallbacks, sl_fbytes, sl_grows;
+
+/* Memory charged to running tasks, for mem_budget/op_mem_budget.
+ * Heaps publish their charge in SLAP_SL_PUBLISH steps to keep the
+ * mutex off the allocation path; ch_malloc only charges blocks of at
+ * least SLAP_SL_CHARGE_MIN bytes since it must look up the context.
+ * Frees are not credited: a task's charge is its high-water mark,
+ * dropped when its operation ends or its context is reset.
+ */
+#define SLAP_SL_CHARGE_MIN	4096
+#define SLAP_SL_PUBLISH	65536
+static ber_len_t sl_inuse;
+
 static struct slab_object * slap_replenish_sopool(struct slab_heap* sh);
+static void slap_sl_mem_uncharge(struct slab_heap *sh);
 #ifdef SLAPD_UNUSED
 static void print_slheap(int level, void *ctx);
 #endif
@@ -170,6 +191,7 @@ slap_sl_mem_destroy(
 	}
 
 	if (key != NULL) {
+		slap_sl_mem_uncharge(sh);
 		ber_memfree_x(sh->sh_base, NULL);
 		ber_memfree_x(sh, NULL);
 	}
@@ -183,9 +205,137 @@ slap_sl_mem_init()
 {
 	assert( Align == 1 << Align_log2 );
 
+	ldap_pvt_thread_mutex_init( &sl_stats_mutex );
 	ber_set_option( NULL, LBER_OPT_MEMORY_FNS, &slap_sl_mfuncs );
 }
 
+void
+slap_sl_mem_stats(
+	unsigned long *overflows,
+	unsigned long *fallbacks,
+	unsigned long *fbytes,
+	unsigned long *grows,
+	unsigned long *inuse
+)
+{
+	ldap_pvt_thread_mutex_lock( &sl_stats_mutex );
+	*overflows = sl_overflows;
+	*fallbacks = sl_fallbacks;
+	*fbytes = sl_fbytes;
+	*grows = sl_grows;
+	*inuse = sl_inuse;
+	ldap_pvt_thread_mutex_unlock( &sl_stats_mutex );
+}
+
+static void
+slap_sl_mem_publish( struct slab_heap *sh )
+{
+	ldap_pvt_thread_mutex_lock( &sl_stats_mutex );
+	sl_inuse += sh->sh_charged - sh->sh_published;
+	ldap_pvt_thread_mutex_unlock( &sl_stats_mutex );
+	sh->sh_published = sh->sh_charged;
+}
+
+static void
+slap_sl_mem_uncharge( struct slab_heap *sh )
+{
+	if ( sh->sh_published ) {
+		ldap_pvt_thread_mutex_lock( &sl_stats_mutex );
+		sl_inuse -= sh->sh_published;
+		ldap_pvt_thread_mutex_unlock( &sl_stats_mutex );
+	}
+	sh->sh_charged = 0;
+	sh->sh_published = 0;
+}
+
+static void
+slap_sl_mem_account( struct slab_heap *sh, ber_len_t size )
+{
+	sh->sh_charged += size;
+	if ( sh->sh_charged - sh->sh_published >= SLAP_SL_PUBLISH )
+		slap_sl_mem_publish( sh );
+}
+
+/* Charge a large ch_malloc to the current thread's task, if any */
+void
+slap_sl_mem_charge( ber_len_t size )
+{
+	void *memctx;
+	struct slab_heap *sh;
+
+	if ( size < SLAP_SL_CHARGE_MIN || ( slapMode & SLAP_TOOL_MODE ))
+		return;
+
+	sh = GET_MEMCTX(ldap_pvt_thread_pool_context(), &memctx);
+	if ( sh )
+		slap_sl_mem_account( sh, size );
+}
+
+/* The operation using this context is over: stop counting what it
+ * allocated against mem_budget */
+void
+slap_sl_mem_release( void *ctx )
+{
+	struct slab_heap *sh = ctx;
+
+	if ( sh )
+		slap_sl_mem_uncharge( sh );
+}
+
+/* Bytes the current task of this context allocated beyond its slab */
+ber_len_t
+slap_sl_mem_used( void *ctx )
+{
+	struct slab_heap *sh = ctx;
+
+	return sh ? sh->sh_charged : 0;
+}
+
+/* Bytes charged to all running tasks, accurate to SLAP_SL_PUBLISH
+ * per thread */
+ber_len_t
+slap_sl_mem_inuse( void )
+{
+	ber_len_t inuse;
+
+	ldap_pvt_thread_mutex_lock( &sl_stats_mutex );
+	inuse = sl_inuse;
+	ldap_pvt_thread_mutex_unlock( &sl_stats_mutex );
+	return inuse;
+}
+
+/* The last task overflowed the slab: account for it, and pick a
+ * size that would have held it, within slab_max_size.
+ */
+static ber_len_t
+slap_sl_mem_grow( struct slab_heap *sh, ber_len_t size )
+{
+	ber_len_t cur = (char *) sh->sh_end - (char *) sh->sh_base;
+	ber_len_t want = cur, need = cur + sh->sh_fbytes;
+	int grown = 0;
+
+	while ( want < need && want < slap_slab_max_size ) {
+		want <<= 1;
+	}
+	if ( want > slap_slab_max_size )
+		want = slap_slab_max_size;
+	if ( want > cur && want > size ) {
+		size = want;
+		grown = 1;
+	}
+
+	ldap_pvt_thread_mutex_lock( &sl_stats_mutex );
+	sl_overflows++;
+	sl_fallbacks += sh->sh_fallback;
+	sl_fbytes += sh->sh_fbytes;
+	sl_grows += grown;
+	ldap_pvt_thread_mutex_unlock( &sl_stats_mutex );
+
+	sh->sh_fallback = 0;
+	sh->sh_fbytes = 0;
+	return size;
+}
+
 /* Create, reset or just return the memory context of the current thread. */
 void *
 slap_sl_mem_create(
@@ -206,6 +356,12 @@ slap_sl_mem_create(
 	if ( sh && !new )
 		return sh;
 
+	if ( sh ) {
+		slap_sl_mem_uncharge( sh );
+		if ( sh->sh_fallback )
+			size = slap_sl_mem_grow( sh, size );
+	}
+
 	/* Round up to doubleword boundary, then make room for initial
 	 * padding, preserving expected available size for pool version */
 	size = ((size + Align-1) & -Align) + Base_offset;
@@ -213,6 +369,8 @@ slap_sl_mem_create(
 	if (!sh) {
 		sh = ch_malloc(sizeof(struct slab_heap));
 		base = ch_malloc(size);
+		sh->sh_charged = 0;
+		sh->sh_published = 0;
 		SET_MEMCTX(thrctx, sh, slap_sl_mem_destroy);
 		VGMEMP_MARK(base, size);
 		VGMEMP_CREATE(sh, 0, 0);
@@ -220,7 +378,8 @@ slap_sl_mem_create(
 		slap_sl_mem_destroy(NULL, sh);
 		base = sh->sh_base;
 		if (size > (ber_len_t) ((char *) sh->sh_end - base)) {
-			newptr = ch_realloc(base, size);
+			/* not ch_realloc, it would take base for a slab block */
+			newptr = ber_memrealloc_x(base, size, NULL);
 			if ( newptr == NULL ) return NULL;
 			VGMEMP_CHANGE(sh, base, newptr, size);
 			base = newptr;
@@ -229,6 +388,8 @@ slap_sl_mem_create(
 	}
 	sh->sh_base = base;
 	sh->sh_end = base + size;
+	sh->sh_fallback = 0;
+	sh->sh_fbytes = 0;
 
 	/* Align (base + head of first block) == first returned block */
 	base += Base_offset;
@@ -390,7 +551,16 @@ slap_sl_malloc(
 	Debug(LDAP_DEBUG_TRACE,
 		"sl_malloc %lu: ch_malloc\n",
 		(unsigned long) size, 0, 0);
-	return ch_malloc(size);
+	sh->sh_fallback++;
+	sh->sh_fbytes += size;
+	slap_sl_mem_account( sh, size );
+	/* not ch_malloc, it would charge the block again */
+	newptr = ber_memalloc_x( size, NULL );
+	if ( newptr ) return newptr;
+	Debug(LDAP_DEBUG_ANY, "slap_sl_malloc of %lu bytes failed\n",
+		(unsigned long) size, 0, 0);
+	assert( 0 );
+	exit( EXIT_FAILURE );
 }
 
 #define LIM_SQRT(t) /* some value < sqrt(max value of unsigned type t) */ \
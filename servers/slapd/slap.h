@@ -145,6 +145,12 @@ LDAP_BEGIN_DECL
 
 #define SLAP_CONN_MAX_PENDING_DEFAULT	100
 #define SLAP_CONN_MAX_PENDING_AUTH	1000
+#define SLAP_CONN_MAX_PDUS_DEFAULT	64
+#define SLAP_CONN_READAHEAD	4096
+#define SLAP_CONN_OUTPUT_BUFFER_DEFAULT	16384
+#define SLAP_CONN_OUTPUT_DELAY	10	/* msec */
+#define SLAP_CONN_GROUP_CACHE_DEFAULT	0
+#define SLAP_DN_CACHE_SIZE_DEFAULT	4096
 
 #define SLAP_TEXT_BUFLEN (256)
 
@@ -762,6 +768,7 @@ struct AttributeType {
 
 	AttributeDescription		*sat_ad;
 	ldap_pvt_thread_mutex_t		sat_ad_mutex;
+	unsigned			sat_index;	/* bit in soc_atmap */
 };
 
 #define is_at_operational(at)	((at)->sat_usage)
@@ -796,9 +803,17 @@ struct ObjectClass {
 #define soc_at_oids_may			soc_oclass.oc_at_oids_may
 #define soc_extensions			soc_oclass.oc_extensions
 
+	/* bitmap of soc_required + soc_allowed, by sat_index */
+	unsigned char			*soc_atmap;
+	unsigned			soc_atmaplen;
+
 	LDAP_STAILQ_ENTRY(ObjectClass)	soc_next;
 };
 
+#define oc_allows_at(oc, at) \
+	( (at)->sat_index / 8 < (oc)->soc_atmaplen && \
+	  ( (oc)->soc_atmap[ (at)->sat_index / 8 ] & ( 1U << ( (at)->sat_index % 8 ) ) ) )
+
 #define	SLAP_OCF_SET_FLAGS	0x1
 #define	SLAP_OCF_CHECK_SUP	0x2
 #define	SLAP_OCF_MASK		(SLAP_OCF_SET_FLAGS|SLAP_OCF_CHECK_SUP)
@@ -914,6 +929,7 @@ struct slap_internal_schema {
 	AttributeDescription *si_ad_modifiersName;
 	AttributeDescription *si_ad_modifyTimestamp;
 	AttributeDescription *si_ad_hasSubordinates;
+	AttributeDescription *si_ad_numSubordinates;
 	AttributeDescription *si_ad_subschemaSubentry;
 	AttributeDescription *si_ad_collectiveSubentries;
 	AttributeDescription *si_ad_collectiveExclusions;
@@ -1838,6 +1854,8 @@ struct BackendDB {
 #define		be_dn2id_get bd_info->bi_tool_dn2id_get
 #define		be_entry_modify	bd_info->bi_tool_entry_modify
 #define		be_entry_delete	bd_info->bi_tool_entry_delete
+#define		be_entry_scan	bd_info->bi_tool_entry_scan
+#define		be_index_rebuild	bd_info->bi_tool_index_rebuild
 #endif
 
 	/* supported controls */
@@ -1868,6 +1886,8 @@ struct BackendDB {
 #define SLAP_DBFLAG_SYNC_SUBENTRY	0x40000U /* use subentry for context */
 #define SLAP_DBFLAG_MULTI_SHADOW	0x80000U /* uses mirrorMode/multi-master */
 #define SLAP_DBFLAG_DISABLED	0x100000U
+#define SLAP_DBFLAG_GLUE_PARALLEL	0x200000U /* search subordinates concurrently */
+#define SLAP_DBFLAG_READ_CACHE	0x400000U /* answer base reads from the read cache */
 	slap_mask_t	be_flags;
 #define SLAP_DBFLAGS(be)			((be)->be_flags)
 #define SLAP_NOLASTMOD(be)			(SLAP_DBFLAGS(be) & SLAP_DBFLAG_NOLASTMOD)
@@ -1896,6 +1916,8 @@ struct BackendDB {
 #define SLAP_DBCLEAN(be)			(SLAP_DBFLAGS(be) & SLAP_DBFLAG_CLEAN)
 #define SLAP_DBACL_ADD(be)			(SLAP_DBFLAGS(be) & SLAP_DBFLAG_ACL_ADD)
 #define SLAP_SYNC_SUBENTRY(be)			(SLAP_DBFLAGS(be) & SLAP_DBFLAG_SYNC_SUBENTRY)
+#define SLAP_GLUE_PARALLEL(be)			(SLAP_DBFLAGS(be) & SLAP_DBFLAG_GLUE_PARALLEL)
+#define SLAP_READ_CACHE(be)			(SLAP_DBFLAGS(be) & SLAP_DBFLAG_READ_CACHE)
 
 	slap_mask_t	be_restrictops;		/* restriction operations */
 #define SLAP_RESTRICT_OP_ADD		0x0001U
@@ -2226,6 +2248,12 @@ typedef ID (BI_tool_entry_modify) LDAP_P(( BackendDB *be, Entry *e,
 	struct berval *text ));
 typedef int (BI_tool_entry_delete) LDAP_P(( BackendDB *be, struct berval *ndn,
 	struct berval *text ));
+typedef int (BI_tool_entry_scan_cb) LDAP_P(( BackendDB *be, ID id, Entry *e,
+	void *arg ));
+typedef int (BI_tool_entry_scan) LDAP_P(( BackendDB *be, ID first, ID *last,
+	BI_tool_entry_scan_cb *cb, void *arg ));
+typedef int (BI_tool_index_rebuild) LDAP_P(( BackendDB *be,
+	AttributeDescription **adv ));
 
 struct BackendInfo {
 	char	*bi_type; /* type of backend */
@@ -2331,6 +2359,14 @@ struct BackendInfo {
 	BI_tool_dn2id_get	*bi_tool_dn2id_get;
 	BI_tool_entry_modify	*bi_tool_entry_modify;
 	BI_tool_entry_delete	*bi_tool_entry_delete;
+	/* calls cb for each entry with first <= ID <= *last, in ID order;
+	 * safe to call from several threads at once. With cb NULL, it
+	 * sets *last to the highest ID in use instead */
+	BI_tool_entry_scan	*bi_tool_entry_scan;
+	/* rebuilds the indexes of adv, or all, for the whole database
+	 * in bulk; SLAP_CB_CONTINUE if it leaves them to
+	 * bi_tool_entry_reindex */
+	BI_tool_index_rebuild	*bi_tool_index_rebuild;
 
 #define SLAP_INDEX_ADD_OP		0x0001
 #define SLAP_INDEX_DELETE_OP	0x0002
@@ -2486,15 +2522,30 @@ typedef struct GroupAssertion {
 	ObjectClass *ga_oc;
 	AttributeDescription *ga_at;
 	int ga_res;
+	unsigned long ga_gen;	/* slap_group_gen when evaluated */
 	ber_len_t ga_len;
 	char ga_ndn[1];
 } GroupAssertion;
 
+/*
+ * Caches the values gathered for a set expression in ACL evaluation
+ */
+typedef struct SetAssertion {
+	struct SetAssertion *sa_next;
+	AttributeDescription *sa_desc;
+	BerVarray sa_vals;
+	unsigned long sa_gen;	/* backend_group_gen() when gathered */
+	ber_len_t sa_len;
+	char sa_name[1];
+} SetAssertion;
+
 struct slap_control_ids {
 	int sc_LDAPsync;
 	int sc_assert;
 	int sc_domainScope;
 	int sc_dontUseCopy;
+	int sc_explain;
+	int sc_trace;
 	int sc_manageDSAit;
 	int sc_modifyIncrement;
 	int sc_noOp;
@@ -2544,6 +2595,15 @@ typedef enum {
 	SLAP_OP_LAST
 } slap_op_t;
 
+/* Operation latency histograms have four buckets per power of two
+ * microseconds, so values in a bucket are within 25% of each other.
+ * The last bucket takes everything from about 33 seconds up.
+ */
+#define SLAP_LAT_WAIT		0	/* queued before a thread picked it up */
+#define SLAP_LAT_EXEC		1	/* executing, including the response */
+#define SLAP_LAT_LAST		2
+#define SLAP_LAT_BUCKETS	100
+
 typedef struct slap_counters_t {
 	struct slap_counters_t	*sc_next;
 	ldap_pvt_thread_mutex_t	sc_mutex;
@@ -2557,9 +2617,120 @@ typedef struct slap_counters_t {
 #ifdef SLAPD_MONITOR
 	ldap_pvt_mp_t		sc_ops_completed_[SLAP_OP_LAST];
 	ldap_pvt_mp_t		sc_ops_initiated_[SLAP_OP_LAST];
+	unsigned long		sc_ops_latency_[SLAP_OP_LAST][SLAP_LAT_LAST][SLAP_LAT_BUCKETS];
 #endif /* SLAPD_MONITOR */
+	char			sc_pad[64];	/* keep other threads' counters off our cache line */
 } slap_counters_t;
 
+/* Each pool thread has its own counters. When they are plain integers
+ * they are bumped with relaxed atomics and sc_mutex is left out; readers
+ * may see a total that lags slightly. Bignum counters still need the lock.
+ */
+#if !defined(USE_MP_BIGNUM) && !defined(USE_MP_GMP) && defined(__ATOMIC_RELAXED)
+#define SLAP_COUNTERS_LOCK(sc)		((void)0)
+#define SLAP_COUNTERS_UNLOCK(sc)	((void)0)
+#define SLAP_COUNTER_ADD(mp,n) \
+	((void)__atomic_fetch_add( &(mp), (n), __ATOMIC_RELAXED ))
+#define SLAP_COUNTER_ADD_MP(mpr,mpv)	SLAP_COUNTER_ADD( mpr, mpv )
+#define SLAP_COUNTER_GET(mp)		__atomic_load_n( &(mp), __ATOMIC_RELAXED )
+#define SLAP_COUNTER_INCR_UL(ul) \
+	((void)__atomic_fetch_add( &(ul), 1, __ATOMIC_RELAXED ))
+#define SLAP_COUNTER_GET_UL(ul)		__atomic_load_n( &(ul), __ATOMIC_RELAXED )
+#else
+#define SLAP_COUNTERS_LOCK(sc)		ldap_pvt_thread_mutex_lock( &(sc)->sc_mutex )
+#define SLAP_COUNTERS_UNLOCK(sc)	ldap_pvt_thread_mutex_unlock( &(sc)->sc_mutex )
+#define SLAP_COUNTER_ADD(mp,n)		ldap_pvt_mp_add_ulong( mp, n )
+#define SLAP_COUNTER_ADD_MP(mpr,mpv)	ldap_pvt_mp_add( mpr, mpv )
+#define SLAP_COUNTER_GET(mp)		(mp)
+#define SLAP_COUNTER_INCR_UL(ul)	((void)(ul)++)
+#define SLAP_COUNTER_GET_UL(ul)		(ul)
+#endif
+
+/*
+ * Where an operation spent its time, collected when slowop_threshold
+ * is set and logged if the operation took longer than that.
+ */
+typedef struct slap_optrace {
+	unsigned long	ot_acl;		/* usec evaluating access controls */
+	unsigned long	ot_cand;	/* usec building search candidates */
+	unsigned long	ot_decode;	/* usec decoding entries */
+	unsigned long	ot_write;	/* usec waiting to write responses */
+	unsigned long	ot_idl;		/* number of search candidates */
+	unsigned long	ot_scanned;	/* entries examined */
+	int		ot_acl_depth;	/* don't count nested access checks twice */
+} slap_optrace;
+
+#define SLAP_OPTRACE_BEGIN(op, tv) \
+	do { \
+		(tv).tv_sec = 0; \
+		if ( slap_slowop_threshold || (op)->o_tracectx.tc_record ) \
+			gettimeofday( &(tv), NULL ); \
+	} while (0)
+#define SLAP_OPTRACE_END(op, field, tv) \
+	do { \
+		if ( (tv).tv_sec ) \
+			slap_optrace_add( &(op)->o_trace.field, &(tv) ); \
+	} while (0)
+
+/*
+ * W3C trace context of an operation, from the trace control or
+ * started by syncrepl. Internal operations sharing the Opheader
+ * belong to the same span.
+ */
+#define SLAP_TRACEPARENT_LEN	55	/* "00-" trace "-" parent "-" flags */
+
+typedef struct slap_tracectx {
+	unsigned char	tc_trace[16];	/* trace-id */
+	unsigned char	tc_parent[8];	/* span-id of the caller, or zero */
+	unsigned char	tc_span[8];	/* span-id of this operation */
+	unsigned char	tc_flags;	/* trace-flags, 01 is sampled */
+	unsigned char	tc_set;
+	unsigned char	tc_record;	/* sampled and tracefile is set */
+} slap_tracectx;
+
+/*
+ * The phase an operation is in, sampled every profile_interval msec.
+ * Time not covered by any other marker counts as SLAP_PROF_OTHER.
+ */
+enum {
+	SLAP_PROF_NONE = 0,	/* no operation running */
+	SLAP_PROF_OTHER,
+	SLAP_PROF_ACL,		/* evaluating access controls */
+	SLAP_PROF_CAND,		/* building search candidates */
+	SLAP_PROF_DECODE,	/* decoding entries */
+	SLAP_PROF_FILTER,	/* testing the search filter */
+	SLAP_PROF_SEND,		/* encoding and writing responses */
+	SLAP_PROF_LAST
+};
+
+/* written by the thread running the operation, read by the sampler */
+typedef struct slap_profslot {
+	struct slap_profslot	*ps_next;
+	BerVarray	ps_suffix;	/* be_suffix of the database */
+	volatile int	ps_phase;
+	int		ps_op;		/* slap_op_t */
+	int		ps_dead;	/* the owning thread has exited */
+} slap_profslot;
+
+#define SLAP_PROFILE_PHASE(op, phase) \
+	do { \
+		if ( (op)->o_prof ) { \
+			(op)->o_prof->ps_suffix = (op)->o_bd ? \
+				(op)->o_bd->be_suffix : NULL; \
+			(op)->o_prof->ps_phase = (phase); \
+		} \
+	} while (0)
+#define SLAP_PROFILE_ENTER(op, phase, save) \
+	do { \
+		(save) = (op)->o_prof ? (op)->o_prof->ps_phase : SLAP_PROF_NONE; \
+		SLAP_PROFILE_PHASE( op, phase ); \
+	} while (0)
+#define SLAP_PROFILE_LEAVE(op, save) \
+	do { \
+		if ( (op)->o_prof ) \
+			(op)->o_prof->ps_phase = (save); \
+	} while (0)
+
 /*
  * represents an operation pending from an ldap client
  */
@@ -2581,6 +2752,10 @@ typedef struct Opheader {
 
 	char		oh_log_prefix[ /* sizeof("conn= op=") + 2*LDAP_PVT_INTTYPE_CHARS(unsigned long) */ SLAP_TEXT_BUFLEN ];
 
+	slap_optrace	oh_trace;
+	slap_profslot	*oh_prof;
+	slap_tracectx	oh_tracectx;
+
 #ifdef LDAP_SLAPI
 	void	*oh_extensions;		/* NS-SLAPI plugin */
 #endif
@@ -2633,6 +2808,9 @@ struct Operation {
 #define	o_tmpfree	o_tmpmfuncs->bmf_free
 
 #define o_log_prefix o_hdr->oh_log_prefix
+#define o_trace o_hdr->oh_trace
+#define o_prof o_hdr->oh_prof
+#define o_tracectx o_hdr->oh_tracectx
 
 	ber_tag_t	o_tag;		/* tag of the request */
 	time_t		o_time;		/* time op was initiated */
@@ -2705,6 +2883,7 @@ struct Operation {
 #define SLAP_CANCEL_DONE				0x03
 
 	GroupAssertion *o_groups;
+	SetAssertion *o_sets;
 	char o_do_not_cache;	/* don't cache groups from this op */
 	char o_is_auth_check;	/* authorization in progress */
 	char o_dont_replicate;
@@ -2768,6 +2947,12 @@ struct Operation {
 #define o_domain_scope	o_ctrlflag[slap_cids.sc_domainScope]
 #define get_domainScope(op)				((int)(op)->o_domain_scope)
 
+#define o_explain	o_ctrlflag[slap_cids.sc_explain]
+#define o_explain_plan	o_controls[slap_cids.sc_explain]
+#define get_explain(op)					((int)(op)->o_explain)
+
+#define o_tracectrl	o_ctrlflag[slap_cids.sc_trace]
+
 #ifdef SLAP_CONTROL_X_TREE_DELETE
 #define	o_tree_delete	o_ctrlflag[slap_cids.sc_treeDelete]
 #define get_treeDelete(op)				((int)(op)->o_tree_delete)
@@ -2821,9 +3006,35 @@ struct Operation {
 	void	*o_private;	/* anything the backend needs */
 	LDAP_SLIST_HEAD(o_e, OpExtra) o_extra;	/* anything the backend needs */
 
+	int o_opclass;	/* SLAP_OPCLASS_* for connection_pool scheduling */
+	LDAP_STAILQ_ENTRY(Operation)	o_cnext;	/* next op waiting in its class */
+
 	LDAP_STAILQ_ENTRY(Operation)	o_next;	/* next operation in list */
 };
 
+/* Operation classes for admission to the connection pool.
+ * Abandon and unbind are never classified or held back.
+ */
+#define SLAP_OPCLASS_NONE	0
+#define SLAP_OPCLASS_BIND	1	/* bind and extended */
+#define SLAP_OPCLASS_WRITE	2
+#define SLAP_OPCLASS_READ	3	/* compare and base scope search */
+#define SLAP_OPCLASS_EXPENSIVE	4	/* every other search */
+#define SLAP_OPCLASS_TLS	5	/* TLS handshakes, not operations */
+#define SLAP_OPCLASS_LAST	6
+#define SLAP_OPCLASS_MASK	0x0f
+#define SLAP_OPCLASS_HELD	0x10	/* op holds a slot of its class */
+#define SLAP_OPCLASS_BUSY	0x20	/* class queue was full, reply busy */
+
+typedef struct slap_opclass_t {
+	int	soc_max;		/* max executing ops, 0 for no limit */
+	int	soc_max_pending;	/* max ops waiting, 0 for no limit */
+	int	soc_conf;		/* set by an opclass directive */
+	int	soc_executing;
+	int	soc_pending;
+	LDAP_STAILQ_HEAD(soc_o, Operation) soc_ops;	/* waiting ops */
+} slap_opclass_t;
+
 typedef struct OperationBuffer {
 	Operation	ob_op;
 	Opheader	ob_hdr;
@@ -2932,7 +3143,22 @@ struct Connection {
 	ldap_pvt_thread_mutex_t	c_write2_mutex;	/* used to wait for sd write-ready */
 	ldap_pvt_thread_cond_t	c_write2_cv;	/* used to wait for sd write-ready*/
 
+	ldap_pvt_thread_mutex_t	c_groups_mutex;	/* protects c_groups*, c_sets, c_limits* */
+	GroupAssertion	*c_groups;	/* group checks made for c_groups_ndn */
+	struct berval	c_groups_ndn;
+	int			c_ngroups;
+	SetAssertion	*c_sets;	/* sets gathered for ACL checks */
+	int			c_nsets;
+	BackendDB	*c_limits_be;	/* limits of c_limits_ndn on c_limits_be */
+	struct slap_limits_set *c_limits;
+	struct berval	c_limits_ndn;
+	unsigned long	c_limits_gen;
+	unsigned long	c_limits_ggen;
+	int			c_limits_group;
+
 	BerElement	*c_currentber;	/* ber we're attempting to read */
+	BerElement	*c_outber;	/* coalesced responses not yet written */
+	struct timeval	c_outtime;	/* when c_outber was started */
 	int			c_writers;		/* number of writers waiting */
 	char		c_writing;		/* someone is writing */
 
@@ -2951,6 +3177,7 @@ struct Connection {
 #ifdef HAVE_TLS
 	char	c_is_tls;		/* true if this LDAP over raw TLS */
 	char	c_needs_tls_accept;	/* true if SSL_accept should be called */
+	char	c_tls_slot;		/* holds a slot of the tls opclass */
 #endif
 	char	c_sasl_layers;	 /* true if we need to install SASL i/o handlers */
 	char	c_sasl_done;		/* SASL completed once */
@@ -3002,36 +3229,69 @@ struct Connection {
 };
 
 #ifdef LDAP_DEBUG
+#ifdef __ATOMIC_ACQUIRE
+#define SLAP_LOG_ASYNC
+#endif
+
 #ifdef LDAP_SYSLOG
 #ifdef LOG_LOCAL4
 #define SLAP_DEFAULT_SYSLOG_USER	LOG_LOCAL4
 #endif /* LOG_LOCAL4 */
 
-#define Statslog( level, fmt, connid, opid, arg1, arg2, arg3 )	\
+#define StatslogNow( level, fmt, connid, opid, arg1, arg2, arg3 )	\
 	Log5( (level), ldap_syslog_level, (fmt), (connid), (opid), (arg1), (arg2), (arg3) )
-#define Statslog6( level, fmt, a1, a2, a3, a4, a5, a6 )				\
+#define StatslogNow6( level, fmt, a1, a2, a3, a4, a5, a6 )				\
 	Log6( (level), ldap_syslog_level, (fmt), (a1), (a2), (a3), (a4), (a5), (a6) )
-#define Statslog7( level, fmt, a1, a2, a3, a4, a5, a6, a7 )				\
+#define StatslogNow7( level, fmt, a1, a2, a3, a4, a5, a6, a7 )				\
 	Log7( (level), ldap_syslog_level, (fmt), (a1), (a2), (a3), (a4), (a5), (a6), (a7) )
 #define StatslogTest( level ) ((ldap_debug | ldap_syslog) & (level))
 #else /* !LDAP_SYSLOG */
-#define Statslog( level, fmt, connid, opid, arg1, arg2, arg3 )	\
+#define StatslogNow( level, fmt, connid, opid, arg1, arg2, arg3 )	\
 	do { \
 		if ( ldap_debug & (level) ) \
 			lutil_debug( ldap_debug, (level), (fmt), (connid), (opid), (arg1), (arg2), (arg3) );\
 	} while (0)
-#define Statslog6( level, fmt, a1, a2, a3, a4, a5, a6 )				\
+#define StatslogNow6( level, fmt, a1, a2, a3, a4, a5, a6 )				\
 	do { \
 		if ( ldap_debug & (level) ) \
 			lutil_debug( ldap_debug, (level), (fmt), (a1), (a2), (a3), (a4), (a5), (a6) ); \
 	} while (0)
-#define Statslog7( level, fmt, a1, a2, a3, a4, a5, a6, a7 )				\
+#define StatslogNow7( level, fmt, a1, a2, a3, a4, a5, a6, a7 )				\
 	do { \
 		if ( ldap_debug & (level) ) \
 			lutil_debug( ldap_debug, (level), (fmt), (a1), (a2), (a3), (a4), (a5), (a6), (a7) ); \
 	} while (0)
 #define StatslogTest( level ) (ldap_debug & (level))
 #endif /* !LDAP_SYSLOG */
+
+#ifdef SLAP_LOG_ASYNC
+/* with logasync set, stats messages are queued for the logger thread */
+#define Statslog( level, fmt, connid, opid, arg1, arg2, arg3 )	\
+	do { \
+		if ( slap_log_async && StatslogTest( level ) ) \
+			slap_log_push( (level), (fmt), (connid), (opid), (arg1), (arg2), (arg3) ); \
+		else \
+			StatslogNow( (level), (fmt), (connid), (opid), (arg1), (arg2), (arg3) ); \
+	} while (0)
+#define Statslog6( level, fmt, a1, a2, a3, a4, a5, a6 )				\
+	do { \
+		if ( slap_log_async && StatslogTest( level ) ) \
+			slap_log_push( (level), (fmt), (a1), (a2), (a3), (a4), (a5), (a6) ); \
+		else \
+			StatslogNow6( (level), (fmt), (a1), (a2), (a3), (a4), (a5), (a6) ); \
+	} while (0)
+#define Statslog7( level, fmt, a1, a2, a3, a4, a5, a6, a7 )				\
+	do { \
+		if ( slap_log_async && StatslogTest( level ) ) \
+			slap_log_push( (level), (fmt), (a1), (a2), (a3), (a4), (a5), (a6), (a7) ); \
+		else \
+			StatslogNow7( (level), (fmt), (a1), (a2), (a3), (a4), (a5), (a6), (a7) ); \
+	} while (0)
+#else /* !SLAP_LOG_ASYNC */
+#define Statslog	StatslogNow
+#define Statslog6	StatslogNow6
+#define Statslog7	StatslogNow7
+#endif /* !SLAP_LOG_ASYNC */
 #else /* !LDAP_DEBUG */
 #define Statslog( level, fmt, connid, opid, arg1, arg2, arg3 ) ((void) 0)
 #define Statslog6( level, fmt, a1, a2, a3, a4, a5, a6 ) ((void) 0)
@@ -3054,6 +3314,7 @@ struct Listener {
 #endif
 	int	sl_mute;	/* Listener is temporarily disabled due to emfile */
 	int	sl_busy;	/* Listener is busy (accept thread activated) */
+	int	sl_shard;	/* SO_REUSEPORT clone index, 0 for the original */
 	ber_socket_t sl_sd;
 	Sockaddr sl_sa;
 #define sl_addr	sl_sa.sa_in_addr
@@ -3108,6 +3369,7 @@ typedef int (SLAP_CTRL_PARSE_FN) LDAP_P((
 typedef int (*SLAP_ENTRY_INFO_FN) LDAP_P(( void *arg, Entry *e ));
 
 #define SLAP_SLAB_SIZE	(1024*1024)
+#define SLAP_SLAB_MAX_SIZE	(16*1024*1024)
 #define SLAP_SLAB_STACK 1
 
 #define SLAP_ZONE_ALLOC 1
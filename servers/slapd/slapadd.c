@@ -64,15 +64,30 @@ typedef struct Erec {
 	unsigned long nextline;
 } Erec;
 
+/* A slot of the threaded reader's queue. The reader thread fills
+ * free slots with raw LDIF records in file order, the parser threads
+ * turn them into entries, and the main thread takes them back in the
+ * same order, so the backend still sees the input sequence.
+ */
 typedef struct Trec {
 	Entry *e;
 	unsigned long lineno;
 	unsigned long nextline;
+	char *buf;
+	int lmax;
 	int rc;
-	int ready;
+	int state;
+#define	TREC_FREE	0
+#define	TREC_READ	1	/* holds a record, not parsed yet */
+#define	TREC_BUSY	2	/* being parsed */
+#define	TREC_DONE	3	/* e and rc are set */
 } Trec;
 
-static Trec trec;
+#define	TREC_QUEUE	64
+#define	TREC_PARSERS	SLAP_MAX_WORKER_THREADS
+
+static Trec trecs[TREC_QUEUE];
+static unsigned long trec_read, trec_parse, trec_take;	/* queue positions */
 static unsigned long sid = SLAP_SYNC_SID_MAX + 1;
 static int checkvals;
 static int enable_meter;
@@ -83,244 +98,331 @@ static char *buf;
 static int lmax;
 
 static ldap_pvt_thread_mutex_t add_mutex;
-static ldap_pvt_thread_cond_t add_cond;
+static ldap_pvt_thread_cond_t add_cond_free;	/* reader waits for a slot */
+static ldap_pvt_thread_cond_t add_cond_read;	/* parsers wait for a record */
+static ldap_pvt_thread_cond_t add_cond_done;	/* main waits for an entry */
 static int add_stop;
 
 /* returns:
  *	1: got a record
  *	0: EOF
  * -1: read failure
- * -2: parse failure
  */
 static int
-getrec0(Erec *erec)
+getrec_read( unsigned long *lineno, unsigned long *nextline,
+	char **bufp, int *lmaxp )
 {
-	const char *text;
 	int ldifrc;
-	char textbuf[SLAP_TEXT_BUFLEN] = { '\0' };
-	size_t textlen = sizeof textbuf;
-	struct berval csn;
-	Operation *op = &opbuf.ob_op;
-	op->o_hdr = &opbuf.ob_hdr;
 
 again:
-	erec->lineno = erec->nextline+1;
+	*lineno = *nextline+1;
 	/* nextline is the line number of the end of the current entry */
-	ldifrc = ldif_read_record( ldiffp, &erec->nextline, &buf, &lmax );
+	ldifrc = ldif_read_record( ldiffp, nextline, bufp, lmaxp );
 	if (ldifrc < 1)
 		return ldifrc < 0 ? -1 : 0;
-	{
-		BackendDB *bd;
-		Entry *e;
-		int prev_DN_strict;
 
-		if ( erec->lineno < jumpline )
-			goto again;
-
-		if ( !dbnum ) {
-			prev_DN_strict = slap_DN_strict;
-			slap_DN_strict = 0;
-		}
-		e = str2entry2( buf, checkvals );
-		if ( !dbnum ) {
-			slap_DN_strict = prev_DN_strict;
-		}
+	if ( *lineno < jumpline )
+		goto again;
 
-		if ( enable_meter )
-			lutil_meter_update( &meter,
-					 ftello( ldiffp->fp ),
-					 0);
+	if ( enable_meter )
+		lutil_meter_update( &meter,
+				 ftello( ldiffp->fp ),
+				 0);
+	return 1;
+}
 
-		if( e == NULL ) {
-			fprintf( stderr, "%s: could not parse entry (line=%lu)\n",
-				progname, erec->lineno );
-			return -2;
-		}
+/* Parse and check the record in buf. May run in several threads
+ * at once, so it must not touch any shared state.
+ * returns:
+ *	1: got an entry
+ * -2: parse failure
+ */
+static int
+getrec_parse( Operation *op, char *buf, Erec *erec )
+{
+	const char *text;
+	char textbuf[SLAP_TEXT_BUFLEN] = { '\0' };
+	size_t textlen = sizeof textbuf;
+	BackendDB *bd;
+	Entry *e;
+	int prev_DN_strict;
 
-		/* make sure the DN is not empty */
-		if( BER_BVISEMPTY( &e->e_nname ) &&
-			!BER_BVISEMPTY( be->be_nsuffix ))
-		{
-			fprintf( stderr, "%s: line %lu: "
-				"cannot add entry with empty dn=\"%s\"",
-				progname, erec->lineno, e->e_dn );
-			bd = select_backend( &e->e_nname, nosubordinates );
-			if ( bd ) {
-				BackendDB *bdtmp;
-				int dbidx = 0;
-				LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
-					if ( bdtmp == bd ) break;
-					dbidx++;
-				}
+	if ( !dbnum ) {
+		prev_DN_strict = slap_DN_strict;
+		slap_DN_strict = 0;
+	}
+	e = str2entry2( buf, checkvals );
+	if ( !dbnum ) {
+		slap_DN_strict = prev_DN_strict;
+	}
 
-				assert( bdtmp != NULL );
-				
-				fprintf( stderr, "; did you mean to use database #%d (%s)?",
-					dbidx,
-					bd->be_suffix[0].bv_val );
+	if( e == NULL ) {
+		fprintf( stderr, "%s: could not parse entry (line=%lu)\n",
+			progname, erec->lineno );
+		return -2;
+	}
 
+	/* make sure the DN is not empty */
+	if( BER_BVISEMPTY( &e->e_nname ) &&
+		!BER_BVISEMPTY( be->be_nsuffix ))
+	{
+		fprintf( stderr, "%s: line %lu: "
+			"cannot add entry with empty dn=\"%s\"",
+			progname, erec->lineno, e->e_dn );
+		bd = select_backend( &e->e_nname, nosubordinates );
+		if ( bd ) {
+			BackendDB *bdtmp;
+			int dbidx = 0;
+			LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
+				if ( bdtmp == bd ) break;
+				dbidx++;
 			}
-			fprintf( stderr, "\n" );
-			entry_free( e );
-			return -2;
-		}
 
-		/* check backend */
-		bd = select_backend( &e->e_nname, nosubordinates );
-		if ( bd != be ) {
-			fprintf( stderr, "%s: line %lu: "
-				"database #%d (%s) not configured to hold \"%s\"",
-				progname, erec->lineno,
-				dbnum,
-				be->be_suffix[0].bv_val,
-				e->e_dn );
-			if ( bd ) {
-				BackendDB *bdtmp;
-				int dbidx = 0;
-				LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
-					if ( bdtmp == bd ) break;
-					dbidx++;
-				}
+			assert( bdtmp != NULL );
+			
+			fprintf( stderr, "; did you mean to use database #%d (%s)?",
+				dbidx,
+				bd->be_suffix[0].bv_val );
 
-				assert( bdtmp != NULL );
-				
-				fprintf( stderr, "; did you mean to use database #%d (%s)?",
-					dbidx,
-					bd->be_suffix[0].bv_val );
+		}
+		fprintf( stderr, "\n" );
+		entry_free( e );
+		return -2;
+	}
 
-			} else {
-				fprintf( stderr, "; no database configured for that naming context" );
+	/* check backend */
+	bd = select_backend( &e->e_nname, nosubordinates );
+	if ( bd != be ) {
+		fprintf( stderr, "%s: line %lu: "
+			"database #%d (%s) not configured to hold \"%s\"",
+			progname, erec->lineno,
+			dbnum,
+			be->be_suffix[0].bv_val,
+			e->e_dn );
+		if ( bd ) {
+			BackendDB *bdtmp;
+			int dbidx = 0;
+			LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
+				if ( bdtmp == bd ) break;
+				dbidx++;
 			}
-			fprintf( stderr, "\n" );
-			entry_free( e );
-			return -2;
-		}
 
-		if ( slap_tool_entry_check( progname, op, e, erec->lineno, &text, textbuf, textlen ) !=
-			LDAP_SUCCESS ) {
-			entry_free( e );
-			return -2;
+			assert( bdtmp != NULL );
+			
+			fprintf( stderr, "; did you mean to use database #%d (%s)?",
+				dbidx,
+				bd->be_suffix[0].bv_val );
+
+		} else {
+			fprintf( stderr, "; no database configured for that naming context" );
 		}
+		fprintf( stderr, "\n" );
+		entry_free( e );
+		return -2;
+	}
 
-		if ( SLAP_LASTMOD(be) ) {
-			time_t now = slap_get_time();
-			char uuidbuf[ LDAP_LUTIL_UUIDSTR_BUFSIZE ];
-			struct berval vals[ 2 ];
+	if ( slap_tool_entry_check( progname, op, e, erec->lineno, &text, textbuf, textlen ) !=
+		LDAP_SUCCESS ) {
+		entry_free( e );
+		return -2;
+	}
 
-			struct berval name, timestamp;
+	erec->e = e;
+	return 1;
+}
 
-			struct berval nvals[ 2 ];
-			struct berval nname;
-			char timebuf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
+/* Add the operational attributes and track the contextCSN; this
+ * stays in input order on the main thread.
+ */
+static void
+getrec_lastmod( Entry *e )
+{
+	struct berval csn;
 
-			enum {
-				GOT_NONE = 0x0,
-				GOT_CSN = 0x1,
-				GOT_UUID = 0x2,
-				GOT_ALL = (GOT_CSN|GOT_UUID)
-			} got = GOT_ALL;
+	if ( SLAP_LASTMOD(be) ) {
+		time_t now = slap_get_time();
+		char uuidbuf[ LDAP_LUTIL_UUIDSTR_BUFSIZE ];
+		struct berval vals[ 2 ];
 
-			vals[1].bv_len = 0;
-			vals[1].bv_val = NULL;
+		struct berval name, timestamp;
 
-			nvals[1].bv_len = 0;
-			nvals[1].bv_val = NULL;
+		struct berval nvals[ 2 ];
+		struct berval nname;
+		char timebuf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
 
-			csn.bv_len = ldap_pvt_csnstr( csnbuf, sizeof( csnbuf ), csnsid, 0 );
-			csn.bv_val = csnbuf;
+		enum {
+			GOT_NONE = 0x0,
+			GOT_CSN = 0x1,
+			GOT_UUID = 0x2,
+			GOT_ALL = (GOT_CSN|GOT_UUID)
+		} got = GOT_ALL;
 
-			timestamp.bv_val = timebuf;
-			timestamp.bv_len = sizeof(timebuf);
+		vals[1].bv_len = 0;
+		vals[1].bv_val = NULL;
 
-			slap_timestamp( &now, &timestamp );
+		nvals[1].bv_len = 0;
+		nvals[1].bv_val = NULL;
 
-			if ( BER_BVISEMPTY( &be->be_rootndn ) ) {
-				BER_BVSTR( &name, SLAPD_ANONYMOUS );
-				nname = name;
-			} else {
-				name = be->be_rootdn;
-				nname = be->be_rootndn;
-			}
+		csn.bv_len = ldap_pvt_csnstr( csnbuf, sizeof( csnbuf ), csnsid, 0 );
+		csn.bv_val = csnbuf;
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_entryUUID )
-				== NULL )
-			{
-				got &= ~GOT_UUID;
-				vals[0].bv_len = lutil_uuidstr( uuidbuf, sizeof( uuidbuf ) );
-				vals[0].bv_val = uuidbuf;
-				attr_merge_normalize_one( e, slap_schema.si_ad_entryUUID, vals, NULL );
-			}
+		timestamp.bv_val = timebuf;
+		timestamp.bv_len = sizeof(timebuf);
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_creatorsName )
-				== NULL )
-			{
-				vals[0] = name;
-				nvals[0] = nname;
-				attr_merge( e, slap_schema.si_ad_creatorsName, vals, nvals );
-			}
+		slap_timestamp( &now, &timestamp );
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_createTimestamp )
-				== NULL )
-			{
-				vals[0] = timestamp;
-				attr_merge( e, slap_schema.si_ad_createTimestamp, vals, NULL );
-			}
+		if ( BER_BVISEMPTY( &be->be_rootndn ) ) {
+			BER_BVSTR( &name, SLAPD_ANONYMOUS );
+			nname = name;
+		} else {
+			name = be->be_rootdn;
+			nname = be->be_rootndn;
+		}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_entryCSN )
-				== NULL )
-			{
-				got &= ~GOT_CSN;
-				vals[0] = csn;
-				attr_merge( e, slap_schema.si_ad_entryCSN, vals, NULL );
-			}
+		if( attr_find( e->e_attrs, slap_schema.si_ad_entryUUID )
+			== NULL )
+		{
+			got &= ~GOT_UUID;
+			vals[0].bv_len = lutil_uuidstr( uuidbuf, sizeof( uuidbuf ) );
+			vals[0].bv_val = uuidbuf;
+			attr_merge_normalize_one( e, slap_schema.si_ad_entryUUID, vals, NULL );
+		}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_modifiersName )
-				== NULL )
-			{
-				vals[0] = name;
-				nvals[0] = nname;
-				attr_merge( e, slap_schema.si_ad_modifiersName, vals, nvals );
-			}
+		if( attr_find( e->e_attrs, slap_schema.si_ad_creatorsName )
+			== NULL )
+		{
+			vals[0] = name;
+			nvals[0] = nname;
+			attr_merge( e, slap_schema.si_ad_creatorsName, vals, nvals );
+		}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_modifyTimestamp )
-				== NULL )
-			{
-				vals[0] = timestamp;
-				attr_merge( e, slap_schema.si_ad_modifyTimestamp, vals, NULL );
-			}
+		if( attr_find( e->e_attrs, slap_schema.si_ad_createTimestamp )
+			== NULL )
+		{
+			vals[0] = timestamp;
+			attr_merge( e, slap_schema.si_ad_createTimestamp, vals, NULL );
+		}
 
-			if ( SLAP_SINGLE_SHADOW(be) && got != GOT_ALL ) {
-				char buf[SLAP_TEXT_BUFLEN];
+		if( attr_find( e->e_attrs, slap_schema.si_ad_entryCSN )
+			== NULL )
+		{
+			got &= ~GOT_CSN;
+			vals[0] = csn;
+			attr_merge( e, slap_schema.si_ad_entryCSN, vals, NULL );
+		}
 
-				snprintf( buf, sizeof(buf),
-					"%s%s%s",
-					( !(got & GOT_UUID) ? slap_schema.si_ad_entryUUID->ad_cname.bv_val : "" ),
-					( !(got & GOT_CSN) ? "," : "" ),
-					( !(got & GOT_CSN) ? slap_schema.si_ad_entryCSN->ad_cname.bv_val : "" ) );
+		if( attr_find( e->e_attrs, slap_schema.si_ad_modifiersName )
+			== NULL )
+		{
+			vals[0] = name;
+			nvals[0] = nname;
+			attr_merge( e, slap_schema.si_ad_modifiersName, vals, nvals );
+		}
 
-				Debug( LDAP_DEBUG_ANY, "%s: warning, missing attrs %s from entry dn=\"%s\"\n",
-					progname, buf, e->e_name.bv_val );
-			}
+		if( attr_find( e->e_attrs, slap_schema.si_ad_modifyTimestamp )
+			== NULL )
+		{
+			vals[0] = timestamp;
+			attr_merge( e, slap_schema.si_ad_modifyTimestamp, vals, NULL );
+		}
+
+		if ( SLAP_SINGLE_SHADOW(be) && got != GOT_ALL ) {
+			char buf[SLAP_TEXT_BUFLEN];
+
+			snprintf( buf, sizeof(buf),
+				"%s%s%s",
+				( !(got & GOT_UUID) ? slap_schema.si_ad_entryUUID->ad_cname.bv_val : "" ),
+				( !(got & GOT_CSN) ? "," : "" ),
+				( !(got & GOT_CSN) ? slap_schema.si_ad_entryCSN->ad_cname.bv_val : "" ) );
 
-			sid = slap_tool_update_ctxcsn_check( progname, e );
+			Debug( LDAP_DEBUG_ANY, "%s: warning, missing attrs %s from entry dn=\"%s\"\n",
+				progname, buf, e->e_name.bv_val );
 		}
-		erec->e = e;
+
+		sid = slap_tool_update_ctxcsn_check( progname, e );
 	}
-	return 1;
+}
+
+static int
+getrec0(Erec *erec)
+{
+	Operation *op = &opbuf.ob_op;
+	int rc;
+
+	op->o_hdr = &opbuf.ob_hdr;
+
+	rc = getrec_read( &erec->lineno, &erec->nextline, &buf, &lmax );
+	if ( rc < 1 )
+		return rc;
+	rc = getrec_parse( op, buf, erec );
+	if ( rc == 1 )
+		getrec_lastmod( erec->e );
+	return rc;
 }
 
 static void *
 getrec_thr(void *ctx)
 {
+	Trec *t;
+	unsigned long nextline = 0;
+	int rc;
+
 	ldap_pvt_thread_mutex_lock( &add_mutex );
-	while (!add_stop) {
-		trec.rc = getrec0((Erec *)&trec);
-		trec.ready = 1;
-		while (trec.ready)
-			ldap_pvt_thread_cond_wait( &add_cond, &add_mutex );
-		/* eof or read failure */
-		if ( trec.rc == 0 || trec.rc == -1 )
+	while ( !add_stop ) {
+		t = &trecs[trec_read % TREC_QUEUE];
+		if ( t->state != TREC_FREE ) {
+			ldap_pvt_thread_cond_wait( &add_cond_free, &add_mutex );
+			continue;
+		}
+		ldap_pvt_thread_mutex_unlock( &add_mutex );
+		rc = getrec_read( &t->lineno, &nextline, &t->buf, &t->lmax );
+		t->nextline = nextline;
+		ldap_pvt_thread_mutex_lock( &add_mutex );
+		trec_read++;
+		if ( rc < 1 ) {
+			/* eof or read failure, nothing to parse */
+			t->rc = rc;
+			t->state = TREC_DONE;
+			ldap_pvt_thread_cond_broadcast( &add_cond_read );
+			ldap_pvt_thread_cond_signal( &add_cond_done );
 			break;
+		}
+		t->state = TREC_READ;
+		ldap_pvt_thread_cond_signal( &add_cond_read );
+	}
+	ldap_pvt_thread_mutex_unlock( &add_mutex );
+	return NULL;
+}
+
+static void *
+getrec_parse_thr(void *ctx)
+{
+	OperationBuffer opb;
+	Operation *op = &opb.ob_op;
+	Trec *t;
+
+	memset( &opb, 0, sizeof( opb ));
+	op->o_hdr = &opb.ob_hdr;
+
+	ldap_pvt_thread_mutex_lock( &add_mutex );
+	while ( !add_stop ) {
+		if ( trec_parse == trec_read ) {
+			ldap_pvt_thread_cond_wait( &add_cond_read, &add_mutex );
+			continue;
+		}
+		t = &trecs[trec_parse % TREC_QUEUE];
+		/* only the end of input is queued as already done */
+		if ( t->state != TREC_READ )
+			break;
+		t->state = TREC_BUSY;
+		trec_parse++;
+		ldap_pvt_thread_mutex_unlock( &add_mutex );
+		t->rc = getrec_parse( op, t->buf, (Erec *)t );
+		ldap_pvt_thread_mutex_lock( &add_mutex );
+		t->state = TREC_DONE;
+		/* main only cares about the next entry in input order */
+		if ( t == &trecs[trec_take % TREC_QUEUE] )
+			ldap_pvt_thread_cond_signal( &add_cond_done );
 	}
 	ldap_pvt_thread_mutex_unlock( &add_mutex );
 	return NULL;
@@ -331,20 +433,31 @@ static int ldif_threaded;
 static int
 getrec(Erec *erec)
 {
+	Trec *t;
 	int rc;
+
 	if ( !ldif_threaded )
 		return getrec0(erec);
 
-	while (!trec.ready)
-		ldap_pvt_thread_yield();
-	erec->e = trec.e;
-	erec->lineno = trec.lineno;
-	erec->nextline = trec.nextline;
-	trec.ready = 0;
-	rc = trec.rc;
 	ldap_pvt_thread_mutex_lock( &add_mutex );
+	t = &trecs[trec_take % TREC_QUEUE];
+	while ( trec_take == trec_read || t->state != TREC_DONE )
+		ldap_pvt_thread_cond_wait( &add_cond_done, &add_mutex );
+	rc = t->rc;
+	erec->lineno = t->lineno;
+	erec->nextline = t->nextline;
+	if ( rc == 1 )
+		erec->e = t->e;
+	/* leave the end of input in place for any later calls */
+	if ( rc != 0 && rc != -1 ) {
+		t->state = TREC_FREE;
+		trec_take++;
+		ldap_pvt_thread_cond_signal( &add_cond_free );
+	}
 	ldap_pvt_thread_mutex_unlock( &add_mutex );
-	ldap_pvt_thread_cond_signal( &add_cond );
+
+	if ( rc == 1 )
+		getrec_lastmod( erec->e );
 	return rc;
 }
 
@@ -355,7 +468,8 @@ slapadd( int argc, char **argv )
 	size_t textlen = sizeof textbuf;
 	Erec erec;
 	struct berval bvtext;
-	ldap_pvt_thread_t thr;
+	ldap_pvt_thread_t thr[TREC_PARSERS + 1];
+	int i, nthr = 0;
 	ID id;
 	Entry *prev = NULL;
 
@@ -428,9 +542,21 @@ slapadd( int argc, char **argv )
 	}
 
 	if ( slap_tool_thread_max > 1 ) {
+		int nparse;
+
+		/* str2entry2 toggles the global slap_DN_strict when no
+		 * database was given, so only parse in one thread then.
+		 */
+		nparse = dbnum ? slap_tool_thread_max - 1 : 1;
+		if ( nparse > TREC_PARSERS )
+			nparse = TREC_PARSERS;
 		ldap_pvt_thread_mutex_init( &add_mutex );
-		ldap_pvt_thread_cond_init( &add_cond );
-		ldap_pvt_thread_create( &thr, 0, getrec_thr, NULL );
+		ldap_pvt_thread_cond_init( &add_cond_free );
+		ldap_pvt_thread_cond_init( &add_cond_read );
+		ldap_pvt_thread_cond_init( &add_cond_done );
+		ldap_pvt_thread_create( &thr[nthr++], 0, getrec_thr, NULL );
+		for ( i = 0; i < nparse; i++ )
+			ldap_pvt_thread_create( &thr[nthr++], 0, getrec_parse_thr, NULL );
 		ldif_threaded = 1;
 	}
 
@@ -482,10 +608,21 @@ slapadd( int argc, char **argv )
 	if ( ldif_threaded ) {
 		ldap_pvt_thread_mutex_lock( &add_mutex );
 		add_stop = 1;
-		trec.ready = 0;
-		ldap_pvt_thread_cond_signal( &add_cond );
+		ldap_pvt_thread_cond_broadcast( &add_cond_free );
+		ldap_pvt_thread_cond_broadcast( &add_cond_read );
 		ldap_pvt_thread_mutex_unlock( &add_mutex );
-		ldap_pvt_thread_join( thr, NULL );
+		for ( i = 0; i < nthr; i++ )
+			ldap_pvt_thread_join( thr[i], NULL );
+		/* entries parsed ahead of a failure */
+		for ( i = 0; i < TREC_QUEUE; i++ ) {
+			if ( trecs[i].state == TREC_DONE && trecs[i].rc == 1 )
+				entry_free( trecs[i].e );
+			ch_free( trecs[i].buf );
+		}
+		ldap_pvt_thread_cond_destroy( &add_cond_done );
+		ldap_pvt_thread_cond_destroy( &add_cond_read );
+		ldap_pvt_thread_cond_destroy( &add_cond_free );
+		ldap_pvt_thread_mutex_destroy( &add_mutex );
 	}
 	if ( erec.e ) entry_free( erec.e );
 
@@ -0,0 +1,446 @@
+/* slapbench.c - time frontend functions in isolation */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include <ac/stdlib.h>
+
+#include <ac/ctype.h>
+#include <ac/string.h>
+#include <ac/socket.h>
+#include <ac/time.h>
+#include <ac/unistd.h>
+
+#include <lber.h>
+#include <ldif.h>
+#include <lutil.h>
+
+#include "slapcommon.h"
+#include "ldap_utf8.h"
+
+#if SLAPD_MDB == SLAPD_MOD_STATIC
+/* back-mdb/idl.c; the headers need LMDB */
+extern int mdb_idl_intersection( ID *a, ID *b );
+extern int mdb_idl_union( ID *a, ID *b );
+#define BENCH_IDL_SIZE	(1<<17)		/* MDB_IDL_UM_SIZE */
+#endif
+
+/*
+ * Each benchmark runs one call of the function under test per
+ * iteration. Like an LDAP operation, every iteration starts with a
+ * fresh slab memory context, so what the function takes from the
+ * context does not count as an allocation; what goes to malloc does.
+ */
+
+static Operation *bop;
+static Entry *bentry;
+static struct berval bencoded;		/* bentry, entry_encode()d */
+static struct berval bber;		/* bentry as a SearchResultEntry */
+
+static char bench_ldif[] =
+	"dn: uid=user42,ou=People,dc=example,dc=com\n"
+	"objectClass: person\n"
+	"objectClass: extensibleObject\n"
+	"uid: user42\n"
+	"cn: James Smith\n"
+	"cn: J. Smith\n"
+	"sn: Smith\n"
+	"mail: James.Smith42@mail3.example.com\n"
+	"mail: James.Smith42-alt@mail0.example.com\n"
+	"title: Senior Engineer\n"
+	"telephoneNumber: +1 555 123 0042\n"
+	"description: Works on the directory, mostly on replication and indexing\n"
+	"l: Springfield\n"
+	"postalCode: 12345\n";
+
+static const char *const bench_filters[] = {
+	"(uid=user42)",
+	"(&(objectClass=person)(cn=*mith*))",
+	"(|(mail=*@mail1.example.com)(sn=Jones))",
+	"(&(cn=James Smith)(!(title=Intern))(telephoneNumber=+1 555*))",
+	NULL
+};
+static Filter *bfilters[ 4 ];
+
+static const char *const bench_dns[] = {
+	"uid=user42,ou=People,dc=example,dc=com",
+	"UID=User42, OU=People, DC=Example, DC=Com",
+	"cn=James Smith+employeeNumber=42,ou=Engineering,o=Example Inc.,c=US",
+	"cn=J\\C3\\BCrgen M\\C3\\BCller,ou=People,dc=example,dc=com",
+	NULL
+};
+static struct berval bdns[ 4 ];
+
+static const char *const bench_strings[] = {
+	"James Smith",
+	"J\xc3\xbcrgen M\xc3\xbcller-L\xc3\xbc" "denscheidt",
+	"\xc3\x85NGSTR\xc3\x96M  Caf\xc3\xa9  Na\xc3\xafve",
+	"Works on the directory, mostly on replication and indexing",
+	NULL
+};
+static struct berval bstrings[ 4 ];
+
+static AttributeDescription *bsubad;
+static BerVarray bsubvals;
+
+#if SLAPD_MDB == SLAPD_MOD_STATIC
+static ID *bidl_a, *bidl_b, *bidl_tmp;
+#endif
+
+static void
+bench_filter( unsigned long i )
+{
+	test_filter( bop, bentry, bfilters[ i & 3 ] );
+}
+
+static void
+bench_dn( unsigned long i )
+{
+	struct berval ndn;
+
+	if ( dnNormalize( 0, NULL, NULL, &bdns[ i & 3 ], &ndn,
+		bop->o_tmpmemctx ) == LDAP_SUCCESS )
+		bop->o_tmpfree( ndn.bv_val, bop->o_tmpmemctx );
+}
+
+static void
+bench_utf8( unsigned long i )
+{
+	struct berval out;
+
+	if ( UTF8bvnormalize( &bstrings[ i & 3 ], &out, LDAP_UTF8_CASEFOLD,
+		bop->o_tmpmemctx ) )
+		bop->o_tmpfree( out.bv_val, bop->o_tmpmemctx );
+}
+
+static void
+bench_substr( unsigned long i )
+{
+	MatchingRule *mr = bsubad->ad_type->sat_substr;
+	BerVarray keys = NULL;
+
+	mr->smr_indexer( LDAP_FILTER_SUBSTRINGS, SLAP_INDEX_SUBSTR_DEFAULT,
+		bsubad->ad_type->sat_syntax, mr, &bsubad->ad_type->sat_cname,
+		bsubvals, &keys, bop->o_tmpmemctx );
+	ber_bvarray_free_x( keys, bop->o_tmpmemctx );
+}
+
+#if SLAPD_MDB == SLAPD_MOD_STATIC
+static void
+bench_idl_and( unsigned long i )
+{
+	AC_MEMCPY( bidl_tmp, bidl_a, ( bidl_a[0] + 1 ) * sizeof( ID ) );
+	mdb_idl_intersection( bidl_tmp, bidl_b );
+}
+
+static void
+bench_idl_or( unsigned long i )
+{
+	AC_MEMCPY( bidl_tmp, bidl_a, ( bidl_a[0] + 1 ) * sizeof( ID ) );
+	mdb_idl_union( bidl_tmp, bidl_b );
+}
+#endif
+
+static void
+bench_entry_encode( unsigned long i )
+{
+	struct berval bv;
+
+	entry_encode( bentry, &bv );
+	ch_free( bv.bv_val );
+}
+
+static void
+bench_entry_decode( unsigned long i )
+{
+	EntryHeader eh;
+	Entry *e;
+	ptrdiff_t off;
+
+	/* as back-bdb does it: one block for the bervals and the data */
+	eh.bv = bencoded;
+	entry_header( &eh );
+	off = eh.data - eh.bv.bv_val;
+	eh.bv.bv_len = eh.nvals * sizeof( struct berval ) + bencoded.bv_len;
+	eh.bv.bv_val = ch_malloc( eh.bv.bv_len );
+	eh.data = eh.bv.bv_val + eh.nvals * sizeof( struct berval );
+	AC_MEMCPY( eh.data, bencoded.bv_val, bencoded.bv_len );
+	eh.data += off;
+#ifdef SLAP_ZONE_ALLOC
+	if ( entry_decode( &eh, &e, NULL ) == 0 )
+#else
+	if ( entry_decode( &eh, &e ) == 0 )
+#endif
+	{
+		/* the DNs point into e_bv, see bdb_entry_return() */
+		BER_BVZERO( &e->e_name );
+		BER_BVZERO( &e->e_nname );
+		entry_free( e );
+	} else {
+		ch_free( eh.bv.bv_val );
+	}
+}
+
+static void
+bench_ber_encode( unsigned long i )
+{
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	Attribute *a;
+
+	ber_init2( ber, NULL, LBER_USE_DER );
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &bop->o_tmpmemctx );
+	ber_printf( ber, "{it{O{" /*}}}*/, 42, LDAP_RES_SEARCH_ENTRY,
+		&bentry->e_name );
+	for ( a = bentry->e_attrs; a; a = a->a_next ) {
+		ber_printf( ber, "{O[W]}", &a->a_desc->ad_cname, a->a_vals );
+	}
+	ber_printf( ber, /*{{{*/ "}}N}" );
+	ber_free_buf( ber );
+}
+
+static void
+bench_ber_decode( unsigned long i )
+{
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	struct berval dn, type;
+	BerVarray vals;
+	ber_int_t msgid;
+	ber_tag_t tag, rtag;
+	ber_len_t len;
+	char *last;
+
+	ber_init2( ber, &bber, 0 );
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &bop->o_tmpmemctx );
+	if ( ber_scanf( ber, "{it{m" /*}}*/, &msgid, &rtag, &dn ) == LBER_ERROR )
+		return;
+	for ( tag = ber_first_element( ber, &len, &last ); tag != LBER_DEFAULT;
+		tag = ber_next_element( ber, &len, last ) )
+	{
+		vals = NULL;
+		if ( ber_scanf( ber, "{m[W]}", &type, &vals ) == LBER_ERROR )
+			break;
+		ber_bvarray_free_x( vals, bop->o_tmpmemctx );
+	}
+}
+
+typedef struct slap_bench {
+	const char	*sb_name;
+	void		(*sb_func)( unsigned long i );
+	unsigned long	sb_iterations;	/* default */
+} slap_bench;
+
+static slap_bench benches[] = {
+	{ "filter", bench_filter, 1000000 },
+	{ "dn", bench_dn, 1000000 },
+	{ "utf8", bench_utf8, 1000000 },
+	{ "substr", bench_substr, 1000000 },
+#if SLAPD_MDB == SLAPD_MOD_STATIC
+	{ "idl-and", bench_idl_and, 10000 },
+	{ "idl-or", bench_idl_or, 10000 },
+#endif
+	{ "entry-encode", bench_entry_encode, 1000000 },
+	{ "entry-decode", bench_entry_decode, 1000000 },
+	{ "ber-encode", bench_ber_encode, 1000000 },
+	{ "ber-decode", bench_ber_decode, 1000000 },
+	{ NULL }
+};
+
+static int
+bench_setup( const char *progname )
+{
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	Attribute *a;
+	const char *text;
+	int i;
+#if SLAPD_MDB == SLAPD_MOD_STATIC
+	ID id;
+#endif
+
+	bentry = str2entry( bench_ldif );
+	if ( bentry == NULL ) {
+		fprintf( stderr, "%s: unable to parse the test entry, "
+			"is cosine.schema missing?\n", progname );
+		return -1;
+	}
+
+	for ( i = 0; bench_filters[ i ]; i++ ) {
+		bfilters[ i ] = str2filter( bench_filters[ i ] );
+		if ( bfilters[ i ] == NULL ) {
+			fprintf( stderr, "%s: unable to parse filter %s\n",
+				progname, bench_filters[ i ] );
+			return -1;
+		}
+	}
+	for ( i = 0; bench_dns[ i ]; i++ )
+		ber_str2bv( bench_dns[ i ], 0, 0, &bdns[ i ] );
+	for ( i = 0; bench_strings[ i ]; i++ )
+		ber_str2bv( bench_strings[ i ], 0, 0, &bstrings[ i ] );
+
+	if ( slap_str2ad( "cn", &bsubad, &text ) != LDAP_SUCCESS ||
+		bsubad->ad_type->sat_substr == NULL ||
+		bsubad->ad_type->sat_substr->smr_indexer == NULL )
+	{
+		fprintf( stderr, "%s: no substring indexer for cn\n", progname );
+		return -1;
+	}
+	a = attr_find( bentry->e_attrs, bsubad );
+	bsubvals = a->a_nvals;
+
+#if SLAPD_MDB == SLAPD_MOD_STATIC
+	/* 1/2 and 1/3 of the first 96k IDs */
+	bidl_a = ch_malloc( BENCH_IDL_SIZE * sizeof( ID ) );
+	bidl_b = ch_malloc( BENCH_IDL_SIZE * sizeof( ID ) );
+	bidl_tmp = ch_malloc( BENCH_IDL_SIZE * sizeof( ID ) );
+	bidl_a[0] = bidl_b[0] = 0;
+	for ( id = 1; id <= 96 * 1024; id++ ) {
+		if ( id % 2 == 0 )
+			bidl_a[ ++bidl_a[0] ] = id;
+		if ( id % 3 == 0 )
+			bidl_b[ ++bidl_b[0] ] = id;
+	}
+#endif
+
+	entry_encode( bentry, &bencoded );
+
+	ber_init2( ber, NULL, LBER_USE_DER );
+	ber_printf( ber, "{it{O{" /*}}}*/, 42, LDAP_RES_SEARCH_ENTRY,
+		&bentry->e_name );
+	for ( a = bentry->e_attrs; a; a = a->a_next ) {
+		ber_printf( ber, "{O[W]}", &a->a_desc->ad_cname, a->a_vals );
+	}
+	ber_printf( ber, /*{{{*/ "}}N}" );
+	ber_flatten2( ber, &bber, 1 );
+	ber_free_buf( ber );
+
+	return 0;
+}
+
+static void
+bench_cleanup( void )
+{
+	int i;
+
+	ch_free( bber.bv_val );
+	ch_free( bencoded.bv_val );
+#if SLAPD_MDB == SLAPD_MOD_STATIC
+	ch_free( bidl_a );
+	ch_free( bidl_b );
+	ch_free( bidl_tmp );
+#endif
+	for ( i = 0; bfilters[ i ]; i++ )
+		filter_free( bfilters[ i ] );
+	entry_free( bentry );
+}
+
+static void
+bench_run( slap_bench *sb, void *thrctx )
+{
+	struct timeval start, end;
+	unsigned long i, n, nalloc = 0;
+	double usec;
+
+	n = iterations ? iterations : sb->sb_iterations;
+
+	/* warm up the caches */
+	for ( i = 0; i < n / 100 + 1; i++ ) {
+		bop->o_tmpmemctx = slap_sl_mem_create( SLAP_SLAB_SIZE,
+			SLAP_SLAB_STACK, thrctx, 1 );
+		sb->sb_func( i );
+	}
+
+	ber_set_option( NULL, LBER_OPT_MEMORY_COUNT, &nalloc );
+	gettimeofday( &start, NULL );
+	for ( i = 0; i < n; i++ ) {
+		bop->o_tmpmemctx = slap_sl_mem_create( SLAP_SLAB_SIZE,
+			SLAP_SLAB_STACK, thrctx, 1 );
+		sb->sb_func( i );
+	}
+	gettimeofday( &end, NULL );
+	ber_set_option( NULL, LBER_OPT_MEMORY_COUNT, NULL );
+
+	usec = ( end.tv_sec - start.tv_sec ) * 1000000.0 +
+		( end.tv_usec - start.tv_usec );
+	printf( "%-14s iterations=%lu ns/op=%.1f allocs/op=%.2f\n",
+		sb->sb_name, n, usec * 1000 / n, (double)nalloc / n );
+}
+
+int
+slapbench( int argc, char **argv )
+{
+	int			rc = EXIT_SUCCESS, i;
+	const char		*progname = "slapbench";
+	Connection		conn = { 0 };
+	OperationBuffer		opbuf;
+	void			*thrctx;
+	slap_bench		*sb;
+
+	slap_tool_init( progname, SLAPBENCH, argc, argv );
+
+	argv = &argv[ optind ];
+	argc -= optind;
+
+	for ( i = 0; i < argc; i++ ) {
+		for ( sb = benches; sb->sb_name; sb++ ) {
+			if ( strcasecmp( argv[ i ], sb->sb_name ) == 0 )
+				break;
+		}
+		if ( sb->sb_name == NULL ) {
+			fprintf( stderr, "%s: unknown benchmark \"%s\"; known are",
+				progname, argv[ i ] );
+			for ( sb = benches; sb->sb_name; sb++ )
+				fprintf( stderr, " %s", sb->sb_name );
+			fprintf( stderr, "\n" );
+			rc = EXIT_FAILURE;
+			goto destroy;
+		}
+	}
+
+	thrctx = ldap_pvt_thread_pool_context();
+	connection_fake_init( &conn, &opbuf, thrctx );
+	bop = &opbuf.ob_op;
+	bop->o_bd = frontendDB;
+
+	if ( bench_setup( progname ) ) {
+		rc = EXIT_FAILURE;
+		goto destroy;
+	}
+
+	for ( sb = benches; sb->sb_name; sb++ ) {
+		if ( argc ) {
+			for ( i = 0; i < argc; i++ ) {
+				if ( strcasecmp( argv[ i ], sb->sb_name ) == 0 )
+					break;
+			}
+			if ( i == argc )
+				continue;
+		}
+		bench_run( sb, thrctx );
+	}
+
+	bop->o_tmpmemctx = NULL;
+	bench_cleanup();
+
+destroy:;
+	if ( slap_tool_destroy() )
+		rc = EXIT_FAILURE;
+
+	return rc;
+}
@@ -40,6 +40,268 @@ slapcat_sig( int sig )
 	gotsig=1;
 }
 
+/*
+ * Parallel export, for backends with bi_tool_entry_scan. The ID space
+ * is cut in chunks of SLAPCAT_CHUNK IDs that worker threads turn into
+ * LDIF in a buffer each; the main thread writes the buffers in ID
+ * order, so the output is the same as the sequential one. At most
+ * SLAPCAT_WINDOW chunks per thread are formatted ahead of the writer.
+ *
+ * With -o shard=yes every thread instead exports one contiguous part
+ * of the ID space to a file of its own: the -l file and then
+ * <ldiffile>.1, <ldiffile>.2, ... in order.
+ */
+#define SLAPCAT_CHUNK	1024
+#define SLAPCAT_WINDOW	4
+
+typedef struct slapcat_buf {
+	struct berval	sb_bv;
+	ber_len_t	sb_size;
+	int	sb_rc;		/* EXIT_FAILURE if an entry was missing */
+	int	sb_stop;	/* the scan was cut short */
+	int	sb_done;
+} slapcat_buf;
+
+static struct slapcat_par {
+	ldap_pvt_thread_mutex_t	sp_mutex;
+	ldap_pvt_thread_cond_t	sp_cond;
+	ID	sp_max;
+	unsigned long	sp_nchunks;
+	unsigned long	sp_issued;
+	unsigned long	sp_written;
+	int	sp_nbufs;
+	slapcat_buf	*sp_bufs;
+	int	sp_stop;
+} par;
+
+static void
+slapcat_append( slapcat_buf *sb, const char *s, ber_len_t len )
+{
+	if ( sb->sb_bv.bv_len + len + 1 > sb->sb_size ) {
+		sb->sb_size = 2 * ( sb->sb_bv.bv_len + len + 1 );
+		sb->sb_bv.bv_val = ch_realloc( sb->sb_bv.bv_val, sb->sb_size );
+	}
+	AC_MEMCPY( sb->sb_bv.bv_val + sb->sb_bv.bv_len, s, len );
+	sb->sb_bv.bv_len += len;
+	sb->sb_bv.bv_val[ sb->sb_bv.bv_len ] = '\0';
+}
+
+static int
+slapcat_scan_cb( BackendDB *bd, ID id, Entry *e, void *arg )
+{
+	slapcat_buf *sb = arg;
+	char buf[ 64 ];
+	int len;
+
+	if ( gotsig || par.sp_stop )
+		return -1;
+
+	if ( e == NULL ) {
+		len = snprintf( buf, sizeof( buf ),
+			"# no data for entry id=%08lx\n\n", (long) id );
+		slapcat_append( sb, buf, len );
+		sb->sb_rc = EXIT_FAILURE;
+		return continuemode ? 0 : -1;
+	}
+
+	if ( sub_ndn.bv_len && !dnIsSuffixScope( &e->e_nname, &sub_ndn, scope ) )
+		return 0;
+	if ( filter != NULL && test_filter( NULL, e, filter ) != LDAP_COMPARE_TRUE )
+		return 0;
+
+	if ( verbose ) {
+		len = snprintf( buf, sizeof( buf ), "# id=%08lx\n", (long) id );
+		slapcat_append( sb, buf, len );
+	}
+	entry2str_append( e, &sb->sb_bv, &sb->sb_size, ldif_wrap );
+	slapcat_append( sb, "\n", 1 );
+
+	return 0;
+}
+
+static void *
+slapcat_task( void *ctx )
+{
+	slapcat_buf *sb;
+	unsigned long n;
+	ID first, last;
+
+	for (;;) {
+		ldap_pvt_thread_mutex_lock( &par.sp_mutex );
+		while ( !par.sp_stop && par.sp_issued < par.sp_nchunks &&
+			par.sp_issued - par.sp_written >= (unsigned long)par.sp_nbufs )
+			ldap_pvt_thread_cond_wait( &par.sp_cond, &par.sp_mutex );
+		if ( par.sp_stop || par.sp_issued == par.sp_nchunks ) {
+			ldap_pvt_thread_mutex_unlock( &par.sp_mutex );
+			break;
+		}
+		n = par.sp_issued++;
+		ldap_pvt_thread_mutex_unlock( &par.sp_mutex );
+
+		sb = &par.sp_bufs[ n % par.sp_nbufs ];
+		sb->sb_bv.bv_len = 0;
+		first = n * SLAPCAT_CHUNK + 1;
+		last = first + SLAPCAT_CHUNK - 1;
+		if ( last > par.sp_max )
+			last = par.sp_max;
+		if ( be->be_entry_scan( be, first, &last, slapcat_scan_cb, sb ) ) {
+			sb->sb_rc = EXIT_FAILURE;
+			sb->sb_stop = 1;
+		}
+
+		ldap_pvt_thread_mutex_lock( &par.sp_mutex );
+		sb->sb_done = 1;
+		ldap_pvt_thread_cond_broadcast( &par.sp_cond );
+		ldap_pvt_thread_mutex_unlock( &par.sp_mutex );
+	}
+
+	return NULL;
+}
+
+static void *
+slapcat_shard_task( void *ctx )
+{
+	slapcat_buf *sb = ctx;
+	int i = sb - par.sp_bufs;
+	ID per = par.sp_max / par.sp_nbufs, first, last, end;
+	char *fname = NULL;
+	FILE *fp;
+
+	if ( i == 0 ) {
+		fp = ldiffp->fp;
+	} else {
+		fname = ch_malloc( strlen( ldiffile ) + 16 );
+		sprintf( fname, "%s.%d", ldiffile, i );
+		fp = fopen( fname, "w" );
+		if ( fp == NULL ) {
+			perror( fname );
+			ch_free( fname );
+			sb->sb_rc = EXIT_FAILURE;
+			par.sp_stop = 1;
+			return NULL;
+		}
+	}
+
+	first = i * per + 1;
+	end = ( i == par.sp_nbufs - 1 ) ? par.sp_max : ( i + 1 ) * per;
+	for ( ; first <= end && !sb->sb_stop; first = last + 1 ) {
+		last = first + SLAPCAT_CHUNK - 1;
+		if ( last > end )
+			last = end;
+		sb->sb_bv.bv_len = 0;
+		if ( be->be_entry_scan( be, first, &last, slapcat_scan_cb, sb ) ) {
+			sb->sb_rc = EXIT_FAILURE;
+			sb->sb_stop = 1;
+			par.sp_stop = 1;
+		}
+		if ( sb->sb_bv.bv_len && fwrite( sb->sb_bv.bv_val,
+			sb->sb_bv.bv_len, 1, fp ) != 1 )
+		{
+			perror( fname ? fname : ldiffile );
+			sb->sb_rc = EXIT_FAILURE;
+			sb->sb_stop = 1;
+			par.sp_stop = 1;
+		}
+	}
+
+	if ( fname ) {
+		if ( fclose( fp ) == EOF ) {
+			perror( fname );
+			sb->sb_rc = EXIT_FAILURE;
+		}
+		ch_free( fname );
+	}
+	return NULL;
+}
+
+static int
+slapcat_parallel( const char *progname )
+{
+	ldap_pvt_thread_t *tids;
+	slapcat_buf *sb;
+	int i, nthreads = slap_tool_thread_max, rc = EXIT_SUCCESS;
+
+	if ( be->be_entry_scan( be, 0, &par.sp_max, NULL, NULL ) ) {
+		fprintf( stderr, "%s: could not read database.\n", progname );
+		return EXIT_FAILURE;
+	}
+	if ( shard ) {
+		par.sp_nbufs = nthreads;
+		/* give every shard at least one chunk */
+		while ( par.sp_nbufs > 1 &&
+			par.sp_max / par.sp_nbufs < SLAPCAT_CHUNK )
+			par.sp_nbufs--;
+		nthreads = par.sp_nbufs;
+	} else {
+		par.sp_nchunks = ( par.sp_max + SLAPCAT_CHUNK - 1 ) / SLAPCAT_CHUNK;
+		par.sp_nbufs = SLAPCAT_WINDOW * nthreads;
+	}
+	par.sp_bufs = ch_calloc( par.sp_nbufs, sizeof( slapcat_buf ) );
+	tids = ch_calloc( nthreads, sizeof( ldap_pvt_thread_t ) );
+	ldap_pvt_thread_mutex_init( &par.sp_mutex );
+	ldap_pvt_thread_cond_init( &par.sp_cond );
+
+	for ( i = 0; i < nthreads; i++ ) {
+		if ( ldap_pvt_thread_create( &tids[i], 0, shard ?
+			slapcat_shard_task : slapcat_task, &par.sp_bufs[i] ) )
+		{
+			fprintf( stderr, "%s: could not start thread.\n", progname );
+			exit( EXIT_FAILURE );
+		}
+	}
+
+	for ( ; !shard && par.sp_written < par.sp_nchunks; ) {
+		sb = &par.sp_bufs[ par.sp_written % par.sp_nbufs ];
+
+		ldap_pvt_thread_mutex_lock( &par.sp_mutex );
+		while ( !sb->sb_done )
+			ldap_pvt_thread_cond_wait( &par.sp_cond, &par.sp_mutex );
+		ldap_pvt_thread_mutex_unlock( &par.sp_mutex );
+
+		if ( sb->sb_bv.bv_len && fwrite( sb->sb_bv.bv_val,
+			sb->sb_bv.bv_len, 1, ldiffp->fp ) != 1 )
+		{
+			fprintf( stderr, "%s: error writing output.\n", progname );
+			rc = EXIT_FAILURE;
+			break;
+		}
+		if ( sb->sb_rc )
+			rc = sb->sb_rc;
+		if ( sb->sb_stop || gotsig )
+			break;
+
+		ldap_pvt_thread_mutex_lock( &par.sp_mutex );
+		sb->sb_done = 0;
+		sb->sb_rc = 0;
+		par.sp_written++;
+		ldap_pvt_thread_cond_broadcast( &par.sp_cond );
+		ldap_pvt_thread_mutex_unlock( &par.sp_mutex );
+	}
+
+	if ( !shard ) {
+		/* let the workers go, whether done or not */
+		ldap_pvt_thread_mutex_lock( &par.sp_mutex );
+		par.sp_stop = 1;
+		ldap_pvt_thread_cond_broadcast( &par.sp_cond );
+		ldap_pvt_thread_mutex_unlock( &par.sp_mutex );
+	}
+
+	for ( i = 0; i < nthreads; i++ )
+		ldap_pvt_thread_join( tids[i], NULL );
+
+	for ( i = 0; i < par.sp_nbufs; i++ ) {
+		if ( shard && par.sp_bufs[i].sb_rc )
+			rc = par.sp_bufs[i].sb_rc;
+		ch_free( par.sp_bufs[i].sb_bv.bv_val );
+	}
+	ch_free( par.sp_bufs );
+	ch_free( tids );
+	ldap_pvt_thread_cond_destroy( &par.sp_cond );
+	ldap_pvt_thread_mutex_destroy( &par.sp_mutex );
+
+	return rc;
+}
+
 int
 slapcat( int argc, char **argv )
 {
@@ -80,6 +342,19 @@ slapcat( int argc, char **argv )
 		exit( EXIT_FAILURE );
 	}
 
+	if ( shard && ( !ldiffile || slap_tool_thread_max < 2 ||
+		!be->be_entry_scan ))
+	{
+		fprintf( stderr, "%s: shard=yes needs -l, tool-threads > 1 "
+			"and a database that supports it.\n", progname );
+		exit( EXIT_FAILURE );
+	}
+
+	if ( slap_tool_thread_max > 1 && be->be_entry_scan ) {
+		rc = slapcat_parallel( progname );
+		goto done;
+	}
+
 	op.o_bd = be;
 	if ( !requestBSF && be->be_entry_first ) {
 		id = be->be_entry_first( be );
@@ -167,6 +442,7 @@ slapcat( int argc, char **argv )
 		}
 	}
 
+done:
 	be->be_entry_close( be );
 
 	if ( slap_tool_destroy())
@@ -71,7 +71,12 @@ usage( int tool, const char *progname )
 
 	case SLAPADD:
 		options = " [-c]\n\t[-g] [-n databasenumber | -b suffix]\n"
-			"\t[-l ldiffile] [-j linenumber] [-q] [-u] [-s] [-w]\n";
+			"\t[-l ldiffile] [-j linenumber] [-q] [-u] [-s] [-w]\n"
+			"\t[-o sortmem=<MB>]\n";
+		break;
+
+	case SLAPBENCH:
+		options = "\n\t[-o iterations=<n>] [benchmark ...]\n";
 		break;
 
 	case SLAPAUTH:
@@ -80,7 +85,8 @@ usage( int tool, const char *progname )
 
 	case SLAPCAT:
 		options = " [-c]\n\t[-g] [-n databasenumber | -b suffix]"
-			" [-l ldiffile] [-a filter] [-s subtree] [-H url]\n";
+			" [-l ldiffile] [-a filter] [-s subtree] [-H url]\n"
+			"\t[-o shard={yes|no}]\n";
 		break;
 
 	case SLAPDN:
@@ -88,7 +94,8 @@ usage( int tool, const char *progname )
 		break;
 
 	case SLAPINDEX:
-		options = " [-c]\n\t[-g] [-n databasenumber | -b suffix] [attr ...] [-q] [-t]\n";
+		options = " [-c]\n\t[-g] [-n databasenumber | -b suffix] [attr ...] [-q] [-t]\n"
+			"\t[-o sortmem=<MB>]\n";
 		break;
 
 	case SLAPTEST:
@@ -250,6 +257,56 @@ parse_slapopt( int tool, int *mode )
 			break;
 		}
 
+	} else if ( strncasecmp( optarg, "shard", len ) == 0 ) {
+		switch ( tool ) {
+		case SLAPCAT:
+			if ( strcasecmp( p, "yes" ) == 0 ) {
+				shard = 1;
+			} else if ( strcasecmp( p, "no" ) == 0 ) {
+				shard = 0;
+			} else {
+				Debug( LDAP_DEBUG_ANY, "unable to parse shard=\"%s\".\n", p, 0, 0 );
+				return -1;
+			}
+			break;
+
+		default:
+			Debug( LDAP_DEBUG_ANY, "shard meaningless for tool.\n", 0, 0, 0 );
+			break;
+		}
+
+	} else if ( strncasecmp( optarg, "sortmem", len ) == 0 ) {
+		switch ( tool ) {
+		case SLAPADD:
+		case SLAPINDEX:
+			if ( lutil_atoul( &slap_tool_sortmem, p ) || !slap_tool_sortmem ||
+				slap_tool_sortmem > (unsigned long)-1 / ( 1024 * 1024 ))
+			{
+				Debug( LDAP_DEBUG_ANY, "unable to parse sortmem=\"%s\".\n", p, 0, 0 );
+				return -1;
+			}
+			slap_tool_sortmem *= 1024 * 1024;
+			break;
+
+		default:
+			Debug( LDAP_DEBUG_ANY, "sortmem meaningless for tool.\n", 0, 0, 0 );
+			break;
+		}
+
+	} else if ( strncasecmp( optarg, "iterations", len ) == 0 ) {
+		switch ( tool ) {
+		case SLAPBENCH:
+			if ( lutil_atoul( &iterations, p ) || !iterations ) {
+				Debug( LDAP_DEBUG_ANY, "unable to parse iterations=\"%s\".\n", p, 0, 0 );
+				return -1;
+			}
+			break;
+
+		default:
+			Debug( LDAP_DEBUG_ANY, "iterations meaningless for tool.\n", 0, 0, 0 );
+			break;
+		}
+
 	} else {
 		return -1;
 	}
@@ -279,7 +336,6 @@ slap_tool_init(
 	struct berval base = BER_BVNULL;
 	char *filterstr = NULL;
 	char *subtree = NULL;
-	char *ldiffile	= NULL;
 	char **debug_unknowns = NULL;
 	int rc, i;
 	int mode = SLAP_TOOL_MODE;
@@ -353,6 +409,11 @@ slap_tool_init(
 		mode |= SLAP_TOOL_READMAIN | SLAP_TOOL_READONLY;
 		break;
 
+	case SLAPBENCH:
+		options = "d:f:F:o:v";
+		mode |= SLAP_TOOL_READMAIN | SLAP_TOOL_READONLY;
+		break;
+
 	default:
 		fprintf( stderr, "%s: unknown tool mode (%d)\n", progname, tool );
 		exit( EXIT_FAILURE );
@@ -739,6 +800,7 @@ slap_tool_init(
 		/* FALLTHRU */
 	case SLAPDN:
 	case SLAPAUTH:
+	case SLAPBENCH:
 		be = NULL;
 		goto startup;
 
@@ -904,11 +966,6 @@ startup:;
 		confdir = NULL;
 	}
 
-	if ( ldiffile != NULL ) {
-		ch_free( ldiffile );
-		ldiffile = NULL;
-	}
-
 	/* slapdn doesn't specify a backend to startup */
 	if ( !dryrun && tool != SLAPDN ) {
 		need_shutdown = 1;
@@ -966,6 +1023,8 @@ int slap_tool_destroy( void )
 
 	if ( ldiffp && ldiffp != &dummy ) {
 		ldif_close( ldiffp );
+		ch_free( ldiffile );
+		ldiffile = NULL;
 	}
 	return rc;
 }
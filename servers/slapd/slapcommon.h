@@ -31,6 +31,7 @@ enum slaptool {
 	SLAPTEST,	/* slapd.conf test tool */
 	SLAPAUTH,	/* test authz-regexp and authc/authz stuff */
 	SLAPACL,	/* test acl */
+	SLAPBENCH,	/* time internal functions */
 	SLAPLAST
 };
 
@@ -48,6 +49,8 @@ typedef struct tool_vars {
 	struct berval tv_sub_ndn;
 	Filter *tv_filter;
 	struct LDIFFP	*tv_ldiffp;
+	char	*tv_ldiffile;
+	int tv_shard;
 	struct berval tv_baseDN;
 	struct berval tv_authcDN;
 	struct berval tv_authzDN;
@@ -66,6 +69,7 @@ typedef struct tool_vars {
 	unsigned tv_dn_mode;
 	unsigned int tv_csnsid;
 	ber_len_t tv_ldif_wrap;
+	unsigned long tv_iterations;
 	char tv_maxcsnbuf[ LDAP_PVT_CSNSTR_BUFSIZE * ( SLAP_SYNC_SID_MAX + 1 ) ];
 	struct berval tv_maxcsn[ SLAP_SYNC_SID_MAX + 1 ];
 } tool_vars;
@@ -85,6 +89,8 @@ extern tool_vars tool_globals;
 #define scope tool_globals.tv_scope
 #define filter tool_globals.tv_filter
 #define ldiffp tool_globals.tv_ldiffp
+#define ldiffile tool_globals.tv_ldiffile
+#define shard tool_globals.tv_shard
 #define baseDN tool_globals.tv_baseDN
 #define authcDN tool_globals.tv_authcDN
 #define authzDN tool_globals.tv_authzDN
@@ -103,6 +109,7 @@ extern tool_vars tool_globals;
 #define dn_mode tool_globals.tv_dn_mode
 #define csnsid tool_globals.tv_csnsid
 #define ldif_wrap tool_globals.tv_ldif_wrap
+#define iterations tool_globals.tv_iterations
 #define maxcsn tool_globals.tv_maxcsn
 #define maxcsnbuf tool_globals.tv_maxcsnbuf
 
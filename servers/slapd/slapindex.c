@@ -78,6 +78,18 @@ slapindex( int argc, char **argv )
 		exit( EXIT_FAILURE );
 	}
 
+	/* rebuild in bulk if the backend can */
+	if ( be->be_index_rebuild && slap_tool_thread_max > 1 &&
+		( slapMode & SLAP_TOOL_QUICK ))
+	{
+		rc = be->be_index_rebuild( be, adv );
+		if ( rc != SLAP_CB_CONTINUE ) {
+			rc = rc ? EXIT_FAILURE : EXIT_SUCCESS;
+			goto done;
+		}
+		rc = EXIT_SUCCESS;
+	}
+
 	if ( be->be_entry_first ) {
 		id = be->be_entry_first( be );
 
@@ -102,6 +114,7 @@ slapindex( int argc, char **argv )
 		}
 	}
 
+done:
 	(void) be->be_entry_close( be );
 
 	if ( slap_tool_destroy())
@@ -114,20 +114,34 @@ typedef struct syncinfo_s {
 	int			si_refreshPresent;
 	int			si_refreshDone;
 	int			si_refreshCount;
+	int			si_refreshTxnSize;	/* refresh entries per backend txn */
 	time_t		si_refreshBeg;
 	time_t		si_refreshEnd;
 	OpExtra		*si_refreshTxn;
 	int			si_syncdata;
 	int			si_logstate;
 	int			si_lazyCommit;
+	int			si_lazyCount;	/* writes not yet made durable */
+	int			si_trimAttrs;	/* don't ask for attrs we'd discard */
 	int			si_got;
 	int			si_strict_refresh;	/* stop listening during fallback refresh */
 	int			si_too_old;
 	ber_int_t	si_msgid;
-	Avlnode			*si_presentlist;
+	struct presentlist	*si_presentlist;
 	LDAP			*si_ld;
 	Connection		*si_conn;
 	LDAP_LIST_HEAD(np, nonpresent_entry)	si_nonpresentlist;
+	slap_tracectx	si_tracectx;	/* parent of the applied changes */
+	/* statistics, read without si_mutex by syncrepl_monitor() */
+	unsigned long	si_nApplied;	/* changes received and applied */
+	unsigned long	si_nRefresh;	/* entries received in this refresh */
+	unsigned long	si_winApplied;	/* changes in the current window */
+	unsigned long	si_winUsec;	/* and the time spent applying them */
+	time_t		si_winStart;
+	unsigned long	si_rate;	/* changes/sec in the last window */
+	unsigned long	si_latency;	/* usec per change in the last window */
+	time_t		si_lastApply;	/* when the last change was applied */
+	time_t		si_lastCSN;	/* and the time in its CSN */
 #ifdef ENABLE_REWRITE
 	struct rewrite_info *si_rewrite;
 	struct berval	si_suffixm;
@@ -135,11 +149,10 @@ typedef struct syncinfo_s {
 	ldap_pvt_thread_mutex_t	si_mutex;
 } syncinfo_t;
 
-static int syncuuid_cmp( const void *, const void * );
 static int presentlist_insert( syncinfo_t* si, struct berval *syncUUID );
-static void presentlist_delete( Avlnode **av, struct berval *syncUUID );
-static char *presentlist_find( Avlnode *av, struct berval *syncUUID );
-static int presentlist_free( Avlnode *av );
+static void presentlist_delete( struct presentlist *pl, struct berval *syncUUID );
+static int presentlist_find( struct presentlist *pl, struct berval *syncUUID );
+static int presentlist_free( struct presentlist *pl );
 static void syncrepl_del_nonpresent( Operation *, syncinfo_t *, BerVarray, struct sync_cookie *, int );
 static int syncrepl_message_to_op(
 					syncinfo_t *, Operation *, LDAPMessage * );
@@ -402,6 +415,55 @@ init_syncrepl(syncinfo_t *si)
 	si->si_exattrs = exattrs;	
 }
 
+/* Expand "+" in the requested attributes into the operational
+ * attributes we actually keep: dynamic attributes and those listed
+ * in exattrs would be dropped on arrival, so don't have the provider
+ * generate and send them for every entry.
+ */
+static char **
+syncrepl_trim_attrs( syncinfo_t *si, char **attrs )
+{
+	AttributeType *at;
+	char **trimmed;
+	int i, k, n, plus = -1;
+
+	for ( n = 0; attrs[n]; n++ ) {
+		if ( !strcmp( attrs[n], "+" ) )
+			plus = n;
+	}
+	if ( plus < 0 )
+		return NULL;
+
+	for ( i = 0, at_start( &at ); at; at_next( &at ) )
+		i++;
+	trimmed = ch_malloc( ( n + i + 1 ) * sizeof( char * ) );
+
+	for ( i = 0, k = 0; k < n; k++ ) {
+		if ( k != plus )
+			trimmed[i++] = attrs[k];
+	}
+
+	for ( at_start( &at ); at; at_next( &at ) ) {
+		if ( !is_at_operational( at ) ||
+			( at->sat_flags & SLAP_AT_DYNAMIC ) )
+			continue;
+		if ( si->si_exanlist ) {
+			int j;
+			for ( j = 0; si->si_exanlist[j].an_name.bv_val; j++ ) {
+				if ( si->si_exanlist[j].an_desc &&
+					si->si_exanlist[j].an_desc->ad_type == at )
+					break;
+			}
+			if ( si->si_exanlist[j].an_name.bv_val )
+				continue;
+		}
+		trimmed[i++] = at->sat_cname.bv_val;
+	}
+	trimmed[i] = NULL;
+
+	return trimmed;
+}
+
 static int
 ldap_sync_search(
 	syncinfo_t *si,
@@ -409,11 +471,12 @@ ldap_sync_search(
 {
 	BerElementBuffer berbuf;
 	BerElement *ber = (BerElement *)&berbuf;
-	LDAPControl c[3], *ctrls[4];
-	int rc;
+	LDAPControl c[4], *ctrls[5];
+	char tbuf[ SLAP_TRACEPARENT_LEN + 1 ];
+	int rc, nc;
 	int rhint;
 	char *base;
-	char **attrs, *lattrs[9];
+	char **attrs, *lattrs[9], **trimmed = NULL;
 	char *filter;
 	int attrsonly;
 	int scope;
@@ -459,6 +522,11 @@ ldap_sync_search(
 		attrs = si->si_attrs;
 		attrsonly = si->si_attrsonly;
 		scope = si->si_scope;
+		if ( si->si_trimAttrs && attrs ) {
+			trimmed = syncrepl_trim_attrs( si, attrs );
+			if ( trimmed )
+				attrs = trimmed;
+		}
 	}
 	if ( si->si_syncdata && si->si_logstate == SYNCLOG_FALLBACK ) {
 		si->si_type = LDAP_SYNC_REFRESH_ONLY;
@@ -489,19 +557,34 @@ ldap_sync_search(
 	c[1].ldctl_iscritical = 1;
 	ctrls[1] = &c[1];
 
+	nc = 2;
 	if ( !BER_BVISNULL( &si->si_bindconf.sb_authzId ) ) {
-		c[2].ldctl_oid = LDAP_CONTROL_PROXY_AUTHZ;
-		c[2].ldctl_value = si->si_bindconf.sb_authzId;
-		c[2].ldctl_iscritical = 1;
-		ctrls[2] = &c[2];
-		ctrls[3] = NULL;
+		c[nc].ldctl_oid = LDAP_CONTROL_PROXY_AUTHZ;
+		c[nc].ldctl_value = si->si_bindconf.sb_authzId;
+		c[nc].ldctl_iscritical = 1;
+		ctrls[nc] = &c[nc];
+		nc++;
+	}
+
+	/* each session is a trace of its own, the provider joins it */
+	if ( slap_trace_file ) {
+		slap_trace_new( &si->si_tracectx );
+		c[nc].ldctl_oid = LDAP_CONTROL_X_TRACE;
+		c[nc].ldctl_value.bv_val = tbuf;
+		slap_trace_format( &si->si_tracectx, &c[nc].ldctl_value );
+		c[nc].ldctl_iscritical = 0;
+		ctrls[nc] = &c[nc];
+		nc++;
 	} else {
-		ctrls[2] = NULL;
+		si->si_tracectx.tc_set = 0;
 	}
+	ctrls[nc] = NULL;
 
 	rc = ldap_search_ext( si->si_ld, base, scope, filter, attrs, attrsonly,
 		ctrls, NULL, NULL, si->si_slimit, &si->si_msgid );
 	ber_free_buf( ber );
+	if ( trimmed )
+		ch_free( trimmed );
 	return rc;
 }
 
@@ -749,6 +832,7 @@ do_syncrep1(
 	si->si_refreshBeg = slap_get_time();
 	si->si_refreshCount = 0;
 	si->si_refreshTxn = NULL;
+	si->si_nRefresh = 0;
 	Debug( LDAP_DEBUG_ANY, "do_syncrep1: %s starting refresh\n",
 		si->si_ridtxt, 0, 0 );
 
@@ -809,6 +893,65 @@ compare_csns( struct sync_cookie *sc1, struct sync_cookie *sc2, int *which )
 
 #define	SYNC_PAUSED	-3
 
+/* Make the writes done with lazyCommit so far durable, by committing
+ * an empty backend transaction; the backend syncs on that commit.
+ */
+static void
+syncrepl_lazy_flush( syncinfo_t *si, Operation *op )
+{
+	BackendDB *be = op->o_bd;
+	OpExtra *txn = NULL;
+
+	if ( !si->si_lazyCount || si->si_refreshCount )
+		return;
+	si->si_lazyCount = 0;
+	op->o_lazyCommit = SLAP_CONTROL_NONE;
+
+	op->o_bd = si->si_be;
+	if ( op->o_bd->bd_info->bi_op_txn &&
+		op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_BEGIN, &txn ) == 0 ) {
+		LDAP_SLIST_REMOVE( &op->o_extra, txn, OpExtra, oe_next );
+		op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_COMMIT, &txn );
+	}
+	op->o_bd = be;
+}
+
+#define SYNCREPL_STATS_WINDOW	10	/* seconds */
+
+/* Account for a change that took from start until now to apply */
+static void
+syncrepl_stats( syncinfo_t *si, struct timeval *start, struct berval *csn )
+{
+	struct timeval now;
+	struct lutil_tm tm;
+	struct lutil_timet tt;
+	time_t elapsed;
+
+	gettimeofday( &now, NULL );
+	if ( !si->si_refreshDone )
+		si->si_nRefresh++;
+	si->si_nApplied++;
+
+	elapsed = now.tv_sec - si->si_winStart;
+	if ( elapsed >= SYNCREPL_STATS_WINDOW ) {
+		/* an idle stretch counts towards the rate */
+		si->si_rate = si->si_winApplied / elapsed;
+		si->si_latency = si->si_winApplied ?
+			si->si_winUsec / si->si_winApplied : 0;
+		si->si_winStart = now.tv_sec;
+		si->si_winApplied = si->si_winUsec = 0;
+	}
+	si->si_winApplied++;
+	si->si_winUsec += ( now.tv_sec - start->tv_sec ) * 1000000 +
+		now.tv_usec - start->tv_usec;
+
+	si->si_lastApply = now.tv_sec;
+	if ( csn && lutil_parsetime( csn->bv_val, &tm ) == 0 ) {
+		lutil_tm2time( &tm, &tt );
+		si->si_lastCSN = tt.tt_sec;
+	}
+}
+
 static int
 do_syncrep2(
 	Operation *op,
@@ -831,6 +974,7 @@ do_syncrep2(
 
 	struct timeval *tout_p = NULL;
 	struct timeval tout = { 0, 0 };
+	struct timeval tstart;
 
 	int		refreshDeletes = 0;
 	char empty[6] = "empty";
@@ -1024,6 +1168,17 @@ do_syncrep2(
 				}
 			}
 			rc = 0;
+			/* Persist-phase changes are flushed in batches, see
+			 * syncrepl_lazy_flush()
+			 */
+			if ( si->si_lazyCommit && si->si_refreshDone &&
+				!SLAP_GLUE_INSTANCE( si->si_be ))
+			{
+				op->o_lazyCommit = SLAP_CONTROL_NONCRITICAL;
+				si->si_lazyCount++;
+			}
+			gettimeofday( &tstart, NULL );
+			slap_trace_child( op, &si->si_tracectx );
 			if ( si->si_syncdata && si->si_logstate == SYNCLOG_LOGGING ) {
 				modlist = NULL;
 				if ( ( rc = syncrepl_message_to_op( si, op, msg ) ) == LDAP_SUCCESS &&
@@ -1078,6 +1233,8 @@ do_syncrep2(
 				}
 				ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
 			}
+			slap_trace_span( op, "syncrepl", &tstart, rc, 0 );
+			syncrepl_stats( si, &tstart, syncCookie.ctxcsn );
 			ldap_controls_free( rctrls );
 			if ( modlist ) {
 				slap_mods_free( modlist, 1 );
@@ -1431,6 +1588,8 @@ do_syncrep2(
 		}
 		ldap_msgfree( msg );
 		msg = NULL;
+		if ( si->si_lazyCount >= si->si_refreshTxnSize )
+			syncrepl_lazy_flush( si, op );
 		if ( ldap_pvt_thread_pool_pausing( &connection_pool )) {
 			slap_sync_cookie_free( &syncCookie, 0 );
 			slap_sync_cookie_free( &syncCookie_req, 0 );
@@ -1440,6 +1599,7 @@ do_syncrep2(
 				si->si_refreshCount = 0;
 				si->si_refreshTxn = NULL;
 			}
+			syncrepl_lazy_flush( si, op );
 			return SYNC_PAUSED;
 		}
 	}
@@ -1451,6 +1611,9 @@ do_syncrep2(
 	}
 
 done:
+	/* no more input for now, or giving up: flush what we have */
+	syncrepl_lazy_flush( si, op );
+
 	if ( err != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_ANY,
 			"do_syncrep2: %s (%d) %s\n",
@@ -1784,11 +1947,11 @@ syncrepl_accesslog_mods(
 {
 	char *colon;
 	const char *text;
-	AttributeDescription *ad;
-	struct berval bv, bv2;
+	AttributeDescription *ad, *lastad = NULL;
+	struct berval bv, bv2, lastname = BER_BVNULL;
 	short op;
 	Modifications *mod = NULL, *modlist = NULL, **modtail;
-	int i, rc = 0;
+	int i, rc = 0, lastskip = 0;
 
 	modtail = &modlist;
 
@@ -1808,6 +1971,20 @@ syncrepl_accesslog_mods(
 		}
 
 		bv.bv_len = colon - bv.bv_val;
+
+		/* Values of one attribute come in a row, don't look it
+		 * up again for each of them
+		 */
+		if ( lastad && bv.bv_len == lastname.bv_len &&
+			!memcmp( bv.bv_val, lastname.bv_val, bv.bv_len ))
+		{
+			if ( lastskip )
+				continue;
+			ad = lastad;
+			goto gotad;
+		}
+		lastname = bv;
+
 		if ( slap_bv2ad( &bv, &ad, &text ) ) {
 			/* Invalid */
 			Debug( LDAP_DEBUG_ANY, "syncrepl_accesslog_mods: %s "
@@ -1819,6 +1996,9 @@ syncrepl_accesslog_mods(
 			break;
 		}
 
+		lastad = ad;
+		lastskip = 1;
+
 		/* Ignore dynamically generated attrs */
 		if ( ad->ad_type->sat_flags & SLAP_AT_DYNAMIC ) {
 			continue;
@@ -1830,7 +2010,9 @@ syncrepl_accesslog_mods(
 		{
 			continue;
 		}
+		lastskip = 0;
 
+gotad:
 		switch(colon[1]) {
 		case '+':	op = LDAP_MOD_ADD; break;
 		case '-':	op = LDAP_MOD_DELETE; break;
@@ -1857,8 +2039,15 @@ syncrepl_accesslog_mods(
 			bv.bv_val = colon + 3;
 			bv.bv_len = vals[i].bv_len - ( bv.bv_val - vals[i].bv_val );
 			REWRITE_VAL( si, ad, bv, bv2 );
-			ber_bvarray_add( &mod->sml_values, &bv2 );
-			mod->sml_numvals++;
+			/* grow the array by doubling, large mods have
+			 * many thousands of values
+			 */
+			if ( !( mod->sml_numvals & ( mod->sml_numvals - 1 ))) {
+				mod->sml_values = ch_realloc( mod->sml_values,
+					( 2 * mod->sml_numvals + 2 ) * sizeof( struct berval ));
+			}
+			mod->sml_values[mod->sml_numvals++] = bv2;
+			BER_BVZERO( &mod->sml_values[mod->sml_numvals] );
 		}
 	}
 	*modres = modlist;
@@ -1955,6 +2144,8 @@ static Modifications *mods_dup( Operation *op, Modifications *modlist, int match
 typedef struct resolve_ctxt {
 	syncinfo_t *rx_si;
 	Modifications *rx_mods;
+	struct berval rx_csn;
+	int rx_dup;	/* this change is already in the log */
 } resolve_ctxt;
 
 static void
@@ -1995,7 +2186,17 @@ syncrepl_resolve_cb( Operation *op, SlapReply *rs )
 {
 	if ( rs->sr_type == REP_SEARCH ) {
 		resolve_ctxt *rx = op->o_callback->sc_private;
-		Attribute *a = attr_find( rs->sr_entry->e_attrs, ad_reqMod );
+		Attribute *a;
+
+		if ( rx->rx_dup )
+			return LDAP_SUCCESS;
+		/* Another provider already delivered this very change */
+		a = attr_find( rs->sr_entry->e_attrs, slap_schema.si_ad_entryCSN );
+		if ( a && bvmatch( &a->a_nvals[0], &rx->rx_csn )) {
+			rx->rx_dup = 1;
+			return LDAP_SUCCESS;
+		}
+		a = attr_find( rs->sr_entry->e_attrs, ad_reqMod );
 		if ( a ) {
 			Modifications *oldmods, *newmods, *m1, *m2, **prev;
 			oldmods = rx->rx_mods;
@@ -2088,7 +2289,7 @@ syncrepl_op_modify( Operation *op, SlapReply *rs )
 	OpExtra *oex;
 	syncinfo_t *si;
 	Entry *e;
-	int rc, match = 0;
+	int rc, match = 0, asis = 0;
 	Modifications *mod, *newlist;
 
 	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
@@ -2188,12 +2389,28 @@ syncrepl_op_modify( Operation *op, SlapReply *rs )
 	 * 3. Change Adds of single-valued attrs to Replace.
 	 */
 
+	/* mod is newer and has nothing that needs tweaking: apply it as is */
+	if ( match > 0 ) {
+		Modifications *ml;
+		for ( ml = op->orm_modlist; ml; ml = ml->sml_next ) {
+			if ( ml->sml_op == LDAP_MOD_DELETE ||
+				( ml->sml_op == LDAP_MOD_ADD &&
+				ml->sml_desc->ad_type->sat_atype.at_single_value ))
+				break;
+		}
+		if ( !ml ) {
+			newlist = op->orm_modlist;
+			asis = 1;
+			goto apply;
+		}
+	}
+
 	newlist = mods_dup( op, op->orm_modlist, match );
 
 	/* mod is older */
 	if ( match < 0 ) {
 		Operation op2 = *op;
-		AttributeName an[2];
+		AttributeName an[3];
 		struct berval bv;
 		int size;
 		SlapReply rs1 = {0};
@@ -2204,6 +2421,8 @@ syncrepl_op_modify( Operation *op, SlapReply *rs )
 
 		rx.rx_si = si;
 		rx.rx_mods = newlist;
+		rx.rx_csn = mod->sml_nvalues[0];
+		rx.rx_dup = 0;
 		cb.sc_private = &rx;
 
 		op2.o_tag = LDAP_REQ_SEARCH;
@@ -2217,6 +2436,8 @@ syncrepl_op_modify( Operation *op, SlapReply *rs )
 		memset( an, 0, sizeof(an));
 		an[0].an_desc = ad_reqMod;
 		an[0].an_name = ad_reqMod->ad_cname;
+		an[1].an_desc = slap_schema.si_ad_entryCSN;
+		an[1].an_name = slap_schema.si_ad_entryCSN->ad_cname;
 		op2.ors_attrs = an;
 		op2.ors_attrsonly = 0;
 
@@ -2248,8 +2469,24 @@ syncrepl_op_modify( Operation *op, SlapReply *rs )
 		op2.o_bd = select_backend( &op2.o_req_ndn, 1 );
 		op2.o_bd->be_search( &op2, &rs1 );
 		newlist = rx.rx_mods;
+		op->o_tmpfree( op2.ors_filterstr.bv_val, op->o_tmpmemctx );
+
+		if ( rx.rx_dup ) {
+			Debug( LDAP_DEBUG_SYNC, "syncrepl_op_modify: %s change already applied, ignoring %s (%s)\n",
+				si->si_ridtxt, mod->sml_nvalues[0].bv_val, op->o_req_dn.bv_val );
+			while ( newlist ) {
+				Modifications *ml = newlist;
+				newlist = ml->sml_next;
+				op->o_tmpfree( ml, op->o_tmpmemctx );
+			}
+			slap_graduate_commit_csn( op );
+			/* tell accesslog this was a failure */
+			rs->sr_err = LDAP_TYPE_OR_VALUE_EXISTS;
+			return LDAP_SUCCESS;
+		}
 	}
 
+apply:
 	{
 		slap_callback *sc = op->o_tmpalloc( sizeof(slap_callback) +
 			sizeof(modify_ctxt), op->o_tmpmemctx );
@@ -2264,8 +2501,8 @@ syncrepl_op_modify( Operation *op, SlapReply *rs )
 		op->o_callback = sc;
 		op->orm_no_opattrs = 1;
 		mx->mx_orig = op->orm_modlist;
-		mx->mx_free = newlist;
-		for ( ml = newlist; ml; ml=ml->sml_next ) {
+		mx->mx_free = asis ? NULL : newlist;
+		for ( ml = asis ? NULL : newlist; ml; ml=ml->sml_next ) {
 			if ( ml->sml_flags == SLAP_MOD_INTERNAL ) {
 				ml->sml_flags = 0;
 				ml->sml_op = SLAP_MOD_SOFTDEL;
@@ -2834,7 +3071,82 @@ typedef struct dninfo {
 	AttributeDescription *newDesc;	/* for renames */
 } dninfo;
 
-#define HASHUUID	1
+/* The UUIDs received in a present phase are kept in an open-addressing
+ * hash set, stored in place with a state byte per slot; a present phase
+ * may list every entry of a large replica.
+ */
+typedef struct presentlist {
+	unsigned char	*pl_uuids;	/* pl_size slots of UUIDLEN bytes */
+	unsigned char	*pl_state;	/* PL_EMPTY, PL_USED or PL_GONE */
+	unsigned	pl_size;	/* a power of 2 */
+	unsigned	pl_used;	/* slots not PL_EMPTY */
+	unsigned	pl_count;	/* slots PL_USED */
+} presentlist;
+
+#define PL_EMPTY	0
+#define PL_USED		1
+#define PL_GONE		2
+
+#define PL_INITSIZE	1024
+
+static unsigned
+presentlist_hash( const char *uuid )
+{
+	unsigned int w[4], h;
+
+	AC_MEMCPY( w, uuid, UUIDLEN );
+	h = w[0] ^ ( w[1] * 0x9e3779b1U ) ^ ( w[2] * 0x85ebca6bU ) ^
+		( w[3] * 0xc2b2ae35U );
+	h ^= h >> 16;
+	h *= 0x7feb352dU;
+	h ^= h >> 15;
+	return h;
+}
+
+/* Return the slot holding uuid, or where it would go */
+static unsigned
+presentlist_slot( presentlist *pl, const char *uuid, int *found )
+{
+	unsigned mask = pl->pl_size - 1, i, gone = pl->pl_size;
+
+	for ( i = presentlist_hash( uuid ) & mask;; i = ( i + 1 ) & mask ) {
+		if ( pl->pl_state[i] == PL_EMPTY )
+			break;
+		if ( pl->pl_state[i] == PL_GONE ) {
+			if ( gone == pl->pl_size )
+				gone = i;
+		} else if ( !memcmp( pl->pl_uuids + i * UUIDLEN, uuid, UUIDLEN )) {
+			*found = 1;
+			return i;
+		}
+	}
+	*found = 0;
+	return gone < pl->pl_size ? gone : i;
+}
+
+static void
+presentlist_resize( presentlist *pl, unsigned size )
+{
+	presentlist old = *pl;
+	unsigned i, j;
+	int found;
+
+	pl->pl_size = size;
+	pl->pl_uuids = ch_malloc( size * UUIDLEN );
+	pl->pl_state = ch_calloc( size, 1 );
+	pl->pl_used = pl->pl_count;
+
+	for ( i = 0; i < old.pl_size; i++ ) {
+		if ( old.pl_state[i] != PL_USED )
+			continue;
+		j = presentlist_slot( pl, (char *)old.pl_uuids + i * UUIDLEN, &found );
+		AC_MEMCPY( pl->pl_uuids + j * UUIDLEN, old.pl_uuids + i * UUIDLEN,
+			UUIDLEN );
+		pl->pl_state[j] = PL_USED;
+	}
+	ch_free( old.pl_uuids );
+	ch_free( old.pl_state );
+}
 
 /* return 1 if inserted, 0 otherwise */
 static int
@@ -2842,96 +3154,82 @@ presentlist_insert(
 	syncinfo_t* si,
 	struct berval *syncUUID )
 {
-	char *val;
-
-#ifdef HASHUUID
-	Avlnode **av;
-	unsigned short s;
-
-	if ( !si->si_presentlist )
-		si->si_presentlist = ch_calloc(65536, sizeof( Avlnode * ));
+	presentlist *pl = si->si_presentlist;
+	unsigned i;
+	int found;
 
-	av = (Avlnode **)si->si_presentlist;
-
-	val = ch_malloc(UUIDLEN-2);
-	memcpy(&s, syncUUID->bv_val, 2);
-	memcpy(val, syncUUID->bv_val+2, UUIDLEN-2);
-
-	if ( avl_insert( &av[s], val,
-		syncuuid_cmp, avl_dup_error ) )
-	{
-		ch_free( val );
+	if ( syncUUID->bv_len != UUIDLEN )
 		return 0;
+
+	if ( !pl ) {
+		pl = ch_calloc( 1, sizeof( presentlist ));
+		presentlist_resize( pl, PL_INITSIZE );
+		si->si_presentlist = pl;
 	}
-#else
-	val = ch_malloc(UUIDLEN);
 
-	AC_MEMCPY( val, syncUUID->bv_val, UUIDLEN );
+	/* keep at most 3/4 of the slots in use */
+	if ( ( pl->pl_used + 1 ) * 4 > pl->pl_size * 3 ) {
+		presentlist_resize( pl, pl->pl_count * 2 >= pl->pl_size ?
+			pl->pl_size * 2 : pl->pl_size );
+	}
 
-	if ( avl_insert( &si->si_presentlist, val,
-		syncuuid_cmp, avl_dup_error ) )
-	{
-		ch_free( val );
+	i = presentlist_slot( pl, syncUUID->bv_val, &found );
+	if ( found )
 		return 0;
-	}
-#endif
+
+	if ( pl->pl_state[i] == PL_EMPTY )
+		pl->pl_used++;
+	pl->pl_state[i] = PL_USED;
+	AC_MEMCPY( pl->pl_uuids + i * UUIDLEN, syncUUID->bv_val, UUIDLEN );
+	pl->pl_count++;
 
 	return 1;
 }
 
-static char *
+static int
 presentlist_find(
-	Avlnode *av,
+	presentlist *pl,
 	struct berval *val )
 {
-#ifdef HASHUUID
-	Avlnode **a2 = (Avlnode **)av;
-	unsigned short s;
+	int found;
 
-	if (!av)
-		return NULL;
+	if ( !pl || val->bv_len != UUIDLEN )
+		return 0;
 
-	memcpy(&s, val->bv_val, 2);
-	return avl_find( a2[s], val->bv_val+2, syncuuid_cmp );
-#else
-	return avl_find( av, val->bv_val, syncuuid_cmp );
-#endif
+	(void)presentlist_slot( pl, val->bv_val, &found );
+	return found;
 }
 
 static int
-presentlist_free( Avlnode *av )
+presentlist_free( presentlist *pl )
 {
-#ifdef HASHUUID
-	Avlnode **a2 = (Avlnode **)av;
-	int i, count = 0;
+	int count = 0;
 
-	if ( av ) {
-		for (i=0; i<65536; i++) {
-			if (a2[i])
-				count += avl_free( a2[i], ch_free );
-		}
-		ch_free( av );
+	if ( pl ) {
+		count = pl->pl_count;
+		ch_free( pl->pl_uuids );
+		ch_free( pl->pl_state );
+		ch_free( pl );
 	}
 	return count;
-#else
-	return avl_free( av, ch_free );
-#endif
 }
 
 static void
 presentlist_delete(
-	Avlnode **av,
+	presentlist *pl,
 	struct berval *val )
 {
-#ifdef HASHUUID
-	Avlnode **a2 = *(Avlnode ***)av;
-	unsigned short s;
+	unsigned i;
+	int found;
 
-	memcpy(&s, val->bv_val, 2);
-	avl_delete( &a2[s], val->bv_val+2, syncuuid_cmp );
-#else
-	avl_delete( av, val->bv_val, syncuuid_cmp );
-#endif
+	if ( !pl || val->bv_len != UUIDLEN )
+		return;
+
+	i = presentlist_slot( pl, val->bv_val, &found );
+	if ( found ) {
+		pl->pl_state[i] = PL_GONE;
+		pl->pl_count--;
+	}
 }
 
 static int
@@ -3074,9 +3372,11 @@ syncrepl_entry(
 	}
 
 	if ( !si->si_refreshDone ) {
-		if ( si->si_lazyCommit )
+		if ( si->si_lazyCommit ) {
 			op->o_lazyCommit = SLAP_CONTROL_NONCRITICAL;
-		if ( si->si_refreshCount == 500 ) {
+			si->si_lazyCount++;
+		}
+		if ( si->si_refreshCount >= si->si_refreshTxnSize ) {
 			LDAP_SLIST_REMOVE( &op->o_extra, si->si_refreshTxn, OpExtra, oe_next );
 			op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_COMMIT, &si->si_refreshTxn );
 			si->si_refreshCount = 0;
@@ -4488,7 +4788,7 @@ nonpresent_callback(
 	syncinfo_t *si = op->o_callback->sc_private;
 	Attribute *a;
 	int count = 0;
-	char *present_uuid = NULL;
+	int present_uuid = 0;
 	struct nonpresent_entry *np_entry;
 
 	if ( rs->sr_type == REP_RESULT ) {
@@ -4516,7 +4816,7 @@ nonpresent_callback(
 			if ( a == NULL ) return 0;
 		}
 
-		if ( present_uuid == NULL ) {
+		if ( !present_uuid ) {
 			np_entry = (struct nonpresent_entry *)
 				ch_calloc( 1, sizeof( struct nonpresent_entry ) );
 			np_entry->npe_name = ber_dupbv( NULL, &rs->sr_entry->e_name );
@@ -4524,8 +4824,7 @@ nonpresent_callback(
 			LDAP_LIST_INSERT_HEAD( &si->si_nonpresentlist, np_entry, npe_link );
 
 		} else {
-			presentlist_delete( &si->si_presentlist, &a->a_nvals[0] );
-			ch_free( present_uuid );
+			presentlist_delete( si->si_presentlist, &a->a_nvals[0] );
 		}
 	}
 	return LDAP_SUCCESS;
@@ -4634,16 +4933,6 @@ done:;
 	return new;
 }
 
-static int
-syncuuid_cmp( const void* v_uuid1, const void* v_uuid2 )
-{
-#ifdef HASHUUID
-	return ( memcmp( v_uuid1, v_uuid2, UUIDLEN-2 ));
-#else
-	return ( memcmp( v_uuid1, v_uuid2, UUIDLEN ));
-#endif
-}
-
 void
 syncinfo_free( syncinfo_t *sie, int free_all )
 {
@@ -4786,6 +5075,112 @@ syncinfo_free( syncinfo_t *sie, int free_all )
 	} while ( free_all && si_next );
 }
 
+/*
+ * Changes/sec and usec per change over the last full window. If no
+ * change has closed the current window yet, it is the last one.
+ */
+static void
+syncrepl_rate( syncinfo_t *si, unsigned long *rate, unsigned long *latency )
+{
+	time_t elapsed = slap_get_time() - si->si_winStart;
+
+	if ( elapsed >= SYNCREPL_STATS_WINDOW ) {
+		*rate = si->si_winApplied / elapsed;
+		*latency = si->si_winApplied ?
+			si->si_winUsec / si->si_winApplied : 0;
+	} else {
+		*rate = si->si_rate;
+		*latency = si->si_latency;
+	}
+}
+
+/*
+ * How far behind the provider the last change was applied, in
+ * seconds: the time it was applied less the time in its CSN.
+ */
+static long
+syncrepl_lag( syncinfo_t *si )
+{
+	if ( !si->si_lastCSN || si->si_lastApply < si->si_lastCSN )
+		return 0;
+	return (long)( si->si_lastApply - si->si_lastCSN );
+}
+
+/*
+ * Report the state of the consumers of a database to the metrics
+ * extended operation. The fields are read without si_mutex, which
+ * the consumer task holds for the whole of a refresh; the values
+ * are only a snapshot anyway.
+ */
+void
+syncrepl_metrics( BackendDB *be, slap_metrics *ms )
+{
+	syncinfo_t *si;
+	char labels[ sizeof( "rid=\"\"" ) + sizeof( si->si_ridtxt ) ];
+	unsigned long rate, latency;
+
+	for ( si = be->be_syncinfo; si; si = si->si_next ) {
+		syncrepl_rate( si, &rate, &latency );
+		snprintf( labels, sizeof( labels ), "rid=\"%03d\"", si->si_rid );
+		slap_metrics_add( ms, "slapd_syncrepl_connected", "gauge",
+			be, labels, "%d", si->si_ld != NULL );
+		slap_metrics_add( ms, "slapd_syncrepl_refresh_done", "gauge",
+			be, labels, "%d", si->si_refreshDone );
+		slap_metrics_add( ms, "slapd_syncrepl_refresh_start_seconds", "gauge",
+			be, labels, "%ld", (long) si->si_refreshBeg );
+		slap_metrics_add( ms, "slapd_syncrepl_refresh_end_seconds", "gauge",
+			be, labels, "%ld", (long) si->si_refreshEnd );
+		slap_metrics_add( ms, "slapd_syncrepl_refresh_entries", "gauge",
+			be, labels, "%lu", si->si_nRefresh );
+		slap_metrics_add( ms, "slapd_syncrepl_applied_total", "counter",
+			be, labels, "%lu", si->si_nApplied );
+		slap_metrics_add( ms, "slapd_syncrepl_apply_rate", "gauge",
+			be, labels, "%lu", rate );
+		slap_metrics_add( ms, "slapd_syncrepl_apply_latency_microseconds",
+			"gauge", be, labels, "%lu", latency );
+		slap_metrics_add( ms, "slapd_syncrepl_uncommitted", "gauge",
+			be, labels, "%d", si->si_lazyCount );
+		slap_metrics_add( ms, "slapd_syncrepl_lag_seconds", "gauge",
+			be, labels, "%ld", syncrepl_lag( si ));
+		slap_metrics_add( ms, "slapd_syncrepl_last_change_seconds", "gauge",
+			be, labels, "%ld", (long) si->si_lastApply );
+	}
+}
+
+/*
+ * Describe each consumer of a database for its entry under
+ * cn=Databases,cn=Monitor, one value per consumer.
+ */
+int
+syncrepl_monitor( BackendDB *be, BerVarray *vals )
+{
+	syncinfo_t *si;
+	struct berval bv;
+	char buf[ SLAP_TEXT_BUFLEN ];
+	unsigned long rate, latency;
+	int n = 0;
+
+	for ( si = be->be_syncinfo; si; si = si->si_next ) {
+		syncrepl_rate( si, &rate, &latency );
+		bv.bv_val = buf;
+		bv.bv_len = snprintf( buf, sizeof( buf ),
+			"%s provider=%s state=%s refreshEntries=%lu "
+			"applied=%lu rate=%lu latency=%lu uncommitted=%d "
+			"lag=%ld lastChange=%ld",
+			si->si_ridtxt, si->si_bindconf.sb_uri.bv_val,
+			si->si_ld == NULL ? "disconnected" :
+				si->si_refreshDone ? "persist" : "refresh",
+			si->si_nRefresh, si->si_nApplied, rate, latency,
+			si->si_lazyCount, syncrepl_lag( si ),
+			(long) si->si_lastApply );
+		if ( bv.bv_len >= sizeof( buf ))
+			bv.bv_len = sizeof( buf ) - 1;
+		value_add_one( vals, &bv );
+		n++;
+	}
+	return n;
+}
+
 #ifdef ENABLE_REWRITE
 static int
 config_suffixm( ConfigArgs *c, syncinfo_t *si )
@@ -4845,6 +5240,10 @@ config_suffixm( ConfigArgs *c, syncinfo_t *si )
 #define SUFFIXMSTR		"suffixmassage"
 #define	STRICT_REFRESH	"strictrefresh"
 #define LAZY_COMMIT		"lazycommit"
+#define TXNSIZESTR		"txnsize"
+#define TRIMATTRSSTR		"trimattrs"
+
+#define SYNC_REFRESH_TXN_SIZE	500
 
 /* FIXME: undocumented */
 #define EXATTRSSTR		"exattrs"
@@ -5351,6 +5750,23 @@ parse_syncrepl_line(
 					STRLENOF( LAZY_COMMIT ) ) )
 		{
 			si->si_lazyCommit = 1;
+		} else if ( !strncasecmp( c->argv[ i ], TRIMATTRSSTR,
+					STRLENOF( TRIMATTRSSTR ) ) )
+		{
+			si->si_trimAttrs = 1;
+		} else if ( !strncasecmp( c->argv[ i ], TXNSIZESTR "=",
+					STRLENOF( TXNSIZESTR "=" ) ) )
+		{
+			val = c->argv[ i ] + STRLENOF( TXNSIZESTR "=" );
+			if ( lutil_atoi( &si->si_refreshTxnSize, val ) != 0
+				|| si->si_refreshTxnSize < 1 )
+			{
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"invalid txnsize value \"%s\".\n",
+					val );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg, 0 );
+				return 1;
+			}
 		} else if ( !bindconf_parse( c->argv[i], &si->si_bindconf ) ) {
 			si->si_got |= GOT_BINDCONF;
 		} else {
@@ -5471,6 +5887,7 @@ add_syncrepl(
 	si->si_manageDSAit = 0;
 	si->si_tlimit = 0;
 	si->si_slimit = 0;
+	si->si_refreshTxnSize = SYNC_REFRESH_TXN_SIZE;
 
 	si->si_presentlist = NULL;
 	LDAP_LIST_INIT( &si->si_nonpresentlist );
@@ -5766,6 +6183,18 @@ syncrepl_unparse( syncinfo_t *si, struct berval *bv )
 		ptr = lutil_strcopy( ptr, " " LAZY_COMMIT );
 	}
 
+	if ( si->si_trimAttrs ) {
+		if ( WHATSLEFT <= STRLENOF( " " TRIMATTRSSTR ) ) return;
+		ptr = lutil_strcopy( ptr, " " TRIMATTRSSTR );
+	}
+
+	if ( si->si_refreshTxnSize != SYNC_REFRESH_TXN_SIZE ) {
+		len = snprintf( ptr, WHATSLEFT, " " TXNSIZESTR "=%d",
+			si->si_refreshTxnSize );
+		if ( WHATSLEFT <= len ) return;
+		ptr += len;
+	}
+
 	bc.bv_len = ptr - buf;
 	bc.bv_val = buf;
 	ber_dupbv( bv, &bc );
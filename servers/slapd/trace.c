@@ -0,0 +1,422 @@
+/* trace.c - trace context propagation and span export */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include <ac/string.h>
+#include <ac/time.h>
+#include <ac/unistd.h>
+
+#include "slap.h"
+#include "lutil.h"
+#include "ldap_rq.h"
+
+char *slap_trace_file;
+
+/*
+ * The trace control carries a W3C traceparent,
+ *	00-<32 hex trace-id>-<16 hex parent-id>-<2 hex flags>
+ * Each traced operation gets a span-id of its own, and the parent-id
+ * in the control is replaced by it so that back-ldap, back-meta and
+ * chain, which forward the request controls, hand our span to the
+ * next server as its parent.
+ *
+ * Spans of sampled operations are formatted as JSON lines into a
+ * buffer, and a runqueue task appends the buffer to tracefile every
+ * SLAP_TRACE_INTERVAL seconds. Spans that don't fit in the buffer
+ * are dropped and counted.
+ */
+#define SLAP_TRACE_INTERVAL	1
+#define SLAP_TRACE_BUFMAX	( 1024 * 1024 )
+
+static ldap_pvt_thread_mutex_t slap_trace_mutex;	/* buffer, ids */
+static char *slap_trace_buf;
+static ber_len_t slap_trace_len, slap_trace_size;
+static unsigned long slap_trace_dropped;
+static unsigned long long slap_trace_seed;
+
+static ldap_pvt_thread_mutex_t slap_trace_fmutex;	/* file */
+static FILE *slap_trace_fp;
+static struct re_s *slap_trace_task;
+
+static const char slap_hex[] = "0123456789abcdef";
+
+/* splitmix64, ids only need to be unique, not secret */
+static unsigned long long
+slap_trace_rand( void )
+{
+	unsigned long long z;
+
+	ldap_pvt_thread_mutex_lock( &slap_trace_mutex );
+	z = ( slap_trace_seed += 0x9e3779b97f4a7c15ULL );
+	ldap_pvt_thread_mutex_unlock( &slap_trace_mutex );
+	z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+	z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+	return z ^ ( z >> 31 );
+}
+
+static void
+slap_trace_id( unsigned char *id, int len )
+{
+	unsigned long long r = 0;
+	int i;
+
+	do {
+		for ( i = 0; i < len; i++ ) {
+			if ( !( i & 7 ))
+				r = slap_trace_rand();
+			id[i] = r & 0xff;
+			r >>= 8;
+		}
+		/* all zero is invalid */
+		for ( i = 0; i < len && !id[i]; i++ )
+			;
+	} while ( i == len );
+}
+
+static char *
+slap_trace_hex( char *ptr, const unsigned char *id, int len )
+{
+	int i;
+
+	for ( i = 0; i < len; i++ ) {
+		*ptr++ = slap_hex[ id[i] >> 4 ];
+		*ptr++ = slap_hex[ id[i] & 0x0f ];
+	}
+	return ptr;
+}
+
+/* traceparent only allows lowercase hex */
+static int
+slap_trace_xval( char c )
+{
+	if ( LDAP_DIGIT( c ))
+		return c - '0';
+	if ( LDAP_HEXLOWER( c ))
+		return c - 'a' + 10;
+	return -1;
+}
+
+static int
+slap_trace_unhex( unsigned char *id, const char *ptr, int len )
+{
+	int i, hi, lo, nz = 0;
+
+	for ( i = 0; i < len; i++ ) {
+		hi = slap_trace_xval( ptr[2*i] );
+		lo = slap_trace_xval( ptr[2*i+1] );
+		if ( hi < 0 || lo < 0 )
+			return -1;
+		id[i] = ( hi << 4 ) | lo;
+		nz |= id[i];
+	}
+	return nz;
+}
+
+/*
+ * Set tc from the value of a trace control and give the operation a
+ * span of its own. The parent-id in val is replaced by that span-id.
+ */
+int
+slap_trace_parse( slap_tracectx *tc, struct berval *val )
+{
+	char *ptr = val->bv_val;
+	unsigned char flags;
+
+	if ( val->bv_len != SLAP_TRACEPARENT_LEN ||
+		strncmp( ptr, "00-", 3 ) || ptr[35] != '-' || ptr[52] != '-' )
+		return -1;
+	/* all zero ids are invalid, the flags may be zero */
+	if ( slap_trace_unhex( tc->tc_trace, ptr + 3, 16 ) <= 0 ||
+		slap_trace_unhex( tc->tc_parent, ptr + 36, 8 ) <= 0 ||
+		slap_trace_unhex( &flags, ptr + 53, 1 ) < 0 )
+		return -1;
+
+	slap_trace_id( tc->tc_span, 8 );
+	tc->tc_flags = flags;
+	tc->tc_record = ( flags & 0x01 ) && slap_trace_file != NULL;
+	tc->tc_set = 1;
+
+	slap_trace_hex( ptr + 36, tc->tc_span, 8 );
+	return 0;
+}
+
+/* Start a new trace, sampled */
+void
+slap_trace_new( slap_tracectx *tc )
+{
+	slap_trace_id( tc->tc_trace, 16 );
+	memset( tc->tc_parent, 0, sizeof( tc->tc_parent ));
+	slap_trace_id( tc->tc_span, 8 );
+	tc->tc_flags = 0x01;
+	tc->tc_record = slap_trace_file != NULL;
+	tc->tc_set = 1;
+}
+
+/*
+ * Make op a child span of parent, for work done on behalf of it
+ * outside of a client request. Resets the phase timings of op.
+ */
+void
+slap_trace_child( Operation *op, slap_tracectx *parent )
+{
+	slap_tracectx *tc = &op->o_tracectx;
+
+	if ( !parent->tc_set ) {
+		tc->tc_set = tc->tc_record = 0;
+		return;
+	}
+	AC_MEMCPY( tc->tc_trace, parent->tc_trace, sizeof( tc->tc_trace ));
+	AC_MEMCPY( tc->tc_parent, parent->tc_span, sizeof( tc->tc_parent ));
+	slap_trace_id( tc->tc_span, 8 );
+	tc->tc_flags = parent->tc_flags;
+	tc->tc_record = parent->tc_record && slap_trace_file != NULL;
+	tc->tc_set = 1;
+
+	memset( &op->o_trace, 0, sizeof( op->o_trace ));
+}
+
+/* Format tc as a traceparent naming our span as the parent */
+void
+slap_trace_format( slap_tracectx *tc, struct berval *bv )
+{
+	char *ptr = bv->bv_val;
+
+	ptr = lutil_strcopy( ptr, "00-" );
+	ptr = slap_trace_hex( ptr, tc->tc_trace, 16 );
+	*ptr++ = '-';
+	ptr = slap_trace_hex( ptr, tc->tc_span, 8 );
+	*ptr++ = '-';
+	ptr = slap_trace_hex( ptr, &tc->tc_flags, 1 );
+	*ptr = '\0';
+	bv->bv_len = ptr - bv->bv_val;
+}
+
+/* Append a JSON string, escaped */
+static int
+slap_trace_json( char *buf, int size, const char *str )
+{
+	int len = 0;
+
+	for ( ; *str && len < size - 7; str++ ) {
+		unsigned char c = *str;
+
+		if ( c == '"' || c == '\\' ) {
+			buf[len++] = '\\';
+			buf[len++] = c;
+		} else if ( c < 0x20 ) {
+			len += snprintf( buf + len, size - len, "\\u%04x", c );
+		} else {
+			buf[len++] = c;
+		}
+	}
+	buf[len] = '\0';
+	return len;
+}
+
+/*
+ * Record the span of op, which started at *start and ended now.
+ * The phase timings are those collected in op->o_trace.
+ */
+void
+slap_trace_span( Operation *op, const char *name, struct timeval *start,
+	int err, int nentries )
+{
+	slap_tracectx *tc = &op->o_tracectx;
+	slap_optrace *ot = &op->o_trace;
+	struct timeval now;
+	char buf[ 2 * SLAP_TEXT_BUFLEN ], db[ SLAP_TEXT_BUFLEN ], *ptr;
+	unsigned long long begin, usec;
+	int len;
+
+	if ( !tc->tc_record || !slap_trace_file )
+		return;
+
+	gettimeofday( &now, NULL );
+	begin = start->tv_sec * 1000000ULL + start->tv_usec;
+	usec = now.tv_sec * 1000000ULL + now.tv_usec - begin;
+
+	db[0] = '\0';
+	if ( op->o_bd && op->o_bd->be_suffix &&
+		!BER_BVISNULL( &op->o_bd->be_suffix[0] ))
+		slap_trace_json( db, sizeof( db ), op->o_bd->be_suffix[0].bv_val );
+
+	ptr = lutil_strcopy( buf, "{\"traceId\":\"" );
+	ptr = slap_trace_hex( ptr, tc->tc_trace, 16 );
+	ptr = lutil_strcopy( ptr, "\",\"spanId\":\"" );
+	ptr = slap_trace_hex( ptr, tc->tc_span, 8 );
+	ptr = lutil_strcopy( ptr, "\",\"parentSpanId\":\"" );
+	ptr = slap_trace_hex( ptr, tc->tc_parent, 8 );
+	len = ptr - buf;
+	len += snprintf( ptr, sizeof( buf ) - len,
+		"\",\"name\":\"%s\",\"start_us\":%llu,\"duration_us\":%llu,"
+		"\"attributes\":{\"server\":%d,\"conn\":%lu,\"op\":%lu,"
+		"\"db\":\"%s\",\"err\":%d,\"nentries\":%d,"
+		"\"acl_us\":%lu,\"cand_us\":%lu,\"decode_us\":%lu,\"write_us\":%lu,"
+		"\"idl\":%lu,\"scanned\":%lu}}\n",
+		name, begin, usec, slap_serverID, op->o_connid, op->o_opid,
+		db, err, nentries, ot->ot_acl, ot->ot_cand, ot->ot_decode,
+		ot->ot_write, ot->ot_idl, ot->ot_scanned );
+	if ( len >= sizeof( buf ))
+		return;
+
+	ldap_pvt_thread_mutex_lock( &slap_trace_mutex );
+	if ( slap_trace_len + len > SLAP_TRACE_BUFMAX ) {
+		slap_trace_dropped++;
+	} else {
+		if ( slap_trace_len + len > slap_trace_size ) {
+			slap_trace_size = slap_trace_size ? slap_trace_size * 2 : 65536;
+			if ( slap_trace_size > SLAP_TRACE_BUFMAX )
+				slap_trace_size = SLAP_TRACE_BUFMAX;
+			slap_trace_buf = ch_realloc( slap_trace_buf, slap_trace_size );
+		}
+		AC_MEMCPY( slap_trace_buf + slap_trace_len, buf, len );
+		slap_trace_len += len;
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_trace_mutex );
+}
+
+/* Write out the spans recorded so far */
+static void
+slap_trace_flush( void )
+{
+	char *buf;
+	ber_len_t len;
+	unsigned long dropped;
+
+	ldap_pvt_thread_mutex_lock( &slap_trace_mutex );
+	buf = slap_trace_buf;
+	len = slap_trace_len;
+	dropped = slap_trace_dropped;
+	slap_trace_buf = NULL;
+	slap_trace_len = slap_trace_size = 0;
+	slap_trace_dropped = 0;
+	ldap_pvt_thread_mutex_unlock( &slap_trace_mutex );
+
+	if ( dropped ) {
+		Debug( LDAP_DEBUG_ANY,
+			"slap_trace_flush: %lu spans dropped, buffer full\n",
+			dropped, 0, 0 );
+	}
+	if ( !len ) {
+		ch_free( buf );
+		return;
+	}
+
+	ldap_pvt_thread_mutex_lock( &slap_trace_fmutex );
+	if ( !slap_trace_fp && slap_trace_file ) {
+		slap_trace_fp = fopen( slap_trace_file, "a" );
+		if ( !slap_trace_fp ) {
+			Debug( LDAP_DEBUG_ANY,
+				"slap_trace_flush: unable to open \"%s\"\n",
+				slap_trace_file, 0, 0 );
+		}
+	}
+	if ( slap_trace_fp ) {
+		fwrite( buf, 1, len, slap_trace_fp );
+		fflush( slap_trace_fp );
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_trace_fmutex );
+	ch_free( buf );
+}
+
+static void *
+slap_trace_flush_fn( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+
+	slap_trace_flush();
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	ldap_pvt_runqueue_resched( &slapd_rq, rtask, 0 );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	return NULL;
+}
+
+/* tracefile was changed, reopen it on the next flush */
+void
+slap_trace_reopen( void )
+{
+	ldap_pvt_thread_mutex_lock( &slap_trace_fmutex );
+	if ( slap_trace_fp ) {
+		fclose( slap_trace_fp );
+		slap_trace_fp = NULL;
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_trace_fmutex );
+}
+
+void
+slap_trace_init( void )
+{
+	struct timeval tv;
+
+	ldap_pvt_thread_mutex_init( &slap_trace_mutex );
+	ldap_pvt_thread_mutex_init( &slap_trace_fmutex );
+
+	if ( lutil_entropy( (unsigned char *)&slap_trace_seed,
+		sizeof( slap_trace_seed )))
+	{
+		gettimeofday( &tv, NULL );
+		slap_trace_seed = ( (unsigned long long)tv.tv_sec << 20 ) ^
+			tv.tv_usec ^ ( (unsigned long long)getpid() << 40 );
+	}
+}
+
+void
+slap_trace_destroy( void )
+{
+	ch_free( slap_trace_buf );
+	slap_trace_buf = NULL;
+	slap_trace_len = slap_trace_size = 0;
+	ldap_pvt_thread_mutex_destroy( &slap_trace_fmutex );
+	ldap_pvt_thread_mutex_destroy( &slap_trace_mutex );
+}
+
+/* Start exporting if tracefile is set; also called when it is set online */
+void
+slap_trace_start( void )
+{
+	if ( !slap_trace_file || !( slapMode & SLAP_SERVER_MODE ))
+		return;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( !slap_trace_task ) {
+		slap_trace_task = ldap_pvt_runqueue_insert( &slapd_rq,
+			SLAP_TRACE_INTERVAL, slap_trace_flush_fn, NULL,
+			"slap_trace_flush_fn", "tracefile" );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
+/* Must only be called once the thread pool has been closed */
+void
+slap_trace_stop( void )
+{
+	if ( slap_trace_task ) {
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+		if ( ldap_pvt_runqueue_isrunning( &slapd_rq, slap_trace_task ))
+			ldap_pvt_runqueue_stoptask( &slapd_rq, slap_trace_task );
+		ldap_pvt_runqueue_remove( &slapd_rq, slap_trace_task );
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+		slap_trace_task = NULL;
+	}
+
+	slap_trace_flush();
+	slap_trace_reopen();
+}
@@ -0,0 +1,304 @@
+/* ldif-gen -- generate a synthetic directory for benchmarks */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * The tree is
+ *
+ *	<base>
+ *	ou=People,<base>	uid=user<N>, N = 0 .. entries-1
+ *	ou=Groups,<base>	cn=group<N>, N = 0 .. groups-1
+ *
+ * Names, mail domains and group sizes are drawn from Zipf-like
+ * distributions so that a few values are very common and most are
+ * rare, which is what equality and substring indices see in real
+ * directories. The output only depends on the options, not on the
+ * platform's rand().
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/stdlib.h>
+#include <ac/string.h>
+#include <ac/unistd.h>
+
+static const char *progname = "ldif-gen";
+
+static const char *const given[] = {
+	"James", "Mary", "John", "Patricia", "Robert", "Jennifer", "Michael",
+	"Linda", "William", "Elizabeth", "David", "Barbara", "Richard", "Susan",
+	"Joseph", "Jessica", "Thomas", "Sarah", "Charles", "Karen", "Daniel",
+	"Nancy", "Matthew", "Lisa", "Anthony", "Margaret", "Mark", "Betty",
+	"Donald", "Sandra", "Steven", "Ashley", "Paul", "Dorothy", "Andrew",
+	"Kimberly", "Joshua", "Emily", "Kenneth", "Donna", "Kevin", "Michelle",
+	"Brian", "Carol", "George", "Amanda", "Edward", "Melissa", "Ronald",
+	"Deborah", "Timothy", "Stephanie", "Jason", "Rebecca", "Jeffrey",
+	"Laura", "Ryan", "Sharon", "Jacob", "Cynthia", "Gary", "Kathleen",
+	"Nicholas", "Amy"
+};
+
+static const char *const surname[] = {
+	"Smith", "Johnson", "Williams", "Brown", "Jones", "Garcia", "Miller",
+	"Davis", "Rodriguez", "Martinez", "Hernandez", "Lopez", "Gonzalez",
+	"Wilson", "Anderson", "Thomas", "Taylor", "Moore", "Jackson", "Martin",
+	"Lee", "Perez", "Thompson", "White", "Harris", "Sanchez", "Clark",
+	"Ramirez", "Lewis", "Robinson", "Walker", "Young", "Allen", "King",
+	"Wright", "Scott", "Torres", "Nguyen", "Hill", "Flores", "Green",
+	"Adams", "Nelson", "Baker", "Hall", "Rivera", "Campbell", "Mitchell",
+	"Carter", "Roberts", "Gomez", "Phillips", "Evans", "Turner", "Diaz",
+	"Parker", "Cruz", "Edwards", "Collins", "Reyes", "Stewart", "Morris",
+	"Morales", "Murphy"
+};
+
+static const char *const title[] = {
+	"Engineer", "Senior Engineer", "Manager", "Director", "Analyst",
+	"Consultant", "Administrator", "Architect", "Technician", "Intern"
+};
+
+#define NELEMS(a)	( sizeof( a ) / sizeof( a[0] ) )
+
+#define DOMAINS		16
+#define DEPARTMENTS	50
+
+/* xorshift64* */
+static unsigned long long seed = 88172645463325252ULL;
+
+static unsigned long long
+gen_rand( void )
+{
+	seed ^= seed >> 12;
+	seed ^= seed << 25;
+	seed ^= seed >> 27;
+	return seed * 2685821657736338717ULL;
+}
+
+/* Uniform in [0, 1) */
+static double
+gen_unit( void )
+{
+	return ( gen_rand() >> 11 ) * ( 1.0 / 9007199254740992.0 );
+}
+
+typedef struct {
+	double	*cdf;
+	int	n;
+} Zipf;
+
+/* P(k) proportional to 1 / (k + 1), k = 0 .. n-1 */
+static void
+zipf_init( Zipf *z, int n )
+{
+	double sum = 0;
+	int i;
+
+	z->n = n;
+	z->cdf = malloc( n * sizeof( double ) );
+	if ( z->cdf == NULL ) {
+		perror( progname );
+		exit( EXIT_FAILURE );
+	}
+	for ( i = 0; i < n; i++ ) {
+		sum += 1.0 / ( i + 1 );
+		z->cdf[i] = sum;
+	}
+	for ( i = 0; i < n; i++ )
+		z->cdf[i] /= sum;
+}
+
+static int
+zipf_next( Zipf *z )
+{
+	double u = gen_unit();
+	int lo = 0, hi = z->n - 1;
+
+	while ( lo < hi ) {
+		int mid = ( lo + hi ) / 2;
+
+		if ( z->cdf[mid] < u )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+typedef struct {
+	unsigned	*val;
+	size_t	len, alloc;
+} Members;
+
+static void
+members_add( Members *m, unsigned id )
+{
+	if ( m->len == m->alloc ) {
+		m->alloc = m->alloc ? 2 * m->alloc : 8;
+		m->val = realloc( m->val, m->alloc * sizeof( unsigned ) );
+		if ( m->val == NULL ) {
+			perror( progname );
+			exit( EXIT_FAILURE );
+		}
+	}
+	m->val[m->len++] = id;
+}
+
+static void
+usage( void )
+{
+	fprintf( stderr, "\
+Usage: %s [-b base] [-g groups] [-m memberships] [-n entries] [-s seed]\n\
+Write an LDIF tree with <entries> users (default 10000) under ou=People\n\
+and <groups> groupOfNames (default entries/100) under ou=Groups.\n\
+Each user is a member of <memberships> groups on average (default 3),\n\
+picked so that group sizes follow a power law.\n",
+		progname );
+	exit( EXIT_FAILURE );
+}
+
+static void
+put_person( const char *base, unsigned id, Zipf *gz, Zipf *sz, Zipf *dz )
+{
+	const char *gn = given[ zipf_next( gz ) ];
+	const char *sn = surname[ zipf_next( sz ) ];
+	int i, nmail = 1 + ( gen_rand() % 8 == 0 ) + ( gen_rand() % 32 == 0 );
+
+	printf( "dn: uid=user%u,ou=People,%s\n", id, base );
+	printf( "objectClass: inetOrgPerson\n" );
+	printf( "uid: user%u\n", id );
+	printf( "cn: %s %s\n", gn, sn );
+	if ( gen_rand() % 4 == 0 )
+		printf( "cn: %c. %s\n", gn[0], sn );
+	printf( "sn: %s\n", sn );
+	printf( "givenName: %s\n", gn );
+	for ( i = 0; i < nmail; i++ ) {
+		printf( "mail: %s.%s%u%s@mail%d.example.com\n", gn, sn, id,
+			i ? ( i == 1 ? "-alt" : "-old" ) : "", zipf_next( dz ) );
+	}
+	printf( "employeeNumber: %u\n", id );
+	printf( "departmentNumber: %u\n",
+		(unsigned)( gen_rand() % DEPARTMENTS ) );
+	printf( "title: %s\n", title[ gen_rand() % NELEMS( title ) ] );
+	printf( "telephoneNumber: +1 555 %03u %04u\n",
+		(unsigned)( gen_rand() % 1000 ), id % 10000 );
+	printf( "userPassword: secret%u\n", id );
+	printf( "\n" );
+}
+
+int
+main( int argc, char **argv )
+{
+	char *base = "dc=example,dc=com", *rdn, *end;
+	unsigned long entries = 10000, groups = 0, memberships = 3, i, j;
+	Zipf gz, sz, dz, grz;
+	Members *members;
+	int c;
+
+	while ( (c = getopt( argc, argv, "b:g:m:n:s:" )) != EOF ) {
+		switch ( c ) {
+		case 'b':
+			base = optarg;
+			break;
+		case 'g':
+			groups = strtoul( optarg, &end, 10 );
+			if ( *end || !groups )
+				usage();
+			break;
+		case 'm':
+			memberships = strtoul( optarg, &end, 10 );
+			if ( *end )
+				usage();
+			break;
+		case 'n':
+			entries = strtoul( optarg, &end, 10 );
+			if ( *end || !entries || entries > 0xffffffffUL )
+				usage();
+			break;
+		case 's':
+			seed = strtoull( optarg, &end, 10 ) ^ seed;
+			if ( *end || !seed )
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if ( optind != argc )
+		usage();
+	if ( !groups )
+		groups = entries / 100 ? entries / 100 : 1;
+
+	zipf_init( &gz, NELEMS( given ) );
+	zipf_init( &sz, NELEMS( surname ) );
+	zipf_init( &dz, DOMAINS );
+	zipf_init( &grz, groups );
+	members = calloc( groups, sizeof( Members ) );
+	if ( members == NULL ) {
+		perror( progname );
+		exit( EXIT_FAILURE );
+	}
+
+	rdn = strchr( base, '=' );
+	end = strchr( base, ',' );
+	if ( rdn == NULL || ( end != NULL && end < rdn ) ) {
+		fprintf( stderr, "%s: invalid base \"%s\"\n", progname, base );
+		exit( EXIT_FAILURE );
+	}
+	end = rdn + 1 + strcspn( rdn + 1, ",+" );
+	printf( "dn: %s\n", base );
+	if ( !strncasecmp( base, "dc=", 3 ) ) {
+		printf( "objectClass: dcObject\nobjectClass: organization\n" );
+		printf( "dc: %.*s\no: %.*s\n\n", (int)( end - rdn - 1 ), rdn + 1,
+			(int)( end - rdn - 1 ), rdn + 1 );
+	} else {
+		printf( "objectClass: organization\n" );
+		printf( "o: %.*s\n\n", (int)( end - rdn - 1 ), rdn + 1 );
+	}
+	printf( "dn: ou=People,%s\nobjectClass: organizationalUnit\n"
+		"ou: People\n\n", base );
+	printf( "dn: ou=Groups,%s\nobjectClass: organizationalUnit\n"
+		"ou: Groups\n\n", base );
+
+	for ( i = 0; i < entries; i++ ) {
+		unsigned long n;
+
+		put_person( base, i, &gz, &sz, &dz );
+
+		/* 0 .. 2 * memberships, a group may come up twice */
+		n = memberships ? gen_rand() % ( 2 * memberships + 1 ) : 0;
+		for ( j = 0; j < n; j++ ) {
+			Members *m = &members[ zipf_next( &grz ) ];
+
+			if ( !m->len || m->val[m->len - 1] != i )
+				members_add( m, i );
+		}
+	}
+
+	for ( i = 0; i < groups; i++ ) {
+		printf( "dn: cn=group%lu,ou=Groups,%s\n", i, base );
+		printf( "objectClass: groupOfNames\n" );
+		printf( "cn: group%lu\n", i );
+		/* groupOfNames needs a member */
+		if ( !members[i].len )
+			members_add( &members[i], gen_rand() % entries );
+		for ( j = 0; j < members[i].len; j++ )
+			printf( "member: uid=user%u,ou=People,%s\n",
+				members[i].val[j], base );
+		printf( "\n" );
+		free( members[i].val );
+	}
+	free( members );
+
+	return ferror( stdout ) || fflush( stdout ) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -28,6 +28,8 @@ typedef enum {
 	TESTER_MODRDN,
 	TESTER_READ,
 	TESTER_SEARCH,
+	TESTER_LOAD,
+	TESTER_LAG,
 	TESTER_LAST
 } tester_t;
 
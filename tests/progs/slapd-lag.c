@@ -0,0 +1,464 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * slapd-lag: measure how far syncrepl consumers trail their provider.
+ *
+ * Probe mode (the default) replaces an attribute of a probe entry on
+ * the provider with a sequence number at a fixed interval and polls
+ * the consumers for it. The lag of a probe is the time from the
+ * provider's response to the first poll that sees it (or a later
+ * one) on a consumer, so it includes up to one poll interval.
+ * If the consumers have a monitor database, the changes they applied
+ * in the meantime are read from it as well.
+ *
+ * Sync mode (-W) waits until the contextCSN of the base on each
+ * consumer matches the provider's and reports how long that took,
+ * which is the refresh or catch-up time of a consumer started just
+ * before.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include "ac/stdlib.h"
+
+#include "ac/ctype.h"
+#include "ac/param.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/time.h"
+#include "ac/unistd.h"
+
+#include "ldap.h"
+#include "lutil.h"
+
+#include "ldap_pvt.h"
+
+#include "slapd-common.h"
+
+#define INTERVAL	100	/* msec between probes */
+#define DURATION	10	/* seconds */
+#define DRAIN		30	/* seconds to wait for the last probes */
+#define POLL		1000	/* usec between polls */
+#define MAXCONSUMERS	16
+
+typedef struct lag_consumer {
+	char		*lc_uri;
+	LDAP		*lc_ld;
+	unsigned long	lc_seen;	/* probes seen so far */
+	unsigned long long	*lc_lag;
+	long		lc_applied;	/* from cn=Monitor, -1 if there is none */
+	unsigned long long	lc_sync;	/* usec, 0 if not in sync */
+} lag_consumer;
+
+static void
+usage( char *name, int opt )
+{
+	if ( opt ) {
+		fprintf( stderr, "%s: unable to handle option \'%c\'\n\n",
+			name, opt );
+	}
+
+	fprintf( stderr, "usage: %s " TESTER_COMMON_HELP
+		"[-a <attr>] "
+		"[-b <base>] "
+		"[-e <probe entry>] "
+		"[-I <msec>] "
+		"[-s <seconds>] "
+		"[-W] "
+		"<consumer uri> [...]\n",
+		name );
+	fprintf( stderr, "\tprobes <entry> on the provider every <msec>, "
+		"or with -W waits until the\n"
+		"\tconsumers have the contextCSN of <base>\n" );
+	exit( EXIT_FAILURE );
+}
+
+static unsigned long long
+lag_now( void )
+{
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static void
+lag_sleep( unsigned long usec )
+{
+	struct timeval tv;
+
+	tv.tv_sec = usec / 1000000;
+	tv.tv_usec = usec % 1000000;
+	select( 0, NULL, NULL, NULL, &tv );
+}
+
+static int
+lag_cmp( const void *a, const void *b )
+{
+	unsigned long long x = *(const unsigned long long *)a,
+		y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Read the values of one attribute of an entry into *valsp */
+static int
+lag_read( LDAP *ld, char *dn, char *attr, struct berval ***valsp )
+{
+	LDAPMessage *res = NULL, *e;
+	char *attrs[ 2 ];
+	int rc;
+
+	*valsp = NULL;
+	attrs[ 0 ] = attr;
+	attrs[ 1 ] = NULL;
+	rc = ldap_search_ext_s( ld, dn, LDAP_SCOPE_BASE, NULL, attrs, 0,
+		NULL, NULL, NULL, LDAP_NO_LIMIT, &res );
+	if ( rc == LDAP_SUCCESS && ( e = ldap_first_entry( ld, res ) ) != NULL )
+		*valsp = ldap_get_values_len( ld, e, attr );
+	ldap_msgfree( res );
+	return rc;
+}
+
+/* Sum of the applied= counters of the consumer's syncrepl stanzas */
+static long
+lag_applied( LDAP *ld )
+{
+	LDAPMessage *res = NULL, *e;
+	struct berval **vals;
+	char *attrs[] = { "monitorSyncConsumer", NULL }, *p;
+	long applied = -1;
+	int i;
+
+	if ( ldap_search_ext_s( ld, "cn=Databases,cn=Monitor",
+		LDAP_SCOPE_SUBTREE, "(monitorSyncConsumer=*)", attrs, 0,
+		NULL, NULL, NULL, LDAP_NO_LIMIT, &res ) != LDAP_SUCCESS )
+	{
+		ldap_msgfree( res );
+		return -1;
+	}
+	for ( e = ldap_first_entry( ld, res ); e; e = ldap_next_entry( ld, e ) ) {
+		vals = ldap_get_values_len( ld, e, attrs[ 0 ] );
+		for ( i = 0; vals && vals[ i ]; i++ ) {
+			p = strstr( vals[ i ]->bv_val, " applied=" );
+			if ( p == NULL )
+				continue;
+			if ( applied < 0 )
+				applied = 0;
+			applied += strtol( p + STRLENOF( " applied=" ), NULL, 10 );
+		}
+		ldap_value_free_len( vals );
+	}
+	ldap_msgfree( res );
+	return applied;
+}
+
+/* Does every value of a appear in b? */
+static int
+lag_csn_covered( struct berval **a, struct berval **b )
+{
+	int i, j;
+
+	for ( i = 0; a[ i ]; i++ ) {
+		if ( b == NULL )
+			return 0;
+		for ( j = 0; b[ j ]; j++ ) {
+			if ( a[ i ]->bv_len == b[ j ]->bv_len &&
+				!memcmp( a[ i ]->bv_val, b[ j ]->bv_val, a[ i ]->bv_len ) )
+				break;
+		}
+		if ( b[ j ] == NULL )
+			return 0;
+	}
+	return 1;
+}
+
+static int
+lag_sync( struct tester_conn_args *config, LDAP *pld, char *base,
+	lag_consumer *cons, int ncons, int duration )
+{
+	struct berval **pcsn, **ccsn;
+	unsigned long long start, now;
+	int i, rc, left = ncons;
+
+	start = lag_now();
+	lag_read( pld, base, "contextCSN", &pcsn );
+	if ( pcsn == NULL ) {
+		tester_error( "no contextCSN on the provider" );
+		exit( EXIT_FAILURE );
+	}
+
+	/* the consumers may just have been started, and still refreshing */
+	while ( left ) {
+		for ( i = 0; i < ncons; i++ ) {
+			if ( cons[ i ].lc_sync )
+				continue;
+			if ( cons[ i ].lc_ld == NULL ) {
+				config->uri = cons[ i ].lc_uri;
+				tester_init_ld( &cons[ i ].lc_ld, config, TESTER_INIT_ONLY );
+			}
+			rc = lag_read( cons[ i ].lc_ld, base, "contextCSN", &ccsn );
+			if ( rc == LDAP_SERVER_DOWN || rc == LDAP_CONNECT_ERROR ) {
+				/* start over on a new connection */
+				ldap_unbind_ext( cons[ i ].lc_ld, NULL, NULL );
+				cons[ i ].lc_ld = NULL;
+				continue;
+			}
+			if ( ccsn && lag_csn_covered( pcsn, ccsn ) ) {
+				cons[ i ].lc_sync = lag_now() - start;
+				left--;
+			}
+			ldap_value_free_len( ccsn );
+		}
+		now = lag_now();
+		if ( left && now - start >= duration * 1000000ULL )
+			break;
+		if ( left )
+			lag_sleep( 10 * POLL );
+	}
+	ldap_value_free_len( pcsn );
+
+	for ( i = 0; i < ncons; i++ ) {
+		if ( cons[ i ].lc_sync ) {
+			printf( "slapd-lag: consumer=%s sync=%llu\n",
+				cons[ i ].lc_uri, cons[ i ].lc_sync );
+		} else {
+			printf( "slapd-lag: consumer=%s sync=timeout\n",
+				cons[ i ].lc_uri );
+		}
+	}
+	return left ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int
+lag_probe( struct tester_conn_args *config, LDAP *pld, char *entry,
+	char *attr, lag_consumer *cons, int ncons, int interval, int duration )
+{
+	unsigned long long start, now, next, end, *done;
+	unsigned long nprobes, seq, s, k;
+	struct berval **vals;
+	char buf[ 64 ];
+	struct berval bv, *bvp[ 2 ];
+	LDAPMod mod, *mods[ 2 ];
+	int i, rc, left, status = EXIT_SUCCESS;
+	long applied;
+
+	nprobes = duration * 1000UL / interval;
+	done = calloc( nprobes + 1, sizeof( unsigned long long ) );
+	for ( i = 0; i < ncons; i++ ) {
+		cons[ i ].lc_lag = calloc( nprobes + 1, sizeof( unsigned long long ) );
+		if ( done == NULL || cons[ i ].lc_lag == NULL ) {
+			tester_error( "out of memory" );
+			exit( EXIT_FAILURE );
+		}
+		config->uri = cons[ i ].lc_uri;
+		tester_init_ld( &cons[ i ].lc_ld, config, 0 );
+		cons[ i ].lc_applied = lag_applied( cons[ i ].lc_ld );
+	}
+
+	bv.bv_val = buf;
+	bvp[ 0 ] = &bv;
+	bvp[ 1 ] = NULL;
+	mod.mod_op = LDAP_MOD_REPLACE | LDAP_MOD_BVALUES;
+	mod.mod_type = attr;
+	mod.mod_bvalues = bvp;
+	mods[ 0 ] = &mod;
+	mods[ 1 ] = NULL;
+
+	/* probe seq is written at start + seq * interval, seq = 1 .. nprobes */
+	start = lag_now();
+	end = start + duration * 1000000ULL + DRAIN * 1000000ULL;
+	for ( seq = 0; ; ) {
+		now = lag_now();
+		next = start + ( seq + 1 ) * interval * 1000ULL;
+		if ( seq < nprobes && now >= next ) {
+			bv.bv_len = snprintf( buf, sizeof( buf ), "slapd-lag %lu",
+				seq + 1 );
+			rc = ldap_modify_ext_s( pld, entry, mods, NULL, NULL );
+			if ( rc != LDAP_SUCCESS ) {
+				tester_ldap_error( pld, "ldap_modify_ext_s", entry );
+				exit( EXIT_FAILURE );
+			}
+			done[ ++seq ] = lag_now();
+		}
+
+		left = 0;
+		for ( i = 0; i < ncons; i++ ) {
+			if ( cons[ i ].lc_seen >= seq )
+				continue;
+			rc = lag_read( cons[ i ].lc_ld, entry, attr, &vals );
+			if ( rc != LDAP_SUCCESS && rc != LDAP_NO_SUCH_OBJECT ) {
+				tester_ldap_error( cons[ i ].lc_ld, "ldap_search_ext_s",
+					cons[ i ].lc_uri );
+				exit( EXIT_FAILURE );
+			}
+			now = lag_now();
+			k = 0;
+			if ( vals && !strncmp( vals[ 0 ]->bv_val, "slapd-lag ",
+				STRLENOF( "slapd-lag " ) ) )
+				k = strtoul( vals[ 0 ]->bv_val + STRLENOF( "slapd-lag " ),
+					NULL, 10 );
+			if ( k > seq )
+				k = 0;	/* left over from an earlier run */
+			for ( s = cons[ i ].lc_seen + 1; s <= k; s++ )
+				cons[ i ].lc_lag[ s ] = now - done[ s ];
+			if ( k > cons[ i ].lc_seen )
+				cons[ i ].lc_seen = k;
+			if ( cons[ i ].lc_seen < seq )
+				left++;
+			ldap_value_free_len( vals );
+		}
+
+		if ( seq == nprobes ) {
+			if ( !left || lag_now() >= end )
+				break;
+		}
+		now = lag_now();
+		next = start + ( seq + 1 ) * interval * 1000ULL;
+		if ( left || seq == nprobes ) {
+			lag_sleep( POLL );
+		} else if ( next > now ) {
+			lag_sleep( next - now < POLL ? next - now : POLL );
+		}
+	}
+
+	now = lag_now();
+	for ( i = 0; i < ncons; i++ ) {
+		lag_consumer *lc = &cons[ i ];
+		unsigned long long *lag = lc->lc_lag + 1;
+		unsigned long n = lc->lc_seen;
+
+		if ( n < nprobes )
+			status = EXIT_FAILURE;
+
+		printf( "slapd-lag: consumer=%s interval=%d probes=%lu seen=%lu",
+			lc->lc_uri, interval, nprobes, n );
+		if ( n ) {
+			qsort( lag, n, sizeof( unsigned long long ), lag_cmp );
+			printf( " p50=%llu p90=%llu p99=%llu max=%llu",
+				lag[ ( n - 1 ) / 2 ], lag[ ( n - 1 ) * 9 / 10 ],
+				lag[ ( n - 1 ) * 99 / 100 ], lag[ n - 1 ] );
+		}
+		if ( lc->lc_applied >= 0 &&
+			( applied = lag_applied( lc->lc_ld ) ) >= 0 )
+		{
+			applied -= lc->lc_applied;
+			printf( " applied=%ld rate=%.1f", applied,
+				applied * 1e6 / ( now - start ) );
+		}
+		printf( "\n" );
+		free( lc->lc_lag );
+	}
+	free( done );
+
+	return status;
+}
+
+int
+main( int argc, char **argv )
+{
+	int		i, rc;
+	char		*base = NULL;
+	char		*entry = NULL;
+	char		*attr = "description";
+	char		*provider;
+	int		interval = INTERVAL, duration = 0, sync = 0;
+	lag_consumer	cons[ MAXCONSUMERS ];
+	int		ncons;
+	LDAP		*pld;
+	struct tester_conn_args	*config;
+
+	config = tester_init( "slapd-lag", TESTER_LAG );
+
+	while ( ( i = getopt( argc, argv, TESTER_COMMON_OPTS "a:b:e:I:s:W" ) ) != EOF )
+	{
+		switch ( i ) {
+		case 'a':		/* probe attribute */
+			attr = strdup( optarg );
+			break;
+
+		case 'b':		/* base for -W */
+			base = strdup( optarg );
+			break;
+
+		case 'e':		/* probe entry */
+			entry = strdup( optarg );
+			break;
+
+		case 'I':		/* probe interval */
+			if ( lutil_atoi( &interval, optarg ) != 0 || interval < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 's':		/* duration, or timeout for -W */
+			if ( lutil_atoi( &duration, optarg ) != 0 || duration < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'W':		/* wait for the consumers */
+			sync++;
+			break;
+
+		default:
+			if ( tester_config_opt( config, i, optarg ) == LDAP_SUCCESS ) {
+				break;
+			}
+			usage( argv[0], i );
+			break;
+		}
+	}
+
+	ncons = argc - optind;
+	if ( ncons < 1 || ncons > MAXCONSUMERS )
+		usage( argv[0], 0 );
+	if ( sync ? base == NULL : entry == NULL ) {
+		fprintf( stderr, "%s: %s\n", argv[0], sync ?
+			"-W needs a base (-b)" : "probing needs an entry (-e)" );
+		exit( EXIT_FAILURE );
+	}
+	if ( !duration )
+		duration = sync ? 10 * DURATION : DURATION;
+	if ( !sync && duration * 1000 < interval )
+		usage( argv[0], 'I' );
+
+	memset( cons, 0, sizeof( cons ) );
+	for ( i = 0; i < ncons; i++ )
+		cons[ i ].lc_uri = argv[ optind + i ];
+
+	tester_config_finish( config );
+	provider = config->uri;
+	tester_init_ld( &pld, config, 0 );
+
+	if ( sync ) {
+		rc = lag_sync( config, pld, base, cons, ncons, duration );
+	} else {
+		rc = lag_probe( config, pld, entry, attr, cons, ncons,
+			interval, duration );
+	}
+	config->uri = provider;
+
+	for ( i = 0; i < ncons; i++ ) {
+		if ( cons[ i ].lc_ld )
+			ldap_unbind_ext( cons[ i ].lc_ld, NULL, NULL );
+	}
+	ldap_unbind_ext( pld, NULL, NULL );
+
+	exit( rc );
+}
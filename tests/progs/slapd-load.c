@@ -0,0 +1,610 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * slapd-load: an open-loop load generator.
+ *
+ * Operations are scheduled at a fixed rate, whatever the server's
+ * response times, and spread over a number of asynchronous
+ * connections. The latency of an operation is measured from the time
+ * it was scheduled, not from when it could actually be sent, so a
+ * server (or a driver) that falls behind shows in the percentiles
+ * instead of silently lowering the offered load.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include "ac/stdlib.h"
+
+#include "ac/ctype.h"
+#include "ac/param.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/time.h"
+#include "ac/unistd.h"
+
+#include "ldap.h"
+#include "lutil.h"
+
+#include "ldap_pvt.h"
+
+#include "slapd-common.h"
+
+#define CONNS		8
+#define RATE		1000	/* ops/sec */
+#define DURATION	10	/* seconds */
+#define DRAIN		5	/* seconds to wait for the last responses */
+#define PENDING		1024	/* outstanding ops per connection */
+#define LATE		1000	/* usec behind schedule to count as late */
+
+enum {
+	LOAD_SEARCH,
+	LOAD_READ,
+	LOAD_BIND,
+	LOAD_MODIFY,
+	LOAD_LAST
+};
+
+static const char *const load_names[] = {
+	"search", "read", "bind", "modify", "all"
+};
+
+/*
+ * Latency histogram: exact below 64us, then 32 buckets per power
+ * of two, so a reported percentile is at most ~3% above the truth.
+ */
+#define HIST_SUB	32
+#define HIST_LINEAR	( 2 * HIST_SUB )
+#define HIST_BUCKETS	( HIST_LINEAR + 40 * HIST_SUB )
+
+typedef struct load_stats {
+	unsigned long	ls_done;
+	unsigned long	ls_errors;
+	unsigned long long	ls_max;
+	unsigned long	ls_hist[ HIST_BUCKETS ];
+} load_stats;
+
+typedef struct load_pending {
+	int		lp_msgid;	/* 0 if the slot is free */
+	int		lp_type;
+	unsigned long long	lp_sched;	/* usec */
+} load_pending;
+
+typedef struct load_conn {
+	LDAP		*lc_ld;
+	ber_socket_t	lc_sd;
+	int		lc_dead;	/* the server dropped the connection */
+	int		lc_npending;
+	load_pending	lc_pending[ PENDING ];
+} load_conn;
+
+static load_stats stats[ LOAD_LAST + 1 ];
+static unsigned long nsent, nlate, noverflow;
+static unsigned long long last;		/* when the last operation completed */
+
+static void
+usage( char *name, int opt )
+{
+	if ( opt ) {
+		fprintf( stderr, "%s: unable to handle option \'%c\'\n\n",
+			name, opt );
+	}
+
+	fprintf( stderr, "usage: %s " TESTER_COMMON_HELP
+		"[-b <searchbase>] "
+		"[-c <connections>] "
+		"[-e <entry>] "
+		"[-f <filter>] "
+		"[-M <attr>=<value>] "
+		"[-m <op>=<weight>[,...]] "
+		"[-n <range>] "
+		"[-q <ops/sec>] "
+		"[-s <seconds>] "
+		"\n",
+		name );
+	fprintf( stderr, "\t<op> is search, read, bind or modify; "
+		"\"%%d\" in <filter> and <entry> is replaced\n"
+		"\tby a random number below <range>\n" );
+	exit( EXIT_FAILURE );
+}
+
+static unsigned long long
+load_now( void )
+{
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static int
+hist_index( unsigned long long v )
+{
+	int e = 0;
+
+	if ( v < HIST_LINEAR )
+		return v;
+	while ( ( v >> e ) >= 2 * HIST_SUB )
+		e++;
+	/* v >> e is in [HIST_SUB, 2 * HIST_SUB) */
+	e = HIST_LINEAR + ( e - 1 ) * HIST_SUB + ( v >> e ) - HIST_SUB;
+	return e < HIST_BUCKETS ? e : HIST_BUCKETS - 1;
+}
+
+/* Upper bound of a bucket */
+static unsigned long long
+hist_value( int i )
+{
+	int e;
+
+	if ( i < HIST_LINEAR )
+		return i;
+	e = ( i - HIST_LINEAR ) / HIST_SUB + 1;
+	return ( (unsigned long long)( HIST_SUB + ( i - HIST_LINEAR ) % HIST_SUB + 1 )
+		<< e ) - 1;
+}
+
+static void
+stats_add( int type, unsigned long long usec, int err )
+{
+	int i, idx = hist_index( usec );
+
+	last = load_now();
+	for ( i = 0; i < 2; i++ ) {
+		load_stats *ls = &stats[ i ? LOAD_LAST : type ];
+
+		ls->ls_done++;
+		if ( err )
+			ls->ls_errors++;
+		if ( usec > ls->ls_max )
+			ls->ls_max = usec;
+		ls->ls_hist[ idx ]++;
+	}
+}
+
+static unsigned long long
+stats_quantile( load_stats *ls, double q )
+{
+	unsigned long n, want;
+	int i;
+
+	want = (unsigned long)( q * ls->ls_done );
+	if ( want >= ls->ls_done )
+		want = ls->ls_done - 1;
+	for ( i = 0, n = 0; i < HIST_BUCKETS; i++ ) {
+		n += ls->ls_hist[ i ];
+		if ( n > want )
+			break;
+	}
+	if ( i == HIST_BUCKETS || hist_value( i ) > ls->ls_max )
+		return ls->ls_max;
+	return hist_value( i );
+}
+
+/* Replace the first "%d" in pattern by a random number below range */
+static char *
+load_expand( const char *pattern, int range, char *buf, size_t size )
+{
+	const char *ptr = strstr( pattern, "%d" );
+
+	if ( ptr == NULL )
+		return (char *)pattern;
+	snprintf( buf, size, "%.*s%d%s", (int)( ptr - pattern ), pattern,
+		(int)( (double)rand() / ( (double)RAND_MAX + 1 ) * range ),
+		ptr + 2 );
+	return buf;
+}
+
+static load_pending *
+pending_find( load_conn *lc, int msgid )
+{
+	load_pending *lp = &lc->lc_pending[ msgid % PENDING ];
+	int i;
+
+	for ( i = 0; i < PENDING; i++ ) {
+		if ( lp->lp_msgid == msgid )
+			return lp;
+		if ( ++lp == &lc->lc_pending[ PENDING ] )
+			lp = lc->lc_pending;
+	}
+	return NULL;
+}
+
+static void
+pending_add( load_conn *lc, int msgid, int type, unsigned long long sched )
+{
+	load_pending *lp = &lc->lc_pending[ msgid % PENDING ];
+
+	while ( lp->lp_msgid ) {
+		if ( ++lp == &lc->lc_pending[ PENDING ] )
+			lp = lc->lc_pending;
+	}
+	lp->lp_msgid = msgid;
+	lp->lp_type = type;
+	lp->lp_sched = sched;
+	lc->lc_npending++;
+}
+
+static void
+load_send( struct tester_conn_args *config, load_conn *lc, int type,
+	unsigned long long sched, char *base, char *filter, char *entry,
+	LDAPMod **mods, int range )
+{
+	char buf[ BUFSIZ ], *attrs[] = { LDAP_NO_ATTRS, NULL };
+	int rc, msgid;
+
+	/* keep free slots so the probing in pending_find() stays short */
+	if ( lc->lc_npending >= PENDING / 2 ) {
+		noverflow++;
+		return;
+	}
+
+	if ( lc->lc_dead ) {
+		nsent++;
+		stats_add( type, load_now() - sched, 1 );
+		return;
+	}
+
+	switch ( type ) {
+	case LOAD_SEARCH:
+		rc = ldap_search_ext( lc->lc_ld, base, LDAP_SCOPE_SUBTREE,
+			load_expand( filter, range, buf, sizeof( buf ) ),
+			attrs, 0, NULL, NULL, NULL, LDAP_NO_LIMIT, &msgid );
+		break;
+
+	case LOAD_READ:
+		rc = ldap_search_ext( lc->lc_ld,
+			load_expand( entry, range, buf, sizeof( buf ) ),
+			LDAP_SCOPE_BASE, NULL, NULL, 0, NULL, NULL, NULL,
+			LDAP_NO_LIMIT, &msgid );
+		break;
+
+	case LOAD_BIND:
+		rc = ldap_sasl_bind( lc->lc_ld, config->binddn, LDAP_SASL_SIMPLE,
+			&config->pass, NULL, NULL, &msgid );
+		break;
+
+	case LOAD_MODIFY:
+		rc = ldap_modify_ext( lc->lc_ld,
+			load_expand( entry, range, buf, sizeof( buf ) ),
+			mods, NULL, NULL, &msgid );
+		break;
+
+	default:
+		return;
+	}
+
+	nsent++;
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( lc->lc_ld, load_names[ type ], NULL );
+		stats_add( type, load_now() - sched, 1 );
+		return;
+	}
+	pending_add( lc, msgid, type, sched );
+}
+
+/* Collect whatever responses are available on lc */
+static void
+load_results( load_conn *lc )
+{
+	struct timeval zero = { 0, 0 };
+	LDAPMessage *res;
+	load_pending *lp;
+	int rc, err;
+
+	while ( lc->lc_npending ) {
+		res = NULL;
+		rc = ldap_result( lc->lc_ld, LDAP_RES_ANY, LDAP_MSG_ALL, &zero, &res );
+		if ( rc == 0 )
+			break;
+		if ( rc < 0 ) {
+			int i;
+
+			/* whatever was outstanding is lost */
+			tester_ldap_error( lc->lc_ld, "ldap_result", NULL );
+			for ( i = 0; i < PENDING; i++ ) {
+				lp = &lc->lc_pending[ i ];
+				if ( lp->lp_msgid ) {
+					stats_add( lp->lp_type, load_now() - lp->lp_sched, 1 );
+					lp->lp_msgid = 0;
+				}
+			}
+			lc->lc_npending = 0;
+			lc->lc_dead = 1;
+			break;
+		}
+
+		lp = pending_find( lc, ldap_msgid( res ) );
+		if ( lp != NULL ) {
+			err = LDAP_OTHER;
+			ldap_parse_result( lc->lc_ld, res, &err, NULL, NULL, NULL, NULL, 0 );
+			stats_add( lp->lp_type, load_now() - lp->lp_sched,
+				!tester_ignore_err( err ) );
+			lp->lp_msgid = 0;
+			lc->lc_npending--;
+		}
+		ldap_msgfree( res );
+	}
+}
+
+/* Wait until one of the connections is readable, or until deadline */
+static void
+load_wait( load_conn *conns, int nconns, unsigned long long deadline )
+{
+	struct timeval tv;
+	unsigned long long now = load_now();
+	fd_set rfds;
+	int i, max = -1;
+
+	if ( deadline <= now )
+		return;
+	FD_ZERO( &rfds );
+	for ( i = 0; i < nconns; i++ ) {
+		if ( !conns[ i ].lc_npending )
+			continue;
+		FD_SET( conns[ i ].lc_sd, &rfds );
+		if ( (int)conns[ i ].lc_sd > max )
+			max = conns[ i ].lc_sd;
+	}
+	tv.tv_sec = ( deadline - now ) / 1000000;
+	tv.tv_usec = ( deadline - now ) % 1000000;
+	select( max + 1, &rfds, NULL, NULL, &tv );
+}
+
+static void
+load_report( int rate, int duration, int nconns, unsigned long long elapsed )
+{
+	load_stats *ls;
+	int i;
+
+	printf( "slapd-load: rate=%d duration=%d conns=%d sent=%lu done=%lu "
+		"errors=%lu late=%lu overflow=%lu throughput=%.1f\n",
+		rate, duration, nconns, nsent, stats[ LOAD_LAST ].ls_done,
+		stats[ LOAD_LAST ].ls_errors, nlate, noverflow,
+		elapsed ? stats[ LOAD_LAST ].ls_done * 1e6 / elapsed : 0.0 );
+
+	for ( i = 0; i <= LOAD_LAST; i++ ) {
+		ls = &stats[ i ];
+		if ( !ls->ls_done )
+			continue;
+		printf( "%s: done=%lu errors=%lu p50=%llu p90=%llu p99=%llu "
+			"p99.9=%llu p99.99=%llu max=%llu\n",
+			load_names[ i ], ls->ls_done, ls->ls_errors,
+			stats_quantile( ls, 0.5 ), stats_quantile( ls, 0.9 ),
+			stats_quantile( ls, 0.99 ), stats_quantile( ls, 0.999 ),
+			stats_quantile( ls, 0.9999 ), ls->ls_max );
+	}
+}
+
+int
+main( int argc, char **argv )
+{
+	int		i, j;
+	char		*base = NULL;
+	char		*filter = "(objectClass=*)";
+	char		*entry = NULL;
+	char		*mix = "search=100";
+	char		*modval = "description=slapd-load";
+	int		nconns = CONNS, rate = RATE, duration = DURATION, range = 1;
+	int		weight[ LOAD_LAST ], total = 0;
+	char		**ops;
+	struct berval	modbv, *modbvp[ 2 ];
+	LDAPMod		mod, *mods[ 2 ] = { NULL, NULL };
+	load_conn	*conns, *lc;
+	int		nall;
+	unsigned long long	start, now, next, end;
+	unsigned long	seq;
+	struct tester_conn_args	*config;
+
+	config = tester_init( "slapd-load", TESTER_LOAD );
+
+	/* by default, tolerate referrals and no such object */
+	tester_ignore_str2errlist( "REFERRAL,NO_SUCH_OBJECT" );
+
+	while ( ( i = getopt( argc, argv, TESTER_COMMON_OPTS "b:c:e:f:M:m:n:q:s:" ) ) != EOF )
+	{
+		switch ( i ) {
+		case 'b':		/* search base */
+			base = strdup( optarg );
+			break;
+
+		case 'c':		/* number of connections */
+			if ( lutil_atoi( &nconns, optarg ) != 0 || nconns < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'e':		/* entry to read and modify */
+			entry = strdup( optarg );
+			break;
+
+		case 'f':		/* search filter */
+			filter = strdup( optarg );
+			break;
+
+		case 'M':		/* modification */
+			modval = strdup( optarg );
+			break;
+
+		case 'm':		/* operation mix */
+			mix = strdup( optarg );
+			break;
+
+		case 'n':		/* range of "%d" */
+			if ( lutil_atoi( &range, optarg ) != 0 || range < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'q':		/* target rate */
+			if ( lutil_atoi( &rate, optarg ) != 0 || rate < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 's':		/* duration */
+			if ( lutil_atoi( &duration, optarg ) != 0 || duration < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		default:
+			if ( tester_config_opt( config, i, optarg ) == LDAP_SUCCESS ) {
+				break;
+			}
+			usage( argv[0], i );
+			break;
+		}
+	}
+
+	memset( weight, 0, sizeof( weight ) );
+	ops = ldap_str2charray( mix, "," );
+	for ( i = 0; ops && ops[ i ]; i++ ) {
+		char *eq = strchr( ops[ i ], '=' );
+
+		if ( eq == NULL )
+			usage( argv[0], 'm' );
+		*eq++ = '\0';
+		for ( j = 0; j < LOAD_LAST; j++ ) {
+			if ( strcasecmp( ops[ i ], load_names[ j ] ) == 0 )
+				break;
+		}
+		if ( j == LOAD_LAST || lutil_atoi( &weight[ j ], eq ) != 0 ||
+			weight[ j ] < 0 )
+			usage( argv[0], 'm' );
+		total += weight[ j ];
+	}
+	ldap_charray_free( ops );
+	if ( total == 0 )
+		usage( argv[0], 'm' );
+
+	if ( weight[ LOAD_SEARCH ] && base == NULL )
+		base = "";
+	if ( ( weight[ LOAD_READ ] || weight[ LOAD_MODIFY ] ) && entry == NULL ) {
+		fprintf( stderr, "%s: read and modify need an entry (-e)\n",
+			argv[0] );
+		exit( EXIT_FAILURE );
+	}
+
+	if ( weight[ LOAD_MODIFY ] ) {
+		char *eq = strchr( modval, '=' );
+
+		if ( eq == NULL )
+			usage( argv[0], 'M' );
+		*eq++ = '\0';
+		modbv.bv_val = eq;
+		modbv.bv_len = strlen( eq );
+		modbvp[ 0 ] = &modbv;
+		modbvp[ 1 ] = NULL;
+		mod.mod_op = LDAP_MOD_REPLACE | LDAP_MOD_BVALUES;
+		mod.mod_type = modval;
+		mod.mod_bvalues = modbvp;
+		mods[ 0 ] = &mod;
+		mods[ 1 ] = NULL;
+	}
+
+	tester_config_finish( config );
+	if ( weight[ LOAD_BIND ] && config->authmethod != LDAP_AUTH_SIMPLE ) {
+		fprintf( stderr, "%s: bind load needs simple authentication\n",
+			argv[0] );
+		exit( EXIT_FAILURE );
+	}
+
+	/*
+	 * A Bind abandons whatever else is outstanding on its connection,
+	 * binds get their own connections with one request at a time.
+	 */
+	nall = weight[ LOAD_BIND ] ? 2 * nconns : nconns;
+	conns = calloc( nall, sizeof( load_conn ) );
+	if ( conns == NULL ) {
+		tester_error( "out of memory" );
+		exit( EXIT_FAILURE );
+	}
+	for ( i = 0; i < nall; i++ ) {
+		tester_init_ld( &conns[ i ].lc_ld, config, 0 );
+		if ( ldap_get_option( conns[ i ].lc_ld, LDAP_OPT_DESC,
+			&conns[ i ].lc_sd ) != LDAP_OPT_SUCCESS ) {
+			tester_ldap_error( conns[ i ].lc_ld, "ldap_get_option(DESC)", NULL );
+			exit( EXIT_FAILURE );
+		}
+	}
+
+	/* operation seq is due at start + seq / rate */
+	start = load_now();
+	end = start + duration * 1000000ULL;
+	for ( seq = 0; ; ) {
+		next = start + seq * 1000000ULL / rate;
+		if ( next >= end )
+			break;
+
+		now = load_now();
+		if ( now < next ) {
+			load_wait( conns, nall, next );
+		} else {
+			int pick = rand() % total, type;
+
+			for ( type = 0; pick >= weight[ type ]; type++ )
+				pick -= weight[ type ];
+			if ( now - next > LATE )
+				nlate++;
+			lc = &conns[ seq % nconns ];
+			if ( type == LOAD_BIND ) {
+				for ( i = 0; i < nconns; i++ ) {
+					lc = &conns[ nconns + ( seq + i ) % nconns ];
+					if ( !lc->lc_npending )
+						break;
+				}
+				if ( i == nconns )
+					lc = NULL;
+			}
+			if ( lc != NULL ) {
+				load_send( config, lc, type, next,
+					base, filter, entry, mods, range );
+			} else {
+				noverflow++;
+			}
+			seq++;
+		}
+		for ( i = 0; i < nall; i++ )
+			load_results( &conns[ i ] );
+	}
+
+	/* give the last operations a chance to complete */
+	end += DRAIN * 1000000ULL;
+	for ( ;; ) {
+		for ( i = 0, j = 0; i < nall; i++ ) {
+			load_results( &conns[ i ] );
+			j += conns[ i ].lc_npending;
+		}
+		now = load_now();
+		if ( !j || now >= end )
+			break;
+		load_wait( conns, nall, now + 10000 < end ? now + 10000 : end );
+	}
+
+	load_report( rate, duration, nconns, last > start ? last - start : 0 );
+	if ( j ) {
+		printf( "slapd-load: %d operations still outstanding\n", j );
+	}
+
+	for ( i = 0; i < nall; i++ ) {
+		ldap_unbind_ext( conns[ i ].lc_ld, NULL, NULL );
+	}
+	free( conns );
+
+	exit( stats[ LOAD_LAST ].ls_errors || j ? EXIT_FAILURE : EXIT_SUCCESS );
+}
@@ -0,0 +1,118 @@
+#! /bin/sh
+# $OpenLDAP$
+## This work is part of OpenLDAP Software <http://www.openldap.org/>.
+##
+## Copyright 2018 The OpenLDAP Foundation.
+## All rights reserved.
+##
+## Redistribution and use in source and binary forms, with or without
+## modification, are permitted only as authorized by the OpenLDAP
+## Public License.
+##
+## A copy of this license is available in the file LICENSE in the
+## top-level directory of the distribution or, alternatively, at
+## <http://www.OpenLDAP.org/license.html>.
+
+# Common code for the bench* scripts; source it after defines.sh.
+#
+# BENCH_ENTRIES	users in the generated directory (default 100000)
+# BENCH_RATE	operations per second offered by slapd-load (default 2000)
+# BENCH_TIME	seconds each workload runs (default 10)
+# BENCH_CONNS	connections used by slapd-load (default 8)
+# BENCH_RESULTS	file the results are appended to (default bench.results)
+# BENCH_CONSUMERS	syncrepl consumers started by bench003-repl (default 2)
+#
+# Every result line is "bench=<workload> backend=<backend> entries=<n>"
+# followed by the key=value pairs printed by slapd-load or slapd-lag.
+
+BENCH_ENTRIES=${BENCH_ENTRIES-100000}
+BENCH_RATE=${BENCH_RATE-2000}
+BENCH_TIME=${BENCH_TIME-10}
+BENCH_CONNS=${BENCH_CONNS-8}
+BENCH_RESULTS=${BENCH_RESULTS-$TESTWD/bench.results}
+BENCHLDIF=$TESTDIR/bench.ldif
+BENCHOUT=$TESTDIR/bench.out
+PEOPLEDN="ou=People,$BASEDN"
+GROUPSDN="ou=Groups,$BASEDN"
+
+# bench_setup [<config>]
+# Generate the directory, load it with slapadd and start slapd
+bench_setup() {
+	mkdir -p $TESTDIR $DBDIR1
+
+	echo "Generating $BENCH_ENTRIES entries..."
+	$LDIFGEN -b "$BASEDN" -n $BENCH_ENTRIES > $BENCHLDIF
+	RC=$?
+	if test $RC != 0 ; then
+		echo "ldif-gen failed ($RC)!"
+		exit $RC
+	fi
+
+	echo "Running slapadd to build slapd database..."
+	. $CONFFILTER $BACKEND $MONITORDB < ${1-$BENCHCONF} > $CONF1
+	START=`date +%s`
+	$SLAPADD -q -f $CONF1 -b "$BASEDN" -l $BENCHLDIF
+	RC=$?
+	if test $RC != 0 ; then
+		echo "slapadd failed ($RC)!"
+		exit $RC
+	fi
+	END=`date +%s`
+	echo "bench=slapadd backend=$BACKEND entries=$BENCH_ENTRIES" \
+		"seconds=`expr $END - $START`" | tee -a $BENCH_RESULTS
+
+	echo "Starting slapd on TCP/IP port $PORT1..."
+	$SLAPD -f $CONF1 -h $URI1 -d $LVL $TIMING > $LOG1 2>&1 &
+	PID=$!
+	if test $WAIT != 0 ; then
+		echo PID $PID
+		read foo
+	fi
+	KILLPIDS="$PID"
+
+	sleep 1
+	for i in 0 1 2 3 4 5; do
+		$LDAPSEARCH -s base -b "$BASEDN" -H $URI1 \
+			'(objectclass=*)' > /dev/null 2>&1
+		RC=$?
+		if test $RC = 0 ; then
+			break
+		fi
+		echo "Waiting 5 seconds for slapd to start..."
+		sleep 5
+	done
+	if test $RC != 0 ; then
+		echo "ldapsearch failed ($RC)!"
+		test $KILLSERVERS != no && kill -HUP $KILLPIDS
+		exit $RC
+	fi
+}
+
+# bench_run <workload> <slapd-load options>
+bench_run() {
+	BENCH=$1
+	shift
+
+	echo "Running $BENCH at $BENCH_RATE ops/sec for $BENCH_TIME seconds..."
+	$SLAPDLOAD -H $URI1 -D "$MANAGERDN" -w $PASSWD \
+		-c $BENCH_CONNS -q $BENCH_RATE -s $BENCH_TIME "$@" > $BENCHOUT
+	RC=$?
+	bench_result $BENCH < $BENCHOUT
+	if test $RC != 0 ; then
+		echo "slapd-load failed ($RC)!"
+		test $KILLSERVERS != no && kill -HUP $KILLPIDS
+		exit $RC
+	fi
+}
+
+# bench_result <workload> < <output of slapd-load or slapd-lag>
+bench_result() {
+	sed -e "s/^slapd-l[a-z]*: //" \
+		-e "s/^\([a-z]*\): /op=\1 /" \
+		-e "s/^/bench=$1 backend=$BACKEND entries=$BENCH_ENTRIES /" |
+		tee -a $BENCH_RESULTS
+}
+
+bench_stop() {
+	test $KILLSERVERS != no && kill -HUP $KILLPIDS
+}
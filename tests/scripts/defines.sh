@@ -86,6 +86,10 @@ CLIENTDIR=../clients/tools
 CONF=$DATADIR/slapd.conf
 CONFTWO=$DATADIR/slapd2.conf
 CONF2DB=$DATADIR/slapd-2db.conf
+MDBENTRYCACHECONF=$DATADIR/slapd-mdb-entrycache.conf
+MDBIDLBITMAPCONF=$DATADIR/slapd-mdb-idlbitmap.conf
+MDBPAGEDCURSORSCONF=$DATADIR/slapd-mdb-pagedcursors.conf
+MDBRANGEPAIRCONF=$DATADIR/slapd-mdb-rangepair.conf
 MCONF=$DATADIR/slapd-master.conf
 COMPCONF=$DATADIR/slapd-component.conf
 PWCONF=$DATADIR/slapd-pw.conf
@@ -102,6 +106,7 @@ CACHEMASTERCONF=$DATADIR/slapd-cache-master.conf
 PROXYAUTHZMASTERCONF=$DATADIR/slapd-cache-master-proxyauthz.conf
 R1SRSLAVECONF=$DATADIR/slapd-syncrepl-slave-refresh1.conf
 R2SRSLAVECONF=$DATADIR/slapd-syncrepl-slave-refresh2.conf
+R3SRSLAVECONF=$DATADIR/slapd-syncrepl-slave-refresh-checkpoint.conf
 P1SRSLAVECONF=$DATADIR/slapd-syncrepl-slave-persist1.conf
 P2SRSLAVECONF=$DATADIR/slapd-syncrepl-slave-persist2.conf
 P3SRSLAVECONF=$DATADIR/slapd-syncrepl-slave-persist3.conf
@@ -126,6 +131,9 @@ CHAINCONF2=$DATADIR/slapd-chain2.conf
 GLUESYNCCONF1=$DATADIR/slapd-glue-syncrepl1.conf
 GLUESYNCCONF2=$DATADIR/slapd-glue-syncrepl2.conf
 SQLCONF=$DATADIR/slapd-sql.conf
+BENCHCONF=$DATADIR/slapd-bench.conf
+BENCHPROVIDERCONF=$DATADIR/slapd-bench-provider.conf
+BENCHCONSUMERCONF=$DATADIR/slapd-bench-consumer.conf
 SQLSRMASTERCONF=$DATADIR/slapd-sql-syncrepl-master.conf
 TRANSLUCENTLOCALCONF=$DATADIR/slapd-translucent-local.conf
 TRANSLUCENTREMOTECONF=$DATADIR/slapd-translucent-remote.conf
@@ -206,6 +214,10 @@ LDAPEXOP="$CLIENTDIR/ldapexop $TOOLARGS"
 SLAPDTESTER=$PROGDIR/slapd-tester
 LDIFFILTER=$PROGDIR/ldif-filter
 SLAPDMTREAD=$PROGDIR/slapd-mtread
+SLAPDLOAD=$PROGDIR/slapd-load
+SLAPDLAG=$PROGDIR/slapd-lag
+SLAPDADDEL=$PROGDIR/slapd-addel
+LDIFGEN=$PROGDIR/ldif-gen
 LVL=${SLAPD_DEBUG-0x4105}
 LOCALHOST=localhost
 LOCALIP=127.0.0.1